@@ -0,0 +1,114 @@
+import numpy as np
+import h5py
+import argparse
+import struct
+
+description="""
+    Convert a HDF5 phantom to the memory-mappable binary phantom format
+    read by bcsim::MappedPhantom. Fixed scatterers ("data") and spline
+    scatterers ("control_points", "amplitudes", "spline_degree" and
+    "knot_vector") are converted if present.
+"""
+
+# Layout of bcsim::BinaryPhantomHeader. All values are little-endian.
+MAGIC           = b"BCSIMPHT"
+VERSION         = 1
+BYTE_ORDER      = 0x01020304
+HEADER_FORMAT   = "<8sIIQQQQiI9Q"
+HEADER_SIZE     = struct.calcsize(HEADER_FORMAT)
+ALIGNMENT       = 64
+SECTIONS        = ["fixed_xs", "fixed_ys", "fixed_zs", "fixed_amplitudes",
+                   "spline_xs", "spline_ys", "spline_zs", "spline_amplitudes",
+                   "knots"]
+
+def _aligned(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+def write_binary_phantom(filename, fixed_data=None, control_points=None, amplitudes=None,
+                         spline_degree=0, knot_vector=None):
+    """
+    fixed_data is a [N, 4] array of x, y, z and amplitude. control_points
+    is a [num_splines, num_cs, 3] array of spline control points.
+    """
+    sections = {}
+    num_fixed = 0
+    if fixed_data is not None:
+        fixed_data = np.asarray(fixed_data, dtype="<f4")
+        num_fixed = fixed_data.shape[0]
+        for i, name in enumerate(SECTIONS[:4]):
+            sections[name] = fixed_data[:, i]
+    num_splines, num_cs, num_knots = 0, 0, 0
+    if control_points is not None:
+        control_points = np.asarray(control_points, dtype="<f4")
+        num_splines, num_cs, num_comp = control_points.shape
+        if num_comp != 3:
+            raise RuntimeError("control points must have three components")
+        knot_vector = np.asarray(knot_vector, dtype="<f4")
+        num_knots = knot_vector.size
+        if num_knots != num_cs + spline_degree + 1:
+            raise RuntimeError("knot vector does not match control points and degree")
+        # [control point][scatterer], as in bcsim::SplineScatterers
+        for i, name in enumerate(SECTIONS[4:7]):
+            sections[name] = control_points[:, :, i].transpose()
+        sections["spline_amplitudes"] = np.asarray(amplitudes, dtype="<f4")
+        sections["knots"] = knot_vector
+
+    offsets = []
+    offset = HEADER_SIZE
+    for name in SECTIONS:
+        if name in sections and sections[name].size > 0:
+            offsets.append(offset)
+            offset = _aligned(offset + 4*sections[name].size)
+        else:
+            offsets.append(0)
+
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, BYTE_ORDER, num_fixed, num_splines,
+                         num_cs, num_knots, spline_degree, len(SECTIONS), *offsets)
+    with open(filename, "wb") as f:
+        f.write(header)
+        for name, offset in zip(SECTIONS, offsets):
+            if offset == 0: continue
+            f.write(b"\0"*(offset - f.tell()))
+            f.write(np.ascontiguousarray(sections[name]).tobytes())
+
+def read_binary_phantom(filename):
+    """
+    Returns a dict of read-only memory mapped sections and the header
+    values. The arrays can be given directly to the pyrfsim
+    add_fixed_scatterers_soa() method without being copied.
+    """
+    with open(filename, "rb") as f:
+        values = struct.unpack(HEADER_FORMAT, f.read(HEADER_SIZE))
+    magic, version, byte_order, num_fixed, num_splines, num_cs, num_knots, degree, num_sections = values[:9]
+    if magic != MAGIC or byte_order != BYTE_ORDER:
+        raise RuntimeError("not a binary phantom file")
+    if version != VERSION or num_sections != len(SECTIONS):
+        raise RuntimeError("unsupported binary phantom version")
+    lengths = [num_fixed]*4 + [num_splines*num_cs]*3 + [num_splines, num_knots]
+    res = {"spline_degree": degree, "num_control_points": num_cs}
+    for name, offset, length in zip(SECTIONS, values[9:], lengths):
+        if offset != 0 and length > 0:
+            res[name] = np.memmap(filename, dtype="<f4", mode="r", offset=offset, shape=(length,))
+    return res
+
+def convert(args):
+    with h5py.File(args.h5_file, "r") as f:
+        fixed_data = f["data"][()] if "data" in f else None
+        control_points, amplitudes, degree, knots = None, None, 0, None
+        if "control_points" in f:
+            control_points = f["control_points"][()]
+            amplitudes     = f["amplitudes"][()]
+            degree         = int(f["spline_degree"][()])
+            knots          = f["knot_vector"][()]
+    if fixed_data is None and control_points is None:
+        raise RuntimeError("no scatterers in %s" % args.h5_file)
+    write_binary_phantom(args.out_file, fixed_data, control_points, amplitudes, degree, knots)
+    print("Binary phantom written to %s" % args.out_file)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument("h5_file", help="HDF5 phantom to convert")
+    parser.add_argument("out_file", help="Binary phantom file to create")
+    args = parser.parse_args()
+
+    convert(args)
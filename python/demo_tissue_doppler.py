@@ -17,7 +17,7 @@ description="""
     The Doppler power is used for thresholding.
 """
 
-def simulate_doppler_frame(args, timestamp, sim, origin):
+def set_doppler_scan_sequence(args, timestamp, sim, origin):
     """
     Create scan sequence for one frame where all RF-lines have the same
     timestamp.
@@ -36,9 +36,6 @@ def simulate_doppler_frame(args, timestamp, sim, origin):
         directions[beam_no, :]   = direction
         lateral_dirs[beam_no, :] = np.cross(direction, y_axis)
     sim.set_scan_sequence(origins, directions, args.line_length, lateral_dirs, timestamps)
-
-    iq_lines = sim.simulate_lines()
-    return iq_lines
     
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
@@ -91,11 +88,9 @@ if __name__ == "__main__":
     # set spline scatterers
     sim.add_spline_scatterers(spline_degree, knot_vector, control_points, amplitudes)
     
-    # simulate one packet
-    iq_frames = []
-    for i in range(args.packet_size):
-        frame = simulate_doppler_frame(args, args.sim_time+i*prt, sim, origin)
-        iq_frames.append(frame)
+    # simulate one packet: the same scan sequence, one PRT apart
+    set_doppler_scan_sequence(args, args.sim_time, sim, origin)
+    iq_frames = sim.simulate_frames(args.packet_size, prt)
         
     # compute autocorrelation frame at lag 0 (for power)
     power_frame = np.zeros(iq_frames[0].shape, dtype="float32")
@@ -0,0 +1,109 @@
+import mmap
+import os
+import struct
+import time
+import numpy as np
+
+description = """
+    Consumer of the shared memory IQ rings written by bcsim::SharedIqRingWriter
+    (RfSimulator.simulate_to_shared_ring in Python). Frames are NumPy views of
+    the shared memory, so reading them does not copy the samples. The layout
+    is documented in src/utils/SharedIqRing.hpp.
+
+    A frame may be overwritten by the writer while it is read if the ring
+    overwrites the oldest frames, so check is_valid(frame_no) after reading
+    (or copying) the samples of a frame.
+
+    The indices are read with aligned 8-byte loads, which are atomic and
+    ordered on x86-64.
+
+    Example:
+        ring = SharedIqRingReader("/bcsim_iq")
+        frame_no = 0
+        while ring.wait_for_frame(frame_no, timeout=1.0):
+            iq, timestamp, scale = ring.map_frame(frame_no)
+            process(iq)
+            if not ring.is_valid(frame_no):
+                print("frame %d was overwritten" % frame_no)
+            ring.release_frames(frame_no + 1)
+            frame_no += 1
+"""
+
+MAGIC = 0x51495342
+VERSION = 1
+SLOT_HEADER_BYTES = 64
+
+# IqOutputFormat::SampleType: NumPy type and values per sample
+SAMPLE_TYPES = {0: (np.complex64, 1), 1: (np.float16, 2), 2: (np.int16, 2)}
+
+
+class SharedIqRingReader(object):
+    def __init__(self, name):
+        path = os.path.join("/dev/shm", name.lstrip("/"))
+        fd = os.open(path, os.O_RDWR)
+        try:
+            self._mm = mmap.mmap(fd, 0, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        magic, version, sample_type = struct.unpack_from("<III", self._mm, 0)
+        if magic != MAGIC or version != VERSION:
+            raise RuntimeError("%s is not an IQ ring of version %d" % (name, VERSION))
+        (self.num_lines, self.num_samples, self.capacity, self._slot_bytes,
+         self._data_offset, overwrite_oldest) = struct.unpack_from("<6Q", self._mm, 16)
+        self.overwrite_oldest = overwrite_oldest != 0
+        self.sample_type = sample_type
+        self._dtype, self._values_per_sample = SAMPLE_TYPES[sample_type]
+        words = np.frombuffer(self._mm, dtype=np.uint64, count=self._data_offset//8)
+        self._closed = np.frombuffer(self._mm, dtype=np.uint32, count=4)[3:4]
+        self._write_index = words[8:9]
+        self._read_index = words[16:17]
+
+    def _slot_offset(self, frame_no):
+        return self._data_offset + (frame_no % self.capacity)*self._slot_bytes
+
+    def _sequence(self, frame_no):
+        return int(np.frombuffer(self._mm, dtype=np.uint64, count=1, offset=self._slot_offset(frame_no))[0])
+
+    def get_end_frame_no(self):
+        """ Number of frames written so far. """
+        return int(self._write_index[0])
+
+    def is_closed(self):
+        return int(self._closed[0]) != 0
+
+    def wait_for_frame(self, frame_no, timeout):
+        """ Wait up to timeout seconds until frame_no is written. Returns
+        False on timeout or if the writer closed first. """
+        deadline = time.time() + timeout
+        while self.get_end_frame_no() <= frame_no:
+            if self.is_closed() or time.time() > deadline:
+                return self.get_end_frame_no() > frame_no
+            time.sleep(1e-4)
+        return True
+
+    def map_frame(self, frame_no):
+        """ Returns ([sample][line] view of the frame, timestamp, scale), where
+        float16 and int16 frames are [sample][line][2], or None if frame_no has
+        not been written yet or has been overwritten. """
+        if self._sequence(frame_no) != 2*frame_no + 2:
+            return None
+        offset = self._slot_offset(frame_no)
+        timestamp, scale = struct.unpack_from("<ff", self._mm, offset + 8)
+        shape = (self.num_lines, self.num_samples) + ((2,) if self._values_per_sample == 2 else ())
+        count = self.num_lines*self.num_samples*self._values_per_sample
+        lines = np.frombuffer(self._mm, dtype=self._dtype, count=count,
+                              offset=offset + SLOT_HEADER_BYTES).reshape(shape)
+        if not self.is_valid(frame_no):
+            return None
+        return np.swapaxes(lines, 0, 1), timestamp, scale
+
+    def is_valid(self, frame_no):
+        """ True if frame_no has not been overwritten since it was mapped. """
+        return self._sequence(frame_no) == 2*frame_no + 2
+
+    def release_frames(self, end_frame_no):
+        """ Let a writer which does not overwrite frames reuse the slots of the
+        frames before end_frame_no. There must be only one consumer. """
+        end_frame_no = min(end_frame_no, self.get_end_frame_no())
+        if end_frame_no > int(self._read_index[0]):
+            self._read_index[0] = end_frame_no
@@ -0,0 +1,723 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  End-to-end benchmark of the simulator algorithms.
+ *
+ *  Builds a synthetic phantom of uniformly distributed fixed or spline
+ *  scatterers and a sector scan, then simulates a number of warm-up frames
+ *  followed by timed frames with each requested algorithm. The results are
+ *  written as JSON, e.g. for comparing builds and hardware. The last frame
+ *  of each algorithm is compared with that of the first one, so that e.g.
+ *  "--algorithm cpu hip" also validates a GPU build against the CPU.
+ *
+ *  With --scaling, the CPU algorithm is instead run for a sweep of thread
+ *  counts and dataset sizes, reporting strong- and weak-scaling efficiency
+ *  and the bandwidth of the scatterer traffic compared to the measured
+ *  memory bandwidth, followed by a roofline-style summary on stderr.
+ *
+ *  With --calibrate <file>, the throughputs of the cost model used by the
+ *  "auto" simulator type are measured on this machine and written to the
+ *  file instead.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include <boost/program_options.hpp>
+#include "../core/LibBCSim.hpp"
+#include "../core/bspline.hpp"
+#include "../core/algorithm/BackendSelection.hpp"
+#include "../core/algorithm/common_utils.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/GaussPulse.hpp"
+
+namespace {
+
+struct BenchmarkConfig {
+    std::vector<std::string>    algorithms;
+    size_t                      num_scatterers;
+    size_t                      num_lines;
+    float                       line_length;        // [m]
+    std::string                 scatterer_type;     // "fixed" or "spline"
+    int                         spline_degree;
+    int                         num_cs;
+    std::string                 beam_profile;       // "analytical" or "lut"
+    int                         num_warmup_frames;
+    int                         num_frames;
+    std::vector<std::string>    parameters;         // key=value pairs for set_parameter()
+
+    // thread-scaling mode
+    bool                        scaling;
+    std::vector<int>            scaling_threads;
+    std::vector<size_t>         scaling_scatterers;
+    size_t                      weak_scatterers_per_thread;
+};
+
+// Per-frame timings reported by get_debug_data() when storing kernel
+// details. Values of several threads or streams are summed.
+const std::vector<std::string> STAGE_KEYS = {
+    "cpu_spline_cache_ms",
+    "cpu_culling_ms",
+    "cpu_lines_ms",
+    "cpu_fixed_projection_ms",
+    "cpu_spline_projection_ms",
+    "cpu_noise_ms",
+    "cpu_convolution_ms",
+    "cpu_demodulation_ms",
+    "cpu_thread_imbalance",
+    "kernel_memset_ms",
+    "fixed_projection_kernel_ms",
+    "spline_projection_kernel_ms",
+    "kernel_forward_fft_ms",
+    "kernel_multiply_fft_ms",
+    "kernel_inverse_fft_ms",
+    "kernel_demodulate_ms",
+    "kernel_memcpy_ms"
+};
+
+struct BenchmarkResult {
+    std::string                             algorithm;
+    double                                  setup_ms;
+    std::vector<double>                     frame_ms;
+    std::map<std::string, std::vector<double>> stage_ms;
+    std::vector<std::complex<float>>        last_frame;
+};
+
+// RMS of the difference to the reference frame relative to the RMS of the
+// reference frame.
+double relative_rms_error(const std::vector<std::complex<float>>& frame, const std::vector<std::complex<float>>& reference) {
+    if (frame.size() != reference.size()) {
+        throw std::runtime_error("frames of different sizes");
+    }
+    double error_sum = 0.0;
+    double reference_sum = 0.0;
+    for (size_t i = 0; i < frame.size(); i++) {
+        error_sum += std::norm(std::complex<double>(frame[i]) - std::complex<double>(reference[i]));
+        reference_sum += std::norm(std::complex<double>(reference[i]));
+    }
+    return (reference_sum > 0.0) ? std::sqrt(error_sum/reference_sum) : std::sqrt(error_sum);
+}
+
+// Value at fraction q of the sorted values, with linear interpolation.
+double percentile(std::vector<double> values, double q) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const auto pos = q*(values.size()-1);
+    const auto i = static_cast<size_t>(pos);
+    if (i+1 >= values.size()) {
+        return values.back();
+    }
+    return values[i] + (pos-i)*(values[i+1]-values[i]);
+}
+
+double millisec_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gaussian beam profile sampled in a lookup table.
+bcsim::IBeamProfile::s_ptr make_lut_profile(float line_length, float sigma_lateral, float sigma_elevational) {
+    const int num_rad = 16;
+    const int num_lat = 64;
+    const int num_ele = 32;
+    const bcsim::Interval range_range(0.0f, line_length);
+    const bcsim::Interval lateral_range(-4.0f*sigma_lateral, 4.0f*sigma_lateral);
+    const bcsim::Interval elevational_range(-4.0f*sigma_elevational, 4.0f*sigma_elevational);
+    bcsim::GaussianBeamProfile gaussian(sigma_lateral, sigma_elevational);
+    std::vector<float> samples;
+    samples.reserve(num_rad*num_lat*num_ele);
+    for (int i = 0; i < num_rad; i++) {
+        for (int j = 0; j < num_lat; j++) {
+            for (int k = 0; k < num_ele; k++) {
+                const auto r = range_range.first + i*(range_range.last-range_range.first)/(num_rad-1);
+                const auto l = lateral_range.first + j*(lateral_range.last-lateral_range.first)/(num_lat-1);
+                const auto e = elevational_range.first + k*(elevational_range.last-elevational_range.first)/(num_ele-1);
+                samples.push_back(gaussian.sample(r, l, e));
+            }
+        }
+    }
+    return std::make_shared<bcsim::LUTBeamProfile>(num_rad, num_lat, num_ele, range_range, lateral_range,
+                                                   elevational_range, std::move(samples));
+}
+
+// Configure everything but the scatterers.
+void configure(bcsim::IAlgorithm& sim, const BenchmarkConfig& config, float timestamp) {
+    sim.set_parameter("verbose", "0");
+    sim.set_parameter("sound_speed", "1540.0");
+    for (const auto& key_value : config.parameters) {
+        const auto pos = key_value.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("parameters must be given as key=value: " + key_value);
+        }
+        sim.set_parameter(key_value.substr(0, pos), key_value.substr(pos+1));
+    }
+    // not supported by all algorithms
+    try {
+        sim.set_parameter("store_kernel_details", "on");
+    } catch (const std::runtime_error&) {
+    }
+
+    const auto center_freq = 2.5e6f;
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    std::vector<float> dummy_times;
+    bcsim::MakeGaussianExcitation(center_freq, 0.2f, ex.sampling_frequency, dummy_times, ex.samples, ex.center_index);
+    ex.demod_freq = center_freq;
+    sim.set_excitation(ex);
+
+    const float sigma_lateral = 1e-3f;
+    const float sigma_elevational = 3e-3f;
+    if (config.beam_profile == "analytical") {
+        sim.set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(sigma_lateral, sigma_elevational));
+    } else if (config.beam_profile == "lut") {
+        sim.set_lookup_profile(make_lut_profile(config.line_length, sigma_lateral, sigma_elevational));
+    } else {
+        throw std::runtime_error("invalid beam profile: " + config.beam_profile);
+    }
+
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = 1.2f;
+    geometry->depth = config.line_length;
+    geometry->tilt  = 0.0f;
+    const auto scan_seq = bcsim::CreateScanSequence(geometry, config.num_lines, timestamp);
+    sim.set_scan_sequence(std::make_shared<bcsim::ScanSequence>(scan_seq));
+}
+
+// Uniformly random scatterers in the box covered by the sector scan. The
+// spline scatterers move randomly by up to 1 mm between control points.
+void add_scatterers(bcsim::IAlgorithm& sim, const BenchmarkConfig& config) {
+    std::mt19937 gen(0);
+    const auto half_width = config.line_length*std::sin(0.6f);
+    std::uniform_real_distribution<float> x_dist(-half_width, half_width);
+    std::uniform_real_distribution<float> y_dist(-0.01f, 0.01f);
+    std::uniform_real_distribution<float> z_dist(0.0f, config.line_length);
+    std::uniform_real_distribution<float> a_dist(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> motion_dist(-1e-3f, 1e-3f);
+
+    if (config.scatterer_type == "fixed") {
+        auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+        scatterers->scatterers.resize(config.num_scatterers);
+        for (auto& scatterer : scatterers->scatterers) {
+            scatterer.pos = bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen));
+            scatterer.amplitude = a_dist(gen);
+        }
+        sim.add_fixed_scatterers(scatterers);
+    } else if (config.scatterer_type == "spline") {
+        auto scatterers = std::make_shared<bcsim::SplineScatterers>();
+        scatterers->spline_degree = config.spline_degree;
+        scatterers->knot_vector = bspline_storve::uniform_regular_knot_vector(config.num_cs, config.spline_degree, 0.0f, 1.0f);
+        scatterers->resize(config.num_scatterers, config.num_cs);
+        for (size_t i = 0; i < config.num_scatterers; i++) {
+            bcsim::vector3 pos(x_dist(gen), y_dist(gen), z_dist(gen));
+            for (int cs_no = 0; cs_no < config.num_cs; cs_no++) {
+                scatterers->set_control_point(i, cs_no, pos);
+                pos += bcsim::vector3(motion_dist(gen), motion_dist(gen), motion_dist(gen));
+            }
+            scatterers->amplitudes[i] = a_dist(gen);
+        }
+        sim.add_spline_scatterers(scatterers);
+    } else {
+        throw std::runtime_error("invalid scatterer type: " + config.scatterer_type);
+    }
+}
+
+BenchmarkResult run_benchmark(const std::string& algorithm, const BenchmarkConfig& config) {
+    BenchmarkResult res;
+    res.algorithm = algorithm;
+
+    auto sim = bcsim::Create(algorithm);
+    const auto setup_start = std::chrono::steady_clock::now();
+    configure(*sim, config, 0.5f);
+    add_scatterers(*sim, config);
+    res.setup_ms = millisec_since(setup_start);
+
+    size_t num_lines, num_samples;
+    sim->get_output_dimensions(num_lines, num_samples);
+    std::vector<std::complex<float>> iq_buffer(num_lines*num_samples);
+    for (int frame_no = 0; frame_no < config.num_warmup_frames + config.num_frames; frame_no++) {
+        const auto start = std::chrono::steady_clock::now();
+        sim->simulate_lines(iq_buffer.data(), num_samples);
+        const auto elapsed_ms = millisec_since(start);
+        if (frame_no < config.num_warmup_frames) {
+            continue;
+        }
+        res.frame_ms.push_back(elapsed_ms);
+        for (const auto& key : STAGE_KEYS) {
+            try {
+                const auto values = sim->get_debug_data(key);
+                double sum = 0.0;
+                for (const auto v : values) sum += v;
+                res.stage_ms[key].push_back(sum);
+            } catch (const std::runtime_error&) {
+            }
+        }
+    }
+    res.last_frame = iq_buffer;
+    return res;
+}
+
+// Bytes of a fixed scatterer in the structure-of-arrays layout of the CPU
+// algorithm (x, y, z and amplitude). Without culling every line streams the
+// whole dataset.
+const size_t FIXED_SCATTERER_BYTES = 4*sizeof(float);
+
+int max_num_threads() {
+#ifdef BCSIM_ENABLE_OPENMP
+    return omp_get_num_procs();
+#else
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+#endif
+}
+
+// Memory bandwidth [GB/s] of a STREAM-like triad a = b + s*c with the given
+// number of threads, on arrays much larger than the last-level cache. Best
+// of a few repetitions, counting two reads and one write per element.
+double measure_triad_bandwidth(int num_threads) {
+    const size_t num_elements = 16*1024*1024;
+    std::vector<float> a(num_elements, 0.0f), b(num_elements, 1.0f), c(num_elements, 2.0f);
+    const auto n = static_cast<long long>(num_elements);
+    double best_ms = 0.0;
+    for (int rep = 0; rep < 5; rep++) {
+        const auto start = std::chrono::steady_clock::now();
+        #pragma omp parallel for num_threads(num_threads)
+        for (long long i = 0; i < n; i++) {
+            a[i] = b[i] + 3.0f*c[i];
+        }
+        const auto elapsed_ms = millisec_since(start);
+        if ((rep == 0) || (elapsed_ms < best_ms)) {
+            best_ms = elapsed_ms;
+        }
+    }
+    if (a[n/2] != 7.0f) {
+        throw std::runtime_error("unexpected triad result");
+    }
+    return 3.0*sizeof(float)*num_elements/(best_ms*1e6);
+}
+
+// Smallest cache level which holds the given number of bytes, if the cache
+// sizes are known.
+std::string cache_level(size_t num_bytes) {
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    const auto l2_bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    const auto l3_bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if ((l2_bytes > 0) && (num_bytes <= static_cast<size_t>(l2_bytes))) return "L2";
+    if ((l3_bytes > 0) && (num_bytes <= static_cast<size_t>(l3_bytes))) return "L3";
+    if (l3_bytes > 0) return "DRAM";
+#endif
+    return "unknown";
+}
+
+struct ScalingPoint {
+    int     num_threads;
+    size_t  num_scatterers;
+    double  median_frame_ms;
+    double  scatterer_gbps;     // scatterer bytes streamed per second
+};
+
+struct ScalingResult {
+    std::string                         algorithm;
+    std::map<int, double>               triad_gbps;             // per number of threads
+    std::vector<std::vector<ScalingPoint>> strong;              // per dataset size
+    std::vector<ScalingPoint>           weak;
+};
+
+ScalingPoint run_scaling_point(const std::string& algorithm, const BenchmarkConfig& config,
+                               int num_threads, size_t num_scatterers) {
+    auto point_config = config;
+    point_config.num_scatterers = num_scatterers;
+    point_config.parameters.insert(point_config.parameters.begin(), "scatterer_culling=off");
+    point_config.parameters.push_back("num_cpu_cores=" + std::to_string(num_threads));
+
+    ScalingPoint point;
+    point.num_threads = num_threads;
+    point.num_scatterers = num_scatterers;
+    point.median_frame_ms = percentile(run_benchmark(algorithm, point_config).frame_ms, 0.5);
+    const auto bytes_per_frame = static_cast<double>(FIXED_SCATTERER_BYTES)*num_scatterers*config.num_lines;
+    point.scatterer_gbps = bytes_per_frame/(point.median_frame_ms*1e6);
+    return point;
+}
+
+ScalingResult run_scaling(const std::string& algorithm, const BenchmarkConfig& config) {
+    ScalingResult res;
+    res.algorithm = algorithm;
+    for (const auto num_threads : config.scaling_threads) {
+        res.triad_gbps[num_threads] = measure_triad_bandwidth(num_threads);
+    }
+    for (const auto num_scatterers : config.scaling_scatterers) {
+        std::vector<ScalingPoint> points;
+        for (const auto num_threads : config.scaling_threads) {
+            std::cerr << algorithm << ": " << num_scatterers << " scatterers, " << num_threads << " thread(s)" << std::endl;
+            points.push_back(run_scaling_point(algorithm, config, num_threads, num_scatterers));
+        }
+        res.strong.push_back(points);
+    }
+    for (const auto num_threads : config.scaling_threads) {
+        const auto num_scatterers = config.weak_scatterers_per_thread*num_threads;
+        std::cerr << algorithm << ": weak scaling, " << num_scatterers << " scatterers, " << num_threads << " thread(s)" << std::endl;
+        res.weak.push_back(run_scaling_point(algorithm, config, num_threads, num_scatterers));
+    }
+    return res;
+}
+
+// Strong scaling: t(1)/(n*t(n)) for a fixed dataset. Weak scaling: t(1)/t(n)
+// with n times as many scatterers. Relative to the first thread count of the
+// sweep, which normally is one.
+double strong_efficiency(const std::vector<ScalingPoint>& points, const ScalingPoint& point) {
+    const auto& base = points.front();
+    return (base.median_frame_ms*base.num_threads)/(point.median_frame_ms*point.num_threads);
+}
+
+double weak_efficiency(const std::vector<ScalingPoint>& points, const ScalingPoint& point) {
+    return points.front().median_frame_ms/point.median_frame_ms;
+}
+
+std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (const auto c : s) {
+        if ((c == '"') || (c == '\\')) res += '\\';
+        res += c;
+    }
+    return res + "\"";
+}
+
+void write_json(std::ostream& out, const BenchmarkConfig& config, const std::vector<BenchmarkResult>& results) {
+    out << "{\n";
+    out << "  \"config\": {\n";
+    out << "    \"num_scatterers\": " << config.num_scatterers << ",\n";
+    out << "    \"num_lines\": " << config.num_lines << ",\n";
+    out << "    \"line_length\": " << config.line_length << ",\n";
+    out << "    \"scatterer_type\": " << json_string(config.scatterer_type) << ",\n";
+    out << "    \"spline_degree\": " << config.spline_degree << ",\n";
+    out << "    \"num_cs\": " << config.num_cs << ",\n";
+    out << "    \"beam_profile\": " << json_string(config.beam_profile) << ",\n";
+    out << "    \"num_warmup_frames\": " << config.num_warmup_frames << ",\n";
+    out << "    \"num_frames\": " << config.num_frames << "\n";
+    out << "  },\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& res = results[i];
+        const auto median_ms = percentile(res.frame_ms, 0.5);
+        const auto scatterer_lines = static_cast<double>(config.num_scatterers)*config.num_lines;
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\n";
+        out << "      \"algorithm\": " << json_string(res.algorithm) << ",\n";
+        out << "      \"setup_ms\": " << res.setup_ms << ",\n";
+        out << "      \"median_frame_ms\": " << median_ms << ",\n";
+        out << "      \"p95_frame_ms\": " << percentile(res.frame_ms, 0.95) << ",\n";
+        out << "      \"min_frame_ms\": " << percentile(res.frame_ms, 0.0) << ",\n";
+        out << "      \"scatterer_lines_per_sec\": " << (median_ms > 0.0 ? 1e3*scatterer_lines/median_ms : 0.0) << ",\n";
+        if (i > 0) {
+            out << "      \"reference_algorithm\": " << json_string(results[0].algorithm) << ",\n";
+            out << "      \"relative_rms_error\": " << relative_rms_error(res.last_frame, results[0].last_frame) << ",\n";
+        }
+        out << "      \"stages_median_ms\": {";
+        bool first = true;
+        for (const auto& stage : res.stage_ms) {
+            out << (first ? "\n" : ",\n") << "        " << json_string(stage.first) << ": " << percentile(stage.second, 0.5);
+            first = false;
+        }
+        out << (first ? "}\n" : "\n      }\n");
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void write_scaling_json(std::ostream& out, const BenchmarkConfig& config, const std::vector<ScalingResult>& results) {
+    out << "{\n";
+    out << "  \"config\": {\n";
+    out << "    \"num_lines\": " << config.num_lines << ",\n";
+    out << "    \"line_length\": " << config.line_length << ",\n";
+    out << "    \"beam_profile\": " << json_string(config.beam_profile) << ",\n";
+    out << "    \"scatterer_bytes\": " << FIXED_SCATTERER_BYTES << ",\n";
+    out << "    \"weak_scatterers_per_thread\": " << config.weak_scatterers_per_thread << ",\n";
+    out << "    \"num_warmup_frames\": " << config.num_warmup_frames << ",\n";
+    out << "    \"num_frames\": " << config.num_frames << "\n";
+    out << "  },\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& res = results[i];
+        const auto write_point = [&](const ScalingPoint& point, double efficiency) {
+            out << "{\"num_threads\": " << point.num_threads
+                << ", \"num_scatterers\": " << point.num_scatterers
+                << ", \"median_frame_ms\": " << point.median_frame_ms
+                << ", \"efficiency\": " << efficiency
+                << ", \"scatterer_gbps\": " << point.scatterer_gbps
+                << ", \"bandwidth_fraction\": " << point.scatterer_gbps/res.triad_gbps.at(point.num_threads) << "}";
+        };
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\n";
+        out << "      \"algorithm\": " << json_string(res.algorithm) << ",\n";
+        out << "      \"triad_gbps\": {";
+        bool first = true;
+        for (const auto& triad : res.triad_gbps) {
+            out << (first ? "" : ", ") << "\"" << triad.first << "\": " << triad.second;
+            first = false;
+        }
+        out << "},\n";
+        out << "      \"strong\": [";
+        for (size_t j = 0; j < res.strong.size(); j++) {
+            const auto& points = res.strong[j];
+            const auto dataset_bytes = FIXED_SCATTERER_BYTES*points.front().num_scatterers;
+            out << (j > 0 ? ",\n" : "\n");
+            out << "        {\"num_scatterers\": " << points.front().num_scatterers
+                << ", \"dataset_bytes\": " << dataset_bytes
+                << ", \"cache_level\": " << json_string(cache_level(dataset_bytes)) << ", \"points\": [";
+            for (size_t k = 0; k < points.size(); k++) {
+                out << (k > 0 ? ",\n" : "\n") << "          ";
+                write_point(points[k], strong_efficiency(points, points[k]));
+            }
+            out << "\n        ]}";
+        }
+        out << "\n      ],\n";
+        out << "      \"weak\": [";
+        for (size_t k = 0; k < res.weak.size(); k++) {
+            out << (k > 0 ? ",\n" : "\n") << "        ";
+            write_point(res.weak[k], weak_efficiency(res.weak, res.weak[k]));
+        }
+        out << "\n      ]\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Roofline-style table: the scatterer bandwidth of each point against the
+// triad bandwidth with the same number of threads. Points close to the roof
+// are limited by memory bandwidth, points well below it which also scale
+// poorly are limited by something else (synchronization, imbalance, shared
+// caches).
+void print_roofline_summary(std::ostream& out, const std::vector<ScalingResult>& results) {
+    const auto classify = [](double bandwidth_fraction, double efficiency) {
+        if (bandwidth_fraction >= 0.6) return "memory-bound";
+        if (efficiency < 0.7) return "scaling-limited";
+        return "compute-bound";
+    };
+    char line[256];
+    for (const auto& res : results) {
+        out << "\nRoofline summary for " << res.algorithm << " (triad GB/s:";
+        for (const auto& triad : res.triad_gbps) {
+            std::snprintf(line, sizeof(line), " %d: %.1f", triad.first, triad.second);
+            out << line;
+        }
+        out << ")\n";
+        std::snprintf(line, sizeof(line), "%-8s %12s %6s %10s %8s %6s %9s %7s  %s\n",
+                      "scaling", "scatterers", "cache", "threads", "ms", "eff", "GB/s", "roof", "limit");
+        out << line;
+        const auto print_point = [&](const char* kind, const ScalingPoint& point, double efficiency) {
+            const auto fraction = point.scatterer_gbps/res.triad_gbps.at(point.num_threads);
+            std::snprintf(line, sizeof(line), "%-8s %12zu %6s %10d %8.2f %6.2f %9.2f %6.0f%%  %s\n",
+                          kind, point.num_scatterers,
+                          cache_level(FIXED_SCATTERER_BYTES*point.num_scatterers).c_str(), point.num_threads,
+                          point.median_frame_ms, efficiency, point.scatterer_gbps, 100.0*fraction,
+                          classify(fraction, efficiency));
+            out << line;
+        };
+        for (const auto& points : res.strong) {
+            for (const auto& point : points) {
+                print_point("strong", point, strong_efficiency(points, point));
+            }
+        }
+        for (const auto& point : res.weak) {
+            print_point("weak", point, weak_efficiency(res.weak, point));
+        }
+    }
+}
+
+double median_frame_seconds(const std::string& algorithm, const BenchmarkConfig& config) {
+    return 1e-3*percentile(run_benchmark(algorithm, config).frame_ms, 0.5);
+}
+
+// Measure the values of the cost model of the backend selection: the
+// per-sample cost from a frame of a single scatterer, the projection rates
+// from the remaining time of the full frames, and the parallel efficiency
+// from a frame with all threads.
+void calibrate(const BenchmarkConfig& config, const std::string& path) {
+    const auto hardware = bcsim::HardwareInfo::detect();
+    bcsim::CostModel model(path);
+
+    auto single_thread = config;
+    single_thread.scatterer_type = "fixed";
+    single_thread.parameters.push_back("num_cpu_cores=1");
+    auto empty = single_thread;
+    empty.num_scatterers = 1;
+    auto spline = single_thread;
+    spline.scatterer_type = "spline";
+
+    const double num_samples = static_cast<double>(config.num_lines)
+        *bcsim::compute_num_rf_samples(1540.0f, config.line_length, 50e6f);
+    const double work = static_cast<double>(config.num_scatterers)*config.num_lines;
+
+    std::cerr << "Calibrating cpu..." << std::endl;
+    const auto empty_seconds = median_frame_seconds("cpu", empty);
+    model.cpu_seconds_per_sample = empty_seconds/num_samples;
+    const auto fixed_seconds = std::max(median_frame_seconds("cpu", single_thread) - empty_seconds, 1e-6);
+    model.cpu_projections_per_lane_second = work/fixed_seconds/hardware.simd_width;
+    const auto spline_seconds = std::max(median_frame_seconds("cpu", spline) - empty_seconds, 1e-6);
+    model.spline_cost_factor = spline_seconds/fixed_seconds;
+    if (hardware.num_cpu_threads > 1) {
+        auto all_threads = config;
+        all_threads.scatterer_type = "fixed";
+        all_threads.parameters.push_back("num_cpu_cores=" + std::to_string(hardware.num_cpu_threads));
+        const auto speedup = (fixed_seconds + empty_seconds)/median_frame_seconds("cpu", all_threads);
+        model.cpu_parallel_efficiency = std::min(1.0, std::max(0.0, (speedup - 1.0)/(hardware.num_cpu_threads - 1)));
+    }
+
+    if (!hardware.gpus.empty()) {
+        std::cerr << "Calibrating gpu..." << std::endl;
+        auto gpu_config = config;
+        gpu_config.scatterer_type = "fixed";
+        gpu_config.parameters.push_back("gpu_device=0");
+        auto gpu_empty = gpu_config;
+        gpu_empty.num_scatterers = 1;
+        const auto gpu_empty_seconds = median_frame_seconds("gpu", gpu_empty);
+        model.gpu_frame_overhead_seconds = gpu_empty_seconds;
+        const auto gpu_fixed_seconds = std::max(median_frame_seconds("gpu", gpu_config) - gpu_empty_seconds, 1e-6);
+        model.gpu_projections_per_sm_second = work/gpu_fixed_seconds/std::max(1, hardware.gpus[0].num_multiprocessors);
+    }
+    model.save(path);
+    std::cerr << "Wrote the cost model to " << path << std::endl;
+}
+
+int run(int argc, char** argv) {
+    BenchmarkConfig config;
+    std::string output_file;
+    std::string calibrate_file;
+
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("algorithm", po::value<std::vector<std::string>>(&config.algorithms)->multitoken(),
+            "simulator types to pass to Create(), e.g. cpu gpu (default: cpu)")
+        ("num_scatterers", po::value<size_t>(&config.num_scatterers)->default_value(100000), "number of scatterers")
+        ("num_lines", po::value<size_t>(&config.num_lines)->default_value(128), "number of lines per frame")
+        ("line_length", po::value<float>(&config.line_length)->default_value(0.12f), "line length [m]")
+        ("scatterers", po::value<std::string>(&config.scatterer_type)->default_value("fixed"), "fixed or spline")
+        ("spline_degree", po::value<int>(&config.spline_degree)->default_value(3), "degree of spline scatterers")
+        ("num_cs", po::value<int>(&config.num_cs)->default_value(10), "control points per spline scatterer")
+        ("beam_profile", po::value<std::string>(&config.beam_profile)->default_value("analytical"), "analytical or lut")
+        ("warmup", po::value<int>(&config.num_warmup_frames)->default_value(2), "number of untimed warm-up frames")
+        ("frames", po::value<int>(&config.num_frames)->default_value(10), "number of timed frames")
+        ("param", po::value<std::vector<std::string>>(&config.parameters)->multitoken(),
+            "simulator parameters as key=value, e.g. num_cpu_cores=4")
+        ("output", po::value<std::string>(&output_file), "write the JSON results to this file instead of stdout")
+        ("scaling", po::bool_switch(&config.scaling), "sweep thread counts and fixed-scatterer dataset sizes")
+        ("scaling_threads", po::value<std::vector<int>>(&config.scaling_threads)->multitoken(),
+            "thread counts of the sweep (default: 1, 2, 4, ... and the number of processors)")
+        ("scaling_scatterers", po::value<std::vector<size_t>>(&config.scaling_scatterers)->multitoken(),
+            "dataset sizes of the strong-scaling sweep (default: 10000 100000 1000000 4000000)")
+        ("weak_scatterers", po::value<size_t>(&config.weak_scatterers_per_thread)->default_value(100000),
+            "scatterers per thread of the weak-scaling sweep")
+        ("calibrate", po::value<std::string>(&calibrate_file),
+            "measure the cost model of the \"auto\" simulator type and write it to this file")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(var_map);
+    if (config.algorithms.empty()) {
+        config.algorithms.push_back("cpu");
+    }
+    if ((config.num_frames < 1) || (config.num_warmup_frames < 0)) {
+        throw std::runtime_error("need at least one timed frame");
+    }
+    if (!calibrate_file.empty()) {
+        calibrate(config, calibrate_file);
+        return 0;
+    }
+
+    std::ofstream output_stream;
+    if (!output_file.empty()) {
+        output_stream.open(output_file);
+        if (!output_stream) {
+            throw std::runtime_error("unable to open " + output_file);
+        }
+    }
+    auto& out = output_file.empty() ? std::cout : output_stream;
+
+    if (config.scaling) {
+        if (config.scatterer_type != "fixed") {
+            throw std::runtime_error("the scaling sweep uses fixed scatterers");
+        }
+        if (config.scaling_threads.empty()) {
+            const auto max_threads = max_num_threads();
+            for (int num_threads = 1; num_threads < max_threads; num_threads *= 2) {
+                config.scaling_threads.push_back(num_threads);
+            }
+            config.scaling_threads.push_back(max_threads);
+        }
+        if (config.scaling_scatterers.empty()) {
+            config.scaling_scatterers = {10000, 100000, 1000000, 4000000};
+        }
+        std::vector<ScalingResult> results;
+        for (const auto& algorithm : config.algorithms) {
+            results.push_back(run_scaling(algorithm, config));
+        }
+        write_scaling_json(out, config, results);
+        print_roofline_summary(std::cerr, results);
+        return 0;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const auto& algorithm : config.algorithms) {
+        std::cerr << "Benchmarking " << algorithm << "..." << std::endl;
+        results.push_back(run_benchmark(algorithm, config));
+    }
+    write_json(out, config, results);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
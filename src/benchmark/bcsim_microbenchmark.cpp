@@ -0,0 +1,329 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  Microbenchmarks of the hot kernels.
+ *
+ *  Uses Google Benchmark, so the usual --benchmark_filter and
+ *  --benchmark_format=json options apply. Every benchmark reports items
+ *  (samples, scatterers, points or pixels) and bytes per second, so that
+ *  optimizations of a single kernel can be measured in isolation.
+ */
+
+#include <complex>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../core/LibBCSim.hpp"
+#include "../core/fft.hpp"
+#include "../core/BeamConvolver.hpp"
+#include "../core/bspline.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/ScanGeometry.hpp"
+#include "../utils/cartesianator/Cartesianator.hpp"
+
+namespace {
+
+std::vector<std::complex<float>> random_signal(size_t length) {
+    std::mt19937 gen(0);
+    std::normal_distribution<float> dist;
+    std::vector<std::complex<float>> res(length);
+    for (auto& x : res) {
+        x = std::complex<float>(dist(gen), dist(gen));
+    }
+    return res;
+}
+
+bcsim::ExcitationSignal make_excitation() {
+    const auto center_freq = 2.5e6f;
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    std::vector<float> dummy_times;
+    bcsim::MakeGaussianExcitation(center_freq, 0.2f, ex.sampling_frequency, dummy_times, ex.samples, ex.center_index);
+    ex.demod_freq = center_freq;
+    return ex;
+}
+
+void BM_fft(benchmark::State& state) {
+    const auto length = static_cast<size_t>(state.range(0));
+    const auto x = random_signal(length);
+    for (auto _ : state) {
+        auto res = fft(x);
+        benchmark::DoNotOptimize(res.data());
+    }
+    state.SetItemsProcessed(state.iterations()*length);
+    state.SetBytesProcessed(state.iterations()*length*sizeof(std::complex<float>));
+}
+BENCHMARK(BM_fft)->RangeMultiplier(4)->Range(256, 1 << 16);
+
+void BM_ifft(benchmark::State& state) {
+    const auto length = static_cast<size_t>(state.range(0));
+    const auto x = random_signal(length);
+    for (auto _ : state) {
+        auto res = ifft(x);
+        benchmark::DoNotOptimize(res.data());
+    }
+    state.SetItemsProcessed(state.iterations()*length);
+    state.SetBytesProcessed(state.iterations()*length*sizeof(std::complex<float>));
+}
+BENCHMARK(BM_ifft)->RangeMultiplier(4)->Range(256, 1 << 16);
+
+// In-place transform with a cached plan, as used by the convolvers.
+void BM_FftPlan_forward(benchmark::State& state) {
+    const auto length = static_cast<size_t>(state.range(0));
+    const auto plan = FftPlan<float>::get(length);
+    auto x = random_signal(length);
+    for (auto _ : state) {
+        plan->forward(x.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations()*length);
+    state.SetBytesProcessed(state.iterations()*length*sizeof(std::complex<float>));
+}
+BENCHMARK(BM_FftPlan_forward)->RangeMultiplier(4)->Range(256, 1 << 16);
+
+// Args: number of time-projection samples, real input (0/1), radial decimation.
+void BeamConvolverProcess(benchmark::State& state, const std::string& fft_backend, const std::string& method) {
+    const auto num_samples = static_cast<size_t>(state.range(0));
+    const auto real_input = state.range(1) != 0;
+    const auto radial_decimation = static_cast<int>(state.range(2));
+    auto convolver = bcsim::IBeamConvolver::Create(num_samples, make_excitation(), fft_backend, real_input,
+                                                   radial_decimation, method);
+    const auto time_proj = random_signal(num_samples);
+    std::vector<std::complex<float>> out(convolver->get_num_output_samples());
+    for (auto _ : state) {
+        auto buffer = convolver->get_zeroed_time_proj_signal();
+        std::copy(time_proj.begin(), time_proj.end(), buffer);
+        convolver->process(out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations()*num_samples);
+    state.SetBytesProcessed(state.iterations()*(num_samples + out.size())*sizeof(std::complex<float>));
+}
+
+// Simulates a single line with one thread, so that the scatterer projection
+// dominates. The projection loops are members of the CPU algorithm and are
+// measured through it. Args: number of scatterers.
+void CpuProjection(benchmark::State& state, bool spline_scatterers) {
+    const auto num_scatterers = static_cast<size_t>(state.range(0));
+    const float line_length = 0.1f;
+    auto sim = bcsim::Create("cpu");
+    sim->set_parameter("verbose", "0");
+    sim->set_parameter("num_cpu_cores", "1");
+    sim->set_parameter("scatterer_culling", "off");
+    sim->set_parameter("sound_speed", "1540.0");
+    sim->set_excitation(make_excitation());
+    sim->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 3e-3f));
+    auto scan_seq = std::make_shared<bcsim::ScanSequence>(line_length);
+    scan_seq->add_scanline(bcsim::Scanline(bcsim::vector3(0.0f, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                           bcsim::vector3(1.0f, 0.0f, 0.0f), 0.5f));
+    sim->set_scan_sequence(scan_seq);
+
+    // scatterers in a narrow box around the line, so that all are inside the beam
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> lateral_dist(-2e-3f, 2e-3f);
+    std::uniform_real_distribution<float> radial_dist(0.0f, line_length);
+    std::uniform_real_distribution<float> amplitude_dist(-1.0f, 1.0f);
+    if (spline_scatterers) {
+        const int spline_degree = 3;
+        const int num_cs = 10;
+        auto scatterers = std::make_shared<bcsim::SplineScatterers>();
+        scatterers->spline_degree = spline_degree;
+        scatterers->knot_vector = bspline_storve::uniform_regular_knot_vector(num_cs, spline_degree, 0.0f, 1.0f);
+        scatterers->resize(num_scatterers, num_cs);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            const bcsim::vector3 pos(lateral_dist(gen), lateral_dist(gen), radial_dist(gen));
+            for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+                scatterers->set_control_point(i, cs_no, pos);
+            }
+            scatterers->amplitudes[i] = amplitude_dist(gen);
+        }
+        sim->add_spline_scatterers(scatterers);
+    } else {
+        auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+        scatterers->scatterers.resize(num_scatterers);
+        for (auto& scatterer : scatterers->scatterers) {
+            scatterer.pos = bcsim::vector3(lateral_dist(gen), lateral_dist(gen), radial_dist(gen));
+            scatterer.amplitude = amplitude_dist(gen);
+        }
+        sim->add_fixed_scatterers(scatterers);
+    }
+
+    size_t num_lines, num_samples;
+    sim->get_output_dimensions(num_lines, num_samples);
+    std::vector<std::complex<float>> iq_line(num_lines*num_samples);
+    for (auto _ : state) {
+        sim->simulate_lines(iq_line.data(), num_samples);
+        benchmark::DoNotOptimize(iq_line.data());
+    }
+    const auto bytes_per_scatterer = spline_scatterers ? 10*3*sizeof(float) + sizeof(float) : 4*sizeof(float);
+    state.SetItemsProcessed(state.iterations()*num_scatterers);
+    state.SetBytesProcessed(state.iterations()*num_scatterers*bytes_per_scatterer);
+}
+
+void BM_CpuAlgorithm_fixed_projection_loop(benchmark::State& state) {
+    CpuProjection(state, false);
+}
+BENCHMARK(BM_CpuAlgorithm_fixed_projection_loop)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+void BM_CpuAlgorithm_spline_projection_loop(benchmark::State& state) {
+    CpuProjection(state, true);
+}
+BENCHMARK(BM_CpuAlgorithm_spline_projection_loop)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Points covering the extent of the profiles below and some outside.
+struct ProfilePoints {
+    explicit ProfilePoints(size_t num_points) : rs(num_points), ls(num_points), es(num_points) {
+        std::mt19937 gen(0);
+        std::uniform_real_distribution<float> r_dist(0.0f, 0.1f);
+        std::uniform_real_distribution<float> l_dist(-5e-3f, 5e-3f);
+        std::uniform_real_distribution<float> e_dist(-15e-3f, 15e-3f);
+        for (size_t i = 0; i < num_points; i++) {
+            rs[i] = r_dist(gen);
+            ls[i] = l_dist(gen);
+            es[i] = e_dist(gen);
+        }
+    }
+    std::vector<float> rs, ls, es;
+};
+
+template <typename Profile>
+void SampleProfile(benchmark::State& state, Profile& profile) {
+    const size_t num_points = 4096;
+    const ProfilePoints points(num_points);
+    for (auto _ : state) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < num_points; i++) {
+            sum += profile.sampleProfile(points.rs[i], points.ls[i], points.es[i]);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations()*num_points);
+    state.SetBytesProcessed(state.iterations()*num_points*3*sizeof(float));
+}
+
+void BM_GaussianBeamProfile_sampleProfile(benchmark::State& state) {
+    bcsim::GaussianBeamProfile profile(1e-3f, 3e-3f);
+    SampleProfile(state, profile);
+}
+BENCHMARK(BM_GaussianBeamProfile_sampleProfile);
+
+void BM_LUTBeamProfile_sampleProfile(benchmark::State& state) {
+    const int num_rad = 16;
+    const int num_lat = 64;
+    const int num_ele = 32;
+    bcsim::GaussianBeamProfile gaussian(1e-3f, 3e-3f);
+    bcsim::LUTBeamProfile profile(num_rad, num_lat, num_ele, bcsim::Interval(0.0f, 0.1f),
+                                  bcsim::Interval(-4e-3f, 4e-3f), bcsim::Interval(-12e-3f, 12e-3f));
+    for (int i = 0; i < num_rad; i++) {
+        for (int j = 0; j < num_lat; j++) {
+            for (int k = 0; k < num_ele; k++) {
+                profile.setDiscreteSample(i, j, k, gaussian.sample(0.0f, -4e-3f + j*8e-3f/(num_lat-1),
+                                                                   -12e-3f + k*24e-3f/(num_ele-1)));
+            }
+        }
+    }
+    SampleProfile(state, profile);
+}
+BENCHMARK(BM_LUTBeamProfile_sampleProfile);
+
+// All basis functions at a number of points. Args: spline degree.
+void BM_bsplineBasis(benchmark::State& state) {
+    const auto degree = static_cast<int>(state.range(0));
+    const int num_cs = 16;
+    const size_t num_points = 256;
+    const auto knots = bspline_storve::uniform_regular_knot_vector(num_cs, degree, 0.0f, 1.0f);
+    for (auto _ : state) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < num_points; i++) {
+            const auto t = static_cast<float>(i)/num_points;
+            for (int j = 0; j < num_cs; j++) {
+                sum += bspline_storve::bsplineBasis(j, degree, t, knots);
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations()*num_points*num_cs);
+    state.SetBytesProcessed(state.iterations()*num_points*num_cs*sizeof(float));
+}
+BENCHMARK(BM_bsplineBasis)->DenseRange(1, 4);
+
+// Scan conversion of a sector scan to a 512x512 image, with the table built
+// before timing. Args: number of beams, samples per beam.
+void BM_CpuCartesianator_Process(benchmark::State& state) {
+    const auto num_beams = static_cast<int>(state.range(0));
+    const auto num_samples = static_cast<int>(state.range(1));
+    const size_t width = 512;
+    const size_t height = 512;
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = 1.2f;
+    geometry->depth = 0.1f;
+    geometry->tilt  = 0.0f;
+    CpuCartesianator<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(width, height);
+    std::vector<float> beamspace(static_cast<size_t>(num_beams)*num_samples);
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    for (auto& x : beamspace) {
+        x = dist(gen);
+    }
+    cartesianator.Process(beamspace.data(), num_beams, num_samples);
+    for (auto _ : state) {
+        cartesianator.Process(beamspace.data(), num_beams, num_samples);
+        benchmark::DoNotOptimize(cartesianator.GetOutputBuffer());
+    }
+    state.SetItemsProcessed(state.iterations()*width*height);
+    state.SetBytesProcessed(state.iterations()*(beamspace.size() + width*height)*sizeof(float));
+}
+BENCHMARK(BM_CpuCartesianator_Process)->Args({128, 512})->Args({256, 2048})->Unit(benchmark::kMicrosecond);
+
+}   // namespace
+
+// One convolver benchmark for each compiled FFT backend, and for the direct
+// convolver and the automatic choice between them.
+int main(int argc, char** argv) {
+    const std::vector<std::vector<int64_t>> convolver_args{{1024, 4096, 16384}, {0, 1}, {1, 4}};
+    for (const auto& backend : bcsim::IBeamConvolver::get_available_fft_backends()) {
+        benchmark::RegisterBenchmark(("BM_BeamConvolver_process/" + backend).c_str(), BeamConvolverProcess, backend, "fft")
+            ->ArgsProduct(convolver_args);
+    }
+    for (const std::string method : {"direct", "auto"}) {
+        benchmark::RegisterBenchmark(("BM_BeamConvolver_process/" + method).c_str(), BeamConvolverProcess, "builtin", method)
+            ->ArgsProduct(convolver_args);
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,715 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  Accuracy-versus-speed validation of the approximate fast modes.
+ *
+ *  Simulates a set of standard phantoms (point targets, an anechoic cyst in
+ *  speckle and plain speckle) with an exact reference configuration and
+ *  with each fast mode, and reports the speedup of each mode together with
+ *  the error metrics relevant for the studies it is used in:
+ *
+ *    envelope_psnr_db      20*log10(max|ref| / rms(|iq| - |ref|))
+ *    phase_error_deg       RMS phase difference to the reference, weighted by
+ *                          the reference intensity, above -40 dB
+ *    speckle_snr           mean/std of the envelope in the speckle region,
+ *                          about 1.91 for fully developed speckle
+ *    cyst_contrast_db      mean intensity in the cyst relative to the speckle
+ *    psf_axial_mm,
+ *    psf_lateral_mm        mean -6 dB widths of the point targets
+ *
+ *  The reference disables scatterer culling, uses a wide beam profile
+ *  cutoff and a long fractional-delay filter. Each mode applies its
+ *  parameters on top of it, so "scatterer_culling=on" measures culling
+ *  alone. Custom modes are given as name:algorithm[:key=value,...], where
+ *  the keys lod_threshold, lod_voxel and lod_representatives simplify the
+ *  phantom (see ScattererSimplification.hpp) instead of being passed to
+ *  set_parameter().
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "../core/LibBCSim.hpp"
+#include "../core/algorithm/BackendSelection.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/ScattererSimplification.hpp"
+
+namespace {
+
+struct ValidationConfig {
+    std::vector<std::string>    phantoms;
+    std::vector<std::string>    modes;              // custom modes, replacing the default ones
+    std::string                 reference_algorithm;
+    size_t                      num_scatterers;     // of the speckle phantoms
+    size_t                      num_lines;
+    float                       scan_width;         // [m]
+    float                       line_length;        // [m]
+    int                         radial_decimation;
+    int                         num_warmup_frames;
+    int                         num_frames;
+};
+
+// A configuration to compare with the reference.
+struct Mode {
+    std::string                             name;
+    std::string                             algorithm;
+    std::vector<std::string>                parameters;     // key=value pairs for set_parameter()
+    bcsim::ScattererSimplificationConfig    simplification;
+};
+
+// Parameters of the reference configuration, which are skipped by
+// algorithms that do not support them.
+const std::vector<std::string> REFERENCE_PARAMETERS = {
+    "scatterer_culling=off",
+    "profile_cutoff_num_sigmas=10",
+    "fractional_delay=16"
+};
+
+const float SOUND_SPEED    = 1540.0f;
+const float SIGMA_LATERAL  = 1e-3f;
+const float SIGMA_ELEVATIONAL = 3e-3f;
+
+// Point targets at these lateral positions and depths relative to the
+// line length.
+const float POINT_TARGET_X[] = {-0.25f, 0.0f, 0.25f};
+const float POINT_TARGET_Z[] = {0.25f, 0.5f, 0.75f};
+
+// Cyst along the elevational direction, relative to the line length.
+const float CYST_Z      = 0.5f;
+const float CYST_RADIUS = 0.1f;
+
+double millisec_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const auto n = values.size();
+    return (n % 2 == 1) ? values[n/2] : 0.5*(values[n/2-1] + values[n/2]);
+}
+
+std::vector<Mode> default_modes() {
+    std::vector<Mode> modes;
+    const auto add = [&](const std::string& name, const std::string& algorithm, std::vector<std::string> parameters) {
+        Mode mode;
+        mode.name = name;
+        mode.algorithm = algorithm;
+        mode.parameters = std::move(parameters);
+        modes.push_back(mode);
+    };
+    add("culling",            "cpu", {"scatterer_culling=on"});
+    add("culling_3_sigmas",   "cpu", {"scatterer_culling=on", "culling_num_sigmas=3", "profile_cutoff_num_sigmas=3"});
+    add("nearest_sample",     "cpu", {"fractional_delay=off"});
+    add("fractional_delay_4", "cpu", {"fractional_delay=4"});
+    add("baseband",           "cpu", {"baseband=on"});
+    Mode lod;
+    lod.name = "lod";
+    lod.algorithm = "cpu";
+    lod.simplification.relative_amplitude_threshold = 0.1f;
+    lod.simplification.merge_voxel_size = 0.5e-3f;
+    modes.push_back(lod);
+    if (!bcsim::HardwareInfo::detect().gpus.empty()) {
+        add("gpu",                "gpu", {});
+        add("gpu_fp16_scatterers", "gpu", {"gpu_compact_scatterers=on"});
+        add("gpu_culling",        "gpu", {"scatterer_culling=on"});
+    }
+    return modes;
+}
+
+// name:algorithm[:key=value,key=value,...]
+Mode parse_mode(const std::string& spec) {
+    std::vector<std::string> fields;
+    std::stringstream ss(spec);
+    std::string field;
+    while (std::getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if ((fields.size() < 2) || (fields.size() > 3) || fields[0].empty() || fields[1].empty()) {
+        throw std::runtime_error("modes must be given as name:algorithm[:key=value,...]: " + spec);
+    }
+    Mode mode;
+    mode.name = fields[0];
+    mode.algorithm = fields[1];
+    if (fields.size() == 3) {
+        std::stringstream params(fields[2]);
+        std::string key_value;
+        while (std::getline(params, key_value, ',')) {
+            const auto pos = key_value.find('=');
+            if (pos == std::string::npos) {
+                throw std::runtime_error("parameters must be given as key=value: " + key_value);
+            }
+            const auto key = key_value.substr(0, pos);
+            const auto value = key_value.substr(pos+1);
+            if (key == "lod_threshold") {
+                mode.simplification.relative_amplitude_threshold = std::stof(value);
+            } else if (key == "lod_voxel") {
+                mode.simplification.merge_voxel_size = std::stof(value);
+            } else if (key == "lod_representatives") {
+                mode.simplification.representatives_per_voxel = std::stoi(value);
+            } else {
+                mode.parameters.push_back(key_value);
+            }
+        }
+    }
+    return mode;
+}
+
+void set_key_value(bcsim::IAlgorithm& sim, const std::string& key_value) {
+    const auto pos = key_value.find('=');
+    sim.set_parameter(key_value.substr(0, pos), key_value.substr(pos+1));
+}
+
+// Configure everything but the scatterers.
+void configure(bcsim::IAlgorithm& sim, const ValidationConfig& config, const Mode& mode) {
+    sim.set_parameter("verbose", "0");
+    sim.set_parameter("sound_speed", std::to_string(SOUND_SPEED));
+    sim.set_parameter("radial_decimation", std::to_string(config.radial_decimation));
+    sim.set_parameter("phase_delay", "on");
+    for (const auto& key_value : REFERENCE_PARAMETERS) {
+        try {
+            set_key_value(sim, key_value);
+        } catch (const std::runtime_error&) {
+        }
+    }
+    for (const auto& key_value : mode.parameters) {
+        set_key_value(sim, key_value);
+    }
+
+    const auto center_freq = 2.5e6f;
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    std::vector<float> dummy_times;
+    bcsim::MakeGaussianExcitation(center_freq, 0.2f, ex.sampling_frequency, dummy_times, ex.samples, ex.center_index);
+    ex.demod_freq = center_freq;
+    sim.set_excitation(ex);
+    sim.set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(SIGMA_LATERAL, SIGMA_ELEVATIONAL));
+
+    auto geometry = std::make_shared<bcsim::LinearScanGeometry>();
+    geometry->width = config.scan_width;
+    geometry->range_max = config.line_length;
+    const auto scan_seq = bcsim::CreateScanSequence(geometry, config.num_lines, 0.0f);
+    sim.set_scan_sequence(std::make_shared<bcsim::ScanSequence>(scan_seq));
+}
+
+bcsim::FixedScatterers::s_ptr make_phantom(const std::string& phantom, const ValidationConfig& config) {
+    auto scatterers = std::make_shared<bcsim::FixedScatterers>();
+    if (phantom == "points") {
+        for (const auto x : POINT_TARGET_X) {
+            for (const auto z : POINT_TARGET_Z) {
+                bcsim::PointScatterer scatterer;
+                scatterer.pos = bcsim::vector3(x*config.scan_width, 0.0f, z*config.line_length);
+                scatterer.amplitude = 1.0f;
+                scatterers->scatterers.push_back(scatterer);
+            }
+        }
+        return scatterers;
+    }
+    if ((phantom != "speckle") && (phantom != "cyst")) {
+        throw std::runtime_error("invalid phantom: " + phantom);
+    }
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> x_dist(-0.5f*config.scan_width, 0.5f*config.scan_width);
+    std::uniform_real_distribution<float> y_dist(-3.0f*SIGMA_ELEVATIONAL, 3.0f*SIGMA_ELEVATIONAL);
+    std::uniform_real_distribution<float> z_dist(0.0f, config.line_length);
+    std::normal_distribution<float> a_dist(0.0f, 1.0f);
+    const auto cyst_radius = CYST_RADIUS*config.line_length;
+    const auto cyst_z = CYST_Z*config.line_length;
+    scatterers->scatterers.reserve(config.num_scatterers);
+    while (scatterers->scatterers.size() < config.num_scatterers) {
+        bcsim::PointScatterer scatterer;
+        scatterer.pos = bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen));
+        scatterer.amplitude = a_dist(gen);
+        const auto dz = scatterer.pos.z - cyst_z;
+        if ((phantom == "cyst") && (scatterer.pos.x*scatterer.pos.x + dz*dz < cyst_radius*cyst_radius)) {
+            continue;
+        }
+        scatterers->scatterers.push_back(scatterer);
+    }
+    return scatterers;
+}
+
+struct Frame {
+    size_t                              num_lines;
+    size_t                              num_samples;
+    std::vector<std::complex<float>>    iq;         // line-major
+};
+
+struct ModeResult {
+    std::string name;
+    std::string algorithm;
+    size_t      num_scatterers;
+    double      median_frame_ms;
+    Frame       frame;
+};
+
+ModeResult run_mode(const Mode& mode, const bcsim::FixedScatterers::s_ptr& phantom, const ValidationConfig& config) {
+    ModeResult res;
+    res.name = mode.name;
+    res.algorithm = mode.algorithm;
+
+    auto scatterers = phantom;
+    const auto& simplification = mode.simplification;
+    if ((simplification.relative_amplitude_threshold > 0.0f) || (simplification.merge_voxel_size > 0.0f)) {
+        bcsim::ScattererSimplificationReport report;
+        scatterers = bcsim::simplify_fixed_scatterers(*phantom, simplification, report);
+    }
+    res.num_scatterers = scatterers->num_scatterers();
+
+    auto sim = bcsim::Create(mode.algorithm);
+    configure(*sim, config, mode);
+    sim->add_fixed_scatterers(scatterers);
+
+    sim->get_output_dimensions(res.frame.num_lines, res.frame.num_samples);
+    res.frame.iq.resize(res.frame.num_lines*res.frame.num_samples);
+    std::vector<double> frame_ms;
+    for (int frame_no = 0; frame_no < config.num_warmup_frames + config.num_frames; frame_no++) {
+        const auto start = std::chrono::steady_clock::now();
+        sim->simulate_lines(res.frame.iq.data(), res.frame.num_samples);
+        if (frame_no >= config.num_warmup_frames) {
+            frame_ms.push_back(millisec_since(start));
+        }
+    }
+    res.median_frame_ms = median(frame_ms);
+    return res;
+}
+
+const double NOT_AVAILABLE = std::numeric_limits<double>::quiet_NaN();
+
+struct Metrics {
+    Metrics() : envelope_psnr_db(NOT_AVAILABLE), phase_error_deg(NOT_AVAILABLE), relative_rms_error(NOT_AVAILABLE),
+                speckle_snr(NOT_AVAILABLE), cyst_contrast_db(NOT_AVAILABLE),
+                psf_axial_mm(NOT_AVAILABLE), psf_lateral_mm(NOT_AVAILABLE) { }
+
+    // relative to the reference
+    double  envelope_psnr_db;
+    double  phase_error_deg;
+    double  relative_rms_error;
+
+    // of the frame itself
+    double  speckle_snr;
+    double  cyst_contrast_db;
+    double  psf_axial_mm;
+    double  psf_lateral_mm;
+};
+
+void compare_with_reference(const Frame& frame, const Frame& reference, Metrics& metrics) {
+    if ((frame.num_lines != reference.num_lines) || (frame.num_samples != reference.num_samples)) {
+        throw std::runtime_error("frames of different sizes");
+    }
+    double max_envelope = 0.0;
+    for (const auto& iq : reference.iq) {
+        max_envelope = std::max(max_envelope, static_cast<double>(std::abs(iq)));
+    }
+    const auto phase_threshold = max_envelope*std::pow(10.0, -40.0/20.0);
+    double envelope_error_sum = 0.0;
+    double error_sum = 0.0;
+    double reference_sum = 0.0;
+    double phase_error_sum = 0.0;
+    double phase_weight_sum = 0.0;
+    for (size_t i = 0; i < frame.iq.size(); i++) {
+        const std::complex<double> x(frame.iq[i]);
+        const std::complex<double> r(reference.iq[i]);
+        const auto envelope_error = std::abs(x) - std::abs(r);
+        envelope_error_sum += envelope_error*envelope_error;
+        error_sum += std::norm(x - r);
+        reference_sum += std::norm(r);
+        if (std::abs(r) > phase_threshold) {
+            const auto phase = std::arg(x*std::conj(r));
+            phase_error_sum += std::norm(r)*phase*phase;
+            phase_weight_sum += std::norm(r);
+        }
+    }
+    const auto envelope_rms_error = std::sqrt(envelope_error_sum/frame.iq.size());
+    metrics.envelope_psnr_db = (envelope_rms_error > 0.0) ? 20.0*std::log10(max_envelope/envelope_rms_error)
+                                                          : std::numeric_limits<double>::infinity();
+    metrics.relative_rms_error = (reference_sum > 0.0) ? std::sqrt(error_sum/reference_sum) : std::sqrt(error_sum);
+    const double RAD_TO_DEG = 45.0/std::atan(1.0);
+    metrics.phase_error_deg = (phase_weight_sum > 0.0) ? RAD_TO_DEG*std::sqrt(phase_error_sum/phase_weight_sum) : 0.0;
+}
+
+// Line and sample positions of the IQ samples.
+struct FrameGrid {
+    FrameGrid(const Frame& frame, const ValidationConfig& config)
+        : frame(frame),
+          dx(config.scan_width/(frame.num_lines-1)),
+          dz(config.line_length/frame.num_samples),
+          x0(-0.5f*config.scan_width) { }
+
+    double envelope(size_t line_no, size_t sample_no) const {
+        return std::abs(frame.iq[line_no*frame.num_samples + sample_no]);
+    }
+    size_t line_at(float x) const {
+        return static_cast<size_t>(std::min<float>(frame.num_lines-1, std::max(0.0f, std::round((x-x0)/dx))));
+    }
+    size_t sample_at(float z) const {
+        return static_cast<size_t>(std::min<float>(frame.num_samples-1, std::max(0.0f, std::round(z/dz))));
+    }
+
+    const Frame&    frame;
+    const float     dx;
+    const float     dz;
+    const float     x0;
+};
+
+// Distance between the half-maximum crossings of values around index peak,
+// in samples, with linear interpolation.
+double half_maximum_width(const std::vector<double>& values, size_t peak) {
+    const auto half = 0.5*values[peak];
+    double width = 0.0;
+    for (const int step : {-1, 1}) {
+        int i = static_cast<int>(peak);
+        while ((i + step >= 0) && (i + step < static_cast<int>(values.size())) && (values[i + step] > half)) {
+            i += step;
+        }
+        if ((i + step < 0) || (i + step >= static_cast<int>(values.size()))) {
+            return NOT_AVAILABLE;
+        }
+        width += std::abs(i - static_cast<double>(peak)) + (values[i] - half)/(values[i] - values[i + step]);
+    }
+    return width;
+}
+
+void measure_point_targets(const FrameGrid& grid, const ValidationConfig& config, Metrics& metrics) {
+    const auto search_x = 4.0f*SIGMA_LATERAL;
+    const auto search_z = 2e-3f;
+    double axial_sum = 0.0, lateral_sum = 0.0;
+    int num_axial = 0, num_lateral = 0;
+    for (const auto x_rel : POINT_TARGET_X) {
+        for (const auto z_rel : POINT_TARGET_Z) {
+            const auto x = x_rel*config.scan_width;
+            const auto z = z_rel*config.line_length;
+            size_t peak_line = 0, peak_sample = 0;
+            double peak = -1.0;
+            for (auto line_no = grid.line_at(x - search_x); line_no <= grid.line_at(x + search_x); line_no++) {
+                for (auto sample_no = grid.sample_at(z - search_z); sample_no <= grid.sample_at(z + search_z); sample_no++) {
+                    if (grid.envelope(line_no, sample_no) > peak) {
+                        peak = grid.envelope(line_no, sample_no);
+                        peak_line = line_no;
+                        peak_sample = sample_no;
+                    }
+                }
+            }
+            if (peak <= 0.0) {
+                continue;
+            }
+            std::vector<double> axial(grid.frame.num_samples), lateral(grid.frame.num_lines);
+            for (size_t i = 0; i < axial.size(); i++) axial[i] = grid.envelope(peak_line, i);
+            for (size_t i = 0; i < lateral.size(); i++) lateral[i] = grid.envelope(i, peak_sample);
+            const auto axial_width = half_maximum_width(axial, peak_sample);
+            const auto lateral_width = half_maximum_width(lateral, peak_line);
+            if (!std::isnan(axial_width)) {
+                axial_sum += 1e3*axial_width*grid.dz;
+                num_axial++;
+            }
+            if (!std::isnan(lateral_width)) {
+                lateral_sum += 1e3*lateral_width*grid.dx;
+                num_lateral++;
+            }
+        }
+    }
+    metrics.psf_axial_mm = (num_axial > 0) ? axial_sum/num_axial : NOT_AVAILABLE;
+    metrics.psf_lateral_mm = (num_lateral > 0) ? lateral_sum/num_lateral : NOT_AVAILABLE;
+}
+
+// The speckle region excludes the near field, the edges of the scan and,
+// for the cyst phantom, the cyst with a margin. The cyst region is its
+// inner part.
+void measure_speckle(const FrameGrid& grid, const ValidationConfig& config, bool has_cyst, Metrics& metrics) {
+    const auto cyst_radius = CYST_RADIUS*config.line_length;
+    const auto cyst_z = CYST_Z*config.line_length;
+    double sum = 0.0, sum_squared = 0.0, cyst_intensity_sum = 0.0;
+    size_t num_speckle = 0, num_cyst = 0;
+    for (size_t line_no = 0; line_no < grid.frame.num_lines; line_no++) {
+        const auto x = grid.x0 + line_no*grid.dx;
+        if (std::abs(x) > 0.4f*config.scan_width) {
+            continue;
+        }
+        for (size_t sample_no = 0; sample_no < grid.frame.num_samples; sample_no++) {
+            const auto z = sample_no*grid.dz;
+            if ((z < 0.1f*config.line_length) || (z > 0.9f*config.line_length)) {
+                continue;
+            }
+            const auto envelope = grid.envelope(line_no, sample_no);
+            const auto cyst_distance = std::sqrt(x*x + (z-cyst_z)*(z-cyst_z));
+            if (has_cyst && (cyst_distance < 0.7f*cyst_radius)) {
+                cyst_intensity_sum += envelope*envelope;
+                num_cyst++;
+            } else if (!has_cyst || (cyst_distance > 1.5f*cyst_radius)) {
+                sum += envelope;
+                sum_squared += envelope*envelope;
+                num_speckle++;
+            }
+        }
+    }
+    if (num_speckle == 0) {
+        return;
+    }
+    const auto mean = sum/num_speckle;
+    const auto variance = std::max(0.0, sum_squared/num_speckle - mean*mean);
+    metrics.speckle_snr = (variance > 0.0) ? mean/std::sqrt(variance) : NOT_AVAILABLE;
+    if (has_cyst && (num_cyst > 0) && (sum_squared > 0.0)) {
+        const auto ratio = (cyst_intensity_sum/num_cyst)/(sum_squared/num_speckle);
+        metrics.cyst_contrast_db = (ratio > 0.0) ? 10.0*std::log10(ratio) : -std::numeric_limits<double>::infinity();
+    }
+}
+
+Metrics compute_metrics(const std::string& phantom, const Frame& frame, const Frame& reference,
+                        const ValidationConfig& config) {
+    Metrics metrics;
+    compare_with_reference(frame, reference, metrics);
+    const FrameGrid grid(frame, config);
+    if (phantom == "points") {
+        measure_point_targets(grid, config, metrics);
+    } else {
+        measure_speckle(grid, config, phantom == "cyst", metrics);
+    }
+    return metrics;
+}
+
+struct PhantomResult {
+    std::string                 phantom;
+    size_t                      num_scatterers;
+    std::vector<ModeResult>     modes;          // the reference first
+    std::vector<Metrics>        metrics;
+};
+
+std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (const auto c : s) {
+        if ((c == '"') || (c == '\\')) res += '\\';
+        res += c;
+    }
+    return res + "\"";
+}
+
+// null for metrics which are not available or infinite.
+std::string json_number(double value) {
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+void write_json(std::ostream& out, const ValidationConfig& config, const std::vector<PhantomResult>& results) {
+    out << "{\n";
+    out << "  \"config\": {\n";
+    out << "    \"reference_algorithm\": " << json_string(config.reference_algorithm) << ",\n";
+    out << "    \"reference_parameters\": [";
+    for (size_t i = 0; i < REFERENCE_PARAMETERS.size(); i++) {
+        out << (i > 0 ? ", " : "") << json_string(REFERENCE_PARAMETERS[i]);
+    }
+    out << "],\n";
+    out << "    \"num_scatterers\": " << config.num_scatterers << ",\n";
+    out << "    \"num_lines\": " << config.num_lines << ",\n";
+    out << "    \"scan_width\": " << config.scan_width << ",\n";
+    out << "    \"line_length\": " << config.line_length << ",\n";
+    out << "    \"radial_decimation\": " << config.radial_decimation << ",\n";
+    out << "    \"num_warmup_frames\": " << config.num_warmup_frames << ",\n";
+    out << "    \"num_frames\": " << config.num_frames << "\n";
+    out << "  },\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& res = results[i];
+        const auto& ref_metrics = res.metrics.front();
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\n";
+        out << "      \"phantom\": " << json_string(res.phantom) << ",\n";
+        out << "      \"num_scatterers\": " << res.num_scatterers << ",\n";
+        out << "      \"modes\": [";
+        for (size_t j = 0; j < res.modes.size(); j++) {
+            const auto& mode = res.modes[j];
+            const auto& metrics = res.metrics[j];
+            out << (j > 0 ? ",\n" : "\n");
+            out << "        {\n";
+            out << "          \"name\": " << json_string(mode.name) << ",\n";
+            out << "          \"algorithm\": " << json_string(mode.algorithm) << ",\n";
+            out << "          \"num_scatterers\": " << mode.num_scatterers << ",\n";
+            out << "          \"median_frame_ms\": " << mode.median_frame_ms << ",\n";
+            out << "          \"speedup\": " << json_number(res.modes.front().median_frame_ms/mode.median_frame_ms) << ",\n";
+            out << "          \"envelope_psnr_db\": " << json_number(metrics.envelope_psnr_db) << ",\n";
+            out << "          \"phase_error_deg\": " << json_number(metrics.phase_error_deg) << ",\n";
+            out << "          \"relative_rms_error\": " << json_number(metrics.relative_rms_error) << ",\n";
+            out << "          \"speckle_snr\": " << json_number(metrics.speckle_snr) << ",\n";
+            out << "          \"speckle_snr_error\": " << json_number(metrics.speckle_snr - ref_metrics.speckle_snr) << ",\n";
+            out << "          \"cyst_contrast_db\": " << json_number(metrics.cyst_contrast_db) << ",\n";
+            out << "          \"psf_axial_mm\": " << json_number(metrics.psf_axial_mm) << ",\n";
+            out << "          \"psf_lateral_mm\": " << json_number(metrics.psf_lateral_mm) << ",\n";
+            out << "          \"psf_axial_relative_error\": "
+                << json_number(metrics.psf_axial_mm/ref_metrics.psf_axial_mm - 1.0) << ",\n";
+            out << "          \"psf_lateral_relative_error\": "
+                << json_number(metrics.psf_lateral_mm/ref_metrics.psf_lateral_mm - 1.0) << "\n";
+            out << "        }";
+        }
+        out << "\n      ]\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void print_summary(std::ostream& out, const std::vector<PhantomResult>& results) {
+    const auto format = [](double value, const char* fmt) {
+        char buffer[32];
+        if (std::isnan(value)) return std::string("-");
+        if (std::isinf(value)) return std::string(value > 0.0 ? "inf" : "-inf");
+        std::snprintf(buffer, sizeof(buffer), fmt, value);
+        return std::string(buffer);
+    };
+    char line[256];
+    for (const auto& res : results) {
+        out << "\nPhantom " << res.phantom << " (" << res.num_scatterers << " scatterers)\n";
+        std::snprintf(line, sizeof(line), "%-22s %10s %8s %9s %9s %8s %9s %8s %8s\n",
+                      "mode", "ms", "speedup", "PSNR dB", "phase", "SNR", "cyst dB", "axial", "lateral");
+        out << line;
+        for (size_t j = 0; j < res.modes.size(); j++) {
+            const auto& mode = res.modes[j];
+            const auto& metrics = res.metrics[j];
+            std::snprintf(line, sizeof(line), "%-22s %10.2f %8s %9s %9s %8s %9s %8s %8s\n",
+                          mode.name.c_str(), mode.median_frame_ms,
+                          format(res.modes.front().median_frame_ms/mode.median_frame_ms, "%.2fx").c_str(),
+                          format(j > 0 ? metrics.envelope_psnr_db : NOT_AVAILABLE, "%.1f").c_str(),
+                          format(j > 0 ? metrics.phase_error_deg : NOT_AVAILABLE, "%.2f").c_str(),
+                          format(metrics.speckle_snr, "%.3f").c_str(),
+                          format(metrics.cyst_contrast_db, "%.1f").c_str(),
+                          format(metrics.psf_axial_mm, "%.3f").c_str(),
+                          format(metrics.psf_lateral_mm, "%.3f").c_str());
+            out << line;
+        }
+    }
+}
+
+int run(int argc, char** argv) {
+    ValidationConfig config;
+    std::string output_file;
+
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("phantom", po::value<std::vector<std::string>>(&config.phantoms)->multitoken(),
+            "phantoms: points, cyst, speckle (default: all)")
+        ("mode", po::value<std::vector<std::string>>(&config.modes)->multitoken(),
+            "modes as name:algorithm[:key=value,...] instead of the default ones")
+        ("reference", po::value<std::string>(&config.reference_algorithm)->default_value("cpu"),
+            "simulator type of the reference")
+        ("num_scatterers", po::value<size_t>(&config.num_scatterers)->default_value(100000),
+            "number of scatterers of the speckle phantoms")
+        ("num_lines", po::value<size_t>(&config.num_lines)->default_value(128), "number of lines per frame")
+        ("scan_width", po::value<float>(&config.scan_width)->default_value(0.04f), "width of the linear scan [m]")
+        ("line_length", po::value<float>(&config.line_length)->default_value(0.06f), "line length [m]")
+        ("radial_decimation", po::value<int>(&config.radial_decimation)->default_value(4), "radial decimation")
+        ("warmup", po::value<int>(&config.num_warmup_frames)->default_value(1), "number of untimed warm-up frames")
+        ("frames", po::value<int>(&config.num_frames)->default_value(3), "number of timed frames")
+        ("output", po::value<std::string>(&output_file), "write the JSON results to this file instead of stdout")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(var_map);
+    if ((config.num_frames < 1) || (config.num_warmup_frames < 0)) {
+        throw std::runtime_error("need at least one timed frame");
+    }
+    if (config.num_lines < 2) {
+        throw std::runtime_error("need at least two lines");
+    }
+    if (config.phantoms.empty()) {
+        config.phantoms = {"points", "cyst", "speckle"};
+    }
+    std::vector<Mode> modes;
+    if (config.modes.empty()) {
+        modes = default_modes();
+    } else {
+        for (const auto& spec : config.modes) {
+            modes.push_back(parse_mode(spec));
+        }
+    }
+    Mode reference;
+    reference.name = "reference";
+    reference.algorithm = config.reference_algorithm;
+
+    std::ofstream output_stream;
+    if (!output_file.empty()) {
+        output_stream.open(output_file);
+        if (!output_stream) {
+            throw std::runtime_error("unable to open " + output_file);
+        }
+    }
+    auto& out = output_file.empty() ? std::cout : output_stream;
+
+    std::vector<PhantomResult> results;
+    for (const auto& phantom_name : config.phantoms) {
+        PhantomResult res;
+        res.phantom = phantom_name;
+        const auto phantom = make_phantom(phantom_name, config);
+        res.num_scatterers = phantom->num_scatterers();
+        std::cerr << phantom_name << ": reference..." << std::endl;
+        res.modes.push_back(run_mode(reference, phantom, config));
+        for (const auto& mode : modes) {
+            std::cerr << phantom_name << ": " << mode.name << "..." << std::endl;
+            res.modes.push_back(run_mode(mode, phantom, config));
+        }
+        for (const auto& mode : res.modes) {
+            res.metrics.push_back(compute_metrics(phantom_name, mode.frame, res.modes.front().frame, config));
+        }
+        results.push_back(std::move(res));
+    }
+    write_json(out, config, results);
+    print_summary(std::cerr, results);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
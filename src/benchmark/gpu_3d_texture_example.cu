@@ -171,7 +171,8 @@ void test2() {
     std::vector<float> host_input_buffer = get_gaussian_samples(x_min, x_max, y_min, y_max, r_min, r_max,
                                                                 num_samples_x, num_samples_y, num_samples_z);
 
-    DeviceBeamProfileRAII beam_profile(DeviceBeamProfileRAII::TableExtent3D(num_samples_x, num_samples_y, num_samples_z), host_input_buffer);
+    // x is the fastest varying index, which is the elevational one
+    DeviceBeamProfileRAII beam_profile(DeviceBeamProfileRAII::TableExtent3D(num_samples_y, num_samples_x, num_samples_z), host_input_buffer.data());
 
     int samples = 2048;
     const auto num_output_samples = samples*samples;
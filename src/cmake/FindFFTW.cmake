@@ -0,0 +1,38 @@
+# Single-precision FFTW3 library
+# available at http://www.fftw.org/
+#
+# The module defines the following variables:
+#  FFTW_FOUND - the system has single-precision FFTW3
+#  FFTW_INCLUDE_DIR - where to find fftw3.h
+#  FFTW_INCLUDE_DIRS - FFTW includes
+#  FFTW_LIBRARY - where to find the fftw3f library
+#  FFTW_LIBRARIES - aditional libraries
+#
+# Set FFTW_ROOT_DIR to search below a custom install prefix.
+
+find_path ( FFTW_INCLUDE_DIR
+  NAMES fftw3.h
+  HINTS ${FFTW_ROOT_DIR} $ENV{FFTW_ROOT_DIR}
+  PATH_SUFFIXES include
+)
+
+set ( FFTW_INCLUDE_DIRS ${FFTW_INCLUDE_DIR} )
+
+find_library ( FFTW_LIBRARY
+  NAMES fftw3f libfftw3f-3 fftw3f-3
+  HINTS ${FFTW_ROOT_DIR} $ENV{FFTW_ROOT_DIR}
+  PATH_SUFFIXES lib lib64
+)
+
+set ( FFTW_LIBRARIES ${FFTW_LIBRARY} )
+
+# handle the QUIETLY and REQUIRED arguments
+include ( FindPackageHandleStandardArgs )
+find_package_handle_standard_args( FFTW REQUIRED_VARS FFTW_LIBRARY FFTW_INCLUDE_DIR )
+
+mark_as_advanced (
+  FFTW_LIBRARY
+  FFTW_LIBRARIES
+  FFTW_INCLUDE_DIR
+  FFTW_INCLUDE_DIRS
+)
@@ -0,0 +1,232 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include "AsyncLog.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// Unique over the lifetime of the process, so that an entry of a thread for
+// a destroyed log never matches a new log.
+std::atomic<uint64_t> g_next_log_id(0);
+
+}   // end anonymous namespace
+
+struct AsyncLog::Record {
+    ILog::LogType                           type;
+    std::string                             msg;
+    std::chrono::steady_clock::time_point   time;
+};
+
+// A single-producer single-consumer ring buffer, written by one thread and
+// read by the drain thread. head and tail count the records written and
+// read, so the ring is full when they differ by the capacity.
+struct AsyncLog::Ring {
+    explicit Ring(size_t capacity) : slots(capacity), head(0), tail(0), closed(false) { }
+
+    std::vector<Record>     slots;
+    std::atomic<size_t>     head;
+    std::atomic<size_t>     tail;
+    // set when the log is destroyed
+    std::atomic<bool>       closed;
+};
+
+AsyncLog::AsyncLog(ILog::ptr forward_log, size_t ring_capacity, size_t max_messages_per_sec, int flush_interval_ms)
+    : m_forward_log(forward_log),
+      m_ring_capacity(ring_capacity),
+      m_max_messages_per_sec(max_messages_per_sec),
+      m_flush_interval_ms(flush_interval_ms),
+      m_log_id(g_next_log_id++),
+      m_num_dropped(0),
+      m_rate_tokens(static_cast<double>(max_messages_per_sec)),
+      m_last_drain(std::chrono::steady_clock::now()),
+      m_last_drop_report(m_last_drain),
+      m_num_reported_drops(0),
+      m_flushes_requested(0),
+      m_flushes_completed(0),
+      m_stop(false)
+{
+    if (!m_forward_log) {
+        throw std::runtime_error("AsyncLog: the forwarded log is null");
+    }
+    if (m_ring_capacity == 0) {
+        throw std::runtime_error("AsyncLog: the ring capacity must be positive");
+    }
+    if (m_flush_interval_ms <= 0) {
+        throw std::runtime_error("AsyncLog: the flush interval must be positive");
+    }
+    m_drain_thread = std::thread(&AsyncLog::drain_loop, this);
+}
+
+AsyncLog::~AsyncLog() {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_drain_thread.join();
+    for (auto& ring : m_rings) {
+        ring->closed = true;
+    }
+}
+
+void AsyncLog::write(LogType type, const std::string& msg) {
+    auto& ring = thread_ring();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    const auto tail = ring.tail.load(std::memory_order_acquire);
+    if (head - tail >= m_ring_capacity) {
+        m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& record = ring.slots[head % m_ring_capacity];
+    record.type = type;
+    record.msg  = msg;
+    record.time = std::chrono::steady_clock::now();
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void AsyncLog::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto ticket = ++m_flushes_requested;
+    m_cond.notify_one();
+    m_flush_cond.wait(lock, [&]() { return m_flushes_completed >= ticket; });
+}
+
+AsyncLog::Ring& AsyncLog::thread_ring() {
+    thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> t_rings;
+    for (const auto& entry : t_rings) {
+        if (entry.first == m_log_id) {
+            return *entry.second;
+        }
+    }
+
+    // first message of the thread to this log
+    t_rings.erase(std::remove_if(t_rings.begin(), t_rings.end(),
+                                 [](const std::pair<uint64_t, std::shared_ptr<Ring>>& entry) {
+                                     return entry.second->closed.load();
+                                 }),
+                  t_rings.end());
+    auto ring = std::make_shared<Ring>(m_ring_capacity);
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_rings.push_back(ring);
+    }
+    t_rings.emplace_back(m_log_id, ring);
+    return *ring;
+}
+
+void AsyncLog::drain_loop() {
+    for (;;) {
+        std::vector<std::shared_ptr<Ring>> rings;
+        uint64_t flush_target;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock, std::chrono::milliseconds(m_flush_interval_ms), [&]() {
+                return m_stop || m_flushes_requested != m_flushes_completed;
+            });
+            rings        = m_rings;
+            flush_target = m_flushes_requested;
+            stop         = m_stop;
+        }
+
+        drain(rings, stop || flush_target != m_flushes_completed);
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_flushes_completed = flush_target;
+            // Forget the empty rings of threads that have exited, which are
+            // only referenced by the log.
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+                                         [](const std::shared_ptr<Ring>& ring) {
+                                             return ring.use_count() == 1 &&
+                                                    ring->tail.load() == ring->head.load();
+                                         }),
+                          m_rings.end());
+        }
+        m_flush_cond.notify_all();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+void AsyncLog::drain(const std::vector<std::shared_ptr<Ring>>& rings, bool report_drops) {
+    std::vector<Record> batch;
+    for (const auto& ring : rings) {
+        const auto tail = ring->tail.load(std::memory_order_relaxed);
+        const auto head = ring->head.load(std::memory_order_acquire);
+        for (auto i = tail; i != head; i++) {
+            batch.push_back(std::move(ring->slots[i % m_ring_capacity]));
+        }
+        ring->tail.store(head, std::memory_order_release);
+    }
+    std::stable_sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) {
+        return a.time < b.time;
+    });
+
+    const auto now = std::chrono::steady_clock::now();
+    if (m_max_messages_per_sec > 0) {
+        // A token bucket allowing bursts of one second of messages.
+        const auto rate = static_cast<double>(m_max_messages_per_sec);
+        m_rate_tokens = std::min(rate, m_rate_tokens + rate*std::chrono::duration<double>(now - m_last_drain).count());
+    }
+    m_last_drain = now;
+
+    for (const auto& record : batch) {
+        if (m_max_messages_per_sec > 0) {
+            if (m_rate_tokens < 1.0) {
+                m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            m_rate_tokens -= 1.0;
+        }
+        try {
+            m_forward_log->write(record.type, record.msg);
+        } catch (...) {
+            // a failing log must not stop the drain thread
+        }
+    }
+
+    const auto num_dropped = m_num_dropped.load();
+    if (num_dropped != m_num_reported_drops && (report_drops || now - m_last_drop_report >= std::chrono::seconds(1))) {
+        try {
+            m_forward_log->write(ILog::WARNING, std::to_string(num_dropped - m_num_reported_drops) + " log messages were dropped");
+        } catch (...) {
+        }
+        m_num_reported_drops = num_dropped;
+        m_last_drop_report = now;
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "export_macros.hpp"
+#include "BCSimConfig.hpp"
+
+namespace bcsim {
+
+// A log that forwards the messages to another log from a background thread,
+// so that writing a message from a simulation thread is a copy into a ring
+// buffer of the thread, which takes no lock. The messages of each thread
+// keep their order, and the threads' messages are merged by the time they
+// were written.
+//
+// A thread whose ring buffer is full drops its messages, and at most
+// max_messages_per_sec messages are forwarded, if positive. Dropped
+// messages are counted and reported to the forwarded log about once per
+// second as a warning.
+class DLL_PUBLIC AsyncLog : public ILog {
+public:
+    typedef std::shared_ptr<AsyncLog> s_ptr;
+
+    explicit AsyncLog(ILog::ptr forward_log, size_t ring_capacity = 1024, size_t max_messages_per_sec = 0,
+                      int flush_interval_ms = 10);
+
+    // Forwards the messages that are still queued.
+    virtual ~AsyncLog();
+
+    // Can be called from any thread.
+    virtual void write(LogType type, const std::string& msg) override;
+
+    // Wait until the messages written before the call are forwarded.
+    void flush();
+
+    // The number of messages dropped so far.
+    size_t get_num_dropped() const {
+        return m_num_dropped.load();
+    }
+
+private:
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    struct Record;
+    struct Ring;
+
+    // The ring buffer of the calling thread, created on its first message.
+    Ring& thread_ring();
+
+    void drain_loop();
+
+    // Forward the queued messages of the rings.
+    void drain(const std::vector<std::shared_ptr<Ring>>& rings, bool report_drops);
+
+private:
+    ILog::ptr                           m_forward_log;
+    size_t                              m_ring_capacity;
+    size_t                              m_max_messages_per_sec;
+    int                                 m_flush_interval_ms;
+    // identifies the log in the threads' lists of rings
+    uint64_t                            m_log_id;
+    std::atomic<size_t>                 m_num_dropped;
+
+    // Only accessed by the drain thread.
+    double                              m_rate_tokens;
+    std::chrono::steady_clock::time_point m_last_drain;
+    std::chrono::steady_clock::time_point m_last_drop_report;
+    size_t                              m_num_reported_drops;
+
+    // m_mutex guards the following. A flush is done when the number of
+    // completed flushes reaches the number requested before it.
+    std::mutex                          m_mutex;
+    std::condition_variable             m_cond;
+    std::condition_variable             m_flush_cond;
+    std::vector<std::shared_ptr<Ring>>  m_rings;
+    uint64_t                            m_flushes_requested;
+    uint64_t                            m_flushes_completed;
+    bool                                m_stop;
+
+    std::thread                         m_drain_thread;
+};
+
+}   // end namespace
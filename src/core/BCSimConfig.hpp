@@ -28,12 +28,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <stdexcept>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 #include "export_macros.hpp"
 #include "vector3.hpp"
+#include "matrix3.hpp"
+#include "philox.hpp"
 
 #ifdef __GNUC__
 #if (__GNUC__ <= 4) && (__GNUC__MINOR <= 8)
@@ -91,6 +97,90 @@ struct ExcitationSignal {
     float demod_freq;
 };
 
+// Conversion of a frame of IQ lines to an 8-bit B-mode image: envelope
+// detection, log-compression and bilinear scan conversion.
+struct BModeImageConfig {
+    BModeImageConfig()
+        : sector(false), beam_min(0.0f), beam_max(0.0f), range_max(0.0f),
+          x_min(0.0f), x_max(0.0f), y_min(0.0f), y_max(0.0f), width(0), height(0),
+          dyn_range(50.0f), gain(1.0f), normalize_const(1.0f), auto_normalize(true) { }
+
+    // Beam space: line i is at lateral position beam_min + i*(beam_max-beam_min)/(num_lines-1)
+    // and IQ sample j at range j*range_max/(num_samples-1). For a sector the lateral
+    // position is the angle atan2(y, x) [radians] and range is the distance to the
+    // origin, otherwise they are x and y [meters].
+    bool    sector;
+    float   beam_min;
+    float   beam_max;
+    float   range_max;
+
+    // Image extent [meters] and size [pixels]. Pixel (xi, yi) is at
+    // x_min + xi*(x_max-x_min)/(width-1), y_min + yi*(y_max-y_min)/(height-1).
+    float   x_min;
+    float   x_max;
+    float   y_min;
+    float   y_max;
+    int     width;
+    int     height;
+
+    // Grayscale transform. The envelope is normalized by its maximum value in
+    // the frame if auto_normalize is set and by normalize_const otherwise.
+    float   dyn_range;      // [dB]
+    float   gain;
+    float   normalize_const;
+    bool    auto_normalize;
+};
+
+// Sample format of the IQ lines of IAlgorithm::simulate_lines_formatted()
+// (see iq_format.hpp). The half-precision and 16-bit integer formats store
+// the real part followed by the imaginary part in four bytes per sample.
+struct IqOutputFormat {
+    enum class SampleType : uint32_t {
+        COMPLEX_FLOAT32 = 0,    // std::complex<float>
+        COMPLEX_FLOAT16 = 1,    // IEEE 754 binary16, rounded to nearest even
+        COMPLEX_INT16   = 2     // round(int16_scale*value), saturated to +-32767
+    };
+
+    IqOutputFormat()
+        : sample_type(SampleType::COMPLEX_FLOAT32), int16_scale(0.0f) { }
+
+    SampleType  sample_type;
+
+    // Scale of COMPLEX_INT16. Zero scales each frame so that its largest
+    // absolute real or imaginary part becomes 32767.
+    float       int16_scale;
+};
+
+// Memory allocated by a simulator [bytes] per category, e.g.
+// "fixed_scatterers" or "time_projections", for pageable host memory,
+// page-locked (pinned) host memory and CUDA device memory. The device
+// categories of simulators using several devices are prefixed with
+// "gpu<device number>/".
+struct MemoryUsage {
+    std::map<std::string, size_t>   host;
+    std::map<std::string, size_t>   pinned;
+    std::map<std::string, size_t>   device;
+
+    size_t total_host() const   { return total(host); }
+    size_t total_pinned() const { return total(pinned); }
+    size_t total_device() const { return total(device); }
+
+    // Add the memory of other to this, e.g. of a part of a simulator. The
+    // prefix is prepended to the device categories of other.
+    void add(const MemoryUsage& other, const std::string& device_prefix = "") {
+        for (const auto& entry : other.host) host[entry.first] += entry.second;
+        for (const auto& entry : other.pinned) pinned[entry.first] += entry.second;
+        for (const auto& entry : other.device) device[device_prefix + entry.first] += entry.second;
+    }
+
+private:
+    static size_t total(const std::map<std::string, size_t>& categories) {
+        size_t res = 0;
+        for (const auto& entry : categories) res += entry.second;
+        return res;
+    }
+};
+
 // Description of a single point scatterer.
 struct PointScatterer {
     // Position in space
@@ -120,6 +210,288 @@ struct FixedScatterers : public Scatterers {
     std::vector<PointScatterer> scatterers;
 };
 
+// Stationary speckle scatterers uniformly distributed in a box or an
+// ellipsoid, with random amplitudes. The scatterers are not stored: scatterer
+// i is a pure function of i and the seed (see get_scatterer()), so that
+// simulators can generate them on the fly while projecting.
+struct ProceduralScatterers : public Scatterers {
+    typedef std::shared_ptr<ProceduralScatterers> s_ptr;
+
+    enum class Region : uint32_t {
+        BOX = 0,
+        ELLIPSOID
+    };
+
+    enum class AmplitudeDistribution : uint32_t {
+        GAUSSIAN = 0,   // zero mean, standard deviation amplitude_scale
+        UNIFORM,        // in [-amplitude_scale, amplitude_scale]
+        CONSTANT        // amplitude_scale
+    };
+
+    ProceduralScatterers()
+        : region(Region::BOX), center(0.0f, 0.0f, 0.0f), half_axes(0.0f, 0.0f, 0.0f), count(0),
+          amplitude_distribution(AmplitudeDistribution::GAUSSIAN), amplitude_scale(1.0f), seed(0) { }
+
+    virtual int num_scatterers() const {
+        return static_cast<int>(count);
+    }
+
+    // Volume of the region [m^3].
+    double volume() const {
+        const auto box_volume = 8.0*half_axes.x*half_axes.y*half_axes.z;
+        return (region == Region::BOX) ? box_volume : box_volume*std::atan(1.0)*2.0/3.0;
+    }
+
+    // Set the number of scatterers from a density [scatterers per m^3].
+    void set_density(double scatterers_per_m3) {
+        count = static_cast<size_t>(std::llround(scatterers_per_m3*volume()));
+    }
+
+    // Scatterer i of the dataset. The four words of one Philox counter give
+    // three 24-bit uniforms for the position and the amplitude.
+    PointScatterer get_scatterer(size_t i) const {
+        const float INV_2_24 = 1.0f/16777216.0f;
+        const float TWO_PI   = 6.283185307179586f;
+        const philox::Key key{{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}};
+        const auto bits = philox::philox4x32(philox::Counter{{static_cast<uint32_t>(i), static_cast<uint32_t>(uint64_t(i) >> 32), 0u, 0u}}, key);
+        const auto uniform = [INV_2_24](uint32_t word) {
+            return (static_cast<float>(word >> 8) + 0.5f)*INV_2_24;
+        };
+        vector3 local;
+        if (region == Region::BOX) {
+            local = vector3(2.0f*uniform(bits[0]) - 1.0f, 2.0f*uniform(bits[1]) - 1.0f, 2.0f*uniform(bits[2]) - 1.0f);
+        } else {
+            // uniform in the unit ball: cube root of the radius, uniform cosine of the polar angle
+            const float radius    = std::cbrt(uniform(bits[0]));
+            const float cos_theta = 2.0f*uniform(bits[1]) - 1.0f;
+            const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta*cos_theta));
+            const float phi       = TWO_PI*uniform(bits[2]);
+            local = vector3(sin_theta*std::cos(phi), sin_theta*std::sin(phi), cos_theta)*radius;
+        }
+        PointScatterer scatterer;
+        scatterer.pos = center + axes*vector3(local.x*half_axes.x, local.y*half_axes.y, local.z*half_axes.z);
+        scatterer.amplitude = draw_amplitude(amplitude_distribution, amplitude_scale, bits[3]);
+        return scatterer;
+    }
+
+    // Amplitude from one random word.
+    static float draw_amplitude(AmplitudeDistribution distribution, float scale, uint32_t word) {
+        const float INV_2_24 = 1.0f/16777216.0f;
+        const float INV_2_16 = 1.0f/65536.0f;
+        const float TWO_PI   = 6.283185307179586f;
+        switch (distribution) {
+        case AmplitudeDistribution::GAUSSIAN: {
+            // Box-Muller with the 16-bit halves of the word, u in (0, 1]
+            const float u1 = static_cast<float>((word >> 16) + 1)*INV_2_16;
+            const float u2 = static_cast<float>(word & 0xFFFFu)*INV_2_16;
+            return scale*std::sqrt(-2.0f*std::log(u1))*std::cos(TWO_PI*u2);
+        }
+        case AmplitudeDistribution::UNIFORM:
+            return scale*(2.0f*((static_cast<float>(word >> 8) + 0.5f)*INV_2_24) - 1.0f);
+        default:
+            return scale;
+        }
+    }
+
+    // Explicit copy of all scatterers, for simulators that only project
+    // stored scatterers.
+    FixedScatterers::s_ptr expand() const {
+        auto res = std::make_shared<FixedScatterers>();
+        res->scatterers.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            res->scatterers[i] = get_scatterer(i);
+        }
+        return res;
+    }
+
+    Region                  region;
+    vector3                 center;
+    // Half side lengths of the box or semi-axes of the ellipsoid [m], along
+    // the columns of axes.
+    vector3                 half_axes;
+    Matrix3                 axes;
+    size_t                  count;
+    AmplitudeDistribution   amplitude_distribution;
+    float                   amplitude_scale;
+    uint64_t                seed;
+};
+
+// Stationary speckle scatterers sampled from a voxel volume such as a
+// segmented CT or MR volume, where every voxel has a scatterer density and an
+// amplitude scale. Like ProceduralScatterers only the volume is stored: the
+// number of scatterers in a voxel, and their positions and amplitudes, are
+// pure functions of the voxel, the scatterer's number in the voxel and the
+// seed. The scatterers are numbered voxel by voxel with x fastest, so the
+// scatterers of a run of voxels along x are contiguous. Call update_counts()
+// after changing the volume.
+struct ImageVolumeScatterers : public Scatterers {
+    typedef std::shared_ptr<ImageVolumeScatterers> s_ptr;
+
+    ImageVolumeScatterers()
+        : origin(0.0f, 0.0f, 0.0f), voxel_size(0.0f, 0.0f, 0.0f), nx(0), ny(0), nz(0),
+          amplitude_distribution(ProceduralScatterers::AmplitudeDistribution::GAUSSIAN), seed(0) { }
+
+    virtual int num_scatterers() const {
+        return static_cast<int>(get_count());
+    }
+
+    size_t get_count() const {
+        return voxel_starts.empty() ? 0 : static_cast<size_t>(voxel_starts.back());
+    }
+
+    size_t get_num_voxels() const {
+        return static_cast<size_t>(nx)*static_cast<size_t>(ny)*static_cast<size_t>(nz);
+    }
+
+    size_t voxel_index(int ix, int iy, int iz) const {
+        return (static_cast<size_t>(iz)*static_cast<size_t>(ny) + static_cast<size_t>(iy))*static_cast<size_t>(nx) + static_cast<size_t>(ix);
+    }
+
+    // Draw the number of scatterers in every voxel, density times voxel
+    // volume rounded up or down at random so that the expected count is
+    // exact, and number them. Throws std::runtime_error if the volume is
+    // inconsistent.
+    void update_counts() {
+        const auto num_voxels = get_num_voxels();
+        if (nx < 0 || ny < 0 || nz < 0 || densities.size() != num_voxels || amplitude_scales.size() != num_voxels) {
+            throw std::runtime_error("image volume size does not match the number of voxels");
+        }
+        const double voxel_volume = static_cast<double>(voxel_size.x)*voxel_size.y*voxel_size.z;
+        voxel_starts.resize(num_voxels + 1);
+        voxel_starts[0] = 0;
+        for (size_t v = 0; v < num_voxels; v++) {
+            const auto bits = philox::philox4x32(voxel_counter(v, 0u), key());
+            const double expected = std::max(0.0, static_cast<double>(densities[v])*voxel_volume);
+            const double u = (static_cast<double>(bits[0] >> 8) + 0.5)/16777216.0;
+            voxel_starts[v + 1] = voxel_starts[v] + static_cast<uint64_t>(std::floor(expected + u));
+        }
+    }
+
+    // Scatterer j of voxel v, uniform in the voxel.
+    PointScatterer get_voxel_scatterer(size_t v, size_t j) const {
+        const float INV_2_24 = 1.0f/16777216.0f;
+        const auto bits = philox::philox4x32(voxel_counter(v, static_cast<uint32_t>(j) + 1u), key());
+        const auto uniform = [INV_2_24](uint32_t word) {
+            return (static_cast<float>(word >> 8) + 0.5f)*INV_2_24;
+        };
+        const auto ix = v % static_cast<size_t>(nx);
+        const auto iy = (v/static_cast<size_t>(nx)) % static_cast<size_t>(ny);
+        const auto iz = v/(static_cast<size_t>(nx)*static_cast<size_t>(ny));
+        PointScatterer scatterer;
+        scatterer.pos = vector3(origin.x + voxel_size.x*(static_cast<float>(ix) + uniform(bits[0])),
+                                origin.y + voxel_size.y*(static_cast<float>(iy) + uniform(bits[1])),
+                                origin.z + voxel_size.z*(static_cast<float>(iz) + uniform(bits[2])));
+        scatterer.amplitude = ProceduralScatterers::draw_amplitude(amplitude_distribution, amplitude_scales[v], bits[3]);
+        return scatterer;
+    }
+
+    // The voxel of scatterer i.
+    size_t find_voxel(size_t i) const {
+        const auto next = std::upper_bound(voxel_starts.begin(), voxel_starts.end(), static_cast<uint64_t>(i));
+        return static_cast<size_t>(next - voxel_starts.begin()) - 1;
+    }
+
+    // Scatterer i of the dataset.
+    PointScatterer get_scatterer(size_t i) const {
+        const auto v = find_voxel(i);
+        return get_voxel_scatterer(v, i - static_cast<size_t>(voxel_starts[v]));
+    }
+
+    // Write the scatterers [begin, end) to the arrays, walking the voxels
+    // instead of searching for every scatterer.
+    void generate(size_t begin, size_t end, float* xs, float* ys, float* zs, float* as) const {
+        if (begin >= end) {
+            return;
+        }
+        auto v = find_voxel(begin);
+        for (size_t i = begin; i < end; i++) {
+            while (voxel_starts[v + 1] <= i) {
+                v++;
+            }
+            const auto scatterer = get_voxel_scatterer(v, i - static_cast<size_t>(voxel_starts[v]));
+            xs[i - begin] = scatterer.pos.x;
+            ys[i - begin] = scatterer.pos.y;
+            zs[i - begin] = scatterer.pos.z;
+            as[i - begin] = scatterer.amplitude;
+        }
+    }
+
+    // Explicit copy of all scatterers, for simulators that only project
+    // stored scatterers.
+    FixedScatterers::s_ptr expand() const {
+        auto res = std::make_shared<FixedScatterers>();
+        res->scatterers.resize(get_count());
+        size_t i = 0;
+        for (size_t v = 0; v + 1 < voxel_starts.size(); v++) {
+            for (size_t j = 0; j < voxel_starts[v + 1] - voxel_starts[v]; j++) {
+                res->scatterers[i++] = get_voxel_scatterer(v, j);
+            }
+        }
+        return res;
+    }
+
+    // Lower corner of voxel (0, 0, 0) [m].
+    vector3                 origin;
+    vector3                 voxel_size;
+    int                     nx;
+    int                     ny;
+    int                     nz;
+    // Scatterers per m^3 and amplitude scale of every voxel, at
+    // voxel_index(ix, iy, iz).
+    std::vector<float>      densities;
+    std::vector<float>      amplitude_scales;
+    ProceduralScatterers::AmplitudeDistribution amplitude_distribution;
+    uint64_t                seed;
+    // Number of the first scatterer of every voxel and the total count, from
+    // update_counts().
+    std::vector<uint64_t>   voxel_starts;
+
+private:
+    philox::Key key() const {
+        return philox::Key{{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}};
+    }
+
+    // The last word keeps the streams of the counts (0) and the scatterers
+    // apart from each other and from ProceduralScatterers.
+    static philox::Counter voxel_counter(size_t v, uint32_t word) {
+        return philox::Counter{{static_cast<uint32_t>(v), static_cast<uint32_t>(uint64_t(v) >> 32), 1u, word}};
+    }
+};
+
+// Stationary scatterers in read-only memory owned by someone else, e.g. a
+// memory-mapped binary phantom or a shared memory segment used by several
+// processes, as a structure of arrays. owner keeps the memory alive for as
+// long as a simulator references the dataset.
+struct ExternalFixedScatterers : public Scatterers {
+    typedef std::shared_ptr<ExternalFixedScatterers> s_ptr;
+
+    ExternalFixedScatterers()
+        : xs(nullptr), ys(nullptr), zs(nullptr), as(nullptr), count(0) { }
+
+    virtual int num_scatterers() const {
+        return static_cast<int>(count);
+    }
+
+    // Explicit copy of all scatterers, for simulators that only project
+    // scatterers they own.
+    FixedScatterers::s_ptr expand() const {
+        auto res = std::make_shared<FixedScatterers>();
+        res->scatterers.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            res->scatterers[i].pos = vector3(xs[i], ys[i], zs[i]);
+            res->scatterers[i].amplitude = as[i];
+        }
+        return res;
+    }
+
+    const float*            xs;
+    const float*            ys;
+    const float*            zs;
+    const float*            as;
+    size_t                  count;
+    std::shared_ptr<const void> owner;
+};
+
 // Scatterers follow trajectory described by splines.
 // All splines have the same degree and are defined on the same
 // knot vector to save memory.
@@ -127,9 +499,10 @@ struct SplineScatterers : public Scatterers {
     typedef std::unique_ptr<SplineScatterers> u_ptr;
     typedef std::shared_ptr<SplineScatterers> s_ptr;
 
+    SplineScatterers() : spline_degree(0), m_num_control_points(0) { }
+
     virtual int num_scatterers() const {
-        // assert(control_points.size() == amplitudes.size());
-        return static_cast<int>(control_points.size());
+        return static_cast<int>(amplitudes.size());
     }
 
     // Returns the number of control points for each spline
@@ -138,7 +511,71 @@ struct SplineScatterers : public Scatterers {
         if (num_scatterers() == 0) {
             throw std::runtime_error("No scatterers in dataset");
         }
-        return control_points[0].size();
+        return m_num_control_points;
+    }
+
+    // Allocate storage for num_splines scatterers with num_cs control
+    // points each. All control points and amplitudes are set to zero.
+    void resize(size_t num_splines, size_t num_cs) {
+        m_num_control_points = num_cs;
+        control_xs.assign(num_splines*num_cs, 0.0f);
+        control_ys.assign(num_splines*num_cs, 0.0f);
+        control_zs.assign(num_splines*num_cs, 0.0f);
+        amplitudes.assign(num_splines, 0.0f);
+    }
+
+    // Index into control_xs, control_ys, and control_zs of control point
+    // cs_no of scatterer spline_no.
+    size_t control_point_index(size_t spline_no, size_t cs_no) const {
+        return cs_no*amplitudes.size() + spline_no;
+    }
+
+    vector3 get_control_point(size_t spline_no, size_t cs_no) const {
+        const auto idx = control_point_index(spline_no, cs_no);
+        return vector3(control_xs[idx], control_ys[idx], control_zs[idx]);
+    }
+
+    void set_control_point(size_t spline_no, size_t cs_no, const vector3& pos) {
+        const auto idx = control_point_index(spline_no, cs_no);
+        control_xs[idx] = pos.x;
+        control_ys[idx] = pos.y;
+        control_zs[idx] = pos.z;
+    }
+
+    // Compatibility with the removed control_points member, which was
+    // indexed by scatterer no. and then control point no. Both copy all
+    // control points; set_control_points() keeps the amplitudes of the
+    // scatterers that remain.
+    [[deprecated("use get_control_point()")]]
+    std::vector<std::vector<vector3>> get_control_points() const {
+        std::vector<std::vector<vector3>> res(amplitudes.size());
+        for (size_t spline_no = 0; spline_no < res.size(); spline_no++) {
+            res[spline_no].resize(m_num_control_points);
+            for (size_t cs_no = 0; cs_no < m_num_control_points; cs_no++) {
+                res[spline_no][cs_no] = get_control_point(spline_no, cs_no);
+            }
+        }
+        return res;
+    }
+
+    [[deprecated("use resize() and set_control_point()")]]
+    void set_control_points(const std::vector<std::vector<vector3>>& control_points) {
+        const auto num_splines = control_points.size();
+        const auto num_cs = (num_splines > 0) ? control_points[0].size() : 0;
+        for (const auto& points : control_points) {
+            if (points.size() != num_cs) {
+                throw std::runtime_error("all spline scatterers must have the same number of control points");
+            }
+        }
+        auto old_amplitudes = amplitudes;
+        old_amplitudes.resize(num_splines, 0.0f);
+        resize(num_splines, num_cs);
+        amplitudes = old_amplitudes;
+        for (size_t spline_no = 0; spline_no < num_splines; spline_no++) {
+            for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
+                set_control_point(spline_no, cs_no, control_points[spline_no][cs_no]);
+            }
+        }
     }
 
     // returns the start time
@@ -158,10 +595,17 @@ struct SplineScatterers : public Scatterers {
     int                         spline_degree;
     std::vector<float>          knot_vector;
     
-    // For each scatterer: list of control points in space and a scalar amplitude
-    // Indexed by scatterer no.
-    std::vector<std::vector<vector3>> control_points;
-    std::vector<float>                amplitudes;
+    // Control point coordinates stored as a structure of arrays, with all
+    // scatterers' values for control point 0 first, then control point 1,
+    // etc. This is the same layout as used on the GPU. Use resize() before
+    // setting values. The scalar amplitude is indexed by scatterer no.
+    std::vector<float>          control_xs;
+    std::vector<float>          control_ys;
+    std::vector<float>          control_zs;
+    std::vector<float>          amplitudes;
+
+private:
+    size_t                      m_num_control_points;
 };
 
 
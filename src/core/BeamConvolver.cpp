@@ -31,24 +31,346 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <complex>
 #include <algorithm>
 #include <functional>
+#include <cmath>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#ifdef BCSIM_ENABLE_FFTW
+    #include <fftw3.h>
+#endif
+#if defined(__AVX512F__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
 #include "discrete_hilbert_mask.hpp"
 #include "fft.hpp"
 #include "BeamConvolver.hpp"
+#include "Tracing.hpp"
+#include "ScratchArena.hpp"
+#include "algorithm/common_utils.hpp" // for same_excitation
 
 namespace bcsim {
 
+// Read-only tables which only depend on the arguments of a convolver. They
+// are shared by all convolvers created with the same arguments, e.g. the
+// convolvers of the threads of a simulator, instead of being computed and
+// stored once per convolver.
+struct ConvolverTables {
+    typedef std::shared_ptr<const ConvolverTables> s_ptr;
+
+    // Hilbert-transformed FFT of the zero-padded excitation, times a scale
+    // factor for unnormalized inverse transforms.
+    AlignedVector<std::complex<float>>  excitation_fft;
+    // Demodulation phasor for every output sample
+    AlignedVector<std::complex<float>>  phasors;
+    // The analytic excitation, i.e. the inverse transform of the unscaled
+    // excitation_fft, truncated to the lags first_tap_lag..last_tap_lag
+    // (first_tap_lag <= 0) which hold all but a fraction
+    // DIRECT_TRUNCATION_TOLERANCE of its energy. Stored in reverse order
+    // with split real and imaginary parts for the direct convolver.
+    AlignedVector<float>                reversed_taps_re;
+    AlignedVector<float>                reversed_taps_im;
+    int                                 first_tap_lag;
+    int                                 last_tap_lag;
+    // Every radial_decimation'th of the taps, at the lags excitation delay
+    // + q*radial_decimation for q = first_baseband_tap..last_baseband_tap,
+    // for convolving time-projections on the decimated grid. Also reversed.
+    AlignedVector<float>                reversed_baseband_taps_re;
+    AlignedVector<float>                reversed_baseband_taps_im;
+    int                                 first_baseband_tap;
+    int                                 last_baseband_tap;
+};
+
+namespace {
+
+// Transform length for a linear convolution of the time-projections with
+// the excitation. Even, so that real-input transforms can be used.
+size_t convolution_fft_length(size_t num_proj_samples, const ExcitationSignal& excitation) {
+    return next_smooth_size(num_proj_samples + excitation.samples.size() - 1, 2);
+}
+
+// Relative energy of the analytic excitation which the direct convolver may
+// ignore, i.e. the truncation error is about -80 dB.
+const double DIRECT_TRUNCATION_TOLERANCE = 1e-8;
+
+// Truncate the circular analytic excitation to the shortest window of lags
+// around the excitation samples which keeps all but the tolerated energy.
+void compute_direct_taps(const AlignedVector<std::complex<float>>& analytic, size_t num_excitation_samples,
+                         ConvolverTables& tables) {
+    const auto length = static_cast<int>(analytic.size());
+    const auto energy = [&](int lag) {
+        return static_cast<double>(std::norm(analytic[static_cast<size_t>((lag + length) % length)]));
+    };
+    double total_energy = 0.0;
+    for (int lag = 0; lag < length; lag++) {
+        total_energy += energy(lag);
+    }
+    int first = 0;
+    int last = std::min(static_cast<int>(num_excitation_samples), length) - 1;
+    double kept_energy = 0.0;
+    for (int lag = first; lag <= last; lag++) {
+        kept_energy += energy(lag);
+    }
+    while ((last - first + 1 < length) && (total_energy - kept_energy > DIRECT_TRUNCATION_TOLERANCE*total_energy)) {
+        // grow towards the larger of the two neighbouring samples
+        if (energy(first - 1) > energy(last + 1)) {
+            kept_energy += energy(--first);
+        } else {
+            kept_energy += energy(++last);
+        }
+    }
+    tables.first_tap_lag = first;
+    tables.last_tap_lag = last;
+    for (int lag = last; lag >= first; lag--) {
+        const auto tap = analytic[static_cast<size_t>((lag + length) % length)];
+        tables.reversed_taps_re.push_back(tap.real());
+        tables.reversed_taps_im.push_back(tap.imag());
+    }
+}
+
+// Pick the taps at the decimated grid positions around the excitation delay.
+// The demodulation phasor of a decimated sample equals the phasor of the RF
+// sample at the same time, so the analytic taps are used as they are.
+void compute_baseband_taps(int excitation_delay, int radial_decimation, ConvolverTables& tables) {
+    tables.first_baseband_tap = 0;
+    tables.last_baseband_tap = 0;
+    bool found = false;
+    for (int lag = tables.last_tap_lag; lag >= tables.first_tap_lag; lag--) {
+        const auto offset = lag - excitation_delay;
+        if (((offset % radial_decimation) + radial_decimation) % radial_decimation != 0) {
+            continue;
+        }
+        const auto q = offset/radial_decimation;
+        if (!found) {
+            tables.last_baseband_tap = q;
+            found = true;
+        }
+        tables.first_baseband_tap = q;
+        const auto index = static_cast<size_t>(tables.last_tap_lag - lag);
+        tables.reversed_baseband_taps_re.push_back(tables.reversed_taps_re[index]);
+        tables.reversed_baseband_taps_im.push_back(tables.reversed_taps_im[index]);
+    }
+    if (!found) {
+        // the excitation delay is outside of the taps, so no energy lands on the grid
+        tables.reversed_baseband_taps_re.push_back(0.0f);
+        tables.reversed_baseband_taps_im.push_back(0.0f);
+    }
+}
+
+ConvolverTables::s_ptr create_convolver_tables(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                               int radial_decimation, float spectrum_scale) {
+    auto tables = std::make_shared<ConvolverTables>();
+
+    const auto fft_length = convolution_fft_length(num_proj_samples, excitation);
+    auto& excitation_fft = tables->excitation_fft;
+    excitation_fft.assign(fft_length, std::complex<float>(0.0f, 0.0f));
+    std::transform(std::begin(excitation.samples), std::end(excitation.samples), std::begin(excitation_fft), [](float v) {
+        return std::complex<float>(v, 0.0f);
+    });
+    FftPlan<float>::get(fft_length)->forward(excitation_fft.data());
+
+    // Hilbert transform is implemented by zeroing out negative frequencies in FFT of excitation.
+    const auto hilbert_mask = discrete_hilbert_mask<float>(fft_length);
+    for (size_t i = 0; i < fft_length; i++) {
+        excitation_fft[i] *= hilbert_mask[i];
+    }
+    auto analytic = excitation_fft;
+    FftPlan<float>::get(fft_length)->inverse(analytic.data());
+    compute_direct_taps(analytic, excitation.samples.size(), *tables);
+    compute_baseband_taps(excitation.center_index, radial_decimation, *tables);
+    for (auto& bin : excitation_fft) {
+        bin *= spectrum_scale;
+    }
+
+    const auto decimation = static_cast<size_t>(radial_decimation);
+    const auto num_output_samples = (num_proj_samples + decimation - 1)/decimation;
+    const double norm_f_demod = excitation.demod_freq/excitation.sampling_frequency;
+    const double TWO_PI = 2.0*4.0*std::atan(1.0);
+    tables->phasors.resize(num_output_samples);
+    for (size_t i = 0; i < num_output_samples; i++) {
+        const double angle = -TWO_PI*norm_f_demod*static_cast<double>(i*decimation);
+        tables->phasors[i] = std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+    }
+    return tables;
+}
+
+// Get the tables from a cache which holds them as long as any convolver
+// uses them. Thread-safe.
+ConvolverTables::s_ptr get_convolver_tables(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                            int radial_decimation, float spectrum_scale) {
+    if (radial_decimation <= 0) {
+        throw std::runtime_error("illegal radial decimation value");
+    }
+    struct CacheEntry {
+        size_t                                  num_proj_samples;
+        ExcitationSignal                        excitation;
+        int                                     radial_decimation;
+        float                                   spectrum_scale;
+        std::weak_ptr<const ConvolverTables>    tables;
+    };
+    static std::mutex cache_mutex;
+    static std::vector<CacheEntry> cache;
+
+    std::lock_guard<std::mutex> guard(cache_mutex);
+    cache.erase(std::remove_if(cache.begin(), cache.end(), [](const CacheEntry& entry) {
+        return entry.tables.expired();
+    }), cache.end());
+    for (const auto& entry : cache) {
+        if ((entry.num_proj_samples == num_proj_samples) && (entry.radial_decimation == radial_decimation)
+            && (entry.spectrum_scale == spectrum_scale) && same_excitation(entry.excitation, excitation)) {
+            if (auto tables = entry.tables.lock()) {
+                return tables;
+            }
+        }
+    }
+    auto tables = create_convolver_tables(num_proj_samples, excitation, radial_decimation, spectrum_scale);
+    cache.push_back(CacheEntry{num_proj_samples, excitation, radial_decimation, spectrum_scale, tables});
+    return tables;
+}
+
+}   // namespace
+
+// Final stage common to all convolvers: Compensates for the delay introduced
+// by the excitation, IQ demodulates with a precomputed phasor table and
+// decimates. Only the samples that are kept are ever computed.
+class IqOutputStage {
+public:
+    IqOutputStage(const ConvolverTables::s_ptr& tables, const ExcitationSignal& excitation, int radial_decimation)
+        : m_radial_decimation(static_cast<size_t>(radial_decimation)),
+          m_excitation_delay(static_cast<size_t>(excitation.center_index)),
+          m_tables(tables)
+    {
+    }
+
+    size_t get_num_output_samples() const {
+        return m_tables->phasors.size();
+    }
+
+    // analytic_signal: The convolved signal, indexing is before delay compensation
+    void write(const std::complex<float>* analytic_signal, std::complex<float>* out) const {
+        const auto start = analytic_signal + m_excitation_delay;
+        const auto& phasors = m_tables->phasors;
+        const auto num_output_samples = phasors.size();
+        for (size_t i = 0; i < num_output_samples; i++) {
+            out[i] = start[i*m_radial_decimation]*phasors[i];
+        }
+    }
+
+private:
+    size_t                              m_radial_decimation;
+    size_t                              m_excitation_delay;   // Compensation offset needed since time zero in the middle.
+    ConvolverTables::s_ptr              m_tables;
+};
+
+// Sparse path of the FFT-based convolvers. Finds the non-zero samples of the
+// time-projections and, if there are few, writes the output directly as the
+// sum of the taps of the direct convolver shifted to each sample, which
+// skips the transforms of the whole padded line.
+class SparseSynthesis {
+public:
+    SparseSynthesis(const ConvolverTables::s_ptr& tables, const ExcitationSignal& excitation, bool real_input,
+                    int radial_decimation)
+        : m_threshold(0),
+          m_real_input(real_input),
+          m_radial_decimation(radial_decimation),
+          m_excitation_delay(excitation.center_index),
+          m_tables(tables),
+          m_active(false)
+    {
+    }
+
+    void set_threshold(size_t max_nonzero_samples) {
+        m_threshold = max_nonzero_samples;
+        m_indices.reserve(m_threshold);
+        m_values.reserve(m_threshold);
+    }
+
+    // Collect the non-zero samples. Returns false, and the line must be
+    // convolved as usual, if there are more than the threshold.
+    bool collect(const std::complex<float>* time_proj, size_t num_samples) {
+        m_indices.clear();
+        m_values.clear();
+        m_active = false;
+        if (m_threshold == 0) {
+            return false;
+        }
+        for (size_t i = 0; i < num_samples; i++) {
+            const auto value = m_real_input ? std::complex<float>(time_proj[i].real(), 0.0f) : time_proj[i];
+            if ((value.real() != 0.0f) || (value.imag() != 0.0f)) {
+                if (m_indices.size() == m_threshold) {
+                    return false;
+                }
+                m_indices.push_back(static_cast<long>(i));
+                m_values.push_back(value);
+            }
+        }
+        m_active = true;
+        return true;
+    }
+
+    // True if the last collect() succeeded.
+    bool is_active() const {
+        return m_active;
+    }
+
+    // Demodulated output of the collected samples.
+    void write(std::complex<float>* out) const {
+        const auto& phasors = m_tables->phasors;
+        const auto num_output_samples = static_cast<long>(phasors.size());
+        std::fill(out, out + num_output_samples, std::complex<float>(0.0f, 0.0f));
+        const long first_lag = m_tables->first_tap_lag;
+        const long last_lag = m_tables->last_tap_lag;
+        const long step = m_radial_decimation;
+        const auto floor_div = [step](long a) {
+            return (a >= 0) ? a/step : -((-a + step - 1)/step);
+        };
+        const auto& taps_re = m_tables->reversed_taps_re;
+        const auto& taps_im = m_tables->reversed_taps_im;
+        for (size_t k = 0; k < m_indices.size(); k++) {
+            // output sample i is at delay + i*step and gets the tap at lag
+            // delay + i*step - n of sample n
+            const auto n = m_indices[k];
+            const auto value = m_values[k];
+            const auto first = std::max(0L, -floor_div(m_excitation_delay - n - first_lag));
+            const auto last = std::min(num_output_samples - 1, floor_div(n + last_lag - m_excitation_delay));
+            for (long i = first; i <= last; i++) {
+                const auto tap_no = static_cast<size_t>(last_lag - (m_excitation_delay + i*step - n));
+                out[i] += value*std::complex<float>(taps_re[tap_no], taps_im[tap_no]);
+            }
+        }
+        for (long i = 0; i < num_output_samples; i++) {
+            out[i] *= phasors[i];
+        }
+    }
+
+private:
+    size_t                              m_threshold;
+    bool                                m_real_input;
+    long                                m_radial_decimation;
+    long                                m_excitation_delay;
+    ConvolverTables::s_ptr              m_tables;
+    bool                                m_active;
+    std::vector<long>                   m_indices;            // of the non-zero samples
+    std::vector<std::complex<float>>    m_values;
+};
+
 // Beam-convolver with built-in Hilbert transform.
 class BeamConvolver : public IBeamConvolver {
 public:
     // num_proj_samples: Number of time-projection samples
     // excitation: The RF excitation
-    BeamConvolver(size_t num_proj_samples, const ExcitationSignal& excitation)
-        : m_num_proj_samples(num_proj_samples)
+    // real_input: Only the real part of the time-projections is used.
+    // radial_decimation: Decimation factor of the output IQ samples.
+    BeamConvolver(size_t num_proj_samples, const ExcitationSignal& excitation, bool real_input, int radial_decimation)
+        : m_num_proj_samples(num_proj_samples),
+          m_tables(get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f)),
+          m_output_stage(m_tables, excitation, radial_decimation),
+          m_sparse(m_tables, excitation, real_input, radial_decimation)
     {
-        const auto num_conv_samples = num_proj_samples + excitation.samples.size() - 1;
-        m_fft_length = next_power_of_two(num_conv_samples);
-        precompute_excitation_fft(excitation);
-        m_excitation_delay = static_cast<size_t>(excitation.center_index);
+        m_fft_length = m_tables->excitation_fft.size();
+        m_fft_plan = FftPlan<float>::get(m_fft_length);
+        if (real_input && (m_fft_length >= 2)) {
+            m_real_fft_plan = RealFftPlan<float>::get(m_fft_length);
+        }
 
         // Padded with zeros, the first num_proj_samples will be used in algorithm's projection loop.
         m_time_proj_buffer.resize(m_fft_length);
@@ -59,48 +381,588 @@ public:
         return m_time_proj_buffer.data();
     }
 
-    // Use contents of the time-projected buffer and create an RF line.
+    virtual size_t get_num_output_samples() const {
+        return m_output_stage.get_num_output_samples();
+    }
+
     // Process the time-projections by doing FFT -> Multiply -> IFFT
-    virtual std::vector<std::complex<float>> process() {
-        auto temp_buffer = fft(m_time_proj_buffer);
-        std::transform(std::begin(temp_buffer), std::end(temp_buffer), std::begin(m_excitation_fft), std::begin(temp_buffer), std::multiplies<std::complex<float>>());
-        temp_buffer = ifft(temp_buffer);
-        if (temp_buffer.size() != m_fft_length) throw std::logic_error("should not happen");
+    // The transforms are done in-place in the time-projection buffer.
+    virtual void convolve() {
+        trace::ScopedEvent event("convolve", "convolver");
+        if (m_sparse.collect(m_time_proj_buffer.data(), m_num_proj_samples)) {
+            return;
+        }
+        if (m_real_fft_plan) {
+            forward_real();
+        } else {
+            m_fft_plan->forward(m_time_proj_buffer.data());
+            std::transform(std::begin(m_time_proj_buffer), std::end(m_time_proj_buffer), std::begin(m_tables->excitation_fft), std::begin(m_time_proj_buffer), std::multiplies<std::complex<float>>());
+        }
+        m_fft_plan->inverse(m_time_proj_buffer.data());
+    }
 
-        // extract output, compensate for delay introduced by convolving with excitation
-        auto start = std::begin(temp_buffer) + m_excitation_delay;
-        return std::vector<std::complex<float>>(start, start + m_num_proj_samples);
+    virtual void write_output(std::complex<float>* out) {
+        trace::ScopedEvent event("write_output", "convolver");
+        if (m_sparse.is_active()) {
+            m_sparse.write(out);
+        } else {
+            m_output_stage.write(m_time_proj_buffer.data(), out);
+        }
+    }
+
+    virtual void set_sparse_threshold(size_t max_nonzero_samples) {
+        m_sparse.set_threshold(max_nonzero_samples);
     }
 
 protected:
-    // Precompute Hilbert-transformed FFT of excitation signal.
-    void precompute_excitation_fft(const ExcitationSignal& excitation) {
-        std::vector<std::complex<float>> padded_excitation(m_fft_length, std::complex<float>(0.0f, 0.0f));
-        std::transform(std::begin(excitation.samples), std::end(excitation.samples), std::begin(padded_excitation), [](float v) {
-            return std::complex<float>(static_cast<float>(v), 0.0f);
-        });
-        m_excitation_fft = fft(padded_excitation);
+    // Forward FFT of the real part of the time-projections followed by the
+    // multiplication with the excitation FFT. Since the Hilbert mask removes
+    // all negative frequencies, only bins 0..n/2 of the real FFT are needed.
+    void forward_real() {
+        // Pack real parts contiguously. Safe in-place since the write position
+        // never gets ahead of the read position.
+        auto packed = reinterpret_cast<float*>(m_time_proj_buffer.data());
+        for (size_t i = 0; i < m_fft_length; i++) {
+            packed[i] = m_time_proj_buffer[i].real();
+        }
+        m_real_fft_plan->forward(m_time_proj_buffer.data());
 
-        // Hilbert transform is implemented by zeroing out negative frequencies in FFT of excitation.
-        const auto hilbert_mask = discrete_hilbert_mask<float>(m_fft_length);
-        std::transform(std::begin(hilbert_mask), std::end(hilbert_mask),
-                       std::begin(m_excitation_fft), std::begin(m_excitation_fft),
-                       [&](float mask_sample, std::complex<float> fft_sample) {
-            return mask_sample*fft_sample;
-        });
+        const auto num_bins = m_fft_length/2 + 1;
+        auto buffer_begin = std::begin(m_time_proj_buffer);
+        std::transform(buffer_begin, buffer_begin + num_bins, std::begin(m_tables->excitation_fft), buffer_begin, std::multiplies<std::complex<float>>());
+        std::fill(buffer_begin + num_bins, std::end(m_time_proj_buffer), std::complex<float>(0.0f, 0.0f));
     }
 
 
 protected:
     size_t                              m_num_proj_samples;   // number of samples in time-projection signal
-    std::vector<std::complex<float>>    m_time_proj_buffer;   // where time-projections are stored in projection loop
-    size_t                              m_fft_length;         // closest power-of-two >= length(m_time_proj_buffer)
-    std::vector<std::complex<float>>    m_excitation_fft;     // Forward FFT of padded excitation, length is m_fft_length
-    size_t                              m_excitation_delay;   // Compensation offset needed since time zero in the middle.
+    AlignedVector<std::complex<float>>  m_time_proj_buffer;   // where time-projections are stored in projection loop
+    size_t                              m_fft_length;         // smallest even 2^a*3^b*5^c >= length of the convolution
+    FftPlan<float>::s_ptr               m_fft_plan;           // shared plan for transforms of length m_fft_length
+    RealFftPlan<float>::s_ptr           m_real_fft_plan;      // only set when using real-input transforms
+    ConvolverTables::s_ptr              m_tables;             // shared excitation FFT (length m_fft_length) and phasors
+    IqOutputStage                       m_output_stage;
+    SparseSynthesis                     m_sparse;
+};
+
+namespace {
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+inline float horizontal_sum(__m256 v) {
+    const auto sum4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const auto sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    return _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1)));
+}
+#endif
+
+// Sum of taps[i]*(xs_re[i] + j*xs_im[i]) for i < n, with split complex taps.
+inline std::complex<float> complex_dot(const float* taps_re, const float* taps_im,
+                                       const float* xs_re, const float* xs_im, size_t n) {
+    float re = 0.0f;
+    float im = 0.0f;
+    size_t i = 0;
+#if defined(__AVX512F__) || defined(__AVX2__)
+    const size_t SIMD_WIDTH = 8;
+    auto acc_re = _mm256_setzero_ps();
+    auto acc_im = _mm256_setzero_ps();
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        const auto tr = _mm256_loadu_ps(taps_re + i);
+        const auto ti = _mm256_loadu_ps(taps_im + i);
+        const auto xr = _mm256_loadu_ps(xs_re + i);
+        const auto xi = _mm256_loadu_ps(xs_im + i);
+        acc_re = _mm256_add_ps(acc_re, _mm256_sub_ps(_mm256_mul_ps(tr, xr), _mm256_mul_ps(ti, xi)));
+        acc_im = _mm256_add_ps(acc_im, _mm256_add_ps(_mm256_mul_ps(tr, xi), _mm256_mul_ps(ti, xr)));
+    }
+    re = horizontal_sum(acc_re);
+    im = horizontal_sum(acc_im);
+#endif
+    for (; i < n; i++) {
+        re += taps_re[i]*xs_re[i] - taps_im[i]*xs_im[i];
+        im += taps_re[i]*xs_im[i] + taps_im[i]*xs_re[i];
+    }
+    return std::complex<float>(re, im);
+}
+
+// As complex_dot() for a real signal.
+inline std::complex<float> real_dot(const float* taps_re, const float* taps_im, const float* xs, size_t n) {
+    float re = 0.0f;
+    float im = 0.0f;
+    size_t i = 0;
+#if defined(__AVX512F__) || defined(__AVX2__)
+    const size_t SIMD_WIDTH = 8;
+    auto acc_re = _mm256_setzero_ps();
+    auto acc_im = _mm256_setzero_ps();
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        const auto x = _mm256_loadu_ps(xs + i);
+        acc_re = _mm256_add_ps(acc_re, _mm256_mul_ps(_mm256_loadu_ps(taps_re + i), x));
+        acc_im = _mm256_add_ps(acc_im, _mm256_mul_ps(_mm256_loadu_ps(taps_im + i), x));
+    }
+    re = horizontal_sum(acc_re);
+    im = horizontal_sum(acc_im);
+#endif
+    for (; i < n; i++) {
+        re += taps_re[i]*xs[i];
+        im += taps_im[i]*xs[i];
+    }
+    return std::complex<float>(re, im);
+}
+
+// Taps and output positions of a direct convolver, in units of the
+// time-projection sample interval. The output sample i is at position
+// output_offset + i*output_step and uses the time-projections at lags
+// first_lag..last_lag before it.
+struct DirectConvolution {
+    const float*    reversed_taps_re;
+    const float*    reversed_taps_im;
+    size_t          num_taps;
+    long            first_lag;
+    long            last_lag;
+    size_t          num_input_samples;
+    size_t          output_offset;
+    size_t          output_step;
+};
+
+// RF time-projections convolved with the analytic excitation, or, in
+// baseband mode, time-projections on the decimated grid convolved with the
+// decimated taps.
+DirectConvolution get_direct_convolution(const ConvolverTables& tables, size_t num_proj_samples,
+                                         const ExcitationSignal& excitation, int radial_decimation, bool baseband) {
+    if (baseband) {
+        return DirectConvolution{tables.reversed_baseband_taps_re.data(), tables.reversed_baseband_taps_im.data(),
+                                 tables.reversed_baseband_taps_re.size(), tables.first_baseband_tap, tables.last_baseband_tap,
+                                 tables.phasors.size(), 0, 1};
+    }
+    return DirectConvolution{tables.reversed_taps_re.data(), tables.reversed_taps_im.data(),
+                             tables.reversed_taps_re.size(), tables.first_tap_lag, tables.last_tap_lag,
+                             num_proj_samples, static_cast<size_t>(excitation.center_index),
+                             static_cast<size_t>(radial_decimation)};
+}
+
+// Zeros needed before and after the time-projections by the direct
+// convolver, i.e. the lags of the first and last output samples that are
+// outside of the time-projections.
+void get_direct_padding(const DirectConvolution& conv, size_t num_output_samples,
+                        size_t& padding_before, size_t& padded_length) {
+    const auto delay = static_cast<long>(conv.output_offset);
+    const auto last_output_pos = delay + static_cast<long>((num_output_samples - 1)*conv.output_step);
+    padding_before = static_cast<size_t>(std::max(0L, conv.last_lag - delay));
+    const auto end_pos = std::max(static_cast<long>(conv.num_input_samples), last_output_pos - conv.first_lag + 1);
+    padded_length = padding_before + static_cast<size_t>(end_pos);
+}
+
+}   // namespace
+
+// Beam-convolver which convolves directly in the time domain with the
+// truncated analytic excitation. Only the output samples which are kept
+// after decimation are computed, so it is cheaper than the FFT-based
+// convolvers when the excitation is short compared to the line.
+// In baseband mode the time-projections are on the decimated grid, i.e.
+// only get_num_output_samples() long, and are convolved with every
+// radial_decimation'th tap, which reduces the work by the decimation squared.
+class DirectBeamConvolver : public IBeamConvolver {
+public:
+    DirectBeamConvolver(size_t num_proj_samples, const ExcitationSignal& excitation, bool real_input,
+                        int radial_decimation, bool baseband)
+        : m_real_input(real_input),
+          m_tables(get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f)),
+          m_conv(get_direct_convolution(*m_tables, num_proj_samples, excitation, radial_decimation, baseband))
+    {
+        size_t padded_length;
+        get_direct_padding(m_conv, m_tables->phasors.size(), m_padding_before, padded_length);
+        m_time_proj_buffer.resize(padded_length);
+        m_split_re.resize(padded_length);
+        if (!real_input) {
+            m_split_im.resize(padded_length);
+        }
+        m_output.resize(m_tables->phasors.size());
+    }
+
+    virtual std::complex<float>* get_zeroed_time_proj_signal() {
+        std::fill(std::begin(m_time_proj_buffer), std::end(m_time_proj_buffer), std::complex<float>(0.0f, 0.0f));
+        return m_time_proj_buffer.data() + m_padding_before;
+    }
+
+    virtual size_t get_num_output_samples() const {
+        return m_output.size();
+    }
+
+    virtual void convolve() {
+        trace::ScopedEvent event("convolve", "convolver");
+        const auto padded_length = m_time_proj_buffer.size();
+        for (size_t i = 0; i < padded_length; i++) {
+            m_split_re[i] = m_time_proj_buffer[i].real();
+        }
+        if (!m_real_input) {
+            for (size_t i = 0; i < padded_length; i++) {
+                m_split_im[i] = m_time_proj_buffer[i].imag();
+            }
+        }
+
+        const auto taps_re = m_conv.reversed_taps_re;
+        const auto taps_im = m_conv.reversed_taps_im;
+        const auto num_taps = m_conv.num_taps;
+        // first padded sample used by output sample 0
+        const auto start = m_padding_before + m_conv.output_offset - static_cast<size_t>(m_conv.last_lag);
+        const auto num_output_samples = m_output.size();
+        for (size_t i = 0; i < num_output_samples; i++) {
+            const auto offset = start + i*m_conv.output_step;
+            m_output[i] = m_real_input
+                ? real_dot(taps_re, taps_im, m_split_re.data() + offset, num_taps)
+                : complex_dot(taps_re, taps_im, m_split_re.data() + offset, m_split_im.data() + offset, num_taps);
+        }
+    }
+
+    virtual void write_output(std::complex<float>* out) {
+        trace::ScopedEvent event("write_output", "convolver");
+        const auto& phasors = m_tables->phasors;
+        const auto num_output_samples = m_output.size();
+        for (size_t i = 0; i < num_output_samples; i++) {
+            out[i] = m_output[i]*phasors[i];
+        }
+    }
+
+private:
+    bool                                m_real_input;
+    ConvolverTables::s_ptr              m_tables;             // shared analytic excitation taps and phasors
+    DirectConvolution                   m_conv;               // points into m_tables
+    size_t                              m_padding_before;     // zeros before the time-projections
+    AlignedVector<std::complex<float>>  m_time_proj_buffer;   // padded time-projections
+    AlignedVector<float>                m_split_re;           // real parts of m_time_proj_buffer
+    AlignedVector<float>                m_split_im;           // imaginary parts (complex input only)
+    AlignedVector<std::complex<float>>  m_output;             // convolved samples which are kept
 };
 
-IBeamConvolver::ptr IBeamConvolver::Create(size_t num_proj_samples, const ExcitationSignal& excitation) {
-    return IBeamConvolver::ptr(new BeamConvolver(num_proj_samples, excitation));
+#ifdef BCSIM_ENABLE_FFTW
+// The FFTW planner is not thread-safe, so all plan creation and
+// destruction is serialized.
+static std::mutex g_fftw_planner_mutex;
+
+// Beam-convolver with built-in Hilbert transform, using FFTW for the transforms.
+// Each instance owns its buffer and plans, so one instance per thread can be
+// used concurrently.
+class FftwBeamConvolver : public IBeamConvolver {
+public:
+    FftwBeamConvolver(size_t num_proj_samples, const ExcitationSignal& excitation, bool real_input, int radial_decimation)
+        : m_num_proj_samples(num_proj_samples),
+          m_fft_length(convolution_fft_length(num_proj_samples, excitation)),
+          // includes the 1/n scaling of the unnormalized FFTW inverse transform
+          m_tables(get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f/m_fft_length)),
+          m_output_stage(m_tables, excitation, radial_decimation),
+          m_sparse(m_tables, excitation, real_input, radial_decimation)
+    {
+
+        m_buffer = static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex)*m_fft_length));
+        if (real_input) {
+            m_real_buffer = static_cast<float*>(fftwf_malloc(sizeof(float)*m_fft_length));
+        }
+        if ((m_buffer == nullptr) || (real_input && (m_real_buffer == nullptr))) {
+            destroy();
+            throw std::runtime_error("FftwBeamConvolver: failed to allocate memory");
+        }
+        {
+            std::lock_guard<std::mutex> guard(g_fftw_planner_mutex);
+            const auto n = static_cast<int>(m_fft_length);
+            m_forward_plan = fftwf_plan_dft_1d(n, m_buffer, m_buffer, FFTW_FORWARD,  FFTW_MEASURE);
+            m_inverse_plan = fftwf_plan_dft_1d(n, m_buffer, m_buffer, FFTW_BACKWARD, FFTW_MEASURE);
+            if (real_input) {
+                m_real_forward_plan = fftwf_plan_dft_r2c_1d(n, m_real_buffer, m_buffer, FFTW_MEASURE);
+            }
+        }
+        if ((m_forward_plan == nullptr) || (m_inverse_plan == nullptr) || (real_input && (m_real_forward_plan == nullptr))) {
+            destroy();
+            throw std::runtime_error("FftwBeamConvolver: failed to create FFTW plans");
+        }
+    }
+
+    virtual ~FftwBeamConvolver() {
+        destroy();
+    }
+
+    virtual std::complex<float>* get_zeroed_time_proj_signal() {
+        auto buffer = get_buffer();
+        std::fill(buffer, buffer + m_fft_length, std::complex<float>(0.0f, 0.0f));
+        return buffer;
+    }
+
+    virtual size_t get_num_output_samples() const {
+        return m_output_stage.get_num_output_samples();
+    }
+
+    virtual void convolve() {
+        trace::ScopedEvent event("convolve_fftw", "convolver");
+        auto buffer = get_buffer();
+        if (m_sparse.collect(buffer, m_num_proj_samples)) {
+            return;
+        }
+        if (m_real_forward_plan) {
+            // Real-to-complex transform gives bins 0..n/2, which are all
+            // that survive the Hilbert mask.
+            for (size_t i = 0; i < m_fft_length; i++) {
+                m_real_buffer[i] = buffer[i].real();
+            }
+            fftwf_execute(m_real_forward_plan);
+            const auto num_bins = m_fft_length/2 + 1;
+            std::transform(buffer, buffer + num_bins, std::begin(m_tables->excitation_fft), buffer, std::multiplies<std::complex<float>>());
+            std::fill(buffer + num_bins, buffer + m_fft_length, std::complex<float>(0.0f, 0.0f));
+        } else {
+            fftwf_execute(m_forward_plan);
+            std::transform(buffer, buffer + m_fft_length, std::begin(m_tables->excitation_fft), buffer, std::multiplies<std::complex<float>>());
+        }
+        fftwf_execute(m_inverse_plan);
+    }
+
+    virtual void write_output(std::complex<float>* out) {
+        trace::ScopedEvent event("write_output", "convolver");
+        if (m_sparse.is_active()) {
+            m_sparse.write(out);
+        } else {
+            m_output_stage.write(get_buffer(), out);
+        }
+    }
+
+    virtual void set_sparse_threshold(size_t max_nonzero_samples) {
+        m_sparse.set_threshold(max_nonzero_samples);
+    }
+
+private:
+    // fftwf_complex is layout-compatible with std::complex<float>
+    std::complex<float>* get_buffer() {
+        return reinterpret_cast<std::complex<float>*>(m_buffer);
+    }
+
+    void destroy() {
+        std::lock_guard<std::mutex> guard(g_fftw_planner_mutex);
+        if (m_forward_plan)      fftwf_destroy_plan(m_forward_plan);
+        if (m_inverse_plan)      fftwf_destroy_plan(m_inverse_plan);
+        if (m_real_forward_plan) fftwf_destroy_plan(m_real_forward_plan);
+        if (m_buffer)            fftwf_free(m_buffer);
+        if (m_real_buffer)       fftwf_free(m_real_buffer);
+        m_forward_plan      = nullptr;
+        m_inverse_plan      = nullptr;
+        m_real_forward_plan = nullptr;
+        m_buffer            = nullptr;
+        m_real_buffer       = nullptr;
+    }
+
+private:
+    size_t                              m_num_proj_samples;
+    size_t                              m_fft_length;
+    ConvolverTables::s_ptr              m_tables;                 // shared excitation FFT and phasors
+    IqOutputStage                       m_output_stage;
+    SparseSynthesis                     m_sparse;
+    fftwf_complex*                      m_buffer = nullptr;       // time-projections, transformed in-place
+    fftwf_plan                          m_forward_plan = nullptr;
+    fftwf_plan                          m_inverse_plan = nullptr;
+    float*                              m_real_buffer = nullptr;  // real parts of time-projections (real-input mode only)
+    fftwf_plan                          m_real_forward_plan = nullptr;
+};
+#endif  // BCSIM_ENABLE_FFTW
+
+namespace {
+
+// Per-operation costs of the convolvers on this machine.
+struct ConvolutionCostModel {
+    double  ns_per_fft_point;   // per n*log2(n) of a complex transform of length n
+    double  ns_per_direct_tap;  // per complex tap and output sample of the direct convolver
+};
+
+// Smallest duration of a number of calls, to be robust against interruptions.
+template <typename Func>
+double min_duration_ns(Func func, int num_repetitions) {
+    auto res = std::numeric_limits<double>::max();
+    for (int i = 0; i < num_repetitions; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const auto duration = std::chrono::steady_clock::now() - start;
+        res = std::min(res, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+    return std::max(res, 1.0);
+}
+
+// Time process() of both kinds of convolvers on a reference line, so that
+// all their overheads are included.
+ConvolutionCostModel measure_cost_model() {
+    ExcitationSignal excitation;
+    excitation.sampling_frequency = 50e6f;
+    excitation.demod_freq = 2.5e6f;
+    excitation.center_index = 64;
+    // narrowband Gaussian pulse which only needs a few taps beyond its samples
+    const double TWO_PI = 2.0*4.0*std::atan(1.0);
+    for (int i = -64; i < 64; i++) {
+        const auto window = std::exp(-0.5*i*i/(20.0*20.0));
+        excitation.samples.push_back(static_cast<float>(window*std::cos(TWO_PI*0.05*i)));
+    }
+    const size_t num_proj_samples = 2048 - excitation.samples.size() + 1;
+
+    const auto time_convolver = [&](IBeamConvolver& convolver) {
+        std::vector<std::complex<float>> out(convolver.get_num_output_samples());
+        return min_duration_ns([&]() {
+            auto signal = convolver.get_zeroed_time_proj_signal();
+            for (size_t i = 0; i < num_proj_samples; i += 7) {
+                signal[i] = std::complex<float>(1.0f, 0.5f);
+            }
+            convolver.process(out.data());
+        }, 3);
+    };
+
+    ConvolutionCostModel model;
+    BeamConvolver fft_convolver(num_proj_samples, excitation, false, 1);
+    const auto fft_length = static_cast<double>(get_convolver_tables(num_proj_samples, excitation, 1, 1.0f)->excitation_fft.size());
+    model.ns_per_fft_point = time_convolver(fft_convolver)/(2.0*fft_length*std::log2(fft_length));
+
+    DirectBeamConvolver direct_convolver(num_proj_samples, excitation, false, 1, false);
+    const auto tables = get_convolver_tables(num_proj_samples, excitation, 1, 1.0f);
+    const auto num_taps = static_cast<double>(tables->reversed_taps_re.size());
+    model.ns_per_direct_tap = time_convolver(direct_convolver)/(num_taps*tables->phasors.size());
+    return model;
+}
+
+// Padded time-projections, their split parts and the kept samples.
+size_t get_direct_memory_usage(size_t num_proj_samples, const ExcitationSignal& excitation, bool real_input,
+                               int radial_decimation, bool baseband) {
+    const auto tables = get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f);
+    const auto conv = get_direct_convolution(*tables, num_proj_samples, excitation, radial_decimation, baseband);
+    size_t padding_before, padded_length;
+    get_direct_padding(conv, tables->phasors.size(), padding_before, padded_length);
+    return padded_length*(sizeof(std::complex<float>) + (real_input ? 1 : 2)*sizeof(float))
+        + tables->phasors.size()*sizeof(std::complex<float>);
+}
+
+// Measured once per process, on first use.
+const ConvolutionCostModel& get_cost_model() {
+    static const ConvolutionCostModel model = measure_cost_model();
+    return model;
+}
+
+std::string resolve_convolution_method(const std::string& convolution_method, size_t num_proj_samples,
+                                       const ExcitationSignal& excitation, bool real_input, int radial_decimation) {
+    if (convolution_method == "auto") {
+        return IBeamConvolver::select_convolution_method(num_proj_samples, excitation, real_input, radial_decimation);
+    } else if ((convolution_method == "fft") || (convolution_method == "direct")) {
+        return convolution_method;
+    }
+    throw std::runtime_error("Unsupported convolution method: " + convolution_method);
+}
+
+}   // namespace
+
+std::string IBeamConvolver::select_convolution_method(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                                      bool real_input, int radial_decimation) {
+    const auto tables = get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f);
+    const auto& model = get_cost_model();
+
+    // A real-input FFT convolution costs about one and a half complex transforms.
+    const auto fft_length = static_cast<double>(tables->excitation_fft.size());
+    const auto num_transforms = real_input ? 1.5 : 2.0;
+    const auto fft_cost = model.ns_per_fft_point*num_transforms*fft_length*std::log2(fft_length);
+
+    // Real input needs half of the multiplications per tap.
+    const auto num_taps = static_cast<double>(tables->reversed_taps_re.size());
+    const auto num_output_samples = static_cast<double>(tables->phasors.size());
+    const auto direct_cost = model.ns_per_direct_tap*(real_input ? 0.5 : 1.0)*num_taps*num_output_samples;
+
+    return (direct_cost < fft_cost) ? "direct" : "fft";
+}
+
+IBeamConvolver::ptr IBeamConvolver::Create(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                           const std::string& fft_backend, bool real_input,
+                                           int radial_decimation, const std::string& convolution_method) {
+    const auto backends = get_available_fft_backends();
+    if (std::find(backends.begin(), backends.end(), fft_backend) == backends.end()) {
+        throw std::runtime_error("Unsupported FFT backend: " + fft_backend);
+    }
+    const auto method = resolve_convolution_method(convolution_method, num_proj_samples, excitation,
+                                                   real_input, radial_decimation);
+    if (method == "direct") {
+        return IBeamConvolver::ptr(new DirectBeamConvolver(num_proj_samples, excitation, real_input, radial_decimation, false));
+    } else if (fft_backend == "builtin") {
+        return IBeamConvolver::ptr(new BeamConvolver(num_proj_samples, excitation, real_input, radial_decimation));
+#ifdef BCSIM_ENABLE_FFTW
+    } else if (fft_backend == "fftw") {
+        return IBeamConvolver::ptr(new FftwBeamConvolver(num_proj_samples, excitation, real_input, radial_decimation));
+#endif
+    } else {
+        throw std::runtime_error("Unsupported FFT backend: " + fft_backend);
+    }
+}
+
+size_t IBeamConvolver::get_memory_usage(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                        const std::string& fft_backend, bool real_input,
+                                        int radial_decimation, const std::string& convolution_method) {
+    if (radial_decimation <= 0) {
+        throw std::runtime_error("illegal radial decimation value");
+    }
+    const auto method = resolve_convolution_method(convolution_method, num_proj_samples, excitation,
+                                                   real_input, radial_decimation);
+    if (method == "direct") {
+        return get_direct_memory_usage(num_proj_samples, excitation, real_input, radial_decimation, false);
+    }
+
+    // the time-projections
+    const auto fft_length = convolution_fft_length(num_proj_samples, excitation);
+    auto res = fft_length*sizeof(std::complex<float>);
+    if ((fft_backend == "fftw") && real_input) {
+        res += fft_length*sizeof(float);
+    }
+    return res;
+}
+
+size_t IBeamConvolver::get_shared_memory_usage(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                               int radial_decimation) {
+    if (radial_decimation <= 0) {
+        throw std::runtime_error("illegal radial decimation value");
+    }
+    // excitation FFT, demodulation phasors and analytic excitation taps
+    const auto tables = get_convolver_tables(num_proj_samples, excitation, radial_decimation, 1.0f);
+    return (tables->excitation_fft.size() + tables->phasors.size() + tables->reversed_taps_re.size()
+            + tables->reversed_baseband_taps_re.size())*sizeof(std::complex<float>);
+}
+
+IBeamConvolver::ptr IBeamConvolver::CreateBaseband(size_t num_rf_samples, const ExcitationSignal& excitation,
+                                                   int radial_decimation) {
+    return IBeamConvolver::ptr(new DirectBeamConvolver(num_rf_samples, excitation, false, radial_decimation, true));
+}
+
+std::vector<std::complex<float>> IBeamConvolver::get_baseband_taps(size_t num_rf_samples, const ExcitationSignal& excitation,
+                                                                   int radial_decimation, int& first_tap) {
+    const auto tables = get_convolver_tables(num_rf_samples, excitation, radial_decimation, 1.0f);
+    const auto& taps_re = tables->reversed_baseband_taps_re;
+    const auto& taps_im = tables->reversed_baseband_taps_im;
+    std::vector<std::complex<float>> res;
+    for (size_t i = taps_re.size(); i > 0; i--) {
+        res.emplace_back(taps_re[i - 1], taps_im[i - 1]);
+    }
+    first_tap = tables->first_baseband_tap;
+    return res;
+}
+
+std::vector<std::complex<float>> IBeamConvolver::get_analytic_taps(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                                                   int& first_lag) {
+    const auto tables = get_convolver_tables(num_proj_samples, excitation, 1, 1.0f);
+    const auto& taps_re = tables->reversed_taps_re;
+    const auto& taps_im = tables->reversed_taps_im;
+    std::vector<std::complex<float>> res;
+    for (size_t i = taps_re.size(); i > 0; i--) {
+        res.emplace_back(taps_re[i - 1], taps_im[i - 1]);
+    }
+    first_lag = tables->first_tap_lag;
+    return res;
+}
+
+size_t IBeamConvolver::get_baseband_memory_usage(size_t num_rf_samples, const ExcitationSignal& excitation,
+                                                 int radial_decimation) {
+    if (radial_decimation <= 0) {
+        throw std::runtime_error("illegal radial decimation value");
+    }
+    return get_direct_memory_usage(num_rf_samples, excitation, false, radial_decimation, true);
+}
+
+std::vector<std::string> IBeamConvolver::get_available_fft_backends() {
+    std::vector<std::string> res{"builtin"};
+#ifdef BCSIM_ENABLE_FFTW
+    res.push_back("fftw");
+#endif
+    return res;
 }
 
 }   // end namespace
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <vector>
 #include <complex>
+#include <string>
 #include "BCSimConfig.hpp"
 
 namespace bcsim {
@@ -39,19 +40,106 @@ class IBeamConvolver {
 public:
     typedef std::unique_ptr<IBeamConvolver> ptr;
     
-    // Factory function for creating IQ data beam convolvers. TODO: Decimate here?
-    // num_proj_samples: Number of time-projection samples (also number of output samples)
-    // excitation: Excitation signal.
-    static ptr Create(size_t num_proj_samples, const ExcitationSignal& excitation); 
+    // Factory function for creating IQ data beam convolvers.
+    // num_proj_samples: Number of time-projection samples
+    // excitation: Excitation signal. Its demodulation frequency is used for
+    //             the complex down-shifting of the output.
+    // fft_backend: FFT implementation to use. Throws std::runtime_error if it is
+    //              not one of get_available_fft_backends().
+    // real_input: If true, the imaginary part of the time-projections is ignored
+    //             and cheaper real-input transforms are used. Only valid when the
+    //             algorithm never writes complex values, i.e. no phase delay
+    //             and no noise.
+    // radial_decimation: Only every radial_decimation'th IQ sample is output.
+    // convolution_method: "fft" for FFT-based convolution with fft_backend,
+    //                     "direct" for time-domain convolution with the
+    //                     analytic excitation truncated at -80 dB, or "auto"
+    //                     for select_convolution_method().
+    static ptr Create(size_t num_proj_samples, const ExcitationSignal& excitation,
+                      const std::string& fft_backend = "builtin", bool real_input = false,
+                      int radial_decimation = 1, const std::string& convolution_method = "auto");
+
+    // The cheaper of "fft" and "direct" for these arguments, estimated with
+    // timings of both which are measured once per process. The choice may
+    // therefore differ between machines; use an explicit method where the
+    // results must be reproducible to the last bit.
+    static std::string select_convolution_method(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                                 bool real_input = false, int radial_decimation = 1);
+
+    // Factory function for a convolver in baseband mode, where the time-
+    // projections are on the decimated IQ grid: get_zeroed_time_proj_signal()
+    // gives get_num_output_samples() samples spaced radial_decimation RF
+    // samples apart, starting at the first output sample. A scatterer is
+    // projected onto the closest of them with the phase delay to its exact
+    // position, and its contribution is convolved with the decimated analytic
+    // excitation in the time domain. Same output as Create() with phase delay,
+    // up to the envelope misalignment of at most half a decimated sample.
+    // num_rf_samples: Number of RF samples of a line, as for Create()
+    static ptr CreateBaseband(size_t num_rf_samples, const ExcitationSignal& excitation, int radial_decimation);
+
+    // Names of the FFT backends compiled into the library. The dependency-free
+    // "builtin" backend is always available.
+    static std::vector<std::string> get_available_fft_backends();
+
+    // Bytes of the private buffers of a convolver created with these
+    // arguments. The FFT plans of the builtin backend and the tables of
+    // get_shared_memory_usage() are shared between convolvers and not
+    // included.
+    static size_t get_memory_usage(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                   const std::string& fft_backend = "builtin", bool real_input = false,
+                                   int radial_decimation = 1, const std::string& convolution_method = "auto");
+
+    // The decimated analytic excitation used by CreateBaseband(), for the lags
+    // (first_tap + q)*radial_decimation relative to the excitation delay, in
+    // the order q = 0, 1, ... Lets other backends build the same filter.
+    static std::vector<std::complex<float>> get_baseband_taps(size_t num_rf_samples, const ExcitationSignal& excitation,
+                                                              int radial_decimation, int& first_tap);
+
+    // The truncated analytic excitation of the "direct" method and of the
+    // sparse path (see set_sparse_threshold()), for the lags first_lag + q
+    // in the order q = 0, 1, ...
+    static std::vector<std::complex<float>> get_analytic_taps(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                                              int& first_lag);
+
+    // Bytes of the private buffers of a convolver created with CreateBaseband().
+    static size_t get_baseband_memory_usage(size_t num_rf_samples, const ExcitationSignal& excitation,
+                                            int radial_decimation);
+
+    // Bytes of the excitation spectrum, demodulation table and taps, which are
+    // computed once and shared read-only by all convolvers created with the
+    // same excitation, number of samples and decimation (per FFT backend).
+    static size_t get_shared_memory_usage(size_t num_proj_samples, const ExcitationSignal& excitation,
+                                          int radial_decimation = 1);
 
     virtual ~IBeamConvolver() { }
 
     // Clears the time-projected signal in preparation for creating a new beam.
-    // Number of samples is equal to num_proj_samples used at creation.
+    // Number of samples is equal to num_proj_samples used at creation, or to
+    // get_num_output_samples() in baseband mode.
     virtual std::complex<float>* get_zeroed_time_proj_signal() = 0;
+
+    // Number of IQ samples written by process().
+    virtual size_t get_num_output_samples() const               = 0;
     
-    // Processed the time-projections into (decimated?) IQ data
-    virtual std::vector<std::complex<float>> process()         = 0;
+    // Process the time-projections into demodulated and decimated IQ data.
+    // Writes get_num_output_samples() samples to out.
+    void process(std::complex<float>* out) {
+        convolve();
+        write_output(out);
+    }
+
+    // The two steps of process(), e.g. for timing them separately:
+    // convolve() does the convolution, and write_output() then demodulates
+    // and decimates the result into out.
+    virtual void convolve()                                     = 0;
+    virtual void write_output(std::complex<float>* out)         = 0;
+
+    // Lines with at most max_nonzero_samples non-zero time-projection
+    // samples are formed by summing shifted copies of the analytic
+    // excitation, truncated as for the "direct" method, instead of
+    // transforming the whole line. 0 (the default) disables this. Only the
+    // FFT-based convolvers have this path, the others ignore it.
+    virtual void set_sparse_threshold(size_t /*max_nonzero_samples*/) { }
 };
 
 
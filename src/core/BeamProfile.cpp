@@ -27,6 +27,9 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
 #include "BeamProfile.hpp"
 
 namespace bcsim {
@@ -47,7 +50,7 @@ void GaussianBeamProfile::setSigmaElevational(float new_sigma_elevational) {
 }
     
 float GaussianBeamProfile::sampleProfile(float r, float l, float e) {
-    return std::exp(-(l*l/m_two_sigma_lateral_squared + e*e/m_two_sigma_elevational_squared));
+    return sample(r, l, e);
 }
     
 void GaussianBeamProfile::updateCaching() {
@@ -60,73 +63,71 @@ LUTBeamProfile::LUTBeamProfile(int num_samples_rad, int num_samples_lat, int num
     m_num_samples_rad(num_samples_rad), m_num_samples_lat(num_samples_lat), m_num_samples_ele(num_samples_ele),
     m_range_range(range_range), m_lateral_range(lateral_range), m_elevational_range(elevational_range) {
 
-    // sanity check
-    if (num_samples_rad <= 1) throw std::runtime_error("Too few radial samples");
-    if (num_samples_lat <= 1) throw std::runtime_error("Too few lateral samples");
-    if (num_samples_ele <= 1) throw std::runtime_error("Too few elevational samples");
+    initialize();
 
     // Allocate memory
     long num_samples = m_num_samples_rad*m_num_samples_lat*m_num_samples_ele;
     m_samples.resize(num_samples);
-        
-    // Compute sample deltas in all dimensions
-    m_dr = (m_range_range.last - m_range_range.first) / (m_num_samples_rad-1);
-    m_dl = (m_lateral_range.last - m_lateral_range.first) / (m_num_samples_lat-1);
-    m_de = (m_elevational_range.last - m_elevational_range.first) / (m_num_samples_ele-1);
-        
+    updatePaddedSamples();
 }
 
-float LUTBeamProfile::sampleProfile(float r, float l, float e) {
-    // map to indices
-    const auto temp_r = (r-m_range_range.first) / m_dr;
-    const auto temp_l = (l-m_lateral_range.first) / m_dl;
-    const auto temp_e = (e-m_elevational_range.first) / m_de; 
+LUTBeamProfile::LUTBeamProfile(int num_samples_rad, int num_samples_lat, int num_samples_ele,
+                               Interval range_range, Interval lateral_range, Interval elevational_range,
+                               std::vector<float>&& samples) :
+    m_num_samples_rad(num_samples_rad), m_num_samples_lat(num_samples_lat), m_num_samples_ele(num_samples_ele),
+    m_samples(std::move(samples)),
+    m_range_range(range_range), m_lateral_range(lateral_range), m_elevational_range(elevational_range) {
 
-    // dim0: radial, dim1: lateral, dim2: elevational
+    initialize();
 
-    const auto r0 = static_cast<int>(temp_r); const auto r1 = static_cast<int>(temp_r+1);
-    const auto l0 = static_cast<int>(temp_l); const auto l1 = static_cast<int>(temp_l+1);
-    const auto e0 = static_cast<int>(temp_e); const auto e1 = static_cast<int>(temp_e+1);
-    
-    // fractional parts
-    const auto fractional_r = static_cast<float>(temp_r - r0);
-    const auto fractional_l = static_cast<float>(temp_l - l0);
-    const auto fractional_e = static_cast<float>(temp_e - e0);
-
-    // return zeros outside
-    if ((r0 < 0) || (r0 >= m_num_samples_rad) || (r1 < 0) || (r1 >= m_num_samples_rad)) {
-        return 0.0;
-    }
-    if ((l0 < 0) || (l0 >= m_num_samples_lat) || (l1 < 0) || (l1 >= m_num_samples_lat)) {
-        return 0.0;
+    const auto num_samples = static_cast<size_t>(m_num_samples_rad)*m_num_samples_lat*m_num_samples_ele;
+    if (m_samples.size() != num_samples) {
+        throw std::runtime_error("Number of LUT samples does not match dimensions");
     }
-    if ((e0 < 0) || (e0 >= m_num_samples_ele) || (e1 < 0) || (e1 >= m_num_samples_ele)) {
-        return 0.0;
+    updatePaddedSamples();
+}
+
+void LUTBeamProfile::initialize() {
+    // sanity check
+    if (m_num_samples_rad <= 1) throw std::runtime_error("Too few radial samples");
+    if (m_num_samples_lat <= 1) throw std::runtime_error("Too few lateral samples");
+    if (m_num_samples_ele <= 1) throw std::runtime_error("Too few elevational samples");
+
+    // Compute reciprocal sample deltas in all dimensions
+    m_inv_dr = static_cast<float>((m_num_samples_rad-1) / static_cast<double>(m_range_range.last - m_range_range.first));
+    m_inv_dl = static_cast<float>((m_num_samples_lat-1) / static_cast<double>(m_lateral_range.last - m_lateral_range.first));
+    m_inv_de = static_cast<float>((m_num_samples_ele-1) / static_cast<double>(m_elevational_range.last - m_elevational_range.first));
+}
+
+void LUTBeamProfile::updatePaddedSamples() {
+    const auto num_padded = static_cast<size_t>(m_num_samples_rad+3)*(m_num_samples_lat+3)*(m_num_samples_ele+3);
+    m_padded_samples.assign(num_padded, 0.0f);
+    for (int ir = 0; ir < m_num_samples_rad; ir++) {
+        for (int il = 0; il < m_num_samples_lat; il++) {
+            std::copy_n(&m_samples[getIndex(ir, il, 0)], m_num_samples_ele, &m_padded_samples[getPaddedIndex(ir, il, 0)]);
+        }
     }
-    
-    // samples in a cube around current point
-    float c000,c001,c010,c011,c100,c101,c110,c111;
-    c000 = m_samples[getIndex(r0, l0, e0)];
-    c001 = m_samples[getIndex(r0, l0, e1)];
-    c010 = m_samples[getIndex(r0, l1, e0)];
-    c011 = m_samples[getIndex(r0, l1, e1)];
-    c100 = m_samples[getIndex(r1, l0, e0)];
-    c101 = m_samples[getIndex(r1, l0, e1)];
-    c110 = m_samples[getIndex(r1, l1, e0)];
-    c111 = m_samples[getIndex(r1, l1, e1)];
-
-    // radial interpolation
-    const auto c00 = (1.0f-fractional_r)*c000 + fractional_r*c100;
-    const auto c10 = (1.0f-fractional_r)*c010 + fractional_r*c110;
-    const auto c01 = (1.0f-fractional_r)*c001 + fractional_r*c101;
-    const auto c11 = (1.0f-fractional_r)*c011 + fractional_r*c111;
-
-    // lateral interpolation
-    const auto c0 = (1.0f-fractional_l)*c00 + fractional_l*c10;
-    const auto c1 = (1.0f-fractional_l)*c01 + fractional_l*c11;
-
-    // finally, elevational interpolation
-    return (1.0f-fractional_e)*c0 + fractional_e*c1;
+}
+
+LUTBeamProfile::PaddedLayout LUTBeamProfile::getPaddedLayout() const {
+    PaddedLayout layout;
+    layout.samples = m_padded_samples.data();
+    layout.stride_lat = m_num_samples_ele + 3;
+    layout.stride_rad = (m_num_samples_lat + 3)*layout.stride_lat;
+    layout.first_rad = m_range_range.first;
+    layout.first_lat = m_lateral_range.first;
+    layout.first_ele = m_elevational_range.first;
+    layout.inv_delta_rad = m_inv_dr;
+    layout.inv_delta_lat = m_inv_dl;
+    layout.inv_delta_ele = m_inv_de;
+    layout.max_index_rad = static_cast<float>(m_num_samples_rad);
+    layout.max_index_lat = static_cast<float>(m_num_samples_lat);
+    layout.max_index_ele = static_cast<float>(m_num_samples_ele);
+    return layout;
+}
+
+float LUTBeamProfile::sampleProfile(float r, float l, float e) {
+    return sample(r, l, e);
 }
 
 void LUTBeamProfile::setDiscreteSample(int ir, int il, int ie, float new_sample) {
@@ -134,6 +135,35 @@ void LUTBeamProfile::setDiscreteSample(int ir, int il, int ie, float new_sample)
     if (il < 0 || il >= m_num_samples_lat) return;
     if (ie < 0 || ie >= m_num_samples_ele) return;
     m_samples[getIndex(ir, il, ie)] = new_sample;
+    m_padded_samples[getPaddedIndex(ir, il, ie)] = new_sample;
+}
+
+MultiResolutionLUTBeamProfile::MultiResolutionLUTBeamProfile(std::vector<LUTBeamProfile> zones) :
+    m_zones(std::move(zones)) {
+
+    if (m_zones.empty()) {
+        throw std::runtime_error("Multi-resolution LUT profile needs at least one zone");
+    }
+    for (size_t i = 0; i + 1 < m_zones.size(); i++) {
+        const auto range = m_zones[i].getRangeRange();
+        const auto next_range = m_zones[i+1].getRangeRange();
+        if ((range.first >= next_range.first) || (range.last >= next_range.last)) {
+            throw std::runtime_error("Radial ranges of LUT zones must be strictly increasing");
+        }
+        m_zone_boundaries.push_back(0.5f*(range.last + next_range.first));
+    }
+}
+
+float MultiResolutionLUTBeamProfile::sampleProfile(float r, float l, float e) {
+    return sample(r, l, e);
+}
+
+size_t MultiResolutionLUTBeamProfile::getNumSamples() const {
+    size_t num_samples = 0;
+    for (const auto& zone : m_zones) {
+        num_samples += zone.getSamples().size();
+    }
+    return num_samples;
 }
 
 }   // namespace
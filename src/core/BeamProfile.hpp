@@ -28,8 +28,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <vector>
 #include "export_macros.hpp"
 #include "BCSimConfig.hpp"
 
@@ -65,6 +67,12 @@ public:
     void setSigmaElevational(float newSigmaElevational);
         
     virtual float sampleProfile(float r, float l, float e);
+
+    // Non-virtual version of sampleProfile() which can be inlined in loops
+    // where the concrete profile type is known.
+    float sample(float r, float l, float e) const {
+        return std::exp(-(l*l/m_two_sigma_lateral_squared + e*e/m_two_sigma_elevational_squared));
+    }
     
     // HACK needed for current GPU algorithms which needs sigma values as
     // kernel parameters
@@ -84,16 +92,84 @@ protected:
 };
 
 
-// BeamProfile with LUT and nearest neighbour interpolation.
-// Returns zero value if outside data region.
+// BeamProfile with LUT and trilinear interpolation.
+// Returns zero value more than one sample delta outside of the data region.
 class DLL_PUBLIC LUTBeamProfile : public IBeamProfile {
 public:
     // Define number of samples and geometrical extent of each direction.
     LUTBeamProfile(int num_samples_rad, int num_samples_lat, int num_samples_ele,
                    Interval range_range, Interval lateral_range, Interval elevational_range);
+
+    // Take ownership of all samples at once. They are stored row-major with
+    // radial as the slowest and elevational as the fastest varying index.
+    LUTBeamProfile(int num_samples_rad, int num_samples_lat, int num_samples_ele,
+                   Interval range_range, Interval lateral_range, Interval elevational_range,
+                   std::vector<float>&& samples);
     
     virtual float sampleProfile(float r, float l, float e);
-        
+
+    // Non-virtual version of sampleProfile() which can be inlined in loops
+    // where the concrete profile type is known.
+    float sample(float r, float l, float e) const {
+        // continuous indices into the padded samples
+        // dim0: radial, dim1: lateral, dim2: elevational
+        const auto temp_r = getPaddedIndex((r-m_range_range.first)*m_inv_dr, m_num_samples_rad);
+        const auto temp_l = getPaddedIndex((l-m_lateral_range.first)*m_inv_dl, m_num_samples_lat);
+        const auto temp_e = getPaddedIndex((e-m_elevational_range.first)*m_inv_de, m_num_samples_ele);
+
+        const auto r0 = static_cast<int>(temp_r);
+        const auto l0 = static_cast<int>(temp_l);
+        const auto e0 = static_cast<int>(temp_e);
+
+        // fractional parts
+        const auto fractional_r = temp_r - r0;
+        const auto fractional_l = temp_l - l0;
+        const auto fractional_e = temp_e - e0;
+
+        // samples in a cube around current point
+        const auto stride_lat = m_num_samples_ele + 3;
+        const auto stride_rad = (m_num_samples_lat + 3)*stride_lat;
+        const float* c = &m_padded_samples[r0*stride_rad + l0*stride_lat + e0];
+        const auto c000 = c[0];
+        const auto c001 = c[1];
+        const auto c010 = c[stride_lat];
+        const auto c011 = c[stride_lat + 1];
+        const auto c100 = c[stride_rad];
+        const auto c101 = c[stride_rad + 1];
+        const auto c110 = c[stride_rad + stride_lat];
+        const auto c111 = c[stride_rad + stride_lat + 1];
+
+        // radial interpolation
+        const auto c00 = (1.0f-fractional_r)*c000 + fractional_r*c100;
+        const auto c10 = (1.0f-fractional_r)*c010 + fractional_r*c110;
+        const auto c01 = (1.0f-fractional_r)*c001 + fractional_r*c101;
+        const auto c11 = (1.0f-fractional_r)*c011 + fractional_r*c111;
+
+        // lateral interpolation
+        const auto c0 = (1.0f-fractional_l)*c00 + fractional_l*c10;
+        const auto c1 = (1.0f-fractional_l)*c01 + fractional_l*c11;
+
+        // finally, elevational interpolation
+        return (1.0f-fractional_e)*c0 + fractional_e*c1;
+    }
+
+    // The samples with a border of zero guard voxels, one before and two
+    // after the samples in each dimension. A continuous sample index t is
+    // clamped to [-1, n] and shifted by one, so that all eight corners of a
+    // lookup are inside the padded samples without checking the bounds, and
+    // the profile falls off linearly to zero over one delta outside the data.
+    struct PaddedLayout {
+        const float* samples;
+        int   stride_rad;           // elements between radial neighbours
+        int   stride_lat;           // elements between lateral neighbours
+        float first_rad,     first_lat,     first_ele;
+        float inv_delta_rad, inv_delta_lat, inv_delta_ele;
+        float max_index_rad, max_index_lat, max_index_ele;  // the number of samples
+    };
+
+    // Valid until the next call to setDiscreteSample().
+    PaddedLayout getPaddedLayout() const;
+
     // Set sample based on discrete indices.
     void setDiscreteSample(int ir, int il, int ie, float new_sample);
 
@@ -121,25 +197,98 @@ public:
         return m_num_samples_ele;
     }
 
+    // All samples in the layout described for the constructor.
+    const std::vector<float>& getSamples() const {
+        return m_samples;
+    }
+
 protected:
+    // Check the number of samples and compute the sample deltas.
+    void initialize();
+
     // row-major indexing
     // dim0: radial, dim1: lateral, dim2: elevational
-    long getIndex(int r, int l, int e) {
+    long getIndex(int r, int l, int e) const {
         return e+m_num_samples_ele*l+m_num_samples_lat*m_num_samples_ele*r;
     }
 
+    // Index into the padded samples of the sample with the given indices.
+    long getPaddedIndex(int r, int l, int e) const {
+        return (e+1)+(m_num_samples_ele+3)*(l+1)+(m_num_samples_lat+3)*(m_num_samples_ele+3)*(r+1);
+    }
+
+    // Continuous index t into the padded samples, see PaddedLayout.
+    static float getPaddedIndex(float t, int num_samples) {
+        // operand order so that NaN maps to -1
+        return std::min(static_cast<float>(num_samples), std::max(-1.0f, t)) + 1.0f;
+    }
+
+    // Copy the samples into the padded layout.
+    void updatePaddedSamples();
+
 protected:
     int m_num_samples_rad;
     int m_num_samples_lat;
     int m_num_samples_ele;
-    double m_dr;
-    double m_dl;
-    double m_de;
+    float m_inv_dr;
+    float m_inv_dl;
+    float m_inv_de;
     std::vector<float> m_samples;
+    std::vector<float> m_padded_samples;
     Interval m_range_range;
     Interval m_lateral_range;
     Interval m_elevational_range;
 };
 
+// Lookup-table beam profile with several radial zones, each a LUTBeamProfile
+// with its own sampling, so that e.g. the smooth far field can be sampled
+// more coarsely than the focal region. The zones are ordered by their
+// radial ranges, which may overlap or leave gaps. A position is sampled in
+// the zone whose range is closest, with the boundary between consecutive
+// zones midway between the end of one and the start of the next.
+class DLL_PUBLIC MultiResolutionLUTBeamProfile : public IBeamProfile {
+public:
+    // Throws std::runtime_error if there are no zones, or if the starts and
+    // ends of the radial ranges are not strictly increasing.
+    explicit MultiResolutionLUTBeamProfile(std::vector<LUTBeamProfile> zones);
+
+    virtual float sampleProfile(float r, float l, float e);
+
+    // Non-virtual version of sampleProfile() which can be inlined in loops
+    // where the concrete profile type is known.
+    float sample(float r, float l, float e) const {
+        return m_zones[getZoneIndex(r)].sample(r, l, e);
+    }
+
+    // The zone a radial distance is sampled in.
+    int getZoneIndex(float r) const {
+        int zone = 0;
+        while ((zone < static_cast<int>(m_zone_boundaries.size())) && (r >= m_zone_boundaries[zone])) {
+            zone++;
+        }
+        return zone;
+    }
+
+    int getNumZones() const {
+        return static_cast<int>(m_zones.size());
+    }
+
+    const LUTBeamProfile& getZone(int zone) const {
+        return m_zones[zone];
+    }
+
+    // Radial distances where zone i ends and zone i+1 starts.
+    const std::vector<float>& getZoneBoundaries() const {
+        return m_zone_boundaries;
+    }
+
+    // Number of samples of all zones.
+    size_t getNumSamples() const;
+
+protected:
+    std::vector<LUTBeamProfile> m_zones;
+    std::vector<float>          m_zone_boundaries;
+};
+
 }   // namespace
 
@@ -27,11 +27,17 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 #include "LibBCSim.hpp"
+#include "algorithm/AutoAlgorithm.hpp"
 #include "algorithm/CpuAlgorithm.hpp"
+#include "algorithm/HybridAlgorithm.hpp"
+#include "algorithm/ScattererGrid.hpp"
 #ifdef BCSIM_ENABLE_CUDA
     #include "algorithm/GpuAlgorithm.hpp"
+    #include "algorithm/MultiGpuAlgorithm.hpp"
 #endif
 
 namespace bcsim {
@@ -39,13 +45,63 @@ namespace bcsim {
 IAlgorithm::s_ptr Create(const std::string& sim_type) {
     if (sim_type == "cpu") {
         return IAlgorithm::s_ptr(new CpuAlgorithm);
+    } else if (sim_type == "auto") {
+        return IAlgorithm::s_ptr(new AutoAlgorithm);
 #ifdef BCSIM_ENABLE_CUDA
     } else if (sim_type == "gpu") {
         return IAlgorithm::s_ptr(new GpuAlgorithm);
+    } else if (sim_type == "multi_gpu") {
+        return IAlgorithm::s_ptr(new MultiGpuAlgorithm);
+    } else if (sim_type == "hybrid") {
+        return IAlgorithm::s_ptr(new HybridAlgorithm(std::make_shared<CpuAlgorithm>(), std::make_shared<GpuAlgorithm>()));
+#endif
+#ifdef BCSIM_ENABLE_HIP
+    } else if (sim_type == "hip") {
+        return IAlgorithm::s_ptr(new GpuAlgorithm);
 #endif
     } else {
         throw std::runtime_error("Illegal algorithm type: " + sim_type);
     }
 }
 
+void sort_fixed_scatterers_for_culling(FixedScatterers& fixed_scatterers) {
+    auto& scatterers = fixed_scatterers.scatterers;
+    const auto num_scatterers = scatterers.size();
+    if (num_scatterers == 0) {
+        return;
+    }
+    std::vector<float> xs(num_scatterers);
+    std::vector<float> ys(num_scatterers);
+    std::vector<float> zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = scatterers[i].pos.x;
+        ys[i] = scatterers[i].pos.y;
+        zs[i] = scatterers[i].pos.z;
+    }
+    ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation);
+    std::vector<PointScatterer> sorted(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        sorted[i] = scatterers[permutation[i]];
+    }
+    scatterers.swap(sorted);
+}
+
+void sort_fixed_scatterers_for_culling(float* xs, float* ys, float* zs, float* as, size_t num_scatterers) {
+    if (num_scatterers == 0) {
+        return;
+    }
+    ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs, ys, zs, num_scatterers, permutation);
+    std::vector<float> sorted(num_scatterers);
+    for (auto values : {xs, ys, zs, as}) {
+        for (size_t i = 0; i < num_scatterers; i++) {
+            sorted[i] = values[permutation[i]];
+        }
+        std::copy(sorted.begin(), sorted.end(), values);
+    }
+}
+
 }   // end namespace
@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <vector>
 #include <complex>
+#include <future>
+#include <functional>
 #include "export_macros.hpp"
 #include "BCSimConfig.hpp"
 #include "ScanSequence.hpp"
@@ -38,11 +40,45 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace bcsim {
 
+// The IQ lines of a frame in memory of a CUDA device, [line][sample] with
+// get_num_samples() samples per line and no padding, which stays allocated
+// as long as the frame is referenced. It is written asynchronously.
+class IDeviceIqFrame {
+public:
+    typedef std::shared_ptr<IDeviceIqFrame> s_ptr;
+
+    virtual ~IDeviceIqFrame() { }
+
+    // Device pointer to the samples.
+    virtual std::complex<float>* data() const = 0;
+
+    virtual size_t get_num_lines() const = 0;
+
+    virtual size_t get_num_samples() const = 0;
+
+    // The CUDA device number of the memory.
+    virtual int get_device() const = 0;
+
+    // The cudaStream_t the frame is written on.
+    virtual void* get_stream() const = 0;
+
+    // Make the work queued afterwards to a cudaStream_t, where null is the
+    // default stream, wait until the frame has been written.
+    virtual void make_stream_wait(void* stream) const = 0;
+
+    // Block the calling thread until the frame has been written.
+    virtual void synchronize() const = 0;
+};
+
 // Interface for simulator algorithm implementations
 class IAlgorithm {
 public:
     typedef std::shared_ptr<IAlgorithm> s_ptr;
     typedef std::unique_ptr<IAlgorithm> u_ptr;
+
+    // Receives the number of a finished line of a frame and its num_samples
+    // IQ samples (see get_output_dimensions()).
+    typedef std::function<void(size_t line_no, const std::complex<float>* iq_samples)> LineCallback;
     
     virtual ~IAlgorithm() { }
 
@@ -58,12 +94,44 @@ public:
     // Add a new set of fixed point scatterers.
     virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                           = 0;
 
+    // Add a procedural fixed dataset, which counts as a fixed dataset for
+    // clear_fixed_scatterers() and the dataset numbers, but cannot be updated.
+    // The CPU simulator generates the scatterers while projecting them, the
+    // others store the expanded dataset.
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                 = 0;
+
+    // Add an image volume dataset, which behaves like a procedural one. Its
+    // counts must be up to date (see ImageVolumeScatterers::update_counts()).
+    // The CPU simulator only visits the voxels close to each line when
+    // scatterer culling is on.
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)              = 0;
+
+    // Add a fixed dataset whose arrays are owned by someone else, which
+    // cannot be updated. The CPU simulator projects the scatterers where they
+    // are, and culls them if they are in the order of
+    // sort_fixed_scatterers_for_culling(). The others store a copy.
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)          = 0;
+
     // Clear all spline scatterers.
     virtual void clear_spline_scatterers()                                              = 0;
 
     // Add a new set of spline point scatterers.
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                         = 0;
 
+    // Replace some scatterers of fixed dataset number dset_idx (in the order
+    // the datasets were added). indices are the positions of the scatterers
+    // in the dataset as it was added, and new_scatterers their new values.
+    // Much cheaper than adding the dataset again when few scatterers change.
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers) = 0;
+
+    // Replace some scatterers of spline dataset number dset_idx. Spline i of
+    // new_scatterers holds the control points and amplitude of scatterer
+    // indices[i], with the same number of control points as the dataset.
+    // The dataset passed to add_spline_scatterers() is not modified.
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers) = 0;
+
     // Set scan sequence to use when simulating all RF lines.
     virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               = 0;
 
@@ -80,20 +148,184 @@ public:
     // Requires that everything is properly configured.
     virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines) = 0;
 
+    // Get the dimensions of the IQ data produced by simulate_lines() with the
+    // current configuration. Throws std::runtime_error if the scan sequence
+    // and excitation are not configured.
+    virtual void get_output_dimensions(size_t& /*out*/ num_lines, size_t& /*out*/ num_samples) const = 0;
+
+    // Get the two-way travel time [s] of the first IQ sample of each line,
+    // which is zero unless the scan sequence has a depth window (see
+    // ScanSequence::r_min). Throws std::runtime_error if the scan sequence
+    // and excitation are not configured.
+    virtual float get_output_start_time() const = 0;
+
+    // Simulate all RF lines into a caller-owned contiguous buffer without any
+    // allocations. Line i is written to iq_buffer + i*line_stride, and the
+    // buffer must have room for num_lines*line_stride samples. line_stride is
+    // in samples and must be at least num_samples (see get_output_dimensions()).
+    virtual void simulate_lines(std::complex<float>* /*out*/ iq_buffer, size_t line_stride) = 0;
+
+    // Queue simulate_lines() into iq_buffer and return at once. The future
+    // becomes ready when the frame has been written, or holds the exception
+    // of the simulation. The frames of a simulator are simulated in the
+    // order they were queued, on CUDA streams or a thread pool shared by all
+    // simulators. Until the futures of all queued frames are ready, the
+    // buffers must be left alone, and the simulator may only be used to
+    // queue frames and to get the "stats_*" parameters: the setters,
+    // scatterer updates and the other simulate functions must wait for the
+    // frames first, and so must the destruction of the simulator.
+    virtual std::future<void> simulate_lines_async(std::complex<float>* /*out*/ iq_buffer, size_t line_stride) = 0;
+
+    // Like simulate_lines() into a caller-owned buffer, but with samples of
+    // the given format (see iq_format.hpp). Line i starts at sample
+    // i*line_stride, i.e. at byte i*line_stride*iq_sample_bytes(). The CPU
+    // simulator converts the lines as they finish, and the GPU simulator on
+    // the device before the copy to the host, so that only the converted
+    // samples are copied. Returns the scale of COMPLEX_INT16 samples, where
+    // a sample is the IQ value times the scale, and one for the float
+    // formats. The line callback gets the float samples.
+    virtual float simulate_lines_formatted(const IqOutputFormat& format, void* /*out*/ iq_buffer, size_t line_stride) = 0;
+
+    // Start simulating a sequence of frames, e.g. a cine loop. Frame i uses
+    // the current scan sequence with timestamp_offsets[i] added to the
+    // timestamps of all lines. Implementations may keep several frames in
+    // flight, so the configuration must not be changed until the last frame
+    // has been retrieved.
+    virtual void begin_stream(const std::vector<float>& timestamp_offsets) = 0;
+
+    // Get the next frame of the stream started by begin_stream(), with the
+    // same buffer layout as simulate_lines(). Returns false without writing
+    // to the buffer when all frames have been retrieved.
+    virtual bool next_frame(std::complex<float>* /*out*/ iq_buffer, size_t line_stride) = 0;
+
+    // Set a function which is called for each line of the frames of
+    // simulate_lines(), simulate_lines_async() and next_frame() as soon as
+    // the line is finished, so that it can be consumed before the rest of the
+    // frame. The samples may be in a buffer of the simulator which is only
+    // valid during the call. The CPU simulator calls the function from its
+    // threads as they finish lines, concurrently and in any order, the GPU
+    // simulators once per line when a batch of lines has been copied to the
+    // host, for simulate_lines_async() from a CUDA host function which must
+    // not make CUDA calls. The function is not called for the frames of the
+    // other simulate functions. An empty function disables the callback.
+    virtual void set_line_callback(LineCallback callback) = 0;
+
+    // Simulate a color Doppler packet: packet_size frames of the current scan
+    // sequence, where frame p has p*prt added to all timestamps, as one batch
+    // of num_lines*packet_size lines. The IQ samples are stored ensemble-
+    // contiguous, i.e. sample j of frame p of line i is written to
+    // packets[(i*num_samples + j)*packet_size + p].
+    virtual void simulate_packets(size_t packet_size, float prt, std::complex<float>* /*out*/ packets) = 0;
+
+    // Simulate the frames of begin_stream() and next_frame() for the
+    // timestamp offsets as one batch of num_frames*num_lines lines, so that
+    // the lines of all frames are simulated in parallel, e.g. for cine loops
+    // with few lines per frame. The frame of offset k has the layout of
+    // simulate_lines() and is written to iq_buffer + k*frame_stride, so
+    // frame_stride must be at least num_lines*line_stride. The line callback
+    // is not called.
+    virtual void simulate_frames(const std::vector<float>& timestamp_offsets, std::complex<float>* /*out*/ iq_buffer,
+                                 size_t line_stride, size_t frame_stride) = 0;
+
+    // Simulate the scan sequence once for each of several independent
+    // realizations of the fixed scatterers, e.g. speckle phantoms for
+    // training data, as one batch of num_realizations*num_lines lines. The
+    // realizations and their copies of the lines are translated apart so that
+    // no line reaches another realization, assuming that the beam profile is
+    // narrower than the line length. With "scatterer_culling" on, each line
+    // only visits the scatterers of its own realization. The frame of
+    // realization k has the layout of simulate_lines() and is written to
+    // iq_buffer + k*frame_stride. The configured fixed scatterers are restored
+    // afterwards. Throws std::runtime_error if spline scatterers are
+    // configured.
+    virtual void simulate_realizations(const std::vector<FixedScatterers::s_ptr>& realizations,
+                                       std::complex<float>* /*out*/ iq_buffer,
+                                       size_t line_stride, size_t frame_stride) = 0;
+
+    // Simulate all lines once for each of the excitations, e.g. the pulses
+    // of pulse inversion or of a multi-frequency study, from one projection
+    // of the scatterers where possible. The frame of excitation k has the
+    // layout of simulate_lines() and is written to iq_buffer + k*frame_stride,
+    // so frame_stride must be at least num_lines*line_stride. The excitations
+    // must have the sampling frequency of the configured excitation, which is
+    // used for the projection and is left configured.
+    virtual void simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                 std::complex<float>* /*out*/ iq_buffer,
+                                                 size_t line_stride, size_t frame_stride) = 0;
+
+    // Simulate all lines and convert them to an 8-bit B-mode image of
+    // config.width*config.height pixels, stored row by row. The GPU
+    // implementation does this on the device and only copies the image to
+    // the host. Returns the normalization constant that was used.
+    virtual float simulate_bmode_image(const BModeImageConfig& config, unsigned char* /*out*/ image) = 0;
+
+    // Like simulate_bmode_image(), but device_image is memory on the CUDA
+    // device of the simulator, e.g. an OpenGL buffer mapped with the CUDA
+    // graphics interop API, so that the image never leaves the device. The
+    // image is complete when the call returns. Throws std::runtime_error for
+    // simulators which do not run on a CUDA device.
+    virtual float simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* /*out*/ device_image) = 0;
+
+    // Like simulate_lines(), but the lines stay in a new frame on the CUDA
+    // device of the simulator, e.g. for further GPU processing, and the line
+    // callback is not called. The call returns when the frame has been
+    // queued for writing (see IDeviceIqFrame). Throws std::runtime_error for
+    // simulators which do not run on a single CUDA device.
+    virtual IDeviceIqFrame::s_ptr simulate_lines_on_device() = 0;
+
     // Get debug data by identifier. Throws std::runtime_error on invalid key.
     virtual std::vector<double> get_debug_data(const std::string& identifier) const = 0;
 
     // Get the total number of scatterers (fixed and dynamic)
     virtual size_t get_total_num_scatterers() const = 0;
 
+    // Memory currently allocated by the simulator, including the datasets
+    // shared with the caller (spline scatterers, beam profile).
+    virtual MemoryUsage get_memory_usage() const = 0;
+
+    // Estimate of get_memory_usage() after configuring scan_seq, adding a
+    // fixed dataset of num_fixed_scatterers and a spline dataset of
+    // num_spline_scatterers with num_cs control points, and simulating a
+    // frame, with the current excitation, beam profile and parameters. Does
+    // not include the buffers of simulate_bmode_image(), simulate_packets()
+    // or frame streams. Throws std::runtime_error if the excitation is not
+    // configured.
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const = 0;
+
     // Set log object to use (optional)
     virtual void set_logger(ILog::ptr log_object) = 0;
+
+    // Write the configuration (parameters, excitation, scan sequence, beam
+    // profile and scatterers) to a binary state file, which is much faster
+    // to restore than configuring a simulator from scratch. The fixed
+    // scatterers are also stored as sorted for culling, which a simulator
+    // with the same scatterer order uses instead of sorting them again.
+    virtual void save_state(const std::string& path) const = 0;
+
+    // Replace the configuration with one written by save_state(), possibly
+    // by another type of simulator. Throws std::runtime_error if invalid.
+    virtual void load_state(const std::string& path) = 0;
 };
 
 // Factory function for creating simulator instances.
 // Valid types are:
 //     "cpu"   - CPU implementation
 //     "gpu"   - GPU implementation
+//     "hip"   - the GPU implementation on AMD GPUs, the same as "gpu" in
+//               builds with BCSIM_ENABLE_HIP and unavailable otherwise
+//     "multi_gpu" - GPU implementation using all CUDA devices
+//     "hybrid" - CPU and GPU implementations sharing the lines of a frame
+//     "auto"  - one of the above, chosen for the machine and the workload
+//               when the first frame is simulated
 IAlgorithm::s_ptr DLL_PUBLIC Create(const std::string& sim_type);
 
+// Reorder the scatterers into the order the CPU simulator keeps them in with
+// its default parameters, so that external datasets made from them (see
+// IAlgorithm::add_external_fixed_scatterers()) can be culled.
+void DLL_PUBLIC sort_fixed_scatterers_for_culling(FixedScatterers& fixed_scatterers);
+
+// The same for scatterers in separate x, y, z and amplitude arrays, in place.
+void DLL_PUBLIC sort_fixed_scatterers_for_culling(float* xs, float* ys, float* zs, float* as, size_t num_scatterers);
+
 }   // namespace
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
 #include "ScanSequence.hpp"
 #include "vector3.hpp"
 
@@ -69,28 +70,123 @@ bool Scanline::is_normalized() const {
     return res;
 }
 
+Scanline Scanline::transformed(const Matrix3& rotation, const vector3& translation) const {
+    Scanline res;
+    res.origin          = rotation*origin + translation;
+    res.direction       = rotation*direction;
+    res.lateral_dir     = rotation*lateral_dir;
+    res.timestamp       = timestamp;
+    res.elevational_dir = res.lateral_dir.cross(res.direction);
+    return res;
+}
+
+Scanline ParametricScan::get_scanline(int line_no) const {
+    if ((line_no < 0) || (line_no >= get_num_lines())) {
+        throw std::runtime_error("ParametricScan: invalid line index");
+    }
+    const int frame_no   = line_no / get_num_frame_lines();
+    const int frame_line = line_no % get_num_frame_lines();
+    const int lateral_no = frame_line % num_lines_lateral;
+    const int plane_no   = frame_line / num_lines_lateral;
+    // the position in [-0.5, 0.5] of the line in the extents
+    const double u = (num_lines_lateral > 1) ? static_cast<double>(lateral_no)/(num_lines_lateral - 1) - 0.5 : 0.0;
+    const double v = (num_planes > 1) ? static_cast<double>(plane_no)/(num_planes - 1) - 0.5 : 0.0;
+    const auto timestamp = first_timestamp + frame_line*line_interval + frame_no*frame_interval;
+    Scanline line;
+    if (type == Type::LINEAR) {
+        const vector3 origin(static_cast<float>(u*lateral_extent), static_cast<float>(v*elevational_extent), 0.0f);
+        line = Scanline(origin, vector3(0.0f, 0.0f, 1.0f), vector3(1.0f, 0.0f, 0.0f), timestamp);
+    } else {
+        // rotation around y, then around x
+        const double a = u*lateral_extent + tilt;
+        const double b = v*elevational_extent;
+        const auto sin_a = std::sin(a);
+        const auto cos_a = std::cos(a);
+        const auto sin_b = std::sin(b);
+        const auto cos_b = std::cos(b);
+        const vector3 direction(static_cast<float>(sin_a), static_cast<float>(-sin_b*cos_a), static_cast<float>(cos_b*cos_a));
+        const vector3 lateral_dir(static_cast<float>(cos_a), static_cast<float>(sin_b*sin_a), static_cast<float>(-cos_b*sin_a));
+        line = Scanline(vector3(0.0f, 0.0f, 0.0f), direction, lateral_dir, timestamp);
+    }
+    const bool is_oriented = !rotation.is_identity() || (translation.x != 0.0f) || (translation.y != 0.0f) || (translation.z != 0.0f);
+    return is_oriented ? line.transformed(rotation, translation) : line;
+}
+
 ScanSequence::ScanSequence(float line_length)
     : line_length(line_length),
-      all_timestamps_equal(false)
+      r_min(0.0f),
+      r_max(0.0f),
+      all_timestamps_equal(false),
+      lines_per_frame(0),
+      m_is_parametric(false),
+      m_parametric_first_line(0),
+      m_parametric_num_lines(0)
 {
 }
 
+ScanSequence::ScanSequence(float line_length, const ParametricScan& scan, int first_line, int num_lines)
+    : line_length(line_length),
+      r_min(0.0f),
+      r_max(0.0f),
+      all_timestamps_equal((scan.line_interval == 0.0f) && ((scan.num_frames == 1) || (scan.frame_interval == 0.0f))),
+      lines_per_frame(0),
+      m_is_parametric(true),
+      m_parametric_scan(scan),
+      m_parametric_first_line(first_line),
+      m_parametric_num_lines(num_lines < 0 ? scan.get_num_lines() - first_line : num_lines)
+{
+    if ((scan.num_lines_lateral <= 0) || (scan.num_planes <= 0) || (scan.num_frames <= 0)) {
+        throw std::runtime_error("ParametricScan: number of lines, planes and frames must be positive");
+    }
+    if ((first_line < 0) || (first_line >= scan.get_num_lines()) || (m_parametric_num_lines < 0)) {
+        throw std::runtime_error("ScanSequence: invalid range of parametric lines");
+    }
+}
+
 int ScanSequence::get_num_lines() const {
-    return static_cast<int>(scanlines.size());
+    return m_is_parametric ? m_parametric_num_lines : static_cast<int>(scanlines.size());
 }
 
 void ScanSequence::add_scanline(Scanline new_line) {
+    if (m_is_parametric) {
+        throw std::runtime_error("ScanSequence: cannot add lines to a parametric sequence");
+    }
     scanlines.push_back(new_line);
 }
 
-const Scanline& ScanSequence::get_scanline(int index) const {
+Scanline ScanSequence::get_scanline(int index) const {
     if (index < 0 || index >= get_num_lines()) {
         throw std::runtime_error("ScanSequence::Invalid index.");
     }
+    if (m_is_parametric) {
+        return m_parametric_scan.get_scanline(std::min(m_parametric_first_line + index, m_parametric_scan.get_num_lines() - 1));
+    }
     return scanlines[index];
 }
 
+const ParametricScan& ScanSequence::get_parametric_scan() const {
+    if (!m_is_parametric) {
+        throw std::runtime_error("ScanSequence: not a parametric sequence");
+    }
+    return m_parametric_scan;
+}
+
+void ScanSequence::transform(const Matrix3& rotation, const vector3& translation) {
+    if (m_is_parametric) {
+        m_parametric_scan.translation = rotation*m_parametric_scan.translation + translation;
+        m_parametric_scan.rotation    = rotation*m_parametric_scan.rotation;
+        return;
+    }
+    for (auto& line : scanlines) {
+        line = line.transformed(rotation, translation);
+    }
+}
+
 bool ScanSequence::is_valid() const {
+    // the parametric lines are orthonormal by construction
+    if (m_is_parametric) {
+        return true;
+    }
     bool res = true;
     int num_lines = static_cast<int>(get_num_lines());
     for (int line_no = 0; line_no < num_lines; line_no++) {
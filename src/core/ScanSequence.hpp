@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include "export_macros.hpp"
 #include "BCSimConfig.hpp"
+#include "matrix3.hpp"
 
 namespace bcsim {
 
@@ -65,6 +66,10 @@ public:
 
     // Verify that the unit vectors are orthonormal
     bool is_valid() const;
+
+    // The line rotated and then translated. Rotations keep the unit vectors
+    // orthonormal, so they are not verified again.
+    Scanline transformed(const Matrix3& rotation, const vector3& translation) const;
         
 private:
     // The start point.
@@ -91,6 +96,59 @@ private:
     bool is_normalized() const;
 };
 
+// Parametric description of a conventional 2D or 3D scan, whose lines are
+// evaluated when needed instead of being stored. Line i of elevational plane
+// j is line number j*num_lines_lateral + i. For zero angles the lines are
+// along z with the lateral direction x, as the ones of CreateScanSequence().
+//   LINEAR: parallel lines with origins spread evenly over the lateral extent
+//           [m] along x and the elevational extent [m] along y.
+//   SECTOR: lines from the origin, rotated by angles spread evenly over the
+//           lateral extent [rad] around y, plus the tilt, and then by angles
+//           spread over the elevational extent [rad] around x.
+// With a single line or plane it is in the center of the extent. The lines
+// of a frame are repeated for num_frames frames, e.g. for a packet. Last,
+// the lines are rotated and translated as by ScanSequence::transform().
+struct DLL_PUBLIC ParametricScan {
+    enum class Type {
+        LINEAR = 0,
+        SECTOR
+    };
+
+    ParametricScan()
+        : type(Type::LINEAR), num_lines_lateral(1), num_planes(1), lateral_extent(0.0f),
+          elevational_extent(0.0f), tilt(0.0f), first_timestamp(0.0f), line_interval(0.0f),
+          num_frames(1), frame_interval(0.0f), rotation(), translation(0.0f, 0.0f, 0.0f) { }
+
+    int get_num_frame_lines() const {
+        return num_lines_lateral*num_planes;
+    }
+
+    int get_num_lines() const {
+        return get_num_frame_lines()*num_frames;
+    }
+
+    // Evaluate line line_no in [0, get_num_lines()).
+    Scanline get_scanline(int line_no) const;
+
+    Type    type;
+    int     num_lines_lateral;
+    int     num_planes;
+    float   lateral_extent;
+    float   elevational_extent;
+    float   tilt;               // [rad], sector scans only
+
+    // Timing: line k of frame f is fired at
+    // first_timestamp + k*line_interval + f*frame_interval [s].
+    float   first_timestamp;
+    float   line_interval;
+    int     num_frames;
+    float   frame_interval;
+
+    // Orientation of the probe.
+    Matrix3 rotation;
+    vector3 translation;
+};
+
 // A collection of scanlines that defines the complete scan.
 // The length of scanlines is common to all lines in a scan sequence.
 class DLL_PUBLIC ScanSequence {
@@ -99,13 +157,38 @@ public:
     typedef std::unique_ptr<ScanSequence> u_ptr;
 
     ScanSequence(float line_length);
+
+    // The lines [first_line, first_line + num_lines) of a parametric scan,
+    // all of them if num_lines is negative. Lines past the end of the scan
+    // repeat its last line, as for the padding of a line batch. Takes
+    // constant memory; lines cannot be added to it.
+    ScanSequence(float line_length, const ParametricScan& scan, int first_line = 0, int num_lines = -1);
     
     int get_num_lines() const;
     
     // Add a new scanline to the scan sequence.
     void add_scanline(Scanline new_line);
     
-    const Scanline& get_scanline(int index) const;
+    // Returned by value since the lines of a parametric sequence are
+    // evaluated by each call.
+    Scanline get_scanline(int index) const;
+
+    bool is_parametric() const {
+        return m_is_parametric;
+    }
+
+    // The parametric scan and the index in it of the first line of this
+    // sequence. Only valid if is_parametric().
+    const ParametricScan& get_parametric_scan() const;
+
+    int get_parametric_first_line() const {
+        return m_parametric_first_line;
+    }
+
+    // Rotate and then translate all lines in place, in a single pass over
+    // the lines of an explicit sequence and in constant time for a
+    // parametric one, whose orientation is updated instead.
+    void transform(const Matrix3& rotation, const vector3& translation);
 
     // Verify that all scanlines are valid.
     bool is_valid() const;
@@ -113,13 +196,36 @@ public:
     // The beam length [m]
     float line_length;
 
+    // Optional depth window [m]: if r_max is positive, only the depths
+    // between r_min and r_max, with a margin of the excitation length, are
+    // simulated, and the output lines start at the first simulated sample
+    // (see IAlgorithm::get_output_start_time()). Requires
+    // 0 <= r_min < r_max <= line_length.
+    float r_min;
+    float r_max;
+
+    bool has_depth_window() const {
+        return r_max > 0.0f;
+    }
+
     // If set to true, all scanlines have exactly equal timestamps
     // which is defined by the timestamp of the first line. This is
     // needed for knowing when to apply the optimized spline alg.
     bool all_timestamps_equal;
 
+    // The number of lines of each frame if the sequence holds the lines of
+    // several frames one after the other, as in IAlgorithm::simulate_frames(),
+    // and 0 if it is one frame. The CPU simulator only shares rendered
+    // spline positions between the lines of a frame.
+    int lines_per_frame;
+
 private:
     std::vector<Scanline> scanlines;
+
+    bool            m_is_parametric;
+    ParametricScan  m_parametric_scan;
+    int             m_parametric_first_line;
+    int             m_parametric_num_lines;
 };
 
 }   // namespace
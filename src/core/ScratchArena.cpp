@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdlib>
+#include <utility>
+#include "ScratchArena.hpp"
+#ifdef __linux__
+    #include <sys/mman.h>
+#endif
+
+namespace bcsim {
+
+namespace {
+
+// Transparent huge pages on x86-64 Linux.
+const size_t HUGE_PAGE_BYTES = 2*1024*1024;
+
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1)/multiple*multiple;
+}
+
+bool use_huge_pages(size_t num_bytes, bool huge_pages) {
+#ifdef __linux__
+    return huge_pages && (num_bytes >= HUGE_PAGE_BYTES);
+#else
+    return false;
+#endif
+}
+
+}   // end anonymous namespace
+
+void* allocate_aligned(size_t num_bytes, bool huge_pages) {
+    if (num_bytes == 0) {
+        num_bytes = 1;
+    }
+#ifdef __linux__
+    if (use_huge_pages(num_bytes, huge_pages)) {
+        auto ptr = mmap(nullptr, round_up(num_bytes, HUGE_PAGE_BYTES), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        // only a hint, so a failure leaves normal pages
+        madvise(ptr, round_up(num_bytes, HUGE_PAGE_BYTES), MADV_HUGEPAGE);
+        return ptr;
+    }
+#endif
+    void* ptr = nullptr;
+#if defined(_WIN32) || defined(_WIN64)
+    ptr = _aligned_malloc(round_up(num_bytes, SCRATCH_ALIGNMENT), SCRATCH_ALIGNMENT);
+#else
+    if (posix_memalign(&ptr, SCRATCH_ALIGNMENT, round_up(num_bytes, SCRATCH_ALIGNMENT)) != 0) {
+        ptr = nullptr;
+    }
+#endif
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void free_aligned(void* ptr, size_t num_bytes, bool huge_pages) {
+    if (ptr == nullptr) {
+        return;
+    }
+#ifdef __linux__
+    if (use_huge_pages(num_bytes, huge_pages)) {
+        munmap(ptr, round_up(num_bytes, HUGE_PAGE_BYTES));
+        return;
+    }
+#else
+    (void) num_bytes;
+    (void) huge_pages;
+#endif
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+ScratchArena::ScratchArena(bool huge_pages)
+    : m_huge_pages(huge_pages),
+      m_block(Block{nullptr, 0, huge_pages}),
+      m_used(0),
+      m_overflow_bytes(0)
+{ }
+
+ScratchArena::~ScratchArena() {
+    release();
+}
+
+ScratchArena::ScratchArena(ScratchArena&& other) noexcept
+    : m_huge_pages(other.m_huge_pages),
+      m_block(other.m_block),
+      m_used(other.m_used),
+      m_overflow(std::move(other.m_overflow)),
+      m_overflow_bytes(other.m_overflow_bytes)
+{
+    other.m_block = Block{nullptr, 0, other.m_huge_pages};
+    other.m_used = 0;
+    other.m_overflow.clear();
+    other.m_overflow_bytes = 0;
+}
+
+ScratchArena& ScratchArena::operator=(ScratchArena&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_huge_pages = other.m_huge_pages;
+        m_block = other.m_block;
+        m_used = other.m_used;
+        m_overflow = std::move(other.m_overflow);
+        m_overflow_bytes = other.m_overflow_bytes;
+        other.m_block = Block{nullptr, 0, other.m_huge_pages};
+        other.m_used = 0;
+        other.m_overflow.clear();
+        other.m_overflow_bytes = 0;
+    }
+    return *this;
+}
+
+void ScratchArena::reset() {
+    if (!m_overflow.empty() || (m_block.huge_pages != m_huge_pages)) {
+        // one block for everything used since the last reset
+        const auto num_bytes = m_used + m_overflow_bytes;
+        release();
+        if (num_bytes > 0) {
+            m_block = allocate_block(num_bytes, m_huge_pages);
+        }
+    }
+    m_used = 0;
+}
+
+void ScratchArena::set_huge_pages(bool huge_pages) {
+    m_huge_pages = huge_pages;
+}
+
+size_t ScratchArena::capacity() const {
+    return m_block.num_bytes + m_overflow_bytes;
+}
+
+void* ScratchArena::allocate_bytes(size_t num_bytes) {
+    num_bytes = round_up(num_bytes, SCRATCH_ALIGNMENT);
+    if (m_used + num_bytes <= m_block.num_bytes) {
+        auto ptr = m_block.data + m_used;
+        m_used += num_bytes;
+        return ptr;
+    }
+    m_overflow.push_back(allocate_block(num_bytes, m_huge_pages));
+    m_overflow_bytes += num_bytes;
+    return m_overflow.back().data;
+}
+
+ScratchArena::Block ScratchArena::allocate_block(size_t num_bytes, bool huge_pages) {
+    num_bytes = round_up(num_bytes, SCRATCH_ALIGNMENT);
+    return Block{static_cast<char*>(allocate_aligned(num_bytes, huge_pages)), num_bytes, huge_pages};
+}
+
+void ScratchArena::free_block(Block& block) {
+    free_aligned(block.data, block.num_bytes, block.huge_pages);
+    block.data = nullptr;
+    block.num_bytes = 0;
+}
+
+void ScratchArena::release() {
+    free_block(m_block);
+    m_block.huge_pages = m_huge_pages;
+    for (auto& block : m_overflow) {
+        free_block(block);
+    }
+    m_overflow.clear();
+    m_overflow_bytes = 0;
+    m_used = 0;
+}
+
+}   // end namespace
@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+#include "export_macros.hpp"
+
+namespace bcsim {
+
+// Alignment of the scratch memory, which is a cache line and the width of
+// an AVX-512 register.
+const size_t SCRATCH_ALIGNMENT = 64;
+
+// Memory aligned to SCRATCH_ALIGNMENT, optionally backed by transparent huge
+// pages when at least a huge page is requested (Linux only, otherwise
+// ignored). Throws std::bad_alloc on failure.
+DLL_PUBLIC void* allocate_aligned(size_t num_bytes, bool huge_pages = false);
+DLL_PUBLIC void free_aligned(void* ptr, size_t num_bytes, bool huge_pages = false);
+
+// Allocator for containers whose data is given to SIMD kernels.
+template <typename T>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+
+    AlignedAllocator() { }
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) { }
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max()/sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(allocate_aligned(n*sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        free_aligned(ptr, n*sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Bump allocator for the scratch buffers of one thread, such as the
+// time-projections of a block of lines. Every allocation is aligned to
+// SCRATCH_ALIGNMENT, and reset() frees all allocations at once. An arena
+// grows to the most memory used between two resets, so that in steady
+// state, when the same buffers are allocated after every reset, it does
+// not allocate from the heap.
+class DLL_PUBLIC ScratchArena {
+public:
+    explicit ScratchArena(bool huge_pages = false);
+
+    ~ScratchArena();
+
+    ScratchArena(ScratchArena&& other) noexcept;
+    ScratchArena& operator=(ScratchArena&& other) noexcept;
+
+    // Invalidates all memory from allocate(). Memory of a huge-page arena is
+    // reallocated when the setting changes.
+    void reset();
+
+    void set_huge_pages(bool huge_pages);
+
+    // Uninitialized memory for n values, valid until the next reset().
+    template <typename T>
+    T* allocate(size_t n) {
+        return static_cast<T*>(allocate_bytes(n*sizeof(T)));
+    }
+
+    // Zeroed memory for n values, valid until the next reset().
+    template <typename T>
+    T* allocate_zeroed(size_t n) {
+        auto ptr = allocate<T>(n);
+        for (size_t i = 0; i < n; i++) {
+            ptr[i] = T();
+        }
+        return ptr;
+    }
+
+    // Bytes owned by the arena.
+    size_t capacity() const;
+
+private:
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    struct Block {
+        char*   data;
+        size_t  num_bytes;
+        bool    huge_pages;
+    };
+
+    void* allocate_bytes(size_t num_bytes);
+
+    static Block allocate_block(size_t num_bytes, bool huge_pages);
+    static void free_block(Block& block);
+
+    void release();
+
+private:
+    bool                m_huge_pages;
+    Block               m_block;
+    size_t              m_used;
+    // blocks allocated when m_block was too small, which are merged into a
+    // larger m_block by the next reset()
+    std::vector<Block>  m_overflow;
+    size_t              m_overflow_bytes;
+};
+
+}   // end namespace
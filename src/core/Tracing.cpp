@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#ifdef BCSIM_ENABLE_NVTX
+    #include <nvToolsExt.h>
+#endif
+#include "Tracing.hpp"
+
+namespace bcsim {
+namespace trace {
+
+namespace {
+
+struct Event {
+    const char*     name;
+    const char*     category;
+    std::int64_t    start_ns;
+    std::int64_t    duration_ns;
+};
+
+// Fixed-size block of events in a singly linked list.
+struct Chunk {
+    static const size_t CAPACITY = 4096;
+
+    Chunk() : count(0), next(nullptr) { }
+
+    Event                   events[CAPACITY];
+    std::atomic<size_t>     count;      // number of events that can be read
+    std::atomic<Chunk*>     next;
+};
+
+// The events of one thread. Only the owning thread appends, and it publishes
+// every event by incrementing the count after writing it, so readers can
+// traverse the chunks concurrently without any locks.
+class ThreadBuffer {
+public:
+    explicit ThreadBuffer(int thread_id)
+        : m_thread_id(thread_id), m_head(new Chunk), m_tail(m_head) { }
+
+    ~ThreadBuffer() {
+        auto chunk = m_head;
+        while (chunk) {
+            const auto next = chunk->next.load();
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    void append(const Event& event) {
+        auto n = m_tail->count.load(std::memory_order_relaxed);
+        if (n == Chunk::CAPACITY) {
+            auto chunk = new Chunk;
+            m_tail->next.store(chunk, std::memory_order_release);
+            m_tail = chunk;
+            n = 0;
+        }
+        m_tail->events[n] = event;
+        m_tail->count.store(n + 1, std::memory_order_release);
+    }
+
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (auto chunk = m_head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            const auto n = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < n; i++) {
+                fn(chunk->events[i]);
+            }
+        }
+    }
+
+    int thread_id() const {
+        return m_thread_id;
+    }
+
+private:
+    int     m_thread_id;
+    Chunk*  m_head;
+    Chunk*  m_tail;     // only used by the owning thread
+};
+
+std::atomic<bool>           g_enabled(false);
+// Events that started before this time have been cleared.
+std::atomic<std::int64_t>   g_cleared_ns(0);
+
+// All thread buffers ever created. They are kept after their threads exit so
+// that the events can still be written.
+std::mutex                                  g_buffers_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>>  g_buffers;
+
+ThreadBuffer& thread_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> guard(g_buffers_mutex);
+        g_buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<int>(g_buffers.size())));
+        buffer = g_buffers.back().get();
+    }
+    return *buffer;
+}
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void write_json_string(std::ostream& out, const char* s) {
+    out << '"';
+    for (; *s; s++) {
+        if ((*s == '"') || (*s == '\\')) out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+}
+
+void set_enabled(bool enabled) {
+    g_enabled.store(enabled);
+}
+
+bool is_enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void clear() {
+    g_cleared_ns.store(now_ns());
+}
+
+void write_chrome_trace(const std::string& path) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> guard(g_buffers_mutex);
+        buffers = g_buffers;
+    }
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("unable to open trace file " + path);
+    }
+
+    // timestamps in microseconds from the first event
+    const auto cleared_ns = g_cleared_ns.load();
+    std::int64_t first_ns = -1;
+    for (const auto& buffer : buffers) {
+        buffer->for_each([&](const Event& event) {
+            if ((event.start_ns >= cleared_ns) && ((first_ns < 0) || (event.start_ns < first_ns))) {
+                first_ns = event.start_ns;
+            }
+        });
+    }
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        buffer->for_each([&](const Event& event) {
+            if (event.start_ns < cleared_ns) {
+                return;
+            }
+            out << (first ? "\n" : ",\n") << "{\"name\": ";
+            write_json_string(out, event.name);
+            out << ", \"cat\": ";
+            write_json_string(out, event.category);
+            out << ", \"ph\": \"X\", \"ts\": " << 1e-3*(event.start_ns - first_ns)
+                << ", \"dur\": " << 1e-3*event.duration_ns
+                << ", \"pid\": 1, \"tid\": " << buffer->thread_id() << "}";
+            first = false;
+        });
+    }
+    out << "\n]}\n";
+    if (!out) {
+        throw std::runtime_error("failed writing trace file " + path);
+    }
+}
+
+ScopedEvent::ScopedEvent(const char* name, const char* category)
+    : m_name(name), m_category(category), m_start_ns(-1)
+{
+#ifdef BCSIM_ENABLE_NVTX
+    nvtxRangePushA(name);
+#endif
+    if (g_enabled.load(std::memory_order_relaxed)) {
+        m_start_ns = now_ns();
+    }
+}
+
+ScopedEvent::~ScopedEvent() {
+    end();
+}
+
+void ScopedEvent::end() {
+    if (m_name == nullptr) {
+        return;
+    }
+#ifdef BCSIM_ENABLE_NVTX
+    nvtxRangePop();
+#endif
+    if (m_start_ns >= 0) {
+        thread_buffer().append(Event{m_name, m_category, m_start_ns, now_ns() - m_start_ns});
+    }
+    m_name = nullptr;
+}
+
+}   // namespace trace
+}   // namespace bcsim
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include "export_macros.hpp"
+
+// Timeline tracing of the simulation stages on all threads. Events are
+// recorded in per-thread buffers without locks, and can be written as
+// Chrome trace JSON for chrome://tracing or Perfetto. When built with
+// NVTX (CUDA), every event is also an NVTX range, so that the stages show
+// up in Nsight Systems next to the CUDA streams.
+namespace bcsim {
+namespace trace {
+
+// Start or stop recording events. Recording is off by default, which leaves
+// a ScopedEvent with the cost of reading an atomic flag (and an NVTX range).
+void DLL_PUBLIC set_enabled(bool enabled);
+
+bool DLL_PUBLIC is_enabled();
+
+// Discard the events recorded so far. The memory of the buffers is kept
+// for the events recorded later.
+void DLL_PUBLIC clear();
+
+// Write the recorded events as Chrome trace JSON. Can be called while other
+// threads record events, which are then included or not. Throws
+// std::runtime_error if the file cannot be written.
+void DLL_PUBLIC write_chrome_trace(const std::string& path);
+
+// Records the time from construction to destruction as an event.
+// name and category are not copied, so they must be string literals or
+// otherwise outlive the trace.
+class DLL_PUBLIC ScopedEvent {
+public:
+    explicit ScopedEvent(const char* name, const char* category = "bcsim");
+
+    ~ScopedEvent();
+
+    // End the event before the end of the scope.
+    void end();
+
+    ScopedEvent(const ScopedEvent&) = delete;
+    ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+private:
+    const char*     m_name;         // null when ended
+    const char*     m_category;
+    std::int64_t    m_start_ns;     // negative if not recording
+};
+
+}   // namespace trace
+}   // namespace bcsim
@@ -0,0 +1,740 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "AlgorithmState.hpp"
+#include "CpuScatterers.hpp"
+#include "../BeamProfile.hpp"
+#include "../content_hash.hpp"
+#include "common_utils.hpp"
+
+namespace bcsim {
+namespace {
+
+const char      state_magic[8] = {'B', 'C', 'S', 'I', 'M', 'S', 'T', 'A'};
+// version 2 added the kind of each fixed dataset, version 3 image volumes,
+// version 4 the depth window of the scan sequence, version 5 the sorted
+// fixed datasets
+const uint32_t  state_version  = 5;
+
+// Format of the sorted fixed datasets at the end of a state file. A reader
+// of another format ignores them, since the configuration before them is
+// complete without them.
+const uint32_t  layout_format  = 1;
+
+enum ProfileKind : uint32_t {
+    PROFILE_NONE = 0,
+    PROFILE_ANALYTICAL,
+    PROFILE_LOOKUP,
+    PROFILE_MULTI_RESOLUTION_LOOKUP
+};
+
+enum FixedKind : uint8_t {
+    FIXED_STORED = 0,
+    FIXED_PROCEDURAL,
+    FIXED_IMAGE_VOLUME
+};
+
+static_assert(sizeof(PointScatterer) == 4*sizeof(float), "PointScatterer must be four packed floats");
+
+bool same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+}   // namespace
+
+// Receives the serialized state, either for a state file or for a hash.
+class StateWriter {
+public:
+    virtual ~StateWriter() { }
+
+    template <typename T>
+    void value(const T& v) {
+        write(&v, sizeof(T));
+    }
+
+    template <typename T>
+    void vector(const std::vector<T>& v) {
+        value<uint64_t>(v.size());
+        write(v.data(), v.size()*sizeof(T));
+    }
+
+    void string(const std::string& s) {
+        value<uint64_t>(s.size());
+        write(s.data(), s.size());
+    }
+
+    void vec3(const vector3& v) {
+        value(v.x); value(v.y); value(v.z);
+    }
+
+protected:
+    virtual void write(const void* data, size_t num_bytes) = 0;
+};
+
+namespace {
+
+class StateFileWriter : public StateWriter {
+public:
+    explicit StateFileWriter(const std::string& path) : m_out(path, std::ios::binary | std::ios::trunc) {
+        if (!m_out) {
+            throw std::runtime_error("failed to create state file " + path);
+        }
+    }
+
+    void finish() {
+        m_out.flush();
+        if (!m_out) {
+            throw std::runtime_error("failed to write state file");
+        }
+    }
+
+protected:
+    virtual void write(const void* data, size_t num_bytes) override {
+        m_out.write(static_cast<const char*>(data), num_bytes);
+    }
+
+private:
+    std::ofstream   m_out;
+};
+
+class StateHashWriter : public StateWriter {
+public:
+    explicit StateHashWriter(ContentHash& hash) : m_hash(hash) { }
+
+protected:
+    virtual void write(const void* data, size_t num_bytes) override {
+        m_hash.update(data, num_bytes);
+    }
+
+private:
+    ContentHash&    m_hash;
+};
+
+class StateReader {
+public:
+    explicit StateReader(const std::string& path) : m_in(path, std::ios::binary) {
+        if (!m_in) {
+            throw std::runtime_error("failed to open state file " + path);
+        }
+        m_in.seekg(0, std::ios::end);
+        m_size = static_cast<uint64_t>(m_in.tellg());
+        m_in.seekg(0, std::ios::beg);
+    }
+
+    template <typename T>
+    T value() {
+        T v;
+        read(&v, sizeof(T));
+        return v;
+    }
+
+    template <typename T>
+    std::vector<T> vector() {
+        const auto size = length(sizeof(T));
+        std::vector<T> v(size);
+        read(v.data(), size*sizeof(T));
+        return v;
+    }
+
+    std::string string() {
+        std::string s(length(1), '\0');
+        read(&s[0], s.size());
+        return s;
+    }
+
+    vector3 vec3() {
+        const auto x = value<float>();
+        const auto y = value<float>();
+        const auto z = value<float>();
+        return vector3(x, y, z);
+    }
+
+private:
+    // An element count, checked against the remaining file size so that
+    // corrupt files do not cause huge allocations.
+    size_t length(size_t element_size) {
+        const auto count = value<uint64_t>();
+        const auto remaining = m_size - static_cast<uint64_t>(m_in.tellg());
+        if (count > remaining/element_size) {
+            throw std::runtime_error("state file is truncated");
+        }
+        return static_cast<size_t>(count);
+    }
+
+    void read(void* dst, size_t num_bytes) {
+        m_in.read(static_cast<char*>(dst), num_bytes);
+        if (!m_in) {
+            throw std::runtime_error("state file is truncated");
+        }
+    }
+
+private:
+    std::ifstream   m_in;
+    uint64_t        m_size;
+};
+
+void write_layouts(StateWriter& writer, const std::vector<FixedScatterers::s_ptr>& datasets,
+                   const std::vector<std::shared_ptr<HostFixedScatterers>>& layouts) {
+    writer.value(layout_format);
+    writer.value<uint64_t>(datasets.size());
+    for (size_t i = 0; i < datasets.size(); i++) {
+        const auto layout = (i < layouts.size()) ? layouts[i] : nullptr;
+        const auto num_scatterers = datasets[i] ? static_cast<size_t>(datasets[i]->num_scatterers()) : 0;
+        const auto valid = layout && datasets[i] && !layout->is_generated() && !layout->external
+            && (layout->get_num_scatterers() == num_scatterers)
+            && (layout->sorted_index.size() == num_scatterers);
+        writer.value<uint8_t>(valid);
+        if (!valid) {
+            continue;
+        }
+        writer.value(static_cast<uint32_t>(layout->cell_order));
+        writer.value<uint64_t>(layout->num_subsets);
+        writer.vector(layout->xs);
+        writer.vector(layout->ys);
+        writer.vector(layout->zs);
+        writer.vector(layout->as);
+        writer.vector(layout->sorted_index);
+        const auto tables = layout->grid.get_tables();
+        writer.vec3(tables.min);
+        writer.value(tables.cell_size);
+        writer.value<int32_t>(tables.nx);
+        writer.value<int32_t>(tables.ny);
+        writer.value<int32_t>(tables.nz);
+        writer.value<uint64_t>(tables.num_subsets);
+        writer.vector(tables.cell_starts);
+        writer.vector(tables.cell_ranks);
+    }
+}
+
+// The layouts must be of the datasets they are stored with, which is
+// checked in one pass instead of sorting the datasets again.
+void read_layouts(StateReader& reader, const std::vector<FixedScatterers::s_ptr>& datasets,
+                  std::vector<std::shared_ptr<HostFixedScatterers>>& layouts) {
+    if (reader.value<uint64_t>() != datasets.size()) {
+        throw std::runtime_error("invalid number of sorted fixed datasets in state file");
+    }
+    for (size_t dset_idx = 0; dset_idx < datasets.size(); dset_idx++) {
+        if (!reader.value<uint8_t>()) {
+            continue;
+        }
+        const auto& dataset = datasets[dset_idx];
+        if (!dataset) {
+            throw std::runtime_error("sorted fixed dataset of a generated dataset in state file");
+        }
+        auto layout = std::make_shared<HostFixedScatterers>();
+        const auto order = reader.value<uint32_t>();
+        layout->num_subsets = static_cast<size_t>(reader.value<uint64_t>());
+        layout->xs = reader.vector<float>();
+        layout->ys = reader.vector<float>();
+        layout->zs = reader.vector<float>();
+        layout->as = reader.vector<float>();
+        layout->sorted_index = reader.vector<uint32_t>();
+        ScattererGrid::Tables tables;
+        tables.min         = reader.vec3();
+        tables.cell_size   = reader.value<float>();
+        tables.nx          = reader.value<int32_t>();
+        tables.ny          = reader.value<int32_t>();
+        tables.nz          = reader.value<int32_t>();
+        tables.num_subsets = static_cast<size_t>(reader.value<uint64_t>());
+        tables.cell_starts = reader.vector<uint32_t>();
+        tables.cell_ranks  = reader.vector<uint32_t>();
+
+        const auto num_scatterers = static_cast<size_t>(dataset->num_scatterers());
+        if ((order > static_cast<uint32_t>(ScattererGrid::CellOrder::MORTON)) || (layout->num_subsets == 0)
+            || (layout->xs.size() != num_scatterers) || (layout->ys.size() != num_scatterers)
+            || (layout->zs.size() != num_scatterers) || (layout->as.size() != num_scatterers)
+            || (layout->sorted_index.size() != num_scatterers)) {
+            throw std::runtime_error("invalid sorted fixed dataset in state file");
+        }
+        layout->cell_order = static_cast<ScattererGrid::CellOrder>(order);
+        layout->grid.set_tables(std::move(tables), num_scatterers);
+        if (!layout->grid.empty() && (layout->grid.get_num_subsets() != layout->num_subsets)) {
+            throw std::runtime_error("invalid sorted fixed dataset in state file");
+        }
+        std::vector<bool> seen(num_scatterers, false);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            const auto dst = layout->sorted_index[i];
+            const auto& scatterer = dataset->scatterers[i];
+            if ((dst >= num_scatterers) || seen[dst]
+                || !same_bits(layout->xs[dst], scatterer.pos.x) || !same_bits(layout->ys[dst], scatterer.pos.y)
+                || !same_bits(layout->zs[dst], scatterer.pos.z) || !same_bits(layout->as[dst], scatterer.amplitude)) {
+                throw std::runtime_error("sorted fixed dataset does not match its dataset in state file");
+            }
+            seen[dst] = true;
+        }
+        layouts[dset_idx] = layout;
+    }
+}
+
+}   // namespace
+
+AlgorithmState::AlgorithmState()
+    : m_has_excitation(false),
+      m_lookup_profile(false)
+{ }
+
+void AlgorithmState::set_parameter(const std::string& key, const std::string& value) {
+    // not part of the simulator configuration
+    if ((key == "trace_file") || (key == "stats_reset") || (key.compare(0, 12, "frame_cache_") == 0)) {
+        return;
+    }
+    m_parameters.erase(std::remove_if(m_parameters.begin(), m_parameters.end(),
+                                      [&](const std::pair<std::string, std::string>& p) { return p.first == key; }),
+                       m_parameters.end());
+    m_parameters.emplace_back(key, value);
+}
+
+void AlgorithmState::set_excitation(const ExcitationSignal& excitation) {
+    m_excitation = excitation;
+    m_has_excitation = true;
+}
+
+void AlgorithmState::set_scan_sequence(ScanSequence::s_ptr scan_sequence) {
+    m_scan_sequence = scan_sequence;
+}
+
+void AlgorithmState::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    m_beam_profile = beam_profile;
+    m_lookup_profile = false;
+}
+
+void AlgorithmState::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    m_beam_profile = beam_profile;
+    m_lookup_profile = true;
+}
+
+void AlgorithmState::clear_fixed_scatterers() {
+    m_fixed_datasets.clear();
+    m_procedural_datasets.clear();
+    m_image_volume_datasets.clear();
+    m_external_datasets.clear();
+    m_fixed_layouts.clear();
+}
+
+void AlgorithmState::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    m_fixed_datasets.push_back(fixed_scatterers);
+    m_procedural_datasets.push_back(nullptr);
+    m_image_volume_datasets.push_back(nullptr);
+    m_external_datasets.push_back(nullptr);
+    m_fixed_layouts.push_back(nullptr);
+}
+
+void AlgorithmState::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    m_fixed_datasets.push_back(nullptr);
+    m_procedural_datasets.push_back(procedural_scatterers);
+    m_image_volume_datasets.push_back(nullptr);
+    m_external_datasets.push_back(nullptr);
+    m_fixed_layouts.push_back(nullptr);
+}
+
+void AlgorithmState::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    m_fixed_datasets.push_back(nullptr);
+    m_procedural_datasets.push_back(nullptr);
+    m_image_volume_datasets.push_back(image_volume_scatterers);
+    m_external_datasets.push_back(nullptr);
+    m_fixed_layouts.push_back(nullptr);
+}
+
+void AlgorithmState::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    m_fixed_datasets.push_back(nullptr);
+    m_procedural_datasets.push_back(nullptr);
+    m_image_volume_datasets.push_back(nullptr);
+    m_external_datasets.push_back(external_scatterers);
+    m_fixed_layouts.push_back(nullptr);
+}
+
+void AlgorithmState::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                             const std::vector<PointScatterer>& new_scatterers) {
+    auto& dataset = m_fixed_datasets.at(dset_idx);
+    if (m_external_datasets.at(dset_idx)) {
+        throw std::runtime_error("external scatterers cannot be updated");
+    }
+    if (!dataset) {
+        throw std::runtime_error("procedural scatterers cannot be updated");
+    }
+    // the dataset is shared with the caller until it is first updated
+    if (dataset.use_count() > 1) {
+        dataset = std::make_shared<FixedScatterers>(*dataset);
+    }
+    for (size_t i = 0; i < indices.size(); i++) {
+        dataset->scatterers[indices[i]] = new_scatterers[i];
+    }
+    m_fixed_layouts[dset_idx] = nullptr;
+}
+
+void AlgorithmState::clear_spline_scatterers() {
+    m_spline_datasets.clear();
+}
+
+void AlgorithmState::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    m_spline_datasets.push_back(spline_scatterers);
+}
+
+void AlgorithmState::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                              const SplineScatterers& new_scatterers) {
+    auto& dataset = m_spline_datasets.at(dset_idx);
+    if (dataset.use_count() > 1) {
+        dataset = std::make_shared<SplineScatterers>(*dataset);
+    }
+    update_spline_dataset(*dataset, indices, new_scatterers);
+}
+
+void AlgorithmState::save(const std::string& path, const std::vector<std::shared_ptr<HostFixedScatterers>>& layouts) const {
+    StateFileWriter writer(path);
+    for (auto c : state_magic) writer.value(c);
+    writer.value(state_version);
+    write_contents(writer, m_parameters);
+    write_layouts(writer, m_fixed_datasets, layouts);
+    writer.finish();
+}
+
+void AlgorithmState::hash(ContentHash& hash, std::function<bool(const std::string& key)> keep_parameter) const {
+    // the same configuration regardless of the order of the setters
+    std::vector<std::pair<std::string, std::string>> parameters;
+    for (const auto& parameter : m_parameters) {
+        if (!keep_parameter || keep_parameter(parameter.first)) {
+            parameters.push_back(parameter);
+        }
+    }
+    std::sort(parameters.begin(), parameters.end());
+    StateHashWriter writer(hash);
+    writer.value(state_version);
+    write_contents(writer, parameters);
+}
+
+void AlgorithmState::write_contents(StateWriter& writer,
+                                    const std::vector<std::pair<std::string, std::string>>& parameters) const {
+    writer.value<uint64_t>(parameters.size());
+    for (const auto& parameter : parameters) {
+        writer.string(parameter.first);
+        writer.string(parameter.second);
+    }
+
+    writer.value<uint8_t>(m_has_excitation);
+    if (m_has_excitation) {
+        writer.vector(m_excitation.samples);
+        writer.value<int32_t>(m_excitation.center_index);
+        writer.value(m_excitation.sampling_frequency);
+        writer.value(m_excitation.demod_freq);
+    }
+
+    writer.value<uint8_t>(m_scan_sequence != nullptr);
+    if (m_scan_sequence) {
+        writer.value(m_scan_sequence->line_length);
+        writer.value<uint8_t>(m_scan_sequence->all_timestamps_equal);
+        writer.value(m_scan_sequence->r_min);
+        writer.value(m_scan_sequence->r_max);
+        const auto num_lines = m_scan_sequence->get_num_lines();
+        writer.value<uint64_t>(num_lines);
+        for (int line_no = 0; line_no < num_lines; line_no++) {
+            const auto& line = m_scan_sequence->get_scanline(line_no);
+            writer.vec3(line.get_origin());
+            writer.vec3(line.get_direction());
+            writer.vec3(line.get_lateral_dir());
+            writer.value(line.get_timestamp());
+        }
+    }
+
+    const auto gaussian = std::dynamic_pointer_cast<GaussianBeamProfile>(m_beam_profile);
+    const auto lut      = std::dynamic_pointer_cast<LUTBeamProfile>(m_beam_profile);
+    const auto zoned    = std::dynamic_pointer_cast<MultiResolutionLUTBeamProfile>(m_beam_profile);
+    const auto write_lut = [&](const LUTBeamProfile& table) {
+        writer.value<int32_t>(table.getNumSamplesRadial());
+        writer.value<int32_t>(table.getNumSamplesLateral());
+        writer.value<int32_t>(table.getNumSamplesElevational());
+        for (const auto& interval : {table.getRangeRange(), table.getLateralRange(), table.getElevationalRange()}) {
+            writer.value(interval.first);
+            writer.value(interval.last);
+        }
+        writer.vector(table.getSamples());
+    };
+    if (m_lookup_profile && lut) {
+        writer.value<uint32_t>(PROFILE_LOOKUP);
+        write_lut(*lut);
+    } else if (m_lookup_profile && zoned) {
+        writer.value<uint32_t>(PROFILE_MULTI_RESOLUTION_LOOKUP);
+        writer.value<uint32_t>(static_cast<uint32_t>(zoned->getNumZones()));
+        for (int zone_no = 0; zone_no < zoned->getNumZones(); zone_no++) {
+            write_lut(zoned->getZone(zone_no));
+        }
+    } else if (!m_lookup_profile && gaussian) {
+        writer.value<uint32_t>(PROFILE_ANALYTICAL);
+        writer.value(gaussian->getSigmaLateral());
+        writer.value(gaussian->getSigmaElevational());
+    } else if (m_beam_profile) {
+        throw std::runtime_error("state of this beam profile type cannot be saved");
+    } else {
+        writer.value<uint32_t>(PROFILE_NONE);
+    }
+
+    writer.value<uint64_t>(m_fixed_datasets.size());
+    for (size_t i = 0; i < m_fixed_datasets.size(); i++) {
+        const auto& procedural = m_procedural_datasets[i];
+        const auto& image_volume = m_image_volume_datasets[i];
+        writer.value<uint8_t>(procedural ? FIXED_PROCEDURAL : (image_volume ? FIXED_IMAGE_VOLUME : FIXED_STORED));
+        if (procedural) {
+            writer.value(static_cast<uint32_t>(procedural->region));
+            writer.vec3(procedural->center);
+            writer.vec3(procedural->half_axes);
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 3; col++) {
+                    writer.value(procedural->axes(row, col));
+                }
+            }
+            writer.value<uint64_t>(procedural->count);
+            writer.value(static_cast<uint32_t>(procedural->amplitude_distribution));
+            writer.value(procedural->amplitude_scale);
+            writer.value(procedural->seed);
+        } else if (image_volume) {
+            writer.vec3(image_volume->origin);
+            writer.vec3(image_volume->voxel_size);
+            writer.value<int32_t>(image_volume->nx);
+            writer.value<int32_t>(image_volume->ny);
+            writer.value<int32_t>(image_volume->nz);
+            writer.vector(image_volume->densities);
+            writer.vector(image_volume->amplitude_scales);
+            writer.value(static_cast<uint32_t>(image_volume->amplitude_distribution));
+            writer.value(image_volume->seed);
+        } else if (m_external_datasets[i]) {
+            // stored as a fixed dataset, since the memory is not ours
+            writer.vector(m_external_datasets[i]->expand()->scatterers);
+        } else {
+            writer.vector(m_fixed_datasets[i]->scatterers);
+        }
+    }
+
+    writer.value<uint64_t>(m_spline_datasets.size());
+    for (const auto& dataset : m_spline_datasets) {
+        writer.value<int32_t>(dataset->spline_degree);
+        writer.vector(dataset->knot_vector);
+        writer.value<uint64_t>(dataset->num_scatterers() > 0 ? dataset->get_num_control_points() : 0);
+        writer.vector(dataset->control_xs);
+        writer.vector(dataset->control_ys);
+        writer.vector(dataset->control_zs);
+        writer.vector(dataset->amplitudes);
+    }
+}
+
+void AlgorithmState::load(const std::string& path) {
+    StateReader reader(path);
+    char magic[sizeof(state_magic)];
+    for (auto& c : magic) c = reader.value<char>();
+    if (std::memcmp(magic, state_magic, sizeof(state_magic)) != 0) {
+        throw std::runtime_error("not a simulator state file: " + path);
+    }
+    const auto version = reader.value<uint32_t>();
+    if ((version < 1) || (version > state_version)) {
+        throw std::runtime_error("unsupported simulator state version: " + std::to_string(version));
+    }
+
+    AlgorithmState state;
+    const auto num_parameters = reader.value<uint64_t>();
+    for (uint64_t i = 0; i < num_parameters; i++) {
+        auto key = reader.string();
+        auto value = reader.string();
+        state.m_parameters.emplace_back(std::move(key), std::move(value));
+    }
+
+    if (reader.value<uint8_t>()) {
+        ExcitationSignal excitation;
+        excitation.samples            = reader.vector<float>();
+        excitation.center_index       = reader.value<int32_t>();
+        excitation.sampling_frequency = reader.value<float>();
+        excitation.demod_freq         = reader.value<float>();
+        state.set_excitation(excitation);
+    }
+
+    if (reader.value<uint8_t>()) {
+        auto scan_sequence = std::make_shared<ScanSequence>(reader.value<float>());
+        scan_sequence->all_timestamps_equal = reader.value<uint8_t>() != 0;
+        if (version >= 4) {
+            scan_sequence->r_min = reader.value<float>();
+            scan_sequence->r_max = reader.value<float>();
+        }
+        const auto num_lines = reader.value<uint64_t>();
+        for (uint64_t line_no = 0; line_no < num_lines; line_no++) {
+            const auto origin      = reader.vec3();
+            const auto direction   = reader.vec3();
+            const auto lateral_dir = reader.vec3();
+            const auto timestamp   = reader.value<float>();
+            scan_sequence->add_scanline(Scanline(origin, direction, lateral_dir, timestamp));
+        }
+        state.set_scan_sequence(scan_sequence);
+    }
+
+    const auto read_lut = [&]() {
+        const auto num_rad = reader.value<int32_t>();
+        const auto num_lat = reader.value<int32_t>();
+        const auto num_ele = reader.value<int32_t>();
+        std::vector<Interval> intervals;
+        for (int i = 0; i < 3; i++) {
+            const auto first = reader.value<float>();
+            const auto last  = reader.value<float>();
+            intervals.emplace_back(first, last);
+        }
+        auto samples = reader.vector<float>();
+        return LUTBeamProfile(num_rad, num_lat, num_ele, intervals[0], intervals[1], intervals[2], std::move(samples));
+    };
+    const auto profile_kind = reader.value<uint32_t>();
+    if (profile_kind == PROFILE_LOOKUP) {
+        state.set_lookup_profile(std::make_shared<LUTBeamProfile>(read_lut()));
+    } else if (profile_kind == PROFILE_MULTI_RESOLUTION_LOOKUP) {
+        const auto num_zones = reader.value<uint32_t>();
+        std::vector<LUTBeamProfile> zones;
+        for (uint32_t zone_no = 0; zone_no < num_zones; zone_no++) {
+            zones.push_back(read_lut());
+        }
+        state.set_lookup_profile(std::make_shared<MultiResolutionLUTBeamProfile>(std::move(zones)));
+    } else if (profile_kind == PROFILE_ANALYTICAL) {
+        const auto sigma_lateral     = reader.value<float>();
+        const auto sigma_elevational = reader.value<float>();
+        state.set_analytical_profile(std::make_shared<GaussianBeamProfile>(sigma_lateral, sigma_elevational));
+    } else if (profile_kind != PROFILE_NONE) {
+        throw std::runtime_error("invalid beam profile in state file");
+    }
+
+    const auto num_fixed = reader.value<uint64_t>();
+    for (uint64_t i = 0; i < num_fixed; i++) {
+        const auto kind = (version >= 2) ? reader.value<uint8_t>() : FIXED_STORED;
+        if (kind == FIXED_PROCEDURAL) {
+            auto procedural = std::make_shared<ProceduralScatterers>();
+            const auto region = reader.value<uint32_t>();
+            procedural->center    = reader.vec3();
+            procedural->half_axes = reader.vec3();
+            float m[9];
+            for (auto& value : m) value = reader.value<float>();
+            procedural->axes = Matrix3(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]);
+            procedural->count = static_cast<size_t>(reader.value<uint64_t>());
+            const auto distribution = reader.value<uint32_t>();
+            procedural->amplitude_scale = reader.value<float>();
+            procedural->seed = reader.value<uint64_t>();
+            if ((region > static_cast<uint32_t>(ProceduralScatterers::Region::ELLIPSOID))
+                || (distribution > static_cast<uint32_t>(ProceduralScatterers::AmplitudeDistribution::CONSTANT))) {
+                throw std::runtime_error("invalid procedural dataset in state file");
+            }
+            procedural->region = static_cast<ProceduralScatterers::Region>(region);
+            procedural->amplitude_distribution = static_cast<ProceduralScatterers::AmplitudeDistribution>(distribution);
+            state.add_procedural_scatterers(procedural);
+        } else if (kind == FIXED_IMAGE_VOLUME) {
+            auto image_volume = std::make_shared<ImageVolumeScatterers>();
+            image_volume->origin     = reader.vec3();
+            image_volume->voxel_size = reader.vec3();
+            image_volume->nx = reader.value<int32_t>();
+            image_volume->ny = reader.value<int32_t>();
+            image_volume->nz = reader.value<int32_t>();
+            image_volume->densities        = reader.vector<float>();
+            image_volume->amplitude_scales = reader.vector<float>();
+            const auto distribution = reader.value<uint32_t>();
+            image_volume->seed = reader.value<uint64_t>();
+            if (distribution > static_cast<uint32_t>(ProceduralScatterers::AmplitudeDistribution::CONSTANT)) {
+                throw std::runtime_error("invalid image volume dataset in state file");
+            }
+            image_volume->amplitude_distribution = static_cast<ProceduralScatterers::AmplitudeDistribution>(distribution);
+            image_volume->update_counts();
+            state.add_image_volume_scatterers(image_volume);
+        } else if (kind != FIXED_STORED) {
+            throw std::runtime_error("invalid fixed dataset in state file");
+        } else {
+            auto dataset = std::make_shared<FixedScatterers>();
+            dataset->scatterers = reader.vector<PointScatterer>();
+            state.add_fixed_scatterers(dataset);
+        }
+    }
+
+    const auto num_spline = reader.value<uint64_t>();
+    for (uint64_t i = 0; i < num_spline; i++) {
+        auto dataset = std::make_shared<SplineScatterers>();
+        dataset->spline_degree = reader.value<int32_t>();
+        dataset->knot_vector   = reader.vector<float>();
+        const auto num_cs      = reader.value<uint64_t>();
+        auto control_xs = reader.vector<float>();
+        auto control_ys = reader.vector<float>();
+        auto control_zs = reader.vector<float>();
+        auto amplitudes = reader.vector<float>();
+        if ((control_xs.size() != num_cs*amplitudes.size()) || (control_ys.size() != control_xs.size())
+            || (control_zs.size() != control_xs.size())) {
+            throw std::runtime_error("invalid spline dataset in state file");
+        }
+        dataset->resize(amplitudes.size(), num_cs);
+        dataset->control_xs = std::move(control_xs);
+        dataset->control_ys = std::move(control_ys);
+        dataset->control_zs = std::move(control_zs);
+        dataset->amplitudes = std::move(amplitudes);
+        state.add_spline_scatterers(dataset);
+    }
+
+    if ((version >= 5) && (reader.value<uint32_t>() == layout_format)) {
+        read_layouts(reader, state.m_fixed_datasets, state.m_fixed_layouts);
+    }
+    *this = std::move(state);
+}
+
+void AlgorithmState::apply(IAlgorithm& algorithm, std::function<bool(const std::string& key)> keep_parameter) const {
+    for (const auto& parameter : m_parameters) {
+        if (!keep_parameter || keep_parameter(parameter.first)) {
+            algorithm.set_parameter(parameter.first, parameter.second);
+        }
+    }
+    if (m_has_excitation) {
+        algorithm.set_excitation(m_excitation);
+    }
+    if (m_scan_sequence) {
+        algorithm.set_scan_sequence(m_scan_sequence);
+    }
+    if (m_beam_profile) {
+        if (m_lookup_profile) {
+            algorithm.set_lookup_profile(m_beam_profile);
+        } else {
+            algorithm.set_analytical_profile(m_beam_profile);
+        }
+    }
+    algorithm.clear_fixed_scatterers();
+    for (size_t i = 0; i < m_fixed_datasets.size(); i++) {
+        if (m_procedural_datasets[i]) {
+            algorithm.add_procedural_scatterers(m_procedural_datasets[i]);
+        } else if (m_image_volume_datasets[i]) {
+            algorithm.add_image_volume_scatterers(m_image_volume_datasets[i]);
+        } else if (m_external_datasets[i]) {
+            algorithm.add_external_fixed_scatterers(m_external_datasets[i]);
+        } else {
+            algorithm.add_fixed_scatterers(m_fixed_datasets[i]);
+        }
+    }
+    algorithm.clear_spline_scatterers();
+    for (const auto& dataset : m_spline_datasets) {
+        algorithm.add_spline_scatterers(dataset);
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../LibBCSim.hpp"
+
+namespace bcsim {
+
+class ContentHash;
+class StateWriter;
+class HostFixedScatterers;
+
+// The configuration of a simulator as given through its setters, which can
+// be written to and read from a versioned binary state file. Datasets are
+// shared with the caller until they are updated.
+//
+// A state file may also hold the fixed datasets as sorted for culling, so
+// that a simulator restoring it with the same cell order and number of
+// subsets skips that sorting. Other derived data, i.e. the excitation
+// spectrum, FFT plans, lookup-table textures and device buffers, is not
+// stored: it depends on the device and is cheap compared to the sorting,
+// or, for the spectrum, is computed once per process on the first frame.
+class AlgorithmState {
+public:
+    AlgorithmState();
+
+    void set_parameter(const std::string& key, const std::string& value);
+
+    // The parameters in the order they were last set.
+    const std::vector<std::pair<std::string, std::string>>& get_parameters() const {
+        return m_parameters;
+    }
+
+    void set_excitation(const ExcitationSignal& excitation);
+
+    // The fixed datasets in the order they were added, with null for the
+    // procedural, image volume and external ones, and those datasets at the
+    // same indices.
+    const std::vector<FixedScatterers::s_ptr>& get_fixed_datasets() const {
+        return m_fixed_datasets;
+    }
+    const std::vector<ProceduralScatterers::s_ptr>& get_procedural_datasets() const {
+        return m_procedural_datasets;
+    }
+    const std::vector<ImageVolumeScatterers::s_ptr>& get_image_volume_datasets() const {
+        return m_image_volume_datasets;
+    }
+    const std::vector<ExternalFixedScatterers::s_ptr>& get_external_datasets() const {
+        return m_external_datasets;
+    }
+
+    // The sorted fixed datasets of a loaded state file at the same indices,
+    // with null where there is none. They are dropped when a dataset is
+    // updated.
+    const std::vector<std::shared_ptr<HostFixedScatterers>>& get_fixed_layouts() const {
+        return m_fixed_layouts;
+    }
+
+    size_t get_num_spline_datasets() const {
+        return m_spline_datasets.size();
+    }
+    const std::vector<SplineScatterers::s_ptr>& get_spline_datasets() const {
+        return m_spline_datasets;
+    }
+
+    // The scan sequence last set, or null.
+    ScanSequence::s_ptr get_scan_sequence() const {
+        return m_scan_sequence;
+    }
+
+    // The excitation last set, or nullptr if none has been set.
+    const ExcitationSignal* get_excitation() const {
+        return m_has_excitation ? &m_excitation : nullptr;
+    }
+
+    void set_scan_sequence(ScanSequence::s_ptr scan_sequence);
+
+    void set_analytical_profile(IBeamProfile::s_ptr beam_profile);
+
+    void set_lookup_profile(IBeamProfile::s_ptr beam_profile);
+
+    void clear_fixed_scatterers();
+
+    void add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers);
+
+    void add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers);
+
+    void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers);
+
+    // Saved as a copy, so a loaded state has a fixed dataset instead.
+    void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers);
+
+    void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                 const std::vector<PointScatterer>& new_scatterers);
+
+    void clear_spline_scatterers();
+
+    void add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers);
+
+    void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                  const SplineScatterers& new_scatterers);
+
+    // Write the state file, with the sorted fixed datasets in layouts at the
+    // indices of get_fixed_datasets(), where not null. Throws
+    // std::runtime_error on failure.
+    void save(const std::string& path, const std::vector<std::shared_ptr<HostFixedScatterers>>& layouts = {}) const;
+
+    // Hash the contents a state file would have, with the parameters in
+    // sorted order and, if given, only those for which keep_parameter
+    // returns true. Throws std::runtime_error like save.
+    void hash(ContentHash& hash, std::function<bool(const std::string& key)> keep_parameter = nullptr) const;
+
+    // Replace the state with the contents of a state file.
+    // Throws std::runtime_error if the file is invalid.
+    void load(const std::string& path);
+
+    // Configure an algorithm in the order parameters, excitation, scan
+    // sequence, beam profile and scatterers. If given, only the parameters
+    // for which keep_parameter returns true are set.
+    void apply(IAlgorithm& algorithm, std::function<bool(const std::string& key)> keep_parameter = nullptr) const;
+
+private:
+    void write_contents(StateWriter& writer, const std::vector<std::pair<std::string, std::string>>& parameters) const;
+
+    // parameters in the order they were last set
+    std::vector<std::pair<std::string, std::string>>    m_parameters;
+    bool                                                m_has_excitation;
+    ExcitationSignal                                    m_excitation;
+    ScanSequence::s_ptr                                 m_scan_sequence;
+    bool                                                m_lookup_profile;
+    IBeamProfile::s_ptr                                 m_beam_profile;
+    // the fixed datasets, where the procedural, image volume and external
+    // ones are null and are at the same index of m_procedural_datasets,
+    // m_image_volume_datasets or m_external_datasets
+    std::vector<FixedScatterers::s_ptr>                 m_fixed_datasets;
+    std::vector<ProceduralScatterers::s_ptr>            m_procedural_datasets;
+    std::vector<ImageVolumeScatterers::s_ptr>           m_image_volume_datasets;
+    std::vector<ExternalFixedScatterers::s_ptr>         m_external_datasets;
+    std::vector<std::shared_ptr<HostFixedScatterers>>   m_fixed_layouts;
+    std::vector<SplineScatterers::s_ptr>                m_spline_datasets;
+};
+
+}   // end namespace
@@ -0,0 +1,400 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include "AutoAlgorithm.hpp"
+#include "common_utils.hpp"
+
+namespace bcsim {
+
+AutoAlgorithm::AutoAlgorithm()
+    : m_param_backend("auto"),
+      m_param_cost_model(CostModel::default_path())
+{
+}
+
+void AutoAlgorithm::record_parameter(const std::string& key, const std::string& value) {
+    m_state.set_parameter(key, value);
+    m_parameters.erase(std::remove_if(m_parameters.begin(), m_parameters.end(),
+                                      [&](const std::pair<std::string, std::string>& p) { return p.first == key; }),
+                       m_parameters.end());
+    m_parameters.emplace_back(key, value);
+}
+
+void AutoAlgorithm::set_parameter(const std::string& key, const std::string& value) {
+    if ((key == "auto_backend") || (key == "auto_cost_model")) {
+        if (m_backend) {
+            throw std::runtime_error(key + " must be set before the backend is selected");
+        }
+        if (key == "auto_cost_model") {
+            m_param_cost_model = value;
+        } else if ((value == "auto") || (value == "cpu") || (value == "gpu") || (value == "multi_gpu") || (value == "hybrid")) {
+            m_param_backend = value;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (m_backend) {
+        m_backend->set_parameter(key, value);
+    } else {
+        record_parameter(key, value);
+    }
+}
+
+std::string AutoAlgorithm::get_parameter(const std::string& key) const {
+    if (key == "auto_backend") {
+        return m_param_backend;
+    } else if (key == "auto_cost_model") {
+        return m_param_cost_model;
+    } else if (key == "auto_selected_backend") {
+        return m_backend ? m_choice.backend : std::string();
+    } else if (key == "auto_predicted_frame_time") {
+        return m_backend ? std::to_string(m_choice.predicted_frame_seconds) : std::string();
+    } else if (m_backend) {
+        return m_backend->get_parameter(key);
+    }
+    for (const auto& parameter : m_parameters) {
+        if (parameter.first == key) {
+            return parameter.second;
+        }
+    }
+    throw std::runtime_error("Illegal key: " + key);
+}
+
+Workload AutoAlgorithm::get_workload() const {
+    Workload workload;
+    const auto& fixed_datasets = m_state.get_fixed_datasets();
+    for (size_t i = 0; i < fixed_datasets.size(); i++) {
+        if (fixed_datasets[i]) {
+            workload.num_fixed_scatterers += fixed_datasets[i]->num_scatterers();
+        } else if (m_state.get_procedural_datasets()[i]) {
+            workload.num_fixed_scatterers += m_state.get_procedural_datasets()[i]->num_scatterers();
+        } else if (m_state.get_image_volume_datasets()[i]) {
+            workload.num_fixed_scatterers += m_state.get_image_volume_datasets()[i]->num_scatterers();
+        } else if (m_state.get_external_datasets()[i]) {
+            workload.num_fixed_scatterers += m_state.get_external_datasets()[i]->num_scatterers();
+        }
+    }
+    for (const auto& dataset : m_state.get_spline_datasets()) {
+        workload.num_spline_scatterers += dataset->num_scatterers();
+        workload.num_cs = std::max(workload.num_cs, static_cast<int>(dataset->get_num_control_points()));
+    }
+    const auto scan_seq = m_state.get_scan_sequence();
+    const auto excitation = m_state.get_excitation();
+    if (scan_seq) {
+        workload.num_lines = scan_seq->get_num_lines();
+        if (excitation) {
+            float sound_speed = 1540.0f;
+            for (const auto& parameter : m_parameters) {
+                if (parameter.first == "sound_speed") {
+                    sound_speed = std::stof(parameter.second);
+                }
+            }
+            // the decimation only rounds the start of a depth window
+            workload.num_time_samples = compute_rf_sample_window(sound_speed, *scan_seq, *excitation, 1).num_samples;
+        }
+    }
+    return workload;
+}
+
+IAlgorithm& AutoAlgorithm::backend() const {
+    if (m_backend) {
+        return *m_backend;
+    }
+    const auto workload = get_workload();
+    const auto forced_backend = (m_param_backend == "auto") ? std::string() : m_param_backend;
+    auto choice = select_backend(workload, HardwareInfo::detect(), CostModel(m_param_cost_model), forced_backend);
+    auto algorithm = Create(choice.backend);
+
+    // the parameters of the other backends would be rejected
+    const auto applies = [&](const std::string& key) {
+        if (choice.backend == "cpu") {
+            return !is_gpu_parameter(key);
+        } else if (choice.backend == "gpu" || choice.backend == "multi_gpu") {
+            return !is_cpu_parameter(key);
+        }
+        return true;
+    };
+    for (const auto& parameter : choice.parameters) {
+        const auto user_set = std::any_of(m_parameters.begin(), m_parameters.end(),
+            [&](const std::pair<std::string, std::string>& p) { return p.first == parameter.first; });
+        if (!user_set) {
+            algorithm->set_parameter(parameter.first, parameter.second);
+        }
+    }
+    for (const auto& parameter : m_parameters) {
+        if (applies(parameter.first)) {
+            algorithm->set_parameter(parameter.first, parameter.second);
+        }
+    }
+    m_state.apply(*algorithm, [](const std::string&) { return false; });
+    if (m_log) {
+        algorithm->set_logger(m_log);
+    }
+    if (m_line_callback) {
+        algorithm->set_line_callback(m_line_callback);
+    }
+    if (m_log) {
+        std::stringstream ss;
+        ss << "Selected the " << choice.backend << " backend for " << workload.num_lines << " lines of "
+           << workload.num_time_samples << " samples, " << workload.num_fixed_scatterers << " fixed and "
+           << workload.num_spline_scatterers << " spline scatterers. Predicted frame time: "
+           << 1e3*choice.predicted_frame_seconds << " ms";
+        m_log->write(ILog::INFO, ss.str());
+    }
+    m_choice = choice;
+    m_backend = algorithm;
+    return *m_backend;
+}
+
+void AutoAlgorithm::clear_fixed_scatterers() {
+    if (m_backend) {
+        m_backend->clear_fixed_scatterers();
+    } else {
+        m_state.clear_fixed_scatterers();
+    }
+}
+
+void AutoAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    if (m_backend) {
+        m_backend->add_fixed_scatterers(fixed_scatterers);
+    } else {
+        m_state.add_fixed_scatterers(fixed_scatterers);
+    }
+}
+
+void AutoAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    if (m_backend) {
+        m_backend->add_procedural_scatterers(procedural_scatterers);
+    } else {
+        m_state.add_procedural_scatterers(procedural_scatterers);
+    }
+}
+
+void AutoAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    if (m_backend) {
+        m_backend->add_image_volume_scatterers(image_volume_scatterers);
+    } else {
+        m_state.add_image_volume_scatterers(image_volume_scatterers);
+    }
+}
+
+void AutoAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    if (m_backend) {
+        m_backend->add_external_fixed_scatterers(external_scatterers);
+    } else {
+        m_state.add_external_fixed_scatterers(external_scatterers);
+    }
+}
+
+void AutoAlgorithm::clear_spline_scatterers() {
+    if (m_backend) {
+        m_backend->clear_spline_scatterers();
+    } else {
+        m_state.clear_spline_scatterers();
+    }
+}
+
+void AutoAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    if (m_backend) {
+        m_backend->add_spline_scatterers(spline_scatterers);
+    } else {
+        m_state.add_spline_scatterers(spline_scatterers);
+    }
+}
+
+void AutoAlgorithm::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                            const std::vector<PointScatterer>& new_scatterers) {
+    if (m_backend) {
+        m_backend->update_fixed_scatterers(dset_idx, indices, new_scatterers);
+    } else {
+        m_state.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+    }
+}
+
+void AutoAlgorithm::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                             const SplineScatterers& new_scatterers) {
+    if (m_backend) {
+        m_backend->update_spline_scatterers(dset_idx, indices, new_scatterers);
+    } else {
+        m_state.update_spline_scatterers(dset_idx, indices, new_scatterers);
+    }
+}
+
+void AutoAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
+    if (m_backend) {
+        m_backend->set_scan_sequence(new_scan_sequence);
+    } else {
+        m_state.set_scan_sequence(new_scan_sequence);
+    }
+}
+
+void AutoAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
+    if (m_backend) {
+        m_backend->set_excitation(new_excitation);
+    } else {
+        m_state.set_excitation(new_excitation);
+    }
+}
+
+void AutoAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    if (m_backend) {
+        m_backend->set_analytical_profile(beam_profile);
+    } else {
+        m_state.set_analytical_profile(beam_profile);
+    }
+}
+
+void AutoAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    if (m_backend) {
+        m_backend->set_lookup_profile(beam_profile);
+    } else {
+        m_state.set_lookup_profile(beam_profile);
+    }
+}
+
+void AutoAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float>> >& rf_lines) {
+    backend().simulate_lines(rf_lines);
+}
+
+void AutoAlgorithm::get_output_dimensions(size_t& num_lines, size_t& num_samples) const {
+    backend().get_output_dimensions(num_lines, num_samples);
+}
+
+float AutoAlgorithm::get_output_start_time() const {
+    return backend().get_output_start_time();
+}
+
+void AutoAlgorithm::simulate_lines(std::complex<float>* iq_buffer, size_t line_stride) {
+    backend().simulate_lines(iq_buffer, line_stride);
+}
+
+std::future<void> AutoAlgorithm::simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) {
+    return backend().simulate_lines_async(iq_buffer, line_stride);
+}
+
+void AutoAlgorithm::begin_stream(const std::vector<float>& timestamp_offsets) {
+    backend().begin_stream(timestamp_offsets);
+}
+
+bool AutoAlgorithm::next_frame(std::complex<float>* iq_buffer, size_t line_stride) {
+    return backend().next_frame(iq_buffer, line_stride);
+}
+
+void AutoAlgorithm::set_line_callback(LineCallback callback) {
+    m_line_callback = callback;
+    if (m_backend) {
+        m_backend->set_line_callback(callback);
+    }
+}
+
+float AutoAlgorithm::simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) {
+    return backend().simulate_lines_formatted(format, iq_buffer, line_stride);
+}
+
+void AutoAlgorithm::simulate_packets(size_t packet_size, float prt, std::complex<float>* packets) {
+    backend().simulate_packets(packet_size, prt, packets);
+}
+
+void AutoAlgorithm::simulate_frames(const std::vector<float>& timestamp_offsets, std::complex<float>* iq_buffer,
+                                    size_t line_stride, size_t frame_stride) {
+    backend().simulate_frames(timestamp_offsets, iq_buffer, line_stride, frame_stride);
+}
+
+void AutoAlgorithm::simulate_realizations(const std::vector<FixedScatterers::s_ptr>& realizations,
+                                          std::complex<float>* iq_buffer,
+                                          size_t line_stride, size_t frame_stride) {
+    backend().simulate_realizations(realizations, iq_buffer, line_stride, frame_stride);
+}
+
+void AutoAlgorithm::simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                    std::complex<float>* iq_buffer,
+                                                    size_t line_stride, size_t frame_stride) {
+    backend().simulate_lines_multi_excitation(excitations, iq_buffer, line_stride, frame_stride);
+}
+
+float AutoAlgorithm::simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) {
+    return backend().simulate_bmode_image(config, image);
+}
+
+float AutoAlgorithm::simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* device_image) {
+    return backend().simulate_bmode_image_on_device(config, device_image);
+}
+
+IDeviceIqFrame::s_ptr AutoAlgorithm::simulate_lines_on_device() {
+    return backend().simulate_lines_on_device();
+}
+
+std::vector<double> AutoAlgorithm::get_debug_data(const std::string& identifier) const {
+    return m_backend ? m_backend->get_debug_data(identifier) : std::vector<double>();
+}
+
+size_t AutoAlgorithm::get_total_num_scatterers() const {
+    if (m_backend) {
+        return m_backend->get_total_num_scatterers();
+    }
+    const auto workload = get_workload();
+    return workload.num_fixed_scatterers + workload.num_spline_scatterers;
+}
+
+MemoryUsage AutoAlgorithm::get_memory_usage() const {
+    return m_backend ? m_backend->get_memory_usage() : MemoryUsage();
+}
+
+MemoryUsage AutoAlgorithm::predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                                size_t num_spline_scatterers, int num_cs) const {
+    return backend().predict_memory_usage(scan_seq, num_fixed_scatterers, num_spline_scatterers, num_cs);
+}
+
+void AutoAlgorithm::set_logger(ILog::ptr log_object) {
+    m_log = log_object;
+    if (m_backend) {
+        m_backend->set_logger(log_object);
+    }
+}
+
+void AutoAlgorithm::save_state(const std::string& path) const {
+    if (m_backend) {
+        m_backend->save_state(path);
+    } else {
+        m_state.save(path);
+    }
+}
+
+void AutoAlgorithm::load_state(const std::string& path) {
+    if (m_backend) {
+        m_backend->load_state(path);
+    } else {
+        m_state.load(path);
+        m_parameters = m_state.get_parameters();
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "../LibBCSim.hpp"
+#include "AlgorithmState.hpp"
+#include "BackendSelection.hpp"
+
+namespace bcsim {
+
+// Chooses the backend ("auto" in Create()) from the hardware of the machine
+// and the size of the first frame. The configuration is recorded until the
+// first frame is simulated, or the output dimensions or a memory prediction
+// are asked for. Then the backend with the shortest frame time predicted by
+// the cost model is created and configured with the recorded configuration,
+// along with a number of threads, GPU device and launch configuration for
+// the machine wherever they were not set, and all later calls go to it.
+//
+// Parameters:
+//     "auto_backend"       - "auto" (default) or the backend to use
+//     "auto_cost_model"    - cost model file, default CostModel::default_path()
+// and, read-only, "auto_selected_backend" and "auto_predicted_frame_time"
+// [s], which are empty until the backend has been selected.
+class AutoAlgorithm : public IAlgorithm {
+public:
+    AutoAlgorithm();
+
+    virtual void set_parameter(const std::string& key, const std::string& value)        override;
+
+    virtual std::string get_parameter(const std::string& key) const                     override;
+
+    virtual void clear_fixed_scatterers()                                               override;
+
+    virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                           override;
+
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                 override;
+
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)              override;
+
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)          override;
+
+    virtual void clear_spline_scatterers()                                              override;
+
+    virtual void add_spline_scatterers(SplineScatterers::s_ptr)                         override;
+
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers) override;
+
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers)           override;
+
+    virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               override;
+
+    virtual void set_excitation(const ExcitationSignal& new_excitation)                 override;
+
+    virtual void set_analytical_profile(IBeamProfile::s_ptr beam_profile)               override;
+
+    virtual void set_lookup_profile(IBeamProfile::s_ptr beam_profile)                   override;
+
+    virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines) override;
+
+    virtual void get_output_dimensions(size_t& num_lines, size_t& num_samples) const    override;
+
+    virtual float get_output_start_time() const                                         override;
+
+    virtual void simulate_lines(std::complex<float>* iq_buffer, size_t line_stride)     override;
+
+    virtual std::future<void> simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) override;
+
+    virtual void begin_stream(const std::vector<float>& timestamp_offsets)              override;
+
+    virtual bool next_frame(std::complex<float>* iq_buffer, size_t line_stride)         override;
+
+    virtual void set_line_callback(LineCallback callback)                               override;
+
+    virtual float simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) override;
+
+    virtual void simulate_packets(size_t packet_size, float prt, std::complex<float>* packets) override;
+
+    virtual void simulate_frames(const std::vector<float>& timestamp_offsets, std::complex<float>* iq_buffer,
+                                 size_t line_stride, size_t frame_stride)              override;
+
+    virtual void simulate_realizations(const std::vector<FixedScatterers::s_ptr>& realizations,
+                                       std::complex<float>* iq_buffer,
+                                       size_t line_stride, size_t frame_stride)         override;
+
+    virtual void simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                 std::complex<float>* iq_buffer,
+                                                 size_t line_stride, size_t frame_stride) override;
+
+    virtual float simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) override;
+
+    virtual float simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* device_image) override;
+
+    virtual IDeviceIqFrame::s_ptr simulate_lines_on_device() override;
+
+    // Empty until the backend has been selected.
+    virtual std::vector<double> get_debug_data(const std::string& identifier) const     override;
+
+    virtual size_t get_total_num_scatterers() const                                     override;
+
+    // Empty until the backend has been selected.
+    virtual MemoryUsage get_memory_usage() const                                        override;
+
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const override;
+
+    virtual void set_logger(ILog::ptr log_object)                                       override;
+
+    // Written from the recorded configuration until the backend has been selected.
+    virtual void save_state(const std::string& path) const                              override;
+
+    virtual void load_state(const std::string& path)                                    override;
+
+    // The size of a frame of the current configuration.
+    Workload get_workload() const;
+
+private:
+    // Create and configure the backend if not done yet.
+    IAlgorithm& backend() const;
+
+    void record_parameter(const std::string& key, const std::string& value);
+
+private:
+    // "auto" or a backend name
+    std::string                                         m_param_backend;
+    std::string                                         m_param_cost_model;
+
+    // the configuration until the backend is selected, with the
+    // parameters in the order they were last set
+    AlgorithmState                                      m_state;
+    std::vector<std::pair<std::string, std::string>>    m_parameters;
+    ILog::ptr                                           m_log;
+    LineCallback                                        m_line_callback;
+
+    mutable IAlgorithm::s_ptr                           m_backend;
+    mutable BackendChoice                               m_choice;
+};
+
+}   // end namespace
@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "AutotuneCache.hpp"
+
+namespace bcsim {
+namespace {
+
+int num_bits(size_t value) {
+    int bits = 0;
+    while (value > 0) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+}   // end anonymous namespace
+
+AutotuneCache::AutotuneCache(const std::string& path)
+    : m_path(path)
+{
+    if (m_path.empty()) {
+        return;
+    }
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string key;
+        AutotuneEntry entry;
+        if ((ss >> key >> entry.threads_per_block >> entry.threads_per_line >> entry.num_cuda_streams)
+            && (entry.threads_per_block > 0) && (entry.threads_per_line > 0) && (entry.num_cuda_streams > 0)) {
+            m_entries[key] = entry;
+        }
+    }
+}
+
+bool AutotuneCache::find(const std::string& key, AutotuneEntry& entry) const {
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+void AutotuneCache::store(const std::string& key, const AutotuneEntry& entry) {
+    m_entries[key] = entry;
+    if (m_path.empty()) {
+        return;
+    }
+    std::ofstream out(m_path);
+    if (!out) {
+        throw std::runtime_error("unable to write autotune cache " + m_path);
+    }
+    for (const auto& item : m_entries) {
+        out << item.first << " " << item.second.threads_per_block << " " << item.second.threads_per_line << " "
+            << item.second.num_cuda_streams << "\n";
+    }
+}
+
+std::string AutotuneCache::make_key(const std::string& device_name, int driver_version,
+                                    size_t num_scatterers, size_t num_lines, size_t num_time_samples) {
+    std::string name = device_name.empty() ? "unknown" : device_name;
+    for (auto& c : name) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            c = '_';
+        }
+    }
+    return name + "/driver" + std::to_string(driver_version) + "/scatterers" + std::to_string(num_bits(num_scatterers))
+        + "/lines" + std::to_string(num_bits(num_lines)) + "/samples" + std::to_string(num_bits(num_time_samples));
+}
+
+std::string AutotuneCache::default_path() {
+    const char* home = std::getenv("HOME");
+    return home ? std::string(home) + "/.bcsim_autotune_cache" : std::string();
+}
+
+}   // end namespace
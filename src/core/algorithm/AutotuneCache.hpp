@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <map>
+#include <string>
+
+namespace bcsim {
+
+// Launch configuration of the GPU algorithm found by autotuning.
+struct AutotuneEntry {
+    int threads_per_block;      // projection kernels
+    int threads_per_line;       // element-wise kernels on the lines (memset, filter, demodulation, noise)
+    int num_cuda_streams;       // streams of the line-by-line launches
+};
+
+// Autotuned configurations persisted in a text file with one line per key:
+//   <key> <threads_per_block> <threads_per_line> <num_cuda_streams>
+// Malformed lines are ignored. An empty path keeps the cache in memory.
+class AutotuneCache {
+public:
+    // Loads the file if it exists.
+    explicit AutotuneCache(const std::string& path);
+
+    // Returns false if there is no entry for the key.
+    bool find(const std::string& key, AutotuneEntry& entry) const;
+
+    // Add or replace the entry of a key and write the file. Throws
+    // std::runtime_error if the file cannot be written.
+    void store(const std::string& key, const AutotuneEntry& entry);
+
+    // Key of a device and the size class of a simulation, which is the
+    // number of bits of the number of scatterers, lines and time samples.
+    // Whitespace in the device name is replaced by underscores.
+    static std::string make_key(const std::string& device_name, int driver_version,
+                                size_t num_scatterers, size_t num_lines, size_t num_time_samples);
+
+    // $HOME/.bcsim_autotune_cache, or an empty path if HOME is not set.
+    static std::string default_path();
+
+private:
+    std::string                             m_path;
+    std::map<std::string, AutotuneEntry>    m_entries;
+};
+
+}   // end namespace
@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#ifdef BCSIM_ENABLE_CUDA
+    #include "gpu_runtime.h"
+#endif
+#include "BackendSelection.hpp"
+#include "NumaTopology.hpp"
+#include "cpu_projection_kernels.hpp"
+
+namespace bcsim {
+namespace {
+
+// The values of a cost model by their names in the file.
+std::map<std::string, double*> model_values(CostModel& model) {
+    return {
+        {"cpu_projections_per_lane_second", &model.cpu_projections_per_lane_second},
+        {"cpu_parallel_efficiency",         &model.cpu_parallel_efficiency},
+        {"cpu_seconds_per_sample",          &model.cpu_seconds_per_sample},
+        {"gpu_projections_per_sm_second",   &model.gpu_projections_per_sm_second},
+        {"gpu_frame_overhead_seconds",      &model.gpu_frame_overhead_seconds},
+        {"gpu_seconds_per_sample",          &model.gpu_seconds_per_sample},
+        {"multi_device_overhead_seconds",   &model.multi_device_overhead_seconds},
+        {"spline_cost_factor",              &model.spline_cost_factor},
+        {"gpu_memory_fraction",             &model.gpu_memory_fraction}
+    };
+}
+
+// Fixed-scatterer projections of a frame equivalent to the workload.
+double projection_work(const Workload& workload, const CostModel& model) {
+    return (workload.num_fixed_scatterers + model.spline_cost_factor*workload.num_spline_scatterers)
+        *static_cast<double>(workload.num_lines);
+}
+
+double num_output_samples(const Workload& workload) {
+    return static_cast<double>(workload.num_lines)*workload.num_time_samples;
+}
+
+double cpu_projection_rate(int num_threads, const HardwareInfo& hardware, const CostModel& model) {
+    return model.cpu_projections_per_lane_second*hardware.simd_width
+        *(1.0 + (num_threads - 1)*model.cpu_parallel_efficiency);
+}
+
+double gpu_projection_rate(const HardwareInfo::Gpu& gpu, const CostModel& model) {
+    return model.gpu_projections_per_sm_second*std::max(1, gpu.num_multiprocessors);
+}
+
+// Every device holds all scatterers, the time-projections, their
+// transform and the IQ lines of a frame.
+bool fits_on_gpu(const HardwareInfo::Gpu& gpu, const Workload& workload, const CostModel& model) {
+    const auto scatterer_bytes = 4.0*sizeof(float)*workload.num_fixed_scatterers
+        + (3.0*workload.num_cs + 1.0)*sizeof(float)*workload.num_spline_scatterers;
+    const auto line_bytes = 3.0*sizeof(std::complex<float>)*num_output_samples(workload);
+    return scatterer_bytes + line_bytes <= model.gpu_memory_fraction*gpu.free_memory;
+}
+
+// The fastest device that fits the workload, or -1.
+int best_gpu(const Workload& workload, const HardwareInfo& hardware, const CostModel& model) {
+    int best = -1;
+    for (size_t device_no = 0; device_no < hardware.gpus.size(); device_no++) {
+        const auto& gpu = hardware.gpus[device_no];
+        if (fits_on_gpu(gpu, workload, model)
+            && ((best < 0) || (gpu_projection_rate(gpu, model) > gpu_projection_rate(hardware.gpus[best], model)))) {
+            best = static_cast<int>(device_no);
+        }
+    }
+    return best;
+}
+
+double cpu_frame_seconds(int num_threads, const Workload& workload, const HardwareInfo& hardware, const CostModel& model) {
+    return projection_work(workload, model)/cpu_projection_rate(num_threads, hardware, model)
+        + num_output_samples(workload)*model.cpu_seconds_per_sample/num_threads;
+}
+
+}   // end anonymous namespace
+
+HardwareInfo HardwareInfo::detect() {
+    HardwareInfo info;
+#ifdef BCSIM_ENABLE_OPENMP
+    info.num_cpu_threads = omp_get_max_threads();
+#endif
+    info.num_numa_nodes = static_cast<int>(NumaTopology::detect().get_num_nodes());
+    const std::string isa = get_projection_kernel_isa();
+    info.simd_width = (isa == "avx512") ? 16 : (isa == "avx2") ? 8 : 1;
+#ifdef BCSIM_ENABLE_CUDA
+    int num_devices = 0;
+    int cur_device = 0;
+    if ((cudaGetDeviceCount(&num_devices) != cudaSuccess) || (cudaGetDevice(&cur_device) != cudaSuccess)) {
+        // no driver or no devices
+        cudaGetLastError();
+        return info;
+    }
+    for (int device_no = 0; device_no < num_devices; device_no++) {
+        cudaDeviceProp prop;
+        size_t free_bytes = 0;
+        size_t total_bytes = 0;
+        if ((cudaGetDeviceProperties(&prop, device_no) != cudaSuccess) || (cudaSetDevice(device_no) != cudaSuccess)
+            || (cudaMemGetInfo(&free_bytes, &total_bytes) != cudaSuccess)) {
+            cudaGetLastError();
+            continue;
+        }
+        Gpu gpu;
+        gpu.name = prop.name;
+        gpu.total_memory = total_bytes;
+        gpu.free_memory = free_bytes;
+        gpu.num_multiprocessors = prop.multiProcessorCount;
+        info.gpus.push_back(gpu);
+    }
+    cudaSetDevice(cur_device);
+#endif
+    return info;
+}
+
+CostModel::CostModel()
+    : cpu_projections_per_lane_second(1e7),
+      cpu_parallel_efficiency(0.85),
+      cpu_seconds_per_sample(1e-7),
+      gpu_projections_per_sm_second(1.5e8),
+      gpu_frame_overhead_seconds(5e-4),
+      gpu_seconds_per_sample(1e-9),
+      multi_device_overhead_seconds(1e-3),
+      spline_cost_factor(1.5),
+      gpu_memory_fraction(0.8)
+{ }
+
+CostModel::CostModel(const std::string& path)
+    : CostModel()
+{
+    if (path.empty()) {
+        return;
+    }
+    const auto values = model_values(*this);
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string name;
+        double value;
+        if ((ss >> name >> value) && (value > 0.0) && (values.count(name) != 0)) {
+            *values.at(name) = value;
+        }
+    }
+}
+
+void CostModel::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("unable to write cost model " + path);
+    }
+    out.precision(10);
+    for (const auto& item : model_values(const_cast<CostModel&>(*this))) {
+        out << item.first << " " << *item.second << "\n";
+    }
+}
+
+std::string CostModel::default_path() {
+    const char* home = std::getenv("HOME");
+    return home ? std::string(home) + "/.bcsim_cost_model" : std::string();
+}
+
+double predict_frame_seconds(const std::string& backend, const Workload& workload,
+                             const HardwareInfo& hardware, const CostModel& model) {
+    const auto work = projection_work(workload, model);
+    const auto num_samples = num_output_samples(workload);
+    if (backend == "cpu") {
+        return cpu_frame_seconds(hardware.num_cpu_threads, workload, hardware, model);
+    }
+#ifdef BCSIM_ENABLE_CUDA
+    const auto device_no = best_gpu(workload, hardware, model);
+    if (device_no < 0) {
+        return -1.0;
+    }
+    const auto& gpu = hardware.gpus[device_no];
+    if (backend == "gpu") {
+        return work/gpu_projection_rate(gpu, model) + model.gpu_frame_overhead_seconds
+            + num_samples*model.gpu_seconds_per_sample;
+    } else if (backend == "multi_gpu") {
+        // the lines are split over all devices, which each hold all scatterers
+        double rate = 0.0;
+        for (const auto& device : hardware.gpus) {
+            if (!fits_on_gpu(device, workload, model)) {
+                return -1.0;
+            }
+            rate += gpu_projection_rate(device, model);
+        }
+        if (hardware.gpus.size() < 2) {
+            return -1.0;
+        }
+        return work/rate + model.gpu_frame_overhead_seconds + model.multi_device_overhead_seconds
+            + num_samples*model.gpu_seconds_per_sample/hardware.gpus.size();
+    } else if (backend == "hybrid") {
+        // one thread feeds the GPU
+        const auto num_cpu_threads = hardware.num_cpu_threads - 1;
+        if (num_cpu_threads < 1) {
+            return -1.0;
+        }
+        const auto rate = gpu_projection_rate(gpu, model) + cpu_projection_rate(num_cpu_threads, hardware, model);
+        const auto samples_per_second = 1.0/model.gpu_seconds_per_sample + num_cpu_threads/model.cpu_seconds_per_sample;
+        return work/rate + model.gpu_frame_overhead_seconds + model.multi_device_overhead_seconds
+            + num_samples/samples_per_second;
+    }
+#else
+    (void) work;
+    (void) num_samples;
+#endif
+    return -1.0;
+}
+
+BackendChoice select_backend(const Workload& workload, const HardwareInfo& hardware, const CostModel& model,
+                             const std::string& forced_backend) {
+    BackendChoice choice;
+    if (forced_backend.empty()) {
+        choice.backend = "cpu";
+        choice.predicted_frame_seconds = predict_frame_seconds("cpu", workload, hardware, model);
+        for (const auto backend : {"gpu", "multi_gpu", "hybrid"}) {
+            const auto seconds = predict_frame_seconds(backend, workload, hardware, model);
+            if ((seconds >= 0.0) && (seconds < choice.predicted_frame_seconds)) {
+                choice.backend = backend;
+                choice.predicted_frame_seconds = seconds;
+            }
+        }
+    } else {
+        choice.backend = forced_backend;
+        choice.predicted_frame_seconds = predict_frame_seconds(forced_backend, workload, hardware, model);
+    }
+
+    auto& params = choice.parameters;
+    const auto numa_mode = (hardware.num_numa_nodes > 1) ? "auto" : "off";
+    if (choice.backend == "cpu") {
+        params.emplace_back("num_cpu_cores", std::to_string(hardware.num_cpu_threads));
+        params.emplace_back("cpu_numa", numa_mode);
+    } else if ((choice.backend == "gpu") || (choice.backend == "hybrid")) {
+        const auto device_no = best_gpu(workload, hardware, model);
+        if (device_no >= 0) {
+            params.emplace_back("gpu_device", std::to_string(device_no));
+        }
+        params.emplace_back("cuda_streams", "auto");
+        params.emplace_back("gpu_autotune", "on");
+        if (choice.backend == "hybrid") {
+            params.emplace_back("num_cpu_cores", std::to_string(std::max(1, hardware.num_cpu_threads - 1)));
+            params.emplace_back("cpu_numa", numa_mode);
+        }
+    } else if (choice.backend == "multi_gpu") {
+        params.emplace_back("cuda_streams", "auto");
+        params.emplace_back("gpu_autotune", "on");
+    } else {
+        throw std::runtime_error("unknown backend: " + choice.backend);
+    }
+    return choice;
+}
+
+}   // end namespace
@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bcsim {
+
+// What the backend selection knows about the machine.
+struct HardwareInfo {
+    struct Gpu {
+        std::string name;
+        size_t      total_memory;       // [bytes]
+        size_t      free_memory;        // [bytes]
+        int         num_multiprocessors;
+    };
+
+    HardwareInfo() : num_cpu_threads(1), num_numa_nodes(1), simd_width(1) { }
+
+    // The OpenMP threads, NUMA nodes, SIMD width of the CPU projection
+    // kernels and, if built with CUDA, the GPUs of this machine.
+    static HardwareInfo detect();
+
+    int                 num_cpu_threads;
+    int                 num_numa_nodes;
+    // floats per vector of the CPU projection kernels
+    int                 simd_width;
+    std::vector<Gpu>    gpus;
+};
+
+// The size of a frame.
+struct Workload {
+    Workload() : num_fixed_scatterers(0), num_spline_scatterers(0), num_cs(0), num_lines(0), num_time_samples(0) { }
+
+    size_t  num_fixed_scatterers;
+    size_t  num_spline_scatterers;
+    int     num_cs;
+    size_t  num_lines;
+    size_t  num_time_samples;
+};
+
+// Throughputs and overheads of the backends, from which the time of a frame
+// is predicted. The defaults are rough figures for current hardware; the
+// values measured on a machine are written by "bcsim_benchmark --calibrate".
+// Stored as a text file with one "<name> <value>" line per value, where
+// unknown names and malformed lines are ignored.
+struct CostModel {
+    CostModel();
+
+    // Loads the values of the file if it exists.
+    explicit CostModel(const std::string& path);
+
+    // Throws std::runtime_error if the file cannot be written.
+    void save(const std::string& path) const;
+
+    // $HOME/.bcsim_cost_model, or an empty path if HOME is not set.
+    static std::string default_path();
+
+    // Fixed-scatterer projections per second of one CPU thread and SIMD lane.
+    double  cpu_projections_per_lane_second;
+    // Speedup of n threads is 1 + (n - 1)*cpu_parallel_efficiency.
+    double  cpu_parallel_efficiency;
+    // Convolution and demodulation of one output sample on one thread.
+    double  cpu_seconds_per_sample;
+    // Fixed-scatterer projections per second of one GPU multiprocessor.
+    double  gpu_projections_per_sm_second;
+    // Launches, synchronization and download of a frame.
+    double  gpu_frame_overhead_seconds;
+    // Convolution and download of one output sample.
+    double  gpu_seconds_per_sample;
+    // Extra time per frame of splitting it between devices or backends.
+    double  multi_device_overhead_seconds;
+    // Cost of a spline-scatterer projection relative to a fixed one.
+    double  spline_cost_factor;
+    // Fraction of the free memory of a GPU that a simulation may use.
+    double  gpu_memory_fraction;
+};
+
+// A backend for Create() and the parameters to set on it.
+struct BackendChoice {
+    std::string                                         backend;
+    std::vector<std::pair<std::string, std::string>>    parameters;
+    double                                              predicted_frame_seconds;
+};
+
+// Predicted time of a frame with a backend, or a negative value if the
+// backend is not available or the workload does not fit on its devices.
+double predict_frame_seconds(const std::string& backend, const Workload& workload,
+                             const HardwareInfo& hardware, const CostModel& model);
+
+// The backend of "cpu", "gpu", "multi_gpu" and "hybrid" with the shortest
+// predicted frame time, with the number of threads and the GPU device and
+// launch configuration set for the hardware. Only "cpu" is considered
+// without CUDA support. If forced_backend is not empty, that backend is
+// configured instead.
+BackendChoice select_backend(const Workload& workload, const HardwareInfo& hardware, const CostModel& model,
+                             const std::string& forced_backend = "");
+
+}   // end namespace
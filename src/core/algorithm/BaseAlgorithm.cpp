@@ -26,9 +26,16 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <algorithm>
 #include <stdexcept>
+#include <typeinfo>
 #include "BaseAlgorithm.hpp"
+#include "CpuScatterers.hpp"
 #include "../BeamConvolver.hpp"
+#include "../bmode_image.hpp"
+#include "../content_hash.hpp"
+#include "../iq_format.hpp"
+#include "../Tracing.hpp"
 
 
 namespace bcsim {
@@ -40,13 +47,54 @@ BaseAlgorithm::BaseAlgorithm()
       m_param_use_arc_projection(true),
       m_radial_decimation(1),
       m_enable_phase_delay(false),
+      m_param_baseband(false),
+      m_param_scatterer_culling(false),
+      m_param_culling_num_sigmas(5.0f),
+      m_param_profile_cutoff_num_sigmas(6.0f),
+      m_param_ensemble_projection(true),
+      m_param_mla_projection(true),
+      m_param_scatterer_order(ScattererGrid::CellOrder::DEPTH),
       m_cur_beam_profile_type(BeamProfileType::NOT_CONFIGURED),
-      m_log_object(std::make_shared<DummyLog>())
+      m_log_object(std::make_shared<DummyLog>()),
+      m_stream_next_frame(0),
+      m_packet_size(0),
+      m_packet_prt(0.0f),
+      m_stats_num_frames(0),
+      m_stats_num_projections(0),
+      m_stats_total_ns(0),
+      m_stats_last_frame_ns(0)
 {
+    m_frame_cache.set_disk_capacity(1024*1024*1024);
+}
+
+BaseAlgorithm::~BaseAlgorithm() {
+    if (!m_param_trace_file.empty()) {
+        try {
+            trace::set_enabled(false);
+            trace::write_chrome_trace(m_param_trace_file);
+        } catch (const std::exception& e) {
+            m_log_object->write(ILog::WARNING, std::string("Failed writing trace: ") + e.what());
+        }
+    }
 }
 
 void BaseAlgorithm::set_parameter(const std::string& key, const std::string& value) {
-    if (key == "verbose") {
+    if (key == "trace_file") {
+        if (!m_param_trace_file.empty()) {
+            trace::set_enabled(false);
+            trace::write_chrome_trace(m_param_trace_file);
+        }
+        m_param_trace_file = value;
+        if (!value.empty()) {
+            trace::clear();
+            trace::set_enabled(true);
+        }
+    } else if (key == "stats_reset") {
+        m_stats_num_frames = 0;
+        m_stats_num_projections = 0;
+        m_stats_total_ns = 0;
+        m_stats_last_frame_ns = 0;
+    } else if (key == "verbose") {
         const auto verbose = std::stoi(value);
         m_param_verbose = verbose;
     } else if (key == "sound_speed") {
@@ -80,6 +128,71 @@ void BaseAlgorithm::set_parameter(const std::string& key, const std::string& val
         } else { 
             throw std::runtime_error("invalid boolean value");
         }
+    } else if (key == "baseband") {
+        if (value == "on" || value == "true") {
+            m_param_baseband = true;
+        } else if (value == "off" || value == "false") {
+            m_param_baseband = false;
+        } else {
+            throw std::runtime_error("invalid boolean value");
+        }
+    } else if (key == "scatterer_culling") {
+        if (value == "on" || value == "true") {
+            m_param_scatterer_culling = true;
+        } else if (value == "off" || value == "false") {
+            m_param_scatterer_culling = false;
+        } else {
+            throw std::runtime_error("invalid boolean value");
+        }
+    } else if (key == "culling_num_sigmas") {
+        const auto new_num_sigmas = std::stof(value);
+        if (new_num_sigmas <= 0.0f) {
+            throw std::runtime_error("illegal number of sigmas for culling");
+        }
+        m_param_culling_num_sigmas = new_num_sigmas;
+    } else if (key == "profile_cutoff_num_sigmas") {
+        const auto new_num_sigmas = std::stof(value);
+        if (new_num_sigmas <= 0.0f) {
+            throw std::runtime_error("illegal number of sigmas for the beam profile cutoff");
+        }
+        m_param_profile_cutoff_num_sigmas = new_num_sigmas;
+    } else if (key == "ensemble_projection") {
+        if (value == "on" || value == "true") {
+            m_param_ensemble_projection = true;
+        } else if (value == "off" || value == "false") {
+            m_param_ensemble_projection = false;
+        } else {
+            throw std::runtime_error("invalid boolean value");
+        }
+    } else if (key == "mla_projection") {
+        if (value == "on" || value == "true") {
+            m_param_mla_projection = true;
+        } else if (value == "off" || value == "false") {
+            m_param_mla_projection = false;
+        } else {
+            throw std::runtime_error("invalid boolean value");
+        }
+    } else if (key == "scatterer_order") {
+        if (value == "depth") {
+            m_param_scatterer_order = ScattererGrid::CellOrder::DEPTH;
+        } else if (value == "morton") {
+            m_param_scatterer_order = ScattererGrid::CellOrder::MORTON;
+        } else {
+            throw std::runtime_error("invalid scatterer order");
+        }
+    } else if ((key == "frame_cache_megabytes") || (key == "frame_cache_disk_megabytes")) {
+        const auto megabytes = std::stod(value);
+        if (megabytes < 0.0) {
+            throw std::runtime_error("illegal frame cache size");
+        }
+        const auto num_bytes = static_cast<size_t>(megabytes*1024.0*1024.0);
+        if (key == "frame_cache_megabytes") {
+            m_frame_cache.set_memory_capacity(num_bytes);
+        } else {
+            m_frame_cache.set_disk_capacity(num_bytes);
+        }
+    } else if (key == "frame_cache_dir") {
+        m_frame_cache.set_directory(value);
     } else {
         const auto err_msg = std::string("illegal parameter name: '") + key + std::string("'");
         throw std::runtime_error(err_msg);
@@ -94,13 +207,669 @@ std::vector<double> BaseAlgorithm::get_debug_data(const std::string& identifier)
 }
 
 std::string BaseAlgorithm::get_parameter(const std::string& key) const {
+    if (key == "stats_num_frames") {
+        return std::to_string(m_stats_num_frames.load());
+    } else if (key == "stats_num_projections") {
+        return std::to_string(m_stats_num_projections.load());
+    } else if (key == "stats_total_time") {
+        return std::to_string(m_stats_total_ns.load()*1e-9);
+    } else if (key == "stats_last_frame_time") {
+        return std::to_string(m_stats_last_frame_ns.load()*1e-9);
+    } else if (key == "stats_projections_per_second") {
+        const auto total_ns = m_stats_total_ns.load();
+        return std::to_string(total_ns > 0 ? m_stats_num_projections.load()/(total_ns*1e-9) : 0.0);
+    } else if (key == "frame_cache_hits") {
+        return std::to_string(m_frame_cache.get_num_hits());
+    } else if (key == "frame_cache_misses") {
+        return std::to_string(m_frame_cache.get_num_misses());
+    }
     throw std::runtime_error("Illegal key: " + key);
 }
 
+void BaseAlgorithm::count_frame(size_t num_lines, std::chrono::steady_clock::time_point start) {
+    const auto frame_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    m_stats_num_frames.fetch_add(1, std::memory_order_relaxed);
+    m_stats_num_projections.fetch_add(num_lines*get_total_num_scatterers(), std::memory_order_relaxed);
+    m_stats_total_ns.fetch_add(frame_ns, std::memory_order_relaxed);
+    m_stats_last_frame_ns.store(frame_ns, std::memory_order_relaxed);
+}
+
+bool BaseAlgorithm::state_has_noise() const {
+    for (const auto& parameter : m_state.get_parameters()) {
+        if (parameter.first == "noise_amplitude") {
+            return std::stof(parameter.second) > 0.0f;
+        }
+    }
+    return false;
+}
+
+std::string BaseAlgorithm::frame_cache_key(uint64_t noise_frame_no) const {
+    if (!m_frame_cache.is_enabled()) {
+        return std::string();
+    }
+    ContentHash hash;
+    // the implementations differ in rounding
+    hash.update(std::string(typeid(*this).name()));
+    if (state_has_noise()) {
+        hash.update(&noise_frame_no, sizeof(noise_frame_no));
+    }
+    try {
+        m_state.hash(hash, [](const std::string& key) { return key != "verbose"; });
+    } catch (const std::runtime_error&) {
+        return std::string();
+    }
+    return hash.hex_digest();
+}
+
+bool BaseAlgorithm::read_cached_frame(const std::string& key, std::complex<float>* iq_buffer, size_t line_stride) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    m_frame_cache_lines.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        m_frame_cache_lines[line_no] = iq_buffer + line_no*line_stride;
+    }
+    if (!m_frame_cache.get(key, num_lines, num_samples, m_frame_cache_lines.data())) {
+        return false;
+    }
+    report_lines(0, num_lines, iq_buffer, line_stride);
+    return true;
+}
+
+bool BaseAlgorithm::read_cached_frame(const std::string& key, std::vector<std::vector<std::complex<float>>>& lines) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    lines.resize(num_lines);
+    m_frame_cache_lines.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        lines[line_no].resize(num_samples);
+        m_frame_cache_lines[line_no] = lines[line_no].data();
+    }
+    if (!m_frame_cache.get(key, num_lines, num_samples, m_frame_cache_lines.data())) {
+        return false;
+    }
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        report_lines(line_no, 1, lines[line_no].data(), 0);
+    }
+    return true;
+}
+
+void BaseAlgorithm::write_cached_frame(const std::string& key, const std::complex<float>* iq_buffer, size_t line_stride) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    m_frame_cache_lines.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        m_frame_cache_lines[line_no] = const_cast<std::complex<float>*>(iq_buffer + line_no*line_stride);
+    }
+    m_frame_cache.put(key, num_lines, num_samples, m_frame_cache_lines.data());
+}
+
+void BaseAlgorithm::write_cached_frame(const std::string& key, const std::vector<std::vector<std::complex<float>>>& lines) {
+    m_frame_cache_lines.resize(lines.size());
+    for (size_t line_no = 0; line_no < lines.size(); line_no++) {
+        m_frame_cache_lines[line_no] = const_cast<std::complex<float>*>(lines[line_no].data());
+    }
+    m_frame_cache.put(key, lines.size(), lines.empty() ? 0 : lines.front().size(), m_frame_cache_lines.data());
+}
+
 void BaseAlgorithm::set_logger(ILog::ptr log_object) {
     m_log_object = log_object;
 }
 
+void BaseAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    add_fixed_scatterers(procedural_scatterers->expand());
+}
+
+void BaseAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    add_fixed_scatterers(image_volume_scatterers->expand());
+}
+
+void BaseAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    add_fixed_scatterers(external_scatterers->expand());
+}
+
+float BaseAlgorithm::simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    if (format.sample_type == IqOutputFormat::SampleType::COMPLEX_FLOAT32) {
+        simulate_lines(static_cast<std::complex<float>*>(iq_buffer), line_stride);
+        return 1.0f;
+    }
+    const auto sample_bytes = iq_sample_bytes(format.sample_type);
+    m_formatted_iq_lines.resize(num_lines*num_samples);
+    simulate_lines(m_formatted_iq_lines.data(), num_samples);
+    const auto iq_lines = m_formatted_iq_lines.data();
+    const auto num_lines_i = static_cast<long long>(num_lines);
+
+    float scale = 1.0f;
+    if (format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16) {
+        scale = format.int16_scale;
+        if (scale == 0.0f) {
+            float max_abs = 0.0f;
+            #pragma omp parallel for reduction(max:max_abs)
+            for (long long line_no = 0; line_no < num_lines_i; line_no++) {
+                max_abs = std::max(max_abs, max_abs_iq_component(iq_lines + line_no*num_samples, num_samples));
+            }
+            scale = int16_frame_scale(max_abs);
+        }
+    }
+    #pragma omp parallel for
+    for (long long line_no = 0; line_no < num_lines_i; line_no++) {
+        convert_iq_samples(iq_lines + line_no*num_samples, num_samples, format.sample_type, scale,
+                           static_cast<char*>(iq_buffer) + line_no*line_stride*sample_bytes);
+    }
+    return scale;
+}
+
+std::future<void> BaseAlgorithm::simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) {
+    // the exception of a frame is stored in its future
+    auto frame = std::make_shared<std::packaged_task<void()>>([this, iq_buffer, line_stride]() {
+        simulate_lines(iq_buffer, line_stride);
+    });
+    auto res = frame->get_future();
+    m_async_frames.submit([frame]() { (*frame)(); });
+    return res;
+}
+
+void BaseAlgorithm::begin_stream(const std::vector<float>& timestamp_offsets) {
+    m_stream_scan_seq = current_scan_sequence();
+    if (!m_stream_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to begin a stream");
+    }
+    m_stream_timestamp_offsets = timestamp_offsets;
+    m_stream_next_frame = 0;
+}
+
+bool BaseAlgorithm::next_frame(std::complex<float>* iq_buffer, size_t line_stride) {
+    const auto num_frames = m_stream_timestamp_offsets.size();
+    if (m_stream_next_frame >= num_frames) {
+        return false;
+    }
+    const auto timestamp_offset = m_stream_timestamp_offsets[m_stream_next_frame++];
+    set_scan_sequence(shifted_scan_sequence(*m_stream_scan_seq, timestamp_offset));
+    try {
+        simulate_lines(iq_buffer, line_stride);
+    } catch (...) {
+        // end the stream with the original scan sequence configured
+        m_stream_next_frame = num_frames;
+        set_scan_sequence(m_stream_scan_seq);
+        throw;
+    }
+    if (m_stream_next_frame == num_frames) {
+        set_scan_sequence(m_stream_scan_seq);
+    }
+    return true;
+}
+
+void BaseAlgorithm::set_line_callback(LineCallback callback) {
+    m_line_callback = std::move(callback);
+}
+
+void BaseAlgorithm::simulate_packets(size_t packet_size, float prt, std::complex<float>* packets) {
+    const auto base_scan_seq = current_scan_sequence();
+    if (!base_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to simulate packets");
+    }
+    if (packet_size == 0) {
+        throw std::runtime_error("packet size must be positive");
+    }
+    const auto num_lines = static_cast<size_t>(base_scan_seq->get_num_lines());
+
+    // Frame by frame, so that lines of a frame with equal timestamps share
+    // the rendered splines.
+    if (!m_packet_scan_seq || (m_packet_base_scan_seq != base_scan_seq)
+                           || (m_packet_size != packet_size) || (m_packet_prt != prt)) {
+        ScanSequence::s_ptr packet_scan_seq;
+        if (is_whole_parametric_frame(*base_scan_seq)) {
+            // the frames of a packet are a timing rule of a parametric scan
+            auto scan = base_scan_seq->get_parametric_scan();
+            scan.num_frames = static_cast<int>(packet_size);
+            scan.frame_interval = prt;
+            packet_scan_seq = std::make_shared<ScanSequence>(base_scan_seq->line_length, scan);
+        } else {
+            packet_scan_seq = std::make_shared<ScanSequence>(base_scan_seq->line_length);
+            for (size_t packet_no = 0; packet_no < packet_size; packet_no++) {
+                for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                    const auto& line = base_scan_seq->get_scanline(static_cast<int>(line_no));
+                    packet_scan_seq->add_scanline(Scanline(line.get_origin(), line.get_direction(), line.get_lateral_dir(),
+                                                           line.get_timestamp() + packet_no*prt));
+                }
+            }
+        }
+        packet_scan_seq->all_timestamps_equal = base_scan_seq->all_timestamps_equal && (packet_size == 1);
+        packet_scan_seq->r_min = base_scan_seq->r_min;
+        packet_scan_seq->r_max = base_scan_seq->r_max;
+        m_packet_scan_seq = packet_scan_seq;
+        m_packet_base_scan_seq = base_scan_seq;
+        m_packet_size = packet_size;
+        m_packet_prt = prt;
+    }
+
+    ScopedLineCallbackSuspension no_line_callback(m_line_callback);
+    set_scan_sequence(m_packet_scan_seq);
+    size_t num_packet_lines, num_samples;
+    try {
+        get_output_dimensions(num_packet_lines, num_samples);
+        m_packet_iq_lines.resize(num_packet_lines*num_samples);
+        simulate_lines(m_packet_iq_lines.data(), num_samples);
+    } catch (...) {
+        set_scan_sequence(base_scan_seq);
+        throw;
+    }
+    set_scan_sequence(base_scan_seq);
+
+    // [frame][line][sample] to [line][sample][frame]
+    const auto iq_lines = m_packet_iq_lines.data();
+    #pragma omp parallel for
+    for (long long line_no = 0; line_no < static_cast<long long>(num_lines); line_no++) {
+        auto dst = packets + line_no*num_samples*packet_size;
+        for (size_t packet_no = 0; packet_no < packet_size; packet_no++) {
+            const auto src = iq_lines + (packet_no*num_lines + line_no)*num_samples;
+            for (size_t i = 0; i < num_samples; i++) {
+                dst[i*packet_size + packet_no] = src[i];
+            }
+        }
+    }
+}
+
+void BaseAlgorithm::simulate_frames(const std::vector<float>& timestamp_offsets, std::complex<float>* iq_buffer,
+                                    size_t line_stride, size_t frame_stride) {
+    const auto base_scan_seq = current_scan_sequence();
+    if (!base_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to simulate frames");
+    }
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    if (frame_stride < num_lines*line_stride) {
+        throw std::runtime_error("frame stride is less than the number of lines times the line stride");
+    }
+    const auto num_frames = timestamp_offsets.size();
+    if ((num_frames == 0) || (num_lines == 0)) {
+        return;
+    }
+
+    // Frame by frame as for packets, so that the lines of a frame are
+    // neighbours in the line blocks and share the rendered splines.
+    if (!m_frames_scan_seq || (m_frames_base_scan_seq != base_scan_seq) || (m_frames_timestamp_offsets != timestamp_offsets)) {
+        auto frames_scan_seq = std::make_shared<ScanSequence>(base_scan_seq->line_length);
+        for (const auto timestamp_offset : timestamp_offsets) {
+            for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                const auto& line = base_scan_seq->get_scanline(static_cast<int>(line_no));
+                frames_scan_seq->add_scanline(Scanline(line.get_origin(), line.get_direction(), line.get_lateral_dir(),
+                                                       line.get_timestamp() + timestamp_offset));
+            }
+        }
+        frames_scan_seq->all_timestamps_equal = base_scan_seq->all_timestamps_equal && (num_frames == 1);
+        frames_scan_seq->lines_per_frame = static_cast<int>(num_lines);
+        frames_scan_seq->r_min = base_scan_seq->r_min;
+        frames_scan_seq->r_max = base_scan_seq->r_max;
+        m_frames_scan_seq = frames_scan_seq;
+        m_frames_base_scan_seq = base_scan_seq;
+        m_frames_timestamp_offsets = timestamp_offsets;
+    }
+
+    // contiguous frames are written in place
+    const bool contiguous = (frame_stride == num_lines*line_stride);
+    ScopedLineCallbackSuspension no_line_callback(m_line_callback);
+    set_scan_sequence(m_frames_scan_seq);
+    try {
+        if (contiguous) {
+            simulate_lines(iq_buffer, line_stride);
+        } else {
+            m_frames_iq_lines.resize(num_frames*num_lines*num_samples);
+            simulate_lines(m_frames_iq_lines.data(), num_samples);
+        }
+    } catch (...) {
+        set_scan_sequence(base_scan_seq);
+        throw;
+    }
+    set_scan_sequence(base_scan_seq);
+
+    if (!contiguous) {
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                const auto src = m_frames_iq_lines.data() + (frame_no*num_lines + line_no)*num_samples;
+                std::copy(src, src + num_samples, iq_buffer + frame_no*frame_stride + line_no*line_stride);
+            }
+        }
+    }
+}
+
+void BaseAlgorithm::simulate_realizations(const std::vector<FixedScatterers::s_ptr>& realizations,
+                                          std::complex<float>* iq_buffer,
+                                          size_t line_stride, size_t frame_stride) {
+    const auto base_scan_seq = current_scan_sequence();
+    if (!base_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to simulate realizations");
+    }
+    if (realizations.empty()) {
+        throw std::runtime_error("at least one realization is required");
+    }
+    if (m_state.get_num_spline_datasets() > 0) {
+        throw std::runtime_error("spline scatterers must be cleared to simulate realizations");
+    }
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    if (frame_stride < num_lines*line_stride) {
+        throw std::runtime_error("frame stride is less than the number of lines times the line stride");
+    }
+    const auto num_realizations = realizations.size();
+    if (num_lines == 0) {
+        return;
+    }
+
+    // The realizations are placed on a cubic lattice with a spacing of the
+    // extent of all scatterers and line origins plus two line lengths, so
+    // that the scatterers of other realizations are at least two line
+    // lengths from a line. A compact lattice keeps the coordinates small,
+    // which preserves the float precision of the projections.
+    vector3 lo = base_scan_seq->get_scanline(0).get_origin();
+    vector3 hi = lo;
+    const auto extend = [&](const vector3& p) {
+        lo = vector3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+        hi = vector3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+    };
+    for (int line_no = 0; line_no < static_cast<int>(num_lines); line_no++) {
+        extend(base_scan_seq->get_scanline(line_no).get_origin());
+    }
+    for (const auto& realization : realizations) {
+        for (const auto& scatterer : realization->scatterers) {
+            extend(scatterer.pos);
+        }
+    }
+    const auto extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    const auto spacing = extent + 2.0f*base_scan_seq->line_length;
+    size_t lattice_size = 1;
+    while (lattice_size*lattice_size*lattice_size < num_realizations) {
+        lattice_size++;
+    }
+    const auto offset = [&](size_t k) {
+        return vector3(static_cast<float>(k%lattice_size), static_cast<float>((k/lattice_size)%lattice_size),
+                       static_cast<float>(k/(lattice_size*lattice_size)))*spacing;
+    };
+
+    auto batch_scatterers = std::make_shared<FixedScatterers>();
+    auto batch_scan_seq = std::make_shared<ScanSequence>(base_scan_seq->line_length);
+    for (size_t k = 0; k < num_realizations; k++) {
+        const auto shift = offset(k);
+        for (const auto& scatterer : realizations[k]->scatterers) {
+            batch_scatterers->scatterers.push_back(PointScatterer{scatterer.pos + shift, scatterer.amplitude});
+        }
+        for (int line_no = 0; line_no < static_cast<int>(num_lines); line_no++) {
+            const auto& line = base_scan_seq->get_scanline(line_no);
+            batch_scan_seq->add_scanline(Scanline(line.get_origin() + shift, line.get_direction(), line.get_lateral_dir(),
+                                                  line.get_timestamp()));
+        }
+    }
+    batch_scan_seq->all_timestamps_equal = base_scan_seq->all_timestamps_equal;
+    batch_scan_seq->r_min = base_scan_seq->r_min;
+    batch_scan_seq->r_max = base_scan_seq->r_max;
+
+    // the configured datasets are shared with the state, so restoring them
+    // does not copy the scatterers
+    const auto fixed_datasets = m_state.get_fixed_datasets();
+    const auto procedural_datasets = m_state.get_procedural_datasets();
+    const auto image_volume_datasets = m_state.get_image_volume_datasets();
+    const auto external_datasets = m_state.get_external_datasets();
+    const auto restore = [&]() {
+        set_scan_sequence(base_scan_seq);
+        clear_fixed_scatterers();
+        for (size_t i = 0; i < fixed_datasets.size(); i++) {
+            if (procedural_datasets[i]) {
+                add_procedural_scatterers(procedural_datasets[i]);
+            } else if (image_volume_datasets[i]) {
+                add_image_volume_scatterers(image_volume_datasets[i]);
+            } else if (external_datasets[i]) {
+                add_external_fixed_scatterers(external_datasets[i]);
+            } else {
+                add_fixed_scatterers(fixed_datasets[i]);
+            }
+        }
+    };
+    ScopedLineCallbackSuspension no_line_callback(m_line_callback);
+    try {
+        clear_fixed_scatterers();
+        add_fixed_scatterers(batch_scatterers);
+        set_scan_sequence(batch_scan_seq);
+        m_realization_iq_lines.resize(num_realizations*num_lines*num_samples);
+        simulate_lines(m_realization_iq_lines.data(), num_samples);
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+
+    for (size_t k = 0; k < num_realizations; k++) {
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            const auto src = m_realization_iq_lines.data() + (k*num_lines + line_no)*num_samples;
+            std::copy(src, src + num_samples, iq_buffer + k*frame_stride + line_no*line_stride);
+        }
+    }
+}
+
+void BaseAlgorithm::simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                    std::complex<float>* iq_buffer,
+                                                    size_t line_stride, size_t frame_stride) {
+    check_multi_excitation_args(excitations, line_stride, frame_stride);
+    const auto configured = *m_state.get_excitation();
+    ScopedLineCallbackSuspension no_line_callback(m_line_callback);
+    try {
+        for (size_t k = 0; k < excitations.size(); k++) {
+            set_excitation(excitations[k]);
+            simulate_lines(iq_buffer + k*frame_stride, line_stride);
+        }
+    } catch (...) {
+        set_excitation(configured);
+        throw;
+    }
+    set_excitation(configured);
+}
+
+void BaseAlgorithm::check_multi_excitation_args(const std::vector<ExcitationSignal>& excitations,
+                                                size_t line_stride, size_t frame_stride) const {
+    const auto configured = m_state.get_excitation();
+    if (!configured) {
+        throw std::runtime_error("Excitation must be configured to simulate multiple excitations");
+    }
+    if (excitations.empty()) {
+        throw std::runtime_error("at least one excitation is required");
+    }
+    for (const auto& excitation : excitations) {
+        if (excitation.sampling_frequency != configured->sampling_frequency) {
+            throw std::runtime_error("all excitations must have the sampling frequency of the configured excitation");
+        }
+    }
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    if (frame_stride < num_lines*line_stride) {
+        throw std::runtime_error("frame stride is less than the number of lines times the line stride");
+    }
+}
+
+float BaseAlgorithm::simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    m_bmode_iq_lines.resize(num_lines*num_samples);
+    ScopedLineCallbackSuspension no_line_callback(m_line_callback);
+    simulate_lines(m_bmode_iq_lines.data(), num_samples);
+    return make_bmode_image(config, m_bmode_iq_lines.data(), num_lines, num_samples, num_samples, image);
+}
+
+float BaseAlgorithm::simulate_bmode_image_on_device(const BModeImageConfig& /*config*/, unsigned char* /*device_image*/) {
+    throw std::runtime_error("B-mode images on the device require a GPU simulator");
+}
+
+IDeviceIqFrame::s_ptr BaseAlgorithm::simulate_lines_on_device() {
+    throw std::runtime_error("IQ lines on the device require a single-GPU simulator");
+}
+
+void BaseAlgorithm::save_state(const std::string& path) const {
+    // sorting the datasets once here saves it in every process loading them
+    const auto& datasets = m_state.get_fixed_datasets();
+    std::vector<std::shared_ptr<HostFixedScatterers>> layouts(datasets.size());
+    for (size_t dset_idx = 0; dset_idx < datasets.size(); dset_idx++) {
+        if (!datasets[dset_idx] || (datasets[dset_idx]->num_scatterers() == 0)) {
+            continue;
+        }
+        layouts[dset_idx] = kept_fixed_layout(dset_idx);
+        if (!layouts[dset_idx]) {
+            layouts[dset_idx] = std::make_shared<HostFixedScatterers>(*datasets[dset_idx], m_param_scatterer_order);
+        }
+    }
+    m_state.save(path, layouts);
+}
+
+void BaseAlgorithm::load_state(const std::string& path) {
+    // read everything before changing the configuration
+    AlgorithmState state;
+    state.load(path);
+    m_restored_layouts = state.get_fixed_layouts();
+    try {
+        state.apply(*this);
+    } catch (...) {
+        m_restored_layouts.clear();
+        throw;
+    }
+    m_restored_layouts.clear();
+}
+
+std::shared_ptr<HostFixedScatterers> BaseAlgorithm::restored_fixed_layout(size_t dset_idx, size_t num_subsets) const {
+    if (dset_idx >= m_restored_layouts.size()) {
+        return nullptr;
+    }
+    const auto& layout = m_restored_layouts[dset_idx];
+    if (!layout || (layout->cell_order != m_param_scatterer_order) || (layout->num_subsets != num_subsets)) {
+        return nullptr;
+    }
+    return layout;
+}
+
+void BaseAlgorithm::add_base_memory_usage(MemoryUsage& usage) const {
+    const auto scan_seq = current_scan_sequence();
+    if (scan_seq) {
+        usage.host["scan_sequence"] += scan_sequence_bytes(*scan_seq);
+    }
+    if (m_packet_scan_seq) {
+        usage.host["scan_sequence"] += scan_sequence_bytes(*m_packet_scan_seq);
+    }
+    if (m_frames_scan_seq) {
+        usage.host["scan_sequence"] += scan_sequence_bytes(*m_frames_scan_seq);
+    }
+    usage.host["image_buffers"] += (m_bmode_iq_lines.capacity() + m_packet_iq_lines.capacity()
+                                    + m_realization_iq_lines.capacity() + m_frames_iq_lines.capacity()
+                                    + m_formatted_iq_lines.capacity())*sizeof(std::complex<float>);
+    usage.host["frame_cache"] += m_frame_cache.get_memory_bytes();
+}
+
+bool BaseAlgorithm::has_single_geometry(const ScanSequence& scan_seq) {
+    const int num_lines = scan_seq.get_num_lines();
+    if (num_lines < 2) {
+        return false;
+    }
+    if (scan_seq.is_parametric()) {
+        return scan_seq.get_parametric_scan().get_num_frame_lines() == 1;
+    }
+    const auto same = [](const vector3& a, const vector3& b) {
+        return (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
+    };
+    const auto first = scan_seq.get_scanline(0);
+    for (int line_no = 1; line_no < num_lines; line_no++) {
+        const auto line = scan_seq.get_scanline(line_no);
+        if (!same(line.get_origin(), first.get_origin()) || !same(line.get_direction(), first.get_direction())
+            || !same(line.get_lateral_dir(), first.get_lateral_dir())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int BaseAlgorithm::mla_group_size(const ScanSequence& scan_seq) {
+    const int num_lines = scan_seq.get_num_lines();
+    if ((num_lines < 2) || scan_seq.is_parametric()) {
+        return 1;
+    }
+    const auto same_transmit = [](const Scanline& a, const Scanline& b) {
+        const auto& o1 = a.get_origin();
+        const auto& o2 = b.get_origin();
+        return (o1.x == o2.x) && (o1.y == o2.y) && (o1.z == o2.z) && (a.get_timestamp() == b.get_timestamp());
+    };
+    // the size of the first group, which all others must have
+    const auto first = scan_seq.get_scanline(0);
+    int group_size = 1;
+    while ((group_size < num_lines) && same_transmit(scan_seq.get_scanline(group_size), first)) {
+        group_size++;
+    }
+    if (group_size == 1) {
+        return 1;
+    }
+    for (int group_start = group_size; group_start < num_lines; group_start += group_size) {
+        const auto group_first = scan_seq.get_scanline(group_start);
+        const int group_end = std::min(group_start + group_size, num_lines);
+        for (int line_no = group_start + 1; line_no < group_end; line_no++) {
+            if (!same_transmit(scan_seq.get_scanline(line_no), group_first)) {
+                return 1;
+            }
+        }
+        // the next group is a new transmit
+        if ((group_end < num_lines) && same_transmit(scan_seq.get_scanline(group_end), group_first)) {
+            return 1;
+        }
+    }
+    return group_size;
+}
+
+ScanSequence::s_ptr BaseAlgorithm::line_range(const ScanSequence& scan_seq, int first_line, int num_lines) {
+    ScanSequence::s_ptr res;
+    if (scan_seq.is_parametric()) {
+        res = std::make_shared<ScanSequence>(scan_seq.line_length, scan_seq.get_parametric_scan(),
+                                             scan_seq.get_parametric_first_line() + first_line, num_lines);
+    } else {
+        res = std::make_shared<ScanSequence>(scan_seq.line_length);
+        for (int line_no = first_line; line_no < first_line + num_lines; line_no++) {
+            res->add_scanline(scan_seq.get_scanline(std::min(line_no, scan_seq.get_num_lines() - 1)));
+        }
+    }
+    res->all_timestamps_equal = scan_seq.all_timestamps_equal;
+    res->r_min = scan_seq.r_min;
+    res->r_max = scan_seq.r_max;
+    return res;
+}
+
+ScanSequence::s_ptr BaseAlgorithm::shifted_scan_sequence(const ScanSequence& scan_seq, float timestamp_offset) {
+    if (scan_seq.is_parametric()) {
+        auto scan = scan_seq.get_parametric_scan();
+        scan.first_timestamp += timestamp_offset;
+        auto res = std::make_shared<ScanSequence>(scan_seq.line_length, scan, scan_seq.get_parametric_first_line(),
+                                                  scan_seq.get_num_lines());
+        res->all_timestamps_equal = scan_seq.all_timestamps_equal;
+        res->r_min = scan_seq.r_min;
+        res->r_max = scan_seq.r_max;
+        return res;
+    }
+    auto res = std::make_shared<ScanSequence>(scan_seq.line_length);
+    for (int line_no = 0; line_no < scan_seq.get_num_lines(); line_no++) {
+        const auto& line = scan_seq.get_scanline(line_no);
+        res->add_scanline(Scanline(line.get_origin(), line.get_direction(), line.get_lateral_dir(), line.get_timestamp() + timestamp_offset));
+    }
+    res->all_timestamps_equal = scan_seq.all_timestamps_equal;
+    res->lines_per_frame = scan_seq.lines_per_frame;
+    res->r_min = scan_seq.r_min;
+    res->r_max = scan_seq.r_max;
+    return res;
+}
+
 
 }   // end namespace
 
@@ -30,15 +30,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include "../LibBCSim.hpp"
 #include "../BeamConvolver.hpp"
+#include "ScattererGrid.hpp"
+#include "AlgorithmState.hpp"
+#include "FrameCache.hpp"
+#include "ThreadPool.hpp"
 
 namespace bcsim {
 
 enum class BeamProfileType {
     NOT_CONFIGURED = 0,
     ANALYTICAL,     // Analytical Gaussian beam profile
-    LOOKUP          // Lookup-table based beam profile
+    LOOKUP,         // Lookup-table based beam profile
+    MULTI_RESOLUTION_LOOKUP     // Lookup-tables of several radial zones
 };
     
 // Common functionality for CPU- and GPU-algorithms.
@@ -46,18 +55,219 @@ class BaseAlgorithm : public IAlgorithm {
 public:
     BaseAlgorithm();
 
-    virtual ~BaseAlgorithm() { }
+    // Writes the trace if a trace file is set.
+    virtual ~BaseAlgorithm();
     
     // Handle common parameters for all algorithm implementations.
+    // Setting "trace_file" to a path clears and starts recording trace
+    // events (see Tracing.hpp), which are written to the file when the
+    // parameter is set again, e.g. to "" to stop, or when the simulator is
+    // destroyed. Setting "stats_reset" to any value resets the frame
+    // statistics.
+    // The frame cache returns the frames of simulate_lines() for exact
+    // repeats of a configuration, keyed by a hash of the scatterers,
+    // excitation, beam profile, scan sequence, parameters and the position
+    // in the noise stream:
+    //   "frame_cache_megabytes"         Frames kept in memory, 0 (default) is off
+    //   "frame_cache_dir"               Directory of frame files shared between
+    //                                   runs and processes, "" (default) is off
+    //   "frame_cache_disk_megabytes"    Size of the directory, 0 is unlimited (default 1024)
+    // Both evict the least recently used frames.
     virtual void set_parameter(const std::string& key, const std::string& value)    override;
 
+    // The frame statistics of all simulated frames since construction or
+    // the last "stats_reset":
+    //   "stats_num_frames"              Number of frames
+    //   "stats_num_projections"         Scatterer-line projections (before culling)
+    //   "stats_total_time"              Cumulative wall time [s]
+    //   "stats_last_frame_time"         Wall time of the last frame [s]
+    //   "stats_projections_per_second"  Projections over the cumulative time
+    // and the frames of simulate_lines() found and not found in the frame
+    // cache, "frame_cache_hits" and "frame_cache_misses".
     virtual std::string get_parameter(const std::string& key)                       const override;
 
     virtual std::vector<double> get_debug_data(const std::string& identifier)       const override;
 
     virtual void set_logger(ILog::ptr log_object) override;
 
+    // Adds the expanded dataset as fixed scatterers.
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) override;
+
+    // Adds the expanded dataset as fixed scatterers.
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) override;
+
+    // Adds a copy of the dataset as fixed scatterers.
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) override;
+
+    // Converts the lines of simulate_lines() on the host.
+    virtual float simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) override;
+
+    // Simulates the frames one at a time on the shared thread pool.
+    virtual std::future<void> simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) override;
+
+    // Simulates one frame per call with a time-shifted scan sequence.
+    virtual void begin_stream(const std::vector<float>& timestamp_offsets)         override;
+
+    virtual bool next_frame(std::complex<float>* iq_buffer, size_t line_stride)     override;
+
+    // Stores the callback for the implementations to call (see report_lines()).
+    virtual void set_line_callback(LineCallback callback)                          override;
+
+    // Simulates all frames of the packet with one scan sequence.
+    virtual void simulate_packets(size_t packet_size, float prt, std::complex<float>* packets) override;
+
+    // Simulates all frames with one scan sequence.
+    virtual void simulate_frames(const std::vector<float>& timestamp_offsets, std::complex<float>* iq_buffer,
+                                 size_t line_stride, size_t frame_stride) override;
+
+    // Simulates the realizations with one scan sequence and fixed dataset.
+    virtual void simulate_realizations(const std::vector<FixedScatterers::s_ptr>& realizations,
+                                       std::complex<float>* iq_buffer,
+                                       size_t line_stride, size_t frame_stride) override;
+
+    // Simulates one frame per excitation, i.e. also projects the scatterers
+    // once per excitation.
+    virtual void simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                 std::complex<float>* iq_buffer,
+                                                 size_t line_stride, size_t frame_stride) override;
+
+    // Converts the lines of simulate_lines() on the host.
+    virtual float simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) override;
+
+    // Throws, there is no device.
+    virtual float simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* device_image) override;
+
+    // Throws, there is no single device.
+    virtual IDeviceIqFrame::s_ptr simulate_lines_on_device() override;
+
+    virtual void save_state(const std::string& path)                                const override;
+
+    virtual void load_state(const std::string& path)                                override;
+
 protected:
+    // The scan sequence currently configured (may be null).
+    virtual ScanSequence::s_ptr current_scan_sequence() const = 0;
+
+    // Copy of a scan sequence with an offset added to all timestamps.
+    static ScanSequence::s_ptr shifted_scan_sequence(const ScanSequence& scan_seq, float timestamp_offset);
+
+    // The lines [first_line, first_line + num_lines) of a scan sequence, with
+    // the last line repeated past its end. A parametric sequence gives a view
+    // of the same parametric scan.
+    static ScanSequence::s_ptr line_range(const ScanSequence& scan_seq, int first_line, int num_lines);
+
+    // Add the host memory of the scan sequence and of the buffers for
+    // B-mode images and packets to usage.
+    void add_base_memory_usage(MemoryUsage& usage) const;
+
+    // A parametric sequence only stores its parameters.
+    static size_t scan_sequence_bytes(const ScanSequence& scan_seq) {
+        return scan_seq.is_parametric() ? sizeof(ScanSequence) : scan_seq.get_num_lines()*sizeof(Scanline);
+    }
+
+    // True if the scan sequence is all lines of a single-frame parametric scan.
+    static bool is_whole_parametric_frame(const ScanSequence& scan_seq) {
+        return scan_seq.is_parametric() && (scan_seq.get_parametric_first_line() == 0)
+               && (scan_seq.get_parametric_scan().num_frames == 1)
+               && (scan_seq.get_num_lines() == scan_seq.get_parametric_scan().get_num_lines());
+    }
+
+    // True if all lines of the scan sequence have the same origin and
+    // directions, as for M-mode and PW Doppler, where only the timestamps
+    // differ. Then the scatterers only need to be projected onto one
+    // geometry for the whole ensemble of timestamps.
+    static bool has_single_geometry(const ScanSequence& scan_seq);
+
+    // The number of lines per transmit of a multi-line acquisition (MLA),
+    // where the scan sequence consists of consecutive groups of this many
+    // receive lines with the same origin and timestamp. Only the last group
+    // may be smaller. Is one if the lines do not form such groups. The lines
+    // of a group can be projected in one pass over the scatterers, which
+    // evaluates each spline once for the whole group.
+    static int mla_group_size(const ScanSequence& scan_seq);
+
+    // Throws std::runtime_error unless the arguments of
+    // simulate_lines_multi_excitation() are valid for the configuration.
+    void check_multi_excitation_args(const std::vector<ExcitationSignal>& excitations,
+                                     size_t line_stride, size_t frame_stride) const;
+
+    // Call the line callback, if any, for the lines [first_line, first_line
+    // + num_lines) of a frame, which are stored line_stride samples apart.
+    void report_lines(size_t first_line, size_t num_lines, const std::complex<float>* iq_lines, size_t line_stride) const {
+        if (m_line_callback) {
+            for (size_t i = 0; i < num_lines; i++) {
+                m_line_callback(first_line + i, iq_lines + i*line_stride);
+            }
+        }
+    }
+
+    // Disables the line callback while the other simulate functions simulate
+    // their internal frames with simulate_lines().
+    class ScopedLineCallbackSuspension {
+    public:
+        explicit ScopedLineCallbackSuspension(LineCallback& callback)
+            : m_callback(callback), m_suspended(std::move(callback))
+        {
+            m_callback = nullptr;
+        }
+        ~ScopedLineCallbackSuspension() { m_callback = std::move(m_suspended); }
+
+        ScopedLineCallbackSuspension(const ScopedLineCallbackSuspension&) = delete;
+        ScopedLineCallbackSuspension& operator=(const ScopedLineCallbackSuspension&) = delete;
+    private:
+        LineCallback&   m_callback;
+        LineCallback    m_suspended;
+    };
+
+    // Wait for the frames queued by BaseAlgorithm::simulate_lines_async(),
+    // which must be done first by the destructors of the implementations.
+    void wait_for_async_frames() {
+        m_async_frames.wait_idle();
+    }
+
+    static bool is_stats_parameter(const std::string& key) {
+        return key.compare(0, 6, "stats_") == 0;
+    }
+
+    static bool is_frame_cache_parameter(const std::string& key) {
+        return key.compare(0, 12, "frame_cache_") == 0;
+    }
+
+    // True if the configured noise amplitude is positive.
+    bool state_has_noise() const;
+
+    // The sorted fixed dataset with this index in the configuration, kept by
+    // the implementation, which save_state() stores. If null, save_state()
+    // sorts the dataset with the configured cell order and one subset.
+    virtual std::shared_ptr<HostFixedScatterers> kept_fixed_layout(size_t /*dset_idx*/) const {
+        return nullptr;
+    }
+
+    // While load_state() restores the configuration: the stored sorted fixed
+    // dataset with this index, if it was sorted with the configured cell
+    // order and num_subsets subsets and can be used instead of sorting the
+    // dataset again. Otherwise null.
+    std::shared_ptr<HostFixedScatterers> restored_fixed_layout(size_t dset_idx, size_t num_subsets) const;
+
+    // The frame cache key of the current configuration, where a noisy frame
+    // is also keyed by its frame number in the noise stream. Empty if the
+    // cache is disabled or the configuration cannot be hashed, e.g. for a
+    // beam profile whose state cannot be saved.
+    std::string frame_cache_key(uint64_t noise_frame_no) const;
+
+    // Copy the cached frame of a non-empty key to the lines, call the line
+    // callback for them and return true, or return false on a miss.
+    bool read_cached_frame(const std::string& key, std::complex<float>* iq_buffer, size_t line_stride);
+    bool read_cached_frame(const std::string& key, std::vector<std::vector<std::complex<float>>>& lines);
+
+    // Store a simulated frame under a non-empty key.
+    void write_cached_frame(const std::string& key, const std::complex<float>* iq_buffer, size_t line_stride);
+    void write_cached_frame(const std::string& key, const std::vector<std::vector<std::complex<float>>>& lines);
+
+    // Count a frame of num_lines lines which was started at the given time
+    // in the frame statistics. Only reads the clock and updates atomics.
+    void count_frame(size_t num_lines, std::chrono::steady_clock::time_point start);
+
     float       m_param_sound_speed;
     int         m_param_verbose;
     float       m_param_noise_amplitude;
@@ -65,6 +275,39 @@ protected:
     int         m_radial_decimation;
     bool        m_enable_phase_delay;
 
+    // If enabled, the scatterers are projected directly onto the decimated
+    // IQ grid with phase delay, so that the convolution runs at the
+    // decimated rate instead of the RF sampling frequency.
+    bool        m_param_baseband;
+
+    // If enabled, only scatterers close to a beam are projected onto it.
+    // The analytical beam profile is cut off at the given number of sigmas,
+    // the lookup-table profile is zero outside of its extent.
+    bool        m_param_scatterer_culling;
+    float       m_param_culling_num_sigmas;
+
+    // The analytical beam profile is zero outside of an ellipse of the given
+    // number of sigmas, so that the scatterers there are rejected without
+    // evaluating the exponential.
+    float       m_param_profile_cutoff_num_sigmas;
+
+    // The corresponding largest exponent l^2/2sigma_l^2 + e^2/2sigma_e^2.
+    float profile_max_exponent() const {
+        return std::min(0.5f*m_param_profile_cutoff_num_sigmas*m_param_profile_cutoff_num_sigmas, 80.0f);
+    }
+
+    // If enabled, scan sequences with a single geometry are simulated by the
+    // ensemble projection (see has_single_geometry()).
+    bool        m_param_ensemble_projection;
+
+    // If enabled, the groups of receive lines of a multi-line acquisition
+    // are projected together (see mla_group_size()).
+    bool        m_param_mla_projection;
+
+    // Order of fixed scatterers when they are added, which determines the
+    // memory locality of neighbouring scatterers.
+    ScattererGrid::CellOrder m_param_scatterer_order;
+
     // The beam profile (analytical expression or LUT)
     BeamProfileType m_cur_beam_profile_type; 
 
@@ -72,6 +315,64 @@ protected:
     std::map<std::string, std::vector<double>>  m_debug_data;
     
     ILog::ptr   m_log_object;   // class invariant: always valid (default dummy object)
+
+    // Frame stream: timestamp offsets, the next frame to retrieve, and the
+    // scan sequence that is restored after the last frame.
+    std::vector<float>      m_stream_timestamp_offsets;
+    size_t                  m_stream_next_frame;
+    ScanSequence::s_ptr     m_stream_scan_seq;
+
+    // Configuration as given through the setters, for save_state(). It must
+    // be updated by the implementations after a setter has succeeded.
+    AlgorithmState          m_state;
+
+    // The sorted fixed datasets of the state file while load_state() runs.
+    std::vector<std::shared_ptr<HostFixedScatterers>> m_restored_layouts;
+
+    // IQ lines of simulate_bmode_image(), kept between frames
+    std::vector<std::complex<float>> m_bmode_iq_lines;
+
+    // Scan sequence with the lines of all frames of a packet, frame by frame,
+    // and the base scan sequence, packet size and PRT it was made from.
+    ScanSequence::s_ptr     m_packet_scan_seq;
+    ScanSequence::s_ptr     m_packet_base_scan_seq;
+    size_t                  m_packet_size;
+    float                   m_packet_prt;
+    std::vector<std::complex<float>> m_packet_iq_lines;
+
+    // Scan sequence with the lines of all frames of simulate_frames(), and
+    // the base scan sequence and timestamp offsets it was made from. The IQ
+    // lines are only used if the frames are not contiguous in the output.
+    ScanSequence::s_ptr     m_frames_scan_seq;
+    ScanSequence::s_ptr     m_frames_base_scan_seq;
+    std::vector<float>      m_frames_timestamp_offsets;
+    std::vector<std::complex<float>> m_frames_iq_lines;
+
+    // IQ lines of simulate_lines_formatted() before the conversion.
+    std::vector<std::complex<float>> m_formatted_iq_lines;
+
+    // IQ lines of all realizations of simulate_realizations().
+    std::vector<std::complex<float>> m_realization_iq_lines;
+
+    // Called for each finished line of the frames of simulate_lines() (may be empty).
+    LineCallback            m_line_callback;
+
+    // Where to write the trace events, empty if not tracing.
+    std::string             m_param_trace_file;
+
+    // Frame statistics, which may be read while another thread simulates.
+    std::atomic<uint64_t>   m_stats_num_frames;
+    std::atomic<uint64_t>   m_stats_num_projections;
+    std::atomic<uint64_t>   m_stats_total_ns;
+    std::atomic<uint64_t>   m_stats_last_frame_ns;
+
+    // Frames of simulate_lines() by content key, and the line pointers of
+    // the frame read or written.
+    FrameCache                          m_frame_cache;
+    std::vector<std::complex<float>*>   m_frame_cache_lines;
+
+    // Frames of simulate_lines_async() on the thread pool.
+    SerialQueue             m_async_frames;
 };
 
 }   // end namespace
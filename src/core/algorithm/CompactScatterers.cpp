@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "CompactScatterers.hpp"
+#include "../lut_compression.hpp"     // for float_to_half() and half_to_float()
+
+namespace bcsim {
+namespace {
+
+const float MAX_CODE = 65535.0f;
+
+float inverse_scale(float scale) {
+    return (scale > 0.0f) ? 1.0f/scale : 0.0f;
+}
+
+uint16_t encode_coordinate(float value, float origin, float inv_scale) {
+    const float code = std::round((value - origin)*inv_scale);
+    // written so that NaN is encoded as zero
+    return static_cast<uint16_t>(std::min(MAX_CODE, std::max(0.0f, code)));
+}
+
+}   // end anonymous namespace
+
+CompactScattererEncoding make_compact_scatterer_encoding(const float* xs, const float* ys, const float* zs, const float* as,
+                                                         size_t num_scatterers) {
+    CompactScattererEncoding encoding;
+    const float* coordinates[3] = {xs, ys, zs};
+    for (int dim = 0; dim < 3; dim++) {
+        float min_value = std::numeric_limits<float>::max();
+        float max_value = std::numeric_limits<float>::lowest();
+        for (size_t i = 0; i < num_scatterers; i++) {
+            min_value = std::min(min_value, coordinates[dim][i]);
+            max_value = std::max(max_value, coordinates[dim][i]);
+        }
+        if (min_value > max_value) {
+            min_value = max_value = 0.0f;
+        }
+        encoding.origin[dim] = min_value;
+        encoding.scale[dim] = (max_value - min_value)/MAX_CODE;
+    }
+    float max_amplitude = 0.0f;
+    for (size_t i = 0; i < num_scatterers; i++) {
+        max_amplitude = std::max(max_amplitude, std::abs(as[i]));
+    }
+    encoding.amplitude_scale = (max_amplitude > 0.0f) ? max_amplitude : 1.0f;
+    return encoding;
+}
+
+bool compact_encoding_contains(const CompactScattererEncoding& encoding, float x, float y, float z) {
+    const float position[3] = {x, y, z};
+    for (int dim = 0; dim < 3; dim++) {
+        const float offset = position[dim] - encoding.origin[dim];
+        if (encoding.scale[dim] > 0.0f) {
+            const float code = offset/encoding.scale[dim];
+            if (!((code >= -0.5f) && (code <= MAX_CODE + 0.5f))) {
+                return false;
+            }
+        } else if (offset != 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void encode_compact_scatterers(const CompactScattererEncoding& encoding, const float* xs, const float* ys, const float* zs,
+                               const float* as, size_t num_scatterers, uint16_t* codes) {
+    const float inv_scale_x = inverse_scale(encoding.scale[0]);
+    const float inv_scale_y = inverse_scale(encoding.scale[1]);
+    const float inv_scale_z = inverse_scale(encoding.scale[2]);
+    const float inv_amplitude_scale = 1.0f/encoding.amplitude_scale;
+    for (size_t i = 0; i < num_scatterers; i++) {
+        codes[4*i]     = encode_coordinate(xs[i], encoding.origin[0], inv_scale_x);
+        codes[4*i + 1] = encode_coordinate(ys[i], encoding.origin[1], inv_scale_y);
+        codes[4*i + 2] = encode_coordinate(zs[i], encoding.origin[2], inv_scale_z);
+        codes[4*i + 3] = float_to_half(as[i]*inv_amplitude_scale);
+    }
+}
+
+void decode_compact_scatterers(const CompactScattererEncoding& encoding, const uint16_t* codes, size_t num_scatterers,
+                               float* xs, float* ys, float* zs, float* as) {
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = encoding.origin[0] + codes[4*i]*encoding.scale[0];
+        ys[i] = encoding.origin[1] + codes[4*i + 1]*encoding.scale[1];
+        zs[i] = encoding.origin[2] + codes[4*i + 2]*encoding.scale[2];
+        as[i] = half_to_float(codes[4*i + 3])*encoding.amplitude_scale;
+    }
+}
+
+CompactScattererError compute_compact_scatterer_error(const CompactScattererEncoding& encoding, const uint16_t* codes,
+                                                      const float* xs, const float* ys, const float* zs, const float* as,
+                                                      size_t num_scatterers) {
+    CompactScattererError error = {0.0f, 0.0f};
+    for (size_t i = 0; i < num_scatterers; i++) {
+        float x, y, z, a;
+        decode_compact_scatterers(encoding, codes + 4*i, 1, &x, &y, &z, &a);
+        const float distance = std::sqrt((x - xs[i])*(x - xs[i]) + (y - ys[i])*(y - ys[i]) + (z - zs[i])*(z - zs[i]));
+        error.max_position_error = std::max(error.max_position_error, distance);
+        error.max_amplitude_error = std::max(error.max_amplitude_error, std::abs(a - as[i])/encoding.amplitude_scale);
+    }
+    return error;
+}
+
+}   // end namespace
@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace bcsim {
+
+// Compact encoding of fixed scatterers in 8 bytes each: the position as
+// 16-bit fixed point in the bounding box of the dataset, and the amplitude
+// relative to the largest amplitude magnitude in half precision. Code q of
+// a coordinate is the position origin + q*scale.
+struct CompactScattererEncoding {
+    float origin[3];
+    float scale[3];
+    float amplitude_scale;
+};
+
+// The encoding of the bounding box of the scatterers, with the largest
+// amplitude magnitude as amplitude scale (one if all amplitudes are zero).
+CompactScattererEncoding make_compact_scatterer_encoding(const float* xs, const float* ys, const float* zs, const float* as,
+                                                         size_t num_scatterers);
+
+// Whether a position can be encoded with an error of at most half a code step,
+// i.e. is inside of the bounding box of the encoding.
+bool compact_encoding_contains(const CompactScattererEncoding& encoding, float x, float y, float z);
+
+// Encode the scatterers as four codes each: x, y, z, and amplitude. Positions
+// outside of the bounding box are clamped to it.
+void encode_compact_scatterers(const CompactScattererEncoding& encoding, const float* xs, const float* ys, const float* zs,
+                               const float* as, size_t num_scatterers, uint16_t* codes);
+
+void decode_compact_scatterers(const CompactScattererEncoding& encoding, const uint16_t* codes, size_t num_scatterers,
+                               float* xs, float* ys, float* zs, float* as);
+
+// Largest errors of encoded scatterers.
+struct CompactScattererError {
+    float max_position_error;       // distance in meters
+    float max_amplitude_error;      // absolute error over the largest amplitude magnitude
+};
+
+CompactScattererError compute_compact_scatterer_error(const CompactScattererEncoding& encoding, const uint16_t* codes,
+                                                      const float* xs, const float* ys, const float* zs, const float* as,
+                                                      size_t num_scatterers);
+
+}   // end namespace
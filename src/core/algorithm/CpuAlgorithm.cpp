@@ -28,12 +28,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <iostream>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
 #include <tuple>
+#include <iterator>
+#include <limits>
 #ifdef BCSIM_ENABLE_OPENMP
     #include <omp.h>
 #endif
@@ -42,50 +45,272 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../to_string.hpp"
 #include "../LibBCSim.hpp"
 #include "../BeamConvolver.hpp"
+#include "../Tracing.hpp"
 #include "common_utils.hpp" // for compute_num_rf_samples
+#include "cpu_projection_kernels.hpp"
 #include "../bspline.hpp"
+#include "../philox.hpp"
+#include "../iq_format.hpp"
 
 namespace bcsim {
+namespace {
 
-void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples) {
+// Sum of the rows [xs_rows[j], xs_rows[j] + length) weighted by weights[j]
+// for j < num_cs into xs, and the same for ys and zs. With a constant
+// number of rows the loop over them is unrolled, with the weights and row
+// pointers in registers.
+template <int num_cs>
+void sum_weighted_rows(const float* const* xs_rows, const float* const* ys_rows, const float* const* zs_rows,
+                       const float* weights, int length, float* xs, float* ys, float* zs) {
+    float w[num_cs];
+    const float* x_rows[num_cs];
+    const float* y_rows[num_cs];
+    const float* z_rows[num_cs];
+    for (int j = 0; j < num_cs; j++) {
+        w[j] = weights[j];
+        x_rows[j] = xs_rows[j];
+        y_rows[j] = ys_rows[j];
+        z_rows[j] = zs_rows[j];
+    }
+    for (int i = 0; i < length; i++) {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+        for (int j = 0; j < num_cs; j++) {
+            x += x_rows[j][i]*w[j];
+            y += y_rows[j][i]*w[j];
+            z += z_rows[j][i]*w[j];
+        }
+        xs[i] = x;
+        ys[i] = y;
+        zs[i] = z;
+    }
+}
 
-    const int num_scatterers = fixed_scatterers->scatterers.size();
-    for (int scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
-        const PointScatterer& scatterer = fixed_scatterers->scatterers[scatterer_no];
-        
-        // Map the global cartesian scatterer position into the beam's local
+// As above for any number of rows, specialized for the spline degrees 1 to 4,
+// i.e. 2 to 5 control points. The terms are summed in the same order.
+void sum_weighted_rows(int num_cs, const float* const* xs_rows, const float* const* ys_rows, const float* const* zs_rows,
+                       const float* weights, int length, float* xs, float* ys, float* zs) {
+    switch (num_cs) {
+    case 2:
+        sum_weighted_rows<2>(xs_rows, ys_rows, zs_rows, weights, length, xs, ys, zs);
+        return;
+    case 3:
+        sum_weighted_rows<3>(xs_rows, ys_rows, zs_rows, weights, length, xs, ys, zs);
+        return;
+    case 4:
+        sum_weighted_rows<4>(xs_rows, ys_rows, zs_rows, weights, length, xs, ys, zs);
+        return;
+    case 5:
+        sum_weighted_rows<5>(xs_rows, ys_rows, zs_rows, weights, length, xs, ys, zs);
+        return;
+    default:
+        break;
+    }
+    std::fill(xs, xs + length, 0.0f);
+    std::fill(ys, ys + length, 0.0f);
+    std::fill(zs, zs + length, 0.0f);
+    for (int j = 0; j < num_cs; j++) {
+        const float weight = weights[j];
+        for (int i = 0; i < length; i++) {
+            xs[i] += xs_rows[j][i]*weight;
+            ys[i] += ys_rows[j][i]*weight;
+            zs[i] += zs_rows[j][i]*weight;
+        }
+    }
+}
+
+// Evaluate the positions of the spline scatterers [block_start, block_start+block_length)
+// from precomputed basis functions, summing over control points lower_lim..upper_lim.
+// The control points are stored control point major, so each term reads a
+// contiguous range.
+void evaluate_spline_positions(const SplineScatterers& spline_scatterers, const std::vector<float>& basis_functions,
+                               int lower_lim, int upper_lim, int block_start, int block_length,
+                               float* xs, float* ys, float* zs) {
+    const int num_cs = upper_lim - lower_lim + 1;
+    if (num_cs <= 0) {
+        std::fill(xs, xs + block_length, 0.0f);
+        std::fill(ys, ys + block_length, 0.0f);
+        std::fill(zs, zs + block_length, 0.0f);
+        return;
+    }
+    // the row pointers of the specialized degrees are kept off the heap
+    const float* small_rows[3*5];
+    std::vector<const float*> large_rows;
+    const float** rows = small_rows;
+    if (num_cs > 5) {
+        large_rows.resize(3*num_cs);
+        rows = large_rows.data();
+    }
+    for (int j = 0; j < num_cs; j++) {
+        const size_t offset = spline_scatterers.control_point_index(block_start, lower_lim + j);
+        rows[j]            = spline_scatterers.control_xs.data() + offset;
+        rows[num_cs + j]   = spline_scatterers.control_ys.data() + offset;
+        rows[2*num_cs + j] = spline_scatterers.control_zs.data() + offset;
+    }
+    sum_weighted_rows(num_cs, rows, rows + num_cs, rows + 2*num_cs,
+                      basis_functions.data() + lower_lim, block_length, xs, ys, zs);
+}
+
+// Beam profile weights of a block of scatterers in beam coordinates.
+void sample_profile_block(const GaussianBeamProfile& profile, float max_exponent,
+                          const float* rs, const float* ls, const float* es, int num_scatterers, float* weights) {
+    const float sigma_lateral = profile.getSigmaLateral();
+    const float sigma_elevational = profile.getSigmaElevational();
+    compute_gaussian_weights(ls, es, num_scatterers, 0.5f/(sigma_lateral*sigma_lateral),
+                             0.5f/(sigma_elevational*sigma_elevational), max_exponent, weights);
+}
+
+void sample_profile_block(const LUTBeamProfile& profile, float /*max_exponent*/,
+                          const float* rs, const float* ls, const float* es, int num_scatterers, float* weights) {
+    compute_lut_weights(profile.getPaddedLayout(), rs, ls, es, num_scatterers, weights);
+}
+
+// The scatterers of each zone are compacted and sampled together.
+void sample_profile_block(const MultiResolutionLUTBeamProfile& profile, float max_exponent,
+                          const float* rs, const float* ls, const float* es, int num_scatterers, float* weights) {
+    const int num_zones = profile.getNumZones();
+    if (num_zones == 1) {
+        sample_profile_block(profile.getZone(0), max_exponent, rs, ls, es, num_scatterers, weights);
+        return;
+    }
+    const int CHUNK_SIZE = 256;
+    int zones[CHUNK_SIZE];
+    int indices[CHUNK_SIZE];
+    float zone_rs[CHUNK_SIZE];
+    float zone_ls[CHUNK_SIZE];
+    float zone_es[CHUNK_SIZE];
+    float zone_ws[CHUNK_SIZE];
+    for (int chunk_start = 0; chunk_start < num_scatterers; chunk_start += CHUNK_SIZE) {
+        const int chunk_length = std::min(CHUNK_SIZE, num_scatterers - chunk_start);
+        for (int i = 0; i < chunk_length; i++) {
+            zones[i] = profile.getZoneIndex(rs[chunk_start + i]);
+        }
+        for (int zone_no = 0; zone_no < num_zones; zone_no++) {
+            int num_in_zone = 0;
+            for (int i = 0; i < chunk_length; i++) {
+                if (zones[i] == zone_no) {
+                    indices[num_in_zone] = chunk_start + i;
+                    zone_rs[num_in_zone] = rs[chunk_start + i];
+                    zone_ls[num_in_zone] = ls[chunk_start + i];
+                    zone_es[num_in_zone] = es[chunk_start + i];
+                    num_in_zone++;
+                }
+            }
+            if (num_in_zone == 0) {
+                continue;
+            }
+            sample_profile_block(profile.getZone(zone_no), max_exponent, zone_rs, zone_ls, zone_es, num_in_zone, zone_ws);
+            for (int i = 0; i < num_in_zone; i++) {
+                weights[indices[i]] = zone_ws[i];
+            }
+        }
+    }
+}
+
+}   // end anonymous namespace
+
+template <bool use_phase_delay>
+void CpuAlgorithm::add_fractional_delay(std::complex<float>* time_proj_signal, int num_time_samples,
+                                        float true_index, float amplitude) const {
+    const auto base_index = static_cast<int>(std::floor(true_index));
+    const auto first_index = base_index + m_fractional_delay->get_first_offset();
+    const auto num_taps = m_fractional_delay->get_num_taps();
+    if ((first_index + num_taps <= 0) || (first_index >= num_time_samples)) {
+        return;
+    }
+    const auto taps = m_fractional_delay->get_taps(true_index - base_index);
+    const auto begin = std::max(0, -first_index);
+    const auto end = std::min(num_taps, num_time_samples - first_index);
+    if (use_phase_delay) {
+        // The phase delay of consecutive samples differs by a constant step.
+        // Real arithmetic, since complex products check for infinities.
+        const float phase_step = 6.283185307179586*m_excitation.demod_freq/m_time_proj_sampling_frequency;
+        const float first_phase = phase_step*(first_index + begin - true_index);
+        float re = amplitude*std::cos(first_phase);
+        float im = amplitude*std::sin(first_phase);
+        const float step_re = std::cos(phase_step);
+        const float step_im = std::sin(phase_step);
+        for (int k = begin; k < end; k++) {
+            time_proj_signal[first_index + k] += std::complex<float>(taps[k]*re, taps[k]*im);
+            const float next_re = re*step_re - im*step_im;
+            im = re*step_im + im*step_re;
+            re = next_re;
+        }
+    } else {
+        for (int k = begin; k < end; k++) {
+            time_proj_signal[first_index + k] += std::complex<float>(taps[k]*amplitude, 0.0f);
+        }
+    }
+}
+
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::fixed_projection_loop(const HostFixedScatterers& fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                         size_t scatterer_begin, size_t scatterer_end) {
+    // Safe since the loop is selected based on the configured profile type.
+    const Profile& beam_profile = static_cast<const Profile&>(*m_beam_profile);
+    const float max_exponent = profile_max_exponent();
+
+    // Scatterers are processed in blocks: first the beam coordinates of all
+    // scatterers in a block are computed with the SIMD kernel, then the
+    // beam profile is sampled and the amplitudes are accumulated.
+    const int BLOCK_SIZE = 256;
+    float rs[BLOCK_SIZE];
+    float ls[BLOCK_SIZE];
+    float es[BLOCK_SIZE];
+    float ws[BLOCK_SIZE];
+
+    const float* xs = fixed_scatterers.x_data();
+    const float* ys = fixed_scatterers.y_data();
+    const float* zs = fixed_scatterers.z_data();
+    const float* as = fixed_scatterers.a_data();
+    const int range_end = static_cast<int>(scatterer_end);
+    for (int block_start = static_cast<int>(scatterer_begin); block_start < range_end; block_start += BLOCK_SIZE) {
+        const int block_length = std::min(BLOCK_SIZE, range_end - block_start);
+
+        // Map the global cartesian scatterer positions into the beam's local
         // coordinate system.
-        vector3 temp = scatterer.pos - line.get_origin();
-        float r = temp.dot(line.get_direction());       // radial component
-        float l = temp.dot(line.get_lateral_dir());     // lateral component
-        float e = temp.dot(line.get_elevational_dir()); // elevational component
-        
-        // Use "arc projection" in the radial direction: use length of vector from
-        // beam's origin to the scatterer with the same sign as the projection onto
-        // the line.
-        if (m_param_use_arc_projection) {
-#ifdef __GNUC__
-            r = std::copysign(temp.norm(), r);
-#else
-            r = _copysignf(temp.norm(), r);
-#endif            
+        compute_beam_coordinates(line, use_arc_projection,
+                                 xs + block_start, ys + block_start, zs + block_start, block_length,
+                                 rs, ls, es);
+        sample_profile_block(beam_profile, max_exponent, rs, ls, es, block_length, ws);
+        accumulate_fixed_block<use_phase_delay, use_fractional_delay>(rs, ws, as + block_start, block_length,
+                                                                      time_proj_signal, num_time_samples);
+    }
+}
+
+template <bool use_phase_delay, bool use_fractional_delay>
+void CpuAlgorithm::accumulate_fixed_block(const float* rs, const float* ws, const float* as, int block_length,
+                                          std::complex<float>* time_proj_signal, size_t num_time_samples) const {
+    for (int i = 0; i < block_length; i++) {
+        // most scatterers of wide phantoms are outside of the beam
+        const float weight = ws[i];
+        if (weight == 0.0f) {
+            continue;
         }
-        
+        const float r = rs[i];
+
+        if (use_fractional_delay) {
+            const float true_index = r*2.0*m_time_proj_sampling_frequency/(m_param_sound_speed) - m_time_proj_first_sample;
+            add_fractional_delay<use_phase_delay>(time_proj_signal, static_cast<int>(num_time_samples), true_index,
+                                                  weight*as[i]);
+            continue;
+        }
+
         // Add scaled amplitude to closest index
-        int closest_index = (int) std::floor(r*2.0*m_excitation.sampling_frequency/(m_param_sound_speed)+0.5f);
+        int closest_index = (int) std::floor(r*2.0*m_time_proj_sampling_frequency/(m_param_sound_speed)+0.5f) - m_time_proj_first_sample;
 
-        float scaled_ampl = m_beam_profile->sampleProfile(r,l,e)*scatterer.amplitude;
-        
         // Avoid out of bound seg.fault
         if (closest_index < 0 || closest_index >= num_time_samples) {
             continue;
         }
 
+        float scaled_ampl = weight*as[i];
 
-        if (m_enable_phase_delay) {
+        if (use_phase_delay) {
             // handle sub-sample displacement with a complex phase
-            const auto true_index = r*2.0*m_excitation.sampling_frequency/(m_param_sound_speed);
-            const float ss_delay = (closest_index - true_index)/m_excitation.sampling_frequency;
+            const auto true_index = r*2.0*m_time_proj_sampling_frequency/(m_param_sound_speed) - m_time_proj_first_sample;
+            const float ss_delay = (closest_index - true_index)/m_time_proj_sampling_frequency;
             const float complex_phase = 6.283185307179586*m_excitation.demod_freq*ss_delay;
 
             // phase-delay
@@ -96,82 +321,225 @@ void CpuAlgorithm::projection_loop(FixedScatterers::s_ptr fixed_scatterers, cons
     }
 }
 
-void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples) {
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::spline_projection_loop(const SplineScatterers& spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                          size_t scatterer_begin, size_t scatterer_end) {
+    const Profile& beam_profile = static_cast<const Profile&>(*m_beam_profile);
+    const float max_exponent = profile_max_exponent();
 
-    const int num_scatterers = spline_scatterers->num_scatterers();
-    
-    // The number of control points most be at least one more than the degree
-    const int num_control_points = spline_scatterers->get_num_control_points();
-    if (num_control_points <= spline_scatterers->spline_degree) {
-        throw std::runtime_error("too few spline control points for given degree");
+    std::vector<float> basis_functions;
+    int lower_lim, upper_lim;
+    compute_spline_basis(spline_scatterers, line.get_timestamp(), basis_functions, lower_lim, upper_lim);
+
+    const int BLOCK_SIZE = 256;
+    float xs[BLOCK_SIZE];
+    float ys[BLOCK_SIZE];
+    float zs[BLOCK_SIZE];
+    float rs[BLOCK_SIZE];
+    float ls[BLOCK_SIZE];
+    float es[BLOCK_SIZE];
+    float ws[BLOCK_SIZE];
+
+    const float* as = spline_scatterers.amplitudes.data();
+    const int range_end = static_cast<int>(scatterer_end);
+    for (int block_start = static_cast<int>(scatterer_begin); block_start < range_end; block_start += BLOCK_SIZE) {
+        const int block_length = std::min(BLOCK_SIZE, range_end - block_start);
+
+        // Compute positions of the current scatterers by evaluating the splines
+        // in the current timestep.
+        evaluate_spline_positions(spline_scatterers, basis_functions, lower_lim, upper_lim,
+                                  block_start, block_length, xs, ys, zs);
+
+        // Map the global cartesian scatterer positions into the beam's local
+        // coordinate system.
+        compute_beam_coordinates(line, use_arc_projection, xs, ys, zs, block_length, rs, ls, es);
+        sample_profile_block(beam_profile, max_exponent, rs, ls, es, block_length, ws);
+        accumulate_spline_block<use_phase_delay, use_fractional_delay>(rs, ws, as + block_start, block_length,
+                                                                       time_proj_signal, num_time_samples);
     }
-    
-    std::vector<float> basis_functions(num_control_points);
-    
-    int mu = bspline_storve::compute_knot_interval(spline_scatterers->knot_vector, line.get_timestamp());
+}
 
-    int lower_lim = 0;
-    int upper_lim = num_control_points-1;
-    if (m_param_sum_all_cs) {
-        m_log_object->write(ILog::DEBUG, "In debug mode: summing over i = " + std::to_string(lower_lim) + "..." + std::to_string(upper_lim));
-    } else {
-        std::tie(lower_lim, upper_lim) = bspline_storve::get_lower_upper_inds(spline_scatterers->knot_vector,
-                                                                              line.get_timestamp(),
-                                                                              spline_scatterers->spline_degree);
-        if (!sanity_check_spline_lower_upper_bound(basis_functions, lower_lim, upper_lim)) {
-            throw std::runtime_error("b-spline basis bounds failed sanity check");
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::spline_ensemble_projection_loop(const SplineScatterers& spline_scatterers, int first_line_no, int num_lines,
+                                                   std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                                   size_t scatterer_begin, size_t scatterer_end) {
+    const Profile& beam_profile = static_cast<const Profile&>(*m_beam_profile);
+    const float max_exponent = profile_max_exponent();
+    const auto geometry = m_scan_sequence->get_scanline(first_line_no);
+
+    // the basis functions of all timestamps, and the control points any of
+    // them sums over.
+    std::vector<std::vector<float>> basis_functions(num_lines);
+    std::vector<int> lower_lims(num_lines);
+    std::vector<int> upper_lims(num_lines);
+    int cs_begin = std::numeric_limits<int>::max();
+    int cs_end = 0;
+    for (int k = 0; k < num_lines; k++) {
+        const auto timestamp = m_scan_sequence->get_scanline(first_line_no + k).get_timestamp();
+        compute_spline_basis(spline_scatterers, timestamp, basis_functions[k], lower_lims[k], upper_lims[k]);
+        cs_begin = std::min(cs_begin, lower_lims[k]);
+        cs_end = std::max(cs_end, upper_lims[k] + 1);
+    }
+    if (cs_begin >= cs_end) {
+        return;
+    }
+
+    // the beam coordinates of the control points of a block, control point major
+    const int BLOCK_SIZE = 256;
+    const auto num_block_cs = static_cast<size_t>(cs_end - cs_begin);
+    std::vector<float> control_rs(num_block_cs*BLOCK_SIZE);
+    std::vector<float> control_ls(num_block_cs*BLOCK_SIZE);
+    std::vector<float> control_es(num_block_cs*BLOCK_SIZE);
+    std::vector<const float*> control_rows(3*num_block_cs);
+    float rs[BLOCK_SIZE];
+    float ls[BLOCK_SIZE];
+    float es[BLOCK_SIZE];
+    float ws[BLOCK_SIZE];
+
+    const float* control_xs = spline_scatterers.control_xs.data();
+    const float* control_ys = spline_scatterers.control_ys.data();
+    const float* control_zs = spline_scatterers.control_zs.data();
+    const float* as = spline_scatterers.amplitudes.data();
+    const int range_end = static_cast<int>(scatterer_end);
+    for (int block_start = static_cast<int>(scatterer_begin); block_start < range_end; block_start += BLOCK_SIZE) {
+        const int block_length = std::min(BLOCK_SIZE, range_end - block_start);
+        for (int cs_no = cs_begin; cs_no < cs_end; cs_no++) {
+            const size_t offset = spline_scatterers.control_point_index(block_start, cs_no);
+            const size_t local_offset = (cs_no - cs_begin)*BLOCK_SIZE;
+            compute_beam_coordinates(geometry, false, control_xs + offset, control_ys + offset, control_zs + offset,
+                                     block_length, &control_rs[local_offset], &control_ls[local_offset], &control_es[local_offset]);
+        }
+
+        for (int k = 0; k < num_lines; k++) {
+            const int num_cs = upper_lims[k] - lower_lims[k] + 1;
+            const size_t local_offset = (lower_lims[k] - cs_begin)*BLOCK_SIZE;
+            for (int j = 0; j < num_cs; j++) {
+                control_rows[j]            = &control_rs[local_offset + j*BLOCK_SIZE];
+                control_rows[num_cs + j]   = &control_ls[local_offset + j*BLOCK_SIZE];
+                control_rows[2*num_cs + j] = &control_es[local_offset + j*BLOCK_SIZE];
+            }
+            sum_weighted_rows(num_cs, control_rows.data(), control_rows.data() + num_cs, control_rows.data() + 2*num_cs,
+                              basis_functions[k].data() + lower_lims[k], block_length, rs, ls, es);
+            if (use_arc_projection) {
+                // the beam coordinates are orthonormal, so the distance to the origin is kept
+                for (int i = 0; i < block_length; i++) {
+                    rs[i] = std::copysign(std::sqrt(rs[i]*rs[i] + ls[i]*ls[i] + es[i]*es[i]), rs[i]);
+                }
+            }
+            sample_profile_block(beam_profile, max_exponent, rs, ls, es, block_length, ws);
+            accumulate_spline_block<use_phase_delay, use_fractional_delay>(rs, ws, as + block_start, block_length,
+                                                                           time_proj_signals[k], num_time_samples);
         }
     }
+}
 
-    // Precompute all B-spline basis function for current timestep
-    for (int i = 0; i < num_control_points; i++) {
-        const float b = bspline_storve::bsplineBasis(i,
-                                                        spline_scatterers->spline_degree,
-                                                        line.get_timestamp(),
-                                                        spline_scatterers->knot_vector);
-        basis_functions[i] = b;
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::fixed_mla_projection_loop(const HostFixedScatterers& fixed_scatterers, int first_line_no, int num_lines,
+                                             std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                             size_t scatterer_begin, size_t scatterer_end) {
+    const Profile& beam_profile = static_cast<const Profile&>(*m_beam_profile);
+    const float max_exponent = profile_max_exponent();
+    std::vector<Scanline> lines;
+    for (int k = 0; k < num_lines; k++) {
+        lines.push_back(m_scan_sequence->get_scanline(first_line_no + k));
     }
-    for (int scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
 
-        // Compute position of current scatterer by evaluating spline in current timestep        
-        vector3 scatterer_pos(0.0f, 0.0f, 0.0f);
-        for (int i = lower_lim; i <= upper_lim; i++) {
-            scatterer_pos += spline_scatterers->control_points[scatterer_no][i]*basis_functions[i];
+    const int BLOCK_SIZE = 256;
+    float rs[BLOCK_SIZE];
+    float ls[BLOCK_SIZE];
+    float es[BLOCK_SIZE];
+    float ws[BLOCK_SIZE];
+
+    const float* xs = fixed_scatterers.x_data();
+    const float* ys = fixed_scatterers.y_data();
+    const float* zs = fixed_scatterers.z_data();
+    const float* as = fixed_scatterers.a_data();
+    const int range_end = static_cast<int>(scatterer_end);
+    for (int block_start = static_cast<int>(scatterer_begin); block_start < range_end; block_start += BLOCK_SIZE) {
+        const int block_length = std::min(BLOCK_SIZE, range_end - block_start);
+        for (int k = 0; k < num_lines; k++) {
+            compute_beam_coordinates(lines[k], use_arc_projection,
+                                     xs + block_start, ys + block_start, zs + block_start, block_length,
+                                     rs, ls, es);
+            sample_profile_block(beam_profile, max_exponent, rs, ls, es, block_length, ws);
+            accumulate_fixed_block<use_phase_delay, use_fractional_delay>(rs, ws, as + block_start, block_length,
+                                                                          time_proj_signals[k], num_time_samples);
         }
-        
-        // Map the global cartesian scatterer position into the beam's local
-        // coordinate system.
-        vector3 temp = scatterer_pos - line.get_origin();
-        float r = temp.dot(line.get_direction());       // radial component
-        float l = temp.dot(line.get_lateral_dir());     // lateral component
-        float e = temp.dot(line.get_elevational_dir()); // elevational component
-        
-        // Use "arc projection" in the radial direction: use length of vector from
-        // beam's origin to the scatterer with the same sign as the projection onto
-        // the line.
-        if (m_param_use_arc_projection) {
-#ifdef __GNUC__
-            r = std::copysign(temp.norm(), r);
-#else
-            r = _copysignf(temp.norm(), r);
-#endif            
+    }
+}
+
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::spline_mla_projection_loop(const SplineScatterers& spline_scatterers, int first_line_no, int num_lines,
+                                              std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                              size_t scatterer_begin, size_t scatterer_end) {
+    const Profile& beam_profile = static_cast<const Profile&>(*m_beam_profile);
+    const float max_exponent = profile_max_exponent();
+    std::vector<Scanline> lines;
+    for (int k = 0; k < num_lines; k++) {
+        lines.push_back(m_scan_sequence->get_scanline(first_line_no + k));
+    }
+
+    // the lines of a transmit share the timestamp
+    std::vector<float> basis_functions;
+    int lower_lim, upper_lim;
+    compute_spline_basis(spline_scatterers, lines[0].get_timestamp(), basis_functions, lower_lim, upper_lim);
+
+    const int BLOCK_SIZE = 256;
+    float xs[BLOCK_SIZE];
+    float ys[BLOCK_SIZE];
+    float zs[BLOCK_SIZE];
+    float rs[BLOCK_SIZE];
+    float ls[BLOCK_SIZE];
+    float es[BLOCK_SIZE];
+    float ws[BLOCK_SIZE];
+
+    const float* as = spline_scatterers.amplitudes.data();
+    const int range_end = static_cast<int>(scatterer_end);
+    for (int block_start = static_cast<int>(scatterer_begin); block_start < range_end; block_start += BLOCK_SIZE) {
+        const int block_length = std::min(BLOCK_SIZE, range_end - block_start);
+        evaluate_spline_positions(spline_scatterers, basis_functions, lower_lim, upper_lim,
+                                  block_start, block_length, xs, ys, zs);
+        for (int k = 0; k < num_lines; k++) {
+            compute_beam_coordinates(lines[k], use_arc_projection, xs, ys, zs, block_length, rs, ls, es);
+            sample_profile_block(beam_profile, max_exponent, rs, ls, es, block_length, ws);
+            accumulate_spline_block<use_phase_delay, use_fractional_delay>(rs, ws, as + block_start, block_length,
+                                                                           time_proj_signals[k], num_time_samples);
+        }
+    }
+}
+
+template <bool use_phase_delay, bool use_fractional_delay>
+void CpuAlgorithm::accumulate_spline_block(const float* rs, const float* ws, const float* as, int block_length,
+                                           std::complex<float>* time_proj_signal, size_t num_time_samples) const {
+    for (int i = 0; i < block_length; i++) {
+        const float weight = ws[i];
+        if (weight == 0.0f) {
+            continue;
+        }
+        const float r = rs[i];
+
+        if (use_fractional_delay) {
+            const float true_index = r*2.0*m_time_proj_sampling_frequency/(m_param_sound_speed) - m_time_proj_first_sample;
+            add_fractional_delay<use_phase_delay>(time_proj_signal, static_cast<int>(num_time_samples), true_index,
+                                                  weight*as[i]);
+            continue;
         }
 
         // Add scaled amplitude to closest index
-        const float sampling_time_step = 1.0/m_excitation.sampling_frequency;
-        int closest_index = (int) std::floor(r*2.0/(m_param_sound_speed*sampling_time_step)+0.5f);
-        
-        float scaled_ampl = m_beam_profile->sampleProfile(r,l,e)*spline_scatterers->amplitudes[scatterer_no];
-        
+        const float sampling_time_step = 1.0/m_time_proj_sampling_frequency;
+        int closest_index = (int) std::floor(r*2.0/(m_param_sound_speed*sampling_time_step)+0.5f) - m_time_proj_first_sample;
+
         // Avoid out of bound seg.fault
         if (closest_index < 0 || closest_index >= num_time_samples) {
             continue;
         }
 
-        if (m_enable_phase_delay) {
+        float scaled_ampl = weight*as[i];
+
+        if (use_phase_delay) {
             // handle sub-sample displacement with a complex phase
-            const auto true_index = r*2.0/(m_param_sound_speed*sampling_time_step);
-            const float ss_delay = (closest_index - true_index)/m_excitation.sampling_frequency;
+            const auto true_index = r*2.0/(m_param_sound_speed*sampling_time_step) - m_time_proj_first_sample;
+            const float ss_delay = (closest_index - true_index)/m_time_proj_sampling_frequency;
             const float complex_phase = 6.283185307179586*m_excitation.demod_freq*ss_delay;
 
             // phase-delay
@@ -183,11 +551,250 @@ void CpuAlgorithm::projection_loop(SplineScatterers::s_ptr spline_scatterers, co
 }
 
 
+void CpuAlgorithm::update_culling_region() {
+    const float sample_dist = m_param_sound_speed/(2.0f*m_time_proj_sampling_frequency);
+    // the regions cover the samples up to the end of the time-projection
+    const auto num_samples = m_time_proj_first_sample + m_time_proj_num_samples;
+    switch (m_cur_beam_profile_type) {
+    case BeamProfileType::ANALYTICAL:
+        {
+            const auto& profile = static_cast<const GaussianBeamProfile&>(*m_beam_profile);
+            m_culling_region = gaussian_culling_region(profile.getSigmaLateral(), profile.getSigmaElevational(),
+                                                       m_param_culling_num_sigmas, sample_dist, num_samples);
+        }
+        break;
+    case BeamProfileType::LOOKUP:
+        {
+            const auto& profile = static_cast<const LUTBeamProfile&>(*m_beam_profile);
+            m_culling_region = lut_culling_region(profile.getRangeRange(), profile.getLateralRange(), profile.getElevationalRange(),
+                                                  profile.getNumSamplesRadial(), profile.getNumSamplesLateral(), profile.getNumSamplesElevational(),
+                                                  m_param_use_arc_projection, sample_dist, num_samples);
+        }
+        break;
+    case BeamProfileType::MULTI_RESOLUTION_LOOKUP:
+        m_culling_region = multi_resolution_lut_culling_region(static_cast<const MultiResolutionLUTBeamProfile&>(*m_beam_profile),
+                                                               m_param_use_arc_projection, sample_dist, num_samples);
+        break;
+    default:
+        throw std::logic_error("unknown beam profile type");
+    }
+    // and from the first sample of a depth window
+    m_culling_region.r_min = std::max(m_culling_region.r_min, (m_time_proj_first_sample - 1)*sample_dist);
+}
+
+void CpuAlgorithm::compute_spline_basis(const SplineScatterers& spline_scatterers, float timestamp,
+                                        std::vector<float>& basis_functions, int& lower_lim, int& upper_lim) {
+    // The number of control points most be at least one more than the degree
+    const int num_control_points = spline_scatterers.get_num_control_points();
+    if (num_control_points <= spline_scatterers.spline_degree) {
+        throw std::runtime_error("too few spline control points for given degree");
+    }
+    
+    // B-spline basis functions for current timestep. Only the ones in the
+    // current knot span are evaluated, the rest are zero.
+    basis_functions = bspline_storve::all_basis_functions(num_control_points,
+                                                          spline_scatterers.spline_degree,
+                                                          timestamp,
+                                                          spline_scatterers.knot_vector);
+
+    lower_lim = 0;
+    upper_lim = num_control_points-1;
+    if (m_param_sum_all_cs) {
+        m_log_object->write(ILog::DEBUG, "In debug mode: summing over i = " + std::to_string(lower_lim) + "..." + std::to_string(upper_lim));
+    } else {
+        std::tie(lower_lim, upper_lim) = bspline_storve::get_lower_upper_inds(spline_scatterers.knot_vector,
+                                                                              timestamp,
+                                                                              spline_scatterers.spline_degree);
+    }
+}
+
+void CpuAlgorithm::render_spline_cache() {
+    m_spline_cache_index.clear();
+    m_spline_cache_line_slots.clear();
+    const auto num_spline_collections = m_scatterers_collection.spline_collections.size();
+    if (!m_param_spline_cache || (num_spline_collections == 0)) {
+        return;
+    }
+
+    // Only timestamps shared by at least two lines of a frame benefit from
+    // rendering, and only those lines use the rendered positions, so that
+    // the frames of simulate_frames() are those of one frame at a time.
+    const auto num_lines = m_scan_sequence->get_num_lines();
+    const auto lines_per_frame = (m_scan_sequence->lines_per_frame > 0) ? m_scan_sequence->lines_per_frame : num_lines;
+    m_spline_cache_line_slots.assign(num_lines, -1);
+    std::map<float, int> num_lines_per_timestamp;
+    for (int frame_start = 0; frame_start < num_lines; frame_start += lines_per_frame) {
+        const auto frame_end = std::min(num_lines, frame_start + lines_per_frame);
+        num_lines_per_timestamp.clear();
+        for (int line_no = frame_start; line_no < frame_end; line_no++) {
+            num_lines_per_timestamp[m_scan_sequence->get_scanline(line_no).get_timestamp()]++;
+        }
+        for (int line_no = frame_start; line_no < frame_end; line_no++) {
+            const auto timestamp = m_scan_sequence->get_scanline(line_no).get_timestamp();
+            if (num_lines_per_timestamp[timestamp] < 2) {
+                continue;
+            }
+            const auto it = m_spline_cache_index.find(timestamp);
+            if (it != m_spline_cache_index.end()) {
+                m_spline_cache_line_slots[line_no] = static_cast<int>(it->second);
+                continue;
+            }
+            const auto slot = m_spline_cache_index.size();
+            m_spline_cache_index[timestamp] = slot;
+            m_spline_cache_line_slots[line_no] = static_cast<int>(slot);
+            render_splines(slot, timestamp);
+        }
+    }
+
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Number of timestamps with pre-rendered splines: " + std::to_string(m_spline_cache_index.size()));
+    }
+}
+
+void CpuAlgorithm::render_splines(size_t slot, float timestamp) {
+    const auto num_spline_collections = m_scatterers_collection.spline_collections.size();
+    if (slot == m_rendered_splines.size()) {
+        m_rendered_splines.emplace_back();
+    }
+    auto& rendered_datasets = m_rendered_splines[slot];
+    rendered_datasets.resize(num_spline_collections);
+
+    for (size_t dset_idx = 0; dset_idx < num_spline_collections; dset_idx++) {
+        const auto& spline_scatterers = *m_scatterers_collection.spline_collections[dset_idx];
+        const int num_scatterers = spline_scatterers.num_scatterers();
+        if (!rendered_datasets[dset_idx]) {
+            rendered_datasets[dset_idx] = std::make_shared<HostFixedScatterers>();
+        }
+        auto& rendered = *rendered_datasets[dset_idx];
+        rendered.resize(num_scatterers);
+        std::copy(spline_scatterers.amplitudes.begin(), spline_scatterers.amplitudes.end(), rendered.as.begin());
+
+        std::vector<float> basis_functions;
+        int lower_lim, upper_lim;
+        compute_spline_basis(spline_scatterers, timestamp, basis_functions, lower_lim, upper_lim);
+
+        const int BLOCK_SIZE = 256;
+        const int num_blocks = (num_scatterers + BLOCK_SIZE - 1)/BLOCK_SIZE;
+#ifdef BCSIM_ENABLE_OPENMP
+        omp_set_num_threads(m_omp_num_threads);
+        #pragma omp parallel for
+#endif
+        for (int block_no = 0; block_no < num_blocks; block_no++) {
+            const int block_start = block_no*BLOCK_SIZE;
+            const int block_length = std::min(BLOCK_SIZE, num_scatterers - block_start);
+            evaluate_spline_positions(spline_scatterers, basis_functions, lower_lim, upper_lim, block_start, block_length,
+                                      rendered.xs.data() + block_start,
+                                      rendered.ys.data() + block_start,
+                                      rendered.zs.data() + block_start);
+        }
+    }
+}
+
+const std::vector<HostFixedScatterers::s_ptr>* CpuAlgorithm::find_rendered_splines(int line_no) const {
+    if (m_spline_cache_line_slots.empty() || (m_spline_cache_line_slots[line_no] < 0)) {
+        return nullptr;
+    }
+    return &m_rendered_splines[m_spline_cache_line_slots[line_no]];
+}
+
+template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+void CpuAlgorithm::set_projection_loops() {
+    m_fixed_projection_loop  = &CpuAlgorithm::fixed_projection_loop<use_arc_projection, use_phase_delay, use_fractional_delay, Profile>;
+    m_spline_projection_loop = &CpuAlgorithm::spline_projection_loop<use_arc_projection, use_phase_delay, use_fractional_delay, Profile>;
+    m_spline_ensemble_projection_loop = &CpuAlgorithm::spline_ensemble_projection_loop<use_arc_projection, use_phase_delay,
+                                                                                       use_fractional_delay, Profile>;
+    m_fixed_mla_projection_loop = &CpuAlgorithm::fixed_mla_projection_loop<use_arc_projection, use_phase_delay, use_fractional_delay, Profile>;
+    m_spline_mla_projection_loop = &CpuAlgorithm::spline_mla_projection_loop<use_arc_projection, use_phase_delay, use_fractional_delay, Profile>;
+}
+
+template <typename Profile>
+void CpuAlgorithm::select_projection_loops_for_profile() {
+    // the decimated grid of baseband mode is too coarse to leave out the phase delay
+    const auto use_phase_delay = m_enable_phase_delay || m_param_baseband;
+    const auto use_fractional_delay = static_cast<bool>(m_fractional_delay);
+    if (!m_param_use_arc_projection && !use_phase_delay && !use_fractional_delay) {
+        set_projection_loops<false, false, false, Profile>();
+    } else if (!m_param_use_arc_projection && !use_phase_delay && use_fractional_delay) {
+        set_projection_loops<false, false, true, Profile>();
+    } else if (!m_param_use_arc_projection && use_phase_delay && !use_fractional_delay) {
+        set_projection_loops<false, true, false, Profile>();
+    } else if (!m_param_use_arc_projection && use_phase_delay && use_fractional_delay) {
+        set_projection_loops<false, true, true, Profile>();
+    } else if (m_param_use_arc_projection && !use_phase_delay && !use_fractional_delay) {
+        set_projection_loops<true, false, false, Profile>();
+    } else if (m_param_use_arc_projection && !use_phase_delay && use_fractional_delay) {
+        set_projection_loops<true, false, true, Profile>();
+    } else if (m_param_use_arc_projection && use_phase_delay && !use_fractional_delay) {
+        set_projection_loops<true, true, false, Profile>();
+    } else {
+        set_projection_loops<true, true, true, Profile>();
+    }
+}
+
+void CpuAlgorithm::select_projection_loops() {
+    switch (m_cur_beam_profile_type) {
+    case BeamProfileType::ANALYTICAL:
+        select_projection_loops_for_profile<GaussianBeamProfile>();
+        break;
+    case BeamProfileType::LOOKUP:
+        select_projection_loops_for_profile<LUTBeamProfile>();
+        break;
+    case BeamProfileType::MULTI_RESOLUTION_LOOKUP:
+        select_projection_loops_for_profile<MultiResolutionLUTBeamProfile>();
+        break;
+    default:
+        throw std::logic_error("unknown beam profile type");
+    }
+}
+
+const int CpuAlgorithm::MIN_ENSEMBLE_LINE_BLOCK_SIZE;
+
 CpuAlgorithm::CpuAlgorithm()
-        : m_scan_sequence_configured(false),
+        : m_use_output_convolvers(false),
+          m_output_frame_stride(0),
+          m_convolvers_dirty(true),
+          m_param_fft_backend("builtin"),
+          m_param_convolution_method("auto"),
+          m_param_sparse_convolution_threshold(0),
+          m_time_proj_num_samples(0),
+          m_time_proj_sampling_frequency(0.0f),
+          m_time_proj_first_sample(0),
+          m_window_phasor(1.0f, 0.0f),
+          m_scan_sequence_configured(false),
           m_excitation_configured(false),
           m_omp_num_threads(1),
-          m_param_sum_all_cs(false) {
+          m_param_noise_seed(0),
+          m_noise_frame_no(0),
+          m_fixed_projection_loop(nullptr),
+          m_spline_projection_loop(nullptr),
+          m_spline_ensemble_projection_loop(nullptr),
+          m_fixed_mla_projection_loop(nullptr),
+          m_spline_mla_projection_loop(nullptr),
+          m_single_geometry(false),
+          m_use_ensemble_projection(false),
+          m_mla_group_size(1),
+          m_mla_lines(1),
+          m_param_spline_cache(true),
+          m_param_fixed_projection_cache(false),
+          m_fixed_projection_cache_valid(false),
+          m_fixed_projection_cache_num_parts(0),
+          m_param_line_block_size(1),
+          m_param_line_schedule("dynamic"),
+          m_param_line_schedule_chunk(0),
+          m_param_scatterer_tile_size(16384),
+          m_param_scatterer_subsets(1),
+          m_param_scatterer_subset_begin(0),
+          m_param_scatterer_subset_end(-1),
+          m_active_subsets(0, 1),
+          m_param_huge_pages(false),
+          m_packed_sample_type(IqOutputFormat::SampleType::COMPLEX_FLOAT32),
+          m_packed_int16_scale(1.0f),
+          m_packed_num_samples(0),
+          m_param_sum_all_cs(false),
+          m_store_kernel_details(false),
+          m_param_numa_mode("off"),
+          m_numa_topology(NumaTopology::detect()),
+          m_numa_placement_valid(false) {
     
     // use all cores by default
     set_use_all_available_cores();
@@ -217,14 +824,56 @@ void CpuAlgorithm::set_use_specific_num_cores(int num_threads) {
     m_log_object->write(ILog::INFO, "Number of OpenMP threads is " + std::to_string(m_omp_num_threads));
     
     // number of convolvers must match number of threads
-    configure_convolvers_if_possible();
+    m_convolvers_dirty = true;
+    // the threads of the NUMA nodes change
+    invalidate_numa_placement();
+}
+
+namespace {
+
+// Parameters which do not change the time projections of the fixed scatterers.
+bool keeps_fixed_projections(const std::string& key) {
+    static const char* keys[] = {"verbose", "noise_amplitude", "noise_seed", "num_cpu_cores", "sum_all_cs",
+                                 "cpu_spline_cache", "cpu_line_block_size", "cpu_line_schedule",
+                                 "cpu_line_schedule_chunk", "cpu_scatterer_tile_size",
+                                 "cpu_fft_backend", "cpu_convolution_method", "cpu_sparse_convolution_threshold",
+                                 "store_kernel_details", "trace_file",
+                                 "cpu_numa", "cpu_huge_pages"};
+    return (std::find(std::begin(keys), std::end(keys), key) != std::end(keys)) || (key.compare(0, 6, "stats_") == 0)
+           || (key.compare(0, 12, "frame_cache_") == 0);
+}
+
+bool same_vector(const vector3& a, const vector3& b) {
+    return (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
 }
 
+// True if the lines only differ in their timestamps.
+bool same_line_geometry(const ScanSequence& a, const ScanSequence& b) {
+    if ((a.get_num_lines() != b.get_num_lines()) || (a.line_length != b.line_length)
+        || (a.r_min != b.r_min) || (a.r_max != b.r_max)) {
+        return false;
+    }
+    for (int line_no = 0; line_no < a.get_num_lines(); line_no++) {
+        const auto& line_a = a.get_scanline(line_no);
+        const auto& line_b = b.get_scanline(line_no);
+        if (!same_vector(line_a.get_origin(), line_b.get_origin()) || !same_vector(line_a.get_direction(), line_b.get_direction())
+            || !same_vector(line_a.get_lateral_dir(), line_b.get_lateral_dir())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}   // namespace
+
 void CpuAlgorithm::set_parameter(const std::string& key, const std::string& value) {
+    if (!keeps_fixed_projections(key)) {
+        invalidate_fixed_projection_cache();
+    }
     if (key == "sound_speed") {
         BaseAlgorithm::set_parameter(key, value);
-        // convolvers must be updated after sound speed has changed.
-        configure_convolvers_if_possible();
+        // the number of RF samples depends on the sound speed
+        m_convolvers_dirty = true;
     } else if (key == "num_cpu_cores") {
         if (value == "all") {
             set_use_all_available_cores();
@@ -242,12 +891,153 @@ void CpuAlgorithm::set_parameter(const std::string& key, const std::string& valu
             throw std::runtime_error("invalid value for " + key);
         }
 
+    } else if (key == "cpu_spline_cache") {
+        if ((value == "on") || (value == "true")) {
+            m_param_spline_cache = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_spline_cache = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (key == "cpu_fixed_projection_cache") {
+        if ((value == "on") || (value == "true")) {
+            m_param_fixed_projection_cache = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_fixed_projection_cache = false;
+            m_fixed_projection_cache.clear();
+            m_fixed_projection_cache_num_parts = 0;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (key == "cpu_line_block_size") {
+        const auto new_block_size = std::stoi(value);
+        if (new_block_size <= 0) {
+            throw std::runtime_error("illegal line block size");
+        }
+        m_param_line_block_size = new_block_size;
+    } else if (key == "cpu_line_schedule") {
+        if ((value != "static") && (value != "dynamic") && (value != "guided")) {
+            throw std::runtime_error("invalid value for " + key);
+        }
+        m_param_line_schedule = value;
+    } else if (key == "cpu_line_schedule_chunk") {
+        const auto new_chunk = std::stoi(value);
+        if (new_chunk < 0) {
+            throw std::runtime_error("illegal line schedule chunk size");
+        }
+        m_param_line_schedule_chunk = new_chunk;
+    } else if (key == "cpu_scatterer_tile_size") {
+        const auto new_tile_size = std::stoi(value);
+        if (new_tile_size <= 0) {
+            throw std::runtime_error("illegal scatterer tile size");
+        }
+        m_param_scatterer_tile_size = new_tile_size;
+    } else if (key == "cpu_scatterer_subsets") {
+        const auto num_subsets = std::stoi(value);
+        if (num_subsets <= 0) {
+            throw std::runtime_error("illegal number of scatterer subsets");
+        }
+        if (num_subsets != m_param_scatterer_subsets) {
+            m_param_scatterer_subsets = num_subsets;
+            invalidate_numa_placement();
+            for (auto& dataset : m_scatterers_collection.fixed_collections) {
+                if (dataset->is_generated()) {
+                    dataset->num_subsets = static_cast<size_t>(num_subsets);
+                } else if (dataset->get_num_scatterers() > 0) {
+                    dataset->sort_by_grid(m_param_scatterer_order, static_cast<size_t>(num_subsets));
+                }
+            }
+        }
+    } else if (key == "cpu_scatterer_subset_begin") {
+        const auto subset = std::stoi(value);
+        if (subset < 0) {
+            throw std::runtime_error("illegal scatterer subset");
+        }
+        m_param_scatterer_subset_begin = subset;
+    } else if (key == "cpu_scatterer_subset_end") {
+        const auto subset = std::stoi(value);
+        if (subset < -1) {
+            throw std::runtime_error("illegal scatterer subset");
+        }
+        m_param_scatterer_subset_end = subset;
+    } else if (key == "cpu_fft_backend") {
+        const auto backends = IBeamConvolver::get_available_fft_backends();
+        if (std::find(backends.begin(), backends.end(), value) == backends.end()) {
+            throw std::runtime_error("FFT backend not available: " + value);
+        }
+        m_param_fft_backend = value;
+        m_convolvers_dirty = true;
+    } else if (key == "cpu_convolution_method") {
+        if ((value != "auto") && (value != "fft") && (value != "direct")) {
+            throw std::runtime_error("illegal convolution method: " + value);
+        }
+        m_param_convolution_method = value;
+        m_convolvers_dirty = true;
+    } else if (key == "cpu_sparse_convolution_threshold") {
+        const auto threshold = std::stoi(value);
+        if (threshold < 0) {
+            throw std::runtime_error("illegal sparse convolution threshold");
+        }
+        m_param_sparse_convolution_threshold = threshold;
+        for (auto& convolver : convolvers) {
+            convolver->set_sparse_threshold(static_cast<size_t>(threshold));
+        }
+        for (auto& thread_convolvers : m_output_convolvers) {
+            for (auto& convolver : thread_convolvers) {
+                convolver->set_sparse_threshold(static_cast<size_t>(threshold));
+            }
+        }
     } else if (key == "noise_amplitude") { 
+        // real-input transforms are used without noise
+        BaseAlgorithm::set_parameter(key, value);
+        m_convolvers_dirty = true;
+    } else if (key == "noise_seed") {
+        // also restarts the frame counter to make a sequence of frames reproducible
+        m_param_noise_seed = static_cast<uint64_t>(std::stoull(value));
+        m_noise_frame_no = 0;
+    } else if (key == "radial_decimation") {
         BaseAlgorithm::set_parameter(key, value);
-        m_normal_dist = std::normal_distribution<float>(0.0f, m_param_noise_amplitude);
+        // decimation is done by the convolvers
+        m_convolvers_dirty = true;
+    } else if ((key == "phase_delay") || (key == "baseband")) {
+        BaseAlgorithm::set_parameter(key, value);
+        m_convolvers_dirty = true;
+    } else if (key == "fractional_delay") {
+        // "off" rounds the scatterers to the closest sample, an even number
+        // of taps spreads them with a windowed-sinc filter
+        if ((value == "off") || (value == "0")) {
+            m_fractional_delay.reset();
+        } else {
+            m_fractional_delay.reset(new FractionalDelayTable(std::stoi(value)));
+        }
+    } else if (key == "cpu_numa") {
+        if ((value != "auto") && (value != "off") && (value != "interleave")) {
+            throw std::runtime_error("invalid value for " + key);
+        }
+        if (value != m_param_numa_mode) {
+            m_param_numa_mode = value;
+            invalidate_numa_placement();
+        }
+    } else if (key == "cpu_huge_pages") {
+        if ((value == "on") || (value == "true")) {
+            m_param_huge_pages = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_huge_pages = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
+    } else if (key == "store_kernel_details") {
+        if ((value == "on") || (value == "true")) {
+            m_store_kernel_details = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_store_kernel_details = false;
+        } else {
+            throw std::runtime_error("invalid value for " + key);
+        }
     } else {
         BaseAlgorithm::set_parameter(key, value);
     }
+    m_state.set_parameter(key, value);
 }
 
 void CpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
@@ -258,48 +1048,737 @@ void CpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
     if (!m_excitation_configured) {
         throw std::runtime_error("Excitation must be configured before scan sequence");        
     }
+    // throws if the depth window is invalid
+    compute_rf_sample_window(m_param_sound_speed, *new_scan_sequence, m_excitation, m_radial_decimation);
     
+    // the fixed scatterers do not depend on the timestamps, as for the
+    // shifted scan sequences of a frame stream
+    if (!m_scan_sequence || !same_line_geometry(*m_scan_sequence, *new_scan_sequence)) {
+        invalidate_fixed_projection_cache();
+    }
     m_scan_sequence = new_scan_sequence;
     m_scan_sequence_configured = true;
-
-    const auto line_length = m_scan_sequence->line_length;
-    m_rf_line_num_samples = compute_num_rf_samples(m_param_sound_speed, line_length, m_excitation.sampling_frequency);
-
-    configure_convolvers_if_possible();
+    m_single_geometry = has_single_geometry(*new_scan_sequence);
+    m_mla_group_size = mla_group_size(*new_scan_sequence);
+    // the convolvers only depend on the line length, not the lines
+    m_convolvers_dirty = true;
+    m_state.set_scan_sequence(new_scan_sequence);
 }
 
 
 void CpuAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
+    invalidate_fixed_projection_cache();
     m_excitation = new_excitation;
     m_excitation_configured = true;
-    configure_convolvers_if_possible();
+    m_convolvers_dirty = true;
+    m_state.set_excitation(new_excitation);
 }   
 
 void CpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float>> > & rfLines) {
     throw_if_not_configured();
-    const auto num_scanlines = m_scan_sequence->get_num_lines();
-    rfLines.resize(num_scanlines);
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+
+    const auto cache_key = frame_cache_key(m_noise_frame_no);
+    if (!cache_key.empty() && read_cached_frame(cache_key, rfLines)) {
+        m_noise_frame_no++;
+        return;
+    }
+
+    // resizing reuses the capacity of the caller's vectors between frames
+    rfLines.resize(num_lines);
+    m_line_outputs.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        rfLines[line_no].resize(num_samples);
+        m_line_outputs[line_no] = rfLines[line_no].data();
+    }
+    simulate_all_lines();
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, rfLines);
+    }
+}
+
+void CpuAlgorithm::get_output_dimensions(size_t& num_lines, size_t& num_samples) const {
+    if (!m_scan_sequence_configured || !m_excitation_configured) {
+        throw std::runtime_error("Scan sequence and excitation must be configured to get output dimensions");
+    }
+    // as the convolvers will decimate, which may not be created yet
+    num_lines   = static_cast<size_t>(m_scan_sequence->get_num_lines());
+    num_samples = (compute_rf_line_num_samples() + m_radial_decimation - 1)/m_radial_decimation;
+}
+
+float CpuAlgorithm::get_output_start_time() const {
+    if (!m_scan_sequence_configured || !m_excitation_configured) {
+        throw std::runtime_error("Scan sequence and excitation must be configured to get the output start time");
+    }
+    return rf_sample_window().first_sample/m_excitation.sampling_frequency;
+}
+
+void CpuAlgorithm::simulate_lines(std::complex<float>* iq_buffer, size_t line_stride) {
+    throw_if_not_configured();
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    const auto cache_key = frame_cache_key(m_noise_frame_no);
+    if (!cache_key.empty() && read_cached_frame(cache_key, iq_buffer, line_stride)) {
+        m_noise_frame_no++;
+        return;
+    }
+
+    m_line_outputs.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        m_line_outputs[line_no] = iq_buffer + line_no*line_stride;
+    }
+    simulate_all_lines();
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, iq_buffer, line_stride);
+    }
+}
+
+void CpuAlgorithm::simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                   std::complex<float>* iq_buffer,
+                                                   size_t line_stride, size_t frame_stride) {
+    throw_if_not_configured();
+    check_multi_excitation_args(excitations, line_stride, frame_stride);
+    auto same_projection = !m_param_baseband;
+    for (const auto& excitation : excitations) {
+        same_projection = same_projection && (!m_enable_phase_delay || (excitation.demod_freq == m_excitation.demod_freq));
+    }
+    if (!same_projection) {
+        BaseAlgorithm::simulate_lines_multi_excitation(excitations, iq_buffer, line_stride, frame_stride);
+        return;
+    }
 
+    const auto num_lines = static_cast<size_t>(m_scan_sequence->get_num_lines());
+    m_line_outputs.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        m_line_outputs[line_no] = iq_buffer + line_no*line_stride;
+    }
+    update_output_convolvers(excitations);
+    m_use_output_convolvers = true;
+    m_output_frame_stride = frame_stride;
+    try {
+        simulate_all_lines();
+    } catch (...) {
+        m_use_output_convolvers = false;
+        throw;
+    }
+    m_use_output_convolvers = false;
+}
+
+float CpuAlgorithm::simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) {
+    const auto per_frame_scale = (format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16)
+                                 && (format.int16_scale == 0.0f);
+    if ((format.sample_type == IqOutputFormat::SampleType::COMPLEX_FLOAT32) || per_frame_scale) {
+        return BaseAlgorithm::simulate_lines_formatted(format, iq_buffer, line_stride);
+    }
+    throw_if_not_configured();
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+
+    const auto sample_bytes = iq_sample_bytes(format.sample_type);
+    m_line_outputs.assign(num_lines, nullptr);
+    m_packed_line_outputs.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        m_packed_line_outputs[line_no] = static_cast<char*>(iq_buffer) + line_no*line_stride*sample_bytes;
+    }
+    m_packed_sample_type = format.sample_type;
+    m_packed_int16_scale = (format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16) ? format.int16_scale : 1.0f;
+    m_packed_num_samples = num_samples;
+    m_thread_iq_lines.resize(static_cast<size_t>(m_omp_num_threads));
+    for (auto& line : m_thread_iq_lines) {
+        line.resize(num_samples);
+    }
+    try {
+        simulate_all_lines();
+    } catch (...) {
+        m_packed_line_outputs.clear();
+        throw;
+    }
+    m_packed_line_outputs.clear();
+    return m_packed_int16_scale;
+}
+
+namespace {
+
+double millisec_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds the time until it goes out of scope to *stage_ms, unless stage_ms is
+// nullptr, in which case the clock is never read.
+class StageTimer {
+public:
+    explicit StageTimer(double* stage_ms)
+        : m_stage_ms(stage_ms)
+    {
+        if (m_stage_ms) m_start = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer() {
+        stop();
+    }
+
+    // Stop before going out of scope.
+    void stop() {
+        if (m_stage_ms) *m_stage_ms += millisec_since(m_start);
+        m_stage_ms = nullptr;
+    }
+
+private:
+    double*                                 m_stage_ms;
+    std::chrono::steady_clock::time_point   m_start;
+};
+
+}
+
+CpuAlgorithm::ThreadStageTimes* CpuAlgorithm::thread_stage_times() {
+    if (!m_store_kernel_details) {
+        return nullptr;
+    }
+    return &m_thread_stage_times[thread_no()];
+}
+
+int CpuAlgorithm::thread_no() {
+#ifdef BCSIM_ENABLE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+void CpuAlgorithm::prepare_thread_arenas() {
+    // The memory of an arena is allocated by its thread on the first block,
+    // so that it is on the thread's NUMA node.
+    m_thread_arenas.resize(m_omp_num_threads);
+    for (auto& arena : m_thread_arenas) {
+        arena.set_huge_pages(m_param_huge_pages);
+    }
+}
+
+void CpuAlgorithm::prepare_numa() {
+    const bool pin_threads = (m_param_numa_mode != "off");
+    std::vector<int> thread_cpus;
+    std::vector<int> thread_nodes;
+    if (pin_threads) {
+        m_numa_topology.assign_threads(m_omp_num_threads, thread_cpus, thread_nodes);
+    }
+    // Pinned threads are released to all CPUs when pinning is turned off.
+    // The OpenMP threads are kept between parallel regions, but the threads
+    // are pinned at every frame in case the runtime has replaced them.
+    if (pin_threads || !m_thread_nodes.empty()) {
+        std::vector<int> all_cpus;
+        for (size_t node_no = 0; node_no < m_numa_topology.get_num_nodes(); node_no++) {
+            const auto& cpus = m_numa_topology.get_cpus(node_no);
+            all_cpus.insert(all_cpus.end(), cpus.begin(), cpus.end());
+        }
+        bool pinned = true;
+#ifdef BCSIM_ENABLE_OPENMP
+        omp_set_num_threads(m_omp_num_threads);
+        #pragma omp parallel reduction(&&: pinned)
+#endif
+        {
+            const auto cpus = pin_threads ? std::vector<int>(1, thread_cpus[thread_no()]) : all_cpus;
+            pinned = NumaTopology::pin_calling_thread(cpus);
+        }
+        if (!pinned && m_param_verbose) {
+            m_log_object->write(ILog::INFO, "Could not pin the threads to CPUs");
+        }
+    }
+    m_thread_nodes = thread_nodes;
+
+    const bool copy_datasets = (m_param_numa_mode == "auto") && (m_numa_topology.get_num_nodes() > 1);
+    if (!copy_datasets) {
+        m_node_fixed_datasets.clear();
+    }
+    if (m_numa_placement_valid) {
+        return;
+    }
+    m_numa_placement_valid = true;
+    const auto& datasets = m_scatterers_collection.fixed_collections;
+    const auto is_placed = [](const HostFixedScatterers& dataset) {
+        return !dataset.is_generated() && !dataset.external && (dataset.get_num_scatterers() > 0);
+    };
+
+    if (copy_datasets) {
+        trace::ScopedEvent event("numa_copy_fixed_scatterers", "cpu");
+        const auto num_nodes = m_numa_topology.get_num_nodes();
+        m_node_fixed_datasets.assign(num_nodes, std::vector<HostFixedScatterers::s_ptr>(datasets.size()));
+        // the first thread of each node copies the datasets
+        std::vector<int> copying_thread(num_nodes, -1);
+        for (int thread_idx = m_omp_num_threads - 1; thread_idx >= 0; thread_idx--) {
+            copying_thread[m_thread_nodes[thread_idx]] = thread_idx;
+        }
+#ifdef BCSIM_ENABLE_OPENMP
+        omp_set_num_threads(m_omp_num_threads);
+        #pragma omp parallel
+#endif
+        {
+            const int thread_idx = thread_no();
+            const int node_no = m_thread_nodes[thread_idx];
+            if (copying_thread[node_no] == thread_idx) {
+                for (size_t dset_idx = 0; dset_idx < datasets.size(); dset_idx++) {
+                    if (is_placed(*datasets[dset_idx])) {
+                        m_node_fixed_datasets[node_no][dset_idx] = std::make_shared<HostFixedScatterers>(*datasets[dset_idx]);
+                    }
+                }
+            }
+        }
+        if (m_param_verbose) {
+            m_log_object->write(ILog::INFO, "Copied the fixed scatterers to " + std::to_string(num_nodes) + " NUMA nodes");
+        }
+    } else if ((m_param_numa_mode == "interleave") && (m_numa_topology.get_num_nodes() > 1)) {
+        bool interleaved = true;
+        for (const auto& dataset : datasets) {
+            if (is_placed(*dataset)) {
+                const auto num_bytes = dataset->get_num_scatterers()*sizeof(float);
+                for (const auto data : {dataset->x_data(), dataset->y_data(), dataset->z_data(), dataset->a_data()}) {
+                    interleaved = m_numa_topology.interleave_pages(data, num_bytes) && interleaved;
+                }
+            }
+        }
+        if (!interleaved) {
+            m_log_object->write(ILog::INFO, "Could not interleave the fixed scatterers over the NUMA nodes");
+        }
+    }
+}
+
+const HostFixedScatterers& CpuAlgorithm::node_local_fixed_dataset(size_t dset_idx) const {
+    const auto& dataset = *m_scatterers_collection.fixed_collections[dset_idx];
+    if (m_node_fixed_datasets.empty()) {
+        return dataset;
+    }
+    const auto thread_idx = static_cast<size_t>(thread_no());
+    if (thread_idx >= m_thread_nodes.size()) {
+        return dataset;
+    }
+    const auto& node_copy = m_node_fixed_datasets[m_thread_nodes[thread_idx]][dset_idx];
+    return node_copy ? *node_copy : dataset;
+}
+
+void CpuAlgorithm::store_stage_times() {
+    // one value per thread, and the imbalance as the ratio of the busiest
+    // thread's time to the mean
+    auto& fixed_projection  = m_debug_data["cpu_fixed_projection_ms"];
+    auto& spline_projection = m_debug_data["cpu_spline_projection_ms"];
+    auto& noise             = m_debug_data["cpu_noise_ms"];
+    auto& convolution       = m_debug_data["cpu_convolution_ms"];
+    auto& demodulation      = m_debug_data["cpu_demodulation_ms"];
+    auto& busy              = m_debug_data["cpu_thread_busy_ms"];
+    auto& finish            = m_debug_data["cpu_thread_finish_ms"];
+    double max_busy_ms = 0.0;
+    double sum_busy_ms = 0.0;
+    for (const auto& times : m_thread_stage_times) {
+        fixed_projection.push_back(times.fixed_projection_ms);
+        spline_projection.push_back(times.spline_projection_ms);
+        noise.push_back(times.noise_ms);
+        convolution.push_back(times.convolution_ms);
+        demodulation.push_back(times.demodulation_ms);
+        const auto busy_ms = times.fixed_projection_ms + times.spline_projection_ms + times.noise_ms
+                             + times.convolution_ms + times.demodulation_ms;
+        busy.push_back(busy_ms);
+        finish.push_back(times.finish_ms);
+        max_busy_ms = std::max(max_busy_ms, busy_ms);
+        sum_busy_ms += busy_ms;
+    }
+    const auto mean_busy_ms = sum_busy_ms/m_thread_stage_times.size();
+    m_debug_data["cpu_thread_imbalance"].push_back(mean_busy_ms > 0.0 ? max_busy_ms/mean_busy_ms : 1.0);
+}
+
+void CpuAlgorithm::update_active_subsets() {
+    const auto num_subsets = static_cast<size_t>(m_param_scatterer_subsets);
+    const auto first_subset = static_cast<size_t>(m_param_scatterer_subset_begin);
+    const auto end_subset = (m_param_scatterer_subset_end < 0) ? num_subsets : static_cast<size_t>(m_param_scatterer_subset_end);
+    if ((first_subset > end_subset) || (end_subset > num_subsets)) {
+        throw std::runtime_error("scatterer subsets " + std::to_string(first_subset) + "..." + std::to_string(end_subset)
+                                 + " are not within the " + std::to_string(num_subsets) + " subsets");
+    }
+    m_active_subsets = std::make_pair(first_subset, end_subset);
+}
+
+void CpuAlgorithm::simulate_all_lines() {
+    trace::ScopedEvent event("simulate_lines", "cpu");
+    const auto frame_start = std::chrono::steady_clock::now();
+    update_convolvers();
+    log_simulation_info();
+    select_projection_loops();
+    prepare_numa();
+    if (m_store_kernel_details) {
+        m_debug_data.clear();
+        m_thread_stage_times.assign(m_omp_num_threads, ThreadStageTimes());
+    }
+
+    auto stage_start = std::chrono::steady_clock::now();
+    {
+        trace::ScopedEvent cache_event("render_spline_cache", "cpu");
+        render_spline_cache();
+    }
+    const auto spline_cache_ms = millisec_since(stage_start);
+    stage_start = std::chrono::steady_clock::now();
+    {
+        trace::ScopedEvent culling_event("update_culling_region", "cpu");
+        update_culling_region();
+    }
+    const auto culling_ms = millisec_since(stage_start);
+    stage_start = std::chrono::steady_clock::now();
+
+    update_active_subsets();
+    m_procedural_tiles.resize(m_omp_num_threads);
+    prepare_thread_arenas();
+    m_use_ensemble_projection = m_param_ensemble_projection && m_single_geometry;
+    if (m_use_ensemble_projection) {
+        trace::ScopedEvent ensemble_event("ensemble_fixed_projection", "cpu");
+        prepare_ensemble_fixed_projection();
+    }
+    m_mla_lines = (m_param_mla_projection && !m_use_ensemble_projection) ? m_mla_group_size : 1;
+
+#ifdef BCSIM_ENABLE_OPENMP
+    // Too few lines to keep all threads busy.
+    if (static_cast<int>(m_line_outputs.size()) < m_omp_num_threads) {
+        simulate_lines_scatterer_parallel();
+    } else
+#endif
+    {
+        prepare_fixed_projection_cache(1);
+        simulate_lines_line_parallel();
+    }
+    // the ensemble projection does not fill the cache
+    m_fixed_projection_cache_valid = m_param_fixed_projection_cache && !m_use_ensemble_projection;
+
+    if (m_store_kernel_details) {
+        m_debug_data["cpu_spline_cache_ms"].push_back(spline_cache_ms);
+        m_debug_data["cpu_culling_ms"].push_back(culling_ms);
+        m_debug_data["cpu_lines_ms"].push_back(millisec_since(stage_start));
+        store_stage_times();
+    }
+    m_noise_frame_no++;
+    count_frame(m_line_outputs.size(), frame_start);
+}
+
+void CpuAlgorithm::prepare_fixed_projection_cache(size_t num_parts) {
+    if (!m_param_fixed_projection_cache || m_use_ensemble_projection) {
+        return;
+    }
+    const auto num_buffers = num_parts*m_line_outputs.size();
+    if ((m_fixed_projection_cache_num_parts != num_parts) || (m_fixed_projection_cache.size() != num_buffers)
+        || m_fixed_projection_cache.empty() || (m_fixed_projection_cache.front().size() != m_time_proj_num_samples)) {
+        invalidate_fixed_projection_cache();
+        m_fixed_projection_cache.resize(num_buffers);
+        for (auto& time_proj : m_fixed_projection_cache) {
+            time_proj.resize(m_time_proj_num_samples);
+        }
+        m_fixed_projection_cache_num_parts = num_parts;
+    }
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, m_fixed_projection_cache_valid ? "Reusing cached fixed-scatterer projections"
+                                                                       : "Caching fixed-scatterer projections");
+    }
+}
+
+void CpuAlgorithm::prepare_ensemble_fixed_projection() {
+    m_ensemble_fixed_projection.assign(m_time_proj_num_samples, std::complex<float>(0.0f, 0.0f));
+    if (m_scatterers_collection.fixed_collections.empty()) {
+        return;
+    }
+#ifdef BCSIM_ENABLE_OPENMP
+    omp_set_num_threads(m_omp_num_threads);
+    #pragma omp parallel
+    {
+        const int thread_idx = omp_get_thread_num();
+        const int num_threads = omp_get_num_threads();
+        auto& arena = m_thread_arenas[thread_idx];
+        arena.reset();
+        auto time_proj_signal = arena.allocate_zeroed<std::complex<float>>(m_time_proj_num_samples);
+        project_fixed_scatterers(0, 1, &time_proj_signal, thread_idx, num_threads);
+        #pragma omp critical
+        {
+            for (size_t i = 0; i < m_time_proj_num_samples; i++) {
+                m_ensemble_fixed_projection[i] += time_proj_signal[i];
+            }
+        }
+    }
+#else
+    std::complex<float>* time_proj_signal = m_ensemble_fixed_projection.data();
+    project_fixed_scatterers(0, 1, &time_proj_signal, 0, 1);
+#endif
+}
+
+void CpuAlgorithm::simulate_lines_line_parallel() {
+    const int block_size = line_block_size();
+    const auto num_scanlines = static_cast<int>(m_line_outputs.size());
+    const int num_line_blocks = (num_scanlines + block_size - 1)/block_size;
+    const auto loop_start = std::chrono::steady_clock::now();
+#ifdef BCSIM_ENABLE_OPENMP
+    omp_set_num_threads(m_omp_num_threads);
+    const auto schedule_kind = (m_param_line_schedule == "static") ? omp_sched_static
+                             : (m_param_line_schedule == "guided") ? omp_sched_guided : omp_sched_dynamic;
+    omp_set_schedule(schedule_kind, m_param_line_schedule_chunk);
+    #pragma omp parallel
+#endif
+    {
+#ifdef BCSIM_ENABLE_OPENMP
+        #pragma omp for schedule(runtime) nowait
+#endif
+        for (int block_no = 0; block_no < num_line_blocks; block_no++) {
+            const int first_line_no = block_no*block_size;
+            const int num_lines = std::min(block_size, num_scanlines - first_line_no);
+            if (m_param_verbose) {
+                m_log_object->write(ILog::INFO, "Simulating line numbers " + std::to_string(first_line_no) + "..." + std::to_string(first_line_no + num_lines - 1));
+            }
+            simulate_line_block(first_line_no, num_lines);
+        }
+        if (const auto stage_times = thread_stage_times()) {
+            stage_times->finish_ms = millisec_since(loop_start);
+        }
+    }
+}
+
+void CpuAlgorithm::log_simulation_info() const {
     if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Projection kernel instruction set: " + std::string(get_projection_kernel_isa()));
         m_log_object->write(ILog::INFO, "Sound speed: " + std::to_string(m_param_sound_speed));
-        m_log_object->write(ILog::INFO, "Number of scan lines: " + std::to_string(num_scanlines));
+        m_log_object->write(ILog::INFO, "Number of scan lines: " + std::to_string(m_scan_sequence->get_num_lines()));
         m_log_object->write(ILog::INFO, "Number of OpenMP threads: " + std::to_string(m_omp_num_threads));
+        m_log_object->write(ILog::INFO, "Lines per block: " + std::to_string(line_block_size()));
+        m_log_object->write(ILog::INFO, "Scatterers per tile: " + std::to_string(m_param_scatterer_tile_size));
         m_log_object->write(ILog::INFO, "IQ demodulation frequency: " + std::to_string(m_excitation.demod_freq));
-    }    
+    }
+}
+
+void CpuAlgorithm::simulate_lines_scatterer_parallel() {
 #ifdef BCSIM_ENABLE_OPENMP
+    const auto num_scanlines = static_cast<int>(m_line_outputs.size());
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Splitting scatterers between threads");
+    }
+
     omp_set_num_threads(m_omp_num_threads);
-    #pragma omp parallel for
+    #pragma omp parallel
+    {
+        const int thread_idx = omp_get_thread_num();
+        const int num_threads = omp_get_num_threads();
+        // The scatterers are split between the threads of the team, which
+        // may be fewer than requested. The per-thread buffers have room for
+        // m_omp_num_threads threads, and the buffers of the parts are sized
+        // by the team.
+        #pragma omp single
+        {
+            m_block_time_proj.assign(num_threads*num_scanlines, nullptr);
+            prepare_fixed_projection_cache(static_cast<size_t>(num_threads));
+        }
+
+        auto& arena = m_thread_arenas[thread_idx];
+        arena.reset();
+        const auto time_proj_signals = m_block_time_proj.data() + thread_idx*num_scanlines;
+        for (int k = 0; k < num_scanlines; k++) {
+            time_proj_signals[k] = arena.allocate_zeroed<std::complex<float>>(m_time_proj_num_samples);
+        }
+        project_line_block(0, num_scanlines, time_proj_signals, thread_idx, num_threads);
+
+        // Pairwise tree reduction into the buffers of thread zero.
+        for (int stride = 1; stride < num_threads; stride *= 2) {
+            #pragma omp barrier
+            if ((thread_idx % (2*stride) == 0) && (thread_idx + stride < num_threads)) {
+                for (int k = 0; k < num_scanlines; k++) {
+                    const auto other = m_block_time_proj[(thread_idx + stride)*num_scanlines + k];
+                    auto dest = time_proj_signals[k];
+                    for (size_t i = 0; i < m_time_proj_num_samples; i++) {
+                        dest[i] += other[i];
+                    }
+                }
+            }
+        }
+        #pragma omp barrier
+
+        #pragma omp for
+        for (int line_no = 0; line_no < num_scanlines; line_no++) {
+            auto& convolver = convolvers[thread_idx];
+            const auto time_proj = m_block_time_proj[line_no];
+            auto convolver_signal = convolver->get_zeroed_time_proj_signal();
+            std::copy(time_proj, time_proj + m_time_proj_num_samples, convolver_signal);
+            process_time_proj_signal(line_no, convolver_signal, convolver);
+        }
+    }
+#else
+    throw std::runtime_error("Scatterer-parallel simulation requires OpenMP");
 #endif
-    for (int line_no = 0; line_no < num_scanlines; line_no++) {
-        const auto& line = m_scan_sequence->get_scanline(line_no);
-        if (m_param_verbose) {
-            m_log_object->write(ILog::INFO, "Simulating line number " + std::to_string(line_no));
+}
+
+void CpuAlgorithm::project_fixed_scatterers(int first_line_no, int num_lines, std::complex<float>* const* time_proj_signals,
+                                            int part_no, int num_parts) {
+    const auto tile_size = static_cast<size_t>(m_param_scatterer_tile_size);
+    std::vector<ScattererGrid::IndexRange> ranges;
+    const auto first_subset = m_active_subsets.first;
+    const auto end_subset = m_active_subsets.second;
+    for (size_t dset_idx = 0; dset_idx < m_scatterers_collection.fixed_collections.size(); dset_idx++) {
+        const auto fixed_scatterers = &node_local_fixed_dataset(dset_idx);
+        const auto active = fixed_scatterers->subset_range(first_subset, end_subset);
+        const auto num_active = active.second - active.first;
+        const ScattererGrid::IndexRange part(active.first + num_active*part_no/num_parts,
+                                             active.first + num_active*(part_no + 1)/num_parts);
+        if (m_param_scatterer_culling && !fixed_scatterers->grid.empty()) {
+            for (int k = 0; k < num_lines; k++) {
+                const auto& line = m_scan_sequence->get_scanline(first_line_no + k);
+                fixed_scatterers->grid.find_ranges(line, m_culling_region, first_subset, end_subset, ranges);
+                for (const auto& range : ranges) {
+                    const auto begin = std::max(range.first, part.first);
+                    const auto end = std::min(range.second, part.second);
+                    if (begin < end) {
+                        (this->*m_fixed_projection_loop)(*fixed_scatterers, line, time_proj_signals[k], m_time_proj_num_samples,
+                                                         begin, end);
+                    }
+                }
+            }
+        } else if (m_param_scatterer_culling && fixed_scatterers->image_volume) {
+            // the scatterers of the voxels close to each line are generated
+            // into the tile buffer of the thread
+            auto& tile = m_procedural_tiles[thread_no()];
+            for (int k = 0; k < num_lines; k++) {
+                const auto& line = m_scan_sequence->get_scanline(first_line_no + k);
+                find_voxel_ranges(*fixed_scatterers->image_volume, line, m_culling_region, ranges);
+                for (const auto& range : ranges) {
+                    const auto begin = std::max(range.first, part.first);
+                    const auto end = std::min(range.second, part.second);
+                    for (size_t tile_begin = begin; tile_begin < end; tile_begin += tile_size) {
+                        const auto tile_end = std::min(end, tile_begin + tile_size);
+                        tile.generate_tile(*fixed_scatterers->image_volume, tile_begin, tile_end);
+                        (this->*m_fixed_projection_loop)(tile, line, time_proj_signals[k], m_time_proj_num_samples,
+                                                         0, tile_end - tile_begin);
+                    }
+                }
+            }
+        } else {
+            for (size_t tile_begin = part.first; tile_begin < part.second; tile_begin += tile_size) {
+                const auto tile_end = std::min(part.second, tile_begin + tile_size);
+                // generated scatterers are written to the tile buffer of the thread
+                const HostFixedScatterers* tile_scatterers = fixed_scatterers;
+                size_t begin = tile_begin;
+                size_t end = tile_end;
+                if (fixed_scatterers->is_generated()) {
+                    auto& tile = m_procedural_tiles[thread_no()];
+                    if (fixed_scatterers->procedural) {
+                        tile.generate_tile(*fixed_scatterers->procedural, tile_begin, tile_end);
+                    } else {
+                        tile.generate_tile(*fixed_scatterers->image_volume, tile_begin, tile_end);
+                    }
+                    tile_scatterers = &tile;
+                    begin = 0;
+                    end = tile_end - tile_begin;
+                }
+                for_each_transmit(first_line_no, num_lines, [&](int transmit_line_no, int num_transmit_lines) {
+                    const int k = transmit_line_no - first_line_no;
+                    if (num_transmit_lines > 1) {
+                        (this->*m_fixed_mla_projection_loop)(*tile_scatterers, transmit_line_no, num_transmit_lines,
+                                                             time_proj_signals + k, m_time_proj_num_samples, begin, end);
+                    } else {
+                        const auto& line = m_scan_sequence->get_scanline(transmit_line_no);
+                        (this->*m_fixed_projection_loop)(*tile_scatterers, line, time_proj_signals[k], m_time_proj_num_samples,
+                                                         begin, end);
+                    }
+                });
+            }
+        }
+    }
+}
+
+void CpuAlgorithm::project_line_block(int first_line_no, int num_lines, std::complex<float>* const* time_proj_signals,
+                                      int part_no, int num_parts) {
+    const auto tile_size = static_cast<size_t>(m_param_scatterer_tile_size);
+    const auto stage_times = thread_stage_times();
+    const auto part_range = [part_no, num_parts](size_t num_scatterers) {
+        return ScattererGrid::IndexRange(num_scatterers*part_no/num_parts, num_scatterers*(part_no + 1)/num_parts);
+    };
+
+    // Project all fixed scatterers. Culled datasets use the ranges close to
+    // each line, the others are processed in tiles which are projected onto
+    // all lines in the block before moving to the next tile, one transmit of
+    // a multi-line acquisition at a time. The buffers only
+    // hold the fixed scatterers after this, which is what is cached. Lines
+    // of an ensemble add the projection onto their common geometry instead.
+    trace::ScopedEvent fixed_event("fixed_projection", "cpu");
+    StageTimer fixed_timer(stage_times ? &stage_times->fixed_projection_ms : nullptr);
+    if (m_use_ensemble_projection) {
+        for (int k = 0; (part_no == 0) && (k < num_lines); k++) {
+            for (size_t i = 0; i < m_time_proj_num_samples; i++) {
+                time_proj_signals[k][i] += m_ensemble_fixed_projection[i];
+            }
+        }
+    } else {
+        const auto num_scanlines = m_line_outputs.size();
+        const auto cached_projection = [&](int k) -> std::vector<std::complex<float>>& {
+            return m_fixed_projection_cache[part_no*num_scanlines + first_line_no + k];
+        };
+        const bool use_cached_projections = m_param_fixed_projection_cache && m_fixed_projection_cache_valid;
+        if (use_cached_projections) {
+            for (int k = 0; k < num_lines; k++) {
+                const auto& time_proj = cached_projection(k);
+                for (size_t i = 0; i < m_time_proj_num_samples; i++) {
+                    time_proj_signals[k][i] += time_proj[i];
+                }
+            }
+        } else {
+            project_fixed_scatterers(first_line_no, num_lines, time_proj_signals, part_no, num_parts);
+            if (m_param_fixed_projection_cache) {
+                for (int k = 0; k < num_lines; k++) {
+                    std::copy(time_proj_signals[k], time_proj_signals[k] + m_time_proj_num_samples, cached_projection(k).begin());
+                }
+            }
+        }
+    }
+    fixed_timer.stop();
+    fixed_event.end();
+
+    // Project all spline scatterers, using the pre-rendered positions if a
+    // line's timestamp is shared with other lines. The lines of an ensemble
+    // are projected together, unless one of them is rendered, and so are
+    // the lines of a transmit.
+    trace::ScopedEvent spline_event("spline_projection", "cpu");
+    StageTimer spline_timer(stage_times ? &stage_times->spline_projection_ms : nullptr);
+    bool use_ensemble_loop = m_use_ensemble_projection;
+    for (int k = 0; use_ensemble_loop && (k < num_lines); k++) {
+        use_ensemble_loop = find_rendered_splines(first_line_no + k) == nullptr;
+    }
+    // the splines belong to the first scatterer subset
+    const auto num_spline_collections = (m_param_scatterer_subset_begin == 0) ? m_scatterers_collection.spline_collections.size() : 0;
+    for (size_t dset_idx = 0; dset_idx < num_spline_collections; dset_idx++) {
+        const auto& spline_scatterers = *m_scatterers_collection.spline_collections[dset_idx];
+        const auto part = part_range(static_cast<size_t>(spline_scatterers.num_scatterers()));
+        for (size_t tile_begin = part.first; tile_begin < part.second; tile_begin += tile_size) {
+            const auto tile_end = std::min(part.second, tile_begin + tile_size);
+            if (use_ensemble_loop) {
+                (this->*m_spline_ensemble_projection_loop)(spline_scatterers, first_line_no, num_lines, time_proj_signals,
+                                                           m_time_proj_num_samples, tile_begin, tile_end);
+                continue;
+            }
+            for_each_transmit(first_line_no, num_lines, [&](int transmit_line_no, int num_transmit_lines) {
+                const int k = transmit_line_no - first_line_no;
+                const auto& line = m_scan_sequence->get_scanline(transmit_line_no);
+                const auto rendered_splines = find_rendered_splines(transmit_line_no);
+                if (rendered_splines && (num_transmit_lines > 1)) {
+                    (this->*m_fixed_mla_projection_loop)(*(*rendered_splines)[dset_idx], transmit_line_no, num_transmit_lines,
+                                                         time_proj_signals + k, m_time_proj_num_samples, tile_begin, tile_end);
+                } else if (rendered_splines) {
+                    (this->*m_fixed_projection_loop)(*(*rendered_splines)[dset_idx], line, time_proj_signals[k], m_time_proj_num_samples,
+                                                     tile_begin, tile_end);
+                } else if (num_transmit_lines > 1) {
+                    (this->*m_spline_mla_projection_loop)(spline_scatterers, transmit_line_no, num_transmit_lines,
+                                                          time_proj_signals + k, m_time_proj_num_samples, tile_begin, tile_end);
+                } else {
+                    (this->*m_spline_projection_loop)(spline_scatterers, line, time_proj_signals[k], m_time_proj_num_samples,
+                                                      tile_begin, tile_end);
+                }
+            });
         }
-        rfLines[line_no] = simulate_line(line);
     }
 }
 
-std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& line) {
+void CpuAlgorithm::simulate_line_block(int first_line_no, int num_lines) {
+    trace::ScopedEvent event("simulate_line_block", "cpu");
 #ifdef BCSIM_ENABLE_OPENMP
     const int thread_idx = omp_get_thread_num();
 #else
@@ -309,26 +1788,39 @@ std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& lin
     if (m_param_verbose) {
         m_log_object->write(ILog::DEBUG, "Thread ID: " + std::to_string(thread_idx));
     }
-    
-    // this will have length num_time_samples [which is valid before padding starts]
-    auto time_proj_signal = convolvers[thread_idx]->get_zeroed_time_proj_signal();
+    auto& convolver = convolvers[thread_idx];
 
-    // Project all fixed scatterers
-    const auto num_fixed_collections = m_scatterers_collection.fixed_collections.size();
-    for (size_t i = 0; i < num_fixed_collections; i++) {
-        const auto fixed_scatterers = m_scatterers_collection.fixed_collections[i];
-        projection_loop(fixed_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+    // A single line is projected directly into the convolver's buffer, which
+    // has length num_time_samples [which is valid before padding starts].
+    // The lines of a larger block are projected into the thread's arena.
+    auto& arena = m_thread_arenas[thread_idx];
+    arena.reset();
+    auto time_proj_signals = arena.allocate<std::complex<float>*>(num_lines);
+    if (num_lines == 1) {
+        time_proj_signals[0] = convolver->get_zeroed_time_proj_signal();
+    } else {
+        for (int k = 0; k < num_lines; k++) {
+            time_proj_signals[k] = arena.allocate_zeroed<std::complex<float>>(m_time_proj_num_samples);
+        }
     }
-    
-    // Project all spline scatterers
-    const auto num_spline_collections = m_scatterers_collection.spline_collections.size();
-    for (size_t i = 0; i < num_spline_collections; i++) {
-        const auto spline_scatterers = m_scatterers_collection.spline_collections[i];
-        projection_loop(spline_scatterers, line, time_proj_signal, m_rf_line_num_samples);
+
+    project_line_block(first_line_no, num_lines, time_proj_signals);
+
+    for (int k = 0; k < num_lines; k++) {
+        const int line_no = first_line_no + k;
+        auto time_proj_signal = time_proj_signals[k];
+        if (num_lines > 1) {
+            auto convolver_signal = convolver->get_zeroed_time_proj_signal();
+            std::copy(time_proj_signal, time_proj_signal + m_time_proj_num_samples, convolver_signal);
+            time_proj_signal = convolver_signal;
+        }
+        process_time_proj_signal(line_no, time_proj_signal, convolver);
     }
-    
+}
+
+void CpuAlgorithm::process_time_proj_signal(int line_no, std::complex<float>* time_proj_signal, IBeamConvolver::ptr& convolver) {
 #ifdef BCSIM_ENABLE_NAN_CHECK
-    for (size_t i = 0; i < m_rf_line_num_samples; i++) {
+    for (size_t i = 0; i < m_time_proj_num_samples; i++) {
         // NOTE: will probably not work if compile with "fast-math", so it makes
         // most sense to do this check for debug builds.
         if (time_proj_signal[i] != time_proj_signal[i])  {
@@ -337,49 +1829,171 @@ std::vector<std::complex<float>> CpuAlgorithm::simulate_line(const Scanline& lin
     }
 #endif
 
+    const auto stage_times = thread_stage_times();
+
     // add Gaussian noise if desirable.
     if (m_param_noise_amplitude > 0.0f) {
-        std::transform(time_proj_signal, time_proj_signal + m_rf_line_num_samples, time_proj_signal, [&](std::complex<float> v) {
-            const auto noise_real = m_normal_dist(m_random_engine);
-            const auto noise_imag = m_normal_dist(m_random_engine);
-            return v + std::complex<float>(noise_real, noise_imag);
-        });
-    }
-
-    // get the convolver associated with this thread and do FFT-based convolution
-    // complex down-shifting to form a proper IQ signal. TODO: consider precomputing the complex exponential
-    auto temp_line = convolvers[thread_idx]->process();
-    // TODO: Consider merging decimateion. No need to compute samples that we later discard..
-    const auto f_demod = m_excitation.demod_freq;
-    const float norm_f_demod = f_demod/m_excitation.sampling_frequency;
-    const float TWO_PI = static_cast<float>(2.0*4.0*std::atan(1));
-    for (size_t i = 0; i < temp_line.size(); i++) {
-        temp_line[i] *= std::exp(-TWO_PI*std::complex<float>(0.0f, 1.0)*norm_f_demod*static_cast<float>(i));
+        trace::ScopedEvent event("noise", "cpu");
+        StageTimer timer(stage_times ? &stage_times->noise_ms : nullptr);
+        const philox::Key key{{static_cast<uint32_t>(m_param_noise_seed), static_cast<uint32_t>(m_param_noise_seed >> 32)}};
+        // the decimated grid has radial_decimation times fewer samples per pulse
+        const auto noise_amplitude = m_param_baseband ? m_param_noise_amplitude*std::sqrt(static_cast<float>(m_radial_decimation))
+                                                      : m_param_noise_amplitude;
+        philox::add_gaussian_noise(time_proj_signal, m_time_proj_num_samples, noise_amplitude, key,
+                                   static_cast<uint32_t>(line_no),
+                                   static_cast<uint32_t>(m_noise_frame_no),
+                                   static_cast<uint32_t>(m_noise_frame_no >> 32));
     }
-    
-    // Decimate
-    // TODO: Consider reserve to avoid unneeded allocations resulting from push_back()?
-    std::vector<std::complex<float>> res;
-    for (int i = 0; i < static_cast<int>(temp_line.size()); i += m_radial_decimation) {
-        res.push_back(temp_line[i]);
+
+    if (m_use_output_convolvers) {
+        const int thread_idx = thread_no();
+        for (size_t k = 0; k < m_output_convolvers.size(); k++) {
+            auto& output_convolver = m_output_convolvers[k][thread_idx];
+            std::copy(time_proj_signal, time_proj_signal + m_time_proj_num_samples,
+                      output_convolver->get_zeroed_time_proj_signal());
+            {
+                StageTimer timer(stage_times ? &stage_times->convolution_ms : nullptr);
+                output_convolver->convolve();
+            }
+            StageTimer timer(stage_times ? &stage_times->demodulation_ms : nullptr);
+            output_convolver->write_output(m_line_outputs[line_no] + k*m_output_frame_stride);
+            apply_window_phase(m_line_outputs[line_no] + k*m_output_frame_stride);
+        }
+        return;
     }
 
-    return res;
+    // do FFT-based convolution, complex down-shifting and decimation to
+    // form a proper IQ signal.
+    {
+        StageTimer timer(stage_times ? &stage_times->convolution_ms : nullptr);
+        convolver->convolve();
+    }
+    // a formatted line is formed in the line buffer of the thread
+    const auto packed_output = !m_packed_line_outputs.empty();
+    const auto line_output = packed_output ? m_thread_iq_lines[thread_no()].data() : m_line_outputs[line_no];
+    {
+        StageTimer timer(stage_times ? &stage_times->demodulation_ms : nullptr);
+        convolver->write_output(line_output);
+        apply_window_phase(line_output);
+        if (packed_output) {
+            convert_iq_samples(line_output, m_packed_num_samples, m_packed_sample_type, m_packed_int16_scale,
+                               m_packed_line_outputs[line_no]);
+        }
+    }
+    // the line is final, so it is delivered by the thread which finished it
+    report_lines(static_cast<size_t>(line_no), 1, line_output, 0);
 }
 
-void CpuAlgorithm::configure_convolvers_if_possible() {
-    if (m_scan_sequence_configured && m_excitation_configured) {
-        convolvers.clear();
-        m_log_object->write(ILog::INFO, "Recreating convolvers");
+void CpuAlgorithm::update_convolvers() {
+    if (!m_convolvers_dirty) {
+        return;
+    }
+    const auto inputs = current_convolver_inputs();
+    const auto unchanged = !convolvers.empty() && same_convolver_setup(inputs, m_convolver_inputs)
+        && same_excitation(inputs.excitation, m_convolver_inputs.excitation);
+    m_convolvers_dirty = false;
+    // a window of the same length may start at another sample
+    const auto first_rf_sample = rf_sample_window().first_sample;
+    m_time_proj_first_sample = static_cast<int>(inputs.baseband ? first_rf_sample/m_radial_decimation : first_rf_sample);
+    m_window_phasor = window_demodulation_phasor(m_excitation, first_rf_sample);
+    if (unchanged) {
+        return;
+    }
+
+    // the old convolvers are freed first
+    convolvers.clear();
+    m_log_object->write(ILog::INFO, "Recreating convolvers");
+    for (int i = 0; i < m_omp_num_threads; i++) {
+        if (m_param_verbose) {
+            m_log_object->write(ILog::DEBUG, "Creating convolver number " + std::to_string(i));
+        }
+        
+        auto convolver = inputs.baseband
+            ? IBeamConvolver::CreateBaseband(inputs.num_rf_samples, m_excitation, m_radial_decimation)
+            : IBeamConvolver::Create(inputs.num_rf_samples, m_excitation, m_param_fft_backend,
+                                     inputs.real_input, m_radial_decimation, m_param_convolution_method);
+        convolver->set_sparse_threshold(static_cast<size_t>(m_param_sparse_convolution_threshold));
+        convolvers.push_back(std::move(convolver));
+    }
+    if (inputs.baseband) {
+        m_time_proj_num_samples = convolvers.front()->get_num_output_samples();
+        m_time_proj_sampling_frequency = m_excitation.sampling_frequency/m_radial_decimation;
+    } else {
+        m_time_proj_num_samples = inputs.num_rf_samples;
+        m_time_proj_sampling_frequency = m_excitation.sampling_frequency;
+    }
+    m_convolver_inputs = inputs;
+}
+
+CpuAlgorithm::ConvolverInputs CpuAlgorithm::current_convolver_inputs() const {
+    ConvolverInputs inputs;
+    inputs.num_rf_samples    = compute_rf_line_num_samples();
+    inputs.num_threads       = m_omp_num_threads;
+    inputs.fft_backend       = m_param_fft_backend;
+    inputs.convolution_method = m_param_convolution_method;
+    inputs.real_input        = use_real_convolution();
+    inputs.baseband          = m_param_baseband;
+    inputs.radial_decimation = m_radial_decimation;
+    inputs.excitation        = m_excitation;
+    return inputs;
+}
+
+bool CpuAlgorithm::same_convolver_setup(const ConvolverInputs& a, const ConvolverInputs& b) {
+    return (a.num_rf_samples == b.num_rf_samples) && (a.num_threads == b.num_threads)
+        && (a.fft_backend == b.fft_backend) && (a.convolution_method == b.convolution_method)
+        && (a.real_input == b.real_input) && (a.baseband == b.baseband)
+        && (a.radial_decimation == b.radial_decimation);
+}
+
+void CpuAlgorithm::update_output_convolvers(const std::vector<ExcitationSignal>& excitations) {
+    const auto inputs = current_convolver_inputs();
+    auto unchanged = (excitations.size() == m_output_excitations.size())
+        && same_convolver_setup(inputs, m_output_convolver_inputs);
+    for (size_t k = 0; unchanged && (k < excitations.size()); k++) {
+        unchanged = same_excitation(excitations[k], m_output_excitations[k]);
+    }
+    if (unchanged) {
+        return;
+    }
+
+    m_output_convolvers.clear();
+    m_log_object->write(ILog::INFO, "Recreating convolvers of " + std::to_string(excitations.size()) + " excitations");
+    for (const auto& excitation : excitations) {
+        std::vector<IBeamConvolver::ptr> thread_convolvers;
         for (int i = 0; i < m_omp_num_threads; i++) {
-            if (m_param_verbose) {
-                m_log_object->write(ILog::DEBUG, "Creating convolver number " + std::to_string(i));
-            }
-            
-            auto convolver = IBeamConvolver::Create(m_rf_line_num_samples, m_excitation);
-            convolvers.push_back(std::move(convolver));
+            thread_convolvers.push_back(IBeamConvolver::Create(inputs.num_rf_samples, excitation, m_param_fft_backend,
+                                                               inputs.real_input, m_radial_decimation,
+                                                               m_param_convolution_method));
+            thread_convolvers.back()->set_sparse_threshold(static_cast<size_t>(m_param_sparse_convolution_threshold));
         }
+        m_output_convolvers.push_back(std::move(thread_convolvers));
     }
+    m_output_excitations = excitations;
+    m_output_convolver_inputs = inputs;
+}
+
+size_t CpuAlgorithm::compute_rf_line_num_samples() const {
+    return rf_sample_window().num_samples;
+}
+
+RfSampleWindow CpuAlgorithm::rf_sample_window() const {
+    return compute_rf_sample_window(m_param_sound_speed, *m_scan_sequence, m_excitation, m_radial_decimation);
+}
+
+void CpuAlgorithm::apply_window_phase(std::complex<float>* iq_line) const {
+    if (m_time_proj_first_sample == 0) {
+        return;
+    }
+    const auto num_samples = (m_convolver_inputs.num_rf_samples + m_radial_decimation - 1)/m_radial_decimation;
+    for (size_t i = 0; i < num_samples; i++) {
+        iq_line[i] *= m_window_phasor;
+    }
+}
+
+bool CpuAlgorithm::use_real_convolution() const {
+    // Without phase delay and noise, only real values are written to the
+    // time-projection buffers.
+    return !m_enable_phase_delay && !m_param_baseband && (m_param_noise_amplitude <= 0.0f);
 }
 
 void CpuAlgorithm::throw_if_not_configured() {
@@ -398,6 +2012,7 @@ void CpuAlgorithm::throw_if_not_configured() {
 }
 
 void CpuAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    invalidate_fixed_projection_cache();
     m_log_object->write(ILog::INFO, "Setting analytical beam profile for CPU algorithm");
 
     const auto temp = std::dynamic_pointer_cast<GaussianBeamProfile>(beam_profile);
@@ -405,45 +2020,288 @@ void CpuAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
     m_cur_beam_profile_type = BeamProfileType::ANALYTICAL;
 
     m_beam_profile = beam_profile;
+    m_state.set_analytical_profile(beam_profile);
 }
 
 void CpuAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    invalidate_fixed_projection_cache();
     m_log_object->write(ILog::INFO, "Setting LUT beam profile for CPU algorithm");
 
-    const auto temp = std::dynamic_pointer_cast<LUTBeamProfile>(beam_profile);
-    if (!temp) throw std::runtime_error("CpuAlgorithm: failed to cast beam profile");
-    m_cur_beam_profile_type = BeamProfileType::LOOKUP;
+    if (std::dynamic_pointer_cast<LUTBeamProfile>(beam_profile)) {
+        m_cur_beam_profile_type = BeamProfileType::LOOKUP;
+    } else if (std::dynamic_pointer_cast<MultiResolutionLUTBeamProfile>(beam_profile)) {
+        m_cur_beam_profile_type = BeamProfileType::MULTI_RESOLUTION_LOOKUP;
+    } else {
+        throw std::runtime_error("CpuAlgorithm: failed to cast beam profile");
+    }
 
     m_beam_profile = beam_profile;
+    m_state.set_lookup_profile(beam_profile);
 }
 
 void CpuAlgorithm::clear_fixed_scatterers() {
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
     m_scatterers_collection.fixed_collections.clear();
+    m_state.clear_fixed_scatterers();
 }
 
 void CpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
-    m_scatterers_collection.fixed_collections.push_back(fixed_scatterers);
+    trace::ScopedEvent event("add_fixed_scatterers", "cpu");
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
+    auto& collections = m_scatterers_collection.fixed_collections;
+    const auto num_subsets = static_cast<size_t>(m_param_scatterer_subsets);
+    // a restored state may have the dataset sorted already
+    auto layout = restored_fixed_layout(collections.size(), num_subsets);
+    collections.push_back(layout ? layout : std::make_shared<HostFixedScatterers>(*fixed_scatterers, m_param_scatterer_order,
+                                                                                   num_subsets));
+    m_state.add_fixed_scatterers(fixed_scatterers);
     if (m_param_verbose) {
         m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
         m_log_object->write(ILog::INFO, "Number of spline scatterers: " + std::to_string(m_scatterers_collection.total_num_spline_scatterers()));
     }
 }
 
+void CpuAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
+    m_scatterers_collection.fixed_collections.push_back(std::make_shared<HostFixedScatterers>(image_volume_scatterers,
+                                                                                              static_cast<size_t>(m_param_scatterer_subsets)));
+    m_state.add_image_volume_scatterers(image_volume_scatterers);
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
+    }
+}
+
+void CpuAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
+    m_scatterers_collection.fixed_collections.push_back(std::make_shared<HostFixedScatterers>(procedural_scatterers,
+                                                                                              static_cast<size_t>(m_param_scatterer_subsets)));
+    m_state.add_procedural_scatterers(procedural_scatterers);
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
+    }
+}
+
+void CpuAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    trace::ScopedEvent event("add_external_fixed_scatterers", "cpu");
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
+    auto dataset = std::make_shared<HostFixedScatterers>(external_scatterers, m_param_scatterer_order,
+                                                         static_cast<size_t>(m_param_scatterer_subsets));
+    if ((dataset->get_num_scatterers() > 0) && dataset->grid.empty()) {
+        m_log_object->write(ILog::INFO, "External scatterers are not sorted for culling, projecting all of them");
+    }
+    m_scatterers_collection.fixed_collections.push_back(dataset);
+    m_state.add_external_fixed_scatterers(external_scatterers);
+    if (m_param_verbose) {
+        m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
+    }
+}
+
 void CpuAlgorithm::clear_spline_scatterers() {
     m_scatterers_collection.spline_collections.clear();
+    m_rendered_splines.clear();
+    m_spline_cache_index.clear();
+    m_spline_cache_line_slots.clear();
+    m_state.clear_spline_scatterers();
 }
 
 void CpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    trace::ScopedEvent event("add_spline_scatterers", "cpu");
     m_scatterers_collection.spline_collections.push_back(spline_scatterers);
+    m_state.add_spline_scatterers(spline_scatterers);
     if (m_param_verbose) {
         m_log_object->write(ILog::INFO, "Number of fixed scatterers: " + std::to_string(m_scatterers_collection.total_num_fixed_scatterers()));
         m_log_object->write(ILog::INFO, "Number of spline scatterers: " + std::to_string(m_scatterers_collection.total_num_spline_scatterers()));
     }
 }
 
+void CpuAlgorithm::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                           const std::vector<PointScatterer>& new_scatterers) {
+    trace::ScopedEvent event("update_fixed_scatterers", "cpu");
+    invalidate_fixed_projection_cache();
+    invalidate_numa_placement();
+    if (dset_idx >= m_scatterers_collection.fixed_collections.size()) {
+        throw std::runtime_error("Illegal dataset index");
+    }
+    auto& dataset = *m_scatterers_collection.fixed_collections[dset_idx];
+    if (!dataset.update(indices, new_scatterers)) {
+        m_log_object->write(ILog::INFO, "Scatterers moved out of their grid cells, sorting dataset again");
+        dataset.sort_by_grid(m_param_scatterer_order, static_cast<size_t>(m_param_scatterer_subsets));
+    }
+    m_state.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+}
+
+void CpuAlgorithm::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                            const SplineScatterers& new_scatterers) {
+    trace::ScopedEvent event("update_spline_scatterers", "cpu");
+    auto& collections = m_scatterers_collection.spline_collections;
+    if (dset_idx >= collections.size()) {
+        throw std::runtime_error("Illegal dataset index");
+    }
+    // the dataset is shared with the caller until it is first updated
+    if (collections[dset_idx].use_count() > 1) {
+        collections[dset_idx] = std::make_shared<SplineScatterers>(*collections[dset_idx]);
+    }
+    update_spline_dataset(*collections[dset_idx], indices, new_scatterers);
+    m_state.update_spline_scatterers(dset_idx, indices, new_scatterers);
+}
+
+HostFixedScatterers::s_ptr CpuAlgorithm::kept_fixed_layout(size_t dset_idx) const {
+    const auto& collections = m_scatterers_collection.fixed_collections;
+    if ((dset_idx >= collections.size()) || collections[dset_idx]->is_generated() || collections[dset_idx]->external) {
+        return nullptr;
+    }
+    return collections[dset_idx];
+}
+
 size_t CpuAlgorithm::get_total_num_scatterers() const {
     return m_scatterers_collection.total_num_scatterers();
 }
 
+namespace {
+
+size_t spline_scatterers_bytes(const SplineScatterers& splines) {
+    return (splines.control_xs.capacity() + splines.control_ys.capacity() + splines.control_zs.capacity()
+            + splines.amplitudes.capacity() + splines.knot_vector.capacity())*sizeof(float);
+}
+
+size_t beam_profile_bytes(const IBeamProfile::s_ptr& beam_profile) {
+    const auto lut_profile = std::dynamic_pointer_cast<LUTBeamProfile>(beam_profile);
+    const auto multi_resolution_profile = std::dynamic_pointer_cast<MultiResolutionLUTBeamProfile>(beam_profile);
+    if (lut_profile) {
+        return lut_profile->getSamples().capacity()*sizeof(float);
+    } else if (multi_resolution_profile) {
+        return multi_resolution_profile->getNumSamples()*sizeof(float);
+    }
+    return 0;
+}
+
+}   // namespace
+
+MemoryUsage CpuAlgorithm::get_memory_usage() const {
+    MemoryUsage usage;
+    add_base_memory_usage(usage);
+
+    size_t fixed_bytes = 0;
+    for (const auto& fixed_scatterers : m_scatterers_collection.fixed_collections) {
+        fixed_bytes += fixed_scatterers->get_num_bytes();
+    }
+    size_t spline_bytes = 0;
+    for (const auto& spline_scatterers : m_scatterers_collection.spline_collections) {
+        spline_bytes += spline_scatterers_bytes(*spline_scatterers);
+    }
+    size_t rendered_bytes = 0;
+    for (const auto& rendered_datasets : m_rendered_splines) {
+        for (const auto& rendered : rendered_datasets) {
+            if (rendered) rendered_bytes += rendered->get_num_bytes();
+        }
+    }
+    size_t time_proj_bytes = 0;
+    for (const auto& arena : m_thread_arenas) {
+        time_proj_bytes += arena.capacity();
+    }
+    for (const auto& tile : m_procedural_tiles) {
+        fixed_bytes += tile.get_num_bytes();
+    }
+    usage.host["fixed_scatterers"] = fixed_bytes;
+    usage.host["spline_scatterers"] = spline_bytes;
+    usage.host["rendered_splines"] = rendered_bytes;
+    usage.host["time_projections"] = time_proj_bytes;
+    for (const auto& line : m_thread_iq_lines) {
+        usage.host["image_buffers"] += line.capacity()*sizeof(std::complex<float>);
+    }
+    size_t cache_bytes = 0;
+    for (const auto& time_proj : m_fixed_projection_cache) {
+        cache_bytes += time_proj.capacity()*sizeof(std::complex<float>);
+    }
+    usage.host["fixed_projection_cache"] = cache_bytes;
+    size_t node_copy_bytes = 0;
+    for (const auto& node_datasets : m_node_fixed_datasets) {
+        for (const auto& dataset : node_datasets) {
+            if (dataset) node_copy_bytes += dataset->get_num_bytes();
+        }
+    }
+    usage.host["numa_fixed_scatterers"] = node_copy_bytes;
+    usage.host["ensemble_fixed_projection"] = m_ensemble_fixed_projection.capacity()*sizeof(std::complex<float>);
+    if (!convolvers.empty()) {
+        const auto& inputs = m_convolver_inputs;
+        const auto convolver_bytes = inputs.baseband
+            ? IBeamConvolver::get_baseband_memory_usage(inputs.num_rf_samples, inputs.excitation, inputs.radial_decimation)
+            : IBeamConvolver::get_memory_usage(inputs.num_rf_samples, inputs.excitation, inputs.fft_backend,
+                                               inputs.real_input, inputs.radial_decimation, inputs.convolution_method);
+        usage.host["convolvers"] = convolvers.size()*convolver_bytes
+            + IBeamConvolver::get_shared_memory_usage(inputs.num_rf_samples, inputs.excitation, inputs.radial_decimation);
+        const auto& output_inputs = m_output_convolver_inputs;
+        for (size_t k = 0; k < m_output_convolvers.size(); k++) {
+            usage.host["convolvers"] += m_output_convolvers[k].size()
+                * IBeamConvolver::get_memory_usage(output_inputs.num_rf_samples, m_output_excitations[k],
+                                                   output_inputs.fft_backend, output_inputs.real_input,
+                                                   output_inputs.radial_decimation, output_inputs.convolution_method);
+        }
+    } else {
+        usage.host["convolvers"] = 0;
+    }
+    usage.host["beam_profile"] = beam_profile_bytes(m_beam_profile);
+    return usage;
+}
+
+MemoryUsage CpuAlgorithm::predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                               size_t num_spline_scatterers, int num_cs) const {
+    if (!m_excitation_configured) {
+        throw std::runtime_error("Excitation not configured.");
+    }
+    const auto num_threads = static_cast<size_t>(m_omp_num_threads);
+    const auto num_rf_samples = compute_rf_sample_window(m_param_sound_speed, scan_seq, m_excitation, m_radial_decimation).num_samples;
+
+    // the spline cache renders the splines for every timestamp shared by several lines
+    size_t num_rendered_timestamps = 0;
+    if (m_param_spline_cache && (num_spline_scatterers > 0)) {
+        std::map<float, int> num_lines_per_timestamp;
+        for (int line_no = 0; line_no < scan_seq.get_num_lines(); line_no++) {
+            num_lines_per_timestamp[scan_seq.get_scanline(line_no).get_timestamp()]++;
+        }
+        for (const auto& entry : num_lines_per_timestamp) {
+            if (entry.second >= 2) num_rendered_timestamps++;
+        }
+    }
+    const bool use_ensemble_projection = m_param_ensemble_projection && has_single_geometry(scan_seq);
+    const int mla_lines = (m_param_mla_projection && !use_ensemble_projection) ? mla_group_size(scan_seq) : 1;
+    const auto line_block_size = static_cast<size_t>(use_ensemble_projection
+                                                     ? std::max(m_param_line_block_size, MIN_ENSEMBLE_LINE_BLOCK_SIZE)
+                                                     : (m_param_line_block_size + mla_lines - 1)/mla_lines*mla_lines);
+
+    MemoryUsage usage;
+    usage.host["scan_sequence"] = scan_sequence_bytes(scan_seq);
+    usage.host["image_buffers"] = 0;
+    usage.host["fixed_scatterers"] = (num_fixed_scatterers > 0)
+        ? HostFixedScatterers::predict_num_bytes(num_fixed_scatterers, m_param_scatterer_order,
+                                                 static_cast<size_t>(m_param_scatterer_subsets)) : 0;
+    usage.host["spline_scatterers"] = (num_spline_scatterers > 0)
+        ? num_spline_scatterers*(3*num_cs + 1)*sizeof(float) : 0;
+    usage.host["rendered_splines"] = num_rendered_timestamps*num_spline_scatterers*4*sizeof(float);
+    const auto decimation = static_cast<size_t>(m_radial_decimation);
+    const auto num_time_proj_samples = m_param_baseband ? (num_rf_samples + decimation - 1)/decimation : num_rf_samples;
+    usage.host["time_projections"] = (line_block_size > 1)
+        ? num_threads*line_block_size*num_time_proj_samples*sizeof(std::complex<float>) : 0;
+    // one projection per line, or per thread and line if they are split by scatterers
+    const auto num_lines = static_cast<size_t>(scan_seq.get_num_lines());
+    const auto num_cache_parts = (num_lines < num_threads) ? num_threads : 1;
+    usage.host["fixed_projection_cache"] = (m_param_fixed_projection_cache && !use_ensemble_projection)
+        ? num_cache_parts*num_lines*num_time_proj_samples*sizeof(std::complex<float>) : 0;
+    usage.host["ensemble_fixed_projection"] = use_ensemble_projection ? num_time_proj_samples*sizeof(std::complex<float>) : 0;
+    const auto convolver_bytes = m_param_baseband
+        ? IBeamConvolver::get_baseband_memory_usage(num_rf_samples, m_excitation, m_radial_decimation)
+        : IBeamConvolver::get_memory_usage(num_rf_samples, m_excitation, m_param_fft_backend,
+                                           use_real_convolution(), m_radial_decimation, m_param_convolution_method);
+    usage.host["convolvers"] = num_threads*convolver_bytes
+        + IBeamConvolver::get_shared_memory_usage(num_rf_samples, m_excitation, m_radial_decimation);
+    usage.host["beam_profile"] = beam_profile_bytes(m_beam_profile);
+    return usage;
+}
+
 }   // namespace
 
@@ -28,26 +28,34 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <algorithm>
 #include <vector>
-#include <random>
+#include <map>
+#include <utility>
+#include <cstdint>
 #include "BaseAlgorithm.hpp"
 #include "../BCSimConfig.hpp"
 #include "../ScanSequence.hpp"
 #include "../BeamProfile.hpp"
 #include "../BeamConvolver.hpp"
+#include "../fractional_delay.hpp"
+#include "../ScratchArena.hpp"
+#include "CpuScatterers.hpp"
+#include "NumaTopology.hpp"
+#include "common_utils.hpp"
 
 namespace bcsim {
 
 // A collection or zero or more fixed and spline scatterer sets.
 struct PointScattererCollection {
-    std::vector<FixedScatterers::s_ptr>     fixed_collections;
+    std::vector<HostFixedScatterers::s_ptr> fixed_collections;
     std::vector<SplineScatterers::s_ptr>    spline_collections;
 
     // Compute the total number of fixed scatterers.
     size_t total_num_fixed_scatterers() const {
         size_t num_scatterers = 0;
         for (const auto& scatterers : fixed_collections) {
-            num_scatterers += scatterers->num_scatterers();
+            num_scatterers += scatterers->get_num_scatterers();
         }
         return num_scatterers;
     }
@@ -68,11 +76,22 @@ struct PointScattererCollection {
 };
 
 // Concrete CPU simulator implementation.
+// With the parameter store_kernel_details on, the following debug data is
+// stored for each frame, with times in milliseconds:
+//     cpu_spline_cache_ms, cpu_culling_ms, cpu_lines_ms: the stages of a frame
+//     cpu_fixed_projection_ms, cpu_spline_projection_ms, cpu_noise_ms,
+//     cpu_convolution_ms, cpu_demodulation_ms: per-thread time of each stage
+//     cpu_thread_busy_ms: per-thread sum of the above
+//     cpu_thread_imbalance: busiest thread's time divided by the mean
+//     cpu_thread_finish_ms: per-thread time from the start of the
+//     line-parallel loop until the thread finished its last line block
 class CpuAlgorithm : public BaseAlgorithm {
 public:
     CpuAlgorithm();
 
-    virtual ~CpuAlgorithm() { }
+    virtual ~CpuAlgorithm() {
+        wait_for_async_frames();
+    }
         
     virtual void set_parameter(const std::string& key, const std::string& value)                    override;
     
@@ -82,6 +101,25 @@ public:
 
     virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines)  override;
 
+    virtual void get_output_dimensions(size_t& num_lines, size_t& num_samples) const               override;
+
+    virtual float get_output_start_time() const                                                    override;
+
+    virtual void simulate_lines(std::complex<float>* iq_buffer, size_t line_stride)                 override;
+
+    // Projects the scatterers once and convolves each time-projection with
+    // all excitations. Uses the one frame per excitation of BaseAlgorithm in
+    // baseband mode, and with phase delay if the demodulation frequencies
+    // differ from the configured one, as the projection depends on them.
+    virtual void simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                 std::complex<float>* iq_buffer,
+                                                 size_t line_stride, size_t frame_stride) override;
+
+    // Converts each line in the output stage of the thread which finished
+    // it, except for the per-frame int16 scale which needs the whole frame.
+    virtual float simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer,
+                                           size_t line_stride)                                    override;
+
     virtual void set_analytical_profile(IBeamProfile::s_ptr beam_profile)                           override;
 
     virtual void set_lookup_profile(IBeamProfile::s_ptr beam_profile)                               override;
@@ -90,18 +128,131 @@ public:
 
     virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                                       override;
 
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                             override;
+
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)                          override;
+
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)                      override;
+
     virtual void clear_spline_scatterers()                                                          override;
 
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                                     override;
 
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers)         override;
+
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers)                   override;
+
     virtual size_t get_total_num_scatterers() const                                                 override;
 
+    // Host memory only.
+    virtual MemoryUsage get_memory_usage() const                                                    override;
+
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const        override;
+
 protected:
-    // Projection loop for a single fixed scatterer dataset.
-    void projection_loop(FixedScatterers::s_ptr fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples);
+    // The dataset as it is projected, unless it is generated or external.
+    virtual HostFixedScatterers::s_ptr kept_fixed_layout(size_t dset_idx) const                      override;
+
+    // Projection loop for the scatterers [scatterer_begin, scatterer_end) of a
+    // fixed scatterer dataset. The arc projection, phase delay and fractional
+    // delay flags and the beam profile type are resolved at compile time, so
+    // that the per-scatterer work has no branches or virtual calls.
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void fixed_projection_loop(const HostFixedScatterers& fixed_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                               size_t scatterer_begin, size_t scatterer_end);
     
-    // Projection loop for a single spline scatterer dataset.
-    void projection_loop(SplineScatterers::s_ptr spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples);
+    // Projection loop for the scatterers [scatterer_begin, scatterer_end) of a
+    // spline scatterer dataset.
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void spline_projection_loop(const SplineScatterers& spline_scatterers, const Scanline& line, std::complex<float>* time_proj_signal, size_t num_time_samples,
+                                size_t scatterer_begin, size_t scatterer_end);
+
+    // Projection loop for the scatterers [scatterer_begin, scatterer_end) of a
+    // spline dataset onto num_lines lines, starting at first_line_no, which
+    // share one geometry and only differ in their timestamps. The control
+    // points of each block of scatterers are mapped into the beam's
+    // coordinate system once, and since the splines are linear in the control
+    // points, each timestamp only sums its basis functions times these
+    // coordinates instead of projecting the evaluated positions.
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void spline_ensemble_projection_loop(const SplineScatterers& spline_scatterers, int first_line_no, int num_lines,
+                                         std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                         size_t scatterer_begin, size_t scatterer_end);
+
+    // Projection loops of the scatterers [scatterer_begin, scatterer_end) onto
+    // the num_lines receive lines, starting at first_line_no, of one transmit
+    // of a multi-line acquisition, which share the origin and timestamp. Each
+    // block of scatterers is loaded, or its splines evaluated, once and then
+    // projected onto all lines while it is in the L1 cache.
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void fixed_mla_projection_loop(const HostFixedScatterers& fixed_scatterers, int first_line_no, int num_lines,
+                                   std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                   size_t scatterer_begin, size_t scatterer_end);
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void spline_mla_projection_loop(const SplineScatterers& spline_scatterers, int first_line_no, int num_lines,
+                                    std::complex<float>* const* time_proj_signals, size_t num_time_samples,
+                                    size_t scatterer_begin, size_t scatterer_end);
+
+    // Add a block of scatterers with radial components rs, beam profile
+    // weights ws and amplitudes as to a time-projection signal.
+    template <bool use_phase_delay, bool use_fractional_delay>
+    void accumulate_spline_block(const float* rs, const float* ws, const float* as, int block_length,
+                                 std::complex<float>* time_proj_signal, size_t num_time_samples) const;
+
+    // The same for a block of fixed scatterers.
+    template <bool use_phase_delay, bool use_fractional_delay>
+    void accumulate_fixed_block(const float* rs, const float* ws, const float* as, int block_length,
+                                std::complex<float>* time_proj_signal, size_t num_time_samples) const;
+
+    // Select the specialized projection loops matching the current parameters.
+    // Called once at the start of every simulate_lines().
+    void select_projection_loops();
+
+    template <typename Profile>
+    void select_projection_loops_for_profile();
+
+    template <bool use_arc_projection, bool use_phase_delay, bool use_fractional_delay, typename Profile>
+    void set_projection_loops();
+
+    // Spread a scatterer at the non-integer time-projection sample position
+    // true_index over the taps of m_fractional_delay. With phase delay, each
+    // tap gets the phase delay from its own sample to true_index.
+    template <bool use_phase_delay>
+    void add_fractional_delay(std::complex<float>* time_proj_signal, int num_time_samples,
+                              float true_index, float amplitude) const;
+
+    // Compute the culling region of the beams from the current beam profile.
+    // Called once at the start of every simulate_lines().
+    void update_culling_region();
+
+    // Compute the B-spline basis functions of a spline dataset at a timestamp
+    // and the range of control points [lower_lim, upper_lim] to sum over.
+    void compute_spline_basis(const SplineScatterers& spline_scatterers, float timestamp,
+                              std::vector<float>& basis_functions, int& lower_lim, int& upper_lim);
+
+    // Render all spline datasets into fixed scatterers for every timestamp
+    // that is shared by more than one line of a frame in the scan sequence,
+    // so that these lines can use the fixed projection loop instead of
+    // evaluating the splines again. Called once at the start of every
+    // simulate_lines().
+    void render_spline_cache();
+
+    // Render all spline datasets at a timestamp into m_rendered_splines[slot].
+    void render_splines(size_t slot, float timestamp);
+
+    // Returns the spline datasets rendered for a line, or nullptr if the
+    // line evaluates the splines itself.
+    const std::vector<HostFixedScatterers::s_ptr>* find_rendered_splines(int line_no) const;
+
+    typedef void (CpuAlgorithm::*FixedProjectionLoop)(const HostFixedScatterers&, const Scanline&, std::complex<float>*, size_t, size_t, size_t);
+    typedef void (CpuAlgorithm::*SplineProjectionLoop)(const SplineScatterers&, const Scanline&, std::complex<float>*, size_t, size_t, size_t);
+    typedef void (CpuAlgorithm::*SplineEnsembleProjectionLoop)(const SplineScatterers&, int, int, std::complex<float>* const*, size_t,
+                                                               size_t, size_t);
+    typedef void (CpuAlgorithm::*FixedMlaProjectionLoop)(const HostFixedScatterers&, int, int, std::complex<float>* const*, size_t,
+                                                         size_t, size_t);
 
 protected:
     // Use as many cores as possible for simulation.
@@ -110,19 +261,158 @@ protected:
     // Use a specific number of cores for simulation.
     void set_use_specific_num_cores(int num_cores);
 
-    // Configure the convolvers to reflect the parameter settings
-    // if all relevant have values.
-    // Delete any old convolvers and create new which reflects the
-    // possibly changed result size.
-    void configure_convolvers_if_possible();
+    // Recreate the convolvers if they are marked dirty and their inputs
+    // have changed since they were created. Requires the scan sequence and
+    // excitation to be configured.
+    void update_convolvers();
+
+    // Recreate the convolvers of the excitations of
+    // simulate_lines_multi_excitation() if the excitations or the other
+    // convolver inputs have changed since they were created.
+    void update_output_convolvers(const std::vector<ExcitationSignal>& excitations);
+
+    // The number of time samples in each RF line with the current parameters.
+    size_t compute_rf_line_num_samples() const;
+
+    // The RF samples of a line which are simulated, see compute_rf_sample_window().
+    RfSampleWindow rf_sample_window() const;
+
+    // Rotate the IQ samples of a line of a depth window to the demodulation
+    // phase of the full line.
+    void apply_window_phase(std::complex<float>* iq_line) const;
+
+    // True if the time-projections are purely real with the current
+    // parameters, so that the convolvers can use real-input transforms.
+    bool use_real_convolution() const;
     
     // Throw a runtime_error if everything isn't properly configured.
     void throw_if_not_configured();
     
-    // Simulate a single RF line.
-    // Returns a std::vector of IQ signal samples.
-    // Sampling frequency is the same as for the excitation signal. TODO: Not so with decimation...
-    std::vector<std::complex<float>> simulate_line(const Scanline& line);
+    // Simulate all lines of the scan sequence into m_line_outputs, in blocks
+    // of m_param_line_block_size lines. If there are fewer lines than
+    // threads, the scatterers are split between the threads instead.
+    void simulate_all_lines();
+
+    // Simulate blocks of line_block_size() lines in parallel.
+    void simulate_lines_line_parallel();
+
+    // The number of lines per block of the line-parallel mode. The ensemble
+    // projection needs enough timestamps per block to pay off, and the
+    // blocks of a multi-line acquisition hold whole transmits.
+    static const int MIN_ENSEMBLE_LINE_BLOCK_SIZE = 32;
+    int line_block_size() const {
+        if (m_use_ensemble_projection) {
+            return std::max(m_param_line_block_size, MIN_ENSEMBLE_LINE_BLOCK_SIZE);
+        }
+        return (m_param_line_block_size + m_mla_lines - 1)/m_mla_lines*m_mla_lines;
+    }
+
+    // Call project(first_line_no, num_lines) for each transmit of the lines
+    // of a line block, which is one line at a time without multi-line
+    // acquisition.
+    template <typename Function>
+    void for_each_transmit(int first_line_no, int num_lines, Function project) const {
+        const int end_line = first_line_no + num_lines;
+        for (int line_no = first_line_no; line_no < end_line; ) {
+            const int transmit_end = std::min(end_line, (line_no/m_mla_lines + 1)*m_mla_lines);
+            project(line_no, transmit_end - line_no);
+            line_no = transmit_end;
+        }
+    }
+
+    // Project the fixed scatterers onto the common geometry of the lines,
+    // split between the threads, into m_ensemble_fixed_projection. Every
+    // line of the ensemble then adds this projection instead of projecting
+    // the fixed scatterers again.
+    void prepare_ensemble_fixed_projection();
+
+    // Allocate the fixed-projection cache for the lines split into num_parts
+    // parts of the scatterers, dropping its contents if they do not match.
+    void prepare_fixed_projection_cache(size_t num_parts);
+
+    void invalidate_fixed_projection_cache() {
+        m_fixed_projection_cache_valid = false;
+    }
+
+    // Simulate all lines with each thread projecting its own part of the
+    // scatterers into private time-projection buffers, which are summed by a
+    // pairwise tree reduction before the lines are convolved.
+    void simulate_lines_scatterer_parallel();
+
+    // Simulate the RF lines first_line_no, ..., first_line_no+num_lines-1 into
+    // m_line_outputs, each of which must have room for the number of samples
+    // given by get_output_dimensions().
+    // Sampling frequency is the excitation sampling frequency divided by the radial decimation.
+    void simulate_line_block(int first_line_no, int num_lines);
+
+    // Project all scatterers onto a block of lines. Each tile of
+    // m_param_scatterer_tile_size scatterers is projected onto all lines in
+    // the block before moving on, so that it is only loaded from memory once
+    // per block and not once per line. Only part part_no of num_parts equal
+    // sized parts of each scatterer dataset is projected.
+    void project_line_block(int first_line_no, int num_lines, std::complex<float>* const* time_proj_signals,
+                            int part_no = 0, int num_parts = 1);
+
+    // Check the scatterer subset parameters and store the subsets of the
+    // frame in m_active_subsets. Throws std::runtime_error if they are not
+    // within the number of subsets.
+    void update_active_subsets();
+
+    // Project part part_no of num_parts of the fixed scatterers onto a block
+    // of lines, tile by tile as described for project_line_block().
+    void project_fixed_scatterers(int first_line_no, int num_lines, std::complex<float>* const* time_proj_signals,
+                                  int part_no, int num_parts);
+
+    // Check, add noise to and convolve a finished time-projection signal,
+    // which must be the buffer of the convolver, and store the IQ line.
+    void process_time_proj_signal(int line_no, std::complex<float>* time_proj_signal, IBeamConvolver::ptr& convolver);
+
+    // Pin the threads and place the fixed datasets on the NUMA nodes as
+    // given by the parameter "cpu_numa". Called once at the start of every
+    // simulate_lines().
+    void prepare_numa();
+
+    // One scratch arena per thread.
+    void prepare_thread_arenas();
+
+    // The copy of a fixed dataset on the NUMA node of the calling thread,
+    // or the dataset itself if it has no copies.
+    const HostFixedScatterers& node_local_fixed_dataset(size_t dset_idx) const;
+
+    void invalidate_numa_placement() {
+        m_numa_placement_valid = false;
+    }
+
+    // Log the configuration used in simulate_lines() if verbose.
+    void log_simulation_info() const;
+
+    // Time [ms] one thread has spent in each stage of the current frame.
+    struct ThreadStageTimes {
+        ThreadStageTimes()
+            : fixed_projection_ms(0.0), spline_projection_ms(0.0), noise_ms(0.0),
+              convolution_ms(0.0), demodulation_ms(0.0), finish_ms(0.0) { }
+
+        double fixed_projection_ms;
+        double spline_projection_ms;
+        double noise_ms;
+        double convolution_ms;
+        double demodulation_ms;
+        double finish_ms;
+    };
+
+    // The stage times of the calling thread, or nullptr unless kernel
+    // details are stored.
+    ThreadStageTimes* thread_stage_times();
+
+    // The OpenMP thread number of the calling thread.
+    static int thread_no();
+
+    // Store the stage times of the frame as debug data.
+    void store_stage_times();
+
+    virtual ScanSequence::s_ptr current_scan_sequence() const override {
+        return m_scan_sequence;
+    }
 
 protected:
     // Geometry of all lines to be simulated in a frame.
@@ -131,11 +421,55 @@ protected:
     ExcitationSignal                         m_excitation;
     // Pointer to one FFT-convolver for each thread.
     std::vector<IBeamConvolver::ptr>         convolvers;
+    // Inputs of the convolvers when they were created.
+    struct ConvolverInputs {
+        size_t              num_rf_samples;
+        int                 num_threads;
+        std::string         fft_backend;
+        std::string         convolution_method;
+        bool                real_input;
+        bool                baseband;
+        int                 radial_decimation;
+        ExcitationSignal    excitation;
+    };
+    ConvolverInputs                          m_convolver_inputs;
+    // The inputs of the convolvers with the current parameters.
+    ConvolverInputs current_convolver_inputs() const;
+    // True if the inputs are equal except for the excitation.
+    static bool same_convolver_setup(const ConvolverInputs& a, const ConvolverInputs& b);
+    // One FFT-convolver for each thread and excitation of
+    // simulate_lines_multi_excitation(), indexed by excitation and thread,
+    // and their excitations and other inputs when they were created.
+    std::vector<std::vector<IBeamConvolver::ptr>>   m_output_convolvers;
+    std::vector<ExcitationSignal>            m_output_excitations;
+    ConvolverInputs                          m_output_convolver_inputs;
+    // If true, the IQ lines of the current frame are formed by the output
+    // convolvers, and the frame of excitation k starts k*m_output_frame_stride
+    // samples after the output line pointers.
+    bool                                     m_use_output_convolvers;
+    size_t                                   m_output_frame_stride;
+    // Set by the setters which change the inputs, so that a sequence of
+    // setters recreates the convolvers at most once, at the next frame.
+    bool                                     m_convolvers_dirty;
+    // FFT backend used when creating the convolvers.
+    std::string                              m_param_fft_backend;
+    // "auto", "fft" or "direct", see IBeamConvolver::Create().
+    std::string                              m_param_convolution_method;
+    // Lines with at most this many non-zero time-projection samples skip the
+    // FFTs, see IBeamConvolver::set_sparse_threshold(). 0 disables it.
+    int                                      m_param_sparse_convolution_threshold;
     
     PointScattererCollection                m_scatterers_collection;
     
-    // The number of time samples in each RF line in the scan sequence.
-    size_t                                  m_rf_line_num_samples;
+    // The number of time-projection samples of each line and their sampling
+    // frequency: the RF samples, or the IQ samples in baseband mode.
+    size_t                                  m_time_proj_num_samples;
+    float                                   m_time_proj_sampling_frequency;
+    // The time-projection sample of the line at the first sample of the
+    // buffers, which is not zero with a depth window, and the demodulation
+    // phasor of that sample.
+    int                                     m_time_proj_first_sample;
+    std::complex<float>                     m_window_phasor;
 
     // Configuration flags needed to ensure everything is configured
     // before doing the simulations.
@@ -145,10 +479,108 @@ protected:
     // Number of threads to use for simulation.
     int  m_omp_num_threads;
 
-    // Amplitude of Gaussian noise that will be added to the time-projected
-    // signal prior to convolution.
-    std::default_random_engine      m_random_engine;
-    std::normal_distribution<float> m_normal_dist;
+    // Gaussian noise that is added to the time-projected signal prior to
+    // convolution is generated with a counter-based generator keyed by the
+    // seed, so that the noise of a line only depends on (seed, frame, line)
+    // and not on the number of threads.
+    uint64_t                        m_param_noise_seed;
+    uint64_t                        m_noise_frame_no;       // incremented for every simulated frame
+
+    // Fractional-delay filter used instead of rounding the scatterers to the
+    // closest sample, or null if disabled.
+    std::unique_ptr<const FractionalDelayTable> m_fractional_delay;
+
+    // Projection loops selected by select_projection_loops().
+    FixedProjectionLoop             m_fixed_projection_loop;
+    SplineProjectionLoop            m_spline_projection_loop;
+    SplineEnsembleProjectionLoop    m_spline_ensemble_projection_loop;
+    FixedMlaProjectionLoop          m_fixed_mla_projection_loop;
+    SplineEnsembleProjectionLoop    m_spline_mla_projection_loop;
+
+    // If the current frame uses the ensemble projection: whether the scan
+    // sequence has a single geometry (updated by set_scan_sequence()), and
+    // the fixed-scatterer projection onto it, shared by all lines.
+    bool                                    m_single_geometry;
+    bool                                    m_use_ensemble_projection;
+    std::vector<std::complex<float>>        m_ensemble_fixed_projection;
+
+    // The lines per transmit of a multi-line acquisition (see
+    // BaseAlgorithm::mla_group_size()), updated by set_scan_sequence(), and
+    // those used by the current frame, which is one if disabled.
+    int                                     m_mla_group_size;
+    int                                     m_mla_lines;
+
+    // Spline datasets rendered by render_spline_cache(). Maps a timestamp to
+    // an index into m_rendered_splines, which has one entry per spline dataset,
+    // and has that index for each line that uses it, or -1.
+    // The rendered datasets are reused between frames to avoid reallocations.
+    bool                                                m_param_spline_cache;
+    std::map<float, size_t>                             m_spline_cache_index;
+    std::vector<int>                                    m_spline_cache_line_slots;
+    std::vector<std::vector<HostFixedScatterers::s_ptr>> m_rendered_splines;
+
+    // Fixed-scatterer time projections of each line if the parameter
+    // "cpu_fixed_projection_cache" is on. They are kept between frames while
+    // the line geometry, the beam profile, the fixed scatterers and the
+    // projection parameters are unchanged, so that later frames only project
+    // the splines. Indexed by part_no*num_lines + line_no, with one part per
+    // thread in the scatterer-parallel mode.
+    bool                                                m_param_fixed_projection_cache;
+    bool                                                m_fixed_projection_cache_valid;
+    size_t                                              m_fixed_projection_cache_num_parts;
+    std::vector<std::vector<std::complex<float>>>       m_fixed_projection_cache;
+
+    // Region around each beam used for culling fixed scatterers.
+    BeamCullingRegion               m_culling_region;
+
+    // Lines are simulated in blocks, and the scatterers are projected onto
+    // all lines in a block one tile at a time. Block size one is equivalent
+    // to simulating one line at a time (see line_block_size()).
+    int                                                 m_param_line_block_size;
+    // How the line blocks are handed to the threads with the parameters
+    // "cpu_line_schedule", which is "static", "dynamic" or "guided" as the
+    // OpenMP schedule kinds, and "cpu_line_schedule_chunk", the number of
+    // blocks per chunk, where zero is the OpenMP default. The lines differ
+    // in cost with culling and sector scans, so by default the threads take
+    // one block at a time.
+    std::string                                         m_param_line_schedule;
+    int                                                 m_param_line_schedule_chunk;
+    int                                                 m_param_scatterer_tile_size;
+
+    // Progressive simulation: the fixed datasets are split into
+    // "cpu_scatterer_subsets" stratified subsets (see ScattererGrid::build()),
+    // and only the subsets ["cpu_scatterer_subset_begin",
+    // "cpu_scatterer_subset_end") are projected, where an end of -1 is the
+    // number of subsets. The spline scatterers belong to the range which
+    // starts at subset zero, so that the frames of consecutive ranges add up
+    // to the full frame. A frame of m out of n subsets has m/n of the
+    // expected energy of a fully developed speckle pattern.
+    int                                                 m_param_scatterer_subsets;
+    int                                                 m_param_scatterer_subset_begin;
+    int                                                 m_param_scatterer_subset_end;
+    // The subsets of the current frame (see update_active_subsets()).
+    std::pair<size_t, size_t>                           m_active_subsets;
+    // Scratch memory of each thread for the time-projections of a block
+    // of lines, which is reset for every block. Backed by huge pages if the
+    // parameter "cpu_huge_pages" is on.
+    std::vector<ScratchArena>                           m_thread_arenas;
+    bool                                                m_param_huge_pages;
+    // The time-projections of every thread and line in the scatterer-
+    // parallel mode, indexed by thread_no*num_lines + line_no and allocated
+    // in the arenas of the threads.
+    std::vector<std::complex<float>*>                   m_block_time_proj;
+    // Scatterers of the current tile of a generated dataset for each thread.
+    std::vector<HostFixedScatterers>                    m_procedural_tiles;
+    // Output IQ line pointers of the current simulate_lines() call.
+    std::vector<std::complex<float>*>                   m_line_outputs;
+    // Output lines of the current simulate_lines_formatted() call, or empty
+    // for the lines of m_line_outputs, and their format. The lines are
+    // formed in a line buffer of each thread and converted from there.
+    std::vector<char*>                                  m_packed_line_outputs;
+    IqOutputFormat::SampleType                          m_packed_sample_type;
+    float                                               m_packed_int16_scale;
+    size_t                                              m_packed_num_samples;
+    std::vector<std::vector<std::complex<float>>>       m_thread_iq_lines;
 
     // Current active beam profile.
     IBeamProfile::s_ptr             m_beam_profile;         // TEMPORARY
@@ -156,6 +588,29 @@ protected:
     // Debug parameter: If true, sum over all B-spline basis functions instead of
     // only those with non-zero basis functions. Result should be the same.
     bool                       m_param_sum_all_cs;
+
+    // If true, the time spent in each stage is measured per thread and stored
+    // as debug data after each frame, like the GPU kernel timings.
+    bool                            m_store_kernel_details;
+    std::vector<ThreadStageTimes>   m_thread_stage_times;
+
+    // NUMA placement with the parameter "cpu_numa": "off" leaves the threads
+    // and the memory to the OS. "auto" pins the threads to spread them over
+    // the NUMA nodes and, on a machine with several nodes, copies the arrays
+    // of the fixed datasets to every node, where they are first written by a
+    // thread on the node so that the OS allocates them there, and each thread
+    // projects its node's copy. "interleave" pins the threads and spreads
+    // the pages of the arrays over the nodes instead, which does not need
+    // more memory. Procedural and external datasets are not placed.
+    std::string                     m_param_numa_mode;
+    NumaTopology                    m_numa_topology;
+    // The node of each thread, or empty if the threads are not pinned.
+    std::vector<int>                m_thread_nodes;
+    // The copies of "auto" indexed by node and dataset, with null for the
+    // datasets that are not copied.
+    std::vector<std::vector<HostFixedScatterers::s_ptr>>    m_node_fixed_datasets;
+    // False if the datasets have changed since they were placed.
+    bool                            m_numa_placement_valid;
 };
 
 }   // end namespace
@@ -0,0 +1,263 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include "../BCSimConfig.hpp"
+#include "ScattererGrid.hpp"
+
+namespace bcsim {
+
+// Host memory for a fixed-scatterer dataset stored as a structure
+// of arrays. This is the layout used by the CPU projection kernels,
+// since it allows loading several consecutive scatterers into one
+// SIMD register.
+class HostFixedScatterers {
+public:
+    typedef std::shared_ptr<HostFixedScatterers> s_ptr;
+
+    HostFixedScatterers() { }
+
+    // Reorganize a dataset of point scatterers. The scatterers are sorted
+    // by the cells of a ScattererGrid, which is used for culling, in the
+    // given cell order, and split into num_subsets stratified subsets.
+    explicit HostFixedScatterers(const FixedScatterers& host_scatterers,
+                                 ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH,
+                                 size_t num_subsets = 1) {
+        const auto num_scatterers = host_scatterers.scatterers.size();
+        resize(num_scatterers);
+        sorted_index.resize(num_scatterers);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            const auto& scatterer = host_scatterers.scatterers[i];
+            xs[i] = scatterer.pos.x;
+            ys[i] = scatterer.pos.y;
+            zs[i] = scatterer.pos.z;
+            as[i] = scatterer.amplitude;
+            sorted_index[i] = static_cast<uint32_t>(i);
+        }
+        if (num_scatterers > 0) {
+            sort_by_grid(order, num_subsets);
+        }
+    }
+
+    // A procedural dataset, whose scatterers are generated tile by tile with
+    // generate_tile() while projecting. It has no grid and cannot be updated.
+    explicit HostFixedScatterers(ProceduralScatterers::s_ptr procedural_scatterers, size_t num_subsets = 1)
+        : num_subsets(num_subsets), procedural(procedural_scatterers) { }
+
+    // An image volume dataset, which is generated like a procedural one.
+    explicit HostFixedScatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers, size_t num_subsets = 1)
+        : num_subsets(num_subsets), image_volume(image_volume_scatterers) { }
+
+    // A dataset in external memory, which is projected where it is. It is
+    // culled if it is already sorted by the grid, and cannot be updated.
+    HostFixedScatterers(ExternalFixedScatterers::s_ptr external_scatterers, ScattererGrid::CellOrder order,
+                        size_t num_subsets = 1)
+        : external(external_scatterers) {
+        if (external->count > 0) {
+            sort_by_grid(order, num_subsets);
+        }
+    }
+
+    // Store the scatterers [begin, end) of a procedural dataset, e.g. in a
+    // per-thread tile buffer.
+    void generate_tile(const ProceduralScatterers& scatterers, size_t begin, size_t end) {
+        resize(end - begin);
+        for (size_t i = begin; i < end; i++) {
+            const auto scatterer = scatterers.get_scatterer(i);
+            xs[i - begin] = scatterer.pos.x;
+            ys[i - begin] = scatterer.pos.y;
+            zs[i - begin] = scatterer.pos.z;
+            as[i - begin] = scatterer.amplitude;
+        }
+    }
+
+    void generate_tile(const ImageVolumeScatterers& scatterers, size_t begin, size_t end) {
+        resize(end - begin);
+        scatterers.generate(begin, end, xs.data(), ys.data(), zs.data(), as.data());
+    }
+
+    // True for the procedural and image volume datasets, whose scatterers
+    // are generated while projecting.
+    bool is_generated() const {
+        return procedural || image_volume;
+    }
+
+    // (Re)build the grid from the current positions and sort the scatterers
+    // by its subsets and cells.
+    // External scatterers cannot be moved, so their grid is only kept if
+    // they are in its order.
+    void sort_by_grid(ScattererGrid::CellOrder order, size_t new_num_subsets) {
+        const auto num_scatterers = get_num_scatterers();
+        num_subsets = new_num_subsets;
+        cell_order = order;
+        std::vector<uint32_t> permutation;
+        grid.build(x_data(), y_data(), z_data(), num_scatterers, permutation, 16, order, num_subsets);
+        if (external) {
+            for (size_t i = 0; i < num_scatterers; i++) {
+                if (permutation[i] != i) {
+                    grid = ScattererGrid();
+                    break;
+                }
+            }
+            return;
+        }
+        const auto permute = [&](std::vector<float>& values) {
+            std::vector<float> sorted(num_scatterers);
+            for (size_t i = 0; i < num_scatterers; i++) {
+                sorted[i] = values[permutation[i]];
+            }
+            values.swap(sorted);
+        };
+        permute(xs);
+        permute(ys);
+        permute(zs);
+        permute(as);
+        std::vector<uint32_t> new_position(num_scatterers);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            new_position[permutation[i]] = static_cast<uint32_t>(i);
+        }
+        for (auto& index : sorted_index) {
+            index = new_position[index];
+        }
+    }
+
+    // Replace the scatterers with the given indices in the dataset as it was
+    // created. Returns false if a scatterer was moved out of its grid cell,
+    // in which case sort_by_grid() must be called before culling.
+    bool update(const std::vector<size_t>& indices, const std::vector<PointScatterer>& new_scatterers) {
+        if (is_generated()) {
+            throw std::runtime_error("procedural scatterers cannot be updated");
+        }
+        if (external) {
+            throw std::runtime_error("external scatterers cannot be updated");
+        }
+        if (indices.size() != new_scatterers.size()) {
+            throw std::runtime_error("number of indices and scatterers differ");
+        }
+        bool grid_is_valid = true;
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (indices[i] >= sorted_index.size()) {
+                throw std::runtime_error("scatterer index out of range");
+            }
+            const auto& scatterer = new_scatterers[i];
+            const auto dst = sorted_index[indices[i]];
+            xs[dst] = scatterer.pos.x;
+            ys[dst] = scatterer.pos.y;
+            zs[dst] = scatterer.pos.z;
+            as[dst] = scatterer.amplitude;
+            grid_is_valid = grid_is_valid && grid.is_in_cell_of(scatterer.pos, dst);
+        }
+        return grid_is_valid;
+    }
+
+    // The scatterers of the subsets [first_subset, end_subset), which are
+    // contiguous. The scatterers of a generated dataset are independent, so
+    // consecutive index ranges are its subsets. A dataset without a grid
+    // is all in the first subset.
+    ScattererGrid::IndexRange subset_range(size_t first_subset, size_t end_subset) const {
+        const auto num_scatterers = get_num_scatterers();
+        if (is_generated()) {
+            return ScattererGrid::IndexRange(num_scatterers*first_subset/num_subsets, num_scatterers*end_subset/num_subsets);
+        }
+        if (grid.empty()) {
+            return ScattererGrid::IndexRange(first_subset == 0 ? 0 : num_scatterers, num_scatterers);
+        }
+        return grid.subset_range(first_subset, end_subset);
+    }
+
+    // Change the number of scatterers. Existing values are kept.
+    void resize(size_t num_scatterers) {
+        xs.resize(num_scatterers);
+        ys.resize(num_scatterers);
+        zs.resize(num_scatterers);
+        as.resize(num_scatterers);
+    }
+
+    size_t get_num_scatterers() const {
+        if (procedural) {
+            return procedural->count;
+        }
+        if (image_volume) {
+            return image_volume->get_count();
+        }
+        return external ? external->count : xs.size();
+    }
+
+    // The arrays read by the projection kernels.
+    const float* x_data() const { return external ? external->xs : xs.data(); }
+    const float* y_data() const { return external ? external->ys : ys.data(); }
+    const float* z_data() const { return external ? external->zs : zs.data(); }
+    const float* a_data() const { return external ? external->as : as.data(); }
+
+    // Bytes of the scatterer arrays and the grid, without external arrays.
+    size_t get_num_bytes() const {
+        return (xs.capacity() + ys.capacity() + zs.capacity() + as.capacity())*sizeof(float)
+            + sorted_index.capacity()*sizeof(uint32_t) + grid.get_num_bytes();
+    }
+
+    // get_num_bytes() of a dataset created from num_scatterers scatterers.
+    static size_t predict_num_bytes(size_t num_scatterers, ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH,
+                                    size_t num_subsets = 1) {
+        return num_scatterers*(4*sizeof(float) + sizeof(uint32_t))
+            + ScattererGrid::predict_num_bytes(num_scatterers, 16, order, num_subsets);
+    }
+
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> zs;
+    std::vector<float> as;
+
+    // Number of subsets the scatterers are split into (see subset_range()).
+    size_t num_subsets = 1;
+
+    // Empty unless created from a FixedScatterers dataset.
+    ScattererGrid grid;
+
+    // Order of the grid cells the scatterers are sorted in.
+    ScattererGrid::CellOrder cell_order = ScattererGrid::CellOrder::DEPTH;
+
+    // Position in the sorted arrays of each scatterer of the dataset it was
+    // created from. Empty unless created from a FixedScatterers dataset.
+    std::vector<uint32_t> sorted_index;
+
+    // Description of a procedural dataset, whose arrays are empty.
+    ProceduralScatterers::s_ptr procedural;
+
+    // Description of an image volume dataset, whose arrays are empty.
+    ImageVolumeScatterers::s_ptr image_volume;
+
+    // Arrays of an external dataset, in which case the own arrays are empty.
+    ExternalFixedScatterers::s_ptr external;
+};
+
+}   // end namespace
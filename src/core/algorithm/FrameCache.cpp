@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include "FrameCache.hpp"
+#ifndef _WIN32
+    #include <dirent.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #include <utime.h>
+#endif
+
+namespace bcsim {
+namespace {
+
+const char      frame_magic[8]    = {'B', 'C', 'S', 'I', 'M', 'F', 'R', 'M'};
+const uint32_t  frame_version     = 1;
+const char      frame_extension[] = ".frame";
+
+bool has_frame_extension(const std::string& name) {
+    const auto len = std::strlen(frame_extension);
+    return (name.size() > len) && (name.compare(name.size() - len, len, frame_extension) == 0);
+}
+
+}   // end anonymous namespace
+
+FrameCache::FrameCache()
+    : m_memory_capacity(0),
+      m_disk_capacity(0),
+      m_memory_bytes(0),
+      m_num_hits(0),
+      m_num_misses(0)
+{ }
+
+void FrameCache::set_memory_capacity(size_t num_bytes) {
+    m_memory_capacity = num_bytes;
+    evict_memory();
+}
+
+void FrameCache::set_directory(const std::string& path) {
+    if (!path.empty()) {
+#ifdef _WIN32
+        throw std::runtime_error("a frame cache directory is not supported on this platform");
+#else
+        struct stat info;
+        if ((stat(path.c_str(), &info) != 0) || !S_ISDIR(info.st_mode)) {
+            throw std::runtime_error("frame cache directory " + path + " does not exist");
+        }
+#endif
+    }
+    m_directory = path;
+}
+
+void FrameCache::set_disk_capacity(size_t num_bytes) {
+    m_disk_capacity = num_bytes;
+}
+
+bool FrameCache::get(const std::string& key, size_t num_lines, size_t num_samples, std::complex<float>* const* lines) {
+    const auto copy_out = [&](const Entry& entry) {
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            std::copy_n(entry.samples.data() + line_no*num_samples, num_samples, lines[line_no]);
+        }
+    };
+    const auto it = m_index.find(key);
+    if ((it != m_index.end()) && (it->second->num_lines == num_lines) && (it->second->num_samples == num_samples)) {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        copy_out(m_entries.front());
+        m_num_hits++;
+        return true;
+    }
+    Entry entry;
+    if (!m_directory.empty() && read_file(key, num_lines, num_samples, entry)) {
+        copy_out(entry);
+        insert(std::move(entry));
+        m_num_hits++;
+        return true;
+    }
+    m_num_misses++;
+    return false;
+}
+
+void FrameCache::put(const std::string& key, size_t num_lines, size_t num_samples, const std::complex<float>* const* lines) {
+    Entry entry;
+    entry.key = key;
+    entry.num_lines = num_lines;
+    entry.num_samples = num_samples;
+    entry.samples.resize(num_lines*num_samples);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        std::copy_n(lines[line_no], num_samples, entry.samples.data() + line_no*num_samples);
+    }
+    if (!m_directory.empty()) {
+        write_file(entry);
+        evict_disk(file_path(key));
+    }
+    insert(std::move(entry));
+}
+
+void FrameCache::clear() {
+    m_entries.clear();
+    m_index.clear();
+    m_memory_bytes = 0;
+}
+
+void FrameCache::insert(Entry&& entry) {
+    const auto num_bytes = entry.samples.size()*sizeof(std::complex<float>);
+    const auto it = m_index.find(entry.key);
+    if (it != m_index.end()) {
+        m_memory_bytes -= it->second->samples.size()*sizeof(std::complex<float>);
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+    if (num_bytes > m_memory_capacity) {
+        return;
+    }
+    m_entries.push_front(std::move(entry));
+    m_index[m_entries.front().key] = m_entries.begin();
+    m_memory_bytes += num_bytes;
+    evict_memory();
+}
+
+void FrameCache::evict_memory() {
+    while (m_memory_bytes > m_memory_capacity) {
+        const auto& oldest = m_entries.back();
+        m_memory_bytes -= oldest.samples.size()*sizeof(std::complex<float>);
+        m_index.erase(oldest.key);
+        m_entries.pop_back();
+    }
+}
+
+std::string FrameCache::file_path(const std::string& key) const {
+    return m_directory + "/" + key + frame_extension;
+}
+
+bool FrameCache::read_file(const std::string& key, size_t num_lines, size_t num_samples, Entry& entry) const {
+    const auto path = file_path(key);
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(frame_magic)];
+    uint32_t version;
+    uint64_t header_lines;
+    uint64_t header_samples;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&header_lines), sizeof(header_lines));
+    in.read(reinterpret_cast<char*>(&header_samples), sizeof(header_samples));
+    if (!in || (std::memcmp(magic, frame_magic, sizeof(magic)) != 0) || (version != frame_version)
+        || (header_lines != num_lines) || (header_samples != num_samples)) {
+        return false;
+    }
+    entry.samples.resize(num_lines*num_samples);
+    in.read(reinterpret_cast<char*>(entry.samples.data()), entry.samples.size()*sizeof(std::complex<float>));
+    if (!in) {
+        return false;
+    }
+    entry.key = key;
+    entry.num_lines = num_lines;
+    entry.num_samples = num_samples;
+#ifndef _WIN32
+    // the modification time is the recency of the frame
+    utime(path.c_str(), nullptr);
+#endif
+    return true;
+}
+
+void FrameCache::write_file(const Entry& entry) const {
+#ifndef _WIN32
+    const auto path = file_path(entry.key);
+    const auto temp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        const uint64_t num_lines = entry.num_lines;
+        const uint64_t num_samples = entry.num_samples;
+        out.write(frame_magic, sizeof(frame_magic));
+        out.write(reinterpret_cast<const char*>(&frame_version), sizeof(frame_version));
+        out.write(reinterpret_cast<const char*>(&num_lines), sizeof(num_lines));
+        out.write(reinterpret_cast<const char*>(&num_samples), sizeof(num_samples));
+        out.write(reinterpret_cast<const char*>(entry.samples.data()), entry.samples.size()*sizeof(std::complex<float>));
+        out.flush();
+        if (!out) {
+            std::remove(temp_path.c_str());
+            throw std::runtime_error("failed to write frame cache file " + temp_path);
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("failed to rename frame cache file to " + path);
+    }
+#else
+    (void) entry;
+#endif
+}
+
+void FrameCache::evict_disk(const std::string& keep_path) const {
+#ifndef _WIN32
+    if (m_disk_capacity == 0) {
+        return;
+    }
+    struct FrameFile {
+        std::string path;
+        time_t      mtime;
+        size_t      num_bytes;
+    };
+    std::vector<FrameFile> files;
+    size_t total_bytes = 0;
+    if (auto dir = opendir(m_directory.c_str())) {
+        while (const auto dir_entry = readdir(dir)) {
+            const std::string name(dir_entry->d_name);
+            struct stat info;
+            const auto path = m_directory + "/" + name;
+            if (has_frame_extension(name) && (stat(path.c_str(), &info) == 0) && S_ISREG(info.st_mode)) {
+                files.push_back(FrameFile{path, info.st_mtime, static_cast<size_t>(info.st_size)});
+                total_bytes += static_cast<size_t>(info.st_size);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end(), [](const FrameFile& a, const FrameFile& b) { return a.mtime < b.mtime; });
+    // other processes may remove the same files
+    for (const auto& file : files) {
+        if (total_bytes <= m_disk_capacity) {
+            break;
+        }
+        if (file.path == keep_path) {
+            continue;
+        }
+        std::remove(file.path.c_str());
+        total_bytes -= file.num_bytes;
+    }
+#else
+    (void) keep_path;
+#endif
+}
+
+}   // end namespace
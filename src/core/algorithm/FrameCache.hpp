@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bcsim {
+
+// Simulated frames by content key, in memory and optionally in a directory
+// shared by processes, both evicting the least recently used frames when
+// over their capacity. A frame file <key>.frame holds
+//   "BCSIMFRM" <uint32 version> <uint64 num_lines> <uint64 num_samples> <samples>
+// and is made visible by a rename, so that readers never see a partial
+// frame. The recency of the files is their modification time.
+class FrameCache {
+public:
+    FrameCache();
+
+    // Zero bytes keeps no frames in memory.
+    void set_memory_capacity(size_t num_bytes);
+
+    // An empty path disables the directory. Throws std::runtime_error if
+    // the directory does not exist.
+    void set_directory(const std::string& path);
+
+    // Zero bytes does not limit the directory.
+    void set_disk_capacity(size_t num_bytes);
+
+    bool is_enabled() const {
+        return (m_memory_capacity > 0) || !m_directory.empty();
+    }
+
+    // Copy a cached frame to the lines and return true, or return false if
+    // there is no frame of the key and dimensions.
+    bool get(const std::string& key, size_t num_lines, size_t num_samples, std::complex<float>* const* lines);
+
+    // Store a frame. Throws std::runtime_error if the frame file cannot be
+    // written.
+    void put(const std::string& key, size_t num_lines, size_t num_samples, const std::complex<float>* const* lines);
+
+    void clear();
+
+    size_t get_num_hits() const {
+        return m_num_hits;
+    }
+    size_t get_num_misses() const {
+        return m_num_misses;
+    }
+
+    // Bytes of the frames in memory.
+    size_t get_memory_bytes() const {
+        return m_memory_bytes;
+    }
+
+private:
+    struct Entry {
+        std::string                         key;
+        size_t                              num_lines;
+        size_t                              num_samples;
+        std::vector<std::complex<float>>    samples;
+    };
+
+    void insert(Entry&& entry);
+    void evict_memory();
+    bool read_file(const std::string& key, size_t num_lines, size_t num_samples, Entry& entry) const;
+    void write_file(const Entry& entry) const;
+    // Remove the least recently used files except keep_path.
+    void evict_disk(const std::string& keep_path) const;
+    std::string file_path(const std::string& key) const;
+
+    size_t                                                      m_memory_capacity;
+    size_t                                                      m_disk_capacity;
+    std::string                                                 m_directory;
+    // most recently used first
+    std::list<Entry>                                            m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t                                                      m_memory_bytes;
+    size_t                                                      m_num_hits;
+    size_t                                                      m_num_misses;
+};
+
+}   // end namespace
@@ -27,31 +27,82 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #ifdef BCSIM_ENABLE_CUDA
-#include <cuda.h>
+#include "gpu_runtime.h"
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 #include <complex>
+#include <cmath>
 #include <tuple> // for std::tie
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <limits>
 #include "GpuAlgorithm.hpp"
+#include "CpuScatterers.hpp"   // for sorted datasets of a restored state
 #include "common_utils.hpp" // for compute_num_rf_samples
 #include "../discrete_hilbert_mask.hpp"
+#include "../BeamConvolver.hpp" // for the baseband filter
+#include "../fft.hpp" // for next_smooth_size
+#include "../lut_compression.hpp"
+#include "../iq_format.hpp"
 #include "cuda_debug_utils.h"
 #include "cuda_helpers.h"
 #include "cufft_helpers.h"
 #include "cuda_kernels_c_interface.h"
-#include "common_definitions.h" // for MAX_NUM_CUDA_STREAMS and MAX_SPLINE_DEGREE
+#include "common_definitions.h" // for MAX_SPLINE_DEGREE
 #include "../bspline.hpp"
+#include "../Tracing.hpp"
 
 namespace bcsim {
 GpuAlgorithm::GpuAlgorithm()
     : m_param_cuda_device_no(0),
       m_can_change_cuda_device(true),
-      m_param_num_cuda_streams(2), // TODO: What if this value is bigger than max num streams...
-      m_num_time_samples(8192),  // TODO: remove this limitation
+      m_param_num_cuda_streams(2),
+      m_num_time_samples(0),
+      m_first_rf_sample(0),
       m_num_beams_allocated(-1),
+      m_use_real_fft(false),
       m_param_threads_per_block(128),
+      m_param_threads_per_line(128),
       m_store_kernel_details(false),
-      m_device_random_buffer(nullptr)
+      m_param_autotune(false),
+      m_param_autotune_cache(AutotuneCache::default_path()),
+      m_autotuning(false),
+      m_param_batched_launch(true),
+      m_param_shared_tile_size(0),
+      m_param_use_cuda_graph(false),
+      m_param_frames_in_flight(2),
+      m_param_fft_callbacks(false),
+      m_param_sparse_convolution_threshold(0),
+      m_sparse_first_lag(0),
+      m_param_max_lines_per_batch(0),
+      m_param_scatterer_chunk_size(0),
+      m_param_generated_tile_size(1 << 20),
+      m_param_compact_scatterers(false),
+      m_param_interleaved_scatterers(false),
+      m_param_mapped_scatterers(-1),
+      m_param_spline_render_min_group_lines(8),
+      m_param_fixed_point_scale(0.0f),
+      m_cur_line_batch(0),
+      m_multi_excitation_num_time_samples(0),
+      m_multi_excitation_first_rf_sample(0),
+      m_multi_excitation_active(false),
+      m_line_descriptors_generation(0),
+      m_copy_iq_to_host(true),
+      m_next_async_stream_frame(0),
+      m_excitation_dirty(false),
+      m_line_batches_dirty(false),
+      m_single_geometry(false),
+      m_mla_group_size(1),
+      m_param_noise_seed(0),
+      m_noise_frame_no(0),
+      m_param_noise_first_line(0),
+      m_param_lut_format(LUTFormat::FLOAT),
+      m_param_lut_separable_rank(3),
+      m_lut_factors(),
+      m_lut_error{0.0f, 0.0f},
+      m_lut_zones()
 {
     // ensure that CUDA device properties is stored
     save_cuda_device_properties();
@@ -66,6 +117,7 @@ int GpuAlgorithm::get_num_cuda_devices() const {
 }
 
 void GpuAlgorithm::set_parameter(const std::string& key, const std::string& value) {
+    m_frame_graph.reset();
     if (key == "gpu_device") {
         if (!m_can_change_cuda_device) {
             throw std::runtime_error("cannot change CUDA device now");            
@@ -75,24 +127,267 @@ void GpuAlgorithm::set_parameter(const std::string& key, const std::string& valu
         if (device_no < 0 || device_no >= device_count) {
             throw std::runtime_error("illegal device number");
         }
+        // the runtime kernels are unloaded from the previous device
+        const bool jit_kernels = static_cast<bool>(m_jit_kernels);
+        m_jit_kernels.reset();
         m_param_cuda_device_no = device_no;
         cudaErrorCheck(cudaSetDevice(m_param_cuda_device_no));
         save_cuda_device_properties();
-    } else if (key == "cuda_streams") {
-        const auto num_streams = std::stoi(value);
-        if (num_streams > MAX_NUM_CUDA_STREAMS) {
-            throw std::runtime_error("number of CUDA streams exceeds MAX_NUM_CUDA_STREAMS");
+        if (jit_kernels) {
+            m_jit_kernels = JitProjectionKernels::u_ptr(new JitProjectionKernels(m_cur_device_prop));
+        }
+        // device resources created so far belong to the previous device
+        create_dummy_lut_profile();
+        m_lut_profile.reset();
+        m_device_lut_factors.reset();
+        m_lut_factors.rank = 0;
+        m_multi_resolution_lut_profile.reset();
+        m_device_lut_zones.clear();
+        m_lut_zones.num_zones = 0;
+        m_device_noise_frame.reset();
+    } else if (key == "noise_seed") {
+        // also restarts the frame counter to make a sequence of frames reproducible
+        m_param_noise_seed = static_cast<uint64_t>(std::stoull(value));
+        m_noise_frame_no = 0;
+    } else if (key == "gpu_noise_first_line") {
+        const auto first_line = std::stoi(value);
+        if (first_line < 0) {
+            throw std::runtime_error("invalid first line of the noise");
         }
+        m_param_noise_first_line = first_line;
+    } else if (key == "cuda_streams") {
+        const auto num_streams = (value == "auto") ? auto_num_cuda_streams() : std::stoi(value);
         if (num_streams <= 0) {
             throw std::runtime_error("number of CUDA streams must be more than zero");
         }
         m_param_num_cuda_streams = num_streams;
+        // the pool is recreated with the new size at the next simulation
+        use_cuda_device();
+        m_stream_wrappers.clear();
     } else if (key == "threads_per_block") {
         const auto threads_per_block = std::stoi(value);
         if (threads_per_block <= 0) {
             throw std::runtime_error("invalid number of threads per block");            
         }
         m_param_threads_per_block = threads_per_block;
+    } else if (key == "gpu_threads_per_line") {
+        const auto threads_per_line = std::stoi(value);
+        if ((threads_per_line <= 0) || (threads_per_line > m_cur_device_prop.maxThreadsPerBlock)) {
+            throw std::runtime_error("invalid number of threads per line");
+        }
+        m_param_threads_per_line = threads_per_line;
+    } else if (key == "gpu_autotune") {
+        if ((value == "on") || (value == "true")) {
+            m_param_autotune = true;
+            // look up the configuration again before the next frame
+            m_autotune_key.clear();
+        } else if ((value == "off") || (value == "false")) {
+            m_param_autotune = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_autotune_cache") {
+        // an empty path does not persist the tuned configurations
+        m_param_autotune_cache = value;
+        m_autotune_key.clear();
+    } else if (key == "gpu_shared_tile_size") {
+        const auto tile_size = std::stoi(value);
+        if (tile_size < 0) {
+            throw std::runtime_error("shared tile size cannot be negative");
+        }
+        // leave room for the static shared memory of the kernels
+        if (tile_size*sizeof(float2) + 64 > m_cur_device_prop.sharedMemPerBlock) {
+            throw std::runtime_error("shared tile size exceeds the shared memory per block");
+        }
+        m_param_shared_tile_size = tile_size;
+    } else if (key == "gpu_frames_in_flight") {
+        const auto frames_in_flight = std::stoi(value);
+        if (frames_in_flight < 1) {
+            throw std::runtime_error("number of frames in flight must be positive");
+        }
+        m_param_frames_in_flight = frames_in_flight;
+    } else if (key == "gpu_fft_callbacks") {
+        if ((value == "on") || (value == "true")) {
+#ifndef BCSIM_ENABLE_CUFFT_CALLBACKS
+            throw std::runtime_error("cuFFT callbacks are not enabled at compile time");
+#endif
+            m_param_fft_callbacks = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_fft_callbacks = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_sparse_convolution_threshold") {
+        const auto threshold = std::stoi(value);
+        if (threshold < 0) {
+            throw std::runtime_error("illegal sparse convolution threshold");
+        }
+        m_param_sparse_convolution_threshold = threshold;
+    } else if (key == "gpu_jit_kernels") {
+        if ((value == "on") || (value == "true")) {
+#ifndef BCSIM_ENABLE_NVRTC
+            throw std::runtime_error("NVRTC kernels are not enabled at compile time");
+#endif
+            if (!m_jit_kernels) {
+                m_jit_kernels = JitProjectionKernels::u_ptr(new JitProjectionKernels(m_cur_device_prop));
+            }
+        } else if ((value == "off") || (value == "false")) {
+            m_jit_kernels.reset();
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_max_lines_per_batch") {
+        const auto max_lines = (value == "auto") ? -1 : std::stoi(value);
+        if ((value != "auto") && (max_lines < 0)) {
+            throw std::runtime_error("maximum number of lines per batch cannot be negative");
+        }
+        m_param_max_lines_per_batch = max_lines;
+        m_line_batches_dirty = true;
+    } else if (key == "gpu_memory_pool") {
+        // shared by all GPU algorithms in the process
+        if ((value == "on") || (value == "true")) {
+            CudaMemoryPool::instance().set_enabled(true);
+        } else if ((value == "off") || (value == "false")) {
+            CudaMemoryPool::instance().set_enabled(false);
+        } else {
+            throw std::runtime_error("invalid boolean value");
+        }
+    } else if (key == "gpu_memory_pool_trim") {
+        // the value is the number of cached bytes to keep
+        const auto max_cached_bytes = std::stoll(value);
+        if (max_cached_bytes < 0) {
+            throw std::runtime_error("number of cached bytes cannot be negative");
+        }
+        CudaMemoryPool::instance().trim(static_cast<size_t>(max_cached_bytes));
+    } else if (key == "gpu_scatterer_chunk_size") {
+        const auto chunk_size = std::stoi(value);
+        if (chunk_size < 0) {
+            throw std::runtime_error("scatterer chunk size cannot be negative");
+        }
+        m_param_scatterer_chunk_size = static_cast<size_t>(chunk_size);
+    } else if (key == "gpu_generated_tile_size") {
+        const auto tile_size = std::stoi(value);
+        if (tile_size <= 0) {
+            throw std::runtime_error("generated tile size must be positive");
+        }
+        m_param_generated_tile_size = static_cast<size_t>(tile_size);
+    } else if (key == "gpu_upload_chunk_bytes") {
+        // scatterer uploads are staged in pinned chunks of this many bytes, 0 is one chunk per array
+        const auto chunk_bytes = std::stoll(value);
+        if (chunk_bytes < 0) {
+            throw std::runtime_error("upload chunk size cannot be negative");
+        }
+        m_device_fixed_datasets.set_upload_chunk_bytes(static_cast<size_t>(chunk_bytes));
+        m_device_spline_datasets.set_upload_chunk_bytes(static_cast<size_t>(chunk_bytes));
+    } else if (key == "gpu_packed_dataset_max_scatterers") {
+        // fixed datasets added afterwards with at most this many scatterers share one launch, 0 packs none
+        const auto max_scatterers = std::stoll(value);
+        if (max_scatterers < 0) {
+            throw std::runtime_error("maximum packed dataset size cannot be negative");
+        }
+        m_device_fixed_datasets.set_packing_max_scatterers(static_cast<size_t>(max_scatterers));
+        m_device_rendered_spline_datasets.set_packing_max_scatterers(static_cast<size_t>(max_scatterers));
+        m_device_rendered_spline_scratch.set_packing_max_scatterers(static_cast<size_t>(max_scatterers));
+    } else if (key == "gpu_spline_render_min_group_lines") {
+        // lines with the same timestamp project rendered splines if there are at least this many
+        const auto min_lines = std::stoi(value);
+        if (min_lines < 0) {
+            throw std::runtime_error("minimum number of lines in a rendered spline group cannot be negative");
+        }
+        m_param_spline_render_min_group_lines = min_lines;
+    } else if (key == "gpu_compact_scatterers") {
+        if ((value == "on") || (value == "true")) {
+            m_param_compact_scatterers = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_compact_scatterers = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_interleaved_scatterers") {
+        // fixed datasets added afterwards as one float4 array instead of four float arrays
+        if ((value == "on") || (value == "true")) {
+            m_param_interleaved_scatterers = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_interleaved_scatterers = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_mapped_scatterers") {
+        // on integrated devices this saves the device copy and the upload,
+        // on discrete devices the kernels read the scatterers over the bus
+        if (value == "auto") {
+            m_param_mapped_scatterers = -1;
+        } else if ((value == "on") || (value == "true")) {
+            if (!m_cur_device_prop.canMapHostMemory) {
+                throw std::runtime_error("the CUDA device cannot map host memory");
+            }
+            m_param_mapped_scatterers = 1;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_mapped_scatterers = 0;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_interleaved_control_points") {
+        // the same for the control points of spline datasets
+        if ((value == "on") || (value == "true")) {
+            m_device_spline_datasets.set_interleaved(true);
+        } else if ((value == "off") || (value == "false")) {
+            m_device_spline_datasets.set_interleaved(false);
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_fixed_point_scale") {
+        // the sums of a sample must fit in an int, 0 accumulates floats
+        const auto scale = std::stof(value);
+        if (!(scale >= 0.0f)) {
+            throw std::runtime_error("fixed-point scale cannot be negative");
+        }
+        m_param_fixed_point_scale = scale;
+    } else if (key == "gpu_cuda_graph") {
+        if ((value == "on") || (value == "true")) {
+            m_param_use_cuda_graph = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_use_cuda_graph = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_batched_launch") {
+        if ((value == "on") || (value == "true")) {
+            m_param_batched_launch = true;
+        } else if ((value == "off") || (value == "false")) {
+            m_param_batched_launch = false;
+        } else {
+            throw std::runtime_error("invalid value");
+        }
+    } else if (key == "gpu_lut_format") {
+        if (value == "float") {
+            m_param_lut_format = LUTFormat::FLOAT;
+        } else if (value == "half") {
+            m_param_lut_format = LUTFormat::HALF;
+        } else if (value == "separable") {
+            if (m_multi_resolution_lut_profile) {
+                throw std::runtime_error("separable LUT format is not supported for multi-resolution LUT profiles");
+            }
+            m_param_lut_format = LUTFormat::SEPARABLE;
+        } else {
+            throw std::runtime_error("invalid LUT format, must be float, half or separable");
+        }
+        if (m_lut_profile || m_multi_resolution_lut_profile) {
+            upload_lookup_profile();
+        }
+    } else if (key == "gpu_lut_separable_rank") {
+        const auto rank = std::stoi(value);
+        if (rank <= 0) {
+            throw std::runtime_error("rank of separable LUT must be positive");
+        }
+        m_param_lut_separable_rank = rank;
+        if (m_lut_profile && (m_param_lut_format == LUTFormat::SEPARABLE)) {
+            upload_lookup_profile();
+        }
+    } else if ((key == "baseband") || (key == "radial_decimation")) {
+        // the baseband filter depends on both
+        BaseAlgorithm::set_parameter(key, value);
+        m_excitation_dirty = true;
     } else if (key == "store_kernel_details") {
         if ((value == "on") || (value == "true")) {
             m_store_kernel_details = true;
@@ -104,16 +399,37 @@ void GpuAlgorithm::set_parameter(const std::string& key, const std::string& valu
     } else {
         BaseAlgorithm::set_parameter(key, value);
     }
+    m_state.set_parameter(key, value);
 }
 
 void GpuAlgorithm::create_cuda_stream_wrappers(int num_streams) {
     m_stream_wrappers.clear();
+    m_stream_events.clear();
     for (int i = 0; i < num_streams; i++) {
         m_stream_wrappers.push_back(std::move(CudaStreamRAII::u_ptr(new CudaStreamRAII)));
+        m_stream_events.push_back(CudaEventRAII::u_ptr(new CudaEventRAII));
     }
+    m_work_stream = CudaStreamRAII::u_ptr(new CudaStreamRAII);
+    m_work_event = CudaEventRAII::u_ptr(new CudaEventRAII);
     m_can_change_cuda_device = false;
 }
 
+int GpuAlgorithm::auto_num_cuda_streams() const {
+    if (!m_cur_device_prop.concurrentKernels) {
+        return 1;
+    }
+    // enough streams for small launches of a few blocks per line to fill all
+    // multiprocessors, within the number of concurrent kernels of recent devices.
+    return std::max(2, std::min(32, m_cur_device_prop.multiProcessorCount/4));
+}
+
+bool GpuAlgorithm::use_mapped_scatterers() const {
+    if (m_param_mapped_scatterers < 0) {
+        return m_cur_device_prop.integrated && m_cur_device_prop.canMapHostMemory;
+    }
+    return m_param_mapped_scatterers > 0;
+}
+
 void GpuAlgorithm::save_cuda_device_properties() {
     const auto num_devices = get_num_cuda_devices();
     if (m_param_cuda_device_no < 0 || m_param_cuda_device_no >= num_devices) {
@@ -142,7 +458,9 @@ void GpuAlgorithm::save_cuda_device_properties() {
     m_log_object->write(ILog::INFO, ss.str());
 }
 
-void GpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> > >&  /*out*/ rf_lines) {
+const std::complex<float>* GpuAlgorithm::simulate_to_host_buffer(bool deliver_lines) {
+    trace::ScopedEvent event("simulate_lines", "gpu");
+    const auto frame_start = std::chrono::steady_clock::now();
     m_can_change_cuda_device = false;
     
     if (m_stream_wrappers.size() == 0) {
@@ -153,144 +471,259 @@ void GpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> >
         m_debug_data.clear();
     }
     
-    auto num_lines = m_scan_seq->get_num_lines();
-    if (num_lines < 1) {
-        throw std::runtime_error("No scanlines in scansequence");
+    throw_if_not_configured();
+    update_derived_state();
+    if (m_line_batches.empty()) {
+        simulate_batch_to_host_buffer();
+        if (deliver_lines) {
+            size_t num_lines, num_samples;
+            get_output_dimensions(num_lines, num_samples);
+            report_lines(0, num_lines, m_host_iq_lines->data(), num_samples);
+        }
+        m_noise_frame_no++;
+        count_frame(m_scan_seq->get_num_lines(), frame_start);
+        return m_host_iq_lines->data();
     }
 
-    if (m_cur_beam_profile_type == BeamProfileType::NOT_CONFIGURED) {
-        throw std::runtime_error("No beam profile is configured");
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto num_frame_bytes = sizeof(complex)*num_samples*num_lines;
+    if (!m_host_frame_iq_lines || (m_host_frame_iq_lines->get_num_bytes() != num_frame_bytes)) {
+        m_log_object->write(ILog::INFO, "Reallocating HOST memory for IQ lines of the frame");
+        m_host_frame_iq_lines = HostPinnedBufferRAII<std::complex<float>>::u_ptr(new HostPinnedBufferRAII<std::complex<float>>(num_frame_bytes));
     }
 
-    if (m_param_noise_amplitude > 0.0f) {
-        const size_t num_random_numbers = num_lines*m_num_time_samples*2; // for real- and imaginary part.
-        const size_t num_bytes_needed = num_random_numbers*sizeof(float);
-        if (num_random_numbers % 2 != 0) throw std::runtime_error("Number of random samples must be even");
-        if ((m_device_random_buffer == nullptr) || (m_device_random_buffer->get_num_bytes() != num_bytes_needed)) {
-            m_log_object->write(ILog::INFO, "Reallocating device memory for random noise samples");
-            m_device_random_buffer = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_needed));
+    // each batch is simulated as a frame of its own, reusing the same buffers
+    const auto frame_scan_seq = m_scan_seq;
+    const auto batch_size = static_cast<size_t>(m_num_beams_allocated);
+    try {
+        for (m_cur_line_batch = 0; m_cur_line_batch < m_line_batches.size(); m_cur_line_batch++) {
+            m_scan_seq = m_line_batches[m_cur_line_batch];
+            simulate_batch_to_host_buffer();
+
+            const auto first_line = m_cur_line_batch*batch_size;
+            const auto num_batch_lines = std::min(batch_size, num_lines - first_line);
+            std::copy(m_host_iq_lines->data(), m_host_iq_lines->data() + num_batch_lines*num_samples,
+                      m_host_frame_iq_lines->data() + first_line*num_samples);
+            if (deliver_lines) {
+                report_lines(first_line, num_batch_lines, m_host_iq_lines->data(), num_samples);
+            }
         }
+    } catch (...) {
+        m_scan_seq = frame_scan_seq;
+        m_cur_line_batch = 0;
+        throw;
+    }
+    m_scan_seq = frame_scan_seq;
+    m_cur_line_batch = 0;
+    m_noise_frame_no++;
+    count_frame(num_lines, frame_start);
+    return m_host_frame_iq_lines->data();
+}
+
+void GpuAlgorithm::simulate_batch_to_host_buffer() {
+    trace::ScopedEvent event("simulate_line_batch", "gpu");
+    auto num_lines = m_scan_seq->get_num_lines();
+    if (m_param_scatterer_culling) {
+        update_culling_region();
+    }
 
-        // recreate random numbers
-        curandErrorCheck(curandGenerateNormal(m_device_rng.get(), m_device_random_buffer->data(), num_random_numbers, 0.0f, m_param_noise_amplitude));
-        cudaErrorCheck(cudaDeviceSynchronize());
+    // compact demodulated and decimated IQ lines
+    size_t num_output_lines, num_iq_samples;
+    get_output_dimensions(num_output_lines, num_iq_samples);
+    allocate_iq_lines(m_device_iq_lines, m_host_iq_lines);
+
+    // Without phase delay and noise the time-projections are real, and a
+    // real-to-complex forward transform can be used.
+    m_use_real_fft = !use_phase_delay() && (m_param_noise_amplitude <= 0.0f);
+
+    if (m_param_noise_amplitude > 0.0f) {
+        upload_noise_frame(m_work_stream->get());
     }
 
-    // TODO: If all beams have the same timestamp, first render to fixed scatterers
-    // in device memory and then simulate with the fixed algorithm
-    bool use_optimized_spline_kernel = false;
-    if (m_scan_seq->all_timestamps_equal && (m_device_spline_datasets.get_num_datasets() > 0)) {
+    // The splines of a group of lines with the same timestamp are rendered to
+    // fixed scatterers once and projected with the fixed kernel. If all lines
+    // have the same timestamp, this is done before any of them is projected.
+    update_spline_render_groups();
+    const auto& groups = m_spline_render_groups;
+    const bool use_optimized_spline_kernel = (groups.size() == 1) && groups[0].rendered;
+    if (use_optimized_spline_kernel) {
         const auto timestamp = m_scan_seq->get_scanline(0).get_timestamp();
-        m_device_rendered_spline_datasets.render(m_device_spline_datasets, timestamp);
-        use_optimized_spline_kernel = true;
-        cudaErrorCheck(cudaDeviceSynchronize());
+        m_device_rendered_spline_datasets.render(m_device_spline_datasets, timestamp, m_work_stream->get());
     }
 
-    for (int beam_no = 0; beam_no < num_lines; beam_no++) {
-        size_t stream_no = beam_no % m_param_num_cuda_streams;
-        auto cur_stream = m_stream_wrappers[stream_no]->get();
+    // the noise frame and rendered splines are consumed by the line streams
+    m_work_event->record(m_work_stream->get());
+
+    // One launch per kernel and dataset for the whole frame, except when
+    // the culled scatterers differ from line to line or several groups are
+    // rendered, which the frame captured as one graph cannot interleave.
+    const auto num_rendered_groups = std::count_if(groups.begin(), groups.end(), [](const SplineRenderGroup& group) {
+        return group.rendered;
+    });
+    if (can_use_batched_launch(num_lines) && (num_rendered_groups < 2)) {
+        simulate_frame_batched(num_lines, use_optimized_spline_kernel);
+        return;
+    }
 
-        std::unique_ptr<EventTimerRAII> event_timer;
-        if (m_store_kernel_details) {
-            event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(cur_stream));
-            m_debug_data["stream_numbers"].push_back(static_cast<double>(stream_no));
-            event_timer->restart();
-        }
+    // the spline kernels read the line and its basis functions from the line
+    // descriptors, which gives every line its own storage of basis functions.
+    const auto uses_spline_kernel = std::any_of(groups.begin(), groups.end(), [&](const SplineRenderGroup& group) {
+        return !group.rendered && (m_device_spline_datasets.get_num_datasets() > 0);
+    });
+    if (uses_spline_kernel) {
+        upload_line_descriptors(m_work_stream->get(), num_lines, false);
+        m_work_event->record(m_work_stream->get());
+    }
 
-        if (m_param_verbose) {
-            m_log_object->write(ILog::DEBUG, "beam_no = " + std::to_string(beam_no) + ", stream_no = " + std::to_string(stream_no));
+    // the culled datasets are projected one by one, the others with one launch per run in the arena
+    const auto fixed_launch_datasets = m_device_fixed_datasets.get_launch_datasets([&](const DeviceFixedScatterers& dataset) {
+        return m_param_scatterer_culling && !dataset.get_grid().empty();
+    });
+
+    streams_wait_for_work_stream();
+    for (size_t group_no = 0; group_no < groups.size(); group_no++) {
+        const auto& group = groups[group_no];
+        // the groups alternate between two rendered datasets, so that a group
+        // is rendered while the lines of the previous one are projected
+        auto& rendered_datasets = (group_no % 2 == 0) ? m_device_rendered_spline_datasets : m_device_rendered_spline_scratch;
+        if (group.rendered && !use_optimized_spline_kernel) {
+            if (group_no >= 2) {
+                // the lines of group group_no - 2 still use them
+                work_stream_wait_for_streams();
+            }
+            const auto timestamp = m_scan_seq->get_scanline(group.first_line).get_timestamp();
+            rendered_datasets.render(m_device_spline_datasets, timestamp, m_work_stream->get());
+            m_work_event->record(m_work_stream->get());
+            streams_wait_for_work_stream();
         }
+        std::vector<DeviceFixedScatterers::s_ptr> rendered_launch_datasets;
+        if (group.rendered) {
+            rendered_launch_datasets = rendered_datasets.get_launch_datasets();
+        }
+        for (int beam_no = group.first_line; beam_no < group.first_line + group.num_lines; beam_no++) {
+            size_t stream_no = beam_no % m_param_num_cuda_streams;
+            auto cur_stream = m_stream_wrappers[stream_no]->get();
 
-        auto scanline = m_scan_seq->get_scanline(beam_no);
-        int threads_per_line = 128;
-        auto rf_ptr = m_device_time_proj->data() + beam_no*m_num_time_samples;
+            std::unique_ptr<EventTimerRAII> event_timer;
+            if (m_store_kernel_details) {
+                event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(cur_stream));
+                m_debug_data["stream_numbers"].push_back(static_cast<double>(stream_no));
+                event_timer->restart();
+            }
 
-        // clear time projections (safer than cudaMemsetAsync)
-        const auto complex_zero = make_cuComplex(0.0f, 0.0f);
-        if (m_store_kernel_details) {
-            event_timer->restart();
-        }
-        launch_MemsetKernel<cuComplex>(m_num_time_samples/threads_per_line, threads_per_line, cur_stream, rf_ptr, complex_zero, m_num_time_samples);
+            if (m_param_verbose) {
+                m_log_object->write(ILog::DEBUG, "beam_no = " + std::to_string(beam_no) + ", stream_no = " + std::to_string(stream_no));
+            }
 
-        if (m_store_kernel_details) {
-            const auto elapsed_ms = static_cast<double>(event_timer->stop());
-            m_debug_data["kernel_memset_ms"].push_back(elapsed_ms);
-            event_timer->restart();
-        }
+            auto scanline = m_scan_seq->get_scanline(beam_no);
+            const int threads_per_line = m_param_threads_per_line;
+            auto rf_ptr = m_device_time_proj->data() + beam_no*m_num_time_samples;
 
-        // project fixed scatterers
-        for (size_t dset_idx = 0; dset_idx < m_device_fixed_datasets.get_num_datasets(); dset_idx++) {
-            const auto device_dataset = m_device_fixed_datasets.get_dataset(dset_idx);
-            const auto num_scatterers = device_dataset->get_num_scatterers();
-            const int num_blocks = round_up_div(num_scatterers, m_param_threads_per_block);
-            if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
-                throw std::runtime_error("required number of x-blocks is larger than device supports (fixed scatterers)");
+            // clear time projections (safer than cudaMemsetAsync)
+            const auto complex_zero = make_cuComplex(0.0f, 0.0f);
+            if (m_store_kernel_details) {
+                event_timer->restart();
+            }
+            // real samples only occupy the first half of the slot. The noise is
+            // added to the floats, i.e. after a fixed-point accumulation.
+            const int num_clear = static_cast<int>(m_use_real_fft ? m_num_time_samples/2 : m_num_time_samples);
+            if ((m_param_noise_amplitude > 0.0f) && (m_param_fixed_point_scale <= 0.0f)) {
+                launch_MemsetNoiseBatchedKernel(round_up_div(round_up_div(num_clear, 2), threads_per_line), 1, threads_per_line, cur_stream,
+                                                rf_ptr, noise_params(beam_no), num_clear, num_clear);
+            } else {
+                launch_MemsetKernel<cuComplex>(round_up_div(num_clear, threads_per_line), threads_per_line, cur_stream, rf_ptr, complex_zero, num_clear);
             }
-            fixed_projection_kernel(stream_no, scanline, num_blocks, rf_ptr, device_dataset);
 
             if (m_store_kernel_details) {
                 const auto elapsed_ms = static_cast<double>(event_timer->stop());
-                m_debug_data["fixed_projection_kernel_ms"].push_back(elapsed_ms);
+                m_debug_data["kernel_memset_ms"].push_back(elapsed_ms);
                 event_timer->restart();
             }
-        }
 
-        // project spline scatterers
-        if (use_optimized_spline_kernel) {
-            for (size_t dset_idx = 0; dset_idx < m_device_rendered_spline_datasets.get_num_datasets(); dset_idx++) {
-                const auto device_dataset = m_device_rendered_spline_datasets.get_dataset(dset_idx);
+            // project fixed scatterers
+            for (const auto& device_dataset : fixed_launch_datasets) {
                 const auto num_scatterers = device_dataset->get_num_scatterers();
                 const int num_blocks = round_up_div(num_scatterers, m_param_threads_per_block);
                 if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
-                    throw std::runtime_error("required number of x-blocks is larger than device supports (spline scatterers)");
+                    throw std::runtime_error("required number of x-blocks is larger than device supports (fixed scatterers)");
                 }
-                fixed_projection_kernel(stream_no, scanline, num_blocks, rf_ptr, device_dataset);
-            }
-        } else {
-            for (size_t dset_idx = 0; dset_idx < m_device_spline_datasets.get_num_datasets(); dset_idx++) {
-                const auto device_dataset = m_device_spline_datasets.get_dataset(dset_idx);
-                const auto num_scatterers = device_dataset->get_num_scatterers();
-                const int num_blocks = round_up_div(num_scatterers, m_param_threads_per_block);
-                if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
-                    throw std::runtime_error("required number of x-blocks is larger than device supports (spline scatterers)");
+                if (m_param_scatterer_culling && !device_dataset->get_grid().empty()) {
+                    const auto num_indices = upload_culled_indices(stream_no, scanline, *device_dataset);
+                    if (num_indices > 0) {
+                        fixed_projection_kernel(stream_no, scanline, round_up_div(num_indices, m_param_threads_per_block), rf_ptr, device_dataset,
+                                                m_culled_index_staging[stream_no].device_indices->data(), num_indices);
+                    }
+                } else {
+                    fixed_projection_kernel(stream_no, scanline, num_blocks, rf_ptr, device_dataset);
                 }
-                spline_projection_kernel(stream_no, scanline, num_blocks, rf_ptr, device_dataset);
-    
+
                 if (m_store_kernel_details) {
                     const auto elapsed_ms = static_cast<double>(event_timer->stop());
-                    m_debug_data["spline_projection_kernel_ms"].push_back(elapsed_ms);
+                    m_debug_data["fixed_projection_kernel_ms"].push_back(elapsed_ms);
+                    event_timer->restart();
+                }
+            }
+
+            // project spline scatterers
+            if (group.rendered) {
+                for (const auto& device_dataset : rendered_launch_datasets) {
+                    const auto num_scatterers = device_dataset->get_num_scatterers();
+                    const int num_blocks = round_up_div(num_scatterers, m_param_threads_per_block);
+                    if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+                        throw std::runtime_error("required number of x-blocks is larger than device supports (spline scatterers)");
+                    }
+                    fixed_projection_kernel(stream_no, scanline, num_blocks, rf_ptr, device_dataset);
+                }
+            } else {
+                for (size_t dset_idx = 0; dset_idx < m_device_spline_datasets.get_num_datasets(); dset_idx++) {
+                    const auto device_dataset = m_device_spline_datasets.get_dataset(dset_idx);
+                    const auto num_scatterers = device_dataset->get_num_scatterers();
+                    const int num_blocks = round_up_div(num_scatterers, m_param_threads_per_block);
+                    if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+                        throw std::runtime_error("required number of x-blocks is larger than device supports (spline scatterers)");
+                    }
+                    const auto device_line = m_device_line_descriptors->data() + (dset_idx + 1)*num_lines + beam_no;
+                    spline_projection_kernel(stream_no, device_line, num_blocks, rf_ptr, device_dataset);
+        
+                    if (m_store_kernel_details) {
+                        const auto elapsed_ms = static_cast<double>(event_timer->stop());
+                        m_debug_data["spline_projection_kernel_ms"].push_back(elapsed_ms);
+                    }
                 }
             }
         }
     }
 
-    // block to ensure that all operations are completed
-    cudaErrorCheck( cudaDeviceSynchronize() );
-
-    if (m_param_noise_amplitude > 0.0f) {
-        const int threads_per_line = 128;
-        const auto num_samples = static_cast<int>(num_lines*m_num_time_samples);
-        const auto complex_ptr = reinterpret_cast<cuComplex*>(m_device_random_buffer->data());
-        cudaStream_t stream = 0;
-        launch_AddNoiseKernel(num_samples/threads_per_line, threads_per_line, stream, complex_ptr, m_device_time_proj->data(), num_samples);
-        cudaErrorCheck(cudaDeviceSynchronize());
-    }
+    // the frame-wide FFTs run on the work stream once all lines are projected
+    const auto work_stream = m_work_stream->get();
+    work_stream_wait_for_streams();
+    convert_fixed_point_projections(work_stream, num_lines);
 
     std::unique_ptr<EventTimerRAII> event_timer;
     if (m_store_kernel_details) {
-        event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(0));
+        event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(work_stream));
         event_timer->restart();
     }
 
-    // in-place batched forward FFT, using default stream 0
-    cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_FORWARD));
+    // in-place batched forward FFT
+    cufftErrorCheck( cufftSetStream(m_fft_plan->get(), work_stream) );
+    cufftErrorCheck( cufftSetStream(m_fft_plan_r2c->get(), work_stream) );
+    if (m_use_real_fft) {
+        auto real_ptr = reinterpret_cast<cufftReal*>(m_device_time_proj->data());
+        cufftErrorCheck(cufftExecR2C(m_fft_plan_r2c->get(), real_ptr, m_device_time_proj->data()));
+    } else {
+        cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_FORWARD));
+    }
     if (m_store_kernel_details) {
         const auto elapsed_ms = static_cast<double>(event_timer->stop());
         m_debug_data["kernel_forward_fft_ms"].push_back(elapsed_ms);
     }
-    cudaErrorCheck( cudaDeviceSynchronize() );
+    m_work_event->record(work_stream);
 
     // Multiply kernel
+    const int num_bins = static_cast<int>(m_use_real_fft ? m_num_time_samples/2 + 1 : m_num_time_samples);
+    streams_wait_for_work_stream();
     for (int beam_no = 0; beam_no < num_lines; beam_no++) {
         size_t stream_no = beam_no % m_param_num_cuda_streams;
         auto cur_stream = m_stream_wrappers[stream_no]->get();
@@ -304,26 +737,38 @@ void GpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> >
         auto rf_ptr = m_device_time_proj->data() + beam_no*m_num_time_samples;
 
         // multiply with FFT of impulse response w/Hilbert transform
-        int threads_per_line = 128;
-        launch_MultiplyFftKernel(m_num_time_samples/threads_per_line, threads_per_line, cur_stream, rf_ptr, m_device_excitation_fft->data(), m_num_time_samples);
+        const int threads_per_line = m_param_threads_per_line;
+        if (m_use_real_fft) {
+            // R2C only gives bins 0..N/2, the negative frequencies are zero after the Hilbert mask.
+            const int num_zero = static_cast<int>(m_num_time_samples) - num_bins;
+            launch_MultiplyFftKernel(round_up_div(num_bins, threads_per_line), threads_per_line, cur_stream, rf_ptr, m_device_excitation_fft->data(), num_bins);
+            launch_MemsetKernel<cuComplex>(round_up_div(num_zero, threads_per_line), threads_per_line, cur_stream, rf_ptr + num_bins, make_cuComplex(0.0f, 0.0f), num_zero);
+        } else {
+            launch_MultiplyFftKernel(round_up_div(static_cast<int>(m_num_time_samples), threads_per_line), threads_per_line, cur_stream, rf_ptr, m_device_excitation_fft->data(), m_num_time_samples);
+        }
         if (m_store_kernel_details) {
             const auto elapsed_ms = static_cast<double>(event_timer->stop());
             m_debug_data["kernel_multiply_fft_ms"].push_back(elapsed_ms);
         }
     }
 
-    // in-place batched backward FFT, using default stream 0
+    // in-place batched backward FFT
+    work_stream_wait_for_streams();
     if (m_store_kernel_details) {
         event_timer->restart();
     }
-    cudaErrorCheck( cudaDeviceSynchronize() );
     cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_INVERSE));
     if (m_store_kernel_details) {
         const auto elapsed_ms = static_cast<double>(event_timer->stop());
         m_debug_data["kernel_inverse_fft_ms"].push_back(elapsed_ms);
     }
-    cudaErrorCheck( cudaDeviceSynchronize() );
+    m_work_event->record(work_stream);
 
+    // IQ demodulation of the delay compensated and decimated samples only
+    float normalized_angular_freq;
+    int delay_compensation_num_samples, decimation;
+    get_demodulation(normalized_angular_freq, delay_compensation_num_samples, decimation);
+    streams_wait_for_work_stream();
     for (int beam_no = 0; beam_no < num_lines; beam_no++) {
         size_t stream_no = beam_no % m_param_num_cuda_streams;
         auto cur_stream = m_stream_wrappers[stream_no]->get();
@@ -337,281 +782,2243 @@ void GpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> >
             event_timer->restart();
         }
 
-        // IQ demodulation (+decimate?)
-        int threads_per_line = 128;
-        const auto f_demod = m_excitation.demod_freq;
-        const float norm_f_demod = f_demod/m_excitation.sampling_frequency;
-        const float PI = static_cast<float>(4.0*std::atan(1));
-        const auto normalized_angular_freq = 2*PI*norm_f_demod;
-        launch_DemodulateKernel(m_num_time_samples/threads_per_line, threads_per_line, cur_stream, rf_ptr, normalized_angular_freq, m_num_time_samples);
+        const int threads_per_line = m_param_threads_per_line;
+        auto iq_ptr = m_device_iq_lines->data() + beam_no*num_iq_samples;
+        launch_DemodulateDecimateKernel(round_up_div(static_cast<int>(num_iq_samples), threads_per_line), threads_per_line, cur_stream,
+                                        rf_ptr, iq_ptr, normalized_angular_freq, delay_compensation_num_samples,
+                                        decimation, static_cast<int>(num_iq_samples));
         if (m_store_kernel_details) {
             const auto elapsed_ms = static_cast<double>(event_timer->stop());
             m_debug_data["kernel_demodulate_ms"].push_back(elapsed_ms);
-            event_timer->restart();
         }
+    }
 
-        // copy to host. Same memory layout?
-        const auto num_bytes_iq = sizeof(std::complex<float>)*m_num_time_samples;
-        cudaErrorCheck( cudaMemcpyAsync(m_host_rf_lines[beam_no]->data(), rf_ptr, num_bytes_iq, cudaMemcpyDeviceToHost, cur_stream) ); 
-        if (m_store_kernel_details) {
-            const auto elapsed_ms = static_cast<double>(event_timer->stop());
-            m_debug_data["kernel_memcpy_ms"].push_back(elapsed_ms);
+    // copy to host: the lines of a stream are every num_streams'th line of
+    // the frame buffers, which is one strided copy per stream
+    if (m_copy_iq_to_host) {
+        const auto num_streams = std::min(static_cast<size_t>(m_param_num_cuda_streams), static_cast<size_t>(num_lines));
+        const auto line_bytes = sizeof(std::complex<float>)*num_iq_samples;
+        const auto pitch = num_streams*line_bytes;
+        for (size_t stream_no = 0; stream_no < num_streams; stream_no++) {
+            auto cur_stream = m_stream_wrappers[stream_no]->get();
+            std::unique_ptr<EventTimerRAII> event_timer;
+            if (m_store_kernel_details) {
+                event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(cur_stream));
+                event_timer->restart();
+            }
+            const auto num_stream_lines = (static_cast<size_t>(num_lines) - stream_no + num_streams - 1)/num_streams;
+            cudaErrorCheck( cudaMemcpy2DAsync(m_host_iq_lines->data() + stream_no*num_iq_samples, pitch,
+                                              m_device_iq_lines->data() + stream_no*num_iq_samples, pitch,
+                                              line_bytes, num_stream_lines, cudaMemcpyDeviceToHost, cur_stream) );
+            if (m_store_kernel_details) {
+                const auto elapsed_ms = static_cast<double>(event_timer->stop());
+                m_debug_data["kernel_memcpy_ms"].push_back(elapsed_ms);
+            }
         }
     }
-    cudaErrorCheck( cudaDeviceSynchronize() );
 
-    // no delay compenasation is needed when returning the projections only
-    size_t delay_compensation_num_samples = static_cast<size_t>(m_excitation.center_index);
-    const auto num_return_samples = compute_num_rf_samples(m_param_sound_speed, m_scan_seq->line_length, m_excitation.sampling_frequency);
+    // the only place the host waits for the device: when the IQ lines are needed
+    for (const auto& stream_wrapper : m_stream_wrappers) {
+        cudaErrorCheck( cudaStreamSynchronize(stream_wrapper->get()) );
+    }
+}
 
-    // TODO: eliminate unneccessary data copying: it would e.g. be better to
-    // only copy what is needed in the above kernel.
-    rf_lines.clear();
-    for (size_t line_no = 0; line_no < num_lines; line_no++) {
-        std::vector<std::complex<float>> temp_samples; // .reserve
-        for (size_t i = 0; i < num_return_samples; i += m_radial_decimation) {
-            temp_samples.push_back(m_host_rf_lines[line_no]->data()[i+delay_compensation_num_samples]);
-        }
-        rf_lines.push_back(temp_samples);
+void GpuAlgorithm::throw_if_not_configured() const {
+    if (!m_scan_seq || (m_scan_seq->get_num_lines() < 1)) {
+        throw std::runtime_error("No scanlines in scansequence");
+    }
+    if (m_cur_beam_profile_type == BeamProfileType::NOT_CONFIGURED) {
+        throw std::runtime_error("No beam profile is configured");
     }
 }
 
-void GpuAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
-    m_can_change_cuda_device = false;
-    
-    m_excitation = new_excitation;
-    size_t rf_line_bytes   = sizeof(complex)*m_num_time_samples;
+void GpuAlgorithm::create_fft_plans(int num_beams, CufftBatchedPlanRAII::u_ptr& c2c_plan, CufftBatchedPlanRAII::u_ptr& r2c_plan) const {
+    const auto num_samples = static_cast<int>(m_num_time_samples);
+    const int rank = 1;
+    int dims[] = {num_samples};
+    c2c_plan = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, num_samples, CUFFT_C2C, num_beams));
+    // real input lines are stored at the start of each complex slot, i.e. 2*N floats apart
+    r2c_plan = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, 2*num_samples, num_samples, CUFFT_R2C, num_beams));
+}
 
-    // setup pre-computed convolution kernel and Hilbert transformer.
-    m_device_excitation_fft = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(rf_line_bytes));
-    m_log_object->write(ILog::INFO, "Number of excitation samples: " + std::to_string(m_excitation.samples.size()));
+void GpuAlgorithm::allocate_iq_lines(DeviceBufferRAII<complex>::u_ptr& device_iq_lines,
+                                     HostPinnedBufferRAII<std::complex<float>>::u_ptr& host_iq_lines) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto num_bytes_iq_lines = sizeof(complex)*num_samples*num_lines;
+    if ((device_iq_lines == nullptr) || (device_iq_lines->get_num_bytes() != num_bytes_iq_lines)) {
+        m_log_object->write(ILog::INFO, "Reallocating HOST and DEVICE memory for IQ lines");
+        device_iq_lines = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(num_bytes_iq_lines));
+        host_iq_lines   = HostPinnedBufferRAII<std::complex<float>>::u_ptr(new HostPinnedBufferRAII<std::complex<float>>(num_bytes_iq_lines));
+    }
+}
 
-    // convert to complex with zero imaginary part.
-    std::vector<std::complex<float> > temp(m_num_time_samples);
-    for (size_t i = 0; i < m_excitation.samples.size(); i++) {
-        temp[i] = std::complex<float>(m_excitation.samples[i], 0.0f);
+void GpuAlgorithm::begin_stream(const std::vector<float>& timestamp_offsets) {
+    use_cuda_device();
+    // frees the buffers of an unfinished stream, which synchronizes the device
+    m_stream_frames.clear();
+    BaseAlgorithm::begin_stream(timestamp_offsets);
+    throw_if_not_configured();
+    update_derived_state();
+
+    // frames in flight need the batched launches, which only depend on the
+    // per-frame buffers of a stream frame.
+    const auto num_lines = m_scan_seq->get_num_lines();
+    if (!can_use_batched_launch(num_lines)) {
+        m_log_object->write(ILog::INFO, "Batched launches not possible, simulating stream frames one by one");
+        return;
+    }
+    // frames in flight have buffers for all lines
+    if (!m_line_batches.empty()) {
+        m_log_object->write(ILog::INFO, "Frames are simulated in line batches, simulating stream frames one by one");
+        return;
     }
-    cudaErrorCheck( cudaMemcpy(m_device_excitation_fft->data(), temp.data(), rf_line_bytes, cudaMemcpyHostToDevice) );
 
-    // create a temporary plan for computing forward FFT of excitation
-    auto excitation_fft_plan = CufftPlanRAII::u_ptr(new CufftPlanRAII(m_num_time_samples, CUFFT_C2C, 1));
+    m_can_change_cuda_device = false;
+    if (m_store_kernel_details) {
+        m_debug_data.clear();
+    }
+    m_use_real_fft = !use_phase_delay() && (m_param_noise_amplitude <= 0.0f);
 
-    // compute FFT of excitation signal and add the Hilbert transform
-    cufftErrorCheck( cufftExecC2C(excitation_fft_plan->get(), m_device_excitation_fft->data(), m_device_excitation_fft->data(), CUFFT_FORWARD) );
-    auto mask = discrete_hilbert_mask<std::complex<float> >(m_num_time_samples);
-    DeviceBufferRAII<complex> device_hilbert_mask(rf_line_bytes);
-    cudaErrorCheck( cudaMemcpy(device_hilbert_mask.data(), mask.data(), rf_line_bytes, cudaMemcpyHostToDevice) );
-    
-    cudaStream_t cuda_stream = 0;
-    launch_ScaleSignalKernel(m_num_time_samples/128, 128, cuda_stream, m_device_excitation_fft->data(), 1.0f/m_num_time_samples, m_num_time_samples);
-    launch_MultiplyFftKernel(m_num_time_samples/128, 128, cuda_stream, m_device_excitation_fft->data(), device_hilbert_mask.data(), m_num_time_samples);
+    const auto num_stream_frames = std::min(static_cast<size_t>(m_param_frames_in_flight), timestamp_offsets.size());
+    for (size_t slot_no = 0; slot_no < num_stream_frames; slot_no++) {
+        m_stream_frames.push_back(create_stream_frame(num_lines));
+    }
+    m_stream_frame_start = std::chrono::steady_clock::now();
+    for (size_t slot_no = 0; slot_no < num_stream_frames; slot_no++) {
+        enqueue_stream_frame(*m_stream_frames[slot_no], timestamp_offsets[slot_no]);
+    }
 }
 
+GpuAlgorithm::StreamFrame::u_ptr GpuAlgorithm::create_stream_frame(int num_lines) {
+    StreamFrame::u_ptr frame(new StreamFrame);
+    frame->stream = CudaStreamRAII::u_ptr(new CudaStreamRAII);
+    frame->device_time_proj = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(sizeof(complex)*m_num_time_samples*num_lines));
+    allocate_iq_lines(frame->device_iq_lines, frame->host_iq_lines);
+    create_fft_plans(num_lines, frame->fft_plan, frame->fft_plan_r2c);
+    return frame;
+}
 
-void GpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
-    m_can_change_cuda_device = false;
-    
-    m_scan_seq = new_scan_sequence;
+bool GpuAlgorithm::next_frame(std::complex<float>* iq_buffer, size_t line_stride) {
+    use_cuda_device();
+    if (m_stream_frames.empty()) {
+        return BaseAlgorithm::next_frame(iq_buffer, line_stride);
+    }
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
 
-    // HACK: Temporarily limited to the hardcoded value for m_num_time_samples
-    auto num_rf_samples = compute_num_rf_samples(m_param_sound_speed, m_scan_seq->line_length, m_excitation.sampling_frequency);
-    if (num_rf_samples > m_num_time_samples) {
-        m_log_object->write(ILog::FATAL, "num_rf_samples required: " + std::to_string(num_rf_samples));
-        throw std::runtime_error("Too many RF samples required. TODO: remove limitation");
+    // the frames are enqueued round-robin on the stream frames
+    auto& frame = *m_stream_frames[m_stream_next_frame % m_stream_frames.size()];
+    cudaErrorCheck( cudaStreamSynchronize(frame.stream->get()) );
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        const auto src = frame.host_iq_lines->data() + line_no*num_samples;
+        std::copy(src, src + num_samples, iq_buffer + line_no*line_stride);
     }
+    report_lines(0, num_lines, iq_buffer, line_stride);
+    // frames in flight overlap, so a frame takes the time since the previous one
+    count_frame(num_lines, m_stream_frame_start);
+    m_stream_frame_start = std::chrono::steady_clock::now();
+
+    const auto num_frames = m_stream_timestamp_offsets.size();
+    const auto refill_frame_no = m_stream_next_frame + m_stream_frames.size();
+    m_stream_next_frame++;
+    if (refill_frame_no < num_frames) {
+        enqueue_stream_frame(frame, m_stream_timestamp_offsets[refill_frame_no]);
+    } else if (m_stream_next_frame == num_frames) {
+        m_stream_frames.clear();
+    }
+    return true;
+}
 
-    size_t num_beams = m_scan_seq->get_num_lines();
+struct GpuAlgorithm::AsyncFrameCompletion {
+    GpuAlgorithm*                           algorithm;
+    std::promise<void>                      promise;
+    const std::complex<float>*              host_iq_lines;
+    std::complex<float>*                    iq_buffer;
+    size_t                                  line_stride;
+    size_t                                  num_lines;
+    size_t                                  num_samples;
+    std::chrono::steady_clock::time_point   start;
+};
+
+std::future<void> GpuAlgorithm::simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) {
+    use_cuda_device();
+    throw_if_not_configured();
+    update_derived_state();
+    const auto num_lines = m_scan_seq->get_num_lines();
+    // the stream frames hold all lines like those of begin_stream()
+    if (!m_stream_frames.empty() || !m_line_batches.empty() || !can_use_batched_launch(num_lines)) {
+        return BaseAlgorithm::simulate_lines_async(iq_buffer, line_stride);
+    }
+    size_t num_output_lines, num_samples;
+    get_output_dimensions(num_output_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
 
-    // avoid reallocating memory if not necessary.
-    if (m_num_beams_allocated != num_beams) {
-        m_log_object->write(ILog::INFO, "Reconfiguring cuFFT batched plan");
-        m_log_object->write(ILog::INFO, "m_num_time_samples: " + std::to_string(m_num_time_samples));
-        const auto num_samples = static_cast<int>(m_num_time_samples);
-        const auto batch = static_cast<int>(num_beams);
-        const int rank = 1;
-        int dims[] = {m_num_time_samples};
-        m_fft_plan = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, num_samples, CUFFT_C2C, batch));
-        m_log_object->write(ILog::INFO, "batch = " + std::to_string(batch));
-
-        // allocate host and device memory related to RF lines
-        const auto device_iq_line_bytes = sizeof(complex)*m_num_time_samples;
-        const auto host_iq_line_bytes   = sizeof(std::complex<float>)*m_num_time_samples;
+    m_can_change_cuda_device = false;
+    m_use_real_fft = !use_phase_delay() && (m_param_noise_amplitude <= 0.0f);
+    // the configuration may have changed since the last frames finished
+    const std::vector<size_t> key = {static_cast<size_t>(num_lines), num_samples, m_use_real_fft,
+                                     m_param_noise_amplitude > 0.0f, static_cast<size_t>(m_param_frames_in_flight)};
+    if (key != m_async_stream_frames_key) {
+        wait_for_async_stream_frames();
+        m_async_stream_frames.clear();
+        for (int slot_no = 0; slot_no < m_param_frames_in_flight; slot_no++) {
+            m_async_stream_frames.push_back(create_stream_frame(num_lines));
+        }
+        m_async_stream_frames_key = key;
+        m_next_async_stream_frame = 0;
+    }
 
-        m_log_object->write(ILog::INFO, "Reallocating HOST and DEVICE memory");
-        m_device_time_proj = DeviceBufferRAII<complex>::u_ptr ( new DeviceBufferRAII<complex>(device_iq_line_bytes*num_beams));
+    auto& frame = *m_async_stream_frames[m_next_async_stream_frame];
+    cudaErrorCheck( cudaStreamSynchronize(frame.stream->get()) );
+
+    std::unique_ptr<AsyncFrameCompletion> completion(new AsyncFrameCompletion);
+    completion->algorithm     = this;
+    completion->host_iq_lines = frame.host_iq_lines->data();
+    completion->iq_buffer     = iq_buffer;
+    completion->line_stride   = line_stride;
+    completion->num_lines     = num_output_lines;
+    completion->num_samples   = num_samples;
+    completion->start         = std::chrono::steady_clock::now();
+    auto res = completion->promise.get_future();
+
+    enqueue_stream_frame(frame, 0.0f);
+    // The host function is not run if the stream fails, which the next
+    // synchronization of the stream throws for.
+    cudaErrorCheck( cudaLaunchHostFunc(frame.stream->get(), &GpuAlgorithm::complete_async_frame, completion.get()) );
+    completion.release();
+    m_next_async_stream_frame = (m_next_async_stream_frame + 1) % m_async_stream_frames.size();
+    return res;
+}
 
-        // allocate host memory for all RF lines
-        m_host_rf_lines.resize(num_beams);
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            m_host_rf_lines[beam_no] = std::move(HostPinnedBufferRAII<std::complex<float>>::u_ptr( new HostPinnedBufferRAII<std::complex<float>>(host_iq_line_bytes)) );
-        }
+void CUDART_CB GpuAlgorithm::complete_async_frame(void* user_data) {
+    // no CUDA calls are allowed in host functions
+    std::unique_ptr<AsyncFrameCompletion> completion(static_cast<AsyncFrameCompletion*>(user_data));
+    for (size_t line_no = 0; line_no < completion->num_lines; line_no++) {
+        const auto src = completion->host_iq_lines + line_no*completion->num_samples;
+        std::copy(src, src + completion->num_samples, completion->iq_buffer + line_no*completion->line_stride);
+    }
+    completion->algorithm->report_lines(0, completion->num_lines, completion->iq_buffer, completion->line_stride);
+    completion->algorithm->count_frame(completion->num_lines, completion->start);
+    completion->promise.set_value();
+}
 
-        m_num_beams_allocated = static_cast<int>(num_beams);
+void GpuAlgorithm::wait_for_async_stream_frames() {
+    for (const auto& frame : m_async_stream_frames) {
+        cudaErrorCheck( cudaStreamSynchronize(frame->stream->get()) );
     }
 }
 
-void GpuAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
-    m_log_object->write(ILog::INFO, "Setting analytical beam profile for GPU algorithm");
-    const auto analytical_profile = std::dynamic_pointer_cast<GaussianBeamProfile>(beam_profile);
-    if (!analytical_profile) throw std::runtime_error("GpuAlgorithm: failed to cast beam profile");
-    m_cur_beam_profile_type = BeamProfileType::ANALYTICAL;
+void GpuAlgorithm::enqueue_stream_frame(StreamFrame& frame, float timestamp_offset) {
+    const auto num_lines = m_scan_seq->get_num_lines();
+    const auto stream = frame.stream->get();
 
-    m_analytical_sigma_lat = analytical_profile->getSigmaLateral();
-    m_analytical_sigma_ele = analytical_profile->getSigmaElevational();
+    // the batched frame functions work on the member buffers
+    swap_stream_frame_buffers(frame);
+    try {
+        // every frame in flight has its own frame number
+        if (m_param_noise_amplitude > 0.0f) {
+            upload_noise_frame(stream);
+        }
+        m_noise_frame_no++;
+        // the spline basis is evaluated per frame instead of rendering
+        // splines into the datasets shared by all frames.
+        upload_line_descriptors(stream, num_lines, false, timestamp_offset);
+        prepare_fft_callbacks(num_lines);
+        enqueue_frame_batched(stream, num_lines, false);
+    } catch (...) {
+        swap_stream_frame_buffers(frame);
+        throw;
+    }
+    swap_stream_frame_buffers(frame);
 }
 
-void GpuAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
-    m_log_object->write(ILog::INFO, "Setting LUT profile for GPU algorithm");
-    const auto lut_beam_profile = std::dynamic_pointer_cast<LUTBeamProfile>(beam_profile);
-    if (!lut_beam_profile) throw std::runtime_error("GpuAlgorithm: failed to cast beam profile");
-    m_cur_beam_profile_type = BeamProfileType::LOOKUP;
-
-    int num_samples_rad = lut_beam_profile->getNumSamplesRadial();
-    int num_samples_lat = lut_beam_profile->getNumSamplesLateral();
-    int num_samples_ele = lut_beam_profile->getNumSamplesElevational();
-    m_log_object->write(ILog::DEBUG, "=== set_lookup_profile() ===");
-    m_log_object->write(ILog::DEBUG, "num_samples_rad: " + std::to_string(num_samples_rad));
-    m_log_object->write(ILog::DEBUG, "num_samples_lat: " + std::to_string(num_samples_lat));
-    m_log_object->write(ILog::DEBUG, "num_samples_ele: " + std::to_string(num_samples_ele));
-        
-    const auto r_range = lut_beam_profile->getRangeRange();
-    const auto l_range = lut_beam_profile->getLateralRange();
-    const auto e_range = lut_beam_profile->getElevationalRange();
-
-    // map to linear memory with correct 3D layout
-    const auto total = num_samples_rad*num_samples_lat*num_samples_ele;
-    std::vector<float> temp_samples;
-    temp_samples.reserve(total);
-    for (int zi = 0; zi < num_samples_rad; zi++) {
-        for (int yi = 0; yi < num_samples_lat; yi++) {
-            for (int xi = 0; xi < num_samples_ele; xi++) {
-                const auto x = l_range.first + xi*(l_range.last-l_range.first)/(num_samples_lat-1);
-                const auto y = e_range.first + yi*(e_range.last-e_range.first)/(num_samples_ele-1);
-                const auto z = r_range.first + zi*(r_range.last-r_range.first)/(num_samples_rad-1);
-                temp_samples.push_back(lut_beam_profile->sampleProfile(z, x, y));
-            }
-        }
+void GpuAlgorithm::swap_stream_frame_buffers(StreamFrame& frame) {
+    std::swap(m_device_time_proj,           frame.device_time_proj);
+    std::swap(m_device_iq_lines,            frame.device_iq_lines);
+    std::swap(m_host_iq_lines,              frame.host_iq_lines);
+    std::swap(m_host_line_descriptors,      frame.host_line_descriptors);
+    std::swap(m_device_line_descriptors,    frame.device_line_descriptors);
+    std::swap(m_line_descriptors_key,       frame.line_descriptors_key);
+    std::swap(m_fft_plan,                   frame.fft_plan);
+    std::swap(m_fft_plan_r2c,               frame.fft_plan_r2c);
+    std::swap(m_device_noise_frame,         frame.device_noise_frame);
+    std::swap(m_host_noise_frame,           frame.host_noise_frame);
+    std::swap(m_fft_callback_plans,         frame.fft_callback_plans);
+}
+
+void GpuAlgorithm::work_stream_wait_for_streams() {
+    for (size_t stream_no = 0; stream_no < m_stream_wrappers.size(); stream_no++) {
+        m_stream_events[stream_no]->record(m_stream_wrappers[stream_no]->get());
+        m_stream_events[stream_no]->make_wait(m_work_stream->get());
     }
-    auto log_adapter = [&](const std::string& msg) {
-        m_log_object->write(ILog::DEBUG, msg);
-    };
-    const auto table_extent = DeviceBeamProfileRAII::TableExtent3D(num_samples_lat, num_samples_ele, num_samples_rad);
-    m_device_beam_profile = std::make_unique<DeviceBeamProfileRAII>(table_extent, temp_samples, log_adapter);
-    // store spatial extent of profile.
-    m_lut_r_min = r_range.first;
-    m_lut_r_max = r_range.last;
-    m_lut_l_min = l_range.first;
-    m_lut_l_max = l_range.last;
-    m_lut_e_min = e_range.first;
-    m_lut_e_max = e_range.last;
+}
 
-    m_log_object->write(ILog::DEBUG, "Created a new DeviceBeamProfileRAII");
-    
-    if (false) {
-        const std::string raw_lut_path("d:/temp/raw_lookup_table/");
-        dump_orthogonal_lut_slices(raw_lut_path);
-        // write extents
-        std::ofstream out_stream;
-        out_stream.open(raw_lut_path + "/extents.txt");
+void GpuAlgorithm::streams_wait_for_work_stream() {
+    for (const auto& stream_wrapper : m_stream_wrappers) {
+        m_work_event->make_wait(stream_wrapper->get());
+    }
+}
+
+void GpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> > >&  /*out*/ rf_lines) {
+    use_cuda_device();
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto cache_key = frame_cache_key(m_noise_frame_no);
+    if (!cache_key.empty() && read_cached_frame(cache_key, rf_lines)) {
+        m_noise_frame_no++;
+        return;
+    }
+    const auto host_iq_lines = simulate_to_host_buffer(true);
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, host_iq_lines, num_samples);
+    }
+
+    trace::ScopedEvent event("copy_output", "gpu");
+    // resizing reuses the capacity of the caller's vectors between frames
+    rf_lines.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        const auto src = host_iq_lines + line_no*num_samples;
+        rf_lines[line_no].assign(src, src + num_samples);
+    }
+}
+
+void GpuAlgorithm::simulate_lines(std::complex<float>* iq_buffer, size_t line_stride) {
+    use_cuda_device();
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    const auto cache_key = frame_cache_key(m_noise_frame_no);
+    if (!cache_key.empty() && read_cached_frame(cache_key, iq_buffer, line_stride)) {
+        m_noise_frame_no++;
+        return;
+    }
+    const auto host_iq_lines = simulate_to_host_buffer(true);
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, host_iq_lines, num_samples);
+    }
+
+    trace::ScopedEvent event("copy_output", "gpu");
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        const auto src = host_iq_lines + line_no*num_samples;
+        std::copy(src, src + num_samples, iq_buffer + line_no*line_stride);
+    }
+}
+
+float GpuAlgorithm::simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) {
+    use_cuda_device();
+    throw_if_not_configured();
+    update_derived_state();
+    if (!m_line_batches.empty()) {
+        // the device IQ lines only hold one line batch
+        return BaseAlgorithm::simulate_bmode_image(config, image);
+    }
+    simulate_to_device_iq_lines();
+    return device_iq_to_bmode_image(config, image, false);
+}
+
+float GpuAlgorithm::simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* device_image) {
+    use_cuda_device();
+    throw_if_not_configured();
+    update_derived_state();
+    if (!m_line_batches.empty()) {
+        m_host_bmode_image.resize(static_cast<size_t>(config.width)*config.height);
+        const auto normalize_const = BaseAlgorithm::simulate_bmode_image(config, m_host_bmode_image.data());
+        cudaErrorCheck( cudaMemcpy(device_image, m_host_bmode_image.data(), m_host_bmode_image.size(), cudaMemcpyHostToDevice) );
+        return normalize_const;
+    }
+    simulate_to_device_iq_lines();
+    return device_iq_to_bmode_image(config, device_image, true);
+}
+
+namespace {
+
+// A frame allocated from the memory pool, with the event of its write.
+class DeviceIqFrame : public IDeviceIqFrame {
+public:
+    DeviceIqFrame(int device_no, cudaStream_t stream, size_t num_lines, size_t num_samples)
+        : m_device_no(device_no),
+          m_stream(stream),
+          m_num_lines(num_lines),
+          m_num_samples(num_samples),
+          m_samples(new DeviceBufferRAII<std::complex<float>>(num_lines*num_samples*sizeof(std::complex<float>)))
+    { }
+
+    virtual std::complex<float>* data() const override {
+        return m_samples->data();
+    }
+
+    virtual size_t get_num_lines() const override {
+        return m_num_lines;
+    }
+
+    virtual size_t get_num_samples() const override {
+        return m_num_samples;
+    }
+
+    virtual int get_device() const override {
+        return m_device_no;
+    }
+
+    virtual void* get_stream() const override {
+        return m_stream;
+    }
+
+    virtual void make_stream_wait(void* stream) const override {
+        m_written.make_wait(static_cast<cudaStream_t>(stream));
+    }
+
+    virtual void synchronize() const override {
+        m_written.synchronize();
+    }
+
+    // Mark the work queued so far to the stream as the write of the frame.
+    void record_written() {
+        m_written.record(m_stream);
+    }
+
+private:
+    int                                         m_device_no;
+    cudaStream_t                                m_stream;
+    size_t                                      m_num_lines;
+    size_t                                      m_num_samples;
+    DeviceBufferRAII<std::complex<float>>::u_ptr m_samples;
+    mutable CudaEventRAII                       m_written;
+};
+
+}   // namespace
+
+IDeviceIqFrame::s_ptr GpuAlgorithm::simulate_lines_on_device() {
+    use_cuda_device();
+    throw_if_not_configured();
+    update_derived_state();
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto frame_bytes = num_lines*num_samples*sizeof(std::complex<float>);
+    if (!m_line_batches.empty()) {
+        // the device IQ lines only hold one line batch
+        const auto host_iq_lines = simulate_to_host_buffer();
+        auto frame = std::make_shared<DeviceIqFrame>(m_param_cuda_device_no, m_work_stream->get(), num_lines, num_samples);
+        // synchronous, since the next frame reuses the host buffer
+        cudaErrorCheck( cudaMemcpy(frame->data(), host_iq_lines, frame_bytes, cudaMemcpyHostToDevice) );
+        frame->record_written();
+        return frame;
+    }
+    simulate_to_device_iq_lines();
+    // The next frame starts on the work stream, so the copy is done before
+    // the device IQ lines are overwritten, without waiting for it here.
+    auto frame = std::make_shared<DeviceIqFrame>(m_param_cuda_device_no, m_work_stream->get(), num_lines, num_samples);
+    cudaErrorCheck( cudaMemcpyAsync(frame->data(), m_device_iq_lines->data(), frame_bytes,
+                                    cudaMemcpyDeviceToDevice, m_work_stream->get()) );
+    frame->record_written();
+    return frame;
+}
+
+float GpuAlgorithm::simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) {
+    if (format.sample_type == IqOutputFormat::SampleType::COMPLEX_FLOAT32) {
+        return BaseAlgorithm::simulate_lines_formatted(format, iq_buffer, line_stride);
+    }
+    use_cuda_device();
+    throw_if_not_configured();
+    update_derived_state();
+    if (!m_line_batches.empty()) {
+        // the device IQ lines only hold one line batch
+        return BaseAlgorithm::simulate_lines_formatted(format, iq_buffer, line_stride);
+    }
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    const auto num_beamspace = num_lines*num_samples;
+    const auto packed_bytes = num_beamspace*sizeof(unsigned int);
+    if (!m_device_packed_iq || (m_device_packed_iq->get_num_bytes() != packed_bytes)) {
+        m_device_packed_iq = DeviceBufferRAII<unsigned int>::u_ptr(new DeviceBufferRAII<unsigned int>(packed_bytes));
+    }
+    if (!m_device_max_iq_bits) {
+        m_device_max_iq_bits = DeviceBufferRAII<unsigned int>::u_ptr(new DeviceBufferRAII<unsigned int>(sizeof(unsigned int)));
+    }
+    simulate_to_device_iq_lines();
+
+    // the IQ lines are complete when the frame has been simulated
+    auto stream = m_stream_wrappers[0]->get();
+    const int threads_per_block = 256;
+    const int num_blocks = round_up_div(static_cast<int>(num_beamspace), threads_per_block);
+    const auto per_frame_scale = (format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16)
+                                 && (format.int16_scale == 0.0f);
+    if (per_frame_scale) {
+        cudaErrorCheck( cudaMemsetAsync(m_device_max_iq_bits->data(), 0, sizeof(unsigned int), stream) );
+        launch_MaxAbsIqComponentKernel(num_blocks, threads_per_block, stream, m_device_iq_lines->data(),
+                                       m_device_max_iq_bits->data(), static_cast<int>(num_beamspace));
+    }
+    launch_PackIqKernel(num_blocks, threads_per_block, stream, m_device_iq_lines->data(), m_device_packed_iq->data(),
+                        static_cast<int>(format.sample_type), format.int16_scale,
+                        per_frame_scale ? m_device_max_iq_bits->data() : nullptr, static_cast<int>(num_beamspace));
+    cudaErrorCheck( cudaMemcpy2DAsync(iq_buffer, line_stride*sizeof(unsigned int),
+                                      m_device_packed_iq->data(), num_samples*sizeof(unsigned int),
+                                      num_samples*sizeof(unsigned int), num_lines, cudaMemcpyDeviceToHost, stream) );
+    unsigned int max_bits = 0;
+    if (per_frame_scale) {
+        cudaErrorCheck( cudaMemcpyAsync(&max_bits, m_device_max_iq_bits->data(), sizeof(max_bits), cudaMemcpyDeviceToHost, stream) );
+    }
+    cudaErrorCheck( cudaStreamSynchronize(stream) );
+    if (format.sample_type != IqOutputFormat::SampleType::COMPLEX_INT16) {
+        return 1.0f;
+    }
+    if (!per_frame_scale) {
+        return format.int16_scale;
+    }
+    float max_abs_component;
+    std::memcpy(&max_abs_component, &max_bits, sizeof(max_abs_component));
+    return int16_frame_scale(max_abs_component);
+}
+
+void GpuAlgorithm::simulate_to_device_iq_lines() {
+    m_copy_iq_to_host = false;
+    try {
+        simulate_to_host_buffer();
+    } catch (...) {
+        m_copy_iq_to_host = true;
+        throw;
+    }
+    m_copy_iq_to_host = true;
+}
+
+float GpuAlgorithm::device_iq_to_bmode_image(const BModeImageConfig& config, unsigned char* image, bool image_on_device) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if ((num_lines < 2) || (num_samples < 2) || (config.width < 2) || (config.height < 2)) {
+        throw std::runtime_error("B-mode image needs at least two lines, samples and pixels in each direction");
+    }
+    const auto num_beamspace = num_lines*num_samples;
+    if (!m_gray_level_texture || (m_gray_level_texture->get_width() != num_samples) || (m_gray_level_texture->get_height() != num_lines)) {
+        m_log_object->write(ILog::INFO, "Reallocating device memory for B-mode image conversion");
+        m_device_envelope    = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_beamspace*sizeof(float)));
+        m_device_gray_levels = DeviceBufferRAII<unsigned char>::u_ptr(new DeviceBufferRAII<unsigned char>(num_beamspace));
+        m_gray_level_texture = DeviceTexture2DRAII::u_ptr(new DeviceTexture2DRAII(num_samples, num_lines));
+    }
+    if (!m_device_max_envelope) {
+        m_device_max_envelope = DeviceBufferRAII<unsigned int>::u_ptr(new DeviceBufferRAII<unsigned int>(sizeof(unsigned int)));
+    }
+    const auto num_pixels = static_cast<size_t>(config.width)*config.height;
+    if (!image_on_device && (!m_device_bmode_image || (m_device_bmode_image->get_num_bytes() != num_pixels))) {
+        m_device_bmode_image = DeviceBufferRAII<unsigned char>::u_ptr(new DeviceBufferRAII<unsigned char>(num_pixels));
+    }
+
+    // the IQ lines are complete when the frame has been simulated
+    auto stream = m_stream_wrappers[0]->get();
+    const int threads_per_block = 256;
+    const int num_blocks = round_up_div(static_cast<int>(num_beamspace), threads_per_block);
+    cudaErrorCheck( cudaMemsetAsync(m_device_max_envelope->data(), 0, sizeof(unsigned int), stream) );
+    launch_EnvelopeKernel(num_blocks, threads_per_block, stream, m_device_iq_lines->data(), m_device_envelope->data(),
+                          m_device_max_envelope->data(), static_cast<int>(num_beamspace));
+    launch_GrayLevelKernel(num_blocks, threads_per_block, stream, m_device_envelope->data(), m_device_gray_levels->data(),
+                           config.auto_normalize ? m_device_max_envelope->data() : nullptr, config.normalize_const,
+                           config.dyn_range, config.gain, static_cast<int>(num_beamspace));
+    m_gray_level_texture->copy_from_device(m_device_gray_levels->data(), stream);
+
+    const int threads_per_row = 128;
+    auto device_image = image_on_device ? image : m_device_bmode_image->data();
+    launch_ScanConvertKernel(round_up_div(config.width, threads_per_row), config.height, threads_per_row, stream,
+                             m_gray_level_texture->get(), config, static_cast<int>(num_lines), static_cast<int>(num_samples),
+                             device_image);
+
+    unsigned int max_bits;
+    if (!image_on_device) {
+        cudaErrorCheck( cudaMemcpyAsync(image, device_image, num_pixels, cudaMemcpyDeviceToHost, stream) );
+    }
+    cudaErrorCheck( cudaMemcpyAsync(&max_bits, m_device_max_envelope->data(), sizeof(max_bits), cudaMemcpyDeviceToHost, stream) );
+    cudaErrorCheck( cudaStreamSynchronize(stream) );
+    if (!config.auto_normalize) {
+        return config.normalize_const;
+    }
+    float max_envelope;
+    std::memcpy(&max_envelope, &max_bits, sizeof(max_envelope));
+    return max_envelope;
+}
+
+void GpuAlgorithm::get_output_dimensions(size_t& num_lines, size_t& num_samples) const {
+    if (!m_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to get output dimensions");
+    }
+    const auto num_rf_samples = rf_sample_window().num_samples;
+    num_lines   = static_cast<size_t>(m_scan_seq->get_num_lines());
+    num_samples = (num_rf_samples + m_radial_decimation - 1)/m_radial_decimation;
+}
+
+float GpuAlgorithm::get_output_start_time() const {
+    if (!m_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to get the output start time");
+    }
+    return rf_sample_window().first_sample/m_excitation.sampling_frequency;
+}
+
+void GpuAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
+    use_cuda_device();
+    m_can_change_cuda_device = false;
+    // the spectrum is computed at the next frame
+    if (!m_device_excitation_fft || !same_excitation(new_excitation, m_excitation)) {
+        m_frame_graph.reset();
+        m_excitation = new_excitation;
+        m_excitation_dirty = true;
+    }
+    m_state.set_excitation(new_excitation);
+}
+
+void GpuAlgorithm::update_derived_state() {
+    // the line length also depends on the sound speed, so it is always checked
+    const auto window = rf_sample_window();
+    const auto num_time_samples = compute_num_time_samples(window.num_samples);
+    if (window.first_sample != m_first_rf_sample) {
+        // a window of the same length may start at another sample
+        m_first_rf_sample = window.first_sample;
+        m_frame_graph.reset();
+        m_excitation_dirty = true;
+    }
+    if (num_time_samples != m_num_time_samples) {
+        m_log_object->write(ILog::INFO, "Number of time samples: " + std::to_string(num_time_samples));
+        m_num_time_samples = num_time_samples;
+        // everything sized by the line length is recreated
+        m_frame_graph.reset();
+        m_fft_callback_plans.reset();
+        m_device_excitation_fft.reset();
+        m_num_beams_allocated = -1;
+        m_excitation_dirty = true;
+        m_line_batches_dirty = true;
+    }
+    if (m_excitation_dirty) {
+        upload_excitation_fft();
+        m_excitation_dirty = false;
+    }
+    if (m_line_batches_dirty) {
+        configure_line_batches();
+        m_line_batches_dirty = false;
+    }
+    autotune_if_needed();
+}
+
+std::string GpuAlgorithm::autotune_key() const {
+    int driver_version = 0;
+    cudaErrorCheck( cudaDriverGetVersion(&driver_version) );
+    const auto num_scatterers = m_device_fixed_datasets.get_total_num_scatterers() + m_device_spline_datasets.get_total_num_scatterers();
+    return AutotuneCache::make_key(m_cur_device_prop.name, driver_version, num_scatterers, m_scan_seq->get_num_lines(),
+                                   m_num_time_samples);
+}
+
+void GpuAlgorithm::autotune_if_needed() {
+    if (!m_param_autotune || m_autotuning) {
+        return;
+    }
+    const auto key = autotune_key();
+    if (key == m_autotune_key) {
+        return;
+    }
+    AutotuneCache cache(m_param_autotune_cache);
+    AutotuneEntry entry;
+    if (cache.find(key, entry)) {
+        m_log_object->write(ILog::INFO, "Using autotuned configuration of " + key);
+    } else {
+        m_log_object->write(ILog::INFO, "Autotuning " + key);
+        entry = run_autotune();
+        cache.store(key, entry);
+    }
+    apply_autotune_entry(entry);
+    m_autotune_key = key;
+    m_log_object->write(ILog::INFO, "threads_per_block=" + std::to_string(entry.threads_per_block)
+                        + " gpu_threads_per_line=" + std::to_string(entry.threads_per_line)
+                        + " cuda_streams=" + std::to_string(entry.num_cuda_streams));
+}
+
+AutotuneEntry GpuAlgorithm::run_autotune() {
+    // the tuning frames are not part of the frame statistics or the noise frames
+    const auto num_frames = m_stats_num_frames.load();
+    const auto num_projections = m_stats_num_projections.load();
+    const auto total_ns = m_stats_total_ns.load();
+    const auto last_frame_ns = m_stats_last_frame_ns.load();
+    const auto noise_frame_no = m_noise_frame_no;
+    const auto restore_stats = [&]() {
+        m_stats_num_frames = num_frames;
+        m_stats_num_projections = num_projections;
+        m_stats_total_ns = total_ns;
+        m_stats_last_frame_ns = last_frame_ns;
+        m_noise_frame_no = noise_frame_no;
+        m_autotuning = false;
+    };
+
+    // the fastest of a few frames after one which allocates and captures
+    const auto time_frame = [&](const AutotuneEntry& candidate) {
+        apply_autotune_entry(candidate);
+        simulate_to_host_buffer();
+        double best_seconds = std::numeric_limits<double>::max();
+        for (int i = 0; i < 3; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            simulate_to_host_buffer();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best_seconds = std::min(best_seconds, elapsed.count());
+        }
+        return best_seconds;
+    };
+
+    AutotuneEntry best = {m_param_threads_per_block, m_param_threads_per_line, m_param_num_cuda_streams};
+    m_autotuning = true;
+    try {
+        std::vector<int> block_sizes;
+        for (int block_size = 64; block_size <= std::min(1024, m_cur_device_prop.maxThreadsPerBlock); block_size *= 2) {
+            block_sizes.push_back(block_size);
+        }
+        const auto tune = [&](int AutotuneEntry::* member, const std::vector<int>& candidates) {
+            auto best_seconds = std::numeric_limits<double>::max();
+            auto best_value = best.*member;
+            for (const auto value : candidates) {
+                auto candidate = best;
+                candidate.*member = value;
+                const auto seconds = time_frame(candidate);
+                if (seconds < best_seconds) {
+                    best_seconds = seconds;
+                    best_value = value;
+                }
+            }
+            best.*member = best_value;
+        };
+        tune(&AutotuneEntry::threads_per_block, block_sizes);
+        tune(&AutotuneEntry::threads_per_line, block_sizes);
+        // the streams are only used by the line-by-line launches
+        if (!can_use_batched_launch(static_cast<int>(m_scan_seq->get_num_lines())) && m_cur_device_prop.concurrentKernels) {
+            tune(&AutotuneEntry::num_cuda_streams, {1, 2, 4, 8, 16});
+        }
+    } catch (...) {
+        restore_stats();
+        throw;
+    }
+    restore_stats();
+    return best;
+}
+
+void GpuAlgorithm::apply_autotune_entry(const AutotuneEntry& entry) {
+    m_frame_graph.reset();
+    m_param_threads_per_block = entry.threads_per_block;
+    m_param_threads_per_line = entry.threads_per_line;
+    if (entry.num_cuda_streams != m_param_num_cuda_streams) {
+        m_param_num_cuda_streams = entry.num_cuda_streams;
+        create_cuda_stream_wrappers(m_param_num_cuda_streams);
+    }
+}
+
+size_t GpuAlgorithm::compute_num_time_samples(size_t num_rf_samples) const {
+    if (m_param_baseband) {
+        const auto decimation = static_cast<size_t>(m_radial_decimation);
+        int first_tap;
+        const auto num_taps = IBeamConvolver::get_baseband_taps(num_rf_samples, m_excitation, m_radial_decimation, first_tap).size();
+        return next_smooth_size((num_rf_samples + decimation - 1)/decimation + num_taps - 1, 128);
+    }
+    return next_smooth_size(num_rf_samples + m_excitation.samples.size() - 1, 128);
+}
+
+RfSampleWindow GpuAlgorithm::rf_sample_window() const {
+    return compute_rf_sample_window(m_param_sound_speed, *m_scan_seq, m_excitation, m_radial_decimation);
+}
+
+int GpuAlgorithm::time_proj_first_sample() const {
+    return static_cast<int>(m_param_baseband ? m_first_rf_sample/m_radial_decimation : m_first_rf_sample);
+}
+
+float GpuAlgorithm::time_proj_sampling_frequency() const {
+    return m_param_baseband ? m_excitation.sampling_frequency/m_radial_decimation : m_excitation.sampling_frequency;
+}
+
+float GpuAlgorithm::noise_amplitude() const {
+    // the decimated grid has radial_decimation times fewer samples per pulse
+    return m_param_baseband ? m_param_noise_amplitude*std::sqrt(static_cast<float>(m_radial_decimation))
+                            : m_param_noise_amplitude;
+}
+
+void GpuAlgorithm::get_demodulation(float& normalized_angular_freq, int& offset, int& decimation) const {
+    const float PI = static_cast<float>(4.0*std::atan(1));
+    normalized_angular_freq = 2*PI*m_excitation.demod_freq/m_excitation.sampling_frequency;
+    if (m_param_baseband) {
+        // the baseband filter is centered at its first sample, and the lines are already decimated
+        normalized_angular_freq *= m_radial_decimation;
+        offset = 0;
+        decimation = 1;
+    } else {
+        offset = static_cast<int>(m_excitation.center_index);
+        decimation = m_radial_decimation;
+    }
+}
+
+void GpuAlgorithm::upload_excitation_fft() {
+    size_t rf_line_bytes   = sizeof(complex)*m_num_time_samples;
+
+    // setup pre-computed convolution kernel and Hilbert transformer.
+    if (!m_device_excitation_fft) {
+        m_device_excitation_fft = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(rf_line_bytes));
+    }
+    m_log_object->write(ILog::INFO, "Number of excitation samples: " + std::to_string(m_excitation.samples.size()));
+
+    if (m_param_baseband) {
+        // The decimated analytic excitation with the excitation delay at sample
+        // zero. The demodulation kernels then see no delay compensation offset,
+        // so its demodulation phase is applied to the filter instead.
+        const auto num_rf_samples = rf_sample_window().num_samples;
+        int first_tap;
+        const auto taps = IBeamConvolver::get_baseband_taps(num_rf_samples, m_excitation, m_radial_decimation, first_tap);
+        const double PI = 4.0*std::atan(1.0);
+        const auto delay_phase = -2.0*PI*m_excitation.demod_freq*m_excitation.center_index/m_excitation.sampling_frequency;
+        const auto delay_phasor = std::complex<float>(static_cast<float>(std::cos(delay_phase)), static_cast<float>(std::sin(delay_phase)))
+                                * window_demodulation_phasor(m_excitation, m_first_rf_sample);
+        std::vector<std::complex<float> > temp(m_num_time_samples);
+        const auto length = static_cast<int>(m_num_time_samples);
+        for (size_t i = 0; i < taps.size(); i++) {
+            temp[static_cast<size_t>((first_tap + static_cast<int>(i) + length) % length)] = taps[i]*delay_phasor;
+        }
+        cudaErrorCheck( cudaMemcpy(m_device_excitation_fft->data(), temp.data(), rf_line_bytes, cudaMemcpyHostToDevice) );
+        auto excitation_fft_plan = CufftPlanRAII::u_ptr(new CufftPlanRAII(m_num_time_samples, CUFFT_C2C, 1));
+        cufftErrorCheck( cufftExecC2C(excitation_fft_plan->get(), m_device_excitation_fft->data(), m_device_excitation_fft->data(), CUFFT_FORWARD) );
+        const int num_blocks = round_up_div(static_cast<int>(m_num_time_samples), m_param_threads_per_line);
+        launch_ScaleSignalKernel(num_blocks, m_param_threads_per_line, 0, m_device_excitation_fft->data(), 1.0f/m_num_time_samples, m_num_time_samples);
+        return;
+    }
+
+    // the truncated analytic excitation of the sparse path, on the host
+    // convolver's lags
+    {
+        const auto num_rf_samples = rf_sample_window().num_samples;
+        auto taps = IBeamConvolver::get_analytic_taps(num_rf_samples, m_excitation, m_sparse_first_lag);
+        for (auto& tap : taps) {
+            tap *= window_demodulation_phasor(m_excitation, m_first_rf_sample);
+        }
+        m_device_sparse_taps = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(sizeof(complex)*taps.size()));
+        cudaErrorCheck( cudaMemcpy(m_device_sparse_taps->data(), taps.data(), sizeof(complex)*taps.size(), cudaMemcpyHostToDevice) );
+    }
+
+    // convert to complex with zero imaginary part.
+    std::vector<std::complex<float> > temp(m_num_time_samples);
+    for (size_t i = 0; i < m_excitation.samples.size(); i++) {
+        temp[i] = std::complex<float>(m_excitation.samples[i], 0.0f);
+    }
+    cudaErrorCheck( cudaMemcpy(m_device_excitation_fft->data(), temp.data(), rf_line_bytes, cudaMemcpyHostToDevice) );
+
+    // create a temporary plan for computing forward FFT of excitation
+    auto excitation_fft_plan = CufftPlanRAII::u_ptr(new CufftPlanRAII(m_num_time_samples, CUFFT_C2C, 1));
+
+    // compute FFT of excitation signal and add the Hilbert transform
+    cufftErrorCheck( cufftExecC2C(excitation_fft_plan->get(), m_device_excitation_fft->data(), m_device_excitation_fft->data(), CUFFT_FORWARD) );
+    // with the demodulation phase of the first sample of a depth window
+    auto mask = discrete_hilbert_mask<std::complex<float> >(m_num_time_samples);
+    const auto window_phasor = window_demodulation_phasor(m_excitation, m_first_rf_sample);
+    for (auto& bin : mask) {
+        bin *= window_phasor;
+    }
+    DeviceBufferRAII<complex> device_hilbert_mask(rf_line_bytes);
+    cudaErrorCheck( cudaMemcpy(device_hilbert_mask.data(), mask.data(), rf_line_bytes, cudaMemcpyHostToDevice) );
+    
+    cudaStream_t cuda_stream = 0;
+    const int num_blocks = round_up_div(static_cast<int>(m_num_time_samples), m_param_threads_per_line);
+    launch_ScaleSignalKernel(num_blocks, m_param_threads_per_line, cuda_stream, m_device_excitation_fft->data(), 1.0f/m_num_time_samples, m_num_time_samples);
+    launch_MultiplyFftKernel(num_blocks, m_param_threads_per_line, cuda_stream, m_device_excitation_fft->data(), device_hilbert_mask.data(), m_num_time_samples);
+}
+
+
+void GpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_can_change_cuda_device = false;
+    
+    m_scan_seq = new_scan_sequence;
+    m_single_geometry = has_single_geometry(*new_scan_sequence);
+    m_mla_group_size = mla_group_size(*new_scan_sequence);
+    m_line_descriptors_generation++;
+
+    // the line batches and their buffers are updated at the next frame,
+    // including the line length
+    m_line_batches_dirty = true;
+    m_state.set_scan_sequence(new_scan_sequence);
+}
+
+int GpuAlgorithm::mla_lines_per_block() const {
+    if (!m_param_mla_projection || (m_mla_group_size == 1)) {
+        return 1;
+    }
+    // the line batches must start at a transmit
+    if (!m_line_batches.empty() && (m_num_beams_allocated % m_mla_group_size != 0)) {
+        return 1;
+    }
+    return m_mla_group_size;
+}
+
+int GpuAlgorithm::line_batch_size(int num_lines) const {
+    if (m_param_max_lines_per_batch > 0) {
+        return std::min(num_lines, m_param_max_lines_per_batch);
+    } else if (m_param_max_lines_per_batch == 0) {
+        return num_lines;
+    }
+
+    // the time projections and cuFFT work area of a line, in half of the
+    // free memory (including the buffers that are replaced).
+    size_t free_bytes, total_bytes;
+    cudaErrorCheck( cudaMemGetInfo(&free_bytes, &total_bytes) );
+    if (m_device_time_proj) {
+        free_bytes += m_device_time_proj->get_num_bytes();
+    }
+    const auto bytes_per_line = 2*sizeof(complex)*m_num_time_samples;
+    // whole multiples of 64 lines, so that small changes of the free
+    // memory do not change the batch size.
+    const size_t granularity = 64;
+    auto max_lines = (free_bytes/2/bytes_per_line/granularity)*granularity;
+    max_lines = std::max(max_lines, granularity);
+    return static_cast<int>(std::min(static_cast<size_t>(num_lines), max_lines));
+}
+
+void GpuAlgorithm::configure_line_batches() {
+    m_frame_graph.reset();
+    m_line_descriptors_generation++;
+    const int num_lines = m_scan_seq->get_num_lines();
+    const int num_beams = line_batch_size(num_lines);
+
+    m_line_batches.clear();
+    if ((num_beams > 0) && (num_beams < num_lines)) {
+        m_log_object->write(ILog::INFO, "Simulating frames in batches of " + std::to_string(num_beams) + " lines");
+        for (int first_line = 0; first_line < num_lines; first_line += num_beams) {
+            m_line_batches.push_back(line_range(*m_scan_seq, first_line, num_beams));
+        }
+    }
+
+    // avoid reallocating memory if not necessary.
+    if (m_num_beams_allocated != num_beams) {
+        // the old and new buffers may not fit in device memory together
+        m_fft_plan.reset();
+        m_fft_plan_r2c.reset();
+        m_device_time_proj.reset();
+        m_log_object->write(ILog::INFO, "Reconfiguring cuFFT batched plan");
+        m_log_object->write(ILog::INFO, "m_num_time_samples: " + std::to_string(m_num_time_samples));
+        create_fft_plans(static_cast<int>(num_beams), m_fft_plan, m_fft_plan_r2c);
+        m_log_object->write(ILog::INFO, "batch = " + std::to_string(num_beams));
+
+        // allocate device memory related to RF lines
+        const auto device_iq_line_bytes = sizeof(complex)*m_num_time_samples;
+
+        m_log_object->write(ILog::INFO, "Reallocating DEVICE memory");
+        m_device_time_proj = DeviceBufferRAII<complex>::u_ptr ( new DeviceBufferRAII<complex>(device_iq_line_bytes*num_beams));
+
+        m_num_beams_allocated = static_cast<int>(num_beams);
+    }
+}
+
+void GpuAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_log_object->write(ILog::INFO, "Setting analytical beam profile for GPU algorithm");
+    const auto analytical_profile = std::dynamic_pointer_cast<GaussianBeamProfile>(beam_profile);
+    if (!analytical_profile) throw std::runtime_error("GpuAlgorithm: failed to cast beam profile");
+    m_cur_beam_profile_type = BeamProfileType::ANALYTICAL;
+
+    m_analytical_sigma_lat = analytical_profile->getSigmaLateral();
+    m_analytical_sigma_ele = analytical_profile->getSigmaElevational();
+    m_state.set_analytical_profile(beam_profile);
+}
+
+void GpuAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_log_object->write(ILog::INFO, "Setting LUT profile for GPU algorithm");
+    const auto lut_profile = std::dynamic_pointer_cast<LUTBeamProfile>(beam_profile);
+    const auto multi_resolution_profile = std::dynamic_pointer_cast<MultiResolutionLUTBeamProfile>(beam_profile);
+    if (!lut_profile && !multi_resolution_profile) {
+        throw std::runtime_error("GpuAlgorithm: failed to cast beam profile");
+    }
+    if (multi_resolution_profile && (multi_resolution_profile->getNumZones() > MAX_LUT_ZONES)) {
+        throw std::runtime_error("GpuAlgorithm: too many zones in multi-resolution LUT profile");
+    }
+    if (multi_resolution_profile && (m_param_lut_format == LUTFormat::SEPARABLE)) {
+        throw std::runtime_error("separable LUT format is not supported for multi-resolution LUT profiles");
+    }
+    m_cur_beam_profile_type = lut_profile ? BeamProfileType::LOOKUP : BeamProfileType::MULTI_RESOLUTION_LOOKUP;
+    m_lut_profile = lut_profile;
+    m_multi_resolution_lut_profile = multi_resolution_profile;
+    upload_lookup_profile();
+
+    m_log_object->write(ILog::DEBUG, "Created a new DeviceBeamProfileRAII");
+    
+    if (false) {
+        const std::string raw_lut_path("d:/temp/raw_lookup_table/");
+        dump_orthogonal_lut_slices(raw_lut_path);
+        // write extents
+        std::ofstream out_stream;
+        out_stream.open(raw_lut_path + "/extents.txt");
         out_stream << m_lut_r_min << " " << m_lut_r_max << std::endl;
         out_stream << m_lut_l_min << " " << m_lut_l_max << std::endl;
         out_stream << m_lut_e_min << " " << m_lut_e_max << std::endl;
     }
+    m_state.set_lookup_profile(beam_profile);
+}
+
+void GpuAlgorithm::upload_lookup_profile() {
+    if (m_multi_resolution_lut_profile && (m_param_lut_format == LUTFormat::SEPARABLE)) {
+        throw std::runtime_error("separable LUT format is not supported for multi-resolution LUT profiles");
+    }
+    auto log_adapter = [&](const std::string& msg) {
+        m_log_object->write(ILog::DEBUG, msg);
+    };
+    m_device_lut_factors.reset();
+    m_lut_factors = SeparableLUTFactors();
+    m_lut_factors.rank = 0;
+    m_device_lut_zones.clear();
+    m_lut_zones = MultiResolutionLUT();
+    m_lut_zones.num_zones = 0;
+    const auto half_precision = (m_param_lut_format == LUTFormat::HALF);
+
+    // the error of rounding the samples to half precision
+    const auto half_precision_error = [](const std::vector<float>& samples) {
+        std::vector<float> rounded(samples);
+        for (auto& sample : rounded) {
+            sample = half_to_float(float_to_half(sample));
+        }
+        return compute_lut_approximation_error(samples, rounded);
+    };
+
+    if (m_multi_resolution_lut_profile) {
+        const auto& profile = *m_multi_resolution_lut_profile;
+        m_log_object->write(ILog::DEBUG, "=== upload_lookup_profile() ===");
+        m_log_object->write(ILog::DEBUG, "num_zones: " + std::to_string(profile.getNumZones()));
+        std::vector<float> all_samples;
+        for (int zone_no = 0; zone_no < profile.getNumZones(); zone_no++) {
+            const auto& zone = profile.getZone(zone_no);
+            const auto table_extent = DeviceBeamProfileRAII::TableExtent3D(zone.getNumSamplesLateral(), zone.getNumSamplesElevational(),
+                                                                           zone.getNumSamplesRadial());
+            m_device_lut_zones.push_back(std::make_unique<DeviceBeamProfileRAII>(table_extent, zone.getSamples().data(), half_precision, log_adapter));
+            m_lut_zones.tex[zone_no] = m_device_lut_zones.back()->get();
+            m_lut_zones.geometry[zone_no].r_min = zone.getRangeRange().first;
+            m_lut_zones.geometry[zone_no].r_max = zone.getRangeRange().last;
+            m_lut_zones.geometry[zone_no].l_min = zone.getLateralRange().first;
+            m_lut_zones.geometry[zone_no].l_max = zone.getLateralRange().last;
+            m_lut_zones.geometry[zone_no].e_min = zone.getElevationalRange().first;
+            m_lut_zones.geometry[zone_no].e_max = zone.getElevationalRange().last;
+            all_samples.insert(all_samples.end(), zone.getSamples().begin(), zone.getSamples().end());
+        }
+        const auto& boundaries = profile.getZoneBoundaries();
+        std::copy(boundaries.begin(), boundaries.end(), m_lut_zones.boundaries);
+        m_lut_zones.num_zones = profile.getNumZones();
+        m_lut_error = half_precision ? half_precision_error(all_samples) : LUTApproximationError{0.0f, 0.0f};
+
+        // the single texture is not used
+        create_dummy_lut_profile();
+        m_lut_r_min = profile.getZone(0).getRangeRange().first;
+        m_lut_r_max = profile.getZone(profile.getNumZones() - 1).getRangeRange().last;
+        m_log_object->write(ILog::INFO, "Multi-resolution LUT beam profile error against the full tables: max "
+                            + std::to_string(m_lut_error.max_error) + ", relative RMS " + std::to_string(m_lut_error.relative_rms_error));
+        return;
+    }
+
+    const auto& profile = *m_lut_profile;
+    const int num_samples_rad = profile.getNumSamplesRadial();
+    const int num_samples_lat = profile.getNumSamplesLateral();
+    const int num_samples_ele = profile.getNumSamplesElevational();
+    m_log_object->write(ILog::DEBUG, "=== upload_lookup_profile() ===");
+    m_log_object->write(ILog::DEBUG, "num_samples_rad: " + std::to_string(num_samples_rad));
+    m_log_object->write(ILog::DEBUG, "num_samples_lat: " + std::to_string(num_samples_lat));
+    m_log_object->write(ILog::DEBUG, "num_samples_ele: " + std::to_string(num_samples_ele));
+
+    const auto& samples = profile.getSamples();
+    if (m_param_lut_format == LUTFormat::SEPARABLE) {
+        const auto separable = compute_separable_lut(profile, m_param_lut_separable_rank);
+        std::vector<float> host_factors(separable.radial);
+        host_factors.insert(host_factors.end(), separable.lateral.begin(), separable.lateral.end());
+        host_factors.insert(host_factors.end(), separable.elevational.begin(), separable.elevational.end());
+        m_device_lut_factors = std::make_unique<DeviceBufferRAII<float>>(host_factors.size()*sizeof(float));
+        cudaErrorCheck( cudaMemcpy(m_device_lut_factors->data(), host_factors.data(), host_factors.size()*sizeof(float), cudaMemcpyHostToDevice) );
+        m_lut_factors.radial = m_device_lut_factors->data();
+        m_lut_factors.lateral = m_lut_factors.radial + separable.radial.size();
+        m_lut_factors.elevational = m_lut_factors.lateral + separable.lateral.size();
+        m_lut_factors.num_samples_rad = num_samples_rad;
+        m_lut_factors.num_samples_lat = num_samples_lat;
+        m_lut_factors.num_samples_ele = num_samples_ele;
+        m_lut_factors.rank = separable.rank;
+        m_lut_error = compute_lut_approximation_error(samples, separable.get_samples());
+        create_dummy_lut_profile();
+    } else {
+        const auto table_extent = DeviceBeamProfileRAII::TableExtent3D(num_samples_lat, num_samples_ele, num_samples_rad);
+        // the texture has the layout of the LUT samples, which are uploaded as they are
+        m_device_beam_profile = std::make_unique<DeviceBeamProfileRAII>(table_extent, samples.data(), half_precision, log_adapter);
+        m_lut_error = half_precision ? half_precision_error(samples) : LUTApproximationError{0.0f, 0.0f};
+    }
+
+    // store spatial extent of profile.
+    const auto r_range = profile.getRangeRange();
+    const auto l_range = profile.getLateralRange();
+    const auto e_range = profile.getElevationalRange();
+    m_lut_r_min = r_range.first;
+    m_lut_r_max = r_range.last;
+    m_lut_l_min = l_range.first;
+    m_lut_l_max = l_range.last;
+    m_lut_e_min = e_range.first;
+    m_lut_e_max = e_range.last;
+    m_lut_num_samples_rad = num_samples_rad;
+    m_lut_num_samples_lat = num_samples_lat;
+    m_lut_num_samples_ele = num_samples_ele;
+
+    m_log_object->write(ILog::INFO, "LUT beam profile error against the full table: max " + std::to_string(m_lut_error.max_error)
+                        + ", relative RMS " + std::to_string(m_lut_error.relative_rms_error));
+}
+
+size_t GpuAlgorithm::beam_profile_device_bytes() const {
+    if (m_multi_resolution_lut_profile) {
+        const auto sample_size = (m_param_lut_format == LUTFormat::HALF) ? sizeof(uint16_t) : sizeof(float);
+        return sample_size*m_multi_resolution_lut_profile->getNumSamples();
+    }
+    if (!m_lut_profile) {
+        return 0;
+    }
+    const size_t num_samples = static_cast<size_t>(m_lut_num_samples_rad)*m_lut_num_samples_lat*m_lut_num_samples_ele;
+    switch (m_param_lut_format) {
+    case LUTFormat::HALF:
+        return sizeof(uint16_t)*num_samples;
+    case LUTFormat::SEPARABLE:
+        return sizeof(float)*m_param_lut_separable_rank*(m_lut_num_samples_rad + m_lut_num_samples_lat + m_lut_num_samples_ele);
+    default:
+        return sizeof(float)*num_samples;
+    }
+}
+
+void GpuAlgorithm::dump_orthogonal_lut_slices(const std::string& raw_path) {
+    const auto write_raw = [&](float3 origin, float3 dir0, float3 dir1, std::string raw_file) {
+        const int num_samples = 1024;
+        const int total_num_samples = num_samples*num_samples;
+        const int num_bytes = sizeof(float)*total_num_samples;
+        DeviceBufferRAII<float> device_slice(static_cast<size_t>(num_bytes));
+            
+        //dim3 grid_size(num_samples, num_samples, 1);
+        //dim3 block_size(1, 1, 1);
+        const cudaStream_t cuda_stream = 0;
+        launch_SliceLookupTable(num_samples, num_samples, 1, cuda_stream,
+                                origin, dir0, dir1, device_slice.data(), m_device_beam_profile->get());
+        cudaErrorCheck( cudaDeviceSynchronize() );
+        dump_device_buffer_as_raw_file(device_slice, raw_file);
+        m_log_object->write(ILog::DEBUG, "Wrote RAW file to " + raw_file);
+
+    };
+
+    // slice in the middle lateral-elevational plane (radial dist is 0.5)
+    write_raw(make_float3(0.0f, 0.0f, 0.5f),
+                make_float3(0.0f, 1.0f, 0.0f),
+                make_float3(1.0f, 0.0f, 0.0f),
+                raw_path + "lut_slice_lat_ele.raw");
+    // slice the middle lateral-radial plane (elevational dist is 0.5)
+    write_raw(make_float3(0.5f, 0.0f, 0.0f),
+                make_float3(0.0f, 1.0f, 0.0f),
+                make_float3(0.0f, 0.0f, 1.0f),
+                raw_path + "lut_slice_lat_rad.raw");
+    // slice the middle elevational-radial plane (lateral dist is 0.5)
+    write_raw(make_float3(0.0f, 0.5f, 0.0f),
+                make_float3(1.0f, 0.0f, 0.0f),
+                make_float3(0.0f, 0.0f, 1.0f),
+                raw_path + "lut_slice_ele_rad.raw");
+
+    // 6 equally spaced lateral-elevational slices of [0.0, 1.0]
+    for (int i = 0; i <=5; i++) {
+        write_raw(make_float3(0.0f, 0.0f, static_cast<float>(i)/5),
+                  make_float3(0.0f, 1.0f, 0.0f),
+                  make_float3(1.0f, 0.0f, 0.0f),
+                  raw_path + "lut_slice_lat_ele_"+std::to_string(i)+".raw");
+    }
+
+}
+
+NoiseParams GpuAlgorithm::noise_params(int first_line) const {
+    NoiseParams params;
+    params.sigma      = noise_amplitude();
+    params.key        = make_uint2(static_cast<uint32_t>(m_param_noise_seed), static_cast<uint32_t>(m_param_noise_seed >> 32));
+    params.frame      = m_device_noise_frame->data();
+    params.first_line = m_param_noise_first_line + static_cast<int>(m_cur_line_batch*m_num_beams_allocated) + first_line;
+    return params;
+}
+
+void GpuAlgorithm::upload_noise_frame(cudaStream_t stream) {
+    if (!m_device_noise_frame) {
+        m_device_noise_frame = DeviceBufferRAII<uint2>::u_ptr(new DeviceBufferRAII<uint2>(sizeof(uint2)));
+        m_host_noise_frame   = HostPinnedBufferRAII<uint2>::u_ptr(new HostPinnedBufferRAII<uint2>(sizeof(uint2)));
+    }
+    // the previous copy from the host buffer has completed with its frame
+    m_host_noise_frame->data()[0] = make_uint2(static_cast<uint32_t>(m_noise_frame_no), static_cast<uint32_t>(m_noise_frame_no >> 32));
+    cudaErrorCheck( cudaMemcpyAsync(m_device_noise_frame->data(), m_host_noise_frame->data(), sizeof(uint2),
+                                    cudaMemcpyHostToDevice, stream) );
+}
+
+void GpuAlgorithm::create_dummy_lut_profile() {
+    const size_t n = 16;
+    std::vector<float> dummy_samples(n*n*n, 0.0f);
+    m_device_beam_profile = DeviceBeamProfileRAII::u_ptr(new DeviceBeamProfileRAII(DeviceBeamProfileRAII::TableExtent3D(n, n, n), dummy_samples.data()));
+}
+
+void GpuAlgorithm::clear_fixed_scatterers() {
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_device_fixed_datasets.clear();
+    m_chunked_fixed_datasets.clear();
+    m_procedural_datasets.clear();
+    m_image_volume_datasets.clear();
+    m_fixed_dataset_kinds.clear();
+    m_device_generated_tile.reset();
+    m_state.clear_fixed_scatterers();
+}
+
+void GpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    trace::ScopedEvent event("add_fixed_scatterers", "gpu");
+    upload_fixed_scatterers(fixed_scatterers);
+    m_state.add_fixed_scatterers(fixed_scatterers);
+}
+
+void GpuAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    trace::ScopedEvent event("add_external_fixed_scatterers", "gpu");
+    upload_fixed_scatterers(external_scatterers->expand());
+    m_state.add_external_fixed_scatterers(external_scatterers);
+}
+
+void GpuAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    trace::ScopedEvent event("add_procedural_scatterers", "gpu");
+    use_cuda_device();
+    m_frame_graph.reset();
+    reserve_generated_tile();
+    m_procedural_datasets.push_back(procedural_scatterers);
+    m_fixed_dataset_kinds.push_back(FixedDatasetKind::GENERATED);
+    m_can_change_cuda_device = false;
+    m_state.add_procedural_scatterers(procedural_scatterers);
+}
+
+void GpuAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    trace::ScopedEvent event("add_image_volume_scatterers", "gpu");
+    static_assert(sizeof(unsigned long long) == sizeof(uint64_t), "the voxel numbering is copied as is");
+    const auto& volume = *image_volume_scatterers;
+    const auto num_voxels = volume.get_num_voxels();
+    if ((volume.voxel_starts.size() != num_voxels + 1) || (volume.amplitude_scales.size() != num_voxels)) {
+        throw std::runtime_error("image volume counts are not up to date");
+    }
+    use_cuda_device();
+    m_frame_graph.reset();
+    reserve_generated_tile();
+    DeviceImageVolume device_volume;
+    device_volume.volume = image_volume_scatterers;
+    const auto starts_bytes = volume.voxel_starts.size()*sizeof(uint64_t);
+    device_volume.voxel_starts = DeviceBufferRAII<unsigned long long>::u_ptr(new DeviceBufferRAII<unsigned long long>(starts_bytes));
+    cudaErrorCheck( cudaMemcpy(device_volume.voxel_starts->data(), volume.voxel_starts.data(), starts_bytes, cudaMemcpyHostToDevice) );
+    if (num_voxels > 0) {
+        device_volume.amplitude_scales = DeviceVolumeTextureRAII::u_ptr(
+            new DeviceVolumeTextureRAII(volume.nx, volume.ny, volume.nz, volume.amplitude_scales.data()));
+    }
+    m_image_volume_datasets.push_back(std::move(device_volume));
+    m_fixed_dataset_kinds.push_back(FixedDatasetKind::GENERATED);
+    m_can_change_cuda_device = false;
+    m_state.add_image_volume_scatterers(image_volume_scatterers);
+}
+
+void GpuAlgorithm::reserve_generated_tile() {
+    const auto tile_bytes = 4*m_param_generated_tile_size*sizeof(float);
+    if (!m_device_generated_tile || (m_device_generated_tile->get_num_bytes() < tile_bytes)) {
+        // the frames in flight may still use the previous tile
+        cudaErrorCheck( cudaDeviceSynchronize() );
+        m_device_generated_tile = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(tile_bytes));
+    }
+}
+
+void GpuAlgorithm::upload_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    use_cuda_device();
+    m_frame_graph.reset();
+    if (m_param_scatterer_chunk_size > 0) {
+        m_chunked_fixed_datasets.push_back(std::make_shared<HostChunkedFixedScatterers>(*fixed_scatterers, m_param_scatterer_chunk_size,
+                                                                                        m_param_scatterer_order));
+        m_fixed_dataset_kinds.push_back(FixedDatasetKind::CHUNKED);
+    } else {
+        m_device_fixed_datasets.set_mapped(use_mapped_scatterers());
+        // a restored state may have the dataset sorted already
+        const auto layout = restored_fixed_layout(m_fixed_dataset_kinds.size(), 1);
+        if (layout) {
+            m_device_fixed_datasets.add(*layout, m_param_compact_scatterers, m_param_interleaved_scatterers);
+        } else {
+            m_device_fixed_datasets.add(fixed_scatterers, m_param_scatterer_order, m_param_compact_scatterers,
+                                        m_param_interleaved_scatterers);
+        }
+        m_fixed_dataset_kinds.push_back(FixedDatasetKind::DEVICE);
+    }
+    m_can_change_cuda_device = false;
+}
+
+void GpuAlgorithm::clear_spline_scatterers() {
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_device_spline_datasets.clear();
+    m_line_descriptors_generation++;
+    m_state.clear_spline_scatterers();
+}
+
+void GpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    trace::ScopedEvent event("add_spline_scatterers", "gpu");
+    use_cuda_device();
+    m_frame_graph.reset();
+    m_can_change_cuda_device = false;
+    m_device_spline_datasets.add(spline_scatterers);
+    m_line_descriptors_generation++;
+    m_state.add_spline_scatterers(spline_scatterers);
+}
+
+void GpuAlgorithm::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                           const std::vector<PointScatterer>& new_scatterers) {
+    use_cuda_device();
+    trace::ScopedEvent event("update_fixed_scatterers", "gpu");
+    if (dset_idx >= m_fixed_dataset_kinds.size()) {
+        throw std::runtime_error("Illegal dataset index");
+    }
+    if (m_state.get_external_datasets()[dset_idx]) {
+        throw std::runtime_error("external scatterers cannot be updated");
+    }
+    const auto kind = m_fixed_dataset_kinds[dset_idx];
+    if (kind == FixedDatasetKind::GENERATED) {
+        throw std::runtime_error("procedural and image volume scatterers cannot be updated");
+    }
+    const auto category_idx = static_cast<size_t>(std::count(m_fixed_dataset_kinds.begin(),
+                                                             m_fixed_dataset_kinds.begin() + dset_idx, kind));
+    if (kind == FixedDatasetKind::CHUNKED) {
+        // the host chunks may still be read by copies of the last frame
+        if (m_copy_stream) {
+            cudaErrorCheck( cudaStreamSynchronize(m_copy_stream->get()) );
+        }
+        m_chunked_fixed_datasets[category_idx]->update(indices, new_scatterers);
+    } else {
+        // the device arrays are updated in place, so a captured frame stays valid.
+        m_device_fixed_datasets.update(category_idx, indices, new_scatterers, m_param_scatterer_order);
+    }
+    m_state.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+}
+
+void GpuAlgorithm::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                            const SplineScatterers& new_scatterers) {
+    use_cuda_device();
+    trace::ScopedEvent event("update_spline_scatterers", "gpu");
+    m_device_spline_datasets.update(dset_idx, indices, new_scatterers);
+    m_state.update_spline_scatterers(dset_idx, indices, new_scatterers);
+}
+
+void GpuAlgorithm::simulate_frame_batched(int num_lines, bool use_rendered_splines) {
+    // the whole frame is enqueued on the first stream, which can be captured
+    // (unlike the legacy default stream).
+    auto stream = m_stream_wrappers[0]->get();
+    upload_line_descriptors(stream, num_lines, use_rendered_splines);
+    prepare_fft_callbacks(num_lines);
+    prepare_sparse_convolution(num_lines);
+    prepare_jit_kernels(use_rendered_splines);
+
+    // outside of the capture, for the noise and rendered splines of this frame
+    m_work_event->make_wait(stream);
+
+    // the event timers synchronize, which is not possible during capture.
+    // the chunk copies on the copy stream cannot be captured, and a
+    // multi-excitation frame is not repeated.
+    if (!m_param_use_cuda_graph || m_store_kernel_details || !m_chunked_fixed_datasets.empty() || m_multi_excitation_active) {
+        m_frame_graph.reset();
+        enqueue_frame_batched(stream, num_lines, use_rendered_splines);
+    } else {
+        const auto graph_key = frame_graph_key(num_lines, use_rendered_splines);
+        if (!m_frame_graph || (graph_key != m_frame_graph_key)) {
+            m_log_object->write(ILog::INFO, "Capturing frame into a CUDA graph");
+            m_frame_graph.reset();
+            cudaGraph_t graph;
+            cudaErrorCheck( cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal) );
+            enqueue_frame_batched(stream, num_lines, use_rendered_splines);
+            cudaErrorCheck( cudaStreamEndCapture(stream, &graph) );
+            m_frame_graph = CudaGraphExecRAII::u_ptr(new CudaGraphExecRAII(graph));
+            m_frame_graph_key = graph_key;
+        }
+        m_frame_graph->launch(stream);
+    }
+    cudaErrorCheck( cudaStreamSynchronize(stream) );
+}
+
+void GpuAlgorithm::enqueue_frame_batched(cudaStream_t stream, int num_lines, bool use_rendered_splines) {
+    project_lines_batched(stream, num_lines, use_rendered_splines);
+    if (m_multi_excitation_active) {
+        enqueue_multi_excitation(stream, num_lines);
+        return;
+    }
+
+    const int threads_per_line = m_param_threads_per_line;
+
+    std::unique_ptr<EventTimerRAII> event_timer;
+    if (m_store_kernel_details) {
+        event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(stream));
+        event_timer->restart();
+    }
+
+    size_t num_output_lines, num_iq_samples;
+    get_output_dimensions(num_output_lines, num_iq_samples);
+    if (m_sparse_counts) {
+        // few non-zero samples per line: no transforms
+        float normalized_angular_freq;
+        int delay_compensation_num_samples, decimation;
+        get_demodulation(normalized_angular_freq, delay_compensation_num_samples, decimation);
+        const auto capacity = m_param_sparse_convolution_threshold;
+        launch_CollectNonzeroKernel(num_lines, threads_per_line, stream, m_device_time_proj->data(), static_cast<int>(m_num_time_samples),
+                                    static_cast<int>(m_num_time_samples), m_use_real_fft, capacity, m_sparse_counts->data(),
+                                    m_sparse_indices->data(), m_sparse_values->data());
+        launch_SparseSynthesisKernel(round_up_div(static_cast<int>(num_iq_samples), threads_per_line), num_lines, threads_per_line, stream,
+                                     m_sparse_counts->data(), m_sparse_indices->data(), m_sparse_values->data(), capacity,
+                                     m_device_sparse_taps->data(), static_cast<int>(m_device_sparse_taps->get_num_bytes()/sizeof(complex)),
+                                     m_sparse_first_lag, m_device_iq_lines->data(), normalized_angular_freq,
+                                     delay_compensation_num_samples, decimation, static_cast<int>(num_iq_samples));
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_sparse_convolution_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+    } else if (m_fft_callback_plans) {
+        // filter multiplication in the forward and demodulation in the inverse
+        // transform's store callback, which writes the IQ lines directly.
+        m_fft_callback_plans->forward(stream, m_device_time_proj->data(), m_use_real_fft);
+        if (m_use_real_fft) {
+            const int num_bins = static_cast<int>(m_num_time_samples/2 + 1);
+            const int num_zero = static_cast<int>(m_num_time_samples) - num_bins;
+            launch_MemsetBatchedKernel(round_up_div(num_zero, threads_per_line), num_lines, threads_per_line, stream,
+                                       m_device_time_proj->data() + num_bins, make_cuComplex(0.0f, 0.0f), num_zero,
+                                       static_cast<int>(m_num_time_samples));
+        }
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_forward_fft_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+        m_fft_callback_plans->inverse(stream, m_device_time_proj->data());
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_inverse_fft_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+    } else {
+        // in-place batched forward FFT
+        cufftErrorCheck( cufftSetStream(m_fft_plan->get(), stream) );
+        cufftErrorCheck( cufftSetStream(m_fft_plan_r2c->get(), stream) );
+        if (m_use_real_fft) {
+            auto real_ptr = reinterpret_cast<cufftReal*>(m_device_time_proj->data());
+            cufftErrorCheck(cufftExecR2C(m_fft_plan_r2c->get(), real_ptr, m_device_time_proj->data()));
+        } else {
+            cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_FORWARD));
+        }
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_forward_fft_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+
+        // multiply with FFT of impulse response w/Hilbert transform, with R2C
+        // the negative frequencies are zeroed.
+        const int num_bins = static_cast<int>(m_use_real_fft ? m_num_time_samples/2 + 1 : m_num_time_samples);
+        launch_MultiplyFftBatchedKernel(round_up_div(static_cast<int>(m_num_time_samples), threads_per_line), num_lines, threads_per_line, stream,
+                                        m_device_time_proj->data(), m_device_excitation_fft->data(), num_bins, static_cast<int>(m_num_time_samples));
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_multiply_fft_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+
+        // in-place batched backward FFT
+        cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_INVERSE));
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_inverse_fft_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+
+        // IQ demodulation of the delay compensated and decimated samples only
+        float normalized_angular_freq;
+        int delay_compensation_num_samples, decimation;
+        get_demodulation(normalized_angular_freq, delay_compensation_num_samples, decimation);
+        launch_DemodulateDecimateBatchedKernel(round_up_div(static_cast<int>(num_iq_samples), threads_per_line), num_lines, threads_per_line, stream,
+                                               m_device_time_proj->data(), m_device_iq_lines->data(), normalized_angular_freq,
+                                               delay_compensation_num_samples, decimation, static_cast<int>(num_iq_samples),
+                                               static_cast<int>(m_num_time_samples));
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_demodulate_ms"].push_back(elapsed_ms);
+            event_timer->restart();
+        }
+    }
+
+    if (m_copy_iq_to_host) {
+        const auto num_bytes_iq_lines = sizeof(complex)*num_iq_samples*num_lines;
+        cudaErrorCheck( cudaMemcpyAsync(m_host_iq_lines->data(), m_device_iq_lines->data(), num_bytes_iq_lines, cudaMemcpyDeviceToHost, stream) );
+        if (m_store_kernel_details) {
+            const auto elapsed_ms = static_cast<double>(event_timer->stop());
+            m_debug_data["kernel_memcpy_ms"].push_back(elapsed_ms);
+        }
+    }
+}
+
+void GpuAlgorithm::simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                   std::complex<float>* iq_buffer,
+                                                   size_t line_stride, size_t frame_stride) {
+    use_cuda_device();
+    throw_if_not_configured();
+    check_multi_excitation_args(excitations, line_stride, frame_stride);
+    if (m_stream_wrappers.size() == 0) {
+        create_cuda_stream_wrappers(m_param_num_cuda_streams);
+    }
+    update_derived_state();
+    if (!can_share_projection(excitations)) {
+        BaseAlgorithm::simulate_lines_multi_excitation(excitations, iq_buffer, line_stride, frame_stride);
+        return;
+    }
+    trace::ScopedEvent event("simulate_lines_multi_excitation", "gpu");
+    prepare_multi_excitation(excitations);
+    m_multi_excitation_active = true;
+    try {
+        simulate_to_host_buffer();
+    } catch (...) {
+        m_multi_excitation_active = false;
+        throw;
+    }
+    m_multi_excitation_active = false;
+
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto host_iq_lines = m_host_multi_excitation_iq->data();
+    for (size_t k = 0; k < excitations.size(); k++) {
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            const auto src = host_iq_lines + (k*num_lines + line_no)*num_samples;
+            std::copy(src, src + num_samples, iq_buffer + k*frame_stride + line_no*line_stride);
+        }
+    }
+}
 
+bool GpuAlgorithm::can_share_projection(const std::vector<ExcitationSignal>& excitations) {
+    const auto num_lines = static_cast<int>(m_scan_seq->get_num_lines());
+    if (m_param_baseband || (m_param_noise_amplitude > 0.0f) || !m_line_batches.empty() || !can_use_batched_launch(num_lines)) {
+        return false;
+    }
+    // as in simulate_batch_to_host_buffer()
+    update_spline_render_groups();
+    const auto num_rendered_groups = std::count_if(m_spline_render_groups.begin(), m_spline_render_groups.end(),
+                                                   [](const SplineRenderGroup& group) { return group.rendered; });
+    if (num_rendered_groups >= 2) {
+        return false;
+    }
+    // the line length and window depend on the number of excitation samples
+    for (const auto& excitation : excitations) {
+        if (excitation.samples.size() != m_excitation.samples.size()) {
+            return false;
+        }
+        if (use_phase_delay() && (excitation.demod_freq != m_excitation.demod_freq)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void GpuAlgorithm::dump_orthogonal_lut_slices(const std::string& raw_path) {
-    const auto write_raw = [&](float3 origin, float3 dir0, float3 dir1, std::string raw_file) {
-        const int num_samples = 1024;
-        const int total_num_samples = num_samples*num_samples;
-        const int num_bytes = sizeof(float)*total_num_samples;
-        DeviceBufferRAII<float> device_slice(static_cast<size_t>(num_bytes));
-            
-        //dim3 grid_size(num_samples, num_samples, 1);
-        //dim3 block_size(1, 1, 1);
-        const cudaStream_t cuda_stream = 0;
-        launch_SliceLookupTable(num_samples, num_samples, 1, cuda_stream,
-                                origin, dir0, dir1, device_slice.data(), m_device_beam_profile->get());
-        cudaErrorCheck( cudaDeviceSynchronize() );
-        dump_device_buffer_as_raw_file(device_slice, raw_file);
-        m_log_object->write(ILog::DEBUG, "Wrote RAW file to " + raw_file);
+void GpuAlgorithm::prepare_multi_excitation(const std::vector<ExcitationSignal>& excitations) {
+    const auto cached = (m_multi_excitations.size() == excitations.size())
+                        && (m_multi_excitation_num_time_samples == m_num_time_samples)
+                        && (m_multi_excitation_first_rf_sample == m_first_rf_sample)
+                        && std::equal(excitations.begin(), excitations.end(), m_multi_excitations.begin(),
+                                      [](const ExcitationSignal& excitation, const MultiExcitation& entry) {
+                                          return same_excitation(excitation, entry.excitation);
+                                      });
+    if (!cached) {
+        m_log_object->write(ILog::INFO, "Computing the spectra of " + std::to_string(excitations.size()) + " excitations");
+        // computed as the spectrum of the configured excitation, which is kept aside
+        auto configured_fft = std::move(m_device_excitation_fft);
+        const auto configured = m_excitation;
+        const auto restore = [&]() {
+            m_excitation = configured;
+            m_device_excitation_fft = std::move(configured_fft);
+            // the sparse taps were overwritten
+            m_excitation_dirty = true;
+        };
+        m_multi_excitations.clear();
+        try {
+            for (const auto& excitation : excitations) {
+                m_excitation = excitation;
+                upload_excitation_fft();
+                MultiExcitation entry;
+                entry.excitation = excitation;
+                entry.filter_fft = std::move(m_device_excitation_fft);
+                int decimation;
+                get_demodulation(entry.normalized_angular_freq, entry.offset, decimation);
+                m_multi_excitations.push_back(std::move(entry));
+            }
+        } catch (...) {
+            m_multi_excitations.clear();
+            restore();
+            throw;
+        }
+        restore();
+        m_multi_excitation_num_time_samples = m_num_time_samples;
+        m_multi_excitation_first_rf_sample = m_first_rf_sample;
+    }
+
+    size_t num_lines, num_iq_samples;
+    get_output_dimensions(num_lines, num_iq_samples);
+    const auto spectrum_bytes = sizeof(complex)*m_num_time_samples*num_lines;
+    if (!m_device_multi_excitation_spectrum || (m_device_multi_excitation_spectrum->get_num_bytes() != spectrum_bytes)) {
+        m_device_multi_excitation_spectrum = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(spectrum_bytes));
+    }
+    const auto iq_bytes = sizeof(complex)*num_iq_samples*num_lines*excitations.size();
+    if (!m_device_multi_excitation_iq || (m_device_multi_excitation_iq->get_num_bytes() != iq_bytes)) {
+        m_log_object->write(ILog::INFO, "Reallocating memory for the IQ lines of the excitations");
+        m_device_multi_excitation_iq = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(iq_bytes));
+        m_host_multi_excitation_iq = HostPinnedBufferRAII<std::complex<float>>::u_ptr(new HostPinnedBufferRAII<std::complex<float>>(iq_bytes));
+    }
+}
 
+void GpuAlgorithm::enqueue_multi_excitation(cudaStream_t stream, int num_lines) {
+    const int threads_per_line = m_param_threads_per_line;
+    const auto line_stride = static_cast<int>(m_num_time_samples);
+    size_t num_output_lines, num_iq_samples;
+    get_output_dimensions(num_output_lines, num_iq_samples);
+
+    // the forward transform of the projections is shared by all excitations
+    cufftErrorCheck( cufftSetStream(m_fft_plan->get(), stream) );
+    cufftErrorCheck( cufftSetStream(m_fft_plan_r2c->get(), stream) );
+    if (m_use_real_fft) {
+        auto real_ptr = reinterpret_cast<cufftReal*>(m_device_time_proj->data());
+        cufftErrorCheck(cufftExecR2C(m_fft_plan_r2c->get(), real_ptr, m_device_time_proj->data()));
+    } else {
+        cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), m_device_time_proj->data(), m_device_time_proj->data(), CUFFT_FORWARD));
+    }
+
+    const int num_bins = static_cast<int>(m_use_real_fft ? m_num_time_samples/2 + 1 : m_num_time_samples);
+    const auto spectrum = m_device_multi_excitation_spectrum->data();
+    const auto spectrum_bytes = sizeof(complex)*m_num_time_samples*num_lines;
+    const auto frame_iq_samples = num_iq_samples*num_lines;
+    for (size_t k = 0; k < m_multi_excitations.size(); k++) {
+        const auto& entry = m_multi_excitations[k];
+        cudaErrorCheck( cudaMemcpyAsync(spectrum, m_device_time_proj->data(), spectrum_bytes, cudaMemcpyDeviceToDevice, stream) );
+        launch_MultiplyFftBatchedKernel(round_up_div(line_stride, threads_per_line), num_lines, threads_per_line, stream,
+                                        spectrum, entry.filter_fft->data(), num_bins, line_stride);
+        cufftErrorCheck(cufftExecC2C(m_fft_plan->get(), spectrum, spectrum, CUFFT_INVERSE));
+        launch_DemodulateDecimateBatchedKernel(round_up_div(static_cast<int>(num_iq_samples), threads_per_line), num_lines, threads_per_line,
+                                               stream, spectrum, m_device_multi_excitation_iq->data() + k*frame_iq_samples,
+                                               entry.normalized_angular_freq, entry.offset, m_radial_decimation,
+                                               static_cast<int>(num_iq_samples), line_stride);
+    }
+    cudaErrorCheck( cudaMemcpyAsync(m_host_multi_excitation_iq->data(), m_device_multi_excitation_iq->data(),
+                                    m_device_multi_excitation_iq->get_num_bytes(), cudaMemcpyDeviceToHost, stream) );
+}
+
+std::vector<size_t> GpuAlgorithm::frame_graph_key(int num_lines, bool use_rendered_splines) const {
+    std::vector<size_t> key;
+    const auto add_pointer = [&](const void* ptr) {
+        key.push_back(reinterpret_cast<size_t>(ptr));
+    };
+    key.push_back(static_cast<size_t>(num_lines));
+    key.push_back(use_rendered_splines ? 1 : 0);
+    key.push_back(m_use_real_fft ? 1 : 0);
+    key.push_back(m_param_noise_amplitude > 0.0f ? 1 : 0);
+    const auto noise = noise_amplitude();
+    uint32_t noise_bits;
+    std::memcpy(&noise_bits, &noise, sizeof(noise_bits));
+    key.push_back(noise_bits);
+    key.push_back(static_cast<size_t>(m_param_noise_seed));
+    key.push_back(static_cast<size_t>(m_param_noise_first_line));
+    key.push_back(m_num_time_samples);
+    key.push_back(m_copy_iq_to_host ? 1 : 0);
+    add_pointer(m_device_excitation_fft->data());
+    add_pointer(m_fft_callback_plans.get());
+    add_pointer(m_sparse_counts ? m_sparse_counts->data() : nullptr);
+    if (m_sparse_counts) {
+        // baked into the kernel arguments
+        key.push_back(static_cast<size_t>(m_param_sparse_convolution_threshold));
+        key.push_back(static_cast<size_t>(m_sparse_first_lag));
+        key.push_back(m_device_sparse_taps->get_num_bytes());
+        add_pointer(m_device_sparse_taps->data());
+    }
+    add_pointer(m_device_time_proj->data());
+    add_pointer(m_device_iq_lines->data());
+    add_pointer(m_host_iq_lines->data());
+    add_pointer(m_device_noise_frame ? m_device_noise_frame->data() : nullptr);
+    add_pointer(m_host_line_descriptors->data());
+    add_pointer(m_device_line_descriptors->data());
+    const auto add_fixed_datasets = [&](const DeviceFixedScatterersCollection& datasets) {
+        key.push_back(datasets.get_num_datasets());
+        for (size_t dset_idx = 0; dset_idx < datasets.get_num_datasets(); dset_idx++) {
+            const auto dataset = datasets.get_dataset(dset_idx);
+            key.push_back(dataset->get_num_scatterers());
+            add_pointer(dataset->get_xs_ptr());
+            add_pointer(dataset->get_ys_ptr());
+            add_pointer(dataset->get_zs_ptr());
+            add_pointer(dataset->get_as_ptr());
+            add_pointer(dataset->get_codes_ptr());
+            add_pointer(dataset->get_points_ptr());
+        }
     };
+    add_fixed_datasets(m_device_fixed_datasets);
+    add_fixed_datasets(m_device_rendered_spline_datasets);
+    key.push_back(m_device_spline_datasets.get_num_datasets());
+    for (size_t dset_idx = 0; dset_idx < m_device_spline_datasets.get_num_datasets(); dset_idx++) {
+        const auto dataset = m_device_spline_datasets.get_dataset(dset_idx);
+        key.push_back(dataset->get_num_scatterers());
+        add_pointer(dataset->get_xs_ptr());
+        add_pointer(dataset->get_ys_ptr());
+        add_pointer(dataset->get_zs_ptr());
+        add_pointer(dataset->get_as_ptr());
+        add_pointer(dataset->get_control_points_ptr());
+    }
+    return key;
+}
 
-    // slice in the middle lateral-elevational plane (radial dist is 0.5)
-    write_raw(make_float3(0.0f, 0.0f, 0.5f),
-                make_float3(1.0f, 0.0f, 0.0f),
-                make_float3(0.0f, 1.0f, 0.0f),
-                raw_path + "lut_slice_lat_ele.raw");
-    // slice the middle lateral-radial plane (elevational dist is 0.5)
-    write_raw(make_float3(0.0f, 0.5f, 0.0f),
-                make_float3(1.0f, 0.0f, 0.0f),
-                make_float3(0.0f, 0.0f, 1.0f),
-                raw_path + "lut_slice_lat_rad.raw");
-    // slice the middle elevational-radial plane (lateral dist is 0.5)
-    write_raw(make_float3(0.5f, 0.0f, 0.0f),
-                make_float3(0.0f, 1.0f, 0.0f),
-                make_float3(0.0f, 0.0f, 1.0f),
-                raw_path + "lut_slice_ele_rad.raw");
+void GpuAlgorithm::project_lines_batched(cudaStream_t stream, int num_lines, bool use_rendered_splines) {
+    const auto device_lines = m_device_line_descriptors->data();
+    const auto line_stride = static_cast<int>(m_num_time_samples);
 
-    // 6 equally spaced lateral-elevational slices of [0.0, 1.0]
-    for (int i = 0; i <=5; i++) {
-        write_raw(make_float3(0.0f, 0.0f, static_cast<float>(i)/5),
-                  make_float3(1.0f, 0.0f, 0.0f),
-                  make_float3(0.0f, 1.0f, 0.0f),
-                  raw_path + "lut_slice_lat_ele_"+std::to_string(i)+".raw");
+    std::unique_ptr<EventTimerRAII> event_timer;
+    if (m_store_kernel_details) {
+        event_timer = std::unique_ptr<EventTimerRAII>(new EventTimerRAII(stream));
+        event_timer->restart();
+    }
+
+    // clear time projections of all lines, real samples only occupy the first half of a slot.
+    // The noise is the initial value, unless it is added after a fixed-point accumulation.
+    const int threads_per_line = m_param_threads_per_line;
+    const int num_clear = static_cast<int>(m_use_real_fft ? m_num_time_samples/2 : m_num_time_samples);
+    if ((m_param_noise_amplitude > 0.0f) && (m_param_fixed_point_scale <= 0.0f)) {
+        launch_MemsetNoiseBatchedKernel(round_up_div(round_up_div(num_clear, 2), threads_per_line), num_lines, threads_per_line, stream,
+                                        m_device_time_proj->data(), noise_params(0), num_clear, line_stride);
+    } else {
+        launch_MemsetBatchedKernel(round_up_div(num_clear, threads_per_line), num_lines, threads_per_line, stream,
+                                   m_device_time_proj->data(), make_cuComplex(0.0f, 0.0f), num_clear, line_stride);
+    }
+    if (m_store_kernel_details) {
+        const auto elapsed_ms = static_cast<double>(event_timer->stop());
+        m_debug_data["kernel_memset_ms"].push_back(elapsed_ms);
+        event_timer->restart();
+    }
+
+    const auto project_fixed = [&](const DeviceFixedScatterers& dataset) {
+        const int num_blocks = round_up_div(static_cast<int>(dataset.get_num_scatterers()), m_param_threads_per_block);
+        if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+            throw std::runtime_error("required number of x-blocks is larger than device supports (fixed scatterers)");
+        }
+        if (num_blocks > 0) {
+            auto params = fixed_kernel_params(dataset, m_device_time_proj->data());
+            params.lines           = device_lines;
+            params.num_lines       = num_lines;
+            params.lines_per_block = mla_lines_per_block();
+            params.res_line_stride = line_stride;
+            launch_fixed_kernel(params, num_blocks, round_up_div(num_lines, params.lines_per_block), stream);
+        }
+    };
+
+    for (const auto& dataset : m_device_fixed_datasets.get_launch_datasets()) {
+        project_fixed(*dataset);
+    }
+    project_chunked_datasets(stream, num_lines);
+    project_generated_datasets(stream, num_lines);
+    if (m_store_kernel_details) {
+        const auto elapsed_ms = static_cast<double>(event_timer->stop());
+        m_debug_data["fixed_projection_kernel_ms"].push_back(elapsed_ms);
+        event_timer->restart();
     }
 
+    if (use_rendered_splines) {
+        for (const auto& dataset : m_device_rendered_spline_datasets.get_launch_datasets()) {
+            project_fixed(*dataset);
+        }
+    } else {
+        // each spline dataset has its own descriptors with basis functions
+        for (size_t dset_idx = 0; dset_idx < m_device_spline_datasets.get_num_datasets(); dset_idx++) {
+            const auto device_dataset = m_device_spline_datasets.get_dataset(dset_idx);
+            const int num_blocks = round_up_div(static_cast<int>(device_dataset->get_num_scatterers()), m_param_threads_per_block);
+            if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+                throw std::runtime_error("required number of x-blocks is larger than device supports (spline scatterers)");
+            }
+            if (num_blocks > 0) {
+                auto params = spline_kernel_params(*device_dataset, m_device_time_proj->data());
+                params.lines           = device_lines + (dset_idx + 1)*num_lines;
+                params.num_lines       = num_lines;
+                params.res_line_stride = line_stride;
+                if (m_param_ensemble_projection && m_single_geometry) {
+                    // the lines of an ensemble share a block, which loads each scatterer once
+                    params.lines_per_block = ENSEMBLE_LINES_PER_BLOCK;
+                } else {
+                    // and those of a transmit also evaluate each spline once
+                    params.lines_per_block = mla_lines_per_block();
+                    params.shared_basis    = (params.lines_per_block > 1);
+                }
+                launch_spline_kernel(params, device_dataset->get_spline_degree(), num_blocks,
+                                     round_up_div(num_lines, params.lines_per_block), stream);
+            }
+        }
+    }
+    if (m_store_kernel_details) {
+        const auto elapsed_ms = static_cast<double>(event_timer->stop());
+        m_debug_data["spline_projection_kernel_ms"].push_back(elapsed_ms);
+    }
+    convert_fixed_point_projections(stream, num_lines);
 }
 
-void GpuAlgorithm::create_dummy_lut_profile() {
-    const size_t n = 16;
-    std::vector<float> dummy_samples(n*n*n, 0.0f);
-    m_device_beam_profile = DeviceBeamProfileRAII::u_ptr(new DeviceBeamProfileRAII(DeviceBeamProfileRAII::TableExtent3D(n, n, n), dummy_samples));
+void GpuAlgorithm::convert_fixed_point_projections(cudaStream_t stream, int num_lines) {
+    if (m_param_fixed_point_scale <= 0.0f) {
+        return;
+    }
+    const int threads_per_line = m_param_threads_per_line;
+    if (m_param_noise_amplitude > 0.0f) {
+        // the samples are complex with noise
+        const int num_samples = static_cast<int>(m_num_time_samples);
+        launch_FixedPointToFloatNoiseBatchedKernel(round_up_div(round_up_div(num_samples, 2), threads_per_line), num_lines,
+                                                   threads_per_line, stream, m_device_time_proj->data(), 1.0f/m_param_fixed_point_scale,
+                                                   noise_params(0), num_samples, num_samples);
+        return;
+    }
+    // real samples only occupy the first half of a slot
+    const int num_values = static_cast<int>(m_use_real_fft ? m_num_time_samples : 2*m_num_time_samples);
+    launch_FixedPointToFloatBatchedKernel(round_up_div(num_values, threads_per_line), num_lines, threads_per_line, stream,
+                                          reinterpret_cast<float*>(m_device_time_proj->data()), 1.0f/m_param_fixed_point_scale,
+                                          num_values, static_cast<int>(2*m_num_time_samples));
 }
 
-void GpuAlgorithm::clear_fixed_scatterers() {
-    m_device_fixed_datasets.clear();
+void GpuAlgorithm::project_chunked_datasets(cudaStream_t stream, int num_lines) {
+    if (m_chunked_fixed_datasets.empty()) {
+        return;
+    }
+    size_t max_chunk_size = 0;
+    for (const auto& dataset : m_chunked_fixed_datasets) {
+        max_chunk_size = std::max(max_chunk_size, dataset->get_chunk_size());
+    }
+    const auto chunk_bytes = 4*max_chunk_size*sizeof(float);
+    if (!m_copy_stream) {
+        m_copy_stream = CudaStreamRAII::u_ptr(new CudaStreamRAII);
+        for (int buffer_no = 0; buffer_no < 2; buffer_no++) {
+            m_chunk_copied_events.push_back(CudaEventRAII::u_ptr(new CudaEventRAII));
+            m_chunk_projected_events.push_back(CudaEventRAII::u_ptr(new CudaEventRAII));
+        }
+    }
+    if (m_device_chunks.empty() || (m_device_chunks[0]->get_num_bytes() < chunk_bytes)) {
+        m_log_object->write(ILog::INFO, "Allocating DEVICE memory for scatterer chunks");
+        // the previous chunk buffers may still be in use
+        cudaErrorCheck( cudaStreamSynchronize(stream) );
+        m_device_chunks.clear();
+        for (int buffer_no = 0; buffer_no < 2; buffer_no++) {
+            m_device_chunks.push_back(DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(chunk_bytes)));
+        }
+    }
+
+    const auto copy_stream = m_copy_stream->get();
+    size_t buffer_no = 0;
+    for (const auto& dataset : m_chunked_fixed_datasets) {
+        const auto chunk_size = dataset->get_chunk_size();
+        for (size_t chunk_no = 0; chunk_no < dataset->get_num_chunks(); chunk_no++) {
+            // overwrite the buffer when the projection of its previous chunk is done
+            const auto device_chunk = m_device_chunks[buffer_no]->data();
+            m_chunk_projected_events[buffer_no]->make_wait(copy_stream);
+            cudaErrorCheck( cudaMemcpyAsync(device_chunk, dataset->get_chunk_ptr(chunk_no), 4*chunk_size*sizeof(float),
+                                            cudaMemcpyHostToDevice, copy_stream) );
+            m_chunk_copied_events[buffer_no]->record(copy_stream);
+
+            m_chunk_copied_events[buffer_no]->make_wait(stream);
+            const auto num_scatterers = dataset->get_chunk_num_scatterers(chunk_no);
+            const int num_blocks = round_up_div(static_cast<int>(num_scatterers), m_param_threads_per_block);
+            if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+                throw std::runtime_error("required number of x-blocks is larger than device supports (scatterer chunk)");
+            }
+            auto params = fixed_kernel_params(device_chunk, device_chunk + chunk_size, device_chunk + 2*chunk_size,
+                                              device_chunk + 3*chunk_size, num_scatterers, m_device_time_proj->data());
+            params.lines           = m_device_line_descriptors->data();
+            params.num_lines       = num_lines;
+            params.lines_per_block = mla_lines_per_block();
+            params.res_line_stride = static_cast<int>(m_num_time_samples);
+            launch_fixed_kernel(params, num_blocks, round_up_div(num_lines, params.lines_per_block), stream);
+            m_chunk_projected_events[buffer_no]->record(stream);
+
+            buffer_no = 1 - buffer_no;
+        }
+    }
 }
 
-void GpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
-    m_device_fixed_datasets.add(fixed_scatterers);
-    m_can_change_cuda_device = false;
+void GpuAlgorithm::project_generated_datasets(cudaStream_t stream, int num_lines) {
+    if (m_procedural_datasets.empty() && m_image_volume_datasets.empty()) {
+        return;
+    }
+    const auto tile_size = m_device_generated_tile->get_num_bytes()/(4*sizeof(float));
+    const auto device_tile = m_device_generated_tile->data();
+    const auto num_tile_blocks = [&](size_t num_scatterers) {
+        const int num_blocks = round_up_div(static_cast<int>(num_scatterers), m_param_threads_per_block);
+        if (num_blocks > m_cur_device_prop.maxGridSize[0]) {
+            throw std::runtime_error("required number of x-blocks is larger than device supports (generated tile)");
+        }
+        return num_blocks;
+    };
+    for (const auto& dataset : m_procedural_datasets) {
+        const auto generate_params = procedural_params(*dataset);
+        for (size_t first = 0; first < dataset->count; first += tile_size) {
+            const auto num_scatterers = std::min(tile_size, dataset->count - first);
+            launch_GenerateProceduralKernel(num_tile_blocks(num_scatterers), m_param_threads_per_block, stream, generate_params, first,
+                                            static_cast<int>(num_scatterers), device_tile, device_tile + tile_size,
+                                            device_tile + 2*tile_size, device_tile + 3*tile_size);
+            project_generated_tile(stream, num_lines, num_scatterers);
+        }
+    }
+    for (const auto& dataset : m_image_volume_datasets) {
+        const auto& volume = *dataset.volume;
+        const auto count = volume.get_count();
+        if (count == 0) {
+            continue;
+        }
+        ImageVolumeParams generate_params;
+        generate_params.origin       = make_float3(volume.origin.x, volume.origin.y, volume.origin.z);
+        generate_params.voxel_size   = make_float3(volume.voxel_size.x, volume.voxel_size.y, volume.voxel_size.z);
+        generate_params.nx           = volume.nx;
+        generate_params.ny           = volume.ny;
+        generate_params.num_voxels   = volume.get_num_voxels();
+        generate_params.voxel_starts = dataset.voxel_starts->data();
+        generate_params.amplitude_scales       = dataset.amplitude_scales->get();
+        generate_params.amplitude_distribution = static_cast<int>(volume.amplitude_distribution);
+        generate_params.key = make_uint2(static_cast<uint32_t>(volume.seed), static_cast<uint32_t>(volume.seed >> 32));
+        for (size_t first = 0; first < count; first += tile_size) {
+            const auto num_scatterers = std::min(tile_size, count - first);
+            launch_GenerateImageVolumeKernel(num_tile_blocks(num_scatterers), m_param_threads_per_block, stream, generate_params, first,
+                                             static_cast<int>(num_scatterers), device_tile, device_tile + tile_size,
+                                             device_tile + 2*tile_size, device_tile + 3*tile_size);
+            project_generated_tile(stream, num_lines, num_scatterers);
+        }
+    }
 }
 
-void GpuAlgorithm::clear_spline_scatterers() {
-    m_device_spline_datasets.clear();
+void GpuAlgorithm::project_generated_tile(cudaStream_t stream, int num_lines, size_t num_scatterers) {
+    const auto tile_size = m_device_generated_tile->get_num_bytes()/(4*sizeof(float));
+    const auto device_tile = m_device_generated_tile->data();
+    auto params = fixed_kernel_params(device_tile, device_tile + tile_size, device_tile + 2*tile_size,
+                                      device_tile + 3*tile_size, num_scatterers, m_device_time_proj->data());
+    params.lines           = m_device_line_descriptors->data();
+    params.num_lines       = num_lines;
+    params.lines_per_block = mla_lines_per_block();
+    params.res_line_stride = static_cast<int>(m_num_time_samples);
+    const int num_blocks = round_up_div(static_cast<int>(num_scatterers), m_param_threads_per_block);
+    launch_fixed_kernel(params, num_blocks, round_up_div(num_lines, params.lines_per_block), stream);
 }
 
-void GpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
-    m_can_change_cuda_device = false;
-    m_device_spline_datasets.add(spline_scatterers);
+ProceduralParams GpuAlgorithm::procedural_params(const ProceduralScatterers& dataset) {
+    ProceduralParams params;
+    params.ellipsoid = (dataset.region == ProceduralScatterers::Region::ELLIPSOID) ? 1 : 0;
+    params.center    = make_float3(dataset.center.x, dataset.center.y, dataset.center.z);
+    params.half_axes = make_float3(dataset.half_axes.x, dataset.half_axes.y, dataset.half_axes.z);
+    for (int row = 0; row < 3; row++) {
+        params.axes_rows[row] = make_float3(dataset.axes(row, 0), dataset.axes(row, 1), dataset.axes(row, 2));
+    }
+    params.amplitude_distribution = static_cast<int>(dataset.amplitude_distribution);
+    params.amplitude_scale        = dataset.amplitude_scale;
+    params.key = make_uint2(static_cast<uint32_t>(dataset.seed), static_cast<uint32_t>(dataset.seed >> 32));
+    return params;
+}
+
+void GpuAlgorithm::update_spline_render_groups() {
+    m_spline_render_groups.clear();
+    const auto num_lines = static_cast<int>(m_scan_seq->get_num_lines());
+    const bool has_splines = (m_device_spline_datasets.get_num_datasets() > 0);
+    if (!has_splines) {
+        m_spline_render_groups.push_back(SplineRenderGroup{0, num_lines, false});
+        return;
+    }
+    // the maximal runs of consecutive lines with equal timestamps
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const auto timestamp = m_scan_seq->get_scanline(line_no).get_timestamp();
+        if (m_spline_render_groups.empty()
+            || (m_scan_seq->get_scanline(line_no - 1).get_timestamp() != timestamp)) {
+            m_spline_render_groups.push_back(SplineRenderGroup{line_no, 0, false});
+        }
+        m_spline_render_groups.back().num_lines++;
+    }
+    // rendering costs about as much as projecting one line with the spline kernel
+    const bool single_group = (m_spline_render_groups.size() == 1);
+    for (auto& group : m_spline_render_groups) {
+        group.rendered = single_group || (group.num_lines >= m_param_spline_render_min_group_lines);
+    }
+}
+
+bool GpuAlgorithm::can_use_batched_launch(int num_lines) const {
+    const bool fits_grid = (num_lines <= m_cur_device_prop.maxGridSize[1]);
+    if (!m_chunked_fixed_datasets.empty() || !m_procedural_datasets.empty() || !m_image_volume_datasets.empty()) {
+        if (!fits_grid) {
+            throw std::runtime_error("too many lines for the batched launches of out-of-core or generated datasets");
+        }
+        // culling is not supported for the out-of-core and generated datasets
+        return true;
+    }
+    return m_param_batched_launch && !m_param_scatterer_culling && fits_grid;
+}
+
+void GpuAlgorithm::prepare_fft_callbacks(int num_lines) {
+    if (!m_param_fft_callbacks) {
+        m_fft_callback_plans.reset();
+        return;
+    }
+    if (!m_fft_callback_plans || (m_fft_callback_plans->get_num_lines() != num_lines)) {
+        m_log_object->write(ILog::INFO, "Creating cuFFT plans with callbacks");
+        m_fft_callback_plans = FftCallbackPlans::u_ptr(new FftCallbackPlans(static_cast<int>(m_num_time_samples), num_lines));
+    }
+    size_t num_output_lines, num_iq_samples;
+    get_output_dimensions(num_output_lines, num_iq_samples);
+    FftCallbackParams params;
+    std::memset(&params, 0, sizeof(params));
+    params.filter_fft  = m_device_excitation_fft->data();
+    params.iq_lines    = m_device_iq_lines->data();
+    params.num_samples = static_cast<int>(m_num_time_samples);
+    get_demodulation(params.w, params.offset, params.decimation);
+    params.num_out     = static_cast<int>(num_iq_samples);
+    m_fft_callback_plans->set_params(params);
+}
+
+bool GpuAlgorithm::use_sparse_convolution() const {
+    // a scatterer is projected onto one sample of each line, and noise fills all of them
+    return (m_param_sparse_convolution_threshold > 0) && !m_param_baseband && (noise_amplitude() == 0.0f)
+        && m_device_sparse_taps && (get_total_num_scatterers() <= static_cast<size_t>(m_param_sparse_convolution_threshold));
+}
+
+void GpuAlgorithm::prepare_sparse_convolution(int num_lines) {
+    if (!use_sparse_convolution()) {
+        m_sparse_counts.reset();
+        return;
+    }
+    const auto capacity = static_cast<size_t>(m_param_sparse_convolution_threshold);
+    const auto num_entries = capacity*static_cast<size_t>(num_lines);
+    if (!m_sparse_counts || (m_sparse_counts->get_num_bytes() != sizeof(int)*num_lines)
+        || (m_sparse_indices->get_num_bytes() != sizeof(int)*num_entries)) {
+        m_sparse_counts  = DeviceBufferRAII<int>::u_ptr(new DeviceBufferRAII<int>(sizeof(int)*num_lines));
+        m_sparse_indices = DeviceBufferRAII<int>::u_ptr(new DeviceBufferRAII<int>(sizeof(int)*num_entries));
+        m_sparse_values  = DeviceBufferRAII<complex>::u_ptr(new DeviceBufferRAII<complex>(sizeof(complex)*num_entries));
+    }
+}
+
+void GpuAlgorithm::reserve_line_descriptors(size_t num_bytes_needed) {
+    if (!m_host_line_descriptors || (m_host_line_descriptors->get_num_bytes() < num_bytes_needed)) {
+        m_log_object->write(ILog::INFO, "Reallocating HOST and DEVICE memory for line descriptors");
+        m_host_line_descriptors   = HostPinnedBufferRAII<LineDescriptor>::u_ptr(new HostPinnedBufferRAII<LineDescriptor>(num_bytes_needed));
+        m_device_line_descriptors = DeviceBufferRAII<LineDescriptor>::u_ptr(new DeviceBufferRAII<LineDescriptor>(num_bytes_needed));
+    }
+}
+
+void GpuAlgorithm::fill_line_descriptors(int num_lines, bool use_rendered_splines, float timestamp_offset) {
+    const size_t num_spline_datasets = use_rendered_splines ? 0 : m_device_spline_datasets.get_num_datasets();
+    reserve_line_descriptors((num_spline_datasets + 1)*num_lines*sizeof(LineDescriptor));
+
+    // the first num_lines descriptors hold the geometry only.
+    auto host_lines = m_host_line_descriptors->data();
+    for (int beam_no = 0; beam_no < num_lines; beam_no++) {
+        const auto& scanline = m_scan_seq->get_scanline(beam_no);
+        auto& line = host_lines[beam_no];
+        line.rad_dir      = to_float3(scanline.get_direction());
+        line.lat_dir      = to_float3(scanline.get_lateral_dir());
+        line.ele_dir      = to_float3(scanline.get_elevational_dir());
+        line.origin       = to_float3(scanline.get_origin());
+        line.cs_idx_start = 0;
+        line.cs_idx_end   = -1;
+    }
+    for (size_t dset_idx = 0; dset_idx < num_spline_datasets; dset_idx++) {
+        const auto dataset = m_device_spline_datasets.get_dataset(dset_idx);
+        const auto knots = dataset->get_knots();
+        auto dset_lines = host_lines + (dset_idx + 1)*num_lines;
+        for (int beam_no = 0; beam_no < num_lines; beam_no++) {
+            dset_lines[beam_no] = host_lines[beam_no];
+            const auto timestamp = m_scan_seq->get_scanline(beam_no).get_timestamp() + timestamp_offset;
+            compute_spline_basis(knots, dataset->get_spline_degree(), dataset->get_num_cs(), timestamp,
+                                 dset_lines[beam_no].cs_idx_start, dset_lines[beam_no].cs_idx_end, dset_lines[beam_no].basis);
+        }
+    }
 }
 
-void GpuAlgorithm::fixed_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceFixedScatterers::s_ptr dataset) {
+void GpuAlgorithm::upload_line_descriptors(cudaStream_t stream, int num_lines, bool use_rendered_splines, float timestamp_offset) {
+    // the basis functions are only evaluated on the host when the lines or
+    // the spline datasets have changed, not for every frame.
+    uint32_t offset_bits;
+    std::memcpy(&offset_bits, &timestamp_offset, sizeof(offset_bits));
+    const std::vector<size_t> key = {m_line_descriptors_generation, m_cur_line_batch, static_cast<size_t>(num_lines),
+                                     use_rendered_splines ? 1u : 0u, offset_bits};
+    if (m_device_line_descriptors && (key == m_line_descriptors_key)) {
+        return;
+    }
+
+    const size_t num_spline_datasets = use_rendered_splines ? 0 : m_device_spline_datasets.get_num_datasets();
+    if (m_scan_seq->is_parametric() && (num_spline_datasets == 0)) {
+        // the geometry alone is generated on the device: no host loop and
+        // no upload, however many lines the scan has.
+        reserve_line_descriptors(num_lines*sizeof(LineDescriptor));
+        const auto& scan = m_scan_seq->get_parametric_scan();
+        ParametricScanParams params;
+        params.sector             = (scan.type == ParametricScan::Type::SECTOR) ? 1 : 0;
+        params.num_lines_lateral  = scan.num_lines_lateral;
+        params.num_planes         = scan.num_planes;
+        params.first_line         = m_scan_seq->get_parametric_first_line();
+        params.last_line          = scan.get_num_lines() - 1;
+        params.lateral_extent     = scan.lateral_extent;
+        params.elevational_extent = scan.elevational_extent;
+        params.tilt               = scan.tilt;
+        for (int i = 0; i < 9; i++) {
+            params.rotation[i] = scan.rotation(i/3, i%3);
+        }
+        params.translation        = to_float3(scan.translation);
+        const int block_size = 128;
+        launch_ParametricLineDescriptorsKernel(round_up_div(num_lines, block_size), block_size, stream,
+                                               m_device_line_descriptors->data(), params, num_lines);
+        m_line_descriptors_key = key;
+        return;
+    }
+
+    fill_line_descriptors(num_lines, use_rendered_splines, timestamp_offset);
+    const auto num_descriptor_bytes = (num_spline_datasets + 1)*num_lines*sizeof(LineDescriptor);
+    cudaErrorCheck( cudaMemcpyAsync(m_device_line_descriptors->data(), m_host_line_descriptors->data(), num_descriptor_bytes,
+                                    cudaMemcpyHostToDevice, stream) );
+    m_line_descriptors_key = key;
+}
+
+void GpuAlgorithm::update_culling_region() {
+    const float sample_dist = m_param_sound_speed/(2.0f*time_proj_sampling_frequency());
+    // the regions cover the samples up to the end of the time-projection
+    const auto first_sample = time_proj_first_sample();
+    const auto num_samples = first_sample + m_num_time_samples;
+    switch (m_cur_beam_profile_type) {
+    case BeamProfileType::ANALYTICAL:
+        m_culling_region = gaussian_culling_region(m_analytical_sigma_lat, m_analytical_sigma_ele,
+                                                   m_param_culling_num_sigmas, sample_dist, num_samples);
+        break;
+    case BeamProfileType::LOOKUP:
+        m_culling_region = lut_culling_region(Interval(m_lut_r_min, m_lut_r_max), Interval(m_lut_l_min, m_lut_l_max), Interval(m_lut_e_min, m_lut_e_max),
+                                              m_lut_num_samples_rad, m_lut_num_samples_lat, m_lut_num_samples_ele,
+                                              m_param_use_arc_projection, sample_dist, num_samples);
+        break;
+    case BeamProfileType::MULTI_RESOLUTION_LOOKUP:
+        m_culling_region = multi_resolution_lut_culling_region(*m_multi_resolution_lut_profile, m_param_use_arc_projection,
+                                                               sample_dist, num_samples);
+        break;
+    default:
+        throw std::logic_error("unknown beam profile type");
+    }
+    // and from the first sample of a depth window
+    m_culling_region.r_min = std::max(m_culling_region.r_min, (first_sample - 1)*sample_dist);
+}
+
+int GpuAlgorithm::upload_culled_indices(int stream_no, const Scanline& scanline, const DeviceFixedScatterers& dataset) {
     auto cur_stream = m_stream_wrappers[stream_no]->get();
 
-    //dim3 grid_size(num_blocks, 1, 1);
-    //dim3 block_size(m_param_threads_per_block, 1, 1);
+    std::vector<ScattererGrid::IndexRange> ranges;
+    dataset.get_grid().find_ranges(scanline, m_culling_region, ranges);
+    size_t num_indices = 0;
+    for (const auto& range : ranges) {
+        num_indices += range.second - range.first;
+    }
+    if (num_indices == 0) {
+        return 0;
+    }
 
-    // prepare struct with parameters
-    FixedAlgKernelParams params;
-    params.point_xs          = dataset->get_xs_ptr();
-    params.point_ys          = dataset->get_ys_ptr();
-    params.point_zs          = dataset->get_zs_ptr();
-    params.point_as          = dataset->get_as_ptr();
+    if (m_culled_index_staging.size() != m_stream_wrappers.size()) {
+        m_culled_index_staging.resize(m_stream_wrappers.size());
+    }
+    auto& staging = m_culled_index_staging[stream_no];
+    if (staging.host_slots.empty()) {
+        const int num_slots = 4;
+        staging.host_slots.resize(num_slots);
+        for (int slot = 0; slot < num_slots; slot++) {
+            staging.uploaded_events.push_back(CudaEventRAII::u_ptr(new CudaEventRAII));
+        }
+    }
+    const auto slot = staging.next_slot;
+    staging.next_slot = (slot + 1) % staging.host_slots.size();
+
+    // the previous upload from this host buffer must be completed before it
+    // is overwritten, which is most often long ago.
+    staging.uploaded_events[slot]->synchronize();
+
+    // grown geometrically, since the number of indices varies between lines
+    const auto num_bytes_needed = num_indices*sizeof(int);
+    auto& host_buffer = staging.host_slots[slot];
+    if (!host_buffer || (host_buffer->get_num_bytes() < num_bytes_needed)) {
+        const auto num_bytes = std::max(num_bytes_needed, host_buffer ? 2*host_buffer->get_num_bytes() : 0);
+        host_buffer = HostPinnedBufferRAII<int>::u_ptr(new HostPinnedBufferRAII<int>(num_bytes));
+    }
+    auto& device_buffer = staging.device_indices;
+    if (!device_buffer || (device_buffer->get_num_bytes() < num_bytes_needed)) {
+        m_log_object->write(ILog::INFO, "Reallocating DEVICE memory for culled scatterer indices");
+        const auto num_bytes = std::max(num_bytes_needed, device_buffer ? 2*device_buffer->get_num_bytes() : 0);
+        // the kernels of the previous lines may still read the indices
+        cudaErrorCheck( cudaStreamSynchronize(cur_stream) );
+        device_buffer = DeviceBufferRAII<int>::u_ptr(new DeviceBufferRAII<int>(num_bytes));
+    }
+
+    // the kernels of the previous lines are before the copy in the stream,
+    // so the device buffer is not overwritten while they read it.
+    auto host_indices = host_buffer->data();
+    size_t i = 0;
+    for (const auto& range : ranges) {
+        for (size_t scatterer_no = range.first; scatterer_no < range.second; scatterer_no++) {
+            host_indices[i++] = static_cast<int>(scatterer_no);
+        }
+    }
+    cudaErrorCheck( cudaMemcpyAsync(device_buffer->data(), host_indices, num_bytes_needed, cudaMemcpyHostToDevice, cur_stream) );
+    staging.uploaded_events[slot]->record(cur_stream);
+    return static_cast<int>(num_indices);
+}
+
+void GpuAlgorithm::fixed_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceFixedScatterers::s_ptr dataset,
+                                           const int* indices, int num_indices) {
+    auto cur_stream = m_stream_wrappers[stream_no]->get();
+
+    auto params = fixed_kernel_params(*dataset, res_buffer);
     params.rad_dir           = to_float3(scanline.get_direction());
     params.lat_dir           = to_float3(scanline.get_lateral_dir());
     params.ele_dir           = to_float3(scanline.get_elevational_dir());
     params.origin            = to_float3(scanline.get_origin());
-    params.fs_hertz          = m_excitation.sampling_frequency;
+    params.num_scatterers    = indices ? num_indices : static_cast<int>(dataset->get_num_scatterers());
+    params.indices           = indices;
+    launch_fixed_kernel(params, num_blocks, 1, cur_stream);
+}
+
+FixedAlgKernelParams GpuAlgorithm::fixed_kernel_params(const DeviceFixedScatterers& dataset, cuComplex* res_buffer) const {
+    auto params = fixed_kernel_params(dataset.get_xs_ptr(), dataset.get_ys_ptr(), dataset.get_zs_ptr(), dataset.get_as_ptr(),
+                                      dataset.get_num_scatterers(), res_buffer);
+    params.points = dataset.get_points_ptr();
+    if (dataset.is_compact()) {
+        const auto& encoding = dataset.get_encoding();
+        params.point_codes = reinterpret_cast<const ushort4*>(dataset.get_codes_ptr());
+        params.compact.origin = make_float3(encoding.origin[0], encoding.origin[1], encoding.origin[2]);
+        params.compact.scale  = make_float3(encoding.scale[0], encoding.scale[1], encoding.scale[2]);
+        params.compact.amplitude_scale = encoding.amplitude_scale;
+    }
+    return params;
+}
+
+FixedAlgKernelParams GpuAlgorithm::fixed_kernel_params(float* xs, float* ys, float* zs, float* as, size_t num_scatterers,
+                                                       cuComplex* res_buffer) const {
+    FixedAlgKernelParams params;
+    params.point_xs          = xs;
+    params.point_ys          = ys;
+    params.point_zs          = zs;
+    params.point_as          = as;
+    params.point_codes       = nullptr;
+    params.points            = nullptr;
+    params.compact.origin    = make_float3(0.0f, 0.0f, 0.0f);
+    params.compact.scale     = make_float3(0.0f, 0.0f, 0.0f);
+    params.compact.amplitude_scale = 1.0f;
+    params.rad_dir           = make_float3(0.0f, 0.0f, 0.0f);
+    params.lat_dir           = make_float3(0.0f, 0.0f, 0.0f);
+    params.ele_dir           = make_float3(0.0f, 0.0f, 0.0f);
+    params.origin            = make_float3(0.0f, 0.0f, 0.0f);
+    params.fs_hertz          = time_proj_sampling_frequency();
     params.num_time_samples  = m_num_time_samples;
+    params.first_time_sample = time_proj_first_sample();
     params.sigma_lateral     = m_analytical_sigma_lat;
     params.sigma_elevational = m_analytical_sigma_ele;
+    params.max_profile_exponent = profile_max_exponent();
     params.sound_speed       = m_param_sound_speed;
     params.res               = res_buffer;
+    params.real_res          = m_use_real_fft;
     params.demod_freq        = m_excitation.demod_freq;
-    params.num_scatterers    = dataset->get_num_scatterers(),
+    params.num_scatterers    = static_cast<int>(num_scatterers);
+    params.indices           = nullptr;
+    params.lines             = nullptr;
+    params.num_lines         = 1;
+    params.lines_per_block   = 1;
+    params.res_line_stride   = 0;
+    params.shared_tile_len   = m_param_shared_tile_size;
+    params.fixed_point_scale = m_param_fixed_point_scale;
     params.lut_tex           = m_device_beam_profile->get();
     params.lut.r_min         = m_lut_r_min;
     params.lut.r_max         = m_lut_r_max;
@@ -619,98 +3026,121 @@ void GpuAlgorithm::fixed_projection_kernel(int stream_no, const Scanline& scanli
     params.lut.l_max         = m_lut_l_max;
     params.lut.e_min         = m_lut_e_min;
     params.lut.e_max         = m_lut_e_max;
+    params.lut_factors       = m_lut_factors;
+    params.lut_zones         = m_lut_zones;
+    return params;
+}
 
-    // map beam profile type to boolean flag
-    bool use_lut;
-    switch(m_cur_beam_profile_type) {
+bool GpuAlgorithm::use_lut_profile() const {
+    switch (m_cur_beam_profile_type) {
     case BeamProfileType::ANALYTICAL:
-        use_lut = false;
-        break;
+        return false;
     case BeamProfileType::LOOKUP:
-        use_lut = true;
-        break;
+    case BeamProfileType::MULTI_RESOLUTION_LOOKUP:
+        return true;
     default:
         throw std::logic_error("unknown beam profile type");
     }
+}
 
-    if (!m_param_use_arc_projection && !m_enable_phase_delay && !use_lut) {
-        launch_FixedAlgKernel<false, false, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && !m_enable_phase_delay && use_lut) {
-        launch_FixedAlgKernel<false, false, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && m_enable_phase_delay && !use_lut) {
-        launch_FixedAlgKernel<false, true, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && m_enable_phase_delay && use_lut) {
-        launch_FixedAlgKernel<false, true, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && !m_enable_phase_delay && !use_lut) {
-        launch_FixedAlgKernel<true, false, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && !m_enable_phase_delay && use_lut) {
-        launch_FixedAlgKernel<true, false, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && m_enable_phase_delay && !use_lut) {
-        launch_FixedAlgKernel<true, true, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && m_enable_phase_delay && use_lut) {
-        launch_FixedAlgKernel<true, true, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else {
-        throw std::logic_error("this should never happen");
+void GpuAlgorithm::prepare_jit_kernels(bool use_rendered_splines) {
+    if (!m_jit_kernels) {
+        return;
+    }
+    const auto use_lut = use_lut_profile();
+    const auto phase_delay = use_phase_delay();
+    const bool has_fixed = (m_device_fixed_datasets.get_num_datasets() > 0) || !m_chunked_fixed_datasets.empty()
+                           || !m_procedural_datasets.empty() || !m_image_volume_datasets.empty()
+                           || (use_rendered_splines && (m_device_spline_datasets.get_num_datasets() > 0));
+    if (has_fixed) {
+        const auto params = fixed_kernel_params(nullptr, nullptr, nullptr, nullptr, 0, nullptr);
+        m_jit_kernels->prepare_fixed(m_param_use_arc_projection, phase_delay, use_lut, params);
+    }
+    if (!use_rendered_splines) {
+        for (size_t dset_idx = 0; dset_idx < m_device_spline_datasets.get_num_datasets(); dset_idx++) {
+            const auto dataset = m_device_spline_datasets.get_dataset(dset_idx);
+            const auto params = spline_kernel_params(*dataset, nullptr);
+            m_jit_kernels->prepare_spline(m_param_use_arc_projection, phase_delay, use_lut, dataset->get_spline_degree(), params);
+        }
     }
 }
 
-void GpuAlgorithm::spline_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceSplineScatterers::s_ptr dataset) {
-    auto cur_stream = m_stream_wrappers[stream_no]->get();
-    const auto cur_knots = dataset->get_knots();
-    const auto num_cs    = dataset->get_num_cs();
-    const auto spline_degree = dataset->get_spline_degree();
+void GpuAlgorithm::launch_fixed_kernel(const FixedAlgKernelParams& params, int num_blocks, int num_lines, cudaStream_t cur_stream) const {
+    //dim3 grid_size(num_blocks, num_lines, 1);
+    //dim3 block_size(m_param_threads_per_block, 1, 1);
 
-    // evaluate the basis functions and upload to constant memory.
-    const auto num_nonzero = spline_degree+1;
-    size_t eval_basis_offset_elements = num_nonzero*stream_no;
-    std::vector<float> host_basis_functions(num_cs);
-    for (int i = 0; i < num_cs; i++) {
-        host_basis_functions[i] = bspline_storve::bsplineBasis(i, spline_degree, scanline.get_timestamp(), cur_knots);
+    const auto use_lut = use_lut_profile();
+    const auto phase_delay = use_phase_delay();
+    if (m_jit_kernels) {
+        m_jit_kernels->launch_fixed(m_param_use_arc_projection, phase_delay, use_lut, num_blocks, num_lines,
+                                    m_param_threads_per_block, cur_stream, params);
+    } else if (!m_param_use_arc_projection && !phase_delay && !use_lut) {
+        launch_FixedAlgKernel<false, false, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (!m_param_use_arc_projection && !phase_delay && use_lut) {
+        launch_FixedAlgKernel<false, false, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (!m_param_use_arc_projection && phase_delay && !use_lut) {
+        launch_FixedAlgKernel<false, true, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (!m_param_use_arc_projection && phase_delay && use_lut) {
+        launch_FixedAlgKernel<false, true, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (m_param_use_arc_projection && !phase_delay && !use_lut) {
+        launch_FixedAlgKernel<true, false, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (m_param_use_arc_projection && !phase_delay && use_lut) {
+        launch_FixedAlgKernel<true, false, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (m_param_use_arc_projection && phase_delay && !use_lut) {
+        launch_FixedAlgKernel<true, true, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else if (m_param_use_arc_projection && phase_delay && use_lut) {
+        launch_FixedAlgKernel<true, true, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, params);
+    } else {
+        throw std::logic_error("this should never happen");
     }
+}
 
-    //dim3 grid_size(num_blocks, 1, 1);
-    //dim3 block_size(m_param_threads_per_block, 1, 1);
+void GpuAlgorithm::spline_projection_kernel(int stream_no, const LineDescriptor* device_line, int num_blocks, cuComplex* res_buffer,
+                                            DeviceSplineScatterers::s_ptr dataset) {
+    auto cur_stream = m_stream_wrappers[stream_no]->get();
+    auto params = spline_kernel_params(*dataset, res_buffer);
+    params.lines = device_line;
+    launch_spline_kernel(params, dataset->get_spline_degree(), num_blocks, 1, cur_stream);
+}
 
+void GpuAlgorithm::compute_spline_basis(const std::vector<float>& knots, int spline_degree, int num_cs, float timestamp,
+                                        int& cs_idx_start, int& cs_idx_end, float* basis) const {
     // compute sum limits (inclusive)
-    int cs_idx_start, cs_idx_end;
-    std::tie(cs_idx_start, cs_idx_end) = bspline_storve::get_lower_upper_inds(cur_knots,
-                                                                              scanline.get_timestamp(),
-                                                                              spline_degree);
-    if (!sanity_check_spline_lower_upper_bound(host_basis_functions, cs_idx_start, cs_idx_end)) {
-        throw std::runtime_error("b-spline basis bounds failed sanity check");
-    }
+    std::tie(cs_idx_start, cs_idx_end) = bspline_storve::get_lower_upper_inds(knots, timestamp, spline_degree);
+    const auto num_nonzero = spline_degree+1;
     if (cs_idx_end-cs_idx_start+1 != num_nonzero) throw std::logic_error("illegal number of non-zero basis functions");
+    if ((cs_idx_start < 0) || (cs_idx_end >= num_cs)) throw std::runtime_error("b-spline basis bounds failed sanity check");
+    if (spline_degree > MAX_SPLINE_DEGREE) throw std::runtime_error("spline degree exceeds MAX_SPLINE_DEGREE");
 
-    if(!splineAlg2_updateConstantMemory(host_basis_functions.data() + cs_idx_start,
-                                        num_nonzero*sizeof(float),
-                                        eval_basis_offset_elements*sizeof(float),
-                                        cudaMemcpyHostToDevice,
-                                        cur_stream))
-    {
-        throw std::runtime_error("Failed to copy to symbol memory");
-    }
+    bspline_storve::nonzero_basis_functions(cs_idx_end, spline_degree, timestamp, knots, basis);
+}
 
+SplineAlgKernelParams GpuAlgorithm::spline_kernel_params(const DeviceSplineScatterers& dataset, cuComplex* res_buffer) const {
     // prepare a struct of arguments
     SplineAlgKernelParams params;
-    params.control_xs                 = dataset->get_xs_ptr();
-    params.control_ys                 = dataset->get_ys_ptr();
-    params.control_zs                 = dataset->get_zs_ptr();
-    params.control_as                 = dataset->get_as_ptr();
-    params.rad_dir                    = to_float3(scanline.get_direction());
-    params.lat_dir                    = to_float3(scanline.get_lateral_dir());
-    params.ele_dir                    = to_float3(scanline.get_elevational_dir());
-    params.origin                     = to_float3(scanline.get_origin());
-    params.fs_hertz                   = m_excitation.sampling_frequency;
+    params.control_xs                 = dataset.get_xs_ptr();
+    params.control_ys                 = dataset.get_ys_ptr();
+    params.control_zs                 = dataset.get_zs_ptr();
+    params.control_as                 = dataset.get_as_ptr();
+    params.control_points             = dataset.get_control_points_ptr();
+    params.fs_hertz                   = time_proj_sampling_frequency();
     params.num_time_samples           = static_cast<int>(m_num_time_samples);
+    params.first_time_sample          = time_proj_first_sample();
     params.sigma_lateral              = m_analytical_sigma_lat;
     params.sigma_elevational          = m_analytical_sigma_ele;
+    params.max_profile_exponent       = profile_max_exponent();
     params.sound_speed                = m_param_sound_speed;
-    params.cs_idx_start               = cs_idx_start;
-    params.cs_idx_end                 = cs_idx_end;
-    params.NUM_SPLINES                = dataset->get_num_scatterers(),
+    params.NUM_SPLINES                = static_cast<int>(dataset.get_num_scatterers());
     params.res                        = res_buffer;
-    params.eval_basis_offset_elements = eval_basis_offset_elements;
+    params.real_res                   = m_use_real_fft;
     params.demod_freq                 = m_excitation.demod_freq;
+    params.lines                      = nullptr;
+    params.num_lines                  = 1;
+    params.lines_per_block            = 1;
+    params.shared_basis               = false;
+    params.res_line_stride            = 0;
+    params.shared_tile_len            = m_param_shared_tile_size;
+    params.fixed_point_scale          = m_param_fixed_point_scale;
     params.lut_tex                    = m_device_beam_profile->get();
     params.lut.r_min                  = m_lut_r_min;
     params.lut.r_max                  = m_lut_r_max;
@@ -718,46 +3148,206 @@ void GpuAlgorithm::spline_projection_kernel(int stream_no, const Scanline& scanl
     params.lut.l_max                  = m_lut_l_max;
     params.lut.e_min                  = m_lut_e_min;
     params.lut.e_max                  = m_lut_e_max;
+    params.lut_factors                = m_lut_factors;
+    params.lut_zones                  = m_lut_zones;
+    return params;
+}
 
-    // map lut type to a boolean flag
-    bool use_lut;
-    switch (m_cur_beam_profile_type) {
-    case BeamProfileType::ANALYTICAL:
-        use_lut = false;
-        break;
-    case BeamProfileType::LOOKUP:
-        use_lut = true;
-        break;
-    default:
-        throw std::logic_error("spline_projection_kernel(): unknown beam profile type");
-    }
-    if (!m_param_use_arc_projection && !m_enable_phase_delay && !use_lut) {
-        launch_SplineAlgKernel<false, false, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && !m_enable_phase_delay && use_lut) {
-        launch_SplineAlgKernel<false, false, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && m_enable_phase_delay && !use_lut) {
-        launch_SplineAlgKernel<false, true, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (!m_param_use_arc_projection && m_enable_phase_delay && use_lut) {
-        launch_SplineAlgKernel<false, true, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && !m_enable_phase_delay && !use_lut) {
-        launch_SplineAlgKernel<true, false, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && !m_enable_phase_delay && use_lut) {
-        launch_SplineAlgKernel<true, false, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && m_enable_phase_delay && !use_lut) {
-        launch_SplineAlgKernel<true, true, false>(num_blocks, m_param_threads_per_block, cur_stream, params);
-    } else if (m_param_use_arc_projection && m_enable_phase_delay && use_lut) {
-        launch_SplineAlgKernel<true, true, true>(num_blocks, m_param_threads_per_block, cur_stream, params);
+void GpuAlgorithm::launch_spline_kernel(const SplineAlgKernelParams& params, int spline_degree, int num_blocks, int num_lines,
+                                        cudaStream_t cur_stream) const {
+    //dim3 grid_size(num_blocks, num_lines, 1);
+    //dim3 block_size(m_param_threads_per_block, 1, 1);
+
+    const auto use_lut = use_lut_profile();
+    const auto phase_delay = use_phase_delay();
+    if (m_jit_kernels) {
+        m_jit_kernels->launch_spline(m_param_use_arc_projection, phase_delay, use_lut, spline_degree, num_blocks, num_lines,
+                                     m_param_threads_per_block, cur_stream, params);
+    } else if (!m_param_use_arc_projection && !phase_delay && !use_lut) {
+        launch_SplineAlgKernel<false, false, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (!m_param_use_arc_projection && !phase_delay && use_lut) {
+        launch_SplineAlgKernel<false, false, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (!m_param_use_arc_projection && phase_delay && !use_lut) {
+        launch_SplineAlgKernel<false, true, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (!m_param_use_arc_projection && phase_delay && use_lut) {
+        launch_SplineAlgKernel<false, true, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (m_param_use_arc_projection && !phase_delay && !use_lut) {
+        launch_SplineAlgKernel<true, false, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (m_param_use_arc_projection && !phase_delay && use_lut) {
+        launch_SplineAlgKernel<true, false, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (m_param_use_arc_projection && phase_delay && !use_lut) {
+        launch_SplineAlgKernel<true, true, false>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
+    } else if (m_param_use_arc_projection && phase_delay && use_lut) {
+        launch_SplineAlgKernel<true, true, true>(num_blocks, num_lines, m_param_threads_per_block, cur_stream, spline_degree, params);
     } else {
         throw std::logic_error("this should never happen");
     }
 }
 
 size_t GpuAlgorithm::get_total_num_scatterers() const {
-    const auto total_num_fixed  = m_device_fixed_datasets.get_total_num_scatterers();
+    auto total_num_fixed = m_device_fixed_datasets.get_total_num_scatterers();
+    for (const auto& dataset : m_chunked_fixed_datasets) {
+        total_num_fixed += dataset->get_num_scatterers();
+    }
+    for (const auto& dataset : m_procedural_datasets) {
+        total_num_fixed += dataset->count;
+    }
+    for (const auto& dataset : m_image_volume_datasets) {
+        total_num_fixed += dataset.volume->get_count();
+    }
     const auto total_num_spline = m_device_spline_datasets.get_total_num_scatterers();
     return total_num_fixed+total_num_spline;
 }
 
+MemoryUsage GpuAlgorithm::get_memory_usage() const {
+    MemoryUsage usage;
+    add_base_memory_usage(usage);
+
+    // zero for buffers which are not allocated
+    const auto bytes = [](const auto& buffer) -> size_t {
+        return buffer ? buffer->get_num_bytes() : 0;
+    };
+    const auto fft_bytes = [](const CufftBatchedPlanRAII::u_ptr& plan) -> size_t {
+        return plan ? plan->get_work_size() : 0;
+    };
+
+    auto& host = usage.host;
+    auto& pinned = usage.pinned;
+    auto& device = usage.device;
+    host["fixed_scatterers"] = m_device_fixed_datasets.get_num_host_bytes();
+    device["fixed_scatterers"] = m_device_fixed_datasets.get_num_device_bytes();
+    pinned["fixed_scatterers"] = m_device_fixed_datasets.get_num_mapped_bytes();
+    pinned["scatterer_upload_staging"] = m_device_fixed_datasets.get_num_pinned_bytes() + m_device_spline_datasets.get_num_pinned_bytes();
+    for (const auto& dataset : m_chunked_fixed_datasets) {
+        host["fixed_scatterers"] += dataset->get_num_host_bytes();
+        pinned["fixed_scatterers"] += dataset->get_num_pinned_bytes();
+    }
+    device["scatterer_chunks"] = 0;
+    for (const auto& chunk : m_device_chunks) {
+        device["scatterer_chunks"] += bytes(chunk);
+    }
+    device["generated_tile"] = bytes(m_device_generated_tile);
+    device["multi_excitation"] = bytes(m_device_multi_excitation_spectrum) + bytes(m_device_multi_excitation_iq);
+    for (const auto& entry : m_multi_excitations) {
+        device["multi_excitation"] += bytes(entry.filter_fft);
+    }
+    pinned["multi_excitation"] = bytes(m_host_multi_excitation_iq);
+    device["image_volumes"] = 0;
+    for (const auto& dataset : m_image_volume_datasets) {
+        device["image_volumes"] += bytes(dataset.voxel_starts) + bytes(dataset.amplitude_scales);
+    }
+    device["spline_scatterers"] = m_device_spline_datasets.get_num_device_bytes();
+    device["rendered_splines"] = m_device_rendered_spline_datasets.get_num_device_bytes()
+                                 + m_device_rendered_spline_scratch.get_num_device_bytes();
+
+    device["time_projections"] = bytes(m_device_time_proj);
+    device["iq_lines"] = bytes(m_device_iq_lines);
+    pinned["iq_lines"] = bytes(m_host_iq_lines) + bytes(m_host_frame_iq_lines);
+    device["noise"] = bytes(m_device_noise_frame);
+    device["excitation"] = bytes(m_device_excitation_fft);
+    device["line_descriptors"] = bytes(m_device_line_descriptors);
+    pinned["line_descriptors"] = bytes(m_host_line_descriptors);
+    device["fft_work_area"] = fft_bytes(m_fft_plan) + fft_bytes(m_fft_plan_r2c)
+        + (m_fft_callback_plans ? m_fft_callback_plans->get_device_bytes() : 0);
+    // the frames in flight of a stream and of simulate_lines_async()
+    for (const auto frames : {&m_stream_frames, &m_async_stream_frames}) {
+        for (const auto& frame : *frames) {
+            device["time_projections"] += bytes(frame->device_time_proj);
+            device["iq_lines"] += bytes(frame->device_iq_lines);
+            pinned["iq_lines"] += bytes(frame->host_iq_lines);
+            device["noise"] += bytes(frame->device_noise_frame);
+            device["line_descriptors"] += bytes(frame->device_line_descriptors);
+            pinned["line_descriptors"] += bytes(frame->host_line_descriptors);
+            device["fft_work_area"] += fft_bytes(frame->fft_plan) + fft_bytes(frame->fft_plan_r2c)
+                + (frame->fft_callback_plans ? frame->fft_callback_plans->get_device_bytes() : 0);
+        }
+    }
+    device["culled_indices"] = 0;
+    pinned["culled_indices"] = 0;
+    for (const auto& staging : m_culled_index_staging) {
+        for (const auto& host_buffer : staging.host_slots) {
+            pinned["culled_indices"] += bytes(host_buffer);
+        }
+        device["culled_indices"] += bytes(staging.device_indices);
+    }
+
+    device["beam_profile"] = beam_profile_device_bytes();
+    device["bmode_image"] = bytes(m_device_envelope) + bytes(m_device_gray_levels) + bytes(m_device_max_envelope)
+        + bytes(m_device_bmode_image)
+        + bytes(m_device_packed_iq) + bytes(m_device_max_iq_bits)
+        + (m_gray_level_texture ? m_gray_level_texture->get_width()*m_gray_level_texture->get_height() : 0);
+    host["bmode_image"] = m_host_bmode_image.capacity();
+    return usage;
+}
+
+MemoryUsage GpuAlgorithm::predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                               size_t num_spline_scatterers, int num_cs) const {
+    if (m_excitation.samples.empty()) {
+        throw std::runtime_error("Excitation not configured.");
+    }
+    const auto num_lines = static_cast<size_t>(scan_seq.get_num_lines());
+    const auto num_beams = static_cast<size_t>(line_batch_size(scan_seq.get_num_lines()));
+    const auto num_rf_samples = compute_rf_sample_window(m_param_sound_speed, scan_seq, m_excitation, m_radial_decimation).num_samples;
+    const auto num_iq_samples = (num_rf_samples + m_radial_decimation - 1)/m_radial_decimation;
+    const auto num_streams = static_cast<size_t>(m_param_num_cuda_streams);
+    const auto num_time_samples = compute_num_time_samples(num_rf_samples);
+    const auto time_proj_bytes = sizeof(complex)*num_time_samples*num_beams;
+    const auto iq_bytes = sizeof(complex)*num_iq_samples*num_beams;
+
+    size_t c2c_work_size = 0;
+    size_t r2c_work_size = 0;
+    cufftErrorCheck( cufftEstimate1d(static_cast<int>(num_time_samples), CUFFT_C2C, static_cast<int>(num_beams), &c2c_work_size) );
+    cufftErrorCheck( cufftEstimate1d(static_cast<int>(num_time_samples), CUFFT_R2C, static_cast<int>(num_beams), &r2c_work_size) );
+
+    // the splines are rendered to fixed scatterers if all lines have the same timestamp
+    const auto render_splines = scan_seq.all_timestamps_equal && (num_spline_scatterers > 0);
+    const auto num_line_datasets = (num_spline_scatterers > 0) && !render_splines ? 2 : 1;
+    const auto max_culled_dataset = std::max(num_fixed_scatterers, render_splines ? num_spline_scatterers : 0);
+
+    MemoryUsage usage;
+    auto& host = usage.host;
+    auto& pinned = usage.pinned;
+    auto& device = usage.device;
+    host["scan_sequence"] = scan_sequence_bytes(scan_seq);
+    host["image_buffers"] = 0;
+    if (m_param_scatterer_chunk_size > 0) {
+        const auto chunk_size = m_param_scatterer_chunk_size;
+        const auto num_chunks = (num_fixed_scatterers + chunk_size - 1)/chunk_size;
+        host["fixed_scatterers"] = num_fixed_scatterers*sizeof(uint32_t);
+        pinned["fixed_scatterers"] = std::max<size_t>(1, num_chunks*4*chunk_size)*sizeof(float);
+        device["fixed_scatterers"] = 0;
+        device["scatterer_chunks"] = (num_fixed_scatterers > 0) ? 2*4*chunk_size*sizeof(float) : 0;
+    } else {
+        host["fixed_scatterers"] = (num_fixed_scatterers > 0)
+            ? num_fixed_scatterers*sizeof(uint32_t) + ScattererGrid::predict_num_bytes(num_fixed_scatterers, 16, m_param_scatterer_order) : 0;
+        const auto fixed_bytes = num_fixed_scatterers*4*(m_param_compact_scatterers ? sizeof(uint16_t) : sizeof(float));
+        pinned["fixed_scatterers"] = use_mapped_scatterers() ? fixed_bytes : 0;
+        device["fixed_scatterers"] = use_mapped_scatterers() ? 0 : fixed_bytes;
+        device["scatterer_chunks"] = 0;
+    }
+    const size_t floats_per_control_point = m_device_spline_datasets.is_interleaved() ? 4 : 3;
+    device["spline_scatterers"] = num_spline_scatterers*(floats_per_control_point*num_cs + 1)*sizeof(float);
+    // with several timestamps, the groups of lines alternate between two rendered datasets
+    const size_t num_rendered_datasets = render_splines ? 1 : ((num_spline_scatterers > 0) ? 2 : 0);
+    device["rendered_splines"] = num_rendered_datasets*num_spline_scatterers*4*sizeof(float);
+
+    device["time_projections"] = time_proj_bytes;
+    device["iq_lines"] = iq_bytes;
+    pinned["iq_lines"] = iq_bytes + ((num_beams < num_lines) ? sizeof(complex)*num_iq_samples*num_lines : 0);
+    device["noise"] = (m_param_noise_amplitude > 0.0f) ? sizeof(uint2) : 0;
+    device["excitation"] = sizeof(complex)*num_time_samples;
+    device["line_descriptors"] = num_line_datasets*num_beams*sizeof(LineDescriptor);
+    pinned["line_descriptors"] = num_line_datasets*num_beams*sizeof(LineDescriptor);
+    device["fft_work_area"] = c2c_work_size + r2c_work_size;
+    device["culled_indices"] = m_param_scatterer_culling ? num_streams*max_culled_dataset*sizeof(int) : 0;
+    pinned["culled_indices"] = device["culled_indices"];
+
+    device["beam_profile"] = beam_profile_device_bytes();
+    device["bmode_image"] = 0;
+    host["bmode_image"] = 0;
+    return usage;
+}
+
 std::string GpuAlgorithm::get_parameter(const std::string& key) const {
     if (key == "num_cuda_devices") {
         int num_devices;
@@ -767,6 +3357,29 @@ std::string GpuAlgorithm::get_parameter(const std::string& key) const {
         cudaDeviceProp prop;
         cudaErrorCheck( cudaGetDeviceProperties(&prop, m_param_cuda_device_no) );
         return prop.name;
+    } else if (key == "gpu_memory_pool_stats") {
+        std::stringstream ss;
+        const auto add_stats = [&](const std::string& name, CudaMemoryPool::Kind kind) {
+            const auto stats = CudaMemoryPool::instance().get_stats(kind);
+            ss << name << "_cuda_allocations=" << stats.num_cuda_allocations << " "
+               << name << "_reused="           << stats.num_reused           << " "
+               << name << "_bytes_in_use="     << stats.bytes_in_use         << " "
+               << name << "_bytes_cached="     << stats.bytes_cached;
+        };
+        add_stats("device", CudaMemoryPool::Kind::DEVICE);
+        ss << " ";
+        add_stats("host_pinned", CudaMemoryPool::Kind::HOST_PINNED);
+        return ss.str();
+    } else if (key == "gpu_lut_max_error") {
+        return std::to_string(m_lut_error.max_error);
+    } else if (key == "gpu_lut_relative_rms_error") {
+        return std::to_string(m_lut_error.relative_rms_error);
+    } else if (key == "gpu_compact_scatterers_max_position_error") {
+        return std::to_string(m_device_fixed_datasets.get_compact_error().max_position_error);
+    } else if (key == "gpu_compact_scatterers_max_amplitude_error") {
+        return std::to_string(m_device_fixed_datasets.get_compact_error().max_amplitude_error);
+    } else if (key == "gpu_jit_num_modules") {
+        return std::to_string(m_jit_kernels ? m_jit_kernels->get_num_modules() : 0);
     } else {
         return BaseAlgorithm::get_parameter(key);
     }
@@ -30,13 +30,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <vector>
 #include <memory>
-#include <cuda.h>
-#include <cufft.h>
+#include "gpu_runtime.h"
 #include "cuda_helpers.h"
 #include "cufft_helpers.h"
 #include "BaseAlgorithm.hpp"
 #include "GpuScatterers.hpp"
-#include "curand_helpers.h"
+#include "cufft_callbacks.h"
+#include "cuda_kernels_c_interface.h"
+#include "../lut_compression.hpp"
+#include "AutotuneCache.hpp"
+#include "JitKernels.hpp"
+#include "common_utils.hpp"
 
 namespace bcsim {
 
@@ -50,6 +54,10 @@ public:
     GpuAlgorithm();
 
     virtual ~GpuAlgorithm() {
+        wait_for_async_frames();
+        for (const auto& frame : m_async_stream_frames) {
+            cudaStreamSynchronize(frame->stream->get());
+        }
         // TODO: Somehow call cudaDeviceReset() without crashes that
         // occur most likely when RAII-wrappers go out of scope and
         // tries to free CUDA resources..
@@ -60,6 +68,12 @@ public:
     virtual std::string get_parameter(const std::string& key) const                     override;
 
     virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines) override;
+
+    virtual void get_output_dimensions(size_t& num_lines, size_t& num_samples) const    override;
+
+    virtual float get_output_start_time() const                                         override;
+
+    virtual void simulate_lines(std::complex<float>* iq_buffer, size_t line_stride)     override;
     
     // NOTE: currently requires that set_excitation is called first!
     virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               override;
@@ -74,13 +88,189 @@ public:
 
     virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                                       override;
 
+    // The dataset is sorted for the device on the host, so an expanded copy
+    // exists while it is uploaded. Cannot be updated.
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)                      override;
+
+    // Only the description is kept: the scatterers are generated on the
+    // device tile by tile while projecting. Cannot be updated.
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                             override;
+
+    // As a procedural dataset, with the voxel numbering and a texture of the
+    // amplitude scales on the device. Cannot be updated.
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)                          override;
+
     virtual void clear_spline_scatterers()                                                          override;
 
     virtual void add_spline_scatterers(SplineScatterers::s_ptr)                                     override;
 
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers)         override;
+
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers)                   override;
+
     virtual size_t get_total_num_scatterers() const                                     override;
 
+    // Not including the blocks cached by the CUDA memory pool.
+    virtual MemoryUsage get_memory_usage() const                                        override;
+
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const override;
+
+    // Keeps gpu_frames_in_flight frames in flight with their own buffers
+    // when batched launches are possible.
+    virtual void begin_stream(const std::vector<float>& timestamp_offsets)             override;
+
+    virtual bool next_frame(std::complex<float>* iq_buffer, size_t line_stride)         override;
+
+    // When batched launches are possible, the frames are enqueued round-robin
+    // on gpu_frames_in_flight stream frames of their own, and a host function
+    // on the stream copies the lines to iq_buffer. Queueing more frames waits
+    // for the frame which used the stream frame before. Otherwise the frames
+    // are simulated on the thread pool.
+    virtual std::future<void> simulate_lines_async(std::complex<float>* iq_buffer, size_t line_stride) override;
+
+    // Projects the scatterers and transforms the projections once, and only
+    // filters, inverse transforms and demodulates them once per excitation.
+    // Uses the one frame per excitation of BaseAlgorithm if the projection
+    // depends on the excitation (see can_share_projection()).
+    virtual void simulate_lines_multi_excitation(const std::vector<ExcitationSignal>& excitations,
+                                                 std::complex<float>* iq_buffer,
+                                                 size_t line_stride, size_t frame_stride) override;
+
+    // Converts the IQ lines on the device unless the frame is simulated in
+    // line batches, which falls back to the host conversion.
+    virtual float simulate_bmode_image(const BModeImageConfig& config, unsigned char* image) override;
+
+    // Scan converts directly into device_image. With line batches, the host
+    // image is copied to the device.
+    virtual float simulate_bmode_image_on_device(const BModeImageConfig& config, unsigned char* device_image) override;
+
+    // Copies the device IQ lines to the frame on the work stream, with line
+    // batches from the host.
+    virtual IDeviceIqFrame::s_ptr simulate_lines_on_device() override;
+
+    // Converts the IQ lines on the device and copies the converted lines,
+    // except with line batches which fall back to the host conversion.
+    virtual float simulate_lines_formatted(const IqOutputFormat& format, void* iq_buffer, size_t line_stride) override;
+
 protected:
+    typedef cufftComplex complex;
+
+    // Buffers and stream of a frame in flight in a stream of frames.
+    struct StreamFrame {
+        typedef std::unique_ptr<StreamFrame> u_ptr;
+
+        CudaStreamRAII::u_ptr                               stream;
+        DeviceBufferRAII<complex>::u_ptr                    device_time_proj;
+        DeviceBufferRAII<complex>::u_ptr                    device_iq_lines;
+        HostPinnedBufferRAII<std::complex<float>>::u_ptr    host_iq_lines;
+        HostPinnedBufferRAII<LineDescriptor>::u_ptr         host_line_descriptors;
+        DeviceBufferRAII<LineDescriptor>::u_ptr             device_line_descriptors;
+        std::vector<size_t>                                 line_descriptors_key;
+        CufftBatchedPlanRAII::u_ptr                         fft_plan;
+        CufftBatchedPlanRAII::u_ptr                         fft_plan_r2c;
+        DeviceBufferRAII<uint2>::u_ptr                      device_noise_frame;
+        HostPinnedBufferRAII<uint2>::u_ptr                  host_noise_frame;
+        FftCallbackPlans::u_ptr                             fft_callback_plans;
+    };
+
+    virtual ScanSequence::s_ptr current_scan_sequence() const override {
+        return m_scan_seq;
+    }
+
+    void throw_if_not_configured() const;
+
+    // Upload a fixed dataset without recording it in the state.
+    void upload_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers);
+
+    // The setters only mark the excitation spectrum and the line batches
+    // dirty, which are recomputed here before a frame. Also applies the
+    // autotuned launch configuration.
+    void update_derived_state();
+
+    // With autotuning: use the cached configuration of the device and size
+    // class of the current simulation, or tune and cache it if there is none.
+    void autotune_if_needed();
+
+    // Time frames of candidate configurations, one kernel family at a time.
+    AutotuneEntry run_autotune();
+
+    void apply_autotune_entry(const AutotuneEntry& entry);
+
+    std::string autotune_key() const;
+
+    // Compute the spectrum of the excitation with the Hilbert transform.
+    void upload_excitation_fft();
+
+    // Length of the time-projection lines and transforms for a line of
+    // num_rf_samples samples: Room for the linear convolution with the
+    // excitation, rounded up to a multiple of 128 (the threads per line of
+    // the kernels) times 2^a*3^b*5^c, which cuFFT handles with mixed-radix
+    // transforms.
+    size_t compute_num_time_samples(size_t num_rf_samples) const;
+
+    // The RF samples of a line which are simulated, see compute_rf_sample_window().
+    RfSampleWindow rf_sample_window() const;
+
+    // The time-projection sample of the line at the first sample of the
+    // buffers: the first RF sample of the window, on the decimated grid in
+    // baseband mode.
+    int time_proj_first_sample() const;
+
+    // In baseband mode the time-projections are on the decimated IQ grid,
+    // always with phase delay, and are convolved with the decimated analytic
+    // excitation, see IBeamConvolver::CreateBaseband().
+    bool use_phase_delay() const {
+        return m_enable_phase_delay || m_param_baseband;
+    }
+    float time_proj_sampling_frequency() const;
+
+    // Standard deviation of the noise added to each time-projection sample.
+    float noise_amplitude() const;
+
+    // Parameters of the noise kernels, where grid row zero is line first_line
+    // of the current line batch.
+    NoiseParams noise_params(int first_line) const;
+
+    // Upload the frame number of the noise to the device on a stream, which
+    // must be done before the kernels of a frame are enqueued.
+    void upload_noise_frame(cudaStream_t stream);
+
+    // Parameters of the demodulation kernels: Phase step per time-projection
+    // sample, delay compensation offset and decimation of the time-projections.
+    void get_demodulation(float& normalized_angular_freq, int& offset, int& decimation) const;
+
+    // The current CUDA device is per host thread, so make the simulator's
+    // device current before touching any device memory.
+    void use_cuda_device() const {
+        cudaErrorCheck(cudaSetDevice(m_param_cuda_device_no));
+    }
+
+    // Create batched C2C and in-place R2C plans for num_beams lines.
+    void create_fft_plans(int num_beams, CufftBatchedPlanRAII::u_ptr& c2c_plan, CufftBatchedPlanRAII::u_ptr& r2c_plan) const;
+
+    // (Re)allocate IQ line buffers for the current output dimensions.
+    void allocate_iq_lines(DeviceBufferRAII<complex>::u_ptr& device_iq_lines,
+                           HostPinnedBufferRAII<std::complex<float>>::u_ptr& host_iq_lines);
+
+    // Buffers and stream for a frame of num_lines lines in flight.
+    StreamFrame::u_ptr create_stream_frame(int num_lines);
+
+    // Completes a frame of simulate_lines_async() on the stream frames.
+    struct AsyncFrameCompletion;
+    static void CUDART_CB complete_async_frame(void* user_data);
+
+    // Synchronize the streams of the frames of simulate_lines_async().
+    void wait_for_async_stream_frames();
+
+    // Enqueue a frame with the timestamp offset on a stream frame without waiting.
+    void enqueue_stream_frame(StreamFrame& frame, float timestamp_offset);
+
+    // Exchange the per-frame member buffers with those of a stream frame.
+    void swap_stream_frame_buffers(StreamFrame& frame);
+
     // Debug functionality: slice the 3D texture and write as RAW file to disk.    
     void dump_orthogonal_lut_slices(const std::string& raw_path);
 
@@ -93,26 +283,227 @@ protected:
     // to ensure that calls to device beam profile RAII wrapper does not cause segfault.
     void create_dummy_lut_profile();
 
-    void fixed_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceFixedScatterers::s_ptr dataset);
+    // Upload m_lut_profile or m_multi_resolution_lut_profile in the format
+    // of m_param_lut_format and compute the error of the format against the
+    // full-precision table.
+    void upload_lookup_profile();
+
+    // Device memory of the lookup-table beam profile.
+    size_t beam_profile_device_bytes() const;
 
-    void spline_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceSplineScatterers::s_ptr dataset);
+
+    // Project a fixed dataset. If indices is not null, only the num_indices
+    // scatterers it lists (in device memory) are projected.
+    void fixed_projection_kernel(int stream_no, const Scanline& scanline, int num_blocks, cuComplex* res_buffer, DeviceFixedScatterers::s_ptr dataset,
+                                 const int* indices = nullptr, int num_indices = 0);
+
+    // Compute the culling region of the beams from the current beam profile.
+    void update_culling_region();
+
+    // Find the scatterers of a dataset that are close to a scanline and
+    // upload their indices to the culling buffer of a stream, without waiting
+    // for the stream. Returns the number of indices.
+    int upload_culled_indices(int stream_no, const Scanline& scanline, const DeviceFixedScatterers& dataset);
+
+    // Project a spline dataset onto a line, whose geometry and basis functions
+    // are read from a line descriptor in device memory.
+    void spline_projection_kernel(int stream_no, const LineDescriptor* device_line, int num_blocks, cuComplex* res_buffer,
+                                  DeviceSplineScatterers::s_ptr dataset);
+
+    // Number of streams for "cuda_streams=auto", from the device properties.
+    int auto_num_cuda_streams() const;
+
+    // Whether fixed datasets are added as mapped host memory, on integrated
+    // devices for "gpu_mapped_scatterers=auto".
+    bool use_mapped_scatterers() const;
+
+    // Kernel parameters of a dataset, without the line geometry.
+    FixedAlgKernelParams fixed_kernel_params(const DeviceFixedScatterers& dataset, cuComplex* res_buffer) const;
+    FixedAlgKernelParams fixed_kernel_params(float* xs, float* ys, float* zs, float* as, size_t num_scatterers,
+                                             cuComplex* res_buffer) const;
+    SplineAlgKernelParams spline_kernel_params(const DeviceSplineScatterers& dataset, cuComplex* res_buffer) const;
+
+    // Launch the kernel variant for the current parameters with a grid of
+    // num_blocks x num_lines blocks (num_lines > 1 requires params.lines).
+    // The kernels compiled at runtime are used if enabled.
+    void launch_fixed_kernel(const FixedAlgKernelParams& params, int num_blocks, int num_lines, cudaStream_t cur_stream) const;
+    // The grids have one row per params.lines_per_block lines.
+    void launch_spline_kernel(const SplineAlgKernelParams& params, int spline_degree, int num_blocks, int num_lines,
+                              cudaStream_t cur_stream) const;
+
+    // Lines per block of the spline kernel for scan sequences with a single
+    // geometry, where each block reuses its scatterers for the whole group.
+    static const int ENSEMBLE_LINES_PER_BLOCK = 8;
+
+    // If the beam profile is a lookup-table, from the beam profile type.
+    bool use_lut_profile() const;
+
+    // Compile the runtime kernels of the frame if enabled, which is not
+    // possible during capture.
+    void prepare_jit_kernels(bool use_rendered_splines);
+
+    // Evaluate the non-zero B-spline basis functions at a timestamp, which
+    // are the coefficients of control points cs_idx_start...cs_idx_end.
+    void compute_spline_basis(const std::vector<float>& knots, int spline_degree, int num_cs, float timestamp,
+                              int& cs_idx_start, int& cs_idx_end, float* basis) const;
+
+    // Project all datasets onto all lines with one launch per dataset, with
+    // the grid rows reading their scanline from the line descriptors.
+    void project_lines_batched(cudaStream_t stream, int num_lines, bool use_rendered_splines);
+
+    // With fixed-point accumulation: convert the time projections of the
+    // first num_lines lines to floats before the forward FFT.
+    void convert_fixed_point_projections(cudaStream_t stream, int num_lines);
+
+    // Project the out-of-core datasets onto all lines, one chunk at a time.
+    // The chunks are copied to two device buffers in turn on the copy stream,
+    // so that copying the next chunk overlaps with projecting the current one.
+    void project_chunked_datasets(cudaStream_t stream, int num_lines);
+
+    // Allocate the tile of generated scatterers if it is smaller than the
+    // tile size.
+    void reserve_generated_tile();
+
+    // Project the procedural and image volume datasets onto all lines. Each tile of scatterers
+    // is generated in m_device_generated_tile and then projected, both on the
+    // stream, so the next tile is only generated when the buffer is free.
+    void project_generated_datasets(cudaStream_t stream, int num_lines);
+
+    // Kernel parameters of a procedural dataset.
+    static ProceduralParams procedural_params(const ProceduralScatterers& dataset);
+
+    // Project the tile of generated scatterers, the first num_scatterers of it.
+    void project_generated_tile(cudaStream_t stream, int num_lines, size_t num_scatterers);
+
+    // Group the lines of the scan sequence into runs with the same
+    // timestamp, and decide which of them project rendered splines.
+    void update_spline_render_groups();
+
+    // True if the frame can be simulated with batched launches. Throws if it
+    // cannot, but out-of-core datasets require it.
+    bool can_use_batched_launch(int num_lines) const;
+
+    // Make the host and device line descriptor buffers hold at least num_bytes_needed.
+    void reserve_line_descriptors(size_t num_bytes_needed);
+
+    // Fill the host line descriptors with the geometry of all lines, followed
+    // by the geometry and basis functions of all lines for each spline dataset
+    // (unless the rendered spline datasets are used). The timestamp offset is
+    // added to the timestamps of the lines.
+    void fill_line_descriptors(int num_lines, bool use_rendered_splines, float timestamp_offset);
+
+    // Fill and upload the line descriptors on a stream, unless the device
+    // already holds them for the current scan sequence and spline datasets.
+    // The geometry of parametric scan sequences without spline datasets is
+    // generated on the device instead.
+    void upload_line_descriptors(cudaStream_t stream, int num_lines, bool use_rendered_splines, float timestamp_offset = 0.0f);
+
+    // Simulate all lines with batched launches, replaying the captured CUDA
+    // graph of the frame if enabled.
+    void simulate_frame_batched(int num_lines, bool use_rendered_splines);
+
+    // Enqueue the whole batched frame on a stream, from the line descriptor
+    // upload to the copy of the IQ lines to host, without host synchronization.
+    void enqueue_frame_batched(cudaStream_t stream, int num_lines, bool use_rendered_splines);
+
+    // True if one projection of the frame serves all excitations: not in
+    // baseband mode, without noise (which differs from frame to frame), with
+    // the frame in one batched launch, and with excitations of the configured
+    // length and, with phase delay, demodulation frequency.
+    bool can_share_projection(const std::vector<ExcitationSignal>& excitations);
+
+    // Compute the spectra and demodulation of the excitations, unless they
+    // are cached, and allocate the buffers of a multi-excitation frame.
+    void prepare_multi_excitation(const std::vector<ExcitationSignal>& excitations);
+
+    // Instead of the convolution of enqueue_frame_batched(): transform the
+    // projections, and filter, inverse transform and demodulate a copy of
+    // them for each excitation into m_host_multi_excitation_iq.
+    void enqueue_multi_excitation(cudaStream_t stream, int num_lines);
+
+    // Create or drop the cuFFT plans with callbacks as configured, and update
+    // their parameters for the current frame buffers. Not during capture.
+    void prepare_fft_callbacks(int num_lines);
+
+    // True if no line can have more non-zero time-projection samples than
+    // "gpu_sparse_convolution_threshold", so that the batched frame is
+    // convolved from the collected samples instead of with cuFFT.
+    bool use_sparse_convolution() const;
+
+    // Allocate or drop the buffers of the sparse path. Not during capture.
+    void prepare_sparse_convolution(int num_lines);
+
+    // Everything baked into the captured graph: a different key requires
+    // a new capture.
+    std::vector<size_t> frame_graph_key(int num_lines, bool use_rendered_splines) const;
+
+    // Simulate all lines of the frame and return the host buffer with the
+    // IQ lines, in line batches if the frame does not fit in one. If
+    // deliver_lines is set, the lines are passed to the line callback as
+    // soon as their batch is on the host.
+    const std::complex<float>* simulate_to_host_buffer(bool deliver_lines = false);
+
+    // Simulate all lines of m_scan_seq into m_host_iq_lines, or only into
+    // m_device_iq_lines if m_copy_iq_to_host is false.
+    void simulate_batch_to_host_buffer();
+
+    // Convert m_device_iq_lines of the whole frame to a B-mode image, which
+    // is either host memory or device memory of the current device.
+    float device_iq_to_bmode_image(const BModeImageConfig& config, unsigned char* image, bool image_on_device);
+
+    // Simulate the whole frame into m_device_iq_lines only.
+    void simulate_to_device_iq_lines();
+
+    // Number of lines simulated together, from gpu_max_lines_per_batch.
+    int line_batch_size(int num_lines) const;
+
+    // Lines per block of the batched kernels: the lines of a multi-line
+    // acquisition transmit if enabled and the line batches hold whole
+    // transmits, otherwise one.
+    int mla_lines_per_block() const;
+
+    // Split the scan sequence into line batches and (re)allocate the time
+    // projections and cuFFT plans for the batch size.
+    void configure_line_batches();
+
+    // Make the work stream wait for everything enqueued on the line streams.
+    void work_stream_wait_for_streams();
+
+    // Make the line streams wait for the last m_work_event record.
+    void streams_wait_for_work_stream();
 
 protected:
-    typedef cufftComplex complex;
-    
     std::vector<CudaStreamRAII::s_ptr>                  m_stream_wrappers;
+    // one event per stream wrapper, for dependencies of the work stream
+    std::vector<CudaEventRAII::u_ptr>                   m_stream_events;
+    // stream of the frame-wide work (noise, spline rendering and FFTs),
+    // and the event the line streams wait for
+    CudaStreamRAII::u_ptr                               m_work_stream;
+    CudaEventRAII::u_ptr                                m_work_event;
 
     ScanSequence::s_ptr                                 m_scan_seq;
     ExcitationSignal                                    m_excitation;
 
-    // number of samples in the time-projection lines [should be a power of two]
+    // number of samples in the time-projection lines, see compute_num_time_samples()
     size_t                                              m_num_time_samples;
+    // the first RF sample of a depth window, whose demodulation phase is in
+    // the excitation spectrum
+    size_t                                              m_first_rf_sample;
 
-    // The cuFFT plan used for all transforms.
+    // The cuFFT plan used for all complex transforms.
     CufftBatchedPlanRAII::u_ptr                         m_fft_plan;
 
+    // In-place real-to-complex plan for the forward transform, used when
+    // the time-projections are real (no phase delay and no noise). The real
+    // samples of a line are stored contiguously at the start of its slot.
+    CufftBatchedPlanRAII::u_ptr                         m_fft_plan_r2c;
+    bool                                                m_use_real_fft;
+
     DeviceBufferRAII<complex>::u_ptr                    m_device_time_proj;   
-    std::vector<HostPinnedBufferRAII<std::complex<float>>::u_ptr>     m_host_rf_lines;
+
+    // Demodulated and decimated IQ lines, [num_lines x num_samples] without padding.
+    DeviceBufferRAII<complex>::u_ptr                    m_device_iq_lines;
+    HostPinnedBufferRAII<std::complex<float>>::u_ptr    m_host_iq_lines;
 
     // precomputed excitation FFT with Hilbert mask applied.
     DeviceBufferRAII<complex>::u_ptr                    m_device_excitation_fft;
@@ -127,9 +518,55 @@ protected:
     
     // parameters that are comon to all GPU algorithms
     int                                                 m_param_cuda_device_no;
+    // number of streams in the pool the lines are distributed over
     int                                                 m_param_num_cuda_streams;
     int                                                 m_param_threads_per_block;
+    // block size of the element-wise kernels on the lines
+    int                                                 m_param_threads_per_line;
     bool                                                m_store_kernel_details;
+    // tune the block sizes and the number of streams before the first frame
+    // of each size class, with the results cached in m_param_autotune_cache
+    bool                                                m_param_autotune;
+    std::string                                         m_param_autotune_cache;
+    // the key of the configuration in use, and whether it is being tuned
+    std::string                                         m_autotune_key;
+    bool                                                m_autotuning;
+    // launch kernels for the whole frame instead of line by line
+    bool                                                m_param_batched_launch;
+    // if positive: number of samples in the shared-memory tile the projection
+    // kernels accumulate a block in, instead of global atomics per scatterer
+    int                                                 m_param_shared_tile_size;
+    // capture the batched frame into a CUDA graph and replay it
+    bool                                                m_param_use_cuda_graph;
+    // number of frames simulated concurrently in a stream of frames
+    int                                                 m_param_frames_in_flight;
+    // fuse the filter multiplication and demodulation into cuFFT callbacks
+    bool                                                m_param_fft_callbacks;
+    // if positive: the maximum number of lines simulated together, with
+    // 0 meaning all lines and -1 a batch size from the free device memory
+    int                                                 m_param_max_lines_per_batch;
+    // if positive: fixed datasets added from now on stay in pinned host
+    // memory and are streamed to the device in chunks of this many scatterers
+    size_t                                              m_param_scatterer_chunk_size;
+    // the number of scatterers generated on the device at a time for the
+    // procedural and image volume datasets added from now on
+    size_t                                              m_param_generated_tile_size;
+    // fixed datasets added from now on are stored on the device with 16-bit
+    // positions and amplitudes (see CompactScatterers.hpp)
+    bool                                                m_param_compact_scatterers;
+    // fixed datasets added from now on are stored as one float4 array of
+    // (x, y, z, amplitude) instead of four float arrays, unless compact
+    bool                                                m_param_interleaved_scatterers;
+    // fixed datasets added from now on stay in pinned host memory which the
+    // kernels read directly (1), are copied to the device (0), or the former
+    // if the device shares its memory with the host (-1)
+    int                                                 m_param_mapped_scatterers;
+    // the splines of a group of lines with the same timestamp are rendered
+    // once if the group has at least this many lines
+    int                                                 m_param_spline_render_min_group_lines;
+    // if positive: the projection kernels accumulate ints of the values in
+    // units of 1/scale, which gives sums independent of the atomics' order
+    float                                               m_param_fixed_point_scale;
 
     // Always reflects the current device in use.
     cudaDeviceProp                                      m_cur_device_prop;
@@ -137,6 +574,25 @@ protected:
     // The 3D texture used as lookup-table beam profile.
     DeviceBeamProfileRAII::u_ptr                        m_device_beam_profile;
 
+    // How the lookup-table beam profile is stored on the device: as a float
+    // or half-precision texture, or as the separable approximation of the
+    // given rank in m_device_lut_factors (with a dummy texture). The profile
+    // is kept to upload it again when the format is changed.
+    enum class LUTFormat { FLOAT, HALF, SEPARABLE };
+    LUTFormat                                           m_param_lut_format;
+    int                                                 m_param_lut_separable_rank;
+    std::shared_ptr<LUTBeamProfile>                     m_lut_profile;
+    DeviceBufferRAII<float>::u_ptr                      m_device_lut_factors;
+    SeparableLUTFactors                                 m_lut_factors;
+    // error of the uploaded format against m_lut_profile
+    LUTApproximationError                               m_lut_error;
+
+    // The multi-resolution lookup-table profile if configured instead of
+    // m_lut_profile, with one texture per zone in the float or half format.
+    std::shared_ptr<MultiResolutionLUTBeamProfile>      m_multi_resolution_lut_profile;
+    std::vector<DeviceBeamProfileRAII::u_ptr>           m_device_lut_zones;
+    MultiResolutionLUT                                  m_lut_zones;
+
     // TEMPORARY: Cached analytical profile data
     float   m_analytical_sigma_lat;
     float   m_analytical_sigma_ele;
@@ -148,17 +604,179 @@ protected:
     float   m_lut_l_max;
     float   m_lut_e_min;
     float   m_lut_e_max;
+    int     m_lut_num_samples_rad;
+    int     m_lut_num_samples_lat;
+    int     m_lut_num_samples_ele;
+
+    // Culling of fixed scatterers: region around the beams, and for each
+    // stream the compacted scatterer indices of the current line. They are
+    // staged in a ring of pinned host buffers, so that a line only waits for
+    // the upload of the line that used its host buffer before.
+    struct CulledIndexStaging {
+        CulledIndexStaging() : next_slot(0) { }
+        std::vector<HostPinnedBufferRAII<int>::u_ptr>   host_slots;
+        std::vector<CudaEventRAII::u_ptr>               uploaded_events;
+        size_t                                          next_slot;
+        DeviceBufferRAII<int>::u_ptr                    device_indices;
+    };
+    BeamCullingRegion                                   m_culling_region;
+    std::vector<CulledIndexStaging>                     m_culled_index_staging;
+
+    // Sub-sequences of the frame's lines when it is simulated in line batches
+    // (empty if the frame is one batch). The last batch is padded with copies
+    // of the last line, so that all batches fit the same buffers and plans.
+    std::vector<ScanSequence::s_ptr>                    m_line_batches;
+    size_t                                              m_cur_line_batch;
+    HostPinnedBufferRAII<std::complex<float>>::u_ptr    m_host_frame_iq_lines;
+
+    // The excitations of simulate_lines_multi_excitation() with their
+    // spectra, computed as m_device_excitation_fft, for the line length and
+    // window they were computed for.
+    struct MultiExcitation {
+        ExcitationSignal                    excitation;
+        DeviceBufferRAII<complex>::u_ptr    filter_fft;
+        float                               normalized_angular_freq;
+        int                                 offset;
+    };
+    std::vector<MultiExcitation>                        m_multi_excitations;
+    size_t                                              m_multi_excitation_num_time_samples;
+    size_t                                              m_multi_excitation_first_rf_sample;
+    // True while a multi-excitation frame is simulated. The filtered copy of
+    // the transformed projections, and the IQ lines of all excitations.
+    bool                                                m_multi_excitation_active;
+    DeviceBufferRAII<complex>::u_ptr                    m_device_multi_excitation_spectrum;
+    DeviceBufferRAII<complex>::u_ptr                    m_device_multi_excitation_iq;
+    HostPinnedBufferRAII<std::complex<float>>::u_ptr    m_host_multi_excitation_iq;
+
+    // Line descriptors of batched launches.
+    HostPinnedBufferRAII<LineDescriptor>::u_ptr         m_host_line_descriptors;
+    DeviceBufferRAII<LineDescriptor>::u_ptr             m_device_line_descriptors;
+
+    // What the device line descriptors were computed for. The generation
+    // changes with the scan sequence and the spline datasets.
+    std::vector<size_t>                                 m_line_descriptors_key;
+    size_t                                              m_line_descriptors_generation;
+
+    // Captured batched frame and what it was captured for.
+    // Plans of batched frames if cuFFT callbacks are enabled.
+    FftCallbackPlans::u_ptr                             m_fft_callback_plans;
+
+    // The truncated analytic excitation at lags from m_sparse_first_lag, and
+    // the non-zero samples of each line of batched frames if the sparse path
+    // is used (null otherwise), see IBeamConvolver::set_sparse_threshold().
+    int                                                 m_param_sparse_convolution_threshold;
+    int                                                 m_sparse_first_lag;
+    DeviceBufferRAII<complex>::u_ptr                    m_device_sparse_taps;
+    DeviceBufferRAII<int>::u_ptr                        m_sparse_counts;
+    DeviceBufferRAII<int>::u_ptr                        m_sparse_indices;
+    DeviceBufferRAII<complex>::u_ptr                    m_sparse_values;
+
+    // Projection kernels compiled at runtime, if "gpu_jit_kernels" is on.
+    JitProjectionKernels::u_ptr                         m_jit_kernels;
+
+    CudaGraphExecRAII::u_ptr                            m_frame_graph;
+    std::vector<size_t>                                 m_frame_graph_key;
+
+    // False while simulating a frame that is post-processed on the device.
+    bool                                                m_copy_iq_to_host;
+
+    // Buffers of the device B-mode image conversion: envelope, gray levels
+    // (also as the scan conversion texture), maximum envelope and the image.
+    DeviceBufferRAII<float>::u_ptr                      m_device_envelope;
+    DeviceBufferRAII<unsigned char>::u_ptr              m_device_gray_levels;
+    DeviceBufferRAII<unsigned int>::u_ptr               m_device_max_envelope;
+    DeviceTexture2DRAII::u_ptr                          m_gray_level_texture;
+    DeviceBufferRAII<unsigned char>::u_ptr              m_device_bmode_image;
+    // host image of simulate_bmode_image_on_device() with line batches
+    std::vector<unsigned char>                          m_host_bmode_image;
+
+    // Buffers of simulate_lines_formatted(): the converted IQ lines with a
+    // word per sample, and the largest real or imaginary part of the frame.
+    DeviceBufferRAII<unsigned int>::u_ptr               m_device_packed_iq;
+    DeviceBufferRAII<unsigned int>::u_ptr               m_device_max_iq_bits;
+
+    // Frames in flight of the current stream (empty if not streaming, or
+    // the frames are simulated one by one), and when the previous frame was
+    // retrieved.
+    std::vector<StreamFrame::u_ptr>                     m_stream_frames;
+    std::chrono::steady_clock::time_point               m_stream_frame_start;
+
+    // Stream frames of simulate_lines_async(), the next one to use, and the
+    // configuration they were allocated for.
+    std::vector<StreamFrame::u_ptr>                     m_async_stream_frames;
+    size_t                                              m_next_async_stream_frame;
+    std::vector<size_t>                                 m_async_stream_frames_key;
+
+    // Derived state to update before the next frame.
+    bool                                                m_excitation_dirty;
+    bool                                                m_line_batches_dirty;
+
+    // True if the lines of the scan sequence only differ in their timestamps
+    // (see BaseAlgorithm::has_single_geometry()).
+    bool                                                m_single_geometry;
+
+    // The lines per transmit of a multi-line acquisition (see
+    // BaseAlgorithm::mla_group_size()).
+    int                                                 m_mla_group_size;
 
     // TODO: set log callbacks!
     DeviceFixedScatterersCollection     m_device_fixed_datasets;
+
+    // Out-of-core fixed datasets, and the procedural and image volume ones
+    // which are generated on the device.
+    std::vector<HostChunkedFixedScatterers::s_ptr> m_chunked_fixed_datasets;
+    std::vector<ProceduralScatterers::s_ptr>       m_procedural_datasets;
+    struct DeviceImageVolume {
+        ImageVolumeScatterers::s_ptr                        volume;
+        DeviceBufferRAII<unsigned long long>::u_ptr         voxel_starts;
+        DeviceVolumeTextureRAII::u_ptr                      amplitude_scales;
+    };
+    std::vector<DeviceImageVolume>                 m_image_volume_datasets;
+
+    // Where each fixed dataset in the order of adding is stored.
+    enum class FixedDatasetKind {
+        DEVICE,
+        CHUNKED,
+        GENERATED
+    };
+    std::vector<FixedDatasetKind>       m_fixed_dataset_kinds;
+
+    // The tile of generated scatterers, as four float arrays.
+    DeviceBufferRAII<float>::u_ptr      m_device_generated_tile;
+
+    // Double-buffered device chunks of the out-of-core datasets, and events
+    // for when a chunk has been copied and when it has been projected.
+    CudaStreamRAII::u_ptr               m_copy_stream;
+    std::vector<DeviceBufferRAII<float>::u_ptr> m_device_chunks;
+    std::vector<CudaEventRAII::u_ptr>   m_chunk_copied_events;
+    std::vector<CudaEventRAII::u_ptr>   m_chunk_projected_events;
+
     DeviceSplineScatterersCollection    m_device_spline_datasets;
 
     // optimization to reduce memory bandwidth usage when all lines
     // in a scan have the same timestamp.
     DeviceFixedScatterersCollection     m_device_rendered_spline_datasets;
 
-    CurandGeneratorRAII                 m_device_rng;
-    DeviceBufferRAII<float>::u_ptr      m_device_random_buffer;
+    // Consecutive lines with the same timestamp, whose splines are rendered
+    // unless the group is small. The groups alternate between the rendered
+    // datasets above and the scratch datasets.
+    struct SplineRenderGroup {
+        int     first_line;
+        int     num_lines;
+        bool    rendered;
+    };
+    std::vector<SplineRenderGroup>      m_spline_render_groups;
+    DeviceFixedScatterersCollection     m_device_rendered_spline_scratch;
+
+    // The noise is generated in the kernels from the seed, the frame number
+    // and the line number, as the noise of the CPU algorithm. The first line
+    // is the line number of the first line of the scan sequence, for the
+    // devices of a multi-GPU simulation.
+    uint64_t                            m_param_noise_seed;
+    uint64_t                            m_noise_frame_no;       // incremented for every simulated frame
+    int                                 m_param_noise_first_line;
+    DeviceBufferRAII<uint2>::u_ptr      m_device_noise_frame;
+    HostPinnedBufferRAII<uint2>::u_ptr  m_host_noise_frame;
 };
     
 }   // end namespace
@@ -1,21 +1,226 @@
 #ifdef BCSIM_ENABLE_CUDA
 #include <stdexcept>
+#include <algorithm>
 #include <tuple>
+#include <cstring>
 #include "common_definitions.h" // for MAX_SPLINE_DEGREE
 #include "GpuScatterers.hpp"
+#include "CpuScatterers.hpp"   // for HostFixedScatterers
 #include "cuda_kernels_c_interface.h"
+#include "common_utils.hpp"    // for check_spline_update
 #include "../bspline.hpp"
 
 namespace bcsim {
 
-DeviceFixedScatterers::DeviceFixedScatterers(size_t num_scatterers)
-    : m_num_scatterers(num_scatterers)
+void DeviceScatterStaging::scatter(const std::vector<float*>& device_arrays, const std::vector<int>& indices,
+                                   const std::vector<float>& values, cudaStream_t stream) {
+    const auto num_indices = indices.size();
+    if (num_indices == 0) {
+        return;
+    }
+    if (values.size() != device_arrays.size()*num_indices) {
+        throw std::logic_error("number of values does not match the arrays and indices");
+    }
+    const auto index_bytes = num_indices*sizeof(int);
+    const auto value_bytes = values.size()*sizeof(float);
+    if (!m_host_indices || (m_host_indices->get_num_bytes() < index_bytes)) {
+        m_host_indices   = HostPinnedBufferRAII<int>::u_ptr(new HostPinnedBufferRAII<int>(index_bytes));
+        m_device_indices = DeviceBufferRAII<int>::u_ptr(new DeviceBufferRAII<int>(index_bytes));
+    }
+    if (!m_host_values || (m_host_values->get_num_bytes() < value_bytes)) {
+        m_host_values   = HostPinnedBufferRAII<float>::u_ptr(new HostPinnedBufferRAII<float>(value_bytes));
+        m_device_values = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(value_bytes));
+    }
+    std::copy(indices.begin(), indices.end(), m_host_indices->data());
+    std::copy(values.begin(), values.end(), m_host_values->data());
+    cudaErrorCheck( cudaMemcpyAsync(m_device_indices->data(), m_host_indices->data(), index_bytes, cudaMemcpyHostToDevice, stream) );
+    cudaErrorCheck( cudaMemcpyAsync(m_device_values->data(), m_host_values->data(), value_bytes, cudaMemcpyHostToDevice, stream) );
+
+    const int num_threads = 128;
+    const int num_blocks = round_up_div(static_cast<int>(num_indices), num_threads);
+    for (size_t array_no = 0; array_no < device_arrays.size(); array_no++) {
+        launch_ScatterKernel(num_blocks, num_threads, stream, device_arrays[array_no], m_device_indices->data(),
+                             m_device_values->data() + array_no*num_indices, static_cast<int>(num_indices));
+    }
+    cudaErrorCheck( cudaStreamSynchronize(stream) );
+}
+
+DeviceUploadStaging::DeviceUploadStaging(size_t chunk_bytes)
+    : m_chunk_bytes(chunk_bytes),
+      m_buffer_in_use{false, false},
+      m_next_buffer(0)
+{
+}
+
+void DeviceUploadStaging::set_chunk_bytes(size_t chunk_bytes) {
+    synchronize();
+    m_chunk_bytes = chunk_bytes;
+    m_buffers[0].reset();
+    m_buffers[1].reset();
+}
+
+size_t DeviceUploadStaging::get_chunk_bytes() const {
+    return m_chunk_bytes;
+}
+
+void DeviceUploadStaging::upload(void* device_dst, const void* host_src, size_t num_bytes) {
+    if (num_bytes == 0) {
+        return;
+    }
+    // created on first use, when the device has been selected
+    if (!m_stream) {
+        m_stream = CudaStreamRAII::u_ptr(new CudaStreamRAII);
+        m_default_stream_event = CudaEventRAII::u_ptr(new CudaEventRAII);
+        m_buffer_events[0] = CudaEventRAII::u_ptr(new CudaEventRAII);
+        m_buffer_events[1] = CudaEventRAII::u_ptr(new CudaEventRAII);
+    }
+    m_default_stream_event->record(0);
+    m_default_stream_event->make_wait(m_stream->get());
+
+    const auto chunk_bytes = (m_chunk_bytes > 0) ? m_chunk_bytes : num_bytes;
+    auto dst = static_cast<char*>(device_dst);
+    auto src = static_cast<const char*>(host_src);
+    for (size_t offset = 0; offset < num_bytes; offset += chunk_bytes) {
+        const auto num_chunk_bytes = std::min(chunk_bytes, num_bytes - offset);
+        auto buffer = next_buffer(num_chunk_bytes);
+        std::memcpy(buffer, src + offset, num_chunk_bytes);
+        cudaErrorCheck( cudaMemcpyAsync(dst + offset, buffer, num_chunk_bytes, cudaMemcpyHostToDevice, m_stream->get()) );
+        m_buffer_events[m_next_buffer]->record(m_stream->get());
+        m_buffer_in_use[m_next_buffer] = true;
+        m_next_buffer = 1 - m_next_buffer;
+    }
+}
+
+char* DeviceUploadStaging::next_buffer(size_t num_bytes) {
+    auto& buffer = m_buffers[m_next_buffer];
+    if (m_buffer_in_use[m_next_buffer]) {
+        m_buffer_events[m_next_buffer]->synchronize();
+        m_buffer_in_use[m_next_buffer] = false;
+    }
+    if (!buffer || (buffer->get_num_bytes() < num_bytes)) {
+        // without chunking the buffers grow to the largest array
+        buffer = HostPinnedBufferRAII<char>::u_ptr(new HostPinnedBufferRAII<char>(std::max(num_bytes, m_chunk_bytes)));
+    }
+    return buffer->data();
+}
+
+void DeviceUploadStaging::synchronize() {
+    if (m_stream) {
+        cudaErrorCheck( cudaStreamSynchronize(m_stream->get()) );
+    }
+    m_buffer_in_use[0] = false;
+    m_buffer_in_use[1] = false;
+}
+
+size_t DeviceUploadStaging::get_num_pinned_bytes() const {
+    size_t sum = 0;
+    for (const auto& buffer : m_buffers) {
+        sum += buffer ? buffer->get_num_bytes() : 0;
+    }
+    return sum;
+}
+
+DeviceScattererArena::DeviceScattererArena(bool interleaved)
+    : m_interleaved(interleaved),
+      m_capacity(0),
+      m_num_scatterers(0)
+{
+}
+
+size_t DeviceScattererArena::allocate(size_t num_scatterers) {
+    const auto offset = m_num_scatterers;
+    if (offset + num_scatterers > m_capacity) {
+        const auto new_capacity = std::max(offset + num_scatterers, std::max(2*m_capacity, static_cast<size_t>(1024)));
+        DeviceBufferRAII<float>::u_ptr new_data(new DeviceBufferRAII<float>(4*new_capacity*sizeof(float)));
+        if ((offset > 0) && m_interleaved) {
+            cudaErrorCheck( cudaMemcpy(new_data->data(), m_data->data(), 4*offset*sizeof(float), cudaMemcpyDeviceToDevice) );
+        } else if (offset > 0) {
+            for (size_t array_no = 0; array_no < 4; array_no++) {
+                cudaErrorCheck( cudaMemcpy(new_data->data() + array_no*new_capacity, m_data->data() + array_no*m_capacity,
+                                           offset*sizeof(float), cudaMemcpyDeviceToDevice) );
+            }
+        }
+        m_data = std::move(new_data);
+        m_capacity = new_capacity;
+    }
+    m_num_scatterers += num_scatterers;
+    return offset;
+}
+
+size_t DeviceScattererArena::get_num_scatterers() const {
+    return m_num_scatterers;
+}
+
+float* DeviceScattererArena::get_xs_ptr() const {
+    return (m_data && !m_interleaved) ? m_data->data() : nullptr;
+}
+
+float* DeviceScattererArena::get_ys_ptr() const {
+    return (m_data && !m_interleaved) ? m_data->data() + m_capacity : nullptr;
+}
+
+float* DeviceScattererArena::get_zs_ptr() const {
+    return (m_data && !m_interleaved) ? m_data->data() + 2*m_capacity : nullptr;
+}
+
+float* DeviceScattererArena::get_as_ptr() const {
+    return (m_data && !m_interleaved) ? m_data->data() + 3*m_capacity : nullptr;
+}
+
+bool DeviceScattererArena::is_interleaved() const {
+    return m_interleaved;
+}
+
+float4* DeviceScattererArena::get_points_ptr() const {
+    return (m_data && m_interleaved) ? reinterpret_cast<float4*>(m_data->data()) : nullptr;
+}
+
+size_t DeviceScattererArena::get_num_device_bytes() const {
+    return 4*m_capacity*sizeof(float);
+}
+
+DeviceFixedScatterers::DeviceFixedScatterers(size_t num_scatterers, bool compact, bool interleaved, bool mapped)
+    : m_compact(compact),
+      m_interleaved(interleaved && !compact),
+      m_encoding(),
+      m_arena_offset(0),
+      m_num_scatterers(num_scatterers)
+{
+    if (mapped) {
+        // the same layouts in one buffer of 8 or 16 bytes per scatterer
+        const auto num_bytes = std::max<size_t>(1, num_scatterers)*(compact ? 4*sizeof(uint16_t) : 4*sizeof(float));
+        m_mapped = HostMappedBufferRAII<float>::u_ptr(new HostMappedBufferRAII<float>(num_bytes));
+    } else if (compact) {
+        m_codes = DeviceBufferRAII<uint16_t>::u_ptr(new DeviceBufferRAII<uint16_t>(4*num_scatterers*sizeof(uint16_t)));
+    } else if (interleaved) {
+        m_points = DeviceBufferRAII<float4>::u_ptr(new DeviceBufferRAII<float4>(num_scatterers*sizeof(float4)));
+    } else {
+        const auto num_bytes = num_scatterers*sizeof(float);
+        xs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
+        ys = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
+        zs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
+        as = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
+    }
+}
+
+DeviceFixedScatterers::DeviceFixedScatterers(DeviceScattererArena::s_ptr arena, size_t num_scatterers)
+    : m_compact(false),
+      m_interleaved(false),
+      m_encoding(),
+      m_arena(arena),
+      m_arena_offset(arena->allocate(num_scatterers)),
+      m_num_scatterers(num_scatterers)
+{
+}
+
+DeviceFixedScatterers::DeviceFixedScatterers(DeviceScattererArena::s_ptr arena, size_t offset, size_t num_scatterers)
+    : m_compact(false),
+      m_interleaved(false),
+      m_encoding(),
+      m_arena(arena),
+      m_arena_offset(offset),
+      m_num_scatterers(num_scatterers)
 {
-    const auto num_bytes = num_scatterers*sizeof(float);
-    xs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
-    ys = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
-    zs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
-    as = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes));
 }
 
 size_t DeviceFixedScatterers::get_num_scatterers() const {
@@ -23,29 +228,195 @@ size_t DeviceFixedScatterers::get_num_scatterers() const {
 }
 
 float* DeviceFixedScatterers::get_xs_ptr() const {
-    return xs->data();
+    if (m_arena) {
+        return m_arena->is_interleaved() ? nullptr : m_arena->get_xs_ptr() + m_arena_offset;
+    }
+    if (m_mapped) {
+        return (m_compact || m_interleaved) ? nullptr : m_mapped->data();
+    }
+    return xs ? xs->data() : nullptr;
 }
 
 float* DeviceFixedScatterers::get_ys_ptr() const {
-    return ys->data();
+    if (m_arena) {
+        return m_arena->is_interleaved() ? nullptr : m_arena->get_ys_ptr() + m_arena_offset;
+    }
+    if (m_mapped) {
+        return (m_compact || m_interleaved) ? nullptr : m_mapped->data() + m_num_scatterers;
+    }
+    return ys ? ys->data() : nullptr;
 }
 
 float* DeviceFixedScatterers::get_zs_ptr() const {
-    return zs->data();
+    if (m_arena) {
+        return m_arena->is_interleaved() ? nullptr : m_arena->get_zs_ptr() + m_arena_offset;
+    }
+    if (m_mapped) {
+        return (m_compact || m_interleaved) ? nullptr : m_mapped->data() + 2*m_num_scatterers;
+    }
+    return zs ? zs->data() : nullptr;
 }
 
 float* DeviceFixedScatterers::get_as_ptr() const {
-    return as->data();
+    if (m_arena) {
+        return m_arena->is_interleaved() ? nullptr : m_arena->get_as_ptr() + m_arena_offset;
+    }
+    if (m_mapped) {
+        return (m_compact || m_interleaved) ? nullptr : m_mapped->data() + 3*m_num_scatterers;
+    }
+    return as ? as->data() : nullptr;
+}
+
+bool DeviceFixedScatterers::is_compact() const {
+    return static_cast<bool>(m_codes) || (m_mapped && m_compact);
+}
+
+const DeviceScattererArena::s_ptr& DeviceFixedScatterers::get_arena() const {
+    return m_arena;
+}
+
+size_t DeviceFixedScatterers::get_arena_offset() const {
+    return m_arena_offset;
+}
+
+float4* DeviceFixedScatterers::get_points_ptr() const {
+    if (m_arena) {
+        return m_arena->is_interleaved() ? m_arena->get_points_ptr() + m_arena_offset : nullptr;
+    }
+    if (m_mapped) {
+        return m_interleaved ? reinterpret_cast<float4*>(m_mapped->data()) : nullptr;
+    }
+    return m_points ? m_points->data() : nullptr;
+}
+
+uint16_t* DeviceFixedScatterers::get_codes_ptr() const {
+    if (m_mapped) {
+        return m_compact ? reinterpret_cast<uint16_t*>(m_mapped->data()) : nullptr;
+    }
+    return m_codes ? m_codes->data() : nullptr;
+}
+
+const CompactScattererEncoding& DeviceFixedScatterers::get_encoding() const {
+    return m_encoding;
+}
+
+void DeviceFixedScatterers::set_encoding(const CompactScattererEncoding& encoding) {
+    m_encoding = encoding;
+}
+
+bool DeviceFixedScatterers::is_mapped() const {
+    return static_cast<bool>(m_mapped);
+}
+
+void* DeviceFixedScatterers::get_host_ptr(const void* device_ptr) const {
+    if (!m_mapped) {
+        return nullptr;
+    }
+    const auto offset = static_cast<const char*>(device_ptr) - reinterpret_cast<const char*>(m_mapped->data());
+    return reinterpret_cast<char*>(m_mapped->host_data()) + offset;
+}
+
+size_t DeviceFixedScatterers::get_num_device_bytes() const {
+    return m_num_scatterers*(is_compact() ? 4*sizeof(uint16_t) : 4*sizeof(float));
+}
+
+const ScattererGrid& DeviceFixedScatterers::get_grid() const {
+    return m_grid;
+}
+
+const std::vector<uint32_t>& DeviceFixedScatterers::get_sorted_index() const {
+    return m_sorted_index;
+}
+
+void DeviceFixedScatterers::set_grid(const ScattererGrid& grid, const std::vector<uint32_t>& sorted_index) {
+    m_grid = grid;
+    m_sorted_index = sorted_index;
 }
 
 // create a new dataset and fill it with data (will allocate memory on device)
-void DeviceFixedScatterersCollection::add(bcsim::FixedScatterers::s_ptr host_scatterers) {
-    auto new_device_scatterers = std::make_shared<DeviceFixedScatterers>(host_scatterers->num_scatterers());
-    transfer_to_device(host_scatterers, new_device_scatterers);
+void DeviceFixedScatterersCollection::add(bcsim::FixedScatterers::s_ptr host_scatterers, ScattererGrid::CellOrder order,
+                                          bool compact, bool interleaved) {
+    auto new_device_scatterers = create_dataset(host_scatterers->num_scatterers(), compact, interleaved);
+    transfer_to_device(host_scatterers, new_device_scatterers, order);
     m_fixed_datasets.push_back(new_device_scatterers);
 }
 
-void DeviceFixedScatterersCollection::render(const DeviceSplineScatterersCollection& spline_datasets, float timestamp) {
+void DeviceFixedScatterersCollection::add(const HostFixedScatterers& sorted_scatterers, bool compact, bool interleaved) {
+    auto new_device_scatterers = create_dataset(sorted_scatterers.get_num_scatterers(), compact, interleaved);
+    new_device_scatterers->set_grid(sorted_scatterers.grid, sorted_scatterers.sorted_index);
+    upload(sorted_scatterers, *new_device_scatterers);
+    m_fixed_datasets.push_back(new_device_scatterers);
+}
+
+DeviceFixedScatterers::s_ptr DeviceFixedScatterersCollection::create_dataset(size_t num_scatterers, bool compact, bool interleaved) {
+    if (m_mapped) {
+        return std::make_shared<DeviceFixedScatterers>(num_scatterers, compact, interleaved, true);
+    }
+    if (compact || (num_scatterers == 0) || (num_scatterers > m_packing_max_scatterers)
+        || (m_arena && (m_arena->is_interleaved() != interleaved))) {
+        return std::make_shared<DeviceFixedScatterers>(num_scatterers, compact, interleaved);
+    }
+    if (!m_arena) {
+        m_arena = std::make_shared<DeviceScattererArena>(interleaved);
+    }
+    return std::make_shared<DeviceFixedScatterers>(m_arena, num_scatterers);
+}
+
+void DeviceFixedScatterersCollection::set_packing_max_scatterers(size_t max_scatterers) {
+    m_packing_max_scatterers = max_scatterers;
+}
+
+size_t DeviceFixedScatterersCollection::get_packing_max_scatterers() const {
+    return m_packing_max_scatterers;
+}
+
+void DeviceFixedScatterersCollection::set_mapped(bool mapped) {
+    m_mapped = mapped;
+}
+
+bool DeviceFixedScatterersCollection::is_mapped() const {
+    return m_mapped;
+}
+
+std::vector<DeviceFixedScatterers::s_ptr> DeviceFixedScatterersCollection::get_launch_datasets(
+    std::function<bool(const DeviceFixedScatterers&)> keep_separate) const
+{
+    // the packed datasets are in the arena in the order they were added
+    std::vector<DeviceFixedScatterers::s_ptr> res;
+    size_t run_begin = 0;
+    size_t run_end = 0;
+    size_t run_length = 0;
+    DeviceFixedScatterers::s_ptr run_first;
+    const auto end_run = [&]() {
+        if (run_length == 1) {
+            res.push_back(run_first);
+        } else if (run_length > 1) {
+            res.push_back(std::make_shared<DeviceFixedScatterers>(m_arena, run_begin, run_end - run_begin));
+        }
+        run_length = 0;
+    };
+    for (const auto& dataset : m_fixed_datasets) {
+        if (!dataset->get_arena() || (keep_separate && keep_separate(*dataset))) {
+            end_run();
+            res.push_back(dataset);
+            continue;
+        }
+        if ((run_length > 0) && (dataset->get_arena_offset() != run_end)) {
+            end_run();
+        }
+        if (run_length == 0) {
+            run_first = dataset;
+            run_begin = dataset->get_arena_offset();
+            run_end = run_begin;
+        }
+        run_end += dataset->get_num_scatterers();
+        run_length++;
+    }
+    end_run();
+    return res;
+}
+
+void DeviceFixedScatterersCollection::render(const DeviceSplineScatterersCollection& spline_datasets, float timestamp, cudaStream_t stream) {
     const auto current_num_datasets = get_num_datasets();
     const auto needed_num_datasets  = spline_datasets.get_num_datasets();
 
@@ -55,136 +426,248 @@ void DeviceFixedScatterersCollection::render(const DeviceSplineScatterersCollect
         spline_counts[dset_idx] = spline_datasets.get_dataset(dset_idx)->get_num_scatterers();
     }
 
-    bool must_check_capacity = true;
-    if (current_num_datasets != needed_num_datasets) {
+    // all datasets are recreated if one changes, which keeps the packed ones
+    // consecutive in the arena
+    bool must_recreate = (current_num_datasets != needed_num_datasets);
+    if (must_recreate) {
         m_log_callback("number of datasets doesn not match, recreating");
+    }
+    for (size_t dset_idx = 0; !must_recreate && (dset_idx < current_num_datasets); dset_idx++) {
+        if (m_fixed_datasets[dset_idx]->get_num_scatterers() != spline_counts[dset_idx]) {
+            m_log_callback("Need different number of splines. Reallocating...");
+            must_recreate = true;
+        }
+    }
+    if (must_recreate) {
         clear();
         for (size_t dset_idx = 0; dset_idx < needed_num_datasets; dset_idx++) {
             m_log_callback("Making empty fixed dataset with capacity of " + std::to_string(spline_counts[dset_idx]) + " scatterers");
-            m_fixed_datasets.push_back(std::make_shared<DeviceFixedScatterers>(spline_counts[dset_idx]));
-        }
-        must_check_capacity = false;
-    }
-
-    if (must_check_capacity) {
-        // reallocate if size doesn't match
-        for (size_t dset_idx = 0; dset_idx < current_num_datasets; dset_idx++) {
-            const auto num_splines = spline_counts[dset_idx];
-            const auto cur_num_scatterers = m_fixed_datasets[dset_idx]->get_num_scatterers();
-            if (cur_num_scatterers != num_splines) {
-                m_log_callback("Need different number of splines. Reallocating...");
-                m_fixed_datasets[dset_idx] = std::make_shared<DeviceFixedScatterers>(num_splines);
-            }
+            m_fixed_datasets.push_back(create_dataset(spline_counts[dset_idx], false, false));
         }
     }
 
     // at this point everything is ready for updating scatterers
     for (size_t dset_idx = 0; dset_idx < spline_datasets.get_num_datasets(); dset_idx++) {
-        cudaStream_t stream_no = 0; // TODO: use streams to overlap transfers
-
         const auto spline_dataset = spline_datasets.get_dataset(dset_idx);
         const auto cur_knots = spline_dataset->get_knots();
         const auto num_cs    = spline_dataset->get_num_cs();
         const auto spline_degree = spline_dataset->get_spline_degree();
 
-        // evaluate the basis functions and upload to constant memory.
-        const auto num_nonzero = spline_degree+1;
-        std::vector<float> host_basis_functions(num_cs);
-        for (int i = 0; i < num_cs; i++) {
-            host_basis_functions[i] = bspline_storve::bsplineBasis(i, spline_degree, timestamp, cur_knots);
-        }
-
         // compute sum limits (inclusive)
         int cs_idx_start, cs_idx_end;
         std::tie(cs_idx_start, cs_idx_end) = bspline_storve::get_lower_upper_inds(cur_knots, timestamp, spline_degree);
 
+        const auto num_nonzero = spline_degree+1;
         if (cs_idx_end-cs_idx_start+1 != num_nonzero) {
             throw std::logic_error("illegal number of non-zero basis functions");
         }
-
-        if(!splineAlg1_updateConstantMemory(host_basis_functions.data() + cs_idx_start, num_nonzero*sizeof(float))) {
-            throw std::runtime_error("Failed to upload basis functions to constant memory");
+        if ((cs_idx_start < 0) || (cs_idx_end >= num_cs)) {
+            throw std::runtime_error("b-spline basis bounds failed sanity check");
         }
+
+        // evaluate the non-zero basis functions, which are passed to the kernel.
+        RenderSplineBasis basis;
+        bspline_storve::nonzero_basis_functions(cs_idx_end, spline_degree, timestamp, cur_knots, basis.values);
         const auto num_splines = spline_dataset->get_num_scatterers();
         int num_threads = 128; // per block
         int num_blocks = round_up_div(num_splines, 128);
-        stream_no = 0;
-        launch_RenderSplineKernel(num_blocks, num_threads, stream_no,
+        launch_RenderSplineKernel(num_blocks, num_threads, stream,
+                                  spline_dataset->get_control_points_ptr(),
                                   spline_dataset->get_xs_ptr(),
                                   spline_dataset->get_ys_ptr(),
                                   spline_dataset->get_zs_ptr(),
                                   m_fixed_datasets[dset_idx]->get_xs_ptr(),
                                   m_fixed_datasets[dset_idx]->get_ys_ptr(),
                                   m_fixed_datasets[dset_idx]->get_zs_ptr(),
+                                  basis,
                                   cs_idx_start, cs_idx_end, num_splines);
         // copy amplitudes [TODO: these can be reused]
-        cudaErrorCheck(cudaMemcpy(m_fixed_datasets[dset_idx]->get_as_ptr(), spline_dataset->get_as_ptr(), num_splines*sizeof(float), cudaMemcpyDeviceToDevice));
+        cudaErrorCheck(cudaMemcpyAsync(m_fixed_datasets[dset_idx]->get_as_ptr(), spline_dataset->get_as_ptr(), num_splines*sizeof(float), cudaMemcpyDeviceToDevice, stream));
     }
 }
 
 void DeviceFixedScatterersCollection::transfer_to_device(bcsim::FixedScatterers::s_ptr host_scatterers,
-                                                         DeviceFixedScatterers::s_ptr device_scatterers) {
-    const auto num_scatterers = host_scatterers->num_scatterers();
-
-    // reorganize and transfer
-    size_t bytes_per_component = num_scatterers*sizeof(float);
-
-    // temporary host memory for scatterer points
-    HostPinnedBufferRAII<float> host_temp(bytes_per_component);
+                                                         DeviceFixedScatterers::s_ptr device_scatterers,
+                                                         ScattererGrid::CellOrder order) {
+    // reorganize into a structure of arrays sorted for culling, and transfer
+    const HostFixedScatterers host_temp(*host_scatterers, order);
+    device_scatterers->set_grid(host_temp.grid, host_temp.sorted_index);
+    upload(host_temp, *device_scatterers);
+}
 
-    // transfer x values
-    for (size_t i = 0; i < num_scatterers; i++) {
-        host_temp.data()[i] = host_scatterers->scatterers[i].pos.x;
-    }
-    cudaErrorCheck( cudaMemcpy(device_scatterers->get_xs_ptr(), host_temp.data(),
-                                bytes_per_component, cudaMemcpyHostToDevice) );
+void DeviceFixedScatterersCollection::set_upload_chunk_bytes(size_t chunk_bytes) {
+    m_upload_staging.set_chunk_bytes(chunk_bytes);
+}
 
-    // transfer y values
-    for (size_t i = 0; i < num_scatterers; i++) {
-        host_temp.data()[i] = host_scatterers->scatterers[i].pos.y;
+void DeviceFixedScatterersCollection::upload(const HostFixedScatterers& host_temp, DeviceFixedScatterers& device_scatterers) {
+    if (device_scatterers.is_compact()) {
+        upload_compact(host_temp, device_scatterers);
+        return;
     }
-    cudaErrorCheck( cudaMemcpy(device_scatterers->get_ys_ptr(), host_temp.data(),
-                                bytes_per_component, cudaMemcpyHostToDevice) );
-
-    // z values
-    for (size_t i = 0; i < num_scatterers; i++) {
-        host_temp.data()[i] = host_scatterers->scatterers[i].pos.z;
+    if (device_scatterers.get_points_ptr()) {
+        const auto num_scatterers = host_temp.get_num_scatterers();
+        std::vector<float4> points(num_scatterers);
+        for (size_t i = 0; i < num_scatterers; i++) {
+            points[i] = make_float4(host_temp.xs[i], host_temp.ys[i], host_temp.zs[i], host_temp.as[i]);
+        }
+        copy_to_dataset(device_scatterers, device_scatterers.get_points_ptr(), points.data(), num_scatterers*sizeof(float4));
+        m_upload_staging.synchronize();
+        return;
     }
-    cudaErrorCheck( cudaMemcpy(device_scatterers->get_zs_ptr(), host_temp.data(),
-                                bytes_per_component, cudaMemcpyHostToDevice) );
-
-    // a values
-    for (size_t i = 0; i < num_scatterers; i++) {
-        host_temp.data()[i] = host_scatterers->scatterers[i].amplitude;
+    const size_t bytes_per_component = host_temp.get_num_scatterers()*sizeof(float);
+    copy_to_dataset(device_scatterers, device_scatterers.get_xs_ptr(), host_temp.xs.data(), bytes_per_component);
+    copy_to_dataset(device_scatterers, device_scatterers.get_ys_ptr(), host_temp.ys.data(), bytes_per_component);
+    copy_to_dataset(device_scatterers, device_scatterers.get_zs_ptr(), host_temp.zs.data(), bytes_per_component);
+    copy_to_dataset(device_scatterers, device_scatterers.get_as_ptr(), host_temp.as.data(), bytes_per_component);
+    m_upload_staging.synchronize();
+}
+
+void DeviceFixedScatterersCollection::copy_to_dataset(const DeviceFixedScatterers& device_scatterers, void* device_dst,
+                                                      const void* host_src, size_t num_bytes) {
+    if (!device_scatterers.is_mapped()) {
+        m_upload_staging.upload(device_dst, host_src, num_bytes);
+        return;
     }
-    cudaErrorCheck( cudaMemcpy(device_scatterers->get_as_ptr(), host_temp.data(),
-                                bytes_per_component, cudaMemcpyHostToDevice) );
+    // kernels may still be reading the previous contents
+    cudaErrorCheck( cudaDeviceSynchronize() );
+    std::memcpy(device_scatterers.get_host_ptr(device_dst), host_src, num_bytes);
 }
 
-void DeviceFixedScatterersCollection::update(bcsim::FixedScatterers::s_ptr host_scatterers, size_t dset_idx) {
+void DeviceFixedScatterersCollection::copy_from_dataset(const DeviceFixedScatterers& device_scatterers, void* host_dst,
+                                                        const void* device_src, size_t num_bytes) {
+    if (!device_scatterers.is_mapped()) {
+        cudaErrorCheck( cudaMemcpy(host_dst, device_src, num_bytes, cudaMemcpyDeviceToHost) );
+        return;
+    }
+    // kernels may still be writing scattered updates
+    cudaErrorCheck( cudaDeviceSynchronize() );
+    std::memcpy(host_dst, device_scatterers.get_host_ptr(device_src), num_bytes);
+}
+
+void DeviceFixedScatterersCollection::upload_compact(const HostFixedScatterers& host_temp, DeviceFixedScatterers& device_scatterers) {
+    const auto num_scatterers = host_temp.get_num_scatterers();
+    const auto encoding = make_compact_scatterer_encoding(host_temp.xs.data(), host_temp.ys.data(), host_temp.zs.data(),
+                                                          host_temp.as.data(), num_scatterers);
+    std::vector<uint16_t> codes(4*num_scatterers);
+    encode_compact_scatterers(encoding, host_temp.xs.data(), host_temp.ys.data(), host_temp.zs.data(), host_temp.as.data(),
+                              num_scatterers, codes.data());
+    copy_to_dataset(device_scatterers, device_scatterers.get_codes_ptr(), codes.data(), codes.size()*sizeof(uint16_t));
+    device_scatterers.set_encoding(encoding);
+
+    const auto error = compute_compact_scatterer_error(encoding, codes.data(), host_temp.xs.data(), host_temp.ys.data(),
+                                                       host_temp.zs.data(), host_temp.as.data(), num_scatterers);
+    m_compact_error.max_position_error = std::max(m_compact_error.max_position_error, error.max_position_error);
+    m_compact_error.max_amplitude_error = std::max(m_compact_error.max_amplitude_error, error.max_amplitude_error);
+    m_log_callback("Compact scatterers: max position error " + std::to_string(error.max_position_error)
+                   + " m, max amplitude error " + std::to_string(error.max_amplitude_error) + " of the largest amplitude");
+    m_upload_staging.synchronize();
+}
+
+void DeviceFixedScatterersCollection::update(size_t dset_idx, const std::vector<size_t>& indices,
+                                             const std::vector<PointScatterer>& new_scatterers, ScattererGrid::CellOrder order) {
     if (dset_idx >= m_fixed_datasets.size()) throw std::runtime_error("Illegal dataset index");
-    throw std::runtime_error("TODO");
-    /*
-    // check capacity of existsing
-    // no point in reallocating if we already have allocated memory and the number of bytes
-    // is the same.
-    bool reallocate_device_mem = true;
-    if (m_device_point_xs && m_device_point_ys && m_device_point_zs && m_device_point_as) {
-        if (   (m_device_point_xs->get_num_bytes() == points_common_bytes)
-            && (m_device_point_ys->get_num_bytes() == points_common_bytes)
-            && (m_device_point_zs->get_num_bytes() == points_common_bytes)
-            && (m_device_point_as->get_num_bytes() == points_common_bytes))
-        {
-            reallocate_device_mem = false;
+    if (indices.size() != new_scatterers.size()) {
+        throw std::runtime_error("number of indices and scatterers differ");
+    }
+    auto& dataset = *m_fixed_datasets[dset_idx];
+    const auto& sorted_index = dataset.get_sorted_index();
+    const auto& grid = dataset.get_grid();
+
+    // the values are grouped by component: xs, ys, zs, and amplitudes.
+    const auto num_updates = indices.size();
+    std::vector<int> device_indices(num_updates);
+    std::vector<float> values(4*num_updates);
+    bool grid_is_valid = true;
+    bool encoding_is_valid = true;
+    for (size_t i = 0; i < num_updates; i++) {
+        if (indices[i] >= dataset.get_num_scatterers()) {
+            throw std::runtime_error("scatterer index out of range");
+        }
+        const auto device_index = sorted_index.empty() ? indices[i] : sorted_index[indices[i]];
+        const auto& scatterer = new_scatterers[i];
+        device_indices[i] = static_cast<int>(device_index);
+        values[i]                 = scatterer.pos.x;
+        values[num_updates + i]   = scatterer.pos.y;
+        values[2*num_updates + i] = scatterer.pos.z;
+        values[3*num_updates + i] = scatterer.amplitude;
+        grid_is_valid = grid_is_valid && grid.is_in_cell_of(scatterer.pos, device_index);
+        encoding_is_valid = encoding_is_valid && (!dataset.is_compact()
+                            || compact_encoding_contains(dataset.get_encoding(), scatterer.pos.x, scatterer.pos.y, scatterer.pos.z));
+    }
+    if (dataset.get_points_ptr()) {
+        // the four components of a scatterer are consecutive floats
+        std::vector<int> point_indices(4*num_updates);
+        std::vector<float> point_values(4*num_updates);
+        for (size_t i = 0; i < num_updates; i++) {
+            for (size_t k = 0; k < 4; k++) {
+                point_indices[4*i + k] = 4*device_indices[i] + static_cast<int>(k);
+                point_values[4*i + k] = values[k*num_updates + i];
+            }
         }
-    */
-    // if does not match, reallocate
+        m_staging.scatter({reinterpret_cast<float*>(dataset.get_points_ptr())}, point_indices, point_values);
+    } else if (!dataset.is_compact()) {
+        m_staging.scatter({dataset.get_xs_ptr(), dataset.get_ys_ptr(), dataset.get_zs_ptr(), dataset.get_as_ptr()},
+                          device_indices, values);
+    } else if (grid_is_valid && encoding_is_valid) {
+        // the four codes of a scatterer are scattered as the bits of two floats
+        std::vector<uint16_t> codes(4*num_updates);
+        encode_compact_scatterers(dataset.get_encoding(), values.data(), values.data() + num_updates, values.data() + 2*num_updates,
+                                  values.data() + 3*num_updates, num_updates, codes.data());
+        std::vector<int> code_indices(2*num_updates);
+        std::vector<float> code_values(2*num_updates);
+        for (size_t i = 0; i < num_updates; i++) {
+            code_indices[2*i]     = 2*device_indices[i];
+            code_indices[2*i + 1] = 2*device_indices[i] + 1;
+        }
+        std::memcpy(code_values.data(), codes.data(), codes.size()*sizeof(uint16_t));
+        m_staging.scatter({reinterpret_cast<float*>(dataset.get_codes_ptr())}, code_indices, code_values);
+    }
 
-    // transfer from host to device.
+    if (!grid_is_valid || !encoding_is_valid) {
+        m_log_callback(grid_is_valid ? "Scatterers moved out of the bounding box of the compact dataset, encoding it again"
+                                     : "Scatterers moved out of their grid cells, sorting dataset again");
+        const auto num_scatterers = dataset.get_num_scatterers();
+        HostFixedScatterers host_temp;
+        host_temp.resize(num_scatterers);
+        const size_t bytes_per_component = num_scatterers*sizeof(float);
+        if (dataset.is_compact()) {
+            // the others are encoded again from their decoded values
+            std::vector<uint16_t> codes(4*num_scatterers);
+            copy_from_dataset(dataset, codes.data(), dataset.get_codes_ptr(), codes.size()*sizeof(uint16_t));
+            decode_compact_scatterers(dataset.get_encoding(), codes.data(), num_scatterers,
+                                      host_temp.xs.data(), host_temp.ys.data(), host_temp.zs.data(), host_temp.as.data());
+            for (size_t i = 0; i < num_updates; i++) {
+                host_temp.xs[device_indices[i]] = values[i];
+                host_temp.ys[device_indices[i]] = values[num_updates + i];
+                host_temp.zs[device_indices[i]] = values[2*num_updates + i];
+                host_temp.as[device_indices[i]] = values[3*num_updates + i];
+            }
+        } else if (dataset.get_points_ptr()) {
+            std::vector<float4> points(num_scatterers);
+            copy_from_dataset(dataset, points.data(), dataset.get_points_ptr(), num_scatterers*sizeof(float4));
+            for (size_t i = 0; i < num_scatterers; i++) {
+                host_temp.xs[i] = points[i].x;
+                host_temp.ys[i] = points[i].y;
+                host_temp.zs[i] = points[i].z;
+                host_temp.as[i] = points[i].w;
+            }
+        } else {
+            copy_from_dataset(dataset, host_temp.xs.data(), dataset.get_xs_ptr(), bytes_per_component);
+            copy_from_dataset(dataset, host_temp.ys.data(), dataset.get_ys_ptr(), bytes_per_component);
+            copy_from_dataset(dataset, host_temp.zs.data(), dataset.get_zs_ptr(), bytes_per_component);
+            copy_from_dataset(dataset, host_temp.as.data(), dataset.get_as_ptr(), bytes_per_component);
+        }
+        host_temp.sorted_index = sorted_index;
+        host_temp.sort_by_grid(order, 1);
+        dataset.set_grid(host_temp.grid, host_temp.sorted_index);
+        upload(host_temp, dataset);
+    }
 }
 
 void DeviceFixedScatterersCollection::clear() {
     m_fixed_datasets.clear();
+    m_arena.reset();
+    m_compact_error = {0.0f, 0.0f};
 }
 
 size_t DeviceFixedScatterersCollection::get_total_num_scatterers() const {
@@ -195,6 +678,38 @@ size_t DeviceFixedScatterersCollection::get_total_num_scatterers() const {
     return sum;
 }
 
+size_t DeviceFixedScatterersCollection::get_num_device_bytes() const {
+    size_t sum = m_arena ? m_arena->get_num_device_bytes() : 0;
+    for (const auto& dataset : m_fixed_datasets) {
+        sum += (dataset->get_arena() || dataset->is_mapped()) ? 0 : dataset->get_num_device_bytes();
+    }
+    return sum;
+}
+
+CompactScattererError DeviceFixedScatterersCollection::get_compact_error() const {
+    return m_compact_error;
+}
+
+size_t DeviceFixedScatterersCollection::get_num_host_bytes() const {
+    size_t sum = 0;
+    for (const auto& dataset : m_fixed_datasets) {
+        sum += dataset->get_grid().get_num_bytes() + dataset->get_sorted_index().capacity()*sizeof(uint32_t);
+    }
+    return sum;
+}
+
+size_t DeviceFixedScatterersCollection::get_num_pinned_bytes() const {
+    return m_upload_staging.get_num_pinned_bytes();
+}
+
+size_t DeviceFixedScatterersCollection::get_num_mapped_bytes() const {
+    size_t sum = 0;
+    for (const auto& dataset : m_fixed_datasets) {
+        sum += dataset->is_mapped() ? dataset->get_num_device_bytes() : 0;
+    }
+    return sum;
+}
+
 size_t DeviceFixedScatterersCollection::get_num_datasets() const {
     return m_fixed_datasets.size();
 }
@@ -204,12 +719,85 @@ DeviceFixedScatterers::s_ptr DeviceFixedScatterersCollection::get_dataset(size_t
     return m_fixed_datasets[dset_idx];
 }
 
-DeviceSplineScatterers::DeviceSplineScatterers(bcsim::SplineScatterers::s_ptr host_scatterers, LogCallback log_callback_fn)
-    : m_log_callback_fn(log_callback_fn)
+HostChunkedFixedScatterers::HostChunkedFixedScatterers(const bcsim::FixedScatterers& host_scatterers, size_t chunk_size,
+                                                       ScattererGrid::CellOrder order)
+    : m_num_scatterers(host_scatterers.scatterers.size()),
+      m_chunk_size(chunk_size)
+{
+    if (chunk_size == 0) {
+        throw std::runtime_error("chunk size must be positive");
+    }
+    // sorted for the locality of the scatterers in a chunk
+    const HostFixedScatterers host_temp(host_scatterers, order);
+    m_sorted_index = host_temp.sorted_index;
+    const auto num_floats = std::max<size_t>(1, get_num_chunks()*4*m_chunk_size);
+    m_data = HostPinnedBufferRAII<float>::u_ptr(new HostPinnedBufferRAII<float>(num_floats*sizeof(float)));
+    for (size_t chunk_no = 0; chunk_no < get_num_chunks(); chunk_no++) {
+        auto chunk = m_data->data() + chunk_no*4*m_chunk_size;
+        const auto first = chunk_no*m_chunk_size;
+        const auto num_in_chunk = get_chunk_num_scatterers(chunk_no);
+        std::copy(host_temp.xs.begin() + first, host_temp.xs.begin() + first + num_in_chunk, chunk);
+        std::copy(host_temp.ys.begin() + first, host_temp.ys.begin() + first + num_in_chunk, chunk + m_chunk_size);
+        std::copy(host_temp.zs.begin() + first, host_temp.zs.begin() + first + num_in_chunk, chunk + 2*m_chunk_size);
+        std::copy(host_temp.as.begin() + first, host_temp.as.begin() + first + num_in_chunk, chunk + 3*m_chunk_size);
+    }
+}
+
+size_t HostChunkedFixedScatterers::get_num_scatterers() const {
+    return m_num_scatterers;
+}
+
+size_t HostChunkedFixedScatterers::get_chunk_size() const {
+    return m_chunk_size;
+}
+
+size_t HostChunkedFixedScatterers::get_num_chunks() const {
+    return (m_num_scatterers + m_chunk_size - 1)/m_chunk_size;
+}
+
+size_t HostChunkedFixedScatterers::get_num_pinned_bytes() const {
+    return m_data ? m_data->get_num_bytes() : 0;
+}
+
+size_t HostChunkedFixedScatterers::get_num_host_bytes() const {
+    return m_sorted_index.capacity()*sizeof(uint32_t);
+}
+
+size_t HostChunkedFixedScatterers::get_chunk_num_scatterers(size_t chunk_no) const {
+    return std::min(m_chunk_size, m_num_scatterers - chunk_no*m_chunk_size);
+}
+
+const float* HostChunkedFixedScatterers::get_chunk_ptr(size_t chunk_no) const {
+    return m_data->data() + chunk_no*4*m_chunk_size;
+}
+
+void HostChunkedFixedScatterers::update(const std::vector<size_t>& indices, const std::vector<PointScatterer>& new_scatterers) {
+    if (indices.size() != new_scatterers.size()) {
+        throw std::runtime_error("number of indices and scatterers differ");
+    }
+    // the chunks are not culled, so the scatterers can move anywhere
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= m_num_scatterers) {
+            throw std::runtime_error("scatterer index out of range");
+        }
+        const size_t sorted_index = m_sorted_index[indices[i]];
+        auto chunk = m_data->data() + (sorted_index/m_chunk_size)*4*m_chunk_size;
+        const auto offset = sorted_index % m_chunk_size;
+        chunk[offset]                  = new_scatterers[i].pos.x;
+        chunk[m_chunk_size + offset]   = new_scatterers[i].pos.y;
+        chunk[2*m_chunk_size + offset] = new_scatterers[i].pos.z;
+        chunk[3*m_chunk_size + offset] = new_scatterers[i].amplitude;
+    }
+}
+
+DeviceSplineScatterers::DeviceSplineScatterers(bcsim::SplineScatterers::s_ptr host_scatterers, DeviceUploadStaging& staging,
+                                               bool interleaved, LogCallback log_callback_fn)
+    : m_interleaved(interleaved),
+      m_log_callback_fn(log_callback_fn)
 {
     copy_information(host_scatterers);
     reallocate_device_memory();
-    transfer_to_device(host_scatterers);
+    transfer_to_device(host_scatterers, staging);
 }
 
 void DeviceSplineScatterers::copy_information(bcsim::SplineScatterers::s_ptr host_scatterers) {
@@ -233,55 +821,78 @@ void DeviceSplineScatterers::reallocate_device_memory() {
     m_log_callback_fn("Allocating memory on host for reorganizing spline data");
     const auto num_bytes_xyz = m_num_cs*m_num_scatterers*sizeof(float);
     const auto num_bytes_amp = m_num_scatterers*sizeof(float);
-    m_control_xs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
-    m_control_ys = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
-    m_control_zs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
+    if (m_interleaved) {
+        m_control_points = DeviceBufferRAII<float4>::u_ptr(new DeviceBufferRAII<float4>(m_num_cs*m_num_scatterers*sizeof(float4)));
+    } else {
+        m_control_xs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
+        m_control_ys = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
+        m_control_zs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_xyz));
+    }
     m_as         = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(num_bytes_amp));
 }
 
-void DeviceSplineScatterers::transfer_to_device(bcsim::SplineScatterers::s_ptr host_scatterers) {
-    // temporary host memory for restructuring to get correct device layout.
-    const auto total_num_cs = m_num_cs*m_num_scatterers;
-    const auto cs_num_bytes = total_num_cs*sizeof(float);
-
-    std::vector<float> host_control_xs(total_num_cs);
-    std::vector<float> host_control_ys(total_num_cs);
-    std::vector<float> host_control_zs(total_num_cs);
-        
-    // there is only one amplitude for each scatterer.
-    std::vector<float> host_control_as(m_num_scatterers); 
-
-    for (size_t spline_no = 0; spline_no < m_num_scatterers; spline_no++) {
-        host_control_as[spline_no] = host_scatterers->amplitudes[spline_no];
-        for (size_t i = 0; i < m_num_cs; i++) {
-            const size_t offset = spline_no + i*m_num_scatterers;
-            host_control_xs[offset] = host_scatterers->control_points[spline_no][i].x;
-            host_control_ys[offset] = host_scatterers->control_points[spline_no][i].y;
-            host_control_zs[offset] = host_scatterers->control_points[spline_no][i].z;
+void DeviceSplineScatterers::transfer_to_device(bcsim::SplineScatterers::s_ptr host_scatterers, DeviceUploadStaging& staging) {
+    // the host layout is the same as the device layout: control point major.
+    const auto cs_num_bytes = m_num_cs*m_num_scatterers*sizeof(float);
+    if (host_scatterers->control_xs.size()*sizeof(float) != cs_num_bytes) {
+        throw std::runtime_error("Spline control point storage does not match number of scatterers");
+    }
+
+    // copy control points and amplitudes to GPU memory.
+    if (m_interleaved) {
+        const auto num_control_points = host_scatterers->control_xs.size();
+        std::vector<float4> points(num_control_points);
+        for (size_t i = 0; i < num_control_points; i++) {
+            points[i] = make_float4(host_scatterers->control_xs[i], host_scatterers->control_ys[i], host_scatterers->control_zs[i], 0.0f);
         }
+        staging.upload(m_control_points->data(), points.data(), num_control_points*sizeof(float4));
+        // the staging buffers are filled from the local copy
+        staging.synchronize();
+    } else {
+        staging.upload(m_control_xs->data(), host_scatterers->control_xs.data(), cs_num_bytes);
+        staging.upload(m_control_ys->data(), host_scatterers->control_ys.data(), cs_num_bytes);
+        staging.upload(m_control_zs->data(), host_scatterers->control_zs.data(), cs_num_bytes);
     }
-    
-    // copy control points to GPU memory.
-    cudaErrorCheck( cudaMemcpy(m_control_xs->data(), host_control_xs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
-    cudaErrorCheck( cudaMemcpy(m_control_ys->data(), host_control_ys.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
-    cudaErrorCheck( cudaMemcpy(m_control_zs->data(), host_control_zs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
-    
-    // copy amplitudes to GPU memory.
-    const auto amplitudes_num_bytes = m_num_scatterers*sizeof(float);
-    cudaErrorCheck( cudaMemcpy(m_as->data(), host_control_as.data(), amplitudes_num_bytes, cudaMemcpyHostToDevice) );
-}
-
-void DeviceSplineScatterers::update(bcsim::SplineScatterers::s_ptr host_scatterers) {
-    throw std::runtime_error("TODO: implement");
-    // Something along these lines:
-    /*
-    copy_information(host_scatterers);
-    // after the constructor has run, the device buffers are always valid
-    if (already allocated memory != needed)  {
-        reallocate_device_memory();
+    staging.upload(m_as->data(), host_scatterers->amplitudes.data(), m_num_scatterers*sizeof(float));
+    staging.synchronize();
+}
+
+void DeviceSplineScatterers::update(const std::vector<size_t>& indices, const bcsim::SplineScatterers& new_scatterers,
+                                    DeviceScatterStaging& staging) {
+    check_spline_update(m_num_scatterers, static_cast<size_t>(m_num_cs), indices, new_scatterers);
+
+    // same control point major layout as on the host
+    const auto num_updates = indices.size();
+    std::vector<int> control_indices(m_num_cs*num_updates);
+    std::vector<float> control_values(3*m_num_cs*num_updates);
+    const auto num_control_values = control_indices.size();
+    for (int cs_no = 0; cs_no < m_num_cs; cs_no++) {
+        for (size_t i = 0; i < num_updates; i++) {
+            const auto k = cs_no*num_updates + i;
+            const auto pos = new_scatterers.get_control_point(i, cs_no);
+            control_indices[k] = static_cast<int>(cs_no*m_num_scatterers + indices[i]);
+            control_values[k]                        = pos.x;
+            control_values[num_control_values + k]   = pos.y;
+            control_values[2*num_control_values + k] = pos.z;
+        }
     }
-    transfer_to_device(host_scatterers);
-    */
+    if (m_interleaved) {
+        // the three coordinates of a control point are consecutive floats
+        std::vector<int> point_indices(3*num_control_values);
+        std::vector<float> point_values(3*num_control_values);
+        for (size_t k = 0; k < num_control_values; k++) {
+            for (size_t c = 0; c < 3; c++) {
+                point_indices[3*k + c] = 4*control_indices[k] + static_cast<int>(c);
+                point_values[3*k + c] = control_values[c*num_control_values + k];
+            }
+        }
+        staging.scatter({reinterpret_cast<float*>(m_control_points->data())}, point_indices, point_values);
+    } else {
+        staging.scatter({m_control_xs->data(), m_control_ys->data(), m_control_zs->data()}, control_indices, control_values);
+    }
+
+    std::vector<int> amplitude_indices(indices.begin(), indices.end());
+    staging.scatter({m_as->data()}, amplitude_indices, new_scatterers.amplitudes);
 }
 
 size_t DeviceSplineScatterers::get_num_scatterers() const {
@@ -289,21 +900,25 @@ size_t DeviceSplineScatterers::get_num_scatterers() const {
 }
 
 float* DeviceSplineScatterers::get_xs_ptr() const {
-    return m_control_xs->data();
+    return m_control_xs ? m_control_xs->data() : nullptr;
 }
 
 float* DeviceSplineScatterers::get_ys_ptr() const {
-    return m_control_ys->data();
+    return m_control_ys ? m_control_ys->data() : nullptr;
 }
 
 float* DeviceSplineScatterers::get_zs_ptr() const {
-    return m_control_zs->data();
+    return m_control_zs ? m_control_zs->data() : nullptr;
 }
 
 float* DeviceSplineScatterers::get_as_ptr() const {
     return m_as->data();
 }
 
+float4* DeviceSplineScatterers::get_control_points_ptr() const {
+    return m_control_points ? m_control_points->data() : nullptr;
+}
+
 std::vector<float> DeviceSplineScatterers::get_knots() const {
     return m_knots;
 }
@@ -318,15 +933,24 @@ int DeviceSplineScatterers::get_spline_degree() const {
 
 
 void DeviceSplineScatterersCollection::add(bcsim::SplineScatterers::s_ptr host_scatterers) {
-    auto new_device_scatterers = std::make_shared<DeviceSplineScatterers>(host_scatterers);
+    auto new_device_scatterers = std::make_shared<DeviceSplineScatterers>(host_scatterers, m_upload_staging, m_interleaved);
     m_spline_datasets.push_back(new_device_scatterers);
 }
 
-void DeviceSplineScatterersCollection::update(bcsim::SplineScatterers::s_ptr host_scatterers, size_t dset_idx) {
+void DeviceSplineScatterersCollection::set_interleaved(bool interleaved) {
+    m_interleaved = interleaved;
+}
+
+bool DeviceSplineScatterersCollection::is_interleaved() const {
+    return m_interleaved;
+}
+
+void DeviceSplineScatterersCollection::update(size_t dset_idx, const std::vector<size_t>& indices,
+                                              const bcsim::SplineScatterers& new_scatterers) {
     if (dset_idx >= m_spline_datasets.size()) {
         throw std::runtime_error("Illegal dataset index");        
     }
-    m_spline_datasets[dset_idx]->update(host_scatterers);        
+    m_spline_datasets[dset_idx]->update(indices, new_scatterers, m_staging);
 }
 
 void DeviceSplineScatterersCollection::clear() {
@@ -341,6 +965,23 @@ size_t DeviceSplineScatterersCollection::get_total_num_scatterers() const {
     return sum;
 }
 
+size_t DeviceSplineScatterersCollection::get_num_device_bytes() const {
+    size_t sum = 0;
+    for (const auto& dataset : m_spline_datasets) {
+        const auto floats_per_control_point = dataset->get_control_points_ptr() ? 4 : 3;
+        sum += dataset->get_num_scatterers()*(floats_per_control_point*dataset->get_num_cs() + 1)*sizeof(float);
+    }
+    return sum;
+}
+
+size_t DeviceSplineScatterersCollection::get_num_pinned_bytes() const {
+    return m_upload_staging.get_num_pinned_bytes();
+}
+
+void DeviceSplineScatterersCollection::set_upload_chunk_bytes(size_t chunk_bytes) {
+    m_upload_staging.set_chunk_bytes(chunk_bytes);
+}
+
 size_t DeviceSplineScatterersCollection::get_num_datasets() const {
     return m_spline_datasets.size();
 }
@@ -3,22 +3,131 @@
 #include <vector>
 #include "../LibBCSim.hpp"
 #include "cuda_helpers.h"
+#include "ScattererGrid.hpp"
+#include "CompactScatterers.hpp"
 
 namespace bcsim {
 
 // forward-decl.
 class DeviceSplineScatterersCollection;
 
+// Scattered writes of a few values into device arrays, staged through
+// pinned host memory which is kept between updates.
+class DeviceScatterStaging {
+public:
+    // Write values[k*indices.size() + i] to element indices[i] of device
+    // array k, asynchronously on a stream. Waits for the copies to finish
+    // before returning, since the staging memory is reused.
+    void scatter(const std::vector<float*>& device_arrays, const std::vector<int>& indices,
+                 const std::vector<float>& values, cudaStream_t stream = 0);
+
+private:
+    HostPinnedBufferRAII<int>::u_ptr    m_host_indices;
+    HostPinnedBufferRAII<float>::u_ptr  m_host_values;
+    DeviceBufferRAII<int>::u_ptr        m_device_indices;
+    DeviceBufferRAII<float>::u_ptr      m_device_values;
+};
+
+// Uploads of whole arrays from pageable host memory, staged through two
+// pinned chunk buffers which are kept between uploads. A chunk is copied into
+// one buffer and uploaded asynchronously on a dedicated copy stream while the
+// next chunk is copied into the other.
+class DeviceUploadStaging {
+public:
+    // The chunk size is in bytes, zero stages each array as one chunk.
+    explicit DeviceUploadStaging(size_t chunk_bytes = 4*1024*1024);
+
+    void set_chunk_bytes(size_t chunk_bytes);
+
+    size_t get_chunk_bytes() const;
+
+    // Start copying num_bytes from host_src to device_dst. The host memory
+    // may be modified or freed when this returns, but the device memory
+    // must not be used before synchronize(). The copies are ordered after
+    // all work issued before on the legacy default stream, as cudaMemcpy().
+    void upload(void* device_dst, const void* host_src, size_t num_bytes);
+
+    // Wait for all started uploads to finish.
+    void synchronize();
+
+    size_t get_num_pinned_bytes() const;
+
+private:
+    // The next pinned buffer, allocated for at least num_bytes, after its
+    // previous upload has finished.
+    char* next_buffer(size_t num_bytes);
+
+    size_t                              m_chunk_bytes;
+    CudaStreamRAII::u_ptr               m_stream;
+    CudaEventRAII::u_ptr                m_default_stream_event;
+    HostPinnedBufferRAII<char>::u_ptr   m_buffers[2];
+    CudaEventRAII::u_ptr                m_buffer_events[2];
+    bool                                m_buffer_in_use[2];
+    size_t                              m_next_buffer;
+};
+
+// Four float arrays (x, y, z and amplitude) shared by small fixed-scatterer
+// datasets, which are placed back to back so that one kernel launch can
+// project all of them. The arrays grow geometrically and are moved when
+// they do, so pointers into them must be fetched again after allocate().
+// If interleaved, there is one float4 array of (x, y, z, amplitude) instead.
+class DeviceScattererArena {
+public:
+    typedef std::shared_ptr<DeviceScattererArena> s_ptr;
+
+    explicit DeviceScattererArena(bool interleaved = false);
+
+    // Offset of num_scatterers new scatterers after the existing ones.
+    size_t allocate(size_t num_scatterers);
+
+    size_t get_num_scatterers() const;
+
+    float* get_xs_ptr() const;
+
+    float* get_ys_ptr() const;
+
+    float* get_zs_ptr() const;
+
+    float* get_as_ptr() const;
+
+    bool is_interleaved() const;
+
+    // Null if not interleaved.
+    float4* get_points_ptr() const;
+
+    size_t get_num_device_bytes() const;
+
+private:
+    DeviceBufferRAII<float>::u_ptr  m_data;
+    bool                            m_interleaved;
+    size_t                          m_capacity;
+    size_t                          m_num_scatterers;
+};
+
 // Device memory for a fixed-scatterer dataset.
 class DeviceFixedScatterers {
 public:
     typedef std::shared_ptr<DeviceFixedScatterers> s_ptr;
 
-    // Allocate space for a new dataset with num_scatterers scatterers.
-    explicit DeviceFixedScatterers(size_t num_scatterers);
+    // Allocate space for a new dataset with num_scatterers scatterers, as
+    // four float arrays or, if compact, as one array of four 16-bit codes
+    // per scatterer (see CompactScatterers.hpp). If interleaved and not
+    // compact, as one float4 array of (x, y, z, amplitude). If mapped, the
+    // arrays are in pinned host memory mapped into the device address space,
+    // which the kernels read directly instead of a device copy.
+    explicit DeviceFixedScatterers(size_t num_scatterers, bool compact = false, bool interleaved = false,
+                                   bool mapped = false);
+
+    // Allocate space for a new dataset at the end of the arena.
+    DeviceFixedScatterers(DeviceScattererArena::s_ptr arena, size_t num_scatterers);
+
+    // A dataset of the scatterers [offset, offset + num_scatterers) which
+    // are already in the arena, to project several datasets at once.
+    DeviceFixedScatterers(DeviceScattererArena::s_ptr arena, size_t offset, size_t num_scatterers);
     
     size_t get_num_scatterers() const;
 
+    // Null if compact or interleaved.
     float* get_xs_ptr() const;
 
     float* get_ys_ptr() const;
@@ -27,15 +136,65 @@ public:
 
     float* get_as_ptr() const;
 
+    bool is_compact() const;
+
+    // Null if not interleaved.
+    float4* get_points_ptr() const;
+
+    // Null if the dataset has arrays of its own.
+    const DeviceScattererArena::s_ptr& get_arena() const;
+
+    size_t get_arena_offset() const;
+
+    // Null if not compact.
+    uint16_t* get_codes_ptr() const;
+
+    const CompactScattererEncoding& get_encoding() const;
+
+    void set_encoding(const CompactScattererEncoding& encoding);
+
+    bool is_mapped() const;
+
+    // The host address of a pointer into the mapped arrays, or null if the
+    // dataset is not mapped.
+    void* get_host_ptr(const void* device_ptr) const;
+
+    // Bytes of the arrays, in device memory or mapped host memory.
+    size_t get_num_device_bytes() const;
+
+    // Grid for culling, in host memory. The device data is sorted by its
+    // cells. Empty if the dataset was not uploaded from a FixedScatterers
+    // dataset.
+    const ScattererGrid& get_grid() const;
+
+    // Position in the device arrays of each scatterer of the dataset it was
+    // uploaded from (empty if the grid is empty).
+    const std::vector<uint32_t>& get_sorted_index() const;
+
+    void set_grid(const ScattererGrid& grid, const std::vector<uint32_t>& sorted_index);
+
 private:
+    ScattererGrid                  m_grid;
+    std::vector<uint32_t>          m_sorted_index;
     DeviceBufferRAII<float>::u_ptr xs;
     DeviceBufferRAII<float>::u_ptr ys;
     DeviceBufferRAII<float>::u_ptr zs;
     DeviceBufferRAII<float>::u_ptr as;
+    DeviceBufferRAII<uint16_t>::u_ptr m_codes;
+    DeviceBufferRAII<float4>::u_ptr m_points;
+    HostMappedBufferRAII<float>::u_ptr m_mapped;
+    // the layout of the mapped buffer
+    bool                           m_compact;
+    bool                           m_interleaved;
+    CompactScattererEncoding       m_encoding;
+    DeviceScattererArena::s_ptr    m_arena;
+    size_t                         m_arena_offset;
 
     size_t m_num_scatterers;
 };
 
+class HostFixedScatterers;
+
 // Device memory for multiple fixed-scatterer datasets
 class DeviceFixedScatterersCollection {
 public:
@@ -43,20 +202,56 @@ public:
 
     DeviceFixedScatterersCollection(LogCallback log_callback = [](const std::string&) {}) {
         m_log_callback = log_callback;
+        m_compact_error = {0.0f, 0.0f};
+        m_packing_max_scatterers = 65536;
+        m_mapped = false;
     }
 
-    // create a new dataset and fill it with data (will allocate memory on device)
-    void add(bcsim::FixedScatterers::s_ptr host_scatterers);
+    // create a new dataset and fill it with data (will allocate memory on device),
+    // with the scatterers sorted by the cells of the culling grid in the given order.
+    // A compact dataset is encoded in the bounding box of its scatterers. Other
+    // datasets of at most get_packing_max_scatterers() scatterers are packed
+    // into one arena, as long as they have the layout of the arena.
+    void add(bcsim::FixedScatterers::s_ptr host_scatterers, ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH,
+             bool compact = false, bool interleaved = false);
+
+    // Same for a dataset which is already sorted, e.g. restored from a state file.
+    void add(const HostFixedScatterers& sorted_scatterers, bool compact = false, bool interleaved = false);
 
     // reset and make fixed scatterer datasets from evaluating all spline datasets
-    void render(const DeviceSplineScatterersCollection& spline_datasets, float timestamp);
+    void render(const DeviceSplineScatterersCollection& spline_datasets, float timestamp, cudaStream_t stream = 0);
 
     void transfer_to_device(bcsim::FixedScatterers::s_ptr host_scatterers,
-                            DeviceFixedScatterers::s_ptr device_scatterers);
+                            DeviceFixedScatterers::s_ptr device_scatterers,
+                            ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH);
+
+    // Chunk size in bytes of the pinned staging of uploads.
+    void set_upload_chunk_bytes(size_t chunk_bytes);
 
-    // update an existing dataset (will only reallocate memory if the new size is
-    // different from the previous)
-    void update(bcsim::FixedScatterers::s_ptr host_scatterers, size_t dset_idx);
+    // Largest dataset packed into the arena when it is added, 0 packs none.
+    void set_packing_max_scatterers(size_t max_scatterers);
+
+    size_t get_packing_max_scatterers() const;
+
+    // Whether datasets added afterwards are mapped host memory, which the
+    // kernels read without a device copy. They are never packed.
+    void set_mapped(bool mapped);
+
+    bool is_mapped() const;
+
+    // The datasets as few datasets for launches: consecutive packed datasets
+    // are merged into a view of their part of the arena, unless
+    // keep_separate returns true for one of them.
+    std::vector<DeviceFixedScatterers::s_ptr> get_launch_datasets(
+        std::function<bool(const DeviceFixedScatterers&)> keep_separate = nullptr) const;
+
+    // Replace the scatterers with the given indices in the dataset as it was
+    // added. If scatterers are moved out of their grid cells, the dataset is
+    // sorted again in the given order, which requires a full download and upload.
+    // This is also the case if they are moved out of the bounding box of a
+    // compact dataset, which is then encoded again from the decoded scatterers.
+    void update(size_t dset_idx, const std::vector<size_t>& indices, const std::vector<PointScatterer>& new_scatterers,
+                ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH);
 
     void clear();
 
@@ -66,9 +261,84 @@ public:
 
     DeviceFixedScatterers::s_ptr get_dataset(size_t dset_idx) const;
 
+    // Bytes of the scatterer arrays on the device, and of the culling grids
+    // and sorted indices on the host.
+    size_t get_num_device_bytes() const;
+
+    size_t get_num_host_bytes() const;
+
+    size_t get_num_pinned_bytes() const;
+
+    // Bytes of the arrays of the mapped datasets, in pinned host memory.
+    size_t get_num_mapped_bytes() const;
+
+    // Largest errors of the compact datasets encoded since the last clear().
+    CompactScattererError get_compact_error() const;
+
 private:
+    // Encode the sorted scatterers in the bounding box and upload them.
+    void upload_compact(const HostFixedScatterers& host_temp, DeviceFixedScatterers& device_scatterers);
+
+    // Upload the sorted scatterers, encoded if the dataset is compact.
+    void upload(const HostFixedScatterers& host_temp, DeviceFixedScatterers& device_scatterers);
+
+    // Copy into the arrays of a dataset: staged if they are on the device,
+    // or written in place, after the device has finished with them, if they
+    // are mapped. Uploads are complete after m_upload_staging.synchronize().
+    void copy_to_dataset(const DeviceFixedScatterers& device_scatterers, void* device_dst, const void* host_src, size_t num_bytes);
+
+    void copy_from_dataset(const DeviceFixedScatterers& device_scatterers, void* host_dst, const void* device_src, size_t num_bytes);
+
+    // A new dataset, in the arena if it is small enough, not compact and
+    // laid out as the arena.
+    DeviceFixedScatterers::s_ptr create_dataset(size_t num_scatterers, bool compact, bool interleaved);
+
     std::vector<DeviceFixedScatterers::s_ptr>   m_fixed_datasets;
+    DeviceScattererArena::s_ptr                 m_arena;
+    size_t                                      m_packing_max_scatterers;
+    bool                                        m_mapped;
     LogCallback                                 m_log_callback;
+    DeviceScatterStaging                        m_staging;
+    DeviceUploadStaging                         m_upload_staging;
+    CompactScattererError                       m_compact_error;
+};
+
+// A fixed-scatterer dataset kept in pinned host memory for datasets larger
+// than the device memory, which is streamed to the device in chunks. Chunk i
+// holds the sorted scatterers [i*chunk_size, (i+1)*chunk_size) as four arrays
+// of chunk_size floats: x, y, z, and amplitude.
+class HostChunkedFixedScatterers {
+public:
+    typedef std::shared_ptr<HostChunkedFixedScatterers> s_ptr;
+
+    HostChunkedFixedScatterers(const bcsim::FixedScatterers& host_scatterers, size_t chunk_size,
+                               ScattererGrid::CellOrder order = ScattererGrid::CellOrder::DEPTH);
+
+    size_t get_num_scatterers() const;
+
+    size_t get_chunk_size() const;
+
+    size_t get_num_chunks() const;
+
+    size_t get_chunk_num_scatterers(size_t chunk_no) const;
+
+    // The 4*chunk_size floats of a chunk.
+    const float* get_chunk_ptr(size_t chunk_no) const;
+
+    // Replace the scatterers with the given indices in the dataset it was
+    // created from. Must not be called while chunks are being copied.
+    void update(const std::vector<size_t>& indices, const std::vector<PointScatterer>& new_scatterers);
+
+    // Bytes of the pinned chunks and of the sorted indices.
+    size_t get_num_pinned_bytes() const;
+
+    size_t get_num_host_bytes() const;
+
+private:
+    size_t                              m_num_scatterers;
+    size_t                              m_chunk_size;
+    std::vector<uint32_t>               m_sorted_index;
+    HostPinnedBufferRAII<float>::u_ptr  m_data;
 };
 
 // Device memory for a spline-scatterer dataset.
@@ -77,7 +347,10 @@ public:
     typedef std::function<void(const std::string&)> LogCallback;
     typedef std::shared_ptr<DeviceSplineScatterers> s_ptr;
 
-    DeviceSplineScatterers(bcsim::SplineScatterers::s_ptr host_scatterers, LogCallback log_callback_fn = [](const std::string&) {});
+    // If interleaved, the control points are stored as one float4 array of
+    // (x, y, z, 0) in the same order instead of as three float arrays.
+    DeviceSplineScatterers(bcsim::SplineScatterers::s_ptr host_scatterers, DeviceUploadStaging& staging,
+                           bool interleaved = false, LogCallback log_callback_fn = [](const std::string&) {});
 
     // copy everything actual control points.
     void copy_information(bcsim::SplineScatterers::s_ptr host_scatterers);
@@ -86,13 +359,15 @@ public:
     void reallocate_device_memory();
 
     // copy data from host datastructure to the device memory
-    void transfer_to_device(bcsim::SplineScatterers::s_ptr host_scatterers);
+    void transfer_to_device(bcsim::SplineScatterers::s_ptr host_scatterers, DeviceUploadStaging& staging);
 
-    // update an existing dataset (will only reallocate memory if the new size is different from the previous)
-    void update(bcsim::SplineScatterers::s_ptr host_scatterers);
+    // Replace the splines with the given indices.
+    void update(const std::vector<size_t>& indices, const bcsim::SplineScatterers& new_scatterers,
+                DeviceScatterStaging& staging);
 
     size_t get_num_scatterers() const;
 
+    // Null if interleaved.
     float* get_xs_ptr() const;
 
     float* get_ys_ptr() const;
@@ -101,6 +376,9 @@ public:
 
     float* get_as_ptr() const;
 
+    // Null if not interleaved.
+    float4* get_control_points_ptr() const;
+
     std::vector<float> get_knots() const;
 
     int get_num_cs() const;
@@ -120,10 +398,13 @@ private:
     // the degree of the spline curve.
     int                                 m_spline_degree;
 
+    bool                                m_interleaved;
+
     // x,y,z coordinates: a fixed number of control points for each scatterer
     DeviceBufferRAII<float>::u_ptr      m_control_xs;
     DeviceBufferRAII<float>::u_ptr      m_control_ys;
     DeviceBufferRAII<float>::u_ptr      m_control_zs;
+    DeviceBufferRAII<float4>::u_ptr     m_control_points;
     
     // amplitudes: one per spline scatterer.
     DeviceBufferRAII<float>::u_ptr      m_as;
@@ -134,9 +415,17 @@ private:
 // Device memory for multiple spline-scatterers datasets
 class DeviceSplineScatterersCollection {
 public:
+    DeviceSplineScatterersCollection() : m_interleaved(false) { }
+
     void add(bcsim::SplineScatterers::s_ptr host_scatterers);
 
-    void update(bcsim::SplineScatterers::s_ptr host_scatterers, size_t dset_idx);
+    // Interleave the control points of the datasets added afterwards.
+    void set_interleaved(bool interleaved);
+
+    bool is_interleaved() const;
+
+    // Replace some splines of an existing dataset.
+    void update(size_t dset_idx, const std::vector<size_t>& indices, const bcsim::SplineScatterers& new_scatterers);
 
     void clear();
 
@@ -146,8 +435,19 @@ public:
 
     DeviceSplineScatterers::s_ptr get_dataset(size_t dset_idx) const;
 
+    // Bytes of the control points and amplitudes on the device.
+    size_t get_num_device_bytes() const;
+
+    size_t get_num_pinned_bytes() const;
+
+    // Chunk size in bytes of the pinned staging of uploads.
+    void set_upload_chunk_bytes(size_t chunk_bytes);
+
 private:
     std::vector<DeviceSplineScatterers::s_ptr> m_spline_datasets;
+    bool                                       m_interleaved;
+    DeviceScatterStaging                       m_staging;
+    DeviceUploadStaging                        m_upload_staging;
 };
 
 }   // end namespace
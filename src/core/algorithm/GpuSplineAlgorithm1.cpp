@@ -27,6 +27,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #ifdef BCSIM_ENABLE_CUDA
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <tuple>
@@ -63,7 +64,6 @@ void GpuSplineAlgorithm1::set_scatterers(Scatterers::s_ptr new_scatterers) {
 
     m_num_cs = scatterers->get_num_control_points();
     std::cout << "Num spline scatterers: " << m_num_splines << std::endl;
-    std::cout << "Allocating memory on host for reorganizing spline data\n";
 
 
     // device memory to hold x, y, z components of all spline control points
@@ -73,26 +73,10 @@ void GpuSplineAlgorithm1::set_scatterers(Scatterers::s_ptr new_scatterers) {
     m_control_ys = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(cs_num_bytes));
     m_control_zs = DeviceBufferRAII<float>::u_ptr(new DeviceBufferRAII<float>(cs_num_bytes));
 
-    // store the control points with correct memory layout of the host
-    std::vector<float> host_control_xs(total_num_cs);
-    std::vector<float> host_control_ys(total_num_cs);
-    std::vector<float> host_control_zs(total_num_cs);
-    std::vector<float> host_control_as(m_num_splines);
-
-    for (size_t spline_no = 0; spline_no < m_num_splines; spline_no++) {
-        host_control_as[spline_no] = scatterers->amplitudes[spline_no];
-        for (size_t i = 0; i < m_num_cs; i++) {
-            const size_t offset = spline_no + i*m_num_splines;
-            host_control_xs[offset] = scatterers->control_points[spline_no][i].x;
-            host_control_ys[offset] = scatterers->control_points[spline_no][i].y;
-            host_control_zs[offset] = scatterers->control_points[spline_no][i].z;
-        }
-    }
-    
-    // copy control points to GPU memory.
-    cudaErrorCheck( cudaMemcpy(m_control_xs->data(), host_control_xs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
-    cudaErrorCheck( cudaMemcpy(m_control_ys->data(), host_control_ys.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
-    cudaErrorCheck( cudaMemcpy(m_control_zs->data(), host_control_zs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
+    // the host control points already have the device memory layout.
+    cudaErrorCheck( cudaMemcpy(m_control_xs->data(), scatterers->control_xs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
+    cudaErrorCheck( cudaMemcpy(m_control_ys->data(), scatterers->control_ys.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
+    cudaErrorCheck( cudaMemcpy(m_control_zs->data(), scatterers->control_zs.data(), cs_num_bytes, cudaMemcpyHostToDevice) );
 
     // device memory to hold x, y, z, a components of rendered splines
     size_t rendered_num_bytes = m_num_splines*sizeof(float);
@@ -103,7 +87,7 @@ void GpuSplineAlgorithm1::set_scatterers(Scatterers::s_ptr new_scatterers) {
     m_fixed_alg->m_num_scatterers = m_num_splines;
 
     // copy amplitudes directly from host memory.
-    cudaErrorCheck( cudaMemcpy(m_fixed_alg->m_device_point_as->data(), host_control_as.data(), rendered_num_bytes, cudaMemcpyHostToDevice) );
+    cudaErrorCheck( cudaMemcpy(m_fixed_alg->m_device_point_as->data(), scatterers->amplitudes.data(), rendered_num_bytes, cudaMemcpyHostToDevice) );
 
     // Store the knot vector.
     m_common_knots = scatterers->knot_vector;
@@ -159,11 +143,9 @@ void GpuSplineAlgorithm1::set_scan_sequence(ScanSequence::s_ptr new_scan_sequenc
         throw std::runtime_error("b-spline basis bounds failed sanity check");
     }
     
-    // only copy the non-zero-basis functions
-    const auto src_ptr = host_basis_functions.data() + cs_idx_start;
-    if (!splineAlg1_updateConstantMemory(src_ptr, num_nonzero*sizeof(float))) {
-        throw std::runtime_error("Failed copying to symbol memory");   
-    }
+    // only pass the non-zero-basis functions
+    RenderSplineBasis basis;
+    std::copy(host_basis_functions.begin() + cs_idx_start, host_basis_functions.begin() + cs_idx_end + 1, basis.values);
     
     int num_threads = 128;
     int num_blocks = round_up_div(m_num_splines, num_threads);
@@ -172,12 +154,14 @@ void GpuSplineAlgorithm1::set_scan_sequence(ScanSequence::s_ptr new_scan_sequenc
     
     const cudaStream_t cuda_stream = 0;
     launch_RenderSplineKernel(num_blocks, num_threads, cuda_stream,
+                              nullptr,
                               m_control_xs->data(),
                               m_control_ys->data(),
                               m_control_zs->data(),
                               m_fixed_alg->m_device_point_xs->data(),
                               m_fixed_alg->m_device_point_ys->data(),
                               m_fixed_alg->m_device_point_zs->data(),
+                              basis,
                               cs_idx_start,
                               cs_idx_end,
                               m_num_splines);
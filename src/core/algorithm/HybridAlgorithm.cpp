@@ -0,0 +1,322 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include "HybridAlgorithm.hpp"
+#include "common_utils.hpp"
+
+namespace bcsim {
+
+HybridAlgorithm::HybridAlgorithm(IAlgorithm::s_ptr cpu_algorithm, IAlgorithm::s_ptr gpu_algorithm)
+    : m_cpu_algorithm(cpu_algorithm),
+      m_gpu_algorithm(gpu_algorithm),
+      m_param_chunk_size(16),
+      m_next_front(0),
+      m_next_back(0)
+{
+}
+
+void HybridAlgorithm::set_parameter(const std::string& key, const std::string& value) {
+    if (key == "hybrid_chunk_size") {
+        const auto chunk_size = std::stoi(value);
+        if (chunk_size <= 0) {
+            throw std::runtime_error("illegal chunk size");
+        }
+        m_param_chunk_size = chunk_size;
+        if (m_scan_seq) {
+            create_chunks();
+        }
+    } else if ((key == "trace_file") || is_frame_cache_parameter(key)) {
+        // the trace and the frame cache cover both algorithms
+        BaseAlgorithm::set_parameter(key, value);
+    } else if (key == "stats_reset") {
+        BaseAlgorithm::set_parameter(key, value);
+        m_cpu_algorithm->set_parameter(key, value);
+        m_gpu_algorithm->set_parameter(key, value);
+    } else if (is_cpu_parameter(key)) {
+        m_cpu_algorithm->set_parameter(key, value);
+    } else if (is_gpu_parameter(key)) {
+        m_gpu_algorithm->set_parameter(key, value);
+    } else {
+        if (key == "verbose") {
+            BaseAlgorithm::set_parameter(key, value);
+        }
+        m_cpu_algorithm->set_parameter(key, value);
+        m_gpu_algorithm->set_parameter(key, value);
+    }
+    m_state.set_parameter(key, value);
+}
+
+std::string HybridAlgorithm::get_parameter(const std::string& key) const {
+    if (key == "hybrid_chunk_size") {
+        return std::to_string(m_param_chunk_size);
+    } else if (is_stats_parameter(key) || is_frame_cache_parameter(key)) {
+        // the frames of the hybrid simulator, not the chunks of the backends
+        return BaseAlgorithm::get_parameter(key);
+    }
+    return m_gpu_algorithm->get_parameter(key);
+}
+
+void HybridAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
+    if (!new_scan_sequence->is_valid()) {
+        throw std::runtime_error("scan sequence is invalid");
+    }
+    if (new_scan_sequence->get_num_lines() < 1) {
+        throw std::runtime_error("No scanlines in scansequence");
+    }
+    m_scan_seq = new_scan_sequence;
+    create_chunks();
+    m_state.set_scan_sequence(new_scan_sequence);
+}
+
+void HybridAlgorithm::create_chunks() {
+    const int num_lines = m_scan_seq->get_num_lines();
+    m_chunks.clear();
+    for (int first_line = 0; first_line < num_lines; first_line += m_param_chunk_size) {
+        m_chunks.push_back(line_range(*m_scan_seq, first_line, std::min(m_param_chunk_size, num_lines - first_line)));
+    }
+
+    // Configure the backends with a chunk each, which validates the chunks
+    // and lets the GPU allocate for the chunk size before the first frame.
+    m_cpu_algorithm->set_scan_sequence(m_chunks.back());
+    m_gpu_algorithm->set_scan_sequence(m_chunks.front());
+}
+
+void HybridAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
+    m_cpu_algorithm->set_excitation(new_excitation);
+    m_gpu_algorithm->set_excitation(new_excitation);
+    m_state.set_excitation(new_excitation);
+}
+
+void HybridAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    m_cpu_algorithm->set_analytical_profile(beam_profile);
+    m_gpu_algorithm->set_analytical_profile(beam_profile);
+    m_state.set_analytical_profile(beam_profile);
+}
+
+void HybridAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    m_cpu_algorithm->set_lookup_profile(beam_profile);
+    m_gpu_algorithm->set_lookup_profile(beam_profile);
+    m_state.set_lookup_profile(beam_profile);
+}
+
+void HybridAlgorithm::clear_fixed_scatterers() {
+    m_cpu_algorithm->clear_fixed_scatterers();
+    m_gpu_algorithm->clear_fixed_scatterers();
+    m_state.clear_fixed_scatterers();
+}
+
+void HybridAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    m_cpu_algorithm->add_fixed_scatterers(fixed_scatterers);
+    m_gpu_algorithm->add_fixed_scatterers(fixed_scatterers);
+    m_state.add_fixed_scatterers(fixed_scatterers);
+}
+
+void HybridAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    m_cpu_algorithm->add_external_fixed_scatterers(external_scatterers);
+    m_gpu_algorithm->add_external_fixed_scatterers(external_scatterers);
+    m_state.add_external_fixed_scatterers(external_scatterers);
+}
+
+void HybridAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    m_cpu_algorithm->add_procedural_scatterers(procedural_scatterers);
+    m_gpu_algorithm->add_procedural_scatterers(procedural_scatterers);
+    m_state.add_procedural_scatterers(procedural_scatterers);
+}
+
+void HybridAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    m_cpu_algorithm->add_image_volume_scatterers(image_volume_scatterers);
+    m_gpu_algorithm->add_image_volume_scatterers(image_volume_scatterers);
+    m_state.add_image_volume_scatterers(image_volume_scatterers);
+}
+
+void HybridAlgorithm::clear_spline_scatterers() {
+    m_cpu_algorithm->clear_spline_scatterers();
+    m_gpu_algorithm->clear_spline_scatterers();
+    m_state.clear_spline_scatterers();
+}
+
+void HybridAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    m_cpu_algorithm->add_spline_scatterers(spline_scatterers);
+    m_gpu_algorithm->add_spline_scatterers(spline_scatterers);
+    m_state.add_spline_scatterers(spline_scatterers);
+}
+
+void HybridAlgorithm::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                              const std::vector<PointScatterer>& new_scatterers) {
+    m_cpu_algorithm->update_fixed_scatterers(dset_idx, indices, new_scatterers);
+    m_gpu_algorithm->update_fixed_scatterers(dset_idx, indices, new_scatterers);
+    m_state.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+}
+
+void HybridAlgorithm::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                               const SplineScatterers& new_scatterers) {
+    m_cpu_algorithm->update_spline_scatterers(dset_idx, indices, new_scatterers);
+    m_gpu_algorithm->update_spline_scatterers(dset_idx, indices, new_scatterers);
+    m_state.update_spline_scatterers(dset_idx, indices, new_scatterers);
+}
+
+size_t HybridAlgorithm::get_total_num_scatterers() const {
+    return m_cpu_algorithm->get_total_num_scatterers();
+}
+
+MemoryUsage HybridAlgorithm::get_memory_usage() const {
+    MemoryUsage usage;
+    add_base_memory_usage(usage);
+    size_t chunks_bytes = 0;
+    for (const auto& chunk : m_chunks) {
+        chunks_bytes += scan_sequence_bytes(*chunk);
+    }
+    usage.host["scan_sequence"] += chunks_bytes;
+    usage.host["image_buffers"] += m_frame_buffer.capacity()*sizeof(std::complex<float>);
+    usage.add(m_cpu_algorithm->get_memory_usage());
+    usage.add(m_gpu_algorithm->get_memory_usage());
+    return usage;
+}
+
+MemoryUsage HybridAlgorithm::predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                                  size_t num_spline_scatterers, int num_cs) const {
+    MemoryUsage usage;
+    usage.host["scan_sequence"] = 2*scan_sequence_bytes(scan_seq);
+    usage.add(m_cpu_algorithm->predict_memory_usage(scan_seq, num_fixed_scatterers, num_spline_scatterers, num_cs));
+    usage.add(m_gpu_algorithm->predict_memory_usage(scan_seq, num_fixed_scatterers, num_spline_scatterers, num_cs));
+    return usage;
+}
+
+void HybridAlgorithm::set_logger(ILog::ptr log_object) {
+    BaseAlgorithm::set_logger(log_object);
+    m_cpu_algorithm->set_logger(log_object);
+    m_gpu_algorithm->set_logger(log_object);
+}
+
+void HybridAlgorithm::get_output_dimensions(size_t& num_lines, size_t& num_samples) const {
+    if (!m_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to get output dimensions");
+    }
+    // the number of samples does not depend on the lines of a chunk
+    size_t chunk_num_lines;
+    m_cpu_algorithm->get_output_dimensions(chunk_num_lines, num_samples);
+    num_lines = static_cast<size_t>(m_scan_seq->get_num_lines());
+}
+
+float HybridAlgorithm::get_output_start_time() const {
+    // the window does not depend on the lines of a chunk
+    return m_cpu_algorithm->get_output_start_time();
+}
+
+bool HybridAlgorithm::claim_chunk(bool from_front, size_t& chunk_idx) {
+    std::lock_guard<std::mutex> guard(m_chunks_mutex);
+    if (m_next_front == m_next_back) {
+        return false;
+    }
+    chunk_idx = from_front ? m_next_front++ : --m_next_back;
+    return true;
+}
+
+void HybridAlgorithm::simulate_chunks(IAlgorithm& algorithm, bool from_front, std::complex<float>* iq_buffer,
+                                      size_t line_stride, int& num_simulated_lines) {
+    size_t chunk_idx;
+    while (claim_chunk(from_front, chunk_idx)) {
+        const auto& chunk = m_chunks[chunk_idx];
+        const auto first_line = chunk_idx*static_cast<size_t>(m_param_chunk_size);
+        algorithm.set_scan_sequence(chunk);
+        algorithm.simulate_lines(iq_buffer + first_line*line_stride, line_stride);
+        // the backends have no callback, a chunk is delivered when it is done
+        report_lines(first_line, static_cast<size_t>(chunk->get_num_lines()), iq_buffer + first_line*line_stride, line_stride);
+        num_simulated_lines += chunk->get_num_lines();
+    }
+}
+
+void HybridAlgorithm::simulate_lines(std::complex<float>* iq_buffer, size_t line_stride) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    // the backends keep the positions in the noise stream
+    const auto cache_key = state_has_noise() ? std::string() : frame_cache_key(0);
+    if (!cache_key.empty() && read_cached_frame(cache_key, iq_buffer, line_stride)) {
+        return;
+    }
+    const auto frame_start = std::chrono::steady_clock::now();
+
+    m_next_front = 0;
+    m_next_back = m_chunks.size();
+
+    // The GPU backend stays on the calling thread, which has its CUDA device current.
+    int num_cpu_lines = 0;
+    int num_gpu_lines = 0;
+    std::exception_ptr cpu_error;
+    std::thread cpu_thread([&]() {
+        try {
+            simulate_chunks(*m_cpu_algorithm, false, iq_buffer, line_stride, num_cpu_lines);
+        } catch (...) {
+            cpu_error = std::current_exception();
+        }
+    });
+    try {
+        simulate_chunks(*m_gpu_algorithm, true, iq_buffer, line_stride, num_gpu_lines);
+    } catch (...) {
+        // make the CPU thread stop after its current chunk
+        {
+            std::lock_guard<std::mutex> guard(m_chunks_mutex);
+            m_next_back = m_next_front;
+        }
+        cpu_thread.join();
+        throw;
+    }
+    cpu_thread.join();
+    if (cpu_error) {
+        std::rethrow_exception(cpu_error);
+    }
+
+    m_debug_data["hybrid_cpu_lines"].push_back(num_cpu_lines);
+    m_debug_data["hybrid_gpu_lines"].push_back(num_gpu_lines);
+    count_frame(num_lines, frame_start);
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, iq_buffer, line_stride);
+    }
+}
+
+void HybridAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> > >&  /*out*/ rf_lines) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    m_frame_buffer.resize(num_lines*num_samples);
+    simulate_lines(m_frame_buffer.data(), num_samples);
+
+    rf_lines.resize(num_lines);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        const auto line_start = m_frame_buffer.begin() + line_no*num_samples;
+        rf_lines[line_no].assign(line_start, line_start + num_samples);
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <vector>
+#include <mutex>
+#include "BaseAlgorithm.hpp"
+
+namespace bcsim {
+
+// Simulates a frame cooperatively with two backends, typically a CPU and a
+// GPU algorithm that are configured identically. The scan sequence is cut
+// into chunks of lines which the backends claim while they are free: the
+// GPU backend from the front and the CPU backend from the back, so that a
+// shorter last chunk always goes to the CPU and the GPU keeps a fixed batch
+// size. The chunks are written in line order directly into the output.
+//
+// The CPU backend runs on a separate host thread, so it may be useful to
+// leave one core for the thread feeding the GPU ("num_cpu_cores").
+class HybridAlgorithm : public BaseAlgorithm {
+public:
+    HybridAlgorithm(IAlgorithm::s_ptr cpu_algorithm, IAlgorithm::s_ptr gpu_algorithm);
+
+    virtual ~HybridAlgorithm() {
+        wait_for_async_frames();
+    }
+
+    // Parameters specific to one of the backends are only forwarded to it,
+    // common parameters to both.
+    virtual void set_parameter(const std::string& key, const std::string& value)        override;
+
+    virtual std::string get_parameter(const std::string& key) const                     override;
+
+    virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines) override;
+
+    virtual void get_output_dimensions(size_t& num_lines, size_t& num_samples) const    override;
+
+    virtual float get_output_start_time() const                                         override;
+
+    virtual void simulate_lines(std::complex<float>* iq_buffer, size_t line_stride)     override;
+
+    virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               override;
+
+    virtual void set_excitation(const ExcitationSignal& new_excitation)                 override;
+
+    virtual void set_analytical_profile(IBeamProfile::s_ptr beam_profile)               override;
+
+    virtual void set_lookup_profile(IBeamProfile::s_ptr beam_profile)                   override;
+
+    virtual void clear_fixed_scatterers()                                               override;
+
+    virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                           override;
+
+    // The CPU simulator references the dataset, the GPU simulator copies it.
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)          override;
+
+    // Both simulators generate the scatterers while projecting.
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                 override;
+
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)              override;
+
+    virtual void clear_spline_scatterers()                                              override;
+
+    virtual void add_spline_scatterers(SplineScatterers::s_ptr)                         override;
+
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers) override;
+
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers)           override;
+
+    virtual size_t get_total_num_scatterers() const                                     override;
+
+    virtual MemoryUsage get_memory_usage() const                                        override;
+
+    // Both simulators are predicted with the full scan sequence as an upper bound.
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const override;
+
+    virtual void set_logger(ILog::ptr log_object)                                       override;
+
+protected:
+    virtual ScanSequence::s_ptr current_scan_sequence() const override {
+        return m_scan_seq;
+    }
+
+    // Cut the scan sequence into chunks of at most m_param_chunk_size lines.
+    void create_chunks();
+
+    // Claim the next free chunk from the front or the back. Returns false
+    // when all chunks of the frame have been claimed.
+    bool claim_chunk(bool from_front, size_t& chunk_idx);
+
+    // Simulate chunks with one backend until none are left.
+    void simulate_chunks(IAlgorithm& algorithm, bool from_front, std::complex<float>* iq_buffer,
+                         size_t line_stride, int& num_simulated_lines);
+
+protected:
+    IAlgorithm::s_ptr                   m_cpu_algorithm;
+    IAlgorithm::s_ptr                   m_gpu_algorithm;
+
+    // Number of lines in a chunk.
+    int                                 m_param_chunk_size;
+
+    ScanSequence::s_ptr                 m_scan_seq;
+
+    // The chunks of the scan sequence; chunk i starts at line i*chunk size.
+    std::vector<ScanSequence::s_ptr>    m_chunks;
+
+    // The free chunks of the current frame are [m_next_front, m_next_back).
+    std::mutex                          m_chunks_mutex;
+    size_t                              m_next_front;
+    size_t                              m_next_back;
+
+    // contiguous output of the vector-of-lines simulate_lines()
+    std::vector<std::complex<float>>    m_frame_buffer;
+};
+
+}   // end namespace
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifdef BCSIM_ENABLE_CUDA
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+#include <vector>
+#ifdef BCSIM_ENABLE_NVRTC
+    #include <nvrtc.h>
+#endif
+#include "JitKernels.hpp"
+
+namespace bcsim {
+namespace {
+
+// A float as an expression of its exact bits, which NVRTC folds.
+std::string float_constant(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::stringstream ss;
+    ss << "__uint_as_float(0x" << std::hex << bits << "u)";
+    return ss.str();
+}
+
+// Source of a struct JitKernelConstants with the functions of
+// RuntimeKernelConstants, returning the given values.
+std::string constants_source(float fs_hertz, float sound_speed, int num_time_samples, int first_time_sample,
+                             int num_splines, int num_control_points) {
+    std::stringstream ss;
+    ss << "struct JitKernelConstants {\n"
+       << "    template <typename Params>\n"
+       << "    __device__ static float fs_hertz(const Params&) { return " << float_constant(fs_hertz) << "; }\n"
+       << "    template <typename Params>\n"
+       << "    __device__ static float sound_speed(const Params&) { return " << float_constant(sound_speed) << "; }\n"
+       << "    template <typename Params>\n"
+       << "    __device__ static int num_time_samples(const Params&) { return " << num_time_samples << "; }\n"
+       << "    template <typename Params>\n"
+       << "    __device__ static int first_time_sample(const Params&) { return " << first_time_sample << "; }\n"
+       << "    __device__ static int num_splines(const SplineAlgKernelParams&) { return " << num_splines << "; }\n"
+       << "    __device__ static int num_control_points(const LineDescriptor&) { return " << num_control_points << "; }\n"
+       << "};\n";
+    return ss.str();
+}
+
+std::string name_expression(const std::string& kernel_name, bool use_arc_projection, bool use_phase_delay, bool use_lut) {
+    const auto flag_string = [](bool flag) { return flag ? "true" : "false"; };
+    return kernel_name + "<" + flag_string(use_arc_projection) + ", " + flag_string(use_phase_delay) + ", "
+           + flag_string(use_lut) + ", JitKernelConstants>";
+}
+
+#ifdef BCSIM_ENABLE_NVRTC
+void nvrtcErrorCheck(nvrtcResult result) {
+    if (result != NVRTC_SUCCESS) {
+        throw std::runtime_error(std::string("NVRTC error: ") + nvrtcGetErrorString(result));
+    }
+}
+
+void cuErrorCheck(CUresult result) {
+    if (result != CUDA_SUCCESS) {
+        const char* message = nullptr;
+        cuGetErrorString(result, &message);
+        throw std::runtime_error(std::string("CUDA driver error: ") + (message ? message : "unknown"));
+    }
+}
+
+class NvrtcProgramRAII {
+public:
+    NvrtcProgramRAII(const std::string& source, const std::string& name) {
+        nvrtcErrorCheck( nvrtcCreateProgram(&m_program, source.c_str(), name.c_str(), 0, nullptr, nullptr) );
+    }
+
+    ~NvrtcProgramRAII() {
+        nvrtcDestroyProgram(&m_program);
+    }
+
+    nvrtcProgram get() const {
+        return m_program;
+    }
+
+private:
+    nvrtcProgram m_program;
+};
+#endif
+
+}   // end anonymous namespace
+
+void JitProjectionKernels::prepare_fixed(bool use_arc_projection, bool use_phase_delay, bool use_lut,
+                                         const FixedAlgKernelParams& params) {
+    fixed_function(use_arc_projection, use_phase_delay, use_lut, params);
+}
+
+void JitProjectionKernels::prepare_spline(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree,
+                                          const SplineAlgKernelParams& params) {
+    spline_function(use_arc_projection, use_phase_delay, use_lut, spline_degree, params);
+}
+
+void JitProjectionKernels::launch_fixed(bool use_arc_projection, bool use_phase_delay, bool use_lut, int grid_size,
+                                        int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params) {
+    const auto function = fixed_function(use_arc_projection, use_phase_delay, use_lut, params);
+    const size_t shared_bytes = params.shared_tile_len*sizeof(float2);
+    launch_function(function, grid_size, grid_size1, block_size, shared_bytes, stream, &params);
+}
+
+void JitProjectionKernels::launch_spline(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree,
+                                         int grid_size, int grid_size1, int block_size, cudaStream_t stream,
+                                         SplineAlgKernelParams params) {
+    const auto function = spline_function(use_arc_projection, use_phase_delay, use_lut, spline_degree, params);
+    const size_t shared_bytes = params.shared_tile_len*sizeof(float2);
+    launch_function(function, grid_size, grid_size1, block_size, shared_bytes, stream, &params);
+}
+
+CUfunction JitProjectionKernels::fixed_function(bool use_arc_projection, bool use_phase_delay, bool use_lut,
+                                                const FixedAlgKernelParams& params) {
+    // the spline constants are not used
+    const auto constants = constants_source(params.fs_hertz, params.sound_speed, params.num_time_samples, params.first_time_sample, 0, 0);
+    return get_function("FixedAlgKernel", use_arc_projection, use_phase_delay, use_lut, constants);
+}
+
+CUfunction JitProjectionKernels::spline_function(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree,
+                                                 const SplineAlgKernelParams& params) {
+    const auto constants = constants_source(params.fs_hertz, params.sound_speed, params.num_time_samples, params.first_time_sample,
+                                            params.NUM_SPLINES, spline_degree + 1);
+    return get_function("SplineAlgKernel", use_arc_projection, use_phase_delay, use_lut, constants);
+}
+
+#ifdef BCSIM_ENABLE_NVRTC
+
+JitProjectionKernels::JitProjectionKernels(const cudaDeviceProp& device_prop) {
+    m_arch_option = "--gpu-architecture=compute_" + std::to_string(device_prop.major) + std::to_string(device_prop.minor);
+}
+
+JitProjectionKernels::~JitProjectionKernels() {
+    for (auto& entry : m_modules) {
+        cuModuleUnload(entry.second.module);
+    }
+}
+
+CUfunction JitProjectionKernels::get_function(const std::string& kernel_name, bool use_arc_projection, bool use_phase_delay,
+                                              bool use_lut, const std::string& constants) {
+    const auto name = name_expression(kernel_name, use_arc_projection, use_phase_delay, use_lut);
+    const auto key = name + "\n" + constants;
+    const auto it = m_modules.find(key);
+    if (it != m_modules.end()) {
+        return it->second.function;
+    }
+
+    const auto source = std::string("#include \"cuda_kernels_fixed.cuh\"\n")
+                        + "#include \"cuda_kernels_spline2.cuh\"\n"
+                        + constants;
+    NvrtcProgramRAII program(source, "jit_projection_kernels.cu");
+    nvrtcErrorCheck( nvrtcAddNameExpression(program.get(), name.c_str()) );
+
+    // the same math as the precompiled kernels
+    const std::vector<std::string> options = {m_arch_option, "--std=c++11", "--use_fast_math",
+                                              "--include-path=" BCSIM_JIT_SOURCE_DIR,
+                                              "--include-path=" BCSIM_JIT_CUDA_INCLUDE_DIR};
+    std::vector<const char*> option_ptrs;
+    for (const auto& option : options) {
+        option_ptrs.push_back(option.c_str());
+    }
+    const auto result = nvrtcCompileProgram(program.get(), static_cast<int>(option_ptrs.size()), option_ptrs.data());
+    if (result != NVRTC_SUCCESS) {
+        size_t log_size;
+        nvrtcErrorCheck( nvrtcGetProgramLogSize(program.get(), &log_size) );
+        std::vector<char> log(log_size + 1, '\0');
+        nvrtcErrorCheck( nvrtcGetProgramLog(program.get(), log.data()) );
+        throw std::runtime_error("compilation of " + name + " failed: " + std::string(log.data()));
+    }
+
+    size_t ptx_size;
+    nvrtcErrorCheck( nvrtcGetPTXSize(program.get(), &ptx_size) );
+    std::vector<char> ptx(ptx_size);
+    nvrtcErrorCheck( nvrtcGetPTX(program.get(), ptx.data()) );
+    const char* lowered_name;
+    nvrtcErrorCheck( nvrtcGetLoweredName(program.get(), name.c_str(), &lowered_name) );
+
+    Module module;
+    cuErrorCheck( cuModuleLoadData(&module.module, ptx.data()) );
+    const auto get_result = cuModuleGetFunction(&module.function, module.module, lowered_name);
+    if (get_result != CUDA_SUCCESS) {
+        cuModuleUnload(module.module);
+        cuErrorCheck(get_result);
+    }
+    m_modules[key] = module;
+    return module.function;
+}
+
+void JitProjectionKernels::launch_function(CUfunction function, int grid_size, int grid_size1, int block_size,
+                                           size_t shared_bytes, cudaStream_t stream, void* params) {
+    void* args[] = {params};
+    cuErrorCheck( cuLaunchKernel(function, grid_size, grid_size1, 1, block_size, 1, 1, static_cast<unsigned int>(shared_bytes),
+                                 stream, args, nullptr) );
+}
+
+#else
+
+JitProjectionKernels::JitProjectionKernels(const cudaDeviceProp&) {
+    throw std::runtime_error("NVRTC kernels are not enabled at compile time");
+}
+
+JitProjectionKernels::~JitProjectionKernels() {
+}
+
+CUfunction JitProjectionKernels::get_function(const std::string&, bool, bool, bool, const std::string&) {
+    throw std::logic_error("NVRTC kernels are not enabled at compile time");
+}
+
+void JitProjectionKernels::launch_function(CUfunction, int, int, int, size_t, cudaStream_t, void*) {
+    throw std::logic_error("NVRTC kernels are not enabled at compile time");
+}
+
+#endif  // BCSIM_ENABLE_NVRTC
+
+}   // end namespace
+
+#endif  // BCSIM_ENABLE_CUDA
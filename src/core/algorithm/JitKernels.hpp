@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#ifdef BCSIM_ENABLE_CUDA
+#include <map>
+#include <memory>
+#include <string>
+#include "gpu_runtime.h"
+#include "cuda_kernels_c_interface.h"
+
+namespace bcsim {
+
+// The projection kernels FixedAlgKernel and SplineAlgKernel compiled at
+// runtime with NVRTC, with the sampling frequency, the sound speed and the
+// number of time samples as constants, and for splines also the number of
+// splines and the number of control points of a line (the spline degree
+// plus one). The control point loop is then fully unrolled and the index
+// computations are folded. Each configuration is compiled on first use for
+// the device of the current context, and the module is cached.
+//
+// Requires BCSIM_ENABLE_NVRTC, otherwise the constructor throws.
+class JitProjectionKernels {
+public:
+    typedef std::unique_ptr<JitProjectionKernels> u_ptr;
+
+    // The kernels are compiled for the compute capability of the device.
+    explicit JitProjectionKernels(const cudaDeviceProp& device_prop);
+
+    ~JitProjectionKernels();
+
+    // Compile the kernel for the constants of the parameters unless it is
+    // cached. The launches do this, but it is not possible while a stream is
+    // captured into a CUDA graph.
+    void prepare_fixed(bool use_arc_projection, bool use_phase_delay, bool use_lut, const FixedAlgKernelParams& params);
+    void prepare_spline(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree,
+                        const SplineAlgKernelParams& params);
+
+    // As launch_FixedAlgKernel() and launch_SplineAlgKernel(), where all lines
+    // of the spline kernel have spline_degree+1 control points.
+    void launch_fixed(bool use_arc_projection, bool use_phase_delay, bool use_lut, int grid_size, int grid_size1,
+                      int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+    void launch_spline(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree, int grid_size,
+                       int grid_size1, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
+
+    // Number of kernels compiled so far.
+    size_t get_num_modules() const {
+        return m_modules.size();
+    }
+
+private:
+    struct Module {
+        CUmodule   module;
+        CUfunction function;
+    };
+
+    // The function of a kernel template instantiated with the flags and a
+    // struct of constants (see RuntimeKernelConstants), compiled if needed.
+    CUfunction get_function(const std::string& kernel_name, bool use_arc_projection, bool use_phase_delay, bool use_lut,
+                            const std::string& constants);
+
+    static void launch_function(CUfunction function, int grid_size, int grid_size1, int block_size, size_t shared_bytes,
+                                cudaStream_t stream, void* params);
+
+    CUfunction fixed_function(bool use_arc_projection, bool use_phase_delay, bool use_lut, const FixedAlgKernelParams& params);
+    CUfunction spline_function(bool use_arc_projection, bool use_phase_delay, bool use_lut, int spline_degree,
+                               const SplineAlgKernelParams& params);
+
+    // NVRTC architecture option, e.g. "--gpu-architecture=compute_61"
+    std::string                     m_arch_option;
+    // keyed by the name expression and the constants
+    std::map<std::string, Module>   m_modules;
+};
+
+}   // end namespace
+
+#endif  // BCSIM_ENABLE_CUDA
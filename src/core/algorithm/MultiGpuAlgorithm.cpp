@@ -0,0 +1,417 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifdef BCSIM_ENABLE_CUDA
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <exception>
+#include "MultiGpuAlgorithm.hpp"
+
+namespace bcsim {
+
+MultiGpuAlgorithm::MultiGpuAlgorithm() {
+    int device_count = 0;
+    cudaErrorCheck( cudaGetDeviceCount(&device_count) );
+    if (device_count < 1) {
+        throw std::runtime_error("no CUDA devices available");
+    }
+    for (int device_no = 0; device_no < device_count; device_no++) {
+        cudaErrorCheck( cudaSetDevice(device_no) );
+        auto device = std::unique_ptr<GpuAlgorithm>(new GpuAlgorithm);
+        device->set_parameter("gpu_device", std::to_string(device_no));
+        m_device_numbers.push_back(device_no);
+        m_devices.push_back(std::move(device));
+    }
+    m_throughputs.assign(m_devices.size(), 1.0);
+    m_first_lines.assign(m_devices.size(), 0);
+    m_num_lines.assign(m_devices.size(), 0);
+    m_device_lines.resize(m_devices.size());
+}
+
+MultiGpuAlgorithm::~MultiGpuAlgorithm() {
+    wait_for_async_frames();
+    // free the resources of every device with it current
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        cudaSetDevice(m_device_numbers[device_idx]);
+        m_devices[device_idx].reset();
+    }
+}
+
+void MultiGpuAlgorithm::set_parameter(const std::string& key, const std::string& value) {
+    if (key == "gpu_device") {
+        throw std::runtime_error("the multi-GPU algorithm uses all devices");
+    }
+    if ((key == "trace_file") || is_frame_cache_parameter(key)) {
+        // the trace and the frame cache cover all devices
+        BaseAlgorithm::set_parameter(key, value);
+        return;
+    }
+    if ((key == "verbose") || (key == "stats_reset")) {
+        BaseAlgorithm::set_parameter(key, value);
+    }
+    for_each_device([&](GpuAlgorithm& device) {
+        device.set_parameter(key, value);
+    });
+    m_state.set_parameter(key, value);
+}
+
+std::string MultiGpuAlgorithm::get_parameter(const std::string& key) const {
+    if (key == "num_devices") {
+        return std::to_string(m_devices.size());
+    } else if (is_stats_parameter(key) || is_frame_cache_parameter(key)) {
+        // the frames of all devices, not those of the first one
+        return BaseAlgorithm::get_parameter(key);
+    }
+    cudaErrorCheck( cudaSetDevice(m_device_numbers[0]) );
+    return m_devices[0]->get_parameter(key);
+}
+
+void MultiGpuAlgorithm::set_scan_sequence(ScanSequence::s_ptr new_scan_sequence) {
+    if (new_scan_sequence->get_num_lines() < 1) {
+        throw std::runtime_error("No scanlines in scansequence");
+    }
+    m_scan_seq = new_scan_sequence;
+    distribute_lines();
+    m_state.set_scan_sequence(new_scan_sequence);
+}
+
+void MultiGpuAlgorithm::set_excitation(const ExcitationSignal& new_excitation) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.set_excitation(new_excitation);
+    });
+    m_state.set_excitation(new_excitation);
+}
+
+void MultiGpuAlgorithm::set_analytical_profile(IBeamProfile::s_ptr beam_profile) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.set_analytical_profile(beam_profile);
+    });
+    m_state.set_analytical_profile(beam_profile);
+}
+
+void MultiGpuAlgorithm::set_lookup_profile(IBeamProfile::s_ptr beam_profile) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.set_lookup_profile(beam_profile);
+    });
+    m_state.set_lookup_profile(beam_profile);
+}
+
+void MultiGpuAlgorithm::clear_fixed_scatterers() {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.clear_fixed_scatterers();
+    });
+    m_state.clear_fixed_scatterers();
+}
+
+void MultiGpuAlgorithm::add_fixed_scatterers(FixedScatterers::s_ptr fixed_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.add_fixed_scatterers(fixed_scatterers);
+    });
+    m_state.add_fixed_scatterers(fixed_scatterers);
+}
+
+void MultiGpuAlgorithm::add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr external_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.add_external_fixed_scatterers(external_scatterers);
+    });
+    m_state.add_external_fixed_scatterers(external_scatterers);
+}
+
+void MultiGpuAlgorithm::add_procedural_scatterers(ProceduralScatterers::s_ptr procedural_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.add_procedural_scatterers(procedural_scatterers);
+    });
+    m_state.add_procedural_scatterers(procedural_scatterers);
+}
+
+void MultiGpuAlgorithm::add_image_volume_scatterers(ImageVolumeScatterers::s_ptr image_volume_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.add_image_volume_scatterers(image_volume_scatterers);
+    });
+    m_state.add_image_volume_scatterers(image_volume_scatterers);
+}
+
+void MultiGpuAlgorithm::clear_spline_scatterers() {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.clear_spline_scatterers();
+    });
+    m_state.clear_spline_scatterers();
+}
+
+void MultiGpuAlgorithm::add_spline_scatterers(SplineScatterers::s_ptr spline_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.add_spline_scatterers(spline_scatterers);
+    });
+    m_state.add_spline_scatterers(spline_scatterers);
+}
+
+void MultiGpuAlgorithm::update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                                const std::vector<PointScatterer>& new_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+    });
+    m_state.update_fixed_scatterers(dset_idx, indices, new_scatterers);
+}
+
+void MultiGpuAlgorithm::update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                                 const SplineScatterers& new_scatterers) {
+    for_each_device([&](GpuAlgorithm& device) {
+        device.update_spline_scatterers(dset_idx, indices, new_scatterers);
+    });
+    m_state.update_spline_scatterers(dset_idx, indices, new_scatterers);
+}
+
+size_t MultiGpuAlgorithm::get_total_num_scatterers() const {
+    // all devices hold the same datasets
+    return m_devices[0]->get_total_num_scatterers();
+}
+
+MemoryUsage MultiGpuAlgorithm::get_memory_usage() const {
+    MemoryUsage usage;
+    add_base_memory_usage(usage);
+    size_t device_lines_bytes = 0;
+    for (const auto& lines : m_device_lines) {
+        for (const auto& line : lines) {
+            device_lines_bytes += line.capacity()*sizeof(std::complex<float>);
+        }
+    }
+    usage.host["device_lines"] = device_lines_bytes;
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        usage.add(m_devices[device_idx]->get_memory_usage(), "gpu" + std::to_string(m_device_numbers[device_idx]) + "/");
+    }
+    return usage;
+}
+
+MemoryUsage MultiGpuAlgorithm::predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                                    size_t num_spline_scatterers, int num_cs) const {
+    MemoryUsage usage;
+    usage.host["scan_sequence"] = scan_sequence_bytes(scan_seq);
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        const auto device_usage = m_devices[device_idx]->predict_memory_usage(scan_seq, num_fixed_scatterers,
+                                                                               num_spline_scatterers, num_cs);
+        usage.add(device_usage, "gpu" + std::to_string(m_device_numbers[device_idx]) + "/");
+    }
+    return usage;
+}
+
+void MultiGpuAlgorithm::set_logger(ILog::ptr log_object) {
+    BaseAlgorithm::set_logger(log_object);
+    for_each_device([&](GpuAlgorithm& device) {
+        device.set_logger(log_object);
+    });
+}
+
+void MultiGpuAlgorithm::set_line_callback(LineCallback callback) {
+    BaseAlgorithm::set_line_callback(callback);
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        if (!callback) {
+            m_devices[device_idx]->set_line_callback(nullptr);
+            continue;
+        }
+        // goes through m_line_callback, which is suspended for the internal
+        // frames of e.g. simulate_packets()
+        m_devices[device_idx]->set_line_callback([this, device_idx](size_t line_no, const std::complex<float>* iq_samples) {
+            if (m_line_callback) {
+                m_line_callback(static_cast<size_t>(m_first_lines[device_idx]) + line_no, iq_samples);
+            }
+        });
+    }
+}
+
+void MultiGpuAlgorithm::get_output_dimensions(size_t& num_lines, size_t& num_samples) const {
+    if (!m_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to get output dimensions");
+    }
+    // the number of samples does not depend on the lines of a device
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        if (m_num_lines[device_idx] > 0) {
+            size_t device_num_lines;
+            m_devices[device_idx]->get_output_dimensions(device_num_lines, num_samples);
+            break;
+        }
+    }
+    num_lines = static_cast<size_t>(m_scan_seq->get_num_lines());
+}
+
+float MultiGpuAlgorithm::get_output_start_time() const {
+    if (!m_scan_seq) {
+        throw std::runtime_error("Scan sequence must be configured to get the output start time");
+    }
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        if (m_num_lines[device_idx] > 0) {
+            return m_devices[device_idx]->get_output_start_time();
+        }
+    }
+    return 0.0f;
+}
+
+void MultiGpuAlgorithm::simulate_lines(std::complex<float>* iq_buffer, size_t line_stride) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    // the devices keep the positions in the noise stream
+    const auto cache_key = state_has_noise() ? std::string() : frame_cache_key(0);
+    if (!cache_key.empty() && read_cached_frame(cache_key, iq_buffer, line_stride)) {
+        return;
+    }
+    const auto frame_start = std::chrono::steady_clock::now();
+    simulate_on_devices([&](size_t device_idx) {
+        m_devices[device_idx]->simulate_lines(iq_buffer + m_first_lines[device_idx]*line_stride, line_stride);
+    });
+    count_frame(num_lines, frame_start);
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, iq_buffer, line_stride);
+    }
+}
+
+void MultiGpuAlgorithm::simulate_lines(std::vector<std::vector<std::complex<float> > >&  /*out*/ rf_lines) {
+    size_t num_lines, num_samples;
+    get_output_dimensions(num_lines, num_samples);
+    const auto cache_key = state_has_noise() ? std::string() : frame_cache_key(0);
+    if (!cache_key.empty() && read_cached_frame(cache_key, rf_lines)) {
+        return;
+    }
+    const auto frame_start = std::chrono::steady_clock::now();
+    simulate_on_devices([&](size_t device_idx) {
+        m_devices[device_idx]->simulate_lines(m_device_lines[device_idx]);
+    });
+    count_frame(num_lines, frame_start);
+
+    // swapping hands the previous output lines back to the devices for reuse
+    rf_lines.resize(num_lines);
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        for (int i = 0; i < m_num_lines[device_idx]; i++) {
+            std::swap(rf_lines[m_first_lines[device_idx] + i], m_device_lines[device_idx][i]);
+        }
+    }
+    if (!cache_key.empty()) {
+        write_cached_frame(cache_key, rf_lines);
+    }
+}
+
+template <typename F>
+void MultiGpuAlgorithm::simulate_on_devices(F simulate_range) {
+    const auto num_devices = m_devices.size();
+    std::vector<double> elapsed_seconds(num_devices, 0.0);
+    std::vector<std::exception_ptr> errors(num_devices);
+    std::vector<std::thread> threads;
+    for (size_t device_idx = 0; device_idx < num_devices; device_idx++) {
+        if (m_num_lines[device_idx] == 0) {
+            continue;
+        }
+        threads.emplace_back([&, device_idx]() {
+            try {
+                // the current device is per host thread
+                cudaErrorCheck( cudaSetDevice(m_device_numbers[device_idx]) );
+                const auto start = std::chrono::steady_clock::now();
+                simulate_range(device_idx);
+                elapsed_seconds[device_idx] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } catch (...) {
+                errors[device_idx] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (size_t device_idx = 0; device_idx < num_devices; device_idx++) {
+        if ((m_num_lines[device_idx] > 0) && (elapsed_seconds[device_idx] > 0.0)) {
+            const auto throughput = m_num_lines[device_idx]/elapsed_seconds[device_idx];
+            m_throughputs[device_idx] = 0.5*(m_throughputs[device_idx] + throughput);
+            m_debug_data["multi_gpu_device_ms"].push_back(1000.0*elapsed_seconds[device_idx]);
+        }
+    }
+    if (is_imbalanced()) {
+        m_log_object->write(ILog::INFO, "Redistributing lines between CUDA devices");
+        distribute_lines();
+    }
+}
+
+void MultiGpuAlgorithm::distribute_lines() {
+    const auto num_devices = m_devices.size();
+    const int num_lines = m_scan_seq->get_num_lines();
+    const double total_throughput = std::accumulate(m_throughputs.begin(), m_throughputs.end(), 0.0);
+
+    // largest remainder rounding of the proportional shares
+    std::vector<double> remainders(num_devices);
+    int num_assigned = 0;
+    for (size_t device_idx = 0; device_idx < num_devices; device_idx++) {
+        const double share = num_lines*m_throughputs[device_idx]/total_throughput;
+        m_num_lines[device_idx] = static_cast<int>(std::floor(share));
+        remainders[device_idx] = share - m_num_lines[device_idx];
+        num_assigned += m_num_lines[device_idx];
+    }
+    std::vector<size_t> order(num_devices);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return remainders[a] > remainders[b];
+    });
+    for (size_t i = 0; num_assigned < num_lines; i++, num_assigned++) {
+        m_num_lines[order[i % num_devices]]++;
+    }
+
+    int first_line = 0;
+    for (size_t device_idx = 0; device_idx < num_devices; device_idx++) {
+        m_first_lines[device_idx] = first_line;
+        if (m_num_lines[device_idx] > 0) {
+            const auto device_seq = line_range(*m_scan_seq, first_line, m_num_lines[device_idx]);
+            cudaErrorCheck( cudaSetDevice(m_device_numbers[device_idx]) );
+            m_devices[device_idx]->set_scan_sequence(device_seq);
+            // the noise of a line does not depend on the device it is simulated on
+            m_devices[device_idx]->set_parameter("gpu_noise_first_line", std::to_string(first_line));
+        }
+        first_line += m_num_lines[device_idx];
+    }
+}
+
+bool MultiGpuAlgorithm::is_imbalanced() const {
+    const double total_throughput = std::accumulate(m_throughputs.begin(), m_throughputs.end(), 0.0);
+    const double balanced_seconds = m_scan_seq->get_num_lines()/total_throughput;
+    double max_seconds = 0.0;
+    for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+        max_seconds = std::max(max_seconds, m_num_lines[device_idx]/m_throughputs[device_idx]);
+    }
+    // changing the split reconfigures the devices, which is not free
+    return max_seconds > 1.1*balanced_seconds;
+}
+
+}   // end namespace
+
+#endif  // BCSIM_ENABLE_CUDA
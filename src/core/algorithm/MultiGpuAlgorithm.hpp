@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifdef BCSIM_ENABLE_CUDA
+#pragma once
+#include <vector>
+#include <memory>
+#include "BaseAlgorithm.hpp"
+#include "GpuAlgorithm.hpp"
+
+namespace bcsim {
+
+// Simulates a frame on all CUDA devices, each owning a GpuAlgorithm with a
+// copy of the scatterer datasets. The lines of the scan sequence are split
+// into contiguous ranges weighted by the measured throughput of the devices,
+// and the devices write their lines directly into the output.
+class MultiGpuAlgorithm : public BaseAlgorithm {
+public:
+    MultiGpuAlgorithm();
+
+    virtual ~MultiGpuAlgorithm();
+
+    // All parameters except "gpu_device" are forwarded to all devices.
+    virtual void set_parameter(const std::string& key, const std::string& value)        override;
+
+    virtual std::string get_parameter(const std::string& key) const                     override;
+
+    virtual void simulate_lines(std::vector<std::vector<std::complex<float>> >&  /*out*/ rf_lines) override;
+
+    virtual void get_output_dimensions(size_t& num_lines, size_t& num_samples) const    override;
+
+    virtual float get_output_start_time() const                                         override;
+
+    virtual void simulate_lines(std::complex<float>* iq_buffer, size_t line_stride)     override;
+
+    virtual void set_scan_sequence(ScanSequence::s_ptr new_scan_sequence)               override;
+
+    virtual void set_excitation(const ExcitationSignal& new_excitation)                 override;
+
+    virtual void set_analytical_profile(IBeamProfile::s_ptr beam_profile)               override;
+
+    virtual void set_lookup_profile(IBeamProfile::s_ptr beam_profile)                   override;
+
+    virtual void clear_fixed_scatterers()                                               override;
+
+    virtual void add_fixed_scatterers(FixedScatterers::s_ptr)                           override;
+
+    virtual void add_external_fixed_scatterers(ExternalFixedScatterers::s_ptr)          override;
+
+    virtual void add_procedural_scatterers(ProceduralScatterers::s_ptr)                 override;
+
+    virtual void add_image_volume_scatterers(ImageVolumeScatterers::s_ptr)              override;
+
+    virtual void clear_spline_scatterers()                                              override;
+
+    virtual void add_spline_scatterers(SplineScatterers::s_ptr)                         override;
+
+    virtual void update_fixed_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                         const std::vector<PointScatterer>& new_scatterers) override;
+
+    virtual void update_spline_scatterers(size_t dset_idx, const std::vector<size_t>& indices,
+                                          const SplineScatterers& new_scatterers)           override;
+
+    virtual size_t get_total_num_scatterers() const                                     override;
+
+    // The usage of every device is prefixed with "gpu<device number>/".
+    virtual MemoryUsage get_memory_usage() const                                        override;
+
+    // Each device is predicted with the full scan sequence as an upper bound.
+    virtual MemoryUsage predict_memory_usage(const ScanSequence& scan_seq, size_t num_fixed_scatterers,
+                                             size_t num_spline_scatterers, int num_cs) const override;
+
+    virtual void set_logger(ILog::ptr log_object)                                       override;
+
+    // The devices call the callback with the line numbers of the whole frame.
+    virtual void set_line_callback(LineCallback callback)                               override;
+
+protected:
+    virtual ScanSequence::s_ptr current_scan_sequence() const override {
+        return m_scan_seq;
+    }
+
+    // Call a function for every device with its CUDA device current.
+    template <typename F>
+    void for_each_device(F f) {
+        for (size_t device_idx = 0; device_idx < m_devices.size(); device_idx++) {
+            cudaErrorCheck( cudaSetDevice(m_device_numbers[device_idx]) );
+            f(*m_devices[device_idx]);
+        }
+    }
+
+    // Simulate the line range of every device concurrently, one host
+    // thread per device, and update the throughput estimates.
+    template <typename F>
+    void simulate_on_devices(F simulate_range);
+
+    // Split the lines over the devices proportionally to their throughput,
+    // and configure the devices with their part of the scan sequence.
+    void distribute_lines();
+
+    // True if the predicted frame time with the current split is far from
+    // the balanced one.
+    bool is_imbalanced() const;
+
+protected:
+    std::vector<int>                        m_device_numbers;
+    std::vector<std::unique_ptr<GpuAlgorithm>> m_devices;
+
+    // The complete scan sequence, and the first line and number of lines
+    // of every device (devices without lines are not simulated).
+    ScanSequence::s_ptr                     m_scan_seq;
+    std::vector<int>                        m_first_lines;
+    std::vector<int>                        m_num_lines;
+
+    // Measured lines per second of every device (smoothed over frames).
+    std::vector<double>                     m_throughputs;
+
+    // per-device output of the vector-of-lines simulate_lines()
+    std::vector<std::vector<std::vector<std::complex<float>>>> m_device_lines;
+};
+
+}   // end namespace
+#endif  // BCSIM_ENABLE_CUDA
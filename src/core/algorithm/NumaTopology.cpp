@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "NumaTopology.hpp"
+#ifdef __linux__
+    #include <sched.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+#endif
+
+namespace bcsim {
+
+NumaTopology::NumaTopology()
+    : m_node_cpus(1),
+      m_node_ids(1, 0)
+{ }
+
+NumaTopology::NumaTopology(const std::vector<std::vector<int>>& node_cpus)
+    : m_node_cpus(node_cpus)
+{
+    if (m_node_cpus.empty()) {
+        throw std::runtime_error("a NUMA topology needs at least one node");
+    }
+    for (size_t node_no = 0; node_no < m_node_cpus.size(); node_no++) {
+        m_node_ids.push_back(static_cast<int>(node_no));
+    }
+}
+
+NumaTopology NumaTopology::detect() {
+#ifdef __linux__
+    // only the CPUs the process may run on
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool known_allowed = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    // the nodes are node0, node1, ... of which some may be offline
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string node_list;
+    if (online && std::getline(online, node_list)) {
+        try {
+            std::vector<std::vector<int>> node_cpus;
+            std::vector<int> node_ids;
+            for (const auto node_no : parse_cpu_list(node_list)) {
+                std::ifstream in("/sys/devices/system/node/node" + std::to_string(node_no) + "/cpulist");
+                std::string cpu_list;
+                std::getline(in, cpu_list);
+                auto cpus = parse_cpu_list(cpu_list);
+                if (known_allowed) {
+                    cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) {
+                        return (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed);
+                    }), cpus.end());
+                }
+                // nodes with memory but no CPUs do not run threads
+                if (!cpus.empty()) {
+                    node_cpus.push_back(cpus);
+                    node_ids.push_back(node_no);
+                }
+            }
+            if (!node_cpus.empty()) {
+                NumaTopology topology(node_cpus);
+                topology.m_node_ids = node_ids;
+                return topology;
+            }
+        } catch (const std::runtime_error&) {
+            // fall back to one node
+        }
+    }
+#endif
+    return NumaTopology();
+}
+
+std::vector<int> NumaTopology::parse_cpu_list(const std::string& cpu_list) {
+    std::vector<int> cpus;
+    std::istringstream in(cpu_list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            const auto dash = range.find('-');
+            const auto first = std::stoi(range.substr(0, dash));
+            const auto last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            if ((first < 0) || (last < first)) {
+                throw std::invalid_argument(range);
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("malformed CPU list: " + cpu_list);
+        }
+    }
+    return cpus;
+}
+
+void NumaTopology::assign_threads(int num_threads, std::vector<int>& cpus, std::vector<int>& nodes) const {
+    std::vector<int> all_cpus;
+    std::vector<int> cpu_nodes;
+    for (size_t node_no = 0; node_no < m_node_cpus.size(); node_no++) {
+        for (const auto cpu : m_node_cpus[node_no]) {
+            all_cpus.push_back(cpu);
+            cpu_nodes.push_back(static_cast<int>(node_no));
+        }
+    }
+    cpus.assign(num_threads, -1);
+    nodes.assign(num_threads, 0);
+    if (all_cpus.empty()) {
+        return;
+    }
+    for (int thread_no = 0; thread_no < num_threads; thread_no++) {
+        const auto cpu_index = (static_cast<size_t>(thread_no)*all_cpus.size()/num_threads) % all_cpus.size();
+        cpus[thread_no] = all_cpus[cpu_index];
+        nodes[thread_no] = cpu_nodes[cpu_index];
+    }
+}
+
+bool NumaTopology::pin_calling_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const auto cpu : cpus) {
+        if ((cpu < 0) || (cpu >= CPU_SETSIZE)) {
+            return false;
+        }
+        CPU_SET(cpu, &cpu_set);
+    }
+    return !cpus.empty() && (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0);
+#else
+    (void) cpus;
+    return false;
+#endif
+}
+
+bool NumaTopology::interleave_pages(const void* data, size_t num_bytes) const {
+#if defined(__linux__) && defined(SYS_mbind)
+    if ((m_node_cpus.size() < 2) || (num_bytes == 0)) {
+        return false;
+    }
+    // the constants of <numaif.h>, which needs libnuma
+    const int MPOL_INTERLEAVE_ = 3;
+    const unsigned MPOL_MF_MOVE_ = 1u << 1;
+    const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+    const auto end = reinterpret_cast<uintptr_t>(data) + num_bytes;
+    const int max_node_id = *std::max_element(m_node_ids.begin(), m_node_ids.end());
+    const size_t bits_per_word = 8*sizeof(unsigned long);
+    std::vector<unsigned long> node_mask(max_node_id/bits_per_word + 1, 0);
+    for (const auto node_id : m_node_ids) {
+        node_mask[node_id/bits_per_word] |= 1ul << (node_id%bits_per_word);
+    }
+    return syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE_, node_mask.data(),
+                   static_cast<unsigned long>(max_node_id) + 2, MPOL_MF_MOVE_) == 0;
+#else
+    (void) data;
+    (void) num_bytes;
+    return false;
+#endif
+}
+
+}   // end namespace
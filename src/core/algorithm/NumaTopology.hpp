@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace bcsim {
+
+// The NUMA nodes of the machine and the CPUs of each node. The topology is
+// read from sysfs on Linux, elsewhere the machine is one node.
+class NumaTopology {
+public:
+    // One node with no known CPUs.
+    NumaTopology();
+
+    // The CPU numbers of each node, which are numbered from zero.
+    explicit NumaTopology(const std::vector<std::vector<int>>& node_cpus);
+
+    // The topology of this machine.
+    static NumaTopology detect();
+
+    // The CPU numbers of a list like "0-3,8,10-11". Throws std::runtime_error
+    // if it is malformed.
+    static std::vector<int> parse_cpu_list(const std::string& cpu_list);
+
+    size_t get_num_nodes() const {
+        return m_node_cpus.size();
+    }
+
+    const std::vector<int>& get_cpus(size_t node_no) const {
+        return m_node_cpus[node_no];
+    }
+
+    // The CPU and node of each of num_threads threads, which are spread
+    // evenly over the CPUs in the order of the nodes, so that consecutive
+    // threads share a node. Threads get node 0 and CPU -1 if no CPUs are known.
+    void assign_threads(int num_threads, std::vector<int>& cpus, std::vector<int>& nodes) const;
+
+    // Restrict the calling thread to a set of CPUs. Returns false if that is
+    // not supported or failed.
+    static bool pin_calling_thread(const std::vector<int>& cpus);
+
+    // Spread the pages of a buffer round-robin over the nodes, moving the
+    // pages that are already allocated. Returns false if that is not
+    // supported or failed, which leaves the pages where they are.
+    bool interleave_pages(const void* data, size_t num_bytes) const;
+
+private:
+    std::vector<std::vector<int>>   m_node_cpus;
+    // the system's number of each node
+    std::vector<int>                m_node_ids;
+};
+
+}   // end namespace
@@ -0,0 +1,441 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "ScattererGrid.hpp"
+
+namespace bcsim {
+namespace {
+
+// Number of cells along an axis with extent ext [m].
+int num_cells(float ext, float cell_size) {
+    return std::max(1, static_cast<int>(std::ceil(ext/cell_size)));
+}
+
+// Distance from a point to the line segment from p0 to p1.
+float distance_to_segment(const vector3& p, const vector3& p0, const vector3& p1) {
+    const auto seg = p1 - p0;
+    const auto len_squared = seg.norm_squared();
+    float t = 0.0f;
+    if (len_squared > 0.0f) {
+        t = std::min(1.0f, std::max(0.0f, (p - p0).dot(seg)/len_squared));
+    }
+    return (p - (p0 + seg*t)).norm();
+}
+
+// Interleave the lowest 21 bits of the cell coordinates.
+uint64_t morton_code(uint32_t ix, uint32_t iy, uint32_t iz) {
+    const auto spread = [](uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | (v << 32)) & 0x1f00000000ffffull;
+        v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+        v = (v | (v << 8))  & 0x100f00f00f00f00full;
+        v = (v | (v << 4))  & 0x10c30c30c30c30c3ull;
+        v = (v | (v << 2))  & 0x1249249249249249ull;
+        return v;
+    };
+    return spread(ix) | (spread(iy) << 1) | (spread(iz) << 2);
+}
+
+}   // end anonymous namespace
+
+ScattererGrid::ScattererGrid()
+    : m_min(0.0f, 0.0f, 0.0f), m_cell_size(1.0f), m_nx(0), m_ny(0), m_nz(0), m_num_subsets(1) { }
+
+ScattererGrid::Tables ScattererGrid::get_tables() const {
+    Tables tables;
+    tables.min         = m_min;
+    tables.cell_size   = m_cell_size;
+    tables.nx          = m_nx;
+    tables.ny          = m_ny;
+    tables.nz          = m_nz;
+    tables.num_subsets = m_num_subsets;
+    tables.cell_starts = m_cell_starts;
+    tables.cell_ranks  = m_cell_ranks;
+    return tables;
+}
+
+void ScattererGrid::set_tables(Tables tables, size_t num_scatterers) {
+    if (tables.cell_starts.empty()) {
+        *this = ScattererGrid();
+        return;
+    }
+    if ((tables.nx <= 0) || (tables.ny <= 0) || (tables.nz <= 0) || (tables.num_subsets == 0)
+        || !(tables.cell_size > 0.0f)) {
+        throw std::runtime_error("invalid scatterer grid dimensions");
+    }
+    const auto total_num_cells = static_cast<uint64_t>(tables.nx)*tables.ny*tables.nz;
+    if ((tables.cell_starts.size() - 1)/tables.num_subsets != total_num_cells
+        || (tables.cell_starts.size() - 1) % tables.num_subsets != 0) {
+        throw std::runtime_error("invalid number of scatterer grid cells");
+    }
+    if ((tables.cell_starts.front() != 0) || (tables.cell_starts.back() != num_scatterers)
+        || !std::is_sorted(tables.cell_starts.begin(), tables.cell_starts.end())) {
+        throw std::runtime_error("invalid scatterer grid cell starts");
+    }
+    if (!tables.cell_ranks.empty()) {
+        if (tables.cell_ranks.size() != total_num_cells) {
+            throw std::runtime_error("invalid number of scatterer grid cell ranks");
+        }
+        for (auto rank : tables.cell_ranks) {
+            if (rank >= total_num_cells) {
+                throw std::runtime_error("invalid scatterer grid cell rank");
+            }
+        }
+    }
+    m_min         = tables.min;
+    m_cell_size   = tables.cell_size;
+    m_nx          = tables.nx;
+    m_ny          = tables.ny;
+    m_nz          = tables.nz;
+    m_num_subsets = tables.num_subsets;
+    m_cell_starts = std::move(tables.cell_starts);
+    m_cell_ranks  = std::move(tables.cell_ranks);
+}
+
+void ScattererGrid::build(const float* xs, const float* ys, const float* zs, size_t num_scatterers,
+                          std::vector<uint32_t>& permutation, size_t num_per_cell, CellOrder order,
+                          size_t num_subsets) {
+    if (num_scatterers == 0) {
+        throw std::runtime_error("cannot build scatterer grid without scatterers");
+    }
+    if (num_subsets == 0) {
+        throw std::runtime_error("number of scatterer subsets must be positive");
+    }
+    if (num_scatterers > UINT32_MAX) {
+        throw std::runtime_error("too many scatterers for scatterer grid");
+    }
+
+    const auto x_lim = std::minmax_element(xs, xs + num_scatterers);
+    const auto y_lim = std::minmax_element(ys, ys + num_scatterers);
+    const auto z_lim = std::minmax_element(zs, zs + num_scatterers);
+    m_min = vector3(*x_lim.first, *y_lim.first, *z_lim.first);
+    const auto ext_x = *x_lim.second - *x_lim.first;
+    const auto ext_y = *y_lim.second - *y_lim.first;
+    const auto ext_z = *z_lim.second - *z_lim.first;
+    const auto max_ext = std::max(ext_x, std::max(ext_y, ext_z));
+
+    // Find the smallest cell size which gives at most the target number of
+    // cells. Flat or elongated phantoms may have a single cell in some
+    // directions, so the cell size is found by bisection.
+    const double target_num_cells = std::max(1.0, static_cast<double>(num_scatterers)/std::max<size_t>(1, num_per_cell));
+    m_cell_size = 1.0f;
+    if (max_ext > 0.0f) {
+        float lo = max_ext*1e-6f;
+        float hi = max_ext;
+        for (int iter = 0; iter < 50; iter++) {
+            const float mid = 0.5f*(lo + hi);
+            const double cur_num_cells = static_cast<double>(num_cells(ext_x, mid))*num_cells(ext_y, mid)*num_cells(ext_z, mid);
+            if (cur_num_cells > target_num_cells) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        m_cell_size = hi;
+    }
+    m_nx = num_cells(ext_x, m_cell_size);
+    m_ny = num_cells(ext_y, m_cell_size);
+    m_nz = num_cells(ext_z, m_cell_size);
+
+    // rank the cells along the Z-order curve
+    const size_t total_num_cells = static_cast<size_t>(m_nx)*m_ny*m_nz;
+    m_cell_ranks.clear();
+    if (order == CellOrder::MORTON) {
+        std::vector<std::pair<uint64_t, uint32_t>> codes;
+        codes.reserve(total_num_cells);
+        for (int iz = 0; iz < m_nz; iz++) {
+            for (int iy = 0; iy < m_ny; iy++) {
+                for (int ix = 0; ix < m_nx; ix++) {
+                    codes.emplace_back(morton_code(ix, iy, iz), static_cast<uint32_t>(codes.size()));
+                }
+            }
+        }
+        std::sort(codes.begin(), codes.end());
+        m_cell_ranks.resize(total_num_cells);
+        for (size_t rank = 0; rank < total_num_cells; rank++) {
+            m_cell_ranks[codes[rank].second] = static_cast<uint32_t>(rank);
+        }
+    }
+
+    // counting sort of the scatterers by subset and cell index. The k-th
+    // scatterer of a cell goes to subset (k + start) % num_subsets, where the
+    // start of the cell is hashed from its index.
+    m_num_subsets = num_subsets;
+    const auto num_slots = num_subsets*total_num_cells;
+    std::vector<uint32_t> cell_indices(num_scatterers);
+    std::vector<uint32_t> num_dealt(num_subsets > 1 ? total_num_cells : 0);
+    m_cell_starts.assign(num_slots + 1, 0);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        const auto cell_no = static_cast<uint32_t>(cell_index(xs[i], ys[i], zs[i]));
+        size_t subset = 0;
+        if (num_subsets > 1) {
+            const auto start = (cell_no*2654435761u) >> 7;
+            subset = (num_dealt[cell_no]++ + start) % num_subsets;
+        }
+        cell_indices[i] = static_cast<uint32_t>(subset*total_num_cells + cell_no);
+        m_cell_starts[cell_indices[i] + 1]++;
+    }
+    for (size_t slot_no = 0; slot_no < num_slots; slot_no++) {
+        m_cell_starts[slot_no + 1] += m_cell_starts[slot_no];
+    }
+    std::vector<uint32_t> next_slot(m_cell_starts.begin(), m_cell_starts.end() - 1);
+    permutation.resize(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        permutation[next_slot[cell_indices[i]]++] = static_cast<uint32_t>(i);
+    }
+}
+
+uint32_t ScattererGrid::cell_rank(int ix, int iy, int iz) const {
+    const auto cell_no = static_cast<uint32_t>((iz*m_ny + iy)*m_nx + ix);
+    return m_cell_ranks.empty() ? cell_no : m_cell_ranks[cell_no];
+}
+
+int ScattererGrid::cell_index(float x, float y, float z) const {
+    const auto ix = std::min(m_nx - 1, static_cast<int>((x - m_min.x)/m_cell_size));
+    const auto iy = std::min(m_ny - 1, static_cast<int>((y - m_min.y)/m_cell_size));
+    const auto iz = std::min(m_nz - 1, static_cast<int>((z - m_min.z)/m_cell_size));
+    return static_cast<int>(cell_rank(ix, iy, iz));
+}
+
+bool ScattererGrid::is_in_cell_of(const vector3& pos, size_t sorted_index) const {
+    if (empty()) {
+        return true;
+    }
+    if (sorted_index >= m_cell_starts.back()) {
+        throw std::runtime_error("scatterer index outside of scatterer grid");
+    }
+
+    // points outside of the grid are in none of the cells.
+    auto to_cell = [&](float v, float v_min, int n, int& cell) {
+        const float f = (v - v_min)/m_cell_size;
+        cell = std::min(n - 1, static_cast<int>(f));
+        return (f >= 0.0f) && (f <= static_cast<float>(n));
+    };
+    int ix, iy, iz;
+    if (!to_cell(pos.x, m_min.x, m_nx, ix) || !to_cell(pos.y, m_min.y, m_ny, iy) || !to_cell(pos.z, m_min.z, m_nz, iz)) {
+        return false;
+    }
+
+    // the last cell starting at or before the index holds the scatterer
+    const auto it = std::upper_bound(m_cell_starts.begin(), m_cell_starts.end(), static_cast<uint32_t>(sorted_index));
+    const auto num_cells = (m_cell_starts.size() - 1)/m_num_subsets;
+    const auto cell = static_cast<uint32_t>((it - m_cell_starts.begin() - 1) % num_cells);
+    return cell_rank(ix, iy, iz) == cell;
+}
+
+void ScattererGrid::find_ranges(const vector3& p0, const vector3& p1, float radius, std::vector<IndexRange>& ranges) const {
+    find_ranges(p0, p1, radius, 0, m_num_subsets, ranges);
+}
+
+void ScattererGrid::find_ranges(const vector3& p0, const vector3& p1, float radius, size_t first_subset, size_t end_subset,
+                                std::vector<IndexRange>& ranges) const {
+    ranges.clear();
+    if (empty()) {
+        return;
+    }
+
+    // Cells overlapping the bounding box of the segment expanded by the radius.
+    auto to_cell = [&](float v, float v_min, int n) {
+        return std::min(n - 1, std::max(0, static_cast<int>(std::floor((v - v_min)/m_cell_size))));
+    };
+    const int ix0 = to_cell(std::min(p0.x, p1.x) - radius, m_min.x, m_nx);
+    const int ix1 = to_cell(std::max(p0.x, p1.x) + radius, m_min.x, m_nx);
+    const int iy0 = to_cell(std::min(p0.y, p1.y) - radius, m_min.y, m_ny);
+    const int iy1 = to_cell(std::max(p0.y, p1.y) + radius, m_min.y, m_ny);
+    const int iz0 = to_cell(std::min(p0.z, p1.z) - radius, m_min.z, m_nz);
+    const int iz1 = to_cell(std::max(p0.z, p1.z) + radius, m_min.z, m_nz);
+
+    // A cell can contain points within the radius if its center is within
+    // the radius plus half the cell diagonal.
+    const float max_dist = radius + 0.8660254f*m_cell_size;
+    const auto num_cells = (m_cell_starts.size() - 1)/m_num_subsets;
+    for (int iz = iz0; iz <= iz1; iz++) {
+        for (int iy = iy0; iy <= iy1; iy++) {
+            for (int ix = ix0; ix <= ix1; ix++) {
+                const vector3 center(m_min.x + (ix + 0.5f)*m_cell_size,
+                                     m_min.y + (iy + 0.5f)*m_cell_size,
+                                     m_min.z + (iz + 0.5f)*m_cell_size);
+                if (distance_to_segment(center, p0, p1) > max_dist) {
+                    continue;
+                }
+                const auto cell_no = cell_rank(ix, iy, iz);
+                for (size_t subset = first_subset; subset < end_subset; subset++) {
+                    const auto slot_no = subset*num_cells + cell_no;
+                    const size_t first = m_cell_starts[slot_no];
+                    const size_t last  = m_cell_starts[slot_no + 1];
+                    if (first == last) {
+                        continue;
+                    }
+                    if (!ranges.empty() && (ranges.back().second == first)) {
+                        ranges.back().second = last;
+                    } else {
+                        ranges.emplace_back(first, last);
+                    }
+                }
+            }
+        }
+    }
+
+    // the cells are not visited in rank order along the Z-order curve, and
+    // the subsets of a cell are apart.
+    if ((!m_cell_ranks.empty() || (end_subset - first_subset > 1)) && (ranges.size() > 1)) {
+        std::sort(ranges.begin(), ranges.end());
+        size_t num_merged = 0;
+        for (size_t i = 1; i < ranges.size(); i++) {
+            if (ranges[num_merged].second == ranges[i].first) {
+                ranges[num_merged].second = ranges[i].second;
+            } else {
+                ranges[++num_merged] = ranges[i];
+            }
+        }
+        ranges.resize(num_merged + 1);
+    }
+}
+
+BeamCullingRegion gaussian_culling_region(float sigma_lateral, float sigma_elevational, float num_sigmas,
+                                          float sample_dist, size_t num_samples) {
+    // the time-projection covers radial distances up to the last sample,
+    // an additional sample is included on each side for rounding.
+    BeamCullingRegion region;
+    region.r_min  = -sample_dist;
+    region.r_max  = (num_samples + 1)*sample_dist;
+    region.radius = num_sigmas*std::max(sigma_lateral, sigma_elevational);
+    return region;
+}
+
+BeamCullingRegion lut_culling_region(const Interval& rad_range, const Interval& lat_range, const Interval& ele_range,
+                                     int num_samples_rad, int num_samples_lat, int num_samples_ele,
+                                     bool use_arc_projection, float sample_dist, size_t num_samples) {
+    BeamCullingRegion region;
+    region.r_min = -sample_dist;
+    region.r_max = (num_samples + 1)*sample_dist;
+
+    // the interpolation is non-zero up to one table cell outside of the ranges.
+    const auto dr = std::abs(rad_range.last - rad_range.first)/(num_samples_rad - 1);
+    const auto dl = std::abs(lat_range.last - lat_range.first)/(num_samples_lat - 1);
+    const auto de = std::abs(ele_range.last - ele_range.first)/(num_samples_ele - 1);
+    const auto max_lat = std::max(std::abs(lat_range.first), std::abs(lat_range.last)) + dl;
+    const auto max_ele = std::max(std::abs(ele_range.first), std::abs(ele_range.last)) + de;
+    region.radius = std::sqrt(max_lat*max_lat + max_ele*max_ele);
+
+    // with arc projection, the radial distance is larger than the projection onto the beam.
+    if (!use_arc_projection) {
+        region.r_min = std::max(region.r_min, std::min(rad_range.first, rad_range.last) - dr);
+    }
+    region.r_max = std::min(region.r_max, std::max(rad_range.first, rad_range.last) + dr);
+    return region;
+}
+
+BeamCullingRegion multi_resolution_lut_culling_region(const MultiResolutionLUTBeamProfile& profile,
+                                                      bool use_arc_projection, float sample_dist, size_t num_samples) {
+    BeamCullingRegion region;
+    for (int zone_no = 0; zone_no < profile.getNumZones(); zone_no++) {
+        const auto& zone = profile.getZone(zone_no);
+        const auto zone_region = lut_culling_region(zone.getRangeRange(), zone.getLateralRange(), zone.getElevationalRange(),
+                                                    zone.getNumSamplesRadial(), zone.getNumSamplesLateral(), zone.getNumSamplesElevational(),
+                                                    use_arc_projection, sample_dist, num_samples);
+        if (zone_no == 0) {
+            region = zone_region;
+        } else {
+            region.r_min  = std::min(region.r_min, zone_region.r_min);
+            region.r_max  = std::max(region.r_max, zone_region.r_max);
+            region.radius = std::max(region.radius, zone_region.radius);
+        }
+    }
+    return region;
+}
+
+void ScattererGrid::find_ranges(const Scanline& line, const BeamCullingRegion& region, std::vector<IndexRange>& ranges) const {
+    const auto p0 = line.get_origin() + line.get_direction()*region.r_min;
+    const auto p1 = line.get_origin() + line.get_direction()*region.r_max;
+    find_ranges(p0, p1, region.radius, ranges);
+}
+
+void ScattererGrid::find_ranges(const Scanline& line, const BeamCullingRegion& region, size_t first_subset, size_t end_subset,
+                                std::vector<IndexRange>& ranges) const {
+    const auto p0 = line.get_origin() + line.get_direction()*region.r_min;
+    const auto p1 = line.get_origin() + line.get_direction()*region.r_max;
+    find_ranges(p0, p1, region.radius, first_subset, end_subset, ranges);
+}
+
+void find_voxel_ranges(const ImageVolumeScatterers& volume, const Scanline& line, const BeamCullingRegion& region,
+                       std::vector<ScattererGrid::IndexRange>& ranges) {
+    ranges.clear();
+    if (volume.get_count() == 0) {
+        return;
+    }
+    const auto p0 = line.get_origin() + line.get_direction()*region.r_min;
+    const auto p1 = line.get_origin() + line.get_direction()*region.r_max;
+    const auto radius = region.radius;
+    const auto& size = volume.voxel_size;
+    auto to_voxel = [](float v, float v_min, float voxel_size, int n) {
+        return std::min(n - 1, std::max(0, static_cast<int>(std::floor((v - v_min)/voxel_size))));
+    };
+    const auto& origin = volume.origin;
+    const int ix0 = to_voxel(std::min(p0.x, p1.x) - radius, origin.x, size.x, volume.nx);
+    const int ix1 = to_voxel(std::max(p0.x, p1.x) + radius, origin.x, size.x, volume.nx);
+    const int iy0 = to_voxel(std::min(p0.y, p1.y) - radius, origin.y, size.y, volume.ny);
+    const int iy1 = to_voxel(std::max(p0.y, p1.y) + radius, origin.y, size.y, volume.ny);
+    const int iz0 = to_voxel(std::min(p0.z, p1.z) - radius, origin.z, size.z, volume.nz);
+    const int iz1 = to_voxel(std::max(p0.z, p1.z) + radius, origin.z, size.z, volume.nz);
+
+    // as for the grid cells, with the half diagonal of a voxel
+    const float max_dist = radius + 0.5f*size.norm();
+    for (int iz = iz0; iz <= iz1; iz++) {
+        for (int iy = iy0; iy <= iy1; iy++) {
+            int run_begin = -1;
+            for (int ix = ix0; ix <= ix1 + 1; ix++) {
+                bool is_close = false;
+                if (ix <= ix1) {
+                    const vector3 center(origin.x + (ix + 0.5f)*size.x,
+                                         origin.y + (iy + 0.5f)*size.y,
+                                         origin.z + (iz + 0.5f)*size.z);
+                    is_close = distance_to_segment(center, p0, p1) <= max_dist;
+                }
+                if (is_close && (run_begin < 0)) {
+                    run_begin = ix;
+                } else if (!is_close && (run_begin >= 0)) {
+                    const size_t first = volume.voxel_starts[volume.voxel_index(run_begin, iy, iz)];
+                    const size_t last  = volume.voxel_starts[volume.voxel_index(ix - 1, iy, iz) + 1];
+                    if (!ranges.empty() && (ranges.back().second == first)) {
+                        ranges.back().second = last;
+                    } else if (first < last) {
+                        ranges.emplace_back(first, last);
+                    }
+                    run_begin = -1;
+                }
+            }
+        }
+    }
+}
+
+}   // end namespace
@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "../vector3.hpp"
+#include "../BCSimConfig.hpp"
+#include "../ScanSequence.hpp"
+#include "../BeamProfile.hpp"
+
+namespace bcsim {
+
+// Region around a beam outside of which scatterers give no contribution:
+// all points within distance radius from the beam axis segment between the
+// radial distances r_min and r_max.
+struct BeamCullingRegion {
+    float r_min;
+    float r_max;
+    float radius;
+};
+
+// Culling region for the analytical Gaussian beam profile, which is cut off
+// at num_sigmas. sample_dist is the radial distance between time samples and
+// num_samples the length of the time-projection.
+BeamCullingRegion gaussian_culling_region(float sigma_lateral, float sigma_elevational, float num_sigmas,
+                                          float sample_dist, size_t num_samples);
+
+// Culling region for a lookup-table beam profile with the given extents and
+// number of samples in each direction, which is zero outside of the table.
+BeamCullingRegion lut_culling_region(const Interval& rad_range, const Interval& lat_range, const Interval& ele_range,
+                                     int num_samples_rad, int num_samples_lat, int num_samples_ele,
+                                     bool use_arc_projection, float sample_dist, size_t num_samples);
+
+// Culling region for a multi-resolution lookup-table beam profile: the union
+// of the regions of its zones.
+BeamCullingRegion multi_resolution_lut_culling_region(const MultiResolutionLUTBeamProfile& profile,
+                                                      bool use_arc_projection, float sample_dist, size_t num_samples);
+
+// Uniform grid over a fixed set of scatterer positions. The scatterers are
+// sorted by grid cell, so that the scatterers in a cell, and in consecutive
+// cells, are contiguous. This allows finding the scatterers that are close
+// to a beam as a few index ranges without testing all of them.
+class ScattererGrid {
+public:
+    typedef std::pair<size_t, size_t> IndexRange;
+
+    // Order of the cells, and hence of the sorted scatterers. DEPTH sorts
+    // by z first, then by y and x. MORTON follows a Z-order curve through
+    // the cells, so that also consecutive cells are close in all directions.
+    enum class CellOrder {
+        DEPTH,
+        MORTON
+    };
+
+    // Create an empty grid.
+    ScattererGrid();
+
+    // Build the grid with approximately num_per_cell scatterers in each cell.
+    // The scatterers must be reordered according to permutation, i.e.
+    // sorted[i] = original[permutation[i]], before using find_ranges().
+    // With num_subsets > 1, the scatterers of every cell are dealt round-robin
+    // from a pseudo-random start to that many stratified subsets, and sorted
+    // by subset first, so that the scatterers of consecutive subsets are
+    // contiguous and every subset covers the whole phantom.
+    void build(const float* xs, const float* ys, const float* zs, size_t num_scatterers,
+               std::vector<uint32_t>& permutation, size_t num_per_cell = 16, CellOrder order = CellOrder::DEPTH,
+               size_t num_subsets = 1);
+
+    bool empty() const {
+        return m_cell_starts.empty();
+    }
+
+    size_t get_num_subsets() const {
+        return m_num_subsets;
+    }
+
+    // The sorted scatterer indices of the subsets [first_subset, end_subset).
+    IndexRange subset_range(size_t first_subset, size_t end_subset) const {
+        const auto num_cells = (m_cell_starts.size() - 1)/m_num_subsets;
+        return IndexRange(m_cell_starts[first_subset*num_cells], m_cell_starts[end_subset*num_cells]);
+    }
+
+    // Find the half-open ranges of sorted scatterer indices in all grid cells
+    // which may contain points within distance radius from the line segment
+    // from p0 to p1. The ranges are in ascending order and consecutive cells
+    // are merged into one range.
+    void find_ranges(const vector3& p0, const vector3& p1, float radius, std::vector<IndexRange>& ranges) const;
+
+    // Same for the culling region of a scanline.
+    void find_ranges(const Scanline& line, const BeamCullingRegion& region, std::vector<IndexRange>& ranges) const;
+
+    // Same, but only in the subsets [first_subset, end_subset).
+    void find_ranges(const Scanline& line, const BeamCullingRegion& region, size_t first_subset, size_t end_subset,
+                     std::vector<IndexRange>& ranges) const;
+
+    // True if a point is inside the cell of the scatterer with the given
+    // sorted index, i.e. the scatterer can be moved there without sorting
+    // the scatterers again. Always true for an empty grid.
+    bool is_in_cell_of(const vector3& pos, size_t sorted_index) const;
+
+    // The complete grid, for storing it with the sorted scatterers and
+    // restoring it later without sorting them again.
+    struct Tables {
+        vector3                 min;
+        float                   cell_size;
+        int                     nx;
+        int                     ny;
+        int                     nz;
+        size_t                  num_subsets;
+        std::vector<uint32_t>   cell_starts;
+        std::vector<uint32_t>   cell_ranks;
+    };
+
+    Tables get_tables() const;
+
+    // Replace the grid with stored tables of a grid over num_scatterers
+    // sorted scatterers. Throws std::runtime_error if they are inconsistent.
+    void set_tables(Tables tables, size_t num_scatterers);
+
+    // Bytes of the cell tables.
+    size_t get_num_bytes() const {
+        return (m_cell_starts.capacity() + m_cell_ranks.capacity())*sizeof(uint32_t);
+    }
+
+    // Upper bound of get_num_bytes() after build() with these arguments.
+    static size_t predict_num_bytes(size_t num_scatterers, size_t num_per_cell = 16, CellOrder order = CellOrder::DEPTH,
+                                    size_t num_subsets = 1) {
+        const auto num_cells = num_scatterers/std::max<size_t>(1, num_per_cell) + 1;
+        return (num_subsets*num_cells + 1 + (order == CellOrder::DEPTH ? 0 : num_cells))*sizeof(uint32_t);
+    }
+
+private:
+    void find_ranges(const vector3& p0, const vector3& p1, float radius, size_t first_subset, size_t end_subset,
+                     std::vector<IndexRange>& ranges) const;
+
+    // Position of a cell in the cell order.
+    uint32_t cell_rank(int ix, int iy, int iz) const;
+
+    int cell_index(float x, float y, float z) const;
+
+private:
+    vector3                 m_min;          // lower corner of the grid
+    float                   m_cell_size;    // the cells are cubes
+    int                     m_nx;
+    int                     m_ny;
+    int                     m_nz;
+    size_t                  m_num_subsets;
+    // Index of the first scatterer in each cell of each subset, at
+    // subset*num_cells + cell, plus a final entry for the total number of
+    // scatterers. Empty if the grid has not been built.
+    std::vector<uint32_t>   m_cell_starts;
+    // Rank of each cell (ix, iy, iz) at (iz*m_ny + iy)*m_nx + ix. Empty for
+    // CellOrder::DEPTH, where this is the identity.
+    std::vector<uint32_t>   m_cell_ranks;
+};
+
+// The scatterers of an image volume in the voxels that can be within the
+// culling region of a line, as ranges of scatterer numbers in increasing
+// order. The voxels are independent of any grid, so every voxel run along x
+// gives at most one range.
+void find_voxel_ranges(const ImageVolumeScatterers& volume, const Scanline& line, const BeamCullingRegion& region,
+                       std::vector<ScattererGrid::IndexRange>& ranges);
+
+}   // end namespace
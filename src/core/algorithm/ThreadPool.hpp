@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace bcsim {
+
+// Worker threads shared by all simulators of the process, so that queueing
+// frames does not need a thread per simulator.
+class ThreadPool {
+public:
+    // The pool of the process with one thread per core, started on first use.
+    static ThreadPool& instance();
+
+    // Finishes the queued tasks.
+    ~ThreadPool();
+
+    // Run a task on one of the threads. The task must not throw.
+    void submit(std::function<void()> task);
+
+    size_t get_num_threads() const {
+        return m_threads.size();
+    }
+
+private:
+    explicit ThreadPool(size_t num_threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void worker_loop();
+
+    std::mutex                          m_mutex;
+    std::condition_variable             m_cond;
+    std::deque<std::function<void()>>   m_tasks;
+    bool                                m_stop;
+    std::vector<std::thread>            m_threads;
+};
+
+// Runs tasks one at a time in the order they were submitted on the threads
+// of the process' ThreadPool, which is only started by the first task.
+class SerialQueue {
+public:
+    SerialQueue();
+
+    // Waits for the submitted tasks.
+    ~SerialQueue();
+
+    // The task must not throw.
+    void submit(std::function<void()> task);
+
+    // Wait until all submitted tasks have finished.
+    void wait_idle();
+
+private:
+    SerialQueue(const SerialQueue&) = delete;
+    SerialQueue& operator=(const SerialQueue&) = delete;
+
+    void run_tasks();
+
+    std::mutex                          m_mutex;
+    std::condition_variable             m_idle_cond;
+    std::deque<std::function<void()>>   m_tasks;
+    // if a thread of the pool is running the tasks
+    bool                                m_running;
+};
+
+}   // end namespace
@@ -1,5 +1,5 @@
 // Maximum supported spline degree
 #define MAX_SPLINE_DEGREE 4
 
-// the maximum number of CUDA streams that can be used when simulating RF lines
-#define MAX_NUM_CUDA_STREAMS 2
+// Maximum number of radial zones of a multi-resolution lookup-table profile
+#define MAX_LUT_ZONES 8
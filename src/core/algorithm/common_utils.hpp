@@ -29,6 +29,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include "../BCSimConfig.hpp"
+#include "../ScanSequence.hpp"
 
 namespace bcsim {
 
@@ -40,6 +47,59 @@ size_t compute_num_rf_samples(T sound_speed, T line_length, T sampling_freq) {
     return static_cast<size_t>(std::floor(sampling_freq*max_time + 0.5)); 
 }
 
+// The RF samples [first_sample, first_sample + num_samples) of a line which
+// are simulated: all of them, or with a depth window in the scan sequence
+// those of the window with a margin of the excitation length on both sides.
+// The first sample is a whole decimated sample, so that the simulated samples
+// are on the grid of the full line. Throws std::runtime_error if the window
+// is invalid.
+struct RfSampleWindow {
+    size_t first_sample;
+    size_t num_samples;
+};
+
+inline RfSampleWindow compute_rf_sample_window(float sound_speed, const ScanSequence& scan_seq,
+                                               const ExcitationSignal& excitation, int radial_decimation) {
+    const auto num_line_samples = compute_num_rf_samples(sound_speed, scan_seq.line_length, excitation.sampling_frequency);
+    if (!scan_seq.has_depth_window()) {
+        return RfSampleWindow{0, num_line_samples};
+    }
+    if ((scan_seq.r_min < 0.0f) || (scan_seq.r_min >= scan_seq.r_max) || (scan_seq.r_max > scan_seq.line_length)) {
+        throw std::runtime_error("invalid depth window: requires 0 <= r_min < r_max <= line_length");
+    }
+    const auto samples_per_meter = 2.0*excitation.sampling_frequency/sound_speed;
+    const auto margin = static_cast<double>(excitation.samples.size());
+    const auto decimation = static_cast<size_t>(radial_decimation);
+    auto first = static_cast<size_t>(std::max(0.0, std::floor(scan_seq.r_min*samples_per_meter - margin)));
+    first -= first % decimation;
+    const auto end = std::min(num_line_samples, static_cast<size_t>(std::ceil(scan_seq.r_max*samples_per_meter + margin)));
+    return RfSampleWindow{first, (end > first) ? end - first : 0};
+}
+
+// The demodulation phasor of the first sample of a window relative to the
+// first sample of the line, by which the IQ samples of the window differ
+// from those of the full line.
+inline std::complex<float> window_demodulation_phasor(const ExcitationSignal& excitation, size_t first_sample) {
+    const double TWO_PI = 2.0*4.0*std::atan(1.0);
+    const auto angle = -TWO_PI*excitation.demod_freq*static_cast<double>(first_sample)/excitation.sampling_frequency;
+    return std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+}
+
+inline bool same_excitation(const ExcitationSignal& a, const ExcitationSignal& b) {
+    return (a.samples == b.samples) && (a.center_index == b.center_index)
+        && (a.sampling_frequency == b.sampling_frequency) && (a.demod_freq == b.demod_freq);
+}
+
+// Parameters only understood by the CPU or by the GPU simulators.
+inline bool is_cpu_parameter(const std::string& key) {
+    return (key.compare(0, 4, "cpu_") == 0) || (key == "num_cpu_cores") || (key == "sum_all_cs");
+}
+
+inline bool is_gpu_parameter(const std::string& key) {
+    return (key.compare(0, 4, "gpu_") == 0) || (key == "cuda_streams") || (key == "threads_per_block")
+        || (key == "store_kernel_details");
+}
+
 // When evaluating a spline as a sum of control points and basis functions,
 // only degree+1 terms are non-zero. The start and end index (inclusive) can
 // be computed. This function asserts that the skipped basis functions are in
@@ -59,4 +119,42 @@ bool sanity_check_spline_lower_upper_bound(const std::vector<T>& all_basis_funct
     return true;
 }
 
+// Throws unless the splines of new_scatterers can replace the splines with
+// the given indices of a dataset with num_splines splines of num_cs control
+// points each.
+inline void check_spline_update(size_t num_splines, size_t num_cs, const std::vector<size_t>& indices,
+                                const SplineScatterers& new_scatterers) {
+    if (indices.size() != static_cast<size_t>(new_scatterers.num_scatterers())) {
+        throw std::runtime_error("number of indices and scatterers differ");
+    }
+    if (indices.empty()) {
+        return;
+    }
+    if (new_scatterers.get_num_control_points() != num_cs) {
+        throw std::runtime_error("number of control points differs from the dataset");
+    }
+    for (const auto index : indices) {
+        if (index >= num_splines) {
+            throw std::runtime_error("scatterer index out of range");
+        }
+    }
+}
+
+// Replace the splines with the given indices of a dataset.
+inline void update_spline_dataset(SplineScatterers& dataset, const std::vector<size_t>& indices,
+                                  const SplineScatterers& new_scatterers) {
+    const size_t num_splines = dataset.num_scatterers();
+    if (num_splines == 0) {
+        throw std::runtime_error("No scatterers in dataset");
+    }
+    const auto num_cs = dataset.get_num_control_points();
+    check_spline_update(num_splines, num_cs, indices, new_scatterers);
+    for (size_t i = 0; i < indices.size(); i++) {
+        for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
+            dataset.set_control_point(indices[i], cs_no, new_scatterers.get_control_point(i, cs_no));
+        }
+        dataset.amplitudes[indices[i]] = new_scatterers.amplitudes[i];
+    }
+}
+
 }   // end namespace
@@ -0,0 +1,354 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX512F__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+#include "cpu_projection_kernels.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// Reference implementation, also used for the tail of the SIMD loops.
+inline void compute_beam_coordinates_scalar(const vector3& origin, const vector3& rad_dir, const vector3& lat_dir, const vector3& ele_dir,
+                                            bool use_arc_projection,
+                                            const float* xs, const float* ys, const float* zs, int start_idx, int end_idx,
+                                            float* rs, float* ls, float* es) {
+    for (int i = start_idx; i < end_idx; i++) {
+        const vector3 temp = vector3(xs[i], ys[i], zs[i]) - origin;
+        float r = temp.dot(rad_dir);
+        if (use_arc_projection) {
+            r = std::copysign(temp.norm(), r);
+        }
+        rs[i] = r;
+        ls[i] = temp.dot(lat_dir);
+        es[i] = temp.dot(ele_dir);
+    }
+}
+
+// exp(-q) for 0 <= q <= 80 as 2^n*2^f with n = round(-q*log2(e)) and a
+// Taylor polynomial for 2^f, |f| <= 1/2. The SIMD versions use the same steps.
+const float LOG2_E = 1.44269504f;
+const float EXP2_C1 = 0.693147181f;
+const float EXP2_C2 = 0.240226507f;
+const float EXP2_C3 = 0.0555041087f;
+const float EXP2_C4 = 0.00961812911f;
+const float EXP2_C5 = 0.00133335581f;
+const float EXP2_C6 = 0.000154035304f;
+
+inline float fast_exp_neg(float q) {
+    const float y = -q*LOG2_E;
+    const float n = std::floor(y + 0.5f);
+    const float f = y - n;
+    const float p = 1.0f + f*(EXP2_C1 + f*(EXP2_C2 + f*(EXP2_C3 + f*(EXP2_C4 + f*(EXP2_C5 + f*EXP2_C6)))));
+    return std::ldexp(p, static_cast<int>(n));
+}
+
+inline void compute_gaussian_weights_scalar(const float* ls, const float* es, int start_idx, int end_idx,
+                                            float lateral_factor, float elevational_factor, float max_exponent,
+                                            float* weights) {
+    for (int i = start_idx; i < end_idx; i++) {
+        const float q = lateral_factor*ls[i]*ls[i] + elevational_factor*es[i]*es[i];
+        weights[i] = (q <= max_exponent) ? fast_exp_neg(q) : 0.0f;
+    }
+}
+
+// Continuous index t into the padded samples, see LUTBeamProfile::PaddedLayout.
+inline float padded_lut_index(float t, float max_index) {
+    return std::min(max_index, std::max(-1.0f, t)) + 1.0f;
+}
+
+inline void compute_lut_weights_scalar(const LUTBeamProfile::PaddedLayout& lut,
+                                       const float* rs, const float* ls, const float* es, int start_idx, int end_idx,
+                                       float* weights) {
+    for (int i = start_idx; i < end_idx; i++) {
+        const float tr = padded_lut_index((rs[i] - lut.first_rad)*lut.inv_delta_rad, lut.max_index_rad);
+        const float tl = padded_lut_index((ls[i] - lut.first_lat)*lut.inv_delta_lat, lut.max_index_lat);
+        const float te = padded_lut_index((es[i] - lut.first_ele)*lut.inv_delta_ele, lut.max_index_ele);
+        const int r0 = static_cast<int>(tr);
+        const int l0 = static_cast<int>(tl);
+        const int e0 = static_cast<int>(te);
+        const float fr = tr - r0;
+        const float fl = tl - l0;
+        const float fe = te - e0;
+        const float* c = lut.samples + (r0*lut.stride_rad + l0*lut.stride_lat + e0);
+        const int sr = lut.stride_rad;
+        const int sl = lut.stride_lat;
+        const float c00 = (1.0f-fr)*c[0]      + fr*c[sr];
+        const float c10 = (1.0f-fr)*c[sl]     + fr*c[sr + sl];
+        const float c01 = (1.0f-fr)*c[1]      + fr*c[sr + 1];
+        const float c11 = (1.0f-fr)*c[sl + 1] + fr*c[sr + sl + 1];
+        const float c0 = (1.0f-fl)*c00 + fl*c10;
+        const float c1 = (1.0f-fl)*c01 + fl*c11;
+        weights[i] = (1.0f-fe)*c0 + fe*c1;
+    }
+}
+
+#if defined(__AVX512F__)
+// (1-f)*a + f*b
+inline __m512 lerp(__m512 f, __m512 a, __m512 b) {
+    return _mm512_add_ps(a, _mm512_mul_ps(f, _mm512_sub_ps(b, a)));
+}
+#elif defined(__AVX2__)
+inline __m256 lerp(__m256 f, __m256 a, __m256 b) {
+    return _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(b, a)));
+}
+#endif
+
+}   // end anonymous namespace
+
+void compute_beam_coordinates(const Scanline& line, bool use_arc_projection,
+                              const float* xs, const float* ys, const float* zs, int num_scatterers,
+                              float* rs, float* ls, float* es) {
+    const auto origin  = line.get_origin();
+    const auto rad_dir = line.get_direction();
+    const auto lat_dir = line.get_lateral_dir();
+    const auto ele_dir = line.get_elevational_dir();
+
+    int i = 0;
+#if defined(__AVX512F__)
+    const int SIMD_WIDTH = 16;
+    const auto ox = _mm512_set1_ps(origin.x);  const auto oy = _mm512_set1_ps(origin.y);  const auto oz = _mm512_set1_ps(origin.z);
+    const auto rx = _mm512_set1_ps(rad_dir.x); const auto ry = _mm512_set1_ps(rad_dir.y); const auto rz = _mm512_set1_ps(rad_dir.z);
+    const auto lx = _mm512_set1_ps(lat_dir.x); const auto ly = _mm512_set1_ps(lat_dir.y); const auto lz = _mm512_set1_ps(lat_dir.z);
+    const auto ex = _mm512_set1_ps(ele_dir.x); const auto ey = _mm512_set1_ps(ele_dir.y); const auto ez = _mm512_set1_ps(ele_dir.z);
+    const auto sign_mask = _mm512_set1_epi32(0x80000000);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        const auto px = _mm512_sub_ps(_mm512_loadu_ps(xs + i), ox);
+        const auto py = _mm512_sub_ps(_mm512_loadu_ps(ys + i), oy);
+        const auto pz = _mm512_sub_ps(_mm512_loadu_ps(zs + i), oz);
+
+        auto r = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(px, rx), _mm512_mul_ps(py, ry)), _mm512_mul_ps(pz, rz));
+        const auto l = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(px, lx), _mm512_mul_ps(py, ly)), _mm512_mul_ps(pz, lz));
+        const auto e = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(px, ex), _mm512_mul_ps(py, ey)), _mm512_mul_ps(pz, ez));
+        if (use_arc_projection) {
+            // copysign(norm, r): the norm is never negative, so OR in the sign bit of r.
+            const auto norm = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(px, px), _mm512_mul_ps(py, py)), _mm512_mul_ps(pz, pz)));
+            const auto sign = _mm512_and_si512(_mm512_castps_si512(r), sign_mask);
+            r = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(norm), sign));
+        }
+        _mm512_storeu_ps(rs + i, r);
+        _mm512_storeu_ps(ls + i, l);
+        _mm512_storeu_ps(es + i, e);
+    }
+#elif defined(__AVX2__)
+    const int SIMD_WIDTH = 8;
+    const auto ox = _mm256_set1_ps(origin.x);  const auto oy = _mm256_set1_ps(origin.y);  const auto oz = _mm256_set1_ps(origin.z);
+    const auto rx = _mm256_set1_ps(rad_dir.x); const auto ry = _mm256_set1_ps(rad_dir.y); const auto rz = _mm256_set1_ps(rad_dir.z);
+    const auto lx = _mm256_set1_ps(lat_dir.x); const auto ly = _mm256_set1_ps(lat_dir.y); const auto lz = _mm256_set1_ps(lat_dir.z);
+    const auto ex = _mm256_set1_ps(ele_dir.x); const auto ey = _mm256_set1_ps(ele_dir.y); const auto ez = _mm256_set1_ps(ele_dir.z);
+    const auto sign_mask = _mm256_set1_ps(-0.0f);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        const auto px = _mm256_sub_ps(_mm256_loadu_ps(xs + i), ox);
+        const auto py = _mm256_sub_ps(_mm256_loadu_ps(ys + i), oy);
+        const auto pz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), oz);
+
+        auto r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, rx), _mm256_mul_ps(py, ry)), _mm256_mul_ps(pz, rz));
+        const auto l = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, lx), _mm256_mul_ps(py, ly)), _mm256_mul_ps(pz, lz));
+        const auto e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, ex), _mm256_mul_ps(py, ey)), _mm256_mul_ps(pz, ez));
+        if (use_arc_projection) {
+            // copysign(norm, r): the norm is never negative, so OR in the sign bit of r.
+            const auto norm = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(pz, pz)));
+            r = _mm256_or_ps(norm, _mm256_and_ps(r, sign_mask));
+        }
+        _mm256_storeu_ps(rs + i, r);
+        _mm256_storeu_ps(ls + i, l);
+        _mm256_storeu_ps(es + i, e);
+    }
+#endif
+    compute_beam_coordinates_scalar(origin, rad_dir, lat_dir, ele_dir, use_arc_projection,
+                                    xs, ys, zs, i, num_scatterers, rs, ls, es);
+}
+
+void compute_gaussian_weights(const float* ls, const float* es, int num_scatterers,
+                              float lateral_factor, float elevational_factor, float max_exponent,
+                              float* weights) {
+    int i = 0;
+#if defined(__AVX512F__)
+    const int SIMD_WIDTH = 16;
+    const auto fl = _mm512_set1_ps(lateral_factor);
+    const auto fe = _mm512_set1_ps(elevational_factor);
+    const auto q_max = _mm512_set1_ps(max_exponent);
+    const auto half = _mm512_set1_ps(0.5f);
+    const auto one = _mm512_set1_ps(1.0f);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        const auto l = _mm512_loadu_ps(ls + i);
+        const auto e = _mm512_loadu_ps(es + i);
+        const auto q = _mm512_add_ps(_mm512_mul_ps(fl, _mm512_mul_ps(l, l)), _mm512_mul_ps(fe, _mm512_mul_ps(e, e)));
+        const auto y = _mm512_mul_ps(q, _mm512_set1_ps(-LOG2_E));
+        const auto n = _mm512_roundscale_ps(_mm512_add_ps(y, half), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const auto f = _mm512_sub_ps(y, n);
+        auto p = _mm512_set1_ps(EXP2_C6);
+        p = _mm512_add_ps(_mm512_set1_ps(EXP2_C5), _mm512_mul_ps(f, p));
+        p = _mm512_add_ps(_mm512_set1_ps(EXP2_C4), _mm512_mul_ps(f, p));
+        p = _mm512_add_ps(_mm512_set1_ps(EXP2_C3), _mm512_mul_ps(f, p));
+        p = _mm512_add_ps(_mm512_set1_ps(EXP2_C2), _mm512_mul_ps(f, p));
+        p = _mm512_add_ps(_mm512_set1_ps(EXP2_C1), _mm512_mul_ps(f, p));
+        p = _mm512_add_ps(one, _mm512_mul_ps(f, p));
+        // 2^n by adding n to the exponent bits
+        const auto exponent = _mm512_slli_epi32(_mm512_cvtps_epi32(n), 23);
+        const auto w = _mm512_castsi512_ps(_mm512_add_epi32(_mm512_castps_si512(p), exponent));
+        const auto inside = _mm512_cmp_ps_mask(q, q_max, _CMP_LE_OQ);
+        _mm512_storeu_ps(weights + i, _mm512_maskz_mov_ps(inside, w));
+    }
+#elif defined(__AVX2__)
+    const int SIMD_WIDTH = 8;
+    const auto fl = _mm256_set1_ps(lateral_factor);
+    const auto fe = _mm256_set1_ps(elevational_factor);
+    const auto q_max = _mm256_set1_ps(max_exponent);
+    const auto half = _mm256_set1_ps(0.5f);
+    const auto one = _mm256_set1_ps(1.0f);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        const auto l = _mm256_loadu_ps(ls + i);
+        const auto e = _mm256_loadu_ps(es + i);
+        const auto q = _mm256_add_ps(_mm256_mul_ps(fl, _mm256_mul_ps(l, l)), _mm256_mul_ps(fe, _mm256_mul_ps(e, e)));
+        const auto y = _mm256_mul_ps(q, _mm256_set1_ps(-LOG2_E));
+        const auto n = _mm256_floor_ps(_mm256_add_ps(y, half));
+        const auto f = _mm256_sub_ps(y, n);
+        auto p = _mm256_set1_ps(EXP2_C6);
+        p = _mm256_add_ps(_mm256_set1_ps(EXP2_C5), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(EXP2_C4), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(EXP2_C3), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(EXP2_C2), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(EXP2_C1), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(one, _mm256_mul_ps(f, p));
+        // 2^n by adding n to the exponent bits
+        const auto exponent = _mm256_slli_epi32(_mm256_cvtps_epi32(n), 23);
+        const auto w = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p), exponent));
+        const auto inside = _mm256_cmp_ps(q, q_max, _CMP_LE_OQ);
+        _mm256_storeu_ps(weights + i, _mm256_and_ps(inside, w));
+    }
+#endif
+    compute_gaussian_weights_scalar(ls, es, i, num_scatterers, lateral_factor, elevational_factor, max_exponent, weights);
+}
+
+void compute_lut_weights(const LUTBeamProfile::PaddedLayout& lut,
+                         const float* rs, const float* ls, const float* es, int num_scatterers,
+                         float* weights) {
+    int i = 0;
+#if defined(__AVX512F__)
+    const int SIMD_WIDTH = 16;
+    const int sr = lut.stride_rad;
+    const int sl = lut.stride_lat;
+    const auto first_r = _mm512_set1_ps(lut.first_rad);     const auto inv_dr = _mm512_set1_ps(lut.inv_delta_rad);
+    const auto first_l = _mm512_set1_ps(lut.first_lat);     const auto inv_dl = _mm512_set1_ps(lut.inv_delta_lat);
+    const auto first_e = _mm512_set1_ps(lut.first_ele);     const auto inv_de = _mm512_set1_ps(lut.inv_delta_ele);
+    const auto max_r = _mm512_set1_ps(lut.max_index_rad);
+    const auto max_l = _mm512_set1_ps(lut.max_index_lat);
+    const auto max_e = _mm512_set1_ps(lut.max_index_ele);
+    const auto minus_one = _mm512_set1_ps(-1.0f);
+    const auto one = _mm512_set1_ps(1.0f);
+    const auto stride_r = _mm512_set1_epi32(sr);
+    const auto stride_l = _mm512_set1_epi32(sl);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        // max returns the second operand for NaN, which maps NaN to -1
+        auto tr = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(rs + i), first_r), inv_dr);
+        auto tl = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(ls + i), first_l), inv_dl);
+        auto te = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(es + i), first_e), inv_de);
+        tr = _mm512_add_ps(_mm512_min_ps(_mm512_max_ps(tr, minus_one), max_r), one);
+        tl = _mm512_add_ps(_mm512_min_ps(_mm512_max_ps(tl, minus_one), max_l), one);
+        te = _mm512_add_ps(_mm512_min_ps(_mm512_max_ps(te, minus_one), max_e), one);
+        const auto r0 = _mm512_cvttps_epi32(tr);
+        const auto l0 = _mm512_cvttps_epi32(tl);
+        const auto e0 = _mm512_cvttps_epi32(te);
+        const auto fr = _mm512_sub_ps(tr, _mm512_cvtepi32_ps(r0));
+        const auto fl = _mm512_sub_ps(tl, _mm512_cvtepi32_ps(l0));
+        const auto fe = _mm512_sub_ps(te, _mm512_cvtepi32_ps(e0));
+        const auto idx = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(r0, stride_r), _mm512_mullo_epi32(l0, stride_l)), e0);
+        const auto c000 = _mm512_i32gather_ps(idx, lut.samples, 4);
+        const auto c001 = _mm512_i32gather_ps(idx, lut.samples + 1, 4);
+        const auto c010 = _mm512_i32gather_ps(idx, lut.samples + sl, 4);
+        const auto c011 = _mm512_i32gather_ps(idx, lut.samples + sl + 1, 4);
+        const auto c100 = _mm512_i32gather_ps(idx, lut.samples + sr, 4);
+        const auto c101 = _mm512_i32gather_ps(idx, lut.samples + sr + 1, 4);
+        const auto c110 = _mm512_i32gather_ps(idx, lut.samples + sr + sl, 4);
+        const auto c111 = _mm512_i32gather_ps(idx, lut.samples + sr + sl + 1, 4);
+        const auto c0 = lerp(fl, lerp(fr, c000, c100), lerp(fr, c010, c110));
+        const auto c1 = lerp(fl, lerp(fr, c001, c101), lerp(fr, c011, c111));
+        _mm512_storeu_ps(weights + i, lerp(fe, c0, c1));
+    }
+#elif defined(__AVX2__)
+    const int SIMD_WIDTH = 8;
+    const int sr = lut.stride_rad;
+    const int sl = lut.stride_lat;
+    const auto first_r = _mm256_set1_ps(lut.first_rad);     const auto inv_dr = _mm256_set1_ps(lut.inv_delta_rad);
+    const auto first_l = _mm256_set1_ps(lut.first_lat);     const auto inv_dl = _mm256_set1_ps(lut.inv_delta_lat);
+    const auto first_e = _mm256_set1_ps(lut.first_ele);     const auto inv_de = _mm256_set1_ps(lut.inv_delta_ele);
+    const auto max_r = _mm256_set1_ps(lut.max_index_rad);
+    const auto max_l = _mm256_set1_ps(lut.max_index_lat);
+    const auto max_e = _mm256_set1_ps(lut.max_index_ele);
+    const auto minus_one = _mm256_set1_ps(-1.0f);
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto stride_r = _mm256_set1_epi32(sr);
+    const auto stride_l = _mm256_set1_epi32(sl);
+    for (; i + SIMD_WIDTH <= num_scatterers; i += SIMD_WIDTH) {
+        // max returns the second operand for NaN, which maps NaN to -1
+        auto tr = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(rs + i), first_r), inv_dr);
+        auto tl = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(ls + i), first_l), inv_dl);
+        auto te = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(es + i), first_e), inv_de);
+        tr = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(tr, minus_one), max_r), one);
+        tl = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(tl, minus_one), max_l), one);
+        te = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(te, minus_one), max_e), one);
+        const auto r0 = _mm256_cvttps_epi32(tr);
+        const auto l0 = _mm256_cvttps_epi32(tl);
+        const auto e0 = _mm256_cvttps_epi32(te);
+        const auto fr = _mm256_sub_ps(tr, _mm256_cvtepi32_ps(r0));
+        const auto fl = _mm256_sub_ps(tl, _mm256_cvtepi32_ps(l0));
+        const auto fe = _mm256_sub_ps(te, _mm256_cvtepi32_ps(e0));
+        const auto idx = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r0, stride_r), _mm256_mullo_epi32(l0, stride_l)), e0);
+        const auto c000 = _mm256_i32gather_ps(lut.samples, idx, 4);
+        const auto c001 = _mm256_i32gather_ps(lut.samples + 1, idx, 4);
+        const auto c010 = _mm256_i32gather_ps(lut.samples + sl, idx, 4);
+        const auto c011 = _mm256_i32gather_ps(lut.samples + sl + 1, idx, 4);
+        const auto c100 = _mm256_i32gather_ps(lut.samples + sr, idx, 4);
+        const auto c101 = _mm256_i32gather_ps(lut.samples + sr + 1, idx, 4);
+        const auto c110 = _mm256_i32gather_ps(lut.samples + sr + sl, idx, 4);
+        const auto c111 = _mm256_i32gather_ps(lut.samples + sr + sl + 1, idx, 4);
+        const auto c0 = lerp(fl, lerp(fr, c000, c100), lerp(fr, c010, c110));
+        const auto c1 = lerp(fl, lerp(fr, c001, c101), lerp(fr, c011, c111));
+        _mm256_storeu_ps(weights + i, lerp(fe, c0, c1));
+    }
+#endif
+    compute_lut_weights_scalar(lut, rs, ls, es, i, num_scatterers, weights);
+}
+
+const char* get_projection_kernel_isa() {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+}   // end namespace
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include "../ScanSequence.hpp"
+#include "../BeamProfile.hpp"
+
+namespace bcsim {
+
+// Map a contiguous block of scatterer positions (structure of arrays) into
+// the local coordinate system of a beam. The radial, lateral and elevational
+// components are written to rs, ls, and es, which must have room for
+// num_scatterers elements.
+// If use_arc_projection is true, the radial component is the length of the
+// vector from the beam's origin to the scatterer with the same sign as the
+// projection onto the beam direction.
+// Uses AVX-512 or AVX2 if the translation unit was compiled with support for
+// it, and a scalar loop otherwise.
+void compute_beam_coordinates(const Scanline& line, bool use_arc_projection,
+                              const float* xs, const float* ys, const float* zs, int num_scatterers,
+                              float* rs, float* ls, float* es);
+
+// Gaussian beam profile weights exp(-(lateral_factor*l^2 + elevational_factor*e^2))
+// of a block of scatterers with lateral and elevational components ls and es.
+// The weight is zero where the exponent exceeds max_exponent, which must be
+// at most 80, so that scatterers far outside the beam can be rejected without
+// evaluating the exponential. The exponential is a polynomial approximation
+// with a relative error of about 2e-7, vectorized like compute_beam_coordinates().
+void compute_gaussian_weights(const float* ls, const float* es, int num_scatterers,
+                              float lateral_factor, float elevational_factor, float max_exponent,
+                              float* weights);
+
+// Lookup-table beam profile weights of a block of scatterers in beam
+// coordinates, the same as LUTBeamProfile::sample(). The eight corners of the
+// trilinear interpolation are gathered from the padded layout without bounds
+// checks, vectorized like compute_beam_coordinates().
+void compute_lut_weights(const LUTBeamProfile::PaddedLayout& lut,
+                         const float* rs, const float* ls, const float* es, int num_scatterers,
+                         float* weights);
+
+// Name of the instruction set used by compute_beam_coordinates().
+const char* get_projection_kernel_isa();
+
+}   // end namespace
@@ -4,7 +4,7 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <cuda.h>
+#include "gpu_runtime.h"
 #include "cuda_helpers.h"
 
 template <typename T>
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <cstring> // for std::memset
 #include <iostream>
 #include <stdexcept>
@@ -7,10 +8,11 @@
 #include <memory>
 #include <random>
 #include <functional>
-#include <driver_types.h>
-#include <driver_functions.h>
-#include <cuda_runtime_api.h>
-#include <vector_functions.h>   // for make_float3() etc.
+#include <vector>
+#include "gpu_runtime.h"
+#include "cuda_memory_pool.h"
+#include "cuda_vector_math.h"
+#include "../lut_compression.hpp"    // for float_to_half()
 
 // Throws a std::runtime_error in case the return value is not cudaSuccess.
 #define cudaErrorCheck(ans) { cudaAssert((ans), __FILE__, __LINE__); }
@@ -26,7 +28,7 @@ inline void cudaAssert(cudaError_t code, const char* file, int line) {
     }
 }
 
-// RAII-style wrapper for device memory.
+// RAII-style wrapper for device memory, allocated from the memory pool.
 template <typename T>
 class DeviceBufferRAII {
 public:
@@ -34,12 +36,13 @@ public:
     typedef std::shared_ptr<DeviceBufferRAII<T> > s_ptr;
 
     explicit DeviceBufferRAII(size_t num_bytes) {
-        cudaErrorCheck( cudaMalloc(&memory, num_bytes) );
+        cudaErrorCheck( cudaGetDevice(&device_no) );
+        memory = CudaMemoryPool::instance().allocate(CudaMemoryPool::Kind::DEVICE, num_bytes);
         num_bytes_allocated = num_bytes;
     }
 
     ~DeviceBufferRAII() {
-        cudaErrorCheck( cudaFree(memory) );
+        CudaMemoryPool::instance().release(CudaMemoryPool::Kind::DEVICE, memory, num_bytes_allocated, device_no);
     }
 
     T* data() {
@@ -53,9 +56,10 @@ public:
 private:
     void*   memory;
     size_t  num_bytes_allocated;
+    int     device_no;
 };
 
-// RAII wrapper for pinned host memory.
+// RAII wrapper for pinned host memory, allocated from the memory pool.
 template <typename T>
 class HostPinnedBufferRAII {
 public:
@@ -63,18 +67,69 @@ public:
     typedef std::shared_ptr<HostPinnedBufferRAII<T> > s_ptr;
 
     explicit HostPinnedBufferRAII(size_t num_bytes) {
-        cudaErrorCheck( cudaMallocHost(&memory, num_bytes) );
+        cudaErrorCheck( cudaGetDevice(&device_no) );
+        memory = CudaMemoryPool::instance().allocate(CudaMemoryPool::Kind::HOST_PINNED, num_bytes);
+        num_bytes_allocated = num_bytes;
     }
 
     ~HostPinnedBufferRAII() {
-        cudaErrorCheck( cudaFreeHost(memory) );
+        CudaMemoryPool::instance().release(CudaMemoryPool::Kind::HOST_PINNED, memory, num_bytes_allocated, device_no);
     }
 
     T* data() {
         return static_cast<T*>(memory);
     }
+
+    size_t get_num_bytes() {
+        return num_bytes_allocated;
+    }
 private:
-    void* memory;
+    void*   memory;
+    size_t  num_bytes_allocated;
+    int     device_no;
+};
+
+// RAII wrapper for pinned host memory which is mapped into the address space
+// of the device, so that kernels read and write it directly. Not pooled,
+// since it only backs long-lived datasets on devices sharing their memory
+// with the host.
+template <typename T>
+class HostMappedBufferRAII {
+public:
+    typedef std::unique_ptr<HostMappedBufferRAII<T> > u_ptr;
+    typedef std::shared_ptr<HostMappedBufferRAII<T> > s_ptr;
+
+    explicit HostMappedBufferRAII(size_t num_bytes) {
+        cudaErrorCheck( cudaHostAlloc(&host_memory, num_bytes, cudaHostAllocMapped) );
+        const auto res = cudaHostGetDevicePointer(&device_memory, host_memory, 0);
+        if (res != cudaSuccess) {
+            cudaFreeHost(host_memory);
+            cudaErrorCheck( res );
+        }
+        num_bytes_allocated = num_bytes;
+    }
+
+    ~HostMappedBufferRAII() {
+        cudaFreeHost(host_memory);
+    }
+
+    // The pointer for kernels.
+    T* data() {
+        return static_cast<T*>(device_memory);
+    }
+
+    // The pointer for the host.
+    T* host_data() {
+        return static_cast<T*>(host_memory);
+    }
+
+    size_t get_num_bytes() {
+        return num_bytes_allocated;
+    }
+private:
+    void*   host_memory;
+    void*   device_memory;
+    size_t  num_bytes_allocated;
 };
 
 // RAII-style CUDA timer.
@@ -134,22 +189,60 @@ private:
     cudaStream_t stream;
 };
 
-// selected math
-inline __host__ __device__ float3 operator+(float3 a, float3 b) {
-    return make_float3(a.x+b.x, a.y+b.y, a.z+b.z);
-}
+// RAII-style CUDA event without timing, used for dependencies
+// between streams.
+class CudaEventRAII {
+public:
+    typedef std::unique_ptr<CudaEventRAII> u_ptr;
 
-inline __host__ __device__ float3 operator-(float3 a, float3 b) {
-    return make_float3(a.x-b.x, a.y-b.y, a.z-b.z);
-}
+    explicit CudaEventRAII() {
+        cudaErrorCheck( cudaEventCreateWithFlags(&event, cudaEventDisableTiming) );
+    }
 
-inline __host__ __device__ float dot(float3 a, float3 b) {
-    return a.x*b.x + a.y*b.y + a.z*b.z;
-}
+    ~CudaEventRAII() {
+        cudaErrorCheck( cudaEventDestroy(event) );
+    }
 
-inline __host__ __device__ float3 operator*(float3 a, float b) {
-    return make_float3(a.x*b, a.y*b, a.z*b);
-}
+    void record(cudaStream_t stream) {
+        cudaErrorCheck( cudaEventRecord(event, stream) );
+    }
+
+    // make all future work in a stream wait for the last recorded work.
+    void make_wait(cudaStream_t stream) {
+        cudaErrorCheck( cudaStreamWaitEvent(stream, event, 0) );
+    }
+
+    // block the host until the last recorded work has finished.
+    void synchronize() {
+        cudaErrorCheck( cudaEventSynchronize(event) );
+    }
+
+private:
+    cudaEvent_t event;
+};
+
+// Owns an instantiated CUDA graph. Takes ownership of the captured graph,
+// which is no longer needed after instantiation.
+class CudaGraphExecRAII {
+public:
+    typedef std::unique_ptr<CudaGraphExecRAII> u_ptr;
+
+    explicit CudaGraphExecRAII(cudaGraph_t graph) {
+        cudaErrorCheck( cudaGraphInstantiateWithFlags(&graph_exec, graph, 0) );
+        cudaErrorCheck( cudaGraphDestroy(graph) );
+    }
+
+    ~CudaGraphExecRAII() {
+        cudaErrorCheck( cudaGraphExecDestroy(graph_exec) );
+    }
+
+    void launch(cudaStream_t stream) {
+        cudaErrorCheck( cudaGraphLaunch(graph_exec, stream) );
+    }
+
+private:
+    cudaGraphExec_t graph_exec;
+};
 
 template <typename T>
 void fill_host_vector_uniform_random(T low, T high, size_t length, T* data) {
@@ -181,18 +274,36 @@ public:
         size_t radial;
     } TableExtent3D;
 
-    DeviceBeamProfileRAII(const TableExtent3D& table_extent, std::vector<float>& host_input_buffer, LogCallback log_callback_fn=[](const std::string&) { })
+    // The host samples are in the row-major [radial][lateral][elevational]
+    // layout of LUTBeamProfile and are copied with a single cudaMemcpy3D,
+    // so texture coordinates are (elevational, lateral, radial). If
+    // half_precision is true, the texture is stored as 16-bit floats, which
+    // halves the memory and is still filtered by the texture unit.
+    DeviceBeamProfileRAII(const TableExtent3D& table_extent, const float* host_samples, bool half_precision=false,
+                          LogCallback log_callback_fn=[](const std::string&) { })
         : texture_object(0),
           m_log_callback_fn(log_callback_fn)
     {
-        auto channel_desc = cudaCreateChannelDesc(32, 0, 0, 0, cudaChannelFormatKindFloat);
-        cudaExtent extent = make_cudaExtent(table_extent.lateral, table_extent.elevational, table_extent.radial);
+        const int bits = half_precision ? 16 : 32;
+        auto channel_desc = cudaCreateChannelDesc(bits, 0, 0, 0, cudaChannelFormatKindFloat);
+        const size_t element_size = half_precision ? sizeof(uint16_t) : sizeof(float);
+        cudaExtent extent = make_cudaExtent(table_extent.elevational, table_extent.lateral, table_extent.radial);
         cudaErrorCheck( cudaMalloc3DArray(&cu_array_3d, &channel_desc, extent, 0) );
         m_log_callback_fn("DeviceBeamProfileRAII: Allocated 3D array");
-        
+
+        std::vector<uint16_t> half_samples;
+        void* src_samples = const_cast<float*>(host_samples);
+        if (half_precision) {
+            half_samples.resize(table_extent.elevational*table_extent.lateral*table_extent.radial);
+            for (size_t i = 0; i < half_samples.size(); i++) {
+                half_samples[i] = bcsim::float_to_half(host_samples[i]);
+            }
+            src_samples = half_samples.data();
+        }
+
         // copy input data from host to CUDA 3D array
         cudaMemcpy3DParms par_3d = {0};
-        par_3d.srcPtr = make_cudaPitchedPtr(host_input_buffer.data(), table_extent.lateral*sizeof(float), table_extent.lateral, table_extent.elevational); 
+        par_3d.srcPtr = make_cudaPitchedPtr(src_samples, table_extent.elevational*element_size, table_extent.elevational, table_extent.lateral); 
         par_3d.dstArray = cu_array_3d;
         par_3d.extent = extent;
         par_3d.kind = cudaMemcpyHostToDevice;
@@ -237,3 +348,120 @@ private:
     cudaArray*              cu_array_3d;
     LogCallback             m_log_callback_fn;
 };
+
+// 2D texture of 8-bit samples with bilinear interpolation, read as normalized
+// floats in unnormalized coordinates and zero outside.
+class DeviceTexture2DRAII {
+public:
+    typedef std::unique_ptr<DeviceTexture2DRAII> u_ptr;
+
+    DeviceTexture2DRAII(size_t width, size_t height)
+        : texture_object(0),
+          m_width(width),
+          m_height(height)
+    {
+        auto channel_desc = cudaCreateChannelDesc(8, 0, 0, 0, cudaChannelFormatKindUnsigned);
+        cudaErrorCheck( cudaMallocArray(&cu_array_2d, &channel_desc, width, height) );
+
+        cudaResourceDesc res_desc;
+        memset(&res_desc, 0, sizeof(res_desc));
+        res_desc.resType = cudaResourceTypeArray;
+        res_desc.res.array.array = cu_array_2d;
+
+        cudaTextureDesc tex_desc;
+        memset(&tex_desc, 0, sizeof(tex_desc));
+        tex_desc.normalizedCoords = 0;
+        tex_desc.filterMode = cudaFilterModeLinear;
+        tex_desc.addressMode[0] = cudaAddressModeBorder;
+        tex_desc.addressMode[1] = cudaAddressModeBorder;
+        tex_desc.readMode = cudaReadModeNormalizedFloat;
+
+        cudaErrorCheck( cudaCreateTextureObject(&texture_object, &res_desc, &tex_desc, NULL) );
+    }
+
+    // Copy rows of width samples from device memory.
+    void copy_from_device(const unsigned char* src, cudaStream_t stream) {
+        cudaErrorCheck( cudaMemcpy2DToArrayAsync(cu_array_2d, 0, 0, src, m_width, m_width, m_height, cudaMemcpyDeviceToDevice, stream) );
+    }
+
+    cudaTextureObject_t get() {
+        return texture_object;
+    }
+
+    size_t get_width() const {
+        return m_width;
+    }
+
+    size_t get_height() const {
+        return m_height;
+    }
+
+    ~DeviceTexture2DRAII() {
+        cudaErrorCheck( cudaDestroyTextureObject(texture_object) );
+        cudaErrorCheck( cudaFreeArray(cu_array_2d) );
+    }
+
+private:
+    cudaTextureObject_t     texture_object;
+    cudaArray*              cu_array_2d;
+    size_t                  m_width;
+    size_t                  m_height;
+};
+
+// 3D texture of floats without interpolation, read in unnormalized
+// coordinates, so that point (x + 0.5, y + 0.5, z + 0.5) gives sample
+// (x, y, z) exactly. The host samples have x fastest.
+class DeviceVolumeTextureRAII {
+public:
+    typedef std::unique_ptr<DeviceVolumeTextureRAII> u_ptr;
+
+    DeviceVolumeTextureRAII(size_t nx, size_t ny, size_t nz, const float* host_samples)
+        : texture_object(0)
+    {
+        auto channel_desc = cudaCreateChannelDesc(32, 0, 0, 0, cudaChannelFormatKindFloat);
+        cudaExtent extent = make_cudaExtent(nx, ny, nz);
+        cudaErrorCheck( cudaMalloc3DArray(&cu_array_3d, &channel_desc, extent, 0) );
+
+        cudaMemcpy3DParms par_3d = {0};
+        par_3d.srcPtr = make_cudaPitchedPtr(const_cast<float*>(host_samples), nx*sizeof(float), nx, ny);
+        par_3d.dstArray = cu_array_3d;
+        par_3d.extent = extent;
+        par_3d.kind = cudaMemcpyHostToDevice;
+        cudaErrorCheck( cudaMemcpy3D(&par_3d) );
+
+        cudaResourceDesc res_desc;
+        memset(&res_desc, 0, sizeof(res_desc));
+        res_desc.resType = cudaResourceTypeArray;
+        res_desc.res.array.array = cu_array_3d;
+
+        cudaTextureDesc tex_desc;
+        memset(&tex_desc, 0, sizeof(tex_desc));
+        tex_desc.normalizedCoords = 0;
+        tex_desc.filterMode = cudaFilterModePoint;
+        tex_desc.addressMode[0] = cudaAddressModeClamp;
+        tex_desc.addressMode[1] = cudaAddressModeClamp;
+        tex_desc.addressMode[2] = cudaAddressModeClamp;
+        tex_desc.readMode = cudaReadModeElementType;
+
+        cudaErrorCheck( cudaCreateTextureObject(&texture_object, &res_desc, &tex_desc, NULL) );
+        num_bytes = nx*ny*nz*sizeof(float);
+    }
+
+    cudaTextureObject_t get() {
+        return texture_object;
+    }
+
+    size_t get_num_bytes() const {
+        return num_bytes;
+    }
+
+    ~DeviceVolumeTextureRAII() {
+        cudaErrorCheck( cudaDestroyTextureObject(texture_object) );
+        cudaErrorCheck( cudaFreeArray(cu_array_3d) );
+    }
+
+private:
+    cudaTextureObject_t     texture_object;
+    cudaArray*              cu_array_3d;
+    size_t                  num_bytes;
+};
@@ -1,8 +1,9 @@
+#include <algorithm>
 #include "cuda_kernels_c_interface.h"
 #include "cuda_kernels_common.cuh"      // for common kernels
 #include "cuda_kernels_fixed.cuh"       // for FixedAlgKernel
-#include "cuda_kernels_spline1.cuh"     // for splineAlg1_updateConstantMemory_internal
-#include "cuda_kernels_spline2.cuh"     // for splineAlg2_updateConstantMemory_internal
+#include "cuda_kernels_spline1.cuh"     // for RenderSplineKernel
+#include "cuda_kernels_spline2.cuh"     // for SplineAlgKernel
 
 template <typename T>
 void launch_MemsetKernel(int grid_size, int block_size, cudaStream_t stream, T* ptr, T value, int num_samples) {
@@ -13,49 +14,138 @@ void launch_MultiplyFftKernel(int grid_size, int block_size, cudaStream_t stream
     MultiplyFftKernel<<<grid_size, block_size, 0, stream>>>(time_proj_fft, filter_fft, num_samples);
 }
 
-void launch_DemodulateKernel(int grid_size, int block_size, cudaStream_t stream, cuComplex* signal, float w, int num_samples) {
-    DemodulateKernel<<<grid_size, block_size, 0, stream>>>(signal, w, num_samples);
+void launch_DemodulateDecimateKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* signal, cuComplex* out,
+                                     float w, int offset, int decimation, int num_out) {
+    DemodulateDecimateKernel<<<grid_size, block_size, 0, stream>>>(signal, out, w, offset, decimation, num_out);
 }
 
 void launch_ScaleSignalKernel(int grid_size, int block_size, cudaStream_t stream, cufftComplex* signal, float factor, int num_samples) {
     ScaleSignalKernel<<<grid_size, block_size, 0, stream>>>(signal, factor, num_samples);
 }
 
+void launch_MemsetBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr, cuComplex value,
+                                int num_samples, int line_stride) {
+    dim3 grid(grid_size, num_lines, 1);
+    MemsetBatchedKernel<<<grid, block_size, 0, stream>>>(ptr, value, num_samples, line_stride);
+}
+
+void launch_FixedPointToFloatBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, float* values,
+                                           float inv_scale, int num_values, int line_stride) {
+    dim3 grid(grid_size, num_lines, 1);
+    FixedPointToFloatBatchedKernel<<<grid, block_size, 0, stream>>>(values, inv_scale, num_values, line_stride);
+}
+
+void launch_MemsetNoiseBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr,
+                                     NoiseParams noise, int num_samples, int line_stride) {
+    dim3 grid(grid_size, num_lines, 1);
+    MemsetNoiseBatchedKernel<<<grid, block_size, 0, stream>>>(ptr, noise, num_samples, line_stride);
+}
+
+void launch_FixedPointToFloatNoiseBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr,
+                                                float inv_scale, NoiseParams noise, int num_samples, int line_stride) {
+    dim3 grid(grid_size, num_lines, 1);
+    FixedPointToFloatNoiseBatchedKernel<<<grid, block_size, 0, stream>>>(ptr, inv_scale, noise, num_samples, line_stride);
+}
+
+void launch_GenerateProceduralKernel(int grid_size, int block_size, cudaStream_t stream, ProceduralParams params,
+                                     unsigned long long first, int num_scatterers, float* xs, float* ys, float* zs, float* as) {
+    GenerateProceduralKernel<<<grid_size, block_size, 0, stream>>>(params, first, num_scatterers, xs, ys, zs, as);
+}
+
+void launch_GenerateImageVolumeKernel(int grid_size, int block_size, cudaStream_t stream, ImageVolumeParams params,
+                                      unsigned long long first, int num_scatterers, float* xs, float* ys, float* zs, float* as) {
+    GenerateImageVolumeKernel<<<grid_size, block_size, 0, stream>>>(params, first, num_scatterers, xs, ys, zs, as);
+}
+
+void launch_MultiplyFftBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cufftComplex* time_proj_fft,
+                                     const cufftComplex* filter_fft, int num_bins, int num_samples) {
+    dim3 grid(grid_size, num_lines, 1);
+    MultiplyFftBatchedKernel<<<grid, block_size, 0, stream>>>(time_proj_fft, filter_fft, num_bins, num_samples);
+}
+
+void launch_DemodulateDecimateBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, const cuComplex* signal,
+                                            cuComplex* out, float w, int offset, int decimation, int num_out, int signal_line_stride) {
+    dim3 grid(grid_size, num_lines, 1);
+    DemodulateDecimateBatchedKernel<<<grid, block_size, 0, stream>>>(signal, out, w, offset, decimation, num_out, signal_line_stride);
+}
+
+void launch_CollectNonzeroKernel(int num_lines, int block_size, cudaStream_t stream, const cuComplex* time_proj, int num_samples,
+                                 int line_stride, bool real_input, int capacity, int* counts, int* indices, cuComplex* values) {
+    // the ballots need full warps
+    dim3 grid(1, num_lines, 1);
+    const int num_threads = std::min(BCSIM_WARP_SIZE*((block_size + BCSIM_WARP_SIZE - 1)/BCSIM_WARP_SIZE), 1024);
+    CollectNonzeroKernel<<<grid, num_threads, 0, stream>>>(time_proj, num_samples, line_stride, real_input, capacity,
+                                                           counts, indices, values);
+}
+
+void launch_SparseSynthesisKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, const int* counts,
+                                  const int* indices, const cuComplex* values, int capacity, const cuComplex* taps, int num_taps,
+                                  int first_lag, cuComplex* out, float w, int offset, int decimation, int num_out) {
+    dim3 grid(grid_size, num_lines, 1);
+    SparseSynthesisKernel<<<grid, block_size, 0, stream>>>(counts, indices, values, capacity, taps, num_taps, first_lag,
+                                                           out, w, offset, decimation, num_out);
+}
+
 template <bool A, bool B, bool C>
-void launch_FixedAlgKernel(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params) {
-    FixedAlgKernel<A, B, C><<<grid_size, block_size, 0, stream>>>(params);
+void launch_FixedAlgKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params) {
+    dim3 grid(grid_size, grid_size1, 1);
+    const size_t shared_bytes = params.shared_tile_len*sizeof(float2);
+    FixedAlgKernel<A, B, C><<<grid, block_size, shared_bytes, stream>>>(params);
 }
 
 // explicit function template instantiations for required datatypes
 template void launch_MemsetKernel(int grid_size, int block_size, cudaStream_t stream, cuComplex* ptr, cuComplex value, int num_samples);
 
 // fixed algorithm explicit function template instantiations - all combinations
-template void launch_FixedAlgKernel<false, false, false>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<false, false,  true>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<false, true,  false>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<false, true,   true>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<true,  false, false>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<true,  false,  true>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<true,  true,  false>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-template void launch_FixedAlgKernel<true,  true,   true>(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
-
-bool splineAlg1_updateConstantMemory(float* src_ptr, size_t num_bytes) {
-    return splineAlg1_updateConstantMemory_internal(src_ptr, num_bytes);
-}
+template void launch_FixedAlgKernel<false, false, false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<false, false,  true>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<false, true,  false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<false, true,   true>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<true,  false, false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<true,  false,  true>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<true,  true,  false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+template void launch_FixedAlgKernel<true,  true,   true>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
 
 void launch_RenderSplineKernel(int grid_size, int block_size, cudaStream_t stream,
+                               const float4* control_points,
                                const float* control_xs,
                                const float* control_ys,
                                const float* control_zs,
                                float* rendered_xs,
                                float* rendered_ys,
                                float* rendered_zs,
+                               RenderSplineBasis basis,
                                int cs_idx_start,
                                int cs_idx_end,
                                int NUM_SPLINES) {
-    RenderSplineKernel<<<grid_size, block_size, 0, stream>>>(control_xs, control_ys, control_zs,
-                                                             rendered_xs, rendered_ys, rendered_zs,
-                                                             cs_idx_start, cs_idx_end, NUM_SPLINES);
+    // unrolled for the spline degrees 1 to MAX_SPLINE_DEGREE
+    switch (cs_idx_end - cs_idx_start) {
+    case 1:
+        RenderSplineKernel<2><<<grid_size, block_size, 0, stream>>>(control_points, control_xs, control_ys, control_zs,
+                                                                    rendered_xs, rendered_ys, rendered_zs, basis,
+                                                                    cs_idx_start, cs_idx_end, NUM_SPLINES);
+        break;
+    case 2:
+        RenderSplineKernel<3><<<grid_size, block_size, 0, stream>>>(control_points, control_xs, control_ys, control_zs,
+                                                                    rendered_xs, rendered_ys, rendered_zs, basis,
+                                                                    cs_idx_start, cs_idx_end, NUM_SPLINES);
+        break;
+    case 3:
+        RenderSplineKernel<4><<<grid_size, block_size, 0, stream>>>(control_points, control_xs, control_ys, control_zs,
+                                                                    rendered_xs, rendered_ys, rendered_zs, basis,
+                                                                    cs_idx_start, cs_idx_end, NUM_SPLINES);
+        break;
+    case 4:
+        RenderSplineKernel<5><<<grid_size, block_size, 0, stream>>>(control_points, control_xs, control_ys, control_zs,
+                                                                    rendered_xs, rendered_ys, rendered_zs, basis,
+                                                                    cs_idx_start, cs_idx_end, NUM_SPLINES);
+        break;
+    default:
+        RenderSplineKernel<0><<<grid_size, block_size, 0, stream>>>(control_points, control_xs, control_ys, control_zs,
+                                                                    rendered_xs, rendered_ys, rendered_zs, basis,
+                                                                    cs_idx_start, cs_idx_end, NUM_SPLINES);
+        break;
+    }
 }
 
 void launch_SliceLookupTable(int grid_size0, int grid_size1, int block_size, cudaStream_t stream,
@@ -68,25 +158,72 @@ void launch_SliceLookupTable(int grid_size0, int grid_size1, int block_size, cud
     SliceLookupTable<<<grid_size, block_size, 0, stream>>>(origin, dir0, dir1, output, lut_tex);
 }
 
-bool splineAlg2_updateConstantMemory(float* src, size_t count, size_t offset, cudaMemcpyKind kind, cudaStream_t stream) {
-    return splineAlg2_updateConstantMemory_internal(src, count, offset, kind, stream);
-}
-
 template <bool A, bool B, bool C>
-void launch_SplineAlgKernel(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params) {
-    SplineAlgKernel<A, B, C><<<grid_size, block_size, 0, stream>>>(params);
+void launch_SplineAlgKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree,
+                            SplineAlgKernelParams params) {
+    dim3 grid(grid_size, grid_size1, 1);
+    const size_t shared_bytes = params.shared_tile_len*sizeof(float2);
+    switch (spline_degree) {
+    case 1:
+        SplineAlgKernel<A, B, C, SplineDegreeKernelConstants<2>><<<grid, block_size, shared_bytes, stream>>>(params);
+        break;
+    case 2:
+        SplineAlgKernel<A, B, C, SplineDegreeKernelConstants<3>><<<grid, block_size, shared_bytes, stream>>>(params);
+        break;
+    case 3:
+        SplineAlgKernel<A, B, C, SplineDegreeKernelConstants<4>><<<grid, block_size, shared_bytes, stream>>>(params);
+        break;
+    case 4:
+        SplineAlgKernel<A, B, C, SplineDegreeKernelConstants<5>><<<grid, block_size, shared_bytes, stream>>>(params);
+        break;
+    default:
+        SplineAlgKernel<A, B, C><<<grid, block_size, shared_bytes, stream>>>(params);
+        break;
+    }
 }
 
 // spline algorithm2 explicit function template instantiations - all combinations
-template void launch_SplineAlgKernel<false, false, false>(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<false, false, true >(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<false, true,  false>(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<false, true,  true >(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<true,  false, false>(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<true,  false, true >(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<true,  true,  false>(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-template void launch_SplineAlgKernel<true,  true,  true >(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
-
-void launch_AddNoiseKernel(int grid_size, int block_size, cudaStream_t stream, cuComplex* noise, cuComplex* signal, int num_samples) {
-    AddNoiseKernel<<<grid_size, block_size, 0, stream>>>(signal, noise, num_samples);
+template void launch_SplineAlgKernel<false, false, false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<false, false, true >(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<false, true,  false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<false, true,  true >(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<true,  false, false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<true,  false, true >(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<true,  true,  false>(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+template void launch_SplineAlgKernel<true,  true,  true >(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree, SplineAlgKernelParams params);
+
+void launch_ParametricLineDescriptorsKernel(int grid_size, int block_size, cudaStream_t stream, LineDescriptor* lines,
+                                            ParametricScanParams params, int num_lines) {
+    ParametricLineDescriptorsKernel<<<grid_size, block_size, 0, stream>>>(lines, params, num_lines);
+}
+
+void launch_ScatterKernel(int grid_size, int block_size, cudaStream_t stream, float* dst, const int* indices,
+                          const float* values, int num_values) {
+    ScatterKernel<<<grid_size, block_size, 0, stream>>>(dst, indices, values, num_values);
+}
+
+void launch_EnvelopeKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq, float* envelope,
+                           unsigned int* max_bits, int num_samples) {
+    EnvelopeKernel<<<grid_size, block_size, 0, stream>>>(iq, envelope, max_bits, num_samples);
+}
+
+void launch_MaxAbsIqComponentKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq,
+                                    unsigned int* max_bits, int num_samples) {
+    MaxAbsIqComponentKernel<<<grid_size, block_size, 0, stream>>>(iq, max_bits, num_samples);
+}
+
+void launch_PackIqKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq, unsigned int* packed,
+                         int sample_type, float int16_scale, const unsigned int* max_bits, int num_samples) {
+    PackIqKernel<<<grid_size, block_size, 0, stream>>>(iq, packed, sample_type, int16_scale, max_bits, num_samples);
+}
+
+void launch_GrayLevelKernel(int grid_size, int block_size, cudaStream_t stream, const float* envelope, unsigned char* gray_levels,
+                            const unsigned int* max_bits, float normalize_const, float dyn_range, float gain, int num_samples) {
+    GrayLevelKernel<<<grid_size, block_size, 0, stream>>>(envelope, gray_levels, max_bits, normalize_const, dyn_range, gain, num_samples);
+}
+
+void launch_ScanConvertKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, cudaTextureObject_t gray_level_tex,
+                              const bcsim::BModeImageConfig& config, int num_lines, int num_samples, unsigned char* image) {
+    dim3 grid(grid_size, grid_size1, 1);
+    ScanConvertKernel<<<grid, block_size, 0, stream>>>(gray_level_tex, config, num_lines, num_samples, image);
 }
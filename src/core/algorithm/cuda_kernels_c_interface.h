@@ -1,8 +1,13 @@
 #pragma once
-#include <cuda.h>
-#include <cuda_runtime_api.h>
-#include <cuComplex.h>
-#include <cufft.h>
+#ifndef __CUDACC_RTC__
+#include "gpu_runtime.h"
+#include "../BCSimConfig.hpp"    // for BModeImageConfig
+#else
+// the kernels compiled at runtime only see the parameter structs, and the
+// device types are built in.
+typedef float2 cuComplex;
+#endif
+#include "common_definitions.h" // for MAX_SPLINE_DEGREE and MAX_LUT_ZONES
 
 // Headers for all CUDA functionality accessible from C++
 
@@ -12,25 +17,145 @@ struct LUTProfileGeometry {
     float e_min, e_max;
 };
 
+// Decoding of compact fixed scatterers (see CompactScatterers.hpp): the codes
+// x, y, z as position origin + code*scale, and the half-precision amplitude
+// times amplitude_scale.
+struct CompactScattererDecoding {
+    float3 origin;
+    float3 scale;
+    float  amplitude_scale;
+};
+
+// Multi-resolution lookup-table beam profile (MultiResolutionLUTBeamProfile),
+// used instead of the single texture if num_zones is positive. A radial
+// distance is in zone i if it is between boundaries[i-1] and boundaries[i].
+struct MultiResolutionLUT {
+    int                 num_zones;
+    cudaTextureObject_t tex[MAX_LUT_ZONES];
+    LUTProfileGeometry  geometry[MAX_LUT_ZONES];
+    float               boundaries[MAX_LUT_ZONES-1];
+};
+
+// Separable approximation of the lookup-table beam profile (SeparableLUT of
+// lut_compression.hpp), evaluated instead of the 3D texture if rank is
+// positive. The profiles are in device memory, [rank][num_samples] each.
+struct SeparableLUTFactors {
+    const float* radial;
+    const float* lateral;
+    const float* elevational;
+    int num_samples_rad;
+    int num_samples_lat;
+    int num_samples_ele;
+    int rank;
+};
+
+// Gaussian noise of the time projections, generated where the samples are
+// initialized. Sample i of line l uses Philox4x32-10 counter
+// (i/2, first_line + l, frame.x, frame.y) with the key, as the noise of the
+// CPU algorithm (see philox.hpp). The frame number is read from device
+// memory, so that a captured frame stays valid.
+struct NoiseParams {
+    float        sigma;         // standard deviation of the real and imaginary parts
+    uint2        key;           // the seed
+    const uint2* frame;         // device memory with the frame number
+    int          first_line;    // line number of grid row zero
+};
+
+// A procedural dataset (see ProceduralScatterers in BCSimConfig.hpp), whose
+// scatterers are generated on the device from the seed and their index with
+// the same Philox4x32-10 counters as on the host.
+struct ProceduralParams {
+    int    ellipsoid;               // non-zero for an ellipsoid, zero for a box
+    float3 center;
+    float3 half_axes;
+    float3 axes_rows[3];            // the rows of the axes matrix
+    int    amplitude_distribution;  // ProceduralScatterers::AmplitudeDistribution
+    float  amplitude_scale;
+    uint2  key;                     // the seed
+};
+
+// An image volume dataset (see ImageVolumeScatterers in BCSimConfig.hpp).
+// Scatterer i is found in the voxel numbering by binary search and then
+// generated from its voxel and its number in the voxel as on the host.
+struct ImageVolumeParams {
+    float3                      origin;
+    float3                      voxel_size;
+    int                         nx;
+    int                         ny;
+    unsigned long long          num_voxels;
+    const unsigned long long*   voxel_starts;           // num_voxels + 1 scatterer numbers, in device memory
+    cudaTextureObject_t         amplitude_scales;       // point-sampled 3D texture of the voxels
+    int                         amplitude_distribution; // ProceduralScatterers::AmplitudeDistribution
+    uint2                       key;                    // the seed
+};
+
+// Geometry of one scanline for batched multi-line launches, where grid
+// row blockIdx.y projects onto line number blockIdx.y.
+struct LineDescriptor {
+    float3 rad_dir;                         // radial direction unit vector
+    float3 lat_dir;                         // lateral direction unit vector
+    float3 ele_dir;                         // elevational direction unit vector
+    float3 origin;                          // beam's origin
+    int    cs_idx_start;                    // spline evaluation sum start index (inclusive, splines only)
+    int    cs_idx_end;                      // spline evaluation sum end index (inclusive, splines only)
+    float  basis[MAX_SPLINE_DEGREE+1];      // non-zero basis functions at the line's timestamp (splines only)
+};
+
+// A parametric scan (see ParametricScan in ScanSequence.hpp) for generating
+// the geometry of the line descriptors on the device.
+struct ParametricScanParams {
+    int   sector;               // non-zero for a sector scan, zero for a linear scan
+    int   num_lines_lateral;    // lines per plane
+    int   num_planes;           // planes per frame
+    int   first_line;           // index in the parametric scan of descriptor zero
+    int   last_line;            // index of the last line, later indices are clamped to it
+    float lateral_extent;       // [m] for linear scans, [rad] for sector scans
+    float elevational_extent;   // [m] for linear scans, [rad] for sector scans
+    float tilt;                 // [rad], sector scans only
+    float rotation[9];          // orientation of the lines, row by row
+    float3 translation;         // added to the rotated origins
+};
+
+// The non-zero basis functions at one timestamp, passed by value so that
+// consecutive renders can be in flight at the same time.
+struct RenderSplineBasis {
+    float values[MAX_SPLINE_DEGREE + 1];
+};
+
 struct FixedAlgKernelParams {
     float* point_xs;            // pointer to device memory x components
     float* point_ys;            // pointer to device memory y components
     float* point_zs;            // pointer to device memory z components
     float* point_as;            // pointer to device memory amplitudes
+    const ushort4* point_codes; // if not null: compact scatterers used instead of the above
+    const float4* points;       // if not null: interleaved (x, y, z, amplitude) used instead of the arrays
+    CompactScattererDecoding compact;
     float3 rad_dir;             // radial direction unit vector
     float3 lat_dir;             // lateral direction unit vector
     float3 ele_dir;             // elevational direction unit vector
     float3 origin;              // beam's origin
     float  fs_hertz;            // temporal sampling frequency in hertz
     int    num_time_samples;    // number of samples in time signal
+    int    first_time_sample;   // sample of the line at res[0], non-zero with a depth window
     float  sigma_lateral;       // lateral beam width (for analyical beam profile)
     float  sigma_elevational;   // elevational beam width (for analytical beam profile)
+    float  max_profile_exponent; // cutoff of the analytical beam profile exponent
     float  sound_speed;         // speed of sound in meters per second
     cuComplex* res;             // the output buffer (complex projected amplitudes)
+    bool   real_res;            // if true, res is written as an array of real samples (no phase delay only)
+    float  fixed_point_scale;   // if positive: res holds ints of the values in units of 1/fixed_point_scale
     float  demod_freq;          // complex demodulation frequency.
     int    num_scatterers;      // number of scatterers
+    const int* indices;         // if not null: indices of the num_scatterers scatterers to project
+    const LineDescriptor* lines; // if not null: per-line geometry of a batched launch (overrides the above)
+    int    num_lines;           // number of lines in lines
+    int    lines_per_block;     // a block projects lines [blockIdx.y*lines_per_block, (blockIdx.y+1)*lines_per_block)
+    int    res_line_stride;     // distance between output lines of a batched launch in complex samples
+    int    shared_tile_len;     // if positive: accumulate each block in a shared-memory tile of this many samples
     cudaTextureObject_t lut_tex; // 3D texture object (for lookup-table beam profile)
     LUTProfileGeometry lut;
+    SeparableLUTFactors lut_factors; // used instead of lut_tex if the rank is positive
+    MultiResolutionLUT lut_zones;    // used instead of lut_tex if there are zones
 };
 
 struct SplineAlgKernelParams {
@@ -38,48 +163,100 @@ struct SplineAlgKernelParams {
     float* control_ys;                  // pointer to device memory y components
     float* control_zs;                  // pointer to device memory z components
     float* control_as;                  // pointer to device memory amplitudes
-    float3 rad_dir;                     // radial direction unit vector
-    float3 lat_dir;                     // lateral direction unit vector
-    float3 ele_dir;                     // elevational direction unit vector
-    float3 origin;                      // beam's origin
+    const float4* control_points;       // if not null: interleaved (x, y, z, 0) used instead of the coordinate arrays
     float  fs_hertz;                    // temporal sampling frequency in hertz
     int    num_time_samples;            // number of samples in time signal
+    int    first_time_sample;           // sample of the line at res[0], non-zero with a depth window
     float  sigma_lateral;               // lateral beam width (for analyical beam profile)
     float  sigma_elevational;           // elevational beam width (for analytical beam profile)
+    float  max_profile_exponent;        // cutoff of the analytical beam profile exponent
     float  sound_speed;                 // speed of sound in meters per second
-    int    cs_idx_start;                // start index for spline evaluation sum (inclusive)
-    int    cs_idx_end;                  // end index for spline evaluation sum (inclusive)
     int    NUM_SPLINES;                 // number of splines in phantom (i.e. number of scatterers)
     cuComplex* res;                     // the output buffer (complex projected amplitudes)
-    size_t eval_basis_offset_elements;  // memory offset (for different CUDA streams)
+    bool   real_res;                    // if true, res is written as an array of real samples (no phase delay only)
+    float  fixed_point_scale;           // if positive: res holds ints of the values in units of 1/fixed_point_scale
     float  demod_freq;                  // complex demodulation frequency.
+    const LineDescriptor* lines;        // per-line geometry and basis functions, line blockIdx.y is projected onto
+    int    num_lines;                   // number of lines in params.lines
+    int    lines_per_block;             // a block projects lines [blockIdx.y*lines_per_block, (blockIdx.y+1)*lines_per_block)
+    bool   shared_basis;                // if true: the lines of a block have the same basis functions
+    int    res_line_stride;             // distance between output lines of a batched launch in complex samples
+    int    shared_tile_len;             // if positive: accumulate each block in a shared-memory tile of this many samples
     cudaTextureObject_t lut_tex;        // 3D texture object (for lookup-table beam profile) 
     LUTProfileGeometry lut;
+    SeparableLUTFactors lut_factors;    // used instead of lut_tex if the rank is positive
+    MultiResolutionLUT lut_zones;       // used instead of lut_tex if there are zones
 };
 
+#ifndef __CUDACC_RTC__
 template <typename T>
 void launch_MemsetKernel(int grid_size, int block_size, cudaStream_t stream, T* ptr, T value, int num_elements);
 
 void launch_MultiplyFftKernel(int grid_size, int block_size, cudaStream_t stream, cufftComplex* time_proj_fft, const cufftComplex* filter_fft, int num_samples);
 
-void launch_DemodulateKernel(int grid_size, int block_size, cudaStream_t stream, cuComplex* signal, float w, int num_samples);
+void launch_DemodulateDecimateKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* signal, cuComplex* out,
+                                     float w, int offset, int decimation, int num_out);
 
 void launch_ScaleSignalKernel(int grid_size, int block_size, cudaStream_t stream, cufftComplex* signal, float factor, int num_samples);
 
-template <bool A, bool B, bool C>
-void launch_FixedAlgKernel(int grid_size, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+// Launches over num_lines lines (one per grid row) operate on the whole frame,
+// where line i starts at offset i*line_stride.
+void launch_MemsetBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr, cuComplex value,
+                                int num_samples, int line_stride);
+
+// Converts the first num_values ints of each line, stored as the bits of
+// floats, to floats multiplied with inv_scale (line_stride is in floats).
+void launch_FixedPointToFloatBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, float* values,
+                                           float inv_scale, int num_values, int line_stride);
+
+// Initializes the first num_samples samples of each line with noise.
+void launch_MemsetNoiseBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr,
+                                     NoiseParams noise, int num_samples, int line_stride);
+
+// As launch_FixedPointToFloatBatchedKernel() for num_samples complex samples
+// per line, adding noise to the converted samples.
+void launch_FixedPointToFloatNoiseBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cuComplex* ptr,
+                                                float inv_scale, NoiseParams noise, int num_samples, int line_stride);
+
+// Writes the scatterers [first, first + num_scatterers) of a procedural
+// dataset to the four arrays, one scatterer per thread.
+void launch_GenerateProceduralKernel(int grid_size, int block_size, cudaStream_t stream, ProceduralParams params,
+                                     unsigned long long first, int num_scatterers, float* xs, float* ys, float* zs, float* as);
+
+// As launch_GenerateProceduralKernel() for an image volume dataset.
+void launch_GenerateImageVolumeKernel(int grid_size, int block_size, cudaStream_t stream, ImageVolumeParams params,
+                                      unsigned long long first, int num_scatterers, float* xs, float* ys, float* zs, float* as);
+
+// Multiplies the first num_bins samples of each line with the filter and zeroes the remaining samples.
+void launch_MultiplyFftBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, cufftComplex* time_proj_fft,
+                                     const cufftComplex* filter_fft, int num_bins, int num_samples);
+
+void launch_DemodulateDecimateBatchedKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, const cuComplex* signal,
+                                            cuComplex* out, float w, int offset, int decimation, int num_out, int signal_line_stride);
+
+// One block per line, block_size a multiple of 32.
+// block_size is rounded up to whole warps.
+void launch_CollectNonzeroKernel(int num_lines, int block_size, cudaStream_t stream, const cuComplex* time_proj, int num_samples,
+                                 int line_stride, bool real_input, int capacity, int* counts, int* indices, cuComplex* values);
 
-// Upload data to constant memory [workaround the fact that constant memory cannot be allocated dynamically]
-// Returns false on error.
-bool splineAlg1_updateConstantMemory(float* src_ptr, size_t num_bytes);
+void launch_SparseSynthesisKernel(int grid_size, int num_lines, int block_size, cudaStream_t stream, const int* counts,
+                                  const int* indices, const cuComplex* values, int capacity, const cuComplex* taps, int num_taps,
+                                  int first_lag, cuComplex* out, float w, int offset, int decimation, int num_out);
 
+// grid_size1 is the number of lines in a batched launch (one if params.lines is null).
+template <bool A, bool B, bool C>
+void launch_FixedAlgKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, FixedAlgKernelParams params);
+
+// basis holds the basis functions cs_idx_start, ..., cs_idx_end.
 void launch_RenderSplineKernel(int grid_size, int block_size, cudaStream_t stream,
+                               const float4* control_points,
                                const float* control_xs,
                                const float* control_ys,
                                const float* control_zs,
                                float* rendered_xs,
                                float* rendered_ys,
                                float* rendered_zs,
+                               RenderSplineBasis basis,
                                int cs_idx_start,
                                int cs_idx_end,
                                int NUM_SPLINES);
@@ -91,10 +268,37 @@ void launch_SliceLookupTable(int grid_size0, int grid_size1, int block_size, cud
                              float* output,
                              cudaTextureObject_t lut_tex);
 
-// Returns false on error.
-bool splineAlg2_updateConstantMemory(float* src, size_t count, size_t offset, cudaMemcpyKind kind, cudaStream_t stream);
-
+// grid_size1 is the number of lines in a batched launch (one if params.lines is null).
+// The kernels of the spline degrees 1 to MAX_SPLINE_DEGREE are compiled with
+// a constant number of control points.
 template <bool A, bool B, bool C>
-void launch_SplineAlgKernel(int grid_size, int block_size, cudaStream_t stream, SplineAlgKernelParams params);
+void launch_SplineAlgKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, int spline_degree,
+                            SplineAlgKernelParams params);
+
+// Writes the geometry of num_lines line descriptors of a parametric scan.
+void launch_ParametricLineDescriptorsKernel(int grid_size, int block_size, cudaStream_t stream, LineDescriptor* lines,
+                                            ParametricScanParams params, int num_lines);
+
+// Writes values[i] to dst[indices[i]] for i < num_values.
+void launch_ScatterKernel(int grid_size, int block_size, cudaStream_t stream, float* dst, const int* indices,
+                          const float* values, int num_values);
+
+// block_size must be a power of two and at most 256. *max_bits must be zero
+// before the launch.
+void launch_EnvelopeKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq, float* envelope,
+                           unsigned int* max_bits, int num_samples);
+
+// Same launch requirements as launch_EnvelopeKernel.
+void launch_MaxAbsIqComponentKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq,
+                                    unsigned int* max_bits, int num_samples);
+
+void launch_PackIqKernel(int grid_size, int block_size, cudaStream_t stream, const cuComplex* iq, unsigned int* packed,
+                         int sample_type, float int16_scale, const unsigned int* max_bits, int num_samples);
+
+void launch_GrayLevelKernel(int grid_size, int block_size, cudaStream_t stream, const float* envelope, unsigned char* gray_levels,
+                            const unsigned int* max_bits, float normalize_const, float dyn_range, float gain, int num_samples);
 
-void launch_AddNoiseKernel(int grid_size, int block_size, cudaStream_t stream, cuComplex* noise, cuComplex* signal, int num_samples);
+// grid_size1 is the image height.
+void launch_ScanConvertKernel(int grid_size, int grid_size1, int block_size, cudaStream_t stream, cudaTextureObject_t gray_level_tex,
+                              const bcsim::BModeImageConfig& config, int num_lines, int num_samples, unsigned char* image);
+#endif  // __CUDACC_RTC__
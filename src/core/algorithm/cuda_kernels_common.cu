@@ -27,12 +27,8 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include <cuda.h>
-#include <cufft.h>
-#include <math_functions.h> // for sincosf()
-#include <cuComplex.h> // for cuCmulf()
+#include "gpu_runtime.h"
 #include "cuda_helpers.h"
-#include "device_launch_parameters.h" // for removing annoying MSVC intellisense error messages
 #include "cuda_kernels_common.cuh"
 
 __global__ void MultiplyFftKernel(cufftComplex* time_proj_fft, const cufftComplex* filter_fft, int num_samples) {
@@ -44,6 +40,177 @@ __global__ void MultiplyFftKernel(cufftComplex* time_proj_fft, const cufftComple
     }
 }
 
+__global__ void MemsetBatchedKernel(cuComplex* res, cuComplex value, int num_samples, int line_stride) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_samples) {
+        res[blockIdx.y*line_stride + global_idx] = value;
+    }
+}
+
+__global__ void FixedPointToFloatBatchedKernel(float* values, float inv_scale, int num_values, int line_stride) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_values) {
+        float* value = values + blockIdx.y*line_stride + global_idx;
+        *value = __float_as_int(*value)*inv_scale;
+    }
+}
+
+__global__ void MemsetNoiseBatchedKernel(cuComplex* res, NoiseParams noise, int num_samples, int line_stride) {
+    const int pair = blockIdx.x*blockDim.x + threadIdx.x;
+    const int sample_idx = 2*pair;
+    if (sample_idx < num_samples) {
+        const float4 values = NoiseSamplePair(noise, blockIdx.y, pair);
+        cuComplex* line = res + blockIdx.y*line_stride;
+        line[sample_idx] = make_cuComplex(values.x, values.y);
+        if (sample_idx + 1 < num_samples) {
+            line[sample_idx + 1] = make_cuComplex(values.z, values.w);
+        }
+    }
+}
+
+__global__ void GenerateProceduralKernel(ProceduralParams params, unsigned long long first, int num_scatterers,
+                                         float* xs, float* ys, float* zs, float* as) {
+    const int idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (idx >= num_scatterers) {
+        return;
+    }
+    // the counter of ProceduralScatterers::get_scatterer()
+    const unsigned long long i = first + idx;
+    const uint4 bits = Philox4x32(make_uint4(static_cast<unsigned int>(i), static_cast<unsigned int>(i >> 32), 0u, 0u), params.key);
+    float3 local;
+    if (params.ellipsoid) {
+        // uniform in the unit ball: cube root of the radius, uniform cosine of the polar angle
+        const float radius    = cbrtf(Uniform24(bits.x));
+        const float cos_theta = 2.0f*Uniform24(bits.y) - 1.0f;
+        const float sin_theta = sqrtf(fmaxf(0.0f, 1.0f - cos_theta*cos_theta));
+        float sin_phi, cos_phi;
+        sincospif(2.0f*Uniform24(bits.z), &sin_phi, &cos_phi);
+        local = make_float3(sin_theta*cos_phi*radius, sin_theta*sin_phi*radius, cos_theta*radius);
+    } else {
+        local = make_float3(2.0f*Uniform24(bits.x) - 1.0f, 2.0f*Uniform24(bits.y) - 1.0f, 2.0f*Uniform24(bits.z) - 1.0f);
+    }
+    const float3 scaled = make_float3(local.x*params.half_axes.x, local.y*params.half_axes.y, local.z*params.half_axes.z);
+    xs[idx] = params.center.x + dot(params.axes_rows[0], scaled);
+    ys[idx] = params.center.y + dot(params.axes_rows[1], scaled);
+    zs[idx] = params.center.z + dot(params.axes_rows[2], scaled);
+    as[idx] = DrawAmplitude(params.amplitude_distribution, params.amplitude_scale, bits.w);
+}
+
+__global__ void GenerateImageVolumeKernel(ImageVolumeParams params, unsigned long long first, int num_scatterers,
+                                          float* xs, float* ys, float* zs, float* as) {
+    const int idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (idx >= num_scatterers) {
+        return;
+    }
+    // the last voxel v with voxel_starts[v] <= i, as ImageVolumeScatterers::find_voxel()
+    const unsigned long long i = first + idx;
+    unsigned long long lo = 0;
+    unsigned long long hi = params.num_voxels;
+    while (hi - lo > 1) {
+        const unsigned long long mid = lo + (hi - lo)/2;
+        if (params.voxel_starts[mid] <= i) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const unsigned long long v = lo;
+    const unsigned int j = static_cast<unsigned int>(i - params.voxel_starts[v]);
+
+    // the counter of ImageVolumeScatterers::get_voxel_scatterer()
+    const uint4 bits = Philox4x32(make_uint4(static_cast<unsigned int>(v), static_cast<unsigned int>(v >> 32), 1u, j + 1u), params.key);
+    const int ix = static_cast<int>(v % params.nx);
+    const int iy = static_cast<int>((v/params.nx) % params.ny);
+    const int iz = static_cast<int>(v/(static_cast<unsigned long long>(params.nx)*params.ny));
+    xs[idx] = params.origin.x + params.voxel_size.x*(ix + Uniform24(bits.x));
+    ys[idx] = params.origin.y + params.voxel_size.y*(iy + Uniform24(bits.y));
+    zs[idx] = params.origin.z + params.voxel_size.z*(iz + Uniform24(bits.z));
+    const float amplitude_scale = tex3D<float>(params.amplitude_scales, ix + 0.5f, iy + 0.5f, iz + 0.5f);
+    as[idx] = DrawAmplitude(params.amplitude_distribution, amplitude_scale, bits.w);
+}
+
+__global__ void FixedPointToFloatNoiseBatchedKernel(cuComplex* res, float inv_scale, NoiseParams noise, int num_samples, int line_stride) {
+    const int pair = blockIdx.x*blockDim.x + threadIdx.x;
+    const int sample_idx = 2*pair;
+    if (sample_idx < num_samples) {
+        const float4 values = NoiseSamplePair(noise, blockIdx.y, pair);
+        cuComplex* line = res + blockIdx.y*line_stride;
+        const cuComplex first = line[sample_idx];
+        line[sample_idx] = make_cuComplex(__float_as_int(first.x)*inv_scale + values.x, __float_as_int(first.y)*inv_scale + values.y);
+        if (sample_idx + 1 < num_samples) {
+            const cuComplex second = line[sample_idx + 1];
+            line[sample_idx + 1] = make_cuComplex(__float_as_int(second.x)*inv_scale + values.z,
+                                                  __float_as_int(second.y)*inv_scale + values.w);
+        }
+    }
+}
+
+__global__ void ParametricLineDescriptorsKernel(LineDescriptor* lines, ParametricScanParams params, int num_lines) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx >= num_lines) {
+        return;
+    }
+    const int line_no    = min(params.first_line + global_idx, params.last_line);
+    const int frame_line = line_no % (params.num_lines_lateral*params.num_planes);
+    const int lateral_no = frame_line % params.num_lines_lateral;
+    const int plane_no   = frame_line / params.num_lines_lateral;
+    const float u = (params.num_lines_lateral > 1) ? static_cast<float>(lateral_no)/(params.num_lines_lateral - 1) - 0.5f : 0.0f;
+    const float v = (params.num_planes > 1) ? static_cast<float>(plane_no)/(params.num_planes - 1) - 0.5f : 0.0f;
+
+    float3 rad_dir, lat_dir, origin;
+    if (params.sector) {
+        float sin_a, cos_a, sin_b, cos_b;
+        sincosf(u*params.lateral_extent + params.tilt, &sin_a, &cos_a);
+        sincosf(v*params.elevational_extent, &sin_b, &cos_b);
+        rad_dir = make_float3(sin_a, -sin_b*cos_a, cos_b*cos_a);
+        lat_dir = make_float3(cos_a, sin_b*sin_a, -cos_b*sin_a);
+        origin  = make_float3(0.0f, 0.0f, 0.0f);
+    } else {
+        rad_dir = make_float3(0.0f, 0.0f, 1.0f);
+        lat_dir = make_float3(1.0f, 0.0f, 0.0f);
+        origin  = make_float3(u*params.lateral_extent, v*params.elevational_extent, 0.0f);
+    }
+
+    LineDescriptor& line = lines[global_idx];
+    const float* r = params.rotation;
+    line.rad_dir = make_float3(r[0]*rad_dir.x + r[1]*rad_dir.y + r[2]*rad_dir.z,
+                               r[3]*rad_dir.x + r[4]*rad_dir.y + r[5]*rad_dir.z,
+                               r[6]*rad_dir.x + r[7]*rad_dir.y + r[8]*rad_dir.z);
+    line.lat_dir = make_float3(r[0]*lat_dir.x + r[1]*lat_dir.y + r[2]*lat_dir.z,
+                               r[3]*lat_dir.x + r[4]*lat_dir.y + r[5]*lat_dir.z,
+                               r[6]*lat_dir.x + r[7]*lat_dir.y + r[8]*lat_dir.z);
+    line.origin  = make_float3(r[0]*origin.x + r[1]*origin.y + r[2]*origin.z + params.translation.x,
+                               r[3]*origin.x + r[4]*origin.y + r[5]*origin.z + params.translation.y,
+                               r[6]*origin.x + r[7]*origin.y + r[8]*origin.z + params.translation.z);
+    // elevational direction is lateral x radial, as in Scanline
+    line.ele_dir = make_float3(line.lat_dir.y*line.rad_dir.z - line.lat_dir.z*line.rad_dir.y,
+                               line.lat_dir.z*line.rad_dir.x - line.lat_dir.x*line.rad_dir.z,
+                               line.lat_dir.x*line.rad_dir.y - line.lat_dir.y*line.rad_dir.x);
+    line.cs_idx_start = 0;
+    line.cs_idx_end   = -1;
+}
+
+__global__ void ScatterKernel(float* dst, const int* indices, const float* values, int num_values) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_values) {
+        dst[indices[global_idx]] = values[global_idx];
+    }
+}
+
+__global__ void MultiplyFftBatchedKernel(cufftComplex* time_proj_fft, const cufftComplex* filter_fft, int num_bins, int num_samples) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_samples) {
+        cufftComplex* line_fft = time_proj_fft + blockIdx.y*num_samples;
+        if (global_idx < num_bins) {
+            cufftComplex a = line_fft[global_idx];
+            cufftComplex b = filter_fft[global_idx];
+            line_fft[global_idx] = make_float2(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);
+        } else {
+            line_fft[global_idx] = make_float2(0.0f, 0.0f);
+        }
+    }
+}
+
 __global__ void ScaleSignalKernel(cufftComplex* signal, float factor, int num_samples) {
     const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
     if (global_idx < num_samples) {
@@ -52,21 +219,189 @@ __global__ void ScaleSignalKernel(cufftComplex* signal, float factor, int num_sa
     }
 }
 
-__global__ void DemodulateKernel(cuComplex* signal, float w, int num_samples) {
-    const auto global_idx = blockIdx.x*blockDim.x + threadIdx.x;
-    if (global_idx < num_samples) {
+__global__ void DemodulateDecimateKernel(const cuComplex* signal, cuComplex* out, float w,
+                                         int offset, int decimation, int num_out) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_out) {
+        const int n = offset + global_idx*decimation;
+
         // exp(-i*w*n) = cos(w*n) - i*sin(w*n)
         float sin_value, cos_value;
-        sincosf(w*global_idx, &sin_value, &cos_value);
+        sincosf(w*n, &sin_value, &cos_value);
         const auto c = make_cuComplex(cos_value, -sin_value);
 
-        signal[global_idx] = cuCmulf(signal[global_idx], c);
+        out[global_idx] = cuCmulf(signal[n], c);
     }
 }
 
-__global__ void AddNoiseKernel(cuComplex* signal, cuComplex* noise, int num_samples) {
+__global__ void DemodulateDecimateBatchedKernel(const cuComplex* signal, cuComplex* out, float w,
+                                                int offset, int decimation, int num_out, int signal_line_stride) {
     const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_out) {
+        const int n = offset + global_idx*decimation;
+
+        // exp(-i*w*n) = cos(w*n) - i*sin(w*n)
+        float sin_value, cos_value;
+        sincosf(w*n, &sin_value, &cos_value);
+        const auto c = make_cuComplex(cos_value, -sin_value);
+
+        out[blockIdx.y*num_out + global_idx] = cuCmulf(signal[blockIdx.y*signal_line_stride + n], c);
+    }
+}
+
+__global__ void CollectNonzeroKernel(const cuComplex* time_proj, int num_samples, int line_stride, bool real_input,
+                                     int capacity, int* counts, int* indices, cuComplex* values) {
+    __shared__ int warp_offsets[1024/BCSIM_WARP_SIZE];
+    __shared__ int num_found;
+    const int line = blockIdx.y;
+    const cuComplex* signal = time_proj + line*line_stride;
+    const float* real_signal = reinterpret_cast<const float*>(signal);
+    const int lane = threadIdx.x % BCSIM_WARP_SIZE;
+    const int warp = threadIdx.x/BCSIM_WARP_SIZE;
+    const int num_warps = (blockDim.x + BCSIM_WARP_SIZE - 1)/BCSIM_WARP_SIZE;
+    if (threadIdx.x == 0) {
+        num_found = 0;
+    }
+    __syncthreads();
+    for (int start = 0; start < num_samples; start += blockDim.x) {
+        const int i = start + threadIdx.x;
+        cuComplex value = make_cuComplex(0.0f, 0.0f);
+        if (i < num_samples) {
+            value = real_input ? make_cuComplex(real_signal[i], 0.0f) : signal[i];
+        }
+        const bool is_nonzero = (value.x != 0.0f) || (value.y != 0.0f);
+        const WarpMask mask = warp_ballot(is_nonzero);
+        if (lane == 0) {
+            warp_offsets[warp] = warp_popc(mask);
+        }
+        __syncthreads();
+        // exclusive scan of the warp counts keeps the samples in order
+        if (threadIdx.x == 0) {
+            int sum = num_found;
+            for (int w = 0; w < num_warps; w++) {
+                const int count = warp_offsets[w];
+                warp_offsets[w] = sum;
+                sum += count;
+            }
+            num_found = sum;
+        }
+        __syncthreads();
+        if (is_nonzero) {
+            const int slot = warp_offsets[warp] + warp_popc(mask & warp_lanes_below(lane));
+            if (slot < capacity) {
+                indices[line*capacity + slot] = i;
+                values[line*capacity + slot] = value;
+            }
+        }
+        __syncthreads();
+    }
+    if (threadIdx.x == 0) {
+        counts[line] = num_found;
+    }
+}
+
+__global__ void SparseSynthesisKernel(const int* counts, const int* indices, const cuComplex* values, int capacity,
+                                      const cuComplex* taps, int num_taps, int first_lag, cuComplex* out,
+                                      float w, int offset, int decimation, int num_out) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_out) {
+        const int line = blockIdx.y;
+        const int n = offset + global_idx*decimation;
+        const int count = min(counts[line], capacity);
+        cuComplex sum = make_cuComplex(0.0f, 0.0f);
+        for (int k = 0; k < count; k++) {
+            const int tap_no = n - indices[line*capacity + k] - first_lag;
+            if ((tap_no >= 0) && (tap_no < num_taps)) {
+                sum = cuCaddf(sum, cuCmulf(values[line*capacity + k], taps[tap_no]));
+            }
+        }
+
+        // exp(-i*w*n) = cos(w*n) - i*sin(w*n)
+        float sin_value, cos_value;
+        sincosf(w*n, &sin_value, &cos_value);
+        out[line*num_out + global_idx] = cuCmulf(sum, make_cuComplex(cos_value, -sin_value));
+    }
+}
+
+__global__ void EnvelopeKernel(const cuComplex* iq, float* envelope, unsigned int* max_bits, int num_samples) {
+    __shared__ float block_max[256];
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    float value = 0.0f;
     if (global_idx < num_samples) {
-        signal[global_idx] = make_cuComplex(signal[global_idx].x+noise[global_idx].x, signal[global_idx].y+noise[global_idx].y);
+        value = cuCabsf(iq[global_idx]);
+        envelope[global_idx] = value;
+    }
+    // reduction in shared memory [blockDim.x is a power of two and at most 256]
+    block_max[threadIdx.x] = value;
+    __syncthreads();
+    for (int offset = blockDim.x/2; offset > 0; offset /= 2) {
+        if (threadIdx.x < offset) {
+            block_max[threadIdx.x] = fmaxf(block_max[threadIdx.x], block_max[threadIdx.x + offset]);
+        }
+        __syncthreads();
+    }
+    if (threadIdx.x == 0) {
+        atomicMax(max_bits, __float_as_uint(block_max[0]));
+    }
+}
+
+__global__ void MaxAbsIqComponentKernel(const cuComplex* iq, unsigned int* max_bits, int num_samples) {
+    __shared__ float block_max[256];
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    float value = 0.0f;
+    if (global_idx < num_samples) {
+        value = fmaxf(fabsf(iq[global_idx].x), fabsf(iq[global_idx].y));
+    }
+    // reduction in shared memory [blockDim.x is a power of two and at most 256]
+    block_max[threadIdx.x] = value;
+    __syncthreads();
+    for (int offset = blockDim.x/2; offset > 0; offset /= 2) {
+        if (threadIdx.x < offset) {
+            block_max[threadIdx.x] = fmaxf(block_max[threadIdx.x], block_max[threadIdx.x + offset]);
+        }
+        __syncthreads();
+    }
+    if (threadIdx.x == 0) {
+        atomicMax(max_bits, __float_as_uint(block_max[0]));
+    }
+}
+
+__global__ void PackIqKernel(const cuComplex* iq, unsigned int* packed, int sample_type, float int16_scale,
+                             const unsigned int* max_bits, int num_samples) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_samples) {
+        const auto sample = iq[global_idx];
+        unsigned int re, im;
+        if (sample_type == static_cast<int>(bcsim::IqOutputFormat::SampleType::COMPLEX_INT16)) {
+            const float scale = max_bits ? bcsim::int16_frame_scale(__uint_as_float(*max_bits)) : int16_scale;
+            re = static_cast<unsigned short>(bcsim::quantize_int16(sample.x, scale));
+            im = static_cast<unsigned short>(bcsim::quantize_int16(sample.y, scale));
+        } else {
+            re = bcsim::float_to_half_bits(sample.x);
+            im = bcsim::float_to_half_bits(sample.y);
+        }
+        packed[global_idx] = re | (im << 16);
+    }
+}
+
+__global__ void GrayLevelKernel(const float* envelope, unsigned char* gray_levels, const unsigned int* max_bits,
+                                float normalize_const, float dyn_range, float gain, int num_samples) {
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    if (global_idx < num_samples) {
+        const float normalization = max_bits ? __uint_as_float(*max_bits) : normalize_const;
+        gray_levels[global_idx] = static_cast<unsigned char>(bcsim::bmode_gray_level(envelope[global_idx], normalization, dyn_range, gain));
+    }
+}
+
+__global__ void ScanConvertKernel(cudaTextureObject_t gray_level_tex, bcsim::BModeImageConfig config,
+                                  int num_lines, int num_samples, unsigned char* image) {
+    const int xi = blockIdx.x*blockDim.x + threadIdx.x;
+    const int yi = blockIdx.y;
+    if (xi < config.width) {
+        float sample_pos, line_pos;
+        bcsim::bmode_pixel_position(config, num_lines, num_samples, xi, yi, sample_pos, line_pos);
+        // texel centers are at half-integers, and the border is zero
+        const float value = tex2D<float>(gray_level_tex, sample_pos + 0.5f, line_pos + 0.5f);
+        image[yi*config.width + xi] = static_cast<unsigned char>(255.0f*value + 0.5f);
     }
 }
@@ -27,11 +27,12 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
-#include <cuda.h>
-#include <cuda_runtime_api.h>
-#include <cuComplex.h>
-#include <cufft.h>
-#include "cuda_kernels_c_interface.h"   // for struct LUTProfileGeometry
+#include "gpu_runtime.h"
+#include "cuda_helpers.h"
+#include "cuda_kernels_c_interface.h"
+#include "cuda_kernels_projection.cuh"  // for the projection of the scatterers
+#include "../bmode_image.hpp"
+#include "../iq_format.hpp"
 
 // initialize GPU memory with value
 template <typename T>
@@ -42,38 +43,146 @@ __global__ void MemsetKernel(T* res, T value, int num_samples) {
     }
 }
 
-// Compute projection weight from Gaussian analytical beam profile.
-__device__ __inline__ float ComputeWeightAnalytical(float sigma_lateral,
-                                                    float sigma_elevational,
-                                                    float radial_dist,
-                                                    float lateral_dist,
-                                                    float elev_dist) {
-    const float two_sigma_lateral_squared     = 2.0f*sigma_lateral*sigma_lateral;
-    const float two_sigma_elevational_squared = 2.0f*sigma_elevational*sigma_elevational; 
-    return expf(-(lateral_dist*lateral_dist/two_sigma_lateral_squared + elev_dist*elev_dist/two_sigma_elevational_squared));
+// initialize the first num_samples samples of line blockIdx.y
+__global__ void MemsetBatchedKernel(cuComplex* res, cuComplex value, int num_samples, int line_stride);
+
+// convert the first num_values fixed-point ints of line blockIdx.y to floats in place
+__global__ void FixedPointToFloatBatchedKernel(float* values, float inv_scale, int num_values, int line_stride);
+
+// Philox4x32-10 of philox.hpp: four random words of a counter and key.
+__device__ __inline__ uint4 Philox4x32(uint4 ctr, uint2 key) {
+    for (int round = 0; round < 10; round++) {
+        if (round > 0) {
+            key.x += 0x9E3779B9u;
+            key.y += 0xBB67AE85u;
+        }
+        const unsigned int hi0 = __umulhi(0xD2511F53u, ctr.x);
+        const unsigned int lo0 = 0xD2511F53u*ctr.x;
+        const unsigned int hi1 = __umulhi(0xCD9E8D57u, ctr.z);
+        const unsigned int lo1 = 0xCD9E8D57u*ctr.z;
+        ctr = make_uint4(hi1^ctr.y^key.x, lo1, hi0^ctr.w^key.y, lo0);
+    }
+    return ctr;
+}
+
+// Box-Muller transform of two random words with 24-bit uniforms, as in
+// philox::add_gaussian_noise().
+__device__ __inline__ float2 GaussianPair(unsigned int bits1, unsigned int bits2, float sigma) {
+    const float u1 = ((bits1 >> 8) + 1)*(1.0f/16777216.0f);
+    const float u2 = (bits2 >> 8)*(1.0f/16777216.0f);
+    const float radius = sigma*sqrtf(-2.0f*logf(u1));
+    float sin_value, cos_value;
+    sincospif(2.0f*u2, &sin_value, &cos_value);
+    return make_float2(radius*cos_value, radius*sin_value);
+}
+
+// The complex noise samples 2*pair and 2*pair+1 of a line.
+__device__ __inline__ float4 NoiseSamplePair(const NoiseParams& noise, int line_no, int pair) {
+    const uint2 frame = *noise.frame;
+    const uint4 bits = Philox4x32(make_uint4(pair, noise.first_line + line_no, frame.x, frame.y), noise.key);
+    const float2 first  = GaussianPair(bits.x, bits.y, noise.sigma);
+    const float2 second = GaussianPair(bits.z, bits.w, noise.sigma);
+    return make_float4(first.x, first.y, second.x, second.y);
 }
 
-// Compute projection weight from a 3D texture based beam profile.
-__device__ __inline__ float ComputeWeightLUT(cudaTextureObject_t lut_tex,
-                                             float radial_dist,
-                                             float lateral_dist, 
-                                             float elev_dist,
-                                             LUTProfileGeometry lut_geo) {
-    const auto r_normalized = (radial_dist-lut_geo.r_min)/(lut_geo.r_max-lut_geo.r_min);
-    const auto l_normalized = (lateral_dist-lut_geo.l_min)/(lut_geo.l_max-lut_geo.l_min);
-    const auto e_normalized = (elev_dist-lut_geo.e_min)/(lut_geo.e_max-lut_geo.e_min);
-    return tex3D<float>(lut_tex, l_normalized, e_normalized, r_normalized);
+// Uniform in (0, 1) from the upper 24 bits of a random word.
+__device__ __inline__ float Uniform24(unsigned int word) {
+    return ((word >> 8) + 0.5f)*(1.0f/16777216.0f);
 }
 
+// Amplitude from one random word as ProceduralScatterers::draw_amplitude().
+__device__ __inline__ float DrawAmplitude(int distribution, float scale, unsigned int word) {
+    switch (distribution) {
+    case 0: {
+        // Box-Muller with the 16-bit halves of the word, u in (0, 1]
+        const float u1 = ((word >> 16) + 1)*(1.0f/65536.0f);
+        const float u2 = (word & 0xFFFFu)*(1.0f/65536.0f);
+        return scale*sqrtf(-2.0f*logf(u1))*cospif(2.0f*u2);
+    }
+    case 1:
+        return scale*(2.0f*Uniform24(word) - 1.0f);
+    default:
+        return scale;
+    }
+}
+
+// generate the scatterers [first, first + num_scatterers) of a procedural dataset, one per thread
+__global__ void GenerateProceduralKernel(ProceduralParams params, unsigned long long first, int num_scatterers,
+                                         float* xs, float* ys, float* zs, float* as);
+
+// generate the scatterers [first, first + num_scatterers) of an image volume dataset, one per thread
+__global__ void GenerateImageVolumeKernel(ImageVolumeParams params, unsigned long long first, int num_scatterers,
+                                          float* xs, float* ys, float* zs, float* as);
+
+// initialize the first num_samples samples of line blockIdx.y with noise, two per thread
+__global__ void MemsetNoiseBatchedKernel(cuComplex* res, NoiseParams noise, int num_samples, int line_stride);
+
+// convert the first num_samples fixed-point complex samples of line blockIdx.y
+// to floats in place and add noise, two per thread
+__global__ void FixedPointToFloatNoiseBatchedKernel(cuComplex* res, float inv_scale, NoiseParams noise, int num_samples, int line_stride);
+
 // used to multiply the FFTs
 __global__ void MultiplyFftKernel(cufftComplex* time_proj_fft, const cufftComplex* filter_fft, int num_samples);
 
+// multiply the FFT of line blockIdx.y with the filter, zeroing from bin num_bins
+__global__ void MultiplyFftBatchedKernel(cufftComplex* time_proj_fft, const cufftComplex* filter_fft, int num_bins, int num_samples);
+
 // scale a signal (to avoid losing precision)
 __global__ void ScaleSignalKernel(cufftComplex* signal, float factor, int num_samples);
 
-// inplace IQ demodulation.
+// IQ demodulation fused with delay compensation and decimation: only the
+// samples that are kept are demodulated and written to a compact output.
+// out[i] = signal[offset + i*decimation]*exp(-i*w*(offset + i*decimation)) for i < num_out
 // normalized_angular_freq = 2*pi*f_demod, where f_demod in [0.0, 0.5]
-__global__ void DemodulateKernel(cuComplex* signal, float normalized_angular_freq, int num_samples);
+__global__ void DemodulateDecimateKernel(const cuComplex* signal, cuComplex* out, float normalized_angular_freq,
+                                         int offset, int decimation, int num_out);
+
+// DemodulateDecimateKernel for line blockIdx.y of a compact [num_lines x num_out] output
+__global__ void DemodulateDecimateBatchedKernel(const cuComplex* signal, cuComplex* out, float normalized_angular_freq,
+                                                int offset, int decimation, int num_out, int signal_line_stride);
+
+// Sparse convolution, step one: the non-zero samples of line blockIdx.y in
+// order, with one block per line. The first capacity of them are written to
+// indices and values at line*capacity, and their number to counts[line].
+// blockDim.x must be a multiple of the warp size. With real_input, a line
+// holds num_samples floats, as with the R2C transform.
+__global__ void CollectNonzeroKernel(const cuComplex* time_proj, int num_samples, int line_stride, bool real_input,
+                                     int capacity, int* counts, int* indices, cuComplex* values);
+
+// Sparse convolution, step two: the demodulated IQ samples of line
+// blockIdx.y from its collected samples, as DemodulateDecimateBatchedKernel
+// of the convolution with taps, which are at lags first_lag, first_lag + 1, ...
+__global__ void SparseSynthesisKernel(const int* counts, const int* indices, const cuComplex* values, int capacity,
+                                      const cuComplex* taps, int num_taps, int first_lag, cuComplex* out,
+                                      float normalized_angular_freq, int offset, int decimation, int num_out);
+
+// Geometry of the line descriptors of a parametric scan, one thread per line,
+// as ParametricScan::get_scanline.
+__global__ void ParametricLineDescriptorsKernel(LineDescriptor* lines, ParametricScanParams params, int num_lines);
+
+// dst[indices[i]] = values[i] for i < num_values
+__global__ void ScatterKernel(float* dst, const int* indices, const float* values, int num_values);
+
+// Envelope of IQ samples, and the maximum envelope value of the launch in *max_bits
+// as the bits of a float (non-negative floats have the same order as their bits).
+__global__ void EnvelopeKernel(const cuComplex* iq, float* envelope, unsigned int* max_bits, int num_samples);
+
+// The largest absolute real or imaginary part of IQ samples in *max_bits as the
+// bits of a float, like EnvelopeKernel.
+__global__ void MaxAbsIqComponentKernel(const cuComplex* iq, unsigned int* max_bits, int num_samples);
+
+// IQ samples as the 16-bit real and imaginary part in the low and high half of
+// each word, in a sample type of bcsim::IqOutputFormat other than float32. The
+// int16 scale is formed from the float in *max_bits if it is not null.
+__global__ void PackIqKernel(const cuComplex* iq, unsigned int* packed, int sample_type, float int16_scale,
+                             const unsigned int* max_bits, int num_samples);
+
+// Log-compressed gray levels of envelope samples, normalized by the float in
+// *max_bits if it is not null and by normalize_const otherwise.
+__global__ void GrayLevelKernel(const float* envelope, unsigned char* gray_levels, const unsigned int* max_bits,
+                                float normalize_const, float dyn_range, float gain, int num_samples);
 
-// add noise to a signal
-__global__ void AddNoiseKernel(cuComplex* signal, cuComplex* noise, int num_samples);
\ No newline at end of file
+// Scan conversion of pixel row blockIdx.y from a texture of gray levels, with a
+// line per row and a sample per column, read as normalized floats.
+__global__ void ScanConvertKernel(cudaTextureObject_t gray_level_tex, bcsim::BModeImageConfig config,
+                                  int num_lines, int num_samples, unsigned char* image);
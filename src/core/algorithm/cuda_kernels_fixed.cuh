@@ -1,9 +1,9 @@
 #pragma once
-#include <cuda.h>
-#include <cuda_runtime_api.h>
-#include <cuComplex.h>
-#include "cuda_helpers.h"   // for operator-
-#include "cuda_kernels_c_interface.h"
+#ifdef __CUDACC_RTC__
+#include <cuda_fp16.h>
+#endif
+#include "cuda_kernels_c_interface.h"   // for the GPU runtime and half floats otherwise
+#include "cuda_kernels_projection.cuh"  // for ProjectPoint and accumulation
 
 __global__ void SliceLookupTable(float3 origin,
                                  float3 dir0,
@@ -12,54 +12,76 @@ __global__ void SliceLookupTable(float3 origin,
                                  cudaTextureObject_t lut_tex);
 
 
-template <bool use_arc_projection, bool use_phase_delay, bool use_lut>
+// Constants are the values of the sampling frequency, sound speed and number
+// of time samples (see RuntimeKernelConstants).
+template <bool use_arc_projection, bool use_phase_delay, bool use_lut, typename Constants = RuntimeKernelConstants>
 __global__ void FixedAlgKernel(FixedAlgKernelParams params) {
     const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
-    if (global_idx >= params.num_scatterers) {
+    // with shared accumulation all threads of a block take part in the flush
+    const bool in_range = (global_idx < params.num_scatterers);
+    if (!in_range && (params.shared_tile_len == 0)) {
         return;
     }
 
-    const float3 point = make_float3(params.point_xs[global_idx], params.point_ys[global_idx], params.point_zs[global_idx]) - params.origin;
-    
-    // compute dot products
-    auto radial_dist  = dot(point, params.rad_dir);
-    const auto lateral_dist = dot(point, params.lat_dir);
-    const auto elev_dist    = dot(point, params.ele_dir);
-
-    if (use_arc_projection) {
-        // Use "arc projection" in the radial direction: use length of vector from
-        // beam's origin to the scatterer with the same sign as the projection onto
-        // the line.
-        radial_dist = copysignf(sqrtf(dot(point,point)), radial_dist);
-    }
-
-    float weight;
-    if (use_lut) {
-        // Compute weight from lookup-table and radial_dist, lateral_dist, and elev_dist
-        weight = ComputeWeightLUT(params.lut_tex, radial_dist, lateral_dist, elev_dist, params.lut);
-    } else {
-        weight = ComputeWeightAnalytical(params.sigma_lateral, params.sigma_elevational, radial_dist, lateral_dist, elev_dist);
+    // the scatterer is loaded once for all lines of the block
+    float3 position = make_float3(0.0f, 0.0f, 0.0f);
+    float amplitude = 0.0f;
+    if (in_range) {
+        // compacted list of scatterers after culling
+        const int scatterer_idx = params.indices ? params.indices[global_idx] : global_idx;
+        // the scatterers are read-only during the launch
+        if (params.point_codes) {
+            // one 8-byte load per scatterer
+            const ushort4 codes = __ldg(params.point_codes + scatterer_idx);
+            const CompactScattererDecoding& compact = params.compact;
+            position = make_float3(compact.origin.x + codes.x*compact.scale.x,
+                                   compact.origin.y + codes.y*compact.scale.y,
+                                   compact.origin.z + codes.z*compact.scale.z);
+            amplitude = __half2float(__ushort_as_half(codes.w))*compact.amplitude_scale;
+        } else if (params.points) {
+            // one 16-byte load per scatterer
+            const float4 point = __ldg(params.points + scatterer_idx);
+            position = make_float3(point.x, point.y, point.z);
+            amplitude = point.w;
+        } else {
+            position = make_float3(__ldg(params.point_xs + scatterer_idx), __ldg(params.point_ys + scatterer_idx),
+                                   __ldg(params.point_zs + scatterer_idx));
+            amplitude = __ldg(params.point_as + scatterer_idx);
+        }
     }
 
-    const int radial_index = static_cast<int>(params.fs_hertz*2.0f*radial_dist/params.sound_speed + 0.5f);
-    
-    if (radial_index >= 0 && radial_index < params.num_time_samples) {
-        //atomicAdd(res+radial_index, weight*point_as[global_idx]);
-        if (use_phase_delay) {
-            // handle sub-sample displacement with a complex phase
-            const auto true_index = params.fs_hertz*2.0f*radial_dist/params.sound_speed;
-            const float ss_delay = (radial_index - true_index)/params.fs_hertz;
-            const float complex_phase = 6.283185307179586*params.demod_freq*ss_delay;
+    // batched launches project onto the lines [blockIdx.y*lines_per_block, (blockIdx.y+1)*lines_per_block),
+    // with the same loop bounds in all threads of a block
+    const int first_line = params.lines ? blockIdx.y*params.lines_per_block : 0;
+    const int end_line = params.lines ? min(first_line + params.lines_per_block, params.num_lines) : 1;
+    for (int line_no = first_line; line_no < end_line; line_no++) {
+        float3 origin  = params.origin;
+        float3 rad_dir = params.rad_dir;
+        float3 lat_dir = params.lat_dir;
+        float3 ele_dir = params.ele_dir;
+        cuComplex* res = params.res;
+        if (params.lines) {
+            const LineDescriptor& line = params.lines[line_no];
+            origin  = line.origin;
+            rad_dir = line.rad_dir;
+            lat_dir = line.lat_dir;
+            ele_dir = line.ele_dir;
+            res += line_no*params.res_line_stride;
+        }
 
-            // exp(i*theta) = cos(theta) + i*sin(theta)
-            float sin_value, cos_value;
-            sincosf(complex_phase, &sin_value, &cos_value);
+        bool valid = false;
+        int radial_index = 0;
+        float2 value = make_float2(0.0f, 0.0f);
+        if (in_range) {
+            valid = ProjectPoint<use_arc_projection, use_phase_delay, use_lut, Constants>(params, position - origin, rad_dir, lat_dir, ele_dir,
+                                                                                amplitude, radial_index, value);
+        }
 
-            const auto w = weight*params.point_as[global_idx];
-            atomicAdd(&(params.res[radial_index].x), w*cos_value);
-            atomicAdd(&(params.res[radial_index].y), w*sin_value);
-        } else {
-            atomicAdd(&(params.res[radial_index].x), weight*params.point_as[global_idx]);
+        if (params.shared_tile_len > 0) {
+            AccumulateBlockShared<use_phase_delay>(res, params.real_res, params.fixed_point_scale, valid, radial_index, value,
+                                                   params.shared_tile_len);
+        } else if (valid) {
+            AccumulateGlobal<use_phase_delay>(res, params.real_res, params.fixed_point_scale, radial_index, value);
         }
     }
 }
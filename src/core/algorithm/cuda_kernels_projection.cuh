@@ -0,0 +1,332 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#ifndef __CUDACC_RTC__
+#include "gpu_runtime.h"
+#include <climits>
+#else
+#define INT_MAX 0x7fffffff
+#endif
+#include "cuda_vector_math.h"           // for dot()
+#include "cuda_kernels_c_interface.h"   // for struct LUTProfileGeometry
+
+// Projection of scatterers onto the lines, shared by the precompiled kernels
+// and the kernels compiled at runtime (see JitKernels.hpp). Everything here
+// must compile both with nvcc and with NVRTC.
+
+// The values which are parameters of the precompiled projection kernels. The
+// kernels compiled at runtime use a struct with the same functions returning
+// constants instead, which are folded into the index computations.
+struct RuntimeKernelConstants {
+    template <typename Params>
+    __device__ static float fs_hertz(const Params& params) {
+        return params.fs_hertz;
+    }
+
+    template <typename Params>
+    __device__ static float sound_speed(const Params& params) {
+        return params.sound_speed;
+    }
+
+    template <typename Params>
+    __device__ static int num_time_samples(const Params& params) {
+        return params.num_time_samples;
+    }
+
+    template <typename Params>
+    __device__ static int first_time_sample(const Params& params) {
+        return params.first_time_sample;
+    }
+
+    __device__ static int num_splines(const SplineAlgKernelParams& params) {
+        return params.NUM_SPLINES;
+    }
+
+    // number of non-zero basis functions at the line's timestamp (spline degree + 1)
+    __device__ static int num_control_points(const LineDescriptor& line) {
+        return line.cs_idx_end - line.cs_idx_start + 1;
+    }
+};
+
+// RuntimeKernelConstants with a constant number of control points per line,
+// for the precompiled spline kernels of the spline degrees 1 to
+// MAX_SPLINE_DEGREE, so that the loop over the control points is unrolled.
+template <int NumControlPoints>
+struct SplineDegreeKernelConstants : RuntimeKernelConstants {
+    __device__ static int num_control_points(const LineDescriptor&) {
+        return NumControlPoints;
+    }
+};
+
+// Compute projection weight from Gaussian analytical beam profile. Returns
+// false without evaluating the exponential if the exponent exceeds
+// max_exponent, i.e. if the scatterer is outside of the cutoff ellipse.
+__device__ __inline__ bool ComputeWeightAnalytical(float sigma_lateral,
+                                                   float sigma_elevational,
+                                                   float max_exponent,
+                                                   float lateral_dist,
+                                                   float elev_dist,
+                                                   float& weight) {
+    const float two_sigma_lateral_squared     = 2.0f*sigma_lateral*sigma_lateral;
+    const float two_sigma_elevational_squared = 2.0f*sigma_elevational*sigma_elevational; 
+    const float exponent = lateral_dist*lateral_dist/two_sigma_lateral_squared + elev_dist*elev_dist/two_sigma_elevational_squared;
+    if (exponent > max_exponent) {
+        return false;
+    }
+    weight = __expf(-exponent);
+    return true;
+}
+
+// Compute projection weight from a 3D texture based beam profile.
+__device__ __inline__ float ComputeWeightLUT(cudaTextureObject_t lut_tex,
+                                             float radial_dist,
+                                             float lateral_dist, 
+                                             float elev_dist,
+                                             LUTProfileGeometry lut_geo) {
+    const auto r_normalized = (radial_dist-lut_geo.r_min)/(lut_geo.r_max-lut_geo.r_min);
+    const auto l_normalized = (lateral_dist-lut_geo.l_min)/(lut_geo.l_max-lut_geo.l_min);
+    const auto e_normalized = (elev_dist-lut_geo.e_min)/(lut_geo.e_max-lut_geo.e_min);
+    return tex3D<float>(lut_tex, e_normalized, l_normalized, r_normalized);
+}
+
+// Compute projection weight from the texture of the zone of radial_dist.
+__device__ __inline__ float ComputeWeightMultiResolutionLUT(const MultiResolutionLUT& lut_zones,
+                                                            float radial_dist,
+                                                            float lateral_dist,
+                                                            float elev_dist) {
+    int zone = 0;
+    while ((zone + 1 < lut_zones.num_zones) && (radial_dist >= lut_zones.boundaries[zone])) {
+        zone++;
+    }
+    return ComputeWeightLUT(lut_zones.tex[zone], radial_dist, lateral_dist, elev_dist, lut_zones.geometry[zone]);
+}
+
+// Linear interpolation of n samples at normalized coordinate u, with the
+// sample positions and zero border of a texture with linear filtering.
+__device__ __inline__ float InterpolateLUTFactor(const float* samples, int n, float u) {
+    const float x = u*n - 0.5f;
+    const float x0 = floorf(x);
+    const int i = static_cast<int>(x0);
+    const float alpha = x - x0;
+    const float s0 = (i >= 0 && i < n) ? __ldg(samples + i) : 0.0f;
+    const float s1 = (i + 1 >= 0 && i + 1 < n) ? __ldg(samples + i + 1) : 0.0f;
+    return s0 + alpha*(s1 - s0);
+}
+
+// Compute projection weight from the separable approximation of the
+// lookup-table, which equals sampling a texture of the approximated table.
+__device__ __inline__ float ComputeWeightSeparable(const SeparableLUTFactors& factors,
+                                                   float radial_dist,
+                                                   float lateral_dist,
+                                                   float elev_dist,
+                                                   LUTProfileGeometry lut_geo) {
+    const auto r_normalized = (radial_dist-lut_geo.r_min)/(lut_geo.r_max-lut_geo.r_min);
+    const auto l_normalized = (lateral_dist-lut_geo.l_min)/(lut_geo.l_max-lut_geo.l_min);
+    const auto e_normalized = (elev_dist-lut_geo.e_min)/(lut_geo.e_max-lut_geo.e_min);
+    float weight = 0.0f;
+    for (int k = 0; k < factors.rank; k++) {
+        weight += InterpolateLUTFactor(factors.radial + k*factors.num_samples_rad, factors.num_samples_rad, r_normalized)
+                * InterpolateLUTFactor(factors.lateral + k*factors.num_samples_lat, factors.num_samples_lat, l_normalized)
+                * InterpolateLUTFactor(factors.elevational + k*factors.num_samples_ele, factors.num_samples_ele, e_normalized);
+    }
+    return weight;
+}
+
+// Project a point, relative to the beam's origin, onto a scanline. Gives the
+// time sample index and the complex contribution [imaginary part is zero
+// without phase delay]. Returns false if the sample is outside the line.
+// Params is FixedAlgKernelParams or SplineAlgKernelParams, Constants is
+// RuntimeKernelConstants or a struct of constants with the same functions.
+template <bool use_arc_projection, bool use_phase_delay, bool use_lut, typename Constants, typename Params>
+__device__ __inline__ bool ProjectPoint(const Params& params, float3 point, float3 rad_dir, float3 lat_dir, float3 ele_dir,
+                                        float amplitude, int& radial_index, float2& value) {
+    // compute dot products
+    auto radial_dist  = dot(point, rad_dir);
+    const auto lateral_dist = dot(point, lat_dir);
+    const auto elev_dist    = dot(point, ele_dir);
+
+    if (use_arc_projection) {
+        // Use "arc projection" in the radial direction: use length of vector from
+        // beam's origin to the scatterer with the same sign as the projection onto
+        // the line.
+        radial_dist = copysignf(sqrtf(dot(point,point)), radial_dist);
+    }
+
+    // reject scatterers outside of the line before the beam profile is evaluated.
+    // the line index is shifted by a whole number of samples to the buffer of
+    // a depth window, which leaves the sub-sample phase unchanged.
+    const float fs_hertz = Constants::fs_hertz(params);
+    const float sound_speed = Constants::sound_speed(params);
+    const int line_index = static_cast<int>(fs_hertz*2.0f*radial_dist/sound_speed + 0.5f);
+    radial_index = line_index - Constants::first_time_sample(params);
+    if (radial_index < 0 || radial_index >= Constants::num_time_samples(params)) {
+        return false;
+    }
+
+    float weight;
+    if (use_lut) {
+        // Compute weight from lookup-table and radial_dist, lateral_dist, and elev_dist
+        if (params.lut_factors.rank > 0) {
+            weight = ComputeWeightSeparable(params.lut_factors, radial_dist, lateral_dist, elev_dist, params.lut);
+        } else if (params.lut_zones.num_zones > 0) {
+            weight = ComputeWeightMultiResolutionLUT(params.lut_zones, radial_dist, lateral_dist, elev_dist);
+        } else {
+            weight = ComputeWeightLUT(params.lut_tex, radial_dist, lateral_dist, elev_dist, params.lut);
+        }
+    } else if (!ComputeWeightAnalytical(params.sigma_lateral, params.sigma_elevational, params.max_profile_exponent,
+                                        lateral_dist, elev_dist, weight)) {
+        return false;
+    }
+
+    const auto w = weight*amplitude;
+    if (use_phase_delay) {
+        // handle sub-sample displacement with a complex phase
+        const auto true_index = fs_hertz*2.0f*radial_dist/sound_speed;
+        const float ss_delay = (line_index - true_index)/fs_hertz;
+        const float complex_phase = 6.283185307179586*params.demod_freq*ss_delay;
+
+        // exp(i*theta) = cos(theta) + i*sin(theta)
+        float sin_value, cos_value;
+        sincosf(complex_phase, &sin_value, &cos_value);
+        value = make_float2(w*cos_value, w*sin_value);
+    } else {
+        value = make_float2(w, 0.0f);
+    }
+    return true;
+}
+
+// Add a fixed-point contribution to a time-projection sample in global
+// memory, where each float of res holds an int. Integer additions commute,
+// so the sums do not depend on the order of the atomics.
+template <bool use_phase_delay>
+__device__ __inline__ void AccumulateGlobalFixedPoint(cuComplex* res, bool real_res, int radial_index, int2 value) {
+    int* res_int = reinterpret_cast<int*>(res);
+    if (use_phase_delay) {
+        atomicAdd(res_int + 2*radial_index, value.x);
+        atomicAdd(res_int + 2*radial_index + 1, value.y);
+    } else if (real_res) {
+        atomicAdd(res_int + radial_index, value.x);
+    } else {
+        atomicAdd(res_int + 2*radial_index, value.x);
+    }
+}
+
+// The value in units of 1/fixed_point_scale, rounded and saturated.
+__device__ __inline__ int2 ToFixedPoint(float2 value, float fixed_point_scale) {
+    return make_int2(__float2int_rn(value.x*fixed_point_scale), __float2int_rn(value.y*fixed_point_scale));
+}
+
+// Add a contribution to a time-projection sample in global memory. If
+// real_res, res is an array of real samples (no phase delay only). If
+// fixed_point_scale is positive, res holds fixed-point values with this
+// scale (see AccumulateGlobalFixedPoint).
+template <bool use_phase_delay>
+__device__ __inline__ void AccumulateGlobal(cuComplex* res, bool real_res, float fixed_point_scale, int radial_index, float2 value) {
+    if (fixed_point_scale > 0.0f) {
+        AccumulateGlobalFixedPoint<use_phase_delay>(res, real_res, radial_index, ToFixedPoint(value, fixed_point_scale));
+    } else if (use_phase_delay) {
+        atomicAdd(&(res[radial_index].x), value.x);
+        atomicAdd(&(res[radial_index].y), value.y);
+    } else if (real_res) {
+        atomicAdd(reinterpret_cast<float*>(res) + radial_index, value.x);
+    } else {
+        atomicAdd(&(res[radial_index].x), value.x);
+    }
+}
+
+// Accumulate the contributions of a block in a shared-memory tile of at most
+// tile_len samples, starting at the smallest radial index in the block, and
+// add the non-zero tile samples to global memory once. Contributions beyond
+// the tile go directly to global memory. Depth-sorted scatterers keep most
+// of a block within the tile. Must be called by all threads of the block,
+// and requires tile_len*sizeof(float2) bytes of dynamic shared memory. With
+// fixed-point accumulation the tile holds the ints of the fixed-point values.
+template <bool use_phase_delay>
+__device__ void AccumulateBlockShared(cuComplex* res, bool real_res, float fixed_point_scale, bool valid, int radial_index,
+                                      float2 value, int tile_len) {
+    extern __shared__ float2 tile[];
+    int2* tile_int = reinterpret_cast<int2*>(tile);
+    __shared__ int tile_start;
+    __shared__ int tile_last;
+    if (threadIdx.x == 0) {
+        tile_start = INT_MAX;
+        tile_last  = -1;
+    }
+    __syncthreads();
+    if (valid) {
+        atomicMin(&tile_start, radial_index);
+        atomicMax(&tile_last, radial_index);
+    }
+    __syncthreads();
+
+    // non-positive if no thread in the block has a contribution
+    const int first = tile_start;
+    const int span  = min(tile_last - first + 1, tile_len);
+    // zero bits are both a float and an int zero
+    for (int i = threadIdx.x; i < span; i += blockDim.x) {
+        tile[i] = make_float2(0.0f, 0.0f);
+    }
+    __syncthreads();
+
+    const bool fixed_point = (fixed_point_scale > 0.0f);
+    if (valid) {
+        const int tile_idx = radial_index - first;
+        if (tile_idx < span) {
+            if (fixed_point) {
+                const int2 fixed_value = ToFixedPoint(value, fixed_point_scale);
+                atomicAdd(&(tile_int[tile_idx].x), fixed_value.x);
+                if (use_phase_delay) {
+                    atomicAdd(&(tile_int[tile_idx].y), fixed_value.y);
+                }
+            } else {
+                atomicAdd(&(tile[tile_idx].x), value.x);
+                if (use_phase_delay) {
+                    atomicAdd(&(tile[tile_idx].y), value.y);
+                }
+            }
+        } else {
+            AccumulateGlobal<use_phase_delay>(res, real_res, fixed_point_scale, radial_index, value);
+        }
+    }
+    __syncthreads();
+
+    for (int i = threadIdx.x; i < span; i += blockDim.x) {
+        if (fixed_point) {
+            const int2 sum = tile_int[i];
+            if ((sum.x != 0) || (sum.y != 0)) {
+                AccumulateGlobalFixedPoint<use_phase_delay>(res, real_res, first + i, sum);
+            }
+        } else {
+            const float2 sum = tile[i];
+            if ((sum.x != 0.0f) || (sum.y != 0.0f)) {
+                AccumulateGlobal<use_phase_delay>(res, real_res, 0.0f, first + i, sum);
+            }
+        }
+    }
+}
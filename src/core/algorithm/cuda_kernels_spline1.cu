@@ -1,23 +1,15 @@
-#include <cuda.h>
-#include <cuda_runtime_api.h>
+#include "gpu_runtime.h"
 #include "cuda_kernels_spline1.cuh"
-#include "common_definitions.h" // for MAX_SPLINE_DEGREE
 
-// Named "eval_basis1" because of a strange linker error with MSVC when compiling
-// only for a virtual target in order to enable JIT compilation.
-__constant__ float eval_basis1[MAX_SPLINE_DEGREE+1];
-
-bool splineAlg1_updateConstantMemory_internal(float* src_ptr, size_t num_bytes) {
-    const auto res = cudaMemcpyToSymbol(eval_basis1, src_ptr, num_bytes);
-    return (res == cudaSuccess);
-}
-
-__global__ void RenderSplineKernel(const float* control_xs,
+template <int NumControlPoints>
+__global__ void RenderSplineKernel(const float4* control_points,
+                                   const float* control_xs,
                                    const float* control_ys,
                                    const float* control_zs,
                                    float* rendered_xs,
                                    float* rendered_ys,
                                    float* rendered_zs,
+                                   RenderSplineBasis basis,
                                    int cs_idx_start,
                                    int cs_idx_end,
                                    int NUM_SPLINES) {
@@ -32,10 +24,21 @@ __global__ void RenderSplineKernel(const float* control_xs,
     float rendered_x = 0.0f;
     float rendered_y = 0.0f;
     float rendered_z = 0.0f;
-    for (int i = cs_idx_start; i <= cs_idx_end; i++) {
-        rendered_x += control_xs[NUM_SPLINES*i + idx]*eval_basis1[i-cs_idx_start];
-        rendered_y += control_ys[NUM_SPLINES*i + idx]*eval_basis1[i-cs_idx_start];
-        rendered_z += control_zs[NUM_SPLINES*i + idx]*eval_basis1[i-cs_idx_start];
+    const int num_cs = (NumControlPoints > 0) ? NumControlPoints : cs_idx_end - cs_idx_start + 1;
+    #pragma unroll
+    for (int j = 0; j < num_cs; j++) {
+        const int i = cs_idx_start + j;
+        const float basis_value = basis.values[j];
+        if (control_points) {
+            const float4 point = __ldg(control_points + NUM_SPLINES*i + idx);
+            rendered_x += point.x*basis_value;
+            rendered_y += point.y*basis_value;
+            rendered_z += point.z*basis_value;
+        } else {
+            rendered_x += __ldg(control_xs + NUM_SPLINES*i + idx)*basis_value;
+            rendered_y += __ldg(control_ys + NUM_SPLINES*i + idx)*basis_value;
+            rendered_z += __ldg(control_zs + NUM_SPLINES*i + idx)*basis_value;
+        }
     }
 
     // write result to memory
@@ -43,3 +46,60 @@ __global__ void RenderSplineKernel(const float* control_xs,
     rendered_ys[idx] = rendered_y;
     rendered_zs[idx] = rendered_z;
 }
+
+// explicit function template instantiations
+template __global__ void RenderSplineKernel<0>(const float4* control_points,
+                                               const float* control_xs,
+                                               const float* control_ys,
+                                               const float* control_zs,
+                                               float* rendered_xs,
+                                               float* rendered_ys,
+                                               float* rendered_zs,
+                                               RenderSplineBasis basis,
+                                               int cs_idx_start,
+                                               int cs_idx_end,
+                                               int NUM_SPLINES);
+template __global__ void RenderSplineKernel<2>(const float4* control_points,
+                                               const float* control_xs,
+                                               const float* control_ys,
+                                               const float* control_zs,
+                                               float* rendered_xs,
+                                               float* rendered_ys,
+                                               float* rendered_zs,
+                                               RenderSplineBasis basis,
+                                               int cs_idx_start,
+                                               int cs_idx_end,
+                                               int NUM_SPLINES);
+template __global__ void RenderSplineKernel<3>(const float4* control_points,
+                                               const float* control_xs,
+                                               const float* control_ys,
+                                               const float* control_zs,
+                                               float* rendered_xs,
+                                               float* rendered_ys,
+                                               float* rendered_zs,
+                                               RenderSplineBasis basis,
+                                               int cs_idx_start,
+                                               int cs_idx_end,
+                                               int NUM_SPLINES);
+template __global__ void RenderSplineKernel<4>(const float4* control_points,
+                                               const float* control_xs,
+                                               const float* control_ys,
+                                               const float* control_zs,
+                                               float* rendered_xs,
+                                               float* rendered_ys,
+                                               float* rendered_zs,
+                                               RenderSplineBasis basis,
+                                               int cs_idx_start,
+                                               int cs_idx_end,
+                                               int NUM_SPLINES);
+template __global__ void RenderSplineKernel<5>(const float4* control_points,
+                                               const float* control_xs,
+                                               const float* control_ys,
+                                               const float* control_zs,
+                                               float* rendered_xs,
+                                               float* rendered_ys,
+                                               float* rendered_zs,
+                                               RenderSplineBasis basis,
+                                               int cs_idx_start,
+                                               int cs_idx_end,
+                                               int NUM_SPLINES);
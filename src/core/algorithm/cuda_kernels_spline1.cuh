@@ -1,14 +1,18 @@
 #pragma once
 
-// Returns false on failure.
-bool splineAlg1_updateConstantMemory_internal(float* src_ptr, size_t num_bytes);
+#include "cuda_kernels_c_interface.h"   // for RenderSplineBasis
 
-__global__ void RenderSplineKernel(const float* control_xs,
+// NumControlPoints is cs_idx_end-cs_idx_start+1 if positive, which unrolls the
+// sum over the control points, or zero for any number of control points.
+template <int NumControlPoints>
+__global__ void RenderSplineKernel(const float4* control_points,
+                                   const float* control_xs,
                                    const float* control_ys,
                                    const float* control_zs,
                                    float* rendered_xs,
                                    float* rendered_ys,
                                    float* rendered_zs,
+                                   RenderSplineBasis basis,
                                    int cs_idx_start,
                                    int cs_idx_end,
                                    int NUM_SPLINES);
@@ -1,8 +1,81 @@
 #pragma once
 #include "cuda_kernels_c_interface.h"
+#include "cuda_kernels_projection.cuh"  // for ProjectPoint and accumulation
 
-// Returns false on error.
-bool splineAlg2_updateConstantMemory_internal(float* src, size_t count, size_t offset, cudaMemcpyKind kind, cudaStream_t stream);
+// Constants are the values of the sampling frequency, sound speed, number of
+// time samples, number of splines and the number of control points of a line
+// (see RuntimeKernelConstants).
+template <bool use_arc_projection, bool use_phase_delay, bool use_lut, typename Constants = RuntimeKernelConstants>
+__global__ void SplineAlgKernel(SplineAlgKernelParams params) {
 
-template <bool use_arc_projection, bool use_phase_delay, bool use_lut>
-__global__ void SplineAlgKernel(SplineAlgKernelParams params);
+    const int global_idx = blockIdx.x*blockDim.x + threadIdx.x;
+    // with shared accumulation all threads of a block take part in the flush
+    const bool in_range = (global_idx < Constants::num_splines(params));
+    if (!in_range && (params.shared_tile_len == 0)) {
+        return;
+    }
+
+    // the lines of the block are [first_line, first_line + params.lines_per_block),
+    // which share the amplitude and, for an ensemble, also the geometry. The
+    // lines of a multi-line acquisition transmit share the basis functions,
+    // so that the spline is only evaluated for the first of them. The loop
+    // bounds are the same in all threads of a block.
+    const int num_splines = Constants::num_splines(params);
+    const float amplitude = in_range ? __ldg(params.control_as + global_idx) : 0.0f;
+    const int first_line = blockIdx.y*params.lines_per_block;
+    const int end_line = min(first_line + params.lines_per_block, params.num_lines);
+    float rendered_x = 0.0f;
+    float rendered_y = 0.0f;
+    float rendered_z = 0.0f;
+    for (int line_no = first_line; line_no < end_line; line_no++) {
+        // step 1: evaluate spline
+        // to get from one control point to the next, we have
+        // to make a jump of size equal to number of splines
+        // the basis functions of the line are stored with its geometry
+        const LineDescriptor& line = params.lines[line_no];
+        if (in_range && (!params.shared_basis || (line_no == first_line))) {
+            rendered_x = 0.0f;
+            rendered_y = 0.0f;
+            rendered_z = 0.0f;
+            // fully unrolled with a constant number of control points
+            #pragma unroll
+            for (int j = 0; j < Constants::num_control_points(line); j++) {
+                const int cs_idx = num_splines*(line.cs_idx_start + j) + global_idx;
+                const float basis = line.basis[j];
+                if (params.control_points) {
+                    // one 16-byte load per control point
+                    const float4 point = __ldg(params.control_points + cs_idx);
+                    rendered_x += point.x*basis;
+                    rendered_y += point.y*basis;
+                    rendered_z += point.z*basis;
+                } else {
+                    rendered_x += __ldg(params.control_xs + cs_idx)*basis;
+                    rendered_y += __ldg(params.control_ys + cs_idx)*basis;
+                    rendered_z += __ldg(params.control_zs + cs_idx)*basis;
+                }
+            }
+        }
+        const float3 origin  = line.origin;
+        const float3 rad_dir = line.rad_dir;
+        const float3 lat_dir = line.lat_dir;
+        const float3 ele_dir = line.ele_dir;
+        cuComplex* res = params.res + line_no*params.res_line_stride;
+
+        // step 2: compute projections
+        bool valid = false;
+        int radial_index = 0;
+        float2 value = make_float2(0.0f, 0.0f);
+        if (in_range) {
+            const float3 point = make_float3(rendered_x, rendered_y, rendered_z) - origin;
+            valid = ProjectPoint<use_arc_projection, use_phase_delay, use_lut, Constants>(params, point, rad_dir, lat_dir, ele_dir,
+                                                                                amplitude, radial_index, value);
+        }
+
+        if (params.shared_tile_len > 0) {
+            AccumulateBlockShared<use_phase_delay>(res, params.real_res, params.fixed_point_scale, valid, radial_index, value,
+                                                   params.shared_tile_len);
+        } else if (valid) {
+            AccumulateGlobal<use_phase_delay>(res, params.real_res, params.fixed_point_scale, radial_index, value);
+        }
+    }
+}
@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include "cuda_memory_pool.h"
+#include "cuda_helpers.h"
+
+CudaMemoryPool& CudaMemoryPool::instance() {
+    static CudaMemoryPool* pool = new CudaMemoryPool;
+    return *pool;
+}
+
+CudaMemoryPool::CudaMemoryPool()
+    : m_enabled(true)
+{
+}
+
+size_t CudaMemoryPool::bucket_size(size_t num_bytes) {
+    const size_t min_bucket = 512;
+    const size_t max_power_of_two_bucket = 1 << 20;
+    size_t power_of_two = min_bucket;
+    while (power_of_two < num_bytes) {
+        power_of_two *= 2;
+    }
+    if (power_of_two <= max_power_of_two_bucket) {
+        return power_of_two;
+    }
+    const auto step = power_of_two/8;
+    return ((num_bytes + step - 1)/step)*step;
+}
+
+void* CudaMemoryPool::allocate(Kind kind, size_t num_bytes) {
+    int device_no;
+    cudaErrorCheck( cudaGetDevice(&device_no) );
+    const auto num_bucket_bytes = bucket_size(num_bytes);
+    auto& stats = m_stats[static_cast<int>(kind)];
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto cached = m_cached_blocks.find(BlockKey(static_cast<int>(kind), device_no, num_bucket_bytes));
+    if ((cached != m_cached_blocks.end()) && !cached->second.empty()) {
+        auto ptr = cached->second.back();
+        cached->second.pop_back();
+        stats.num_reused++;
+        stats.bytes_cached -= num_bucket_bytes;
+        stats.bytes_in_use += num_bucket_bytes;
+        lock.unlock();
+        // the previous owner may have work in flight on the block
+        cudaErrorCheck( cudaDeviceSynchronize() );
+        return ptr;
+    }
+
+    void* ptr = nullptr;
+    auto cuda_allocate = [&]() {
+        return (kind == Kind::DEVICE) ? cudaMalloc(&ptr, num_bucket_bytes) : cudaMallocHost(&ptr, num_bucket_bytes);
+    };
+    auto res = cuda_allocate();
+    if ((res == cudaErrorMemoryAllocation) && (stats.bytes_cached > 0)) {
+        // clear the error and retry without the cached blocks
+        cudaGetLastError();
+        trim_locked(0);
+        res = cuda_allocate();
+    }
+    cudaErrorCheck( res );
+    stats.num_cuda_allocations++;
+    stats.bytes_in_use += num_bucket_bytes;
+    return ptr;
+}
+
+void CudaMemoryPool::release(Kind kind, void* ptr, size_t num_bytes, int device_no) {
+    const auto num_bucket_bytes = bucket_size(num_bytes);
+    auto& stats = m_stats[static_cast<int>(kind)];
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    stats.bytes_in_use -= num_bucket_bytes;
+    if (!m_enabled) {
+        cuda_free(kind, ptr, device_no);
+        return;
+    }
+    m_cached_blocks[BlockKey(static_cast<int>(kind), device_no, num_bucket_bytes)].push_back(ptr);
+    stats.bytes_cached += num_bucket_bytes;
+}
+
+void CudaMemoryPool::trim(size_t max_cached_bytes) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    trim_locked(max_cached_bytes);
+}
+
+void CudaMemoryPool::trim_locked(size_t max_cached_bytes) {
+    auto total_cached = m_stats[0].bytes_cached + m_stats[1].bytes_cached;
+    // free the largest blocks first
+    std::vector<BlockKey> keys;
+    for (const auto& entry : m_cached_blocks) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end(), [](const BlockKey& a, const BlockKey& b) {
+        return std::get<2>(a) > std::get<2>(b);
+    });
+    for (const auto& key : keys) {
+        auto& blocks = m_cached_blocks[key];
+        const auto kind = static_cast<Kind>(std::get<0>(key));
+        const auto num_bucket_bytes = std::get<2>(key);
+        while ((total_cached > max_cached_bytes) && !blocks.empty()) {
+            cuda_free(kind, blocks.back(), std::get<1>(key));
+            blocks.pop_back();
+            m_stats[std::get<0>(key)].bytes_cached -= num_bucket_bytes;
+            total_cached -= num_bucket_bytes;
+        }
+        if (blocks.empty()) {
+            m_cached_blocks.erase(key);
+        }
+    }
+}
+
+void CudaMemoryPool::cuda_free(Kind kind, void* ptr, int device_no) const {
+    if (kind == Kind::HOST_PINNED) {
+        cudaErrorCheck( cudaFreeHost(ptr) );
+        return;
+    }
+    int cur_device_no;
+    cudaErrorCheck( cudaGetDevice(&cur_device_no) );
+    if (cur_device_no != device_no) {
+        cudaErrorCheck( cudaSetDevice(device_no) );
+    }
+    const auto res = cudaFree(ptr);
+    if (cur_device_no != device_no) {
+        cudaErrorCheck( cudaSetDevice(cur_device_no) );
+    }
+    cudaErrorCheck( res );
+}
+
+void CudaMemoryPool::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_enabled = enabled;
+    if (!enabled) {
+        trim_locked(0);
+    }
+}
+
+bool CudaMemoryPool::is_enabled() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_enabled;
+}
+
+CudaMemoryPool::Stats CudaMemoryPool::get_stats(Kind kind) const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_stats[static_cast<int>(kind)];
+}
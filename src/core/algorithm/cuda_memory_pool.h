@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// Size-bucketed cache of device and pinned host memory behind the RAII
+// buffer wrappers, so that reallocating buffers of similar sizes does not
+// call into the CUDA runtime. Blocks are cached per device, and a cached
+// block is handed out again only after the device has synchronized, as
+// cudaFree() would have done. Thread-safe.
+class CudaMemoryPool {
+public:
+    enum class Kind { DEVICE, HOST_PINNED };
+
+    struct Stats {
+        Stats() : num_cuda_allocations(0), num_reused(0), bytes_in_use(0), bytes_cached(0) { }
+        size_t  num_cuda_allocations;   // blocks allocated from the CUDA runtime
+        size_t  num_reused;             // blocks handed out from the cache
+        size_t  bytes_in_use;           // bucket bytes of blocks handed out
+        size_t  bytes_cached;           // bucket bytes of cached blocks
+    };
+
+    // The pool of the process. Never destroyed, since the CUDA runtime may
+    // be torn down before static destructors run.
+    static CudaMemoryPool& instance();
+
+    // A block of at least num_bytes on the current device.
+    void* allocate(Kind kind, size_t num_bytes);
+
+    // Return a block obtained from allocate() on the current device then.
+    void release(Kind kind, void* ptr, size_t num_bytes, int device_no);
+
+    // Free cached blocks, largest first, until at most max_cached_bytes
+    // remain cached over all devices and kinds.
+    void trim(size_t max_cached_bytes = 0);
+
+    // If disabled, released blocks are freed at once. Disabling frees the cache.
+    void set_enabled(bool enabled);
+    bool is_enabled() const;
+
+    Stats get_stats(Kind kind) const;
+
+    // The size of the bucket of num_bytes: powers of two up to 1 MiB, and
+    // eight buckets per power of two above.
+    static size_t bucket_size(size_t num_bytes);
+
+private:
+    CudaMemoryPool();
+
+    void cuda_free(Kind kind, void* ptr, int device_no) const;
+    void trim_locked(size_t max_cached_bytes);
+
+    // (kind, device number, bucket size) -> cached blocks
+    typedef std::tuple<int, int, size_t>    BlockKey;
+
+    mutable std::mutex                      m_mutex;
+    bool                                    m_enabled;
+    std::map<BlockKey, std::vector<void*> > m_cached_blocks;
+    Stats                                   m_stats[2];
+};
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <stdexcept>
+#include "gpu_runtime.h"
+#include "cufft_callbacks.h"
+#include "cuda_helpers.h"
+#ifdef BCSIM_ENABLE_CUFFT_CALLBACKS
+#include <cufftXt.h>
+#endif
+
+#ifdef BCSIM_ENABLE_CUFFT_CALLBACKS
+namespace {
+
+// the output offset is in complex elements: line*num_samples + bin
+__device__ void MultiplyFilterStore(void* data_out, size_t offset, cufftComplex element, void* caller_info, void* /*shared_ptr*/) {
+    const auto params = static_cast<const FftCallbackParams*>(caller_info);
+    const int bin = static_cast<int>(offset % params->num_samples);
+    static_cast<cufftComplex*>(data_out)[offset] = cuCmulf(element, params->filter_fft[bin]);
+}
+
+// only the samples that are returned are stored, and to the IQ lines
+__device__ void DemodulateDecimateStore(void* /*data_out*/, size_t offset, cufftComplex element, void* caller_info, void* /*shared_ptr*/) {
+    const auto params = static_cast<const FftCallbackParams*>(caller_info);
+    const int line_no = static_cast<int>(offset / params->num_samples);
+    const int n = static_cast<int>(offset - static_cast<size_t>(line_no)*params->num_samples);
+    const int delayed_n = n - params->offset;
+    if ((delayed_n < 0) || (delayed_n % params->decimation != 0)) {
+        return;
+    }
+    const int out_idx = delayed_n/params->decimation;
+    if (out_idx >= params->num_out) {
+        return;
+    }
+
+    // exp(-i*w*n) = cos(w*n) - i*sin(w*n)
+    float sin_value, cos_value;
+    sincosf(params->w*n, &sin_value, &cos_value);
+    params->iq_lines[line_no*params->num_out + out_idx] = cuCmulf(element, make_cuComplex(cos_value, -sin_value));
+}
+
+__device__ cufftCallbackStoreC d_multiply_filter_store       = MultiplyFilterStore;
+__device__ cufftCallbackStoreC d_demodulate_decimate_store   = DemodulateDecimateStore;
+
+void set_store_callback(cufftHandle plan, const cufftCallbackStoreC& device_symbol, FftCallbackParams* device_params) {
+    cufftCallbackStoreC host_callback;
+    cudaErrorCheck( cudaMemcpyFromSymbol(&host_callback, device_symbol, sizeof(host_callback)) );
+    auto caller_info = reinterpret_cast<void*>(device_params);
+    cufftErrorCheck( cufftXtSetCallback(plan, reinterpret_cast<void**>(&host_callback), CUFFT_CB_ST_COMPLEX, &caller_info) );
+}
+
+}   // end anonymous namespace
+#endif
+
+FftCallbackPlans::FftCallbackPlans(int num_samples, int num_lines)
+    : m_num_lines(num_lines),
+      m_device_params(nullptr)
+{
+#ifdef BCSIM_ENABLE_CUFFT_CALLBACKS
+    const int rank = 1;
+    int dims[] = {num_samples};
+    m_forward_c2c = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, num_samples, CUFFT_C2C, num_lines));
+    m_forward_r2c = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, 2*num_samples, num_samples, CUFFT_R2C, num_lines));
+    m_inverse_c2c = CufftBatchedPlanRAII::u_ptr(new CufftBatchedPlanRAII(rank, dims, num_samples, CUFFT_C2C, num_lines));
+
+    std::memset(&m_host_params, 0, sizeof(m_host_params));
+    cudaErrorCheck( cudaMalloc(&m_device_params, sizeof(FftCallbackParams)) );
+    cudaErrorCheck( cudaMemcpy(m_device_params, &m_host_params, sizeof(FftCallbackParams), cudaMemcpyHostToDevice) );
+
+    set_store_callback(m_forward_c2c->get(), d_multiply_filter_store, m_device_params);
+    set_store_callback(m_forward_r2c->get(), d_multiply_filter_store, m_device_params);
+    set_store_callback(m_inverse_c2c->get(), d_demodulate_decimate_store, m_device_params);
+#else
+    (void) num_samples;
+    throw std::runtime_error("cuFFT callbacks are not enabled (BCSIM_ENABLE_CUFFT_CALLBACKS)");
+#endif
+}
+
+FftCallbackPlans::~FftCallbackPlans() {
+    if (m_device_params != nullptr) {
+        cudaFree(m_device_params);
+    }
+}
+
+void FftCallbackPlans::set_params(const FftCallbackParams& params) {
+    if (std::memcmp(&params, &m_host_params, sizeof(FftCallbackParams)) != 0) {
+        m_host_params = params;
+        cudaErrorCheck( cudaMemcpy(m_device_params, &m_host_params, sizeof(FftCallbackParams), cudaMemcpyHostToDevice) );
+    }
+}
+
+void FftCallbackPlans::forward(cudaStream_t stream, cufftComplex* time_proj, bool real_input) {
+    if (real_input) {
+        cufftErrorCheck( cufftSetStream(m_forward_r2c->get(), stream) );
+        cufftErrorCheck( cufftExecR2C(m_forward_r2c->get(), reinterpret_cast<cufftReal*>(time_proj), time_proj) );
+    } else {
+        cufftErrorCheck( cufftSetStream(m_forward_c2c->get(), stream) );
+        cufftErrorCheck( cufftExecC2C(m_forward_c2c->get(), time_proj, time_proj, CUFFT_FORWARD) );
+    }
+}
+
+void FftCallbackPlans::inverse(cudaStream_t stream, cufftComplex* time_proj) {
+    cufftErrorCheck( cufftSetStream(m_inverse_c2c->get(), stream) );
+    cufftErrorCheck( cufftExecC2C(m_inverse_c2c->get(), time_proj, time_proj, CUFFT_INVERSE) );
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+#include "gpu_runtime.h"
+#include "cufft_helpers.h"
+
+// Parameters of the cuFFT store callbacks, which are read on the device.
+struct FftCallbackParams {
+    const cufftComplex* filter_fft;     // excitation FFT with Hilbert mask
+    cufftComplex*       iq_lines;       // compact demodulated output lines
+    int                 num_samples;    // FFT length, also the line stride
+    float               w;              // normalized angular demodulation frequency
+    int                 offset;         // delay compensation in samples
+    int                 decimation;
+    int                 num_out;        // output samples per line
+};
+
+// Batched plans of a frame with store callbacks fused into them: the forward
+// transform multiplies with the filter, and the inverse transform demodulates,
+// decimates and writes the compact IQ lines instead of the time signal.
+// Requires BCSIM_ENABLE_CUFFT_CALLBACKS, otherwise the constructor throws.
+class FftCallbackPlans {
+public:
+    typedef std::unique_ptr<FftCallbackPlans> u_ptr;
+
+    FftCallbackPlans(int num_samples, int num_lines);
+
+    ~FftCallbackPlans();
+
+    int get_num_lines() const {
+        return m_num_lines;
+    }
+
+    // Synchronous upload if changed, so must not be called during capture.
+    void set_params(const FftCallbackParams& params);
+
+    // In-place forward transform, the real input lines are stored at the
+    // start of each complex slot. Only the bins 0...N/2 are written for
+    // real input.
+    void forward(cudaStream_t stream, cufftComplex* time_proj, bool real_input);
+
+    void inverse(cudaStream_t stream, cufftComplex* time_proj);
+
+    // Bytes of the work areas of the plans and the parameters on the device.
+    size_t get_device_bytes() const {
+        size_t res = sizeof(FftCallbackParams);
+        for (const auto plan : {m_forward_c2c.get(), m_forward_r2c.get(), m_inverse_c2c.get()}) {
+            if (plan) res += plan->get_work_size();
+        }
+        return res;
+    }
+
+private:
+    int                             m_num_lines;
+    CufftBatchedPlanRAII::u_ptr     m_forward_c2c;
+    CufftBatchedPlanRAII::u_ptr     m_forward_r2c;
+    CufftBatchedPlanRAII::u_ptr     m_inverse_c2c;
+    FftCallbackParams               m_host_params;
+    FftCallbackParams*              m_device_params;
+};
@@ -2,7 +2,7 @@
 #include <string>
 #include <stdexcept>
 #include <memory>
-#include <cufft.h>
+#include "gpu_runtime.h"
 
 #define cufftErrorCheck(ans) { cufftAssert((ans), __FILE__, __LINE__); }
 inline void cufftAssert(cufftResult_t code, const char* file, int line) {
@@ -23,7 +23,9 @@ inline void cufftAssert(cufftResult_t code, const char* file, int line) {
         case CUFFT_PARSE_ERROR:               err_str = "CUFFT_PARSE_ERROR";               break;
         case CUFFT_NO_WORKSPACE:              err_str = "CUFFT_NO_WORKSPACE";              break;
         case CUFFT_NOT_IMPLEMENTED:           err_str = "CUFFT_NOT_IMPLEMENTED";           break;
+#ifndef BCSIM_ENABLE_HIP
         case CUFFT_LICENSE_ERROR:             err_str = "CUFFT_LICENSE_ERROR";             break;
+#endif
         default:
             err_str = "UNKNOWN ERROR";
         }
@@ -66,6 +68,15 @@ public:
     CufftBatchedPlanRAII(int rank, int* dims, int num_samples, cufftType type, int batch) {
         cufftErrorCheck(cufftPlanMany(&plan, rank, dims, NULL, 1, num_samples, NULL, 1, num_samples, type, batch));
     }
+
+    // Advanced data layout with different input and output distance between
+    // batches (in elements of input and output type respectively). Needed for
+    // in-place R2C transforms into a buffer of complex lines.
+    CufftBatchedPlanRAII(int rank, int* dims, int input_dist, int output_dist, cufftType type, int batch) {
+        int inembed[] = {input_dist};
+        int onembed[] = {output_dist};
+        cufftErrorCheck(cufftPlanMany(&plan, rank, dims, inembed, 1, input_dist, onembed, 1, output_dist, type, batch));
+    }
     ~CufftBatchedPlanRAII() {
         cufftDestroy(plan);
     }
@@ -73,6 +84,13 @@ public:
     cufftHandle get() {
         return plan;
     }
+
+    // Bytes of the work area of the plan on the device.
+    size_t get_work_size() {
+        size_t work_size = 0;
+        cufftErrorCheck(cufftGetSize(plan, &work_size));
+        return work_size;
+    }
 private:
     cufftHandle plan;
 };
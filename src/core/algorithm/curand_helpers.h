@@ -1,5 +1,5 @@
 #pragma once
-#include <curand.h>
+#include "gpu_runtime.h"
 #include <string>
 
 #define curandErrorCheck(ans) { curandAssert((ans), __FILE__, __LINE__); }
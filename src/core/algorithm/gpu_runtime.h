@@ -0,0 +1,253 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+// The GPU runtime, FFT and random number APIs used by the GPU algorithm, by
+// their CUDA names. With BCSIM_ENABLE_HIP the same sources are built for AMD
+// GPUs: the CUDA names are mapped to HIP, hipFFT and hipRAND (which runs on
+// rocRAND), in the manner of hipify. Only the names used in this directory
+// are mapped, so new ones must be added here when used.
+
+#ifdef BCSIM_ENABLE_HIP
+
+#include <hip/hip_runtime.h>
+#include <hip/hip_complex.h>
+#include <hip/hip_fp16.h>
+#include <hipfft/hipfft.h>
+#include <hiprand/hiprand.h>
+
+// runtime
+#define cudaError_t                         hipError_t
+#define cudaSuccess                         hipSuccess
+#define cudaErrorMemoryAllocation           hipErrorOutOfMemory
+#define cudaGetErrorString                  hipGetErrorString
+#define cudaGetLastError                    hipGetLastError
+#define cudaDeviceProp                      hipDeviceProp_t
+#define cudaGetDeviceProperties             hipGetDeviceProperties
+#define cudaGetDeviceCount                  hipGetDeviceCount
+#define cudaGetDevice                       hipGetDevice
+#define cudaSetDevice                       hipSetDevice
+#define cudaDeviceSynchronize               hipDeviceSynchronize
+#define cudaDeviceReset                     hipDeviceReset
+#define cudaDriverGetVersion                hipDriverGetVersion
+#define cudaMemGetInfo                      hipMemGetInfo
+
+// memory
+#define cudaMalloc                          hipMalloc
+#define cudaFree                            hipFree
+#define cudaMallocHost                      hipHostMalloc
+#define cudaHostAlloc                       hipHostMalloc
+#define cudaHostAllocMapped                 hipHostMallocMapped
+#define cudaHostGetDevicePointer            hipHostGetDevicePointer
+#define cudaFreeHost                        hipHostFree
+#define cudaMemcpy                          hipMemcpy
+#define cudaMemcpyAsync                     hipMemcpyAsync
+#define cudaMemcpy2DAsync                   hipMemcpy2DAsync
+#define cudaMemcpy2DToArrayAsync            hipMemcpy2DToArrayAsync
+#define cudaMemcpy3D                        hipMemcpy3D
+#define cudaMemcpy3DParms                   hipMemcpy3DParms
+#define cudaMemcpyHostToDevice              hipMemcpyHostToDevice
+#define cudaMemcpyDeviceToHost              hipMemcpyDeviceToHost
+#define cudaMemcpyDeviceToDevice            hipMemcpyDeviceToDevice
+#define cudaMemsetAsync                     hipMemsetAsync
+#define cudaExtent                          hipExtent
+#define make_cudaExtent                     make_hipExtent
+#define make_cudaPitchedPtr                 make_hipPitchedPtr
+
+// streams, events and graphs
+#define cudaStream_t                        hipStream_t
+#define cudaStreamCreate                    hipStreamCreate
+#define cudaStreamDestroy                   hipStreamDestroy
+#define cudaStreamSynchronize               hipStreamSynchronize
+#define cudaStreamWaitEvent                 hipStreamWaitEvent
+#define cudaStreamBeginCapture              hipStreamBeginCapture
+#define cudaStreamEndCapture                hipStreamEndCapture
+#define cudaStreamCaptureModeThreadLocal    hipStreamCaptureModeThreadLocal
+#define cudaLaunchHostFunc                  hipLaunchHostFunc
+#define CUDART_CB
+#define cudaEvent_t                         hipEvent_t
+#define cudaEventCreate                     hipEventCreate
+#define cudaEventCreateWithFlags            hipEventCreateWithFlags
+#define cudaEventDisableTiming              hipEventDisableTiming
+#define cudaEventDestroy                    hipEventDestroy
+#define cudaEventRecord                     hipEventRecord
+#define cudaEventSynchronize                hipEventSynchronize
+#define cudaEventElapsedTime                hipEventElapsedTime
+#define cudaGraph_t                         hipGraph_t
+#define cudaGraphExec_t                     hipGraphExec_t
+#define cudaGraphInstantiateWithFlags       hipGraphInstantiateWithFlags
+#define cudaGraphLaunch                     hipGraphLaunch
+#define cudaGraphExecDestroy                hipGraphExecDestroy
+#define cudaGraphDestroy                    hipGraphDestroy
+
+// arrays and textures
+#define cudaArray                           hipArray
+#define cudaMallocArray                     hipMallocArray
+#define cudaMalloc3DArray                   hipMalloc3DArray
+#define cudaFreeArray                       hipFreeArray
+#define cudaCreateChannelDesc               hipCreateChannelDesc
+#define cudaChannelFormatKindFloat          hipChannelFormatKindFloat
+#define cudaChannelFormatKindUnsigned       hipChannelFormatKindUnsigned
+#define cudaTextureObject_t                 hipTextureObject_t
+#define cudaResourceDesc                    hipResourceDesc
+#define cudaResourceTypeArray               hipResourceTypeArray
+#define cudaTextureDesc                     hipTextureDesc
+#define cudaCreateTextureObject             hipCreateTextureObject
+#define cudaDestroyTextureObject            hipDestroyTextureObject
+#define cudaAddressModeBorder               hipAddressModeBorder
+#define cudaFilterModeLinear                hipFilterModeLinear
+#define cudaReadModeElementType             hipReadModeElementType
+#define cudaReadModeNormalizedFloat         hipReadModeNormalizedFloat
+
+// module types of the runtime-compiled kernels, which are not built with HIP
+#define CUmodule                            hipModule_t
+#define CUfunction                          hipFunction_t
+#define cuModuleUnload                      hipModuleUnload
+
+// complex numbers
+#define cuComplex                           hipFloatComplex
+#define make_cuComplex                      make_hipFloatComplex
+#define cuCaddf                             hipCaddf
+#define cuCmulf                             hipCmulf
+#define cuCabsf                             hipCabsf
+
+// FFT
+#define cufftHandle                         hipfftHandle
+#define cufftResult_t                       hipfftResult_t
+#define cufftType                           hipfftType
+#define cufftComplex                        hipfftComplex
+#define cufftReal                           hipfftReal
+#define cufftPlan1d                         hipfftPlan1d
+#define cufftPlanMany                       hipfftPlanMany
+#define cufftEstimate1d                     hipfftEstimate1d
+#define cufftGetSize                        hipfftGetSize
+#define cufftSetStream                      hipfftSetStream
+#define cufftExecC2C                        hipfftExecC2C
+#define cufftExecR2C                        hipfftExecR2C
+#define cufftDestroy                        hipfftDestroy
+#define CUFFT_C2C                           HIPFFT_C2C
+#define CUFFT_R2C                           HIPFFT_R2C
+#define CUFFT_FORWARD                       HIPFFT_FORWARD
+#define CUFFT_INVERSE                       HIPFFT_BACKWARD
+#define CUFFT_SUCCESS                       HIPFFT_SUCCESS
+#define CUFFT_INVALID_PLAN                  HIPFFT_INVALID_PLAN
+#define CUFFT_ALLOC_FAILED                  HIPFFT_ALLOC_FAILED
+#define CUFFT_INVALID_TYPE                  HIPFFT_INVALID_TYPE
+#define CUFFT_INVALID_VALUE                 HIPFFT_INVALID_VALUE
+#define CUFFT_INTERNAL_ERROR                HIPFFT_INTERNAL_ERROR
+#define CUFFT_EXEC_FAILED                   HIPFFT_EXEC_FAILED
+#define CUFFT_SETUP_FAILED                  HIPFFT_SETUP_FAILED
+#define CUFFT_INVALID_SIZE                  HIPFFT_INVALID_SIZE
+#define CUFFT_UNALIGNED_DATA                HIPFFT_UNALIGNED_DATA
+#define CUFFT_INCOMPLETE_PARAMETER_LIST     HIPFFT_INCOMPLETE_PARAMETER_LIST
+#define CUFFT_INVALID_DEVICE                HIPFFT_INVALID_DEVICE
+#define CUFFT_PARSE_ERROR                   HIPFFT_PARSE_ERROR
+#define CUFFT_NO_WORKSPACE                  HIPFFT_NO_WORKSPACE
+#define CUFFT_NOT_IMPLEMENTED               HIPFFT_NOT_IMPLEMENTED
+
+// random numbers
+#define curandStatus_t                      hiprandStatus_t
+#define curandGenerator_t                   hiprandGenerator_t
+#define curandRngType_t                     hiprandRngType_t
+#define curandCreateGenerator               hiprandCreateGenerator
+#define curandDestroyGenerator              hiprandDestroyGenerator
+#define CURAND_RNG_PSEUDO_DEFAULT           HIPRAND_RNG_PSEUDO_DEFAULT
+#define CURAND_STATUS_SUCCESS               HIPRAND_STATUS_SUCCESS
+#define CURAND_STATUS_VERSION_MISMATCH      HIPRAND_STATUS_VERSION_MISMATCH
+#define CURAND_STATUS_NOT_INITIALIZED       HIPRAND_STATUS_NOT_INITIALIZED
+#define CURAND_STATUS_ALLOCATION_FAILED     HIPRAND_STATUS_ALLOCATION_FAILED
+#define CURAND_STATUS_TYPE_ERROR            HIPRAND_STATUS_TYPE_ERROR
+#define CURAND_STATUS_OUT_OF_RANGE          HIPRAND_STATUS_OUT_OF_RANGE
+#define CURAND_STATUS_LENGTH_NOT_MULTIPLE   HIPRAND_STATUS_LENGTH_NOT_MULTIPLE
+#define CURAND_STATUS_DOUBLE_PRECISION_REQUIRED HIPRAND_STATUS_DOUBLE_PRECISION_REQUIRED
+#define CURAND_STATUS_LAUNCH_FAILURE        HIPRAND_STATUS_LAUNCH_FAILURE
+#define CURAND_STATUS_PREEXISTING_FAILURE   HIPRAND_STATUS_PREEXISTING_FAILURE
+#define CURAND_STATUS_INITIALIZATION_FAILED HIPRAND_STATUS_INITIALIZATION_FAILED
+#define CURAND_STATUS_ARCH_MISMATCH         HIPRAND_STATUS_ARCH_MISMATCH
+#define CURAND_STATUS_INTERNAL_ERROR        HIPRAND_STATUS_INTERNAL_ERROR
+
+#else
+
+#include <cuda.h>
+#include <cuda_runtime_api.h>
+#include <driver_types.h>
+#include <driver_functions.h>
+#include <vector_functions.h>   // for make_float3() etc.
+#include <cuComplex.h>
+#include <cuda_fp16.h>
+#include <cufft.h>
+#include <curand.h>
+
+#endif  // BCSIM_ENABLE_HIP
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+
+// Lanes of a warp, which are 64 on most AMD GPUs, and the warp votes as
+// masks of that many bits.
+#if defined(__HIP_PLATFORM_AMD__) && defined(__AMDGCN_WAVEFRONT_SIZE)
+    #define BCSIM_WARP_SIZE __AMDGCN_WAVEFRONT_SIZE
+#elif defined(__HIP_PLATFORM_AMD__)
+    #define BCSIM_WARP_SIZE 64
+#else
+    #define BCSIM_WARP_SIZE 32
+#endif
+
+#if BCSIM_WARP_SIZE == 64
+typedef unsigned long long WarpMask;
+
+__device__ __forceinline__ WarpMask warp_ballot(bool predicate) {
+    return __ballot(predicate);
+}
+
+__device__ __forceinline__ int warp_popc(WarpMask mask) {
+    return __popcll(mask);
+}
+#else
+typedef unsigned int WarpMask;
+
+// All lanes of the warp must take part.
+__device__ __forceinline__ WarpMask warp_ballot(bool predicate) {
+#ifdef __HIP_PLATFORM_AMD__
+    return static_cast<WarpMask>(__ballot(predicate));
+#else
+    return __ballot_sync(0xffffffffu, predicate);
+#endif
+}
+
+__device__ __forceinline__ int warp_popc(WarpMask mask) {
+    return __popc(mask);
+}
+#endif
+
+// The bits of the lanes below lane_no, which is less than BCSIM_WARP_SIZE.
+__device__ __forceinline__ WarpMask warp_lanes_below(int lane_no) {
+    return (static_cast<WarpMask>(1) << lane_no) - static_cast<WarpMask>(1);
+}
+
+#endif  // __CUDACC__ || __HIPCC__
@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "bmode_image.hpp"
+
+namespace bcsim {
+
+float make_bmode_image(const BModeImageConfig& config, const std::complex<float>* iq_lines,
+                       size_t num_lines, size_t num_samples, size_t line_stride, unsigned char* image) {
+    if ((num_lines < 2) || (num_samples < 2) || (config.width < 2) || (config.height < 2)) {
+        throw std::runtime_error("B-mode image needs at least two lines, samples and pixels in each direction");
+    }
+    const auto num_beamspace = static_cast<int>(num_lines*num_samples);
+    std::vector<float> envelope(num_beamspace);
+    float max_envelope = 0.0f;
+    #pragma omp parallel for reduction(max:max_envelope)
+    for (int i = 0; i < num_beamspace; i++) {
+        const auto line_no = i/num_samples;
+        envelope[i] = std::abs(iq_lines[line_no*line_stride + i%num_samples]);
+        max_envelope = std::max(max_envelope, envelope[i]);
+    }
+    const float normalize_const = config.auto_normalize ? max_envelope : config.normalize_const;
+
+    // the scan conversion interpolates between gray levels
+    std::vector<unsigned char> beamspace(num_beamspace);
+    #pragma omp parallel for
+    for (int i = 0; i < num_beamspace; i++) {
+        beamspace[i] = static_cast<unsigned char>(bmode_gray_level(envelope[i], normalize_const, config.dyn_range, config.gain));
+    }
+
+    const auto num_lines_i   = static_cast<int>(num_lines);
+    const auto num_samples_i = static_cast<int>(num_samples);
+    const auto sample_value = [&](int line_no, int sample_no) {
+        const bool inside = (line_no >= 0) && (line_no < num_lines_i) && (sample_no >= 0) && (sample_no < num_samples_i);
+        return inside ? static_cast<float>(beamspace[line_no*num_samples_i + sample_no]) : 0.0f;
+    };
+    #pragma omp parallel for
+    for (int yi = 0; yi < config.height; yi++) {
+        for (int xi = 0; xi < config.width; xi++) {
+            float sample_pos, line_pos;
+            bmode_pixel_position(config, num_lines_i, num_samples_i, xi, yi, sample_pos, line_pos);
+            const float s0 = std::floor(sample_pos);
+            const float l0 = std::floor(line_pos);
+            const float fs = sample_pos - s0;
+            const float fl = line_pos - l0;
+            // clamped to avoid integer overflow far outside the beam space
+            const int s = static_cast<int>(std::min(std::max(s0, -2.0f), static_cast<float>(num_samples_i)));
+            const int l = static_cast<int>(std::min(std::max(l0, -2.0f), static_cast<float>(num_lines_i)));
+            const float value = (1.0f-fs)*(1.0f-fl)*sample_value(l, s)     + fs*(1.0f-fl)*sample_value(l, s + 1)
+                               +(1.0f-fs)*fl*sample_value(l + 1, s)        + fs*fl*sample_value(l + 1, s + 1);
+            image[static_cast<size_t>(yi)*config.width + xi] = static_cast<unsigned char>(value);
+        }
+    }
+    return normalize_const;
+}
+
+}   // end namespace
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include "BCSimConfig.hpp"
+
+// The per-sample functions are shared by the CPU implementation and the
+// CUDA kernels of the B-mode image conversion.
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#define BCSIM_HOST_DEVICE __host__ __device__
+#else
+#define BCSIM_HOST_DEVICE
+#endif
+
+namespace bcsim {
+
+// Log-compressed gray level in [0, 255] of an envelope sample.
+inline BCSIM_HOST_DEVICE float bmode_gray_level(float envelope, float normalize_const, float dyn_range, float gain) {
+    const float db = 20.0f*log10f(gain*envelope/normalize_const);
+    return fminf(fmaxf((255.0f/dyn_range)*(db + dyn_range), 0.0f), 255.0f);
+}
+
+// Beam space position of image pixel (xi, yi) in units of samples and
+// lines, i.e. (0, 0) is the first sample of the first line.
+inline BCSIM_HOST_DEVICE void bmode_pixel_position(const BModeImageConfig& config, int num_lines, int num_samples,
+                                                   int xi, int yi, float& sample_pos, float& line_pos) {
+    const float x = config.x_min + xi*(config.x_max - config.x_min)/(config.width - 1);
+    const float y = config.y_min + yi*(config.y_max - config.y_min)/(config.height - 1);
+    float range, lateral;
+    if (config.sector) {
+        range = sqrtf(x*x + y*y);
+        // straight down along the y-axis if x is close to zero
+        lateral = (fabsf(x) > 1e-6f) ? atan2f(y, x) : 1.57079632f;
+    } else {
+        range = y;
+        lateral = x;
+    }
+    sample_pos = range*(num_samples - 1)/config.range_max;
+    line_pos = (lateral - config.beam_min)*(num_lines - 1)/(config.beam_max - config.beam_min);
+}
+
+// Convert num_lines IQ lines of num_samples samples each, where line i
+// starts at iq_lines + i*line_stride, to a B-mode image of config.width
+// times config.height pixels stored row by row. Samples outside of the
+// beam space are zero. Returns the normalization constant used.
+float make_bmode_image(const BModeImageConfig& config, const std::complex<float>* iq_lines,
+                       size_t num_lines, size_t num_samples, size_t line_stride, unsigned char* image);
+
+}   // end namespace
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cmath>
 #include <vector>
 #include <utility>
+#include <string>
 
 namespace bspline_storve {
 
@@ -69,6 +70,29 @@ T bsplineBasis(int j, int p, T x, const std::vector<T>& knots) {
     }
 }
 
+// Evaluate the p+1 basis functions of degree p that can be non-zero at x
+// with the iterative Cox-de Boor recurrence, which costs O(p^2) operations.
+//  mu:  Knot interval containing x, i.e. knots[mu] <= x < knots[mu+1]
+//       (see compute_knot_interval())
+//  p:   Polynomial degree
+//  res: Output, must have room for p+1 values. res[k] is the value of
+//       basis function no. mu-p+k.
+template <typename T>
+void nonzero_basis_functions(int mu, int p, T x, const std::vector<T>& knots, T* res) {
+    res[0] = static_cast<T>(1.0);
+    for (int j = 1; j <= p; j++) {
+        T saved = static_cast<T>(0.0);
+        for (int r = 0; r < j; r++) {
+            const T right = knots[mu+r+1] - x;
+            const T left  = x - knots[mu+1-j+r];
+            const T temp  = res[r]/(right + left);
+            res[r] = saved + right*temp;
+            saved  = left*temp;
+        }
+        res[j] = saved;
+    }
+}
+
 // Determine which knot span a parameter value is in.
 // Throws std::runtime_error if interval cannot be found.
 template <typename T>
@@ -90,6 +114,41 @@ std::pair<int, int> get_lower_upper_inds(const std::vector<T>& knots, T t, int d
     return std::make_pair(mu-degree, mu);
 }
 
+// Inclusive range of the control points needed to evaluate splines with
+// num_cs control points in the time interval [t0, t1], which is clamped to
+// the valid interval [knots[degree], knots[num_cs]). In the interval, the
+// splines equal the splines with only these control points and the knots
+// from index first to second+degree+1.
+// Throws std::runtime_error if the interval is empty or outside the knots.
+template <typename T>
+std::pair<int, int> control_point_range(const std::vector<T>& knots, int degree, int num_cs, T t0, T t1) {
+    if ((degree < 0) || (num_cs <= degree) || (static_cast<int>(knots.size()) != num_cs + degree + 1)) {
+        throw std::runtime_error(std::string(__FUNCTION__) + " : invalid spline configuration");
+    }
+    const T start_time = knots[degree];
+    const T end_time   = knots[num_cs];
+    if ((t0 > t1) || (t0 >= end_time) || (t1 < start_time)) {
+        throw std::runtime_error(std::string(__FUNCTION__) + " : time interval outside of splines");
+    }
+    const int first = (t0 <= start_time) ? 0 : get_lower_upper_inds(knots, t0, degree).first;
+    const int last  = (t1 >= end_time) ? num_cs - 1 : get_lower_upper_inds(knots, t1, degree).second;
+    return std::make_pair(first, last);
+}
+
+// Evaluate all num_basis basis functions of degree p at x. Only the non-zero
+// ones are computed, the rest are set to zero.
+// Throws std::runtime_error if the knot interval of x cannot be found.
+template <typename T>
+std::vector<T> all_basis_functions(int num_basis, int p, T x, const std::vector<T>& knots) {
+    std::vector<T> res(num_basis, static_cast<T>(0.0));
+    const int mu = compute_knot_interval(knots, x);
+    if ((mu < p) || (mu >= num_basis)) {
+        throw std::runtime_error(std::string(__FUNCTION__) + " : illegal knot interval");
+    }
+    nonzero_basis_functions(mu, p, x, knots, res.data() + mu - p);
+    return res;
+}
+
 // Create a p + 1 - regular uniform knot vector for a given number of control points
 // Throws if n is too small
 template <typename T>
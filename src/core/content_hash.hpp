@@ -0,0 +1,183 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace bcsim {
+
+// Streaming XXH64 ("xxHash" by Yann Collet), which hashes gigabytes per
+// second. Inputs are read in host byte order.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0)
+        : m_seed(seed),
+          m_total_bytes(0),
+          m_num_buffered(0)
+    {
+        m_acc[0] = seed + P1 + P2;
+        m_acc[1] = seed + P2;
+        m_acc[2] = seed;
+        m_acc[3] = seed - P1;
+    }
+
+    void update(const void* data, size_t num_bytes) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        m_total_bytes += num_bytes;
+        if (m_num_buffered + num_bytes < sizeof(m_buffer)) {
+            std::memcpy(m_buffer + m_num_buffered, bytes, num_bytes);
+            m_num_buffered += num_bytes;
+            return;
+        }
+        if (m_num_buffered > 0) {
+            const auto fill = sizeof(m_buffer) - m_num_buffered;
+            std::memcpy(m_buffer + m_num_buffered, bytes, fill);
+            consume_stripe(m_buffer);
+            bytes += fill;
+            num_bytes -= fill;
+            m_num_buffered = 0;
+        }
+        for (; num_bytes >= sizeof(m_buffer); bytes += sizeof(m_buffer), num_bytes -= sizeof(m_buffer)) {
+            consume_stripe(bytes);
+        }
+        std::memcpy(m_buffer, bytes, num_bytes);
+        m_num_buffered = num_bytes;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (m_total_bytes >= sizeof(m_buffer)) {
+            h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+            for (const auto acc : m_acc) {
+                h ^= round(0, acc);
+                h = h*P1 + P4;
+            }
+        } else {
+            h = m_seed + P5;
+        }
+        h += m_total_bytes;
+        size_t pos = 0;
+        for (; pos + 8 <= m_num_buffered; pos += 8) {
+            h ^= round(0, read<uint64_t>(m_buffer + pos));
+            h = rotl(h, 27)*P1 + P4;
+        }
+        if (pos + 4 <= m_num_buffered) {
+            h ^= read<uint32_t>(m_buffer + pos)*P1;
+            h = rotl(h, 23)*P2 + P3;
+            pos += 4;
+        }
+        for (; pos < m_num_buffered; pos++) {
+            h ^= m_buffer[pos]*P5;
+            h = rotl(h, 11)*P1;
+        }
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static const uint64_t P1 = 11400714785074694791ULL;
+    static const uint64_t P2 = 14029467366897019727ULL;
+    static const uint64_t P3 = 1609587929392839161ULL;
+    static const uint64_t P4 = 9650029242287828579ULL;
+    static const uint64_t P5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        return rotl(acc + input*P2, 31)*P1;
+    }
+
+    template <typename T>
+    static T read(const unsigned char* p) {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    }
+
+    void consume_stripe(const unsigned char* stripe) {
+        for (int i = 0; i < 4; i++) {
+            m_acc[i] = round(m_acc[i], read<uint64_t>(stripe + 8*i));
+        }
+    }
+
+    uint64_t        m_seed;
+    uint64_t        m_acc[4];
+    uint64_t        m_total_bytes;
+    unsigned char   m_buffer[32];
+    size_t          m_num_buffered;
+};
+
+// A 128-bit content key from two XXH64 streams with different seeds, so
+// that collisions are negligible even for caches of many entries. Not a
+// cryptographic hash.
+class ContentHash {
+public:
+    ContentHash()
+        : m_low(0),
+          m_high(0x9E3779B97F4A7C15ULL)
+    { }
+
+    void update(const void* data, size_t num_bytes) {
+        m_low.update(data, num_bytes);
+        m_high.update(data, num_bytes);
+    }
+
+    void update(const std::string& s) {
+        const uint64_t size = s.size();
+        update(&size, sizeof(size));
+        update(s.data(), s.size());
+    }
+
+    // 32 lowercase hex digits.
+    std::string hex_digest() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string res(32, '0');
+        const uint64_t words[2] = {m_high.digest(), m_low.digest()};
+        for (int i = 0; i < 32; i++) {
+            const auto word = words[i/16];
+            res[i] = digits[(word >> (4*(15 - i%16))) & 0xF];
+        }
+        return res;
+    }
+
+private:
+    Xxh64   m_low;
+    Xxh64   m_high;
+};
+
+}   // end namespace
@@ -31,56 +31,331 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <map>
+#include <mutex>
+#include "fft.hpp"
+
+// Shared implementation of plan caching.
+template <typename Plan>
+std::shared_ptr<const Plan> get_cached_plan(size_t length) {
+    static std::mutex cache_mutex;
+    static std::map<size_t, std::shared_ptr<const Plan> > cache;
+
+    std::lock_guard<std::mutex> guard(cache_mutex);
+    auto it = cache.find(length);
+    if (it == cache.end()) {
+        it = cache.insert(std::make_pair(length, std::make_shared<const Plan>(length))).first;
+    }
+    return it->second;
+}
 
 template <typename T>
-std::vector<std::complex<T> > fft(const std::vector<std::complex<T> >& x) {
-    auto n = x.size();
-    auto n_half = n/2;
-    if (n == 1) {
-        return x;
-    }
-    const auto PI = 4.0*std::atan(1.0);
-    auto wn = std::exp(std::complex<T>(static_cast<T>(0.0), static_cast<T>(-2.0*PI/n)));
-    auto w = std::complex<T>(static_cast<T>(1.0), static_cast<T>(0.0));
-    std::vector<std::complex<T> > x_even(n_half);
-    std::vector<std::complex<T> > x_odd(n_half);
-    for (size_t i = 0; i < n_half; i++) {
-        x_even[i] = x[2*i];
-        x_odd[i]  = x[2*i+1];    
-    }
-    auto y_even = fft(x_even);
-    auto y_odd  = fft(x_odd);
-    std::vector<std::complex<T> > y(n, std::complex<T>(static_cast<T>(0.0), static_cast<T>(0.0)));
-    for (size_t k = 0; k < n_half; k++) {
-        y[k]        = y_even[k] + w*y_odd[k];
-        y[k+n_half] = y_even[k] - w*y_odd[k];
-        w = w*wn;
+FftPlan<T>::FftPlan(size_t length)
+    : m_length(length)
+{
+    if (length == 0) {
+        throw std::runtime_error("FFT length must be positive");
+    }
+    // computed in double precision to avoid accumulating errors.
+    const double PI = 4.0*std::atan(1.0);
+
+    if ((length & (length-1)) != 0) {
+        // Radix-4 stages are cheaper than pairs of radix-2 stages.
+        auto remaining = length;
+        size_t num_twos = 0;
+        while (remaining % 2 == 0) { remaining /= 2; num_twos++; }
+        for (size_t i = 0; i < num_twos/2; i++) m_radices.push_back(4);
+        if (num_twos % 2 == 1) m_radices.push_back(2);
+        while (remaining % 3 == 0) { remaining /= 3; m_radices.push_back(3); }
+        while (remaining % 5 == 0) { remaining /= 5; m_radices.push_back(5); }
+        if (remaining != 1) {
+            throw std::runtime_error("FFT length must only have prime factors 2, 3 and 5");
+        }
+
+        // Decimation in time: the stages combine transforms of contiguous
+        // blocks, where the last stage with radix p gets the transforms of
+        // the samples r, r+p, r+2p, ... in block r, and so on recursively.
+        std::vector<size_t> source(length);
+        for (size_t i = 0; i < length; i++) {
+            size_t index = i;
+            size_t block_length = length;
+            size_t stride = 1;
+            for (size_t stage = m_radices.size(); stage-- > 0; ) {
+                const auto radix = m_radices[stage];
+                block_length /= radix;
+                source[i] += stride*(index/block_length);
+                index %= block_length;
+                stride *= radix;
+            }
+        }
+        // x[i] = x[source[i]] done in-place by swapping along each cycle.
+        std::vector<bool> done(length, false);
+        for (size_t i = 0; i < length; i++) {
+            for (size_t j = i; !done[j]; j = source[j]) {
+                done[j] = true;
+                if (!done[source[j]]) {
+                    m_swap_pairs.push_back(std::make_pair(j, source[j]));
+                }
+            }
+        }
+
+        size_t sub_length = 1;
+        for (const auto radix : m_radices) {
+            for (size_t k = 0; k < sub_length; k++) {
+                for (size_t r = 1; r < radix; r++) {
+                    const double angle = -2.0*PI*static_cast<double>(r*k)/static_cast<double>(radix*sub_length);
+                    m_twiddles.push_back(std::complex<T>(static_cast<T>(std::cos(angle)), static_cast<T>(std::sin(angle))));
+                }
+            }
+            sub_length *= radix;
+        }
+        return;
+    }
+
+    size_t num_bits = 0;
+    while ((static_cast<size_t>(1) << num_bits) < length) num_bits++;
+    for (size_t i = 0; i < length; i++) {
+        size_t j = 0;
+        for (size_t bit = 0; bit < num_bits; bit++) {
+            if (i & (static_cast<size_t>(1) << bit)) {
+                j |= static_cast<size_t>(1) << (num_bits-1-bit);
+            }
+        }
+        if (i < j) {
+            m_swap_pairs.push_back(std::make_pair(i, j));
+        }
+    }
+
+    m_twiddles.reserve(length > 1 ? length-1 : 0);
+    for (size_t half = 1; half < length; half *= 2) {
+        for (size_t k = 0; k < half; k++) {
+            const double angle = -PI*static_cast<double>(k)/static_cast<double>(half);
+            m_twiddles.push_back(std::complex<T>(static_cast<T>(std::cos(angle)), static_cast<T>(std::sin(angle))));
+        }
+    }
+}
+
+template <typename T>
+typename FftPlan<T>::s_ptr FftPlan<T>::get(size_t length) {
+    return get_cached_plan<FftPlan<T> >(length);
+}
+
+template <typename T>
+void FftPlan<T>::forward(std::complex<T>* x) const {
+    transform(x, false);
+}
+
+template <typename T>
+void FftPlan<T>::inverse(std::complex<T>* x) const {
+    transform(x, true);
+    const T scale = static_cast<T>(1.0)/static_cast<T>(m_length);
+    for (size_t i = 0; i < m_length; i++) {
+        x[i] *= scale;
+    }
+}
+
+template <typename T>
+void FftPlan<T>::transform(std::complex<T>* x, bool inverse) const {
+    for (const auto& swap_pair : m_swap_pairs) {
+        std::swap(x[swap_pair.first], x[swap_pair.second]);
+    }
+    if (!m_radices.empty()) {
+        transform_mixed_radix(x, inverse);
+        return;
+    }
+
+    // iterative Cooley-Tukey butterflies
+    for (size_t half = 1; half < m_length; half *= 2) {
+        const std::complex<T>* stage_twiddles = m_twiddles.data() + half - 1;
+        for (size_t start = 0; start < m_length; start += 2*half) {
+            std::complex<T>* a = x + start;
+            std::complex<T>* b = x + start + half;
+            for (size_t k = 0; k < half; k++) {
+                const auto w = inverse ? std::conj(stage_twiddles[k]) : stage_twiddles[k];
+                const auto t = w*b[k];
+                b[k] = a[k] - t;
+                a[k] = a[k] + t;
+            }
+        }
+    }
+}
+
+namespace {
+
+// Multiply by -i for forward and by i for inverse transforms.
+template <typename T>
+inline std::complex<T> rotate_quarter(const std::complex<T>& z, bool inverse) {
+    return inverse ? std::complex<T>(-z.imag(), z.real()) : std::complex<T>(z.imag(), -z.real());
+}
+
+// One stage combining radix transforms of length m, stored in blocks of m
+// consecutive samples, into transforms of length radix*m.
+template <typename T, size_t RADIX>
+void mixed_radix_stage(std::complex<T>* x, size_t length, size_t m, const std::complex<T>* twiddles, bool inverse) {
+    const double PI = 4.0*std::atan(1.0);
+    const T cos1 = static_cast<T>(std::cos(2.0*PI/5.0));
+    const T cos2 = static_cast<T>(std::cos(4.0*PI/5.0));
+    const T sin1 = static_cast<T>(std::sin(2.0*PI/5.0));
+    const T sin2 = static_cast<T>(std::sin(4.0*PI/5.0));
+    const T sin3 = static_cast<T>(std::sin(2.0*PI/3.0));
+
+    for (size_t start = 0; start < length; start += RADIX*m) {
+        for (size_t k = 0; k < m; k++) {
+            std::complex<T> a[RADIX];
+            a[0] = x[start + k];
+            for (size_t r = 1; r < RADIX; r++) {
+                const auto w = twiddles[k*(RADIX-1) + r-1];
+                a[r] = x[start + r*m + k]*(inverse ? std::conj(w) : w);
+            }
+
+            std::complex<T> y[RADIX];
+            if (RADIX == 2) {
+                y[0] = a[0] + a[1];
+                y[1] = a[0] - a[1];
+            } else if (RADIX == 3) {
+                const auto sum = a[1] + a[2];
+                const auto mid = a[0] - static_cast<T>(0.5)*sum;
+                const auto diff = rotate_quarter(sin3*(a[1] - a[2]), inverse);
+                y[0] = a[0] + sum;
+                y[1] = mid + diff;
+                y[2] = mid - diff;
+            } else if (RADIX == 4) {
+                const auto sum02  = a[0] + a[2];
+                const auto diff02 = a[0] - a[2];
+                const auto sum13  = a[1] + a[3];
+                const auto diff13 = rotate_quarter(a[1] - a[3], inverse);
+                y[0] = sum02 + sum13;
+                y[1] = diff02 + diff13;
+                y[2] = sum02 - sum13;
+                y[3] = diff02 - diff13;
+            } else if (RADIX == 5) {
+                const auto sum14  = a[1] + a[4];
+                const auto sum23  = a[2] + a[3];
+                const auto diff14 = a[1] - a[4];
+                const auto diff23 = a[2] - a[3];
+                const auto mid1 = a[0] + cos1*sum14 + cos2*sum23;
+                const auto mid2 = a[0] + cos2*sum14 + cos1*sum23;
+                const auto rot1 = rotate_quarter(sin1*diff14 + sin2*diff23, inverse);
+                const auto rot2 = rotate_quarter(sin2*diff14 - sin1*diff23, inverse);
+                y[0] = a[0] + sum14 + sum23;
+                y[1] = mid1 + rot1;
+                y[2] = mid2 + rot2;
+                y[3] = mid2 - rot2;
+                y[4] = mid1 - rot1;
+            }
+            for (size_t q = 0; q < RADIX; q++) {
+                x[start + q*m + k] = y[q];
+            }
+        }
+    }
+}
+
+}   // namespace
+
+template <typename T>
+void FftPlan<T>::transform_mixed_radix(std::complex<T>* x, bool inverse) const {
+    const std::complex<T>* stage_twiddles = m_twiddles.data();
+    size_t sub_length = 1;
+    for (const auto radix : m_radices) {
+        switch (radix) {
+        case 2: mixed_radix_stage<T, 2>(x, m_length, sub_length, stage_twiddles, inverse); break;
+        case 3: mixed_radix_stage<T, 3>(x, m_length, sub_length, stage_twiddles, inverse); break;
+        case 4: mixed_radix_stage<T, 4>(x, m_length, sub_length, stage_twiddles, inverse); break;
+        case 5: mixed_radix_stage<T, 5>(x, m_length, sub_length, stage_twiddles, inverse); break;
+        }
+        stage_twiddles += (radix - 1)*sub_length;
+        sub_length *= radix;
+    }
+}
+
+template <typename T>
+RealFftPlan<T>::RealFftPlan(size_t length)
+    : m_length(length)
+{
+    if ((length < 2) || (length % 2 != 0)) {
+        throw std::runtime_error("real FFT length must be even and at least two");
+    }
+    m_half_plan = FftPlan<T>::get(length/2);
+
+    const double PI = 4.0*std::atan(1.0);
+    for (size_t k = 0; k <= length/4; k++) {
+        const double angle = -2.0*PI*static_cast<double>(k)/static_cast<double>(length);
+        m_twiddles.push_back(std::complex<T>(static_cast<T>(std::cos(angle)), static_cast<T>(std::sin(angle))));
+    }
+}
+
+template <typename T>
+typename RealFftPlan<T>::s_ptr RealFftPlan<T>::get(size_t length) {
+    return get_cached_plan<RealFftPlan<T> >(length);
+}
+
+template <typename T>
+void RealFftPlan<T>::forward(std::complex<T>* data) const {
+    // z[m] = x[2m] + i*x[2m+1] is exactly the memory layout of the input.
+    m_half_plan->forward(data);
+
+    // Split Z into the transforms of the even (E) and odd (O) samples and
+    // combine with X[k] = E[k] + W^k*O[k]. Bins k and n/2-k depend on the
+    // same two values of Z, so they are computed in pairs which allows the
+    // unpacking to be done in-place.
+    const auto half = m_length/2;
+    const auto z0 = data[0];
+    data[0]    = std::complex<T>(z0.real() + z0.imag(), static_cast<T>(0.0));
+    data[half] = std::complex<T>(z0.real() - z0.imag(), static_cast<T>(0.0));
+
+    const std::complex<T> minus_half_i(static_cast<T>(0.0), static_cast<T>(-0.5));
+    for (size_t k = 1; k <= half/2; k++) {
+        const auto j  = half - k;
+        const auto zk = data[k];
+        const auto zj = data[j];
+        const auto even = static_cast<T>(0.5)*(zk + std::conj(zj));
+        const auto odd  = minus_half_i*(zk - std::conj(zj));
+        const auto w    = m_twiddles[k];
+        data[k] = even + w*odd;
+        // W^(n/2-k) = -conj(W^k), and E[j], O[j] are the conjugates of E[k], O[k].
+        data[j] = std::conj(even) - std::conj(w)*std::conj(odd);
     }
+}
+
+template <typename T>
+std::vector<std::complex<T> > fft(const std::vector<std::complex<T> >& x) {
+    auto y = x;
+    FftPlan<T>::get(x.size())->forward(y.data());
     return y;
 }
 
 template <typename T>
 std::vector<std::complex<T> > ifft(const std::vector<std::complex<T> >& x) {
-    const auto n = x.size();
-    // swap real and imag
-    std::vector<std::complex<T> > temp(n);
-    std::transform(x.begin(), x.end(), temp.begin(), [](std::complex<T> sample) {
-        return std::complex<T>(sample.imag(), sample.real()); 
-    });
-    // take the forward FFT
-    auto res = fft(temp);
-    
-    // swap real and imag and scale.
-    std::transform(res.begin(), res.end(), temp.begin(), [=](std::complex<T> sample) {
-        return std::complex<T>(sample.imag()/n, sample.real()/n); 
-    });
-    return temp;
+    auto y = x;
+    FftPlan<T>::get(x.size())->inverse(y.data());
+    return y;
 }
 
 size_t next_power_of_two(size_t n) {
     return static_cast<size_t>(std::pow(2, std::ceil(std::log(n) / std::log(2))));
 }
 
+size_t next_smooth_size(size_t n, size_t multiple) {
+    if (multiple == 0) {
+        throw std::runtime_error("multiple must be positive");
+    }
+    const auto target = std::max<size_t>(1, (n + multiple - 1)/multiple);
+    // the power of two is always a candidate
+    auto best = next_power_of_two(target);
+    for (size_t p5 = 1; p5 < best; p5 *= 5) {
+        for (size_t p35 = p5; p35 < best; p35 *= 3) {
+            auto candidate = p35;
+            while (candidate < target) {
+                candidate *= 2;
+            }
+            best = std::min(best, candidate);
+        }
+    }
+    return multiple*best;
+}
+
 template <typename T>
 std::vector<std::complex<T> > zero_pad_to_complex(const std::vector<T>& v, size_t padded_size) {
     std::vector<std::complex<T> > res(padded_size, std::complex<T>(0.0, 0.0));
@@ -96,8 +371,8 @@ std::vector<T> fft_conv(const std::vector<T>& x, const std::vector<T>& y) {
 
     const auto final_out_size = x.size() + y.size() - 1;
 
-    // find the power of two we must use
-    const auto power_size = next_power_of_two(final_out_size);
+    // find the transform length we must use
+    const auto power_size = next_smooth_size(final_out_size);
 
     const auto padded_x_fft = fft(zero_pad_to_complex(x, power_size));
     const auto padded_y_fft = fft(zero_pad_to_complex(y, power_size));
@@ -122,6 +397,10 @@ std::vector<T> fft_conv(const std::vector<T>& x, const std::vector<T>& y) {
 
 
 // explicit instantiations for float and double.
+template class FftPlan<float>;
+template class FftPlan<double>;
+template class RealFftPlan<float>;
+template class RealFftPlan<double>;
 template std::vector<std::complex<float> >  fft(const std::vector<std::complex<float> >& x);
 template std::vector<std::complex<double> > fft(const std::vector<std::complex<double> >& x);
 template std::vector<std::complex<float> >  ifft(const std::vector<std::complex<float> >& x);
@@ -30,25 +30,108 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <complex>
 #include <vector>
+#include <memory>
+
+// Precomputed input permutation and twiddle factors for iterative, in-place
+// FFTs of a fixed length 2^a*3^b*5^c. Powers of two use radix-2 butterflies,
+// other lengths mixed radix-4/2/3/5 butterflies. Transforms do not allocate
+// any memory, and a plan can be shared between threads.
+template <typename T>
+class FftPlan {
+public:
+    typedef std::shared_ptr<const FftPlan<T> > s_ptr;
+
+    // Throws std::runtime_error if length has a prime factor larger than five.
+    explicit FftPlan(size_t length);
+
+    // Get a plan for the given length. Plans are created on first use and
+    // cached, so subsequent calls with the same length are cheap. Thread-safe.
+    static s_ptr get(size_t length);
+
+    size_t size() const {
+        return m_length;
+    }
+
+    // In-place forward FFT of size() samples.
+    void forward(std::complex<T>* x) const;
+
+    // In-place inverse FFT of size() samples, including the 1/n scaling.
+    void inverse(std::complex<T>* x) const;
+
+private:
+    void transform(std::complex<T>* x, bool inverse) const;
+    void transform_mixed_radix(std::complex<T>* x, bool inverse) const;
+
+private:
+    size_t                              m_length;
+    // Index pairs (i, j) to swap, in order, for the digit-reversal
+    // permutation of the input (bit-reversal for powers of two).
+    std::vector<std::pair<size_t, size_t> > m_swap_pairs;
+    // Radices of the stages for lengths which are not a power of two. Empty
+    // for powers of two.
+    std::vector<size_t>                 m_radices;
+    // Twiddle factors for all stages. For powers of two, exp(-2*pi*i*k/len)
+    // where the stage combining transforms of length half into length
+    // 2*half starts at index half-1. For mixed radix, the stage with radix p
+    // combining transforms of length m stores exp(-2*pi*i*r*k/(p*m)) at index
+    // k*(p-1) + r-1 from its start, for k < m and 0 < r < p.
+    std::vector<std::complex<T> >       m_twiddles;
+};
+
+// Forward FFT of real signals of a fixed even length n, where n/2 is a
+// length supported by FftPlan, computed with a complex FFT of length n/2.
+// Only the non-negative frequency bins 0..n/2 are produced, since the
+// remaining ones follow from symmetry.
+template <typename T>
+class RealFftPlan {
+public:
+    typedef std::shared_ptr<const RealFftPlan<T> > s_ptr;
+
+    // Throws std::runtime_error if length is odd or n/2 is not supported by FftPlan.
+    explicit RealFftPlan(size_t length);
+
+    // Get a cached plan for the given length. Thread-safe.
+    static s_ptr get(size_t length);
+
+    size_t size() const {
+        return m_length;
+    }
+
+    // In-place forward FFT. On input, data holds the n real samples stored
+    // contiguously (i.e. as n/2 complex values). On output, data holds the
+    // n/2+1 frequency bins 0..n/2, so there must be room for one complex
+    // value more than the input occupies.
+    void forward(std::complex<T>* data) const;
+
+private:
+    size_t                          m_length;
+    typename FftPlan<T>::s_ptr      m_half_plan;
+    // exp(-2*pi*i*k/n) for k = 0..n/4
+    std::vector<std::complex<T> >   m_twiddles;
+};
 
 // Compute forward FFT
-// NOTE: THIS IS COMPLETELY UNTESTED!
-// NOTE: Length must be a power of two!
+// NOTE: Length must be of the form 2^a*3^b*5^c!
 template <typename T>
 std::vector<std::complex<T> > fft(const std::vector<std::complex<T> >& x);
     
 
-// Compute backward FFT (using forward FFT behind the scenes)
-// NOTE: THIS IS COMPLETELY UNTESTED!
-// NOTE: Length must be a power of two!
+// Compute backward FFT
+// NOTE: Length must be of the form 2^a*3^b*5^c!
 template <typename T>
 std::vector<std::complex<T> > ifft(const std::vector<std::complex<T> >& x);
 
 // Find the power of two greater than or equal to n
-// This is intended to be used with fft() since it requires
-// power-of-two input sizes.
 size_t next_power_of_two(size_t n);
 
+// Find the smallest length of the form multiple*2^a*3^b*5^c which is
+// greater than or equal to n. This is intended for zero-padding before
+// transforms, and avoids padding of up to 2x with powers of two. If the
+// multiple also only has prime factors up to five, the result is a valid
+// FftPlan length, and e.g. a multiple of two gives lengths which also work
+// with RealFftPlan.
+size_t next_smooth_size(size_t n, size_t multiple = 1);
+
 // Convolve two real signals. Output size will be Nx+Ny-1.
 // Will perform zero-padding behind the scenes.
 template <typename T>
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+namespace bcsim {
+
+// Polyphase table of a windowed-sinc fractional-delay filter, for spreading
+// a point scatterer at a non-integer sample position t over the num_taps
+// samples floor(t) + get_first_offset(), ..., around it instead of rounding
+// it to the closest sample. The taps of each of num_phases+1 equally spaced
+// fractional positions in [0, 1] are precomputed with a Blackman window and
+// normalized to unit sum, so that a constant signal is interpolated exactly.
+class FractionalDelayTable {
+public:
+    FractionalDelayTable(int num_taps, int num_phases = 256)
+        : m_num_taps(num_taps),
+          m_num_phases(num_phases)
+    {
+        if ((num_taps < 2) || (num_taps % 2 != 0)) {
+            throw std::runtime_error("number of fractional delay taps must be even and at least two");
+        }
+        if (num_phases <= 0) {
+            throw std::runtime_error("number of fractional delay phases must be positive");
+        }
+        const double PI = 4.0*std::atan(1.0);
+        const double half_width = 0.5*num_taps;
+        m_taps.resize(static_cast<size_t>((num_phases + 1)*num_taps));
+        for (int phase = 0; phase <= num_phases; phase++) {
+            const double frac = static_cast<double>(phase)/num_phases;
+            float* taps = &m_taps[static_cast<size_t>(phase*num_taps)];
+            double sum = 0.0;
+            for (int k = 0; k < num_taps; k++) {
+                const double x = get_first_offset() + k - frac;
+                const double sinc = (x == 0.0) ? 1.0 : std::sin(PI*x)/(PI*x);
+                const double window = 0.42 + 0.5*std::cos(PI*x/half_width) + 0.08*std::cos(2.0*PI*x/half_width);
+                taps[k] = static_cast<float>(sinc*window);
+                sum += taps[k];
+            }
+            for (int k = 0; k < num_taps; k++) {
+                taps[k] = static_cast<float>(taps[k]/sum);
+            }
+        }
+    }
+
+    int get_num_taps() const {
+        return m_num_taps;
+    }
+
+    // Offset of the first tap relative to the integer part of the position.
+    int get_first_offset() const {
+        return 1 - m_num_taps/2;
+    }
+
+    // The get_num_taps() weights for a fractional position 0 <= frac <= 1,
+    // using the closest of the precomputed phases.
+    const float* get_taps(float frac) const {
+        const auto phase = static_cast<int>(frac*m_num_phases + 0.5f);
+        return &m_taps[static_cast<size_t>(phase*m_num_taps)];
+    }
+
+private:
+    int                 m_num_taps;
+    int                 m_num_phases;
+    std::vector<float>  m_taps;     // num_phases+1 rows of num_taps weights
+};
+
+}   // end namespace
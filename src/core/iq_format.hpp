@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "BCSimConfig.hpp"
+
+// The per-sample conversions are shared by the CPU output stage, the CUDA
+// kernel packing the device IQ lines and the IQ recorder.
+#ifndef BCSIM_HOST_DEVICE
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#define BCSIM_HOST_DEVICE __host__ __device__
+#else
+#define BCSIM_HOST_DEVICE
+#endif
+#endif
+
+namespace bcsim {
+
+// IEEE 754 binary16 bits of a float, rounded to nearest even. Magnitudes
+// which round beyond the largest half (65504) become infinity, and NaN
+// stays NaN.
+inline BCSIM_HOST_DEVICE uint16_t float_to_half_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t abs_bits = bits & 0x7fffffffu;
+    if (abs_bits >= 0x7f800000u) {
+        return static_cast<uint16_t>(sign | 0x7c00u | ((abs_bits > 0x7f800000u) ? 0x200u : 0u));
+    }
+    if (abs_bits >= 0x477ff000u) {
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (abs_bits < 0x38800000u) {
+        // subnormal half: a multiple of 2^-24, where a carry gives the smallest normal
+        const int exponent = static_cast<int>(abs_bits >> 23) - 127;
+        if (exponent < -25) {
+            return static_cast<uint16_t>(sign);
+        }
+        const uint32_t mantissa = (abs_bits & 0x7fffffu) | 0x800000u;
+        const int shift = -(exponent + 1);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1);
+        if ((rest > halfway) || ((rest == halfway) && (half & 1u))) {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+    // rebias the exponent and round the mantissa, where a carry increments the exponent
+    uint32_t half = (abs_bits - 0x38000000u) >> 13;
+    const uint32_t rest = abs_bits & 0x1fffu;
+    if ((rest > 0x1000u) || ((rest == 0x1000u) && (half & 1u))) {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+// The float value of IEEE 754 binary16 bits (exact).
+inline BCSIM_HOST_DEVICE float half_bits_to_float(uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1fu;
+    const uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0x1fu) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent == 0) {
+        const float magnitude = mantissa*5.9604644775390625e-8f;    // 2^-24
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    } else {
+        bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// round(scale*value) saturated to [-32767, 32767], with NaN as zero. The
+// range is symmetric so that negating a sample cannot overflow.
+inline BCSIM_HOST_DEVICE int16_t quantize_int16(float value, float scale) {
+    const float scaled = scale*value;
+    if (!(scaled == scaled)) {
+        return 0;
+    }
+    return static_cast<int16_t>(lrintf(fminf(fmaxf(scaled, -32767.0f), 32767.0f)));
+}
+
+// The scale of COMPLEX_INT16 which maps the largest absolute real or
+// imaginary part of a frame to 32767, or one for a frame of zeros.
+inline BCSIM_HOST_DEVICE float int16_frame_scale(float max_abs_component) {
+    return (max_abs_component > 0.0f) ? 32767.0f/max_abs_component : 1.0f;
+}
+
+// Bytes of one IQ sample.
+inline size_t iq_sample_bytes(IqOutputFormat::SampleType sample_type) {
+    switch (sample_type) {
+    case IqOutputFormat::SampleType::COMPLEX_FLOAT32:
+        return sizeof(std::complex<float>);
+    case IqOutputFormat::SampleType::COMPLEX_FLOAT16:
+    case IqOutputFormat::SampleType::COMPLEX_INT16:
+        return 2*sizeof(uint16_t);
+    default:
+        throw std::runtime_error("unknown IQ sample type");
+    }
+}
+
+// The largest absolute real or imaginary part of the samples.
+inline float max_abs_iq_component(const std::complex<float>* samples, size_t num_samples) {
+    float res = 0.0f;
+    for (size_t i = 0; i < num_samples; i++) {
+        res = std::max(res, std::max(std::abs(samples[i].real()), std::abs(samples[i].imag())));
+    }
+    return res;
+}
+
+// Convert num_samples IQ samples to dst in the given sample type, where
+// int16_scale is the scale actually used for COMPLEX_INT16 (not zero).
+inline void convert_iq_samples(const std::complex<float>* samples, size_t num_samples,
+                               IqOutputFormat::SampleType sample_type, float int16_scale, void* dst) {
+    switch (sample_type) {
+    case IqOutputFormat::SampleType::COMPLEX_FLOAT32:
+        std::copy(samples, samples + num_samples, static_cast<std::complex<float>*>(dst));
+        break;
+    case IqOutputFormat::SampleType::COMPLEX_FLOAT16:
+        {
+            auto out = static_cast<uint16_t*>(dst);
+            for (size_t i = 0; i < num_samples; i++) {
+                out[2*i]     = float_to_half_bits(samples[i].real());
+                out[2*i + 1] = float_to_half_bits(samples[i].imag());
+            }
+        }
+        break;
+    case IqOutputFormat::SampleType::COMPLEX_INT16:
+        {
+            auto out = static_cast<int16_t*>(dst);
+            for (size_t i = 0; i < num_samples; i++) {
+                out[2*i]     = quantize_int16(samples[i].real(), int16_scale);
+                out[2*i + 1] = quantize_int16(samples[i].imag(), int16_scale);
+            }
+        }
+        break;
+    default:
+        throw std::runtime_error("unknown IQ sample type");
+    }
+}
+
+}   // end namespace
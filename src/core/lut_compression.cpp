@@ -0,0 +1,307 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "lut_compression.hpp"
+
+namespace bcsim {
+
+namespace {
+
+// factors [rank][n] of one mode
+typedef std::vector<double> Factors;
+
+// Solve x*G = m for all num_rows rows of m in place, where G is a symmetric
+// positive semi-definite rank x rank matrix. A small ridge keeps it regular
+// when terms vanish.
+void solve_normal_equations(std::vector<double> g, int rank, std::vector<double>& m, int num_rows) {
+    double trace = 0.0;
+    for (int k = 0; k < rank; k++) {
+        trace += g[k*rank + k];
+    }
+    for (int k = 0; k < rank; k++) {
+        g[k*rank + k] += 1e-9*trace + 1e-300;
+    }
+    // Cholesky factorization G = L*L^T, L in the lower triangle
+    for (int j = 0; j < rank; j++) {
+        for (int k = 0; k < j; k++) {
+            g[j*rank + j] -= g[j*rank + k]*g[j*rank + k];
+        }
+        g[j*rank + j] = std::sqrt(std::max(g[j*rank + j], 1e-300));
+        for (int i = j + 1; i < rank; i++) {
+            for (int k = 0; k < j; k++) {
+                g[i*rank + j] -= g[i*rank + k]*g[j*rank + k];
+            }
+            g[i*rank + j] /= g[j*rank + j];
+        }
+    }
+    for (int row = 0; row < num_rows; row++) {
+        double* x = &m[row*rank];
+        for (int i = 0; i < rank; i++) {
+            for (int k = 0; k < i; k++) {
+                x[i] -= g[i*rank + k]*x[k];
+            }
+            x[i] /= g[i*rank + i];
+        }
+        for (int i = rank - 1; i >= 0; i--) {
+            for (int k = i + 1; k < rank; k++) {
+                x[i] -= g[k*rank + i]*x[k];
+            }
+            x[i] /= g[i*rank + i];
+        }
+    }
+}
+
+// Gram matrix of the factors multiplied elementwise with that of others.
+std::vector<double> gram_product(const Factors& f0, int n0, const Factors& f1, int n1, int rank) {
+    std::vector<double> g(rank*rank);
+    for (int k = 0; k < rank; k++) {
+        for (int j = 0; j < rank; j++) {
+            double g0 = 0.0;
+            double g1 = 0.0;
+            for (int i = 0; i < n0; i++) g0 += f0[k*n0 + i]*f0[j*n0 + i];
+            for (int i = 0; i < n1; i++) g1 += f1[k*n1 + i]*f1[j*n1 + i];
+            g[k*rank + j] = g0*g1;
+        }
+    }
+    return g;
+}
+
+}   // end anonymous namespace
+
+uint16_t float_to_half(float value) {
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+    const uint32_t sign = (f >> 16) & 0x8000u;
+    const uint32_t abs_f = f & 0x7fffffffu;
+    if (abs_f >= 0x7f800000u) {
+        // infinity or NaN
+        return static_cast<uint16_t>(sign | 0x7c00u | ((abs_f > 0x7f800000u) ? 0x200u : 0u));
+    }
+    if (abs_f >= 0x477ff000u) {
+        // rounds to more than the largest half, 65504
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (abs_f < 0x38800000u) {
+        // subnormal half: round the value in units of 2^-24
+        float abs_value;
+        std::memcpy(&abs_value, &abs_f, sizeof(abs_value));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(abs_value*16777216.0f)));
+    }
+    // rebias the exponent and round the 13 dropped mantissa bits to nearest even
+    const uint32_t rebiased = abs_f - 0x38000000u;
+    const uint32_t round_bit = (rebiased >> 13) & 1u;
+    return static_cast<uint16_t>(sign | ((rebiased + 0xfffu + round_bit) >> 13));
+}
+
+float half_to_float(uint16_t bits) {
+    const uint32_t sign = static_cast<uint32_t>(bits & 0x8000u) << 16;
+    const uint32_t exponent = (bits >> 10) & 0x1fu;
+    const uint32_t mantissa = bits & 0x3ffu;
+    uint32_t f;
+    if (exponent == 0x1fu) {
+        f = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        const float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    float value;
+    std::memcpy(&value, &f, sizeof(value));
+    return value;
+}
+
+std::vector<float> SeparableLUT::get_samples() const {
+    std::vector<float> samples(static_cast<size_t>(num_samples_rad)*num_samples_lat*num_samples_ele, 0.0f);
+    for (int ir = 0; ir < num_samples_rad; ir++) {
+        for (int il = 0; il < num_samples_lat; il++) {
+            float* row = &samples[(static_cast<size_t>(ir)*num_samples_lat + il)*num_samples_ele];
+            for (int k = 0; k < rank; k++) {
+                const float w = radial[k*num_samples_rad + ir]*lateral[k*num_samples_lat + il];
+                for (int ie = 0; ie < num_samples_ele; ie++) {
+                    row[ie] += w*elevational[k*num_samples_ele + ie];
+                }
+            }
+        }
+    }
+    return samples;
+}
+
+SeparableLUT compute_separable_lut(const LUTBeamProfile& profile, int rank, int num_iterations) {
+    if (rank <= 0) {
+        throw std::runtime_error("rank of separable LUT must be positive");
+    }
+    const int nr = profile.getNumSamplesRadial();
+    const int nl = profile.getNumSamplesLateral();
+    const int ne = profile.getNumSamplesElevational();
+    const auto& samples = profile.getSamples();
+    const auto sample = [&](int ir, int il, int ie) {
+        return static_cast<double>(samples[(static_cast<size_t>(ir)*nl + il)*ne + ie]);
+    };
+
+    Factors a(rank*nr, 0.0), b(rank*nl, 0.0), c(rank*ne, 0.0);
+
+    // Products of the samples with the factors of the other two modes,
+    // m[i][k] = sum over the other indices of lut*f0[k]*f1[k], for the
+    // given mode (0: radial, 1: lateral, 2: elevational).
+    const auto contract = [&](int mode, int num_terms) {
+        const int n = (mode == 0) ? nr : ((mode == 1) ? nl : ne);
+        std::vector<double> m(n*num_terms, 0.0);
+        std::vector<double> tmp(num_terms);
+        for (int ir = 0; ir < nr; ir++) {
+            for (int il = 0; il < nl; il++) {
+                if (mode == 2) {
+                    for (int k = 0; k < num_terms; k++) {
+                        const double w = a[k*nr + ir]*b[k*nl + il];
+                        for (int ie = 0; ie < ne; ie++) {
+                            m[ie*num_terms + k] += w*sample(ir, il, ie);
+                        }
+                    }
+                    continue;
+                }
+                for (int k = 0; k < num_terms; k++) {
+                    double sum = 0.0;
+                    for (int ie = 0; ie < ne; ie++) {
+                        sum += sample(ir, il, ie)*c[k*ne + ie];
+                    }
+                    tmp[k] = sum;
+                }
+                for (int k = 0; k < num_terms; k++) {
+                    if (mode == 0) {
+                        m[ir*num_terms + k] += tmp[k]*b[k*nl + il];
+                    } else {
+                        m[il*num_terms + k] += tmp[k]*a[k*nr + ir];
+                    }
+                }
+            }
+        }
+        return m;
+    };
+
+    // Greedy initialization: each term is the rank-one approximation of the
+    // residual of the previous terms, by power iteration. The residual is
+    // not stored, its contractions are corrected by the previous terms.
+    for (int term = 0; term < rank; term++) {
+        std::fill(&a[term*nr], &a[term*nr] + nr, 1.0);
+        std::fill(&b[term*nl], &b[term*nl] + nl, 1.0);
+        std::fill(&c[term*ne], &c[term*ne] + ne, 1.0);
+        for (int it = 0; it < 10; it++) {
+            for (int mode = 0; mode < 3; mode++) {
+                Factors& f = (mode == 0) ? a : ((mode == 1) ? b : c);
+                const int n = (mode == 0) ? nr : ((mode == 1) ? nl : ne);
+                const auto& f0 = (mode == 0) ? b : a;
+                const auto& f1 = (mode == 2) ? b : c;
+                const int n0 = (mode == 0) ? nl : nr;
+                const int n1 = (mode == 2) ? nl : ne;
+                // the contraction of the residual of the previous terms
+                const auto m = contract(mode, term + 1);
+                const auto g = gram_product(f0, n0, f1, n1, term + 1);
+                const double scale = g[term*(term + 1) + term];
+                for (int i = 0; i < n; i++) {
+                    double value = m[i*(term + 1) + term];
+                    for (int j = 0; j < term; j++) {
+                        value -= f[j*n + i]*g[j*(term + 1) + term];
+                    }
+                    f[term*n + i] = (scale > 0.0) ? value/scale : 0.0;
+                }
+            }
+        }
+    }
+
+    // Alternating least squares: each mode is the least-squares solution
+    // for the other two fixed.
+    for (int it = 0; it < num_iterations; it++) {
+        for (int mode = 0; mode < 3; mode++) {
+            Factors& f = (mode == 0) ? a : ((mode == 1) ? b : c);
+            const int n = (mode == 0) ? nr : ((mode == 1) ? nl : ne);
+            const auto& f0 = (mode == 0) ? b : a;
+            const auto& f1 = (mode == 2) ? b : c;
+            const int n0 = (mode == 0) ? nl : nr;
+            const int n1 = (mode == 2) ? nl : ne;
+            auto m = contract(mode, rank);
+            solve_normal_equations(gram_product(f0, n0, f1, n1, rank), rank, m, n);
+            for (int i = 0; i < n; i++) {
+                for (int k = 0; k < rank; k++) {
+                    f[k*n + i] = m[i*rank + k];
+                }
+            }
+        }
+    }
+
+    // Balance the norms of the profiles of each term to stay in float range.
+    SeparableLUT result;
+    result.num_samples_rad = nr;
+    result.num_samples_lat = nl;
+    result.num_samples_ele = ne;
+    result.rank = rank;
+    result.radial.resize(rank*nr);
+    result.lateral.resize(rank*nl);
+    result.elevational.resize(rank*ne);
+    for (int k = 0; k < rank; k++) {
+        double norms[3] = {0.0, 0.0, 0.0};
+        for (int i = 0; i < nr; i++) norms[0] += a[k*nr + i]*a[k*nr + i];
+        for (int i = 0; i < nl; i++) norms[1] += b[k*nl + i]*b[k*nl + i];
+        for (int i = 0; i < ne; i++) norms[2] += c[k*ne + i]*c[k*ne + i];
+        for (auto& norm : norms) norm = std::sqrt(norm);
+        const double common = std::cbrt(norms[0]*norms[1]*norms[2]);
+        const auto scale = [&](double norm) { return (norm > 0.0) ? common/norm : 0.0; };
+        for (int i = 0; i < nr; i++) result.radial[k*nr + i]      = static_cast<float>(a[k*nr + i]*scale(norms[0]));
+        for (int i = 0; i < nl; i++) result.lateral[k*nl + i]     = static_cast<float>(b[k*nl + i]*scale(norms[1]));
+        for (int i = 0; i < ne; i++) result.elevational[k*ne + i] = static_cast<float>(c[k*ne + i]*scale(norms[2]));
+    }
+    return result;
+}
+
+LUTApproximationError compute_lut_approximation_error(const std::vector<float>& samples,
+                                                      const std::vector<float>& approximation) {
+    if (samples.size() != approximation.size()) {
+        throw std::runtime_error("LUT approximation has the wrong number of samples");
+    }
+    double max_sample = 0.0;
+    double max_error = 0.0;
+    double sum_squares = 0.0;
+    double sum_squared_errors = 0.0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const double error = static_cast<double>(approximation[i]) - samples[i];
+        max_sample = std::max(max_sample, std::abs(static_cast<double>(samples[i])));
+        max_error = std::max(max_error, std::abs(error));
+        sum_squares += static_cast<double>(samples[i])*samples[i];
+        sum_squared_errors += error*error;
+    }
+    LUTApproximationError result;
+    result.max_error = (max_sample > 0.0) ? static_cast<float>(max_error/max_sample) : 0.0f;
+    result.relative_rms_error = (sum_squares > 0.0) ? static_cast<float>(std::sqrt(sum_squared_errors/sum_squares)) : 0.0f;
+    return result;
+}
+
+}   // end namespace
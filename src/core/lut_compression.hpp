@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "BeamProfile.hpp"
+
+namespace bcsim {
+
+// IEEE 754 half-precision bits of a float, rounded to nearest even. Values
+// too large for half precision become infinite, NaN stays NaN.
+uint16_t float_to_half(float value);
+
+// The float value of IEEE 754 half-precision bits (exact).
+float half_to_float(uint16_t bits);
+
+// Approximation of a lookup-table beam profile by a sum of rank products of
+// one-dimensional radial, lateral and elevational profiles,
+//   lut[ir][il][ie] ~ sum_k radial[k][ir]*lateral[k][il]*elevational[k][ie]
+// Trilinear interpolation of the sum is the sum of the products of the
+// linearly interpolated profiles, which can be evaluated without the table.
+struct SeparableLUT {
+    int num_samples_rad;
+    int num_samples_lat;
+    int num_samples_ele;
+    int rank;
+    // The profiles of all terms, [rank][num_samples] row-major.
+    std::vector<float> radial;
+    std::vector<float> lateral;
+    std::vector<float> elevational;
+
+    // The approximated samples in the layout of LUTBeamProfile::getSamples().
+    std::vector<float> get_samples() const;
+};
+
+// Rank-rank canonical polyadic decomposition of the LUT samples: greedy
+// rank-one terms refined by num_iterations sweeps of alternating least
+// squares. Throws std::runtime_error if rank is not positive.
+SeparableLUT compute_separable_lut(const LUTBeamProfile& profile, int rank, int num_iterations=25);
+
+// Error of an approximation of the LUT samples, both in the same layout.
+struct LUTApproximationError {
+    float max_error;            // largest absolute error over the largest sample magnitude
+    float relative_rms_error;   // L2 norm of the error over that of the samples
+};
+
+LUTApproximationError compute_lut_approximation_error(const std::vector<float>& samples,
+                                                      const std::vector<float>& approximation);
+
+}   // end namespace
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cmath>
+#include "vector3.hpp"
+
+namespace bcsim {
+
+// Fixed-size 3x3 matrix of floats for rotating vectors, e.g. all lines of a
+// scan sequence, without the heap allocations of boost::numeric::ublas.
+class Matrix3 {
+public:
+    // The identity.
+    constexpr Matrix3()
+        : m{{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}} { }
+
+    // Row by row.
+    constexpr Matrix3(float m00, float m01, float m02,
+                      float m10, float m11, float m12,
+                      float m20, float m21, float m22)
+        : m{{m00, m01, m02}, {m10, m11, m12}, {m20, m21, m22}} { }
+
+    // Rotation around the x-axis.
+    static Matrix3 rotation_x(double angle) {
+        const auto c = static_cast<float>(std::cos(angle));
+        const auto s = static_cast<float>(std::sin(angle));
+        return Matrix3(1.0f, 0.0f, 0.0f,
+                       0.0f, c,    -s,
+                       0.0f, s,    c);
+    }
+
+    // Rotation around the y-axis.
+    static Matrix3 rotation_y(double angle) {
+        const auto c = static_cast<float>(std::cos(angle));
+        const auto s = static_cast<float>(std::sin(angle));
+        return Matrix3(c,    0.0f, s,
+                       0.0f, 1.0f, 0.0f,
+                       -s,   0.0f, c);
+    }
+
+    // Rotation around the z-axis.
+    static Matrix3 rotation_z(double angle) {
+        const auto c = static_cast<float>(std::cos(angle));
+        const auto s = static_cast<float>(std::sin(angle));
+        return Matrix3(c,    -s,   0.0f,
+                       s,    c,    0.0f,
+                       0.0f, 0.0f, 1.0f);
+    }
+
+    // Rotation around x, y and z, in that order, i.e. R_z*R_y*R_x as
+    // rotation_matrix_xyz() of rotation3d.hpp. The product is formed in
+    // double precision so that rotated unit vectors stay orthonormal.
+    static Matrix3 rotation_xyz(double x_angle, double y_angle, double z_angle) {
+        const double cx = std::cos(x_angle), sx = std::sin(x_angle);
+        const double cy = std::cos(y_angle), sy = std::sin(y_angle);
+        const double cz = std::cos(z_angle), sz = std::sin(z_angle);
+        return Matrix3(static_cast<float>(cz*cy), static_cast<float>(cz*sy*sx - sz*cx), static_cast<float>(cz*sy*cx + sz*sx),
+                       static_cast<float>(sz*cy), static_cast<float>(sz*sy*sx + cz*cx), static_cast<float>(sz*sy*cx - cz*sx),
+                       static_cast<float>(-sy),   static_cast<float>(cy*sx),            static_cast<float>(cy*cx));
+    }
+
+    constexpr float operator()(int row, int col) const {
+        return m[row][col];
+    }
+
+    constexpr Vector3D<float> operator*(const Vector3D<float>& v) const {
+        return Vector3D<float>(m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+                               m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+                               m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z);
+    }
+
+    constexpr Matrix3 operator*(const Matrix3& b) const {
+        return Matrix3(row_times(0, b, 0), row_times(0, b, 1), row_times(0, b, 2),
+                       row_times(1, b, 0), row_times(1, b, 1), row_times(1, b, 2),
+                       row_times(2, b, 0), row_times(2, b, 1), row_times(2, b, 2));
+    }
+
+    constexpr bool is_identity() const {
+        return (m[0][0] == 1.0f) && (m[0][1] == 0.0f) && (m[0][2] == 0.0f)
+            && (m[1][0] == 0.0f) && (m[1][1] == 1.0f) && (m[1][2] == 0.0f)
+            && (m[2][0] == 0.0f) && (m[2][1] == 0.0f) && (m[2][2] == 1.0f);
+    }
+
+private:
+    constexpr float row_times(int row, const Matrix3& b, int col) const {
+        return m[row][0]*b.m[0][col] + m[row][1]*b.m[1][col] + m[row][2]*b.m[2][col];
+    }
+
+    float m[3][3];
+};
+
+static_assert((Matrix3()*Vector3D<float>(1.0f, 2.0f, 3.0f)).z == 3.0f, "Matrix3 must be usable in constant expressions");
+
+}   // end namespace
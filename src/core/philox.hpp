@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <array>
+#include <complex>
+#include <cmath>
+#include <cstdint>
+
+// Counter-based random number generator Philox4x32-10 from
+// "Parallel Random Numbers: As Easy as 1, 2, 3" by Salmon et al. (2011).
+// The output is a pure function of counter and key, so any number of threads
+// can generate independent streams without sharing state.
+namespace philox {
+
+typedef std::array<uint32_t, 4> Counter;
+typedef std::array<uint32_t, 2> Key;
+
+inline void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+    const uint64_t product = static_cast<uint64_t>(a)*static_cast<uint64_t>(b);
+    hi = static_cast<uint32_t>(product >> 32);
+    lo = static_cast<uint32_t>(product);
+}
+
+// Map a counter to four random 32-bit words.
+inline Counter philox4x32(Counter ctr, Key key) {
+    const uint32_t M0 = 0xD2511F53u;
+    const uint32_t M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u;
+    const uint32_t W1 = 0xBB67AE85u;
+    for (int round = 0; round < 10; round++) {
+        if (round > 0) {
+            key[0] += W0;
+            key[1] += W1;
+        }
+        uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(M0, ctr[0], hi0, lo0);
+        mulhilo(M1, ctr[2], hi1, lo1);
+        ctr = Counter{{hi1^ctr[1]^key[0], lo1, hi0^ctr[3]^key[1], lo0}};
+    }
+    return ctr;
+}
+
+// Fill num_samples complex values whose real and imaginary parts are
+// independent zero-mean Gaussians with standard deviation sigma, and add
+// them to signal. The samples only depend on key and the stream words,
+// i.e. counter (i/2, stream0, stream1, stream2) is used for samples i, i+1.
+inline void add_gaussian_noise(std::complex<float>* signal, size_t num_samples, float sigma,
+                               Key key, uint32_t stream0, uint32_t stream1, uint32_t stream2) {
+    const float TWO_PI    = static_cast<float>(2.0*4.0*std::atan(1.0));
+    const float INV_2_24  = 1.0f/16777216.0f;
+    for (size_t i = 0; i < num_samples; i += 2) {
+        const auto bits = philox4x32(Counter{{static_cast<uint32_t>(i/2), stream0, stream1, stream2}}, key);
+
+        // Box-Muller with 24-bit uniforms: u in (0, 1] for the logarithm.
+        for (size_t j = 0; (j < 2) && (i + j < num_samples); j++) {
+            const float u1 = static_cast<float>((bits[2*j] >> 8) + 1)*INV_2_24;
+            const float u2 = static_cast<float>(bits[2*j+1] >> 8)*INV_2_24;
+            const float radius = sigma*std::sqrt(-2.0f*std::log(u1));
+            const float angle  = TWO_PI*u2;
+            signal[i+j] += std::complex<float>(radius*std::cos(angle), radius*std::sin(angle));
+        }
+    }
+}
+
+}   // end namespace philox
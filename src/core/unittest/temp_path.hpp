@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdlib>
+#include <string>
+#ifdef _WIN32
+    #include <process.h>
+    #define BCSIM_TEST_GETPID _getpid
+#else
+    #include <unistd.h>
+    #define BCSIM_TEST_GETPID getpid
+#endif
+
+namespace bcsim {
+namespace test {
+
+// Path of a scratch file in the system temporary folder. The name is unique
+// to the test process, so a file left behind by a failed or manual run is
+// never picked up by a later run or committed from the source tree.
+inline std::string temp_path(const std::string& name) {
+    std::string dir = "/tmp";
+    for (auto var : {"TMPDIR", "TEMP", "TMP"}) {
+        if (const char* value = std::getenv(var)) {
+            if (*value != '\0') {
+                dir = value;
+                break;
+            }
+        }
+    }
+    return dir + "/bcsim_" + std::to_string(BCSIM_TEST_GETPID()) + "_" + name;
+}
+
+}   // end namespace test
+}   // end namespace bcsim
@@ -0,0 +1,335 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE AlgorithmStateTests
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../algorithm/AlgorithmState.hpp"
+#include "../algorithm/CpuScatterers.hpp"
+#include "../BeamProfile.hpp"
+#include "../content_hash.hpp"
+#include "temp_path.hpp"
+
+namespace {
+
+const std::string test_file_path  = bcsim::test::temp_path("test_algorithm_state.bin");
+const std::string test_file_path2 = bcsim::test::temp_path("test_algorithm_state2.bin");
+const char* test_file  = test_file_path.c_str();
+const char* test_file2 = test_file_path2.c_str();
+
+std::string hash_of(const bcsim::AlgorithmState& state,
+                    std::function<bool(const std::string&)> keep_parameter = nullptr) {
+    bcsim::ContentHash hash;
+    state.hash(hash, keep_parameter);
+    return hash.hex_digest();
+}
+
+std::string read_file(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bcsim::AlgorithmState make_state(bool lookup_profile, bool multi_resolution=false) {
+    bcsim::AlgorithmState state;
+    state.set_parameter("sound_speed", "1500");
+    state.set_parameter("radial_decimation", "2");
+    state.set_parameter("sound_speed", "1540");
+
+    bcsim::ExcitationSignal excitation;
+    excitation.samples = {0.1f, -0.5f, 1.0f, -0.5f, 0.1f};
+    excitation.center_index = 2;
+    excitation.sampling_frequency = 50e6f;
+    excitation.demod_freq = 2.5e6f;
+    state.set_excitation(excitation);
+
+    auto scan_seq = std::make_shared<bcsim::ScanSequence>(0.1f);
+    for (int i = 0; i < 4; i++) {
+        scan_seq->add_scanline(bcsim::Scanline(bcsim::vector3(0.001f*i, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                               bcsim::vector3(1.0f, 0.0f, 0.0f), 0.01f*i));
+    }
+    scan_seq->r_min = 0.02f;
+    scan_seq->r_max = 0.05f;
+    state.set_scan_sequence(scan_seq);
+
+    if (lookup_profile && multi_resolution) {
+        std::vector<bcsim::LUTBeamProfile> zones;
+        zones.emplace_back(3, 4, 5, bcsim::Interval(0.0f, 0.05f), bcsim::Interval(-0.01f, 0.01f), bcsim::Interval(-0.02f, 0.02f));
+        zones.emplace_back(2, 3, 3, bcsim::Interval(0.05f, 0.1f), bcsim::Interval(-0.02f, 0.02f), bcsim::Interval(-0.03f, 0.03f));
+        zones[0].setDiscreteSample(1, 2, 3, 0.5f);
+        zones[1].setDiscreteSample(1, 1, 1, 0.25f);
+        state.set_lookup_profile(std::make_shared<bcsim::MultiResolutionLUTBeamProfile>(std::move(zones)));
+    } else if (lookup_profile) {
+        std::vector<float> samples(3*4*5);
+        for (size_t i = 0; i < samples.size(); i++) samples[i] = 0.01f*i;
+        state.set_lookup_profile(std::make_shared<bcsim::LUTBeamProfile>(3, 4, 5, bcsim::Interval(0.0f, 0.1f),
+                                                                         bcsim::Interval(-0.01f, 0.01f), bcsim::Interval(-0.02f, 0.02f),
+                                                                         std::move(samples)));
+    } else {
+        state.set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 2e-3f));
+    }
+
+    auto fixed = std::make_shared<bcsim::FixedScatterers>();
+    for (int i = 0; i < 10; i++) {
+        fixed->scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.01f*i), 1.0f*i});
+    }
+    state.add_fixed_scatterers(fixed);
+
+    auto procedural = std::make_shared<bcsim::ProceduralScatterers>();
+    procedural->region = bcsim::ProceduralScatterers::Region::ELLIPSOID;
+    procedural->center = bcsim::vector3(0.0f, 0.0f, 0.05f);
+    procedural->half_axes = bcsim::vector3(0.01f, 0.02f, 0.03f);
+    procedural->axes = bcsim::Matrix3::rotation_y(0.3);
+    procedural->count = 1000;
+    procedural->amplitude_distribution = bcsim::ProceduralScatterers::AmplitudeDistribution::UNIFORM;
+    procedural->amplitude_scale = 0.5f;
+    procedural->seed = 0x123456789ull;
+    state.add_procedural_scatterers(procedural);
+
+    auto image_volume = std::make_shared<bcsim::ImageVolumeScatterers>();
+    image_volume->origin = bcsim::vector3(-0.01f, -0.01f, 0.02f);
+    image_volume->voxel_size = bcsim::vector3(0.005f, 0.005f, 0.01f);
+    image_volume->nx = 4;
+    image_volume->ny = 4;
+    image_volume->nz = 2;
+    for (int i = 0; i < 32; i++) {
+        image_volume->densities.push_back(1e8f*(i % 5));
+        image_volume->amplitude_scales.push_back(0.1f*i);
+    }
+    image_volume->seed = 7;
+    image_volume->update_counts();
+    state.add_image_volume_scatterers(image_volume);
+
+    auto spline = std::make_shared<bcsim::SplineScatterers>();
+    spline->spline_degree = 1;
+    spline->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    spline->resize(3, 2);
+    for (int i = 0; i < 3; i++) {
+        spline->set_control_point(i, 0, bcsim::vector3(0.0f, 0.0f, 0.01f*i));
+        spline->set_control_point(i, 1, bcsim::vector3(0.001f, 0.0f, 0.01f*i));
+        spline->amplitudes[i] = 0.5f*i;
+    }
+    state.add_spline_scatterers(spline);
+    return state;
+}
+
+}
+
+// Loading a state file and saving it again must give the same file.
+BOOST_AUTO_TEST_CASE(SaveLoadRoundTrip) {
+    for (bool lookup_profile : {false, true}) {
+        for (bool multi_resolution : {false, true}) {
+            make_state(lookup_profile, multi_resolution).save(test_file);
+            bcsim::AlgorithmState state;
+            state.load(test_file);
+            state.save(test_file2);
+            BOOST_CHECK(read_file(test_file) == read_file(test_file2));
+            BOOST_CHECK_EQUAL(state.get_scan_sequence()->r_min, 0.02f);
+            BOOST_CHECK_EQUAL(state.get_scan_sequence()->r_max, 0.05f);
+        }
+    }
+    std::remove(test_file);
+    std::remove(test_file2);
+}
+
+// The hash is of the configuration, not of the order of the setters.
+BOOST_AUTO_TEST_CASE(HashDependsOnContents) {
+    auto state = make_state(false);
+    const auto digest = hash_of(state);
+    BOOST_CHECK_EQUAL(digest.size(), 32u);
+    BOOST_CHECK_EQUAL(hash_of(make_state(false)), digest);
+    BOOST_CHECK(hash_of(make_state(true)) != digest);
+
+    state.set_parameter("radial_decimation", "2");
+    BOOST_CHECK_EQUAL(hash_of(state), digest);
+    state.set_parameter("verbose", "1");
+    BOOST_CHECK(hash_of(state) != digest);
+    BOOST_CHECK_EQUAL(hash_of(state, [](const std::string& key) { return key != "verbose"; }), digest);
+    state.set_parameter("frame_cache_megabytes", "16");
+    BOOST_CHECK(hash_of(state) == hash_of(state, [](const std::string& key) { return key != "frame_cache_megabytes"; }));
+
+    auto moved = make_state(false);
+    moved.update_fixed_scatterers(0, {3}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}});
+    BOOST_CHECK(hash_of(moved) != digest);
+}
+
+// Updates are recorded without modifying the caller's datasets.
+BOOST_AUTO_TEST_CASE(UpdatesAreCopyOnWrite) {
+    auto state = make_state(false);
+    const auto caller_fixed = state.get_fixed_datasets().at(0);
+    const auto caller_spline = state.get_spline_datasets().at(0);
+    const auto original_fixed = *caller_fixed;
+    const auto original_spline = *caller_spline;
+    const bcsim::PointScatterer new_scatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f};
+    state.update_fixed_scatterers(0, {3}, {new_scatterer});
+    bcsim::SplineScatterers new_spline;
+    new_spline.resize(1, 2);
+    new_spline.set_control_point(0, 0, bcsim::vector3(0.002f, 0.001f, 0.03f));
+    new_spline.set_control_point(0, 1, bcsim::vector3(0.004f, 0.001f, 0.03f));
+    new_spline.amplitudes[0] = -2.0f;
+    state.update_spline_scatterers(0, {1}, new_spline);
+
+    const auto same_bytes = [](const std::vector<float>& a, const std::vector<float>& b) {
+        return (a.size() == b.size()) && (std::memcmp(a.data(), b.data(), a.size()*sizeof(float)) == 0);
+    };
+    BOOST_REQUIRE_EQUAL(caller_fixed->scatterers.size(), original_fixed.scatterers.size());
+    BOOST_CHECK(std::memcmp(caller_fixed->scatterers.data(), original_fixed.scatterers.data(),
+                            original_fixed.scatterers.size()*sizeof(bcsim::PointScatterer)) == 0);
+    BOOST_CHECK(same_bytes(caller_spline->control_xs, original_spline.control_xs));
+    BOOST_CHECK(same_bytes(caller_spline->control_ys, original_spline.control_ys));
+    BOOST_CHECK(same_bytes(caller_spline->control_zs, original_spline.control_zs));
+    BOOST_CHECK(same_bytes(caller_spline->amplitudes, original_spline.amplitudes));
+
+    const auto& recorded_fixed = *state.get_fixed_datasets().at(0);
+    BOOST_CHECK_EQUAL(recorded_fixed.scatterers[3].pos.z, 0.05f);
+    BOOST_CHECK_EQUAL(recorded_fixed.scatterers[3].amplitude, -1.0f);
+    BOOST_CHECK_EQUAL(recorded_fixed.scatterers[4].amplitude, original_fixed.scatterers[4].amplitude);
+    const auto& recorded_spline = *state.get_spline_datasets().at(0);
+    BOOST_CHECK_EQUAL(recorded_spline.get_control_point(1, 1).x, 0.004f);
+    BOOST_CHECK_EQUAL(recorded_spline.amplitudes[1], -2.0f);
+    BOOST_CHECK_EQUAL(recorded_spline.get_control_point(2, 1).x, original_spline.get_control_point(2, 1).x);
+}
+
+// Saved updates give the same file as the same updates of another state.
+BOOST_AUTO_TEST_CASE(UpdatesAreSaved) {
+    auto state = make_state(false);
+    state.save(test_file);
+    state.update_fixed_scatterers(0, {3}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}});
+    state.save(test_file2);
+    BOOST_CHECK(read_file(test_file) != read_file(test_file2));
+
+    // the same update applied to a fresh state gives the same file
+    auto other = make_state(false);
+    other.update_fixed_scatterers(0, {3}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}});
+    other.save(test_file);
+    BOOST_CHECK(read_file(test_file) == read_file(test_file2));
+    std::remove(test_file);
+    std::remove(test_file2);
+}
+
+BOOST_AUTO_TEST_CASE(ProceduralDatasetsCannotBeUpdated) {
+    auto state = make_state(false);
+    for (size_t dset_idx : {1, 2}) {
+        BOOST_CHECK_THROW(state.update_fixed_scatterers(dset_idx, {3}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}}),
+                          std::runtime_error);
+    }
+}
+
+// The counts of a loaded image volume are drawn again, which gives the same
+// scatterers.
+BOOST_AUTO_TEST_CASE(ImageVolumesLoadWithTheirScatterers) {
+    const auto state = make_state(false);
+    state.save(test_file);
+    bcsim::AlgorithmState loaded;
+    loaded.load(test_file);
+    const auto& original = *state.get_image_volume_datasets().at(2);
+    const auto& image_volume = loaded.get_image_volume_datasets().at(2);
+    BOOST_REQUIRE(image_volume);
+    BOOST_CHECK(image_volume->voxel_starts == original.voxel_starts);
+    BOOST_CHECK_EQUAL(image_volume->get_scatterer(5).pos.x, original.get_scatterer(5).pos.x);
+    BOOST_CHECK_EQUAL(image_volume->get_scatterer(5).amplitude, original.get_scatterer(5).amplitude);
+    std::remove(test_file);
+}
+
+// External datasets are saved as copies and load as fixed datasets.
+BOOST_AUTO_TEST_CASE(ExternalDatasetsAreSavedAsFixed) {
+    const std::vector<float> xs = {0.0f, 0.01f, -0.01f};
+    const std::vector<float> ys = {0.0f, 0.0f, 0.002f};
+    const std::vector<float> zs = {0.02f, 0.03f, 0.04f};
+    const std::vector<float> as = {1.0f, -0.5f, 0.25f};
+    auto external = std::make_shared<bcsim::ExternalFixedScatterers>();
+    external->xs = xs.data();
+    external->ys = ys.data();
+    external->zs = zs.data();
+    external->as = as.data();
+    external->count = xs.size();
+
+    auto state = make_state(false);
+    auto copied = make_state(false);
+    state.add_external_fixed_scatterers(external);
+    copied.add_fixed_scatterers(external->expand());
+    const auto external_idx = state.get_fixed_datasets().size() - 1;
+    BOOST_CHECK_THROW(state.update_fixed_scatterers(external_idx, {0}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}}),
+                      std::runtime_error);
+    state.save(test_file);
+    copied.save(test_file2);
+    BOOST_CHECK(read_file(test_file) == read_file(test_file2));
+
+    bcsim::AlgorithmState loaded;
+    loaded.load(test_file);
+    BOOST_CHECK(loaded.get_fixed_datasets().back() != nullptr);
+    BOOST_CHECK(loaded.get_external_datasets().back() == nullptr);
+    std::remove(test_file);
+    std::remove(test_file2);
+}
+
+// The sorted fixed datasets are restored as they were saved, and only with
+// the dataset they were sorted from.
+BOOST_AUTO_TEST_CASE(SortedFixedDatasetsAreRestored) {
+    auto state = make_state(false);
+    const auto& fixed = *state.get_fixed_datasets().at(0);
+    std::vector<std::shared_ptr<bcsim::HostFixedScatterers>> layouts(state.get_fixed_datasets().size());
+    layouts[0] = std::make_shared<bcsim::HostFixedScatterers>(fixed, bcsim::ScattererGrid::CellOrder::MORTON, 2);
+    // not a stored dataset, so it is ignored
+    layouts[1] = layouts[0];
+    state.save(test_file, layouts);
+
+    bcsim::AlgorithmState loaded;
+    loaded.load(test_file);
+    const auto& restored = loaded.get_fixed_layouts();
+    BOOST_REQUIRE_EQUAL(restored.size(), layouts.size());
+    BOOST_REQUIRE(restored[0]);
+    BOOST_CHECK(!restored[1]);
+    BOOST_CHECK(restored[0]->cell_order == bcsim::ScattererGrid::CellOrder::MORTON);
+    BOOST_CHECK_EQUAL(restored[0]->num_subsets, 2u);
+    BOOST_CHECK(restored[0]->xs == layouts[0]->xs);
+    BOOST_CHECK(restored[0]->as == layouts[0]->as);
+    BOOST_CHECK(restored[0]->sorted_index == layouts[0]->sorted_index);
+    BOOST_CHECK(restored[0]->grid.get_tables().cell_starts == layouts[0]->grid.get_tables().cell_starts);
+    const auto range = restored[0]->subset_range(1, 2);
+    BOOST_CHECK(range == layouts[0]->subset_range(1, 2));
+
+    // the configuration is the same with and without them
+    state.save(test_file2);
+    bcsim::AlgorithmState without;
+    without.load(test_file2);
+    BOOST_CHECK(!without.get_fixed_layouts().at(0));
+    BOOST_CHECK_EQUAL(hash_of(loaded), hash_of(without));
+
+    // dropped when the dataset is updated
+    loaded.update_fixed_scatterers(0, {3}, {bcsim::PointScatterer{bcsim::vector3(0.0f, 0.0f, 0.05f), -1.0f}});
+    BOOST_CHECK(!loaded.get_fixed_layouts().at(0));
+
+    // a layout of other scatterers is rejected
+    auto other = fixed;
+    other.scatterers[4].amplitude = 2.0f;
+    layouts[0] = std::make_shared<bcsim::HostFixedScatterers>(other);
+    state.save(test_file, layouts);
+    BOOST_CHECK_THROW(loaded.load(test_file), std::runtime_error);
+    std::remove(test_file);
+    std::remove(test_file2);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidFilesAreRejected) {
+    make_state(true).save(test_file);
+    const auto contents = read_file(test_file);
+    bcsim::AlgorithmState state;
+    {
+        std::ofstream out(test_file2, std::ios::binary);
+        out.write(contents.data(), contents.size()/2);
+    }
+    BOOST_CHECK_THROW(state.load(test_file2), std::runtime_error);
+    {
+        std::ofstream out(test_file2, std::ios::binary);
+        out << "not a state file";
+    }
+    BOOST_CHECK_THROW(state.load(test_file2), std::runtime_error);
+    BOOST_CHECK_THROW(state.load(bcsim::test::temp_path("does_not_exist.bin")), std::runtime_error);
+    std::remove(test_file);
+    std::remove(test_file2);
+}
@@ -0,0 +1,120 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE AsyncLogTests
+#include <boost/test/unit_test.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../AsyncLog.hpp"
+
+namespace {
+
+class RecordingLog : public bcsim::ILog {
+public:
+    virtual void write(LogType type, const std::string& msg) override {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_types.push_back(type);
+        m_messages.push_back(msg);
+    }
+
+    std::vector<std::string> messages() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_messages;
+    }
+
+    std::vector<LogType> types() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_types;
+    }
+
+private:
+    std::mutex                  m_mutex;
+    std::vector<LogType>        m_types;
+    std::vector<std::string>    m_messages;
+};
+
+}   // namespace
+
+BOOST_AUTO_TEST_CASE(MessagesFromAllThreadsAreForwardedInOrder) {
+    auto recording_log = std::make_shared<RecordingLog>();
+    const int num_threads = 4;
+    const int messages_per_thread = 500;
+    {
+        bcsim::AsyncLog log(recording_log, messages_per_thread);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back([&log, i]() {
+                for (int j = 0; j < messages_per_thread; j++) {
+                    log.write(bcsim::ILog::INFO, std::to_string(i) + " " + std::to_string(j));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        log.flush();
+        BOOST_CHECK_EQUAL(log.get_num_dropped(), 0u);
+        BOOST_CHECK_EQUAL(recording_log->messages().size(), static_cast<size_t>(num_threads*messages_per_thread));
+    }
+
+    std::vector<int> next(num_threads, 0);
+    for (const auto& msg : recording_log->messages()) {
+        const auto space = msg.find(' ');
+        const int thread_no = std::stoi(msg.substr(0, space));
+        BOOST_CHECK_EQUAL(std::stoi(msg.substr(space + 1)), next[thread_no]);
+        next[thread_no]++;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DestructionForwardsQueuedMessages) {
+    auto recording_log = std::make_shared<RecordingLog>();
+    {
+        bcsim::AsyncLog log(recording_log, 16, 0, 1000);
+        log.write(bcsim::ILog::WARNING, "first");
+        log.write(bcsim::ILog::DEBUG, "second");
+    }
+    const auto messages = recording_log->messages();
+    BOOST_REQUIRE_EQUAL(messages.size(), 2u);
+    BOOST_CHECK_EQUAL(messages[0], "first");
+    BOOST_CHECK_EQUAL(messages[1], "second");
+    BOOST_CHECK(recording_log->types()[0] == bcsim::ILog::WARNING);
+}
+
+BOOST_AUTO_TEST_CASE(FullRingDropsAndReports) {
+    auto recording_log = std::make_shared<RecordingLog>();
+    // a long interval so that nothing is drained while writing
+    bcsim::AsyncLog log(recording_log, 8, 0, 10000);
+    for (int i = 0; i < 20; i++) {
+        log.write(bcsim::ILog::INFO, "message");
+    }
+    BOOST_CHECK_EQUAL(log.get_num_dropped(), 12u);
+    log.flush();
+    const auto messages = recording_log->messages();
+    BOOST_REQUIRE_EQUAL(messages.size(), 9u);
+    BOOST_CHECK_EQUAL(messages.back(), "12 log messages were dropped");
+
+    // the ring can be reused after draining
+    log.write(bcsim::ILog::INFO, "again");
+    log.flush();
+    BOOST_CHECK_EQUAL(recording_log->messages().back(), "again");
+}
+
+BOOST_AUTO_TEST_CASE(RateLimitDropsExcessMessages) {
+    auto recording_log = std::make_shared<RecordingLog>();
+    bcsim::AsyncLog log(recording_log, 1000, 10);
+    for (int i = 0; i < 100; i++) {
+        log.write(bcsim::ILog::INFO, "message");
+    }
+    log.flush();
+    const auto num_forwarded = recording_log->messages().size() - 1;
+    BOOST_CHECK(num_forwarded >= 10u);
+    BOOST_CHECK(num_forwarded < 20u);
+    BOOST_CHECK_EQUAL(log.get_num_dropped(), 100u - num_forwarded);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidArgumentsThrow) {
+    auto recording_log = std::make_shared<RecordingLog>();
+    BOOST_CHECK_THROW(bcsim::AsyncLog(nullptr), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::AsyncLog(recording_log, 0), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::AsyncLog(recording_log, 8, 0, 0), std::runtime_error);
+}
@@ -0,0 +1,55 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_autotune_cache
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "../algorithm/AutotuneCache.hpp"
+
+using namespace bcsim;
+
+BOOST_AUTO_TEST_CASE(KeysDependOnDeviceAndSizeClass) {
+    const auto key = AutotuneCache::make_key("GeForce GTX 1080", 11020, 100000, 256, 4096);
+    BOOST_CHECK_EQUAL(key, "GeForce_GTX_1080/driver11020/scatterers17/lines9/samples13");
+    // same size class
+    BOOST_CHECK_EQUAL(AutotuneCache::make_key("GeForce GTX 1080", 11020, 120000, 300, 5000), key);
+    BOOST_CHECK(AutotuneCache::make_key("GeForce GTX 1080", 11020, 200000, 256, 4096) != key);
+    BOOST_CHECK(AutotuneCache::make_key("GeForce GTX 1080", 12000, 100000, 256, 4096) != key);
+}
+
+BOOST_AUTO_TEST_CASE(EntriesArePersisted) {
+    const std::string path = "test_autotune_cache.txt";
+    std::remove(path.c_str());
+    {
+        AutotuneCache cache(path);
+        AutotuneEntry entry;
+        BOOST_CHECK(!cache.find("device/a", entry));
+        cache.store("device/a", {256, 128, 4});
+        cache.store("device/b", {64, 512, 1});
+        cache.store("device/a", {512, 128, 2});
+        BOOST_REQUIRE(cache.find("device/a", entry));
+        BOOST_CHECK_EQUAL(entry.threads_per_block, 512);
+    }
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "malformed line\n" << "device/c 0 128 2\n";
+    }
+    AutotuneCache cache(path);
+    AutotuneEntry entry;
+    BOOST_REQUIRE(cache.find("device/a", entry));
+    BOOST_CHECK_EQUAL(entry.threads_per_block, 512);
+    BOOST_CHECK_EQUAL(entry.threads_per_line, 128);
+    BOOST_CHECK_EQUAL(entry.num_cuda_streams, 2);
+    BOOST_REQUIRE(cache.find("device/b", entry));
+    BOOST_CHECK_EQUAL(entry.threads_per_line, 512);
+    BOOST_CHECK(!cache.find("device/c", entry));
+    BOOST_CHECK(!cache.find("malformed", entry));
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(EmptyPathKeepsEntriesInMemory) {
+    AutotuneCache cache("");
+    cache.store("device/a", {128, 128, 2});
+    AutotuneEntry entry;
+    BOOST_CHECK(cache.find("device/a", entry));
+}
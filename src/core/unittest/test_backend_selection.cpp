@@ -0,0 +1,131 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_backend_selection
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "../algorithm/BackendSelection.hpp"
+
+using namespace bcsim;
+
+namespace {
+
+Workload make_workload(size_t num_fixed_scatterers) {
+    Workload workload;
+    workload.num_fixed_scatterers = num_fixed_scatterers;
+    workload.num_lines = 256;
+    workload.num_time_samples = 4096;
+    return workload;
+}
+
+HardwareInfo make_cpu_machine(int num_threads) {
+    HardwareInfo hardware;
+    hardware.num_cpu_threads = num_threads;
+    hardware.simd_width = 8;
+    return hardware;
+}
+
+std::string find_parameter(const BackendChoice& choice, const std::string& key) {
+    for (const auto& parameter : choice.parameters) {
+        if (parameter.first == key) {
+            return parameter.second;
+        }
+    }
+    return "";
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(DetectedHardwareIsPlausible) {
+    const auto hardware = HardwareInfo::detect();
+    BOOST_CHECK_GE(hardware.num_cpu_threads, 1);
+    BOOST_CHECK_GE(hardware.num_numa_nodes, 1);
+    BOOST_CHECK(hardware.simd_width == 1 || hardware.simd_width == 8 || hardware.simd_width == 16);
+}
+
+BOOST_AUTO_TEST_CASE(CpuTimeScalesWithWorkAndThreads) {
+    const CostModel model;
+    const auto small = predict_frame_seconds("cpu", make_workload(1000), make_cpu_machine(4), model);
+    const auto large = predict_frame_seconds("cpu", make_workload(1000000), make_cpu_machine(4), model);
+    const auto large_one_thread = predict_frame_seconds("cpu", make_workload(1000000), make_cpu_machine(1), model);
+    BOOST_CHECK_GT(small, 0.0);
+    BOOST_CHECK_GT(large, small);
+    BOOST_CHECK_GT(large_one_thread, large);
+}
+
+BOOST_AUTO_TEST_CASE(CpuChoiceUsesAllThreads) {
+    auto hardware = make_cpu_machine(12);
+    hardware.num_numa_nodes = 2;
+    const auto choice = select_backend(make_workload(100000), hardware, CostModel());
+    BOOST_CHECK_EQUAL(choice.backend, "cpu");
+    BOOST_CHECK_EQUAL(find_parameter(choice, "num_cpu_cores"), "12");
+    BOOST_CHECK_EQUAL(find_parameter(choice, "cpu_numa"), "auto");
+    BOOST_CHECK_GT(choice.predicted_frame_seconds, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(UnknownBackendIsRejected) {
+    BOOST_CHECK_THROW(select_backend(make_workload(1000), make_cpu_machine(1), CostModel(), "fpga"), std::runtime_error);
+}
+
+#ifdef BCSIM_ENABLE_CUDA
+BOOST_AUTO_TEST_CASE(GpuIsChosenForLargeWorkloadsThatFit) {
+    auto hardware = make_cpu_machine(4);
+    HardwareInfo::Gpu gpu;
+    gpu.name = "test";
+    gpu.total_memory = gpu.free_memory = size_t(8) << 30;
+    gpu.num_multiprocessors = 40;
+    hardware.gpus.push_back(gpu);
+    const CostModel model;
+
+    const auto large = select_backend(make_workload(1000000), hardware, model);
+    BOOST_CHECK(large.backend == "gpu" || large.backend == "hybrid");
+    BOOST_CHECK_EQUAL(find_parameter(large, "gpu_device"), "0");
+
+    // does not fit in the memory of the device
+    hardware.gpus[0].free_memory = 1 << 20;
+    BOOST_CHECK_LT(predict_frame_seconds("gpu", make_workload(1000000), hardware, model), 0.0);
+    BOOST_CHECK_EQUAL(select_backend(make_workload(1000000), hardware, model).backend, "cpu");
+}
+
+BOOST_AUTO_TEST_CASE(MultiGpuNeedsSeveralDevices) {
+    auto hardware = make_cpu_machine(4);
+    HardwareInfo::Gpu gpu;
+    gpu.total_memory = gpu.free_memory = size_t(8) << 30;
+    gpu.num_multiprocessors = 40;
+    hardware.gpus.push_back(gpu);
+    BOOST_CHECK_LT(predict_frame_seconds("multi_gpu", make_workload(1000000), hardware, CostModel()), 0.0);
+    hardware.gpus.push_back(gpu);
+    BOOST_CHECK_GT(predict_frame_seconds("multi_gpu", make_workload(1000000), hardware, CostModel()), 0.0);
+}
+#else
+BOOST_AUTO_TEST_CASE(OnlyCpuWithoutCuda) {
+    auto hardware = make_cpu_machine(4);
+    HardwareInfo::Gpu gpu;
+    gpu.total_memory = gpu.free_memory = size_t(8) << 30;
+    gpu.num_multiprocessors = 40;
+    hardware.gpus.push_back(gpu);
+    BOOST_CHECK_LT(predict_frame_seconds("gpu", make_workload(1000000), hardware, CostModel()), 0.0);
+    BOOST_CHECK_EQUAL(select_backend(make_workload(1000000), hardware, CostModel()).backend, "cpu");
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(CostModelIsPersisted) {
+    const std::string path = "test_backend_selection_model.txt";
+    std::remove(path.c_str());
+    // a missing file gives the defaults
+    BOOST_CHECK_EQUAL(CostModel(path).spline_cost_factor, CostModel().spline_cost_factor);
+
+    CostModel model;
+    model.cpu_projections_per_lane_second = 1.25e7;
+    model.spline_cost_factor = 4.5;
+    model.save(path);
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "unknown_value 3\n" << "garbage\n";
+    }
+    const CostModel loaded(path);
+    BOOST_CHECK_EQUAL(loaded.cpu_projections_per_lane_second, 1.25e7);
+    BOOST_CHECK_EQUAL(loaded.spline_cost_factor, 4.5);
+    BOOST_CHECK_EQUAL(loaded.gpu_memory_fraction, model.gpu_memory_fraction);
+    std::remove(path.c_str());
+}
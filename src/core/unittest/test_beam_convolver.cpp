@@ -0,0 +1,139 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE BeamConvolverTests
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "../BeamConvolver.hpp"
+
+namespace {
+
+// Gaussian-windowed 2.5 MHz pulse sampled at 50 MHz.
+bcsim::ExcitationSignal make_excitation(int half_length) {
+    bcsim::ExcitationSignal ex;
+    ex.sampling_frequency = 50e6f;
+    ex.demod_freq = 2.5e6f;
+    ex.center_index = half_length;
+    const float PI = 3.14159265358979f;
+    for (int i = -half_length; i <= half_length; i++) {
+        const float t = i/ex.sampling_frequency;
+        const float sigma = 0.35f*half_length/ex.sampling_frequency;
+        ex.samples.push_back(std::exp(-0.5f*t*t/(sigma*sigma))*std::cos(2.0f*PI*ex.demod_freq*t));
+    }
+    return ex;
+}
+
+std::vector<std::complex<float>> convolve(const std::string& method, const bcsim::ExcitationSignal& ex,
+                                          const std::vector<std::complex<float>>& time_proj,
+                                          bool real_input, int radial_decimation, size_t sparse_threshold = 0) {
+    auto convolver = bcsim::IBeamConvolver::Create(time_proj.size(), ex, "builtin", real_input,
+                                                   radial_decimation, method);
+    convolver->set_sparse_threshold(sparse_threshold);
+    auto buffer = convolver->get_zeroed_time_proj_signal();
+    std::copy(time_proj.begin(), time_proj.end(), buffer);
+    std::vector<std::complex<float>> out(convolver->get_num_output_samples());
+    convolver->process(out.data());
+    return out;
+}
+
+}   // namespace
+
+// The direct convolver must agree with the FFT-based one to within the
+// truncation of the analytic excitation, for sparse signals as written by
+// the projection loops, also at the ends of the line.
+BOOST_AUTO_TEST_CASE(test_direct_matches_fft) {
+    const auto ex = make_excitation(40);
+    const size_t num_samples = 3000;
+    for (bool real_input : {false, true}) {
+        std::vector<std::complex<float>> time_proj(num_samples);
+        for (size_t i = 0; i < num_samples; i += 97) {
+            time_proj[i] = std::complex<float>(1.0f + 0.001f*i, real_input ? 0.0f : 0.5f);
+        }
+        time_proj[num_samples - 1] = std::complex<float>(2.0f, 0.0f);
+        for (int radial_decimation : {1, 3}) {
+            const auto fft_out = convolve("fft", ex, time_proj, real_input, radial_decimation);
+            const auto direct_out = convolve("direct", ex, time_proj, real_input, radial_decimation);
+            BOOST_REQUIRE_EQUAL(fft_out.size(), direct_out.size());
+            float max_magnitude = 0.0f;
+            float max_error = 0.0f;
+            for (size_t i = 0; i < fft_out.size(); i++) {
+                max_magnitude = std::max(max_magnitude, std::abs(fft_out[i]));
+                max_error = std::max(max_error, std::abs(fft_out[i] - direct_out[i]));
+            }
+            BOOST_CHECK_GT(max_magnitude, 0.1f);
+            BOOST_CHECK_LT(max_error, 1e-3f*max_magnitude);
+        }
+    }
+}
+
+// Lines with few non-zero samples synthesised from shifted copies of the
+// excitation must agree with the FFT, as must lines over the threshold.
+BOOST_AUTO_TEST_CASE(test_sparse_matches_fft) {
+    const auto ex = make_excitation(40);
+    const size_t num_samples = 3000;
+    for (bool real_input : {false, true}) {
+        std::vector<std::complex<float>> time_proj(num_samples);
+        time_proj[0] = std::complex<float>(1.5f, real_input ? 0.0f : -0.5f);
+        time_proj[17] = std::complex<float>(-1.0f, 0.0f);
+        time_proj[1500] = std::complex<float>(0.7f, real_input ? 0.0f : 0.2f);
+        time_proj[num_samples - 3] = std::complex<float>(2.0f, 0.0f);
+        for (int radial_decimation : {1, 3}) {
+            const auto fft_out = convolve("fft", ex, time_proj, real_input, radial_decimation);
+            for (size_t threshold : {4, 3}) {
+                for (const std::string method : {"fft", "direct"}) {
+                    const auto sparse_out = convolve(method, ex, time_proj, real_input, radial_decimation, threshold);
+                    BOOST_REQUIRE_EQUAL(fft_out.size(), sparse_out.size());
+                    float max_magnitude = 0.0f;
+                    float max_error = 0.0f;
+                    for (size_t i = 0; i < fft_out.size(); i++) {
+                        max_magnitude = std::max(max_magnitude, std::abs(fft_out[i]));
+                        max_error = std::max(max_error, std::abs(fft_out[i] - sparse_out[i]));
+                    }
+                    BOOST_CHECK_GT(max_magnitude, 0.1f);
+                    BOOST_CHECK_LT(max_error, 1e-3f*max_magnitude);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_convolution_method_selection) {
+    const auto ex = make_excitation(20);
+    const auto method = bcsim::IBeamConvolver::select_convolution_method(8192, ex, true, 4);
+    BOOST_CHECK(method == "fft" || method == "direct");
+    auto convolver = bcsim::IBeamConvolver::Create(8192, ex, "builtin", true, 4, "auto");
+    BOOST_CHECK_EQUAL(convolver->get_num_output_samples(), 2048u);
+    BOOST_CHECK_THROW(bcsim::IBeamConvolver::Create(8192, ex, "builtin", true, 4, "winograd"), std::runtime_error);
+}
+
+// A baseband convolver must give the same output as the direct RF convolver
+// for time-projections which are only non-zero on the decimated grid.
+BOOST_AUTO_TEST_CASE(test_baseband_matches_rf_on_grid) {
+    const auto ex = make_excitation(40);
+    const size_t num_samples = 3001;
+    for (int radial_decimation : {1, 2, 5}) {
+        auto baseband = bcsim::IBeamConvolver::CreateBaseband(num_samples, ex, radial_decimation);
+        const auto num_grid_samples = baseband->get_num_output_samples();
+        BOOST_REQUIRE_EQUAL(num_grid_samples, (num_samples + radial_decimation - 1)/radial_decimation);
+
+        std::vector<std::complex<float>> time_proj(num_samples);
+        auto grid = baseband->get_zeroed_time_proj_signal();
+        for (size_t k = 0; k < num_grid_samples; k += 29) {
+            const auto value = std::complex<float>(1.0f + 0.01f*k, -0.5f);
+            time_proj[k*radial_decimation] = value;
+            grid[k] = value;
+        }
+        grid[num_grid_samples - 1] = time_proj[(num_grid_samples - 1)*radial_decimation] = 2.0f;
+
+        const auto rf_out = convolve("direct", ex, time_proj, false, radial_decimation);
+        std::vector<std::complex<float>> baseband_out(num_grid_samples);
+        baseband->process(baseband_out.data());
+        BOOST_REQUIRE_EQUAL(rf_out.size(), baseband_out.size());
+        float max_error = 0.0f;
+        for (size_t i = 0; i < rf_out.size(); i++) {
+            max_error = std::max(max_error, std::abs(rf_out[i] - baseband_out[i]));
+        }
+        BOOST_CHECK_LT(max_error, 1e-4f);
+    }
+}
@@ -0,0 +1,104 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE BModeImageTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "../bmode_image.hpp"
+
+namespace {
+
+const size_t num_lines   = 5;
+const size_t num_samples = 9;
+
+// IQ lines with the given stride and a linear geometry where pixel (xi, yi)
+// is exactly at line xi and sample yi.
+std::vector<std::complex<float>> make_iq_lines(size_t line_stride) {
+    std::vector<std::complex<float>> iq_lines(num_lines*line_stride, std::complex<float>(-1.0f, -1.0f));
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+            iq_lines[line_no*line_stride + sample_no] = std::polar(0.01f + 0.1f*line_no + 0.01f*sample_no, 0.3f*sample_no);
+        }
+    }
+    return iq_lines;
+}
+
+bcsim::BModeImageConfig make_config() {
+    bcsim::BModeImageConfig config;
+    config.sector    = false;
+    config.beam_min  = -1.0f;
+    config.beam_max  = 1.0f;
+    config.range_max = 2.0f;
+    config.x_min     = -1.0f;
+    config.x_max     = 1.0f;
+    config.y_min     = 0.0f;
+    config.y_max     = 2.0f;
+    config.width     = static_cast<int>(num_lines);
+    config.height    = static_cast<int>(num_samples);
+    config.dyn_range = 40.0f;
+    config.gain      = 1.0f;
+    return config;
+}
+
+}
+
+// Pixels on the beam space samples get their gray levels.
+BOOST_AUTO_TEST_CASE(PixelsOnSamplesAreExact) {
+    const size_t line_stride = num_samples + 3;
+    const auto iq_lines = make_iq_lines(line_stride);
+    auto config = make_config();
+    config.auto_normalize = false;
+    config.normalize_const = 0.3f;
+    std::vector<unsigned char> image(num_lines*num_samples);
+    const auto normalize_const = bcsim::make_bmode_image(config, iq_lines.data(), num_lines, num_samples, line_stride, image.data());
+    BOOST_CHECK_EQUAL(normalize_const, 0.3f);
+    for (size_t yi = 0; yi < num_samples; yi++) {
+        for (size_t xi = 0; xi < num_lines; xi++) {
+            const auto envelope = std::abs(iq_lines[xi*line_stride + yi]);
+            const auto expected = static_cast<unsigned char>(bcsim::bmode_gray_level(envelope, 0.3f, 40.0f, 1.0f));
+            BOOST_CHECK_EQUAL(image[yi*num_lines + xi], expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AutoNormalizeUsesMaximum) {
+    const auto iq_lines = make_iq_lines(num_samples);
+    std::vector<unsigned char> image(num_lines*num_samples);
+    const auto normalize_const = bcsim::make_bmode_image(make_config(), iq_lines.data(), num_lines, num_samples, num_samples, image.data());
+    BOOST_CHECK_CLOSE(normalize_const, 0.01f + 0.1f*(num_lines-1) + 0.01f*(num_samples-1), 1e-4);
+    // the maximum is at the last sample of the last line
+    BOOST_CHECK_EQUAL(image.back(), 255);
+}
+
+// Pixels between samples are interpolated, and zero outside the beam space.
+BOOST_AUTO_TEST_CASE(InterpolationAndBorder) {
+    const auto iq_lines = make_iq_lines(num_samples);
+    auto config = make_config();
+    config.x_min = -2.0f;
+    config.x_max = 2.0f;
+    config.width = 17;
+    std::vector<unsigned char> exact(num_lines*num_samples);
+    std::vector<unsigned char> image(config.width*num_samples);
+    bcsim::make_bmode_image(make_config(), iq_lines.data(), num_lines, num_samples, num_samples, exact.data());
+    bcsim::make_bmode_image(config, iq_lines.data(), num_lines, num_samples, num_samples, image.data());
+    for (size_t yi = 0; yi < num_samples; yi++) {
+        BOOST_CHECK_EQUAL(image[yi*config.width], 0);
+        BOOST_CHECK_EQUAL(image[yi*config.width + 16], 0);
+        // pixel 7 is at line 1.5
+        const auto mean = 0.5f*(exact[yi*num_lines + 1] + exact[yi*num_lines + 2]);
+        BOOST_CHECK(std::abs(image[yi*config.width + 7] - mean) <= 1.0f);
+    }
+}
+
+// A pixel straight down in a sector is on the middle line.
+BOOST_AUTO_TEST_CASE(SectorCenterLine) {
+    const auto iq_lines = make_iq_lines(num_samples);
+    auto config = make_config();
+    config.sector = true;
+    config.beam_min = 1.0f;
+    config.beam_max = 2.14159265f;
+    float sample_pos, line_pos;
+    bcsim::bmode_pixel_position(config, num_lines, num_samples, 2, 4, sample_pos, line_pos);
+    BOOST_CHECK_CLOSE(sample_pos, 4.0f, 1e-3);
+    BOOST_CHECK_CLOSE(line_pos, 2.0f, 1e-3);
+}
@@ -0,0 +1,67 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE BSplineTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <vector>
+#include "../bspline.hpp"
+
+// The iterative evaluation must agree with the recursive definition.
+BOOST_AUTO_TEST_CASE(NonzeroBasisMatchesRecursive) {
+    for (int p : {0, 1, 2, 3, 5}) {
+        const int num_cs = 12;
+        const auto knots = bspline_storve::uniform_regular_knot_vector(num_cs, p, 0.0, 1.0);
+        for (double x = 0.0; x < 1.0; x += 0.0173) {
+            const auto res = bspline_storve::all_basis_functions(num_cs, p, x, knots);
+            BOOST_REQUIRE_EQUAL(res.size(), static_cast<size_t>(num_cs));
+            double sum = 0.0;
+            for (int i = 0; i < num_cs; i++) {
+                BOOST_CHECK_SMALL(res[i] - bspline_storve::bsplineBasis(i, p, x, knots), 1e-12);
+                sum += res[i];
+            }
+            // partition of unity
+            BOOST_CHECK_SMALL(sum - 1.0, 1e-12);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(NonzeroBasisOutsideKnotsThrows) {
+    const auto knots = bspline_storve::uniform_regular_knot_vector(6, 2, 0.0, 1.0);
+    BOOST_CHECK_THROW(bspline_storve::all_basis_functions(6, 2, 1.5, knots), std::runtime_error);
+}
+
+// Splines restricted to the control point range must equal the full
+// splines inside the time interval.
+BOOST_AUTO_TEST_CASE(ControlPointRangeGivesEqualSplines) {
+    for (int p : {1, 2, 3}) {
+        const int num_cs = 20;
+        const auto knots = bspline_storve::uniform_regular_knot_vector(num_cs, p, 0.0, 2.0);
+        std::vector<double> cs(num_cs);
+        for (int i = 0; i < num_cs; i++) {
+            cs[i] = std::sin(0.7*i);
+        }
+        for (double t0 : {0.0, 0.3, 1.1}) {
+            const double t1 = t0 + 0.5;
+            const auto range = bspline_storve::control_point_range(knots, p, num_cs, t0, t1);
+            const int num_window_cs = range.second - range.first + 1;
+            BOOST_CHECK(num_window_cs < num_cs);
+            const std::vector<double> window_knots(knots.begin() + range.first, knots.begin() + range.second + p + 2);
+            BOOST_REQUIRE_EQUAL(static_cast<int>(window_knots.size()), num_window_cs + p + 1);
+            BOOST_CHECK(window_knots[p] <= t0);
+            BOOST_CHECK(window_knots[num_window_cs] > t1);
+            for (double t = t0; t <= t1; t += 0.01) {
+                const auto full   = bspline_storve::all_basis_functions(num_cs, p, t, knots);
+                const auto window = bspline_storve::all_basis_functions(num_window_cs, p, t, window_knots);
+                double full_sum = 0.0;
+                double window_sum = 0.0;
+                for (int i = 0; i < num_cs; i++) full_sum += full[i]*cs[i];
+                for (int i = 0; i < num_window_cs; i++) window_sum += window[i]*cs[range.first + i];
+                BOOST_CHECK_SMALL(full_sum - window_sum, 1e-12);
+            }
+        }
+        // clamped to the end of the splines
+        const auto range = bspline_storve::control_point_range(knots, p, num_cs, 1.5, 5.0);
+        BOOST_CHECK_EQUAL(range.second, num_cs - 1);
+        BOOST_CHECK_THROW(bspline_storve::control_point_range(knots, p, num_cs, 2.5, 3.0), std::runtime_error);
+        BOOST_CHECK_THROW(bspline_storve::control_point_range(knots, p, num_cs, 1.0, 0.5), std::runtime_error);
+    }
+}
@@ -0,0 +1,70 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_compact_scatterers
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../algorithm/CompactScatterers.hpp"
+
+using namespace bcsim;
+
+BOOST_AUTO_TEST_CASE(EncodingCoversBoundingBox) {
+    const std::vector<float> xs = {-0.02f, 0.01f, 0.03f};
+    const std::vector<float> ys = {0.0f, 0.0f, 0.0f};
+    const std::vector<float> zs = {0.01f, 0.08f, 0.05f};
+    const std::vector<float> as = {0.5f, -2.0f, 1.0f};
+    const auto encoding = make_compact_scatterer_encoding(xs.data(), ys.data(), zs.data(), as.data(), xs.size());
+    BOOST_CHECK_EQUAL(encoding.origin[0], -0.02f);
+    BOOST_CHECK_EQUAL(encoding.origin[2], 0.01f);
+    BOOST_CHECK_CLOSE(encoding.scale[0], 0.05f/65535.0f, 1e-3f);
+    BOOST_CHECK_EQUAL(encoding.scale[1], 0.0f);
+    BOOST_CHECK_EQUAL(encoding.amplitude_scale, 2.0f);
+
+    BOOST_CHECK(compact_encoding_contains(encoding, 0.0f, 0.0f, 0.05f));
+    BOOST_CHECK(compact_encoding_contains(encoding, 0.03f, 0.0f, 0.08f));
+    BOOST_CHECK(!compact_encoding_contains(encoding, 0.031f, 0.0f, 0.05f));
+    BOOST_CHECK(!compact_encoding_contains(encoding, 0.0f, 1e-3f, 0.05f));
+    BOOST_CHECK(!compact_encoding_contains(encoding, 0.0f, 0.0f, std::nanf("")));
+
+    std::vector<uint16_t> codes(4*xs.size());
+    encode_compact_scatterers(encoding, xs.data(), ys.data(), zs.data(), as.data(), xs.size(), codes.data());
+    BOOST_CHECK_EQUAL(codes[0], 0);
+    BOOST_CHECK_EQUAL(codes[4*2], 65535);
+    BOOST_CHECK_EQUAL(codes[4*1 + 2], 65535);
+}
+
+BOOST_AUTO_TEST_CASE(DecodedScatterersAreWithinErrorBound) {
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> pos_dist(-0.03f, 0.03f);
+    std::normal_distribution<float> amplitude_dist(0.0f, 1.0f);
+    const size_t num_scatterers = 10000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers), as(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = pos_dist(gen);
+        ys[i] = 0.5f*pos_dist(gen);
+        zs[i] = 0.05f + pos_dist(gen);
+        as[i] = amplitude_dist(gen);
+    }
+    const auto encoding = make_compact_scatterer_encoding(xs.data(), ys.data(), zs.data(), as.data(), num_scatterers);
+    std::vector<uint16_t> codes(4*num_scatterers);
+    encode_compact_scatterers(encoding, xs.data(), ys.data(), zs.data(), as.data(), num_scatterers, codes.data());
+
+    std::vector<float> decoded_xs(num_scatterers), decoded_ys(num_scatterers), decoded_zs(num_scatterers), decoded_as(num_scatterers);
+    decode_compact_scatterers(encoding, codes.data(), num_scatterers,
+                              decoded_xs.data(), decoded_ys.data(), decoded_zs.data(), decoded_as.data());
+    // half a code step, and the float rounding error of the decoding
+    const float tolerance = 1e-8f;
+    for (size_t i = 0; i < num_scatterers; i++) {
+        BOOST_REQUIRE_SMALL(decoded_xs[i] - xs[i], 0.5f*encoding.scale[0] + tolerance);
+        BOOST_REQUIRE_SMALL(decoded_ys[i] - ys[i], 0.5f*encoding.scale[1] + tolerance);
+        BOOST_REQUIRE_SMALL(decoded_zs[i] - zs[i], 0.5f*encoding.scale[2] + tolerance);
+        BOOST_REQUIRE_SMALL(decoded_as[i] - as[i], std::ldexp(encoding.amplitude_scale, -11));
+    }
+
+    const auto error = compute_compact_scatterer_error(encoding, codes.data(), xs.data(), ys.data(), zs.data(), as.data(),
+                                                       num_scatterers);
+    BOOST_CHECK_GT(error.max_position_error, 0.0f);
+    BOOST_CHECK_LT(error.max_position_error, std::sqrt(3.0f)*(0.5f*encoding.scale[0] + tolerance));
+    BOOST_CHECK_GT(error.max_amplitude_error, 0.0f);
+    BOOST_CHECK_LE(error.max_amplitude_error, std::ldexp(1.0f, -11));
+}
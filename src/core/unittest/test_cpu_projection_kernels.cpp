@@ -0,0 +1,193 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_cpu_projection_kernels
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+#include "../algorithm/cpu_projection_kernels.hpp"
+
+using namespace bcsim;
+
+// Straightforward reference implementation of the beam coordinate mapping.
+void reference_beam_coordinates(const Scanline& line, bool use_arc_projection,
+                                const std::vector<float>& xs, const std::vector<float>& ys, const std::vector<float>& zs,
+                                std::vector<float>& rs, std::vector<float>& ls, std::vector<float>& es) {
+    for (size_t i = 0; i < xs.size(); i++) {
+        const auto temp = vector3(xs[i], ys[i], zs[i]) - line.get_origin();
+        rs[i] = temp.dot(line.get_direction());
+        ls[i] = temp.dot(line.get_lateral_dir());
+        es[i] = temp.dot(line.get_elevational_dir());
+        if (use_arc_projection) {
+            rs[i] = std::copysign(temp.norm(), rs[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BeamCoordinatesMatchReference) {
+    const float angle = 0.3f;
+    const Scanline line(vector3(0.001f, -0.002f, 0.0f),
+                        vector3(std::sin(angle), 0.0f, std::cos(angle)),
+                        vector3(std::cos(angle), 0.0f, -std::sin(angle)),
+                        0.0f);
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.1f);
+
+    // odd number of scatterers to exercise the scalar tail of the SIMD loops.
+    const int num_scatterers = 1000 + 13;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (int i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen);
+        ys[i] = dist(gen);
+        zs[i] = dist(gen);
+    }
+
+    for (bool use_arc_projection : {false, true}) {
+        std::vector<float> rs(num_scatterers), ls(num_scatterers), es(num_scatterers);
+        std::vector<float> ref_rs(num_scatterers), ref_ls(num_scatterers), ref_es(num_scatterers);
+        compute_beam_coordinates(line, use_arc_projection, xs.data(), ys.data(), zs.data(), num_scatterers,
+                                 rs.data(), ls.data(), es.data());
+        reference_beam_coordinates(line, use_arc_projection, xs, ys, zs, ref_rs, ref_ls, ref_es);
+
+        for (int i = 0; i < num_scatterers; i++) {
+            BOOST_REQUIRE_SMALL(rs[i] - ref_rs[i], 1e-6f);
+            BOOST_REQUIRE_SMALL(ls[i] - ref_ls[i], 1e-6f);
+            BOOST_REQUIRE_SMALL(es[i] - ref_es[i], 1e-6f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(GaussianWeightsMatchExpWithinCutoff) {
+    std::mt19937 gen(4321);
+    std::uniform_real_distribution<float> dist(-0.01f, 0.01f);
+    const int num_scatterers = 1000 + 13;
+    std::vector<float> ls(num_scatterers), es(num_scatterers), weights(num_scatterers);
+    for (int i = 0; i < num_scatterers; i++) {
+        ls[i] = dist(gen);
+        es[i] = dist(gen);
+    }
+    const float sigma_lateral = 1e-3f;
+    const float sigma_elevational = 2e-3f;
+    const float lateral_factor = 1.0f/(2.0f*sigma_lateral*sigma_lateral);
+    const float elevational_factor = 1.0f/(2.0f*sigma_elevational*sigma_elevational);
+    const float max_exponent = 18.0f;
+    compute_gaussian_weights(ls.data(), es.data(), num_scatterers, lateral_factor, elevational_factor, max_exponent,
+                             weights.data());
+
+    int num_rejected = 0;
+    for (int i = 0; i < num_scatterers; i++) {
+        const float q = lateral_factor*ls[i]*ls[i] + elevational_factor*es[i]*es[i];
+        if (q <= max_exponent) {
+            BOOST_REQUIRE_CLOSE(weights[i], std::exp(-q), 1e-3f);
+        } else {
+            BOOST_REQUIRE_EQUAL(weights[i], 0.0f);
+            num_rejected++;
+        }
+    }
+    BOOST_CHECK_GT(num_rejected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(LUTWeightsMatchSampledProfile) {
+    const int num_rad = 5;
+    const int num_lat = 7;
+    const int num_ele = 6;
+    std::mt19937 gen(5678);
+    std::uniform_real_distribution<float> sample_dist(0.5f, 1.0f);
+    LUTBeamProfile profile(num_rad, num_lat, num_ele, Interval(0.0f, 0.04f),
+                           Interval(-4e-3f, 4e-3f), Interval(-6e-3f, 6e-3f));
+    for (int ir = 0; ir < num_rad; ir++) {
+        for (int il = 0; il < num_lat; il++) {
+            for (int ie = 0; ie < num_ele; ie++) {
+                profile.setDiscreteSample(ir, il, ie, sample_dist(gen));
+            }
+        }
+    }
+
+    // positions inside, on the border of and outside of the data region
+    std::uniform_real_distribution<float> rad_dist(-0.02f, 0.06f);
+    std::uniform_real_distribution<float> lat_dist(-6e-3f, 6e-3f);
+    std::uniform_real_distribution<float> ele_dist(-9e-3f, 9e-3f);
+    const int num_scatterers = 1000 + 13;
+    std::vector<float> rs(num_scatterers), ls(num_scatterers), es(num_scatterers), weights(num_scatterers);
+    for (int i = 0; i < num_scatterers; i++) {
+        rs[i] = rad_dist(gen);
+        ls[i] = lat_dist(gen);
+        es[i] = ele_dist(gen);
+    }
+    rs[0] = std::nanf("");
+    rs[1] = 1e30f;
+    ls[2] = -1e30f;
+    compute_lut_weights(profile.getPaddedLayout(), rs.data(), ls.data(), es.data(), num_scatterers, weights.data());
+
+    int num_outside = 0;
+    for (int i = 0; i < num_scatterers; i++) {
+        BOOST_REQUIRE_SMALL(weights[i] - profile.sample(rs[i], ls[i], es[i]), 1e-6f);
+        if (weights[i] == 0.0f) {
+            num_outside++;
+        }
+    }
+    BOOST_CHECK_GT(num_outside, 3);
+    BOOST_CHECK_EQUAL(weights[0], 0.0f);
+    BOOST_CHECK_EQUAL(weights[1], 0.0f);
+    BOOST_CHECK_EQUAL(weights[2], 0.0f);
+}
+
+BOOST_AUTO_TEST_CASE(LUTWeightsInterpolateSamples) {
+    // the profile is linear in all directions, which trilinear interpolation reproduces
+    const int num_rad = 4;
+    const int num_lat = 3;
+    const int num_ele = 5;
+    LUTBeamProfile profile(num_rad, num_lat, num_ele, Interval(0.0f, 3.0f),
+                           Interval(-1.0f, 1.0f), Interval(0.0f, 4.0f));
+    for (int ir = 0; ir < num_rad; ir++) {
+        for (int il = 0; il < num_lat; il++) {
+            for (int ie = 0; ie < num_ele; ie++) {
+                profile.setDiscreteSample(ir, il, ie, 1.0f + ir + 2.0f*il + 3.0f*ie);
+            }
+        }
+    }
+    const std::vector<float> rs = {0.0f, 3.0f, 1.25f, 2.5f, 0.5f,  -2.0f, 1.0f, 1.0f};
+    const std::vector<float> ls = {-1.0f, 1.0f, 0.1f, -0.5f, 0.75f, 0.0f, 3.0f, 0.0f};
+    const std::vector<float> es = {0.0f, 4.0f, 3.5f, 0.25f, 1.0f,  1.0f, 1.0f, -1.5f};
+    std::vector<float> weights(rs.size());
+    compute_lut_weights(profile.getPaddedLayout(), rs.data(), ls.data(), es.data(),
+                        static_cast<int>(rs.size()), weights.data());
+    for (size_t i = 0; i < 5; i++) {
+        BOOST_CHECK_CLOSE(weights[i], 1.0f + rs[i] + 2.0f*(ls[i] + 1.0f) + 3.0f*es[i], 1e-4f);
+    }
+    for (size_t i = 5; i < rs.size(); i++) {
+        BOOST_CHECK_EQUAL(weights[i], 0.0f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiResolutionProfileSelectsZoneByDepth) {
+    // a fine near-field zone followed by a coarse far-field zone
+    LUTBeamProfile near_zone(8, 3, 3, Interval(0.0f, 0.02f), Interval(-1e-3f, 1e-3f), Interval(-1e-3f, 1e-3f));
+    LUTBeamProfile far_zone(4, 3, 3, Interval(0.03f, 0.08f), Interval(-4e-3f, 4e-3f), Interval(-4e-3f, 4e-3f));
+    for (int il = 0; il < 3; il++) {
+        for (int ie = 0; ie < 3; ie++) {
+            for (int ir = 0; ir < 8; ir++) near_zone.setDiscreteSample(ir, il, ie, 1.0f);
+            for (int ir = 0; ir < 4; ir++) far_zone.setDiscreteSample(ir, il, ie, 0.5f);
+        }
+    }
+    MultiResolutionLUTBeamProfile profile({near_zone, far_zone});
+    BOOST_REQUIRE_EQUAL(profile.getNumZones(), 2);
+    BOOST_REQUIRE_EQUAL(profile.getZoneBoundaries().size(), 1u);
+    BOOST_CHECK_CLOSE(profile.getZoneBoundaries()[0], 0.025f, 1e-4f);
+
+    BOOST_CHECK_EQUAL(profile.getZoneIndex(0.01f), 0);
+    BOOST_CHECK_EQUAL(profile.getZoneIndex(0.05f), 1);
+    BOOST_CHECK_EQUAL(profile.sample(0.01f, 0.0f, 0.0f), near_zone.sample(0.01f, 0.0f, 0.0f));
+    BOOST_CHECK_EQUAL(profile.sample(0.05f, 2e-3f, 0.0f), far_zone.sample(0.05f, 2e-3f, 0.0f));
+    // laterally outside of the near zone, but inside of the far zone
+    BOOST_CHECK_EQUAL(profile.sample(0.01f, 3e-3f, 0.0f), 0.0f);
+
+    // zones must not overlap
+    BOOST_CHECK_THROW(MultiResolutionLUTBeamProfile({far_zone, near_zone}), std::runtime_error);
+    BOOST_CHECK_THROW(MultiResolutionLUTBeamProfile(std::vector<LUTBeamProfile>()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(KernelIsaIsReported) {
+    const std::string isa(get_projection_kernel_isa());
+    BOOST_CHECK(isa == "scalar" || isa == "avx2" || isa == "avx512");
+}
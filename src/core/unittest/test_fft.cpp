@@ -2,6 +2,7 @@
 #define BOOST_TEST_MODULE test_fft
 #include <boost/test/unit_test.hpp>
 #include <complex>
+#include <cmath>
 #include <stdexcept> 
 #include <vector>
 #include <iostream>
@@ -88,3 +89,96 @@ BOOST_AUTO_TEST_CASE(TestNextPowerOfTwo) {
     BOOST_CHECK_EQUAL(next_power_of_two(65535), 65536);
     BOOST_CHECK_EQUAL(next_power_of_two(65536), 65536);
 }
+
+// Direct O(n^2) evaluation of the DFT as reference.
+std::vector<std::complex<double> > naive_dft(const std::vector<std::complex<double> >& x) {
+    const auto n = x.size();
+    const double PI = 4.0*std::atan(1.0);
+    std::vector<std::complex<double> > res(n);
+    for (size_t k = 0; k < n; k++) {
+        for (size_t i = 0; i < n; i++) {
+            res[k] += x[i]*std::exp(std::complex<double>(0.0, -2.0*PI*k*i/n));
+        }
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(FftPlanMatchesNaiveDft) {
+    for (size_t n : {1, 2, 3, 4, 5, 6, 8, 9, 12, 15, 20, 25, 30, 45, 64, 120, 256, 360}) {
+        std::vector<std::complex<double> > x(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = std::complex<double>(std::sin(0.3*i) + 0.1*i, std::cos(1.7*i));
+        }
+        const auto desired = naive_dft(x);
+
+        auto y = x;
+        FftPlan<double>::get(n)->forward(y.data());
+        for (size_t i = 0; i < n; i++) {
+            BOOST_CHECK_SMALL(std::abs(y[i] - desired[i]), 1e-9);
+        }
+
+        // inverse transform should restore the input
+        FftPlan<double>::get(n)->inverse(y.data());
+        for (size_t i = 0; i < n; i++) {
+            BOOST_CHECK_SMALL(std::abs(y[i] - x[i]), 1e-12);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(FftPlanIsCached) {
+    const auto plan1 = FftPlan<float>::get(1024);
+    const auto plan2 = FftPlan<float>::get(1024);
+    BOOST_CHECK(plan1 == plan2);
+    BOOST_CHECK_EQUAL(plan1->size(), 1024);
+    BOOST_CHECK(FftPlan<float>::get(2048) != plan1);
+}
+
+BOOST_AUTO_TEST_CASE(FftPlanRequiresSmoothLength) {
+    BOOST_CHECK_THROW(FftPlan<float>(0), std::runtime_error);
+    BOOST_CHECK_THROW(FftPlan<float>(7), std::runtime_error);
+    BOOST_CHECK_THROW(FftPlan<float>(1001), std::runtime_error);
+    BOOST_CHECK_NO_THROW(FftPlan<float>(3000));
+}
+
+BOOST_AUTO_TEST_CASE(TestNextSmoothSize) {
+    BOOST_CHECK_EQUAL(next_smooth_size(1), 1);
+    BOOST_CHECK_EQUAL(next_smooth_size(7), 8);
+    BOOST_CHECK_EQUAL(next_smooth_size(11), 12);
+    BOOST_CHECK_EQUAL(next_smooth_size(13), 15);
+    BOOST_CHECK_EQUAL(next_smooth_size(8193), 8640);
+    BOOST_CHECK_EQUAL(next_smooth_size(65536), 65536);
+    // multiples
+    BOOST_CHECK_EQUAL(next_smooth_size(13, 2), 16);
+    BOOST_CHECK_EQUAL(next_smooth_size(8193, 128), 9216);
+    BOOST_CHECK_EQUAL(next_smooth_size(0, 2), 2);
+    for (size_t n = 1; n < 2000; n++) {
+        const auto size = next_smooth_size(n);
+        BOOST_CHECK_GE(size, n);
+        BOOST_CHECK_LE(size, next_power_of_two(n));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RealFftPlanMatchesNaiveDft) {
+    for (size_t n : {2, 4, 6, 8, 10, 16, 18, 30, 256, 360}) {
+        std::vector<double> x(n);
+        std::vector<std::complex<double> > x_complex(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = std::sin(0.3*i) + 0.1*i;
+            x_complex[i] = x[i];
+        }
+        const auto desired = naive_dft(x_complex);
+
+        // real samples packed into n/2 complex values, room for n/2+1 bins
+        std::vector<std::complex<double> > y(n/2 + 1);
+        for (size_t i = 0; i < n/2; i++) {
+            y[i] = std::complex<double>(x[2*i], x[2*i+1]);
+        }
+        RealFftPlan<double>::get(n)->forward(y.data());
+        for (size_t k = 0; k <= n/2; k++) {
+            BOOST_CHECK_SMALL(std::abs(y[k] - desired[k]), 1e-9);
+        }
+    }
+    BOOST_CHECK_THROW(RealFftPlan<float>(1), std::runtime_error);
+    BOOST_CHECK_THROW(RealFftPlan<float>(15), std::runtime_error);
+    BOOST_CHECK_THROW(RealFftPlan<float>(14), std::runtime_error);
+}
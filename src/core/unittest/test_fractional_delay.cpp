@@ -0,0 +1,56 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE FractionalDelayTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <stdexcept>
+#include "../fractional_delay.hpp"
+
+BOOST_AUTO_TEST_CASE(test_taps_have_unit_sum) {
+    for (int num_taps : {2, 4, 8}) {
+        const bcsim::FractionalDelayTable table(num_taps);
+        BOOST_CHECK_EQUAL(table.get_first_offset(), 1 - num_taps/2);
+        for (float frac : {0.0f, 0.1f, 0.5f, 0.77f, 1.0f}) {
+            const auto taps = table.get_taps(frac);
+            double sum = 0.0;
+            for (int k = 0; k < num_taps; k++) {
+                sum += taps[k];
+            }
+            BOOST_CHECK_CLOSE(sum, 1.0, 1e-4);
+        }
+    }
+}
+
+// Integer positions are not spread.
+BOOST_AUTO_TEST_CASE(test_integer_position_is_impulse) {
+    const bcsim::FractionalDelayTable table(6);
+    for (float frac : {0.0f, 1.0f}) {
+        const auto taps = table.get_taps(frac);
+        for (int k = 0; k < 6; k++) {
+            const int offset = table.get_first_offset() + k;
+            const float expected = (offset == static_cast<int>(frac)) ? 1.0f : 0.0f;
+            BOOST_CHECK_SMALL(taps[k] - expected, 1e-6f);
+        }
+    }
+}
+
+// The taps interpolate a sampled sinusoid well below the Nyquist frequency
+// at fractional positions.
+BOOST_AUTO_TEST_CASE(test_interpolates_sinusoid) {
+    const bcsim::FractionalDelayTable table(8);
+    const double w = 2.0*3.14159265358979*0.15;
+    for (double position = 20.0; position < 21.0; position += 0.0625) {
+        const auto base_index = static_cast<int>(std::floor(position));
+        const auto taps = table.get_taps(static_cast<float>(position - base_index));
+        double value = 0.0;
+        for (int k = 0; k < table.get_num_taps(); k++) {
+            value += taps[k]*std::cos(w*(base_index + table.get_first_offset() + k));
+        }
+        BOOST_CHECK_SMALL(value - std::cos(w*position), 1e-2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_number_of_taps) {
+    BOOST_CHECK_THROW(bcsim::FractionalDelayTable(0), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::FractionalDelayTable(5), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::FractionalDelayTable(4, 0), std::runtime_error);
+}
@@ -0,0 +1,143 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_frame_cache
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "../algorithm/FrameCache.hpp"
+#include "../content_hash.hpp"
+
+using namespace bcsim;
+
+namespace {
+
+const size_t num_lines   = 3;
+const size_t num_samples = 5;
+const size_t frame_bytes = num_lines*num_samples*sizeof(std::complex<float>);
+
+std::vector<std::complex<float>> make_frame(float value) {
+    std::vector<std::complex<float>> frame(num_lines*num_samples);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = std::complex<float>(value, static_cast<float>(i));
+    }
+    return frame;
+}
+
+std::vector<std::complex<float>*> line_pointers(std::vector<std::complex<float>>& frame) {
+    std::vector<std::complex<float>*> lines;
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        lines.push_back(frame.data() + line_no*num_samples);
+    }
+    return lines;
+}
+
+void put(FrameCache& cache, const std::string& key, float value) {
+    auto frame = make_frame(value);
+    cache.put(key, num_lines, num_samples, line_pointers(frame).data());
+}
+
+bool get(FrameCache& cache, const std::string& key, float& value) {
+    std::vector<std::complex<float>> frame(num_lines*num_samples);
+    if (!cache.get(key, num_lines, num_samples, line_pointers(frame).data())) {
+        return false;
+    }
+    value = frame.front().real();
+    BOOST_CHECK(frame == make_frame(value));
+    return true;
+}
+
+std::string xxh64_hex(const std::string& s) {
+    Xxh64 hash;
+    hash.update(s.data(), s.size());
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash.digest()));
+    return buffer;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(Xxh64MatchesReference) {
+    BOOST_CHECK_EQUAL(xxh64_hex(""), "ef46db3751d8e999");
+    BOOST_CHECK_EQUAL(xxh64_hex("abc"), "44bc2cf5ad770999");
+
+    // the digest does not depend on how the input is split
+    const std::string text = "The quick brown fox jumps over the lazy dog, and then some more to fill two stripes.";
+    for (size_t split = 0; split <= text.size(); split++) {
+        Xxh64 hash;
+        hash.update(text.data(), split);
+        hash.update(text.data() + split, text.size() - split);
+        BOOST_CHECK_EQUAL(hash.digest(), [&]() { Xxh64 whole; whole.update(text.data(), text.size()); return whole.digest(); }());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LeastRecentlyUsedFramesAreEvicted) {
+    FrameCache cache;
+    BOOST_CHECK(!cache.is_enabled());
+    cache.set_memory_capacity(2*frame_bytes);
+    BOOST_CHECK(cache.is_enabled());
+    put(cache, "a", 1.0f);
+    put(cache, "b", 2.0f);
+    float value;
+    BOOST_REQUIRE(get(cache, "a", value));
+    BOOST_CHECK_EQUAL(value, 1.0f);
+    // b is the least recently used
+    put(cache, "c", 3.0f);
+    BOOST_CHECK(!get(cache, "b", value));
+    BOOST_CHECK(get(cache, "a", value));
+    BOOST_CHECK(get(cache, "c", value));
+    BOOST_CHECK_EQUAL(cache.get_memory_bytes(), 2*frame_bytes);
+    BOOST_CHECK_EQUAL(cache.get_num_hits(), 3u);
+    BOOST_CHECK_EQUAL(cache.get_num_misses(), 1u);
+
+    // other dimensions are a miss
+    std::vector<std::complex<float>> line(num_samples);
+    auto line_ptr = line.data();
+    BOOST_CHECK(!cache.get("a", 1, num_samples, &line_ptr));
+
+    cache.set_memory_capacity(frame_bytes);
+    BOOST_CHECK_EQUAL(cache.get_memory_bytes(), frame_bytes);
+    BOOST_CHECK(get(cache, "c", value));
+    BOOST_CHECK(!get(cache, "a", value));
+}
+
+BOOST_AUTO_TEST_CASE(FramesAreSharedThroughTheDirectory) {
+    const auto dir = "test_frame_cache_" + std::to_string(getpid());
+    BOOST_REQUIRE_EQUAL(mkdir(dir.c_str(), 0700), 0);
+    {
+        FrameCache cache;
+        BOOST_CHECK_THROW(cache.set_directory(dir + "/missing"), std::runtime_error);
+        cache.set_directory(dir);
+        cache.set_disk_capacity(2*frame_bytes + 200);
+        put(cache, "a", 1.0f);
+        put(cache, "b", 2.0f);
+        // the recency is the modification time
+        const auto set_mtime = [&](const std::string& key, time_t mtime) {
+            const utimbuf times{mtime, mtime};
+            BOOST_REQUIRE_EQUAL(utime((dir + "/" + key + ".frame").c_str(), &times), 0);
+        };
+        set_mtime("a", 1000);
+        set_mtime("b", 2000);
+        put(cache, "c", 3.0f);
+    }
+    FrameCache cache;
+    cache.set_directory(dir);
+    float value;
+    // a was removed to stay within the capacity
+    BOOST_CHECK(!get(cache, "a", value));
+    BOOST_REQUIRE(get(cache, "b", value));
+    BOOST_CHECK_EQUAL(value, 2.0f);
+    BOOST_REQUIRE(get(cache, "c", value));
+    BOOST_CHECK_EQUAL(value, 3.0f);
+    // the memory is disabled
+    BOOST_CHECK_EQUAL(cache.get_memory_bytes(), 0u);
+
+    for (const auto key : {"a", "b", "c"}) {
+        std::remove((dir + "/" + key + ".frame").c_str());
+    }
+    BOOST_CHECK_EQUAL(rmdir(dir.c_str()), 0);
+}
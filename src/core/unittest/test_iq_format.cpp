@@ -0,0 +1,102 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE IqFormatTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "../iq_format.hpp"
+
+BOOST_AUTO_TEST_CASE(HalfBitsOfNormalFloats) {
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(0.0f), 0x0000);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(-0.0f), 0x8000);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1.0f), 0x3c00);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(-2.0f), 0xc000);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(0.5f), 0x3800);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(65504.0f), 0x7bff);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(6.103515625e-5f), 0x0400);    // smallest normal
+}
+
+BOOST_AUTO_TEST_CASE(HalfBitsRoundToNearestEven) {
+    // 1 + 2^-11 is halfway between 1 and the next half, and rounds to 1
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+    // 1 + 3*2^-11 is halfway between two halves, and rounds to the even one
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1.0f + 3.0f*std::ldexp(1.0f, -11)), 0x3c02);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1.0f + std::ldexp(1.0f, -11) + std::ldexp(1.0f, -20)), 0x3c01);
+    // a carry into the exponent
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(2.0f - std::ldexp(1.0f, -12)), 0x4000);
+}
+
+BOOST_AUTO_TEST_CASE(HalfBitsOfLargeAndSpecialFloats) {
+    // 65520 is halfway to the next binade and rounds to infinity
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(65519.0f), 0x7bff);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(65520.0f), 0x7c00);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(-1e10f), 0xfc00);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(std::numeric_limits<float>::infinity()), 0x7c00);
+    const auto nan_bits = bcsim::float_to_half_bits(std::numeric_limits<float>::quiet_NaN());
+    BOOST_CHECK_EQUAL(nan_bits & 0x7c00, 0x7c00);
+    BOOST_CHECK(nan_bits & 0x03ff);
+    BOOST_CHECK(std::isnan(bcsim::half_bits_to_float(nan_bits)));
+}
+
+BOOST_AUTO_TEST_CASE(HalfBitsOfSubnormals) {
+    const auto smallest = std::ldexp(1.0f, -24);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(smallest), 0x0001);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(-3.0f*smallest), 0x8003);
+    // halfway between zero and the smallest subnormal rounds to zero
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(0.5f*smallest), 0x0000);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(0.75f*smallest), 0x0001);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1.5f*smallest), 0x0002);
+    // the largest subnormal rounds up to the smallest normal
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1023.75f*smallest), 0x0400);
+    BOOST_CHECK_EQUAL(bcsim::float_to_half_bits(1e-10f), 0x0000);
+}
+
+BOOST_AUTO_TEST_CASE(HalfBitsRoundTrip) {
+    // every finite half is exactly a float which converts back to it
+    for (uint32_t bits = 0; bits < 0x10000u; bits++) {
+        const auto half = static_cast<uint16_t>(bits);
+        if ((half & 0x7c00u) == 0x7c00u) {
+            continue;
+        }
+        const auto value = bcsim::half_bits_to_float(half);
+        if (bcsim::float_to_half_bits(value) != half) {
+            BOOST_ERROR("round trip failed for half " << bits);
+        }
+    }
+    BOOST_CHECK_EQUAL(bcsim::half_bits_to_float(0x3555), 0.333251953125f);
+    BOOST_CHECK_EQUAL(bcsim::half_bits_to_float(0xfc00), -std::numeric_limits<float>::infinity());
+}
+
+BOOST_AUTO_TEST_CASE(Int16Quantization) {
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(0.3f, 10.0f), 3);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(-0.36f, 10.0f), -4);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(1.0f, 32767.0f), 32767);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(2.0f, 32767.0f), 32767);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(-2.0f, 32767.0f), -32767);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(std::numeric_limits<float>::infinity(), 1.0f), 32767);
+    BOOST_CHECK_EQUAL(bcsim::quantize_int16(std::numeric_limits<float>::quiet_NaN(), 1.0f), 0);
+    BOOST_CHECK_EQUAL(bcsim::int16_frame_scale(2.0f), 32767.0f/2.0f);
+    BOOST_CHECK_EQUAL(bcsim::int16_frame_scale(0.0f), 1.0f);
+}
+
+BOOST_AUTO_TEST_CASE(ConvertIqSamples) {
+    const std::vector<std::complex<float>> samples = {{1.0f, -0.5f}, {0.25f, 2.0f}, {-2.0f, 0.0f}};
+    BOOST_CHECK_EQUAL(bcsim::max_abs_iq_component(samples.data(), samples.size()), 2.0f);
+    BOOST_CHECK_EQUAL(bcsim::iq_sample_bytes(bcsim::IqOutputFormat::SampleType::COMPLEX_FLOAT32), 8u);
+    BOOST_CHECK_EQUAL(bcsim::iq_sample_bytes(bcsim::IqOutputFormat::SampleType::COMPLEX_INT16), 4u);
+
+    std::vector<uint16_t> half(2*samples.size());
+    bcsim::convert_iq_samples(samples.data(), samples.size(), bcsim::IqOutputFormat::SampleType::COMPLEX_FLOAT16,
+                              1.0f, half.data());
+    const std::vector<uint16_t> expected_half = {0x3c00, 0xb800, 0x3400, 0x4000, 0xc000, 0x0000};
+    BOOST_CHECK_EQUAL_COLLECTIONS(half.begin(), half.end(), expected_half.begin(), expected_half.end());
+
+    std::vector<int16_t> ints(2*samples.size());
+    const auto scale = bcsim::int16_frame_scale(2.0f);
+    bcsim::convert_iq_samples(samples.data(), samples.size(), bcsim::IqOutputFormat::SampleType::COMPLEX_INT16,
+                              scale, ints.data());
+    const std::vector<int16_t> expected_ints = {16384, -8192, 4096, 32767, -32767, 0};
+    BOOST_CHECK_EQUAL_COLLECTIONS(ints.begin(), ints.end(), expected_ints.begin(), expected_ints.end());
+}
@@ -0,0 +1,96 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_lut_compression
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <vector>
+#include "../lut_compression.hpp"
+
+using namespace bcsim;
+
+BOOST_AUTO_TEST_CASE(HalfConversionOfKnownValues) {
+    BOOST_CHECK_EQUAL(float_to_half(0.0f),     0x0000);
+    BOOST_CHECK_EQUAL(float_to_half(-0.0f),    0x8000);
+    BOOST_CHECK_EQUAL(float_to_half(1.0f),     0x3c00);
+    BOOST_CHECK_EQUAL(float_to_half(-2.0f),    0xc000);
+    BOOST_CHECK_EQUAL(float_to_half(65504.0f), 0x7bff);
+    BOOST_CHECK_EQUAL(float_to_half(1e6f),     0x7c00);
+    BOOST_CHECK_EQUAL(float_to_half(std::ldexp(1.0f, -24)), 0x0001);
+    BOOST_CHECK_EQUAL(float_to_half(std::ldexp(1.0f, -26)), 0x0000);
+    // halfway between 1 and the next half rounds to even
+    BOOST_CHECK_EQUAL(float_to_half(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+    BOOST_CHECK_EQUAL(float_to_half(1.0f + 3.0f*std::ldexp(1.0f, -11)), 0x3c02);
+    BOOST_CHECK(std::isnan(half_to_float(float_to_half(std::nanf("")))));
+}
+
+BOOST_AUTO_TEST_CASE(HalfConversionRoundTrips) {
+    for (uint32_t bits = 0; bits < 0x10000u; bits++) {
+        const auto half = static_cast<uint16_t>(bits);
+        const float value = half_to_float(half);
+        if (!std::isnan(value)) {
+            BOOST_REQUIRE_EQUAL(float_to_half(value), half);
+        }
+    }
+    for (float value = 1e-3f; value < 1.0f; value *= 1.01f) {
+        BOOST_REQUIRE_SMALL(half_to_float(float_to_half(value))/value - 1.0f, std::ldexp(1.0f, -11));
+    }
+}
+
+// LUT of a Gaussian beam whose lateral and elevational widths depend on the
+// radial index, which is not separable.
+LUTBeamProfile make_focused_lut(int nr, int nl, int ne) {
+    LUTBeamProfile profile(nr, nl, ne, Interval(0.0f, 0.05f), Interval(-4e-3f, 4e-3f), Interval(-6e-3f, 6e-3f));
+    for (int ir = 0; ir < nr; ir++) {
+        const float sigma_lat = 0.5e-3f + 1e-3f*std::abs(ir - nr/2)/nr;
+        const float sigma_ele = 1e-3f + 2e-3f*ir/nr;
+        for (int il = 0; il < nl; il++) {
+            const float l = -4e-3f + 8e-3f*il/(nl - 1);
+            for (int ie = 0; ie < ne; ie++) {
+                const float e = -6e-3f + 12e-3f*ie/(ne - 1);
+                profile.setDiscreteSample(ir, il, ie, std::exp(-0.5f*(l*l/(sigma_lat*sigma_lat) + e*e/(sigma_ele*sigma_ele))));
+            }
+        }
+    }
+    return profile;
+}
+
+BOOST_AUTO_TEST_CASE(SeparableLUTReproducesSeparableProfile) {
+    const int nr = 8, nl = 9, ne = 7;
+    LUTBeamProfile profile(nr, nl, ne, Interval(0.0f, 1.0f), Interval(-1.0f, 1.0f), Interval(-1.0f, 1.0f));
+    for (int ir = 0; ir < nr; ir++) {
+        for (int il = 0; il < nl; il++) {
+            for (int ie = 0; ie < ne; ie++) {
+                // sum of two products
+                profile.setDiscreteSample(ir, il, ie, (1.0f + ir)*std::exp(-0.1f*il*il)*(ne - ie)
+                                                      + 0.5f*std::cos(0.3f*ir)*il*std::exp(-0.2f*ie));
+            }
+        }
+    }
+    const auto rank1 = compute_separable_lut(profile, 1);
+    const auto rank2 = compute_separable_lut(profile, 2, 1000);
+    BOOST_CHECK_EQUAL(rank2.radial.size(), 2u*nr);
+    BOOST_CHECK_EQUAL(rank2.lateral.size(), 2u*nl);
+    BOOST_CHECK_EQUAL(rank2.elevational.size(), 2u*ne);
+    const auto error1 = compute_lut_approximation_error(profile.getSamples(), rank1.get_samples());
+    const auto error2 = compute_lut_approximation_error(profile.getSamples(), rank2.get_samples());
+    BOOST_CHECK_GT(error1.relative_rms_error, 1e-3f);
+    BOOST_CHECK_SMALL(error2.relative_rms_error, 1e-4f);
+    BOOST_CHECK_SMALL(error2.max_error, 1e-4f);
+}
+
+BOOST_AUTO_TEST_CASE(SeparableLUTErrorDecreasesWithRank) {
+    const auto profile = make_focused_lut(32, 24, 20);
+    float previous_error = 1.0f;
+    for (int rank = 1; rank <= 4; rank++) {
+        const auto separable = compute_separable_lut(profile, rank);
+        const auto error = compute_lut_approximation_error(profile.getSamples(), separable.get_samples());
+        BOOST_CHECK_LT(error.relative_rms_error, previous_error);
+        BOOST_CHECK_LE(error.relative_rms_error, error.max_error*10.0f);
+        previous_error = error.relative_rms_error;
+    }
+    BOOST_CHECK_LT(previous_error, 0.05f);
+}
+
+BOOST_AUTO_TEST_CASE(SeparableLUTThrowsOnInvalidRank) {
+    const auto profile = make_focused_lut(4, 4, 4);
+    BOOST_CHECK_THROW(compute_separable_lut(profile, 0), std::runtime_error);
+}
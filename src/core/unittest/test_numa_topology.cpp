@@ -0,0 +1,50 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE NumaTopologyTests
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <vector>
+#include "../algorithm/NumaTopology.hpp"
+
+BOOST_AUTO_TEST_CASE(test_parse_cpu_list) {
+    const auto cpus = bcsim::NumaTopology::parse_cpu_list("0-3,8, 10-11\n");
+    const std::vector<int> expected = {0, 1, 2, 3, 8, 10, 11};
+    BOOST_CHECK_EQUAL_COLLECTIONS(cpus.begin(), cpus.end(), expected.begin(), expected.end());
+    BOOST_CHECK(bcsim::NumaTopology::parse_cpu_list("").empty());
+    BOOST_CHECK_THROW(bcsim::NumaTopology::parse_cpu_list("3-1"), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::NumaTopology::parse_cpu_list("a"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_threads_are_spread_over_nodes) {
+    const bcsim::NumaTopology topology({{0, 1, 2, 3}, {4, 5, 6, 7}});
+    std::vector<int> cpus;
+    std::vector<int> nodes;
+    topology.assign_threads(4, cpus, nodes);
+    const std::vector<int> expected_cpus = {0, 2, 4, 6};
+    const std::vector<int> expected_nodes = {0, 0, 1, 1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(cpus.begin(), cpus.end(), expected_cpus.begin(), expected_cpus.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(nodes.begin(), nodes.end(), expected_nodes.begin(), expected_nodes.end());
+
+    // more threads than CPUs share them
+    topology.assign_threads(16, cpus, nodes);
+    BOOST_CHECK_EQUAL(cpus[1], 0);
+    BOOST_CHECK_EQUAL(nodes[15], 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_unknown_cpus) {
+    const bcsim::NumaTopology topology;
+    std::vector<int> cpus;
+    std::vector<int> nodes;
+    topology.assign_threads(3, cpus, nodes);
+    BOOST_CHECK_EQUAL(cpus.size(), 3u);
+    BOOST_CHECK_EQUAL(cpus[0], -1);
+    BOOST_CHECK_EQUAL(nodes[2], 0);
+    BOOST_CHECK(!topology.interleave_pages(cpus.data(), cpus.size()*sizeof(int)));
+}
+
+BOOST_AUTO_TEST_CASE(test_detected_topology) {
+    const auto topology = bcsim::NumaTopology::detect();
+    BOOST_REQUIRE_GE(topology.get_num_nodes(), 1u);
+    if (!topology.get_cpus(0).empty()) {
+        BOOST_CHECK(bcsim::NumaTopology::pin_calling_thread(topology.get_cpus(0)));
+    }
+}
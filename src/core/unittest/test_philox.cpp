@@ -0,0 +1,64 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE PhiloxTests
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <vector>
+#include <cmath>
+#include "../philox.hpp"
+
+// Known-answer tests from the Random123 distribution.
+BOOST_AUTO_TEST_CASE(Philox4x32KnownAnswers) {
+    const auto res1 = philox::philox4x32(philox::Counter{{0, 0, 0, 0}}, philox::Key{{0, 0}});
+    BOOST_CHECK_EQUAL(res1[0], 0x6627e8d5u);
+    BOOST_CHECK_EQUAL(res1[1], 0xe169c58du);
+    BOOST_CHECK_EQUAL(res1[2], 0xbc57ac4cu);
+    BOOST_CHECK_EQUAL(res1[3], 0x9b00dbd8u);
+
+    const auto res2 = philox::philox4x32(philox::Counter{{0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu}},
+                                         philox::Key{{0xffffffffu, 0xffffffffu}});
+    BOOST_CHECK_EQUAL(res2[0], 0x408f276du);
+    BOOST_CHECK_EQUAL(res2[1], 0x41c83b0eu);
+    BOOST_CHECK_EQUAL(res2[2], 0xa20bc7c6u);
+    BOOST_CHECK_EQUAL(res2[3], 0x6d5451fdu);
+
+    const auto res3 = philox::philox4x32(philox::Counter{{0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u}},
+                                         philox::Key{{0xa4093822u, 0x299f31d0u}});
+    BOOST_CHECK_EQUAL(res3[0], 0xd16cfe09u);
+    BOOST_CHECK_EQUAL(res3[1], 0x94fdccebu);
+    BOOST_CHECK_EQUAL(res3[2], 0x5001e420u);
+    BOOST_CHECK_EQUAL(res3[3], 0x24126ea1u);
+}
+
+BOOST_AUTO_TEST_CASE(GaussianNoiseStatistics) {
+    const size_t n = 100001;
+    const float sigma = 2.0f;
+    std::vector<std::complex<float> > x(n);
+    philox::add_gaussian_noise(x.data(), n, sigma, philox::Key{{1, 2}}, 3, 4, 5);
+
+    double mean_re = 0.0, mean_im = 0.0, var_re = 0.0, var_im = 0.0;
+    for (const auto& v : x) {
+        mean_re += v.real();
+        mean_im += v.imag();
+        var_re  += v.real()*v.real();
+        var_im  += v.imag()*v.imag();
+    }
+    BOOST_CHECK_SMALL(mean_re/n, 0.05);
+    BOOST_CHECK_SMALL(mean_im/n, 0.05);
+    BOOST_CHECK_CLOSE(std::sqrt(var_re/n), sigma, 2.0);
+    BOOST_CHECK_CLOSE(std::sqrt(var_im/n), sigma, 2.0);
+}
+
+BOOST_AUTO_TEST_CASE(GaussianNoiseIsReproducible) {
+    // A subrange of a stream is identical to the start of the full stream.
+    std::vector<std::complex<float> > a(64), b(37);
+    philox::add_gaussian_noise(a.data(), a.size(), 1.0f, philox::Key{{7, 8}}, 1, 2, 3);
+    philox::add_gaussian_noise(b.data(), b.size(), 1.0f, philox::Key{{7, 8}}, 1, 2, 3);
+    for (size_t i = 0; i < b.size(); i++) {
+        BOOST_CHECK_EQUAL(a[i], b[i]);
+    }
+
+    // Other streams differ
+    std::vector<std::complex<float> > c(64);
+    philox::add_gaussian_noise(c.data(), c.size(), 1.0f, philox::Key{{7, 8}}, 1, 2, 4);
+    BOOST_CHECK(a[0] != c[0]);
+}
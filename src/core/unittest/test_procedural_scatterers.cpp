@@ -0,0 +1,182 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ProceduralScattererTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include "../BCSimConfig.hpp"
+
+namespace {
+
+bcsim::ProceduralScatterers make_scatterers(bcsim::ProceduralScatterers::Region region) {
+    bcsim::ProceduralScatterers scatterers;
+    scatterers.region = region;
+    scatterers.center = bcsim::vector3(0.01f, -0.02f, 0.05f);
+    scatterers.half_axes = bcsim::vector3(0.01f, 0.005f, 0.02f);
+    scatterers.count = 20000;
+    scatterers.seed = 42;
+    return scatterers;
+}
+
+}
+
+// A scatterer only depends on its index and the seed.
+BOOST_AUTO_TEST_CASE(ScatterersAreReproducible) {
+    auto scatterers = make_scatterers(bcsim::ProceduralScatterers::Region::BOX);
+    const auto a = scatterers.get_scatterer(123);
+    scatterers.count = 200;
+    const auto b = scatterers.get_scatterer(123);
+    BOOST_CHECK_EQUAL(a.pos.x, b.pos.x);
+    BOOST_CHECK_EQUAL(a.pos.y, b.pos.y);
+    BOOST_CHECK_EQUAL(a.pos.z, b.pos.z);
+    BOOST_CHECK_EQUAL(a.amplitude, b.amplitude);
+
+    scatterers.seed = 43;
+    const auto c = scatterers.get_scatterer(123);
+    BOOST_CHECK(c.pos.x != a.pos.x);
+
+    const auto expanded = scatterers.expand();
+    BOOST_REQUIRE_EQUAL(expanded->scatterers.size(), scatterers.count);
+    BOOST_CHECK_EQUAL(expanded->scatterers[123].pos.x, c.pos.x);
+}
+
+BOOST_AUTO_TEST_CASE(ScatterersAreInsideTheRegion) {
+    for (auto region : {bcsim::ProceduralScatterers::Region::BOX, bcsim::ProceduralScatterers::Region::ELLIPSOID}) {
+        auto scatterers = make_scatterers(region);
+        scatterers.axes = bcsim::Matrix3::rotation_z(0.5);
+        const auto inverse = bcsim::Matrix3::rotation_z(-0.5);
+        bcsim::vector3 mean(0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < scatterers.count; i++) {
+            const auto d = inverse*(scatterers.get_scatterer(i).pos - scatterers.center);
+            const auto u = bcsim::vector3(d.x/scatterers.half_axes.x, d.y/scatterers.half_axes.y, d.z/scatterers.half_axes.z);
+            if (region == bcsim::ProceduralScatterers::Region::BOX) {
+                BOOST_CHECK(std::abs(u.x) <= 1.0001f && std::abs(u.y) <= 1.0001f && std::abs(u.z) <= 1.0001f);
+            } else {
+                BOOST_CHECK(u.dot(u) <= 1.0001f);
+            }
+            mean += u;
+        }
+        mean /= static_cast<float>(scatterers.count);
+        BOOST_CHECK_SMALL(mean.x, 0.02f);
+        BOOST_CHECK_SMALL(mean.y, 0.02f);
+        BOOST_CHECK_SMALL(mean.z, 0.02f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AmplitudeDistributions) {
+    auto scatterers = make_scatterers(bcsim::ProceduralScatterers::Region::BOX);
+    scatterers.amplitude_scale = 2.0f;
+    for (auto distribution : {bcsim::ProceduralScatterers::AmplitudeDistribution::GAUSSIAN,
+                              bcsim::ProceduralScatterers::AmplitudeDistribution::UNIFORM,
+                              bcsim::ProceduralScatterers::AmplitudeDistribution::CONSTANT}) {
+        scatterers.amplitude_distribution = distribution;
+        double sum = 0.0;
+        double sum_squares = 0.0;
+        for (size_t i = 0; i < scatterers.count; i++) {
+            const auto amplitude = scatterers.get_scatterer(i).amplitude;
+            sum += amplitude;
+            sum_squares += amplitude*amplitude;
+        }
+        const auto mean = sum/scatterers.count;
+        const auto rms = std::sqrt(sum_squares/scatterers.count);
+        if (distribution == bcsim::ProceduralScatterers::AmplitudeDistribution::GAUSSIAN) {
+            BOOST_CHECK_SMALL(mean, 0.05);
+            BOOST_CHECK_CLOSE(rms, 2.0, 2.0);
+        } else if (distribution == bcsim::ProceduralScatterers::AmplitudeDistribution::UNIFORM) {
+            BOOST_CHECK_SMALL(mean, 0.05);
+            BOOST_CHECK_CLOSE(rms, 2.0/std::sqrt(3.0), 2.0);
+        } else {
+            BOOST_CHECK_CLOSE(mean, 2.0, 1e-4);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DensityGivesTheCount) {
+    auto scatterers = make_scatterers(bcsim::ProceduralScatterers::Region::BOX);
+    scatterers.set_density(1e9);
+    BOOST_CHECK_EQUAL(scatterers.count, 8000u);
+    scatterers.region = bcsim::ProceduralScatterers::Region::ELLIPSOID;
+    scatterers.set_density(1e9);
+    BOOST_CHECK_EQUAL(scatterers.count, static_cast<size_t>(std::llround(8000.0*std::atan(1.0)*2.0/3.0)));
+}
+
+namespace {
+
+bcsim::ImageVolumeScatterers make_image_volume() {
+    bcsim::ImageVolumeScatterers volume;
+    volume.origin = bcsim::vector3(-0.01f, 0.0f, 0.02f);
+    volume.voxel_size = bcsim::vector3(0.001f, 0.002f, 0.0005f);
+    volume.nx = 8;
+    volume.ny = 5;
+    volume.nz = 6;
+    for (int iz = 0; iz < volume.nz; iz++) {
+        for (int iy = 0; iy < volume.ny; iy++) {
+            for (int ix = 0; ix < volume.nx; ix++) {
+                // 0 to 9 scatterers per voxel on average, with one empty row
+                volume.densities.push_back((iy == 2) ? 0.0f : 1e10f*((ix + iz) % 10));
+                volume.amplitude_scales.push_back(1.0f + ix);
+            }
+        }
+    }
+    volume.seed = 11;
+    volume.update_counts();
+    return volume;
+}
+
+}
+
+// Each voxel gets its density times its volume on average, and its
+// scatterers are inside it.
+BOOST_AUTO_TEST_CASE(ImageVolumeScatterersAreInTheirVoxels) {
+    const auto volume = make_image_volume();
+    const double voxel_volume = 0.001*0.002*0.0005;
+    double expected_count = 0.0;
+    for (size_t v = 0; v < volume.get_num_voxels(); v++) {
+        const auto count = volume.voxel_starts[v + 1] - volume.voxel_starts[v];
+        const double expected = volume.densities[v]*voxel_volume;
+        BOOST_CHECK(count == static_cast<uint64_t>(std::floor(expected)) || count == static_cast<uint64_t>(std::ceil(expected)));
+        expected_count += expected;
+    }
+    BOOST_CHECK_CLOSE(static_cast<double>(volume.get_count()), expected_count, 5.0);
+
+    for (size_t i = 0; i < volume.get_count(); i++) {
+        const auto v = volume.find_voxel(i);
+        const auto scatterer = volume.get_scatterer(i);
+        const auto ix = static_cast<int>(v % volume.nx);
+        const auto iy = static_cast<int>((v/volume.nx) % volume.ny);
+        const auto iz = static_cast<int>(v/(volume.nx*volume.ny));
+        BOOST_CHECK(iy != 2);
+        BOOST_CHECK(scatterer.pos.x >= volume.origin.x + volume.voxel_size.x*ix - 1e-7f);
+        BOOST_CHECK(scatterer.pos.x <= volume.origin.x + volume.voxel_size.x*(ix + 1) + 1e-7f);
+        BOOST_CHECK(scatterer.pos.y >= volume.origin.y + volume.voxel_size.y*iy - 1e-7f);
+        BOOST_CHECK(scatterer.pos.y <= volume.origin.y + volume.voxel_size.y*(iy + 1) + 1e-7f);
+        BOOST_CHECK(scatterer.pos.z >= volume.origin.z + volume.voxel_size.z*iz - 1e-7f);
+        BOOST_CHECK(scatterer.pos.z <= volume.origin.z + volume.voxel_size.z*(iz + 1) + 1e-7f);
+    }
+}
+
+// Generating a range, expanding and single lookups give the same scatterers,
+// and a voxel's scatterers do not depend on the other voxels.
+BOOST_AUTO_TEST_CASE(ImageVolumeScatterersAreReproducible) {
+    auto volume = make_image_volume();
+    const auto expanded = volume.expand();
+    BOOST_REQUIRE_EQUAL(expanded->scatterers.size(), volume.get_count());
+    const size_t begin = volume.get_count()/3;
+    const size_t end = begin + 100;
+    std::vector<float> xs(end - begin), ys(end - begin), zs(end - begin), as(end - begin);
+    volume.generate(begin, end, xs.data(), ys.data(), zs.data(), as.data());
+    for (size_t i = begin; i < end; i++) {
+        BOOST_CHECK_EQUAL(xs[i - begin], expanded->scatterers[i].pos.x);
+        BOOST_CHECK_EQUAL(zs[i - begin], volume.get_scatterer(i).pos.z);
+        BOOST_CHECK_EQUAL(as[i - begin], expanded->scatterers[i].amplitude);
+    }
+
+    const auto v = volume.voxel_index(3, 1, 4);
+    const auto a = volume.get_voxel_scatterer(v, 0);
+    volume.densities[0] *= 2.0f;
+    volume.update_counts();
+    const auto b = volume.get_voxel_scatterer(v, 0);
+    BOOST_CHECK_EQUAL(a.pos.x, b.pos.x);
+    BOOST_CHECK_EQUAL(a.amplitude, b.amplitude);
+
+    volume.densities.pop_back();
+    BOOST_CHECK_THROW(volume.update_counts(), std::runtime_error);
+}
@@ -0,0 +1,127 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_scan_sequence
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <stdexcept>
+#include "../ScanSequence.hpp"
+#include "../algorithm/common_utils.hpp"
+
+using namespace bcsim;
+
+namespace {
+
+void check_close(const vector3& a, const vector3& b) {
+    BOOST_CHECK_SMALL(a.x - b.x, 1e-6f);
+    BOOST_CHECK_SMALL(a.y - b.y, 1e-6f);
+    BOOST_CHECK_SMALL(a.z - b.z, 1e-6f);
+}
+
+}   // end namespace
+
+BOOST_AUTO_TEST_CASE(LinearScanLines) {
+    ParametricScan scan;
+    scan.type              = ParametricScan::Type::LINEAR;
+    scan.num_lines_lateral = 5;
+    scan.lateral_extent    = 0.04f;
+    scan.line_interval     = 1e-4f;
+    const ScanSequence seq(0.1f, scan);
+    BOOST_CHECK(seq.is_parametric());
+    BOOST_CHECK(seq.is_valid());
+    BOOST_CHECK_EQUAL(seq.get_num_lines(), 5);
+
+    check_close(seq.get_scanline(0).get_origin(), vector3(-0.02f, 0.0f, 0.0f));
+    check_close(seq.get_scanline(2).get_origin(), vector3(0.0f, 0.0f, 0.0f));
+    check_close(seq.get_scanline(4).get_origin(), vector3(0.02f, 0.0f, 0.0f));
+    check_close(seq.get_scanline(3).get_direction(), vector3(0.0f, 0.0f, 1.0f));
+    check_close(seq.get_scanline(3).get_lateral_dir(), vector3(1.0f, 0.0f, 0.0f));
+    BOOST_CHECK_CLOSE(seq.get_scanline(3).get_timestamp(), 3e-4f, 1e-3f);
+}
+
+BOOST_AUTO_TEST_CASE(SectorScanLines) {
+    const float pi = 3.14159265f;
+    ParametricScan scan;
+    scan.type              = ParametricScan::Type::SECTOR;
+    scan.num_lines_lateral = 3;
+    scan.num_planes        = 3;
+    scan.lateral_extent    = pi/2.0f;
+    scan.elevational_extent = pi/2.0f;
+    const ScanSequence seq(0.1f, scan);
+    BOOST_CHECK_EQUAL(seq.get_num_lines(), 9);
+
+    // the center line of the middle plane is along z
+    check_close(seq.get_scanline(4).get_direction(), vector3(0.0f, 0.0f, 1.0f));
+    check_close(seq.get_scanline(4).get_lateral_dir(), vector3(1.0f, 0.0f, 0.0f));
+    // the last line of the middle plane is rotated 45 degrees around y
+    const float s = std::sqrt(0.5f);
+    check_close(seq.get_scanline(5).get_direction(), vector3(s, 0.0f, s));
+    check_close(seq.get_scanline(5).get_lateral_dir(), vector3(s, 0.0f, -s));
+    // the center line of the last plane is rotated 45 degrees around x
+    check_close(seq.get_scanline(7).get_direction(), vector3(0.0f, -s, s));
+    check_close(seq.get_scanline(7).get_elevational_dir(), vector3(0.0f, -s, -s));
+}
+
+BOOST_AUTO_TEST_CASE(FramesAndSubranges) {
+    ParametricScan scan;
+    scan.num_lines_lateral = 4;
+    scan.lateral_extent    = 0.03f;
+    scan.first_timestamp   = 1.0f;
+    scan.line_interval     = 0.01f;
+    scan.num_frames        = 3;
+    scan.frame_interval    = 0.5f;
+    const ScanSequence seq(0.1f, scan);
+    BOOST_CHECK_EQUAL(seq.get_num_lines(), 12);
+    BOOST_CHECK_CLOSE(seq.get_scanline(9).get_timestamp(), 1.0f + 0.01f + 2*0.5f, 1e-4f);
+    check_close(seq.get_scanline(9).get_origin(), seq.get_scanline(1).get_origin());
+
+    // lines past the end of the scan are clamped to its last line
+    const ScanSequence part(0.1f, scan, 10, 4);
+    BOOST_CHECK_EQUAL(part.get_num_lines(), 4);
+    BOOST_CHECK_EQUAL(part.get_parametric_first_line(), 10);
+    BOOST_CHECK_CLOSE(part.get_scanline(0).get_timestamp(), seq.get_scanline(10).get_timestamp(), 1e-4f);
+    BOOST_CHECK_CLOSE(part.get_scanline(3).get_timestamp(), seq.get_scanline(11).get_timestamp(), 1e-4f);
+
+    ScanSequence explicit_seq(0.1f);
+    BOOST_CHECK(!explicit_seq.is_parametric());
+    BOOST_CHECK_THROW(explicit_seq.get_parametric_scan(), std::runtime_error);
+    ScanSequence parametric_seq(0.1f, scan);
+    BOOST_CHECK_THROW(parametric_seq.add_scanline(seq.get_scanline(0)), std::runtime_error);
+}
+
+// A depth window covers its depths plus the excitation length on both sides,
+// starting at a decimated sample, and is clamped to the line.
+BOOST_AUTO_TEST_CASE(DepthWindowSamples) {
+    ExcitationSignal excitation;
+    excitation.samples.assign(40, 1.0f);
+    excitation.center_index = 20;
+    excitation.sampling_frequency = 50e6f;
+    excitation.demod_freq = 2.5e6f;
+    const float sound_speed = 1540.0f;
+    ScanSequence seq(0.15f);
+    BOOST_CHECK(!seq.has_depth_window());
+    const auto full = compute_rf_sample_window(sound_speed, seq, excitation, 4);
+    BOOST_CHECK_EQUAL(full.first_sample, 0u);
+    BOOST_CHECK_EQUAL(full.num_samples, compute_num_rf_samples(sound_speed, seq.line_length, excitation.sampling_frequency));
+
+    seq.r_min = 0.04f;
+    seq.r_max = 0.06f;
+    const auto window = compute_rf_sample_window(sound_speed, seq, excitation, 4);
+    const double samples_per_meter = 2.0*excitation.sampling_frequency/sound_speed;
+    BOOST_CHECK_EQUAL(window.first_sample % 4, 0u);
+    BOOST_CHECK(window.first_sample <= seq.r_min*samples_per_meter - 40);
+    BOOST_CHECK(window.first_sample > seq.r_min*samples_per_meter - 40 - 4);
+    BOOST_CHECK(window.first_sample + window.num_samples >= seq.r_max*samples_per_meter + 40);
+    BOOST_CHECK(window.num_samples < full.num_samples/6);
+
+    seq.r_min = 0.0f;
+    seq.r_max = seq.line_length;
+    const auto whole = compute_rf_sample_window(sound_speed, seq, excitation, 4);
+    BOOST_CHECK_EQUAL(whole.first_sample, 0u);
+    BOOST_CHECK_EQUAL(whole.num_samples, full.num_samples);
+
+    seq.r_min = 0.07f;
+    seq.r_max = 0.06f;
+    BOOST_CHECK_THROW(compute_rf_sample_window(sound_speed, seq, excitation, 4), std::runtime_error);
+    seq.r_min = 0.1f;
+    seq.r_max = 0.2f;
+    BOOST_CHECK_THROW(compute_rf_sample_window(sound_speed, seq, excitation, 4), std::runtime_error);
+}
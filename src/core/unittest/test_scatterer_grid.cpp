@@ -0,0 +1,256 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ScattererGridTests
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "../algorithm/ScattererGrid.hpp"
+
+namespace {
+
+float distance_to_segment(const bcsim::vector3& p, const bcsim::vector3& p0, const bcsim::vector3& p1) {
+    const auto seg = p1 - p0;
+    const auto t = std::min(1.0f, std::max(0.0f, (p - p0).dot(seg)/seg.norm_squared()));
+    return (p - (p0 + seg*t)).norm();
+}
+
+}
+
+// The permutation must contain every scatterer exactly once.
+BOOST_AUTO_TEST_CASE(PermutationIsValid) {
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+    const size_t num_scatterers = 10000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen); ys[i] = 0.1f*dist(gen); zs[i] = dist(gen);
+    }
+    bcsim::ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation);
+    BOOST_REQUIRE_EQUAL(permutation.size(), num_scatterers);
+    std::sort(permutation.begin(), permutation.end());
+    for (size_t i = 0; i < num_scatterers; i++) {
+        BOOST_REQUIRE_EQUAL(permutation[i], i);
+    }
+}
+
+// All scatterers within the radius of the segment must be in the ranges.
+BOOST_AUTO_TEST_CASE(RangesContainAllCloseScatterers) {
+    std::mt19937 gen(5678);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+    const size_t num_scatterers = 20000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen); ys[i] = dist(gen); zs[i] = dist(gen);
+    }
+    bcsim::ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation);
+
+    const bcsim::vector3 p0(-0.03f, 0.01f, -0.06f);
+    const bcsim::vector3 p1(0.02f, -0.01f, 0.06f);
+    const float radius = 0.005f;
+    std::vector<bcsim::ScattererGrid::IndexRange> ranges;
+    grid.find_ranges(p0, p1, radius, ranges);
+
+    std::vector<bool> found(num_scatterers, false);
+    size_t num_found = 0;
+    for (const auto& range : ranges) {
+        BOOST_REQUIRE(range.first < range.second);
+        for (size_t i = range.first; i < range.second; i++) {
+            found[permutation[i]] = true;
+            num_found++;
+        }
+    }
+    for (size_t i = 0; i < num_scatterers; i++) {
+        if (distance_to_segment(bcsim::vector3(xs[i], ys[i], zs[i]), p0, p1) <= radius) {
+            BOOST_CHECK(found[i]);
+        }
+    }
+    // only a small part of the volume is close to the segment
+    BOOST_CHECK(num_found < num_scatterers/4);
+}
+
+// With the Z-order cell order the ranges must still cover all close
+// scatterers, and be sorted and disjoint.
+BOOST_AUTO_TEST_CASE(MortonOrderRanges) {
+    std::mt19937 gen(4321);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+    const size_t num_scatterers = 20000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen); ys[i] = 0.5f*dist(gen); zs[i] = dist(gen);
+    }
+    bcsim::ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation, 16, bcsim::ScattererGrid::CellOrder::MORTON);
+
+    const bcsim::vector3 p0(0.04f, -0.02f, -0.05f);
+    const bcsim::vector3 p1(-0.01f, 0.02f, 0.05f);
+    const float radius = 0.004f;
+    std::vector<bcsim::ScattererGrid::IndexRange> ranges;
+    grid.find_ranges(p0, p1, radius, ranges);
+
+    std::vector<bool> found(num_scatterers, false);
+    for (size_t range_no = 0; range_no < ranges.size(); range_no++) {
+        BOOST_REQUIRE(ranges[range_no].first < ranges[range_no].second);
+        if (range_no > 0) {
+            BOOST_REQUIRE(ranges[range_no - 1].second < ranges[range_no].first);
+        }
+        for (size_t i = ranges[range_no].first; i < ranges[range_no].second; i++) {
+            found[permutation[i]] = true;
+        }
+    }
+    for (size_t i = 0; i < num_scatterers; i++) {
+        if (distance_to_segment(bcsim::vector3(xs[i], ys[i], zs[i]), p0, p1) <= radius) {
+            BOOST_CHECK(found[i]);
+        }
+    }
+}
+
+// A flat dataset must not give a degenerate grid.
+BOOST_AUTO_TEST_CASE(FlatDataset) {
+    const size_t num_scatterers = 1000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers, 0.0f), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = 1e-4f*(i % 40); zs[i] = 1e-4f*(i / 40);
+    }
+    bcsim::ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation);
+
+    std::vector<bcsim::ScattererGrid::IndexRange> ranges;
+    grid.find_ranges(bcsim::vector3(0.0f, -1.0f, 0.0f), bcsim::vector3(0.0f, 1.0f, 0.0f), 1.0f, ranges);
+    BOOST_REQUIRE_EQUAL(ranges.size(), 1u);
+    BOOST_CHECK_EQUAL(ranges[0].first, 0u);
+    BOOST_CHECK_EQUAL(ranges[0].second, num_scatterers);
+}
+
+// Every scatterer is in its own cell, and not in the cells of all others.
+BOOST_AUTO_TEST_CASE(ScatterersAreInTheirCells) {
+    std::mt19937 gen(4321);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+    const size_t num_scatterers = 5000;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen); ys[i] = dist(gen); zs[i] = dist(gen);
+    }
+    for (auto order : {bcsim::ScattererGrid::CellOrder::DEPTH, bcsim::ScattererGrid::CellOrder::MORTON}) {
+        bcsim::ScattererGrid grid;
+        std::vector<uint32_t> permutation;
+        grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation, 16, order);
+        size_t num_in_cell_of_first = 0;
+        for (size_t i = 0; i < num_scatterers; i++) {
+            const bcsim::vector3 pos(xs[permutation[i]], ys[permutation[i]], zs[permutation[i]]);
+            BOOST_REQUIRE(grid.is_in_cell_of(pos, i));
+            if (grid.is_in_cell_of(pos, 0)) {
+                num_in_cell_of_first++;
+            }
+        }
+        BOOST_CHECK(num_in_cell_of_first < num_scatterers/10);
+        BOOST_CHECK(!grid.is_in_cell_of(bcsim::vector3(1.0f, 0.0f, 0.0f), 0));
+    }
+}
+
+// The subsets partition the sorted scatterers, are stratified by cell, and
+// the ranges of a few subsets hold all close scatterers of those subsets.
+BOOST_AUTO_TEST_CASE(SubsetsArePartitionedAndCulled) {
+    std::mt19937 gen(2468);
+    std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+    const size_t num_scatterers = 20000;
+    const size_t num_subsets = 8;
+    std::vector<float> xs(num_scatterers), ys(num_scatterers), zs(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        xs[i] = dist(gen); ys[i] = dist(gen); zs[i] = dist(gen);
+    }
+    bcsim::ScattererGrid grid;
+    std::vector<uint32_t> permutation;
+    grid.build(xs.data(), ys.data(), zs.data(), num_scatterers, permutation, 16, bcsim::ScattererGrid::CellOrder::DEPTH,
+               num_subsets);
+    BOOST_CHECK_EQUAL(grid.get_num_subsets(), num_subsets);
+    BOOST_CHECK_EQUAL(grid.subset_range(0, num_subsets).first, 0u);
+    BOOST_CHECK_EQUAL(grid.subset_range(0, num_subsets).second, num_scatterers);
+    for (size_t subset = 0; subset < num_subsets; subset++) {
+        const auto range = grid.subset_range(subset, subset + 1);
+        BOOST_CHECK(range.first <= range.second);
+        if (subset > 0) {
+            BOOST_CHECK_EQUAL(range.first, grid.subset_range(subset - 1, subset).second);
+        }
+        // every cell deals about the same number of scatterers to each subset
+        const auto expected = static_cast<double>(num_scatterers)/num_subsets;
+        BOOST_CHECK(std::abs(static_cast<double>(range.second - range.first) - expected) < 0.05*expected);
+    }
+    // a scatterer of a subset stays in its cell
+    BOOST_CHECK(grid.is_in_cell_of(bcsim::vector3(xs[permutation[12345]], ys[permutation[12345]], zs[permutation[12345]]), 12345));
+
+    const bcsim::Scanline line(bcsim::vector3(0.01f, 0.0f, -0.05f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                               bcsim::vector3(1.0f, 0.0f, 0.0f), 0.0f);
+    bcsim::BeamCullingRegion region;
+    region.r_min = 0.0f;
+    region.r_max = 0.1f;
+    region.radius = 0.005f;
+    std::vector<bcsim::ScattererGrid::IndexRange> ranges;
+    grid.find_ranges(line, region, 2, 5, ranges);
+    const auto active = grid.subset_range(2, 5);
+    std::vector<bool> found(num_scatterers, false);
+    for (const auto& range : ranges) {
+        BOOST_REQUIRE(active.first <= range.first && range.second <= active.second);
+        for (size_t i = range.first; i < range.second; i++) {
+            found[i] = true;
+        }
+    }
+    const bcsim::vector3 p1(0.01f, 0.0f, 0.05f);
+    for (size_t i = active.first; i < active.second; i++) {
+        const auto j = permutation[i];
+        if (distance_to_segment(bcsim::vector3(xs[j], ys[j], zs[j]), line.get_origin(), p1) <= region.radius) {
+            BOOST_CHECK(found[i]);
+        }
+    }
+}
+
+// The voxel ranges of an image volume are increasing and contain all its
+// scatterers close to the line.
+BOOST_AUTO_TEST_CASE(VoxelRangesContainAllCloseScatterers) {
+    bcsim::ImageVolumeScatterers volume;
+    volume.origin = bcsim::vector3(-0.02f, -0.02f, 0.0f);
+    volume.voxel_size = bcsim::vector3(0.002f, 0.003f, 0.004f);
+    volume.nx = 20;
+    volume.ny = 14;
+    volume.nz = 15;
+    volume.densities.assign(volume.get_num_voxels(), 2e8f);
+    volume.amplitude_scales.assign(volume.get_num_voxels(), 1.0f);
+    volume.seed = 3;
+    volume.update_counts();
+
+    const bcsim::Scanline line(bcsim::vector3(-0.005f, 0.002f, 0.0f), bcsim::vector3(0.3f, 0.0f, 0.9539392f),
+                               bcsim::vector3(0.9539392f, 0.0f, -0.3f), 0.0f);
+    bcsim::BeamCullingRegion region;
+    region.r_min = 0.01f;
+    region.r_max = 0.05f;
+    region.radius = 0.003f;
+    std::vector<bcsim::ScattererGrid::IndexRange> ranges;
+    bcsim::find_voxel_ranges(volume, line, region, ranges);
+
+    const auto num_scatterers = volume.get_count();
+    std::vector<bool> found(num_scatterers, false);
+    size_t num_found = 0;
+    for (size_t k = 0; k < ranges.size(); k++) {
+        BOOST_REQUIRE(ranges[k].first < ranges[k].second);
+        BOOST_REQUIRE(k == 0 || ranges[k - 1].second < ranges[k].first);
+        for (size_t i = ranges[k].first; i < ranges[k].second; i++) {
+            found[i] = true;
+            num_found++;
+        }
+    }
+    const auto p0 = line.get_origin() + line.get_direction()*region.r_min;
+    const auto p1 = line.get_origin() + line.get_direction()*region.r_max;
+    for (size_t i = 0; i < num_scatterers; i++) {
+        if (distance_to_segment(volume.get_scatterer(i).pos, p0, p1) <= region.radius) {
+            BOOST_CHECK(found[i]);
+        }
+    }
+    BOOST_CHECK(num_found > 0);
+    BOOST_CHECK(num_found < num_scatterers/4);
+}
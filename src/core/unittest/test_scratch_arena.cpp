@@ -0,0 +1,80 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ScratchArenaTests
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <cstdint>
+#include <utility>
+#include "../ScratchArena.hpp"
+
+namespace {
+
+bool is_aligned(const void* ptr) {
+    return reinterpret_cast<uintptr_t>(ptr) % bcsim::SCRATCH_ALIGNMENT == 0;
+}
+
+}   // namespace
+
+BOOST_AUTO_TEST_CASE(AllocationsAreAlignedAndDisjoint) {
+    bcsim::ScratchArena arena;
+    auto a = arena.allocate<float>(3);
+    auto b = arena.allocate_zeroed<std::complex<float>>(100);
+    auto c = arena.allocate<char>(1);
+    BOOST_CHECK(is_aligned(a));
+    BOOST_CHECK(is_aligned(b));
+    BOOST_CHECK(is_aligned(c));
+    BOOST_CHECK(reinterpret_cast<char*>(b) >= reinterpret_cast<char*>(a + 3));
+    BOOST_CHECK(c >= reinterpret_cast<char*>(b + 100));
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK(b[i] == std::complex<float>(0.0f, 0.0f));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ArenaGrowsToOneBlockAndIsReused) {
+    bcsim::ScratchArena arena;
+    for (int k = 0; k < 4; k++) {
+        arena.allocate<float>(1000);
+    }
+    arena.reset();
+    const auto capacity = arena.capacity();
+    BOOST_CHECK(capacity >= 4*1000*sizeof(float));
+
+    // the same allocations fit without growing, at the same addresses
+    auto first = arena.allocate<float>(1000);
+    for (int k = 1; k < 4; k++) {
+        arena.allocate<float>(1000);
+    }
+    arena.reset();
+    BOOST_CHECK_EQUAL(arena.capacity(), capacity);
+    BOOST_CHECK_EQUAL(arena.allocate<float>(1000), first);
+}
+
+BOOST_AUTO_TEST_CASE(HugePageArena) {
+    bcsim::ScratchArena arena(true);
+    const size_t n = 1 << 20;
+    auto data = arena.allocate_zeroed<std::complex<float>>(n);
+    data[n - 1] = std::complex<float>(1.0f, 2.0f);
+    arena.reset();
+    BOOST_CHECK(is_aligned(arena.allocate<std::complex<float>>(n)));
+
+    // switching to normal pages on the next reset
+    arena.set_huge_pages(false);
+    arena.reset();
+    BOOST_CHECK(arena.capacity() >= n*sizeof(std::complex<float>));
+}
+
+BOOST_AUTO_TEST_CASE(MovedArenaKeepsMemory) {
+    bcsim::ScratchArena arena;
+    arena.allocate<double>(10);
+    arena.reset();
+    const auto capacity = arena.capacity();
+    bcsim::ScratchArena other(std::move(arena));
+    BOOST_CHECK_EQUAL(other.capacity(), capacity);
+    BOOST_CHECK_EQUAL(arena.capacity(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(AlignedVectorData) {
+    bcsim::AlignedVector<std::complex<float>> samples(7);
+    BOOST_CHECK(is_aligned(samples.data()));
+    samples.resize(1000);
+    BOOST_CHECK(is_aligned(samples.data()));
+}
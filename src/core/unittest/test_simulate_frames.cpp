@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE SimulateFramesTests
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "../LibBCSim.hpp"
+
+namespace {
+
+// A CPU simulator of scatterers moving in depth along linear splines on
+// t in [0, 1], and lines whose timestamps are timestamps[i]. The
+// timestamps are dyadic, so that a timestamp plus an offset can be
+// exactly equal to another timestamp. With the phase delay, the rendered
+// and evaluated spline positions give results that differ in the last bits.
+bcsim::IAlgorithm::s_ptr make_simulator(const std::vector<float>& timestamps, bool spline_cache) {
+    auto sim = bcsim::Create("cpu");
+    sim->set_parameter("verbose", "0");
+    sim->set_parameter("cpu_spline_cache", spline_cache ? "on" : "off");
+    sim->set_parameter("phase_delay", "on");
+    bcsim::ExcitationSignal excitation;
+    excitation.sampling_frequency = 50e6f;
+    excitation.center_index = 0;
+    excitation.demod_freq = 2.5e6f;
+    for (int i = 0; i < 32; i++) excitation.samples.push_back(std::sin(0.3f*i));
+    sim->set_excitation(excitation);
+    auto scan_seq = std::make_shared<bcsim::ScanSequence>(0.05f);
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        scan_seq->add_scanline(bcsim::Scanline(bcsim::vector3(1e-4f*i, 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                               bcsim::vector3(1.0f, 0.0f, 0.0f), timestamps[i]));
+    }
+    sim->set_scan_sequence(scan_seq);
+    sim->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 1e-3f));
+    auto splines = std::make_shared<bcsim::SplineScatterers>();
+    splines->spline_degree = 1;
+    splines->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    splines->resize(301, 2);
+    for (size_t i = 0; i < 301; i++) {
+        const auto x = 1e-5f*(static_cast<float>(i) - 150.0f);
+        splines->set_control_point(i, 0, bcsim::vector3(x, 0.0f, 0.01f + 5e-5f*i));
+        splines->set_control_point(i, 1, bcsim::vector3(-x, 0.0f, 0.04f - 5e-5f*i));
+        splines->amplitudes[i] = 1.0f + 0.01f*(i % 7);
+    }
+    sim->add_spline_scatterers(splines);
+    return sim;
+}
+
+// The frames of simulate_frames() are those of next_frame().
+void check_frames_equal_streamed_frames(const std::vector<float>& timestamps, const std::vector<float>& offsets,
+                                        bool spline_cache) {
+    auto sim = make_simulator(timestamps, spline_cache);
+    size_t num_lines, num_samples;
+    sim->get_output_dimensions(num_lines, num_samples);
+    const auto frame_size = num_lines*num_samples;
+
+    std::vector<std::complex<float>> batched(offsets.size()*frame_size);
+    sim->simulate_frames(offsets, batched.data(), num_samples, frame_size);
+
+    std::vector<std::complex<float>> streamed(offsets.size()*frame_size);
+    sim->begin_stream(offsets);
+    for (size_t frame_no = 0; frame_no < offsets.size(); frame_no++) {
+        BOOST_REQUIRE(sim->next_frame(streamed.data() + frame_no*frame_size, num_samples));
+    }
+
+    float max_abs = 0.0f;
+    size_t num_different = 0;
+    for (size_t i = 0; i < batched.size(); i++) {
+        max_abs = std::max(max_abs, std::abs(streamed[i]));
+        if (batched[i] != streamed[i]) {
+            num_different++;
+        }
+    }
+    BOOST_CHECK(max_abs > 0.0f);
+    BOOST_CHECK_EQUAL(num_different, 0u);
+}
+
+}
+
+// Line i of the second frame has the timestamp of line i + 8 of the first,
+// but no timestamp is shared within a frame.
+BOOST_AUTO_TEST_CASE(SplineCacheIsPerFrame) {
+    std::vector<float> timestamps;
+    for (int i = 0; i < 16; i++) {
+        timestamps.push_back(i/64.0f);
+    }
+    const std::vector<float> offsets = {0.0f, 0.125f};
+    check_frames_equal_streamed_frames(timestamps, offsets, true);
+    check_frames_equal_streamed_frames(timestamps, offsets, false);
+}
+
+// Pairs of lines share a timestamp within a frame, and the timestamps of
+// the frames overlap as above.
+BOOST_AUTO_TEST_CASE(SplineCacheWithSharedTimestamps) {
+    std::vector<float> timestamps;
+    for (int i = 0; i < 16; i++) {
+        timestamps.push_back((i/2)/32.0f);
+    }
+    const std::vector<float> offsets = {0.0f, 0.125f, 0.25f};
+    check_frames_equal_streamed_frames(timestamps, offsets, true);
+}
@@ -0,0 +1,62 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ThreadPoolTests
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../algorithm/ThreadPool.hpp"
+
+BOOST_AUTO_TEST_CASE(test_serial_queue_keeps_order) {
+    std::vector<int> order;
+    bcsim::SerialQueue queue;
+    for (int i = 0; i < 100; i++) {
+        queue.submit([&order, i]() { order.push_back(i); });
+    }
+    queue.wait_idle();
+    BOOST_REQUIRE_EQUAL(order.size(), 100u);
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK_EQUAL(order[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_serial_queue_runs_one_task_at_a_time) {
+    std::atomic<int> num_running(0);
+    std::atomic<int> max_running(0);
+    bcsim::SerialQueue queue;
+    for (int i = 0; i < 20; i++) {
+        queue.submit([&]() {
+            const auto running = ++num_running;
+            if (running > max_running) max_running = running;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            --num_running;
+        });
+    }
+    queue.wait_idle();
+    BOOST_CHECK_EQUAL(max_running.load(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_serial_queues_share_the_pool) {
+    std::atomic<int> num_done(0);
+    {
+        std::vector<std::unique_ptr<bcsim::SerialQueue>> queues;
+        for (int i = 0; i < 8; i++) {
+            queues.emplace_back(new bcsim::SerialQueue);
+            for (int j = 0; j < 10; j++) {
+                queues.back()->submit([&num_done]() { num_done++; });
+            }
+        }
+        // destroying a queue waits for its tasks
+    }
+    BOOST_CHECK_EQUAL(num_done.load(), 80);
+    BOOST_CHECK(bcsim::ThreadPool::instance().get_num_threads() >= 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_wait_idle_without_tasks) {
+    bcsim::SerialQueue queue;
+    queue.wait_idle();
+    queue.submit([]() { });
+    queue.wait_idle();
+    queue.wait_idle();
+}
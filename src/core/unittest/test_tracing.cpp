@@ -0,0 +1,83 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TracingTests
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Tracing.hpp"
+
+namespace {
+
+std::string write_and_read_trace() {
+    const std::string path = "test_tracing.json";
+    bcsim::trace::write_chrome_trace(path);
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::remove(path.c_str());
+    return ss.str();
+}
+
+size_t count_occurrences(const std::string& haystack, const std::string& needle) {
+    size_t count = 0;
+    for (auto pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+}   // namespace
+
+BOOST_AUTO_TEST_CASE(EventsFromAllThreadsAreWritten) {
+    bcsim::trace::clear();
+    bcsim::trace::set_enabled(true);
+    const int num_threads = 4;
+    const int events_per_thread = 5000;     // more than one buffer chunk
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([] {
+            for (int k = 0; k < events_per_thread; k++) {
+                bcsim::trace::ScopedEvent event("worker_event", "test");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    {
+        bcsim::trace::ScopedEvent event("main_event");
+    }
+    bcsim::trace::set_enabled(false);
+
+    const auto json = write_and_read_trace();
+    BOOST_CHECK_EQUAL(json.front(), '{');
+    BOOST_CHECK_EQUAL(count_occurrences(json, "\"worker_event\""), static_cast<size_t>(num_threads*events_per_thread));
+    BOOST_CHECK_EQUAL(count_occurrences(json, "\"main_event\""), 1u);
+    BOOST_CHECK_EQUAL(count_occurrences(json, "\"cat\": \"bcsim\""), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(DisabledAndClearedEventsAreNotWritten) {
+    bcsim::trace::set_enabled(true);
+    {
+        bcsim::trace::ScopedEvent event("before_clear");
+    }
+    bcsim::trace::clear();
+    bcsim::trace::set_enabled(false);
+    {
+        bcsim::trace::ScopedEvent event("while_disabled");
+    }
+    bcsim::trace::set_enabled(true);
+    {
+        bcsim::trace::ScopedEvent event("ended_early");
+        event.end();
+    }
+    bcsim::trace::set_enabled(false);
+
+    const auto json = write_and_read_trace();
+    BOOST_CHECK_EQUAL(count_occurrences(json, "before_clear"), 0u);
+    BOOST_CHECK_EQUAL(count_occurrences(json, "while_disabled"), 0u);
+    BOOST_CHECK_EQUAL(count_occurrences(json, "ended_early"), 1u);
+}
@@ -37,10 +37,10 @@ namespace bcsim {
 template <typename T>
 class Vector3D {
 public:
-    Vector3D () : x(static_cast<T>(0.0)),
-                 y(static_cast<T>(0.0)),
-                 z(static_cast<T>(0.0)) { }
-    Vector3D (T x, T y, T z) : x(x), y(y), z(z) { }
+    constexpr Vector3D () : x(static_cast<T>(0.0)),
+                           y(static_cast<T>(0.0)),
+                           z(static_cast<T>(0.0)) { }
+    constexpr Vector3D (T x, T y, T z) : x(x), y(y), z(z) { }
     T norm() const {
         return std::sqrt(x*x+y*y+z*z);
     }
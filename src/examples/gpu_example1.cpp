@@ -30,10 +30,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <iostream>
 #include <random>
 #include <chrono>
+#include <memory>
 #include <stdexcept>
 #include <boost/program_options.hpp>
 #include "../core/LibBCSim.hpp"
 #include "../utils/GaussPulse.hpp"
+#include "../utils/HdfIqRecorder.hpp"
 #include "examples_common.hpp"
 
 /*
@@ -55,6 +57,7 @@ void example(int argc, char** argv) {
     float  num_seconds = 5.0;
     bool   enable_set_scatterers = true;
     bool   enable_simulate_lines = true;
+    std::string iq_file;
 
     boost::program_options::options_description desc("Allowed options");
     desc.add_options()
@@ -63,6 +66,7 @@ void example(int argc, char** argv) {
         ("num_seconds", boost::program_options::value<float>(), "set simulation running time (longer time gives better timing accuracy)")
         ("set_scatterers", boost::program_options::value<bool>(), "upload scatterers to GPU each time step")
         ("simulate_lines", boost::program_options::value<bool>(), "simulate lines each time step")
+        ("iq_file", boost::program_options::value<std::string>(), "record the simulated IQ lines to this HDF5 file")
     ;
     boost::program_options::variables_map var_map;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), var_map);
@@ -86,6 +90,9 @@ void example(int argc, char** argv) {
     if (var_map.count("simulate_lines") != 0) {
         enable_simulate_lines = var_map["simulate_lines"].as<bool>();
     }
+    if (var_map.count("iq_file") != 0) {
+        iq_file = var_map["iq_file"].as<std::string>();
+    }
 
     std::cout << "Number of scatterers is " << num_scatterers << ".\n";
     std::cout << "Simulations will run for " << num_seconds << " seconds." << std::endl;
@@ -140,6 +147,13 @@ void example(int argc, char** argv) {
     }
     sim->add_fixed_scatterers(scatterers);
     std::cout << "Created scatterers\n";
+
+    std::unique_ptr<bcsim::HdfIqRecorder> iq_recorder;
+    if (!iq_file.empty() && enable_simulate_lines) {
+        size_t num_lines, num_samples;
+        sim->get_output_dimensions(num_lines, num_samples);
+        iq_recorder.reset(new bcsim::HdfIqRecorder(iq_file, num_lines, num_samples));
+    }
     
     auto start = std::chrono::high_resolution_clock::now();
     size_t num_beams = 0;
@@ -159,6 +173,10 @@ void example(int argc, char** argv) {
         std::vector<std::vector<std::complex<float>>> sim_res;
         if (enable_simulate_lines) {
             sim->simulate_lines(sim_res);
+            if (iq_recorder) {
+                const auto frame_time = std::chrono::high_resolution_clock::now() - start;
+                iq_recorder->append(sim_res, std::chrono::duration<float>(frame_time).count());
+            }
         }
         num_beams++;
 
@@ -170,6 +188,10 @@ void example(int argc, char** argv) {
             break;
         }
     }
+    if (iq_recorder) {
+        iq_recorder->close();
+        std::cout << "Wrote " << iq_recorder->get_num_frames() << " frames to " << iq_file << ".\n";
+    }
     std::cout << "Done. Processed " << num_beams << " in " << elapsed << " seconds.\n";
     const auto prf = num_beams / elapsed;
     std::cout << "Achieved a PRF of " << prf << " Hz.\n";
@@ -149,11 +149,11 @@ void example(int argc, char** argv) {
     std::uniform_real_distribution<float> y_dist(-0.01f, 0.01f);
     std::uniform_real_distribution<float> z_dist(0.04f, 0.10f);
     std::uniform_real_distribution<float> a_dist(-1.0f, 1.0f);
-    spline_scatterers->control_points.clear();
+    spline_scatterers->resize(num_scatterers, num_cs);
     for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
-        spline_scatterers->amplitudes.push_back( a_dist(gen) );
+        spline_scatterers->amplitudes[scatterer_no] = a_dist(gen);
         for (size_t i = 0; i < num_cs; i++) {
-            spline_scatterers->control_points[scatterer_no].push_back( bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen)) );
+            spline_scatterers->set_control_point(scatterer_no, i, bcsim::vector3(x_dist(gen), y_dist(gen), z_dist(gen)));
         }
     }
 
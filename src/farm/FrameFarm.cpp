@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <unistd.h>
+#include "FrameFarm.hpp"
+#include "../core/LibBCSim.hpp"
+#include "../utils/HdfIqRecorder.hpp"
+
+namespace bcsim {
+namespace {
+
+const int TAG_REQUEST = 1;  // worker -> rank 0: finished task {first_frame, num_frames}
+const int TAG_FRAMES  = 2;  // worker -> rank 0: the samples of the finished task
+const int TAG_TASK    = 3;  // rank 0 -> worker: next task, with no frames to stop
+
+// Large messages are split, since MPI counts are ints.
+const size_t MAX_MESSAGE_ELEMENTS = size_t(1) << 30;
+
+void broadcast_bytes(MPI_Comm comm, std::vector<char>& bytes) {
+    uint64_t num_bytes = bytes.size();
+    MPI_Bcast(&num_bytes, 1, MPI_UINT64_T, 0, comm);
+    bytes.resize(static_cast<size_t>(num_bytes));
+    for (size_t offset = 0; offset < bytes.size(); offset += MAX_MESSAGE_ELEMENTS) {
+        const auto count = std::min(MAX_MESSAGE_ELEMENTS, bytes.size() - offset);
+        MPI_Bcast(bytes.data() + offset, static_cast<int>(count), MPI_CHAR, 0, comm);
+    }
+}
+
+void send_samples(MPI_Comm comm, int dest, const std::vector<std::complex<float>>& samples) {
+    for (size_t offset = 0; offset < samples.size(); offset += MAX_MESSAGE_ELEMENTS) {
+        const auto count = std::min(MAX_MESSAGE_ELEMENTS, samples.size() - offset);
+        MPI_Send(samples.data() + offset, static_cast<int>(count), MPI_C_FLOAT_COMPLEX, dest, TAG_FRAMES, comm);
+    }
+}
+
+void recv_samples(MPI_Comm comm, int source, std::vector<std::complex<float>>& samples) {
+    for (size_t offset = 0; offset < samples.size(); offset += MAX_MESSAGE_ELEMENTS) {
+        const auto count = std::min(MAX_MESSAGE_ELEMENTS, samples.size() - offset);
+        MPI_Recv(samples.data() + offset, static_cast<int>(count), MPI_C_FLOAT_COMPLEX, source, TAG_FRAMES, comm,
+                 MPI_STATUS_IGNORE);
+    }
+}
+
+// The contents of the state file read on rank 0, on all ranks.
+std::vector<char> broadcast_state(MPI_Comm comm, int rank, const FrameFarmConfig& config) {
+    std::vector<char> state;
+    if (rank == 0) {
+        std::ifstream in(config.state_file, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("failed to open state file " + config.state_file);
+        }
+        state.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    broadcast_bytes(comm, state);
+    return state;
+}
+
+IAlgorithm::s_ptr create_simulator(const std::vector<char>& state, int rank, const FrameFarmConfig& config) {
+    // load_state() reads a file, so the state is written to local scratch space
+    const auto local_file = config.scratch_dir + "/bcsim_farm_" + std::to_string(getpid()) + "_"
+                          + std::to_string(rank) + ".state";
+    {
+        std::ofstream out(local_file, std::ios::binary | std::ios::trunc);
+        out.write(state.data(), static_cast<std::streamsize>(state.size()));
+        if (!out) {
+            throw std::runtime_error("failed to write " + local_file);
+        }
+    }
+    auto sim = Create(config.sim_type);
+    try {
+        sim->load_state(local_file);
+    } catch (...) {
+        std::remove(local_file.c_str());
+        throw;
+    }
+    std::remove(local_file.c_str());
+
+    for (const auto& key_value : config.parameters) {
+        const auto pos = key_value.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("parameters must be given as key=value: " + key_value);
+        }
+        sim->set_parameter(key_value.substr(0, pos), key_value.substr(pos+1));
+    }
+    return sim;
+}
+
+// Simulate the frames [first_frame, first_frame + num_frames) as one stream.
+void simulate_frames(IAlgorithm& sim, const FrameFarmConfig& config, size_t first_frame, size_t num_frames,
+                     size_t frame_size, size_t num_samples, std::vector<std::complex<float>>& frames) {
+    std::vector<float> timestamp_offsets(num_frames);
+    for (size_t i = 0; i < num_frames; i++) {
+        timestamp_offsets[i] = (first_frame + i)*config.frame_dt;
+    }
+    frames.resize(num_frames*frame_size);
+    sim.begin_stream(timestamp_offsets);
+    for (size_t i = 0; i < num_frames; i++) {
+        sim.next_frame(frames.data() + i*frame_size, num_samples);
+    }
+}
+
+}   // end anonymous namespace
+
+FrameFarmStats run_frame_farm(MPI_Comm comm, const FrameFarmConfig& config) {
+    if ((config.num_frames == 0) || (config.frames_per_task == 0)) {
+        throw std::runtime_error("the farm needs frames and tasks of at least one frame");
+    }
+    if (config.output_file.empty()) {
+        throw std::runtime_error("no output file given");
+    }
+    int rank;
+    int num_ranks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_ranks);
+    const auto start_time = MPI_Wtime();
+
+    // rank 0 only simulates if it is alone, otherwise rank 1 tells it the
+    // frame size
+    IAlgorithm::s_ptr sim;
+    {
+        const auto state = broadcast_state(comm, rank, config);
+        if ((rank > 0) || (num_ranks == 1)) {
+            sim = create_simulator(state, rank, config);
+        }
+    }
+    uint64_t dimensions[2] = {0, 0};
+    if (sim) {
+        size_t num_lines;
+        size_t num_samples;
+        sim->get_output_dimensions(num_lines, num_samples);
+        dimensions[0] = num_lines;
+        dimensions[1] = num_samples;
+    }
+    MPI_Bcast(dimensions, 2, MPI_UINT64_T, (num_ranks == 1) ? 0 : 1, comm);
+    const auto num_lines   = static_cast<size_t>(dimensions[0]);
+    const auto num_samples = static_cast<size_t>(dimensions[1]);
+    const auto frame_size  = num_lines*num_samples;
+
+    uint64_t num_simulated = 0;
+    std::vector<std::complex<float>> frames;
+    if (rank == 0) {
+        HdfIqRecorder recorder(config.output_file, num_lines, num_samples, config.compression_level);
+
+        // frames that arrived before all earlier frames
+        std::map<size_t, std::vector<std::complex<float>>> pending;
+        size_t next_to_write = 0;
+        const auto store = [&](size_t first_frame, size_t num_frames, const std::vector<std::complex<float>>& samples) {
+            for (size_t i = 0; i < num_frames; i++) {
+                pending[first_frame + i].assign(samples.begin() + i*frame_size, samples.begin() + (i + 1)*frame_size);
+            }
+            for (auto it = pending.begin(); (it != pending.end()) && (it->first == next_to_write); it = pending.erase(it)) {
+                recorder.append(it->second.data(), num_samples, next_to_write*config.frame_dt);
+                next_to_write++;
+            }
+        };
+
+        size_t next_task = 0;
+        if (num_ranks == 1) {
+            for (; next_task < config.num_frames; next_task += config.frames_per_task) {
+                const auto num_frames = std::min(config.frames_per_task, config.num_frames - next_task);
+                simulate_frames(*sim, config, next_task, num_frames, frame_size, num_samples, frames);
+                store(next_task, num_frames, frames);
+                num_simulated += num_frames;
+            }
+        }
+
+        // hand out tasks to whoever asks until all workers are told to stop
+        int num_active_workers = num_ranks - 1;
+        while (num_active_workers > 0) {
+            uint64_t finished[2];
+            MPI_Status status;
+            MPI_Recv(finished, 2, MPI_UINT64_T, MPI_ANY_SOURCE, TAG_REQUEST, comm, &status);
+            const auto worker = status.MPI_SOURCE;
+            if (finished[1] > 0) {
+                frames.resize(static_cast<size_t>(finished[1])*frame_size);
+                recv_samples(comm, worker, frames);
+                store(static_cast<size_t>(finished[0]), static_cast<size_t>(finished[1]), frames);
+            }
+            uint64_t task[2] = {next_task, std::min<uint64_t>(config.frames_per_task, config.num_frames - next_task)};
+            next_task += static_cast<size_t>(task[1]);
+            MPI_Send(task, 2, MPI_UINT64_T, worker, TAG_TASK, comm);
+            if (task[1] == 0) {
+                num_active_workers--;
+            }
+        }
+        if (next_to_write != config.num_frames) {
+            throw std::runtime_error("frame farm lost frames");
+        }
+        recorder.close();
+    } else {
+        uint64_t finished[2] = {0, 0};
+        for (;;) {
+            MPI_Send(finished, 2, MPI_UINT64_T, 0, TAG_REQUEST, comm);
+            if (finished[1] > 0) {
+                send_samples(comm, 0, frames);
+            }
+            uint64_t task[2];
+            MPI_Recv(task, 2, MPI_UINT64_T, 0, TAG_TASK, comm, MPI_STATUS_IGNORE);
+            if (task[1] == 0) {
+                break;
+            }
+            simulate_frames(*sim, config, static_cast<size_t>(task[0]), static_cast<size_t>(task[1]), frame_size,
+                            num_samples, frames);
+            finished[0] = task[0];
+            finished[1] = task[1];
+            num_simulated += task[1];
+        }
+    }
+
+    FrameFarmStats stats;
+    std::vector<uint64_t> frames_per_rank(num_ranks);
+    MPI_Allgather(&num_simulated, 1, MPI_UINT64_T, frames_per_rank.data(), 1, MPI_UINT64_T, comm);
+    stats.frames_per_rank.assign(frames_per_rank.begin(), frames_per_rank.end());
+    stats.elapsed_sec = MPI_Wtime() - start_time;
+    return stats;
+}
+
+}   // end namespace
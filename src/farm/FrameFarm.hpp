@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+// Distributes the frames of a cine loop over MPI ranks, which each load the
+// same simulator state into a local simulator. Rank 0 reads the state file
+// once and broadcasts it, hands out tasks of consecutive frames to the ranks
+// that ask for work, and writes the frames to a HDF5 file in order as they
+// come back. Rank 0 only simulates when it is the only rank, so with a
+// GPU per node, one more rank than GPUs is started.
+
+namespace bcsim {
+
+struct FrameFarmConfig {
+    FrameFarmConfig()
+        : sim_type("cpu"), num_frames(1), frame_dt(0.0f), compression_level(0),
+          frames_per_task(1), scratch_dir("/tmp") { }
+
+    // state file written by IAlgorithm::save_state(), read on rank 0
+    std::string                 state_file;
+    // simulator type for Create()
+    std::string                 sim_type;
+    // key=value pairs applied after loading the state, e.g. thread counts
+    std::vector<std::string>    parameters;
+    size_t                      num_frames;
+    // frame k is simulated with k*frame_dt added to the timestamps [s]
+    float                       frame_dt;
+    // HDF5 file written on rank 0 by HdfIqRecorder
+    std::string                 output_file;
+    int                         compression_level;
+    size_t                      frames_per_task;
+    // where each rank writes the broadcast state before loading it
+    std::string                 scratch_dir;
+};
+
+struct FrameFarmStats {
+    // frames simulated by each rank (on all ranks)
+    std::vector<size_t>         frames_per_rank;
+    double                      elapsed_sec;
+};
+
+// Run the farm on all ranks of comm. Collective; exceptions on one rank
+// should be turned into MPI_Abort() by the caller, since the other ranks
+// would otherwise wait forever.
+FrameFarmStats run_frame_farm(MPI_Comm comm, const FrameFarmConfig& config);
+
+}   // end namespace
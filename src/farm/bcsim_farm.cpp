@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  Simulates the frames of a cine loop on all ranks of an MPI job, e.g.
+ *
+ *      mpirun -n 9 bcsim_farm --state cine.state --frames 1000 --frame_dt 0.02 --output cine.h5
+ *
+ *  The state file is written by save_state() of any simulator and holds the
+ *  whole configuration including the phantom. Rank 0 distributes it and
+ *  writes the frames, the other ranks simulate them.
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <mpi.h>
+#include <boost/program_options.hpp>
+#include "FrameFarm.hpp"
+
+namespace {
+
+int run(int argc, char** argv, int rank) {
+    bcsim::FrameFarmConfig config;
+
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("state", po::value<std::string>(&config.state_file)->required(), "simulator state file")
+        ("algorithm", po::value<std::string>(&config.sim_type)->default_value("cpu"), "simulator type to pass to Create()")
+        ("param", po::value<std::vector<std::string>>(&config.parameters)->multitoken(),
+            "simulator parameters as key=value, applied after loading the state")
+        ("frames", po::value<size_t>(&config.num_frames)->default_value(1), "number of frames")
+        ("frame_dt", po::value<float>(&config.frame_dt)->default_value(0.0f), "time between frames [s]")
+        ("output", po::value<std::string>(&config.output_file)->required(), "HDF5 file of the IQ frames")
+        ("compression", po::value<int>(&config.compression_level)->default_value(0), "deflate level in [0, 9]")
+        ("frames_per_task", po::value<size_t>(&config.frames_per_task)->default_value(1),
+            "frames handed out to a rank at a time")
+        ("scratch_dir", po::value<std::string>(&config.scratch_dir)->default_value("/tmp"),
+            "node-local directory for the state file of each rank")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    if (var_map.count("help") != 0) {
+        if (rank == 0) std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(var_map);
+
+    const auto stats = bcsim::run_frame_farm(MPI_COMM_WORLD, config);
+    if (rank == 0) {
+        std::cout << "Simulated " << config.num_frames << " frames in " << stats.elapsed_sec << " sec" << std::endl;
+        for (size_t rank_no = 0; rank_no < stats.frames_per_rank.size(); rank_no++) {
+            std::cout << "  rank " << rank_no << ": " << stats.frames_per_rank[rank_no] << " frames" << std::endl;
+        }
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    try {
+        const auto res = run(argc, argv, rank);
+        MPI_Finalize();
+        return res;
+    } catch (const std::exception& e) {
+        // the other ranks may be waiting for this one
+        std::cerr << "Rank " << rank << " caught exception: " << e.what() << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+}
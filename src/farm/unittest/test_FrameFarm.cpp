@@ -0,0 +1,127 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE FrameFarmTests
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <mpi.h>
+#include <H5Cpp.h>
+#include "../FrameFarm.hpp"
+#include "../../core/LibBCSim.hpp"
+#include "../../core/unittest/temp_path.hpp"
+
+namespace {
+
+const std::string state_file_path = bcsim::test::temp_path("test_FrameFarm.state");
+const char* state_file  = state_file_path.c_str();
+const char* output_file = "test_FrameFarm.h5";
+
+struct MpiFixture {
+    MpiFixture()  { MPI_Init(nullptr, nullptr); }
+    ~MpiFixture() { MPI_Finalize(); }
+};
+
+struct ComplexSample {
+    float r;
+    float i;
+};
+
+// A few scatterers moving in depth along linear splines on t in [0, 1].
+bcsim::IAlgorithm::s_ptr make_simulator() {
+    auto sim = bcsim::Create("cpu");
+    sim->set_parameter("verbose", "0");
+    bcsim::ExcitationSignal excitation;
+    excitation.sampling_frequency = 50e6f;
+    excitation.center_index = 0;
+    excitation.demod_freq = 2.5e6f;
+    for (int i = 0; i < 32; i++) excitation.samples.push_back(std::sin(0.3f*i));
+    sim->set_excitation(excitation);
+    auto scan_seq = std::make_shared<bcsim::ScanSequence>(0.05f);
+    for (int i = 0; i < 8; i++) {
+        scan_seq->add_scanline(bcsim::Scanline(bcsim::vector3(1e-3f*(i - 4), 0.0f, 0.0f), bcsim::vector3(0.0f, 0.0f, 1.0f),
+                                               bcsim::vector3(1.0f, 0.0f, 0.0f), 0.0f));
+    }
+    sim->set_scan_sequence(scan_seq);
+    sim->set_analytical_profile(std::make_shared<bcsim::GaussianBeamProfile>(1e-3f, 1e-3f));
+    auto splines = std::make_shared<bcsim::SplineScatterers>();
+    splines->spline_degree = 1;
+    splines->knot_vector = {0.0f, 0.0f, 1.0f, 1.0f};
+    splines->resize(5, 2);
+    for (size_t i = 0; i < 5; i++) {
+        const auto x = 1e-3f*(static_cast<float>(i) - 2.0f);
+        splines->set_control_point(i, 0, bcsim::vector3(x, 0.0f, 0.01f));
+        splines->set_control_point(i, 1, bcsim::vector3(x, 0.0f, 0.04f));
+        splines->amplitudes[i] = 1.0f;
+    }
+    sim->add_spline_scatterers(splines);
+    return sim;
+}
+
+}
+
+BOOST_GLOBAL_FIXTURE(MpiFixture);
+
+// The frames written by the farm are the frames of one stream, on any
+// number of ranks.
+BOOST_AUTO_TEST_CASE(FramesAreWrittenInOrder) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    const size_t num_frames = 7;
+    const float frame_dt = 0.1f;
+    auto sim = make_simulator();
+    if (rank == 0) {
+        sim->save_state(state_file);
+    }
+
+    bcsim::FrameFarmConfig config;
+    config.state_file = state_file;
+    config.num_frames = num_frames;
+    config.frame_dt = frame_dt;
+    config.output_file = output_file;
+    config.frames_per_task = 2;
+    config.scratch_dir = ".";
+    const auto stats = bcsim::run_frame_farm(MPI_COMM_WORLD, config);
+    size_t total = 0;
+    for (const auto count : stats.frames_per_rank) total += count;
+    BOOST_CHECK_EQUAL(total, num_frames);
+    if (rank != 0) {
+        return;
+    }
+
+    size_t num_lines;
+    size_t num_samples;
+    sim->get_output_dimensions(num_lines, num_samples);
+    const auto frame_size = num_lines*num_samples;
+    std::vector<float> offsets(num_frames);
+    for (size_t i = 0; i < num_frames; i++) offsets[i] = i*frame_dt;
+    std::vector<std::complex<float>> expected(num_frames*frame_size);
+    sim->begin_stream(offsets);
+    for (size_t i = 0; i < num_frames; i++) {
+        sim->next_frame(expected.data() + i*frame_size, num_samples);
+    }
+
+    H5::H5File file(output_file, H5F_ACC_RDONLY);
+    auto iq_dataset = file.openDataSet("iq");
+    hsize_t dims[3];
+    iq_dataset.getSpace().getSimpleExtentDims(dims);
+    BOOST_REQUIRE_EQUAL(dims[0], num_frames);
+    BOOST_REQUIRE_EQUAL(dims[1], num_lines);
+    BOOST_REQUIRE_EQUAL(dims[2], num_samples);
+    H5::CompType sample_type(sizeof(ComplexSample));
+    sample_type.insertMember("r", HOFFSET(ComplexSample, r), H5::PredType::NATIVE_FLOAT);
+    sample_type.insertMember("i", HOFFSET(ComplexSample, i), H5::PredType::NATIVE_FLOAT);
+    std::vector<ComplexSample> samples(expected.size());
+    iq_dataset.read(samples.data(), sample_type);
+    size_t num_wrong = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        num_wrong += (samples[i].r != expected[i].real()) || (samples[i].i != expected[i].imag());
+    }
+    BOOST_CHECK_EQUAL(num_wrong, 0u);
+    // the scatterers move, so the order of the frames matters
+    BOOST_CHECK(std::vector<std::complex<float>>(expected.begin(), expected.begin() + frame_size)
+                != std::vector<std::complex<float>>(expected.begin() + frame_size, expected.begin() + 2*frame_size));
+    std::remove(state_file);
+    std::remove(output_file);
+}
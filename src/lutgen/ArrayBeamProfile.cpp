@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <H5Cpp.h>
+#include "ArrayBeamProfile.hpp"
+#include "ArrayBeamProfileKernel.hpp"
+
+namespace bcsim {
+
+void buildArrayModel(const ArrayBeamProfileConfig& config, ArrayModel& model) {
+    const auto& array = config.array;
+    if (array.num_elements < 1) {
+        throw std::runtime_error("the array must have at least one element");
+    }
+    if ((array.kerf < 0.0f) || (array.pitch <= array.kerf) || (array.element_height <= 0.0f)) {
+        throw std::runtime_error("invalid element dimensions");
+    }
+    if ((array.num_sub_x < 1) || (array.num_sub_y < 1)) {
+        throw std::runtime_error("the elements must have at least one subdivision");
+    }
+    if ((config.num_frequencies < 1) || (config.num_frequencies > ArrayBeamProfileConfig::MAX_FREQUENCIES)) {
+        throw std::runtime_error("num_frequencies must be in [1, " + std::to_string(ArrayBeamProfileConfig::MAX_FREQUENCIES) + "]");
+    }
+    if ((config.center_frequency <= 0.0f) || (config.sound_speed <= 0.0f) || (config.attenuation < 0.0f)) {
+        throw std::runtime_error("invalid center frequency, sound speed or attenuation");
+    }
+    if ((config.num_frequencies > 1) && (config.bandwidth <= 0.0f)) {
+        throw std::runtime_error("the bandwidth must be positive");
+    }
+    if ((config.num_rad_samples < 2) || (config.num_lat_samples < 2) || (config.num_ele_samples < 2)) {
+        throw std::runtime_error("the grid needs at least two samples in each dimension");
+    }
+
+    model.element_x.resize(array.num_elements);
+    model.tx_weight.resize(array.num_elements);
+    model.tx_path.resize(array.num_elements);
+    // as Matlab's hanning(num_elements), which is non-zero at the ends
+    const float full_half_aperture = 0.5f*(array.num_elements + 1)*array.pitch;
+    for (int element_no = 0; element_no < array.num_elements; element_no++) {
+        const float element_x = (element_no - 0.5f*(array.num_elements - 1))*array.pitch;
+        model.element_x[element_no] = element_x;
+        model.tx_weight[element_no] = apodizationWeight(static_cast<int>(config.tx_apodization), element_x/full_half_aperture);
+        model.tx_path[element_no] = (config.tx_focus > 0.0f) ? std::sqrt(config.tx_focus*config.tx_focus + element_x*element_x) : 0.0f;
+    }
+
+    const float element_width = array.pitch - array.kerf;
+    model.source_x.clear();
+    model.source_y.clear();
+    model.source_lens.clear();
+    model.source_element.clear();
+    for (int element_no = 0; element_no < array.num_elements; element_no++) {
+        for (int sub_x = 0; sub_x < array.num_sub_x; sub_x++) {
+            for (int sub_y = 0; sub_y < array.num_sub_y; sub_y++) {
+                const float x = model.element_x[element_no] + element_width*((sub_x + 0.5f)/array.num_sub_x - 0.5f);
+                const float y = array.element_height*((sub_y + 0.5f)/array.num_sub_y - 0.5f);
+                // the lens delays the center so that all paths to the
+                // elevation focus are equally long
+                const float focus = array.elevation_focus;
+                const float lens = (focus > 0.0f) ? focus - std::sqrt(focus*focus + y*y) : 0.0f;
+                model.source_x.push_back(x);
+                model.source_y.push_back(y);
+                model.source_lens.push_back(lens);
+                model.source_element.push_back(element_no);
+            }
+        }
+    }
+
+    // Gaussian pulse-echo spectrum over +-3 sigma
+    model.spectrum_power.resize(config.num_frequencies);
+    const float sigma = 0.5f*config.bandwidth*config.center_frequency/std::sqrt(2.0f*std::log(2.0f));
+    float first_frequency = config.center_frequency;
+    float frequency_step = 0.0f;
+    if (config.num_frequencies > 1) {
+        first_frequency = std::max(config.center_frequency - 3.0f*sigma, 0.0f);
+        frequency_step = 2.0f*(config.center_frequency - first_frequency)/(config.num_frequencies - 1);
+    }
+    for (int freq_no = 0; freq_no < config.num_frequencies; freq_no++) {
+        const float offset = first_frequency + freq_no*frequency_step - config.center_frequency;
+        model.spectrum_power[freq_no] = (config.num_frequencies > 1) ? std::exp(-offset*offset/(sigma*sigma)) : 1.0f;
+    }
+
+    auto& view = model.view;
+    view.num_sources            = static_cast<int>(model.source_x.size());
+    view.source_x               = model.source_x.data();
+    view.source_y               = model.source_y.data();
+    view.source_lens            = model.source_lens.data();
+    view.source_element         = model.source_element.data();
+    view.element_x              = model.element_x.data();
+    view.tx_weight              = model.tx_weight.data();
+    view.tx_path                = model.tx_path.data();
+    view.pitch                  = array.pitch;
+    view.full_half_aperture     = full_half_aperture;
+    view.rx_focus               = config.rx_focus;
+    view.rx_f_number            = config.rx_f_number;
+    view.rx_window              = static_cast<int>(config.rx_apodization);
+    view.num_frequencies        = config.num_frequencies;
+    view.first_frequency        = first_frequency;
+    view.frequency_step         = frequency_step;
+    view.spectrum_power         = model.spectrum_power.data();
+    view.phase_per_hz_m         = static_cast<float>(2.0*3.14159265358979/config.sound_speed);
+    // dB/(MHz cm) to Np/(Hz m)
+    view.attenuation_per_hz_m   = config.attenuation*100.0f*1e-6f*std::log(10.0f)/20.0f;
+}
+
+ArrayBeamProfileTable makeEmptyTable(const ArrayBeamProfileConfig& config) {
+    ArrayBeamProfileTable table{config.num_rad_samples, config.num_lat_samples, config.num_ele_samples,
+                                config.rad_range, config.lat_range, config.ele_range, {}};
+    table.samples.resize(static_cast<size_t>(table.num_rad_samples)*table.num_lat_samples*table.num_ele_samples, 0.0f);
+    return table;
+}
+
+void normalizeTable(ArrayBeamProfileTable& table) {
+    const auto max_value = *std::max_element(table.samples.begin(), table.samples.end());
+    if (max_value > 0.0f) {
+        for (auto& sample : table.samples) {
+            sample /= max_value;
+        }
+    }
+}
+
+ArrayBeamProfileTable simulateArrayBeamProfile(const ArrayBeamProfileConfig& config) {
+    ArrayModel model;
+    buildArrayModel(config, model);
+    auto table = makeEmptyTable(config);
+
+    // the ranges of a radial line are independent, so a task is a line
+    const int num_lines = table.num_rad_samples*table.num_lat_samples;
+    #pragma omp parallel for schedule(dynamic)
+    for (int line_no = 0; line_no < num_lines; line_no++) {
+        const int rad_no = line_no/table.num_lat_samples;
+        const int lat_no = line_no%table.num_lat_samples;
+        const float z = gridCoordinate(table.rad_range.first, table.rad_range.last, table.num_rad_samples, rad_no);
+        const float x = gridCoordinate(table.lat_range.first, table.lat_range.last, table.num_lat_samples, lat_no);
+        for (int ele_no = 0; ele_no < table.num_ele_samples; ele_no++) {
+            const float y = gridCoordinate(table.ele_range.first, table.ele_range.last, table.num_ele_samples, ele_no);
+            table.samples[static_cast<size_t>(line_no)*table.num_ele_samples + ele_no] = pulseEchoAmplitude(model.view, x, y, z);
+        }
+    }
+    normalizeTable(table);
+    return table;
+}
+
+void saveBeamProfileToHdf(const std::string& h5_file, const ArrayBeamProfileTable& table) {
+    const auto num_samples = static_cast<size_t>(table.num_rad_samples)*table.num_lat_samples*table.num_ele_samples;
+    if (table.samples.size() != num_samples) {
+        throw std::runtime_error("the number of samples does not match the table dimensions");
+    }
+    try {
+        H5::H5File file(h5_file, H5F_ACC_TRUNC);
+        const hsize_t dims[3] = {static_cast<hsize_t>(table.num_rad_samples),
+                                 static_cast<hsize_t>(table.num_lat_samples),
+                                 static_cast<hsize_t>(table.num_ele_samples)};
+        file.createDataSet("beam_profile", H5::PredType::NATIVE_FLOAT, H5::DataSpace(3, dims))
+            .write(table.samples.data(), H5::PredType::NATIVE_FLOAT);
+        const hsize_t extent_dims[1] = {2};
+        const auto write_extent = [&](const std::string& name, const Interval& range) {
+            const float extent[2] = {range.first, range.last};
+            file.createDataSet(name, H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, extent_dims))
+                .write(extent, H5::PredType::NATIVE_FLOAT);
+        };
+        write_extent("rad_extent", table.rad_range);
+        write_extent("lat_extent", table.lat_range);
+        write_extent("ele_extent", table.ele_range);
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to write " + h5_file + ": " + e.getDetailMsg());
+    }
+}
+
+}   // end namespace
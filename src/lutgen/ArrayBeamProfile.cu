@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <memory>
+#include <vector>
+#include <cuda.h>
+#include "ArrayBeamProfile.hpp"
+#include "ArrayBeamProfileKernel.hpp"
+#include "../core/algorithm/cuda_helpers.h"
+
+namespace bcsim {
+namespace {
+
+// The grid of an ArrayBeamProfileTable without the samples.
+struct GridView {
+    int         num_rad_samples;
+    int         num_lat_samples;
+    int         num_ele_samples;
+    Interval    rad_range;
+    Interval    lat_range;
+    Interval    ele_range;
+};
+
+// One thread per grid point.
+__global__ void ArrayBeamProfileKernel(ArrayModelView model, GridView table, float* samples) {
+    const int ele_no = blockIdx.x*blockDim.x + threadIdx.x;
+    const int lat_no = blockIdx.y;
+    const int rad_no = blockIdx.z;
+    if (ele_no >= table.num_ele_samples) {
+        return;
+    }
+    const float z = gridCoordinate(table.rad_range.first, table.rad_range.last, table.num_rad_samples, rad_no);
+    const float x = gridCoordinate(table.lat_range.first, table.lat_range.last, table.num_lat_samples, lat_no);
+    const float y = gridCoordinate(table.ele_range.first, table.ele_range.last, table.num_ele_samples, ele_no);
+    samples[(static_cast<size_t>(rad_no)*table.num_lat_samples + lat_no)*table.num_ele_samples + ele_no] =
+        pulseEchoAmplitude(model, x, y, z);
+}
+
+template <typename T>
+T* copy_to_device(const std::vector<T>& values, std::vector<std::unique_ptr<DeviceBufferRAII<T>>>& buffers) {
+    buffers.emplace_back(new DeviceBufferRAII<T>(values.size()*sizeof(T)));
+    cudaErrorCheck( cudaMemcpy(buffers.back()->data(), values.data(), values.size()*sizeof(T), cudaMemcpyHostToDevice) );
+    return buffers.back()->data();
+}
+
+}   // end anonymous namespace
+
+ArrayBeamProfileTable simulateArrayBeamProfileGpu(const ArrayBeamProfileConfig& config) {
+    ArrayModel model;
+    buildArrayModel(config, model);
+    auto table = makeEmptyTable(config);
+
+    std::vector<std::unique_ptr<DeviceBufferRAII<float>>> float_buffers;
+    std::vector<std::unique_ptr<DeviceBufferRAII<int>>> int_buffers;
+    auto device_view = model.view;
+    device_view.source_x        = copy_to_device(model.source_x, float_buffers);
+    device_view.source_y        = copy_to_device(model.source_y, float_buffers);
+    device_view.source_lens     = copy_to_device(model.source_lens, float_buffers);
+    device_view.source_element  = copy_to_device(model.source_element, int_buffers);
+    device_view.element_x       = copy_to_device(model.element_x, float_buffers);
+    device_view.tx_weight       = copy_to_device(model.tx_weight, float_buffers);
+    device_view.tx_path         = copy_to_device(model.tx_path, float_buffers);
+    device_view.spectrum_power  = copy_to_device(model.spectrum_power, float_buffers);
+
+    const auto num_bytes = table.samples.size()*sizeof(float);
+    DeviceBufferRAII<float> device_samples(num_bytes);
+    const int threads_per_block = 128;
+    const dim3 grid_size(round_up_div(table.num_ele_samples, threads_per_block), table.num_lat_samples, table.num_rad_samples);
+    const GridView grid{table.num_rad_samples, table.num_lat_samples, table.num_ele_samples,
+                        table.rad_range, table.lat_range, table.ele_range};
+    ArrayBeamProfileKernel<<<grid_size, threads_per_block>>>(device_view, grid, device_samples.data());
+    cudaErrorCheck( cudaGetLastError() );
+    cudaErrorCheck( cudaMemcpy(table.samples.data(), device_samples.data(), num_bytes, cudaMemcpyDeviceToHost) );
+
+    normalizeTable(table);
+    return table;
+}
+
+}   // end namespace
@@ -0,0 +1,135 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include "../core/BCSimConfig.hpp"
+
+namespace bcsim {
+
+enum class ApodizationWindow {
+    RECTANGULAR,
+    HANN,           // as Matlab's hanning(), which is non-zero at the ends
+    HAMMING
+};
+
+// A one-dimensional array along x in the plane z = 0, centered on the
+// origin, which covers both linear and phased arrays. Each element is
+// subdivided into num_sub_x by num_sub_y point sources.
+struct LinearArrayGeometry {
+    LinearArrayGeometry()
+        : num_elements(64), pitch(0.3e-3f), kerf(0.03e-3f), element_height(10e-3f),
+          elevation_focus(0.0f), num_sub_x(2), num_sub_y(10) { }
+
+    int     num_elements;
+    float   pitch;              // [m]
+    float   kerf;               // [m]
+    float   element_height;     // [m]
+    // depth [m] of the fixed acoustic lens, or 0 for none
+    float   elevation_focus;
+    int     num_sub_x;
+    int     num_sub_y;
+};
+
+// The pulse-echo beam profile of an array along the z axis, sampled on a
+// grid in the beam coordinate system of LUTBeamProfile: z is radial, x is
+// lateral and y is elevational.
+//
+// The transmit and receive fields are sums of point sources over the
+// elements (the Rayleigh integral), evaluated at num_frequencies
+// frequencies of a Gaussian pulse-echo spectrum. A sample is the
+// root-sum-of-squares of the pulse-echo signal at the point, as computed
+// from calc_hhp() by matlab/sim_lut_hdf5.m, by Parseval's theorem. With one
+// frequency it is the continuous wave profile at the center frequency.
+struct ArrayBeamProfileConfig {
+    ArrayBeamProfileConfig()
+        : sound_speed(1540.0f), center_frequency(3.5e6f), bandwidth(0.5f), num_frequencies(16),
+          attenuation(0.0f), tx_focus(60e-3f), tx_apodization(ApodizationWindow::RECTANGULAR),
+          rx_focus(0.0f), rx_f_number(0.0f), rx_apodization(ApodizationWindow::RECTANGULAR),
+          rad_range(0.0f, 0.12f), lat_range(-10e-3f, 10e-3f), ele_range(-10e-3f, 10e-3f),
+          num_rad_samples(128), num_lat_samples(32), num_ele_samples(32) { }
+
+    LinearArrayGeometry     array;
+    float                   sound_speed;        // [m/s]
+    float                   center_frequency;   // [Hz]
+    // fractional -6 dB bandwidth of the pulse-echo spectrum
+    float                   bandwidth;
+    // at most MAX_FREQUENCIES
+    int                     num_frequencies;
+    float                   attenuation;        // [dB/(MHz cm)]
+
+    // transmit focus depth [m], or 0 for an unfocused transmit
+    float                   tx_focus;
+    ApodizationWindow       tx_apodization;
+
+    // receive focus depth [m], or 0 for dynamic focus at the depth of
+    // each point
+    float                   rx_focus;
+    // if positive: the receive aperture grows with depth z as z/rx_f_number
+    float                   rx_f_number;
+    ApodizationWindow       rx_apodization;
+
+    Interval                rad_range;          // [m]
+    Interval                lat_range;
+    Interval                ele_range;
+    int                     num_rad_samples;
+    int                     num_lat_samples;
+    int                     num_ele_samples;
+
+    static const int MAX_FREQUENCIES = 64;
+};
+
+// A simulated profile in the layout of LUTBeamProfile, normalized to a
+// maximum of one.
+struct ArrayBeamProfileTable {
+    int                 num_rad_samples;
+    int                 num_lat_samples;
+    int                 num_ele_samples;
+    Interval            rad_range;
+    Interval            lat_range;
+    Interval            ele_range;
+    // index (rad_no*num_lat_samples + lat_no)*num_ele_samples + ele_no
+    std::vector<float>  samples;
+};
+
+// Simulate on all cores with OpenMP. Throws std::runtime_error if the
+// configuration is invalid.
+ArrayBeamProfileTable simulateArrayBeamProfile(const ArrayBeamProfileConfig& config);
+
+#ifdef BCSIM_ENABLE_CUDA
+// Simulate on the current CUDA device.
+ArrayBeamProfileTable simulateArrayBeamProfileGpu(const ArrayBeamProfileConfig& config);
+#endif
+
+// Write the data sets beam_profile, rad_extent, lat_extent and ele_extent
+// which are read by loadBeamProfileFromHdf().
+void saveBeamProfileToHdf(const std::string& h5_file, const ArrayBeamProfileTable& table);
+
+}   // end namespace
@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cmath>
+#include <vector>
+#include "ArrayBeamProfile.hpp"
+
+// The evaluation of one grid point, shared by the CPU and the CUDA
+// implementation.
+
+#ifdef __CUDACC__
+    #define BCSIM_HOST_DEVICE __host__ __device__
+#else
+    #define BCSIM_HOST_DEVICE
+#endif
+
+namespace bcsim {
+
+// An ArrayBeamProfileConfig in flat arrays, either in host or device memory.
+struct ArrayModelView {
+    int             num_sources;
+    const float*    source_x;
+    const float*    source_y;
+    const float*    source_lens;        // path through the lens [m]
+    const int*      source_element;
+    const float*    element_x;
+    const float*    tx_weight;          // per element
+    const float*    tx_path;            // from the element to the focus [m]
+    float           pitch;
+    float           full_half_aperture;
+    float           rx_focus;
+    float           rx_f_number;
+    int             rx_window;
+    int             num_frequencies;
+    float           first_frequency;    // [Hz]
+    float           frequency_step;     // [Hz]
+    const float*    spectrum_power;     // per frequency
+    float           phase_per_hz_m;     // 2*pi/c
+    float           attenuation_per_hz_m;
+};
+
+// The model in host memory.
+struct ArrayModel {
+    std::vector<float>  source_x;
+    std::vector<float>  source_y;
+    std::vector<float>  source_lens;
+    std::vector<int>    source_element;
+    std::vector<float>  element_x;
+    std::vector<float>  tx_weight;
+    std::vector<float>  tx_path;
+    std::vector<float>  spectrum_power;
+    ArrayModelView      view;           // with the pointers into this
+};
+
+// Throws std::runtime_error if the configuration is invalid.
+void buildArrayModel(const ArrayBeamProfileConfig& config, ArrayModel& model);
+
+// A table with the grid of the configuration and zeroed samples.
+ArrayBeamProfileTable makeEmptyTable(const ArrayBeamProfileConfig& config);
+
+// Divide the samples by the largest one.
+void normalizeTable(ArrayBeamProfileTable& table);
+
+BCSIM_HOST_DEVICE inline float gridCoordinate(float first, float last, int num_samples, int sample_no) {
+    return first + sample_no*(last - first)/(num_samples - 1);
+}
+
+// The apodization at u in [-1, 1] relative to the aperture, zero outside.
+BCSIM_HOST_DEVICE inline float apodizationWeight(int window, float u) {
+    if (std::fabs(u) >= 1.0f) {
+        return 0.0f;
+    }
+    const float pi = 3.14159265358979f;
+    switch (static_cast<ApodizationWindow>(window)) {
+    case ApodizationWindow::HANN:
+        return 0.5f*(1.0f + cosf(pi*u));
+    case ApodizationWindow::HAMMING:
+        return 0.54f + 0.46f*cosf(pi*u);
+    default:
+        return 1.0f;
+    }
+}
+
+BCSIM_HOST_DEVICE inline float receiveWeight(const ArrayModelView& model, float element_x, float z) {
+    float half_aperture = model.full_half_aperture;
+    if (model.rx_f_number > 0.0f) {
+        half_aperture = fminf(fmaxf(0.5f*z/model.rx_f_number, model.pitch), half_aperture);
+    }
+    return apodizationWeight(model.rx_window, element_x/half_aperture);
+}
+
+// Add a*exp(-(attenuation + j*phase)*path_length*f) for all frequencies,
+// rotating the phasor from one frequency to the next.
+BCSIM_HOST_DEVICE inline void accumulateSource(const ArrayModelView& model, float amplitude, float decay_length,
+                                               float path_length, float* re, float* im) {
+    const float decay = model.attenuation_per_hz_m*decay_length;
+    const float phase = model.phase_per_hz_m*path_length;
+    const float first_magnitude = amplitude*expf(-decay*model.first_frequency);
+    // the phase in double, since it is many turns
+    const double first_phase = static_cast<double>(phase)*model.first_frequency;
+    const float first_angle = static_cast<float>(first_phase - 6.283185307179586*floor(first_phase/6.283185307179586));
+    float zr = first_magnitude*cosf(first_angle);
+    float zi = -first_magnitude*sinf(first_angle);
+    const float step_magnitude = expf(-decay*model.frequency_step);
+    const float step_r = step_magnitude*cosf(phase*model.frequency_step);
+    const float step_i = -step_magnitude*sinf(phase*model.frequency_step);
+    for (int freq_no = 0; freq_no < model.num_frequencies; freq_no++) {
+        re[freq_no] += zr;
+        im[freq_no] += zi;
+        const float next_r = zr*step_r - zi*step_i;
+        zi = zr*step_i + zi*step_r;
+        zr = next_r;
+    }
+}
+
+// The root-sum-of-squares of the pulse-echo signal at (x, y, z).
+BCSIM_HOST_DEVICE inline float pulseEchoAmplitude(const ArrayModelView& model, float x, float y, float z) {
+    float tx_re[ArrayBeamProfileConfig::MAX_FREQUENCIES];
+    float tx_im[ArrayBeamProfileConfig::MAX_FREQUENCIES];
+    float rx_re[ArrayBeamProfileConfig::MAX_FREQUENCIES];
+    float rx_im[ArrayBeamProfileConfig::MAX_FREQUENCIES];
+    for (int freq_no = 0; freq_no < model.num_frequencies; freq_no++) {
+        tx_re[freq_no] = 0.0f;
+        tx_im[freq_no] = 0.0f;
+        rx_re[freq_no] = 0.0f;
+        rx_im[freq_no] = 0.0f;
+    }
+
+    const float rx_focus = (model.rx_focus > 0.0f) ? model.rx_focus : z;
+    for (int source_no = 0; source_no < model.num_sources; source_no++) {
+        const int element_no = model.source_element[source_no];
+        const float element_x = model.element_x[element_no];
+        const float dx = x - model.source_x[source_no];
+        const float dy = y - model.source_y[source_no];
+        const float r = fmaxf(sqrtf(dx*dx + dy*dy + z*z), 1e-6f);
+        const float path_length = r + model.source_lens[source_no];
+
+        const float tx_weight = model.tx_weight[element_no];
+        if (tx_weight != 0.0f) {
+            accumulateSource(model, tx_weight/r, r, path_length - model.tx_path[element_no], tx_re, tx_im);
+        }
+        const float rx_weight = receiveWeight(model, element_x, z);
+        if (rx_weight != 0.0f) {
+            const float rx_path = sqrtf(rx_focus*rx_focus + element_x*element_x);
+            accumulateSource(model, rx_weight/r, r, path_length - rx_path, rx_re, rx_im);
+        }
+    }
+
+    float energy = 0.0f;
+    for (int freq_no = 0; freq_no < model.num_frequencies; freq_no++) {
+        const float tx_power = tx_re[freq_no]*tx_re[freq_no] + tx_im[freq_no]*tx_im[freq_no];
+        const float rx_power = rx_re[freq_no]*rx_re[freq_no] + rx_im[freq_no]*rx_im[freq_no];
+        energy += model.spectrum_power[freq_no]*tx_power*rx_power;
+    }
+    return sqrtf(energy);
+}
+
+}   // end namespace
@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  Simulates the pulse-echo beam profile of a linear or phased array and
+ *  writes it as a lookup table for LUTBeamProfile, e.g. for the phased
+ *  array of matlab/sim_profile_cardiac.m:
+ *
+ *      bcsim_lutgen --output cardiac_lut.h5 --num_elements 71 --pitch 0.2617e-3 --kerf 0.025e-3
+ *                   --element_height 15e-3 --elevation_focus 70e-3 --num_sub_x 5 --num_sub_y 25
+ *                   --center_frequency 3e6 --tx_focus 70e-3 --tx_apodization hann --rx_apodization hann
+ *                   --attenuation 0.5 --rad_min 0 --rad_max 0.15
+ */
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <boost/program_options.hpp>
+#include "ArrayBeamProfile.hpp"
+
+namespace {
+
+bcsim::ApodizationWindow parse_window(const std::string& name) {
+    if (name == "rectangular") {
+        return bcsim::ApodizationWindow::RECTANGULAR;
+    } else if (name == "hann") {
+        return bcsim::ApodizationWindow::HANN;
+    } else if (name == "hamming") {
+        return bcsim::ApodizationWindow::HAMMING;
+    }
+    throw std::runtime_error("unknown apodization window: " + name);
+}
+
+bcsim::ArrayBeamProfileTable simulate(const std::string& device, const bcsim::ArrayBeamProfileConfig& config) {
+    if (device == "cpu") {
+        return bcsim::simulateArrayBeamProfile(config);
+    } else if (device == "gpu") {
+#ifdef BCSIM_ENABLE_CUDA
+        return bcsim::simulateArrayBeamProfileGpu(config);
+#else
+        throw std::runtime_error("built without CUDA support");
+#endif
+    }
+    throw std::runtime_error("unknown device: " + device);
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        bcsim::ArrayBeamProfileConfig config;
+        auto& array = config.array;
+        std::string output_file;
+        std::string device;
+        std::string tx_apodization;
+        std::string rx_apodization;
+
+        namespace po = boost::program_options;
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help", "show help message")
+            ("output", po::value<std::string>(&output_file)->required(), "output HDF5 beam profile")
+            ("device", po::value<std::string>(&device)->default_value("cpu"), "cpu or gpu")
+            ("num_elements", po::value<int>(&array.num_elements)->default_value(array.num_elements), "number of elements")
+            ("pitch", po::value<float>(&array.pitch)->default_value(array.pitch), "element pitch [m]")
+            ("kerf", po::value<float>(&array.kerf)->default_value(array.kerf), "kerf [m]")
+            ("element_height", po::value<float>(&array.element_height)->default_value(array.element_height), "element height [m]")
+            ("elevation_focus", po::value<float>(&array.elevation_focus)->default_value(array.elevation_focus),
+                "depth of the acoustic lens focus [m], 0 for none")
+            ("num_sub_x", po::value<int>(&array.num_sub_x)->default_value(array.num_sub_x), "lateral subdivisions of an element")
+            ("num_sub_y", po::value<int>(&array.num_sub_y)->default_value(array.num_sub_y), "elevational subdivisions of an element")
+            ("sound_speed", po::value<float>(&config.sound_speed)->default_value(config.sound_speed), "speed of sound [m/s]")
+            ("center_frequency", po::value<float>(&config.center_frequency)->default_value(config.center_frequency), "[Hz]")
+            ("bandwidth", po::value<float>(&config.bandwidth)->default_value(config.bandwidth),
+                "fractional -6 dB bandwidth of the pulse-echo spectrum")
+            ("num_frequencies", po::value<int>(&config.num_frequencies)->default_value(config.num_frequencies),
+                "frequencies of the spectrum, 1 for continuous wave")
+            ("attenuation", po::value<float>(&config.attenuation)->default_value(config.attenuation), "[dB/(MHz cm)]")
+            ("tx_focus", po::value<float>(&config.tx_focus)->default_value(config.tx_focus), "transmit focus depth [m], 0 for none")
+            ("tx_apodization", po::value<std::string>(&tx_apodization)->default_value("rectangular"), "rectangular, hann or hamming")
+            ("rx_focus", po::value<float>(&config.rx_focus)->default_value(config.rx_focus), "receive focus depth [m], 0 for dynamic")
+            ("rx_f_number", po::value<float>(&config.rx_f_number)->default_value(config.rx_f_number),
+                "receive F-number of an expanding aperture, 0 for the full aperture")
+            ("rx_apodization", po::value<std::string>(&rx_apodization)->default_value("rectangular"), "rectangular, hann or hamming")
+            ("rad_min", po::value<float>(&config.rad_range.first)->default_value(config.rad_range.first), "[m]")
+            ("rad_max", po::value<float>(&config.rad_range.last)->default_value(config.rad_range.last), "[m]")
+            ("lat_min", po::value<float>(&config.lat_range.first)->default_value(config.lat_range.first), "[m]")
+            ("lat_max", po::value<float>(&config.lat_range.last)->default_value(config.lat_range.last), "[m]")
+            ("ele_min", po::value<float>(&config.ele_range.first)->default_value(config.ele_range.first), "[m]")
+            ("ele_max", po::value<float>(&config.ele_range.last)->default_value(config.ele_range.last), "[m]")
+            ("num_samples_rad", po::value<int>(&config.num_rad_samples)->default_value(config.num_rad_samples), "")
+            ("num_samples_lat", po::value<int>(&config.num_lat_samples)->default_value(config.num_lat_samples), "")
+            ("num_samples_ele", po::value<int>(&config.num_ele_samples)->default_value(config.num_ele_samples), "")
+        ;
+        po::variables_map var_map;
+        po::store(po::parse_command_line(argc, argv, desc), var_map);
+        if (var_map.count("help") != 0) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(var_map);
+        config.tx_apodization = parse_window(tx_apodization);
+        config.rx_apodization = parse_window(rx_apodization);
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto table = simulate(device, config);
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        bcsim::saveBeamProfileToHdf(output_file, table);
+        std::cout << "Simulated " << table.samples.size() << " samples in " << elapsed << " sec" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
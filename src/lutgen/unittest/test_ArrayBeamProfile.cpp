@@ -0,0 +1,106 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ArrayBeamProfileTests
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include "../ArrayBeamProfile.hpp"
+#include "../../utils/HDFConvenience.hpp"
+
+namespace {
+
+// A small array focused at 30 mm, on a grid whose radial sample 4 is the
+// focus and whose lateral and elevational center samples are on the axis.
+bcsim::ArrayBeamProfileConfig make_config() {
+    bcsim::ArrayBeamProfileConfig config;
+    config.array.num_elements   = 16;
+    config.array.pitch          = 0.3e-3f;
+    config.array.kerf           = 0.03e-3f;
+    config.array.element_height = 6e-3f;
+    config.array.num_sub_x      = 1;
+    config.array.num_sub_y      = 4;
+    config.center_frequency     = 3e6f;
+    config.num_frequencies      = 8;
+    config.tx_focus             = 30e-3f;
+    config.tx_apodization       = bcsim::ApodizationWindow::HANN;
+    config.rad_range            = bcsim::Interval(10e-3f, 50e-3f);
+    config.lat_range            = bcsim::Interval(-4e-3f, 4e-3f);
+    config.ele_range            = bcsim::Interval(-4e-3f, 4e-3f);
+    config.num_rad_samples      = 9;
+    config.num_lat_samples      = 9;
+    config.num_ele_samples      = 5;
+    return config;
+}
+
+float sample(const bcsim::ArrayBeamProfileTable& table, int rad_no, int lat_no, int ele_no) {
+    return table.samples[(static_cast<size_t>(rad_no)*table.num_lat_samples + lat_no)*table.num_ele_samples + ele_no];
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(ProfileIsNormalizedAndSymmetric) {
+    const auto table = bcsim::simulateArrayBeamProfile(make_config());
+    BOOST_CHECK_CLOSE(*std::max_element(table.samples.begin(), table.samples.end()), 1.0f, 1e-4);
+    for (int rad_no = 0; rad_no < table.num_rad_samples; rad_no++) {
+        for (int lat_no = 0; lat_no < table.num_lat_samples; lat_no++) {
+            for (int ele_no = 0; ele_no < table.num_ele_samples; ele_no++) {
+                const auto value = sample(table, rad_no, lat_no, ele_no);
+                BOOST_CHECK_SMALL(value - sample(table, rad_no, table.num_lat_samples - 1 - lat_no, ele_no), 1e-4f);
+                BOOST_CHECK_SMALL(value - sample(table, rad_no, lat_no, table.num_ele_samples - 1 - ele_no), 1e-4f);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TransmitFocusNarrowsTheBeam) {
+    auto config = make_config();
+    const auto focused = bcsim::simulateArrayBeamProfile(config);
+    config.tx_focus = 0.0f;
+    const auto unfocused = bcsim::simulateArrayBeamProfile(config);
+    // relative sensitivity at the focus 1 mm off the axis
+    const auto off_axis = [](const bcsim::ArrayBeamProfileTable& table) {
+        return sample(table, 4, 5, 2)/sample(table, 4, 4, 2);
+    };
+    BOOST_CHECK_LT(off_axis(focused), off_axis(unfocused));
+    for (int lat_no = 0; lat_no < focused.num_lat_samples; lat_no++) {
+        BOOST_CHECK_LE(sample(focused, 4, lat_no, 2), sample(focused, 4, 4, 2) + 1e-6f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LensFocusesInElevation) {
+    auto config = make_config();
+    config.array.elevation_focus = 30e-3f;
+    const auto with_lens = bcsim::simulateArrayBeamProfile(config);
+    config.array.elevation_focus = 0.0f;
+    const auto without_lens = bcsim::simulateArrayBeamProfile(config);
+    const auto off_axis = [](const bcsim::ArrayBeamProfileTable& table) {
+        return sample(table, 4, 4, 3)/sample(table, 4, 4, 2);
+    };
+    BOOST_CHECK_LT(off_axis(with_lens), off_axis(without_lens));
+}
+
+BOOST_AUTO_TEST_CASE(SavedProfileIsLoaded) {
+    const char* h5_file = "test_ArrayBeamProfile.h5";
+    const auto table = bcsim::simulateArrayBeamProfile(make_config());
+    bcsim::saveBeamProfileToHdf(h5_file, table);
+    const auto profile = bcsim::loadBeamProfileFromHdf(h5_file);
+    for (int rad_no = 1; rad_no < table.num_rad_samples - 1; rad_no++) {
+        const float r = 10e-3f + rad_no*5e-3f;
+        BOOST_CHECK_SMALL(profile->sampleProfile(r, 0.0f, 0.0f) - sample(table, rad_no, 4, 2), 1e-4f);
+        BOOST_CHECK_SMALL(profile->sampleProfile(r, 1e-3f, -2e-3f) - sample(table, rad_no, 5, 1), 1e-4f);
+    }
+    std::remove(h5_file);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidConfigurationThrows) {
+    auto config = make_config();
+    config.num_frequencies = bcsim::ArrayBeamProfileConfig::MAX_FREQUENCIES + 1;
+    BOOST_CHECK_THROW(bcsim::simulateArrayBeamProfile(config), std::runtime_error);
+    config = make_config();
+    config.array.kerf = config.array.pitch;
+    BOOST_CHECK_THROW(bcsim::simulateArrayBeamProfile(config), std::runtime_error);
+    config = make_config();
+    config.num_ele_samples = 1;
+    BOOST_CHECK_THROW(bcsim::simulateArrayBeamProfile(config), std::runtime_error);
+}
@@ -36,10 +36,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <mutex>
 #include "../core/BCSimConfig.hpp"
 #include "../core/BeamProfile.hpp"
 #include "../core/to_string.hpp"
 #include "../core/LibBCSim.hpp"
+#include "../utils/HdfIqRecorder.hpp"
+#include "../utils/SharedIqRing.hpp"
+#include "../utils/BinaryPhantom.hpp"
 
 using namespace bcsim;
 
@@ -55,45 +63,585 @@ std::vector<size_t> get_dimensions(numpy_boost<T, Ndims> v) {
     return res;
 }
 
+// "gaussian", "uniform" or "constant".
+ProceduralScatterers::AmplitudeDistribution parse_amplitude_distribution(const std::string& name) {
+    if (name == "gaussian") {
+        return ProceduralScatterers::AmplitudeDistribution::GAUSSIAN;
+    } else if (name == "uniform") {
+        return ProceduralScatterers::AmplitudeDistribution::UNIFORM;
+    } else if (name == "constant") {
+        return ProceduralScatterers::AmplitudeDistribution::CONSTANT;
+    }
+    throw std::runtime_error("invalid amplitude distribution: " + name);
+}
+
+// A C-contiguous, aligned float32 array of rank ndim from a Python object.
+// NumPy arrays that already are such arrays are referenced, not copied.
+boost::python::handle<> contiguous_float_array(boost::python::object obj, int ndim) {
+    PyObject* array_object = PyArray_FROMANY(obj.ptr(), NPY_FLOAT32, ndim, ndim, NPY_ARRAY_IN_ARRAY);
+    if (!array_object) {
+        boost::python::throw_error_already_set();
+    }
+    return boost::python::handle<>(array_object);
+}
+
+inline PyArrayObject* as_array(const boost::python::handle<>& array) {
+    return reinterpret_cast<PyArrayObject*>(array.get());
+}
+
+inline const float* float_data(const boost::python::handle<>& array) {
+    return static_cast<const float*>(PyArray_DATA(as_array(array)));
+}
+
+// Releases the GIL for the lifetime of the object.
+class ScopedGilRelease {
+public:
+    ScopedGilRelease() : m_state(PyEval_SaveThread()) { }
+    ~ScopedGilRelease() { PyEval_RestoreThread(m_state); }
+private:
+    ScopedGilRelease(const ScopedGilRelease&) = delete;
+    ScopedGilRelease& operator=(const ScopedGilRelease&) = delete;
+    PyThreadState*  m_state;
+};
+
+// Keeps NumPy arrays alive for as long as a simulator reads them. The last
+// reference may be dropped by a thread without the GIL.
+std::shared_ptr<const void> array_owner(std::vector<boost::python::handle<>> arrays) {
+    auto owner = new std::vector<boost::python::handle<>>(std::move(arrays));
+    return std::shared_ptr<const void>(owner, [](std::vector<boost::python::handle<>>* p) {
+        const auto gil_state = PyGILState_Ensure();
+        delete p;
+        PyGILState_Release(gil_state);
+    });
+}
+
+// External fixed scatterers that reference separate x, y, z and amplitude
+// arrays in place. Contiguous float32 arrays are not copied.
+ExternalFixedScatterers::s_ptr external_scatterers_from_soa(boost::python::object xs, boost::python::object ys,
+                                                            boost::python::object zs, boost::python::object amplitudes) {
+    const auto xs_array = contiguous_float_array(xs, 1);
+    const auto ys_array = contiguous_float_array(ys, 1);
+    const auto zs_array = contiguous_float_array(zs, 1);
+    const auto amplitudes_array = contiguous_float_array(amplitudes, 1);
+    const auto num_scatterers = static_cast<size_t>(PyArray_DIM(as_array(xs_array), 0));
+    for (const auto& array : {ys_array, zs_array, amplitudes_array}) {
+        if (static_cast<size_t>(PyArray_DIM(as_array(array), 0)) != num_scatterers) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : all arrays must have the same length");
+        }
+    }
+
+    auto res = std::make_shared<ExternalFixedScatterers>();
+    res->xs    = float_data(xs_array);
+    res->ys    = float_data(ys_array);
+    res->zs    = float_data(zs_array);
+    res->as    = float_data(amplitudes_array);
+    res->count = num_scatterers;
+    res->owner = array_owner({xs_array, ys_array, zs_array, amplitudes_array});
+    return res;
+}
+
+// External fixed scatterers that reference the columns of an Nx4 array of
+// rows (x, y, z, amplitude). The columns are read in place if the array is
+// a Fortran-ordered float32 array, e.g. the transpose of a C-ordered 4xN
+// array. Other arrays are converted to one once, which is sorted for
+// culling since nobody else sees it.
+ExternalFixedScatterers::s_ptr external_scatterers_from_rows(boost::python::object data) {
+    PyObject* array_object = PyArray_FROMANY(data.ptr(), NPY_FLOAT32, 2, 2,
+                                             NPY_ARRAY_F_CONTIGUOUS | NPY_ARRAY_ALIGNED);
+    if (!array_object) {
+        boost::python::throw_error_already_set();
+    }
+    const auto array = boost::python::handle<>(array_object);
+    if (PyArray_DIM(as_array(array), 1) != 4) {
+        throw std::runtime_error(std::string(__FUNCTION__) + " : Number of columns must be four");
+    }
+    const auto num_scatterers = static_cast<size_t>(PyArray_DIM(as_array(array), 0));
+    const auto columns = static_cast<float*>(PyArray_DATA(as_array(array)));
+    if (array_object != data.ptr()) {
+        sort_fixed_scatterers_for_culling(columns, columns + num_scatterers, columns + 2*num_scatterers,
+                                          columns + 3*num_scatterers, num_scatterers);
+    }
+
+    auto res = std::make_shared<ExternalFixedScatterers>();
+    res->xs    = columns;
+    res->ys    = columns + num_scatterers;
+    res->zs    = columns + 2*num_scatterers;
+    res->as    = columns + 3*num_scatterers;
+    res->count = num_scatterers;
+    res->owner = array_owner({array});
+    return res;
+}
+
+// Fixed scatterers copied from separate x, y, z and amplitude arrays, for
+// when they are reordered.
+FixedScatterers::s_ptr fixed_scatterers_from_soa(boost::python::object xs, boost::python::object ys,
+                                                 boost::python::object zs, boost::python::object amplitudes) {
+    const auto xs_array = contiguous_float_array(xs, 1);
+    const auto ys_array = contiguous_float_array(ys, 1);
+    const auto zs_array = contiguous_float_array(zs, 1);
+    const auto amplitudes_array = contiguous_float_array(amplitudes, 1);
+    const auto num_scatterers = static_cast<size_t>(PyArray_DIM(as_array(xs_array), 0));
+    for (const auto& array : {ys_array, zs_array, amplitudes_array}) {
+        if (static_cast<size_t>(PyArray_DIM(as_array(array), 0)) != num_scatterers) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : all arrays must have the same length");
+        }
+    }
+
+    const auto x = float_data(xs_array);
+    const auto y = float_data(ys_array);
+    const auto z = float_data(zs_array);
+    const auto a = float_data(amplitudes_array);
+    auto new_scatterers = FixedScatterers::s_ptr(new FixedScatterers);
+    new_scatterers->scatterers.resize(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        auto& ps = new_scatterers->scatterers[i];
+        ps.pos = vector3(x[i], y[i], z[i]);
+        ps.amplitude = a[i];
+    }
+    return new_scatterers;
+}
+
+// Sort separate x, y, z and amplitude arrays in place like
+// sort_fixed_scatterers_for_culling(), so that the CPU simulator can cull
+// them when they are given to add_fixed_scatterers_soa(). They must be
+// writeable, contiguous float32 arrays.
+void sort_scatterers_for_culling(boost::python::object xs, boost::python::object ys,
+                                 boost::python::object zs, boost::python::object amplitudes) {
+    std::vector<boost::python::handle<>> arrays;
+    for (const auto& obj : {xs, ys, zs, amplitudes}) {
+        PyObject* array_object = PyArray_FROMANY(obj.ptr(), NPY_FLOAT32, 1, 1, NPY_ARRAY_CARRAY);
+        if (!array_object) {
+            boost::python::throw_error_already_set();
+        }
+        arrays.emplace_back(array_object);
+        if (array_object != obj.ptr()) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : arrays must be writeable, contiguous float32 arrays");
+        }
+    }
+    const auto num_scatterers = static_cast<size_t>(PyArray_DIM(as_array(arrays[0]), 0));
+    for (const auto& array : arrays) {
+        if (static_cast<size_t>(PyArray_DIM(as_array(array), 0)) != num_scatterers) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : all arrays must have the same length");
+        }
+    }
+    std::vector<float*> data;
+    for (const auto& array : arrays) {
+        data.push_back(static_cast<float*>(PyArray_DATA(as_array(array))));
+    }
+    ScopedGilRelease no_gil;
+    sort_fixed_scatterers_for_culling(data[0], data[1], data[2], data[3], num_scatterers);
+}
+
+// Write fixed scatterers to a binary phantom for add_shared_fixed_scatterers(),
+// sorted so that the CPU simulator can cull them. A path in /dev/shm keeps
+// the phantom in shared memory.
+void create_shared_phantom(const std::string& phantom_file, boost::python::object xs, boost::python::object ys,
+                           boost::python::object zs, boost::python::object amplitudes) {
+    auto fixed_scatterers = fixed_scatterers_from_soa(xs, ys, zs, amplitudes);
+    ScopedGilRelease no_gil;
+    sort_fixed_scatterers_for_culling(*fixed_scatterers);
+    savePhantomToBinary(phantom_file, fixed_scatterers.get(), nullptr);
+}
+
+// Handle to a frame queued with simulate_lines_async. The array of the
+// frame is kept alive by the handle, and dropping the last handle to an
+// unfinished frame waits for it.
+class SimulationFuture {
+public:
+    SimulationFuture(boost::python::object array, std::shared_future<void> future)
+        : m_state(std::make_shared<State>(array, future)) { }
+
+    bool done() const {
+        return m_state->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    void wait() const {
+        ScopedGilRelease no_gil;
+        m_state->future.wait();
+    }
+
+    // Waits for the frame and returns its [sample][line] array, or raises
+    // the error of the simulation.
+    boost::python::object result() const {
+        wait();
+        m_state->future.get();
+        return m_state->array;
+    }
+
+private:
+    struct State {
+        State(boost::python::object array, std::shared_future<void> future)
+            : array(array), future(future) { }
+        ~State() {
+            if (!future.valid()) return;
+            ScopedGilRelease no_gil;
+            future.wait();
+        }
+        boost::python::object       array;
+        std::shared_future<void>    future;
+    };
+    std::shared_ptr<State>  m_state;
+};
+
+// Streams IQ frames from simulate_lines or simulate_frames to a HDF5 file.
+class IqRecorderWrapper {
+public:
+    IqRecorderWrapper(const std::string& h5_file, size_t num_lines, size_t num_samples,
+                      int compression_level, size_t max_queued_frames)
+        : m_recorder(h5_file, num_lines, num_samples, compression_level, max_queued_frames) { }
+
+    // Queue a [sample][line] frame, or the [frame][sample][line] frames
+    // of a cine loop, which start at timestamp and are frame_dt apart.
+    void append(boost::python::object iq, float timestamp, float frame_dt) {
+        PyObject* array_object = PyArray_FROMANY(iq.ptr(), NPY_COMPLEX64, 2, 3, 0);
+        if (!array_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> array(array_object);
+        const int ndim = PyArray_NDIM(as_array(array));
+
+        // [..][line][sample], which is C-contiguous for arrays from the simulator
+        std::vector<npy_intp> axes(ndim);
+        for (int i = 0; i < ndim; i++) {
+            axes[i] = i;
+        }
+        std::swap(axes[ndim - 2], axes[ndim - 1]);
+        PyArray_Dims permute = {axes.data(), ndim};
+        PyObject* lines_object = PyArray_Transpose(as_array(array), &permute);
+        if (!lines_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines_view(lines_object);
+        PyObject* contiguous_object = PyArray_FROMANY(lines_object, NPY_COMPLEX64, ndim, ndim, NPY_ARRAY_IN_ARRAY);
+        if (!contiguous_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines(contiguous_object);
+
+        const auto num_frames  = (ndim == 3) ? PyArray_DIM(as_array(lines), 0) : 1;
+        const auto num_lines   = PyArray_DIM(as_array(lines), ndim - 2);
+        const auto num_samples = PyArray_DIM(as_array(lines), ndim - 1);
+        if ((num_lines != static_cast<npy_intp>(m_recorder.get_num_lines()))
+            || (num_samples != static_cast<npy_intp>(m_recorder.get_num_samples()))) {
+            throw std::runtime_error("IQ frames must have num_samples samples and num_lines lines");
+        }
+        const auto iq_buffer = static_cast<const std::complex<float>*>(PyArray_DATA(as_array(lines)));
+        ScopedGilRelease no_gil;
+        for (npy_intp frame_no = 0; frame_no < num_frames; frame_no++) {
+            m_recorder.append(iq_buffer + frame_no*num_lines*num_samples, num_samples, timestamp + frame_no*frame_dt);
+        }
+    }
+
+    void close() {
+        ScopedGilRelease no_gil;
+        m_recorder.close();
+    }
+
+    size_t get_num_frames() const {
+        return m_recorder.get_num_frames();
+    }
+
+private:
+    bcsim::HdfIqRecorder    m_recorder;
+};
+
+// The sample type named "complex64", "float16" or "int16".
+IqOutputFormat::SampleType iq_sample_type(const std::string& name) {
+    if (name == "complex64") return IqOutputFormat::SampleType::COMPLEX_FLOAT32;
+    if (name == "float16")   return IqOutputFormat::SampleType::COMPLEX_FLOAT16;
+    if (name == "int16")     return IqOutputFormat::SampleType::COMPLEX_INT16;
+    throw std::runtime_error("unknown IQ sample type " + name);
+}
+
+// Publishes the frames of RfSimulator.simulate_to_shared_ring to a shared
+// memory ring, read by python/shared_iq_ring.py or bcsim::SharedIqRingReader.
+class SharedIqRingWrapper {
+public:
+    SharedIqRingWrapper(const std::string& name, size_t num_lines, size_t num_samples, size_t capacity,
+                        const std::string& sample_type, float int16_scale, bool overwrite_oldest, int wait_timeout_ms)
+        : m_format(make_format(sample_type, int16_scale)),
+          m_writer(name, num_lines, num_samples, capacity, m_format, overwrite_oldest, wait_timeout_ms) { }
+
+    uint64_t get_end_frame_no() const {
+        return m_writer.get_end_frame_no();
+    }
+
+    const IqOutputFormat& get_format() const {
+        return m_format;
+    }
+
+    bcsim::SharedIqRingWriter& get_writer() {
+        return m_writer;
+    }
+
+private:
+    static IqOutputFormat make_format(const std::string& sample_type, float int16_scale) {
+        IqOutputFormat format;
+        format.sample_type = iq_sample_type(sample_type);
+        format.int16_scale = int16_scale;
+        return format;
+    }
+
+    const IqOutputFormat        m_format;
+    bcsim::SharedIqRingWriter   m_writer;
+};
+
+// The DLPack tensor ABI (dlpack.h v0.8), which the Python array libraries
+// exchange through __dlpack__ capsules.
+struct DLDevice {
+    int32_t     device_type;    // 2 is CUDA
+    int32_t     device_id;
+};
+
+struct DLDataType {
+    uint8_t     code;           // 5 is complex
+    uint8_t     bits;
+    uint16_t    lanes;
+};
+
+struct DLTensor {
+    void*       data;
+    DLDevice    device;
+    int32_t     ndim;
+    DLDataType  dtype;
+    int64_t*    shape;
+    int64_t*    strides;        // in elements
+    uint64_t    byte_offset;
+};
+
+struct DLManagedTensor {
+    DLTensor    dl_tensor;
+    void*       manager_ctx;
+    void        (*deleter)(DLManagedTensor* self);
+};
+
+// An IQ frame on the CUDA device, returned by RfSimulator.simulate_lines_device,
+// which is exported without copies through __dlpack__ (e.g. to
+// torch.from_dlpack or cupy.from_dlpack) and __cuda_array_interface__.
+// Both give a [sample][line] view of the [line][sample] frame, like the
+// arrays of simulate_lines.
+class DeviceIqFrameWrapper {
+public:
+    DeviceIqFrameWrapper() { }
+
+    explicit DeviceIqFrameWrapper(IDeviceIqFrame::s_ptr frame) : m_frame(frame) { }
+
+    // stream is the consumer's stream: None for the legacy default stream,
+    // 1 and 2 for the legacy and per-thread default streams or a
+    // cudaStream_t, which waits for the frame to be written, or -1 to not
+    // wait.
+    PyObject* dlpack(boost::python::object stream) const {
+        if (stream.is_none()) {
+            m_frame->make_stream_wait(nullptr);
+        } else {
+            const auto stream_value = boost::python::extract<long long>(stream)();
+            if (stream_value == 0) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : stream 0 is ambiguous, use 1 or 2");
+            }
+            if (stream_value != -1) {
+                m_frame->make_stream_wait(reinterpret_cast<void*>(static_cast<uintptr_t>(stream_value)));
+            }
+        }
+        // the capsule owns a reference to the frame until the consumer calls the deleter
+        auto context = new ManagerContext;
+        context->frame = m_frame;
+        context->shape[0] = static_cast<int64_t>(m_frame->get_num_samples());
+        context->shape[1] = static_cast<int64_t>(m_frame->get_num_lines());
+        context->strides[0] = 1;
+        context->strides[1] = static_cast<int64_t>(m_frame->get_num_samples());
+        auto& tensor = context->tensor.dl_tensor;
+        tensor.data = m_frame->data();
+        tensor.device = DLDevice{2, m_frame->get_device()};
+        tensor.ndim = 2;
+        tensor.dtype = DLDataType{5, 64, 1};
+        tensor.shape = context->shape;
+        tensor.strides = context->strides;
+        tensor.byte_offset = 0;
+        context->tensor.manager_ctx = context;
+        context->tensor.deleter = [](DLManagedTensor* self) {
+            delete static_cast<ManagerContext*>(self->manager_ctx);
+        };
+        PyObject* capsule = PyCapsule_New(&context->tensor, "dltensor", [](PyObject* capsule) {
+            // a consumer renames the capsule and calls the deleter itself
+            if (PyCapsule_IsValid(capsule, "dltensor")) {
+                auto tensor = static_cast<DLManagedTensor*>(PyCapsule_GetPointer(capsule, "dltensor"));
+                tensor->deleter(tensor);
+            }
+        });
+        if (!capsule) {
+            delete context;
+            boost::python::throw_error_already_set();
+        }
+        return capsule;
+    }
+
+    boost::python::tuple dlpack_device() const {
+        return boost::python::make_tuple(2, m_frame->get_device());
+    }
+
+    // Version 3 with the stream the frame is written on, which the consumer
+    // synchronizes with.
+    boost::python::dict cuda_array_interface() const {
+        const auto num_lines = m_frame->get_num_lines();
+        const auto num_samples = m_frame->get_num_samples();
+        const auto sample_bytes = sizeof(std::complex<float>);
+        boost::python::dict interface;
+        interface["shape"] = boost::python::make_tuple(num_samples, num_lines);
+        interface["strides"] = boost::python::make_tuple(sample_bytes, num_samples*sample_bytes);
+        interface["typestr"] = "<c8";
+        interface["data"] = boost::python::make_tuple(reinterpret_cast<uintptr_t>(m_frame->data()), false);
+        interface["stream"] = reinterpret_cast<uintptr_t>(m_frame->get_stream());
+        interface["version"] = 3;
+        return interface;
+    }
+
+    boost::python::tuple get_shape() const {
+        return boost::python::make_tuple(m_frame->get_num_samples(), m_frame->get_num_lines());
+    }
+
+    int get_device() const {
+        return m_frame->get_device();
+    }
+
+    void synchronize() const {
+        ScopedGilRelease no_gil;
+        m_frame->synchronize();
+    }
+
+private:
+    struct ManagerContext {
+        IDeviceIqFrame::s_ptr   frame;
+        int64_t                 shape[2];
+        int64_t                 strides[2];
+        DLManagedTensor         tensor;
+    };
+
+    IDeviceIqFrame::s_ptr   m_frame;
+};
+
 class RfSimulatorWrapper {
 public:
-    RfSimulatorWrapper(std::string sim_type) {
+    RfSimulatorWrapper(std::string sim_type)
+        : m_print_debug(false),
+          m_output_dims_valid(false)
+    {
         if (m_print_debug) std::cout << "Creating simulator of type " << sim_type << std::endl;
         m_rf_simulator = Create(sim_type);
     }
 
+    ~RfSimulatorWrapper() {
+        // the queued frames are finished first, they never need the GIL
+        ScopedGilRelease no_gil;
+        wait_for_queued_frames();
+    }
+
     void set_print_debug(bool val) {
         m_print_debug = val;
     }
     
     void set_parameter(const std::string& key, const std::string& value) {
+        const auto lock = acquire_simulator();
+        m_output_dims_valid = false;
         m_rf_simulator->set_parameter(key, value);
     }
     
     void clear_fixed_scatterers() {
+        const auto lock = acquire_simulator();
         m_rf_simulator->clear_fixed_scatterers();
     }
 
-    void add_fixed_scatterers(numpy_boost<float, 2> data) {
-        auto dimensions = get_dimensions(data);
-        size_t numScatterers = dimensions[0];
-        size_t numColumns = dimensions[1];
-        
-        if (numColumns != 4) {
-            throw std::runtime_error(std::string(__FUNCTION__) + " : Number of columns must be four");
+    // Fixed scatterers from an Nx4 array of rows (x, y, z, amplitude). The
+    // array is referenced, not copied, if it is Fortran-ordered float32, so
+    // it must not be modified while the simulator uses it. Other arrays are
+    // copied once, and sorted for culling.
+    void add_fixed_scatterers(boost::python::object data) {
+        const auto new_scatterers = external_scatterers_from_rows(data);
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_external_fixed_scatterers(new_scatterers);
+    }
+
+    // Fixed scatterers from separate x, y, z and amplitude arrays, which are
+    // referenced, not copied, if they are contiguous float32 arrays. They
+    // must not be modified while the simulator uses them, and the CPU
+    // simulator only culls them if they are sorted, see
+    // sort_scatterers_for_culling().
+    void add_fixed_scatterers_soa(boost::python::object xs, boost::python::object ys,
+                                  boost::python::object zs, boost::python::object amplitudes) {
+        const auto new_scatterers = external_scatterers_from_soa(xs, ys, zs, amplitudes);
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_external_fixed_scatterers(new_scatterers);
+    }
+
+    // Reference the fixed scatterers of a binary phantom, e.g. one made by
+    // create_shared_phantom(), without copying them. Processes using the same
+    // file share one copy of the scatterers in memory.
+    void add_shared_fixed_scatterers(const std::string& phantom_file) {
+        const auto new_scatterers = getExternalFixedScatterers(std::make_shared<MappedPhantom>(phantom_file));
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_external_fixed_scatterers(new_scatterers);
+    }
+
+    // Axis-aligned procedural speckle of the given density [scatterers per
+    // m^3]. region is "box" or "ellipsoid", amplitude_distribution is
+    // "gaussian", "uniform" or "constant", see ProceduralScatterers.
+    void add_procedural_scatterers(const std::string& region, float center_x, float center_y, float center_z,
+                                   float half_x, float half_y, float half_z, double density,
+                                   const std::string& amplitude_distribution, float amplitude_scale, uint64_t seed) {
+        auto new_scatterers = std::make_shared<ProceduralScatterers>();
+        if (region == "box") {
+            new_scatterers->region = ProceduralScatterers::Region::BOX;
+        } else if (region == "ellipsoid") {
+            new_scatterers->region = ProceduralScatterers::Region::ELLIPSOID;
+        } else {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : invalid region");
         }
-        auto new_scatterers = FixedScatterers::s_ptr(new FixedScatterers);
+        new_scatterers->amplitude_distribution = parse_amplitude_distribution(amplitude_distribution);
+        new_scatterers->center          = vector3(center_x, center_y, center_z);
+        new_scatterers->half_axes       = vector3(half_x, half_y, half_z);
+        new_scatterers->amplitude_scale = amplitude_scale;
+        new_scatterers->seed            = seed;
+        new_scatterers->set_density(density);
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_procedural_scatterers(new_scatterers);
+    }
 
-        for (size_t row = 0; row < numScatterers; row++) {
-            PointScatterer ps;
-            ps.pos = vector3(data[row][0], data[row][1], data[row][2]);
-            ps.amplitude = data[row][3];
-            new_scatterers->scatterers.push_back(ps);
+    // Speckle sampled from a voxel volume, where densities [scatterers per
+    // m^3] and amplitude_scales are arrays of shape (nz, ny, nx) and origin
+    // is the lower corner of the first voxel, see ImageVolumeScatterers.
+    void add_image_volume_scatterers(numpy_boost<float, 3> densities, numpy_boost<float, 3> amplitude_scales,
+                                     float origin_x, float origin_y, float origin_z,
+                                     float voxel_x, float voxel_y, float voxel_z,
+                                     const std::string& amplitude_distribution, uint64_t seed) {
+        const auto dims = get_dimensions(densities);
+        if (get_dimensions(amplitude_scales) != dims) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : densities and amplitude_scales differ in shape");
         }
-        m_rf_simulator->add_fixed_scatterers(new_scatterers);
+        auto new_scatterers = std::make_shared<ImageVolumeScatterers>();
+        new_scatterers->nz = static_cast<int>(dims[0]);
+        new_scatterers->ny = static_cast<int>(dims[1]);
+        new_scatterers->nx = static_cast<int>(dims[2]);
+        new_scatterers->origin     = vector3(origin_x, origin_y, origin_z);
+        new_scatterers->voxel_size = vector3(voxel_x, voxel_y, voxel_z);
+        new_scatterers->amplitude_distribution = parse_amplitude_distribution(amplitude_distribution);
+        new_scatterers->seed = seed;
+        new_scatterers->densities.resize(new_scatterers->get_num_voxels());
+        new_scatterers->amplitude_scales.resize(new_scatterers->get_num_voxels());
+        for (int iz = 0; iz < new_scatterers->nz; iz++) {
+            for (int iy = 0; iy < new_scatterers->ny; iy++) {
+                for (int ix = 0; ix < new_scatterers->nx; ix++) {
+                    const auto v = new_scatterers->voxel_index(ix, iy, iz);
+                    new_scatterers->densities[v]        = densities[iz][iy][ix];
+                    new_scatterers->amplitude_scales[v] = amplitude_scales[iz][iy][ix];
+                }
+            }
+        }
+        new_scatterers->update_counts();
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_image_volume_scatterers(new_scatterers);
     }
 
     void clear_spline_scatterers() {
+        const auto lock = acquire_simulator();
         m_rf_simulator->clear_spline_scatterers();
     }
 
@@ -141,23 +689,69 @@ public:
             throw std::runtime_error("Mismatch between control_points and amplitudes");
         }
                 
-        new_scatterers->control_points.resize(num_scatterers);
-        new_scatterers->amplitudes.resize(num_scatterers);
+        // The scatterer-major [scatterer, cs, 3] array of the old
+        // SplineScatterers::control_points is still accepted, and transposed
+        // into the control-point-major arrays. add_spline_scatterers_soa()
+        // takes them in that order without a transpose.
+        new_scatterers->resize(num_scatterers, num_control_points);
 
         for (int scatterer_i = 0; scatterer_i < num_scatterers; scatterer_i++) {
             new_scatterers->amplitudes[scatterer_i] = amplitudes[scatterer_i];
 
-            new_scatterers->control_points[scatterer_i].resize(num_control_points);
             for (int control_point_i = 0; control_point_i < num_control_points; control_point_i++) {
                
                 const vector3 pos(control_points[scatterer_i][control_point_i][0],
                                   control_points[scatterer_i][control_point_i][1],
                                   control_points[scatterer_i][control_point_i][2]);
                 
-                new_scatterers->control_points[scatterer_i][control_point_i] = pos;
+                new_scatterers->set_control_point(scatterer_i, control_point_i, pos);
             }
         }
 
+        const auto lock = acquire_simulator();
+        m_rf_simulator->add_spline_scatterers(new_scatterers);
+    }
+
+    // Spline scatterers with the control points as a [num_cs, num_scatterers, 3]
+    // array, which is the control point order of SplineScatterers. The arrays
+    // are read in place if they are contiguous float32 arrays.
+    void add_spline_scatterers_soa(int spline_degree,
+                                   boost::python::object knot_vector,
+                                   boost::python::object control_points,
+                                   boost::python::object amplitudes) {
+        const auto knots_array = contiguous_float_array(knot_vector, 1);
+        const auto cs_array    = contiguous_float_array(control_points, 3);
+        const auto amps_array  = contiguous_float_array(amplitudes, 1);
+
+        const auto num_knots          = static_cast<size_t>(PyArray_DIM(as_array(knots_array), 0));
+        const auto num_control_points = static_cast<size_t>(PyArray_DIM(as_array(cs_array), 0));
+        const auto num_scatterers     = static_cast<size_t>(PyArray_DIM(as_array(cs_array), 1));
+        if (PyArray_DIM(as_array(cs_array), 2) != 3) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : size of dimension 3 must be three (x,y,z)");
+        }
+        if (static_cast<size_t>(PyArray_DIM(as_array(amps_array), 0)) != num_scatterers) {
+            throw std::runtime_error("Mismatch between control_points and amplitudes");
+        }
+        if ((spline_degree < 0) || (num_knots != num_control_points + spline_degree + 1)) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : mismatch in number of nodes, degree and control points");
+        }
+
+        auto new_scatterers = SplineScatterers::s_ptr(new SplineScatterers);
+        new_scatterers->spline_degree = spline_degree;
+        const auto knots = float_data(knots_array);
+        new_scatterers->knot_vector.assign(knots, knots + num_knots);
+        new_scatterers->resize(num_scatterers, num_control_points);
+        const auto amps = float_data(amps_array);
+        std::copy(amps, amps + num_scatterers, new_scatterers->amplitudes.begin());
+
+        // element (cs, n) of the array is at control_point_index(n, cs)
+        const auto cs = float_data(cs_array);
+        for (size_t idx = 0; idx < num_control_points*num_scatterers; idx++) {
+            new_scatterers->control_xs[idx] = cs[3*idx];
+            new_scatterers->control_ys[idx] = cs[3*idx + 1];
+            new_scatterers->control_zs[idx] = cs[3*idx + 2];
+        }
+        const auto lock = acquire_simulator();
         m_rf_simulator->add_spline_scatterers(new_scatterers);
     }
 
@@ -165,7 +759,8 @@ public:
                            numpy_boost<float, 2> directions,
                            float line_length,
                            numpy_boost<float, 2> lateralDirs,
-                           numpy_boost<float, 1> timestamps) {
+                           numpy_boost<float, 1> timestamps,
+                           float r_min, float r_max) {
 
         auto originsDims = get_dimensions(origins);
         auto directionsDims = get_dimensions(directions);
@@ -192,6 +787,41 @@ public:
             const Scanline sl(origin, dir, lateral_dir, timestamp);
             seq->add_scanline(sl);
         }
+        seq->r_min = r_min;
+        seq->r_max = r_max;
+        const auto lock = acquire_simulator();
+        m_output_dims_valid = false;
+        m_rf_simulator->set_scan_sequence(seq);
+    }
+
+    // A scan sequence of evenly spaced lines that is evaluated on demand.
+    // scan_type is "linear" or "sector", see ParametricScan.
+    void set_parametric_scan_sequence(const std::string& scan_type, int num_lines_lateral, int num_planes,
+                                      float lateral_extent, float elevational_extent, float line_length,
+                                      float tilt, float first_timestamp, float line_interval,
+                                      int num_frames, float frame_interval, float r_min, float r_max) {
+        ParametricScan scan;
+        if (scan_type == "linear") {
+            scan.type = ParametricScan::Type::LINEAR;
+        } else if (scan_type == "sector") {
+            scan.type = ParametricScan::Type::SECTOR;
+        } else {
+            throw std::runtime_error("set_parametric_scan_sequence(): invalid scan type");
+        }
+        scan.num_lines_lateral  = num_lines_lateral;
+        scan.num_planes         = num_planes;
+        scan.lateral_extent     = lateral_extent;
+        scan.elevational_extent = elevational_extent;
+        scan.tilt               = tilt;
+        scan.first_timestamp    = first_timestamp;
+        scan.line_interval      = line_interval;
+        scan.num_frames         = num_frames;
+        scan.frame_interval     = frame_interval;
+        auto seq = ScanSequence::s_ptr(new ScanSequence(line_length, scan));
+        seq->r_min = r_min;
+        seq->r_max = r_max;
+        const auto lock = acquire_simulator();
+        m_output_dims_valid = false;
         m_rf_simulator->set_scan_sequence(seq);
     }
 
@@ -211,6 +841,8 @@ public:
         ex.center_index = center_index;
         ex.sampling_frequency = fs;
         ex.demod_freq = demod_freq;
+        const auto lock = acquire_simulator();
+        m_output_dims_valid = false;
         m_rf_simulator->set_excitation(ex);
         if (m_print_debug) {
             std::cout << to_string(ex) << std::endl;
@@ -221,6 +853,7 @@ public:
     void set_analytical_beam_profile(float sigmaLateral, float sigmaElevational) {
         // TODO: Plug memleak
         auto beam_profile = IBeamProfile::s_ptr(new GaussianBeamProfile(sigmaLateral, sigmaElevational));
+        const auto lock = acquire_simulator();
         m_rf_simulator->set_analytical_profile(beam_profile);
         if (m_print_debug) {
             std::cout << "Lateral sigma is now " << sigmaLateral << " [m]" << std::endl;
@@ -228,78 +861,316 @@ public:
         }
     }
     
+    // The samples are a [radial][lateral][elevational] float32 array.
     void set_lut_beam_profile(float rMin, float rMax, float lMin, float lMax, float eMin, float eMax,
-                              numpy_boost<float, 3> samples) {
-       
-        // TODO: use smart-pointers to avoid memory leak.
-        auto dims = get_dimensions(samples);
-        size_t numDims = dims.size();
-        if (numDims != 3) {
-            // TODO: Allow 2d (circularly symmetric)?
-            throw std::runtime_error("Number of sample dimensions must be three.");
-        }
+                              boost::python::object samples) {
+        const auto samples_array = contiguous_float_array(samples, 3);
+        const size_t numSamplesRad = PyArray_DIM(as_array(samples_array), 0);
+        const size_t numSamplesLat = PyArray_DIM(as_array(samples_array), 1);
+        const size_t numSamplesEle = PyArray_DIM(as_array(samples_array), 2);
         if (m_print_debug) {
             std::cout << "rMin = " << rMin << ", rMax = " << rMax << std::endl;
             std::cout << "lMin = " << lMin << ", lMax = " << lMax << std::endl;
             std::cout << "eMin = " << eMin << ", eMax = " << eMax << std::endl;
-            std::cout << "Number of sample dimensions: " << numDims << std::endl;
-        }
-        
-        size_t numSamplesRad = dims[0];
-        size_t numSamplesLat = dims[1];
-        size_t numSamplesEle = dims[2];
-        
-	
-        if (m_print_debug) {
             std::cout << "Number of radial samples: " << numSamplesRad << std::endl;
             std::cout << "Number of lateral samples: " << numSamplesLat << std::endl;
             std::cout << "Number of elevational samples: " << numSamplesEle << std::endl;
         }
 
-        // Must temporarily work with a pointer of type LUTBeamProfile, since otherwise
-        // its specific functionality will be unavailable as a BeamProfile pointer...
-        Interval rangeRange(rMin, rMax);
-        Interval lateralRange(lMin, lMax);
-        Interval elevationalRange(eMin, eMax);
-        auto lut = new LUTBeamProfile(numSamplesRad, numSamplesLat, numSamplesEle,
-                                      rangeRange, lateralRange, elevationalRange);
+        // same layout as the NumPy array, so all samples are copied at once
+        const auto data = float_data(samples_array);
+        std::vector<float> lut_samples(data, data + numSamplesRad*numSamplesLat*numSamplesEle);
+        auto lut = std::make_shared<LUTBeamProfile>(numSamplesRad, numSamplesLat, numSamplesEle,
+                                                    Interval(rMin, rMax), Interval(lMin, lMax), Interval(eMin, eMax),
+                                                    std::move(lut_samples));
+        const auto lock = acquire_simulator();
+        m_rf_simulator->set_lookup_profile(lut);
+    }
+
+    // Simulate into a C-contiguous [line][sample] NumPy array and return a
+    // transposed [sample][line] view of it. If out is given, it must be such
+    // a view (like a previously returned array) and is simulated into.
+    // Other Python threads run during the simulation.
+    PyObject* simulate_lines(boost::python::object out) {
+        std::complex<float>* iq_buffer;
+        size_t line_stride;
+        auto array = output_array(out, iq_buffer, line_stride);
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->simulate_lines(iq_buffer, line_stride);
+        }
+        return boost::python::incref(array.ptr());
+    }
 
-        // Copy all samples from numpy array.
-        for (int ir=0; ir < numSamplesRad; ir++) {
-            for (int il=0; il < numSamplesLat; il++) {
-                for (int ie=0; ie < numSamplesEle; ie++) {
-                    lut->setDiscreteSample(ir, il, ie, samples[ir][il][ie]);       
-                }
+    // Simulate in a reduced-precision sample type, "float16" or "int16" (or
+    // "complex64" as simulate_lines). Returns ([sample][line][2] view of a
+    // C-contiguous [line][sample][2] array, scale), where the scale is the
+    // int16 scale used (int16_scale, or per frame if it is zero) and one for
+    // the other types.
+    boost::python::tuple simulate_lines_formatted(const std::string& sample_type, float int16_scale) {
+        IqOutputFormat format;
+        format.sample_type = iq_sample_type(sample_type);
+        format.int16_scale = int16_scale;
+        if (format.sample_type == IqOutputFormat::SampleType::COMPLEX_FLOAT32) {
+            return boost::python::make_tuple(boost::python::object(boost::python::handle<>(simulate_lines(boost::python::object()))), 1.0f);
+        }
+        const int npy_type = (format.sample_type == IqOutputFormat::SampleType::COMPLEX_FLOAT16) ? NPY_FLOAT16 : NPY_INT16;
+        cache_output_dimensions();
+        npy_intp array_dims[] = {static_cast<npy_intp>(m_num_output_lines), static_cast<npy_intp>(m_num_output_samples), 2};
+        PyObject* lines_object = PyArray_SimpleNew(3, array_dims, npy_type);
+        if (!lines_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines_handle(lines_object);
+        float scale;
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            scale = m_rf_simulator->simulate_lines_formatted(format, PyArray_DATA(reinterpret_cast<PyArrayObject*>(lines_object)),
+                                                             m_num_output_samples);
+        }
+        npy_intp axes[] = {1, 0, 2};
+        PyArray_Dims permutation = {axes, 3};
+        PyObject* samples_object = PyArray_Transpose(reinterpret_cast<PyArrayObject*>(lines_object), &permutation);
+        if (!samples_object) {
+            boost::python::throw_error_already_set();
+        }
+        return boost::python::make_tuple(boost::python::object(boost::python::handle<>(samples_object)), scale);
+    }
+
+    // Simulate a frame directly into the next slot of a shared memory ring
+    // and publish it with the given timestamp.
+    void simulate_to_shared_ring(SharedIqRingWrapper& ring, float timestamp) {
+        cache_output_dimensions();
+        auto& writer = ring.get_writer();
+        if ((writer.get_num_lines() != m_num_output_lines) || (writer.get_num_samples() != m_num_output_samples)) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : shared ring must have the output dimensions");
+        }
+        const auto lock = acquire_simulator();
+        ScopedGilRelease no_gil;
+        const auto scale = m_rf_simulator->simulate_lines_formatted(ring.get_format(), writer.begin_frame(), m_num_output_samples);
+        writer.commit_frame(timestamp, scale);
+    }
+
+    // Simulate a frame which stays on the CUDA device of a GPU simulator,
+    // for further processing on the GPU without copies to the host.
+    DeviceIqFrameWrapper simulate_lines_device() {
+        IDeviceIqFrame::s_ptr frame;
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            frame = m_rf_simulator->simulate_lines_on_device();
+        }
+        return DeviceIqFrameWrapper(frame);
+    }
+
+    // Like simulate_lines, but returns at once with a handle to the result.
+    // The frames are queued with IAlgorithm::simulate_lines_async, and the
+    // other methods wait for the queued frames first.
+    SimulationFuture simulate_lines_async(boost::python::object out) {
+        std::complex<float>* iq_buffer;
+        size_t line_stride;
+        auto array = output_array(out, iq_buffer, line_stride);
+
+        std::shared_future<void> future;
+        {
+            ScopedGilRelease no_gil;
+            std::lock_guard<std::mutex> lock(m_simulator_mutex);
+            future = m_rf_simulator->simulate_lines_async(iq_buffer, line_stride).share();
+            m_queued_frames.erase(std::remove_if(m_queued_frames.begin(), m_queued_frames.end(), [](const std::shared_future<void>& f) {
+                return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }), m_queued_frames.end());
+            m_queued_frames.push_back(future);
+        }
+        return SimulationFuture(array, future);
+    }
+
+    // Simulate a cine loop of num_frames frames with the current scan
+    // sequence, where frame i has i*frame_dt added to all timestamps. The
+    // frames are simulated by the streaming mode of the simulator, with
+    // several frames in flight if supported, or if batched as one batch of
+    // the lines of all frames. Returns a [frame][sample][line] view of a
+    // C-contiguous [frame][line][sample] array. If out is given, it must be
+    // such a view (like a previously returned array).
+    PyObject* simulate_frames(int num_frames, float frame_dt, boost::python::object out, bool batched) {
+        if (num_frames < 1) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : number of frames must be positive");
+        }
+        cache_output_dimensions();
+        const auto num_lines   = m_num_output_lines;
+        const auto num_samples = m_num_output_samples;
+
+        boost::python::object frames;
+        if (!out.is_none()) {
+            if (!PyArray_Check(out.ptr()) || (PyArray_NDIM(reinterpret_cast<PyArrayObject*>(out.ptr())) != 3)) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : out must be a three-dimensional NumPy array");
+            }
+            if (PyArray_DIM(reinterpret_cast<PyArrayObject*>(out.ptr()), 0) != num_frames) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : out must have num_frames frames");
+            }
+            frames = out;
+        } else {
+            npy_intp array_dims[] = {static_cast<npy_intp>(num_frames), static_cast<npy_intp>(num_lines), static_cast<npy_intp>(num_samples)};
+            PyObject* lines_object = PyArray_SimpleNew(3, array_dims, NPY_COMPLEX64);
+            if (!lines_object) {
+                boost::python::throw_error_already_set();
+            }
+            boost::python::handle<> lines_handle(lines_object);
+            npy_intp axes[] = {0, 2, 1};
+            PyArray_Dims permutation = {axes, 3};
+            PyObject* frames_object = PyArray_Transpose(reinterpret_cast<PyArrayObject*>(lines_object), &permutation);
+            if (!frames_object) {
+                boost::python::throw_error_already_set();
+            }
+            frames = boost::python::object(boost::python::handle<>(frames_object));
+        }
+        auto frames_array = reinterpret_cast<PyArrayObject*>(frames.ptr());
+        const auto line_stride  = iq_line_stride(frames_array, 1, num_samples, num_lines);
+        const auto frame_stride = PyArray_STRIDE(frames_array, 0);
+        auto frame_ptr = static_cast<char*>(PyArray_DATA(frames_array));
+
+        std::vector<float> timestamp_offsets(num_frames);
+        for (int frame_no = 0; frame_no < num_frames; frame_no++) {
+            timestamp_offsets[frame_no] = frame_no*frame_dt;
+        }
+        if (batched) {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->simulate_frames(timestamp_offsets, reinterpret_cast<std::complex<float>*>(frame_ptr), line_stride,
+                                            static_cast<size_t>(frame_stride)/sizeof(std::complex<float>));
+        } else {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->begin_stream(timestamp_offsets);
+            for (int frame_no = 0; frame_no < num_frames; frame_no++) {
+                auto iq_buffer = reinterpret_cast<std::complex<float>*>(frame_ptr + frame_no*frame_stride);
+                m_rf_simulator->next_frame(iq_buffer, line_stride);
             }
         }
-        m_rf_simulator->set_lookup_profile(IBeamProfile::s_ptr(lut));
+        return boost::python::incref(frames.ptr());
     }
 
-    PyObject* simulate_lines() {
-        // Simulate
-        std::vector<std::vector<std::complex<float>> > rf_lines;
-        m_rf_simulator->simulate_lines(rf_lines);
-        int num_rf_lines = rf_lines.size();
-        // all lines have same number of samples
-        int num_samples = rf_lines[0].size();
-        
-        // Copy over to a NumPy array.
-        int array_dims[] = {static_cast<int>(num_samples), static_cast<int>(num_rf_lines)};
-        numpy_boost<std::complex<float>, 2> array(array_dims);
-        
-        for (int sample_no = 0; sample_no < num_samples; sample_no++) {
-            for (int line_no = 0; line_no < num_rf_lines; line_no++) {
-                array[sample_no][line_no] = rf_lines[line_no][sample_no];
+    // Simulate a color Doppler packet of packet_size frames, where frame p
+    // has p*prt added to all timestamps. Returns a C-contiguous
+    // [line][sample][frame] array.
+    PyObject* simulate_packets(int packet_size, float prt) {
+        if (packet_size < 1) {
+            throw std::runtime_error(std::string(__FUNCTION__) + " : packet size must be positive");
+        }
+        cache_output_dimensions();
+        npy_intp array_dims[] = {static_cast<npy_intp>(m_num_output_lines),
+                                 static_cast<npy_intp>(m_num_output_samples),
+                                 static_cast<npy_intp>(packet_size)};
+        PyObject* packets_object = PyArray_SimpleNew(3, array_dims, NPY_COMPLEX64);
+        if (!packets_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> packets_handle(packets_object);
+        auto packets = static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(packets_object)));
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->simulate_packets(static_cast<size_t>(packet_size), prt, packets);
+        }
+        return boost::python::incref(packets_object);
+    }
+
+    // Simulate one frame per realization of the fixed scatterers as one
+    // batch, where the realizations are a sequence of [scatterer][x, y, z,
+    // amplitude] arrays. Returns a [realization][sample][line] view of a
+    // C-contiguous [realization][line][sample] array.
+    PyObject* simulate_realizations(boost::python::object realizations) {
+        const auto num_realizations = boost::python::len(realizations);
+        std::vector<FixedScatterers::s_ptr> datasets;
+        for (boost::python::ssize_t k = 0; k < num_realizations; k++) {
+            const auto data_array = contiguous_float_array(realizations[k], 2);
+            if (PyArray_DIM(as_array(data_array), 1) != 4) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : Number of columns must be four");
             }
+            const auto num_scatterers = static_cast<size_t>(PyArray_DIM(as_array(data_array), 0));
+            const auto data = float_data(data_array);
+            auto dataset = std::make_shared<FixedScatterers>();
+            dataset->scatterers.resize(num_scatterers);
+            for (size_t i = 0; i < num_scatterers; i++) {
+                auto& ps = dataset->scatterers[i];
+                ps.pos = vector3(data[4*i], data[4*i + 1], data[4*i + 2]);
+                ps.amplitude = data[4*i + 3];
+            }
+            datasets.push_back(dataset);
+        }
+        cache_output_dimensions();
+        const auto num_lines   = m_num_output_lines;
+        const auto num_samples = m_num_output_samples;
+
+        npy_intp array_dims[] = {static_cast<npy_intp>(num_realizations), static_cast<npy_intp>(num_lines), static_cast<npy_intp>(num_samples)};
+        PyObject* lines_object = PyArray_SimpleNew(3, array_dims, NPY_COMPLEX64);
+        if (!lines_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines_handle(lines_object);
+        auto iq_buffer = static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(lines_object)));
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->simulate_realizations(datasets, iq_buffer, num_samples, num_lines*num_samples);
+        }
+        npy_intp axes[] = {0, 2, 1};
+        PyArray_Dims permutation = {axes, 3};
+        PyObject* frames_object = PyArray_Transpose(reinterpret_cast<PyArrayObject*>(lines_object), &permutation);
+        if (!frames_object) {
+            boost::python::throw_error_already_set();
+        }
+        return frames_object;
+    }
+
+    // Simulate one frame per excitation from one projection of the
+    // scatterers, where the excitations are a sequence of (samples,
+    // center_index, fs, demod_freq) tuples as for set_excitation. Returns a
+    // [excitation][sample][line] view of a C-contiguous
+    // [excitation][line][sample] array.
+    PyObject* simulate_lines_multi_excitation(boost::python::object excitations) {
+        const auto num_excitations = boost::python::len(excitations);
+        std::vector<ExcitationSignal> exs(num_excitations);
+        for (boost::python::ssize_t k = 0; k < num_excitations; k++) {
+            const boost::python::object excitation = excitations[k];
+            if (boost::python::len(excitation) != 4) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : excitations must be (samples, center_index, fs, demod_freq) tuples");
+            }
+            const auto samples_array = contiguous_float_array(excitation[0], 1);
+            const auto samples = float_data(samples_array);
+            exs[k].samples.assign(samples, samples + PyArray_DIM(as_array(samples_array), 0));
+            exs[k].center_index       = boost::python::extract<int>(excitation[1]);
+            exs[k].sampling_frequency = boost::python::extract<float>(excitation[2]);
+            exs[k].demod_freq         = boost::python::extract<float>(excitation[3]);
         }
+        cache_output_dimensions();
+        const auto num_lines   = m_num_output_lines;
+        const auto num_samples = m_num_output_samples;
 
-        // Return it as a PyObject
-        PyObject* array_object = array.py_ptr();
-        Py_INCREF(array_object);
-        return array_object;
+        npy_intp array_dims[] = {static_cast<npy_intp>(num_excitations), static_cast<npy_intp>(num_lines), static_cast<npy_intp>(num_samples)};
+        PyObject* lines_object = PyArray_SimpleNew(3, array_dims, NPY_COMPLEX64);
+        if (!lines_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines_handle(lines_object);
+        auto iq_buffer = static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(lines_object)));
+        {
+            const auto lock = acquire_simulator();
+            ScopedGilRelease no_gil;
+            m_rf_simulator->simulate_lines_multi_excitation(exs, iq_buffer, num_samples, num_lines*num_samples);
+        }
+        npy_intp axes[] = {0, 2, 1};
+        PyArray_Dims permutation = {axes, 3};
+        PyObject* frames_object = PyArray_Transpose(reinterpret_cast<PyArrayObject*>(lines_object), &permutation);
+        if (!frames_object) {
+            boost::python::throw_error_already_set();
+        }
+        return frames_object;
     }
 
     boost::python::list get_debug_data(const std::string& identifier) {
+        const auto lock = acquire_simulator();
         const auto temp = m_rf_simulator->get_debug_data(identifier);
         boost::python::list res;
         for (const auto value : temp) {
@@ -309,17 +1180,164 @@ public:
     }
 
     std::string get_parameter(const std::string& key) {
+        const auto lock = acquire_simulator();
         return m_rf_simulator->get_parameter(key);
     }
 
-    size_t get_total_num_scatterers() const {
+    // [s], non-zero with a depth window
+    float get_output_start_time() {
+        const auto lock = acquire_simulator();
+        return m_rf_simulator->get_output_start_time();
+    }
+
+    size_t get_total_num_scatterers() {
+        const auto lock = acquire_simulator();
         return m_rf_simulator->get_total_num_scatterers();
     }
 
+    // {"host": {category: bytes}, "pinned": {...}, "device": {...}}
+    boost::python::dict get_memory_usage() {
+        const auto lock = acquire_simulator();
+        const auto usage = m_rf_simulator->get_memory_usage();
+        const auto to_dict = [](const std::map<std::string, size_t>& categories) {
+            boost::python::dict res;
+            for (const auto& entry : categories) {
+                res[entry.first] = entry.second;
+            }
+            return res;
+        };
+        boost::python::dict res;
+        res["host"]   = to_dict(usage.host);
+        res["pinned"] = to_dict(usage.pinned);
+        res["device"] = to_dict(usage.device);
+        return res;
+    }
+
+    // {"num_frames": ..., "num_projections": ..., "total_time": ..., ...}
+    // Does not wait for a frame in progress, the statistics are atomic.
+    boost::python::dict get_stats() {
+        boost::python::dict res;
+        for (const auto name : {"num_frames", "num_projections", "total_time", "last_frame_time", "projections_per_second"}) {
+            res[name] = std::stod(m_rf_simulator->get_parameter(std::string("stats_") + name));
+        }
+        return res;
+    }
+
+    void reset_stats() {
+        set_parameter("stats_reset", "");
+    }
+
+    void save_state(const std::string& path) {
+        const auto lock = acquire_simulator();
+        m_rf_simulator->save_state(path);
+    }
+
+    void load_state(const std::string& path) {
+        const auto lock = acquire_simulator();
+        m_output_dims_valid = false;
+        m_rf_simulator->load_state(path);
+    }
+
 protected:
+    // Wait for the queued frames without holding the GIL, and lock the
+    // simulator. The GIL is reacquired after locking: the simulator mutex
+    // is never waited for while holding the GIL, so this cannot deadlock.
+    std::unique_lock<std::mutex> acquire_simulator() {
+        ScopedGilRelease no_gil;
+        std::unique_lock<std::mutex> lock(m_simulator_mutex);
+        wait_for_queued_frames();
+        return lock;
+    }
+
+    // The errors of the frames are raised by their futures.
+    void wait_for_queued_frames() {
+        for (const auto& future : m_queued_frames) {
+            future.wait();
+        }
+        m_queued_frames.clear();
+    }
+
+    // The output dimensions are cached between configuration changes, so
+    // that queueing a frame does not wait for the queued frames.
+    void cache_output_dimensions() {
+        if (!m_output_dims_valid) {
+            const auto lock = acquire_simulator();
+            m_rf_simulator->get_output_dimensions(m_num_output_lines, m_num_output_samples);
+            m_output_dims_valid = true;
+        }
+    }
+
+    // The [sample][line] array to return, and where in it the simulator
+    // writes the lines.
+    boost::python::object output_array(boost::python::object out, std::complex<float>*& iq_buffer, size_t& line_stride) {
+        cache_output_dimensions();
+        const auto num_lines   = m_num_output_lines;
+        const auto num_samples = m_num_output_samples;
+
+        if (!out.is_none()) {
+            PyObject* out_object = out.ptr();
+            if (!PyArray_Check(out_object)) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : out must be a NumPy array");
+            }
+            auto out_array = reinterpret_cast<PyArrayObject*>(out_object);
+            if (PyArray_NDIM(out_array) != 2) {
+                throw std::runtime_error(std::string(__FUNCTION__) + " : out must be two-dimensional");
+            }
+            iq_buffer   = static_cast<std::complex<float>*>(PyArray_DATA(out_array));
+            line_stride = iq_line_stride(out_array, 0, num_samples, num_lines);
+            return out;
+        }
+
+        npy_intp array_dims[] = {static_cast<npy_intp>(num_lines), static_cast<npy_intp>(num_samples)};
+        PyObject* lines_object = PyArray_SimpleNew(2, array_dims, NPY_COMPLEX64);
+        if (!lines_object) {
+            boost::python::throw_error_already_set();
+        }
+        boost::python::handle<> lines_handle(lines_object);
+        iq_buffer   = static_cast<std::complex<float>*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(lines_object)));
+        line_stride = num_samples;
+
+        // same [sample][line] indexing as before, through strides instead of a copy
+        PyObject* array_object = PyArray_Transpose(reinterpret_cast<PyArrayObject*>(lines_object), nullptr);
+        if (!array_object) {
+            boost::python::throw_error_already_set();
+        }
+        return boost::python::object(boost::python::handle<>(array_object));
+    }
+
+    // The line stride of a writeable complex64 array with num_samples
+    // contiguous samples along sample_axis and num_lines lines along the
+    // next axis, which must not overlap.
+    static size_t iq_line_stride(PyArrayObject* array, int sample_axis, size_t num_samples, size_t num_lines) {
+        const auto sample_bytes = static_cast<npy_intp>(sizeof(std::complex<float>));
+        if ((PyArray_TYPE(array) != NPY_COMPLEX64) || !PyArray_ISWRITEABLE(array)) {
+            throw std::runtime_error("out must be a writeable complex64 array");
+        }
+        if ((PyArray_DIM(array, sample_axis) != static_cast<npy_intp>(num_samples))
+            || (PyArray_DIM(array, sample_axis + 1) != static_cast<npy_intp>(num_lines))) {
+            throw std::runtime_error("out must have num_samples samples and num_lines lines");
+        }
+        const auto line_stride_bytes = PyArray_STRIDE(array, sample_axis + 1);
+        if ((PyArray_STRIDE(array, sample_axis) != sample_bytes) || (line_stride_bytes % sample_bytes != 0)
+            || (line_stride_bytes < static_cast<npy_intp>(num_samples)*sample_bytes)) {
+            throw std::runtime_error("the samples of each line in out must be contiguous");
+        }
+        return static_cast<size_t>(line_stride_bytes/sample_bytes);
+    }
+
     IAlgorithm::s_ptr       m_rf_simulator;
     bool                    m_print_debug;
 
+    // serializes the use of the simulator between Python threads
+    std::mutex              m_simulator_mutex;
+
+    // frames queued by simulate_lines_async, guarded by m_simulator_mutex
+    std::vector<std::shared_future<void>>   m_queued_frames;
+
+    bool                    m_output_dims_valid;
+    size_t                  m_num_output_lines;
+    size_t                  m_num_output_samples;
+
 };
 
 BOOST_PYTHON_MODULE(pyrfsim) {
@@ -332,20 +1350,84 @@ BOOST_PYTHON_MODULE(pyrfsim) {
     numpy_boost_python_register_type<float, 3>();
     numpy_boost_python_register_type<std::complex<float>, 2>();
 
-    class_<RfSimulatorWrapper>("RfSimulator", init<std::string>())
+    def("create_shared_phantom", &create_shared_phantom);
+    def("sort_scatterers_for_culling", &sort_scatterers_for_culling);
+
+    class_<SimulationFuture>("SimulationFuture", no_init)
+        .def("done",                        &SimulationFuture::done)
+        .def("wait",                        &SimulationFuture::wait)
+        .def("result",                      &SimulationFuture::result)
+    ;
+
+    class_<IqRecorderWrapper, boost::noncopyable>("IqRecorder",
+            init<std::string, size_t, size_t, int, size_t>((arg("h5_file"), arg("num_lines"), arg("num_samples"),
+                                                            arg("compression_level")=0, arg("max_queued_frames")=8)))
+        .def("append",                      &IqRecorderWrapper::append, (arg("iq"), arg("timestamp")=0.0f, arg("frame_dt")=0.0f))
+        .def("close",                       &IqRecorderWrapper::close)
+        .def("get_num_frames",              &IqRecorderWrapper::get_num_frames)
+    ;
+
+    class_<SharedIqRingWrapper, boost::noncopyable>("SharedIqRing",
+            init<std::string, size_t, size_t, size_t, std::string, float, bool, int>((arg("name"), arg("num_lines"), arg("num_samples"),
+                                                            arg("capacity"), arg("sample_type")="complex64", arg("int16_scale")=0.0f,
+                                                            arg("overwrite_oldest")=true, arg("wait_timeout_ms")=1000)))
+        .def("get_end_frame_no",            &SharedIqRingWrapper::get_end_frame_no)
+    ;
+
+    class_<DeviceIqFrameWrapper>("DeviceIqFrame", no_init)
+        .def("__dlpack__",                  &DeviceIqFrameWrapper::dlpack, (arg("stream")=object()))
+        .def("__dlpack_device__",           &DeviceIqFrameWrapper::dlpack_device)
+        .add_property("__cuda_array_interface__", &DeviceIqFrameWrapper::cuda_array_interface)
+        .add_property("shape",              &DeviceIqFrameWrapper::get_shape)
+        .def("get_device",                  &DeviceIqFrameWrapper::get_device)
+        .def("synchronize",                 &DeviceIqFrameWrapper::synchronize)
+    ;
+
+    class_<RfSimulatorWrapper, boost::noncopyable>("RfSimulator", init<std::string>())
         .def("set_print_debug",             &RfSimulatorWrapper::set_print_debug)
         .def("set_parameter",               &RfSimulatorWrapper::set_parameter)
         .def("clear_fixed_scatterers",      &RfSimulatorWrapper::clear_fixed_scatterers)
         .def("add_fixed_scatterers",        &RfSimulatorWrapper::add_fixed_scatterers)
+        .def("add_fixed_scatterers_soa",    &RfSimulatorWrapper::add_fixed_scatterers_soa)
+        .def("add_shared_fixed_scatterers", &RfSimulatorWrapper::add_shared_fixed_scatterers)
+        .def("add_procedural_scatterers",   &RfSimulatorWrapper::add_procedural_scatterers,
+             (arg("region"), arg("center_x"), arg("center_y"), arg("center_z"), arg("half_x"), arg("half_y"), arg("half_z"),
+              arg("density"), arg("amplitude_distribution")="gaussian", arg("amplitude_scale")=1.0f, arg("seed")=0))
+        .def("add_image_volume_scatterers", &RfSimulatorWrapper::add_image_volume_scatterers,
+             (arg("densities"), arg("amplitude_scales"), arg("origin_x"), arg("origin_y"), arg("origin_z"),
+              arg("voxel_x"), arg("voxel_y"), arg("voxel_z"), arg("amplitude_distribution")="gaussian", arg("seed")=0))
         .def("clear_spline_scatterers",     &RfSimulatorWrapper::clear_spline_scatterers)
         .def("add_spline_scatterers",       &RfSimulatorWrapper::add_spline_scatterers)
-        .def("set_scan_sequence",           &RfSimulatorWrapper::set_scan_sequence)
+        .def("add_spline_scatterers_soa",   &RfSimulatorWrapper::add_spline_scatterers_soa)
+        .def("set_scan_sequence",           &RfSimulatorWrapper::set_scan_sequence,
+             (arg("origins"), arg("directions"), arg("line_length"), arg("lateral_dirs"), arg("timestamps"),
+              arg("r_min")=0.0f, arg("r_max")=0.0f))
+        .def("set_parametric_scan_sequence", &RfSimulatorWrapper::set_parametric_scan_sequence,
+             (arg("scan_type"), arg("num_lines_lateral"), arg("num_planes"), arg("lateral_extent"),
+              arg("elevational_extent"), arg("line_length"), arg("tilt")=0.0f, arg("first_timestamp")=0.0f, arg("line_interval")=0.0f,
+              arg("num_frames")=1, arg("frame_interval")=0.0f, arg("r_min")=0.0f, arg("r_max")=0.0f))
         .def("set_excitation",              &RfSimulatorWrapper::set_excitation)
         .def("set_analytical_beam_profile", &RfSimulatorWrapper::set_analytical_beam_profile)
         .def("set_lut_beam_profile",        &RfSimulatorWrapper::set_lut_beam_profile)
-        .def("simulate_lines",              &RfSimulatorWrapper::simulate_lines)
+        .def("simulate_lines",              &RfSimulatorWrapper::simulate_lines, (arg("out")=object()))
+        .def("simulate_to_shared_ring",     &RfSimulatorWrapper::simulate_to_shared_ring, (arg("ring"), arg("timestamp")=0.0f))
+        .def("simulate_lines_device",       &RfSimulatorWrapper::simulate_lines_device)
+        .def("simulate_lines_formatted",    &RfSimulatorWrapper::simulate_lines_formatted,
+                                            (arg("sample_type")="float16", arg("int16_scale")=0.0f))
+        .def("simulate_lines_async",        &RfSimulatorWrapper::simulate_lines_async, (arg("out")=object()))
+        .def("simulate_frames",             &RfSimulatorWrapper::simulate_frames, (arg("num_frames"), arg("frame_dt"), arg("out")=object(),
+                                                                                  arg("batched")=false))
+        .def("simulate_packets",            &RfSimulatorWrapper::simulate_packets, (arg("packet_size"), arg("prt")))
+        .def("simulate_realizations",       &RfSimulatorWrapper::simulate_realizations, (arg("realizations")))
+        .def("simulate_lines_multi_excitation", &RfSimulatorWrapper::simulate_lines_multi_excitation, (arg("excitations")))
         .def("get_debug_data",              &RfSimulatorWrapper::get_debug_data)
         .def("get_parameter",               &RfSimulatorWrapper::get_parameter)
         .def("get_total_num_scatterers",    &RfSimulatorWrapper::get_total_num_scatterers)
+        .def("get_output_start_time",       &RfSimulatorWrapper::get_output_start_time)
+        .def("get_memory_usage",            &RfSimulatorWrapper::get_memory_usage)
+        .def("get_stats",                   &RfSimulatorWrapper::get_stats)
+        .def("reset_stats",                 &RfSimulatorWrapper::reset_stats)
+        .def("save_state",                  &RfSimulatorWrapper::save_state)
+        .def("load_state",                  &RfSimulatorWrapper::load_state)
     ;
 }
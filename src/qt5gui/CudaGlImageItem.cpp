@@ -0,0 +1,299 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef BCSIM_ENABLE_CUDA
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <QMatrix4x4>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QPainter>
+#include <QPaintDevice>
+#include <QVector2D>
+#include <cuda_runtime_api.h>
+#include <cuda_gl_interop.h>
+#include "CudaGlImageItem.hpp"
+
+namespace {
+
+void cuda_check(cudaError_t result, const char* what) {
+    if (result != cudaSuccess) {
+        throw std::runtime_error(std::string(what) + " failed: " + cudaGetErrorString(result));
+    }
+}
+
+const char* vertex_shader_source =
+    "#version 150\n"
+    "in vec2 position;\n"
+    "out vec2 texcoord;\n"
+    "uniform mat4 matrix;\n"
+    "uniform vec2 size;\n"
+    "void main() {\n"
+    "    texcoord = position;\n"
+    "    gl_Position = matrix*vec4(position*size, 0.0, 1.0);\n"
+    "}\n";
+
+const char* fragment_shader_source =
+    "#version 150\n"
+    "in vec2 texcoord;\n"
+    "out vec4 fragColor;\n"
+    "uniform sampler2D image;\n"
+    "void main() {\n"
+    "    float gray = texture(image, texcoord).r;\n"
+    "    fragColor = vec4(gray, gray, gray, 1.0);\n"
+    "}\n";
+
+}   // end anonymous namespace
+
+CudaGlImageItem::DeviceFrame::DeviceFrame()
+    : data(nullptr), width(0), height(0) { }
+
+CudaGlImageItem::DeviceFrame::~DeviceFrame() {
+    if (data) {
+        cudaFree(data);
+    }
+}
+
+void CudaGlImageItem::DeviceFrame::resize(int new_width, int new_height) {
+    if ((new_width == width) && (new_height == height)) {
+        return;
+    }
+    if (data) {
+        cudaFree(data);
+        data = nullptr;
+    }
+    width = 0;
+    height = 0;
+    cuda_check(cudaMalloc(reinterpret_cast<void**>(&data), static_cast<size_t>(new_width)*new_height), "cudaMalloc");
+    width = new_width;
+    height = new_height;
+}
+
+CudaGlImageItem::CudaGlImageItem(int cuda_device_no, QGraphicsItem* parent)
+    : QGraphicsItem(parent),
+      m_cuda_device_no(cuda_device_no),
+      m_back_frame(new DeviceFrame),
+      m_front_frame(new DeviceFrame),
+      m_new_frame(false),
+      m_width(0),
+      m_height(0),
+      m_gl_initialized(false),
+      m_quad_vbo(QOpenGLBuffer::VertexBuffer),
+      m_pbo(0),
+      m_texture(0),
+      m_texture_width(0),
+      m_texture_height(0),
+      m_pbo_resource(nullptr)
+{
+}
+
+CudaGlImageItem::~CudaGlImageItem() {
+    // the OpenGL resources are freed by cleanup_gl()
+    cudaSetDevice(m_cuda_device_no);
+    m_back_frame.reset();
+    m_front_frame.reset();
+}
+
+unsigned char* CudaGlImageItem::begin_frame(int width, int height) {
+    if ((width <= 0) || (height <= 0)) {
+        throw std::runtime_error("image must have pixels");
+    }
+    cuda_check(cudaSetDevice(m_cuda_device_no), "cudaSetDevice");
+    m_back_frame->resize(width, height);
+    return m_back_frame->data;
+}
+
+void CudaGlImageItem::finish_frame(bool completed) {
+    if (!completed) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(m_frame_mutex);
+    std::swap(m_back_frame, m_front_frame);
+    m_new_frame = true;
+}
+
+void CudaGlImageItem::show_latest_frame() {
+    {
+        std::lock_guard<std::mutex> guard(m_frame_mutex);
+        if ((m_front_frame->width != m_width) || (m_front_frame->height != m_height)) {
+            prepareGeometryChange();
+            m_width = m_front_frame->width;
+            m_height = m_front_frame->height;
+        }
+    }
+    update();
+}
+
+QRectF CudaGlImageItem::boundingRect() const {
+    return QRectF(0.0, 0.0, m_width, m_height);
+}
+
+void CudaGlImageItem::initialize_gl(QOpenGLFunctions* gl) {
+    m_program = std::unique_ptr<QOpenGLShaderProgram>(new QOpenGLShaderProgram);
+    if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader_source)) {
+        throw std::runtime_error("Failed to compile image vertex shader");
+    }
+    if (!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader_source)) {
+        throw std::runtime_error("Failed to compile image fragment shader");
+    }
+    m_program->bindAttributeLocation("position", 0);
+    if (!m_program->link()) {
+        throw std::runtime_error("Failed to link image shader program");
+    }
+
+    // unit square as a triangle strip
+    const GLfloat quad[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    if (!m_quad_vbo.create()) {
+        throw std::runtime_error("Unable to create VBO for image");
+    }
+    m_quad_vbo.bind();
+    m_quad_vbo.allocate(quad, sizeof(quad));
+    m_quad_vbo.release();
+
+    gl->glGenBuffers(1, &m_pbo);
+    gl->glGenTextures(1, &m_texture);
+    gl->glBindTexture(GL_TEXTURE_2D, m_texture);
+    // bilinear filtering like the pixmap items
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_gl_initialized = true;
+}
+
+void CudaGlImageItem::upload_frame(QOpenGLFunctions* gl) {
+    std::lock_guard<std::mutex> guard(m_frame_mutex);
+    const auto& frame = *m_front_frame;
+    if (!m_new_frame || (frame.width != m_width) || (frame.height != m_height)) {
+        return;
+    }
+    m_new_frame = false;
+    cuda_check(cudaSetDevice(m_cuda_device_no), "cudaSetDevice");
+
+    const auto num_bytes = static_cast<size_t>(frame.width)*frame.height;
+    if ((frame.width != m_texture_width) || (frame.height != m_texture_height)) {
+        if (m_pbo_resource) {
+            cuda_check(cudaGraphicsUnregisterResource(m_pbo_resource), "cudaGraphicsUnregisterResource");
+            m_pbo_resource = nullptr;
+        }
+        gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        gl->glBufferData(GL_PIXEL_UNPACK_BUFFER, num_bytes, nullptr, GL_STREAM_DRAW);
+        gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        cuda_check(cudaGraphicsGLRegisterBuffer(&m_pbo_resource, m_pbo, cudaGraphicsRegisterFlagsWriteDiscard),
+                   "cudaGraphicsGLRegisterBuffer");
+
+        gl->glBindTexture(GL_TEXTURE_2D, m_texture);
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, frame.width, frame.height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        gl->glBindTexture(GL_TEXTURE_2D, 0);
+        m_texture_width = frame.width;
+        m_texture_height = frame.height;
+    }
+
+    // device to device copy into the pixel buffer
+    cuda_check(cudaGraphicsMapResources(1, &m_pbo_resource, 0), "cudaGraphicsMapResources");
+    void* pbo_data;
+    size_t pbo_size;
+    auto result = cudaGraphicsResourceGetMappedPointer(&pbo_data, &pbo_size, m_pbo_resource);
+    if (result == cudaSuccess) {
+        result = cudaMemcpy(pbo_data, frame.data, num_bytes, cudaMemcpyDeviceToDevice);
+    }
+    cuda_check(cudaGraphicsUnmapResources(1, &m_pbo_resource, 0), "cudaGraphicsUnmapResources");
+    cuda_check(result, "copy to pixel buffer");
+
+    // and from the pixel buffer to the texture, also on the device
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+    gl->glBindTexture(GL_TEXTURE_2D, m_texture);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void CudaGlImageItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* /*option*/, QWidget* /*widget*/) {
+    if ((m_width == 0) || (m_height == 0)) {
+        return;
+    }
+    // item coordinates to normalized device coordinates of the viewport
+    const auto device = painter->device();
+    QMatrix4x4 matrix;
+    matrix.ortho(0.0f, device->width(), device->height(), 0.0f, -1.0f, 1.0f);
+    matrix *= QMatrix4x4(painter->combinedTransform());
+
+    painter->beginNativePainting();
+    try {
+        auto gl = QOpenGLContext::currentContext()->functions();
+        if (!m_gl_initialized) {
+            initialize_gl(gl);
+        }
+        upload_frame(gl);
+        if (m_texture_width > 0) {
+            m_program->bind();
+            m_program->setUniformValue("matrix", matrix);
+            m_program->setUniformValue("size", QVector2D(m_width, m_height));
+            m_program->setUniformValue("image", 0);
+            gl->glActiveTexture(GL_TEXTURE0);
+            gl->glBindTexture(GL_TEXTURE_2D, m_texture);
+            m_quad_vbo.bind();
+            gl->glEnableVertexAttribArray(0);
+            gl->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), 0);
+            gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            gl->glDisableVertexAttribArray(0);
+            m_quad_vbo.release();
+            gl->glBindTexture(GL_TEXTURE_2D, 0);
+            m_program->release();
+        }
+    } catch (...) {
+        painter->endNativePainting();
+        throw;
+    }
+    painter->endNativePainting();
+}
+
+void CudaGlImageItem::cleanup_gl() {
+    if (!m_gl_initialized) {
+        return;
+    }
+    cudaSetDevice(m_cuda_device_no);
+    if (m_pbo_resource) {
+        cudaGraphicsUnregisterResource(m_pbo_resource);
+        m_pbo_resource = nullptr;
+    }
+    auto gl = QOpenGLContext::currentContext()->functions();
+    gl->glDeleteBuffers(1, &m_pbo);
+    gl->glDeleteTextures(1, &m_texture);
+    m_quad_vbo.destroy();
+    m_program.reset();
+    m_texture_width = 0;
+    m_texture_height = 0;
+    m_gl_initialized = false;
+}
+
+#endif  // BCSIM_ENABLE_CUDA
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#ifdef BCSIM_ENABLE_CUDA
+#include <memory>
+#include <mutex>
+#include <QGraphicsItem>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+
+class QOpenGLShaderProgram;
+struct cudaGraphicsResource;
+
+// A graphics item which shows 8-bit gray level images that are made on a
+// CUDA device, without copying them to the host. One thread writes frames to
+// device buffers of the item, and paint() copies the most recent frame to an
+// OpenGL pixel buffer registered with CUDA and from there to a texture. The
+// view must have a QOpenGLWidget viewport.
+class CudaGlImageItem : public QGraphicsItem {
+public:
+    explicit CudaGlImageItem(int cuda_device_no, QGraphicsItem* parent = Q_NULLPTR);
+
+    virtual ~CudaGlImageItem();
+
+    // Get device memory for a frame of width*height pixels stored row by row.
+    // Only one thread may write frames, and each call must be followed by
+    // finish_frame() also when the frame was not completed.
+    unsigned char* begin_frame(int width, int height);
+
+    // The frame of begin_frame() is shown at the next show_latest_frame()
+    // if completed.
+    void finish_frame(bool completed);
+
+    // GUI thread: resize to the latest finished frame and schedule a repaint.
+    void show_latest_frame();
+
+    virtual QRectF boundingRect() const override;
+
+    virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+    // Free the OpenGL resources and the CUDA registration of the pixel
+    // buffer. The OpenGL context of the viewport must be current.
+    void cleanup_gl();
+
+private:
+    // A frame in device memory of m_cuda_device_no.
+    struct DeviceFrame {
+        DeviceFrame();
+        ~DeviceFrame();
+        void resize(int new_width, int new_height);
+
+        unsigned char*  data;
+        int             width;
+        int             height;
+    };
+
+    void initialize_gl(QOpenGLFunctions* gl);
+
+    // Copy a new front frame to the texture through the pixel buffer.
+    void upload_frame(QOpenGLFunctions* gl);
+
+private:
+    const int                   m_cuda_device_no;
+
+    // The writer owns m_back_frame. m_frame_mutex protects the rest.
+    std::unique_ptr<DeviceFrame> m_back_frame;
+    std::unique_ptr<DeviceFrame> m_front_frame;
+    bool                        m_new_frame;
+    std::mutex                  m_frame_mutex;
+
+    // Size of the shown frame.
+    int                         m_width;
+    int                         m_height;
+
+    // OpenGL resources, created at the first paint.
+    bool                        m_gl_initialized;
+    std::unique_ptr<QOpenGLShaderProgram> m_program;
+    QOpenGLBuffer               m_quad_vbo;
+    GLuint                      m_pbo;
+    GLuint                      m_texture;
+    int                         m_texture_width;
+    int                         m_texture_height;
+    cudaGraphicsResource*       m_pbo_resource;
+};
+
+#endif  // BCSIM_ENABLE_CUDA
@@ -4,7 +4,9 @@
 #include <QWheelEvent>
 #include <QVBoxLayout>
 #include <QStatusBar>
+#include <QOpenGLWidget>
 #include "DisplayWidget.hpp"
+#include "CudaGlImageItem.hpp"
 
 class CustomView : public QGraphicsView {
 public:
@@ -29,7 +31,10 @@ protected:
 };
 
 DisplayWidget::DisplayWidget(QWidget* parent, Qt::WindowFlags f)
-    : QWidget(parent, f)
+    : QWidget(parent, f),
+      m_device_bmode_item(nullptr),
+      m_bmode_enabled(true),
+      m_device_bmode_active(false)
 {
     // If no inital size is given, the scene bouding rect will be
     // large enough to cover all items that has been added to it
@@ -49,6 +54,7 @@ DisplayWidget::DisplayWidget(QWidget* parent, Qt::WindowFlags f)
     // pixmap for color flow
     m_colorflow_item = new QGraphicsPixmapItem;
     m_colorflow_item->setTransformationMode(Qt::SmoothTransformation);
+    m_colorflow_item->setZValue(1.0);
     m_scene->addItem(m_colorflow_item);
     m_layout->addWidget(m_view);
 
@@ -59,7 +65,55 @@ DisplayWidget::DisplayWidget(QWidget* parent, Qt::WindowFlags f)
     setLayout(m_layout);
 }
 
+DisplayWidget::~DisplayWidget() {
+#ifdef BCSIM_ENABLE_CUDA
+    if (m_device_bmode_item) {
+        // the OpenGL resources belong to the context of the viewport
+        auto gl_viewport = static_cast<QOpenGLWidget*>(m_view->viewport());
+        gl_viewport->makeCurrent();
+        m_device_bmode_item->cleanup_gl();
+        gl_viewport->doneCurrent();
+    }
+#endif
+}
+
+#ifdef BCSIM_ENABLE_CUDA
+CudaGlImageItem* DisplayWidget::enable_device_bmode(int cuda_device_no) {
+    if (!m_device_bmode_item) {
+        m_view->setViewport(new QOpenGLWidget);
+        m_device_bmode_item = new CudaGlImageItem(cuda_device_no);
+        m_device_bmode_item->setVisible(false);
+        m_scene->addItem(m_device_bmode_item);
+    }
+    return m_device_bmode_item;
+}
+#endif
+
+void DisplayWidget::update_device_bmode(float x_min, float x_max, float y_min, float y_max) {
+#ifdef BCSIM_ENABLE_CUDA
+    if (!m_device_bmode_item) {
+        return;
+    }
+    bool should_autofit = m_device_bmode_item->boundingRect().isEmpty();
+    m_device_bmode_item->show_latest_frame();
+    const auto rect = m_device_bmode_item->boundingRect();
+    if (rect.isEmpty()) {
+        return;
+    }
+    m_device_bmode_item->setTransform(QTransform::fromScale((x_max - x_min)/rect.width(), (y_max - y_min)/rect.height()));
+    m_device_bmode_item->setPos(x_min, y_min);
+    m_device_bmode_active = true;
+    update_bmode_visibility();
+
+    if (should_autofit) {
+        m_view->fitInView(m_device_bmode_item, Qt::KeepAspectRatio);
+    }
+#endif
+}
+
 void DisplayWidget::update_bmode(const QPixmap& pixmap, float x_min, float x_max, float y_min, float y_max) {
+    m_device_bmode_active = false;
+    update_bmode_visibility();
     bool should_autofit = (m_pixmap_item->boundingRect().width()==0) && (m_pixmap_item->boundingRect().height()==0);
     // set pixel data and scale item
     m_pixmap_item->setPixmap(pixmap);
@@ -104,7 +158,17 @@ void DisplayWidget::update_status(const QString& msg, int timeout) {
 }
 
 void DisplayWidget::enable_b_mode(bool enabled) {
-    m_pixmap_item->setVisible(enabled);
+    m_bmode_enabled = enabled;
+    update_bmode_visibility();
+}
+
+void DisplayWidget::update_bmode_visibility() {
+    m_pixmap_item->setVisible(m_bmode_enabled && !m_device_bmode_active);
+#ifdef BCSIM_ENABLE_CUDA
+    if (m_device_bmode_item) {
+        m_device_bmode_item->setVisible(m_bmode_enabled && m_device_bmode_active);
+    }
+#endif
 }
 
 void DisplayWidget::enable_color_doppler(bool enabled) {
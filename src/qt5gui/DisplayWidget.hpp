@@ -7,16 +7,29 @@ class QGraphicsScene;
 class QGraphicsPixmapItem;
 class QVBoxLayout;
 class QStatusBar;
+class CudaGlImageItem;
 
 class DisplayWidget : public QWidget {
 Q_OBJECT
 public:
     DisplayWidget(QWidget* parent = 0, Qt::WindowFlags f=0);
 
+    virtual ~DisplayWidget();
+
     void fitInView();
 
     void update_bmode(const QPixmap& pixmap, float x_min, float x_max, float y_min, float y_max);
 
+#ifdef BCSIM_ENABLE_CUDA
+    // Draw the view with OpenGL and add an item for B-mode images which
+    // stay on the given CUDA device. Returns the item to write frames to.
+    CudaGlImageItem* enable_device_bmode(int cuda_device_no);
+#endif
+
+    // Show the latest frame written to the device B-mode item instead of the
+    // B-mode pixmap. Does nothing if enable_device_bmode() was not called.
+    void update_device_bmode(float x_min, float x_max, float y_min, float y_max);
+
     void update_colorflow(const QPixmap& pixmap, float x_min, float x_max, float y_min, float y_max);
 
     void update_status(const QString& msg, int timeout=0);
@@ -25,11 +38,19 @@ public:
 
     Q_SLOT void enable_color_doppler(bool enabled);
 
+private:
+    // Show the B-mode item which has the latest image if B-mode is enabled.
+    void update_bmode_visibility();
+
 private:
     QGraphicsView*                  m_view;
     QGraphicsScene*                 m_scene;
     QGraphicsPixmapItem*            m_pixmap_item;
     QGraphicsPixmapItem*            m_colorflow_item;
+    CudaGlImageItem*                m_device_bmode_item;
+    bool                            m_bmode_enabled;
+    // the latest B-mode image is in m_device_bmode_item
+    bool                            m_device_bmode_active;
     QVBoxLayout*                    m_layout;
     QStatusBar*                     m_status_bar;
 };
\ No newline at end of file
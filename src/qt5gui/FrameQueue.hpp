@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <deque>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+
+// Bounded queue between the stages of the frame pipeline. When it is full,
+// the oldest frame is dropped, so that a slow consumer always gets the most
+// recent frames.
+template <typename T>
+class FrameQueue {
+public:
+    explicit FrameQueue(size_t capacity)
+        : m_capacity(capacity),
+          m_num_dropped(0),
+          m_closed(false)
+    {
+        if (capacity == 0) {
+            throw std::runtime_error("frame queue capacity must be positive");
+        }
+    }
+
+    // Returns true if the oldest frame was dropped to make room.
+    bool push(T item) {
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.size() >= m_capacity) {
+                m_items.pop_front();
+                m_num_dropped++;
+                dropped = true;
+            }
+            m_items.push_back(std::move(item));
+        }
+        m_cond.notify_one();
+        return dropped;
+    }
+
+    // Wait for a frame. Returns false when the queue has been closed.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+        if (m_closed) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        return true;
+    }
+
+    // Returns false at once if the queue is empty.
+    bool try_pop(T& item) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        return true;
+    }
+
+    bool empty() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.empty();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.clear();
+    }
+
+    // Wake up and return false from all current and future calls to pop().
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_cond.notify_all();
+    }
+
+    size_t num_dropped() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_num_dropped;
+    }
+
+private:
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_cond;
+    std::deque<T>               m_items;
+    size_t                      m_capacity;
+    size_t                      m_num_dropped;
+    bool                        m_closed;
+};
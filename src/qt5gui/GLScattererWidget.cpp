@@ -27,7 +27,9 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 #include <QMouseEvent>
 #include <QOpenGLShaderProgram>
 #include <QCoreApplication>
@@ -35,12 +37,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ScattererModel.hpp"
 #include "ScanSeqModel.hpp"
 
+namespace {
+// Width of the control point texture, which is within the minimum
+// maximum texture size of OpenGL 3.
+const int CONTROL_POINTS_TEXTURE_WIDTH = 1024;
+}
+
 GLScattererWidget::GLScattererWidget(QWidget* parent)
     : QOpenGLWidget(parent),
       m_xRot(0),
       m_yRot(0),
       m_zRot(0),
-      m_camera_z(static_cast<int>(-0.18f*256))
+      m_camera_z(static_cast<int>(-0.18f*256)),
+      m_control_points_texture(0),
+      m_upload_pending(true),
+      m_lod_num_scatterers(0),
+      m_lod_camera_distance(0.0f)
 {
     m_scatterer_data = QSharedPointer<IScattererModel>(new EmptyScattererModel);
     m_scanseq_data   = QSharedPointer<ScanSeqModel>(new ScanSeqModel);
@@ -106,6 +118,10 @@ void GLScattererWidget::setCameraZ(int value) {
 
 void GLScattererWidget::cleanup() {
     makeCurrent();
+    if (m_control_points_texture) {
+        glDeleteTextures(1, &m_control_points_texture);
+        m_control_points_texture = 0;
+    }
     m_scatterers_vbo.destroy();
     m_scanseq_vbo.destroy();
     doneCurrent();
@@ -161,7 +177,12 @@ void GLScattererWidget::initializeGL() {
     if (!m_scatterers_vbo.bind()) {
         throw std::runtime_error("Unable to bind VBO for scatterers");
     }
-    m_scatterers_vbo.allocate(m_scatterer_data->constData(), m_scatterer_data->count()*sizeof(GLfloat));
+    glGenTextures(1, &m_control_points_texture);
+    glBindTexture(GL_TEXTURE_2D, m_control_points_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_upload_pending = true;
     
     // Setup out vertex buffer object for scanseq
     if (!m_scanseq_vbo.create()) {
@@ -180,6 +201,7 @@ void GLScattererWidget::initializeGL() {
     // Light position is fixed. This value is used in the fragment shader
     m_program->bind();
     m_program->setUniformValue(m_program->uniformLocation("lightPos"), QVector3D(0, 0, 70));
+    m_program->setUniformValue(m_program->uniformLocation("controlPoints"), 0);
     m_program->release();
 
     // Set light position for scanseq also
@@ -201,14 +223,30 @@ void GLScattererWidget::paintGL() {
     
     QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao);
 
+    if (m_upload_pending) {
+        uploadScatterers();
+    }
+
     if (!m_program->bind()) {
         throw std::runtime_error("Failed to bind scatterer program");
     }
     m_scatterers_vbo.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_control_points_texture);
 
     m_program->setUniformValue(m_program->uniformLocation("projMatrix"), m_proj);
     m_program->setUniformValue(m_program->uniformLocation("mvMatrix"), m_camera*m_world);
     m_program->setUniformValue(m_program->uniformLocation("normalMatrix"), m_world.normalMatrix());
+
+    // the scatterer positions at the current time
+    const auto& weights = m_scatterer_data->weights();
+    const auto num_weights = std::min(weights.size(), MAX_SPLINE_WEIGHTS);
+    m_program->setUniformValue(m_program->uniformLocation("numControlPoints"), m_scatterer_data->numControlPoints());
+    m_program->setUniformValue(m_program->uniformLocation("firstControlPoint"), m_scatterer_data->firstControlPoint());
+    m_program->setUniformValue(m_program->uniformLocation("numWeights"), num_weights);
+    if (num_weights > 0) {
+        m_program->setUniformValueArray(m_program->uniformLocation("weights"), weights.constData(), num_weights, 1);
+    }
     
     QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
     // Remember that "vertex"~0 and "normal"~1
@@ -216,7 +254,11 @@ void GLScattererWidget::paintGL() {
     f->glEnableVertexAttribArray(1);
     f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), 0);
     f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), reinterpret_cast<void*>(3*sizeof(GLfloat)));
-    glDrawArrays(GL_TRIANGLES, 0, m_scatterer_data->vertexCount());
+    const auto num_instances = numVisibleScatterers();
+    if (num_instances > 0) {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, m_scatterer_data->templateVertexCount(), num_instances);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
     m_scatterers_vbo.release();
     m_program->release();
 
@@ -263,15 +305,47 @@ void GLScattererWidget::mouseMoveEvent(QMouseEvent* event) {
 }
 
 void GLScattererWidget::updateFromModel() {
-    // Copy updated vertices
-    m_scatterers_vbo.bind();
-    m_scatterers_vbo.allocate(m_scatterer_data->constData(), m_scatterer_data->count()*sizeof(GLfloat));
-    m_scatterers_vbo.release();
+    // Copied to the GPU at the next paint, when the context is current.
+    m_upload_pending = true;
     
     // TODO: Should this be here or should the caller do it?
     update();    
 }
 
+void GLScattererWidget::setLevelOfDetail(int num_scatterers, float camera_distance) {
+    m_lod_num_scatterers = std::max(num_scatterers, 0);
+    m_lod_camera_distance = camera_distance;
+    update();
+}
+
+int GLScattererWidget::numVisibleScatterers() const {
+    const auto num_scatterers = m_scatterer_data->numScatterers();
+    if ((m_lod_num_scatterers > 0) && (-m_camera_z/256.0f > m_lod_camera_distance)) {
+        // the model has the scatterers in random order
+        return std::min(num_scatterers, m_lod_num_scatterers);
+    }
+    return num_scatterers;
+}
+
+void GLScattererWidget::uploadScatterers() {
+    m_upload_pending = false;
+
+    m_scatterers_vbo.bind();
+    m_scatterers_vbo.allocate(m_scatterer_data->templateData(), 6*m_scatterer_data->templateVertexCount()*sizeof(GLfloat));
+    m_scatterers_vbo.release();
+
+    // Wrap the control points in rows of the texture, and pad the last row.
+    const auto num_texels = m_scatterer_data->numScatterers()*m_scatterer_data->numControlPoints();
+    const auto height = std::max((num_texels + CONTROL_POINTS_TEXTURE_WIDTH - 1)/CONTROL_POINTS_TEXTURE_WIDTH, 1);
+    std::vector<GLfloat> texels(3*CONTROL_POINTS_TEXTURE_WIDTH*height, 0.0f);
+    std::copy_n(m_scatterer_data->controlPointData(), 3*num_texels, texels.begin());
+
+    glBindTexture(GL_TEXTURE_2D, m_control_points_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, CONTROL_POINTS_TEXTURE_WIDTH, height, 0, GL_RGB, GL_FLOAT, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void GLScattererWidget::setScanSequence(bcsim::ScanSequence::s_ptr scan_seq) {
     m_scanseq_data->setScanSequence(scan_seq);
 
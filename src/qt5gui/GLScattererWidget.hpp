@@ -30,7 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <memory>
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions> // provides cross-platform access to the OpenGL ES 2.0 API.
+#include <QOpenGLExtraFunctions> // provides cross-platform access to the OpenGL ES 3.0 API.
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLBuffer>
 #include <QMatrix4x4>
@@ -46,8 +46,13 @@ class ScanSeqModel;
 // [which are specific to *spline* scatterers] it should accept an
 // IScattererModel [which *then* can internally be of type spline]
 // from the user.
+//
+// The scatterers are drawn as instances of a template mesh, and their
+// positions are evaluated in the vertex shader from control points which are
+// only uploaded when the scatterers change, so that advancing time only
+// updates a few uniforms.
 class GLScattererWidget : public QOpenGLWidget,
-                          protected QOpenGLFunctions {
+                          protected QOpenGLExtraFunctions {
     Q_OBJECT
 public:
     GLScattererWidget(QWidget* parent = 0);
@@ -62,9 +67,14 @@ public:
     void setScanSequence(bcsim::ScanSequence::s_ptr scan_seq);
 
     // Must be called when the scatterer data model has changed in order to
-    // refresh the visualization.
+    // refresh the visualization. A new timestamp only needs update().
     void updateFromModel();
 
+    // Level of detail: draw only a random subset of num_scatterers
+    // scatterers when the camera is further away than camera_distance.
+    // Disabled if num_scatterers is zero.
+    void setLevelOfDetail(int num_scatterers, float camera_distance);
+
 public slots:
     void setXRotation(int angle);
     void setYRotation(int angle);
@@ -85,6 +95,13 @@ protected:
     void mousePressEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
     void mouseMoveEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
 
+private:
+    // Copy the template and the control points of the model to the GPU.
+    void uploadScatterers();
+
+    // Number of scatterers to draw with the current camera.
+    int numVisibleScatterers() const;
+
 private:
     std::unique_ptr<QOpenGLShaderProgram> m_program;
     std::unique_ptr<QOpenGLShaderProgram> m_scanseq_program;
@@ -103,7 +120,13 @@ private:
     // Data related to scatterers
     QSharedPointer<IScattererModel> m_scatterer_data;
     QOpenGLVertexArrayObject        m_vao;
+    // Template scatterer mesh
     QOpenGLBuffer                   m_scatterers_vbo;
+    // Control points of all scatterers, texel no. i at (i % width, i / width)
+    GLuint                          m_control_points_texture;
+    bool                            m_upload_pending;
+    int                             m_lod_num_scatterers;
+    float                           m_lod_camera_distance;
     
     // Data related to scan sequence
     QSharedPointer<ScanSeqModel>    m_scanseq_data;
@@ -78,13 +78,24 @@ GLVisualizationWidget::GLVisualizationWidget(const QString& scatterer_obj_file,
     m_render_sb->setCheckable(true);
     m_render_sb->setChecked(false);
     v_layout->addWidget(m_render_sb);
+    m_lod_sb = new QCheckBox("Subsample when zoomed out");
+    m_lod_sb->setCheckable(true);
+    m_lod_sb->setChecked(m_cfg->get_bool("gl_lod_enabled", true));
+    connect(m_lod_sb, &QCheckBox::toggled, this, &GLVisualizationWidget::updateLevelOfDetail);
+    v_layout->addWidget(m_lod_sb);
     setLayout(v_layout);
+    updateLevelOfDetail();
     
     xSlider->setValue(15*16);
     ySlider->setValue(345*16);
     zSlider->setValue(0*16);
 }
 
+void GLVisualizationWidget::updateLevelOfDetail() {
+    const auto num_scatterers = m_lod_sb->isChecked() ? m_cfg->get_int("gl_lod_num_scatterers", 10000) : 0;
+    glWidget->setLevelOfDetail(num_scatterers, static_cast<float>(m_cfg->get_double("gl_lod_camera_distance", 0.25)));
+}
+
 QSlider* GLVisualizationWidget::createSlider() {
     QSlider* slider = new QSlider(Qt::Vertical);
     slider->setRange(0, 360*16);
@@ -106,8 +117,8 @@ void GLVisualizationWidget::updateTimestamp(float new_timestamp) {
         temp->setTimestamp(new_timestamp);
     } 
 
-    glWidget->updateFromModel();
-    update();
+    // the positions are evaluated on the GPU, only the weights have changed
+    glWidget->update();
 }
 
 void GLVisualizationWidget::setScattererSplines(const std::vector<SplineCurve<float, bcsim::vector3> >& splines) {
@@ -63,6 +63,8 @@ public slots:
 private:
     QSlider* createSlider();
 
+    void updateLevelOfDetail();
+
 private:
     GLScattererWidget*      glWidget;
     QSlider*                xSlider;
@@ -76,6 +78,9 @@ private:
     // for controlling rendering of point scatterers
     QCheckBox*              m_render_sb;
 
+    // for drawing a subset of the scatterers when zoomed out
+    QCheckBox*              m_lod_sb;
+
 	QString					m_scatterer_obj_file;
     IConfig::s_ptr          m_cfg;
 };
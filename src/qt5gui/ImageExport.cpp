@@ -1,36 +1,197 @@
+#include <algorithm>
+#include <stdexcept>
 #include <QPixmap>
 #include <QImage>
 #include <QDir>
+#include <QProcess>
 #include "ImageExport.hpp"
 
-ImageSaver::ImageSaver(const QString& output_path)
+ImageSaver::ImageSaver(const QString& output_path, int num_threads, size_t max_pending)
     : m_output_path(output_path),
-      m_quality_factor(100)
+      m_quality_factor(100),
+      m_num_threads(num_threads),
+      m_max_pending(max_pending),
+      m_num_active(0),
+      m_num_dropped(0),
+      m_num_failed(0),
+      m_stop(false)
 {
+    if (max_pending == 0) {
+        throw std::runtime_error("image export queue capacity must be positive");
+    }
+    if (m_num_threads <= 0) {
+        m_num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()/2));
+    }
     set_format_str("Image%1.bmp");
     reset_counter();
 }
 
+ImageSaver::~ImageSaver() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_cond.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
 void ImageSaver::set_format_str(const QString& format_str) {
     m_format_str = format_str;
 }
 
+void ImageSaver::set_video_encoder(const QString& program, const QStringList& arguments) {
+    if (!m_workers.empty()) {
+        throw std::runtime_error("video encoder must be set before the first frame is added");
+    }
+    m_video_program   = program;
+    m_video_arguments = arguments;
+}
+
 void ImageSaver::reset_counter() {
     m_counter = 0;
 }
 
 const QString ImageSaver::add(const QPixmap& pixmap) {
-    const auto img_file = construct_cur_image_path();
-    pixmap.save(img_file, 0, m_quality_factor);
-    m_counter++;
-    return img_file;
+    // QPixmap can only be used from the GUI thread.
+    return add(pixmap.toImage());
 }
 
 const QString ImageSaver::add(const QImage& image) {
-    const auto img_file = construct_cur_image_path();
-    image.save(img_file, 0, m_quality_factor);
+    if (m_workers.empty()) {
+        start_workers();
+    }
+    Job job;
+    job.image = image;
+    job.path  = m_video_program.isEmpty() ? construct_cur_image_path()
+                                          : QString("%1 (video frame %2)").arg(m_output_path).arg(m_counter);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_jobs.size() >= m_max_pending) {
+            m_num_dropped++;
+            return QString();
+        }
+        m_jobs.push_back(job);
+    }
+    m_job_cond.notify_one();
     m_counter++;
-    return img_file;
+    return job.path;
+}
+
+void ImageSaver::finish() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cond.wait(lock, [this]() { return m_jobs.empty() && m_num_active == 0; });
+}
+
+bool ImageSaver::is_backlogged() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return 2*(m_jobs.size() + m_num_active) > m_max_pending;
+}
+
+size_t ImageSaver::num_pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size() + m_num_active;
+}
+
+size_t ImageSaver::num_dropped() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_dropped;
+}
+
+size_t ImageSaver::num_failed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_failed;
+}
+
+void ImageSaver::start_workers() {
+    // frames must reach the video encoder in order.
+    const auto num_workers = m_video_program.isEmpty() ? m_num_threads : 1;
+    for (int i = 0; i < num_workers; i++) {
+        m_workers.emplace_back(&ImageSaver::worker_loop, this);
+    }
+}
+
+void ImageSaver::worker_loop() {
+    // the encoder process is owned by the single video worker thread.
+    std::unique_ptr<QProcess> encoder;
+    QSize frame_size;
+    Job job;
+    while (pop_job(job)) {
+        bool ok;
+        if (m_video_program.isEmpty()) {
+            ok = job.image.save(job.path, 0, m_quality_factor);
+        } else {
+            ok = write_video_frame(encoder, frame_size, job.image);
+        }
+        job = Job();
+        job_done(ok);
+    }
+    if (encoder) {
+        encoder->closeWriteChannel();
+        encoder->waitForFinished(-1);
+    }
+}
+
+bool ImageSaver::pop_job(Job& job) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_cond.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+    // drain the queue before stopping.
+    if (m_jobs.empty()) {
+        return false;
+    }
+    job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_num_active++;
+    return true;
+}
+
+void ImageSaver::job_done(bool ok) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_num_active--;
+        if (!ok) {
+            m_num_failed++;
+        }
+    }
+    m_idle_cond.notify_all();
+}
+
+bool ImageSaver::write_video_frame(std::unique_ptr<QProcess>& encoder, QSize& frame_size, const QImage& image) {
+    if (!encoder) {
+        // raw video has a fixed frame size, given by the first frame.
+        frame_size = image.size();
+        QStringList arguments;
+        for (auto argument : m_video_arguments) {
+            arguments << argument.replace("{width}", QString::number(frame_size.width()))
+                                 .replace("{height}", QString::number(frame_size.height()));
+        }
+        encoder = std::make_unique<QProcess>();
+        encoder->setWorkingDirectory(m_output_path);
+        encoder->setProcessChannelMode(QProcess::ForwardedChannels);
+        encoder->start(m_video_program, arguments);
+        encoder->waitForStarted(-1);
+    }
+    if (encoder->state() != QProcess::Running) {
+        return false;
+    }
+
+    const auto& sized = (image.size() == frame_size) ? image : image.scaled(frame_size);
+    const auto rgb = sized.convertToFormat(QImage::Format_RGB888);
+    // scanlines are padded to 32 bits
+    const auto line_bytes = 3*rgb.width();
+    for (int y = 0; y < rgb.height(); y++) {
+        if (encoder->write(reinterpret_cast<const char*>(rgb.constScanLine(y)), line_bytes) != line_bytes) {
+            return false;
+        }
+    }
+    // there is no event loop in this thread to flush the write buffer.
+    while (encoder->bytesToWrite() > 0) {
+        if (!encoder->waitForBytesWritten(-1)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 const QString ImageSaver::construct_cur_image_path() const {
@@ -1,39 +1,111 @@
 #pragma once
 #include <QString>
+#include <QStringList>
+#include <QImage>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 class QPixmap;
+class QProcess;
 
 // Class for managing saving of numbered sequence of images, such
 // as Image00001.bmp, Image00002.bmp, ...
+//
+// Frames are encoded and written by a pool of worker threads, so add()
+// returns at once. At most max_pending frames can wait in the queue;
+// callers should stop producing frames while is_backlogged() is true.
+// Alternatively, all frames can be piped as raw RGB video to an external
+// encoder such as ffmpeg, see set_video_encoder().
 class ImageSaver {
 public:
     typedef std::unique_ptr<ImageSaver> ptr;
 
     // create new saver that will put images in output_path.
-    explicit ImageSaver(const QString& output_path);
+    // num_threads=0 uses half of the hardware threads.
+    explicit ImageSaver(const QString& output_path, int num_threads=0, size_t max_pending=16);
+
+    // waits until all queued frames have been written.
+    ~ImageSaver();
 
     // set format string to use, eg. "Image%1.bmp"
     void set_format_str(const QString& format_str);
 
-    // returns name of file that was saved
+    // Pipe frames to an external encoder instead of writing image files.
+    // The process is started in the output folder when the first frame
+    // arrives, and "{width}" and "{height}" in the arguments are replaced
+    // by the frame size, e.g.
+    //   ffmpeg -y -f rawvideo -pix_fmt rgb24 -s {width}x{height} -r 25 -i - cine.mp4
+    // Must be called before the first frame is added.
+    void set_video_encoder(const QString& program, const QStringList& arguments);
+
+    // returns name of file that will be saved, or an empty string
+    // if the queue was full and the frame was dropped.
     const QString add(const QPixmap& pixmap);
 
-    // returns name of file that was saved
+    // returns name of file that will be saved, or an empty string
+    // if the queue was full and the frame was dropped.
     const QString add(const QImage& image);
 
+    // wait until all queued frames have been written.
+    void finish();
+
+    // true when the queue is more than half full. The remaining part
+    // absorbs frames that are already in flight in the frame pipeline.
+    bool is_backlogged() const;
+
+    size_t num_pending() const;
+
+    size_t num_dropped() const;
+
+    // number of frames that failed to encode or write.
+    size_t num_failed() const;
+
     void reset_counter();
 
     const QString get_output_path() const;
 
 private:
+    struct Job {
+        QImage  image;
+        QString path;
+    };
+
     const QString construct_cur_basename() const;
 
     const QString construct_cur_image_path() const;
 
+    void start_workers();
+
+    void worker_loop();
+
+    bool pop_job(Job& job);
+
+    void job_done(bool ok);
+
+    bool write_video_frame(std::unique_ptr<QProcess>& encoder, QSize& frame_size, const QImage& image);
+
 private:
     size_t  m_counter;
     QString m_output_path;
     QString m_format_str;
     int     m_quality_factor;
+
+    int                         m_num_threads;
+    size_t                      m_max_pending;
+    std::vector<std::thread>    m_workers;
+    QString                     m_video_program;
+    QStringList                 m_video_arguments;
+
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_job_cond;
+    std::condition_variable     m_idle_cond;
+    std::deque<Job>             m_jobs;
+    size_t                      m_num_active;
+    size_t                      m_num_dropped;
+    size_t                      m_num_failed;
+    bool                        m_stop;
 };
@@ -1,6 +1,7 @@
 #include <QTextEdit>
 #include <QVBoxLayout>
 #include <QString>
+#include <QThread>
 #include "LogWidget.hpp"
 
 LogWidget::LogWidget(QWidget* parent, Qt::WindowFlags f)
@@ -15,22 +16,32 @@ LogWidget::LogWidget(QWidget* parent, Qt::WindowFlags f)
 }
 
 void LogWidget::write(bcsim::ILog::LogType type, const std::string& msg) {
+    // e.g. the simulator logs from the simulation thread
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "append_message", Qt::QueuedConnection,
+                                  Q_ARG(int, static_cast<int>(type)), Q_ARG(QString, QString::fromStdString(msg)));
+        return;
+    }
+    append_message(static_cast<int>(type), QString::fromStdString(msg));
+}
+
+void LogWidget::append_message(int type, const QString& msg) {
     switch (type) {
     case bcsim::ILog::DEBUG:
         m_text_edit->setTextColor(QColor("grey"));
-        m_text_edit->append("[debug] " + QString::fromStdString(msg));
+        m_text_edit->append("[debug] " + msg);
         break;
     case bcsim::ILog::FATAL:
         m_text_edit->setTextColor(QColor("red"));
-        m_text_edit->append("[fatal] " + QString::fromStdString(msg));
+        m_text_edit->append("[fatal] " + msg);
         break;
     case bcsim::ILog::INFO:
         m_text_edit->setTextColor(QColor("green"));
-        m_text_edit->append("[info] " + QString::fromStdString(msg));
+        m_text_edit->append("[info] " + msg);
         break;
     case bcsim::ILog::WARNING:
         m_text_edit->setTextColor(QColor("black"));
-        m_text_edit->append("[warning] " + QString::fromStdString(msg));
+        m_text_edit->append("[warning] " + msg);
         break;
     }
 }
@@ -9,10 +9,14 @@ Q_OBJECT
 public:
     LogWidget(QWidget* parent=Q_NULLPTR, Qt::WindowFlags f= Qt::WindowFlags());
         
+    // Can be called from any thread.
     virtual void write(bcsim::ILog::LogType type, const std::string& msg) override;
 
     void clear_contents();
         
+private:
+    Q_SLOT void append_message(int type, const QString& msg);
+
 private:
     QTextEdit*  m_text_edit;
 };
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cmath>
 #include <algorithm>
 #include <random> // for selecting scatterers
+#include <chrono>
 
 #include <QMenuBar>
 #include <QMenu>
@@ -48,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "MainWindow.hpp"
 #include "../utils/HDFConvenience.hpp"
+#include "../utils/BinaryPhantom.hpp"
 #include "../core/LibBCSim.hpp"
 #include "utils.hpp" // needed for generating grayscale colortable
 #include "../utils/SimpleHDF.hpp"    // for reading scatterer splines for vis.
@@ -61,22 +63,61 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ExcitationSignalWidget.hpp"
 #include "SimulationParamsWidget.hpp"
 #include "../utils/SignalProcessing.hpp"
+#include "../utils/ColorFlowEstimator.hpp"
 #include "../utils/ScanGeometry.hpp"
 #include "../core/BCSimConfig.hpp"
 #include "ProbeWidget.hpp"
 #include "SimTimeWidget.hpp"
 #include "GrayscaleTransformWidget.hpp"
 #include "RefreshWorker.hpp"
+#include "SimulationWorker.hpp"
 #include "QSettingsConfigAdapter.hpp"
 #include "QFileAdapter.hpp"
 #include "../utils/DefaultPhantoms.hpp"
 
+namespace {
+
+// Scan conversion matching the refresh worker for a scan geometry.
+bcsim::BModeImageConfig make_bmode_image_config(bcsim::ScanGeometry::ptr geometry, float dpm,
+                                                const GrayscaleTransformSettings& grayscale_settings) {
+    bcsim::BModeImageConfig config;
+    if (auto sector_geo = std::dynamic_pointer_cast<bcsim::SectorScanGeometry>(geometry)) {
+        config.sector = true;
+        sector_geo->get_angle_limits(config.beam_min, config.beam_max);
+        config.range_max = sector_geo->depth;
+    } else if (auto linear_geo = std::dynamic_pointer_cast<bcsim::LinearScanGeometry>(geometry)) {
+        config.sector = false;
+        config.beam_min = -0.5f*linear_geo->width;
+        config.beam_max = 0.5f*linear_geo->width;
+        config.range_max = linear_geo->range_max;
+    } else {
+        throw std::runtime_error("unknown scan geometry");
+    }
+    geometry->get_xy_extent(config.x_min, config.x_max, config.y_min, config.y_max);
+    float width_m, height_m;
+    bcsim::GetCartesianDimensions(geometry, width_m, height_m);
+    config.width  = static_cast<int>(static_cast<size_t>(width_m*dpm));
+    config.height = static_cast<int>(static_cast<size_t>(height_m*dpm));
+
+    config.dyn_range       = grayscale_settings.dyn_range;
+    config.gain            = grayscale_settings.gain;
+    config.normalize_const = grayscale_settings.normalization_const;
+    config.auto_normalize  = grayscale_settings.auto_normalize;
+    return config;
+}
+
+}   // end anonymous namespace
+
 MainWindow::MainWindow() {
     // Make standalone log window
     m_log_widget = new LogWidget;
     m_log_widget->show();
     m_log_widget->resize(400, 400);
     onLoadIniSettings();
+    // The simulator logs from its threads through a queue, so that they do
+    // not wait for the log widget. The log widget is not owned by the queue.
+    m_sim_log = std::make_shared<bcsim::AsyncLog>(std::shared_ptr<bcsim::ILog>(m_log_widget, [](bcsim::ILog*) { }),
+                                                  1024, m_settings->value("max_log_messages_per_sec", 200).toUInt());
 
     // Simulation time manager
     m_sim_time_manager = new SimTimeManager(0.0f, 1.0f);
@@ -153,65 +194,60 @@ MainWindow::MainWindow() {
     v_layout->addLayout(h_layout);
     v_layout->addWidget(m_time_widget);
 
-    createNewSimulator("auto");
-    m_display_widget = new DisplayWidget;
-    h_layout->addWidget(m_display_widget);
-    
-    // Playback timer
-    m_playback_timer = new QTimer;
-    m_playback_millisec = 1;
-    connect(m_playback_timer, SIGNAL(timeout()), this, SLOT(onTimer()));
-
-    int num_lines;
-    auto geometry = m_scanseq_widget->get_geometry(num_lines);
-    newScansequence(geometry, num_lines, m_scanseq_widget->all_timestamps_equal());
-
     // refresh thread setup
     qRegisterMetaType<refresh_worker::WorkTask::ptr>();
     qRegisterMetaType<refresh_worker::WorkResult::ptr>();
     m_refresh_worker = new refresh_worker::RefreshWorker(10);
 
     connect(m_refresh_worker, &refresh_worker::RefreshWorker::processed_bmode_data_available, [&](refresh_worker::WorkResult::ptr work_result) {
-        auto result_image = work_result->image.get_image();
-        result_image.setColorTable(GrayColortable());
-
-        // get Cartesian extents from current scan geometry.
-        const auto geometry = m_scanseq_widget->get_geometry(num_lines);
-        float x_min, x_max, y_min, y_max;
-        geometry->get_xy_extent(x_min, x_max, y_min, y_max);
-
-        m_display_widget->update_bmode(QPixmap::fromImage(result_image), x_min, x_max, y_min, y_max);
+        showBModeResult(work_result);
+    });
 
-        if (m_ultrasound_image_exporter) {
-            const auto written_image = m_ultrasound_image_exporter->add(result_image);
-            m_log_widget->write(bcsim::ILog::INFO, "Simulation time is " + std::to_string(m_sim_time_manager->get_time()) + ". Wrote image " + written_image.toStdString());
-        }
-        // store updated normalization constant if enabled.
-        auto temp = m_grayscale_widget->get_values();
-        if (temp.auto_normalize) {
-            m_grayscale_widget->set_normalization_constant(work_result->updated_normalization_const);
-        }
+    connect(m_refresh_worker, &refresh_worker::RefreshWorker::processed_color_data_available, [&](refresh_worker::WorkResult::ptr work_result) {
+        showColorResult(work_result);
+    });
 
-        // store grabbed OpenGL image if enabled
-        if (m_opengl_image_exporter) {
-            const auto written_image = m_opengl_image_exporter->add(m_gl_vis_widget->getGlImage());
-            m_log_widget->write(bcsim::ILog::INFO, "Wrote grabbed OpenGL image to " + written_image.toStdString());
+    // A fixed amount of memory for the most recent IQ frames. By default as
+    // many frames as fit, unless the number of frames is set.
+    m_iq_buffer = std::make_shared<bcsim::IqRingBuffer>(m_settings->value("iq_buffer_megabytes", 256.0).toDouble(),
+                                                        m_settings->value("iq_buffer_frames", 0).toUInt());
+    m_iq_record_frame_no = 0;
+
+    // simulation thread setup
+    m_simulation_worker = new simulation_worker::SimulationWorker(m_refresh_worker,
+                                                                  m_sim_log,
+                                                                  m_iq_buffer,
+                                                                  m_settings->value("max_queued_frames", 2).toInt(),
+                                                                  this);
+    connect(m_simulation_worker, &simulation_worker::SimulationWorker::frame_simulated, this, [&](int num_samples) {
+        if (m_save_iq_act->isChecked() && (m_iq_file != "")) {
+            recordBufferedIqFrames();
         }
+        m_display_widget->update_status(QString("Radial samples: %1").arg(num_samples));
     });
 
+    m_sim_on_gpu = false;
+    m_num_scatterer_subsets = 1;
+    m_preview_subsets = 1;
+    createNewSimulator("auto");
+    m_display_widget = new DisplayWidget;
+    h_layout->addWidget(m_display_widget);
+    m_device_bmode_item = nullptr;
+#ifdef BCSIM_ENABLE_CUDA
+    // display B-mode images from the GPU simulator without copying them to the host
+    if (m_settings->value("cuda_gl_interop", false).toBool()) {
+        m_device_bmode_item = m_display_widget->enable_device_bmode(m_settings->value("cuda_device_no", 0).toInt());
+    }
+#endif
+    
+    // Playback timer
+    m_playback_timer = new QTimer;
+    m_playback_millisec = 1;
+    connect(m_playback_timer, SIGNAL(timeout()), this, SLOT(onTimer()));
 
-    connect(m_refresh_worker, &refresh_worker::RefreshWorker::processed_color_data_available, [&](refresh_worker::WorkResult::ptr work_result) {
-        auto result_image = work_result->image.get_image();
-
-        // get Cartesian extents from current scan geometry.
-        const auto geometry = m_scanseq_widget->get_geometry(num_lines);
-        float x_min, x_max, y_min, y_max;
-        geometry->get_xy_extent(x_min, x_max, y_min, y_max);
-
-        m_display_widget->update_colorflow(QPixmap::fromImage(result_image), x_min, x_max, y_min, y_max);
-        
-        // TODO: Handle saving PNG images
-    });
+    int num_lines;
+    auto geometry = m_scanseq_widget->get_geometry(num_lines);
+    newScansequence(geometry, num_lines, m_scanseq_widget->all_timestamps_equal());
 
     createMenus();
 
@@ -300,7 +336,7 @@ void MainWindow::createMenus() {
                 m_log_widget->write(bcsim::ILog::WARNING, "No folder selected. Skipping");
                 return;
             }
-            m_ultrasound_image_exporter = std::make_unique<ImageSaver>(out_path);
+            m_ultrasound_image_exporter = createImageExporter(out_path);
         } else {
             m_ultrasound_image_exporter = nullptr;
         }
@@ -317,25 +353,27 @@ void MainWindow::createMenus() {
                 m_log_widget->write(bcsim::ILog::WARNING, "No folder selected. Skipping");
                 return;
             } 
-            m_opengl_image_exporter = std::make_unique<ImageSaver>(out_path);
+            m_opengl_image_exporter = createImageExporter(out_path);
         } else {
             m_opengl_image_exporter = 0;
         }
     });
     simulateMenu->addAction(save_opengl_image_act);
 
-    m_save_iq_act = new QAction(tr("Save IQ data"), this);
+    m_save_iq_act = new QAction(tr("Record IQ data"), this);
     m_save_iq_act->setCheckable(true);
     m_save_iq_act->setChecked(false);
+    connect(m_save_iq_act, SIGNAL(toggled(bool)), this, SLOT(onRecordIqToggled(bool)));
     simulateMenu->addAction(m_save_iq_act);
 
-    m_save_iq_buffer_as_act = new QAction(tr("Save IQ buffer as"), this);
-    connect(m_save_iq_buffer_as_act, SIGNAL(triggered()), this, SLOT(onSaveIqBufferAs()));
-    simulateMenu->addAction(m_save_iq_buffer_as_act);
+    auto save_iq_buffer_act = new QAction(tr("Save IQ buffer"), this);
+    connect(save_iq_buffer_act, SIGNAL(triggered()), this, SLOT(onSaveIqBuffer()));
+    simulateMenu->addAction(save_iq_buffer_act);
 
-    m_reset_iq_buffer_act = new QAction(tr("Reset IQ buffer"), this);
-    connect(m_reset_iq_buffer_act, SIGNAL(triggered()), this, SLOT(onResetIqBuffer()));
-    simulateMenu->addAction(m_reset_iq_buffer_act);
+    m_simulator_bmode_act = new QAction(tr("B-mode processing in simulator"), this);
+    m_simulator_bmode_act->setCheckable(true);
+    m_simulator_bmode_act->setChecked(m_settings->value("simulator_bmode_processing", false).toBool());
+    simulateMenu->addAction(m_simulator_bmode_act);
 
     auto save_cartesian_limits_act = new QAction(tr("Save xy extent"), this);
     connect(save_cartesian_limits_act, &QAction::triggered, [&]() {
@@ -397,7 +435,7 @@ void MainWindow::createMenus() {
                 try {
                     m_log_widget->write(bcsim::ILog::DEBUG, "=== key:" + key + "===");
                     std::stringstream ss;
-                    for (const auto v : m_sim->get_debug_data(key)) {
+                    for (const auto v : sim()->get_debug_data(key)) {
                         ss << v << " ";
                     }
                     m_log_widget->write(bcsim::ILog::DEBUG, ss.str());
@@ -436,7 +474,7 @@ void MainWindow::createMenus() {
 }
 
 void MainWindow::onLoadScatterers() {
-    auto h5_file = QFileDialog::getOpenFileName(this, tr("Load h5 scatterer dataset"), "", tr("h5 files (*.h5)"));
+    auto h5_file = QFileDialog::getOpenFileName(this, tr("Load h5 scatterer dataset"), "", tr("Scatterer files (*.h5 *.bin);;h5 files (*.h5);;Binary phantoms (*.bin)"));
     if (h5_file == "") {
         m_log_widget->write(bcsim::ILog::WARNING, "Invalid scatterer file. Skipping");
         return;
@@ -484,15 +522,24 @@ void MainWindow::onSetSimulatorNoise() {
     }
 
     m_log_widget->write(bcsim::ILog::DEBUG, "Setting new noise amplitude: " + std::to_string(noise_amplitude));
-    m_sim->set_parameter("noise_amplitude", std::to_string(noise_amplitude));
+    sim()->set_parameter("noise_amplitude", std::to_string(noise_amplitude));
+}
+
+simulation_worker::LockedSimulator MainWindow::sim() {
+    return simulation_worker::LockedSimulator(m_simulation_worker->lock_simulator(), m_sim.get());
 }
 
 void MainWindow::createNewSimulator(const QString& sim_type) {
+    // frames requested from the previous simulator
+    m_simulation_worker->clear_requests();
     const int gpu_device_no = m_settings->value("cuda_device_no", 0).toInt();
     bool force_cpu = false;
     bool force_gpu = false;
     QString window_title_extra;
     m_sim = nullptr;
+    m_sim_on_gpu = false;
+    m_num_scatterer_subsets = 1;
+    m_preview_subsets = 1;
     if (sim_type == "auto") {
         if (m_hardware_autodetector.built_with_gpu_support()) {
             const auto gpu_name = m_hardware_autodetector.get_gpu_name(gpu_device_no);
@@ -506,18 +553,21 @@ void MainWindow::createNewSimulator(const QString& sim_type) {
     }
     if (sim_type == "gpu" || force_gpu) {
         m_sim = bcsim::Create("gpu");
-        m_sim->set_parameter("gpu_device", std::to_string(gpu_device_no));
+        sim()->set_parameter("gpu_device", std::to_string(gpu_device_no));
+        m_sim_on_gpu = true;
     } else if (sim_type == "cpu" || force_cpu) {
         const auto num_cores = m_settings->value("cpu_sim_num_cores", m_hardware_autodetector.max_openmp_threads()).toInt();
         m_log_widget->write(bcsim::ILog::INFO, "Simulator will use " + std::to_string(num_cores) + " threads");
         m_sim = bcsim::Create("cpu");
-        m_sim->set_parameter("num_cpu_cores", std::to_string(num_cores));
+        sim()->set_parameter("num_cpu_cores", std::to_string(num_cores));
         window_title_extra = QString::number(num_cores) + " CPU threads";
+        // large phantoms are previewed with a part of their scatterers
+        m_num_scatterer_subsets = std::max(1, m_settings->value("progressive_num_subsets", 1).toInt());
+        sim()->set_parameter("cpu_scatterer_subsets", std::to_string(m_num_scatterer_subsets));
     }
     if (!m_sim) throw std::runtime_error("This should never happen - simulator was not created!");
 
-    // The simulator needs a shared pointer. A dummy deleted ensures that it doesn't try to delete our log widget.
-    m_sim->set_logger(std::shared_ptr<bcsim::ILog>(m_log_widget, [](bcsim::ILog*) { }));
+    sim()->set_logger(m_sim_log);
     setWindowTitle("BCSimGUI @ " + window_title_extra);
     
     // onLoadScatterers(); // ask user for a scatterer dataset.
@@ -534,17 +584,17 @@ void MainWindow::createNewSimulator(const QString& sim_type) {
     default_phantoms::LeftVentricle3dPhantomFactory lv_phantom_factory(lv_params, csv_adapter(), [&](const std::string& log_msg) {
         m_log_widget->write(bcsim::ILog::DEBUG, "LV phantom factory: " + log_msg);
     });
-    m_sim->clear_fixed_scatterers();
-    m_sim->clear_spline_scatterers();
+    sim()->clear_fixed_scatterers();
+    sim()->clear_spline_scatterers();
     auto lv_spline_scatterers = bcsim::SplineScatterers::s_ptr(lv_phantom_factory.get());
     m_log_widget->write(bcsim::ILog::INFO, "Auto-generated phantom contains " + std::to_string(lv_spline_scatterers->num_scatterers()) + " scatterers");
     updateWithNewSplineScatterers(lv_spline_scatterers);
     updateOpenGlVisualization();
 
-    m_sim->set_parameter("verbose", "0");
-    m_sim->set_parameter("sound_speed", "1540.0");
-    m_sim->set_parameter("radial_decimation", std::to_string(m_settings->value("radial_decimation", 15).toInt()));
-    m_sim->set_parameter("phase_delay", "on");
+    sim()->set_parameter("verbose", "0");
+    sim()->set_parameter("sound_speed", "1540.0");
+    sim()->set_parameter("radial_decimation", std::to_string(m_settings->value("radial_decimation", 15).toInt()));
+    sim()->set_parameter("phase_delay", "on");
 
     // force-emit from all widgets to ensure a fully configured simulator.
     m_excitation_signal_widget->force_emit();
@@ -558,14 +608,14 @@ void MainWindow::createNewSimulator(const QString& sim_type) {
     // use Gaussian beam profile by default
     const auto sigma_lateral     = m_beamprofile_widget->get_lateral_sigma();
     const auto sigma_elevational = m_beamprofile_widget->get_elevational_sigma();
-    m_sim->set_analytical_profile(bcsim::IBeamProfile::s_ptr(new bcsim::GaussianBeamProfile(sigma_lateral, sigma_elevational)));
+    sim()->set_analytical_profile(bcsim::IBeamProfile::s_ptr(new bcsim::GaussianBeamProfile(sigma_lateral, sigma_elevational)));
 
     updateOpenGlVisualization();
     m_log_widget->write(bcsim::ILog::INFO, "Created simulator");
 }
 
 void MainWindow::updateWithNewFixedScatterers(bcsim::FixedScatterers::s_ptr fixed_scatterers) {
-    m_sim->add_fixed_scatterers(fixed_scatterers);
+    sim()->add_fixed_scatterers(fixed_scatterers);
     try {
         initializeFixedVisualization(fixed_scatterers);
     }
@@ -575,7 +625,7 @@ void MainWindow::updateWithNewFixedScatterers(bcsim::FixedScatterers::s_ptr fixe
 }
 
 void MainWindow::updateWithNewSplineScatterers(bcsim::SplineScatterers::s_ptr spline_scatterers) {
-    m_sim->add_spline_scatterers(spline_scatterers);
+    sim()->add_spline_scatterers(spline_scatterers);
 
     // Handle visualization in OpenGL - TODO: Update (sample some scatterers from all collections?)
     // This does not yet support hdf5 files with both types of scatterers!
@@ -600,8 +650,24 @@ void MainWindow::loadScatterers(const QString h5_file) {
         m_log_widget->write(bcsim::ILog::WARNING, "Invalid scatterer file. Skipping");
         return;
     }
-    m_sim->clear_fixed_scatterers();
-    m_sim->clear_spline_scatterers();
+    sim()->clear_fixed_scatterers();
+    sim()->clear_spline_scatterers();
+
+    const auto phantom_file = std::string(h5_file.toUtf8().constData());
+    if (bcsim::isBinaryPhantom(phantom_file)) {
+        try {
+            const bcsim::MappedPhantom phantom(phantom_file);
+            if (phantom.has_fixed_scatterers()) {
+                updateWithNewFixedScatterers(phantom.get_fixed_scatterers());
+            }
+            if (phantom.has_spline_scatterers()) {
+                updateWithNewSplineScatterers(phantom.get_spline_scatterers());
+            }
+        } catch (std::runtime_error& e) {
+            m_log_widget->write(bcsim::ILog::WARNING, "Could not read binary phantom: " + std::string(e.what()));
+        }
+        return;
+    }
 
     // load fixed scatterers (if found)
     try {
@@ -618,7 +684,8 @@ void MainWindow::loadScatterers(const QString h5_file) {
     }
 }
 
-void MainWindow::newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_num_lines, bool equal_timestamps) {
+void MainWindow::newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_num_lines, bool equal_timestamps,
+                                 bool configure_simulator) {
     const auto cur_time = m_sim_time_manager->get_time();
 
     // Get probe origin and orientation corresponding to current simulation time.
@@ -634,7 +701,9 @@ void MainWindow::newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_
 
     new_scanseq->all_timestamps_equal = equal_timestamps;
 
-    m_sim->set_scan_sequence(new_scanseq);
+    if (configure_simulator) {
+        sim()->set_scan_sequence(new_scanseq);
+    }
     m_cur_scanseq = new_scanseq;
     
     if (m_settings->value("enable_gl_widget", true).toBool()) {
@@ -646,7 +715,7 @@ void MainWindow::setExcitation(const QString h5_file) {
     throw std::runtime_error("this function should not be used");
     try {
         auto new_excitation = bcsim::loadExcitationFromHdf(h5_file.toUtf8().constData());
-        m_sim->set_excitation(new_excitation);
+        sim()->set_excitation(new_excitation);
         m_log_widget->write(bcsim::ILog::INFO, "Configured excitation");
     } catch (const std::runtime_error& e) {
         m_log_widget->write(bcsim::ILog::WARNING, "Caught exception: " + std::string(e.what()));
@@ -654,105 +723,118 @@ void MainWindow::setExcitation(const QString h5_file) {
 }
 
 void MainWindow::doSimulation() {
+    if (!m_sim) {
+        return;
+    }
     // recreate scanseq to ensure correct time and probe info in case of dynamic probe.
+    // The simulation worker configures it when the frame is simulated.
     int new_num_scanlines;
     auto new_scan_geometry = m_scanseq_widget->get_geometry(new_num_scanlines);
-    newScansequence(new_scan_geometry, new_num_scanlines, m_scanseq_widget->all_timestamps_equal());
-    
-    typedef std::vector<std::vector<std::complex<float>>> IQ_Frame;
-    
-    if (m_enable_color_act->isChecked()) {
-        // Color Doppler scan
-        const auto color_packet_size = m_settings->value("color_packet_size", 16).toInt();
-        const auto color_prf         = m_settings->value("color_prf", 2500.0).toFloat();
-        const auto color_prt         = 1.0f/color_prf;
-        std::vector<IQ_Frame> iq_frames_complex;
-
-        try {
-            int total_millisec = 0;
-            for (int packet_no = 0; packet_no < color_packet_size; packet_no++) {
-                // make a copy of current scan sequence to change timestamp
-                auto temp_scanseq = bcsim::ScanSequence::s_ptr(new bcsim::ScanSequence(m_cur_scanseq->line_length));
-                const auto num_lines = m_cur_scanseq->get_num_lines();
-                float packet_timestamp;
-                for (int line_no = 0; line_no < num_lines; line_no++) {
-                    auto scanline = m_cur_scanseq->get_scanline(line_no);
-                    const auto temp_direction = scanline.get_direction();
-                    const auto temp_lateral_dir = scanline.get_lateral_dir();
-                    const auto temp_origin = scanline.get_origin();
-                    packet_timestamp = scanline.get_timestamp()+packet_no*color_prt;
-                    temp_scanseq->add_scanline(bcsim::Scanline(temp_origin, temp_direction, temp_lateral_dir, packet_timestamp));
-                }
-                m_sim->set_scan_sequence(temp_scanseq);
+    newScansequence(new_scan_geometry, new_num_scanlines, m_scanseq_widget->all_timestamps_equal(), false);
 
-                IQ_Frame iq_frame;
-                {
-                ScopedCpuTimer timer([&](int millisec) { total_millisec += millisec; });
-                m_sim->simulate_lines(iq_frame);
-                }
-                iq_frames_complex.push_back(iq_frame);
-                m_log_widget->write(bcsim::ILog::DEBUG, "Simulated frame in packet: timestamp is " + std::to_string(packet_timestamp));
-            }
+    try {
+        auto request = std::make_shared<simulation_worker::FrameRequest>();
+        request->simulator          = m_sim;
+        request->scan_sequence      = m_cur_scanseq;
+        request->scan_geometry      = m_scan_geometry;
+        request->sim_time           = m_sim_time_manager->get_time();
+        request->dots_per_meter     = m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat();
+        request->grayscale_settings = m_grayscale_widget->get_values();
+
+        // the IQ lines are only available on the host with the refresh worker.
+        request->enable_bmode       = m_enable_bmode_act->isChecked();
+        request->simulator_bmode    = m_simulator_bmode_act->isChecked() && !m_save_iq_act->isChecked();
+        if (request->enable_bmode && request->simulator_bmode) {
+            request->bmode_config = make_bmode_image_config(m_scan_geometry, request->dots_per_meter, request->grayscale_settings);
+        }
+        // exported images are needed on the host
+        const auto device_bmode = request->simulator_bmode && m_sim_on_gpu && !m_ultrasound_image_exporter;
+        request->device_image       = device_bmode ? m_device_bmode_item : nullptr;
+
+        request->enable_color       = m_enable_color_act->isChecked();
+        request->color_packet_size  = m_settings->value("color_packet_size", 16).toInt();
+        request->color_prt          = 1.0f/m_settings->value("color_prf", 2500.0).toFloat();
+        request->clutter_filter     = bcsim::parse_clutter_filter(m_settings->value("color_clutter_filter", "mean").toString().toStdString());
+        request->polynomial_order   = m_settings->value("color_polynomial_order", 1).toInt();
+
+        // recorded IQ frames must be complete
+        const auto progressive = request->enable_bmode && !request->simulator_bmode && !m_save_iq_act->isChecked();
+        request->num_scatterer_subsets = progressive ? m_num_scatterer_subsets : 1;
+        request->preview_subsets    = m_preview_subsets;
+
+        m_simulation_worker->request_frame(request);
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Caught exception while requesting frame: " + std::string(e.what()));
+    }
+}
 
+void MainWindow::showBModeResult(refresh_worker::WorkResult::ptr work_result) {
+    const auto display_start_time = std::chrono::steady_clock::now();
 
-            auto color_task = std::make_shared<refresh_worker::WorkTask_ColorDoppler>();
-            color_task->set_geometry(m_scan_geometry);
-            color_task->set_data(iq_frames_complex);
-            color_task->set_dots_per_meter( m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat() );
-    
-            m_refresh_worker->process_data(color_task);
-            statusBar()->showMessage("Color Doppler simulation time per packet: " + QString::number(total_millisec/static_cast<float>(color_packet_size)) + " ms.");
+    // get Cartesian extents from current scan geometry.
+    int num_lines;
+    const auto geometry = m_scanseq_widget->get_geometry(num_lines);
+    float x_min, x_max, y_min, y_max;
+    geometry->get_xy_extent(x_min, x_max, y_min, y_max);
 
+    if (work_result->on_device) {
+        m_display_widget->update_device_bmode(x_min, x_max, y_min, y_max);
+    } else {
+        auto result_image = work_result->image.get_image();
+        result_image.setColorTable(GrayColortable());
+        m_display_widget->update_bmode(QPixmap::fromImage(result_image), x_min, x_max, y_min, y_max);
 
-        } catch (std::runtime_error& e) {
-            m_log_widget->write(bcsim::ILog::WARNING, "Caught exception simulating color Doppler: " + std::string(e.what()));
+        if (m_ultrasound_image_exporter) {
+            const auto written_image = m_ultrasound_image_exporter->add(result_image);
+            if (written_image.isEmpty()) {
+                m_log_widget->write(bcsim::ILog::WARNING, "Image export queue is full. Dropped ultrasound image");
+            } else {
+                m_log_widget->write(bcsim::ILog::INFO, "Simulation time is " + std::to_string(m_sim_time_manager->get_time()) + ". Wrote image " + written_image.toStdString());
+            }
         }
     }
-    if (m_enable_bmode_act->isChecked()) {
-        // B-Mode scan
-        try {
-            IQ_Frame rf_lines_complex;
-            int total_millisec;
-            {
-            ScopedCpuTimer timer([&](int millisec) { total_millisec = millisec; });
-            m_sim->simulate_lines(rf_lines_complex);
-            }
+    // store updated normalization constant if enabled.
+    auto temp = m_grayscale_widget->get_values();
+    if (temp.auto_normalize) {
+        m_grayscale_widget->set_normalization_constant(work_result->updated_normalization_const);
+    }
 
-            m_display_widget->update_status(QString("Radial samples: %1").arg(rf_lines_complex[0].size()));
+    // store grabbed OpenGL image if enabled
+    if (m_opengl_image_exporter) {
+        const auto written_image = m_opengl_image_exporter->add(m_gl_vis_widget->getGlImage());
+        if (written_image.isEmpty()) {
+            m_log_widget->write(bcsim::ILog::WARNING, "Image export queue is full. Dropped OpenGL image");
+        } else {
+            m_log_widget->write(bcsim::ILog::INFO, "Wrote grabbed OpenGL image to " + written_image.toStdString());
+        }
+    }
 
-            if (m_save_iq_act->isChecked()) {
-                m_iq_buffer.push_back(rf_lines_complex);
-                const auto timestamp = m_sim_time_manager->get_time();
-                m_iq_buffer_timestamps.push_back(timestamp);
-            }
+    // per-stage latency from the request of the frame until it was displayed
+    const auto& timing = work_result->timing;
+    const auto display_millisec = refresh_worker::millisec_since(display_start_time);
+    const auto total_millisec = refresh_worker::millisec_since(timing.request_time);
+    const auto num_dropped = m_simulation_worker->num_dropped_frames() + m_refresh_worker->num_dropped_frames();
+    statusBar()->showMessage(QString("Latency: %1 ms  (queue %2, simulation %3, processing %4, display %5 ms)   Dropped frames: %6")
+                                .arg(total_millisec, 0, 'f', 1)
+                                .arg(timing.queue_millisec, 0, 'f', 1)
+                                .arg(timing.simulation_millisec, 0, 'f', 1)
+                                .arg(timing.processing_millisec, 0, 'f', 1)
+                                .arg(display_millisec, 0, 'f', 1)
+                                .arg(num_dropped));
+}
 
-            // Create refresh work task from current geometry and the beam space data
-            auto bmode_task = std::make_shared<refresh_worker::WorkTask_BMode>();
-            bmode_task->set_geometry(m_scan_geometry);
-            bmode_task->set_data(rf_lines_complex);
-            auto grayscale_settings = m_grayscale_widget->get_values();
-            bmode_task->set_normalize_const(grayscale_settings.normalization_const);
-            bmode_task->set_auto_normalize(grayscale_settings.auto_normalize);
-            bmode_task->set_dots_per_meter( m_settings->value("qimage_dots_per_meter", 6000.0f).toFloat() );
-            bmode_task->set_dyn_range(grayscale_settings.dyn_range);
-            bmode_task->set_gain(grayscale_settings.gain); 
-    
-            m_refresh_worker->process_data(bmode_task);
+void MainWindow::showColorResult(refresh_worker::WorkResult::ptr work_result) {
+    auto result_image = work_result->image.get_image();
 
-            const auto total_scatterers = m_sim->get_total_num_scatterers();
-            const auto ns_value = static_cast<float>(1e6*total_millisec/(new_num_scanlines*total_scatterers));
-            const auto msg = QString("Simulation time: %1 ms   ~   %2 nanosec. per scatterer per line")
-                                .arg(total_millisec, 3)
-                                .arg(ns_value, 3);
-            statusBar()->showMessage(msg);
+    // get Cartesian extents from current scan geometry.
+    int num_lines;
+    const auto geometry = m_scanseq_widget->get_geometry(num_lines);
+    float x_min, x_max, y_min, y_max;
+    geometry->get_xy_extent(x_min, x_max, y_min, y_max);
 
-        } catch (std::runtime_error& e) {
-            m_log_widget->write(bcsim::ILog::WARNING, "Caught exception while simulating B-mode: " + std::string(e.what()));
+    m_display_widget->update_colorflow(QPixmap::fromImage(result_image), x_min, x_max, y_min, y_max);
 
-        } catch (...) {
-            m_log_widget->write(bcsim::ILog::WARNING, "Caught unknown error");
-        }
-    }
+    // TODO: Handle saving PNG images
 }
 
 // Currently ignoring weights when visualizing
@@ -805,10 +887,10 @@ void MainWindow::initializeSplineVisualization(bcsim::SplineScatterers::s_ptr sp
         SplineCurve<float, bcsim::vector3> curve;
         curve.knots = spline_scatterers->knot_vector;
         curve.degree = spline_scatterers->spline_degree;
-        const auto num_cs = spline_scatterers->control_points[0].size();
+        const auto num_cs = spline_scatterers->get_num_control_points();
         curve.cs.resize(num_cs);
         for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
-            curve.cs[cs_no] = spline_scatterers->control_points[ind][cs_no];
+            curve.cs[cs_no] = spline_scatterers->get_control_point(ind, cs_no);
         }
         splines[scatterer_no] = curve;
     }
@@ -820,15 +902,16 @@ void MainWindow::initializeSplineVisualization(bcsim::SplineScatterers::s_ptr sp
 }
 
 void MainWindow::onNewExcitation(bcsim::ExcitationSignal new_excitation) {
-    m_sim->set_excitation(new_excitation);
+    sim()->set_excitation(new_excitation);
     m_log_widget->write(bcsim::ILog::INFO, "Configured excitation signal");
 }
 
 void MainWindow::onNewBeamProfile(bcsim::IBeamProfile::s_ptr new_beamprofile) {
     if (std::dynamic_pointer_cast<bcsim::GaussianBeamProfile>(new_beamprofile)) {
-        m_sim->set_analytical_profile(new_beamprofile);
-    } else if (std::dynamic_pointer_cast<bcsim::LUTBeamProfile>(new_beamprofile)) {
-        m_sim->set_lookup_profile(new_beamprofile);
+        sim()->set_analytical_profile(new_beamprofile);
+    } else if (std::dynamic_pointer_cast<bcsim::LUTBeamProfile>(new_beamprofile)
+               || std::dynamic_pointer_cast<bcsim::MultiResolutionLUTBeamProfile>(new_beamprofile)) {
+        sim()->set_lookup_profile(new_beamprofile);
     } else {
         throw std::runtime_error("onNewBeamProfile(): all casts failed");
     }
@@ -864,19 +947,54 @@ void MainWindow::onSetSimTme() {
 }
 
 void MainWindow::onTimer() {
+    // hold back the simulation instead of dropping exported frames.
+    if (imageExportBacklogged()) {
+        return;
+    }
     m_sim_time_manager->advance();
+    // preview as many scatterer subsets as the frame time of the target
+    // frame rate allows, measured on the last progressive frame
+    if (m_num_scatterer_subsets > 1) {
+        const auto target_millisec = 1000.0/std::max(1.0, m_settings->value("progressive_target_fps", 20.0).toDouble());
+        const auto subset_millisec = m_simulation_worker->subset_millisec();
+        if (subset_millisec > 0.0) {
+            const auto num_subsets = static_cast<int>(target_millisec/subset_millisec);
+            m_preview_subsets = std::max(1, std::min(m_num_scatterer_subsets, num_subsets));
+        }
+    }
     ScopedCpuTimer timer([&](int millisec) {
         m_log_widget->write(bcsim::ILog::DEBUG, "onTimer() used " + std::to_string(millisec) + " milliseconds");
     });
     onSimulate();
 }
 
+ImageSaver::ptr MainWindow::createImageExporter(const QString& out_path) {
+    auto exporter = std::make_unique<ImageSaver>(out_path,
+                                                 m_settings->value("image_export_num_threads", 0).toInt(),
+                                                 m_settings->value("image_export_max_pending", 16).toUInt());
+    exporter->set_format_str(m_settings->value("image_export_format_str", "Image%1.png").toString());
+
+    // e.g. "ffmpeg -y -f rawvideo -pix_fmt rgb24 -s {width}x{height} -r 25 -i - cine.mp4"
+    auto video_command = m_settings->value("video_encoder_command", "").toString().split(' ', QString::SkipEmptyParts);
+    if (!video_command.isEmpty()) {
+        const auto program = video_command.takeFirst();
+        exporter->set_video_encoder(program, video_command);
+        m_log_widget->write(bcsim::ILog::INFO, "Piping exported frames to " + program.toStdString());
+    }
+    return exporter;
+}
+
+bool MainWindow::imageExportBacklogged() const {
+    return (m_ultrasound_image_exporter && m_ultrasound_image_exporter->is_backlogged())
+        || (m_opengl_image_exporter && m_opengl_image_exporter->is_backlogged());
+}
+
 void MainWindow::onAboutScatterers() {
     if (!m_sim) {
         m_log_widget->write(bcsim::ILog::WARNING, "No simulator is active");
         return;
     }
-    const auto n = m_sim->get_total_num_scatterers();
+    const auto n = sim()->get_total_num_scatterers();
     QMessageBox::information(this, "Current scatterers", QString("Phantom consists of %1 scatterers").arg(n));
 }
 
@@ -910,7 +1028,7 @@ void MainWindow::onLoadBeamProfileLUT() {
         m_log_widget->write(bcsim::ILog::WARNING, "No lookup-table file selected. Ignoring.");
         return;
     }
-    m_sim->set_lookup_profile(bcsim::loadBeamProfileFromHdf(h5_file.toUtf8().constData()));
+    sim()->set_lookup_profile(bcsim::loadBeamProfileFromHdf(h5_file.toUtf8().constData()));
 }
 
 void MainWindow::onLoadSimulatedData() {
@@ -1018,7 +1136,7 @@ void MainWindow::onSetSimulatorParameter() {
         return;
     }
     try {
-        m_sim->set_parameter(key.toUtf8().constData(), value.toUtf8().constData());
+        sim()->set_parameter(key.toUtf8().constData(), value.toUtf8().constData());
     } catch (std::runtime_error& e) {
         m_log_widget->write(bcsim::ILog::WARNING, "Caught exception: " + std::string(e.what()));
     } catch (...) {
@@ -1026,79 +1144,101 @@ void MainWindow::onSetSimulatorParameter() {
     }
 }
 
-void MainWindow::onSaveIqBufferAs() {
-    const auto num_frames = m_iq_buffer.size();
-    const auto num_timestamps = m_iq_buffer_timestamps.size();
-    m_log_widget->write(bcsim::ILog::INFO, "IQ Buffer contains data for " + std::to_string(num_frames) + " frames");
-    m_log_widget->write(bcsim::ILog::INFO, "Number of frame timestamps is " + std::to_string(num_timestamps));
-    if (num_timestamps != num_frames) {
-        m_log_widget->write(bcsim::ILog::WARNING, "Mismatch in number of samples. Aborting");
-        onResetIqBuffer();
+void MainWindow::onRecordIqToggled(bool checked) {
+    if (!checked) {
+        finishIqRecording();
         return;
     }
+    auto h5_file = QFileDialog::getSaveFileName(this, "Record IQ data to HDF5", ".", "HDF5 files (*.h5)");
+    if (h5_file == "") {
+        m_log_widget->write(bcsim::ILog::WARNING, "No file selected. Not recording IQ data");
+        m_save_iq_act->setChecked(false);
+        return;
+    }
+    // the recorder is created when the frame dimensions are known
+    m_iq_file = h5_file;
+    m_iq_record_frame_no = m_iq_buffer->get_end_frame_no();
+}
 
-    m_log_widget->write(bcsim::ILog::INFO, "Buffer contains IQ data for " + std::to_string(num_frames) + " frames.");
+void MainWindow::recordBufferedIqFrames() {
+    const auto first_frame_no = m_iq_buffer->get_first_frame_no();
+    if (m_iq_record_frame_no < first_frame_no) {
+        m_log_widget->write(bcsim::ILog::WARNING, "IQ recording can not keep up: lost "
+                                                  + std::to_string(first_frame_no - m_iq_record_frame_no) + " frames");
+        m_iq_record_frame_no = first_frame_no;
+    }
+    try {
+        const auto end_frame_no = m_iq_buffer->get_end_frame_no();
+        for (; m_iq_record_frame_no < end_frame_no; m_iq_record_frame_no++) {
+            if (!m_iq_buffer->read(m_iq_record_frame_no, m_iq_frame)) {
+                // overwritten since the check above
+                continue;
+            }
+            const auto num_lines   = m_iq_frame.num_lines;
+            const auto num_samples = m_iq_frame.num_samples;
+            if (!m_iq_recorder) {
+                m_iq_recorder = std::make_unique<bcsim::HdfIqRecorder>(m_iq_file.toUtf8().constData(), num_lines, num_samples);
+                m_log_widget->write(bcsim::ILog::INFO, "Recording frames of " + std::to_string(num_lines) + " lines of "
+                                                       + std::to_string(num_samples) + " samples to " + m_iq_file.toStdString());
+            }
+            if ((num_lines != m_iq_recorder->get_num_lines()) || (num_samples != m_iq_recorder->get_num_samples())) {
+                throw std::runtime_error("frame size changed");
+            }
+            m_iq_recorder->append(m_iq_frame.samples.data(), num_samples, m_iq_frame.timestamp);
+        }
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Stopped recording IQ data: " + std::string(e.what()));
+        m_save_iq_act->setChecked(false);
+    }
+}
 
-    if (num_frames == 0) {
-        m_log_widget->write(bcsim::ILog::WARNING, "No frames in buffer. Skipping");
+void MainWindow::onSaveIqBuffer() {
+    if (m_iq_buffer->get_num_frames() == 0) {
+        m_log_widget->write(bcsim::ILog::WARNING, "The IQ buffer is empty");
         return;
     }
-
-    auto h5_file = QFileDialog::getSaveFileName(this, "Save IQ buffer as HDF5", ".", "HDF5 files (*.h5)");
+    auto h5_file = QFileDialog::getSaveFileName(this, "Save IQ buffer to HDF5", ".", "HDF5 files (*.h5)");
     if (h5_file == "") {
-        m_log_widget->write(bcsim::ILog::WARNING, "Ignoring IQ buffer save");
+        m_log_widget->write(bcsim::ILog::WARNING, "No file selected. Not saving IQ data");
         return;
     }
-
-    // all frames must have same dimensions
-    const auto& frame = m_iq_buffer[0];
-    const auto num_lines   = frame.size();
-    const auto num_samples = frame[0].size();
-    m_log_widget->write(bcsim::ILog::INFO, "Each frame has " + std::to_string(num_lines) + " lines of " + std::to_string(num_samples) + " samples.");
-    
-    boost::array<size_t, 3> dims;
-    dims[0] = num_frames;
-    dims[1] = num_lines;
-    dims[2] = num_samples;
-
-    boost::multi_array<float, 3> iq_real;
-    boost::multi_array<float, 3> iq_imag;
-    iq_real.resize(dims);
-    iq_imag.resize(dims);
-
-    m_log_widget->write(bcsim::ILog::INFO, "Converting data");
-    for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
-        for (size_t line_no = 0; line_no < num_lines; line_no++) {
-            for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
-                iq_real[frame_no][line_no][sample_no] = m_iq_buffer[frame_no][line_no][sample_no].real();
-                iq_imag[frame_no][line_no][sample_no] = m_iq_buffer[frame_no][line_no][sample_no].imag();
+    try {
+        // frames pushed while saving are left out
+        const auto end_frame_no = m_iq_buffer->get_end_frame_no();
+        std::unique_ptr<bcsim::HdfIqRecorder> recorder;
+        for (auto frame_no = m_iq_buffer->get_first_frame_no(); frame_no < end_frame_no; frame_no++) {
+            if (!m_iq_buffer->read(frame_no, m_iq_frame)) {
+                continue;
+            }
+            if (!recorder) {
+                recorder = std::make_unique<bcsim::HdfIqRecorder>(h5_file.toUtf8().constData(), m_iq_frame.num_lines, m_iq_frame.num_samples);
+            }
+            if ((m_iq_frame.num_lines != recorder->get_num_lines()) || (m_iq_frame.num_samples != recorder->get_num_samples())) {
+                break;
             }
+            recorder->append(m_iq_frame.samples.data(), m_iq_frame.num_samples, m_iq_frame.timestamp);
         }
+        if (!recorder) {
+            throw std::runtime_error("the buffered frames were overwritten");
+        }
+        recorder->close();
+        m_log_widget->write(bcsim::ILog::INFO, "Wrote IQ data for " + std::to_string(recorder->get_num_frames()) + " buffered frames");
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Failed to save IQ buffer: " + std::string(e.what()));
     }
-
-    auto file = H5::H5File(h5_file.toUtf8().constData(), H5F_ACC_TRUNC);
-    hsize_t dspace_dims[] = {num_frames, num_lines, num_samples};
-    H5::DataSpace dspace(3, dspace_dims);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing real part");
-    auto dset_real = file.createDataSet("iq_real", H5::PredType::NATIVE_FLOAT, dspace);
-    dset_real.write(iq_real.data(), H5::PredType::NATIVE_FLOAT);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing imaginary part");
-    auto dset_imag = file.createDataSet("iq_imag", H5::PredType::NATIVE_FLOAT, dspace);
-    dset_imag.write(iq_imag.data(), H5::PredType::NATIVE_FLOAT);
-    
-    m_log_widget->write(bcsim::ILog::INFO, "Writing timestamps");
-    hsize_t dspace_dims_timestamps[] = {num_frames};
-    H5::DataSpace dspace_timestamps(1, dspace_dims_timestamps);
-    auto dset_timestamps = file.createDataSet("frame_times", H5::PredType::NATIVE_FLOAT, dspace_timestamps);
-    dset_timestamps.write(m_iq_buffer_timestamps.data(), H5::PredType::NATIVE_FLOAT);
-
-    onResetIqBuffer();
 }
 
-void MainWindow::onResetIqBuffer() {
-    m_iq_buffer.clear();
-    m_iq_buffer_timestamps.clear();
+void MainWindow::finishIqRecording() {
+    m_iq_file = "";
+    if (!m_iq_recorder) {
+        return;
+    }
+    try {
+        m_iq_recorder->close();
+        m_log_widget->write(bcsim::ILog::INFO, "Wrote IQ data for " + std::to_string(m_iq_recorder->get_num_frames()) + " frames");
+    } catch (std::runtime_error& e) {
+        m_log_widget->write(bcsim::ILog::WARNING, "Failed to record IQ data: " + std::string(e.what()));
+    }
+    m_iq_recorder.reset();
 }
 
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 #include <iostream>
 #include <memory>
+#include <vector>
 #include <QApplication>
 #include <QMainWindow>
 #include <QSlider>
@@ -38,8 +39,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "../core/LibBCSim.hpp"
 #include "SimTimeManager.hpp"
 #include "../utils/ScanGeometry.hpp"
+#include "../utils/HdfIqRecorder.hpp"
+#include "../utils/IqRingBuffer.hpp"
 #include "ImageExport.hpp"
 #include "LogWidget.hpp"
+#include "../core/AsyncLog.hpp"
 #include "../utils/HardwareAutodetection.hpp"
 
 // Forward decl.
@@ -55,8 +59,14 @@ class ProbeWidget;
 class SimTimeWidget;
 class GrayscaleTransformWidget;
 class QTimer;
+class CudaGlImageItem;
 namespace refresh_worker {
     class RefreshWorker;
+    class WorkResult;
+}
+namespace simulation_worker {
+    class SimulationWorker;
+    class LockedSimulator;
 }
 
 class MainWindow : public QMainWindow {
@@ -80,7 +90,8 @@ public:
     // Define the excitation signal using data from hdf5 file
     void setExcitation(const QString h5_file);
 
-    // Do simulation using current config.
+    // Request simulation of a frame with the current config. The frame is
+    // simulated on the simulation thread.
     void doSimulation();
 
 protected:
@@ -90,7 +101,8 @@ protected:
     }
 
 private slots:
-    void newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_num_lines, bool equal_timestamps);
+    void newScansequence(bcsim::ScanGeometry::ptr new_geometry, int new_num_lines, bool equal_timestamps,
+                         bool configure_simulator = true);
     
     // Configure current simulator with new scatterers.
     // Ask user for a h5 file with scatterers.
@@ -138,9 +150,11 @@ private slots:
 
     void onLoadSimulatedData();
 
-    void onSaveIqBufferAs();
+    // Starts or stops streaming of B-mode IQ frames to a HDF5 file.
+    void onRecordIqToggled(bool checked);
 
-    void onResetIqBuffer();
+    // Write the frames in the IQ buffer to a HDF5 file.
+    void onSaveIqBuffer();
 
 private:
     void initializeSplineVisualization(bcsim::SplineScatterers::s_ptr spline_scatterers);
@@ -151,6 +165,27 @@ private:
 
     void updateWithNewSplineScatterers(bcsim::SplineScatterers::s_ptr spline_scatterers);
 
+    // Pass the frames which have entered the IQ buffer since the last call
+    // on to the recorder.
+    void recordBufferedIqFrames();
+
+    void finishIqRecording();
+
+    // Create an exporter of numbered images or video in out_path as
+    // configured in the settings.
+    ImageSaver::ptr createImageExporter(const QString& out_path);
+
+    // True if an image exporter cannot keep up with the simulated frames.
+    bool imageExportBacklogged() const;
+
+    // Display a B-mode image from the refresh worker or the simulator.
+    void showBModeResult(std::shared_ptr<refresh_worker::WorkResult> work_result);
+
+    void showColorResult(std::shared_ptr<refresh_worker::WorkResult> work_result);
+
+    // The simulator, locked against the simulation thread.
+    simulation_worker::LockedSimulator sim();
+
 private:
     // The simulator object.
     bcsim::IAlgorithm::s_ptr        m_sim;
@@ -183,13 +218,29 @@ private:
     GrayscaleTransformWidget*       m_grayscale_widget;
     
     refresh_worker::RefreshWorker*  m_refresh_worker;
+    simulation_worker::SimulationWorker* m_simulation_worker;
 
-    // Related to IQ-buffering
-    std::vector<std::vector<std::vector<std::complex<float>>>> m_iq_buffer;
-    std::vector<float>                                         m_iq_buffer_timestamps;
+    // Related to IQ recording
     QAction*                        m_save_iq_act;
-    QAction*                        m_save_iq_buffer_as_act;
-    QAction*                        m_reset_iq_buffer_act;
+    QString                         m_iq_file;
+    std::unique_ptr<bcsim::HdfIqRecorder> m_iq_recorder;
+    // The most recent IQ frames, filled by the simulation thread.
+    std::shared_ptr<bcsim::IqRingBuffer> m_iq_buffer;
+    // The next frame of the IQ buffer to record.
+    size_t                          m_iq_record_frame_no;
+    bcsim::IqRingBuffer::Frame      m_iq_frame;
+
+    // Let the simulator make the B-mode images instead of the refresh worker.
+    QAction*                        m_simulator_bmode_act;
+    // Where the GPU simulator writes B-mode images for display, if enabled.
+    CudaGlImageItem*                m_device_bmode_item;
+    bool                            m_sim_on_gpu;
+
+    // Progressive B-mode with the CPU simulator: the number of scatterer
+    // subsets, one if disabled, and the number of them in the first image
+    // of a frame, which onTimer() adapts to the target frame rate.
+    int                             m_num_scatterer_subsets;
+    int                             m_preview_subsets;
 
     // Related to scan types
     QAction*                        m_enable_bmode_act;
@@ -201,6 +252,8 @@ private:
     bcsim::ScanSequence::s_ptr      m_cur_scanseq;
 
     LogWidget*                      m_log_widget;
+    // forwards the messages of the simulator to the log widget
+    std::shared_ptr<bcsim::AsyncLog> m_sim_log;
     utils::HardwareAutodetector     m_hardware_autodetector;
 };
 
@@ -29,20 +29,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 #include <stdexcept>
+#include <vector>
+#include <complex>
+#include <algorithm>
 #include <memory>
+#include <chrono>
 #include <QObject>
 #include <QThread>
 #include <QTimer>
-#include <QMutex>
-#include <QQueue>
-#include <QMutexLocker>
 #include <QImage>
+#include "../core/Tracing.hpp"
 #include "../utils/cartesianator/Cartesianator.hpp"
 #include "../utils/ScanGeometry.hpp"
 #include "../utils/BCSimConvenience.hpp"
+#include "../utils/ColorFlowEstimator.hpp"
+#include "FrameQueue.hpp"
 
 namespace refresh_worker {
 
+// Time spent by a frame in the stages of the pipeline from the request to
+// the image, for reporting the latency.
+struct FrameTiming {
+    FrameTiming()
+        : request_time(std::chrono::steady_clock::now()),
+          queue_millisec(0.0f),
+          simulation_millisec(0.0f),
+          processing_millisec(0.0f) { }
+
+    std::chrono::steady_clock::time_point   request_time;
+    float                                   queue_millisec;         // waiting for the simulator
+    float                                   simulation_millisec;
+    float                                   processing_millisec;    // beam space data to image
+};
+
+inline float millisec_since(std::chrono::steady_clock::time_point start_time) {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
 // A safe variant of QImage owning its pixel data.
 class SafeQImage {
 public:
@@ -87,9 +110,14 @@ public:
         m_dpm = dpm;
     }
 
+    void set_timing(const FrameTiming& timing) {
+        m_timing = timing;
+    }
+
 private:
     bcsim::ScanGeometry::ptr            m_scan_geometry;
     float                               m_dpm;
+    FrameTiming                         m_timing;
 };
 
 class WorkTask_BMode : public WorkTask {
@@ -97,8 +125,29 @@ public:
     friend class Worker;
     typedef std::shared_ptr<WorkTask_BMode> ptr;
 
-    void set_data(const std::vector<std::vector<std::complex<float>>>& data) {
-        m_data = data;
+    WorkTask_BMode()
+        : m_num_lines(0), m_num_samples(0) { }
+
+    // IQ lines stored contiguously, line by line
+    void set_data(std::vector<std::complex<float>> iq_lines, size_t num_lines, size_t num_samples) {
+        if (iq_lines.size() != num_lines*num_samples) {
+            throw std::runtime_error("size of IQ data is inconsistent");
+        }
+        m_data = std::move(iq_lines);
+        m_num_lines = num_lines;
+        m_num_samples = num_samples;
+    }
+
+    void set_data(const std::vector<std::vector<std::complex<float>>>& iq_lines) {
+        if (iq_lines.empty()) throw std::runtime_error("No lines returned");
+        m_num_lines = iq_lines.size();
+        m_num_samples = iq_lines[0].size();
+        m_data.clear();
+        m_data.reserve(m_num_lines*m_num_samples);
+        for (const auto& line : iq_lines) {
+            if (line.size() != m_num_samples) throw std::runtime_error("IQ lines must have the same length");
+            m_data.insert(m_data.end(), line.begin(), line.end());
+        }
     }
 
     void set_auto_normalize(bool status) {
@@ -115,7 +164,9 @@ public:
     }
 
 private:
-    std::vector<std::vector<std::complex<float>>>  m_data;
+    std::vector<std::complex<float>>    m_data;
+    size_t                              m_num_lines;
+    size_t                              m_num_samples;
     bool                                m_auto_normalize;
     float                               m_normalize_const;
     float                               m_gain;
@@ -127,28 +178,58 @@ public:
     friend class Worker;
     typedef std::shared_ptr<WorkTask_ColorDoppler> ptr;
 
-    void set_data(const std::vector<std::vector<std::vector<std::complex<float>>>>& data) {
-        m_data = data;
+    WorkTask_ColorDoppler()
+        : m_num_lines(0), m_num_samples(0), m_packet_size(0),
+          m_clutter_filter(bcsim::ClutterFilter::MEAN), m_polynomial_order(1) { }
+
+    // IQ packets stored as [line][sample][packet]
+    void set_data(std::vector<std::complex<float>> packets, size_t num_lines, size_t num_samples, size_t packet_size) {
+        if (packets.size() != num_lines*num_samples*packet_size) {
+            throw std::runtime_error("size of packet data is inconsistent");
+        }
+        m_data = std::move(packets);
+        m_num_lines = num_lines;
+        m_num_samples = num_samples;
+        m_packet_size = packet_size;
+    }
+
+    void set_clutter_filter(bcsim::ClutterFilter filter, int polynomial_order) {
+        m_clutter_filter = filter;
+        m_polynomial_order = polynomial_order;
     }
 
 private:
-    std::vector<std::vector<std::vector<std::complex<float>>>>  m_data;
+    std::vector<std::complex<float>>    m_data;
+    size_t                              m_num_lines;
+    size_t                              m_num_samples;
+    size_t                              m_packet_size;
+    bcsim::ClutterFilter                m_clutter_filter;
+    int                                 m_polynomial_order;
 };
 
 class WorkResult {
 public:
     friend class Worker;
     typedef std::shared_ptr<WorkResult> ptr;
-    WorkResult() {
+    WorkResult()
+        : on_device(false) {
     }
     SafeQImage  image;
+    // the image was written to the device B-mode item instead of image
+    bool    on_device;
     float   updated_normalization_const;
+    FrameTiming timing;
 };
 
 class Worker : public QObject {
 Q_OBJECT
 public:
-    Worker() : QObject() {
+    // At most max_queued_tasks tasks are queued, older tasks are dropped.
+    Worker(size_t max_queued_tasks = 4)
+        : QObject(),
+          m_queue(max_queued_tasks),
+          m_clutter_filter(bcsim::ClutterFilter::MEAN),
+          m_polynomial_order(1) {
         // Create geometry converters
         m_cartesianator       = ICartesianator<unsigned char>::u_ptr(new CpuCartesianator<unsigned char>);
         m_color_cartesianator = ICartesianator<float>::u_ptr(new CpuCartesianator<float>); 
@@ -156,16 +237,17 @@ public:
 
     // enqueue new work item
     Q_SLOT void on_new_data(refresh_worker::WorkTask::ptr msg) {
-        QMutexLocker mutex_locker(&m_mutex);
-        m_queue.enqueue(msg);
+        m_queue.push(msg);
+    }
+
+    size_t num_dropped_tasks() const {
+        return m_queue.num_dropped();
     }
     
 private:
     Q_SLOT void on_timeout() {
-        QMutexLocker mutex_locker(&m_mutex);
-        auto num_elements = m_queue.size();
-        if (!m_queue.isEmpty()) {
-            auto work_task = m_queue.dequeue();
+        WorkTask::ptr work_task;
+        if (m_queue.try_pop(work_task)) {
             if (std::dynamic_pointer_cast<WorkTask_BMode>(work_task)) {
                 process(std::dynamic_pointer_cast<WorkTask_BMode>(work_task));
             } else if (std::dynamic_pointer_cast<WorkTask_ColorDoppler>(work_task)) {
@@ -177,24 +259,27 @@ private:
     }
 
     void process(WorkTask_BMode::ptr work_task) {
+        bcsim::trace::ScopedEvent event("refresh_bmode", "gui");
         // Create output package
         auto work_result = WorkResult::ptr(new WorkResult);
+        const auto start_time = std::chrono::steady_clock::now();
+        work_result->timing = work_task->m_timing;
 
-        const auto& iq_data = work_task->m_data;
-
-        // Transform complex IQ samples to real-valued envelope.
-        if (iq_data.size() == 0) throw std::runtime_error("No lines returned");
-        const auto num_iq_samples = iq_data[0].size();;
-        std::vector<std::vector<float>> env_lines;
-        for (size_t line_no = 0; line_no < iq_data.size(); line_no++) {
-            std::vector<float> temp;
-            temp.reserve(num_iq_samples);
-            for (size_t i = 0; i < iq_data[line_no].size(); i++) {
-                temp.push_back(std::abs(iq_data[line_no][i]));
-            }
-            env_lines.push_back(temp);
+        const size_t num_beams = work_task->m_num_lines;
+        const size_t num_range = work_task->m_num_samples;
+        if (num_beams*num_range == 0) {
+            throw std::runtime_error("No lines were returned");
         }
 
+        // Envelope detection and grayscale log-compression in one pass. The
+        // beamspace data has the sample index most rapidly varying.
+        m_beamspace_data.resize(num_beams*num_range);
+        work_result->updated_normalization_const =
+            bcsim::envelope_log_compress_frame(work_task->m_data.data(), num_beams, num_range, num_range,
+                                               work_task->m_dyn_range, work_task->m_normalize_const,
+                                               work_task->m_gain, work_task->m_auto_normalize,
+                                               m_beamspace_data.data());
+
         m_cartesianator->SetGeometry(work_task->m_scan_geometry);
 
 
@@ -208,38 +293,8 @@ private:
         // As long as the size doesn't change, this call is not expensive.
         m_cartesianator->SetOutputSize(width_pixels, height_pixels);
 
-        const size_t num_beams = env_lines.size();
-        const size_t num_range = env_lines[0].size();
-        if (num_beams <= 0) {
-            throw std::runtime_error("No lines were returned");
-        }
-    
-
-        if (work_task->m_auto_normalize) {
-            work_result->updated_normalization_const = bcsim::get_max_value(env_lines);
-        } else {
-            work_result->updated_normalization_const = work_task->m_normalize_const;
-        }
-
-        // grayscale log-compression
-        bcsim::log_compress_frame(env_lines, work_task->m_dyn_range,
-                                    work_result->updated_normalization_const,
-                                    work_task->m_gain);
-            
-        // Copy beamspace data in order to get correct memory layout,
-        // i.e. sample index most rapidly varying. Convert to unsigned char.
-        std::vector<unsigned char> beamspace_data(num_beams*num_range);
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(env_lines[beam_no]),
-                            std::end(env_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return static_cast<unsigned char>(v);
-            });
-        }
-
         // do geometry transform
-        m_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_cartesianator->Process(m_beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
     
         // make QImage from output of Cartesianator
         size_t out_x, out_y;
@@ -257,56 +312,40 @@ private:
                                         static_cast<int>(out_y),
                                         1,
                                         QImage::Format_Indexed8);
+        work_result->timing.processing_millisec = millisec_since(start_time);
         emit finished_processing_bmode(work_result);
     }
 
     void process(WorkTask_ColorDoppler::ptr work_task) {
+        bcsim::trace::ScopedEvent event("refresh_color", "gui");
         // Create output package
         auto work_result = WorkResult::ptr(new WorkResult);
+        const auto start_time = std::chrono::steady_clock::now();
+        work_result->timing = work_task->m_timing;
+
+        // The estimator only depends on the packet size and the clutter filter.
+        if (!m_color_estimator || m_color_estimator->get_packet_size() != work_task->m_packet_size
+                               || m_clutter_filter != work_task->m_clutter_filter
+                               || m_polynomial_order != work_task->m_polynomial_order) {
+            m_color_estimator.reset(new bcsim::ColorFlowEstimator(work_task->m_packet_size,
+                                                                  work_task->m_clutter_filter,
+                                                                  work_task->m_polynomial_order));
+            m_clutter_filter = work_task->m_clutter_filter;
+            m_polynomial_order = work_task->m_polynomial_order;
+        }
 
-        const auto& iq_data = work_task->m_data;
-        
-        // Estimate R0 and R1
-        std::vector<std::vector<float>> r0_lines;
-        std::vector<std::vector<float>> velocity_lines;
-
-        const auto packet_size    = iq_data.size();
-        const auto num_iq_lines   = iq_data[0].size();
-        const auto num_iq_samples = iq_data[0][0].size();;
-        for (size_t line_no = 0; line_no < num_iq_lines; line_no++) {
-            std::vector<float> temp1;
-            std::vector<float> temp2;
-            temp1.reserve(num_iq_samples);
-            temp2.reserve(num_iq_samples);
-            for (size_t i = 0; i < num_iq_samples; i++) {
-                float r0 = 0.0f;
-                std::complex<float> r1 = 0.0f;
-
-                // simple clutter filter
-                std::complex<float> mean_val(0.0f);
-                for (int packet_no = 0; packet_no < packet_size; packet_no++) {
-                    mean_val += iq_data[packet_no][line_no][i];
-                }
-                mean_val = mean_val/static_cast<float>(packet_size);
-
-                // estimate R0
-                for (int packet_no = 0; packet_no < packet_size; packet_no++) {
-                    const auto z = iq_data[packet_no][line_no][i] - mean_val;
-                    r0 += (z*std::conj(z)).real();
-                }
-
-                // estimate R1
-                for (int packet_no = 0; packet_no < packet_size-1; packet_no++) {
-                    r1 += std::conj(iq_data[packet_no][line_no][i])*iq_data[packet_no+1][line_no][i];
-                }
-                temp1.push_back(r0);
-                temp2.push_back(std::arg(r1));
-            }
-            r0_lines.push_back(temp1);
-            velocity_lines.push_back(temp2);
+        // Estimate R0 and R1 in beam space layout, i.e. sample index most rapidly varying.
+        const size_t num_beams = work_task->m_num_lines;
+        const size_t num_range = work_task->m_num_samples;
+        if (num_beams <= 0) {
+            throw std::runtime_error("No lines were returned");
         }
+        std::vector<float> r0_data(num_beams*num_range);
+        std::vector<float> velocity_data(num_beams*num_range);
+        m_color_estimator->process(work_task->m_data.data(), num_beams, num_range,
+                                   r0_data.data(), velocity_data.data());
 
-        const auto max_r0_value = bcsim::get_max_value(r0_lines);
+        const auto max_r0_value = *std::max_element(r0_data.begin(), r0_data.end());
 
         m_color_cartesianator->SetGeometry(work_task->m_scan_geometry);
 
@@ -320,26 +359,14 @@ private:
         // As long as the size doesn't change, this call is not expensive.
         m_color_cartesianator->SetOutputSize(width_pixels, height_pixels);
 
-        const size_t num_beams = r0_lines.size();
-        const size_t num_range = r0_lines[0].size();
-        if (num_beams <= 0) {
-            throw std::runtime_error("No lines were returned");
-        }
-    
-        // Copy beamspace data in order to get correct memory layout,
-        // i.e. sample index most rapidly varying. Normalize power to [0, 1]
-        std::vector<float> beamspace_data(num_beams*num_range);
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(r0_lines[beam_no]),
-                            std::end(r0_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return v/max_r0_value;
-            });
+        // Normalize power to [0, 1]
+        const auto inv_max_r0 = 1.0f/max_r0_value;
+        for (auto& v : r0_data) {
+            v *= inv_max_r0;
         }
 
         // do geometry transform
-        m_color_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_color_cartesianator->Process(r0_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
     
         // make QImage from output of Cartesianator
         size_t out_x, out_y;
@@ -355,18 +382,8 @@ private:
             thresholded_samples[i] = (out_ptr[i] >= normalized_threshold);
         }
 
-        // Reorganize memory layout
-        for (size_t beam_no = 0; beam_no < num_beams; beam_no++) {
-            std::transform(std::begin(velocity_lines[beam_no]),
-                            std::end(velocity_lines[beam_no]),
-                            beamspace_data.data()+num_range*beam_no,
-                            [=](float v) {
-                return v;
-            });
-        }
-
         // do geometry transform
-        m_color_cartesianator->Process(beamspace_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
+        m_color_cartesianator->Process(velocity_data.data(), static_cast<int>(num_beams), static_cast<int>(num_range));
 
         std::vector<unsigned char> color_pixels(4*num_output_samples);
         for (size_t i = 0; i < num_output_samples; i++) {
@@ -398,6 +415,7 @@ private:
                                         static_cast<int>(out_y),
                                         4,
                                         QImage::Format_ARGB32);
+        work_result->timing.processing_millisec = millisec_since(start_time);
         emit finished_processing_color(work_result);
     }
 
@@ -407,25 +425,33 @@ private:
     Q_SIGNAL void finished_processing_color(refresh_worker::WorkResult::ptr);
 
 private:
-    QMutex                                  m_mutex;
-    QQueue<WorkTask::ptr>                   m_queue;
+    FrameQueue<WorkTask::ptr>               m_queue;
     ICartesianator<unsigned char>::u_ptr    m_cartesianator;
+    std::vector<unsigned char>              m_beamspace_data;
     ICartesianator<float>::u_ptr            m_color_cartesianator;
+    std::unique_ptr<bcsim::ColorFlowEstimator> m_color_estimator;
+    bcsim::ClutterFilter                    m_clutter_filter;
+    int                                     m_polynomial_order;
 };
 
 class RefreshWorker : public QObject {
 Q_OBJECT
 public:
-    RefreshWorker(int millisec) {
+    // Only the most recent image of each kind waits for the display, older
+    // images are dropped when the display can not keep up.
+    RefreshWorker(int millisec)
+        : m_bmode_results(1),
+          m_color_results(1)
+    {
         connect(&m_timer, SIGNAL(timeout()), &m_worker, SLOT(on_timeout()));
         m_timer.start(millisec);
         m_timer.moveToThread(&m_thread);    // not neccessary according to tutorial.
         m_worker.moveToThread(&m_thread);
         m_thread.start();
         connect(&m_worker, SIGNAL(finished_processing_bmode(refresh_worker::WorkResult::ptr)),
-                this, SIGNAL(processed_bmode_data_available(refresh_worker::WorkResult::ptr)));
+                this, SLOT(add_bmode_result(refresh_worker::WorkResult::ptr)), Qt::DirectConnection);
         connect(&m_worker, SIGNAL(finished_processing_color(refresh_worker::WorkResult::ptr)),
-                this, SIGNAL(processed_color_data_available(refresh_worker::WorkResult::ptr)));
+                this, SLOT(add_color_result(refresh_worker::WorkResult::ptr)), Qt::DirectConnection);
     }
 
     // new beam space data for processing
@@ -433,15 +459,51 @@ public:
         m_worker.on_new_data(message);
     }
 
+    // Pass a finished image on to the display. Can be called from any thread.
+    Q_SLOT void add_bmode_result(refresh_worker::WorkResult::ptr result) {
+        // a pending emit_bmode_result() will take the new image
+        if (!m_bmode_results.push(result)) {
+            QMetaObject::invokeMethod(this, "emit_bmode_result", Qt::QueuedConnection);
+        }
+    }
+
+    Q_SLOT void add_color_result(refresh_worker::WorkResult::ptr result) {
+        if (!m_color_results.push(result)) {
+            QMetaObject::invokeMethod(this, "emit_color_result", Qt::QueuedConnection);
+        }
+    }
+
+    // Work tasks and images dropped so far.
+    size_t num_dropped_frames() const {
+        return m_worker.num_dropped_tasks() + m_bmode_results.num_dropped() + m_color_results.num_dropped();
+    }
+
     // processed beam space data is ready
     Q_SIGNAL void processed_bmode_data_available(refresh_worker::WorkResult::ptr);
 
     Q_SIGNAL void processed_color_data_available(refresh_worker::WorkResult::ptr);
 
+private:
+    Q_SLOT void emit_bmode_result() {
+        WorkResult::ptr result;
+        if (m_bmode_results.try_pop(result)) {
+            emit processed_bmode_data_available(result);
+        }
+    }
+
+    Q_SLOT void emit_color_result() {
+        WorkResult::ptr result;
+        if (m_color_results.try_pop(result)) {
+            emit processed_color_data_available(result);
+        }
+    }
+
 private:
     QThread     m_thread;
     QTimer      m_timer;
     Worker      m_worker;
+    FrameQueue<WorkResult::ptr> m_bmode_results;
+    FrameQueue<WorkResult::ptr> m_color_results;
 };
 
 }   // end namespace
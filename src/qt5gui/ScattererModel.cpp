@@ -27,70 +27,106 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <numeric>
 #include <random>
+#include <stdexcept>
 #include "ScattererModel.hpp"
 
 void BaseScattererModel::precompute_template(trianglemesh3d::ITriangleMesh3d::u_ptr template_model) {
-    QVector<GLfloat> ps; // points
-    QVector<GLfloat> ns; // normals
-
-	// do data conversion
-	const auto num_vertices = template_model->num_vertices();
-	for (size_t i = 0; i < 3*num_vertices; i++) {
-		m_cube_points.push_back(static_cast<GLfloat>(template_model->vertex_data()[i]));
-		m_cube_normals.push_back(static_cast<GLfloat>(template_model->normal_data()[i]));
-	}
+    const auto num_vertices = template_model->num_vertices();
+    m_template_data.clear();
+    m_template_data.reserve(6*num_vertices);
+    for (size_t i = 0; i < num_vertices; i++) {
+        for (size_t dim = 0; dim < 3; dim++) {
+            m_template_data.push_back(static_cast<GLfloat>(template_model->vertex_data()[3*i+dim]*m_scatterer_radius));
+        }
+        for (size_t dim = 0; dim < 3; dim++) {
+            m_template_data.push_back(static_cast<GLfloat>(template_model->normal_data()[3*i+dim]));
+        }
+    }
 }
 
+void BaseScattererModel::setControlPoints(const std::vector<bcsim::vector3>& control_points, int num_cs) {
+    const auto num_scatterers = (num_cs > 0) ? static_cast<int>(control_points.size())/num_cs : 0;
 
-void SplineScattererModel::setTimestamp(float timestamp) {
-    size_t num_splines = m_splines.size();
-    m_data.clear();
-        
-    // Each scatterer has one point and one normal vector
-    m_data.reserve(num_splines*2*3);
-    
-    // Evaluate all splines in timestamp
-    for (size_t i = 0; i < num_splines; i++) {
-        // Evaluate scatterer position
-        bcsim::vector3 p = RenderCurve<float, bcsim::vector3>(m_splines[i], timestamp);
-        
-        // Add a correctly positioned cube in each scatterer position
-        for (size_t i = 0; i < m_cube_points.size()/3; i++) {
-            m_data.push_back(m_cube_points[3*i]  *m_scatterer_radius + p.x);
-            m_data.push_back(m_cube_points[3*i+1]*m_scatterer_radius + p.y);
-            m_data.push_back(m_cube_points[3*i+2]*m_scatterer_radius + p.z);
-            m_data.push_back(m_cube_normals[3*i]);
-            m_data.push_back(m_cube_normals[3*i+1]);
-            m_data.push_back(m_cube_normals[3*i+2]);
+    // fixed seed to get the same subsets every time
+    std::vector<int> order(num_scatterers);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(0));
+
+    m_control_points.clear();
+    m_control_points.reserve(3*num_scatterers*num_cs);
+    for (const auto scatterer_no : order) {
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            const auto& p = control_points[scatterer_no*num_cs + cs_no];
+            m_control_points.push_back(p.x);
+            m_control_points.push_back(p.y);
+            m_control_points.push_back(p.z);
         }
     }
+    m_num_scatterers = num_scatterers;
+    m_num_cs = num_cs;
 }
 
-void SplineScattererModel::setSplines(const std::vector<SplineCurve<float, bcsim::vector3> >& splines) {
-    size_t num_splines = splines.size();
-    m_splines = splines;
+void SplineScattererModel::setTimestamp(float timestamp) {
+    m_first_cs = 0;
+    m_weights.clear();
+    if (m_num_scatterers == 0) {
+        return;
+    }
+
+    // Only degree+1 basis functions are non-zero. Outside of the knot
+    // vector all are zero, which puts the scatterers in the origin.
+    int mu;
+    try {
+        mu = bspline_storve::compute_knot_interval(m_knots, timestamp);
+    } catch (std::runtime_error&) {
+        return;
+    }
+    float basis[MAX_SPLINE_WEIGHTS];
+    bspline_storve::nonzero_basis_functions(mu, m_degree, timestamp, m_knots, basis);
+
+    // skip basis functions without a control point
+    const auto first_cs = std::max(mu - m_degree, 0);
+    const auto end_cs = std::min(mu + 1, m_num_cs);
+    for (int cs_no = first_cs; cs_no < end_cs; cs_no++) {
+        m_weights.push_back(basis[cs_no - (mu - m_degree)]);
+    }
+    m_first_cs = first_cs;
 }
 
-void FixedScattererModel::setPoints(const std::vector<bcsim::vector3>& points) {
-    size_t num_points = points.size();
-    m_data.clear();
-        
-    // Each scatterer has one point and one normal vector
-    m_data.reserve(num_points*2*3);
-    
-    // Evaluate all splines in timestamp
-    for (size_t i = 0; i < num_points; i++) {
-        auto p = points[i];
-        
-        // Add a correctly positioned cube in each scatterer position
-        for (size_t i = 0; i < m_cube_points.size()/3; i++) {
-            m_data.push_back(m_cube_points[3*i]  *m_scatterer_radius + p.x);
-            m_data.push_back(m_cube_points[3*i+1]*m_scatterer_radius + p.y);
-            m_data.push_back(m_cube_points[3*i+2]*m_scatterer_radius + p.z);
-            m_data.push_back(m_cube_normals[3*i]);
-            m_data.push_back(m_cube_normals[3*i+1]);
-            m_data.push_back(m_cube_normals[3*i+2]);
+void SplineScattererModel::setSplines(const std::vector<SplineCurve<float, bcsim::vector3> >& splines) {
+    m_knots.clear();
+    m_degree = 0;
+    if (splines.empty()) {
+        setControlPoints(std::vector<bcsim::vector3>(), 0);
+        m_weights.clear();
+        return;
+    }
+
+    const auto& knots = splines[0].knots;
+    const auto degree = splines[0].degree;
+    const auto num_cs = static_cast<int>(splines[0].cs.size());
+    if ((degree < 0) || (degree + 1 > MAX_SPLINE_WEIGHTS)) {
+        throw std::runtime_error("unsupported spline degree for visualization");
+    }
+    std::vector<bcsim::vector3> control_points;
+    control_points.reserve(splines.size()*num_cs);
+    for (const auto& spline : splines) {
+        if ((spline.knots != knots) || (spline.degree != degree) || (static_cast<int>(spline.cs.size()) != num_cs)) {
+            throw std::runtime_error("all visualized splines must have the same knots and degree");
         }
+        control_points.insert(control_points.end(), spline.cs.begin(), spline.cs.end());
     }
+    m_knots = knots;
+    m_degree = degree;
+    setControlPoints(control_points, num_cs);
+    setTimestamp(knots[degree]);
+}
+
+void FixedScattererModel::setPoints(const std::vector<bcsim::vector3>& points) {
+    setControlPoints(points, 1);
+    m_first_cs = 0;
+    m_weights = QVector<GLfloat>(1, 1.0f);
 }
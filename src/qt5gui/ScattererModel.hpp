@@ -36,112 +36,155 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "trianglemesh3d/TriangleMesh3d.hpp"
 #include "IConfig.hpp"
 
-// Interface for something capable of returning data for consumption by OpenGL
+// Maximum number of non-zero spline basis functions, i.e. degree+1, which
+// the scatterer vertex shader supports.
+const int MAX_SPLINE_WEIGHTS = 8;
+
+// Interface for scatterers which are drawn as instances of a template mesh.
+// The position of scatterer no. i is the weighted sum of its control points
+//   sum_k weights()[k]*cs[i][firstControlPoint()+k],
+// so that the positions of moving scatterers can be evaluated on the GPU
+// with the same control points for all timestamps.
 class IScattererModel {
 public:
     virtual ~IScattererModel() { }
 
     // Pointer to data [p_x, p_y, p_z, n_x, n_y, n_z, ...] for all vertices
-    // and associated normal vectors.
-    virtual const GLfloat* constData() const    = 0;
+    // and associated normal vectors of the template scatterer.
+    virtual const GLfloat* templateData() const = 0;
 
-    // Number of floats
-    virtual int count() const                   = 0;
+    // Number of vertices of the template scatterer.
+    virtual int templateVertexCount() const     = 0;
 
-    // Number of vertices
-    virtual int vertexCount() const             = 0;
+    // Pointer to control points [x, y, z, ...] of all scatterers, with the
+    // control points of each scatterer after each other. The scatterers are
+    // in random order, so that the first n scatterers is a random subset.
+    virtual const GLfloat* controlPointData() const = 0;
+
+    virtual int numScatterers() const           = 0;
+
+    // Number of control points per scatterer.
+    virtual int numControlPoints() const        = 0;
+
+    // Index of the control point of the first weight.
+    virtual int firstControlPoint() const       = 0;
+
+    // At most MAX_SPLINE_WEIGHTS control point weights for the current time.
+    virtual const QVector<GLfloat>& weights() const = 0;
 };
 
 // Functionality which is common for both SplineScattererModel and FixedScattererModel.
-class BaseScattererModel {
+class BaseScattererModel : public IScattererModel {
 public:
     BaseScattererModel(trianglemesh3d::ITriangleMesh3d::u_ptr scatterer_template, IConfig::s_ptr& cfg) {
         m_scatterer_radius = cfg->get_double("scatterer_radius", 1.2e-3);
-		precompute_template(std::move(scatterer_template));
+        precompute_template(std::move(scatterer_template));
+    }
+
+    virtual const GLfloat* templateData() const {
+        return m_template_data.constData();
+    }
+
+    virtual int templateVertexCount() const {
+        return m_template_data.size()/6;
+    }
+
+    virtual const GLfloat* controlPointData() const {
+        return m_control_points.constData();
+    }
+
+    virtual int numScatterers() const {
+        return m_num_scatterers;
+    }
+
+    virtual int numControlPoints() const {
+        return m_num_cs;
+    }
+
+    virtual int firstControlPoint() const {
+        return m_first_cs;
+    }
+
+    virtual const QVector<GLfloat>& weights() const {
+        return m_weights;
     }
 
 protected:
     // Precompute vertices and normals of a template scatterer model.
-	void precompute_template(trianglemesh3d::ITriangleMesh3d::u_ptr scatterer_template);
+    void precompute_template(trianglemesh3d::ITriangleMesh3d::u_ptr scatterer_template);
 
-    // Creates random normalized normal vectors.
-    QVector<QVector3D> generateRandomNormalVectors(int num_vectors);
+    // Store num_cs control points per scatterer in random scatterer order.
+    void setControlPoints(const std::vector<bcsim::vector3>& control_points, int num_cs);
 
 protected:
-    // Precomputed data for a cube with unit radius
-    QVector<GLfloat>                                m_cube_points;
-    QVector<GLfloat>                                m_cube_normals;
+    // Template vertices scaled to the scatterer radius, and normals
+    QVector<GLfloat>                                m_template_data;
     double                                          m_scatterer_radius;
+
+    QVector<GLfloat>                                m_control_points;
+    int                                             m_num_scatterers = 0;
+    int                                             m_num_cs = 0;
+    int                                             m_first_cs = 0;
+    QVector<GLfloat>                                m_weights;
 };
 
 // Dummy empty model.
 class EmptyScattererModel : public IScattererModel {
 public:
-    virtual const GLfloat* constData() const {
+    virtual const GLfloat* templateData() const {
         return nullptr;
     }
 
-    virtual int count() const {
+    virtual int templateVertexCount() const {
         return 0;
     }
 
-    virtual int vertexCount() const {
-        return 0;
+    virtual const GLfloat* controlPointData() const {
+        return nullptr;
     }
-};
 
-class SplineScattererModel : public  IScattererModel,
-                             private BaseScattererModel {
-public:
-    SplineScattererModel(trianglemesh3d::ITriangleMesh3d::u_ptr template_model, IConfig::s_ptr& cfg)
-		: BaseScattererModel(std::move(template_model), cfg) {  }
+    virtual int numScatterers() const {
+        return 0;
+    }
 
-    virtual const GLfloat* constData() const {
-        return m_data.constData();
+    virtual int numControlPoints() const {
+        return 0;
     }
-    
-    virtual int count() const {
-        return m_data.size();
+
+    virtual int firstControlPoint() const {
+        return 0;
     }
-    
-    virtual int vertexCount() const {
-        return m_data.size()/6;
+
+    virtual const QVector<GLfloat>& weights() const {
+        return m_weights;
     }
 
-    // Recompute scatterer positions for a new timestamp.
+private:
+    QVector<GLfloat>                                m_weights;
+};
+
+class SplineScattererModel : public BaseScattererModel {
+public:
+    SplineScattererModel(trianglemesh3d::ITriangleMesh3d::u_ptr template_model, IConfig::s_ptr& cfg)
+        : BaseScattererModel(std::move(template_model), cfg) {  }
+
+    // Compute the basis function weights for a new timestamp.
     void setTimestamp(float timestamp);
 
-    // Use a new collection of spline scatterers.
+    // Use a new collection of spline scatterers. All splines must have the
+    // same knot vector and degree. Throws std::runtime_error if not.
     void setSplines(const std::vector<SplineCurve<float, bcsim::vector3> >& splines);
 
 private:
-    // Vertex and normal data that will be passed to VBO
-    QVector<GLfloat>                                m_data;
-    std::vector<SplineCurve<float, bcsim::vector3> > m_splines;
+    std::vector<float>                              m_knots;
+    int                                             m_degree = 0;
 };
 
-class FixedScattererModel : public  IScattererModel,
-                            private BaseScattererModel {
+class FixedScattererModel : public BaseScattererModel {
 public:
     FixedScattererModel(trianglemesh3d::ITriangleMesh3d::u_ptr template_model, IConfig::s_ptr& cfg)
-		: BaseScattererModel(std::move(template_model), cfg)	{ }
-
-    virtual const GLfloat* constData() const {
-        return m_data.constData();
-    }
-    
-    virtual int count() const {
-        return m_data.size();
-    }
-    
-    virtual int vertexCount() const {
-        return m_data.size()/6;
-    }
+        : BaseScattererModel(std::move(template_model), cfg) { }
 
     // Use a new collection of 3D points for visualization.
     void setPoints(const std::vector<bcsim::vector3>& points);
-
-private:
-    // Vertex and normal data that will be passed to VBO
-    QVector<GLfloat>                                m_data;
-};
\ No newline at end of file
+};
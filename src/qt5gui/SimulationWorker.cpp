@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include "SimulationWorker.hpp"
+#include "CudaGlImageItem.hpp"
+
+namespace simulation_worker {
+
+SimulationWorker::SimulationWorker(refresh_worker::RefreshWorker* refresh_worker, bcsim::ILog::ptr log,
+                                   std::shared_ptr<bcsim::IqRingBuffer> iq_buffer,
+                                   size_t max_queued_frames, QObject* parent)
+    : QThread(parent),
+      m_refresh_worker(refresh_worker),
+      m_log(log),
+      m_iq_buffer(iq_buffer),
+      m_requests(max_queued_frames),
+      m_subset_millisec(0.0)
+{
+    start();
+}
+
+SimulationWorker::~SimulationWorker() {
+    m_requests.close();
+    wait();
+}
+
+void SimulationWorker::request_frame(FrameRequest::ptr request) {
+    if (m_requests.push(request)) {
+        m_log->write(bcsim::ILog::DEBUG, "Simulator can not keep up: dropped oldest frame request");
+    }
+}
+
+void SimulationWorker::clear_requests() {
+    m_requests.clear();
+}
+
+void SimulationWorker::run() {
+    FrameRequest::ptr request;
+    while (m_requests.pop(request)) {
+        try {
+            simulate(*request);
+        } catch (std::runtime_error& e) {
+            m_log->write(bcsim::ILog::WARNING, "Caught exception while simulating: " + std::string(e.what()));
+        } catch (...) {
+            m_log->write(bcsim::ILog::WARNING, "Caught unknown error while simulating");
+        }
+        // release the simulator of the request
+        request.reset();
+    }
+}
+
+void SimulationWorker::simulate(FrameRequest& request) {
+    request.timing.queue_millisec = refresh_worker::millisec_since(request.timing.request_time);
+
+    std::lock_guard<std::mutex> lock(m_simulator_mutex);
+    auto& sim = *request.simulator;
+    sim.set_scan_sequence(request.scan_sequence);
+
+    size_t num_lines, num_samples;
+    sim.get_output_dimensions(num_lines, num_samples);
+
+    if (request.enable_color) {
+        // all frames of the packet in one batch with the current scan sequence
+        const auto packet_size = static_cast<size_t>(request.color_packet_size);
+        std::vector<std::complex<float>> packets(num_lines*num_samples*packet_size);
+        auto timing = request.timing;
+        const auto start_time = std::chrono::steady_clock::now();
+        sim.simulate_packets(packet_size, request.color_prt, packets.data());
+        timing.simulation_millisec = refresh_worker::millisec_since(start_time);
+
+        auto color_task = std::make_shared<refresh_worker::WorkTask_ColorDoppler>();
+        color_task->set_geometry(request.scan_geometry);
+        color_task->set_data(std::move(packets), num_lines, num_samples, packet_size);
+        color_task->set_clutter_filter(request.clutter_filter, request.polynomial_order);
+        color_task->set_dots_per_meter(request.dots_per_meter);
+        color_task->set_timing(timing);
+        m_refresh_worker->process_data(color_task);
+    }
+
+    if (request.enable_bmode && request.simulator_bmode) {
+        const auto& config = request.bmode_config;
+
+        auto work_result = std::make_shared<refresh_worker::WorkResult>();
+        work_result->timing = request.timing;
+        const auto start_time = std::chrono::steady_clock::now();
+#ifdef BCSIM_ENABLE_CUDA
+        if (request.device_image) {
+            // straight into the device buffer which is displayed
+            const auto device_image = request.device_image->begin_frame(config.width, config.height);
+            try {
+                work_result->updated_normalization_const = sim.simulate_bmode_image_on_device(config, device_image);
+            } catch (...) {
+                request.device_image->finish_frame(false);
+                throw;
+            }
+            request.device_image->finish_frame(true);
+            work_result->on_device = true;
+        } else
+#endif
+        {
+            m_bmode_image.resize(static_cast<size_t>(config.width)*config.height);
+            work_result->updated_normalization_const = sim.simulate_bmode_image(config, m_bmode_image.data());
+            work_result->image = refresh_worker::SafeQImage(m_bmode_image.data(), config.width, config.height,
+                                                            1, QImage::Format_Indexed8);
+        }
+        work_result->timing.simulation_millisec = refresh_worker::millisec_since(start_time);
+        m_refresh_worker->add_bmode_result(work_result);
+        emit frame_simulated(static_cast<int>(num_samples));
+
+    } else if (request.enable_bmode && (request.num_scatterer_subsets > 1)) {
+        simulate_progressive(request, num_lines, num_samples);
+        emit frame_simulated(static_cast<int>(num_samples));
+
+    } else if (request.enable_bmode) {
+        // a new buffer per frame since the refresh worker takes ownership
+        std::vector<std::complex<float>> iq_lines(num_lines*num_samples);
+        auto timing = request.timing;
+        const auto start_time = std::chrono::steady_clock::now();
+        sim.simulate_lines(iq_lines.data(), num_samples);
+        timing.simulation_millisec = refresh_worker::millisec_since(start_time);
+
+        const auto total_scatterers = sim.get_total_num_scatterers();
+        if (total_scatterers > 0) {
+            const auto ns_value = 1e6f*timing.simulation_millisec/(num_lines*total_scatterers);
+            m_log->write(bcsim::ILog::DEBUG, "Simulation time: " + std::to_string(ns_value) + " nanosec. per scatterer per line");
+        }
+
+        // the buffer only holds its lock while copying the frame
+        m_iq_buffer->push(iq_lines.data(), num_lines, num_samples, num_samples, request.sim_time);
+        process_bmode(request, std::move(iq_lines), num_lines, num_samples, timing);
+        emit frame_simulated(static_cast<int>(num_samples));
+    }
+}
+
+void SimulationWorker::simulate_progressive(FrameRequest& request, size_t num_lines, size_t num_samples) {
+    auto& sim = *request.simulator;
+    const auto num_subsets = request.num_scatterer_subsets;
+    const auto step = std::max(1, std::min(request.preview_subsets, num_subsets));
+
+    // the frames of disjoint subsets add up, and a frame of m out of n
+    // subsets is scaled by sqrt(n/m) to have the energy of the full frame.
+    std::vector<std::complex<float>> accumulated(num_lines*num_samples);
+    std::vector<std::complex<float>> iq_lines(num_lines*num_samples);
+    const auto start_time = std::chrono::steady_clock::now();
+    try {
+        for (int first_subset = 0; first_subset < num_subsets; first_subset += step) {
+            const auto end_subset = std::min(num_subsets, first_subset + step);
+            const auto subset_start = std::chrono::steady_clock::now();
+            sim.set_parameter("cpu_scatterer_subset_begin", std::to_string(first_subset));
+            sim.set_parameter("cpu_scatterer_subset_end", std::to_string(end_subset));
+            sim.simulate_lines(iq_lines.data(), num_samples);
+            m_subset_millisec = refresh_worker::millisec_since(subset_start)/(end_subset - first_subset);
+
+            const auto scale = std::sqrt(static_cast<float>(num_subsets)/end_subset);
+            std::vector<std::complex<float>> frame(num_lines*num_samples);
+            for (size_t i = 0; i < frame.size(); i++) {
+                accumulated[i] += iq_lines[i];
+                frame[i] = scale*accumulated[i];
+            }
+            auto timing = request.timing;
+            timing.simulation_millisec = refresh_worker::millisec_since(start_time);
+            if (end_subset == num_subsets) {
+                // only complete frames are recorded
+                m_iq_buffer->push(frame.data(), num_lines, num_samples, num_samples, request.sim_time);
+            }
+            process_bmode(request, std::move(frame), num_lines, num_samples, timing);
+
+            // a new probe pose or time makes the refinement obsolete
+            if (!m_requests.empty()) {
+                break;
+            }
+        }
+    } catch (...) {
+        sim.set_parameter("cpu_scatterer_subset_begin", "0");
+        sim.set_parameter("cpu_scatterer_subset_end", "-1");
+        throw;
+    }
+    sim.set_parameter("cpu_scatterer_subset_begin", "0");
+    sim.set_parameter("cpu_scatterer_subset_end", "-1");
+}
+
+void SimulationWorker::process_bmode(const FrameRequest& request, std::vector<std::complex<float>> iq_lines,
+                                     size_t num_lines, size_t num_samples, const refresh_worker::FrameTiming& timing) {
+    // Create refresh work task from current geometry and the beam space data
+    const auto& grayscale_settings = request.grayscale_settings;
+    auto bmode_task = std::make_shared<refresh_worker::WorkTask_BMode>();
+    bmode_task->set_geometry(request.scan_geometry);
+    bmode_task->set_data(std::move(iq_lines), num_lines, num_samples);
+    bmode_task->set_normalize_const(grayscale_settings.normalization_const);
+    bmode_task->set_auto_normalize(grayscale_settings.auto_normalize);
+    bmode_task->set_dots_per_meter(request.dots_per_meter);
+    bmode_task->set_dyn_range(grayscale_settings.dyn_range);
+    bmode_task->set_gain(grayscale_settings.gain);
+    bmode_task->set_timing(timing);
+    m_refresh_worker->process_data(bmode_task);
+}
+
+}   // end namespace
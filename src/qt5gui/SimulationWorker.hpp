@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <complex>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <QThread>
+#include "../core/LibBCSim.hpp"
+#include "../utils/ScanGeometry.hpp"
+#include "../utils/ColorFlowEstimator.hpp"
+#include "../utils/IqRingBuffer.hpp"
+#include "GrayscaleTransformWidget.hpp"
+#include "RefreshWorker.hpp"
+#include "FrameQueue.hpp"
+
+class CudaGlImageItem;
+
+namespace simulation_worker {
+
+// Everything needed to simulate a frame, captured on the GUI thread when
+// the frame is requested.
+struct FrameRequest {
+    typedef std::shared_ptr<FrameRequest> ptr;
+
+    bcsim::IAlgorithm::s_ptr        simulator;
+    bcsim::ScanSequence::s_ptr      scan_sequence;
+    bcsim::ScanGeometry::ptr        scan_geometry;
+    float                           sim_time;
+    float                           dots_per_meter;
+
+    bool                            enable_bmode;
+    bool                            simulator_bmode;    // let the simulator make the image
+    bcsim::BModeImageConfig         bmode_config;       // used with simulator_bmode
+    CudaGlImageItem*                device_image;       // keep the simulator image on the device if set
+    GrayscaleTransformSettings      grayscale_settings;
+
+    bool                            enable_color;
+    int                             color_packet_size;
+    float                           color_prt;
+    bcsim::ClutterFilter            clutter_filter;
+    int                             polynomial_order;
+
+    // Progressive B-mode of the CPU simulator, which has its fixed scatterers
+    // split into num_scatterer_subsets subsets: a preview of the first
+    // preview_subsets of them, refined with as many at a time until all are
+    // included or the next frame is requested. One disables it.
+    int                             num_scatterer_subsets;
+    int                             preview_subsets;
+
+    refresh_worker::FrameTiming     timing;
+};
+
+// Access to a simulator which is locked against the simulation worker
+// until the end of the full-expression, e.g. sim()->set_parameter(...).
+// A full-expression must not lock the simulator twice.
+class LockedSimulator {
+public:
+    LockedSimulator(std::unique_lock<std::mutex> lock, bcsim::IAlgorithm* simulator)
+        : m_lock(std::move(lock)),
+          m_simulator(simulator) { }
+
+    bcsim::IAlgorithm* operator->() const {
+        return m_simulator;
+    }
+
+private:
+    std::unique_lock<std::mutex>    m_lock;
+    bcsim::IAlgorithm*              m_simulator;
+};
+
+// Simulates requested frames on its own thread, so that the GUI is not
+// blocked and simulation runs concurrently with the refresh worker and the
+// display. B-mode and color Doppler data is passed on to the refresh
+// worker, and B-mode images made by the simulator directly to its display
+// queue. The IQ lines of B-mode frames are also kept in an IQ ring buffer.
+class SimulationWorker : public QThread {
+Q_OBJECT
+public:
+    // At most max_queued_frames requests are waiting, older requests are dropped.
+    SimulationWorker(refresh_worker::RefreshWorker* refresh_worker, bcsim::ILog::ptr log,
+                     std::shared_ptr<bcsim::IqRingBuffer> iq_buffer,
+                     size_t max_queued_frames = 2, QObject* parent = Q_NULLPTR);
+
+    virtual ~SimulationWorker();
+
+    void request_frame(FrameRequest::ptr request);
+
+    // Drop all requests that are not being simulated yet.
+    void clear_requests();
+
+    // Other threads must lock the simulator while using it.
+    std::unique_lock<std::mutex> lock_simulator() {
+        return std::unique_lock<std::mutex>(m_simulator_mutex);
+    }
+
+    size_t num_dropped_frames() const {
+        return m_requests.num_dropped();
+    }
+
+    // Simulation time of one scatterer subset in the last progressive frame.
+    double subset_millisec() const {
+        return m_subset_millisec;
+    }
+
+    // The number of IQ samples per line of the last simulated frame.
+    Q_SIGNAL void frame_simulated(int num_samples);
+
+protected:
+    virtual void run() override;
+
+private:
+    void simulate(FrameRequest& request);
+
+    // Simulate the B-mode IQ lines of the request in subsets and hand each
+    // refinement to the refresh worker.
+    void simulate_progressive(FrameRequest& request, size_t num_lines, size_t num_samples);
+
+    // Hand IQ lines to the refresh worker for B-mode processing.
+    void process_bmode(const FrameRequest& request, std::vector<std::complex<float>> iq_lines,
+                       size_t num_lines, size_t num_samples, const refresh_worker::FrameTiming& timing);
+
+private:
+    refresh_worker::RefreshWorker*  m_refresh_worker;
+    bcsim::ILog::ptr                m_log;
+    std::shared_ptr<bcsim::IqRingBuffer> m_iq_buffer;
+    FrameQueue<FrameRequest::ptr>   m_requests;
+    std::mutex                      m_simulator_mutex;
+
+    // Output of simulator B-mode processing, kept between frames.
+    std::vector<unsigned char>      m_bmode_image;
+
+    std::atomic<double>             m_subset_millisec;
+};
+
+}   // end namespace
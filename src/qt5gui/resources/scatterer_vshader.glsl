@@ -6,8 +6,22 @@ out vec3 vertNormal;
 uniform mat4 projMatrix;
 uniform mat4 mvMatrix;
 uniform mat3 normalMatrix;
+// control points of all scatterers, wrapped in rows
+uniform sampler2D controlPoints;
+uniform int numControlPoints;
+uniform int firstControlPoint;
+uniform int numWeights;
+uniform float weights[8];
 void main() {
-   vert = vertex.xyz;
+   // the scatterer position is a weighted sum of its control points
+   int width = textureSize(controlPoints, 0).x;
+   int first = gl_InstanceID*numControlPoints + firstControlPoint;
+   vec3 pos = vec3(0.0);
+   for (int k = 0; k < numWeights; k++) {
+       int i = first + k;
+       pos += weights[k]*texelFetch(controlPoints, ivec2(i % width, i / width), 0).xyz;
+   }
+   vert = vertex.xyz + pos;
    vertNormal = normalMatrix*normal;
-   gl_Position = projMatrix*mvMatrix*vertex;
+   gl_Position = projMatrix*mvMatrix*vec4(vert, 1.0);
 }
@@ -0,0 +1,442 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include "JobRunner.hpp"
+#include "../utils/BCSimConvenience.hpp"
+#include "../utils/BinaryPhantom.hpp"
+#include "../utils/GaussPulse.hpp"
+#include "../utils/HDFConvenience.hpp"
+#include "../utils/HdfIqRecorder.hpp"
+#include "../utils/ScanGeometry.hpp"
+
+namespace bcsim {
+namespace {
+
+typedef boost::property_tree::ptree ptree;
+
+// 64-bit FNV-1a
+const uint64_t FNV_OFFSET_BASIS = 1469598103934665603ull;
+const uint64_t FNV_PRIME        = 1099511628211ull;
+
+uint64_t fnv1a(const char* data, size_t num_bytes, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (size_t i = 0; i < num_bytes; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i]))*FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t string_hash(const std::string& text) {
+    return fnv1a(text.data(), text.size());
+}
+
+// An entry of the manifest is either a file name or an object.
+bool is_file_entry(const ptree& node) {
+    return node.empty();
+}
+
+// The canonical text of an object in the manifest.
+std::string subtree_text(const ptree& node) {
+    std::ostringstream out;
+    boost::property_tree::write_json(out, node, false);
+    return out.str();
+}
+
+std::vector<std::string> string_list(const ptree& node) {
+    std::vector<std::string> res;
+    for (const auto& child : node) {
+        res.push_back(child.second.get_value<std::string>());
+    }
+    return res;
+}
+
+std::string json_string(const std::string& value) {
+    std::string res = "\"";
+    for (const auto c : value) {
+        switch (c) {
+        case '"':  res += "\\\""; break;
+        case '\\': res += "\\\\"; break;
+        case '\n': res += "\\n";  break;
+        case '\t': res += "\\t";  break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                res += escaped;
+            } else {
+                res += c;
+            }
+        }
+    }
+    return res + "\"";
+}
+
+std::string json_list(const std::vector<std::string>& values) {
+    std::string res = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        res += (i > 0 ? ", " : "") + json_string(values[i]);
+    }
+    return res + "]";
+}
+
+ScanSequence::s_ptr create_scan_sequence(const ptree& node) {
+    const auto type = node.get<std::string>("type");
+    const auto num_lines = node.get<size_t>("num_lines");
+    ScanGeometry::ptr geometry;
+    if (type == "sector") {
+        auto sector = std::make_shared<SectorScanGeometry>();
+        sector->width = node.get<float>("width");
+        sector->depth = node.get<float>("depth");
+        sector->tilt  = node.get<float>("tilt", 0.0f);
+        geometry = sector;
+    } else if (type == "linear") {
+        auto linear = std::make_shared<LinearScanGeometry>();
+        linear->width     = node.get<float>("width");
+        linear->range_max = node.get<float>("depth");
+        geometry = linear;
+    } else {
+        throw std::runtime_error("unknown scan sequence type: " + type);
+    }
+    return std::make_shared<ScanSequence>(CreateScanSequence(geometry, num_lines, 0.0f));
+}
+
+}   // end anonymous namespace
+
+std::string JobResult::to_json() const {
+    std::ostringstream out;
+    out << "{\"id\": " << json_string(id) << ", \"ok\": " << (ok ? "true" : "false")
+        << ", \"frames\": " << num_frames << ", \"elapsed_sec\": " << elapsed_sec
+        << ", \"applied\": " << json_list(applied) << ", \"reused\": " << json_list(reused);
+    if (!ok) {
+        out << ", \"message\": " << json_string(message);
+    }
+    out << "}";
+    return out.str();
+}
+
+// A simulator with the content hashes of what is configured in it, where 0
+// is unknown or not configured.
+struct JobRunner::CachedSimulator {
+    CachedSimulator() : state(0), excitation(0), beam_profile(0), scan_sequence(0) { }
+
+    IAlgorithm::s_ptr                                   sim;
+    uint64_t                                            state;
+    std::map<std::string, std::string>                  parameters;
+    uint64_t                                            excitation;
+    uint64_t                                            beam_profile;
+    uint64_t                                            scan_sequence;
+    // (cache kind, hash) of the datasets in the order they were added
+    std::vector<std::pair<std::string, uint64_t>>       fixed;
+    std::vector<std::pair<std::string, uint64_t>>       spline;
+};
+
+struct JobRunner::Job {
+    ptree manifest;
+};
+
+bool JobRunner::FileKey::operator<(const FileKey& other) const {
+    return std::tie(path, size, mtime) < std::tie(other.path, other.size, other.mtime);
+}
+
+JobRunner::JobRunner(size_t max_cached_datasets)
+    : m_max_cached_datasets(max_cached_datasets),
+      m_job_counter(0)
+{ }
+
+JobRunner::~JobRunner() { }
+
+JobResult JobRunner::run(const std::string& manifest_json) {
+    JobResult result;
+    const auto start = std::chrono::steady_clock::now();
+    m_job_counter++;
+    std::string algorithm;
+    try {
+        Job job;
+        std::istringstream in(manifest_json);
+        boost::property_tree::read_json(in, job.manifest);
+        result.id = job.manifest.get<std::string>("id", "");
+        algorithm = job.manifest.get<std::string>("algorithm", "cpu");
+        const auto output_file = job.manifest.get<std::string>("output");
+        const auto num_frames = job.manifest.get<size_t>("frames", 1);
+        const auto frame_dt = job.manifest.get<float>("frame_dt", 0.0f);
+        const auto compression_level = job.manifest.get<int>("compression", 0);
+        if (num_frames == 0) {
+            throw std::runtime_error("a job needs at least one frame");
+        }
+
+        auto& cached = m_simulators[algorithm];
+        if (!cached) {
+            cached.reset(new CachedSimulator);
+            cached->sim = Create(algorithm);
+        }
+        configure(*cached, job, result);
+
+        size_t num_lines;
+        size_t num_samples;
+        cached->sim->get_output_dimensions(num_lines, num_samples);
+        HdfIqRecorder recorder(output_file, num_lines, num_samples, compression_level);
+        std::vector<float> timestamp_offsets(num_frames);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            timestamp_offsets[frame_no] = frame_no*frame_dt;
+        }
+        std::vector<std::complex<float>> frame(num_lines*num_samples);
+        cached->sim->begin_stream(timestamp_offsets);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            cached->sim->next_frame(frame.data(), num_samples);
+            recorder.append(frame.data(), num_samples, timestamp_offsets[frame_no]);
+        }
+        recorder.close();
+        result.num_frames = num_frames;
+        result.ok = true;
+    } catch (const std::exception& e) {
+        // the configuration of the simulator is unknown after a failure
+        m_simulators.erase(algorithm);
+        result.message = e.what();
+    }
+    evict_datasets();
+    result.elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void JobRunner::configure(CachedSimulator& cached, const Job& job, JobResult& result) {
+    auto& sim = *cached.sim;
+    const auto& manifest = job.manifest;
+    const auto record = [&](const std::string& part, bool applied) {
+        (applied ? result.applied : result.reused).push_back(part);
+    };
+
+    // a state replaces everything, so nothing else is known afterwards
+    if (const auto state_file = manifest.get_optional<std::string>("state")) {
+        const auto hash = file_hash(*state_file);
+        const bool changed = (hash != cached.state);
+        if (changed) {
+            auto sim_ptr = cached.sim;
+            cached = CachedSimulator();
+            cached.sim = sim_ptr;
+            sim.load_state(*state_file);
+            cached.state = hash;
+        }
+        record("state", changed);
+    }
+
+    if (const auto parameters = manifest.get_child_optional("parameters")) {
+        bool changed = false;
+        for (const auto& entry : *parameters) {
+            const auto value = entry.second.get_value<std::string>();
+            const auto it = cached.parameters.find(entry.first);
+            if ((it == cached.parameters.end()) || (it->second != value)) {
+                sim.set_parameter(entry.first, value);
+                cached.parameters[entry.first] = value;
+                changed = true;
+            }
+        }
+        record("parameters", changed);
+    }
+
+    if (const auto node = manifest.get_child_optional("excitation")) {
+        const auto hash = string_hash(subtree_text(*node));
+        const bool changed = (hash != cached.excitation);
+        if (changed) {
+            const auto center_freq = node->get<float>("center_frequency");
+            ExcitationSignal excitation;
+            excitation.sampling_frequency = node->get<float>("sampling_frequency");
+            std::vector<float> times;
+            MakeGaussianExcitation(center_freq, node->get<float>("bandwidth"), excitation.sampling_frequency,
+                                   times, excitation.samples, excitation.center_index);
+            excitation.demod_freq = node->get<float>("demod_frequency", center_freq);
+            cached.excitation = 0;
+            sim.set_excitation(excitation);
+            cached.excitation = hash;
+        }
+        record("excitation", changed);
+    }
+
+    if (const auto node = manifest.get_child_optional("beam_profile")) {
+        const bool lookup = is_file_entry(*node);
+        const auto hash = lookup ? file_hash(node->get_value<std::string>()) : string_hash(subtree_text(*node));
+        const bool changed = (hash != cached.beam_profile);
+        if (changed) {
+            cached.beam_profile = 0;
+            if (lookup) {
+                const auto path = node->get_value<std::string>();
+                sim.set_lookup_profile(get_cached<IBeamProfile>("beam_profile", hash, [&]() {
+                    return loadBeamProfileFromHdf(path);
+                }));
+            } else {
+                sim.set_analytical_profile(std::make_shared<GaussianBeamProfile>(node->get<float>("sigma_lateral"),
+                                                                                 node->get<float>("sigma_elevational")));
+            }
+            cached.beam_profile = hash;
+        }
+        record("beam_profile", changed);
+    }
+
+    if (const auto node = manifest.get_child_optional("scan_sequence")) {
+        const bool from_file = is_file_entry(*node);
+        const auto hash = from_file ? file_hash(node->get_value<std::string>()) : string_hash(subtree_text(*node));
+        const bool changed = (hash != cached.scan_sequence);
+        if (changed) {
+            cached.scan_sequence = 0;
+            const auto scan_seq = get_cached<ScanSequence>("scan_sequence", hash, [&]() -> ScanSequence::s_ptr {
+                if (from_file) {
+                    return ScanSequence::s_ptr(loadScanSequenceFromHdf(node->get_value<std::string>()));
+                }
+                return create_scan_sequence(*node);
+            });
+            sim.set_scan_sequence(scan_seq);
+            cached.scan_sequence = hash;
+        }
+        record("scan_sequence", changed);
+    }
+
+    // Datasets are only added if the list extends the configured list,
+    // otherwise all are added again, from memory if they are cached.
+    typedef std::vector<std::pair<std::string, uint64_t>> DatasetKeys;
+    const auto update_datasets = [&](const std::string& part, DatasetKeys& configured, const DatasetKeys& wanted,
+                                     std::function<void()> clear, std::function<void(size_t)> add) {
+        if (wanted == configured) {
+            record(part, false);
+            return;
+        }
+        size_t first_new = configured.size();
+        if ((wanted.size() < configured.size()) || !std::equal(configured.begin(), configured.end(), wanted.begin())) {
+            configured.clear();
+            clear();
+            first_new = 0;
+        }
+        for (size_t i = first_new; i < wanted.size(); i++) {
+            add(i);
+            configured.push_back(wanted[i]);
+        }
+        record(part, true);
+    };
+
+    if (const auto node = manifest.get_child_optional("fixed_scatterers")) {
+        const auto paths = string_list(*node);
+        DatasetKeys wanted;
+        for (const auto& path : paths) {
+            wanted.emplace_back(isBinaryPhantom(path) ? "mapped_fixed" : "fixed", file_hash(path));
+        }
+        update_datasets("fixed_scatterers", cached.fixed, wanted, [&]() { sim.clear_fixed_scatterers(); }, [&](size_t i) {
+            if (wanted[i].first == "mapped_fixed") {
+                sim.add_external_fixed_scatterers(get_cached<ExternalFixedScatterers>(wanted[i].first, wanted[i].second, [&]() {
+                    return getExternalFixedScatterers(std::make_shared<MappedPhantom>(paths[i]));
+                }));
+            } else {
+                sim.add_fixed_scatterers(get_cached<FixedScatterers>(wanted[i].first, wanted[i].second, [&]() {
+                    return loadFixedScatterersFromHdf(paths[i]);
+                }));
+            }
+        });
+    }
+
+    if (const auto node = manifest.get_child_optional("spline_scatterers")) {
+        const auto paths = string_list(*node);
+        DatasetKeys wanted;
+        for (const auto& path : paths) {
+            wanted.emplace_back("spline", file_hash(path));
+        }
+        update_datasets("spline_scatterers", cached.spline, wanted, [&]() { sim.clear_spline_scatterers(); }, [&](size_t i) {
+            sim.add_spline_scatterers(get_cached<SplineScatterers>("spline", wanted[i].second, [&]() {
+                return isBinaryPhantom(paths[i]) ? MappedPhantom(paths[i]).get_spline_scatterers()
+                                                 : loadSplineScatterersFromHdf(paths[i]);
+            }));
+        });
+    }
+}
+
+uint64_t JobRunner::file_hash(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("cannot access " + path);
+    }
+    const FileKey key = {path, static_cast<int64_t>(info.st_size), static_cast<int64_t>(info.st_mtime)};
+    const auto it = m_file_hashes.find(key);
+    if (it != m_file_hashes.end()) {
+        return it->second;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot read " + path);
+    }
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = FNV_OFFSET_BASIS;
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        hash = fnv1a(buffer.data(), static_cast<size_t>(in.gcount()), hash);
+    }
+    // 0 means "not configured"
+    hash = std::max<uint64_t>(hash, 1);
+    m_file_hashes[key] = hash;
+    return hash;
+}
+
+template <typename T, typename Loader>
+std::shared_ptr<T> JobRunner::get_cached(const std::string& kind, uint64_t hash, Loader load) {
+    auto& entry = m_cache[std::make_pair(kind, hash)];
+    if (!entry.object) {
+        entry.object = load();
+    }
+    entry.last_used = m_job_counter;
+    return std::static_pointer_cast<T>(entry.object);
+}
+
+void JobRunner::evict_datasets() {
+    std::set<std::pair<std::string, uint64_t>> in_use;
+    for (const auto& entry : m_simulators) {
+        const auto& cached = *entry.second;
+        in_use.insert(cached.fixed.begin(), cached.fixed.end());
+        in_use.insert(cached.spline.begin(), cached.spline.end());
+        in_use.emplace("beam_profile", cached.beam_profile);
+        in_use.emplace("scan_sequence", cached.scan_sequence);
+    }
+    std::vector<std::pair<size_t, std::pair<std::string, uint64_t>>> unused;
+    for (const auto& entry : m_cache) {
+        if (in_use.count(entry.first) == 0) {
+            unused.emplace_back(entry.second.last_used, entry.first);
+        }
+    }
+    if (unused.size() <= m_max_cached_datasets) {
+        return;
+    }
+    std::sort(unused.begin(), unused.end());
+    for (size_t i = 0; i < unused.size() - m_max_cached_datasets; i++) {
+        m_cache.erase(unused[i].second);
+    }
+}
+
+}   // end namespace
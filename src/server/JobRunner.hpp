@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../core/LibBCSim.hpp"
+
+namespace bcsim {
+
+// The outcome of a job, see JobRunner::run().
+struct JobResult {
+    JobResult() : ok(false), num_frames(0), elapsed_sec(0.0) { }
+
+    std::string                 id;
+    bool                        ok;
+    std::string                 message;        // the error if !ok
+    size_t                      num_frames;
+    double                      elapsed_sec;
+    // the parts of the configuration that were applied to the simulator,
+    // e.g. "scan_sequence", and the ones that were already in place
+    std::vector<std::string>    applied;
+    std::vector<std::string>    reused;
+
+    // One line of JSON.
+    std::string to_json() const;
+};
+
+// Runs simulation jobs described by JSON manifests, e.g.
+//
+//  {"id": "job7", "algorithm": "cpu", "state": "base.state",
+//   "parameters": {"num_cpu_cores": "8"},
+//   "excitation": {"center_frequency": 2.5e6, "bandwidth": 0.2, "sampling_frequency": 50e6},
+//   "beam_profile": "lut.h5" or {"sigma_lateral": 1e-3, "sigma_elevational": 3e-3},
+//   "scan_sequence": "scan.h5" or {"type": "sector", "width": 1.2, "depth": 0.12, "tilt": 0, "num_lines": 128},
+//   "fixed_scatterers": ["tissue.bin"], "spline_scatterers": ["heart.h5"],
+//   "frames": 10, "frame_dt": 0.02, "output": "job7.h5", "compression": 0}
+//
+// where everything but "output" is optional. The runner keeps one simulator
+// per algorithm and remembers the content hash of everything applied to it,
+// so a job only applies what differs from the previous job on the same
+// simulator. Entries that are left out keep the previous configuration, and
+// an empty list clears the datasets. A state is applied first and replaces
+// the whole configuration. Loaded files are cached by content hash, and
+// binary phantoms (see BinaryPhantom.hpp) are memory mapped rather than
+// copied by the CPU simulator.
+class JobRunner {
+public:
+    // At most max_cached_datasets loaded datasets are kept that are not
+    // configured in a simulator.
+    explicit JobRunner(size_t max_cached_datasets = 8);
+
+    ~JobRunner();
+
+    // Run one job. Failures are reported in the result, after which the
+    // simulator of the job is recreated by the next job using it.
+    JobResult run(const std::string& manifest_json);
+
+private:
+    struct CachedSimulator;
+    struct Job;
+
+    void configure(CachedSimulator& cached, const Job& job, JobResult& result);
+
+    // Content hash of a file, which is only recomputed when its size or
+    // modification time changes.
+    uint64_t file_hash(const std::string& path);
+
+    // A loaded object from the cache, or loaded with load() and cached.
+    template <typename T, typename Loader>
+    std::shared_ptr<T> get_cached(const std::string& kind, uint64_t hash, Loader load);
+
+    void evict_datasets();
+
+private:
+    struct FileKey {
+        std::string path;
+        int64_t     size;
+        int64_t     mtime;
+        bool operator<(const FileKey& other) const;
+    };
+    struct CacheEntry {
+        std::shared_ptr<void>   object;
+        size_t                  last_used;
+    };
+
+    size_t                                                  m_max_cached_datasets;
+    size_t                                                  m_job_counter;
+    std::map<std::string, std::unique_ptr<CachedSimulator>> m_simulators;
+    std::map<FileKey, uint64_t>                             m_file_hashes;
+    std::map<std::pair<std::string, uint64_t>, CacheEntry>  m_cache;
+};
+
+}   // end namespace
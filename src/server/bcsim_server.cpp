@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*  Runs a queue of simulation jobs with simulators that are kept configured
+ *  between jobs, e.g.
+ *
+ *      mkfifo jobs && bcsim_server --queue jobs --follow &
+ *      echo '{"id": "a", "state": "base.state", "output": "a.h5"}' > jobs
+ *
+ *  Every line of the queue is a JSON job manifest, see JobRunner.hpp, and
+ *  one line of JSON is written to stdout per job. Empty lines and lines
+ *  starting with '#' are skipped.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <boost/program_options.hpp>
+#include "JobRunner.hpp"
+
+namespace {
+
+void run_queue(std::istream& in, bcsim::JobRunner& runner) {
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto first = line.find_first_not_of(" \t\r");
+        if ((first == std::string::npos) || (line[first] == '#')) {
+            continue;
+        }
+        std::cout << runner.run(line).to_json() << std::endl;
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::string queue;
+        size_t max_cached_datasets;
+        namespace po = boost::program_options;
+        po::options_description desc("Allowed options");
+        desc.add_options()
+            ("help", "show help message")
+            ("queue", po::value<std::string>(&queue)->default_value("-"), "file or FIFO of job manifests, - for stdin")
+            ("follow", "reopen the queue at end of file, for FIFOs")
+            ("max_cached_datasets", po::value<size_t>(&max_cached_datasets)->default_value(8),
+                "loaded datasets to keep when no simulator uses them")
+        ;
+        po::variables_map var_map;
+        po::store(po::parse_command_line(argc, argv, desc), var_map);
+        if (var_map.count("help") != 0) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(var_map);
+
+        bcsim::JobRunner runner(max_cached_datasets);
+        if (queue == "-") {
+            run_queue(std::cin, runner);
+            return 0;
+        }
+        const bool follow = (var_map.count("follow") != 0);
+        do {
+            // opening a FIFO blocks until a writer opens it
+            std::ifstream in(queue);
+            if (!in) {
+                throw std::runtime_error("cannot open " + queue);
+            }
+            run_queue(in, runner);
+        } while (follow);
+    } catch (const std::exception& e) {
+        std::cerr << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
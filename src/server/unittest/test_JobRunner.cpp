@@ -0,0 +1,75 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE JobRunnerTests
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../JobRunner.hpp"
+#include "../../core/LibBCSim.hpp"
+#include "../../utils/BinaryPhantom.hpp"
+
+namespace {
+
+const char* phantom_file = "test_JobRunner_phantom.bin";
+
+void write_phantom() {
+    bcsim::FixedScatterers fixed;
+    for (int i = 0; i < 200; i++) {
+        bcsim::PointScatterer scatterer;
+        scatterer.pos = bcsim::vector3(1e-4f*(i%20 - 10), 0.0f, 0.01f + 1e-4f*i);
+        scatterer.amplitude = 1.0f;
+        fixed.scatterers.push_back(scatterer);
+    }
+    bcsim::sort_fixed_scatterers_for_culling(fixed);
+    bcsim::savePhantomToBinary(phantom_file, &fixed, nullptr);
+}
+
+std::string manifest(const std::string& id, int num_lines) {
+    return "{\"id\": \"" + id + "\", \"algorithm\": \"cpu\", \"parameters\": {\"verbose\": \"0\"},"
+           " \"excitation\": {\"center_frequency\": 2.5e6, \"bandwidth\": 0.2, \"sampling_frequency\": 50e6},"
+           " \"beam_profile\": {\"sigma_lateral\": 1e-3, \"sigma_elevational\": 3e-3},"
+           " \"scan_sequence\": {\"type\": \"linear\", \"width\": 0.004, \"depth\": 0.04, \"num_lines\": "
+           + std::to_string(num_lines) + "},"
+           " \"fixed_scatterers\": [\"" + phantom_file + "\"],"
+           " \"frames\": 2, \"output\": \"test_JobRunner_" + id + ".h5\"}";
+}
+
+bool contains(const std::vector<std::string>& parts, const std::string& part) {
+    return std::find(parts.begin(), parts.end(), part) != parts.end();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(SecondJobOnlyAppliesChanges) {
+    write_phantom();
+    bcsim::JobRunner runner;
+
+    const auto first = runner.run(manifest("first", 8));
+    BOOST_REQUIRE_MESSAGE(first.ok, first.message);
+    BOOST_CHECK_EQUAL(first.num_frames, 2u);
+    BOOST_CHECK(contains(first.applied, "fixed_scatterers"));
+    BOOST_CHECK(contains(first.applied, "scan_sequence"));
+
+    const auto second = runner.run(manifest("second", 16));
+    BOOST_REQUIRE_MESSAGE(second.ok, second.message);
+    BOOST_CHECK(contains(second.applied, "scan_sequence"));
+    BOOST_CHECK(contains(second.reused, "fixed_scatterers"));
+    BOOST_CHECK(contains(second.reused, "excitation"));
+    BOOST_CHECK(contains(second.reused, "beam_profile"));
+    BOOST_CHECK(contains(second.reused, "parameters"));
+
+    std::remove("test_JobRunner_first.h5");
+    std::remove("test_JobRunner_second.h5");
+    std::remove(phantom_file);
+}
+
+BOOST_AUTO_TEST_CASE(FailedJobIsReported) {
+    bcsim::JobRunner runner;
+    const auto res = runner.run("{\"id\": \"bad\", \"fixed_scatterers\": [\"no_such_file.h5\"], \"output\": \"x.h5\"}");
+    BOOST_CHECK(!res.ok);
+    BOOST_CHECK(!res.message.empty());
+    BOOST_CHECK(res.to_json().find("\"ok\": false") != std::string::npos);
+
+    BOOST_CHECK(!runner.run("not json").ok);
+}
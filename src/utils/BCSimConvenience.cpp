@@ -33,7 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdexcept>
 #include "BCSimConvenience.hpp"
 #include "../core/bspline.hpp"
-#include "rotation3d.hpp"
+#include "../core/matrix3.hpp"
 
 namespace bcsim {
 
@@ -82,35 +82,166 @@ void log_compress_frame(std::vector<std::vector<float> >& image_lines, float dyn
     }
 }
 
+void decimate_frame(const float* frame, size_t num_beams, size_t num_samples, int rad_decimation, float* decimated) {
+    if (rad_decimation < 1) throw std::runtime_error("Invalid decimation value");
+
+    const auto num_samples_dec = num_samples / rad_decimation;
+    const auto num_beams_int = static_cast<int>(num_beams);
+    #pragma omp parallel for
+    for (int beam_no = 0; beam_no < num_beams_int; beam_no++) {
+        const auto src = frame + beam_no*num_samples;
+        const auto dst = decimated + beam_no*num_samples_dec;
+        #pragma omp simd
+        for (size_t sample_no = 0; sample_no < num_samples_dec; sample_no++) {
+            dst[sample_no] = src[sample_no*rad_decimation];
+        }
+    }
+}
+
+float get_max_value(const float* values, size_t num_values) {
+    if (num_values == 0) throw std::runtime_error("No values");
+
+    float max_value = values[0];
+    const auto num_values_int = static_cast<std::ptrdiff_t>(num_values);
+    #pragma omp parallel for simd reduction(max: max_value)
+    for (std::ptrdiff_t i = 0; i < num_values_int; i++) {
+        max_value = std::max(max_value, values[i]);
+    }
+    return max_value;
+}
+
+void log_compress_frame(float* values, size_t num_values, float dyn_range, float normalize_factor, float gain_factor) {
+    // 255/dyn_range*(20*log10(gain*v/normalize) + dyn_range) = scale*log10(v) + offset
+    const float scale  = 20.0f*255.0f/dyn_range;
+    const float offset = (255.0f/dyn_range)*(20.0f*std::log10(gain_factor/normalize_factor) + dyn_range);
+    const auto num_values_int = static_cast<std::ptrdiff_t>(num_values);
+    #pragma omp parallel for simd
+    for (std::ptrdiff_t i = 0; i < num_values_int; i++) {
+        const float pixel = scale*fast_log10(values[i]) + offset;
+        values[i] = std::min(std::max(pixel, 0.0f), 255.0f);
+    }
+}
+
+float envelope_log_compress_frame(const std::complex<float>* iq_lines, size_t num_lines, size_t num_samples,
+                                  size_t line_stride, float dyn_range, float normalize_factor, float gain_factor,
+                                  bool auto_normalize, unsigned char* gray_levels) {
+    if ((num_lines == 0) || (num_samples == 0)) throw std::runtime_error("No IQ samples");
+
+    // the squared envelope, which avoids the square roots
+    const auto iq_floats = reinterpret_cast<const float*>(iq_lines);
+    const auto num_lines_int = static_cast<int>(num_lines);
+    if (auto_normalize) {
+        float max_power = 0.0f;
+        #pragma omp parallel for reduction(max: max_power)
+        for (int line_no = 0; line_no < num_lines_int; line_no++) {
+            const auto src = iq_floats + 2*line_no*line_stride;
+            #pragma omp simd reduction(max: max_power)
+            for (size_t i = 0; i < num_samples; i++) {
+                max_power = std::max(max_power, src[2*i]*src[2*i] + src[2*i+1]*src[2*i+1]);
+            }
+        }
+        normalize_factor = std::sqrt(max_power);
+    }
+
+    // 255/dyn_range*(20*log10(gain*envelope/normalize) + dyn_range) = scale*log10(power) + offset
+    const float scale  = 10.0f*255.0f/dyn_range;
+    const float offset = (255.0f/dyn_range)*(20.0f*std::log10(gain_factor/normalize_factor) + dyn_range);
+    #pragma omp parallel for
+    for (int line_no = 0; line_no < num_lines_int; line_no++) {
+        const auto src = iq_floats + 2*line_no*line_stride;
+        const auto dst = gray_levels + line_no*num_samples;
+        #pragma omp simd
+        for (size_t i = 0; i < num_samples; i++) {
+            const float power = src[2*i]*src[2*i] + src[2*i+1]*src[2*i+1];
+            const float pixel = scale*fast_log10(power) + offset;
+            dst[i] = static_cast<unsigned char>(std::min(std::max(pixel, 0.0f), 255.0f));
+        }
+    }
+    return normalize_factor;
+}
+
 Scatterers::s_ptr render_fixed_scatterers(SplineScatterers::s_ptr spline_scatterers, float timestamp) {
-    // TODO: can parts of this code be put in a separate function and used both
-    // here and in the CPU spline algoritm to reduce code duplication?
     auto res = FixedScatterers::s_ptr(new FixedScatterers);
-    const auto num_scatterers = spline_scatterers->num_scatterers();
+    res->scatterers.resize(spline_scatterers->num_scatterers());
+    render_fixed_scatterers(*spline_scatterers, &timestamp, 1, res->scatterers.data());
+    return res;
+}
+
+void render_fixed_scatterers(const SplineScatterers& spline_scatterers, const float* timestamps,
+                             size_t num_timestamps, PointScatterer* scatterers) {
+    const size_t num_scatterers = spline_scatterers.num_scatterers();
     if (num_scatterers == 0) {
         throw std::runtime_error("No spline scatterers");
     }
-    
-        
-    // precompute basis functions
-    const auto num_cs = spline_scatterers->get_num_control_points();
-    std::vector<float> basis_fn(num_cs);
-    for (size_t i = 0; i < num_cs; i++) {
-        basis_fn[i] = bspline_storve::bsplineBasis(i, spline_scatterers->spline_degree, timestamp, spline_scatterers->knot_vector);
+
+    // precompute the non-zero basis functions of each timestamp, i.e. for
+    // control points mu-p..mu
+    const auto spline_degree = spline_scatterers.spline_degree;
+    const auto num_cs = static_cast<int>(spline_scatterers.get_num_control_points());
+    std::vector<int> first_cs(num_timestamps);
+    std::vector<float> basis_fn(num_timestamps*(spline_degree+1));
+    for (size_t i = 0; i < num_timestamps; i++) {
+        const auto mu = bspline_storve::compute_knot_interval(spline_scatterers.knot_vector, timestamps[i]);
+        if ((mu < spline_degree) || (mu >= num_cs)) {
+            throw std::runtime_error("illegal knot interval for timestamp");
+        }
+        first_cs[i] = mu - spline_degree;
+        bspline_storve::nonzero_basis_functions(mu, spline_degree, timestamps[i], spline_scatterers.knot_vector,
+                                                basis_fn.data() + i*(spline_degree+1));
     }
-    
-    // evaluate using cached basis functions
-    res->scatterers.resize(num_scatterers);
-    for (size_t spline_no = 0; spline_no < num_scatterers; spline_no++) {
-        PointScatterer scatterer;
-        scatterer.pos       = vector3(0.0f, 0.0f, 0.0f);
-        scatterer.amplitude = spline_scatterers->amplitudes[spline_no];
-        for (size_t i = 0; i < num_cs; i++) {
-            scatterer.pos += spline_scatterers->control_points[spline_no][i]*basis_fn[i];
+
+    // The control points are stored with all scatterers for one control point
+    // next to each other, so blocks of scatterers are accumulated in local
+    // arrays with unit-stride loops before they are written out.
+    const size_t block_size = 256;
+    const auto num_blocks = static_cast<std::ptrdiff_t>((num_scatterers + block_size - 1) / block_size);
+    const auto num_timestamps_int = static_cast<std::ptrdiff_t>(num_timestamps);
+    #pragma omp parallel for collapse(2)
+    for (std::ptrdiff_t time_no = 0; time_no < num_timestamps_int; time_no++) {
+        for (std::ptrdiff_t block_no = 0; block_no < num_blocks; block_no++) {
+            const auto first_scatterer = block_no*block_size;
+            const auto n = std::min(block_size, num_scatterers - first_scatterer);
+            const auto weights = basis_fn.data() + time_no*(spline_degree+1);
+
+            float xs[block_size] = {0.0f};
+            float ys[block_size] = {0.0f};
+            float zs[block_size] = {0.0f};
+            for (int k = 0; k <= spline_degree; k++) {
+                const auto offset = spline_scatterers.control_point_index(first_scatterer, first_cs[time_no] + k);
+                const auto cs_xs = spline_scatterers.control_xs.data() + offset;
+                const auto cs_ys = spline_scatterers.control_ys.data() + offset;
+                const auto cs_zs = spline_scatterers.control_zs.data() + offset;
+                const auto weight = weights[k];
+                #pragma omp simd
+                for (size_t i = 0; i < n; i++) {
+                    xs[i] += weight*cs_xs[i];
+                    ys[i] += weight*cs_ys[i];
+                    zs[i] += weight*cs_zs[i];
+                }
+            }
+
+            auto dst = scatterers + time_no*num_scatterers + first_scatterer;
+            for (size_t i = 0; i < n; i++) {
+                dst[i].pos       = vector3(xs[i], ys[i], zs[i]);
+                dst[i].amplitude = spline_scatterers.amplitudes[first_scatterer + i];
+            }
         }
-        res->scatterers[spline_no] = scatterer;
     }
+}
+
+std::vector<FixedScatterers::s_ptr> render_fixed_scatterers(SplineScatterers::s_ptr spline_scatterers,
+                                                            const std::vector<float>& timestamps) {
+    const size_t num_scatterers = spline_scatterers->num_scatterers();
+    std::vector<PointScatterer> all_scatterers(timestamps.size()*num_scatterers);
+    render_fixed_scatterers(*spline_scatterers, timestamps.data(), timestamps.size(), all_scatterers.data());
 
+    std::vector<FixedScatterers::s_ptr> res;
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        auto fixed_scatterers = std::make_shared<FixedScatterers>();
+        fixed_scatterers->scatterers.assign(all_scatterers.begin() + i*num_scatterers,
+                                            all_scatterers.begin() + (i+1)*num_scatterers);
+        res.push_back(fixed_scatterers);
+    }
     return res;
 }
 
@@ -119,24 +250,16 @@ ScanSequence CreateScanSequence(std::shared_ptr<SectorScanGeometry> geometry, si
     ScanSequence res(line_length);
     
     // Will be transformed by a rotation into lateral and radial unit vectors.
-    // NOTE: Need to use double to avoid "not orthonormal" error (maybe the test is to strict for floats?)
-    const auto unit_vector_x = unit_x<double>();
-    const auto unit_vector_z = unit_z<double>();
+    const vector3 unit_vector_x(1.0f, 0.0f, 0.0f);
+    const vector3 unit_vector_z(0.0f, 0.0f, 1.0f);
     const vector3 origin(0.0f, 0.0f, 0.0f);
 
     for (int line_no = 0; line_no < static_cast<int>(num_lines); line_no++) {
         const float angle = -0.5f*geometry->width + geometry->tilt + line_no*geometry->width/(num_lines-1);
 
-        const auto ROT_MATRIX = rotation_matrix_y<double>(angle);
-        const auto temp_radial_direction  = boost::numeric::ublas::prod(ROT_MATRIX, unit_vector_z);
-        const auto temp_lateral_direction = boost::numeric::ublas::prod(ROT_MATRIX, unit_vector_x); 
-	
-        // Copy to vector3 vectors. TODO: deduplicate
-        const vector3 direction  ((float)temp_radial_direction(0),  (float)temp_radial_direction(1),  (float)temp_radial_direction(2));
-        const vector3 lateral_dir((float)temp_lateral_direction(0), (float)temp_lateral_direction(1), (float)temp_lateral_direction(2));
-
+        const auto rot_matrix = Matrix3::rotation_y(angle);
         try {
-            auto sl = Scanline(origin, direction, lateral_dir, timestamp);
+            auto sl = Scanline(origin, rot_matrix*unit_vector_z, rot_matrix*unit_vector_x, timestamp);
             res.add_scanline(sl);
         } catch (std::runtime_error& e) {
             throw std::runtime_error(std::string("failed creating scan line: ") + e.what());
@@ -150,13 +273,8 @@ ScanSequence CreateScanSequence(std::shared_ptr<LinearScanGeometry> geometry, si
     const auto line_length = geometry->range_max;
     ScanSequence res(line_length);
 
-    const auto unit_vector_x = unit_x<double>();
-    const auto unit_vector_z = unit_z<double>();
-
-    // Copy to vector3 vectors. TODO: deduplicate
-    const vector3 direction  (unit_vector_z(0), unit_vector_z(1), unit_vector_z(2));
-    const vector3 lateral_dir(unit_vector_x(0), unit_vector_x(1), unit_vector_x(2));
-
+    const vector3 direction  (0.0f, 0.0f, 1.0f);
+    const vector3 lateral_dir(1.0f, 0.0f, 0.0f);
 
     for (int line_no = 0; line_no < static_cast<int>(num_lines); line_no++) {
         try {
@@ -185,38 +303,14 @@ ScanSequence CreateScanSequence(ScanGeometry::ptr geometry, size_t num_lines, fl
     }
 }
 
-namespace detail {
-    // Apply a 3x3 rotation matrix to a vector3;
-    template <typename T>
-    vector3 TransformVector(const vector3& v, const boost::numeric::ublas::matrix<T>& matrix33) {
-        boost::numeric::ublas::vector<T> temp_v(3);
-        temp_v(0) = static_cast<T>(v.x); temp_v(1) = static_cast<T>(v.y); temp_v(2) = static_cast<T>(v.z);
-        const auto transformed = boost::numeric::ublas::prod(matrix33, temp_v);
-        return vector3(static_cast<float>(transformed(0)),
-                       static_cast<float>(transformed(1)),
-                       static_cast<float>(transformed(2)));
-    }
-}
-
 ScanSequence::s_ptr OrientScanSequence(const ScanSequence& scan_seq, const vector3& rot_angles, const vector3& probe_origin) {
-    const auto rot_matrix = rotation_matrix_xyz(rot_angles.x, rot_angles.y, rot_angles.z);
-
-    const auto line_length = scan_seq.line_length;
+    auto res = ScanSequence::s_ptr(new ScanSequence(scan_seq));
+    OrientScanSequenceInPlace(*res, rot_angles, probe_origin);
+    return res;
+}
 
-    auto num_lines = scan_seq.get_num_lines();
-    auto res = new ScanSequence(line_length);
-    for (int i = 0; i < num_lines; i++) {
-        const auto old_line = scan_seq.get_scanline(i);
-        const auto rotated_origin      = detail::TransformVector(old_line.get_origin(),      rot_matrix);
-        const auto rotated_direction   = detail::TransformVector(old_line.get_direction(),   rot_matrix);
-        const auto rotated_lateral_dir = detail::TransformVector(old_line.get_lateral_dir(), rot_matrix);
-        
-        res->add_scanline(Scanline(rotated_origin + probe_origin,
-                                  rotated_direction,
-                                  rotated_lateral_dir,
-                                  old_line.get_timestamp()));
-    }
-    return ScanSequence::s_ptr(res);
+void OrientScanSequenceInPlace(ScanSequence& scan_seq, const vector3& rot_angles, const vector3& probe_origin) {
+    scan_seq.transform(Matrix3::rotation_xyz(rot_angles.x, rot_angles.y, rot_angles.z), probe_origin);
 }
 
 }   // end namespace
@@ -28,6 +28,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <complex>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include "../core/export_macros.hpp"
 #include "../core/BCSimConfig.hpp"
@@ -52,12 +55,68 @@ float DLL_PUBLIC get_max_value(const std::vector<std::vector<float> >& image_lin
 // gain_factor:         Image gain
 void DLL_PUBLIC log_compress_frame(std::vector<std::vector<float> >& image_lines, float dyn_range, float normalize_factor, float gain_factor);
 
+// Approximation of log10(x) for finite x > 0 made of bit operations and a
+// polynomial, so that loops calling it vectorize. The absolute error is
+// below 5e-7 for x in [1e-3, 1e3] and the relative error below 2e-7 for
+// all normal x. Zero and denormals give about -38.2 instead of -inf.
+inline float fast_log10(float x) {
+    // x = m*2^e with m in [sqrt(1/2), sqrt(2))
+    std::int32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const std::int32_t e = (bits - 0x3f3504f3) >> 23;
+    bits -= e*(1 << 23);
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+
+    // log2(m) = 2/ln(2)*atanh(t) with t = (m-1)/(m+1) in (-0.172, 0.172)
+    const float t  = (m - 1.0f)/(m + 1.0f);
+    const float t2 = t*t;
+    const float log2_m = t*(2.88539008f + t2*(0.961796694f + t2*(0.577078016f + t2*0.412198583f)));
+    return 0.301029996f*(static_cast<float>(e) + log2_m);
+}
+
+// The functions below work on frames stored contiguously, beam by beam, and
+// use OpenMP threads and SIMD.
+
+// Decimate num_beams beams of num_samples samples radially. The result has
+// num_samples/rad_decimation samples per beam and is written to decimated.
+void DLL_PUBLIC decimate_frame(const float* frame, size_t num_beams, size_t num_samples, int rad_decimation, float* decimated);
+
+// The biggest of num_values values.
+float DLL_PUBLIC get_max_value(const float* values, size_t num_values);
+
+// Log-compress num_values values in place and clamp them to [0, 255] like
+// the vector version, but with fast_log10().
+void DLL_PUBLIC log_compress_frame(float* values, size_t num_values, float dyn_range, float normalize_factor, float gain_factor);
+
+// Envelope detection, log-compression and normalization of a frame of IQ
+// samples in one pass, instead of one pass per step. Line i of num_samples
+// samples starts at iq_lines + i*line_stride, and the gray levels in [0, 255]
+// are stored line by line in gray_levels. If auto_normalize is set, the
+// envelope is normalized by its maximum in the frame, which takes an extra
+// pass that only reads the IQ samples, and by normalize_factor otherwise.
+// Returns the normalization factor used.
+float DLL_PUBLIC envelope_log_compress_frame(const std::complex<float>* iq_lines, size_t num_lines, size_t num_samples,
+                                             size_t line_stride, float dyn_range, float normalize_factor, float gain_factor,
+                                             bool auto_normalize, unsigned char* gray_levels);
+
 // Evaluate a spline scatterer dataset at a specific time in order to generate
 // a new fixed scatterer dataset.
 // timestamp: the time to evaluate the spline scatterers in
-// NOTE: This code is completely untested!
 Scatterers::s_ptr DLL_PUBLIC render_fixed_scatterers(SplineScatterers::s_ptr spline_scatterers, float timestamp);
 
+// Evaluate a spline scatterer dataset at num_timestamps times, e.g. all frames
+// of a cine loop. The scatterers of timestamp i are written to
+// scatterers + i*num_scatterers, so there must be room for num_timestamps
+// times num_scatterers() scatterers. Throws if a timestamp is outside the
+// time limits of the splines.
+void DLL_PUBLIC render_fixed_scatterers(const SplineScatterers& spline_scatterers, const float* timestamps,
+                                        size_t num_timestamps, PointScatterer* scatterers);
+
+// As above, with one fixed scatterer dataset per timestamp.
+std::vector<FixedScatterers::s_ptr> DLL_PUBLIC render_fixed_scatterers(SplineScatterers::s_ptr spline_scatterers,
+                                                                       const std::vector<float>& timestamps);
+
 // Create a sector/linear scan where all lines have the same timestamp.
 // By convention, all scan sequences are created in their own local coordinate system
 // centered at origin. The standard radial direction is along the z-axis and the lateral
@@ -70,4 +129,8 @@ ScanSequence DLL_PUBLIC CreateScanSequence(ScanGeometry::ptr geometry, size_t nu
 // 2. Translate the origin.
 ScanSequence::s_ptr DLL_PUBLIC OrientScanSequence(const ScanSequence& scan_seq, const vector3& rot_angles, const vector3& origin);
 
+// As above, but modifies scan_seq in a single pass over its lines, or in
+// constant time if it is parametric.
+void DLL_PUBLIC OrientScanSequenceInPlace(ScanSequence& scan_seq, const vector3& rot_angles, const vector3& origin);
+
 }   // end namespace
\ No newline at end of file
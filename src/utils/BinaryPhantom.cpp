@@ -0,0 +1,285 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "BinaryPhantom.hpp"
+#include "../core/bspline.hpp"
+
+namespace bcsim {
+namespace {
+
+const char      phantom_magic[8]   = {'B', 'C', 'S', 'I', 'M', 'P', 'H', 'T'};
+const uint32_t  phantom_version    = 1;
+const uint32_t  phantom_byte_order = 0x01020304;
+const uint64_t  section_alignment  = 64;
+
+static_assert(sizeof(BinaryPhantomHeader) == 128, "binary phantom header must be 128 bytes");
+
+// Number of floats in a section according to the header.
+uint64_t section_length(const BinaryPhantomHeader& header, int section) {
+    switch (section) {
+    case BinaryPhantomHeader::FIXED_XS:
+    case BinaryPhantomHeader::FIXED_YS:
+    case BinaryPhantomHeader::FIXED_ZS:
+    case BinaryPhantomHeader::FIXED_AMPLITUDES:
+        return header.num_fixed_scatterers;
+    case BinaryPhantomHeader::SPLINE_XS:
+    case BinaryPhantomHeader::SPLINE_YS:
+    case BinaryPhantomHeader::SPLINE_ZS:
+        return header.num_spline_scatterers*header.num_control_points;
+    case BinaryPhantomHeader::SPLINE_AMPLITUDES:
+        return header.num_spline_scatterers;
+    case BinaryPhantomHeader::KNOTS:
+        return (header.num_spline_scatterers > 0) ? header.num_knots : 0;
+    default:
+        throw std::logic_error("invalid phantom section");
+    }
+}
+
+bool has_magic(const BinaryPhantomHeader& header) {
+    return std::memcmp(header.magic, phantom_magic, sizeof(phantom_magic)) == 0;
+}
+
+}   // namespace
+
+struct MappedPhantom::Mapping {
+    boost::interprocess::file_mapping   file;
+    boost::interprocess::mapped_region  region;
+};
+
+MappedPhantom::MappedPhantom(const std::string& phantom_file) {
+    try {
+        m_mapping = std::unique_ptr<Mapping>(new Mapping);
+        m_mapping->file   = boost::interprocess::file_mapping(phantom_file.c_str(), boost::interprocess::read_only);
+        m_mapping->region = boost::interprocess::mapped_region(m_mapping->file, boost::interprocess::read_only);
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        throw std::runtime_error("failed to map phantom file " + phantom_file + ": " + e.what());
+    }
+    const auto file_size = static_cast<uint64_t>(m_mapping->region.get_size());
+    if (file_size < sizeof(BinaryPhantomHeader)) {
+        throw std::runtime_error("phantom file is too small");
+    }
+    m_header = static_cast<const BinaryPhantomHeader*>(m_mapping->region.get_address());
+    if (!has_magic(*m_header)) {
+        throw std::runtime_error("not a binary phantom file");
+    }
+    if (m_header->byte_order != phantom_byte_order) {
+        throw std::runtime_error("binary phantom has wrong byte order");
+    }
+    if (m_header->version != phantom_version) {
+        throw std::runtime_error("unsupported binary phantom version: " + std::to_string(m_header->version));
+    }
+    if (m_header->num_sections != BinaryPhantomHeader::NUM_SECTIONS) {
+        throw std::runtime_error("binary phantom has wrong number of sections");
+    }
+    if (has_spline_scatterers()) {
+        if ((m_header->spline_degree < 0) || (m_header->num_control_points == 0)
+            || (m_header->num_knots != m_header->num_control_points + m_header->spline_degree + 1)) {
+            throw std::runtime_error("binary phantom has invalid spline configuration");
+        }
+    }
+    for (int section_no = 0; section_no < BinaryPhantomHeader::NUM_SECTIONS; section_no++) {
+        const auto offset = m_header->section_offsets[section_no];
+        const auto length = section_length(*m_header, section_no);
+        if (length == 0) {
+            continue;
+        }
+        if ((offset == 0) || (offset % section_alignment != 0)) {
+            throw std::runtime_error("binary phantom section is missing or misaligned");
+        }
+        if ((offset > file_size) || (length > (file_size - offset)/sizeof(float))) {
+            throw std::runtime_error("binary phantom file is truncated");
+        }
+    }
+}
+
+MappedPhantom::~MappedPhantom() { }
+
+const float* MappedPhantom::section(BinaryPhantomHeader::Section section) const {
+    if (section_length(*m_header, section) == 0) {
+        return nullptr;
+    }
+    const auto base = static_cast<const char*>(m_mapping->region.get_address());
+    return reinterpret_cast<const float*>(base + m_header->section_offsets[section]);
+}
+
+FixedScatterers::s_ptr MappedPhantom::get_fixed_scatterers() const {
+    if (!has_fixed_scatterers()) {
+        throw std::runtime_error("no fixed scatterers in phantom");
+    }
+    const auto xs = section(BinaryPhantomHeader::FIXED_XS);
+    const auto ys = section(BinaryPhantomHeader::FIXED_YS);
+    const auto zs = section(BinaryPhantomHeader::FIXED_ZS);
+    const auto as = section(BinaryPhantomHeader::FIXED_AMPLITUDES);
+    auto res = std::make_shared<FixedScatterers>();
+    const auto num_scatterers = static_cast<size_t>(m_header->num_fixed_scatterers);
+    res->scatterers.resize(num_scatterers);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        res->scatterers[i].pos       = vector3(xs[i], ys[i], zs[i]);
+        res->scatterers[i].amplitude = as[i];
+    }
+    return res;
+}
+
+SplineScatterers::s_ptr MappedPhantom::get_spline_scatterers() const {
+    if (!has_spline_scatterers()) {
+        throw std::runtime_error("no spline scatterers in phantom");
+    }
+    auto res = std::make_shared<SplineScatterers>();
+    res->spline_degree = m_header->spline_degree;
+    const auto knots = section(BinaryPhantomHeader::KNOTS);
+    res->knot_vector.assign(knots, knots + m_header->num_knots);
+
+    // same layout, so the sections are copied as they are
+    res->resize(m_header->num_spline_scatterers, m_header->num_control_points);
+    const auto num_values = res->control_xs.size();
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_XS), num_values, res->control_xs.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_YS), num_values, res->control_ys.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_ZS), num_values, res->control_zs.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_AMPLITUDES), res->amplitudes.size(), res->amplitudes.begin());
+    return res;
+}
+
+SplineScatterers::s_ptr MappedPhantom::get_spline_scatterers(float start_time, float end_time) const {
+    if (!has_spline_scatterers()) {
+        throw std::runtime_error("no spline scatterers in phantom");
+    }
+    const auto knots = section(BinaryPhantomHeader::KNOTS);
+    const std::vector<float> knot_vector(knots, knots + m_header->num_knots);
+    const auto degree = m_header->spline_degree;
+    const auto cs_range = bspline_storve::control_point_range(knot_vector, degree, static_cast<int>(m_header->num_control_points),
+                                                              start_time, end_time);
+
+    auto res = std::make_shared<SplineScatterers>();
+    res->spline_degree = degree;
+    res->knot_vector.assign(knot_vector.begin() + cs_range.first, knot_vector.begin() + cs_range.second + degree + 2);
+    const auto num_scatterers = static_cast<size_t>(m_header->num_spline_scatterers);
+    res->resize(num_scatterers, cs_range.second - cs_range.first + 1);
+    const auto first_value = cs_range.first*num_scatterers;
+    const auto num_values  = res->control_xs.size();
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_XS) + first_value, num_values, res->control_xs.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_YS) + first_value, num_values, res->control_ys.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_ZS) + first_value, num_values, res->control_zs.begin());
+    std::copy_n(section(BinaryPhantomHeader::SPLINE_AMPLITUDES), num_scatterers, res->amplitudes.begin());
+    return res;
+}
+
+ExternalFixedScatterers::s_ptr getExternalFixedScatterers(MappedPhantom::s_ptr phantom) {
+    if (!phantom->has_fixed_scatterers()) {
+        throw std::runtime_error("binary phantom has no fixed scatterers");
+    }
+    auto res = std::make_shared<ExternalFixedScatterers>();
+    res->xs    = phantom->section(BinaryPhantomHeader::FIXED_XS);
+    res->ys    = phantom->section(BinaryPhantomHeader::FIXED_YS);
+    res->zs    = phantom->section(BinaryPhantomHeader::FIXED_ZS);
+    res->as    = phantom->section(BinaryPhantomHeader::FIXED_AMPLITUDES);
+    res->count = static_cast<size_t>(phantom->header().num_fixed_scatterers);
+    res->owner = phantom;
+    return res;
+}
+
+bool isBinaryPhantom(const std::string& phantom_file) {
+    std::ifstream in(phantom_file, std::ios::binary);
+    char magic[sizeof(phantom_magic)];
+    if (!in.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, phantom_magic, sizeof(phantom_magic)) == 0;
+}
+
+void savePhantomToBinary(const std::string& phantom_file,
+                         const FixedScatterers* fixed_scatterers,
+                         const SplineScatterers* spline_scatterers) {
+    if (*reinterpret_cast<const unsigned char*>(&phantom_byte_order) != 0x04) {
+        throw std::runtime_error("binary phantoms can only be written on little-endian hosts");
+    }
+    BinaryPhantomHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, phantom_magic, sizeof(phantom_magic));
+    header.version      = phantom_version;
+    header.byte_order   = phantom_byte_order;
+    header.num_sections = BinaryPhantomHeader::NUM_SECTIONS;
+
+    std::vector<std::vector<float>> sections(BinaryPhantomHeader::NUM_SECTIONS);
+    if (fixed_scatterers && fixed_scatterers->num_scatterers() > 0) {
+        const auto& scatterers = fixed_scatterers->scatterers;
+        header.num_fixed_scatterers = scatterers.size();
+        for (const auto& scatterer : scatterers) {
+            sections[BinaryPhantomHeader::FIXED_XS].push_back(scatterer.pos.x);
+            sections[BinaryPhantomHeader::FIXED_YS].push_back(scatterer.pos.y);
+            sections[BinaryPhantomHeader::FIXED_ZS].push_back(scatterer.pos.z);
+            sections[BinaryPhantomHeader::FIXED_AMPLITUDES].push_back(scatterer.amplitude);
+        }
+    }
+    if (spline_scatterers && spline_scatterers->num_scatterers() > 0) {
+        header.num_spline_scatterers = spline_scatterers->num_scatterers();
+        header.num_control_points    = spline_scatterers->get_num_control_points();
+        header.num_knots             = spline_scatterers->knot_vector.size();
+        header.spline_degree         = spline_scatterers->spline_degree;
+        sections[BinaryPhantomHeader::SPLINE_XS]         = spline_scatterers->control_xs;
+        sections[BinaryPhantomHeader::SPLINE_YS]         = spline_scatterers->control_ys;
+        sections[BinaryPhantomHeader::SPLINE_ZS]         = spline_scatterers->control_zs;
+        sections[BinaryPhantomHeader::SPLINE_AMPLITUDES] = spline_scatterers->amplitudes;
+        sections[BinaryPhantomHeader::KNOTS]             = spline_scatterers->knot_vector;
+    }
+
+    uint64_t offset = sizeof(BinaryPhantomHeader);
+    for (int section_no = 0; section_no < BinaryPhantomHeader::NUM_SECTIONS; section_no++) {
+        if (sections[section_no].empty()) continue;
+        header.section_offsets[section_no] = offset;
+        offset += sections[section_no].size()*sizeof(float);
+        offset = (offset + section_alignment - 1)/section_alignment*section_alignment;
+    }
+
+    std::ofstream out(phantom_file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("failed to create phantom file " + phantom_file);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    const std::vector<char> padding(section_alignment, 0);
+    for (int section_no = 0; section_no < BinaryPhantomHeader::NUM_SECTIONS; section_no++) {
+        if (sections[section_no].empty()) continue;
+        out.write(padding.data(), header.section_offsets[section_no] - written);
+        const auto num_bytes = sections[section_no].size()*sizeof(float);
+        out.write(reinterpret_cast<const char*>(sections[section_no].data()), num_bytes);
+        written = header.section_offsets[section_no] + num_bytes;
+    }
+    if (!out) {
+        throw std::runtime_error("failed to write phantom file " + phantom_file);
+    }
+}
+
+}   // namespace
@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+// Binary phantom files hold fixed and/or spline scatterers as a structure
+// of arrays of little-endian float32 values, in 64-byte aligned sections
+// that can be memory mapped. The spline control points use the layout of
+// SplineScatterers, i.e. all scatterers' values for control point 0 first.
+// The files are written by savePhantomToBinary() and by
+// phantom_scripts/binary_phantom.py, which converts HDF5 phantoms.
+
+namespace bcsim {
+
+// The 128 byte header at the start of a binary phantom file.
+struct BinaryPhantomHeader {
+    enum Section {
+        FIXED_XS = 0, FIXED_YS, FIXED_ZS, FIXED_AMPLITUDES,
+        SPLINE_XS, SPLINE_YS, SPLINE_ZS, SPLINE_AMPLITUDES,
+        KNOTS,
+        NUM_SECTIONS
+    };
+
+    char        magic[8];               // "BCSIMPHT"
+    uint32_t    version;
+    uint32_t    byte_order;             // 0x01020304 when written
+    uint64_t    num_fixed_scatterers;
+    uint64_t    num_spline_scatterers;
+    uint64_t    num_control_points;
+    uint64_t    num_knots;
+    int32_t     spline_degree;
+    uint32_t    num_sections;
+    // byte offset of each section, 0 if the section is not present
+    uint64_t    section_offsets[NUM_SECTIONS];
+};
+
+// A read-only memory mapping of a binary phantom file. The section
+// pointers stay valid for the lifetime of the object.
+class DLL_PUBLIC MappedPhantom {
+public:
+    typedef std::shared_ptr<MappedPhantom> s_ptr;
+
+    // Throws if the file is not a valid binary phantom.
+    explicit MappedPhantom(const std::string& phantom_file);
+    ~MappedPhantom();
+
+    const BinaryPhantomHeader& header() const { return *m_header; }
+
+    // Pointer to the floats of a section, or nullptr if not present.
+    const float* section(BinaryPhantomHeader::Section section) const;
+
+    bool has_fixed_scatterers() const   { return m_header->num_fixed_scatterers > 0; }
+    bool has_spline_scatterers() const  { return m_header->num_spline_scatterers > 0; }
+
+    // Copies into the structures used by the simulators.
+    FixedScatterers::s_ptr  get_fixed_scatterers() const;
+    SplineScatterers::s_ptr get_spline_scatterers() const;
+
+    // Spline scatterers with only the control points that are needed in
+    // [start_time, end_time], which are read from one contiguous range of
+    // each section, and the knot vector trimmed to match.
+    SplineScatterers::s_ptr get_spline_scatterers(float start_time, float end_time) const;
+
+private:
+    struct Mapping;
+    std::unique_ptr<Mapping>    m_mapping;
+    const BinaryPhantomHeader*  m_header;
+};
+
+// The fixed scatterers of a mapped phantom as an external dataset, which
+// references the mapping and keeps it alive. Several processes mapping the
+// same file, e.g. in /dev/shm, share its pages. Throws if the phantom has no
+// fixed scatterers.
+ExternalFixedScatterers::s_ptr DLL_PUBLIC getExternalFixedScatterers(MappedPhantom::s_ptr phantom);
+
+// True if the file starts with the binary phantom magic.
+bool DLL_PUBLIC isBinaryPhantom(const std::string& phantom_file);
+
+// Write fixed and/or spline scatterers (either may be null) to a binary
+// phantom file.
+void DLL_PUBLIC savePhantomToBinary(const std::string& phantom_file,
+                                    const FixedScatterers* fixed_scatterers,
+                                    const SplineScatterers* spline_scatterers);
+
+}   // namespace
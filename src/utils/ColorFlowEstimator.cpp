@@ -0,0 +1,208 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "ColorFlowEstimator.hpp"
+
+namespace bcsim {
+
+ClutterFilter parse_clutter_filter(const std::string& name) {
+    if (name == "none") {
+        return ClutterFilter::NONE;
+    } else if (name == "mean") {
+        return ClutterFilter::MEAN;
+    } else if (name == "polynomial") {
+        return ClutterFilter::POLYNOMIAL;
+    } else {
+        throw std::runtime_error("unknown clutter filter: " + name);
+    }
+}
+
+ColorFlowEstimator::ColorFlowEstimator(size_t packet_size, ClutterFilter filter, int polynomial_order)
+    : m_packet_size(packet_size),
+      m_num_basis(0)
+{
+    if (packet_size < 2) {
+        throw std::runtime_error("packet size must be at least two");
+    }
+    switch (filter) {
+    case ClutterFilter::NONE:
+        m_num_basis = 0;
+        break;
+    case ClutterFilter::MEAN:
+        m_num_basis = 1;
+        break;
+    case ClutterFilter::POLYNOMIAL:
+        if (polynomial_order < 0) {
+            throw std::runtime_error("polynomial order cannot be negative");
+        }
+        m_num_basis = static_cast<size_t>(polynomial_order) + 1;
+        break;
+    default:
+        throw std::runtime_error("invalid clutter filter");
+    }
+    if (m_num_basis + 2 > packet_size) {
+        throw std::runtime_error("packet size is too small for the clutter filter");
+    }
+
+    // Gram-Schmidt orthonormalization of the monomials in the centered
+    // packet index, in double precision.
+    std::vector<double> basis(m_num_basis*packet_size);
+    const auto center = 0.5*(packet_size - 1);
+    for (size_t k = 0; k < m_num_basis; k++) {
+        double* b = basis.data() + k*packet_size;
+        for (size_t p = 0; p < packet_size; p++) {
+            b[p] = std::pow((p - center)/packet_size, static_cast<double>(k));
+        }
+        for (size_t j = 0; j < k; j++) {
+            const double* prev = basis.data() + j*packet_size;
+            double dot = 0.0;
+            for (size_t p = 0; p < packet_size; p++) {
+                dot += b[p]*prev[p];
+            }
+            for (size_t p = 0; p < packet_size; p++) {
+                b[p] -= dot*prev[p];
+            }
+        }
+        double norm = 0.0;
+        for (size_t p = 0; p < packet_size; p++) {
+            norm += b[p]*b[p];
+        }
+        norm = std::sqrt(norm);
+        for (size_t p = 0; p < packet_size; p++) {
+            b[p] /= norm;
+        }
+    }
+    m_clutter_basis.assign(basis.begin(), basis.end());
+}
+
+void ColorFlowEstimator::process(const std::complex<float>* packets, size_t num_lines, size_t num_samples,
+                                 float* r0, float* r1_phase) const {
+    const auto packet_size = m_packet_size;
+    const auto num_basis   = m_num_basis;
+
+    #pragma omp parallel
+    {
+        // Filtered packets of one line as [packet][sample], real and imaginary
+        // parts separate, so that the loops over samples vectorize.
+        std::vector<float> re(packet_size*num_samples);
+        std::vector<float> im(packet_size*num_samples);
+        std::vector<float> coeff_re(num_samples);
+        std::vector<float> coeff_im(num_samples);
+        std::vector<float> r1_re(num_samples);
+        std::vector<float> r1_im(num_samples);
+
+        #pragma omp for schedule(static)
+        for (long long line_no = 0; line_no < static_cast<long long>(num_lines); line_no++) {
+            const auto line_packets = packets + line_no*num_samples*packet_size;
+            for (size_t i = 0; i < num_samples; i++) {
+                for (size_t p = 0; p < packet_size; p++) {
+                    const auto z = line_packets[i*packet_size + p];
+                    re[p*num_samples + i] = z.real();
+                    im[p*num_samples + i] = z.imag();
+                }
+            }
+
+            // remove the projection onto the clutter subspace
+            for (size_t k = 0; k < num_basis; k++) {
+                const float* b = m_clutter_basis.data() + k*packet_size;
+                std::fill(coeff_re.begin(), coeff_re.end(), 0.0f);
+                std::fill(coeff_im.begin(), coeff_im.end(), 0.0f);
+                for (size_t p = 0; p < packet_size; p++) {
+                    const auto bp = b[p];
+                    const float* x_re = re.data() + p*num_samples;
+                    const float* x_im = im.data() + p*num_samples;
+                    #pragma omp simd
+                    for (size_t i = 0; i < num_samples; i++) {
+                        coeff_re[i] += bp*x_re[i];
+                        coeff_im[i] += bp*x_im[i];
+                    }
+                }
+                for (size_t p = 0; p < packet_size; p++) {
+                    const auto bp = b[p];
+                    float* x_re = re.data() + p*num_samples;
+                    float* x_im = im.data() + p*num_samples;
+                    #pragma omp simd
+                    for (size_t i = 0; i < num_samples; i++) {
+                        x_re[i] -= bp*coeff_re[i];
+                        x_im[i] -= bp*coeff_im[i];
+                    }
+                }
+            }
+
+            // R0 and R1 = sum conj(z[p])*z[p+1]
+            float* line_r0 = r0 + line_no*num_samples;
+            std::fill(line_r0, line_r0 + num_samples, 0.0f);
+            std::fill(r1_re.begin(), r1_re.end(), 0.0f);
+            std::fill(r1_im.begin(), r1_im.end(), 0.0f);
+            for (size_t p = 0; p < packet_size; p++) {
+                const float* x_re = re.data() + p*num_samples;
+                const float* x_im = im.data() + p*num_samples;
+                #pragma omp simd
+                for (size_t i = 0; i < num_samples; i++) {
+                    line_r0[i] += x_re[i]*x_re[i] + x_im[i]*x_im[i];
+                }
+            }
+            for (size_t p = 0; p + 1 < packet_size; p++) {
+                const float* a_re = re.data() + p*num_samples;
+                const float* a_im = im.data() + p*num_samples;
+                const float* b_re = a_re + num_samples;
+                const float* b_im = a_im + num_samples;
+                #pragma omp simd
+                for (size_t i = 0; i < num_samples; i++) {
+                    r1_re[i] += a_re[i]*b_re[i] + a_im[i]*b_im[i];
+                    r1_im[i] += a_re[i]*b_im[i] - a_im[i]*b_re[i];
+                }
+            }
+            float* line_phase = r1_phase + line_no*num_samples;
+            for (size_t i = 0; i < num_samples; i++) {
+                line_phase[i] = std::atan2(r1_im[i], r1_re[i]);
+            }
+        }
+    }
+}
+
+void interleave_packet_frame(const std::complex<float>* frame, size_t num_lines, size_t num_samples,
+                             size_t packet_no, size_t packet_size, std::complex<float>* packets) {
+    if (packet_no >= packet_size) {
+        throw std::runtime_error("packet index out of range");
+    }
+    #pragma omp parallel for
+    for (long long line_no = 0; line_no < static_cast<long long>(num_lines); line_no++) {
+        const auto src = frame + line_no*num_samples;
+        const auto dst = packets + line_no*num_samples*packet_size + packet_no;
+        for (size_t i = 0; i < num_samples; i++) {
+            dst[i*packet_size] = src[i];
+        }
+    }
+}
+
+}   // end namespace
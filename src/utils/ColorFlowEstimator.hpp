@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <vector>
+#include <complex>
+#include <string>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// Clutter filters applied to each packet of IQ samples before estimation.
+enum class ClutterFilter {
+    NONE,           // no filtering
+    MEAN,           // subtract the packet mean
+    POLYNOMIAL      // subtract the least squares fit of a polynomial
+};
+
+// Parse "none", "mean" or "polynomial".
+ClutterFilter DLL_PUBLIC parse_clutter_filter(const std::string& name);
+
+// Autocorrelation (Kasai) color flow estimator. The IQ data of a packet
+// is stored contiguously as [line][sample][packet], and the estimates as
+// [line][sample], which is the beam space layout of the Cartesianator.
+class DLL_PUBLIC ColorFlowEstimator {
+public:
+    // polynomial_order is only used by the polynomial regression filter.
+    ColorFlowEstimator(size_t packet_size, ClutterFilter filter = ClutterFilter::MEAN, int polynomial_order = 1);
+
+    // Estimate the power R0 and the phase of the lag one autocorrelation R1
+    // in [-pi, pi] for every sample. The lines are processed in parallel.
+    void process(const std::complex<float>* packets, size_t num_lines, size_t num_samples,
+                 float* r0, float* r1_phase) const;
+
+    size_t get_packet_size() const {
+        return m_packet_size;
+    }
+
+private:
+    size_t                  m_packet_size;
+    // Orthonormal basis of the clutter subspace, one packet_size long vector
+    // per basis function.
+    std::vector<float>      m_clutter_basis;
+    size_t                  m_num_basis;
+};
+
+// Copy frame packet_no of a packet with num_lines lines of num_samples IQ
+// samples (sample index most rapidly varying) into a [line][sample][packet]
+// buffer.
+void DLL_PUBLIC interleave_packet_frame(const std::complex<float>* frame, size_t num_lines, size_t num_samples,
+                                        size_t packet_no, size_t packet_size, std::complex<float>* packets);
+
+}   // end namespace
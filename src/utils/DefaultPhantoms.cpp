@@ -4,10 +4,11 @@
 #include <utility>
 #include <iostream>
 #include <cassert>
+#include <cmath>
 #include "DefaultPhantoms.hpp"
 #include "CSVReader.hpp"
 #include "../core/bspline.hpp"
-#include "rotation3d.hpp"
+#include "../core/philox.hpp"
 
 namespace default_phantoms {
 
@@ -32,32 +33,67 @@ private:
     std::vector<T> m_ys;
 };
 
-void LeftVentricle3dPhantomFactory::create_random_scatterers_in_box(size_t num_scatterers, float thickness) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> x_distr(m_box_region.x_min - thickness, m_box_region.x_max + thickness);
-    std::uniform_real_distribution<float> y_distr(m_box_region.y_min - thickness, m_box_region.y_max + thickness);
-    std::uniform_real_distribution<float> z_distr(m_box_region.z_min - thickness, m_box_region.z_max + thickness);
-    m_points.reserve(num_scatterers);
-    for (size_t i = 0; i < num_scatterers; i++) {
-        m_points.emplace_back(ellipsoid::Point3D(x_distr(gen), y_distr(gen), z_distr(gen)));
+void LeftVentricle3dPhantomFactory::create_random_scatterers_in_box(size_t num_scatterers, float thickness,
+                                                                   float max_amplitude, uint64_t seed) {
+    const size_t BLOCK_SIZE = 1 << 16;
+    const float INV_2_24 = 1.0f/16777216.0f;
+    const float x_min = m_box_region.x_min - thickness;
+    const float y_min = m_box_region.y_min - thickness;
+    const float z_min = m_box_region.z_min - thickness;
+    const float x_range = m_box_region.x_max - m_box_region.x_min + 2.0f*thickness;
+    const float y_range = m_box_region.y_max - m_box_region.y_min + 2.0f*thickness;
+    const float z_range = m_box_region.z_max - m_box_region.z_min + 2.0f*thickness;
+    const philox::Key key{{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}};
+
+    // the scatterers kept in each block, concatenated in block order
+    const auto num_blocks = static_cast<int>((num_scatterers + BLOCK_SIZE - 1)/BLOCK_SIZE);
+    std::vector<std::vector<float>> block_points(num_blocks);
+    #pragma omp parallel
+    {
+        std::vector<float> xs(BLOCK_SIZE), ys(BLOCK_SIZE), zs(BLOCK_SIZE), as(BLOCK_SIZE);
+        std::vector<unsigned char> inside(BLOCK_SIZE);
+        #pragma omp for schedule(dynamic)
+        for (int block_no = 0; block_no < num_blocks; block_no++) {
+            const size_t first = static_cast<size_t>(block_no)*BLOCK_SIZE;
+            const size_t count = std::min(BLOCK_SIZE, num_scatterers - first);
+            for (size_t j = 0; j < count; j++) {
+                const auto i = first + j;
+                const auto bits = philox::philox4x32(philox::Counter{{static_cast<uint32_t>(i), static_cast<uint32_t>(uint64_t(i) >> 32), 0u, 0u}}, key);
+                xs[j] = x_min + x_range*(static_cast<float>(bits[0] >> 8) + 0.5f)*INV_2_24;
+                ys[j] = y_min + y_range*(static_cast<float>(bits[1] >> 8) + 0.5f)*INV_2_24;
+                zs[j] = z_min + z_range*(static_cast<float>(bits[2] >> 8) + 0.5f)*INV_2_24;
+                as[j] = max_amplitude*(2.0f*(static_cast<float>(bits[3] >> 8) + 0.5f)*INV_2_24 - 1.0f);
+            }
+            m_mathematical_model.are_points_inside(xs.data(), ys.data(), zs.data(), count, inside.data());
+            auto& points = block_points[block_no];
+            for (size_t j = 0; j < count; j++) {
+                if (inside[j]) {
+                    points.insert(points.end(), {xs[j], ys[j], zs[j], as[j]});
+                }
+            }
+        }
     }
-}
 
-void LeftVentricle3dPhantomFactory::create_random_amplitudes(size_t num, float low, float high) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> a_distr(low, high);
-    m_amplitudes.reserve(num);
-    for (size_t i = 0; i < num; i++) {
-        m_amplitudes.push_back(a_distr(gen));
+    std::vector<size_t> offsets(num_blocks + 1, 0);
+    for (int block_no = 0; block_no < num_blocks; block_no++) {
+        offsets[block_no + 1] = offsets[block_no] + block_points[block_no].size()/4;
+    }
+    const auto num_inside = offsets[num_blocks];
+    m_xs.resize(num_inside);
+    m_ys.resize(num_inside);
+    m_zs.resize(num_inside);
+    m_amplitudes.resize(num_inside);
+    #pragma omp parallel for
+    for (int block_no = 0; block_no < num_blocks; block_no++) {
+        const auto& points = block_points[block_no];
+        for (size_t j = 0; j < points.size()/4; j++) {
+            const auto i = offsets[block_no] + j;
+            m_xs[i]         = points[4*j];
+            m_ys[i]         = points[4*j + 1];
+            m_zs[i]         = points[4*j + 2];
+            m_amplitudes[i] = points[4*j + 3];
+        }
     }
-}
-
-void LeftVentricle3dPhantomFactory::remove_scatterers_outside() {
-    m_points.erase(std::remove_if(std::begin(m_points), std::end(m_points), [&](const ellipsoid::Point3D& p) {
-        return !m_mathematical_model.is_point_inside(p);
-    }), std::end(m_points));
 }
 
 void LeftVentricle3dPhantomFactory::load_csv_scale_signal(std::istream& csv_stream) {
@@ -86,14 +122,11 @@ LeftVentricle3dPhantomFactory::LeftVentricle3dPhantomFactory(const LeftVentricle
     }
     load_csv_scale_signal(csv_stream);
 
-    create_random_scatterers_in_box(par.num_scatterers, par.thickness);
-    remove_scatterers_outside();
-    const auto num_scatterers_left = m_points.size();
-    m_log_callback("After filtering " + std::to_string(num_scatterers_left) + " scatterers remain");
     if (par.lv_max_amplitude < 0.0) {
         throw std::runtime_error("LV max amplitude must be positive");
     }
-    create_random_amplitudes(num_scatterers_left, -par.lv_max_amplitude, par.lv_max_amplitude);
+    create_random_scatterers_in_box(par.num_scatterers, par.thickness, par.lv_max_amplitude, par.seed);
+    m_log_callback("After filtering " + std::to_string(m_xs.size()) + " scatterers remain");
     create_splines(par);
 }
 
@@ -129,30 +162,36 @@ void LeftVentricle3dPhantomFactory::create_splines(const LeftVentriclePhantomPar
 
     const auto num_splines = m_amplitudes.size();
     m_spline_scatterers->spline_degree = par.spline_degree;
-    m_spline_scatterers->amplitudes = m_amplitudes;
     m_spline_scatterers->knot_vector = knots;
-    m_spline_scatterers->control_points.reserve(num_splines);
+    m_spline_scatterers->resize(num_splines, par.num_cs);
+    m_spline_scatterers->amplitudes = m_amplitudes;
 
-    for (size_t spline_no = 0; spline_no < num_splines; spline_no++) {
+    // the contraction at the knot averages, shared by all splines
+    std::vector<float> scales(par.num_cs);
+    for (int cs_i = 0; cs_i < par.num_cs; cs_i++) {
+        scales[cs_i] = m_scale_function(knot_avgs[cs_i]);
+    }
+    auto& control_xs = m_spline_scatterers->control_xs;
+    auto& control_ys = m_spline_scatterers->control_ys;
+    auto& control_zs = m_spline_scatterers->control_zs;
+    const auto num_spline_rows = static_cast<long long>(num_splines);
+    #pragma omp parallel for
+    for (long long spline_no = 0; spline_no < num_spline_rows; spline_no++) {
         //value in[0, 1] for the normalized z coordinate of each scatterer will be used to control rotation amplitude.
-        const auto zs_fractional = (m_points[spline_no].z - m_box_region.z_min) / (m_box_region.z_max - m_box_region.z_min);
-        std::vector<bcsim::vector3> control_points;
-        control_points.reserve(par.num_cs);
-        for (size_t cs_i = 0; cs_i < par.num_cs; cs_i++) {
-            const auto t_star = knot_avgs[cs_i];
-            const auto cur_scale = m_scale_function(t_star);
+        const auto zs_fractional = (m_zs[spline_no] - m_box_region.z_min) / (m_box_region.z_max - m_box_region.z_min);
+        for (int cs_i = 0; cs_i < par.num_cs; cs_i++) {
+            // scaling followed by rotation about the z-axis
+            const auto cur_scale = scales[cs_i];
             const auto cur_angle = zs_fractional * cur_scale*par.rotation_scale;
-            const auto rot_matrix = rotation_matrix_z<float>(cur_angle);
-
-            boost::numeric::ublas::vector<float> p(3);
-            p(0) = cur_scale*m_points[spline_no].x;
-            p(1) = cur_scale*m_points[spline_no].y;
-            p(2) = cur_scale*m_points[spline_no].z;
-            
-            const auto p_rotated = boost::numeric::ublas::prod(rot_matrix, p);
-            control_points.emplace_back(bcsim::vector3(p_rotated(0), p_rotated(1), p_rotated(2)));
+            const auto cos_angle = std::cos(cur_angle);
+            const auto sin_angle = std::sin(cur_angle);
+            const auto x = cur_scale*m_xs[spline_no];
+            const auto y = cur_scale*m_ys[spline_no];
+            const auto index = cs_i*num_splines + spline_no;
+            control_xs[index] = cos_angle*x - sin_angle*y;
+            control_ys[index] = sin_angle*x + cos_angle*y;
+            control_zs[index] = cur_scale*m_zs[spline_no];
         }
-        m_spline_scatterers->control_points.emplace_back(control_points);
     }
 }
 
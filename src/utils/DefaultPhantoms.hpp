@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <random>
@@ -20,7 +21,8 @@ struct LeftVentriclePhantomParameters {
           spline_degree(2),
           num_cs(10),
           lv_max_amplitude(1.0f),
-          rotation_scale(3.0f)
+          rotation_scale(3.0f),
+          seed(0)
     {
     }
 
@@ -34,11 +36,14 @@ struct LeftVentriclePhantomParameters {
     int num_cs;                                         // Number of control points to use for each spline scatterer
     float lv_max_amplitude;                             // Max amplitude for the spline scatterers
     float rotation_scale;                               // "Gain" for rotation. Will use same signal as contraction - higher value gives more rotation.
+    uint64_t seed;                                      // The phantom is a pure function of the parameters and the seed
 };
 
 // Create a LV spline phantom model by randomly distributing point-scatterers in a box and then removing
 // those who are not inside a 3D capped ellipsoid. The remaining points are then scaled and rotated
-// to generate control points for splines.
+// to generate control points for splines. The scatterers are generated in
+// parallel in blocks, where candidate i only depends on i and the seed, so the
+// phantom does not depend on the number of threads.
 class DLL_PUBLIC LeftVentricle3dPhantomFactory {
 public:
     typedef std::function<void(const std::string&)> LogCallback;
@@ -52,14 +57,10 @@ private:
     // creates an interpolated function from samples loaded from CSV
     void load_csv_scale_signal(std::istream&);
 
-    // fill a rectangular region of space with uniformly random scatterers
-    void create_random_scatterers_in_box(size_t num_scatterers, float thickness);
-
-    // create uniformly random amplitudes
-    void create_random_amplitudes(size_t num, float low, float high);
-
-    // use the mathematical shape model to filter out unwanted scatterers
-    void remove_scatterers_outside();
+    // fill a rectangular region of space with uniformly random scatterers with
+    // amplitudes uniform in [-max_amplitude, max_amplitude], and use the
+    // mathematical shape model to filter out unwanted scatterers
+    void create_random_scatterers_in_box(size_t num_scatterers, float thickness, float max_amplitude, uint64_t seed);
 
     // create the scatterer splines
     void create_splines(const LeftVentriclePhantomParameters& params);
@@ -67,7 +68,10 @@ private:
 private:
     ellipsoid::Region3D                 m_box_region;
     ellipsoid::ThickCappedZEllipsoid    m_mathematical_model;
-    std::vector<ellipsoid::Point3D>     m_points;
+    // the scatterers inside the model
+    std::vector<float>                  m_xs;
+    std::vector<float>                  m_ys;
+    std::vector<float>                  m_zs;
     std::vector<float>                  m_amplitudes;
     std::function<float(float)>         m_scale_function;
     LogCallback                         m_log_callback;
@@ -56,4 +56,11 @@ bool ThickCappedZEllipsoid::is_point_inside(const Point3D& p) const {
     return is_inside_outer && is_outside_inner;
 }
 
+void ThickCappedZEllipsoid::are_points_inside(const float* xs, const float* ys, const float* zs, size_t num_points,
+                                              unsigned char* inside) const {
+    for (size_t i = 0; i < num_points; i++) {
+        inside[i] = m_outer.contains(xs[i], ys[i], zs[i]) & !m_inner.contains(xs[i], ys[i], zs[i]);
+    }
+}
+
 }   // end namespace
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 
 namespace ellipsoid {
 
@@ -27,6 +28,14 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    // Inline test in single precision for the loops over many points.
+    bool contains(float x, float y, float z) const {
+        const auto dx = (x - m_center.x)/m_coeffs.a;
+        const auto dy = (y - m_center.y)/m_coeffs.b;
+        const auto dz = (z - m_center.z)/m_coeffs.c;
+        return (dx*dx + dy*dy + dz*dz) <= 1.0f;
+    }
+
 private:
     void compute_centers(const Region3D& region);
 
@@ -43,6 +52,10 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    bool contains(float x, float y, float z) const {
+        return m_ellipsoid.contains(x, y, z) & (z <= m_z_cap);
+    }
+
 private:
     Ellipsoid   m_ellipsoid;
     float       m_z_cap;
@@ -56,6 +69,12 @@ public:
 
     bool is_point_inside(const Point3D& p) const;
 
+    // Test num_points points given as arrays of coordinates, setting
+    // inside[i] to 1 if point i is inside and to 0 otherwise. The loop has
+    // no branches, so that it can be vectorized.
+    void are_points_inside(const float* xs, const float* ys, const float* zs, size_t num_points,
+                           unsigned char* inside) const;
+
 private:
     CappedZEllipsoid    m_inner;
     CappedZEllipsoid    m_outer;
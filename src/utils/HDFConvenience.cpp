@@ -32,77 +32,75 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdexcept>
 #include <boost/multi_array.hpp>
 #include <algorithm>
+#include <utility>
 #include "HDFConvenience.hpp"
 #include "../core/ScanSequence.hpp"
 #include "../core/BeamProfile.hpp"
 #include "../core/BCSimConfig.hpp"
 #include "../core/vector3.hpp"
+#include "../core/bspline.hpp"
 #include "SimpleHDF.hpp"
+#include "ParallelHdfReader.hpp"
 #include "../core/LibBCSim.hpp"
 
 namespace bcsim {
 
 FixedScatterers::s_ptr loadFixedScatterersFromHdf(const std::string& h5_file) {
-    SimpleHDF::SimpleHDF5Reader loader(h5_file);
-    auto res = new FixedScatterers;
-    try {
-        auto data = loader.readMultiArray<float, 2>("data");
-        auto data_shape = data.shape();
-        size_t num_scatterers = data_shape[0];
-        size_t num_components = data_shape[1];
-        if (num_components != 4) {
-            throw std::runtime_error("Second dimension must have length four");
-        }
-        res->scatterers.resize(num_scatterers);
-        for (size_t i = 0; i < num_scatterers; i++) {
-            PointScatterer scatterer;
-            scatterer.pos       = vector3(data[i][0], data[i][1], data[i][2]);
-            scatterer.amplitude = data[i][3];
-            res->scatterers[i]  = scatterer;
-        }
-    } catch (...) {
-        throw std::runtime_error("failed to load fixed scatterers");
-    }
-    return FixedScatterers::s_ptr(res);
+    return loadFixedScatterersFromHdfParallel(h5_file);
 }
 
 SplineScatterers::s_ptr loadSplineScatterersFromHdf(const std::string& h5_file) {
+    return loadSplineScatterersFromHdfParallel(h5_file);
+}
+
+SplineScatterers::s_ptr loadSplineScatterersFromHdf(const std::string& h5_file, float start_time, float end_time) {
     SimpleHDF::SimpleHDF5Reader loader(h5_file);
-    auto res = new SplineScatterers;
+    auto res = std::make_shared<SplineScatterers>();
 
     try {
-        auto control_points = loader.readMultiArray<float, 3>("control_points");
-        auto amplitudes     = loader.readMultiArray<float, 1>("amplitudes");
+        auto amplitudes     = loader.readStdVector<float>("amplitudes");
         int spline_degree   = loader.readScalar<int>("spline_degree");
         auto knot_vector    = loader.readStdVector<float>("knot_vector");
 
-        res->spline_degree = spline_degree;
-        res->knot_vector = knot_vector;
-
-        // Copy control points
-        auto shape = control_points.shape();
-        size_t num_scatterers = shape[0];
-        size_t num_cs = shape[1];
-        size_t num_comp = shape[2];
-        if (num_comp != 3) {
-            throw std::runtime_error("SplineScatterer illegal number of components (should be 3)");
+        const auto shape = loader.getDimensions("control_points");
+        if ((shape.size() != 3) || (shape[2] != 3)) {
+            throw std::runtime_error("SplineScatterer illegal control point dimensions");
+        }
+        const size_t num_scatterers = shape[0];
+        const int num_cs = shape[1];
+        if (amplitudes.size() != num_scatterers) {
+            throw std::runtime_error("SplineScatterer number of amplitudes does not match control points");
         }
-        res->control_points.resize(num_scatterers);
-        res->amplitudes.resize(num_scatterers);
+        const auto cs_range = bspline_storve::control_point_range(knot_vector, spline_degree, num_cs, start_time, end_time);
+        const size_t num_window_cs = cs_range.second - cs_range.first + 1;
+
+        // read the hyperslab of the needed control points only
+        const auto dataset = loader.openDataSet("control_points");
+        auto file_space = dataset.getSpace();
+        const hsize_t start[] = {0, static_cast<hsize_t>(cs_range.first), 0};
+        const hsize_t count[] = {num_scatterers, num_window_cs, 3};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+        std::vector<float> control_points(num_scatterers*num_window_cs*3);
+        dataset.read(control_points.data(), H5::PredType::NATIVE_FLOAT, H5::DataSpace(3, count), file_space);
+
+        res->spline_degree = spline_degree;
+        res->knot_vector.assign(knot_vector.begin() + cs_range.first,
+                                knot_vector.begin() + cs_range.second + spline_degree + 2);
+        // The file keeps the scatterer-major [scatterer, cs, 3] layout of the
+        // old SplineScatterers::control_points; it is transposed into the
+        // control-point-major arrays here.
+        res->resize(num_scatterers, num_window_cs);
         for (size_t scatterer_no = 0; scatterer_no < num_scatterers; scatterer_no++) {
             res->amplitudes[scatterer_no] = amplitudes[scatterer_no];
-
-            for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
-                const vector3 pt(control_points[scatterer_no][cs_no][0],
-                                 control_points[scatterer_no][cs_no][1],
-                                 control_points[scatterer_no][cs_no][2]);
-                res->control_points[scatterer_no].push_back(pt);
+            for (size_t cs_no = 0; cs_no < num_window_cs; cs_no++) {
+                const auto pt = &control_points[(scatterer_no*num_window_cs + cs_no)*3];
+                res->set_control_point(scatterer_no, cs_no, vector3(pt[0], pt[1], pt[2]));
             }
         }
     } catch (...) {
         throw std::runtime_error("failed to load spline scatterers");
     }
-    return SplineScatterers::s_ptr(res);
+    return res;
 }
 
 ScanSequence::u_ptr loadScanSequenceFromHdf(const std::string& h5_file) {
@@ -139,60 +137,109 @@ ExcitationSignal loadExcitationFromHdf(const std::string& h5_file) {
     return excitation;
 }
 
-IBeamProfile::s_ptr loadBeamProfileFromHdf(const std::string& h5_file) {
-    SimpleHDF::SimpleHDF5Reader reader(h5_file);
-    auto lut_samples = reader.readMultiArray<float, 3>("beam_profile");
-    auto rad_extent  = reader.readStdVector<float>("rad_extent");
-    auto lat_extent  = reader.readStdVector<float>("lat_extent");
-    auto ele_extent  = reader.readStdVector<float>("ele_extent");
-    auto lut_samples_shape = lut_samples.shape();
+namespace {
+
+// Samples and extents of a LUT as stored in the file, before normalization.
+struct LUTData {
+    int num_rad_samples;
+    int num_lat_samples;
+    int num_ele_samples;
+    Interval rad_range;
+    Interval lat_range;
+    Interval ele_range;
+    std::vector<float> samples;
+};
+
+// Read the data sets beam_profile, rad_extent, lat_extent and ele_extent,
+// each with the given prefix.
+LUTData readLUTData(SimpleHDF::SimpleHDF5Reader& reader, const std::string& prefix) {
+    auto rad_extent  = reader.readStdVector<float>(prefix + "rad_extent");
+    auto lat_extent  = reader.readStdVector<float>(prefix + "lat_extent");
+    auto ele_extent  = reader.readStdVector<float>(prefix + "ele_extent");
+    const auto lut_samples_shape = reader.getDimensions(prefix + "beam_profile");
     
     // TODO: Consider allowing 2D samples array with the interpretation of being axial symmetric
-    if (lut_samples.num_dimensions() != 3) {
-        throw std::runtime_error("beam_profile data must be a 3D array");
+    if (lut_samples_shape.size() != 3) {
+        throw std::runtime_error(prefix + "beam_profile data must be a 3D array");
     }
     
     // parse rad, lat, and elev. extents
     if (rad_extent.size() != 2) {
-        throw std::runtime_error("rad_extent must contain two elements: [min, max]");
+        throw std::runtime_error(prefix + "rad_extent must contain two elements: [min, max]");
     }
-    const auto r_min = rad_extent[0];
-    const auto r_max = rad_extent[1];
     if (lat_extent.size() != 2) {
-        throw std::runtime_error("lat_extent must contain two elements: [min, max]");
+        throw std::runtime_error(prefix + "lat_extent must contain two elements: [min, max]");
     }
-    const auto l_min = lat_extent[0];
-    const auto l_max = lat_extent[1];
     if (ele_extent.size() != 2) {
-        throw std::runtime_error("ele_extent must contain two elements: [min, max]");
+        throw std::runtime_error(prefix + "ele_extent must contain two elements: [min, max]");
     }
-    const auto e_min = ele_extent[0];
-    const auto e_max = ele_extent[1];
 
     // corresponding number of samples
-    const auto num_rad_samples = lut_samples_shape[0];
-    const auto num_lat_samples = lut_samples_shape[1];
-    const auto num_ele_samples = lut_samples_shape[2];
-    
-    auto lut_profile = new LUTBeamProfile(num_rad_samples, num_lat_samples, num_ele_samples,
-                                          Interval(r_min, r_max), Interval(l_min, l_max), Interval(e_min, e_max));
+    LUTData data{static_cast<int>(lut_samples_shape[0]),
+                 static_cast<int>(lut_samples_shape[1]),
+                 static_cast<int>(lut_samples_shape[2]),
+                 Interval(rad_extent[0], rad_extent[1]),
+                 Interval(lat_extent[0], lat_extent[1]),
+                 Interval(ele_extent[0], ele_extent[1]),
+                 {}};
+
+    // dim0: radial index, dim1: lateral index, dim2: elevational index,
+    // which is the layout of LUTBeamProfile, so the dataset is read into
+    // the buffer that is handed over to it.
+    data.samples.resize(static_cast<size_t>(data.num_rad_samples)*data.num_lat_samples*data.num_ele_samples);
+    try {
+        reader.openDataSet(prefix + "beam_profile").read(data.samples.data(), H5::PredType::NATIVE_FLOAT);
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to read " + prefix + "beam_profile: " + e.getDetailMsg());
+    }
+    return data;
+}
+
+LUTBeamProfile makeLUTBeamProfile(LUTData&& data) {
+    return LUTBeamProfile(data.num_rad_samples, data.num_lat_samples, data.num_ele_samples,
+                          data.rad_range, data.lat_range, data.ele_range, std::move(data.samples));
+}
 
+}   // end anonymous namespace
 
-    // Normalize so that maximum is one
-    const auto max_val = *std::max_element(lut_samples.origin(), lut_samples.origin()+lut_samples.num_elements());
+IBeamProfile::s_ptr loadBeamProfileFromHdf(const std::string& h5_file) {
+    SimpleHDF::SimpleHDF5Reader reader(h5_file);
 
-    // Copy data. TODO: require matching hdf5 layout so that copying can be eliminated
-    // dim0: radial index
-    // dim1: lateral index
-    // dim2: elevational index
-    for (size_t rad_idx = 0; rad_idx < num_rad_samples; rad_idx++) {
-        for (size_t lat_idx = 0; lat_idx < num_lat_samples; lat_idx++) {
-            for (int ele_idx = 0; ele_idx < num_ele_samples; ele_idx++) {
-                lut_profile->setDiscreteSample(rad_idx, lat_idx, ele_idx, lut_samples[rad_idx][lat_idx][ele_idx]/max_val);       
-            }
+    // A multi-resolution profile has the scalar num_zones and the data sets
+    // of zone i prefixed with "zone<i>_", in the order of increasing depth.
+    std::vector<LUTData> tables;
+    const bool multi_resolution = reader.hasDataSet("num_zones");
+    if (multi_resolution) {
+        const auto num_zones = reader.readScalar<int>("num_zones");
+        if (num_zones < 1) {
+            throw std::runtime_error("num_zones must be positive");
         }
+        for (int zone_no = 0; zone_no < num_zones; zone_no++) {
+            tables.push_back(readLUTData(reader, "zone" + std::to_string(zone_no) + "_"));
+        }
+    } else {
+        tables.push_back(readLUTData(reader, ""));
+    }
+
+    // Normalize so that maximum is one (over all zones)
+    float max_val = 0.0f;
+    for (const auto& table : tables) {
+        max_val = std::max(max_val, *std::max_element(table.samples.begin(), table.samples.end()));
+    }
+    for (auto& table : tables) {
+        for (auto& sample : table.samples) {
+            sample /= max_val;
+        }
+    }
+
+    if (!multi_resolution) {
+        return std::make_shared<LUTBeamProfile>(makeLUTBeamProfile(std::move(tables[0])));
+    }
+    std::vector<LUTBeamProfile> zones;
+    for (auto& table : tables) {
+        zones.push_back(makeLUTBeamProfile(std::move(table)));
     }
-    return IBeamProfile::s_ptr(lut_profile);
+    return std::make_shared<MultiResolutionLUTBeamProfile>(std::move(zones));
 }
 
 }   // namespace
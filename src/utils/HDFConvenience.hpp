@@ -39,19 +39,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace bcsim {
 
-// Specific loader for fixed scatterers
+// Specific loader for fixed scatterers, read in parallel (see ParallelHdfReader.hpp)
 FixedScatterers::s_ptr DLL_PUBLIC loadFixedScatterersFromHdf(const std::string& h5_file);
 
-// Specific loader for spline scatterers
+// Specific loader for spline scatterers, read in parallel (see ParallelHdfReader.hpp)
 SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromHdf(const std::string& h5_file);
 
+// Load only the control points of spline scatterers that are needed in the
+// time interval [start_time, end_time], with the knot vector trimmed to match.
+SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromHdf(const std::string& h5_file, float start_time, float end_time);
+
 // Load a scan sequence.
 ScanSequence::u_ptr DLL_PUBLIC loadScanSequenceFromHdf(const std::string& h5_file);
 
 // Load an excitation signal.
 ExcitationSignal DLL_PUBLIC loadExcitationFromHdf(const std::string& h5_file);
 
-// Load a LUT beam profile.
+// Load a LUT beam profile. If the file has the scalar num_zones, it is a
+// MultiResolutionLUTBeamProfile with the data sets of zone i prefixed with
+// "zone<i>_", otherwise a LUTBeamProfile.
 IBeamProfile::s_ptr DLL_PUBLIC loadBeamProfileFromHdf(const std::string& h5_file);
 
 }   // namespace
@@ -0,0 +1,304 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include "HdfIqRecorder.hpp"
+#include "SimpleHDF.hpp"    // for H5Cpp.h
+#include "../core/iq_format.hpp"
+
+namespace bcsim {
+
+struct HdfIqRecorder::HdfFile {
+    H5::H5File      file;
+    H5::CompType    sample_type;
+    H5::DataSet     iq_dataset;
+    H5::DataSet     times_dataset;
+    H5::DataSet     scales_dataset;
+};
+
+namespace {
+
+// IEEE 754 binary16 in the byte order of IEEE_F32LE.
+H5::FloatType half_float_type() {
+    H5::FloatType type(H5::PredType::IEEE_F32LE);
+    type.setFields(15, 10, 5, 0, 10);
+    type.setEbias(15);
+    type.setSize(2);
+    return type;
+}
+
+// An unlimited one-dimensional float dataset.
+H5::DataSet create_frame_values(H5::H5File& file, const std::string& name) {
+    const hsize_t dims[]     = {0};
+    const hsize_t max_dims[] = {H5S_UNLIMITED};
+    const hsize_t chunk[]    = {1024};
+    H5::DSetCreatPropList props;
+    props.setChunk(1, chunk);
+    return file.createDataSet(name, H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, dims, max_dims), props);
+}
+
+void write_frame_value(H5::DataSet& dataset, hsize_t frame_no, float value) {
+    const hsize_t size[] = {frame_no + 1};
+    dataset.extend(size);
+    auto space = dataset.getSpace();
+    const hsize_t start[] = {frame_no};
+    const hsize_t count[] = {1};
+    space.selectHyperslab(H5S_SELECT_SET, count, start);
+    dataset.write(&value, H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, count), space);
+}
+
+}   // namespace
+
+HdfIqRecorder::HdfIqRecorder(const std::string& h5_file, size_t num_lines, size_t num_samples,
+                             int compression_level, size_t max_queued_frames, const IqOutputFormat& format)
+    : m_num_lines(num_lines),
+      m_num_samples(num_samples),
+      m_max_queued_frames(std::max<size_t>(max_queued_frames, 1)),
+      m_format(format),
+      m_sample_bytes(iq_sample_bytes(format.sample_type)),
+      m_num_frames(0),
+      m_closing(false)
+{
+    if ((num_lines == 0) || (num_samples == 0)) {
+        throw std::runtime_error("IQ frames must have lines and samples");
+    }
+    if ((compression_level < 0) || (compression_level > 9)) {
+        throw std::runtime_error("compression level must be in [0, 9]");
+    }
+
+    m_file = std::unique_ptr<HdfFile>(new HdfFile);
+    try {
+        m_file->file = H5::H5File(h5_file, H5F_ACC_TRUNC);
+
+        // same layout as the real and imaginary part of the sample type
+        m_file->sample_type = H5::CompType(m_sample_bytes);
+        switch (format.sample_type) {
+        case IqOutputFormat::SampleType::COMPLEX_FLOAT16:
+            m_file->sample_type.insertMember("r", 0,                  half_float_type());
+            m_file->sample_type.insertMember("i", m_sample_bytes/2,   half_float_type());
+            break;
+        case IqOutputFormat::SampleType::COMPLEX_INT16:
+            m_file->sample_type.insertMember("r", 0,                  H5::PredType::NATIVE_INT16);
+            m_file->sample_type.insertMember("i", m_sample_bytes/2,   H5::PredType::NATIVE_INT16);
+            break;
+        default:
+            m_file->sample_type.insertMember("r", 0,                  H5::PredType::NATIVE_FLOAT);
+            m_file->sample_type.insertMember("i", m_sample_bytes/2,   H5::PredType::NATIVE_FLOAT);
+        }
+
+        const hsize_t iq_dims[]     = {0, num_lines, num_samples};
+        const hsize_t iq_max_dims[] = {H5S_UNLIMITED, num_lines, num_samples};
+        const hsize_t iq_chunk[]    = {1, num_lines, num_samples};
+        H5::DSetCreatPropList iq_props;
+        iq_props.setChunk(3, iq_chunk);
+        if (compression_level > 0) {
+            iq_props.setDeflate(compression_level);
+        }
+        m_file->iq_dataset = m_file->file.createDataSet("iq", m_file->sample_type, H5::DataSpace(3, iq_dims, iq_max_dims), iq_props);
+
+        m_file->times_dataset = create_frame_values(m_file->file, "frame_times");
+        if (format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16) {
+            m_file->scales_dataset = create_frame_values(m_file->file, "iq_scales");
+        }
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to create IQ file " + h5_file + ": " + e.getDetailMsg());
+    }
+
+    m_writer = std::thread(&HdfIqRecorder::writer_loop, this);
+}
+
+HdfIqRecorder::~HdfIqRecorder() {
+    try {
+        close();
+    } catch (...) {
+        // reported by close() only
+    }
+}
+
+std::unique_ptr<HdfIqRecorder::Frame> HdfIqRecorder::get_free_frame() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() { return (m_queued_frames.size() < m_max_queued_frames) || m_error || m_closing; });
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    if (m_closing) {
+        throw std::runtime_error("IQ recorder is closed");
+    }
+    if (!m_free_frames.empty()) {
+        auto frame = std::move(m_free_frames.back());
+        m_free_frames.pop_back();
+        return frame;
+    }
+    lock.unlock();
+    std::unique_ptr<Frame> frame(new Frame);
+    frame->samples.resize(m_num_lines*m_num_samples*m_sample_bytes);
+    return frame;
+}
+
+void HdfIqRecorder::queue_frame(std::unique_ptr<Frame> frame) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued_frames.push_back(std::move(frame));
+        m_num_frames++;
+    }
+    m_cond.notify_all();
+}
+
+void HdfIqRecorder::convert_line(const std::complex<float>* samples, size_t line_no, Frame& frame) const {
+    convert_iq_samples(samples, m_num_samples, m_format.sample_type, frame.scale,
+                       frame.samples.data() + line_no*m_num_samples*m_sample_bytes);
+}
+
+template <typename LineFn>
+float HdfIqRecorder::frame_scale(LineFn line) const {
+    if (m_format.sample_type != IqOutputFormat::SampleType::COMPLEX_INT16) {
+        return 1.0f;
+    }
+    if (m_format.int16_scale != 0.0f) {
+        return m_format.int16_scale;
+    }
+    float max_abs_component = 0.0f;
+    for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+        max_abs_component = std::max(max_abs_component, max_abs_iq_component(line(line_no), m_num_samples));
+    }
+    return int16_frame_scale(max_abs_component);
+}
+
+void HdfIqRecorder::append(const std::complex<float>* iq_buffer, size_t line_stride, float timestamp) {
+    if (line_stride < m_num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    auto frame = get_free_frame();
+    frame->scale = frame_scale([&](size_t line_no) { return iq_buffer + line_no*line_stride; });
+    for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+        convert_line(iq_buffer + line_no*line_stride, line_no, *frame);
+    }
+    frame->timestamp = timestamp;
+    queue_frame(std::move(frame));
+}
+
+void HdfIqRecorder::append_formatted(const void* iq_buffer, size_t line_stride, float timestamp, float scale) {
+    if (line_stride < m_num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    auto frame = get_free_frame();
+    const auto line_bytes = m_num_samples*m_sample_bytes;
+    for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+        const auto src = static_cast<const char*>(iq_buffer) + line_no*line_stride*m_sample_bytes;
+        std::copy(src, src + line_bytes, frame->samples.begin() + line_no*line_bytes);
+    }
+    frame->timestamp = timestamp;
+    frame->scale = scale;
+    queue_frame(std::move(frame));
+}
+
+void HdfIqRecorder::append(const std::vector<std::vector<std::complex<float>>>& iq_lines, float timestamp) {
+    if (iq_lines.size() != m_num_lines) {
+        throw std::runtime_error("wrong number of IQ lines in frame");
+    }
+    for (const auto& line : iq_lines) {
+        if (line.size() != m_num_samples) {
+            throw std::runtime_error("wrong number of IQ samples in line");
+        }
+    }
+    auto frame = get_free_frame();
+    frame->scale = frame_scale([&](size_t line_no) { return iq_lines[line_no].data(); });
+    for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+        convert_line(iq_lines[line_no].data(), line_no, *frame);
+    }
+    frame->timestamp = timestamp;
+    queue_frame(std::move(frame));
+}
+
+void HdfIqRecorder::writer_loop() {
+    hsize_t num_written = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this]() { return m_closing || !m_queued_frames.empty(); });
+        if (m_queued_frames.empty()) {
+            break;
+        }
+        auto frame = std::move(m_queued_frames.front());
+        m_queued_frames.pop_front();
+        lock.unlock();
+        // room for the next frame in the queue
+        m_cond.notify_all();
+
+        try {
+            const hsize_t iq_size[] = {num_written + 1, m_num_lines, m_num_samples};
+            m_file->iq_dataset.extend(iq_size);
+            auto iq_space = m_file->iq_dataset.getSpace();
+            const hsize_t iq_start[] = {num_written, 0, 0};
+            const hsize_t iq_count[] = {1, m_num_lines, m_num_samples};
+            iq_space.selectHyperslab(H5S_SELECT_SET, iq_count, iq_start);
+            m_file->iq_dataset.write(frame->samples.data(), m_file->sample_type, H5::DataSpace(3, iq_count), iq_space);
+
+            write_frame_value(m_file->times_dataset, num_written, frame->timestamp);
+            if (m_format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16) {
+                write_frame_value(m_file->scales_dataset, num_written, frame->scale);
+            }
+            num_written++;
+        } catch (const H5::Exception& e) {
+            lock.lock();
+            m_error = std::make_exception_ptr(std::runtime_error("failed to write IQ frame: " + e.getDetailMsg()));
+            m_queued_frames.clear();
+            m_cond.notify_all();
+            return;
+        }
+
+        lock.lock();
+        m_free_frames.push_back(std::move(frame));
+    }
+}
+
+void HdfIqRecorder::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_cond.notify_all();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+    if (m_file) {
+        m_file.reset();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+size_t HdfIqRecorder::get_num_frames() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_frames;
+}
+
+}   // namespace
@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <complex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"   // for IqOutputFormat
+
+namespace bcsim {
+
+// Records IQ frames to a HDF5 file while they are produced. The frames are
+// queued in a bounded queue and appended by a background thread to the
+// chunked dataset "iq" of shape [frame][line][sample], with one frame per
+// chunk and optional deflate compression. The samples are stored as a
+// compound of the floats "r" and "i", which h5py reads as complex64. The
+// frame timestamps are appended to the dataset "frame_times".
+//
+// With a reduced-precision format, "r" and "i" are IEEE half floats (read as
+// float16) or int16, and frame i of int16 samples equals
+// iq[i]/iq_scales[i], where the scales are appended to "iq_scales".
+//
+// All HDF5 calls are made on the writer thread. Unless the HDF5 library is
+// built thread-safe, it must not be used by other threads during recording.
+class DLL_PUBLIC HdfIqRecorder {
+public:
+    // Creates or truncates h5_file. compression_level is the deflate level
+    // in [0, 9], with 0 for no compression. append() blocks while
+    // max_queued_frames frames wait to be written. The float frames are
+    // converted to the sample type of format when appended.
+    HdfIqRecorder(const std::string& h5_file, size_t num_lines, size_t num_samples,
+                  int compression_level = 0, size_t max_queued_frames = 8,
+                  const IqOutputFormat& format = IqOutputFormat());
+
+    // Writes the queued frames and closes the file. Errors are ignored,
+    // call close() to get them.
+    ~HdfIqRecorder();
+
+    // Queue a frame with the layout of IAlgorithm::simulate_lines().
+    void append(const std::complex<float>* iq_buffer, size_t line_stride, float timestamp);
+
+    // Queue a frame of num_lines lines of num_samples samples.
+    void append(const std::vector<std::vector<std::complex<float>>>& iq_lines, float timestamp);
+
+    // Queue a frame already in the sample type of the recorder, such as from
+    // IAlgorithm::simulate_lines_formatted(), with the int16 scale it returned.
+    void append_formatted(const void* iq_buffer, size_t line_stride, float timestamp, float scale);
+
+    // Write the queued frames and close the file. Throws if writing failed.
+    void close();
+
+    size_t get_num_lines() const      { return m_num_lines; }
+    size_t get_num_samples() const    { return m_num_samples; }
+
+    // Number of frames appended so far.
+    size_t get_num_frames() const;
+
+private:
+    struct Frame {
+        // the samples in the sample type of m_format
+        std::vector<char>                   samples;
+        float                               timestamp;
+        float                               scale;
+    };
+    struct HdfFile;
+
+    // Wait for room in the queue and return a buffer for the next frame.
+    std::unique_ptr<Frame> get_free_frame();
+    void queue_frame(std::unique_ptr<Frame> frame);
+    // Convert line line_no of a frame with the scale of the frame.
+    void convert_line(const std::complex<float>* samples, size_t line_no, Frame& frame) const;
+    // The scale of a frame of float lines, where line(line_no) is the start
+    // of a line.
+    template <typename LineFn>
+    float frame_scale(LineFn line) const;
+    void writer_loop();
+
+private:
+    const size_t                        m_num_lines;
+    const size_t                        m_num_samples;
+    const size_t                        m_max_queued_frames;
+    const IqOutputFormat                m_format;
+    const size_t                        m_sample_bytes;
+    std::unique_ptr<HdfFile>            m_file;
+
+    mutable std::mutex                  m_mutex;
+    std::condition_variable             m_cond;
+    std::deque<std::unique_ptr<Frame>>  m_queued_frames;
+    // written frames, whose buffers are reused
+    std::vector<std::unique_ptr<Frame>> m_free_frames;
+    size_t                              m_num_frames;
+    bool                                m_closing;
+    std::exception_ptr                  m_error;
+    std::thread                         m_writer;
+};
+
+}   // namespace
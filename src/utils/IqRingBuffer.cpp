@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include "IqRingBuffer.hpp"
+
+namespace bcsim {
+
+IqRingBuffer::IqRingBuffer(double max_megabytes, size_t max_frames)
+    : m_max_samples(static_cast<size_t>(std::max(max_megabytes, 0.0)*1024*1024/sizeof(std::complex<float>))),
+      m_max_frames(max_frames),
+      m_num_lines(0),
+      m_num_samples(0),
+      m_capacity(0),
+      m_first_frame_no(0),
+      m_end_frame_no(0)
+{
+    if (m_max_samples == 0) {
+        throw std::runtime_error("IQ ring buffer must have room for samples");
+    }
+    m_storage = std::unique_ptr<float[]>(new float[2*m_max_samples]);
+}
+
+size_t IqRingBuffer::capacity_for_frame_size(size_t frame_size) const {
+    const auto capacity = m_max_samples/frame_size;
+    return (m_max_frames > 0) ? std::min(capacity, m_max_frames) : capacity;
+}
+
+std::complex<float>* IqRingBuffer::next_slot(size_t num_lines, size_t num_samples) {
+    if ((num_lines == 0) || (num_samples == 0)) {
+        throw std::runtime_error("IQ frames must have lines and samples");
+    }
+    const auto frame_size = num_lines*num_samples;
+    if (frame_size > m_max_samples) {
+        throw std::runtime_error("IQ frame is larger than the ring buffer");
+    }
+    if ((num_lines != m_num_lines) || (num_samples != m_num_samples)) {
+        m_num_lines = num_lines;
+        m_num_samples = num_samples;
+        m_capacity = capacity_for_frame_size(frame_size);
+        m_timestamps.assign(m_capacity, 0.0f);
+        m_first_frame_no = m_end_frame_no;
+    }
+    const auto slot = m_end_frame_no % m_capacity;
+    return reinterpret_cast<std::complex<float>*>(m_storage.get()) + slot*frame_size;
+}
+
+void IqRingBuffer::commit_slot(float timestamp) {
+    m_timestamps[m_end_frame_no % m_capacity] = timestamp;
+    m_end_frame_no++;
+    if (m_end_frame_no - m_first_frame_no > m_capacity) {
+        m_first_frame_no++;
+    }
+}
+
+void IqRingBuffer::push(const std::complex<float>* iq_buffer, size_t num_lines, size_t num_samples,
+                        size_t line_stride, float timestamp) {
+    if (line_stride < num_samples) {
+        throw std::runtime_error("line stride is less than the number of samples");
+    }
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto dest = next_slot(num_lines, num_samples);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        std::copy_n(iq_buffer + line_no*line_stride, num_samples, dest + line_no*num_samples);
+    }
+    commit_slot(timestamp);
+}
+
+void IqRingBuffer::push(const std::vector<std::vector<std::complex<float>>>& iq_lines, float timestamp) {
+    const auto num_lines = iq_lines.size();
+    const auto num_samples = iq_lines.empty() ? 0 : iq_lines[0].size();
+    for (const auto& line : iq_lines) {
+        if (line.size() != num_samples) {
+            throw std::runtime_error("all IQ lines must have the same number of samples");
+        }
+    }
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto dest = next_slot(num_lines, num_samples);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        std::copy(iq_lines[line_no].begin(), iq_lines[line_no].end(), dest + line_no*num_samples);
+    }
+    commit_slot(timestamp);
+}
+
+bool IqRingBuffer::read(size_t frame_no, Frame& frame) const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if ((frame_no < m_first_frame_no) || (frame_no >= m_end_frame_no)) {
+        return false;
+    }
+    const auto frame_size = m_num_lines*m_num_samples;
+    const auto slot = frame_no % m_capacity;
+    const auto src = reinterpret_cast<const std::complex<float>*>(m_storage.get()) + slot*frame_size;
+    frame.samples.assign(src, src + frame_size);
+    frame.num_lines = m_num_lines;
+    frame.num_samples = m_num_samples;
+    frame.timestamp = m_timestamps[slot];
+    return true;
+}
+
+size_t IqRingBuffer::get_first_frame_no() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_first_frame_no;
+}
+
+size_t IqRingBuffer::get_end_frame_no() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_end_frame_no;
+}
+
+size_t IqRingBuffer::get_num_frames() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_end_frame_no - m_first_frame_no;
+}
+
+size_t IqRingBuffer::get_capacity() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_capacity;
+}
+
+void IqRingBuffer::clear() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_first_frame_no = m_end_frame_no;
+}
+
+}   // namespace
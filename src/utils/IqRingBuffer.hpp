@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <complex>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "../core/export_macros.hpp"
+
+namespace bcsim {
+
+// A fixed-capacity ring buffer with the most recent IQ frames, e.g. for
+// keeping a cine loop in memory without growing. The storage is allocated
+// once, and each frame is stored contiguously with the [line][sample] layout
+// of IAlgorithm::simulate_lines(). When full, pushing a frame overwrites the
+// oldest frame.
+//
+// Frames are numbered in the order they are pushed, and readers refer to
+// frames by number, so that a reader which falls behind just misses the
+// overwritten frames. A push only locks the buffer while copying the frame,
+// and is safe while other threads read frames.
+class DLL_PUBLIC IqRingBuffer {
+public:
+    struct Frame {
+        std::vector<std::complex<float>>    samples;    // [line][sample]
+        size_t                              num_lines;
+        size_t                              num_samples;
+        float                               timestamp;
+    };
+
+    // Preallocates max_megabytes of storage. The capacity is as many frames
+    // as fit, but at most max_frames if it is nonzero.
+    explicit IqRingBuffer(double max_megabytes, size_t max_frames = 0);
+
+    // Copy a frame of num_lines lines of num_samples samples with the given
+    // distance between lines. If the frame size differs from the previous
+    // frames, all buffered frames are discarded. Throws if the frame does
+    // not fit in the storage.
+    void push(const std::complex<float>* iq_buffer, size_t num_lines, size_t num_samples,
+              size_t line_stride, float timestamp);
+
+    void push(const std::vector<std::vector<std::complex<float>>>& iq_lines, float timestamp);
+
+    // Copy the frame with the given number to frame, whose buffer is reused.
+    // Returns false if the frame has been overwritten or not pushed yet.
+    bool read(size_t frame_no, Frame& frame) const;
+
+    // Number of the oldest frame in the buffer.
+    size_t get_first_frame_no() const;
+
+    // Number of the next frame to be pushed.
+    size_t get_end_frame_no() const;
+
+    // Number of frames in the buffer.
+    size_t get_num_frames() const;
+
+    // Number of frames of the current frame size which fit in the buffer.
+    size_t get_capacity() const;
+
+    size_t get_max_samples() const {
+        return m_max_samples;
+    }
+
+    // Discard all frames.
+    void clear();
+
+private:
+    size_t capacity_for_frame_size(size_t frame_size) const;
+
+    // With the mutex locked: check the frame size, discard the buffered
+    // frames if it changed, and return the storage of the next frame.
+    std::complex<float>* next_slot(size_t num_lines, size_t num_samples);
+
+    // With the mutex locked: make the frame in the next slot available.
+    void commit_slot(float timestamp);
+
+private:
+    const size_t                        m_max_samples;
+    const size_t                        m_max_frames;
+    // uninitialized storage, so that unused pages are not touched
+    std::unique_ptr<float[]>            m_storage;
+
+    mutable std::mutex                  m_mutex;
+    size_t                              m_num_lines;
+    size_t                              m_num_samples;
+    size_t                              m_capacity;
+    size_t                              m_first_frame_no;
+    size_t                              m_end_frame_no;
+    std::vector<float>                  m_timestamps;
+};
+
+}   // namespace
@@ -0,0 +1,389 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include "MeshPhantom.hpp"
+#include "../core/bspline.hpp"
+
+namespace bcsim {
+namespace {
+
+const uint32_t  MAX_LEAF_TRIANGLES = 4;
+const int       MAX_DEPTH          = 48;
+const size_t    BLOCK_SIZE         = 1 << 14;
+
+// Vertex number of an OBJ face corner such as "7", "7/2", "7//3" or "-1".
+uint32_t parse_face_corner(const std::string& corner, size_t num_vertices) {
+    long index;
+    try {
+        index = std::stol(corner.substr(0, corner.find('/')));
+    } catch (const std::exception&) {
+        throw std::runtime_error("failed parsing face corner: " + corner);
+    }
+    // negative indices count from the last vertex read
+    const auto vertex_no = (index < 0) ? static_cast<long>(num_vertices) + index : index - 1;
+    if ((vertex_no < 0) || (vertex_no >= static_cast<long>(num_vertices))) {
+        throw std::runtime_error("invalid vertex index: " + corner);
+    }
+    return static_cast<uint32_t>(vertex_no);
+}
+
+void expand(vector3& min_corner, vector3& max_corner, const vector3& p) {
+    min_corner = vector3(std::min(min_corner.x, p.x), std::min(min_corner.y, p.y), std::min(min_corner.z, p.z));
+    max_corner = vector3(std::max(max_corner.x, p.x), std::max(max_corner.y, p.y), std::max(max_corner.z, p.z));
+}
+
+float component(const vector3& v, int axis) {
+    return (axis == 0) ? v.x : (axis == 1) ? v.y : v.z;
+}
+
+// Slab test of the ray against a box, for t > 0.
+bool ray_hits_box(const vector3& origin, const vector3& inv_direction, const vector3& min_corner, const vector3& max_corner) {
+    float t_near = 0.0f;
+    float t_far = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        const auto o = component(origin, axis);
+        const auto inv_d = component(inv_direction, axis);
+        auto t0 = (component(min_corner, axis) - o)*inv_d;
+        auto t1 = (component(max_corner, axis) - o)*inv_d;
+        if (t0 > t1) std::swap(t0, t1);
+        t_near = std::max(t_near, t0);
+        t_far = std::min(t_far, t1);
+    }
+    return t_near <= t_far;
+}
+
+// Moller-Trumbore intersection for t > 0.
+bool ray_hits_triangle(const vector3& origin, const vector3& direction,
+                       const vector3& v0, const vector3& v1, const vector3& v2) {
+    const auto e1 = v1 - v0;
+    const auto e2 = v2 - v0;
+    const auto p = direction.cross(e2);
+    const auto det = e1.dot(p);
+    if (det == 0.0f) {
+        return false;
+    }
+    const auto inv_det = 1.0f/det;
+    const auto s = origin - v0;
+    const auto u = s.dot(p)*inv_det;
+    if ((u < 0.0f) || (u > 1.0f)) {
+        return false;
+    }
+    const auto q = s.cross(e1);
+    const auto v = direction.dot(q)*inv_det;
+    if ((v < 0.0f) || (u + v > 1.0f)) {
+        return false;
+    }
+    return e2.dot(q)*inv_det > 0.0f;
+}
+
+float squared_distance_to_box(const vector3& p, const vector3& min_corner, const vector3& max_corner) {
+    const auto dx = std::max(std::max(min_corner.x - p.x, 0.0f), p.x - max_corner.x);
+    const auto dy = std::max(std::max(min_corner.y - p.y, 0.0f), p.y - max_corner.y);
+    const auto dz = std::max(std::max(min_corner.z - p.z, 0.0f), p.z - max_corner.z);
+    return dx*dx + dy*dy + dz*dz;
+}
+
+// Closest point on a triangle, from "Real-Time Collision Detection" by Ericson.
+vector3 closest_point_on_triangle(const vector3& p, const vector3& a, const vector3& b, const vector3& c) {
+    const auto ab = b - a;
+    const auto ac = c - a;
+    const auto ap = p - a;
+    const auto d1 = ab.dot(ap);
+    const auto d2 = ac.dot(ap);
+    if ((d1 <= 0.0f) && (d2 <= 0.0f)) return a;
+    const auto bp = p - b;
+    const auto d3 = ab.dot(bp);
+    const auto d4 = ac.dot(bp);
+    if ((d3 >= 0.0f) && (d4 <= d3)) return b;
+    const auto vc = d1*d4 - d3*d2;
+    if ((vc <= 0.0f) && (d1 >= 0.0f) && (d3 <= 0.0f)) return a + ab*(d1/(d1 - d3));
+    const auto cp = p - c;
+    const auto d5 = ab.dot(cp);
+    const auto d6 = ac.dot(cp);
+    if ((d6 >= 0.0f) && (d5 <= d6)) return c;
+    const auto vb = d5*d2 - d1*d6;
+    if ((vb <= 0.0f) && (d2 >= 0.0f) && (d6 <= 0.0f)) return a + ac*(d2/(d2 - d6));
+    const auto va = d3*d6 - d5*d4;
+    if ((va <= 0.0f) && (d4 - d3 >= 0.0f) && (d5 - d6 >= 0.0f)) return b + (c - b)*((d4 - d3)/((d4 - d3) + (d5 - d6)));
+    const auto denom = 1.0f/(va + vb + vc);
+    return a + ab*(vb*denom) + ac*(vc*denom);
+}
+
+void check_config(const MeshPhantomConfig& config) {
+    if (!(config.density > 0.0)) {
+        throw std::runtime_error("scatterer density must be positive");
+    }
+    if (config.shell_thickness < 0.0f) {
+        throw std::runtime_error("shell thickness cannot be negative");
+    }
+}
+
+// Candidate i is scatterer i of a procedural box dataset covering the
+// bounding box, so the result does not depend on the number of threads.
+std::vector<PointScatterer> sample_mesh_volume(const MeshVolume& volume, const MeshPhantomConfig& config) {
+    check_config(config);
+    ProceduralScatterers candidates;
+    candidates.region = ProceduralScatterers::Region::BOX;
+    candidates.center = (volume.get_min_corner() + volume.get_max_corner())*0.5f;
+    candidates.half_axes = (volume.get_max_corner() - volume.get_min_corner())*0.5f;
+    candidates.amplitude_distribution = ProceduralScatterers::AmplitudeDistribution::GAUSSIAN;
+    candidates.amplitude_scale = config.amplitude_scale;
+    candidates.seed = config.seed;
+    candidates.set_density(config.density);
+
+    const auto num_blocks = static_cast<int>((candidates.count + BLOCK_SIZE - 1)/BLOCK_SIZE);
+    std::vector<std::vector<PointScatterer>> block_scatterers(num_blocks);
+    #pragma omp parallel for schedule(dynamic)
+    for (int block_no = 0; block_no < num_blocks; block_no++) {
+        const auto first = static_cast<size_t>(block_no)*BLOCK_SIZE;
+        const auto last = std::min(first + BLOCK_SIZE, candidates.count);
+        for (size_t i = first; i < last; i++) {
+            const auto scatterer = candidates.get_scatterer(i);
+            if (volume.is_inside(scatterer.pos)
+                && ((config.shell_thickness <= 0.0f) || (volume.distance_to_surface(scatterer.pos) <= config.shell_thickness))) {
+                block_scatterers[block_no].push_back(scatterer);
+            }
+        }
+    }
+    std::vector<PointScatterer> res;
+    for (const auto& scatterers : block_scatterers) {
+        res.insert(res.end(), scatterers.begin(), scatterers.end());
+    }
+    return res;
+}
+
+}   // end anonymous namespace
+
+TriangleMesh load_obj_mesh(std::istream& obj_stream, float scale) {
+    TriangleMesh mesh;
+    std::string line;
+    while (std::getline(obj_stream, line)) {
+        std::istringstream ss(line);
+        std::string command;
+        ss >> command;
+        if (command == "v") {
+            float x, y, z;
+            if (!(ss >> x >> y >> z)) {
+                throw std::runtime_error("failed to parse vertex");
+            }
+            mesh.vertices.emplace_back(scale*x, scale*y, scale*z);
+        } else if (command == "f") {
+            std::vector<uint32_t> corners;
+            std::string corner;
+            while (ss >> corner) {
+                corners.push_back(parse_face_corner(corner, mesh.vertices.size()));
+            }
+            if (corners.size() < 3) {
+                throw std::runtime_error("face with less than three vertices");
+            }
+            for (size_t i = 1; i + 1 < corners.size(); i++) {
+                mesh.triangles.insert(mesh.triangles.end(), {corners[0], corners[i], corners[i + 1]});
+            }
+        }
+    }
+    return mesh;
+}
+
+TriangleMesh load_obj_mesh(const std::string& obj_file, float scale) {
+    std::ifstream in(obj_file);
+    if (!in) {
+        throw std::runtime_error("unable to open " + obj_file);
+    }
+    return load_obj_mesh(in, scale);
+}
+
+MeshVolume::MeshVolume(const TriangleMesh& mesh) {
+    const auto num_triangles = static_cast<uint32_t>(mesh.num_triangles());
+    if (num_triangles == 0) {
+        throw std::runtime_error("mesh has no triangles");
+    }
+    std::vector<vector3> centroids(num_triangles);
+    std::vector<uint32_t> order(num_triangles);
+    for (uint32_t i = 0; i < num_triangles; i++) {
+        centroids[i] = (mesh.vertices[mesh.triangles[3*i]] + mesh.vertices[mesh.triangles[3*i + 1]]
+                        + mesh.vertices[mesh.triangles[3*i + 2]])/3.0f;
+        order[i] = i;
+    }
+    m_nodes.reserve(2*num_triangles/MAX_LEAF_TRIANGLES + 1);
+    build(order, 0, num_triangles, centroids, mesh, 0);
+    m_v0.resize(num_triangles);
+    m_v1.resize(num_triangles);
+    m_v2.resize(num_triangles);
+    for (uint32_t i = 0; i < num_triangles; i++) {
+        m_v0[i] = mesh.vertices[mesh.triangles[3*order[i]]];
+        m_v1[i] = mesh.vertices[mesh.triangles[3*order[i] + 1]];
+        m_v2[i] = mesh.vertices[mesh.triangles[3*order[i] + 2]];
+    }
+    m_min_corner = m_nodes[0].min_corner;
+    m_max_corner = m_nodes[0].max_corner;
+}
+
+uint32_t MeshVolume::build(std::vector<uint32_t>& order, uint32_t begin, uint32_t end,
+                           const std::vector<vector3>& centroids, const TriangleMesh& mesh, int depth) {
+    const auto node_no = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(Node());
+    const auto inf = std::numeric_limits<float>::max();
+    vector3 min_corner(inf, inf, inf);
+    vector3 max_corner(-inf, -inf, -inf);
+    vector3 min_centroid(inf, inf, inf);
+    vector3 max_centroid(-inf, -inf, -inf);
+    for (auto i = begin; i < end; i++) {
+        for (int corner = 0; corner < 3; corner++) {
+            expand(min_corner, max_corner, mesh.vertices[mesh.triangles[3*order[i] + corner]]);
+        }
+        expand(min_centroid, max_centroid, centroids[order[i]]);
+    }
+    m_nodes[node_no].min_corner = min_corner;
+    m_nodes[node_no].max_corner = max_corner;
+    if ((end - begin <= MAX_LEAF_TRIANGLES) || (depth >= MAX_DEPTH)) {
+        m_nodes[node_no].first = begin;
+        m_nodes[node_no].count = end - begin;
+        return node_no;
+    }
+
+    // median split along the longest axis of the centroids
+    const auto extent = max_centroid - min_centroid;
+    const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+    const auto middle = begin + (end - begin)/2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return component(centroids[a], axis) < component(centroids[b], axis);
+    });
+    build(order, begin, middle, centroids, mesh, depth + 1);
+    const auto second = build(order, middle, end, centroids, mesh, depth + 1);
+    m_nodes[node_no].first = second;
+    m_nodes[node_no].count = 0;
+    return node_no;
+}
+
+int MeshVolume::count_crossings(const vector3& origin, const vector3& direction) const {
+    const vector3 inv_direction(1.0f/direction.x, 1.0f/direction.y, 1.0f/direction.z);
+    int num_crossings = 0;
+    std::array<uint32_t, 2*MAX_DEPTH + 2> stack;
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const auto& node = m_nodes[stack[--stack_size]];
+        if (!ray_hits_box(origin, inv_direction, node.min_corner, node.max_corner)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (auto i = node.first; i < node.first + node.count; i++) {
+                num_crossings += ray_hits_triangle(origin, direction, m_v0[i], m_v1[i], m_v2[i]);
+            }
+        } else {
+            stack[stack_size++] = node.first;
+            stack[stack_size++] = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+        }
+    }
+    return num_crossings;
+}
+
+bool MeshVolume::is_inside(const vector3& p) const {
+    if (squared_distance_to_box(p, m_min_corner, m_max_corner) > 0.0f) {
+        return false;
+    }
+    // skewed so that no ray is parallel to the faces of axis-aligned meshes
+    static const vector3 directions[3] = {
+        vector3(0.9317f, 0.3225f, 0.1669f),
+        vector3(-0.2478f, 0.9164f, 0.3142f),
+        vector3(0.1812f, -0.3907f, 0.9025f)
+    };
+    int num_inside = 0;
+    for (const auto& direction : directions) {
+        num_inside += count_crossings(p, direction) % 2;
+    }
+    return num_inside >= 2;
+}
+
+float MeshVolume::distance_to_surface(const vector3& p) const {
+    float best = std::numeric_limits<float>::max();
+    std::array<uint32_t, 2*MAX_DEPTH + 2> stack;
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const auto node_no = stack[--stack_size];
+        const auto& node = m_nodes[node_no];
+        if (squared_distance_to_box(p, node.min_corner, node.max_corner) >= best) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (auto i = node.first; i < node.first + node.count; i++) {
+                best = std::min(best, (closest_point_on_triangle(p, m_v0[i], m_v1[i], m_v2[i]) - p).norm_squared());
+            }
+        } else {
+            // visit the closer child first
+            const auto left = node_no + 1;
+            const auto right = node.first;
+            const auto left_distance = squared_distance_to_box(p, m_nodes[left].min_corner, m_nodes[left].max_corner);
+            const auto right_distance = squared_distance_to_box(p, m_nodes[right].min_corner, m_nodes[right].max_corner);
+            stack[stack_size++] = (left_distance < right_distance) ? right : left;
+            stack[stack_size++] = (left_distance < right_distance) ? left : right;
+        }
+    }
+    return std::sqrt(best);
+}
+
+FixedScatterers::s_ptr create_mesh_fixed_scatterers(const MeshVolume& volume, const MeshPhantomConfig& config) {
+    auto res = std::make_shared<FixedScatterers>();
+    res->scatterers = sample_mesh_volume(volume, config);
+    return res;
+}
+
+SplineScatterers::s_ptr create_mesh_spline_scatterers(const MeshVolume& volume, const MeshPhantomConfig& config,
+                                                      const MotionFunction& motion, int spline_degree,
+                                                      int num_cs, float t0, float t1) {
+    if ((spline_degree < 1) || (num_cs <= spline_degree) || !(t1 > t0)) {
+        throw std::runtime_error("invalid spline configuration");
+    }
+    const auto scatterers = sample_mesh_volume(volume, config);
+    const auto knots = bspline_storve::uniform_regular_knot_vector(num_cs, spline_degree, t0, t1);
+    const auto knot_avgs = bspline_storve::control_points(spline_degree, knots);
+    auto res = std::make_shared<SplineScatterers>();
+    res->spline_degree = spline_degree;
+    res->knot_vector = knots;
+    res->resize(scatterers.size(), num_cs);
+    const auto num_splines = static_cast<long long>(scatterers.size());
+    #pragma omp parallel for
+    for (long long spline_no = 0; spline_no < num_splines; spline_no++) {
+        res->amplitudes[spline_no] = scatterers[spline_no].amplitude;
+        for (int cs_i = 0; cs_i < num_cs; cs_i++) {
+            res->set_control_point(spline_no, cs_i, motion(scatterers[spline_no].pos, knot_avgs[cs_i]));
+        }
+    }
+    return res;
+}
+
+}   // end namespace
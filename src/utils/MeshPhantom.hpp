@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+namespace bcsim {
+
+// A triangle mesh as indices into a vertex array.
+struct TriangleMesh {
+    std::vector<vector3>    vertices;
+    // three vertex indices per triangle
+    std::vector<uint32_t>   triangles;
+
+    size_t num_triangles() const {
+        return triangles.size()/3;
+    }
+};
+
+// Read the vertices and faces of a Wavefront OBJ mesh, with the vertex
+// coordinates multiplied by scale, e.g. 1e-3 for a mesh in millimeters.
+// Polygons are split into triangle fans; texture coordinates, normals and
+// other statements are ignored. Throws on malformed vertices or faces.
+TriangleMesh DLL_PUBLIC load_obj_mesh(std::istream& obj_stream, float scale = 1.0f);
+TriangleMesh DLL_PUBLIC load_obj_mesh(const std::string& obj_file, float scale = 1.0f);
+
+// Inside/outside and distance queries against a closed triangle mesh,
+// accelerated by a bounding volume hierarchy. The queries are const and can
+// be made from several threads.
+class DLL_PUBLIC MeshVolume {
+public:
+    // Throws if the mesh has no triangles.
+    explicit MeshVolume(const TriangleMesh& mesh);
+
+    // Ray parity test: rays in three skewed directions are cast and the
+    // majority decides, which makes the result robust to rays grazing edges
+    // and to small holes in the mesh.
+    bool is_inside(const vector3& p) const;
+
+    // Distance to the closest point on the surface.
+    float distance_to_surface(const vector3& p) const;
+
+    const vector3& get_min_corner() const { return m_min_corner; }
+    const vector3& get_max_corner() const { return m_max_corner; }
+
+    size_t get_num_nodes() const { return m_nodes.size(); }
+
+private:
+    struct Node {
+        vector3     min_corner;
+        vector3     max_corner;
+        // leaf: first triangle and count; inner node: index of the
+        // second child (the first child follows the node) and count 0
+        uint32_t    first;
+        uint32_t    count;
+    };
+
+    // Build the subtree of order[begin, end) and return the index of its node.
+    uint32_t build(std::vector<uint32_t>& order, uint32_t begin, uint32_t end,
+                   const std::vector<vector3>& centroids, const TriangleMesh& mesh, int depth);
+
+    // Number of triangles hit by the ray from origin along direction.
+    int count_crossings(const vector3& origin, const vector3& direction) const;
+
+private:
+    // the corners of the triangles in BVH order
+    std::vector<vector3>    m_v0;
+    std::vector<vector3>    m_v1;
+    std::vector<vector3>    m_v2;
+    std::vector<Node>       m_nodes;
+    vector3                 m_min_corner;
+    vector3                 m_max_corner;
+};
+
+struct MeshPhantomConfig {
+    MeshPhantomConfig()
+        : density(1e9), shell_thickness(0.0f), amplitude_scale(1.0f), seed(0) { }
+
+    // Scatterers per m^3.
+    double      density;
+
+    // If positive, only the scatterers inside the mesh within this distance
+    // [m] of the surface are kept, e.g. for the wall of an organ.
+    float       shell_thickness;
+
+    // Standard deviation of the zero-mean Gaussian amplitudes.
+    float       amplitude_scale;
+
+    // The phantom is a pure function of the mesh, the configuration and the
+    // seed, independent of the number of threads.
+    uint64_t    seed;
+};
+
+// Fill the interior (or shell) of a mesh with uniformly distributed
+// scatterers. Candidates are drawn in the bounding box of the mesh in
+// parallel blocks and tested against the mesh. Throws on invalid settings.
+FixedScatterers::s_ptr DLL_PUBLIC create_mesh_fixed_scatterers(const MeshVolume& volume, const MeshPhantomConfig& config);
+
+// Position at time t of the material point at p at rest, e.g. a
+// contraction of the organ.
+typedef std::function<vector3(const vector3& p, float t)> MotionFunction;
+
+// Like create_mesh_fixed_scatterers(), but the scatterers follow the motion
+// along B-splines on [t0, t1] with uniform knots, with the control points
+// at the motion at the knot averages.
+SplineScatterers::s_ptr DLL_PUBLIC create_mesh_spline_scatterers(const MeshVolume& volume, const MeshPhantomConfig& config,
+                                                                 const MotionFunction& motion, int spline_degree,
+                                                                 int num_cs, float t0, float t1);
+
+}   // end namespace
@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#include "NumericCSVReader.hpp"
+
+namespace csv {
+
+namespace {
+
+// Read-only view of a whole file.
+struct MappedFile {
+    explicit MappedFile(const std::string& filename) : data(nullptr), num_bytes(0) {
+#ifdef _WIN32
+        std::ifstream in(filename, std::ios::in | std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("unable to open " + filename);
+        }
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = contents.data();
+        num_bytes = contents.size();
+#else
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("unable to open " + filename);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("unable to stat " + filename);
+        }
+        num_bytes = static_cast<size_t>(info.st_size);
+        if (num_bytes > 0) {
+            void* address = mmap(nullptr, num_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("unable to map " + filename);
+            }
+            madvise(address, num_bytes, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(address);
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data) {
+            munmap(const_cast<char*>(data), num_bytes);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data;
+    size_t      num_bytes;
+#ifdef _WIN32
+    std::string contents;
+#endif
+};
+
+inline bool is_blank(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+// Exactly representable powers of ten.
+const double POWERS_OF_TEN[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// The number in [begin, end), with surrounding blanks.
+double parse_number(const char* begin, const char* end) {
+    const char* p = begin;
+    while ((p < end) && is_blank(*p)) p++;
+    const char* last = end;
+    while ((last > p) && is_blank(last[-1])) last--;
+
+    const char* q = p;
+    bool negative = false;
+    if ((q < last) && ((*q == '-') || (*q == '+'))) {
+        negative = (*q == '-');
+        q++;
+    }
+    uint64_t mantissa = 0;
+    int num_digits = 0;         // significant digits in the mantissa
+    int exponent = 0;
+    bool exact = true;
+    bool any_digits = false;
+    for (; (q < last) && (*q >= '0') && (*q <= '9'); q++) {
+        any_digits = true;
+        if (num_digits < 19) {
+            mantissa = 10*mantissa + static_cast<uint64_t>(*q - '0');
+            num_digits += (mantissa != 0) ? 1 : 0;
+        } else {
+            exponent++;
+            exact = exact && (*q == '0');
+        }
+    }
+    if ((q < last) && (*q == '.')) {
+        for (q++; (q < last) && (*q >= '0') && (*q <= '9'); q++) {
+            any_digits = true;
+            if (num_digits < 19) {
+                mantissa = 10*mantissa + static_cast<uint64_t>(*q - '0');
+                num_digits += (mantissa != 0) ? 1 : 0;
+                exponent--;
+            } else {
+                exact = exact && (*q == '0');
+            }
+        }
+    }
+    if (any_digits && (q < last) && ((*q == 'e') || (*q == 'E'))) {
+        q++;
+        bool negative_exponent = false;
+        if ((q < last) && ((*q == '-') || (*q == '+'))) {
+            negative_exponent = (*q == '-');
+            q++;
+        }
+        int value = 0;
+        bool exponent_digits = false;
+        for (; (q < last) && (*q >= '0') && (*q <= '9'); q++) {
+            exponent_digits = true;
+            value = std::min(10*value + (*q - '0'), 100000);
+        }
+        any_digits = exponent_digits;
+        exponent += negative_exponent ? -value : value;
+    }
+
+    if (any_digits && (q == last) && exact && (mantissa <= (uint64_t(1) << 53))
+        && (exponent >= -22) && (exponent <= 22)) {
+        const auto m = static_cast<double>(mantissa);
+        const auto value = (exponent >= 0) ? m*POWERS_OF_TEN[exponent] : m/POWERS_OF_TEN[-exponent];
+        return negative ? -value : value;
+    }
+
+    // Long mantissas, large exponents, inf and nan.
+    const std::string token(p, last);
+    char* token_end = nullptr;
+    const auto value = std::strtod(token.c_str(), &token_end);
+    if (token.empty() || (token_end != token.c_str() + token.size())) {
+        throw std::runtime_error("invalid number: '" + token + "'");
+    }
+    return value;
+}
+
+// Parse the lines in [begin, end) into one vector per column.
+void parse_block(const char* begin, const char* end, char delimiter, std::vector<std::vector<double>>& columns) {
+    const auto num_columns = columns.size();
+    const char* p = begin;
+    while (p < end) {
+        auto line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        const char* q = p;
+        while ((q < line_end) && is_blank(*q)) q++;
+        if (q == line_end) {
+            p = line_end + 1;
+            continue;
+        }
+        for (size_t col = 0; col < num_columns; col++) {
+            auto field_end = static_cast<const char*>(std::memchr(p, delimiter, line_end - p));
+            if ((col + 1 < num_columns) == (field_end == nullptr)) {
+                throw std::runtime_error("mismatch between number of row entries and number of column headers");
+            }
+            if (!field_end) {
+                field_end = line_end;
+            }
+            columns[col].push_back(parse_number(p, field_end));
+            p = field_end + 1;
+        }
+        p = line_end + 1;
+    }
+}
+
+}   // end anonymous namespace
+
+NumericCSVReader::NumericCSVReader(const std::string& filename, char delimiter, int num_threads)
+    : m_delimiter(delimiter)
+{
+    MappedFile file(filename);
+    parse(file.data, file.num_bytes, num_threads);
+}
+
+NumericCSVReader::NumericCSVReader(const char* text, size_t num_bytes, char delimiter, int num_threads)
+    : m_delimiter(delimiter)
+{
+    parse(text, num_bytes, num_threads);
+}
+
+const std::vector<double>& NumericCSVReader::get_values(const std::string& col_name) const {
+    const auto it = std::find(std::begin(m_column_headers), std::end(m_column_headers), col_name);
+    if (it == std::end(m_column_headers)) {
+        throw std::runtime_error("no column found");
+    }
+    return m_columns[it - std::begin(m_column_headers)];
+}
+
+void NumericCSVReader::parse(const char* text, size_t num_bytes, int num_threads) {
+    const char* end = text + num_bytes;
+    auto header_end = static_cast<const char*>(num_bytes > 0 ? std::memchr(text, '\n', num_bytes) : nullptr);
+    if (!header_end) {
+        header_end = end;
+    }
+    if (header_end == text) {
+        throw std::runtime_error("unable to read column headers");
+    }
+    const char* p = text;
+    while (true) {
+        auto field_end = static_cast<const char*>(std::memchr(p, m_delimiter, header_end - p));
+        std::string name(p, field_end ? field_end : header_end);
+        name.erase(std::remove_if(std::begin(name), std::end(name), [](char c) {
+            return (c=='\n') || (c=='\r');
+        }), std::end(name));
+        m_column_headers.push_back(name);
+        if (!field_end) {
+            break;
+        }
+        p = field_end + 1;
+    }
+    const char* data = std::min(header_end + 1, end);
+
+    // Blocks of whole lines of about the same size.
+    const size_t min_block_bytes = 1024*1024;
+    const auto num_data_bytes = static_cast<size_t>(end - data);
+    auto num_blocks = (num_threads > 0) ? static_cast<size_t>(num_threads)
+                                        : static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()));
+    num_blocks = std::max<size_t>(1, std::min(num_blocks, num_data_bytes/min_block_bytes));
+    std::vector<const char*> block_starts(1, data);
+    for (size_t i = 1; i < num_blocks; i++) {
+        auto start = std::max(block_starts.back(), data + i*num_data_bytes/num_blocks);
+        auto newline = static_cast<const char*>(std::memchr(start, '\n', end - start));
+        block_starts.push_back(newline ? newline + 1 : end);
+    }
+    block_starts.push_back(end);
+
+    std::vector<std::vector<std::vector<double>>> block_columns(num_blocks,
+        std::vector<std::vector<double>>(m_column_headers.size()));
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    const auto parse_one = [&](size_t block_no) {
+        try {
+            parse_block(block_starts[block_no], block_starts[block_no+1], m_delimiter, block_columns[block_no]);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_blocks; i++) {
+        threads.emplace_back(parse_one, i);
+    }
+    parse_one(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    m_columns = std::move(block_columns[0]);
+    for (size_t col = 0; col < m_columns.size(); col++) {
+        for (size_t i = 1; i < num_blocks; i++) {
+            const auto& values = block_columns[i][col];
+            m_columns[col].insert(m_columns[col].end(), values.begin(), values.end());
+        }
+    }
+}
+
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace csv {
+
+// Reader for large CSV files of numbers, with the format of CSVReader: a
+// line of column names followed by rows with one number per column, where
+// blank lines are skipped. The file is memory mapped and split into blocks
+// of whole lines which are parsed in parallel without streams or locales.
+// The fields are found with memchr(), which is vectorized by the C library,
+// and numbers with at most 19 significant digits and a power of ten of at
+// most 22 are converted exactly without strtod().
+class NumericCSVReader {
+public:
+    // num_threads zero uses one thread per hardware thread.
+    NumericCSVReader(const std::string& filename, char delimiter=';', int num_threads=0);
+
+    // Parse text in memory.
+    NumericCSVReader(const char* text, size_t num_bytes, char delimiter=';', int num_threads=0);
+
+    const std::vector<std::string>& get_column_headers() const {
+        return m_column_headers;
+    }
+
+    size_t get_num_rows() const {
+        return m_columns.empty() ? 0 : m_columns[0].size();
+    }
+
+    const std::vector<double>& get_values(const std::string& col_name) const;
+
+    template <typename T>
+    std::vector<T> get_column(const std::string& col_name) const {
+        const auto& values = get_values(col_name);
+        std::vector<T> res(values.size());
+        std::transform(std::begin(values), std::end(values), std::begin(res), [](double v) {
+            return static_cast<T>(v);
+        });
+        return res;
+    }
+
+private:
+    void parse(const char* text, size_t num_bytes, int num_threads);
+
+private:
+    char                                m_delimiter;
+    std::vector<std::string>            m_column_headers;
+    std::vector<std::vector<double>>    m_columns;
+};
+
+}
@@ -0,0 +1,276 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#include "ParallelHdfReader.hpp"
+#include "SimpleHDF.hpp"
+
+namespace bcsim {
+
+namespace {
+
+typedef std::function<void(size_t, size_t, const float*)> RowConsumer;
+
+// Returns the destination of all rows given the dimensions of the dataset,
+// or nullptr to read each hyperslab into a temporary buffer.
+typedef std::function<float*(const std::vector<hsize_t>& dims)> RowAllocator;
+
+#ifndef _WIN32
+// pread() of exactly num_bytes.
+void read_fully(int fd, void* buffer, size_t num_bytes, off_t offset) {
+    auto bytes = static_cast<char*>(buffer);
+    while (num_bytes > 0) {
+        const auto n = pread(fd, bytes, num_bytes, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("failed to read the raw dataset");
+        }
+        bytes += n;
+        num_bytes -= static_cast<size_t>(n);
+        offset += n;
+    }
+}
+#endif
+
+void read_rows(const std::string& h5_file, const std::string& dataset_name, const ParallelHdfReadConfig& config,
+               const RowAllocator& allocate, const RowConsumer& consumer) {
+    H5::Exception::dontPrint();
+    H5::H5File file;
+    H5::DataSet dataset;
+    try {
+        file = H5::H5File(h5_file, H5F_ACC_RDONLY);
+    } catch (const H5::Exception&) {
+        throw std::runtime_error("unable to open " + h5_file);
+    }
+    try {
+        dataset = file.openDataSet(dataset_name);
+    } catch (const H5::Exception&) {
+        throw std::runtime_error("no dataset " + dataset_name + " in " + h5_file);
+    }
+
+    const auto space = dataset.getSpace();
+    const auto rank = space.getSimpleExtentNdims();
+    if (!space.isSimple() || (rank < 1)) {
+        throw std::runtime_error("dataset " + dataset_name + " is not a simple array");
+    }
+    std::vector<hsize_t> dims(rank);
+    space.getSimpleExtentDims(dims.data());
+    if (dataset.getDataType().getClass() != H5T_FLOAT) {
+        throw std::runtime_error("dataset " + dataset_name + " is not of floating point type");
+    }
+    float* destination = allocate ? allocate(dims) : nullptr;
+
+    const auto num_rows = static_cast<size_t>(dims[0]);
+    size_t row_floats = 1;
+    for (int dim = 1; dim < rank; dim++) {
+        row_floats *= static_cast<size_t>(dims[dim]);
+    }
+    if ((num_rows == 0) || (row_floats == 0)) {
+        return;
+    }
+
+    // The raw data of a contiguous dataset in a plain file starts at a known
+    // offset and needs no conversion if it has the native float type.
+    int fd = -1;
+    haddr_t raw_offset = HADDR_UNDEF;
+#ifndef _WIN32
+    raw_offset = H5Dget_offset(dataset.getId());
+    if ((raw_offset != HADDR_UNDEF) && (H5Tequal(dataset.getDataType().getId(), H5T_NATIVE_FLOAT) > 0)) {
+        const auto access_props = H5Fget_access_plist(file.getId());
+        if (H5Pget_driver(access_props) == H5FD_SEC2) {
+            fd = open(h5_file.c_str(), O_RDONLY);
+        }
+        H5Pclose(access_props);
+    }
+#endif
+
+    const auto rows_per_chunk = std::max<size_t>(1, config.chunk_bytes/(row_floats*sizeof(float)));
+    const auto num_chunks = (num_rows + rows_per_chunk - 1)/rows_per_chunk;
+    auto num_threads = (config.num_threads > 0) ? static_cast<size_t>(config.num_threads)
+                                                : static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()));
+    num_threads = std::min(num_threads, num_chunks);
+
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<bool> failed(false);
+    std::mutex hdf_mutex;       // unless the HDF5 library is thread-safe
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    const auto worker = [&]() {
+        std::vector<float> buffer;
+        try {
+            while (!failed) {
+                const auto chunk_no = next_chunk++;
+                if (chunk_no >= num_chunks) {
+                    break;
+                }
+                const auto first_row = chunk_no*rows_per_chunk;
+                const auto chunk_rows = std::min(rows_per_chunk, num_rows - first_row);
+                const auto num_values = chunk_rows*row_floats;
+                float* values;
+                if (destination) {
+                    values = destination + first_row*row_floats;
+                } else {
+                    buffer.resize(num_values);
+                    values = buffer.data();
+                }
+#ifndef _WIN32
+                if (fd >= 0) {
+                    read_fully(fd, values, num_values*sizeof(float),
+                               static_cast<off_t>(raw_offset + first_row*row_floats*sizeof(float)));
+                } else
+#endif
+                {
+                    std::lock_guard<std::mutex> guard(hdf_mutex);
+                    std::vector<hsize_t> start(rank, 0);
+                    auto count = dims;
+                    start[0] = first_row;
+                    count[0] = chunk_rows;
+                    auto file_space = dataset.getSpace();
+                    file_space.selectHyperslab(H5S_SELECT_SET, count.data(), start.data());
+                    const hsize_t mem_count = num_values;
+                    dataset.read(values, H5::PredType::NATIVE_FLOAT, H5::DataSpace(1, &mem_count), file_space);
+                }
+                if (consumer) {
+                    consumer(first_row, chunk_rows, values);
+                }
+            }
+        } catch (const H5::Exception& e) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (!error) error = std::make_exception_ptr(std::runtime_error("failed to read " + dataset_name + ": " + e.getDetailMsg()));
+            failed = true;
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (!error) error = std::current_exception();
+            failed = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#ifndef _WIN32
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}   // end anonymous namespace
+
+void readHdfRowsParallel(const std::string& h5_file, const std::string& dataset_name,
+                         const ParallelHdfReadConfig& config, const RowConsumer& consumer) {
+    read_rows(h5_file, dataset_name, config, RowAllocator(), consumer);
+}
+
+FixedScatterers::s_ptr loadFixedScatterersFromHdfParallel(const std::string& h5_file, const ParallelHdfReadConfig& config) {
+    static_assert(sizeof(PointScatterer) == 4*sizeof(float), "PointScatterer must be four floats");
+    auto res = std::make_shared<FixedScatterers>();
+    try {
+        read_rows(h5_file, "data", config, [&](const std::vector<hsize_t>& dims) {
+            if ((dims.size() != 2) || (dims[1] != 4)) {
+                throw std::runtime_error("Second dimension must have length four");
+            }
+            res->scatterers.resize(dims[0]);
+            return reinterpret_cast<float*>(res->scatterers.data());
+        }, RowConsumer());
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("failed to load fixed scatterers: ") + e.what());
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to load fixed scatterers: " + e.getDetailMsg());
+    }
+    return res;
+}
+
+SplineScatterers::s_ptr loadSplineScatterersFromHdfParallel(const std::string& h5_file, const ParallelHdfReadConfig& config) {
+    auto res = std::make_shared<SplineScatterers>();
+    try {
+        std::vector<float> amplitudes;
+        {
+            SimpleHDF::SimpleHDF5Reader loader(h5_file);
+            amplitudes         = loader.readStdVector<float>("amplitudes");
+            res->spline_degree = loader.readScalar<int>("spline_degree");
+            res->knot_vector   = loader.readStdVector<float>("knot_vector");
+        }
+        const auto num_scatterers = amplitudes.size();
+        size_t num_cs = 0;
+        read_rows(h5_file, "control_points", config, [&](const std::vector<hsize_t>& dims) -> float* {
+            if ((dims.size() != 3) || (dims[2] != 3)) {
+                throw std::runtime_error("SplineScatterer illegal number of components (should be 3)");
+            }
+            if (dims[0] != num_scatterers) {
+                throw std::runtime_error("SplineScatterer number of amplitudes does not match control points");
+            }
+            num_cs = static_cast<size_t>(dims[1]);
+            res->resize(num_scatterers, num_cs);
+            res->amplitudes = amplitudes;
+            return nullptr;
+        }, [&](size_t first_row, size_t num_rows, const float* values) {
+            auto xs = res->control_xs.data();
+            auto ys = res->control_ys.data();
+            auto zs = res->control_zs.data();
+            for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
+                const auto offset = cs_no*num_scatterers + first_row;
+                for (size_t i = 0; i < num_rows; i++) {
+                    const auto pt = values + 3*(i*num_cs + cs_no);
+                    xs[offset + i] = pt[0];
+                    ys[offset + i] = pt[1];
+                    zs[offset + i] = pt[2];
+                }
+            }
+        });
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("failed to load spline scatterers: ") + e.what());
+    } catch (const H5::Exception& e) {
+        throw std::runtime_error("failed to load spline scatterers: " + e.getDetailMsg());
+    }
+    return res;
+}
+
+}   // end namespace
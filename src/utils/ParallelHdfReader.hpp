@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+namespace bcsim {
+
+// Splitting of a dataset read into hyperslabs of whole rows along the
+// first dimension.
+struct ParallelHdfReadConfig {
+    ParallelHdfReadConfig() : chunk_bytes(8*1024*1024), num_threads(0) { }
+
+    // Approximate size of one hyperslab, at least one row.
+    size_t  chunk_bytes;
+
+    // Number of reading threads, zero for one per hardware thread.
+    int     num_threads;
+};
+
+// Reads a float dataset of any rank from several threads in hyperslabs of
+// whole rows and passes each to consumer(first_row, num_rows, values), where
+// values holds num_rows rows of the product of the remaining dimensions. The
+// consumer is called concurrently from the reading threads, for disjoint
+// rows, and should convert the values directly into their destination.
+//
+// Uncompressed contiguous datasets of native floats are read with pread()
+// in parallel, bypassing HDF5. Otherwise the hyperslabs are read through
+// HDF5 one at a time, overlapped with the consumers of the other threads.
+void DLL_PUBLIC readHdfRowsParallel(const std::string& h5_file, const std::string& dataset_name,
+                                    const ParallelHdfReadConfig& config,
+                                    const std::function<void(size_t first_row, size_t num_rows, const float* values)>& consumer);
+
+// Like loadFixedScatterersFromHdf(), reading "data" directly into the
+// scatterers.
+FixedScatterers::s_ptr DLL_PUBLIC loadFixedScatterersFromHdfParallel(const std::string& h5_file,
+                                                                     const ParallelHdfReadConfig& config = ParallelHdfReadConfig());
+
+// Like loadSplineScatterersFromHdf(), converting "control_points" directly
+// into the structure-of-arrays layout of SplineScatterers.
+SplineScatterers::s_ptr DLL_PUBLIC loadSplineScatterersFromHdfParallel(const std::string& h5_file,
+                                                                       const ParallelHdfReadConfig& config = ParallelHdfReadConfig());
+
+}   // end namespace
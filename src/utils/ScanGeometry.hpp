@@ -77,6 +77,63 @@ struct LinearScanGeometry : public ScanGeometry {
     }
 };
 
+// Interface for volumetric scanning geometries. The probe is at the origin
+// with x lateral, y elevational and z along the depth direction.
+struct VolumeScanGeometry {
+    typedef std::shared_ptr<VolumeScanGeometry> ptr;
+
+    virtual void get_xyz_extent(float& x_min, float& x_max, float& y_min, float& y_max,
+                                float& z_min, float& z_max) const = 0;
+};
+
+// Beams from the origin steered in a pyramid. The beam with lateral angle a
+// and elevational angle e has direction (sin(a)cos(e), sin(e), cos(a)cos(e)).
+struct PyramidScanGeometry : public VolumeScanGeometry {
+    float width_lateral;        // Lateral opening angle [radians]
+    float width_elevational;    // Elevational opening angle [radians]
+    float depth;                // Depth [meters]
+    float tilt_lateral;         // Lateral tilt [radians]
+    float tilt_elevational;     // Elevational tilt [radians]
+
+    virtual void get_xyz_extent(float& x_min, float& x_max, float& y_min, float& y_max,
+                                float& z_min, float& z_max) const {
+        float lat_min, lat_max, ele_min, ele_max;
+        get_angle_limits(lat_min, lat_max, ele_min, ele_max);
+
+        x_min = std::fmin(0.0f, depth*std::sin(lat_min));
+        x_max = std::fmax(0.0f, depth*std::sin(lat_max));
+        y_min = std::fmin(0.0f, depth*std::sin(ele_min));
+        y_max = std::fmax(0.0f, depth*std::sin(ele_max));
+        z_min = 0.0f;
+        z_max = depth;
+    }
+
+    void get_angle_limits(float& /*out*/ lat_min, float& /*out*/ lat_max,
+                          float& /*out*/ ele_min, float& /*out*/ ele_max) const {
+        lat_min = -0.5f*width_lateral + tilt_lateral;
+        lat_max =  0.5f*width_lateral + tilt_lateral;
+        ele_min = -0.5f*width_elevational + tilt_elevational;
+        ele_max =  0.5f*width_elevational + tilt_elevational;
+    }
+};
+
+// Parallel beams along z from a rectangular aperture centered at the origin.
+struct Linear3DScanGeometry : public VolumeScanGeometry {
+    float width_lateral;        // Lateral scan width [meters]
+    float width_elevational;    // Elevational scan width [meters]
+    float range_max;            // Maximum range distance [meters]
+
+    virtual void get_xyz_extent(float& x_min, float& x_max, float& y_min, float& y_max,
+                                float& z_min, float& z_max) const {
+        x_min = -0.5f*width_lateral;
+        x_max =  0.5f*width_lateral;
+        y_min = -0.5f*width_elevational;
+        y_max =  0.5f*width_elevational;
+        z_min = 0.0f;
+        z_max = range_max;
+    }
+};
+
 inline void GetCartesianDimensions(ScanGeometry::ptr geometry, float& /*out*/ width, float& /*out*/ height) {
     float x_min, x_max, y_min, y_max;
     geometry->get_xy_extent(x_min, x_max, y_min, y_max);
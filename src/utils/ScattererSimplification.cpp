@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include "ScattererSimplification.hpp"
+
+namespace bcsim {
+namespace {
+
+typedef std::array<std::int64_t, 3> CellKey;
+
+CellKey cell_key(const vector3& pos, float cell_size) {
+    return CellKey{{static_cast<std::int64_t>(std::floor(pos.x/cell_size)),
+                    static_cast<std::int64_t>(std::floor(pos.y/cell_size)),
+                    static_cast<std::int64_t>(std::floor(pos.z/cell_size))}};
+}
+
+// Sums of the squared and fourth powers of the amplitudes in a cell.
+struct CellMoments {
+    CellMoments() : sum_a2(0.0), sum_a4(0.0) { }
+
+    double contrast() const {
+        return (sum_a2 > 0.0) ? std::sqrt(std::max(0.0, 1.0 - sum_a4/(sum_a2*sum_a2))) : 0.0;
+    }
+
+    double sum_a2;
+    double sum_a4;
+};
+
+std::map<CellKey, CellMoments> resolution_cell_moments(const std::vector<PointScatterer>& scatterers, float cell_size) {
+    std::map<CellKey, CellMoments> cells;
+    for (const auto& scatterer : scatterers) {
+        const double a2 = static_cast<double>(scatterer.amplitude)*scatterer.amplitude;
+        auto& moments = cells[cell_key(scatterer.pos, cell_size)];
+        moments.sum_a2 += a2;
+        moments.sum_a4 += a2*a2;
+    }
+    return cells;
+}
+
+// Merge scatterers [begin, end) of the same voxel, taking every
+// num_representatives-th into the same representative.
+void merge_voxel(const std::vector<PointScatterer>& scatterers, const std::vector<size_t>& order, size_t begin, size_t end,
+                 int num_representatives, std::vector<PointScatterer>& result) {
+    const auto num_in_voxel = end - begin;
+    if (num_in_voxel <= static_cast<size_t>(num_representatives)) {
+        for (size_t i = begin; i < end; i++) {
+            result.push_back(scatterers[order[i]]);
+        }
+        return;
+    }
+    for (int group_no = 0; group_no < num_representatives; group_no++) {
+        double sum_a = 0.0;
+        double sum_a2 = 0.0;
+        double x = 0.0, y = 0.0, z = 0.0;
+        for (size_t i = begin + group_no; i < end; i += num_representatives) {
+            const auto& scatterer = scatterers[order[i]];
+            const double a2 = static_cast<double>(scatterer.amplitude)*scatterer.amplitude;
+            sum_a += scatterer.amplitude;
+            sum_a2 += a2;
+            x += a2*scatterer.pos.x;
+            y += a2*scatterer.pos.y;
+            z += a2*scatterer.pos.z;
+        }
+        if (sum_a2 <= 0.0) {
+            continue;
+        }
+        PointScatterer representative;
+        representative.pos = vector3(static_cast<float>(x/sum_a2), static_cast<float>(y/sum_a2), static_cast<float>(z/sum_a2));
+        representative.amplitude = static_cast<float>((sum_a < 0.0) ? -std::sqrt(sum_a2) : std::sqrt(sum_a2));
+        result.push_back(representative);
+    }
+}
+
+}   // namespace
+
+FixedScatterers::s_ptr simplify_fixed_scatterers(const FixedScatterers& scatterers,
+                                                 const ScattererSimplificationConfig& config,
+                                                 ScattererSimplificationReport& report) {
+    if (!(config.relative_amplitude_threshold >= 0.0f) || !(config.relative_amplitude_threshold < 1.0f)) {
+        throw std::runtime_error("relative amplitude threshold must be in [0, 1)");
+    }
+    if (!(config.merge_voxel_size >= 0.0f)) {
+        throw std::runtime_error("merge voxel size cannot be negative");
+    }
+    if (config.representatives_per_voxel < 1) {
+        throw std::runtime_error("need at least one representative per voxel");
+    }
+    if (!(config.resolution_cell_size > 0.0f)) {
+        throw std::runtime_error("resolution cell size must be positive");
+    }
+    const auto& input = scatterers.scatterers;
+
+    // drop the weak scatterers
+    float max_amplitude = 0.0f;
+    for (const auto& scatterer : input) {
+        max_amplitude = std::max(max_amplitude, std::abs(scatterer.amplitude));
+    }
+    const auto min_amplitude = config.relative_amplitude_threshold*max_amplitude;
+    std::vector<PointScatterer> kept;
+    kept.reserve(input.size());
+    for (const auto& scatterer : input) {
+        if ((std::abs(scatterer.amplitude) >= min_amplitude) && (scatterer.amplitude != 0.0f)) {
+            kept.push_back(scatterer);
+        }
+    }
+
+    const auto num_kept = kept.size();
+
+    auto result = std::make_shared<FixedScatterers>();
+    if (config.merge_voxel_size > 0.0f) {
+        // group the scatterers by voxel, in their original order within a voxel
+        std::vector<CellKey> keys(kept.size());
+        for (size_t i = 0; i < kept.size(); i++) {
+            keys[i] = cell_key(kept[i].pos, config.merge_voxel_size);
+        }
+        std::vector<size_t> order(kept.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+        for (size_t begin = 0; begin < order.size();) {
+            auto end = begin + 1;
+            while ((end < order.size()) && (keys[order[end]] == keys[order[begin]])) end++;
+            merge_voxel(kept, order, begin, end, config.representatives_per_voxel, result->scatterers);
+            begin = end;
+        }
+    } else {
+        result->scatterers = std::move(kept);
+    }
+
+    report.num_input_scatterers = input.size();
+    report.num_pruned_scatterers = input.size() - num_kept;
+    report.num_output_scatterers = result->scatterers.size();
+    report.speedup = report.num_output_scatterers > 0
+        ? static_cast<float>(report.num_input_scatterers)/report.num_output_scatterers : 0.0f;
+
+    // compare the speckle statistics of the resolution cells of the original
+    const auto input_cells = resolution_cell_moments(input, config.resolution_cell_size);
+    const auto output_cells = resolution_cell_moments(result->scatterers, config.resolution_cell_size);
+    double input_intensity = 0.0;
+    double output_intensity = 0.0;
+    double intensity_error = 0.0;
+    double contrast_error = 0.0;
+    for (const auto& entry : output_cells) {
+        output_intensity += entry.second.sum_a2;
+        // representatives may end up in cells without original scatterers
+        if (input_cells.find(entry.first) == input_cells.end()) {
+            intensity_error += entry.second.sum_a2;
+        }
+    }
+    for (const auto& entry : input_cells) {
+        const auto& moments = entry.second;
+        const auto it = output_cells.find(entry.first);
+        const auto output_moments = (it != output_cells.end()) ? it->second : CellMoments();
+        input_intensity += moments.sum_a2;
+        intensity_error += std::abs(output_moments.sum_a2 - moments.sum_a2);
+        contrast_error += moments.sum_a2*std::abs(output_moments.contrast() - moments.contrast());
+    }
+    if (input_intensity > 0.0) {
+        report.total_intensity_error  = static_cast<float>((output_intensity - input_intensity)/input_intensity);
+        report.mean_intensity_error   = static_cast<float>(intensity_error/input_intensity);
+        report.speckle_contrast_error = static_cast<float>(contrast_error/input_intensity);
+    } else {
+        report.total_intensity_error  = 0.0f;
+        report.mean_intensity_error   = 0.0f;
+        report.speckle_contrast_error = 0.0f;
+    }
+    return result;
+}
+
+}   // end namespace
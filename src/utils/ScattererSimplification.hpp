@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstddef>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"
+
+namespace bcsim {
+
+// Preprocessing of fixed-scatterer phantoms which trades fidelity for
+// simulation speed. Everything is disabled by default.
+struct ScattererSimplificationConfig {
+    ScattererSimplificationConfig()
+        : relative_amplitude_threshold(0.0f), merge_voxel_size(0.0f), representatives_per_voxel(1),
+          resolution_cell_size(1e-3f) { }
+
+    // Scatterers whose absolute amplitude is below this fraction of the
+    // largest absolute amplitude are dropped. In [0, 1).
+    float   relative_amplitude_threshold;
+
+    // If positive: the scatterers in each cube of this size [m] are merged
+    // into at most representatives_per_voxel scatterers, which should be well
+    // below the resolution cell. A representative is placed at the centroid
+    // of its scatterers weighted by the squared amplitudes, and has the root
+    // of the sum of their squared amplitudes, so that the mean speckle
+    // intensity of the voxel is unchanged.
+    float   merge_voxel_size;
+    int     representatives_per_voxel;
+
+    // Size [m] of the cubes in which the speckle statistics are compared,
+    // which should be about the resolution cell of the system.
+    float   resolution_cell_size;
+};
+
+// How much a simplified phantom differs from the original. In a resolution
+// cell with amplitudes a_i, the mean speckle intensity is proportional to
+// sum(a_i^2) and its contrast std(I)/mean(I) is sqrt(1 - sum(a_i^4)/sum(a_i^2)^2),
+// which is one for fully developed speckle and drops as the cell holds fewer
+// scatterers. The errors are means over the cells weighted by the original
+// intensity.
+struct ScattererSimplificationReport {
+    size_t  num_input_scatterers;
+    size_t  num_pruned_scatterers;      // dropped by the amplitude threshold
+    size_t  num_output_scatterers;
+
+    // The expected speedup of the projection, which is linear in the number
+    // of scatterers.
+    float   speedup;
+
+    // Relative change of the total intensity.
+    float   total_intensity_error;
+
+    // Mean relative change of the intensity of a resolution cell.
+    float   mean_intensity_error;
+
+    // Mean absolute change of the speckle contrast of a resolution cell.
+    float   speckle_contrast_error;
+};
+
+// Prune and merge scatterers according to the configuration. Throws on
+// invalid settings.
+FixedScatterers::s_ptr DLL_PUBLIC simplify_fixed_scatterers(const FixedScatterers& scatterers,
+                                                            const ScattererSimplificationConfig& config,
+                                                            ScattererSimplificationReport& report);
+
+}   // end namespace
@@ -0,0 +1,349 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include "SharedIqRing.hpp"
+#include "../core/iq_format.hpp"
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace bcsim {
+
+namespace {
+
+const uint32_t RING_MAGIC        = 0x51495342;   // "BSIQ"
+const uint32_t RING_VERSION      = 1;
+const size_t   RING_HEADER_BYTES = 256;
+const size_t   SLOT_HEADER_BYTES = 64;
+// polling interval of the waits for the other side of the ring
+const auto     POLL_INTERVAL     = std::chrono::microseconds(100);
+
+// The header at the start of the shared memory, with the two indices in
+// separate cache lines as they are written by different processes.
+struct RingHeader {
+    std::atomic<uint32_t>               magic;
+    uint32_t                            version;
+    uint32_t                            sample_type;
+    std::atomic<uint32_t>               closed;
+    uint64_t                            num_lines;
+    uint64_t                            num_samples;
+    uint64_t                            capacity;
+    uint64_t                            slot_bytes;
+    uint64_t                            data_offset;
+    uint64_t                            overwrite_oldest;
+    alignas(64) std::atomic<uint64_t>   write_index;
+    alignas(64) std::atomic<uint64_t>   read_index;
+};
+static_assert(offsetof(RingHeader, num_lines) == 16, "layout of the shared IQ ring header");
+static_assert(offsetof(RingHeader, write_index) == 64, "layout of the shared IQ ring header");
+static_assert(offsetof(RingHeader, read_index) == 128, "layout of the shared IQ ring header");
+static_assert(sizeof(RingHeader) <= RING_HEADER_BYTES, "layout of the shared IQ ring header");
+
+struct SlotHeader {
+    std::atomic<uint64_t>   sequence;
+    float                   timestamp;
+    float                   scale;
+};
+static_assert(sizeof(SlotHeader) <= SLOT_HEADER_BYTES, "layout of the shared IQ ring slots");
+
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1)/multiple*multiple;
+}
+
+// Sequence number of a slot when frame_no is complete in it. It is one less
+// while the frame is being written.
+uint64_t complete_sequence(uint64_t frame_no) {
+    return 2*frame_no + 2;
+}
+
+}   // end anonymous namespace
+
+struct SharedIqRingMapping {
+    // Create (replacing) or open the shared memory object name, where
+    // num_bytes is the size to create.
+    SharedIqRingMapping(const std::string& name, size_t num_bytes, bool create)
+        : name(name), address(nullptr), num_bytes(num_bytes), owner(create)
+    {
+        if (!std::atomic<uint64_t>().is_lock_free() || !std::atomic<uint32_t>().is_lock_free()) {
+            throw std::runtime_error("shared IQ rings need lock-free 64-bit atomics");
+        }
+#ifdef _WIN32
+        throw std::runtime_error("shared IQ rings need POSIX shared memory");
+#else
+        int fd;
+        if (create) {
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        } else {
+            fd = shm_open(name.c_str(), O_RDWR, 0);
+        }
+        if (fd < 0) {
+            throw std::runtime_error("failed to open shared memory " + name);
+        }
+        struct stat info;
+        if (create ? (ftruncate(fd, static_cast<off_t>(num_bytes)) != 0) : (fstat(fd, &info) != 0)) {
+            close(fd);
+            if (create) shm_unlink(name.c_str());
+            throw std::runtime_error("failed to size shared memory " + name);
+        }
+        if (!create) {
+            this->num_bytes = static_cast<size_t>(info.st_size);
+        }
+        if (this->num_bytes < RING_HEADER_BYTES) {
+            close(fd);
+            throw std::runtime_error("shared memory " + name + " is not an IQ ring");
+        }
+        address = mmap(nullptr, this->num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) {
+            address = nullptr;
+            if (create) shm_unlink(name.c_str());
+            throw std::runtime_error("failed to map shared memory " + name);
+        }
+#endif
+    }
+
+    ~SharedIqRingMapping() {
+#ifndef _WIN32
+        if (address) {
+            munmap(address, num_bytes);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+#endif
+    }
+
+    RingHeader* header() const {
+        return static_cast<RingHeader*>(address);
+    }
+
+    SlotHeader* slot(uint64_t frame_no) const {
+        const auto h = header();
+        return reinterpret_cast<SlotHeader*>(static_cast<char*>(address) + h->data_offset + (frame_no % h->capacity)*h->slot_bytes);
+    }
+
+    char* samples(uint64_t frame_no) const {
+        return reinterpret_cast<char*>(slot(frame_no)) + SLOT_HEADER_BYTES;
+    }
+
+    const std::string   name;
+    void*               address;
+    size_t              num_bytes;
+    const bool          owner;
+};
+
+SharedIqRingWriter::SharedIqRingWriter(const std::string& name, size_t num_lines, size_t num_samples, size_t capacity,
+                                       const IqOutputFormat& format, bool overwrite_oldest, int wait_timeout_ms)
+    : m_num_lines(num_lines),
+      m_num_samples(num_samples),
+      m_capacity(capacity),
+      m_format(format),
+      m_overwrite_oldest(overwrite_oldest),
+      m_wait_timeout_ms(wait_timeout_ms),
+      m_frame_begun(false)
+{
+    if ((num_lines == 0) || (num_samples == 0)) {
+        throw std::runtime_error("IQ frames must have lines and samples");
+    }
+    if (capacity == 0) {
+        throw std::runtime_error("shared IQ ring must have room for frames");
+    }
+    // the slots start at cache lines, and so do the samples
+    const auto frame_bytes = num_lines*num_samples*iq_sample_bytes(format.sample_type);
+    const auto slot_bytes = round_up(SLOT_HEADER_BYTES + frame_bytes, SLOT_HEADER_BYTES);
+    m_mapping = std::unique_ptr<SharedIqRingMapping>(new SharedIqRingMapping(name, RING_HEADER_BYTES + capacity*slot_bytes, true));
+
+    // the new object is zero-filled, so the indices and sequence numbers start at zero
+    auto header = m_mapping->header();
+    header->sample_type      = static_cast<uint32_t>(format.sample_type);
+    header->num_lines        = num_lines;
+    header->num_samples      = num_samples;
+    header->capacity         = capacity;
+    header->slot_bytes       = slot_bytes;
+    header->data_offset      = RING_HEADER_BYTES;
+    header->overwrite_oldest = overwrite_oldest ? 1 : 0;
+    header->version          = RING_VERSION;
+    // readers check the magic number first
+    header->magic.store(RING_MAGIC, std::memory_order_release);
+}
+
+SharedIqRingWriter::~SharedIqRingWriter() {
+    m_mapping->header()->closed.store(1, std::memory_order_release);
+}
+
+void* SharedIqRingWriter::begin_frame() {
+    auto header = m_mapping->header();
+    const auto frame_no = header->write_index.load(std::memory_order_relaxed);
+    if (!m_frame_begun) {
+        if (!m_overwrite_oldest) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_wait_timeout_ms);
+            while (frame_no - header->read_index.load(std::memory_order_acquire) >= m_capacity) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    throw std::runtime_error("consumer of shared IQ ring did not release a frame in time");
+                }
+                std::this_thread::sleep_for(POLL_INTERVAL);
+            }
+        }
+        // readers of the overwritten frame see an odd sequence number
+        m_mapping->slot(frame_no)->sequence.store(complete_sequence(frame_no) - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_frame_begun = true;
+    }
+    return m_mapping->samples(frame_no);
+}
+
+void SharedIqRingWriter::commit_frame(float timestamp, float scale) {
+    if (!m_frame_begun) {
+        throw std::runtime_error("no frame to commit to shared IQ ring");
+    }
+    auto header = m_mapping->header();
+    const auto frame_no = header->write_index.load(std::memory_order_relaxed);
+    auto slot = m_mapping->slot(frame_no);
+    slot->timestamp = timestamp;
+    slot->scale = scale;
+    slot->sequence.store(complete_sequence(frame_no), std::memory_order_release);
+    header->write_index.store(frame_no + 1, std::memory_order_release);
+    m_frame_begun = false;
+}
+
+void SharedIqRingWriter::write(const std::complex<float>* iq_buffer, size_t line_stride, float timestamp) {
+    if (line_stride < m_num_samples) {
+        throw std::runtime_error("line stride is less than the number of IQ samples per line");
+    }
+    auto scale = 1.0f;
+    if (m_format.sample_type == IqOutputFormat::SampleType::COMPLEX_INT16) {
+        scale = m_format.int16_scale;
+        if (scale == 0.0f) {
+            float max_abs_component = 0.0f;
+            for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+                max_abs_component = std::max(max_abs_component, max_abs_iq_component(iq_buffer + line_no*line_stride, m_num_samples));
+            }
+            scale = int16_frame_scale(max_abs_component);
+        }
+    }
+    auto dest = static_cast<char*>(begin_frame());
+    const auto line_bytes = m_num_samples*iq_sample_bytes(m_format.sample_type);
+    for (size_t line_no = 0; line_no < m_num_lines; line_no++) {
+        convert_iq_samples(iq_buffer + line_no*line_stride, m_num_samples, m_format.sample_type, scale,
+                           dest + line_no*line_bytes);
+    }
+    commit_frame(timestamp, scale);
+}
+
+uint64_t SharedIqRingWriter::get_end_frame_no() const {
+    return m_mapping->header()->write_index.load(std::memory_order_relaxed);
+}
+
+SharedIqRingReader::SharedIqRingReader(const std::string& name)
+    : m_mapping(new SharedIqRingMapping(name, 0, false))
+{
+    auto header = m_mapping->header();
+    if ((header->magic.load(std::memory_order_acquire) != RING_MAGIC) || (header->version != RING_VERSION)) {
+        throw std::runtime_error("shared memory " + name + " is not an IQ ring of this version");
+    }
+    if (m_mapping->num_bytes < header->data_offset + header->capacity*header->slot_bytes) {
+        throw std::runtime_error("shared memory " + name + " is smaller than its IQ ring");
+    }
+}
+
+SharedIqRingReader::~SharedIqRingReader() { }
+
+size_t SharedIqRingReader::get_num_lines() const {
+    return static_cast<size_t>(m_mapping->header()->num_lines);
+}
+
+size_t SharedIqRingReader::get_num_samples() const {
+    return static_cast<size_t>(m_mapping->header()->num_samples);
+}
+
+size_t SharedIqRingReader::get_capacity() const {
+    return static_cast<size_t>(m_mapping->header()->capacity);
+}
+
+IqOutputFormat::SampleType SharedIqRingReader::get_sample_type() const {
+    return static_cast<IqOutputFormat::SampleType>(m_mapping->header()->sample_type);
+}
+
+uint64_t SharedIqRingReader::get_end_frame_no() const {
+    return m_mapping->header()->write_index.load(std::memory_order_acquire);
+}
+
+bool SharedIqRingReader::is_closed() const {
+    return m_mapping->header()->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool SharedIqRingReader::wait_for_frame(uint64_t frame_no, int timeout_ms) const {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (get_end_frame_no() <= frame_no) {
+        if (is_closed() || (std::chrono::steady_clock::now() > deadline)) {
+            // the last frame may have been written just before closing
+            return get_end_frame_no() > frame_no;
+        }
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+    return true;
+}
+
+bool SharedIqRingReader::map_frame(uint64_t frame_no, FrameView& view) const {
+    const auto slot = m_mapping->slot(frame_no);
+    if (slot->sequence.load(std::memory_order_acquire) != complete_sequence(frame_no)) {
+        return false;
+    }
+    view.samples   = m_mapping->samples(frame_no);
+    view.frame_no  = frame_no;
+    view.timestamp = slot->timestamp;
+    view.scale     = slot->scale;
+    // the timestamp and scale are of this frame if it is still there
+    return is_valid(view);
+}
+
+bool SharedIqRingReader::is_valid(const FrameView& view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_mapping->slot(view.frame_no)->sequence.load(std::memory_order_relaxed) == complete_sequence(view.frame_no);
+}
+
+void SharedIqRingReader::release_frames(uint64_t end_frame_no) {
+    auto& read_index = m_mapping->header()->read_index;
+    end_frame_no = std::min(end_frame_no, get_end_frame_no());
+    auto released = read_index.load(std::memory_order_relaxed);
+    while ((released < end_frame_no)
+           && !read_index.compare_exchange_weak(released, end_frame_no, std::memory_order_release, std::memory_order_relaxed)) { }
+}
+
+}   // namespace
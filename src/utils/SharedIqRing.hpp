@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "../core/export_macros.hpp"
+#include "../core/BCSimConfig.hpp"   // for IqOutputFormat
+
+namespace bcsim {
+
+// The mapped shared memory of a ring, see SharedIqRing.cpp.
+struct SharedIqRingMapping;
+
+// A ring of IQ frames in a named POSIX shared memory object, so that other
+// processes can read the frames as they are produced without copying them.
+// There is one writer, and the frames are numbered in the order they are
+// written. Each frame is stored contiguously with the [line][sample] layout
+// of IAlgorithm::simulate_lines_formatted() in the sample type of the ring.
+//
+// The writer and the readers only synchronize through atomic indices in the
+// shared memory: the number of frames written, the number of frames released
+// by the consumer, and a sequence number of each slot which is odd while the
+// slot is being written. A reader which maps a frame checks the sequence
+// number again after reading, so that a frame overwritten meanwhile is
+// detected. If the ring does not overwrite frames, the writer instead waits
+// for the consumer to release the oldest frame.
+//
+// Layout for consumers in other languages (little-endian, byte offsets):
+//   header, 256 bytes:
+//     0   uint32  magic 0x51495342 ("BSIQ")
+//     4   uint32  version (1)
+//     8   uint32  sample type of IqOutputFormat
+//     12  uint32  nonzero when the writer is closed
+//     16  uint64  number of lines
+//     24  uint64  number of samples per line
+//     32  uint64  capacity in frames
+//     40  uint64  bytes per slot
+//     48  uint64  offset of the first slot
+//     56  uint64  nonzero if the oldest frames are overwritten
+//     64  uint64  number of frames written
+//     128 uint64  number of frames released by the consumer
+//   slot of frame n at data offset + (n % capacity)*slot bytes:
+//     0   uint64  sequence number, 2n + 2 when frame n is complete
+//     8   float32 timestamp
+//     12  float32 int16 scale (one for other sample types)
+//     64  the samples
+class DLL_PUBLIC SharedIqRingWriter {
+public:
+    // Creates the shared memory object name (e.g. "/bcsim_iq"), replacing an
+    // existing one, with room for capacity frames. If overwrite_oldest is
+    // false, begin_frame() waits up to wait_timeout_ms for the consumer to
+    // release the oldest frame when the ring is full, and throws otherwise.
+    SharedIqRingWriter(const std::string& name, size_t num_lines, size_t num_samples, size_t capacity,
+                       const IqOutputFormat& format = IqOutputFormat(), bool overwrite_oldest = true,
+                       int wait_timeout_ms = 1000);
+
+    // Marks the ring as closed for the readers and removes the name. Mapped
+    // readers keep the memory until they are destroyed.
+    ~SharedIqRingWriter();
+
+    // The storage of the next frame, with lines num_samples samples apart,
+    // e.g. for IAlgorithm::simulate_lines_formatted(). The frame is not
+    // visible to the readers until commit_frame().
+    void* begin_frame();
+
+    // Publish the frame of the last begin_frame() with the scale returned by
+    // simulate_lines_formatted().
+    void commit_frame(float timestamp, float scale = 1.0f);
+
+    // Convert and publish a frame with the layout of IAlgorithm::simulate_lines().
+    void write(const std::complex<float>* iq_buffer, size_t line_stride, float timestamp);
+
+    size_t get_num_lines() const      { return m_num_lines; }
+    size_t get_num_samples() const    { return m_num_samples; }
+    size_t get_capacity() const       { return m_capacity; }
+
+    // Number of frames written so far.
+    uint64_t get_end_frame_no() const;
+
+private:
+    const size_t                m_num_lines;
+    const size_t                m_num_samples;
+    const size_t                m_capacity;
+    const IqOutputFormat        m_format;
+    const bool                  m_overwrite_oldest;
+    const int                   m_wait_timeout_ms;
+    std::unique_ptr<SharedIqRingMapping>  m_mapping;
+    // true between begin_frame() and commit_frame()
+    bool                        m_frame_begun;
+};
+
+// Maps the frames of a SharedIqRingWriter in another process (or thread).
+class DLL_PUBLIC SharedIqRingReader {
+public:
+    // A frame in the shared memory. The samples are only valid if
+    // is_valid() is true after they have been read.
+    struct FrameView {
+        const void*     samples;
+        uint64_t        frame_no;
+        float           timestamp;
+        float           scale;
+    };
+
+    // Opens an existing ring. Throws if it does not exist or is invalid.
+    explicit SharedIqRingReader(const std::string& name);
+
+    ~SharedIqRingReader();
+
+    size_t get_num_lines() const;
+    size_t get_num_samples() const;
+    size_t get_capacity() const;
+    IqOutputFormat::SampleType get_sample_type() const;
+
+    // Number of frames written so far, where the oldest frame still in the
+    // ring is at most get_capacity() frames earlier.
+    uint64_t get_end_frame_no() const;
+
+    // True when the writer has been destroyed.
+    bool is_closed() const;
+
+    // Wait up to timeout_ms until frame_no has been written. Returns false on
+    // timeout or if the writer was closed first.
+    bool wait_for_frame(uint64_t frame_no, int timeout_ms) const;
+
+    // Map frame frame_no without copying. Returns false if it has not been
+    // written yet or has been overwritten.
+    bool map_frame(uint64_t frame_no, FrameView& view) const;
+
+    // True if the frame has not been overwritten since map_frame().
+    bool is_valid(const FrameView& view) const;
+
+    // Let a writer which does not overwrite frames reuse the slots of the
+    // frames before end_frame_no.
+    void release_frames(uint64_t end_frame_no);
+
+private:
+    std::unique_ptr<SharedIqRingMapping>  m_mapping;
+};
+
+}   // namespace
@@ -32,6 +32,63 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdexcept>
 #include <vector>
 #include "SignalProcessing.hpp"
+#include "../core/fft.hpp"
+
+namespace {
+
+inline void store_sample(float& dst, const std::complex<float>& v) { dst = v.real(); }
+inline void store_sample(double& dst, const std::complex<double>& v) { dst = v.real(); }
+template <typename T>
+void store_sample(std::complex<T>& dst, const std::complex<T>& v) { dst = v; }
+
+// FFT length for overlap-save with a kernel of the given length producing
+// num_out samples. About eight times the kernel length is the fastest.
+size_t overlap_save_fft_length(size_t kernel_length, size_t num_out) {
+    return std::min(next_power_of_two(8*kernel_length), next_smooth_size(num_out + kernel_length - 1));
+}
+
+// FFT of a real kernel zero-padded to the plan length.
+template <typename T>
+std::vector<std::complex<T> > kernel_fft(const std::vector<T>& kernel, const FftPlan<T>& plan) {
+    std::vector<std::complex<T> > res(plan.size(), std::complex<T>(0.0, 0.0));
+    std::copy(kernel.begin(), kernel.end(), res.begin());
+    plan.forward(res.data());
+    return res;
+}
+
+// Overlap-save convolution of the num_samples samples x with a kernel of
+// kernel_length samples whose FFT with plan is kernel_fft. The samples
+// first_out..first_out+num_out-1 of the full convolution are written to y.
+// scratch must have room for plan.size() values.
+template <typename T, typename S>
+void overlap_save(const S* x, size_t num_samples, const FftPlan<T>& plan, const std::complex<T>* kernel_fft,
+                  size_t kernel_length, size_t first_out, size_t num_out, S* y, std::complex<T>* scratch) {
+    const auto fft_length = plan.size();
+    const auto overlap = kernel_length - 1;
+    const auto block_length = fft_length - overlap;
+    for (size_t out_no = 0; out_no < num_out; out_no += block_length) {
+        // the block of output samples k0.. needs the input samples k0-overlap..
+        const auto x_start = static_cast<std::ptrdiff_t>(first_out + out_no) - static_cast<std::ptrdiff_t>(overlap);
+        for (size_t i = 0; i < fft_length; i++) {
+            const auto x_idx = x_start + static_cast<std::ptrdiff_t>(i);
+            const bool inside = (x_idx >= 0) && (x_idx < static_cast<std::ptrdiff_t>(num_samples));
+            scratch[i] = inside ? std::complex<T>(x[x_idx]) : std::complex<T>(0.0, 0.0);
+        }
+        plan.forward(scratch);
+        for (size_t i = 0; i < fft_length; i++) {
+            scratch[i] *= kernel_fft[i];
+        }
+        plan.inverse(scratch);
+
+        // the first overlap samples are wrapped around
+        const auto count = std::min(block_length, num_out - out_no);
+        for (size_t i = 0; i < count; i++) {
+            store_sample(y[out_no + i], scratch[overlap + i]);
+        }
+    }
+}
+
+}
 
 template <typename T>
 std::vector<T> HammingWindow(size_t length) {
@@ -103,6 +160,83 @@ std::vector<T> direct_conv(const std::vector<T>& v1, const std::vector<T>& v2) {
     return res;
 }
 
+template <typename T>
+std::vector<T> overlap_save_conv(const std::vector<T>& v1, const std::vector<T>& v2) {
+    if (v1.empty() || v2.empty()) {
+        throw std::runtime_error("Cannot convolve empty vectors");
+    }
+    const auto& x      = (v1.size() >= v2.size()) ? v1 : v2;
+    const auto& kernel = (v1.size() >= v2.size()) ? v2 : v1;
+
+    const auto res_size = x.size() + kernel.size() - 1;
+    const auto plan = FftPlan<T>::get(overlap_save_fft_length(kernel.size(), res_size));
+    const auto h_fft = kernel_fft(kernel, *plan);
+    std::vector<std::complex<T> > scratch(plan->size());
+    std::vector<T> res(res_size);
+    overlap_save(x.data(), x.size(), *plan, h_fft.data(), kernel.size(), 0, res_size, res.data(), scratch.data());
+    return res;
+}
+
+template <typename T>
+std::vector<T> conv(const std::vector<T>& v1, const std::vector<T>& v2) {
+    if (std::min(v1.size(), v2.size()) < FFT_CONV_CROSSOVER) {
+        return direct_conv(v1, v2);
+    }
+    return overlap_save_conv(v1, v2);
+}
+
+template <typename T>
+void filter_lines(const std::complex<T>* lines, size_t num_lines, size_t num_samples,
+                  size_t line_stride, const std::vector<T>& filter, std::complex<T>* filtered) {
+    if (filter.empty()) {
+        throw std::runtime_error("Empty filter");
+    }
+    if (line_stride < num_samples) {
+        throw std::runtime_error("Line stride must be at least the number of samples");
+    }
+    const auto filter_length = static_cast<std::ptrdiff_t>(filter.size());
+    const auto delay = (filter_length - 1)/2;
+    const auto num_lines_int = static_cast<int>(num_lines);
+
+    if (filter.size() < FFT_CONV_CROSSOVER) {
+        #pragma omp parallel
+        {
+            // a copy of the line, which allows in-place filtering
+            std::vector<std::complex<T> > line(num_samples);
+            #pragma omp for
+            for (int line_no = 0; line_no < num_lines_int; line_no++) {
+                std::copy(lines + line_no*line_stride, lines + line_no*line_stride + num_samples, line.begin());
+                auto dst = filtered + line_no*num_samples;
+                const auto n = static_cast<std::ptrdiff_t>(num_samples);
+                for (std::ptrdiff_t i = 0; i < n; i++) {
+                    // dst[i] = sum_j h[j]*x[i+delay-j] over valid x indices
+                    const auto j_min = std::max<std::ptrdiff_t>(0, i + delay - n + 1);
+                    const auto j_max = std::min<std::ptrdiff_t>(filter_length - 1, i + delay);
+                    std::complex<T> sum(0.0, 0.0);
+                    for (std::ptrdiff_t j = j_min; j <= j_max; j++) {
+                        sum += filter[j]*line[i + delay - j];
+                    }
+                    dst[i] = sum;
+                }
+            }
+        }
+    } else {
+        const auto plan = FftPlan<T>::get(overlap_save_fft_length(filter.size(), num_samples));
+        const auto h_fft = kernel_fft(filter, *plan);
+        #pragma omp parallel
+        {
+            std::vector<std::complex<T> > line(num_samples);
+            std::vector<std::complex<T> > scratch(plan->size());
+            #pragma omp for
+            for (int line_no = 0; line_no < num_lines_int; line_no++) {
+                std::copy(lines + line_no*line_stride, lines + line_no*line_stride + num_samples, line.begin());
+                overlap_save(line.data(), num_samples, *plan, h_fft.data(), filter.size(), delay,
+                             num_samples, filtered + line_no*num_samples, scratch.data());
+            }
+        }
+    }
+}
+
 // Explicit instantiations since templates cannot be exported in DLL.
 template std::vector<float>  HammingWindow<float>(size_t length);
 template std::vector<double> HammingWindow<double>(size_t length);
@@ -111,3 +245,11 @@ template std::vector<double> FirWin(int length, double fc);
 template std::vector<float>  direct_conv(const std::vector<float>& v1, const std::vector<float>& v2);
 template std::vector<double> direct_conv(const std::vector<double>& v1, const std::vector<double>& v2);
 template std::vector<int>    direct_conv(const std::vector<int>& v1, const std::vector<int>& v2);
+template std::vector<float>  overlap_save_conv(const std::vector<float>& v1, const std::vector<float>& v2);
+template std::vector<double> overlap_save_conv(const std::vector<double>& v1, const std::vector<double>& v2);
+template std::vector<float>  conv(const std::vector<float>& v1, const std::vector<float>& v2);
+template std::vector<double> conv(const std::vector<double>& v1, const std::vector<double>& v2);
+template void filter_lines(const std::complex<float>* lines, size_t num_lines, size_t num_samples,
+                           size_t line_stride, const std::vector<float>& filter, std::complex<float>* filtered);
+template void filter_lines(const std::complex<double>* lines, size_t num_lines, size_t num_samples,
+                           size_t line_stride, const std::vector<double>& filter, std::complex<double>* filtered);
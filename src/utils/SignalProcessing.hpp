@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <complex>
 #include <vector>
 #include "../core/export_macros.hpp"
 
@@ -46,3 +47,29 @@ std::vector<T> DLL_PUBLIC FirWin(int length, T fc);
 // Computes the discrete convolution of two vectors directly using the definition.
 template <typename T>
 std::vector<T> DLL_PUBLIC direct_conv(const std::vector<T>& v1, const std::vector<T>& v2);
+
+// Computes the discrete convolution of two vectors with FFTs, using the
+// overlap-save method with blocks of the longer vector.
+template <typename T>
+std::vector<T> DLL_PUBLIC overlap_save_conv(const std::vector<T>& v1, const std::vector<T>& v2);
+
+// Kernel length from which overlap-save is faster than direct convolution.
+// Found by benchmarking signals of 1000-100000 samples on the CPU.
+const size_t FFT_CONV_CROSSOVER = 128;
+
+// Computes the discrete convolution of two vectors with direct_conv() if the
+// shorter vector has fewer than FFT_CONV_CROSSOVER samples, and with
+// overlap_save_conv() otherwise.
+template <typename T>
+std::vector<T> DLL_PUBLIC conv(const std::vector<T>& v1, const std::vector<T>& v2);
+
+// Filter num_lines IQ lines of num_samples samples each with a real FIR
+// filter, e.g. from FirWin(). Line i starts at lines + i*line_stride. The
+// output has the samples of the convolution that are centered on the input,
+// i.e. delayed by (filter length-1)/2, and line i of the output is stored at
+// filtered + i*num_samples. filtered may be equal to lines if line_stride
+// equals num_samples. Lines are filtered in parallel, choosing between direct
+// convolution and overlap-save as conv() does.
+template <typename T>
+void DLL_PUBLIC filter_lines(const std::complex<T>* lines, size_t num_lines, size_t num_samples,
+                             size_t line_stride, const std::vector<T>& filter, std::complex<T>* filtered);
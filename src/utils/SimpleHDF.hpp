@@ -156,6 +156,16 @@ public:
         H5::DataSet dataset = hdf5_file.openDataSet(dataset_name);
         return getDimensions(dataset);
     }
+
+    // Whether the file has a data set (or other object) with the given name.
+    bool hasDataSet(const std::string& dataset_name) {
+        return H5Lexists(hdf5_file.getId(), dataset_name.c_str(), H5P_DEFAULT) > 0;
+    }
+
+    // Open a data set, e.g. for reading a hyperslab of it.
+    H5::DataSet openDataSet(const std::string& dataset_name) {
+        return hdf5_file.openDataSet(dataset_name);
+    }
        
     ~SimpleHDF5Reader() {
         hdf5_file.close();   
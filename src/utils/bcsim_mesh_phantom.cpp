@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fill a closed Wavefront OBJ mesh, e.g. an organ surface, with scatterers
+// and write them to a binary phantom file. With --num_cs, the scatterers
+// are spline scatterers that contract towards the center of the mesh with
+// a raised cosine over [0, 1] s.
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "MeshPhantom.hpp"
+#include "BinaryPhantom.hpp"
+
+namespace {
+
+int run(int argc, char** argv) {
+    std::string mesh_file;
+    std::string output_file;
+    float scale;
+    bcsim::MeshPhantomConfig config;
+    int num_cs;
+    int spline_degree;
+    float contraction;
+
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "show help message")
+        ("mesh", po::value<std::string>(&mesh_file)->required(), "closed triangle mesh in Wavefront OBJ format")
+        ("output", po::value<std::string>(&output_file)->required(), "binary phantom file to write")
+        ("scale", po::value<float>(&scale)->default_value(1e-3f), "meters per mesh unit")
+        ("density", po::value<double>(&config.density)->default_value(1e9), "scatterers per m^3")
+        ("shell", po::value<float>(&config.shell_thickness)->default_value(0.0f),
+            "if positive, only fill this distance [m] inside the surface")
+        ("amplitude", po::value<float>(&config.amplitude_scale)->default_value(1.0f), "standard deviation of the amplitudes")
+        ("seed", po::value<uint64_t>(&config.seed)->default_value(0), "random seed")
+        ("num_cs", po::value<int>(&num_cs)->default_value(0), "control points of spline scatterers (0: fixed scatterers)")
+        ("spline_degree", po::value<int>(&spline_degree)->default_value(2), "degree of spline scatterers")
+        ("contraction", po::value<float>(&contraction)->default_value(0.2f), "largest relative contraction of spline scatterers")
+    ;
+    po::variables_map var_map;
+    po::store(po::parse_command_line(argc, argv, desc), var_map);
+    if (var_map.count("help") != 0) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    po::notify(var_map);
+
+    const auto mesh = bcsim::load_obj_mesh(mesh_file, scale);
+    const bcsim::MeshVolume volume(mesh);
+    std::cerr << "Loaded " << mesh.num_triangles() << " triangles into " << volume.get_num_nodes() << " BVH nodes" << std::endl;
+    if (num_cs == 0) {
+        const auto scatterers = bcsim::create_mesh_fixed_scatterers(volume, config);
+        std::cerr << "Created " << scatterers->num_scatterers() << " fixed scatterers" << std::endl;
+        bcsim::savePhantomToBinary(output_file, scatterers.get(), nullptr);
+    } else {
+        const auto center = (volume.get_min_corner() + volume.get_max_corner())*0.5f;
+        const float PI = 3.14159265358979f;
+        const auto motion = [=](const bcsim::vector3& p, float t) {
+            const auto factor = 1.0f - contraction*0.5f*(1.0f - std::cos(2.0f*PI*t));
+            return center + (p - center)*factor;
+        };
+        const auto scatterers = bcsim::create_mesh_spline_scatterers(volume, config, motion, spline_degree, num_cs, 0.0f, 1.0f);
+        std::cerr << "Created " << scatterers->num_scatterers() << " spline scatterers" << std::endl;
+        bcsim::savePhantomToBinary(output_file, nullptr, scatterers.get());
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Caught exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
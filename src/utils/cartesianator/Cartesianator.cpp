@@ -35,13 +35,20 @@ template <typename T>
 CpuCartesianator<T>::CpuCartesianator() 
     : m_num_samples_x(512),
       m_num_samples_y(512),
-      m_geometry(nullptr)
+      m_geometry(nullptr),
+      m_lookup_num_beams(0),
+      m_lookup_num_range(0)
 {
     UpdateOutputBuffer();           
 }
 
 template <typename T>
 void CpuCartesianator<T>::SetGeometry(bcsim::ScanGeometry::ptr geometry) {
+    auto parameters = GetGeometryParameters(geometry);
+    if (parameters != m_lookup_geometry) {
+        m_lookup_geometry = std::move(parameters);
+        m_lookup_table.clear();
+    }
     m_geometry = geometry;
     geometry->get_xy_extent(m_x_min, m_x_max, m_y_min, m_y_max);
 }
@@ -54,6 +61,9 @@ const T* CpuCartesianator<T>::GetOutputBuffer() {
 template <typename T>
 void CpuCartesianator<T>::SetOutputSize(size_t num_samples_x,
                                         size_t num_samples_y) {
+    if ((num_samples_x != m_num_samples_x) || (num_samples_y != m_num_samples_y)) {
+        m_lookup_table.clear();
+    }
     m_num_samples_x = num_samples_x;
     m_num_samples_y = num_samples_y;
     UpdateOutputBuffer();
@@ -71,26 +81,91 @@ void CpuCartesianator<T>::Process(T* in_buffer, int num_beams, int num_samples)
     if (!m_geometry) {
         throw std::runtime_error("geometry not configured");
     }
+    if (m_lookup_table.empty() || (num_beams != m_lookup_num_beams) || (num_samples != m_lookup_num_range)) {
+        BuildLookupTable(num_beams, num_samples);
+    }
+
+    const auto num_outputs = static_cast<int>(m_lookup_table.size());
+    const auto lookup_table = m_lookup_table.data();
+    const auto output_buffer = m_output_buffer.data();
+    #pragma omp parallel for
+    for (int i = 0; i < num_outputs; i++) {
+        const auto& entry = lookup_table[i];
+        const float value = entry.weights[0]*in_buffer[entry.indices[0]]
+                           +entry.weights[1]*in_buffer[entry.indices[1]]
+                           +entry.weights[2]*in_buffer[entry.indices[2]]
+                           +entry.weights[3]*in_buffer[entry.indices[3]];
+        output_buffer[i] = static_cast<T>(value);
+    }
+}
+
+template <typename T>
+void CpuCartesianator<T>::UpdateOutputBuffer() {
+    auto num_samples = m_num_samples_x*m_num_samples_y;
+    m_output_buffer.resize(num_samples);
+}
+
+template <typename T>
+std::vector<float> CpuCartesianator<T>::GetGeometryParameters(bcsim::ScanGeometry::ptr geometry) {
+    auto sector_geo = std::dynamic_pointer_cast<bcsim::SectorScanGeometry>(geometry);
+    auto linear_geo = std::dynamic_pointer_cast<bcsim::LinearScanGeometry>(geometry);
+    if (sector_geo) {
+        return {0.0f, sector_geo->width, sector_geo->depth, sector_geo->tilt};
+    } else if (linear_geo) {
+        return {1.0f, linear_geo->width, linear_geo->range_max};
+    } else {
+        throw std::runtime_error("unknown geometry");
+    }
+}
+
+template <typename T>
+void CpuCartesianator<T>::BuildLookupTable(int num_beams, int num_range) {
     auto sector_geo = std::dynamic_pointer_cast<bcsim::SectorScanGeometry>(m_geometry);
     auto linear_geo = std::dynamic_pointer_cast<bcsim::LinearScanGeometry>(m_geometry);
+    m_lookup_table.resize(m_num_samples_x*m_num_samples_y);
     if (sector_geo) {
-        DoSectorTransform(in_buffer, num_beams, num_samples, sector_geo);
+        BuildSectorTable(num_beams, num_range, sector_geo);
     } else if (linear_geo) {
-        DoLinearTransform(in_buffer, num_beams, num_samples, linear_geo);
+        BuildLinearTable(num_beams, num_range, linear_geo);
     } else {
         throw std::runtime_error("unknown geometry");
     }
+    m_lookup_num_beams = num_beams;
+    m_lookup_num_range = num_range;
 }
 
 template <typename T>
-void CpuCartesianator<T>::UpdateOutputBuffer() {
-    auto num_samples = m_num_samples_x*m_num_samples_y;
-    m_output_buffer.resize(num_samples);
+typename CpuCartesianator<T>::LookupEntry CpuCartesianator<T>::MakeEntry(float range, float r_min, float dr, int num_range,
+                                                                     float beam, float b_min, float db, int num_beams) {
+    const int r_idx0 = static_cast<int>(std::floor( (range - r_min) / dr ));
+    const int b_idx0 = static_cast<int>(std::floor( (beam - b_min) / db ));
+    const float range0 = r_min + r_idx0*dr;
+    const float range1 = range0 + dr;
+    const float beam0  = b_min + b_idx0*db;
+    const float beam1  = beam0 + db;
+
+    // Use Wikipedia formula
+    const float scale = 1.0f/((range1-range0)*(beam1-beam0));
+    const float weights[4] = {scale*(range1-range)*(beam1-beam),
+                              scale*(range1-range)*(beam-beam0),
+                              scale*(range-range0)*(beam1-beam),
+                              scale*(range-range0)*(beam-beam0)};
+
+    // order: (r0, b0), (r0, b1), (r1, b0), (r1, b1)
+    LookupEntry entry;
+    for (int i = 0; i < 4; i++) {
+        const int r_idx = r_idx0 + i/2;
+        const int b_idx = b_idx0 + i%2;
+        const bool inside = (r_idx >= 0 && r_idx < num_range && b_idx >= 0 && b_idx < num_beams);
+        entry.indices[i] = inside ? static_cast<uint32_t>(num_range*b_idx + r_idx) : 0u;
+        entry.weights[i] = inside ? weights[i] : 0.0f;
+    }
+    return entry;
 }
 
 template <typename T>
-void CpuCartesianator<T>::DoSectorTransform(T* in_buffer, int num_beams, int num_range,
-                                            std::shared_ptr<bcsim::SectorScanGeometry> geometry) {
+void CpuCartesianator<T>::BuildSectorTable(int num_beams, int num_range,
+                                           std::shared_ptr<bcsim::SectorScanGeometry> geometry) {
 
     // deltas for cartesian grid
     const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
@@ -106,9 +181,10 @@ void CpuCartesianator<T>::DoSectorTransform(T* in_buffer, int num_beams, int num
     const auto dr = (range_max - range_min) / (num_range-1);
     const auto dt = (theta_max - theta_min) / (num_beams-1);
 
-    // For each output sample determine index of closest beamspace sample
-    for (size_t xi = 0; xi < m_num_samples_x; xi++) {
-        for (size_t yi = 0; yi < m_num_samples_y; yi++) {
+    const auto num_samples_y = static_cast<int>(m_num_samples_y);
+    #pragma omp parallel for
+    for (int yi = 0; yi < num_samples_y; yi++) {
+        for (size_t xi = 0; xi < m_num_samples_x; xi++) {
             float x = m_x_min + xi*dx;
             float y = m_y_min + yi*dy;
 
@@ -121,39 +197,15 @@ void CpuCartesianator<T>::DoSectorTransform(T* in_buffer, int num_beams, int num
                 // Avoid division by zero. TODO: Can this be solved more elegant?
                 theta = static_cast<float>(std::atan(1)*2);
             }
-
-            float value = 0.0f;
-
-            int r_idx0 = static_cast<int>(std::floor( (r - range_min) / dr ));
-            int t_idx0 = static_cast<int>(std::floor( (theta - theta_min) / dt));
-            int r_idx1 = r_idx0 + 1;
-            int t_idx1 = t_idx0 + 1;
-
-            float sample00 = (r_idx0 >= 0 && r_idx0 < num_range && t_idx0 >= 0 && t_idx0 < num_beams) ? in_buffer[num_range*t_idx0 + r_idx0] : 0.0f;
-            float sample01 = (r_idx0 >= 0 && r_idx0 < num_range && t_idx1 >= 0 && t_idx1 < num_beams) ? in_buffer[num_range*t_idx1 + r_idx0] : 0.0f;
-            float sample10 = (r_idx1 >= 0 && r_idx1 < num_range && t_idx0 >= 0 && t_idx0 < num_beams) ? in_buffer[num_range*t_idx0 + r_idx1] : 0.0f;
-            float sample11 = (r_idx1 >= 0 && r_idx1 < num_range && t_idx1 >= 0 && t_idx1 < num_beams) ? in_buffer[num_range*t_idx1 + r_idx1] : 0.0f;
-            float range0 = range_min + r_idx0*dr;
-            float range1 = range0 + dr;
-            float theta0 = theta_min + t_idx0*dt;
-            float theta1 = theta0 + dt;
-
-            // Use Wikipedia formula
-            value = 1.0f/((range1-range0)*(theta1-theta0))*( sample00*(range1-r)*(theta1-theta)
-                                                            +sample10*(r-range0)*(theta1-theta)
-                                                            +sample01*(range1-r)*(theta-theta0)
-                                                            +sample11*(r-range0)*(theta-theta0));
-
-
-            size_t res_offset = static_cast<size_t>(m_num_samples_x*yi + xi);
-            m_output_buffer[res_offset] = static_cast<T>(value);
+            m_lookup_table[m_num_samples_x*yi + xi] = MakeEntry(r, range_min, dr, num_range,
+                                                                theta, theta_min, dt, num_beams);
         }
     }
 }
 
 template <typename T>
-void CpuCartesianator<T>::DoLinearTransform(T* in_buffer, int num_beams, int num_range,
-                                            std::shared_ptr<bcsim::LinearScanGeometry> geometry) {
+void CpuCartesianator<T>::BuildLinearTable(int num_beams, int num_range,
+                                           std::shared_ptr<bcsim::LinearScanGeometry> geometry) {
     // deltas for cartesian grid
     const auto dx = (m_x_max - m_x_min) / (m_num_samples_x-1);
     const auto dy = (m_y_max - m_y_min) / (m_num_samples_y-1);
@@ -168,38 +220,14 @@ void CpuCartesianator<T>::DoLinearTransform(T* in_buffer, int num_beams, int num
     const float bs_dx = (x_max-x_min) / (num_beams-1);
     const float bs_dy = (y_max-y_min) / (num_range-1);
 
-    // for each output sample determine index of closest beamspace sample
-    for (size_t xi = 0; xi < m_num_samples_x; xi++) {
-        for (size_t yi = 0; yi < m_num_samples_y; yi++) {
+    const auto num_samples_y = static_cast<int>(m_num_samples_y);
+    #pragma omp parallel for
+    for (int yi = 0; yi < num_samples_y; yi++) {
+        for (size_t xi = 0; xi < m_num_samples_x; xi++) {
             float x = m_x_min + xi*dx;
             float y = m_y_min + yi*dy;
-
-            // map to inds
-            int x_idx0 = static_cast<int>(std::floor( (x - x_min) / bs_dx ));
-            int y_idx0 = static_cast<int>(std::floor( (y - y_min) / bs_dy ));
-            int x_idx1 = x_idx0 + 1;
-            int y_idx1 = y_idx0 + 1;
-
-            float value = 0.0f;
-
-
-            float sample00 = (y_idx0 >= 0 && y_idx0 < num_range && x_idx0 >= 0 && x_idx0 < num_beams) ? in_buffer[num_range*x_idx0 + y_idx0] : 0.0f;
-            float sample01 = (y_idx0 >= 0 && y_idx0 < num_range && x_idx1 >= 0 && x_idx1 < num_beams) ? in_buffer[num_range*x_idx1 + y_idx0] : 0.0f;
-            float sample10 = (y_idx1 >= 0 && y_idx1 < num_range && x_idx0 >= 0 && x_idx0 < num_beams) ? in_buffer[num_range*x_idx0 + y_idx1] : 0.0f;
-            float sample11 = (y_idx1 >= 0 && y_idx1 < num_range && x_idx1 >= 0 && x_idx1 < num_beams) ? in_buffer[num_range*x_idx1 + y_idx1] : 0.0f;
-            float y0 = y_min + y_idx0*bs_dy;
-            float y1 = y0 + bs_dy;
-            float x0 = x_min + x_idx0*bs_dx;
-            float x1 = x0 + bs_dx;
-
-            // Use Wikipedia formula
-            value = 1.0f/((y1-y0)*(x1-x0))*( sample00*(y1-y)*(x1-x)
-                                            +sample10*(y-y0)*(x1-x)
-                                            +sample01*(y1-y)*(x-x0)
-                                            +sample11*(y-y0)*(x-x0));
-
-            size_t res_offset = static_cast<size_t>(m_num_samples_x*yi + xi);
-            m_output_buffer[res_offset] = static_cast<T>(value);
+            m_lookup_table[m_num_samples_x*yi + xi] = MakeEntry(y, y_min, bs_dy, num_range,
+                                                                x, x_min, bs_dx, num_beams);
         }
     }
 }
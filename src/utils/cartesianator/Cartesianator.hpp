@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include "../ScanGeometry.hpp"
@@ -68,6 +69,7 @@ class DLL_PUBLIC CpuCartesianator : public ICartesianator<T> {
 public:
     CpuCartesianator();
 
+    // The scan conversion table is kept if the geometry is unchanged.
     virtual void SetGeometry(bcsim::ScanGeometry::ptr geometry);
 
     virtual const T* GetOutputBuffer();
@@ -78,17 +80,35 @@ public:
     virtual void GetOutputSize(size_t& num_samples_x,
                                size_t& num_samples_y);
 
+    // Builds the scan conversion table on the first call after the geometry,
+    // output size or input dimensions changed.
     virtual void Process(T* in_buffer, int num_beams, int num_samples);
 
 private:
+    // Bilinear interpolation of an output sample from four input samples.
+    // Input samples outside of the beam space have index zero and weight zero.
+    struct LookupEntry {
+        uint32_t    indices[4];
+        float       weights[4];
+    };
 
     void UpdateOutputBuffer();
 
-    void DoSectorTransform(T* in_buffer, int num_beams, int num_range,
-                           std::shared_ptr<bcsim::SectorScanGeometry> geometry);
+    // Identifies the geometry type and its parameters.
+    static std::vector<float> GetGeometryParameters(bcsim::ScanGeometry::ptr geometry);
 
-    void DoLinearTransform(T* in_buffer, int num_beams, int num_range,
-                           std::shared_ptr<bcsim::LinearScanGeometry> geometry);
+    void BuildLookupTable(int num_beams, int num_range);
+
+    void BuildSectorTable(int num_beams, int num_range,
+                          std::shared_ptr<bcsim::SectorScanGeometry> geometry);
+
+    void BuildLinearTable(int num_beams, int num_range,
+                          std::shared_ptr<bcsim::LinearScanGeometry> geometry);
+
+    // Weights for position (range, beam) where input samples have range
+    // r_min + i*dr and beam position b_min + j*db.
+    static LookupEntry MakeEntry(float range, float r_min, float dr, int num_range,
+                                 float beam, float b_min, float db, int num_beams);
 
 private:
     bcsim::ScanGeometry::ptr    m_geometry;
@@ -101,4 +121,11 @@ private:
     float   m_x_max;
     float   m_y_min;
     float   m_y_max;
+
+    // Scan conversion table with one entry per output sample, empty if
+    // it must be rebuilt. Valid for the geometry and input dimensions below.
+    std::vector<LookupEntry>    m_lookup_table;
+    std::vector<float>          m_lookup_geometry;
+    int                         m_lookup_num_beams;
+    int                         m_lookup_num_range;
 };
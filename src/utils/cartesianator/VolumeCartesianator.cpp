@@ -0,0 +1,334 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include "VolumeCartesianator.hpp"
+
+namespace {
+
+// Identifies the geometry type and its parameters.
+std::vector<float> GetGeometryParameters(bcsim::VolumeScanGeometry::ptr geometry) {
+    auto pyramid_geo = std::dynamic_pointer_cast<bcsim::PyramidScanGeometry>(geometry);
+    auto linear_geo  = std::dynamic_pointer_cast<bcsim::Linear3DScanGeometry>(geometry);
+    if (pyramid_geo) {
+        return {0.0f, pyramid_geo->width_lateral, pyramid_geo->width_elevational, pyramid_geo->depth,
+                pyramid_geo->tilt_lateral, pyramid_geo->tilt_elevational};
+    } else if (linear_geo) {
+        return {1.0f, linear_geo->width_lateral, linear_geo->width_elevational, linear_geo->range_max};
+    } else {
+        throw std::runtime_error("unknown volume geometry");
+    }
+}
+
+// Continuous sample index of value on the grid min + i*delta, i in [0, num).
+// Returns false if outside of the grid, otherwise the lower index and the
+// fractional offset towards the next sample. A small tolerance keeps output
+// points on the boundary of the volume inside despite rounding.
+bool GetGridPosition(float value, float min, float delta, int num, int& idx0, float& frac) {
+    const float tolerance = 1e-4f;
+    float pos = (value - min) / delta;
+    if (!(pos >= -tolerance && pos <= (num-1) + tolerance)) {
+        return false;
+    }
+    pos = std::max(0.0f, std::min(static_cast<float>(num-1), pos));
+    idx0 = std::min(static_cast<int>(pos), num-2);
+    frac = pos - idx0;
+    return true;
+}
+
+inline float Lerp(float a, float b, float t) {
+    return a + t*(b - a);
+}
+
+}   // end anonymous namespace
+
+VolumeLookupTable::VolumeLookupTable()
+    : m_stride_lateral(0),
+      m_stride_elevational(0)
+{
+}
+
+void VolumeLookupTable::Update(bcsim::VolumeScanGeometry::ptr geometry,
+                               int num_beams_lateral, int num_beams_elevational, int num_samples,
+                               const bcsim::vector3& origin, const bcsim::vector3& step_u,
+                               const bcsim::vector3& step_v, const bcsim::vector3& step_w,
+                               size_t num_u, size_t num_v, size_t num_w) {
+    if (!geometry) {
+        throw std::runtime_error("geometry not configured");
+    }
+    auto key = GetGeometryParameters(geometry);
+    const float dims[] = {static_cast<float>(num_beams_lateral), static_cast<float>(num_beams_elevational),
+                          static_cast<float>(num_samples),
+                          origin.x, origin.y, origin.z, step_u.x, step_u.y, step_u.z,
+                          step_v.x, step_v.y, step_v.z, step_w.x, step_w.y, step_w.z,
+                          static_cast<float>(num_u), static_cast<float>(num_v), static_cast<float>(num_w)};
+    key.insert(key.end(), std::begin(dims), std::end(dims));
+    if (key != m_key) {
+        m_key.clear();
+        Build(geometry, num_beams_lateral, num_beams_elevational, num_samples,
+              origin, step_u, step_v, step_w, num_u, num_v, num_w);
+        m_key = std::move(key);
+    }
+}
+
+void VolumeLookupTable::Build(bcsim::VolumeScanGeometry::ptr geometry,
+                              int num_beams_lateral, int num_beams_elevational, int num_samples,
+                              const bcsim::vector3& origin, const bcsim::vector3& step_u,
+                              const bcsim::vector3& step_v, const bcsim::vector3& step_w,
+                              size_t num_u, size_t num_v, size_t num_w) {
+    if (num_beams_lateral < 2 || num_beams_elevational < 2 || num_samples < 2) {
+        throw std::runtime_error("volume scan conversion needs at least two beams and samples in each dimension");
+    }
+    const auto num_inputs = static_cast<uint64_t>(num_beams_lateral)*num_beams_elevational*num_samples;
+    if (num_inputs >= INVALID_INDEX) {
+        throw std::runtime_error("beam space volume is too large");
+    }
+    m_stride_lateral     = static_cast<uint32_t>(num_samples);
+    m_stride_elevational = static_cast<uint32_t>(num_samples*num_beams_lateral);
+
+    // beam space grid: range, lateral and elevational coordinate of the first
+    // sample and deltas.
+    auto pyramid_geo = std::dynamic_pointer_cast<bcsim::PyramidScanGeometry>(geometry);
+    auto linear_geo  = std::dynamic_pointer_cast<bcsim::Linear3DScanGeometry>(geometry);
+    float r_min, r_max, lat_min, lat_max, ele_min, ele_max;
+    if (pyramid_geo) {
+        r_min = 0.0f;
+        r_max = pyramid_geo->depth;
+        pyramid_geo->get_angle_limits(lat_min, lat_max, ele_min, ele_max);
+    } else {
+        float z_min;
+        linear_geo->get_xyz_extent(lat_min, lat_max, ele_min, ele_max, z_min, r_max);
+        r_min = z_min;
+    }
+    const float dr   = (r_max - r_min) / (num_samples-1);
+    const float dlat = (lat_max - lat_min) / (num_beams_lateral-1);
+    const float dele = (ele_max - ele_min) / (num_beams_elevational-1);
+    const bool is_pyramid = static_cast<bool>(pyramid_geo);
+
+    m_entries.resize(num_u*num_v*num_w);
+    const auto num_rows = static_cast<int>(num_v*num_w);
+    #pragma omp parallel for
+    for (int row = 0; row < num_rows; row++) {
+        const size_t iv = row % num_v;
+        const size_t iw = row / num_v;
+        for (size_t iu = 0; iu < num_u; iu++) {
+            const auto p = origin + step_u*static_cast<float>(iu)
+                                  + step_v*static_cast<float>(iv)
+                                  + step_w*static_cast<float>(iw);
+            // Map (x, y, z) to (range, lateral, elevational)
+            float range, lat, ele;
+            if (is_pyramid) {
+                range = p.norm();
+                ele = (range > 1e-9f) ? std::asin(std::max(-1.0f, std::min(1.0f, p.y/range))) : 0.0f;
+                lat = std::atan2(p.x, p.z);
+            } else {
+                range = p.z;
+                lat = p.x;
+                ele = p.y;
+            }
+
+            LookupEntry entry;
+            int r_idx0, lat_idx0, ele_idx0;
+            if (GetGridPosition(range, r_min, dr, num_samples, r_idx0, entry.frac_range) &&
+                GetGridPosition(lat, lat_min, dlat, num_beams_lateral, lat_idx0, entry.frac_lateral) &&
+                GetGridPosition(ele, ele_min, dele, num_beams_elevational, ele_idx0, entry.frac_elevational)) {
+                entry.base = m_stride_elevational*ele_idx0 + m_stride_lateral*lat_idx0 + r_idx0;
+            } else {
+                entry.base = INVALID_INDEX;
+                entry.frac_range = entry.frac_lateral = entry.frac_elevational = 0.0f;
+            }
+            m_entries[num_u*row + iu] = entry;
+        }
+    }
+}
+
+template <typename T>
+void VolumeLookupTable::Apply(const T* in_buffer, T* out_buffer) const {
+    const auto num_outputs = static_cast<int>(m_entries.size());
+    const auto entries = m_entries.data();
+    const auto stride_lat = m_stride_lateral;
+    const auto stride_ele = m_stride_elevational;
+    #pragma omp parallel for
+    for (int i = 0; i < num_outputs; i++) {
+        const auto& entry = entries[i];
+        if (entry.base == INVALID_INDEX) {
+            out_buffer[i] = static_cast<T>(0);
+            continue;
+        }
+        const T* p0 = in_buffer + entry.base;
+        const T* p1 = p0 + stride_ele;
+        const float fr = entry.frac_range;
+        const float c00 = Lerp(p0[0],          p0[1],            fr);
+        const float c10 = Lerp(p0[stride_lat], p0[stride_lat+1], fr);
+        const float c01 = Lerp(p1[0],          p1[1],            fr);
+        const float c11 = Lerp(p1[stride_lat], p1[stride_lat+1], fr);
+        const float c0 = Lerp(c00, c10, entry.frac_lateral);
+        const float c1 = Lerp(c01, c11, entry.frac_lateral);
+        out_buffer[i] = static_cast<T>(Lerp(c0, c1, entry.frac_elevational));
+    }
+}
+
+template <typename T>
+CpuVolumeCartesianator<T>::CpuVolumeCartesianator()
+    : m_geometry(nullptr),
+      m_num_samples_x(128),
+      m_num_samples_y(128),
+      m_num_samples_z(128),
+      m_x_min(0.0f), m_x_max(0.0f),
+      m_y_min(0.0f), m_y_max(0.0f),
+      m_z_min(0.0f), m_z_max(0.0f)
+{
+    m_output_buffer.resize(m_num_samples_x*m_num_samples_y*m_num_samples_z);
+}
+
+template <typename T>
+void CpuVolumeCartesianator<T>::SetGeometry(bcsim::VolumeScanGeometry::ptr geometry) {
+    m_geometry = geometry;
+    geometry->get_xyz_extent(m_x_min, m_x_max, m_y_min, m_y_max, m_z_min, m_z_max);
+}
+
+template <typename T>
+const T* CpuVolumeCartesianator<T>::GetOutputBuffer() {
+    return m_output_buffer.data();
+}
+
+template <typename T>
+void CpuVolumeCartesianator<T>::SetOutputSize(size_t num_samples_x, size_t num_samples_y, size_t num_samples_z) {
+    if (num_samples_x < 2 || num_samples_y < 2 || num_samples_z < 2) {
+        throw std::runtime_error("need at least two output samples along each axis");
+    }
+    m_num_samples_x = num_samples_x;
+    m_num_samples_y = num_samples_y;
+    m_num_samples_z = num_samples_z;
+    m_output_buffer.resize(m_num_samples_x*m_num_samples_y*m_num_samples_z);
+}
+
+template <typename T>
+void CpuVolumeCartesianator<T>::GetOutputSize(size_t& num_samples_x, size_t& num_samples_y, size_t& num_samples_z) {
+    num_samples_x = m_num_samples_x;
+    num_samples_y = m_num_samples_y;
+    num_samples_z = m_num_samples_z;
+}
+
+template <typename T>
+void CpuVolumeCartesianator<T>::GetOutputExtent(float& x_min, float& x_max, float& y_min, float& y_max,
+                                                float& z_min, float& z_max) {
+    x_min = m_x_min; x_max = m_x_max;
+    y_min = m_y_min; y_max = m_y_max;
+    z_min = m_z_min; z_max = m_z_max;
+}
+
+template <typename T>
+void CpuVolumeCartesianator<T>::Process(const T* in_buffer, int num_beams_lateral, int num_beams_elevational, int num_samples) {
+    // deltas for cartesian grid
+    const bcsim::vector3 step_x((m_x_max - m_x_min) / (m_num_samples_x-1), 0.0f, 0.0f);
+    const bcsim::vector3 step_y(0.0f, (m_y_max - m_y_min) / (m_num_samples_y-1), 0.0f);
+    const bcsim::vector3 step_z(0.0f, 0.0f, (m_z_max - m_z_min) / (m_num_samples_z-1));
+    m_lookup_table.Update(m_geometry, num_beams_lateral, num_beams_elevational, num_samples,
+                          bcsim::vector3(m_x_min, m_y_min, m_z_min), step_x, step_y, step_z,
+                          m_num_samples_x, m_num_samples_y, m_num_samples_z);
+    m_lookup_table.Apply(in_buffer, m_output_buffer.data());
+}
+
+template <typename T>
+CpuVolumeSlicer<T>::CpuVolumeSlicer()
+    : m_geometry(nullptr),
+      m_num_samples_u(256),
+      m_num_samples_v(256),
+      m_center(0.0f, 0.0f, 0.0f),
+      m_u_dir(1.0f, 0.0f, 0.0f),
+      m_v_dir(0.0f, 0.0f, 1.0f),
+      m_width(0.0f),
+      m_height(0.0f)
+{
+    m_output_buffer.resize(m_num_samples_u*m_num_samples_v);
+}
+
+template <typename T>
+void CpuVolumeSlicer<T>::SetGeometry(bcsim::VolumeScanGeometry::ptr geometry) {
+    m_geometry = geometry;
+}
+
+template <typename T>
+void CpuVolumeSlicer<T>::SetPlane(const bcsim::vector3& center, const bcsim::vector3& u_dir,
+                                  const bcsim::vector3& v_dir, float width, float height) {
+    if (u_dir.norm() <= 0.0f || v_dir.norm() <= 0.0f) {
+        throw std::runtime_error("plane directions must be nonzero");
+    }
+    if (u_dir.cross(v_dir).norm() < 1e-6f*u_dir.norm()*v_dir.norm()) {
+        throw std::runtime_error("plane directions must not be parallel");
+    }
+    m_center = center;
+    m_u_dir = u_dir/u_dir.norm();
+    m_v_dir = v_dir/v_dir.norm();
+    m_width = width;
+    m_height = height;
+}
+
+template <typename T>
+const T* CpuVolumeSlicer<T>::GetOutputBuffer() {
+    return m_output_buffer.data();
+}
+
+template <typename T>
+void CpuVolumeSlicer<T>::SetOutputSize(size_t num_samples_u, size_t num_samples_v) {
+    if (num_samples_u < 2 || num_samples_v < 2) {
+        throw std::runtime_error("need at least two output samples along each axis");
+    }
+    m_num_samples_u = num_samples_u;
+    m_num_samples_v = num_samples_v;
+    m_output_buffer.resize(m_num_samples_u*m_num_samples_v);
+}
+
+template <typename T>
+void CpuVolumeSlicer<T>::GetOutputSize(size_t& num_samples_u, size_t& num_samples_v) {
+    num_samples_u = m_num_samples_u;
+    num_samples_v = m_num_samples_v;
+}
+
+template <typename T>
+void CpuVolumeSlicer<T>::Process(const T* in_buffer, int num_beams_lateral, int num_beams_elevational, int num_samples) {
+    const auto step_u = m_u_dir*(m_width / (m_num_samples_u-1));
+    const auto step_v = m_v_dir*(m_height / (m_num_samples_v-1));
+    const auto origin = m_center - m_u_dir*(0.5f*m_width) - m_v_dir*(0.5f*m_height);
+    m_lookup_table.Update(m_geometry, num_beams_lateral, num_beams_elevational, num_samples,
+                          origin, step_u, step_v, bcsim::vector3(0.0f, 0.0f, 0.0f),
+                          m_num_samples_u, m_num_samples_v, 1);
+    m_lookup_table.Apply(in_buffer, m_output_buffer.data());
+}
+
+// explicit instantiations for the required datatypes.
+template void VolumeLookupTable::Apply<unsigned char>(const unsigned char*, unsigned char*) const;
+template void VolumeLookupTable::Apply<float>(const float*, float*) const;
+template class CpuVolumeCartesianator<unsigned char>;
+template class CpuVolumeCartesianator<float>;
+template class CpuVolumeSlicer<unsigned char>;
+template class CpuVolumeSlicer<float>;
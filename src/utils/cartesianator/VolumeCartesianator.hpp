@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2015, Sigurd Storve
+All rights reserved.
+
+Licensed under the BSD license.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "../ScanGeometry.hpp"
+#include "core/BCSimConfig.hpp"
+#include "core/export_macros.hpp"
+
+// Trilinear scan conversion table from a regular grid of cartesian points
+// to a beam space volume. Shared by the volume cartesianator and the slicer.
+//
+// Beam space indexing: num_samples*(num_beams_lateral*ele_idx + lat_idx) + sample_idx
+class DLL_PUBLIC VolumeLookupTable {
+public:
+    VolumeLookupTable();
+
+    // Output point (iu, iv, iw) is origin + iu*step_u + iv*step_v + iw*step_w.
+    // The table is only rebuilt if any of the arguments changed.
+    void Update(bcsim::VolumeScanGeometry::ptr geometry,
+                int num_beams_lateral, int num_beams_elevational, int num_samples,
+                const bcsim::vector3& origin, const bcsim::vector3& step_u,
+                const bcsim::vector3& step_v, const bcsim::vector3& step_w,
+                size_t num_u, size_t num_v, size_t num_w);
+
+    // Indexing of out_buffer: num_u*(num_v*iw + iv) + iu
+    // Output points outside of the beam space volume are zero.
+    template <typename T>
+    void Apply(const T* in_buffer, T* out_buffer) const;
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+private:
+    // Sixteen bytes instead of eight indices and weights keeps the table small
+    // enough for full volumes. The eight input samples are base + {0, 1} +
+    // {0, m_stride_lateral} + {0, m_stride_elevational}.
+    struct LookupEntry {
+        uint32_t    base;           // INVALID_INDEX if outside of the volume
+        float       frac_range;
+        float       frac_lateral;
+        float       frac_elevational;
+    };
+
+    static const uint32_t INVALID_INDEX = 0xFFFFFFFFu;
+
+    void Build(bcsim::VolumeScanGeometry::ptr geometry,
+               int num_beams_lateral, int num_beams_elevational, int num_samples,
+               const bcsim::vector3& origin, const bcsim::vector3& step_u,
+               const bcsim::vector3& step_v, const bcsim::vector3& step_w,
+               size_t num_u, size_t num_v, size_t num_w);
+
+private:
+    // Everything the table depends on, empty if it must be rebuilt.
+    std::vector<float>          m_key;
+    std::vector<LookupEntry>    m_entries;
+    uint32_t                    m_stride_lateral;
+    uint32_t                    m_stride_elevational;
+};
+
+// Geometry + Beam Space volume => Sampled cartesian voxel grid.
+// Manages its own output buffer.
+template <typename T>
+class DLL_PUBLIC CpuVolumeCartesianator {
+public:
+    typedef std::unique_ptr<CpuVolumeCartesianator<T>> u_ptr;
+
+    CpuVolumeCartesianator();
+
+    // Also computes Cartesian xyz extents.
+    void SetGeometry(bcsim::VolumeScanGeometry::ptr geometry);
+
+    // Indexing: num_samples_x*(num_samples_y*z_idx + y_idx) + x_idx
+    const T* GetOutputBuffer();
+
+    void SetOutputSize(size_t num_samples_x, size_t num_samples_y, size_t num_samples_z);
+
+    void GetOutputSize(size_t& num_samples_x, size_t& num_samples_y, size_t& num_samples_z);
+
+    // Cartesian position of the first and last voxel along each axis.
+    void GetOutputExtent(float& x_min, float& x_max, float& y_min, float& y_max,
+                         float& z_min, float& z_max);
+
+    // Indexing: see VolumeLookupTable. The scan conversion table is built on
+    // the first call after the geometry, output size or input dimensions changed.
+    void Process(const T* in_buffer, int num_beams_lateral, int num_beams_elevational, int num_samples);
+
+private:
+    bcsim::VolumeScanGeometry::ptr  m_geometry;
+    std::vector<T>                  m_output_buffer;
+    size_t                          m_num_samples_x;
+    size_t                          m_num_samples_y;
+    size_t                          m_num_samples_z;
+
+    // auto-computed extents
+    float   m_x_min;
+    float   m_x_max;
+    float   m_y_min;
+    float   m_y_max;
+    float   m_z_min;
+    float   m_z_max;
+
+    VolumeLookupTable               m_lookup_table;
+};
+
+// Arbitrary-plane (multiplanar reconstruction) slicing directly from the beam
+// space volume, which avoids interpolating twice via a voxel grid.
+// Manages its own output buffer.
+template <typename T>
+class DLL_PUBLIC CpuVolumeSlicer {
+public:
+    typedef std::unique_ptr<CpuVolumeSlicer<T>> u_ptr;
+
+    CpuVolumeSlicer();
+
+    void SetGeometry(bcsim::VolumeScanGeometry::ptr geometry);
+
+    // The plane through center spanned by the directions u_dir and v_dir,
+    // covering [-width/2, width/2] along u_dir and [-height/2, height/2]
+    // along v_dir. The directions are normalized.
+    void SetPlane(const bcsim::vector3& center, const bcsim::vector3& u_dir,
+                  const bcsim::vector3& v_dir, float width, float height);
+
+    // Indexing: num_samples_u*v_idx + u_idx
+    const T* GetOutputBuffer();
+
+    void SetOutputSize(size_t num_samples_u, size_t num_samples_v);
+
+    void GetOutputSize(size_t& num_samples_u, size_t& num_samples_v);
+
+    // Indexing: see VolumeLookupTable. Moving the plane rebuilds the table
+    // for the slice only, which is cheap compared to a full volume.
+    void Process(const T* in_buffer, int num_beams_lateral, int num_beams_elevational, int num_samples);
+
+private:
+    bcsim::VolumeScanGeometry::ptr  m_geometry;
+    std::vector<T>                  m_output_buffer;
+    size_t                          m_num_samples_u;
+    size_t                          m_num_samples_v;
+
+    bcsim::vector3  m_center;
+    bcsim::vector3  m_u_dir;
+    bcsim::vector3  m_v_dir;
+    float           m_width;
+    float           m_height;
+
+    VolumeLookupTable               m_lookup_table;
+};
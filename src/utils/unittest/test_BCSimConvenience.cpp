@@ -0,0 +1,220 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_BCSimConvenience
+#include <cmath>
+#include <vector>
+#include <complex>
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include "../BCSimConvenience.hpp"
+#include "../../core/bspline.hpp"
+#include "../rotation3d.hpp"
+
+namespace {
+
+std::vector<std::vector<float>> make_frame(size_t num_beams, size_t num_samples) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dist(1e-4f, 10.0f);
+    std::vector<std::vector<float>> frame(num_beams, std::vector<float>(num_samples));
+    for (auto& beam : frame) {
+        for (auto& v : beam) v = dist(gen);
+    }
+    return frame;
+}
+
+void check_close(const bcsim::vector3& a, const bcsim::vector3& b, float tol) {
+    BOOST_CHECK_SMALL(a.x - b.x, tol);
+    BOOST_CHECK_SMALL(a.y - b.y, tol);
+    BOOST_CHECK_SMALL(a.z - b.z, tol);
+}
+
+std::vector<float> flatten(const std::vector<std::vector<float>>& frame) {
+    std::vector<float> res;
+    for (const auto& beam : frame) res.insert(res.end(), beam.begin(), beam.end());
+    return res;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(FastLog10ErrorBound) {
+    double max_abs_error = 0.0;
+    double max_rel_error = 0.0;
+    for (double x = 1e-30; x < 1e30; x *= 1.0001) {
+        const auto exact = std::log10(static_cast<double>(static_cast<float>(x)));
+        const auto error = std::abs(bcsim::fast_log10(static_cast<float>(x)) - exact);
+        if (x > 1e-3 && x < 1e3) max_abs_error = std::max(max_abs_error, error);
+        if (std::abs(exact) > 1.0) max_rel_error = std::max(max_rel_error, error/std::abs(exact));
+    }
+    BOOST_CHECK_LT(max_abs_error, 5e-7);
+    BOOST_CHECK_LT(max_rel_error, 2e-7);
+    BOOST_CHECK_CLOSE(bcsim::fast_log10(0.0f), -38.2f, 0.1f);
+}
+
+BOOST_AUTO_TEST_CASE(ContiguousMatchesVectorVersions) {
+    const size_t num_beams = 17;
+    const size_t num_samples = 301;
+    const auto frame = make_frame(num_beams, num_samples);
+    auto values = flatten(frame);
+
+    const int rad_decimation = 3;
+    std::vector<float> decimated(num_beams*(num_samples/rad_decimation));
+    bcsim::decimate_frame(values.data(), num_beams, num_samples, rad_decimation, decimated.data());
+    BOOST_CHECK(decimated == flatten(bcsim::decimate_frame(frame, rad_decimation)));
+
+    const auto max_value = bcsim::get_max_value(values.data(), values.size());
+    BOOST_CHECK_EQUAL(max_value, bcsim::get_max_value(frame));
+
+    auto compressed = frame;
+    bcsim::log_compress_frame(compressed, 60.0f, max_value, 2.0f);
+    bcsim::log_compress_frame(values.data(), values.size(), 60.0f, max_value, 2.0f);
+    const auto expected = flatten(compressed);
+    for (size_t i = 0; i < values.size(); i++) {
+        BOOST_REQUIRE_SMALL(values[i] - expected[i], 1e-3f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EnvelopeLogCompressMatchesSeparatePasses) {
+    const size_t num_lines = 13;
+    const size_t num_samples = 257;
+    const size_t line_stride = 260;
+    std::mt19937 gen(1);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<std::complex<float>> iq(num_lines*line_stride);
+    for (auto& z : iq) z = std::complex<float>(dist(gen), dist(gen));
+
+    std::vector<std::vector<float>> envelope(num_lines, std::vector<float>(num_samples));
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t i = 0; i < num_samples; i++) {
+            envelope[line_no][i] = std::abs(iq[line_no*line_stride + i]);
+        }
+    }
+    const auto max_value = bcsim::get_max_value(envelope);
+    bcsim::log_compress_frame(envelope, 50.0f, max_value, 1.5f);
+    const auto expected = flatten(envelope);
+
+    std::vector<unsigned char> gray_levels(num_lines*num_samples);
+    const auto normalize_factor = bcsim::envelope_log_compress_frame(iq.data(), num_lines, num_samples, line_stride,
+                                                                     50.0f, 1.0f, 1.5f, true, gray_levels.data());
+    BOOST_CHECK_CLOSE(normalize_factor, max_value, 1e-4f);
+    for (size_t i = 0; i < gray_levels.size(); i++) {
+        // the truncation may differ where the exact gray level is close to an integer
+        BOOST_REQUIRE_SMALL(static_cast<float>(gray_levels[i]) - std::floor(expected[i]), 1.0f + 1e-6f);
+        BOOST_REQUIRE(std::abs(gray_levels[i] - expected[i]) < 1.01f);
+    }
+
+    // a fixed normalization factor
+    bcsim::envelope_log_compress_frame(iq.data(), num_lines, num_samples, line_stride,
+                                       50.0f, max_value, 1.5f, false, gray_levels.data());
+    for (size_t i = 0; i < gray_levels.size(); i++) {
+        BOOST_REQUIRE(std::abs(gray_levels[i] - expected[i]) < 1.01f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RenderFixedScatterersMatchesBasisFunctions) {
+    const size_t num_splines = 1000;
+    const int num_cs = 7;
+    const int degree = 3;
+    auto splines = std::make_shared<bcsim::SplineScatterers>();
+    splines->spline_degree = degree;
+    splines->knot_vector = bspline_storve::uniform_regular_knot_vector(num_cs, degree, 0.0f, 1.0f);
+    splines->resize(num_splines, num_cs);
+    std::mt19937 gen(2);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (size_t spline_no = 0; spline_no < num_splines; spline_no++) {
+        for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+            splines->set_control_point(spline_no, cs_no, bcsim::vector3(dist(gen), dist(gen), dist(gen)));
+        }
+        splines->amplitudes[spline_no] = dist(gen);
+    }
+
+    const std::vector<float> timestamps = {0.0f, 0.1f, 0.45f, 0.9f};
+    const auto frames = bcsim::render_fixed_scatterers(splines, timestamps);
+    BOOST_REQUIRE_EQUAL(frames.size(), timestamps.size());
+    for (size_t time_no = 0; time_no < timestamps.size(); time_no++) {
+        const auto single = std::dynamic_pointer_cast<bcsim::FixedScatterers>(
+            bcsim::render_fixed_scatterers(splines, timestamps[time_no]));
+        BOOST_REQUIRE_EQUAL(frames[time_no]->scatterers.size(), num_splines);
+        BOOST_REQUIRE_EQUAL(single->scatterers.size(), num_splines);
+        for (size_t spline_no = 0; spline_no < num_splines; spline_no++) {
+            bcsim::vector3 expected(0.0f, 0.0f, 0.0f);
+            for (int cs_no = 0; cs_no < num_cs; cs_no++) {
+                const auto b = bspline_storve::bsplineBasis(cs_no, degree, timestamps[time_no], splines->knot_vector);
+                expected += splines->get_control_point(spline_no, cs_no)*b;
+            }
+            const auto& s = frames[time_no]->scatterers[spline_no];
+            BOOST_REQUIRE_SMALL((s.pos - expected).norm(), 1e-5f);
+            BOOST_REQUIRE_EQUAL(s.amplitude, splines->amplitudes[spline_no]);
+            BOOST_REQUIRE_EQUAL((single->scatterers[spline_no].pos - s.pos).norm(), 0.0f);
+        }
+    }
+
+    const float outside = 2.0f;
+    std::vector<bcsim::PointScatterer> out(num_splines);
+    BOOST_CHECK_THROW(bcsim::render_fixed_scatterers(*splines, &outside, 1, out.data()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(OrientScanSequenceMatchesUblasRotation) {
+    auto geometry = std::make_shared<bcsim::SectorScanGeometry>();
+    geometry->width = 1.2f;
+    geometry->depth = 0.1f;
+    geometry->tilt  = 0.1f;
+    const auto seq = bcsim::CreateScanSequence(geometry, 65, 0.5f);
+    const bcsim::vector3 angles(0.3f, -0.7f, 1.1f);
+    const bcsim::vector3 origin(0.01f, -0.02f, 0.03f);
+    const auto oriented = bcsim::OrientScanSequence(seq, angles, origin);
+    BOOST_REQUIRE_EQUAL(oriented->get_num_lines(), 65);
+    BOOST_CHECK(oriented->is_valid());
+
+    const auto ref_matrix = rotation_matrix_xyz(angles.x, angles.y, angles.z);
+    const auto rotate = [&](const bcsim::vector3& v) {
+        boost::numeric::ublas::vector<double> u(3);
+        u(0) = v.x; u(1) = v.y; u(2) = v.z;
+        const boost::numeric::ublas::vector<double> r = boost::numeric::ublas::prod(ref_matrix, u);
+        return bcsim::vector3(static_cast<float>(r(0)), static_cast<float>(r(1)), static_cast<float>(r(2)));
+    };
+    for (int i = 0; i < seq.get_num_lines(); i++) {
+        const auto line = seq.get_scanline(i);
+        const auto res  = oriented->get_scanline(i);
+        check_close(res.get_origin(), rotate(line.get_origin()) + origin, 1e-6f);
+        check_close(res.get_direction(), rotate(line.get_direction()), 1e-6f);
+        check_close(res.get_lateral_dir(), rotate(line.get_lateral_dir()), 1e-6f);
+        check_close(res.get_elevational_dir(), rotate(line.get_elevational_dir()), 1e-6f);
+        BOOST_CHECK_EQUAL(res.get_timestamp(), line.get_timestamp());
+    }
+
+    // in place gives the same lines
+    auto in_place = seq;
+    bcsim::OrientScanSequenceInPlace(in_place, angles, origin);
+    for (int i = 0; i < seq.get_num_lines(); i++) {
+        check_close(in_place.get_scanline(i).get_origin(), oriented->get_scanline(i).get_origin(), 0.0f);
+        check_close(in_place.get_scanline(i).get_direction(), oriented->get_scanline(i).get_direction(), 0.0f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(OrientParametricScanSequence) {
+    bcsim::ParametricScan scan;
+    scan.type              = bcsim::ParametricScan::Type::SECTOR;
+    scan.num_lines_lateral = 16;
+    scan.num_planes        = 4;
+    scan.lateral_extent    = 1.0f;
+    scan.elevational_extent = 0.4f;
+    scan.line_interval     = 1e-4f;
+    const bcsim::ScanSequence parametric(0.1f, scan);
+    bcsim::ScanSequence explicit_seq(0.1f);
+    for (int i = 0; i < parametric.get_num_lines(); i++) {
+        explicit_seq.add_scanline(parametric.get_scanline(i));
+    }
+
+    // orienting twice composes the orientations
+    const bcsim::vector3 angles(0.2f, 0.5f, -0.4f);
+    const bcsim::vector3 origin(0.0f, 0.01f, -0.02f);
+    auto oriented = bcsim::OrientScanSequence(parametric, angles, origin);
+    bcsim::OrientScanSequenceInPlace(*oriented, angles, origin);
+    BOOST_CHECK(oriented->is_parametric());
+    bcsim::OrientScanSequenceInPlace(explicit_seq, angles, origin);
+    bcsim::OrientScanSequenceInPlace(explicit_seq, angles, origin);
+    for (int i = 0; i < parametric.get_num_lines(); i++) {
+        check_close(oriented->get_scanline(i).get_origin(), explicit_seq.get_scanline(i).get_origin(), 1e-6f);
+        check_close(oriented->get_scanline(i).get_direction(), explicit_seq.get_scanline(i).get_direction(), 1e-6f);
+        check_close(oriented->get_scanline(i).get_lateral_dir(), explicit_seq.get_scanline(i).get_lateral_dir(), 1e-6f);
+    }
+}
@@ -0,0 +1,164 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_BinaryPhantom
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+#include "../BinaryPhantom.hpp"
+#include "../../core/bspline.hpp"
+
+namespace {
+const char* test_file = "test_BinaryPhantom.bin";
+
+bcsim::FixedScatterers make_fixed_scatterers(size_t num_scatterers) {
+    bcsim::FixedScatterers res;
+    for (size_t i = 0; i < num_scatterers; i++) {
+        const auto v = static_cast<float>(i);
+        res.scatterers.push_back(bcsim::PointScatterer{bcsim::vector3(v, -v, 2.0f*v), 0.5f*v});
+    }
+    return res;
+}
+
+bcsim::SplineScatterers make_spline_scatterers(size_t num_scatterers, size_t num_cs, int degree) {
+    bcsim::SplineScatterers res;
+    res.spline_degree = degree;
+    for (size_t i = 0; i < num_cs + degree + 1; i++) {
+        res.knot_vector.push_back(static_cast<float>(i));
+    }
+    res.resize(num_scatterers, num_cs);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        res.amplitudes[i] = static_cast<float>(i);
+        for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
+            const auto v = static_cast<float>(i*100 + cs_no);
+            res.set_control_point(i, cs_no, bcsim::vector3(v, v + 0.25f, v + 0.5f));
+        }
+    }
+    return res;
+}
+}
+
+BOOST_AUTO_TEST_CASE(verify_round_trip_works) {
+    const auto fixed  = make_fixed_scatterers(37);
+    const auto spline = make_spline_scatterers(21, 5, 2);
+    bcsim::savePhantomToBinary(test_file, &fixed, &spline);
+    BOOST_CHECK(bcsim::isBinaryPhantom(test_file));
+
+    bcsim::MappedPhantom phantom(test_file);
+    BOOST_CHECK_EQUAL(phantom.header().num_fixed_scatterers, 37u);
+    BOOST_CHECK_EQUAL(phantom.header().num_spline_scatterers, 21u);
+    for (int section_no = 0; section_no < bcsim::BinaryPhantomHeader::NUM_SECTIONS; section_no++) {
+        const auto ptr = phantom.section(static_cast<bcsim::BinaryPhantomHeader::Section>(section_no));
+        BOOST_CHECK(ptr != nullptr);
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(ptr) % 64, 0u);
+    }
+
+    const auto loaded_fixed = phantom.get_fixed_scatterers();
+    BOOST_REQUIRE_EQUAL(loaded_fixed->scatterers.size(), fixed.scatterers.size());
+    for (size_t i = 0; i < fixed.scatterers.size(); i++) {
+        BOOST_CHECK_EQUAL(loaded_fixed->scatterers[i].pos.x, fixed.scatterers[i].pos.x);
+        BOOST_CHECK_EQUAL(loaded_fixed->scatterers[i].pos.y, fixed.scatterers[i].pos.y);
+        BOOST_CHECK_EQUAL(loaded_fixed->scatterers[i].pos.z, fixed.scatterers[i].pos.z);
+        BOOST_CHECK_EQUAL(loaded_fixed->scatterers[i].amplitude, fixed.scatterers[i].amplitude);
+    }
+
+    const auto loaded_spline = phantom.get_spline_scatterers();
+    BOOST_CHECK_EQUAL(loaded_spline->spline_degree, spline.spline_degree);
+    BOOST_CHECK(loaded_spline->knot_vector == spline.knot_vector);
+    BOOST_CHECK_EQUAL(loaded_spline->get_num_control_points(), 5u);
+    BOOST_CHECK(loaded_spline->control_xs == spline.control_xs);
+    BOOST_CHECK(loaded_spline->control_ys == spline.control_ys);
+    BOOST_CHECK(loaded_spline->control_zs == spline.control_zs);
+    BOOST_CHECK(loaded_spline->amplitudes == spline.amplitudes);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_fixed_only_phantom_works) {
+    const auto fixed = make_fixed_scatterers(3);
+    bcsim::savePhantomToBinary(test_file, &fixed, nullptr);
+    bcsim::MappedPhantom phantom(test_file);
+    BOOST_CHECK(phantom.has_fixed_scatterers());
+    BOOST_CHECK(!phantom.has_spline_scatterers());
+    BOOST_CHECK(phantom.section(bcsim::BinaryPhantomHeader::KNOTS) == nullptr);
+    BOOST_CHECK_THROW(phantom.get_spline_scatterers(), std::runtime_error);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_external_scatterers_reference_the_mapping) {
+    const auto fixed = make_fixed_scatterers(37);
+    bcsim::savePhantomToBinary(test_file, &fixed, nullptr);
+    auto phantom = std::make_shared<bcsim::MappedPhantom>(test_file);
+    const auto xs = phantom->section(bcsim::BinaryPhantomHeader::FIXED_XS);
+    const auto external = bcsim::getExternalFixedScatterers(phantom);
+    BOOST_CHECK(external->xs == xs);
+    BOOST_CHECK_EQUAL(external->count, 37u);
+
+    // the dataset keeps the mapping alive
+    phantom.reset();
+    const auto expanded = external->expand();
+    BOOST_REQUIRE_EQUAL(expanded->scatterers.size(), fixed.scatterers.size());
+    for (size_t i = 0; i < fixed.scatterers.size(); i++) {
+        BOOST_CHECK_EQUAL(expanded->scatterers[i].pos.z, fixed.scatterers[i].pos.z);
+        BOOST_CHECK_EQUAL(expanded->scatterers[i].amplitude, fixed.scatterers[i].amplitude);
+    }
+
+    const auto spline = make_spline_scatterers(2, 3, 1);
+    const auto spline_file = "test_BinaryPhantom_spline.bin";
+    bcsim::savePhantomToBinary(spline_file, nullptr, &spline);
+    BOOST_CHECK_THROW(bcsim::getExternalFixedScatterers(std::make_shared<bcsim::MappedPhantom>(spline_file)), std::runtime_error);
+    std::remove(spline_file);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_invalid_files_fail) {
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        out << "not a phantom, but long enough to hold a header......................................"
+            << "........................................................................................";
+    }
+    BOOST_CHECK(!bcsim::isBinaryPhantom(test_file));
+    BOOST_CHECK_THROW(bcsim::MappedPhantom phantom(test_file), std::runtime_error);
+
+    // truncated file
+    const auto fixed = make_fixed_scatterers(100);
+    bcsim::savePhantomToBinary(test_file, &fixed, nullptr);
+    {
+        std::ifstream in(test_file, std::ios::binary);
+        std::vector<char> bytes(512);
+        in.read(bytes.data(), bytes.size());
+        std::ofstream out(test_file, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size());
+    }
+    BOOST_CHECK_THROW(bcsim::MappedPhantom phantom(test_file), std::runtime_error);
+    std::remove(test_file);
+    BOOST_CHECK_THROW(bcsim::MappedPhantom phantom(test_file), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(verify_time_window_loading_works) {
+    auto spline = make_spline_scatterers(4, 12, 2);
+    spline.knot_vector = bspline_storve::uniform_regular_knot_vector(12, 2, 0.0f, 1.0f);
+    bcsim::savePhantomToBinary(test_file, nullptr, &spline);
+    bcsim::MappedPhantom phantom(test_file);
+    const auto window = phantom.get_spline_scatterers(0.4f, 0.6f);
+    const auto range = bspline_storve::control_point_range(spline.knot_vector, 2, 12, 0.4f, 0.6f);
+    const size_t num_window_cs = range.second - range.first + 1;
+    BOOST_CHECK_EQUAL(window->get_num_control_points(), num_window_cs);
+    BOOST_CHECK_EQUAL(window->knot_vector.size(), num_window_cs + 3);
+    float start_time, end_time;
+    window->get_time_limits(start_time, end_time);
+    BOOST_CHECK(start_time <= 0.4f);
+    BOOST_CHECK(end_time >= 0.6f);
+    for (size_t i = 0; i < 4; i++) {
+        BOOST_CHECK_EQUAL(window->amplitudes[i], spline.amplitudes[i]);
+        for (size_t cs_no = 0; cs_no < num_window_cs; cs_no++) {
+            const auto expected = spline.get_control_point(i, range.first + cs_no);
+            const auto actual   = window->get_control_point(i, cs_no);
+            BOOST_CHECK_EQUAL(actual.x, expected.x);
+            BOOST_CHECK_EQUAL(actual.z, expected.z);
+        }
+    }
+    BOOST_CHECK_THROW(phantom.get_spline_scatterers(1.5f, 2.0f), std::runtime_error);
+    std::remove(test_file);
+}
@@ -0,0 +1,93 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_ColorFlowEstimator
+#include <cmath>
+#include <vector>
+#include <complex>
+#include <stdexcept>
+#include <boost/test/unit_test.hpp>
+#include "../ColorFlowEstimator.hpp"
+
+namespace {
+
+// Packets of num_lines*num_samples samples from z(line, sample, packet).
+template <typename Fn>
+std::vector<std::complex<float>> make_packets(size_t num_lines, size_t num_samples, size_t packet_size, Fn z) {
+    std::vector<std::complex<float>> frame(num_lines*num_samples);
+    std::vector<std::complex<float>> packets(num_lines*num_samples*packet_size);
+    for (size_t packet_no = 0; packet_no < packet_size; packet_no++) {
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            for (size_t i = 0; i < num_samples; i++) {
+                frame[line_no*num_samples + i] = z(line_no, i, packet_no);
+            }
+        }
+        bcsim::interleave_packet_frame(frame.data(), num_lines, num_samples, packet_no, packet_size, packets.data());
+    }
+    return packets;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(MeanFilterMatchesDirectEstimate) {
+    const size_t num_lines = 3;
+    const size_t num_samples = 37;
+    const size_t packet_size = 8;
+    auto z = [](size_t line_no, size_t i, size_t p) {
+        const auto phase = 0.3f*p*(1.0f + 0.1f*line_no) + 0.05f*i;
+        return std::complex<float>(2.0f + std::cos(phase) + 0.01f*i, std::sin(phase) - 1.0f);
+    };
+    const auto packets = make_packets(num_lines, num_samples, packet_size, z);
+
+    bcsim::ColorFlowEstimator estimator(packet_size, bcsim::ClutterFilter::MEAN);
+    std::vector<float> r0(num_lines*num_samples), phase(num_lines*num_samples);
+    estimator.process(packets.data(), num_lines, num_samples, r0.data(), phase.data());
+
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t i = 0; i < num_samples; i++) {
+            std::complex<float> mean_val(0.0f);
+            for (size_t p = 0; p < packet_size; p++) mean_val += z(line_no, i, p);
+            mean_val /= static_cast<float>(packet_size);
+            float expected_r0 = 0.0f;
+            std::complex<float> r1(0.0f);
+            for (size_t p = 0; p < packet_size; p++) {
+                expected_r0 += std::norm(z(line_no, i, p) - mean_val);
+            }
+            for (size_t p = 0; p + 1 < packet_size; p++) {
+                r1 += std::conj(z(line_no, i, p) - mean_val)*(z(line_no, i, p+1) - mean_val);
+            }
+            BOOST_CHECK_CLOSE(r0[line_no*num_samples + i], expected_r0, 1e-3);
+            BOOST_CHECK_SMALL(phase[line_no*num_samples + i] - std::arg(r1), 1e-4f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PolynomialFilterRemovesLinearClutter) {
+    const size_t num_samples = 16;
+    const size_t packet_size = 10;
+    const float doppler_phase = 0.7f;
+    auto z = [&](size_t, size_t i, size_t p) {
+        const std::complex<float> clutter(5.0f + 0.5f*p, -3.0f + 0.2f*p*i);
+        return clutter + std::polar(0.1f, doppler_phase*p);
+    };
+    const auto packets = make_packets(1, num_samples, packet_size, z);
+
+    std::vector<float> r0(num_samples), phase(num_samples);
+    bcsim::ColorFlowEstimator estimator(packet_size, bcsim::ClutterFilter::POLYNOMIAL, 1);
+    estimator.process(packets.data(), 1, num_samples, r0.data(), phase.data());
+    for (size_t i = 0; i < num_samples; i++) {
+        // the linear trend of the flow signal is removed too, which biases the estimate slightly
+        BOOST_CHECK_SMALL(phase[i] - doppler_phase, 0.1f);
+        BOOST_CHECK(r0[i] < packet_size*0.1f*0.1f);
+    }
+
+    // no filter: the clutter dominates
+    bcsim::ColorFlowEstimator unfiltered(packet_size, bcsim::ClutterFilter::NONE);
+    unfiltered.process(packets.data(), 1, num_samples, r0.data(), phase.data());
+    BOOST_CHECK(std::abs(phase[0] - doppler_phase) > 0.5f);
+}
+
+BOOST_AUTO_TEST_CASE(InvalidSettings) {
+    BOOST_CHECK_THROW(bcsim::ColorFlowEstimator(1), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::ColorFlowEstimator(4, bcsim::ClutterFilter::POLYNOMIAL, 3), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::parse_clutter_filter("iir"), std::runtime_error);
+    BOOST_CHECK(bcsim::parse_clutter_filter("polynomial") == bcsim::ClutterFilter::POLYNOMIAL);
+}
@@ -0,0 +1,68 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_DefaultPhantoms
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "../DefaultPhantoms.hpp"
+
+using namespace default_phantoms;
+
+namespace {
+
+// Constant contraction, so that the control points are the scatterer
+// positions when there is no rotation.
+bcsim::SplineScatterers::u_ptr make_phantom(const LeftVentriclePhantomParameters& params) {
+    std::stringstream csv;
+    csv << "times;factors\n0.0;1.0\n0.5;1.0\n1.0;1.0\n";
+    LeftVentricle3dPhantomFactory factory(params, csv);
+    return factory.get();
+}
+
+LeftVentriclePhantomParameters make_parameters() {
+    LeftVentriclePhantomParameters params;
+    params.num_scatterers = 200000;
+    params.rotation_scale = 0.0f;
+    params.num_cs = 4;
+    return params;
+}
+
+bool same_phantom(const bcsim::SplineScatterers& a, const bcsim::SplineScatterers& b) {
+    return (a.amplitudes == b.amplitudes) && (a.control_xs == b.control_xs)
+        && (a.control_ys == b.control_ys) && (a.control_zs == b.control_zs);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(ScatterersAreInsideTheModel) {
+    const auto params = make_parameters();
+    const auto phantom = make_phantom(params);
+    const ellipsoid::Region3D region(params.x_min, params.x_max, params.y_min, params.y_max, params.z_min, params.z_max);
+    const ellipsoid::ThickCappedZEllipsoid model(region, params.thickness, params.z_ratio);
+    const auto num_splines = static_cast<size_t>(phantom->num_scatterers());
+    BOOST_REQUIRE_GT(num_splines, 0u);
+    BOOST_CHECK_LT(num_splines, params.num_scatterers);
+    size_t num_outside = 0;
+    for (size_t i = 0; i < num_splines; i++) {
+        const auto p = phantom->get_control_point(i, 0);
+        num_outside += !model.is_point_inside(ellipsoid::Point3D(p.x, p.y, p.z));
+        BOOST_CHECK_LE(std::abs(phantom->amplitudes[i]), params.lv_max_amplitude);
+    }
+    // points on the surfaces may be classified differently in double precision
+    BOOST_CHECK_LE(num_outside, num_splines/10000);
+}
+
+BOOST_AUTO_TEST_CASE(PhantomDependsOnlyOnTheSeed) {
+    auto params = make_parameters();
+    const auto phantom = make_phantom(params);
+    BOOST_CHECK(same_phantom(*phantom, *make_phantom(params)));
+#ifdef BCSIM_ENABLE_OPENMP
+    const auto max_threads = omp_get_max_threads();
+    omp_set_num_threads(3);
+    BOOST_CHECK(same_phantom(*phantom, *make_phantom(params)));
+    omp_set_num_threads(max_threads);
+#endif
+    params.seed = 1;
+    BOOST_CHECK(!same_phantom(*phantom, *make_phantom(params)));
+}
@@ -0,0 +1,197 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_HdfIqRecorder
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <H5Cpp.h>
+#include "../HdfIqRecorder.hpp"
+#include "../../core/iq_format.hpp"
+
+namespace {
+const char* test_file = "test_HdfIqRecorder.h5";
+
+std::complex<float> test_sample(size_t frame_no, size_t line_no, size_t sample_no) {
+    return std::complex<float>(static_cast<float>(frame_no*1000 + line_no*100 + sample_no),
+                               -static_cast<float>(sample_no));
+}
+
+struct ComplexSample {
+    float r;
+    float i;
+};
+}
+
+BOOST_AUTO_TEST_CASE(verify_invalid_dimensions_fail) {
+    BOOST_CHECK_THROW(bcsim::HdfIqRecorder(test_file, 0, 10), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::HdfIqRecorder(test_file, 10, 0), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::HdfIqRecorder(test_file, 10, 10, 10), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(verify_frames_are_written_in_order) {
+    const size_t num_lines = 3;
+    const size_t num_samples = 5;
+    const size_t line_stride = 7;
+    const size_t num_frames = 20;
+    for (int compression_level : {0, 4}) {
+        bcsim::HdfIqRecorder recorder(test_file, num_lines, num_samples, compression_level, 2);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            if (frame_no % 2 == 0) {
+                std::vector<std::complex<float>> buffer(num_lines*line_stride);
+                for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                    for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                        buffer[line_no*line_stride + sample_no] = test_sample(frame_no, line_no, sample_no);
+                    }
+                }
+                recorder.append(buffer.data(), line_stride, 0.5f*frame_no);
+            } else {
+                std::vector<std::vector<std::complex<float>>> lines(num_lines, std::vector<std::complex<float>>(num_samples));
+                for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                    for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                        lines[line_no][sample_no] = test_sample(frame_no, line_no, sample_no);
+                    }
+                }
+                recorder.append(lines, 0.5f*frame_no);
+            }
+        }
+        BOOST_CHECK_EQUAL(recorder.get_num_frames(), num_frames);
+        recorder.close();
+        BOOST_CHECK_THROW(recorder.append(std::vector<std::vector<std::complex<float>>>(num_lines,
+                                          std::vector<std::complex<float>>(num_samples)), 0.0f), std::runtime_error);
+
+        H5::H5File file(test_file, H5F_ACC_RDONLY);
+        auto iq_dataset = file.openDataSet("iq");
+        hsize_t dims[3];
+        BOOST_CHECK_EQUAL(iq_dataset.getSpace().getSimpleExtentDims(dims), 3);
+        BOOST_CHECK_EQUAL(dims[0], num_frames);
+        BOOST_CHECK_EQUAL(dims[1], num_lines);
+        BOOST_CHECK_EQUAL(dims[2], num_samples);
+
+        H5::CompType sample_type(sizeof(ComplexSample));
+        sample_type.insertMember("r", HOFFSET(ComplexSample, r), H5::PredType::NATIVE_FLOAT);
+        sample_type.insertMember("i", HOFFSET(ComplexSample, i), H5::PredType::NATIVE_FLOAT);
+        std::vector<ComplexSample> samples(num_frames*num_lines*num_samples);
+        iq_dataset.read(samples.data(), sample_type);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                    const auto& s = samples[(frame_no*num_lines + line_no)*num_samples + sample_no];
+                    const auto expected = test_sample(frame_no, line_no, sample_no);
+                    BOOST_CHECK_EQUAL(s.r, expected.real());
+                    BOOST_CHECK_EQUAL(s.i, expected.imag());
+                }
+            }
+        }
+
+        std::vector<float> frame_times(num_frames);
+        file.openDataSet("frame_times").read(frame_times.data(), H5::PredType::NATIVE_FLOAT);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            BOOST_CHECK_EQUAL(frame_times[frame_no], 0.5f*frame_no);
+        }
+    }
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_wrong_frame_size_fails) {
+    bcsim::HdfIqRecorder recorder(test_file, 2, 4);
+    std::vector<std::vector<std::complex<float>>> lines(3, std::vector<std::complex<float>>(4));
+    BOOST_CHECK_THROW(recorder.append(lines, 0.0f), std::runtime_error);
+    lines.resize(2);
+    lines[1].resize(5);
+    BOOST_CHECK_THROW(recorder.append(lines, 0.0f), std::runtime_error);
+    std::vector<std::complex<float>> buffer(8);
+    BOOST_CHECK_THROW(recorder.append(buffer.data(), 3, 0.0f), std::runtime_error);
+    recorder.close();
+    BOOST_CHECK_EQUAL(recorder.get_num_frames(), 0);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_int16_frames_are_scaled_per_frame) {
+    const size_t num_lines = 3;
+    const size_t num_samples = 5;
+    const size_t num_frames = 4;
+    bcsim::IqOutputFormat format;
+    format.sample_type = bcsim::IqOutputFormat::SampleType::COMPLEX_INT16;
+    {
+        bcsim::HdfIqRecorder recorder(test_file, num_lines, num_samples, 0, 2, format);
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            std::vector<std::complex<float>> buffer(num_lines*num_samples);
+            for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                    buffer[line_no*num_samples + sample_no] = test_sample(frame_no, line_no, sample_no);
+                }
+            }
+            recorder.append(buffer.data(), num_samples, 0.5f*frame_no);
+        }
+        recorder.close();
+    }
+
+    H5::H5File file(test_file, H5F_ACC_RDONLY);
+    struct Int16Sample {
+        int16_t r;
+        int16_t i;
+    };
+    H5::CompType sample_type(sizeof(Int16Sample));
+    sample_type.insertMember("r", HOFFSET(Int16Sample, r), H5::PredType::NATIVE_INT16);
+    sample_type.insertMember("i", HOFFSET(Int16Sample, i), H5::PredType::NATIVE_INT16);
+    std::vector<Int16Sample> samples(num_frames*num_lines*num_samples);
+    file.openDataSet("iq").read(samples.data(), sample_type);
+    std::vector<float> scales(num_frames);
+    file.openDataSet("iq_scales").read(scales.data(), H5::PredType::NATIVE_FLOAT);
+    for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+        // the largest part of the frame is its last real part
+        const auto max_abs = test_sample(frame_no, num_lines - 1, num_samples - 1).real();
+        BOOST_CHECK_CLOSE(scales[frame_no], 32767.0f/max_abs, 1e-4);
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                const auto& s = samples[(frame_no*num_lines + line_no)*num_samples + sample_no];
+                const auto expected = test_sample(frame_no, line_no, sample_no);
+                BOOST_CHECK_SMALL(s.r/scales[frame_no] - expected.real(), 0.5f/scales[frame_no] + 1e-3f);
+                BOOST_CHECK_SMALL(s.i/scales[frame_no] - expected.imag(), 0.5f/scales[frame_no] + 1e-3f);
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(samples[num_lines*num_samples - 1].r, 32767);
+    std::remove(test_file);
+}
+
+BOOST_AUTO_TEST_CASE(verify_float16_frames_are_read_as_floats) {
+    const size_t num_lines = 2;
+    const size_t num_samples = 3;
+    const size_t line_stride = 4;
+    bcsim::IqOutputFormat format;
+    format.sample_type = bcsim::IqOutputFormat::SampleType::COMPLEX_FLOAT16;
+    std::vector<std::complex<float>> buffer(num_lines*line_stride);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = std::complex<float>(0.1f*i - 0.3f, 1000.7f*i);
+    }
+    {
+        bcsim::HdfIqRecorder recorder(test_file, num_lines, num_samples, 0, 2, format);
+        recorder.append(buffer.data(), line_stride, 0.0f);
+        // the same frame converted by the caller
+        std::vector<uint16_t> packed(2*buffer.size());
+        bcsim::convert_iq_samples(buffer.data(), buffer.size(), format.sample_type, 1.0f, packed.data());
+        recorder.append_formatted(packed.data(), line_stride, 1.0f, 1.0f);
+        recorder.close();
+    }
+
+    H5::H5File file(test_file, H5F_ACC_RDONLY);
+    H5::CompType sample_type(sizeof(ComplexSample));
+    sample_type.insertMember("r", HOFFSET(ComplexSample, r), H5::PredType::NATIVE_FLOAT);
+    sample_type.insertMember("i", HOFFSET(ComplexSample, i), H5::PredType::NATIVE_FLOAT);
+    std::vector<ComplexSample> samples(2*num_lines*num_samples);
+    file.openDataSet("iq").read(samples.data(), sample_type);
+    BOOST_CHECK(!H5Lexists(file.getId(), "iq_scales", H5P_DEFAULT));
+    for (size_t frame_no = 0; frame_no < 2; frame_no++) {
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                const auto& s = samples[(frame_no*num_lines + line_no)*num_samples + sample_no];
+                const auto& x = buffer[line_no*line_stride + sample_no];
+                BOOST_CHECK_EQUAL(s.r, bcsim::half_bits_to_float(bcsim::float_to_half_bits(x.real())));
+                BOOST_CHECK_EQUAL(s.i, bcsim::half_bits_to_float(bcsim::float_to_half_bits(x.imag())));
+            }
+        }
+    }
+    std::remove(test_file);
+}
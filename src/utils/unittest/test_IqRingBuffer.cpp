@@ -0,0 +1,128 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_IqRingBuffer
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "../IqRingBuffer.hpp"
+
+namespace {
+std::complex<float> test_sample(size_t frame_no, size_t line_no, size_t sample_no) {
+    return std::complex<float>(static_cast<float>(frame_no*1000 + line_no*100 + sample_no),
+                               -static_cast<float>(sample_no));
+}
+
+std::vector<std::vector<std::complex<float>>> test_frame(size_t frame_no, size_t num_lines, size_t num_samples) {
+    std::vector<std::vector<std::complex<float>>> lines(num_lines, std::vector<std::complex<float>>(num_samples));
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+            lines[line_no][sample_no] = test_sample(frame_no, line_no, sample_no);
+        }
+    }
+    return lines;
+}
+
+void check_frame(const bcsim::IqRingBuffer::Frame& frame, size_t frame_no, size_t num_lines, size_t num_samples) {
+    BOOST_REQUIRE_EQUAL(frame.num_lines, num_lines);
+    BOOST_REQUIRE_EQUAL(frame.num_samples, num_samples);
+    BOOST_REQUIRE_EQUAL(frame.samples.size(), num_lines*num_samples);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+            BOOST_REQUIRE(frame.samples[line_no*num_samples + sample_no] == test_sample(frame_no, line_no, sample_no));
+        }
+    }
+}
+}
+
+BOOST_AUTO_TEST_CASE(verify_oldest_frames_are_overwritten) {
+    const size_t num_lines = 3;
+    const size_t num_samples = 5;
+    const size_t line_stride = 7;
+    bcsim::IqRingBuffer ring_buffer(1.0, 4);
+    BOOST_CHECK_EQUAL(ring_buffer.get_num_frames(), 0u);
+
+    for (size_t frame_no = 0; frame_no < 10; frame_no++) {
+        if (frame_no % 2 == 0) {
+            std::vector<std::complex<float>> buffer(num_lines*line_stride);
+            for (size_t line_no = 0; line_no < num_lines; line_no++) {
+                for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+                    buffer[line_no*line_stride + sample_no] = test_sample(frame_no, line_no, sample_no);
+                }
+            }
+            ring_buffer.push(buffer.data(), num_lines, num_samples, line_stride, 0.5f*frame_no);
+        } else {
+            ring_buffer.push(test_frame(frame_no, num_lines, num_samples), 0.5f*frame_no);
+        }
+    }
+    BOOST_CHECK_EQUAL(ring_buffer.get_capacity(), 4u);
+    BOOST_CHECK_EQUAL(ring_buffer.get_num_frames(), 4u);
+    BOOST_CHECK_EQUAL(ring_buffer.get_first_frame_no(), 6u);
+    BOOST_CHECK_EQUAL(ring_buffer.get_end_frame_no(), 10u);
+
+    bcsim::IqRingBuffer::Frame frame;
+    BOOST_CHECK(!ring_buffer.read(5, frame));
+    BOOST_CHECK(!ring_buffer.read(10, frame));
+    for (size_t frame_no = 6; frame_no < 10; frame_no++) {
+        BOOST_REQUIRE(ring_buffer.read(frame_no, frame));
+        check_frame(frame, frame_no, num_lines, num_samples);
+        BOOST_CHECK_EQUAL(frame.timestamp, 0.5f*frame_no);
+    }
+
+    ring_buffer.clear();
+    BOOST_CHECK_EQUAL(ring_buffer.get_num_frames(), 0u);
+    BOOST_CHECK_EQUAL(ring_buffer.get_end_frame_no(), 10u);
+}
+
+BOOST_AUTO_TEST_CASE(verify_capacity_from_size) {
+    // room for 1024*1024/8 samples
+    bcsim::IqRingBuffer ring_buffer(8.0/8);
+    ring_buffer.push(test_frame(0, 64, 1024), 0.0f);
+    BOOST_CHECK_EQUAL(ring_buffer.get_capacity(), 2u);
+    BOOST_CHECK_THROW(ring_buffer.push(test_frame(0, 129, 1024), 0.0f), std::runtime_error);
+    BOOST_CHECK_THROW(ring_buffer.push(test_frame(0, 0, 1024), 0.0f), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::IqRingBuffer(0.0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(verify_new_frame_size_discards_frames) {
+    bcsim::IqRingBuffer ring_buffer(1.0, 8);
+    for (size_t frame_no = 0; frame_no < 3; frame_no++) {
+        ring_buffer.push(test_frame(frame_no, 2, 4), 0.0f);
+    }
+    ring_buffer.push(test_frame(3, 4, 2), 0.0f);
+    BOOST_CHECK_EQUAL(ring_buffer.get_num_frames(), 1u);
+    BOOST_CHECK_EQUAL(ring_buffer.get_first_frame_no(), 3u);
+
+    bcsim::IqRingBuffer::Frame frame;
+    BOOST_CHECK(!ring_buffer.read(2, frame));
+    BOOST_REQUIRE(ring_buffer.read(3, frame));
+    check_frame(frame, 3, 4, 2);
+}
+
+BOOST_AUTO_TEST_CASE(verify_concurrent_reader_gets_consistent_frames) {
+    const size_t num_lines = 8;
+    const size_t num_samples = 16;
+    const size_t num_frames = 2000;
+    bcsim::IqRingBuffer ring_buffer(1.0, 4);
+
+    std::thread writer([&]() {
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            ring_buffer.push(test_frame(frame_no, num_lines, num_samples), 0.0f);
+        }
+    });
+
+    // read all frames which are still in the buffer
+    size_t next_frame_no = 0;
+    size_t num_read = 0;
+    bcsim::IqRingBuffer::Frame frame;
+    while (next_frame_no < num_frames) {
+        next_frame_no = std::max(next_frame_no, ring_buffer.get_first_frame_no());
+        if (ring_buffer.read(next_frame_no, frame)) {
+            check_frame(frame, next_frame_no, num_lines, num_samples);
+            next_frame_no++;
+            num_read++;
+        }
+    }
+    writer.join();
+    BOOST_CHECK(num_read > 0);
+}
@@ -0,0 +1,117 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_MeshPhantom
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#ifdef BCSIM_ENABLE_OPENMP
+    #include <omp.h>
+#endif
+#include "../MeshPhantom.hpp"
+
+using namespace bcsim;
+
+namespace {
+
+// Unit cube [0, 1]^3 in millimeters, with quads and triangles in several
+// face formats.
+const char* CUBE_OBJ =
+    "# cube\n"
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "v 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\n"
+    "vn 0 0 1\n"
+    "f 1 4 3 2\n"
+    "f 5/1/1 6/1/1 7/1/1 8/1/1\n"
+    "f 1//1 2//1 6//1\nf 1 6 5\n"
+    "f 2 3 7\nf 2 7 6\n"
+    "f 3 4 8\nf 3 8 7\n"
+    "f -8 -4 -1 -5\n";
+
+MeshVolume make_cube() {
+    std::istringstream obj(CUBE_OBJ);
+    const auto mesh = load_obj_mesh(obj, 1e-3f);
+    BOOST_REQUIRE_EQUAL(mesh.num_triangles(), 12u);
+    return MeshVolume(mesh);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(InvalidMeshesAreRejected) {
+    std::istringstream bad_index("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n");
+    BOOST_CHECK_THROW(load_obj_mesh(bad_index), std::runtime_error);
+    std::istringstream bad_vertex("v 0 0\n");
+    BOOST_CHECK_THROW(load_obj_mesh(bad_vertex), std::runtime_error);
+    BOOST_CHECK_THROW(MeshVolume{TriangleMesh()}, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(InsideAndDistanceQueries) {
+    const auto cube = make_cube();
+    BOOST_CHECK(cube.is_inside(vector3(0.5e-3f, 0.5e-3f, 0.5e-3f)));
+    BOOST_CHECK(cube.is_inside(vector3(0.01e-3f, 0.99e-3f, 0.5e-3f)));
+    BOOST_CHECK(!cube.is_inside(vector3(1.5e-3f, 0.5e-3f, 0.5e-3f)));
+    BOOST_CHECK(!cube.is_inside(vector3(-0.5e-3f, -0.5e-3f, 0.5e-3f)));
+    BOOST_CHECK_CLOSE(cube.distance_to_surface(vector3(0.5e-3f, 0.5e-3f, 0.5e-3f)), 0.5e-3f, 1e-3);
+    BOOST_CHECK_CLOSE(cube.distance_to_surface(vector3(0.5e-3f, 0.2e-3f, 0.5e-3f)), 0.2e-3f, 1e-3);
+    BOOST_CHECK_CLOSE(cube.distance_to_surface(vector3(2e-3f, 0.5e-3f, 0.5e-3f)), 1e-3f, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(FixedScatterersFillTheVolume) {
+    const auto cube = make_cube();
+    MeshPhantomConfig config;
+    config.density = 1e14;      // 100k in the cube
+    const auto scatterers = create_mesh_fixed_scatterers(cube, config);
+    BOOST_CHECK_EQUAL(scatterers->num_scatterers(), 100000);
+    for (const auto& s : scatterers->scatterers) {
+        BOOST_REQUIRE(cube.is_inside(s.pos));
+    }
+
+    // a shell of 0.1 mm holds 1 - 0.8^3 of the cube
+    config.shell_thickness = 0.1e-3f;
+    const auto shell = create_mesh_fixed_scatterers(cube, config);
+    BOOST_CHECK_CLOSE(static_cast<double>(shell->num_scatterers()), 48800.0, 2.0);
+    for (const auto& s : shell->scatterers) {
+        BOOST_REQUIRE_LE(cube.distance_to_surface(s.pos), config.shell_thickness);
+    }
+
+    config.density = -1.0;
+    BOOST_CHECK_THROW(create_mesh_fixed_scatterers(cube, config), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(PhantomDependsOnlyOnTheSeed) {
+    const auto cube = make_cube();
+    MeshPhantomConfig config;
+    config.density = 1e13;
+    config.shell_thickness = 0.2e-3f;
+    const auto a = create_mesh_fixed_scatterers(cube, config);
+#ifdef BCSIM_ENABLE_OPENMP
+    const auto max_threads = omp_get_max_threads();
+    omp_set_num_threads(3);
+#endif
+    const auto b = create_mesh_fixed_scatterers(cube, config);
+#ifdef BCSIM_ENABLE_OPENMP
+    omp_set_num_threads(max_threads);
+#endif
+    BOOST_REQUIRE_EQUAL(a->num_scatterers(), b->num_scatterers());
+    for (size_t i = 0; i < a->scatterers.size(); i++) {
+        BOOST_REQUIRE(a->scatterers[i].pos.x == b->scatterers[i].pos.x);
+        BOOST_REQUIRE(a->scatterers[i].amplitude == b->scatterers[i].amplitude);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SplineScatterersFollowTheMotion) {
+    const auto cube = make_cube();
+    MeshPhantomConfig config;
+    config.density = 1e12;
+    const auto shift = [](const vector3& p, float t) { return p + vector3(t*1e-3f, 0.0f, 0.0f); };
+    const auto splines = create_mesh_spline_scatterers(cube, config, shift, 1, 3, 0.0f, 1.0f);
+    const auto fixed = create_mesh_fixed_scatterers(cube, config);
+    BOOST_REQUIRE_EQUAL(splines->num_scatterers(), fixed->num_scatterers());
+    BOOST_CHECK_EQUAL(splines->get_num_control_points(), 3u);
+    for (size_t i = 0; i < fixed->scatterers.size(); i++) {
+        const auto& p = fixed->scatterers[i].pos;
+        BOOST_REQUIRE_CLOSE(splines->get_control_point(i, 0).x, p.x, 1e-3);
+        BOOST_REQUIRE_CLOSE(splines->get_control_point(i, 2).x, p.x + 1e-3f, 1e-3);
+        BOOST_REQUIRE_EQUAL(splines->amplitudes[i], fixed->scatterers[i].amplitude);
+    }
+    BOOST_CHECK_THROW(create_mesh_spline_scatterers(cube, config, shift, 3, 3, 0.0f, 1.0f), std::runtime_error);
+}
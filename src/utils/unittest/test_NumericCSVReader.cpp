@@ -0,0 +1,95 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_NumericCSVReader
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "../NumericCSVReader.hpp"
+#include "../CSVReader.hpp"
+
+BOOST_AUTO_TEST_CASE(MatchesCSVReader) {
+    const std::string text = "times;factors\n0;1.0\r\n0.25;1.5\n\n  0.5 ;-2e-3\n1e1;+7\n";
+    csv::NumericCSVReader reader(text.data(), text.size(), ';');
+    csv::CSVReader reference(std::stringstream(text), ';');
+    BOOST_REQUIRE_EQUAL(reader.get_num_rows(), 4u);
+    BOOST_CHECK_EQUAL(reader.get_column_headers().size(), 2u);
+    for (const auto& name : {"times", "factors"}) {
+        const auto values = reader.get_column<float>(name);
+        const auto expected = reference.get_column<float>(name);
+        BOOST_REQUIRE_EQUAL(values.size(), expected.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            BOOST_CHECK_EQUAL(values[i], expected[i]);
+        }
+    }
+    BOOST_CHECK_EQUAL(reader.get_column<int>("factors")[3], 7);
+    BOOST_CHECK_THROW(reader.get_values("missing"), std::runtime_error);
+}
+
+// The fast path and the fallback give the same doubles as strtod().
+BOOST_AUTO_TEST_CASE(ParsesExactly) {
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> mantissa_dist(-10.0, 10.0);
+    std::uniform_int_distribution<int> exponent_dist(-40, 40);
+    std::ostringstream ss;
+    ss << "x\n";
+    std::vector<std::string> tokens;
+    for (int i = 0; i < 2000; i++) {
+        std::ostringstream token;
+        token.precision(1 + i % 20);
+        token << mantissa_dist(gen)*std::pow(10.0, exponent_dist(gen));
+        tokens.push_back(token.str());
+        ss << token.str() << "\n";
+    }
+    ss << "12345678901234567890123\n0.000000000000000000000000001\ninf\n";
+    tokens.push_back("12345678901234567890123");
+    tokens.push_back("0.000000000000000000000000001");
+    tokens.push_back("inf");
+    const auto text = ss.str();
+    csv::NumericCSVReader reader(text.data(), text.size());
+    const auto& values = reader.get_values("x");
+    BOOST_REQUIRE_EQUAL(values.size(), tokens.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        BOOST_CHECK_EQUAL(values[i], std::strtod(tokens[i].c_str(), nullptr));
+    }
+}
+
+// A mapped file large enough to be split across threads.
+BOOST_AUTO_TEST_CASE(ParsesFileInParallel) {
+    const std::string filename = "test_NumericCSVReader.csv";
+    const size_t num_rows = 200000;
+    {
+        std::ofstream out(filename);
+        out << "i;square;half\n";
+        for (size_t i = 0; i < num_rows; i++) {
+            out << i << ";" << i*i << ";" << 0.5*i << "\n";
+        }
+    }
+    csv::NumericCSVReader reader(filename, ';', 4);
+    std::remove(filename.c_str());
+    BOOST_REQUIRE_EQUAL(reader.get_num_rows(), num_rows);
+    const auto& is = reader.get_values("i");
+    const auto& squares = reader.get_values("square");
+    const auto& halves = reader.get_values("half");
+    for (size_t i = 0; i < num_rows; i++) {
+        BOOST_REQUIRE_EQUAL(is[i], static_cast<double>(i));
+        BOOST_REQUIRE_EQUAL(squares[i], static_cast<double>(i*i));
+        BOOST_REQUIRE_EQUAL(halves[i], 0.5*i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(InvalidInputIsRejected) {
+    const std::string empty;
+    BOOST_CHECK_THROW(csv::NumericCSVReader(empty.data(), empty.size()), std::runtime_error);
+    const std::string too_few = "x;y\n1;2\n3\n";
+    BOOST_CHECK_THROW(csv::NumericCSVReader(too_few.data(), too_few.size()), std::runtime_error);
+    const std::string too_many = "x;y\n1;2;3\n";
+    BOOST_CHECK_THROW(csv::NumericCSVReader(too_many.data(), too_many.size()), std::runtime_error);
+    const std::string not_a_number = "x\n1.5x\n";
+    BOOST_CHECK_THROW(csv::NumericCSVReader(not_a_number.data(), not_a_number.size()), std::runtime_error);
+    BOOST_CHECK_THROW(csv::NumericCSVReader("no_such_file.csv"), std::runtime_error);
+}
@@ -0,0 +1,121 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_ParallelHdfReader
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <H5Cpp.h>
+#include "../ParallelHdfReader.hpp"
+
+namespace {
+
+// Writes values as a dataset of the given dimensions, chunked and
+// compressed or contiguous, as floats or doubles.
+void write_dataset(H5::H5File& file, const std::string& name, const std::vector<hsize_t>& dims,
+                   const std::vector<float>& values, bool compressed, bool as_double) {
+    H5::DSetCreatPropList props;
+    if (compressed) {
+        auto chunk_dims = dims;
+        chunk_dims[0] = std::min<hsize_t>(dims[0], 7);
+        props.setChunk(static_cast<int>(dims.size()), chunk_dims.data());
+        props.setDeflate(4);
+    }
+    const H5::DataSpace space(static_cast<int>(dims.size()), dims.data());
+    const auto file_type = as_double ? H5::PredType::NATIVE_DOUBLE : H5::PredType::NATIVE_FLOAT;
+    auto dataset = file.createDataSet(name, file_type, space, props);
+    dataset.write(values.data(), H5::PredType::NATIVE_FLOAT);
+}
+
+void write_scalar(H5::H5File& file, const std::string& name, int value) {
+    auto dataset = file.createDataSet(name, H5::PredType::NATIVE_INT, H5::DataSpace());
+    dataset.write(&value, H5::PredType::NATIVE_INT);
+}
+
+std::vector<float> ramp(size_t n) {
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; i++) values[i] = 0.25f*i - 3.0f;
+    return values;
+}
+
+bcsim::ParallelHdfReadConfig small_chunks() {
+    bcsim::ParallelHdfReadConfig config;
+    config.chunk_bytes = 100;
+    config.num_threads = 4;
+    return config;
+}
+
+}   // end anonymous namespace
+
+BOOST_AUTO_TEST_CASE(FixedScatterersMatchForAllLayouts) {
+    const size_t num_scatterers = 1001;
+    const auto values = ramp(4*num_scatterers);
+    for (const bool compressed : {false, true}) {
+        for (const bool as_double : {false, true}) {
+            const std::string filename = "test_ParallelHdfReader_fixed.h5";
+            {
+                H5::H5File file(filename, H5F_ACC_TRUNC);
+                write_dataset(file, "data", {num_scatterers, 4}, values, compressed, as_double);
+            }
+            const auto scatterers = bcsim::loadFixedScatterersFromHdfParallel(filename, small_chunks());
+            std::remove(filename.c_str());
+            BOOST_REQUIRE_EQUAL(scatterers->scatterers.size(), num_scatterers);
+            for (size_t i = 0; i < num_scatterers; i++) {
+                const auto& s = scatterers->scatterers[i];
+                BOOST_REQUIRE_EQUAL(s.pos.x, values[4*i]);
+                BOOST_REQUIRE_EQUAL(s.pos.y, values[4*i + 1]);
+                BOOST_REQUIRE_EQUAL(s.pos.z, values[4*i + 2]);
+                BOOST_REQUIRE_EQUAL(s.amplitude, values[4*i + 3]);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SplineScatterersAreConvertedToStructureOfArrays) {
+    const size_t num_scatterers = 333;
+    const size_t num_cs = 5;
+    const auto control_points = ramp(num_scatterers*num_cs*3);
+    const auto amplitudes = ramp(num_scatterers);
+    const std::string filename = "test_ParallelHdfReader_spline.h5";
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        write_dataset(file, "control_points", {num_scatterers, num_cs, 3}, control_points, true, false);
+        write_dataset(file, "amplitudes", {num_scatterers}, amplitudes, false, false);
+        write_dataset(file, "knot_vector", {num_cs + 3}, {0, 0, 0, 0.3f, 0.6f, 1, 1, 1}, false, false);
+        write_scalar(file, "spline_degree", 2);
+    }
+    const auto scatterers = bcsim::loadSplineScatterersFromHdfParallel(filename, small_chunks());
+    std::remove(filename.c_str());
+    BOOST_REQUIRE_EQUAL(scatterers->num_scatterers(), static_cast<int>(num_scatterers));
+    BOOST_CHECK_EQUAL(scatterers->get_num_control_points(), num_cs);
+    BOOST_CHECK_EQUAL(scatterers->spline_degree, 2);
+    BOOST_CHECK_EQUAL(scatterers->knot_vector.size(), num_cs + 3);
+    for (size_t i = 0; i < num_scatterers; i++) {
+        BOOST_REQUIRE_EQUAL(scatterers->amplitudes[i], amplitudes[i]);
+        for (size_t cs_no = 0; cs_no < num_cs; cs_no++) {
+            const auto pt = scatterers->get_control_point(i, cs_no);
+            const auto expected = &control_points[3*(i*num_cs + cs_no)];
+            BOOST_REQUIRE_EQUAL(pt.x, expected[0]);
+            BOOST_REQUIRE_EQUAL(pt.y, expected[1]);
+            BOOST_REQUIRE_EQUAL(pt.z, expected[2]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RowsArePassedToConsumer) {
+    const std::string filename = "test_ParallelHdfReader_rows.h5";
+    const auto values = ramp(10*6);
+    {
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        write_dataset(file, "values", {10, 2, 3}, values, false, false);
+    }
+    std::vector<float> read(values.size(), 0.0f);
+    bcsim::readHdfRowsParallel(filename, "values", small_chunks(), [&](size_t first_row, size_t num_rows, const float* rows) {
+        std::copy(rows, rows + 6*num_rows, read.begin() + 6*first_row);
+    });
+    BOOST_CHECK(read == values);
+    BOOST_CHECK_THROW(bcsim::readHdfRowsParallel(filename, "missing", small_chunks(), nullptr), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::loadFixedScatterersFromHdfParallel(filename), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::loadFixedScatterersFromHdfParallel("no_such_file.h5"), std::runtime_error);
+    std::remove(filename.c_str());
+}
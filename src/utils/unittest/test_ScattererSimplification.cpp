@@ -0,0 +1,116 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_ScattererSimplification
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include "../ScattererSimplification.hpp"
+
+namespace {
+// Uniformly distributed scatterers in [0, size)^3 with Gaussian amplitudes.
+bcsim::FixedScatterers make_speckle_phantom(size_t num_scatterers, float size) {
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> position(0.0f, size);
+    std::normal_distribution<float> amplitude(0.0f, 1.0f);
+    bcsim::FixedScatterers phantom;
+    phantom.scatterers.resize(num_scatterers);
+    for (auto& scatterer : phantom.scatterers) {
+        scatterer.pos = bcsim::vector3(position(gen), position(gen), position(gen));
+        scatterer.amplitude = amplitude(gen);
+    }
+    return phantom;
+}
+
+double total_intensity(const bcsim::FixedScatterers& scatterers) {
+    double sum = 0.0;
+    for (const auto& scatterer : scatterers.scatterers) {
+        sum += static_cast<double>(scatterer.amplitude)*scatterer.amplitude;
+    }
+    return sum;
+}
+}
+
+BOOST_AUTO_TEST_CASE(verify_default_config_keeps_all_scatterers) {
+    const auto phantom = make_speckle_phantom(1000, 4e-3f);
+    bcsim::ScattererSimplificationReport report;
+    const auto result = bcsim::simplify_fixed_scatterers(phantom, bcsim::ScattererSimplificationConfig(), report);
+    BOOST_REQUIRE_EQUAL(result->scatterers.size(), phantom.scatterers.size());
+    BOOST_CHECK_EQUAL(report.num_pruned_scatterers, 0u);
+    BOOST_CHECK_CLOSE(report.speedup, 1.0f, 1e-4f);
+    BOOST_CHECK_SMALL(report.mean_intensity_error, 1e-6f);
+    BOOST_CHECK_SMALL(report.speckle_contrast_error, 1e-6f);
+}
+
+BOOST_AUTO_TEST_CASE(verify_pruning_drops_weak_scatterers) {
+    const auto phantom = make_speckle_phantom(10000, 4e-3f);
+    bcsim::ScattererSimplificationConfig config;
+    config.relative_amplitude_threshold = 0.1f;
+    bcsim::ScattererSimplificationReport report;
+    const auto result = bcsim::simplify_fixed_scatterers(phantom, config, report);
+
+    float max_amplitude = 0.0f;
+    for (const auto& scatterer : phantom.scatterers) {
+        max_amplitude = std::max(max_amplitude, std::abs(scatterer.amplitude));
+    }
+    for (const auto& scatterer : result->scatterers) {
+        BOOST_REQUIRE(std::abs(scatterer.amplitude) >= 0.1f*max_amplitude);
+    }
+    BOOST_CHECK_EQUAL(report.num_output_scatterers, result->scatterers.size());
+    BOOST_CHECK_EQUAL(report.num_pruned_scatterers + report.num_output_scatterers, phantom.scatterers.size());
+    BOOST_CHECK(report.speedup > 1.0f);
+    // the weakest scatterers carry little of the intensity
+    BOOST_CHECK(report.total_intensity_error < 0.0f);
+    BOOST_CHECK(report.total_intensity_error > -0.05f);
+}
+
+BOOST_AUTO_TEST_CASE(verify_merging_preserves_voxel_intensity) {
+    const auto phantom = make_speckle_phantom(20000, 4e-3f);
+    bcsim::ScattererSimplificationConfig config;
+    config.merge_voxel_size = 0.25e-3f;
+    config.representatives_per_voxel = 2;
+    config.resolution_cell_size = 1e-3f;
+    bcsim::ScattererSimplificationReport report;
+    const auto result = bcsim::simplify_fixed_scatterers(phantom, config, report);
+
+    // 4096 voxels of about five scatterers each
+    BOOST_CHECK(result->scatterers.size() <= 2*4096u);
+    BOOST_CHECK(report.speedup > 2.0f);
+    BOOST_CHECK_CLOSE(total_intensity(*result), total_intensity(phantom), 1e-3);
+    BOOST_CHECK_SMALL(report.total_intensity_error, 1e-5f);
+    // the voxels are aligned with the resolution cells
+    BOOST_CHECK_SMALL(report.mean_intensity_error, 1e-5f);
+    // a resolution cell still holds about 128 scatterers
+    BOOST_CHECK(report.speckle_contrast_error > 0.0f);
+    BOOST_CHECK(report.speckle_contrast_error < 0.05f);
+    for (const auto& scatterer : result->scatterers) {
+        BOOST_REQUIRE(scatterer.pos.x >= 0.0f && scatterer.pos.x < 4e-3f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(verify_coarse_merging_increases_contrast_error) {
+    const auto phantom = make_speckle_phantom(20000, 4e-3f);
+    bcsim::ScattererSimplificationConfig config;
+    config.resolution_cell_size = 1e-3f;
+    bcsim::ScattererSimplificationReport fine_report;
+    bcsim::ScattererSimplificationReport coarse_report;
+    config.merge_voxel_size = 0.25e-3f;
+    bcsim::simplify_fixed_scatterers(phantom, config, fine_report);
+    config.merge_voxel_size = 0.5e-3f;
+    bcsim::simplify_fixed_scatterers(phantom, config, coarse_report);
+    BOOST_CHECK(coarse_report.speedup > fine_report.speedup);
+    BOOST_CHECK(coarse_report.speckle_contrast_error > fine_report.speckle_contrast_error);
+}
+
+BOOST_AUTO_TEST_CASE(verify_invalid_config_throws) {
+    const auto phantom = make_speckle_phantom(10, 1e-3f);
+    bcsim::ScattererSimplificationReport report;
+    bcsim::ScattererSimplificationConfig config;
+    config.relative_amplitude_threshold = 1.0f;
+    BOOST_CHECK_THROW(bcsim::simplify_fixed_scatterers(phantom, config, report), std::runtime_error);
+    config = bcsim::ScattererSimplificationConfig();
+    config.representatives_per_voxel = 0;
+    BOOST_CHECK_THROW(bcsim::simplify_fixed_scatterers(phantom, config, report), std::runtime_error);
+    config = bcsim::ScattererSimplificationConfig();
+    config.resolution_cell_size = 0.0f;
+    BOOST_CHECK_THROW(bcsim::simplify_fixed_scatterers(phantom, config, report), std::runtime_error);
+}
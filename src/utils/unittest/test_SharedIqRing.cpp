@@ -0,0 +1,143 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_SharedIqRing
+#include <boost/test/unit_test.hpp>
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../SharedIqRing.hpp"
+#include "../../core/iq_format.hpp"
+
+namespace {
+const std::string ring_name = "/bcsim_test_ring_" + std::to_string(getpid());
+
+std::complex<float> test_sample(size_t frame_no, size_t line_no, size_t sample_no) {
+    return std::complex<float>(static_cast<float>(frame_no*1000 + line_no*100 + sample_no),
+                               -static_cast<float>(sample_no));
+}
+
+std::vector<std::complex<float>> test_frame(size_t frame_no, size_t num_lines, size_t num_samples, size_t line_stride) {
+    std::vector<std::complex<float>> buffer(num_lines*line_stride);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+            buffer[line_no*line_stride + sample_no] = test_sample(frame_no, line_no, sample_no);
+        }
+    }
+    return buffer;
+}
+
+void check_frame(const bcsim::SharedIqRingReader::FrameView& view, size_t frame_no, size_t num_lines, size_t num_samples) {
+    const auto samples = static_cast<const std::complex<float>*>(view.samples);
+    for (size_t line_no = 0; line_no < num_lines; line_no++) {
+        for (size_t sample_no = 0; sample_no < num_samples; sample_no++) {
+            BOOST_REQUIRE(samples[line_no*num_samples + sample_no] == test_sample(frame_no, line_no, sample_no));
+        }
+    }
+}
+}
+
+BOOST_AUTO_TEST_CASE(verify_oldest_frames_are_overwritten) {
+    const size_t num_lines = 3;
+    const size_t num_samples = 5;
+    const size_t line_stride = 7;
+    bcsim::SharedIqRingWriter writer(ring_name, num_lines, num_samples, 4);
+    bcsim::SharedIqRingReader reader(ring_name);
+    BOOST_CHECK_EQUAL(reader.get_num_lines(), num_lines);
+    BOOST_CHECK_EQUAL(reader.get_num_samples(), num_samples);
+    BOOST_CHECK_EQUAL(reader.get_capacity(), 4u);
+    BOOST_CHECK(reader.get_sample_type() == bcsim::IqOutputFormat::SampleType::COMPLEX_FLOAT32);
+    BOOST_CHECK_EQUAL(reader.get_end_frame_no(), 0u);
+
+    for (size_t frame_no = 0; frame_no < 10; frame_no++) {
+        writer.write(test_frame(frame_no, num_lines, num_samples, line_stride).data(), line_stride, 0.5f*frame_no);
+    }
+    BOOST_CHECK_EQUAL(reader.get_end_frame_no(), 10u);
+    bcsim::SharedIqRingReader::FrameView view;
+    BOOST_CHECK(!reader.map_frame(5, view));
+    BOOST_CHECK(!reader.map_frame(10, view));
+    for (size_t frame_no = 6; frame_no < 10; frame_no++) {
+        BOOST_REQUIRE(reader.map_frame(frame_no, view));
+        check_frame(view, frame_no, num_lines, num_samples);
+        BOOST_CHECK_EQUAL(view.timestamp, 0.5f*frame_no);
+        BOOST_CHECK(reader.is_valid(view));
+    }
+
+    // a mapped frame which is overwritten while it is read is detected
+    BOOST_REQUIRE(reader.map_frame(6, view));
+    writer.begin_frame();
+    BOOST_CHECK(!reader.is_valid(view));
+    BOOST_CHECK(!reader.map_frame(6, view));
+    writer.commit_frame(5.0f);
+    BOOST_CHECK(!reader.is_valid(view));
+    BOOST_CHECK(reader.map_frame(10, view));
+    BOOST_CHECK_EQUAL(view.timestamp, 5.0f);
+}
+
+BOOST_AUTO_TEST_CASE(verify_writer_waits_for_consumer) {
+    const size_t num_lines = 2;
+    const size_t num_samples = 64;
+    const size_t num_frames = 200;
+    bcsim::SharedIqRingWriter writer(ring_name, num_lines, num_samples, 3, bcsim::IqOutputFormat(), false, 5000);
+    bcsim::SharedIqRingReader reader(ring_name);
+
+    std::thread producer([&]() {
+        for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+            writer.write(test_frame(frame_no, num_lines, num_samples, num_samples).data(), num_samples, 1.0f*frame_no);
+        }
+    });
+    // no frame is overwritten, so every frame is read in order
+    bcsim::SharedIqRingReader::FrameView view;
+    for (size_t frame_no = 0; frame_no < num_frames; frame_no++) {
+        BOOST_REQUIRE(reader.wait_for_frame(frame_no, 5000));
+        BOOST_REQUIRE(reader.map_frame(frame_no, view));
+        check_frame(view, frame_no, num_lines, num_samples);
+        BOOST_REQUIRE(reader.is_valid(view));
+        reader.release_frames(frame_no + 1);
+    }
+    producer.join();
+    BOOST_CHECK(!reader.wait_for_frame(num_frames, 1));
+}
+
+BOOST_AUTO_TEST_CASE(verify_full_ring_times_out) {
+    bcsim::SharedIqRingWriter writer(ring_name, 1, 4, 2, bcsim::IqOutputFormat(), false, 10);
+    std::vector<std::complex<float>> frame(4);
+    writer.write(frame.data(), 4, 0.0f);
+    writer.write(frame.data(), 4, 0.0f);
+    BOOST_CHECK_THROW(writer.write(frame.data(), 4, 0.0f), std::runtime_error);
+    bcsim::SharedIqRingReader reader(ring_name);
+    reader.release_frames(1);
+    BOOST_CHECK_NO_THROW(writer.write(frame.data(), 4, 0.0f));
+    BOOST_CHECK_EQUAL(reader.get_end_frame_no(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(verify_int16_frames_and_closing) {
+    bcsim::IqOutputFormat format;
+    format.sample_type = bcsim::IqOutputFormat::SampleType::COMPLEX_INT16;
+    std::unique_ptr<bcsim::SharedIqRingReader> reader;
+    {
+        bcsim::SharedIqRingWriter writer(ring_name, 2, 3, 2, format);
+        reader.reset(new bcsim::SharedIqRingReader(ring_name));
+        writer.write(test_frame(1, 2, 3, 3).data(), 3, 0.0f);
+        BOOST_CHECK(!reader->is_closed());
+    }
+    // the mapping outlives the writer and its name
+    BOOST_CHECK(reader->is_closed());
+    BOOST_CHECK_THROW(bcsim::SharedIqRingReader{ring_name}, std::runtime_error);
+    bcsim::SharedIqRingReader::FrameView view;
+    BOOST_REQUIRE(reader->map_frame(0, view));
+    BOOST_CHECK_CLOSE(view.scale, 32767.0f/1102.0f, 1e-4);
+    const auto samples = static_cast<const int16_t*>(view.samples);
+    BOOST_CHECK_EQUAL(samples[2*5], 32767);
+    BOOST_CHECK_EQUAL(samples[2*5 + 1], bcsim::quantize_int16(-2.0f, view.scale));
+}
+
+BOOST_AUTO_TEST_CASE(verify_invalid_rings_fail) {
+    BOOST_CHECK_THROW(bcsim::SharedIqRingWriter(ring_name, 0, 4, 2), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::SharedIqRingWriter(ring_name, 1, 4, 0), std::runtime_error);
+    BOOST_CHECK_THROW(bcsim::SharedIqRingReader("/bcsim_test_ring_missing"), std::runtime_error);
+    bcsim::SharedIqRingWriter writer(ring_name, 1, 4, 1);
+    BOOST_CHECK_THROW(writer.commit_frame(0.0f), std::runtime_error);
+}
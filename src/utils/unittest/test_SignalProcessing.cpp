@@ -1,5 +1,8 @@
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Test_SignalProcessing
+#include <complex>
+#include <random>
+#include <vector>
 #include <boost/test/unit_test.hpp>
 #include "../SignalProcessing.hpp"
 
@@ -25,3 +28,62 @@ BOOST_AUTO_TEST_CASE(SanityCheck_DirectConvolution2) {
         BOOST_REQUIRE(desired_res[i] == v[i]);
     }
 }
+
+BOOST_AUTO_TEST_CASE(OverlapSaveMatchesDirectConvolution) {
+    std::mt19937 gen(0);
+    std::normal_distribution<double> dist;
+    for (size_t n : {1, 7, 300, 1000}) {
+        for (size_t m : {1, 5, 130, 257}) {
+            std::vector<double> v1(n), v2(m);
+            for (auto& v : v1) v = dist(gen);
+            for (auto& v : v2) v = dist(gen);
+            const auto desired_res = direct_conv(v1, v2);
+            for (const auto& v : {overlap_save_conv(v1, v2), overlap_save_conv(v2, v1), conv(v1, v2)}) {
+                BOOST_REQUIRE_EQUAL(v.size(), desired_res.size());
+                for (size_t i = 0; i < v.size(); i++) {
+                    BOOST_REQUIRE_SMALL(v[i] - desired_res[i], 1e-9);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(FilterLinesKeepsCenteredConvolution) {
+    const size_t num_lines = 5;
+    const size_t num_samples = 400;
+    const size_t line_stride = 410;
+    std::mt19937 gen(1);
+    std::normal_distribution<float> dist;
+    std::vector<std::complex<float>> lines(num_lines*line_stride);
+    for (auto& z : lines) z = std::complex<float>(dist(gen), dist(gen));
+
+    // both the direct and the overlap-save path
+    for (int filter_length : {31, 201}) {
+        const auto filter = FirWin(filter_length, 0.1f);
+        std::vector<std::complex<float>> filtered(num_lines*num_samples);
+        filter_lines(lines.data(), num_lines, num_samples, line_stride, filter, filtered.data());
+
+        auto in_place = lines;
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            std::copy(lines.begin() + line_no*line_stride, lines.begin() + line_no*line_stride + num_samples,
+                      in_place.begin() + line_no*num_samples);
+        }
+        filter_lines(in_place.data(), num_lines, num_samples, num_samples, filter, in_place.data());
+
+        const size_t delay = (filter_length-1)/2;
+        for (size_t line_no = 0; line_no < num_lines; line_no++) {
+            std::vector<float> re(num_samples), im(num_samples);
+            for (size_t i = 0; i < num_samples; i++) {
+                re[i] = lines[line_no*line_stride + i].real();
+                im[i] = lines[line_no*line_stride + i].imag();
+            }
+            const auto re_conv = direct_conv(re, filter);
+            const auto im_conv = direct_conv(im, filter);
+            for (size_t i = 0; i < num_samples; i++) {
+                const std::complex<float> desired(re_conv[i + delay], im_conv[i + delay]);
+                BOOST_REQUIRE_SMALL(std::abs(filtered[line_no*num_samples + i] - desired), 1e-5f);
+                BOOST_REQUIRE_SMALL(std::abs(in_place[line_no*num_samples + i] - desired), 1e-5f);
+            }
+        }
+    }
+}
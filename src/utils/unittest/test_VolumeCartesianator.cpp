@@ -0,0 +1,216 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Test_VolumeCartesianator
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <boost/test/unit_test.hpp>
+#include "../cartesianator/VolumeCartesianator.hpp"
+
+namespace {
+
+// Beam space volume with value f(range, lateral, elevational) at each sample,
+// where lateral and elevational are beam positions or angles.
+template <typename F>
+std::vector<float> make_volume(int num_lat, int num_ele, int num_samples,
+                               float r_min, float r_max, float lat_min, float lat_max,
+                               float ele_min, float ele_max, F f) {
+    std::vector<float> volume(num_lat*num_ele*num_samples);
+    for (int ei = 0; ei < num_ele; ei++) {
+        for (int li = 0; li < num_lat; li++) {
+            for (int ri = 0; ri < num_samples; ri++) {
+                const float r   = r_min + ri*(r_max-r_min)/(num_samples-1);
+                const float lat = lat_min + li*(lat_max-lat_min)/(num_lat-1);
+                const float ele = ele_min + ei*(ele_max-ele_min)/(num_ele-1);
+                volume[num_samples*(num_lat*ei + li) + ri] = f(r, lat, ele);
+            }
+        }
+    }
+    return volume;
+}
+
+std::shared_ptr<bcsim::Linear3DScanGeometry> make_linear_geometry() {
+    auto geometry = std::make_shared<bcsim::Linear3DScanGeometry>();
+    geometry->width_lateral = 0.04f;
+    geometry->width_elevational = 0.02f;
+    geometry->range_max = 0.06f;
+    return geometry;
+}
+
+std::shared_ptr<bcsim::PyramidScanGeometry> make_pyramid_geometry() {
+    auto geometry = std::make_shared<bcsim::PyramidScanGeometry>();
+    geometry->width_lateral = 1.2f;
+    geometry->width_elevational = 0.8f;
+    geometry->depth = 0.1f;
+    geometry->tilt_lateral = 0.0f;
+    geometry->tilt_elevational = 0.0f;
+    return geometry;
+}
+
+float linear_function(float x, float y, float z) {
+    return 3.0f + 20.0f*x - 40.0f*y + 50.0f*z;
+}
+
+}   // end anonymous namespace
+
+// Trilinear interpolation is exact for a function linear in x, y and z.
+BOOST_AUTO_TEST_CASE(LinearGeometryReproducesLinearFunction) {
+    auto geometry = make_linear_geometry();
+    const int num_lat = 17, num_ele = 9, num_samples = 33;
+    const auto volume = make_volume(num_lat, num_ele, num_samples, 0.0f, 0.06f, -0.02f, 0.02f, -0.01f, 0.01f,
+                                    [](float r, float lat, float ele) { return linear_function(lat, ele, r); });
+
+    CpuVolumeCartesianator<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(11, 7, 13);
+    cartesianator.Process(volume.data(), num_lat, num_ele, num_samples);
+
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+    cartesianator.GetOutputExtent(x_min, x_max, y_min, y_max, z_min, z_max);
+    BOOST_CHECK_CLOSE(x_max - x_min, 0.04f, 1e-3);
+    BOOST_CHECK_CLOSE(z_max - z_min, 0.06f, 1e-3);
+    const auto output = cartesianator.GetOutputBuffer();
+    for (size_t zi = 0; zi < 13; zi++) {
+        for (size_t yi = 0; yi < 7; yi++) {
+            for (size_t xi = 0; xi < 11; xi++) {
+                const float x = x_min + xi*(x_max-x_min)/10;
+                const float y = y_min + yi*(y_max-y_min)/6;
+                const float z = z_min + zi*(z_max-z_min)/12;
+                BOOST_CHECK_SMALL(output[11*(7*zi + yi) + xi] - linear_function(x, y, z), 1e-4f);
+            }
+        }
+    }
+}
+
+// With range as input value the output is the distance to the origin
+// inside of the pyramid and zero outside of it.
+BOOST_AUTO_TEST_CASE(PyramidGeometryMapsRange) {
+    auto geometry = make_pyramid_geometry();
+    const int num_lat = 32, num_ele = 24, num_samples = 200;
+    const auto volume = make_volume(num_lat, num_ele, num_samples, 0.0f, 0.1f, -0.6f, 0.6f, -0.4f, 0.4f,
+                                    [](float r, float, float) { return r; });
+
+    CpuVolumeCartesianator<float> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    const size_t n = 21;
+    cartesianator.SetOutputSize(n, n, n);
+    cartesianator.Process(volume.data(), num_lat, num_ele, num_samples);
+
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+    cartesianator.GetOutputExtent(x_min, x_max, y_min, y_max, z_min, z_max);
+    BOOST_CHECK_CLOSE(x_max, 0.1f*std::sin(0.6f), 1e-3);
+    BOOST_CHECK_CLOSE(y_min, -0.1f*std::sin(0.4f), 1e-3);
+
+    const auto output = cartesianator.GetOutputBuffer();
+    int num_inside = 0;
+    for (size_t zi = 0; zi < n; zi++) {
+        for (size_t yi = 0; yi < n; yi++) {
+            for (size_t xi = 0; xi < n; xi++) {
+                const float x = x_min + xi*(x_max-x_min)/(n-1);
+                const float y = y_min + yi*(y_max-y_min)/(n-1);
+                const float z = z_min + zi*(z_max-z_min)/(n-1);
+                const float r = std::sqrt(x*x + y*y + z*z);
+                const float lat = std::atan2(x, z);
+                const float ele = std::asin(r > 0.0f ? y/r : 0.0f);
+                const float value = output[n*(n*zi + yi) + xi];
+                const float margin = 1e-3f;
+                if (r < 0.1f - margin && std::abs(lat) < 0.6f - margin && std::abs(ele) < 0.4f - margin) {
+                    BOOST_CHECK_SMALL(value - r, 1e-5f);
+                    num_inside++;
+                } else if (r > 0.1f + margin || std::abs(lat) > 0.6f + margin || std::abs(ele) > 0.4f + margin) {
+                    BOOST_CHECK_EQUAL(value, 0.0f);
+                }
+            }
+        }
+    }
+    BOOST_CHECK(num_inside > 0);
+}
+
+// An oblique plane sampled directly from beam space.
+BOOST_AUTO_TEST_CASE(SlicerSamplesObliquePlane) {
+    auto geometry = make_linear_geometry();
+    const int num_lat = 17, num_ele = 9, num_samples = 33;
+    const auto volume = make_volume(num_lat, num_ele, num_samples, 0.0f, 0.06f, -0.02f, 0.02f, -0.01f, 0.01f,
+                                    [](float r, float lat, float ele) { return linear_function(lat, ele, r); });
+
+    CpuVolumeSlicer<float> slicer;
+    slicer.SetGeometry(geometry);
+    const bcsim::vector3 center(0.0f, 0.0f, 0.03f);
+    const bcsim::vector3 u_dir(1.0f, 1.0f, 0.0f);
+    const bcsim::vector3 v_dir(0.0f, 0.0f, 2.0f);
+    slicer.SetPlane(center, u_dir, v_dir, 0.02f, 0.04f);
+    slicer.SetOutputSize(9, 5);
+    slicer.Process(volume.data(), num_lat, num_ele, num_samples);
+
+    const auto output = slicer.GetOutputBuffer();
+    const float s = 1.0f/std::sqrt(2.0f);
+    for (size_t vi = 0; vi < 5; vi++) {
+        for (size_t ui = 0; ui < 9; ui++) {
+            const float u = -0.01f + ui*0.02f/8;
+            const float v = -0.02f + vi*0.04f/4;
+            const float x = center.x + s*u;
+            const float y = center.y + s*u;
+            const float z = center.z + v;
+            BOOST_CHECK_SMALL(output[9*vi + ui] - linear_function(x, y, z), 1e-4f);
+        }
+    }
+
+    // Moving the plane outside of the volume gives an empty slice.
+    slicer.SetPlane(bcsim::vector3(0.0f, 0.0f, 0.2f), u_dir, v_dir, 0.02f, 0.04f);
+    slicer.Process(volume.data(), num_lat, num_ele, num_samples);
+    for (size_t i = 0; i < 9*5; i++) {
+        BOOST_CHECK_EQUAL(slicer.GetOutputBuffer()[i], 0.0f);
+    }
+}
+
+// An axis-aligned slice through a voxel layer equals that layer.
+BOOST_AUTO_TEST_CASE(SlicerMatchesVoxelLayer) {
+    auto geometry = make_pyramid_geometry();
+    const int num_lat = 16, num_ele = 12, num_samples = 64;
+    const auto volume = make_volume(num_lat, num_ele, num_samples, 0.0f, 0.1f, -0.6f, 0.6f, -0.4f, 0.4f,
+                                    [](float r, float lat, float ele) { return r*(1.0f + lat*lat) + ele; });
+    std::vector<unsigned char> bytes(volume.size());
+    for (size_t i = 0; i < volume.size(); i++) {
+        bytes[i] = static_cast<unsigned char>(std::fmod(1000.0f*std::abs(volume[i]), 255.0f));
+    }
+
+    const size_t n = 16;
+    CpuVolumeCartesianator<unsigned char> cartesianator;
+    cartesianator.SetGeometry(geometry);
+    cartesianator.SetOutputSize(n, n, n);
+    cartesianator.Process(bytes.data(), num_lat, num_ele, num_samples);
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+    cartesianator.GetOutputExtent(x_min, x_max, y_min, y_max, z_min, z_max);
+
+    const size_t zi = 11;
+    const float z = z_min + zi*(z_max-z_min)/(n-1);
+    CpuVolumeSlicer<unsigned char> slicer;
+    slicer.SetGeometry(geometry);
+    slicer.SetPlane(bcsim::vector3(0.5f*(x_min+x_max), 0.5f*(y_min+y_max), z),
+                    bcsim::vector3(1.0f, 0.0f, 0.0f), bcsim::vector3(0.0f, 1.0f, 0.0f),
+                    x_max-x_min, y_max-y_min);
+    slicer.SetOutputSize(n, n);
+    slicer.Process(bytes.data(), num_lat, num_ele, num_samples);
+
+    int num_different = 0;
+    for (size_t i = 0; i < n*n; i++) {
+        const int diff = std::abs(static_cast<int>(slicer.GetOutputBuffer()[i])
+                                  - static_cast<int>(cartesianator.GetOutputBuffer()[n*n*zi + i]));
+        BOOST_CHECK(diff <= 1);
+        if (diff != 0) num_different++;
+    }
+    BOOST_CHECK(num_different < static_cast<int>(n));
+}
+
+BOOST_AUTO_TEST_CASE(InvalidInputIsRejected) {
+    std::vector<float> volume(2*2*2);
+    CpuVolumeCartesianator<float> cartesianator;
+    BOOST_CHECK_THROW(cartesianator.Process(volume.data(), 2, 2, 2), std::runtime_error);
+    BOOST_CHECK_THROW(cartesianator.SetOutputSize(1, 4, 4), std::runtime_error);
+    cartesianator.SetGeometry(make_linear_geometry());
+    BOOST_CHECK_THROW(cartesianator.Process(volume.data(), 1, 4, 2), std::runtime_error);
+
+    CpuVolumeSlicer<float> slicer;
+    const bcsim::vector3 u_dir(1.0f, 0.0f, 0.0f);
+    BOOST_CHECK_THROW(slicer.SetPlane(bcsim::vector3(), u_dir, u_dir*2.0f, 0.01f, 0.01f), std::runtime_error);
+    BOOST_CHECK_THROW(slicer.SetPlane(bcsim::vector3(), u_dir, bcsim::vector3(), 0.01f, 0.01f), std::runtime_error);
+}
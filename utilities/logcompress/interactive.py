@@ -48,10 +48,14 @@ if __name__ == "__main__":
         # generate random values
         img_data = np.random.uniform(low=0.0, high=1.0, size=((300, 300)))
     else:
-        with h5py.File(args.h5_iq) as f_in:
-            iq_data = f_in["iq_real"].value + 1.0J*f_in["iq_imag"].value
         frame_no = 0
-        iq_frame = iq_data[frame_no, :, :]
+        with h5py.File(args.h5_iq) as f_in:
+            if "iq" in f_in:
+                # written by HdfIqRecorder, read by h5py as complex64
+                iq_frame = f_in["iq"][frame_no, :, :]
+            else:
+                iq_data = f_in["iq_real"].value + 1.0J*f_in["iq_imag"].value
+                iq_frame = iq_data[frame_no, :, :]
         env_frame = np.real(abs(iq_frame))
         min_val = np.min(env_frame.flatten())
         max_val = np.max(env_frame.flatten())